@@ -0,0 +1,57 @@
+# This script is executed by the benchmark targets.
+# Each project is run by a separate process so that the peak memory usage of a project
+# is not affected by the other projects. The results are merged into the OUTPUT file.
+# BENCHMARK_OPTION is the option which takes the result file of a project, and OPTIONS
+# are the other options given to all the projects. The lists are separated by "|".
+# When FAILURE_PATTERN is given, the script fails after writing the OUTPUT file if the result
+# of any project contains the pattern.
+
+string(REPLACE "|" ";" PROJECTS "${PROJECTS}")
+string(REPLACE "|" ";" OPTIONS "${OPTIONS}")
+
+# Run without showing the windows
+set(ENV{QT_QPA_PLATFORM} offscreen)
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+set(results "")
+set(failed_projects "")
+
+foreach(project ${PROJECTS})
+  get_filename_component(name ${project} NAME_WE)
+  set(result_file ${WORK_DIR}/${name}.json)
+  file(REMOVE ${result_file})
+
+  message(STATUS "Running ${name}")
+  execute_process(
+    COMMAND ${CHOREONOID} ${project} ${BENCHMARK_OPTION} ${result_file} ${OPTIONS} --quit
+    RESULT_VARIABLE status
+    OUTPUT_QUIET ERROR_QUIET)
+
+  if(status EQUAL 0 AND EXISTS ${result_file})
+    file(READ ${result_file} result)
+    string(STRIP "${result}" result)
+  else()
+    set(result "{\n  \"project\": \"${project}\",\n  \"error\": \"The process exited with status ${status}.\"\n}")
+    message(WARNING "The benchmark of ${name} failed with status ${status}")
+  endif()
+
+  if(FAILURE_PATTERN)
+    string(FIND "${result}" "${FAILURE_PATTERN}" failure_position)
+    if(NOT failure_position EQUAL -1)
+      list(APPEND failed_projects ${name})
+    endif()
+  endif()
+
+  if(results)
+    set(results "${results},\n")
+  endif()
+  set(results "${results}${result}")
+endforeach()
+
+file(WRITE ${OUTPUT} "[\n${results}\n]\n")
+message(STATUS "The benchmark results have been written to ${OUTPUT}")
+
+if(failed_projects)
+  message(FATAL_ERROR "The results of ${failed_projects} contain \"${FAILURE_PATTERN}\"")
+endif()
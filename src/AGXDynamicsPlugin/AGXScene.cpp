@@ -1,5 +1,6 @@
 #include "AGXScene.h"
 #include <agx/version.h>
+#include <agx/Statistics.h>
 
 namespace cnoid{
 
@@ -146,6 +147,17 @@ bool AGXScene::saveSceneToAGXFile()
     return true;
 }
 
+void AGXScene::setStatisticsEnabled(bool on)
+{
+    getSimulation()->setEnableStatistics(on);
+}
+
+double AGXScene::getLastStepTime(const agx::String& module, const agx::String& data) const
+{
+    // AGX gives the times in milliseconds
+    return agx::Statistics::instance()->getTimingInfo(module, data).current * 1.0e-3;
+}
+
 agxSDK::SimulationRef AGXScene::getSimulation() const
 {
     return _agxSimulation;
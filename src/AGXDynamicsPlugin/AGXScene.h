@@ -38,6 +38,9 @@ public:
     bool getEnableAutoSleep() const;
     void setEnableAutoSleep(const bool& bOn);
     bool saveSceneToAGXFile();
+    void setStatisticsEnabled(bool on);
+    // The time of the last step in seconds. The statistics must be enabled.
+    double getLastStepTime(const agx::String& module, const agx::String& data) const;
 
 private:
     agxSDK::SimulationRef _agxSimulation;
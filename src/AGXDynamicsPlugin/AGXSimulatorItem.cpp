@@ -123,6 +123,16 @@ void AGXSimulatorItem::restartSimulation()
     SimulatorItem::restartSimulation();
 }
 
+void AGXSimulatorItem::getProfilingNames(std::vector<std::string>& profilingNames)
+{
+    impl->getProfilingNames(profilingNames);
+}
+
+void AGXSimulatorItem::getProfilingTimes(std::vector<double>& profilingTimes)
+{
+    impl->getProfilingTimes(profilingTimes);
+}
+
 
 
 
@@ -19,6 +19,7 @@ public:
     bool saveSimulationToAGXFile();
 
     virtual Vector3 getGravity() const override;
+    //! Zero lets the simulator determine the number from the movable bodies of the world
     void setNumThreads(unsigned int num);
     void setEnableContactReduction(bool bOn);
     void setContactReductionBinResolution(int r);
@@ -40,7 +41,8 @@ protected:
     virtual void stopSimulation();
     virtual void pauseSimulation();
     virtual void restartSimulation();
-
+    virtual void getProfilingNames(std::vector<std::string>& profilingNames) override;
+    virtual void getProfilingTimes(std::vector<double>& profilingTimes) override;
 
 private:
     AGXSimulatorItemImplPtr impl;
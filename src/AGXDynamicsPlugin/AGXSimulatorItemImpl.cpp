@@ -5,6 +5,8 @@
 #include <cnoid/MaterialTable>
 #include "AGXConvert.h"
 #include <unordered_map>
+#include <thread>
+#include <algorithm>
 #include <cnoid/Archive>
 #include <cnoid/EigenArchive>
 #include "gettext.h"
@@ -86,12 +88,18 @@ AGXSimulatorItemImpl::AGXSimulatorItemImpl(AGXSimulatorItem* self, const AGXSimu
 
 AGXSimulatorItemImpl::~AGXSimulatorItemImpl(){}
 
-void AGXSimulatorItemImpl::initialize(){}
+void AGXSimulatorItemImpl::initialize()
+{
+    numAutoThreads = 0;
+    numActiveBodies = 0;
+    isProfilingEnabled = false;
+}
 
 void AGXSimulatorItemImpl::doPutProperties(PutPropertyFunction & putProperty)
 {
     putProperty(_("Gravity"), str(m_p_gravity), [&](const string& value){ return toVector3(value, m_p_gravity); });
-    putProperty(_("NumThreads"), m_p_numThreads, changeProperty(m_p_numThreads));
+    // Zero means that the number is determined from the bodies of the world
+    putProperty.min(0)(_("NumThreads"), m_p_numThreads, changeProperty(m_p_numThreads));
     putProperty(_("ContactReduction"), m_p_enableContactReduction, changeProperty(m_p_enableContactReduction));
     putProperty(_("ContactReductionBinResolution"), m_p_contactReductionBinResolution, changeProperty(m_p_contactReductionBinResolution));
     putProperty(_("ContactReductionThreshhold"), m_p_contactReductionThreshhold, changeProperty(m_p_contactReductionThreshhold));
@@ -145,7 +153,15 @@ bool AGXSimulatorItemImpl::initializeSimulation(const std::vector<SimulationBody
     AGXSceneDesc sd;
     sd.simdesc.timeStep = self->worldTimeStep();
     sd.simdesc.gravity = agx::Vec3(g(0), g(1), g(2));
-    sd.simdesc.numThreads = m_p_numThreads;
+    if(m_p_numThreads > 0){
+        sd.simdesc.numThreads = m_p_numThreads;
+        numAutoThreads = 0;
+    } else {
+        numActiveBodies = simBodies.size();
+        numAutoThreads = calcAutoNumThreads(simBodies);
+        sd.simdesc.numThreads = numAutoThreads;
+        LOGGER_INFO() << "AGXDynamicsPlugin:INFO " << "number of threads " << numAutoThreads << LOGGER_ENDL();
+    }
     sd.simdesc.enableContactReduction = m_p_enableContactReduction;
     sd.simdesc.contactReductionBinResolution = (agx::UInt8)m_p_contactReductionBinResolution;
     sd.simdesc.contactReductionThreshhold = (agx::UInt8)m_p_contactReductionThreshhold;
@@ -153,6 +169,8 @@ bool AGXSimulatorItemImpl::initializeSimulation(const std::vector<SimulationBody
     sd.simdesc.enableContactWarmstarting = m_p_enableContactWarmstarting;
     sd.simdesc.enableAutoSleep = m_p_enableAutoSleep;
     agxScene = AGXScene::create(sd);
+    isProfilingEnabled = self->isProfilingEnabled();
+    agxScene->setStatisticsEnabled(isProfilingEnabled);
     const agx::Notify::NotifyLevel notifyLevel = agxNotifyLevel.at(m_p_debugMessageOnConsoleType.selectedSymbol());
     agx::Notify::instance()->setNotifyLevel(notifyLevel);
     //agx::Notify::instance()->setLogNotifyLevel(notifyLevel);
@@ -311,14 +329,27 @@ bool AGXSimulatorItemImpl::stepSimulation(const std::vector<SimulationBody*>& ac
     // Need to set NotifyLevel for each thread.
     agx::Notify::instance()->setNotifyLevel(agxNotifyLevel.at(m_p_debugMessageOnConsoleType.selectedSymbol()));
 
+    // Bodies may be added or removed during the simulation
+    if(numAutoThreads > 0 && (int)activeSimBodies.size() != numActiveBodies){
+        numActiveBodies = activeSimBodies.size();
+        int n = calcAutoNumThreads(activeSimBodies);
+        if(n != numAutoThreads){
+            numAutoThreads = n;
+            agx::setNumThreads(n);
+        }
+    }
+
+    if(isProfilingEnabled) inputTimer.begin();
     for(auto simBody : activeSimBodies){
         auto const agxBody = dynamic_cast<AGXBody*>(simBody);
         agxBody->setControlInputToAGX();
         agxBody->addForceTorqueToAGX();
     }
+    if(isProfilingEnabled) inputTimer.end();
 
     agxScene->stepSimulation();
 
+    if(isProfilingEnabled) outputTimer.begin();
     for(auto simBody : activeSimBodies){
         auto const agxBody = dynamic_cast<AGXBody*>(simBody);
         agxBody->setLinkStateToCnoid();
@@ -327,9 +358,50 @@ bool AGXSimulatorItemImpl::stepSimulation(const std::vector<SimulationBody*>& ac
         if(agxBody->hasForceSensors())              agxBody->updateForceSensors();
         if(agxBody->hasGyroOrAccelerationSensors()) agxBody->updateGyroAndAccelerationSensors();
     }
+    if(isProfilingEnabled) outputTimer.end();
+
     return true;
 }
 
+/**
+   Each thread of AGX mainly processes the partitions of the interacting bodies, so more threads
+   than the movable bodies do not speed up the step. The static bodies are excluded for the same
+   reason.
+*/
+int AGXSimulatorItemImpl::calcAutoNumThreads(const std::vector<SimulationBody*>& simBodies) const
+{
+    int numMovableBodies = 0;
+    for(auto simBody : simBodies){
+        if(!simBody->body()->isStaticModel()){
+            ++numMovableBodies;
+        }
+    }
+    int numCores = std::max(1, (int)std::thread::hardware_concurrency());
+    return std::max(1, std::min(numMovableBodies, numCores));
+}
+
+void AGXSimulatorItemImpl::getProfilingNames(vector<string>& profilingNames)
+{
+    profilingNames.push_back("AGX collision detection time");
+    profilingNames.push_back("AGX dynamics system time");
+    profilingNames.push_back("AGX step forward time");
+    profilingNames.push_back("Control input time");
+    profilingNames.push_back("State output time");
+}
+
+void AGXSimulatorItemImpl::getProfilingTimes(vector<double>& profilingTimes)
+{
+    if(!agxScene){
+        profilingTimes.resize(profilingTimes.size() + 5, 0.0);
+        return;
+    }
+    profilingTimes.push_back(agxScene->getLastStepTime("Simulation", "Collision-detection time"));
+    profilingTimes.push_back(agxScene->getLastStepTime("Simulation", "Dynamics-system time"));
+    profilingTimes.push_back(agxScene->getLastStepTime("Simulation", "Step forward time"));
+    profilingTimes.push_back(inputTimer.time());
+    profilingTimes.push_back(outputTimer.time());
+}
+
 void AGXSimulatorItemImpl::stopSimulation()
 {
     //cout << "stopSimulation" << endl;
@@ -4,6 +4,7 @@
 #include <cnoid/SimulatorItem>
 #include "AGXScene.h"
 #include "AGXBody.h"
+#include <cnoid/TimeMeasure>
 #include <iostream>
 
 namespace cnoid {
@@ -42,6 +43,8 @@ public:
     void setEnableContactWarmstarting(bool bOn);
     void setEnableAMOR(bool bOn);
     bool saveSimulationToAGXFile();
+    void getProfilingNames(std::vector<std::string>& profilingNames);
+    void getProfilingTimes(std::vector<double>& profilingTimes);
 
 private:
     ref_ptr<AGXSimulatorItem> self;
@@ -56,7 +59,13 @@ private:
     bool    m_p_enableAutoSleep;
     bool    m_p_saveToAGXFileOnStart;
     Selection m_p_debugMessageOnConsoleType;
+    int     numAutoThreads;
+    int     numActiveBodies;
+    bool    isProfilingEnabled;
+    TimeMeasure inputTimer;
+    TimeMeasure outputTimer;
     AGXScene* getAGXScene();
+    int calcAutoNumThreads(const std::vector<SimulationBody*>& simBodies) const;
 };
 }
 #endif
\ No newline at end of file
@@ -5,19 +5,28 @@
 
 #include "AISTCollisionDetector.h"
 #include "ColdetModelPair.h"
+#include "PrimitiveCollision.h"
 #include <cnoid/IdPair>
 #include <cnoid/SceneDrawables>
 #include <cnoid/MeshExtractor>
 #include <cnoid/ThreadPool>
-#include <random>
+#include <chrono>
 #include <set>
+#include <unordered_map>
 
 using namespace std;
 using namespace cnoid;
 
 namespace {
 
-const bool ENABLE_SHUFFLE = false;
+// The bounding boxes of the broad phase are expanded by this margin [m]
+const double BROAD_PHASE_MARGIN = 1.0e-4;
+
+// The distance queries fewer than this number are computed in the calling thread
+const int MIN_NUM_PARALLEL_DISTANCE_QUERIES = 8;
+
+// The number of the consecutive rays which are culled by the bounding boxes together
+const int RAY_PACKET_SIZE = 64;
 
 typedef CollisionDetector::GeometryHandle GeometryHandle;
 
@@ -41,10 +50,90 @@ class ColdetModelEx : public ColdetModel
 public:
     ReferencedPtr object;
     bool isStatic;
+    bool isResting;
+    uint32_t collisionCategory;
+    uint32_t collisionMask;
     boost::optional<Position> localPosition;
     ColdetModelExPtr sibling;
+    int index;
+
+    /*
+      The following members are used for the top model of a geometry.
+      isMoved is true when the geometry has moved beyond the tolerance since the last detection.
+    */
+    bool isMoved;
+    Position referencePosition;
+
+    // The axis-aligned bounding box of the vertices in the local coordinate
+    Vector3 localBoxCenter;
+    Vector3 localBoxExtents;
+
+    /*
+      The shape of the geometry when it consists of a single primitive, which is used
+      instead of the triangles for the pairs with the other primitives.
+    */
+    CollisionPrimitive primitive;
+    Position position;
     
-    ColdetModelEx() : isStatic(false) { }
+    ColdetModelEx()
+        : isStatic(false), isResting(false), collisionCategory(1), collisionMask(~0u), index(-1), isMoved(true) {
+        referencePosition.setIdentity();
+        position.setIdentity();
+    }
+
+    //! The internal model including the tree is shared with the original model
+    ColdetModelEx(const ColdetModelEx& org)
+        : ColdetModel(org),
+          isStatic(false),
+          isResting(false),
+          collisionCategory(1),
+          collisionMask(~0u),
+          index(-1),
+          isMoved(true),
+          localBoxCenter(org.localBoxCenter),
+          localBoxExtents(org.localBoxExtents),
+          primitive(org.primitive) {
+        referencePosition.setIdentity();
+        position.setIdentity();
+    }
+
+    void shareModel(const ColdetModelEx& org){
+        shareInternalModel(org);
+        localBoxCenter = org.localBoxCenter;
+        localBoxExtents = org.localBoxExtents;
+    }
+
+    void updateLocalBox(){
+        Vector3 minPos = Vector3::Constant(std::numeric_limits<double>::max());
+        Vector3 maxPos = -minPos;
+        const int n = getNumVertices();
+        for(int i=0; i < n; ++i){
+            float x, y, z;
+            getVertex(i, x, y, z);
+            const Vector3 v(x, y, z);
+            minPos = minPos.cwiseMin(v);
+            maxPos = maxPos.cwiseMax(v);
+        }
+        if(primitive.type != CollisionPrimitive::NONE){
+            Vector3 center, extents;
+            primitive.getLocalBox(center, extents);
+            minPos = minPos.cwiseMin(center - extents);
+            maxPos = maxPos.cwiseMax(center + extents);
+        }
+        localBoxCenter = (minPos + maxPos) / 2.0;
+        localBoxExtents = (maxPos - minPos) / 2.0;
+    }
+
+    void setPosition(const Position& T){
+        ColdetModel::setPosition(T);
+        position = T;
+    }
+
+    bool isStaticOrResting() const { return isStatic || isResting; }
+
+    bool isCollisionFilteredWith(const ColdetModelEx* model) const {
+        return !(collisionCategory & model->collisionMask) || !(model->collisionCategory & collisionMask);
+    }
 };
 
 class ColdetModelPairEx;
@@ -82,7 +171,24 @@ public:
         return static_cast<ColdetModelEx*>(ColdetModelPair::model(which));
     }
 
+    bool isResting() {
+        return model(0)->isStaticOrResting() && model(1)->isStaticOrResting();
+    }
+
+    //! The pair is skipped when it is resting or filtered out by the collision filter
+    bool isSkipped() {
+        return isResting() || model(0)->isCollisionFilteredWith(model(1));
+    }
+
     ColdetModelPairExPtr sibling;
+
+    // The result of the last test, which includes the collisions of the sibling pairs
+    CollisionPair collisionPair;
+    int lastDetectionCounter = -1;
+
+    // for multithread version
+    bool hasCollisions = false;
+    double cost = 0.0; // The time of the last test [ns], which is used for the load balancing
 };
 
 
@@ -134,24 +240,78 @@ public:
     int maxNumThreads;
     set<IdPair<GeometryHandle>> nonInterfarencePairs;
     MeshExtractor* meshExtractor;
+
+    /*
+      The models of the same geometry node or the same mesh share an internal model so that
+      the tree is built only once. The node is referenced so that its address is not reused.
+    */
+    struct SharedModelInfo {
+        SgNodePtr node;
+        ColdetModelExPtr model;
+    };
+    unordered_map<SgNode*, SharedModelInfo> nodeToSharedModelMap;
+    unordered_multimap<uint64_t, ColdetModelExPtr> meshHashToSharedModelMap;
+
+    /**
+       The broad phase is the sweep and prune along the axis on which the boxes are spread most.
+       The sorted order of the previous detection is reused because it is almost sorted.
+    */
+    bool isBroadPhaseEnabled;
+    struct Box {
+        Vector3 min;
+        Vector3 max;
+    };
+    vector<Box> worldBoxes; // indexed by the model index
+    vector<int> sortedModelIndices;
+    int sweepAxis;
+    bool isSortingNeeded;
+    unordered_map<int64_t, int> modelIndexPairToPairIndexMap;
+    vector<int> candidatePairIndices;
+
+    /**
+       The result of a pair is reused when the pair has been tested in the previous detection
+       and neither of the geometries has moved beyond the tolerance.
+    */
+    bool isTemporalCoherenceEnabled;
+    double translationTolerance;
+    double rotationTolerance;
+    int detectionCounter;
+    int numDirtyGeometries;
+
+    bool isPrimitiveCollisionEnabled;
         
     AISTCollisionDetectorImpl();
     ~AISTCollisionDetectorImpl();
     boost::optional<GeometryHandle> addGeometry(SgNode* geometry);
     void addMesh(ColdetModelEx* model);
+    bool addHeightFieldMesh(ColdetModelEx* model, SgMesh* mesh);
     bool makeReady();
+    void initializeBroadPhase();
+    void clearWorldBox(ColdetModelEx* model);
+    void expandWorldBox(ColdetModelEx* model, ColdetModelEx* element, const Position& T);
+    void findCandidatePairs();
+    int numPairsToTest() const;
+    ColdetModelPairEx* pairToTest(int index);
+    void checkMovement(ColdetModelEx* topModel, const Position& T);
+    void beginDetection();
+    void endDetection();
+    bool testPair(ColdetModelPairEx* modelPair);
+    bool detectPrimitiveCollisions(ColdetModelPairEx* modelPair, CollisionPair& collisionPair);
     void detectCollisions(std::function<void(const CollisionPair&)> callback);
     void detectCollisionsInParallel(std::function<void(const CollisionPair&)> callback);
+    template<class PairFunction>
+    void detectDistances(
+        int numPairs, const PairFunction& getPair,
+        double* out_distances, Vector3* out_points1, Vector3* out_points2, double maxDistance);
+    void castRays(
+        const Vector3& origin, const Vector3* directions, int numRays,
+        double minDistance, double maxDistance, double* out_distances,
+        const std::function<bool(Referenced* object)>& geometryFilter);
 
     // for multithread version
     int numThreads;
     std::unique_ptr<ThreadPool> threadPool;
-    vector<int> shuffledPairIndices;
-    vector<vector<CollisionPair>> collisionPairArrays;
-    
-    void extractCollisionsOfAssignedPairs(
-        int pairIndexBegin, int pairIndexEnd, vector<CollisionPair>& collisionPairs);    
-    void dispatchCollisionsInCollisionPairArrays(std::function<void(const CollisionPair&)> callback);    
+    vector<ColdetModelPairEx*> pairsInCostOrder;
 };
 
 }
@@ -168,6 +328,15 @@ AISTCollisionDetectorImpl::AISTCollisionDetectorImpl()
     maxNumThreads = 0;
     numThreads = 0;
     meshExtractor = new MeshExtractor;
+    isBroadPhaseEnabled = true;
+    sweepAxis = 0;
+    isSortingNeeded = true;
+    isTemporalCoherenceEnabled = true;
+    translationTolerance = 0.0;
+    rotationTolerance = 0.0;
+    detectionCounter = 0;
+    numDirtyGeometries = 0;
+    isPrimitiveCollisionEnabled = true;
 }
 
 
@@ -201,12 +370,58 @@ void AISTCollisionDetector::setNumThreads(int n)
     impl->maxNumThreads = n;
 }
 
+
+void AISTCollisionDetector::setBroadPhaseEnabled(bool on)
+{
+    impl->isBroadPhaseEnabled = on;
+}
+
+
+void AISTCollisionDetector::setTemporalCoherenceEnabled(bool on)
+{
+    impl->isTemporalCoherenceEnabled = on;
+}
+
+
+/**
+   \param translation The tolerance of the translation [m]
+   \param rotation The tolerance of the rotation angle [rad]
+*/
+void AISTCollisionDetector::setTemporalCoherenceTolerance(double translation, double rotation)
+{
+    impl->translationTolerance = translation;
+    impl->rotationTolerance = rotation;
+}
+
+
+/**
+   When the primitive collision is enabled, the contacts of the pairs of the geometries
+   consisting of a single primitive are computed analytically instead of the triangles.
+   The height fields are always handled analytically.
+*/
+void AISTCollisionDetector::setPrimitiveCollisionEnabled(bool on)
+{
+    impl->isPrimitiveCollisionEnabled = on;
+}
+
+
+int AISTCollisionDetector::numDirtyGeometries() const
+{
+    return impl->numDirtyGeometries;
+}
+
         
 void AISTCollisionDetector::clearGeometries()
 {
     impl->models.clear();
+    impl->nodeToSharedModelMap.clear();
+    impl->meshHashToSharedModelMap.clear();
     impl->modelPairs.clear();
     impl->nonInterfarencePairs.clear();
+    impl->worldBoxes.clear();
+    impl->sortedModelIndices.clear();
+    impl->modelIndexPairToPairIndexMap.clear();
+    impl->candidatePairIndices.clear();
 }
 
 
@@ -225,15 +440,47 @@ boost::optional<GeometryHandle> AISTCollisionDetector::addGeometry(SgNode* geome
 boost::optional<GeometryHandle> AISTCollisionDetectorImpl::addGeometry(SgNode* geometry)
 {
     if(geometry){
-        ColdetModelExPtr model = new ColdetModelEx;
-        if(meshExtractor->extract(geometry, [&]() { addMesh(model); })){
+        ColdetModelExPtr model;
+        auto p = nodeToSharedModelMap.find(geometry);
+        if(p != nodeToSharedModelMap.end()){
+            model = new ColdetModelEx(*p->second.model);
+            model->setName(geometry->name());
+        } else {
+            model = new ColdetModelEx;
+            if(!meshExtractor->extract(geometry, [&]() { addMesh(model); })){
+                return boost::none;
+            }
             model->setName(geometry->name());
-            model->build();
-            if(model->isValid()){
+            if(model->primitive.type == CollisionPrimitive::HEIGHT_FIELD){
+                // The triangles of a height field are not built into the tree
+                model->updateLocalBox();
+                nodeToSharedModelMap[geometry] = SharedModelInfo{ geometry, model };
                 models.push_back(model);
                 return getHandle(model);
             }
+            ColdetModelEx* sharedModel = nullptr;
+            const uint64_t hash = model->getMeshHash();
+            auto range = meshHashToSharedModelMap.equal_range(hash);
+            for(auto q = range.first; q != range.second; ++q){
+                if(q->second->hasSameMesh(*model)){
+                    sharedModel = q->second;
+                    break;
+                }
+            }
+            if(sharedModel){
+                model->shareModel(*sharedModel);
+            } else {
+                model->build();
+                if(!model->isValid()){
+                    return boost::none;
+                }
+                model->updateLocalBox();
+                meshHashToSharedModelMap.emplace(hash, model);
+            }
+            nodeToSharedModelMap[geometry] = SharedModelInfo{ geometry, model };
         }
+        models.push_back(model);
+        return getHandle(model);
     }
     return boost::none;
 }
@@ -243,8 +490,22 @@ void AISTCollisionDetectorImpl::addMesh(ColdetModelEx* model)
 {
     SgMesh* mesh = meshExtractor->currentMesh();
     const Affine3& T = meshExtractor->currentTransform();
+
+    if(mesh->primitiveType() == SgMesh::HEIGHT_FIELD && addHeightFieldMesh(model, mesh)){
+        return;
+    }
+    if(model->primitive.type == CollisionPrimitive::HEIGHT_FIELD){
+        addHeightFieldTriangles(model->primitive, model);
+        model->primitive.clear();
+    }
     
     const int vertexIndexTop = model->getNumVertices();
+
+    // A geometry is a primitive only when it consists of a single mesh which is not scaled
+    if(vertexIndexTop > 0 || meshExtractor->isCurrentScaled() ||
+       !model->primitive.set(mesh, meshExtractor->currentTransformWithoutScaling())){
+        model->primitive.clear();
+    }
     
     const SgVertexArray& vertices = *mesh->vertices();
     const int numVertices = vertices.size();
@@ -264,6 +525,26 @@ void AISTCollisionDetectorImpl::addMesh(ColdetModelEx* model)
 }
 
 
+/**
+   The meshes of the tiles of a height field share the heights of the whole field,
+   which is handled as a primitive when the geometry only consists of the field.
+*/
+bool AISTCollisionDetectorImpl::addHeightFieldMesh(ColdetModelEx* model, SgMesh* mesh)
+{
+    if(model->getNumVertices() > 0 || meshExtractor->isCurrentScaled()){
+        return false;
+    }
+    const Affine3& T = meshExtractor->currentTransformWithoutScaling();
+    auto& primitive = model->primitive;
+    if(primitive.type == CollisionPrimitive::HEIGHT_FIELD){
+        return (primitive.heights == mesh->primitive<SgMesh::HeightField>().heights &&
+                primitive.localPosition.linear() == T.linear() &&
+                primitive.localPosition.translation() == T.translation());
+    }
+    return primitive.set(mesh, T);
+}
+
+
 void AISTCollisionDetector::setCustomObject(GeometryHandle geometry, Referenced* object)
 {
     getColdetModel(geometry)->object = object;
@@ -276,6 +557,22 @@ void AISTCollisionDetector::setGeometryStatic(GeometryHandle geometry, bool isSt
 }
 
 
+void AISTCollisionDetector::setGeometryResting(GeometryHandle geometry, bool isResting)
+{
+    for(auto model = getColdetModel(geometry); model; model = model->sibling){
+        model->isResting = isResting;
+    }
+}
+
+
+void AISTCollisionDetector::setGeometryCollisionFilter(GeometryHandle geometry, uint32_t category, uint32_t mask)
+{
+    auto model = getColdetModel(geometry);
+    model->collisionCategory = category;
+    model->collisionMask = mask;
+}
+
+
 void AISTCollisionDetector::setNonInterfarenceGeometyrPair(GeometryHandle geometry1, GeometryHandle geometry2)
 {
     impl->nonInterfarencePairs.insert(IdPair<GeometryHandle>(geometry1, geometry2));
@@ -307,35 +604,98 @@ bool AISTCollisionDetectorImpl::makeReady()
 
     const int numPairs = modelPairs.size();
 
+    initializeBroadPhase();
+
     if(maxNumThreads <= 0){
         numThreads = 0;
         threadPool.reset();
-        collisionPairArrays.clear();
     } else {
         numThreads = (maxNumThreads > numPairs) ? numPairs : maxNumThreads;
-        threadPool.reset(new ThreadPool(numThreads));
-        if(ENABLE_SHUFFLE){
-            shuffledPairIndices.resize(modelPairs.size());
-            for(size_t i=0; i < shuffledPairIndices.size(); ++i){
-                shuffledPairIndices[i] = i;
-            }
-        }
-        collisionPairArrays.resize(numThreads);
+        // The calling thread also tests the pairs
+        threadPool.reset(new ThreadPool(numThreads - 1));
     }
 
     return true;
 }
 
 
+void AISTCollisionDetectorImpl::initializeBroadPhase()
+{
+    const int n = models.size();
+    worldBoxes.resize(n);
+    sortedModelIndices.resize(n);
+    for(int i=0; i < n; ++i){
+        ColdetModelEx* model = models[i];
+        model->index = i;
+        sortedModelIndices[i] = i;
+        clearWorldBox(model);
+        for(auto element = model; element; element = element->sibling){
+            expandWorldBox(model, element, Position::Identity());
+        }
+    }
+    isSortingNeeded = true;
+
+    for(auto& model : models){
+        model->isMoved = true;
+    }
+
+    modelIndexPairToPairIndexMap.clear();
+    for(size_t i=0; i < modelPairs.size(); ++i){
+        ColdetModelPairEx* pair = modelPairs[i];
+        int index1 = pair->model(0)->index;
+        int index2 = pair->model(1)->index;
+        if(index1 > index2){
+            std::swap(index1, index2);
+        }
+        modelIndexPairToPairIndexMap[(static_cast<int64_t>(index1) << 32) | index2] = i;
+    }
+}
+
+
+void AISTCollisionDetectorImpl::clearWorldBox(ColdetModelEx* model)
+{
+    Box& box = worldBoxes[model->index];
+    box.min.setConstant(std::numeric_limits<double>::max());
+    box.max = -box.min;
+}
+
+
+/**
+   The box of a model includes the boxes of its siblings.
+   \param T The position of the element in the world coordinate
+*/
+void AISTCollisionDetectorImpl::expandWorldBox(ColdetModelEx* model, ColdetModelEx* element, const Position& T)
+{
+    Box& box = worldBoxes[model->index];
+    const Vector3 center = T * element->localBoxCenter;
+    const Vector3 extents =
+        T.linear().cwiseAbs() * element->localBoxExtents + Vector3::Constant(BROAD_PHASE_MARGIN);
+    box.min = box.min.cwiseMin(center - extents);
+    box.max = box.max.cwiseMax(center + extents);
+}
+
+
 void AISTCollisionDetector::updatePosition(GeometryHandle geometry, const Position& position)
 {
-    auto model = getColdetModel(geometry);
+    auto topModel = getColdetModel(geometry);
+    impl->checkMovement(topModel, position);
+    const bool doUpdateBox = (topModel->index >= 0);
+    if(doUpdateBox){
+        impl->clearWorldBox(topModel);
+    }
+    auto model = topModel;
     do {
         if(model->localPosition){
             Position T = position * (*model->localPosition);
             model->setPosition(T);
+            if(doUpdateBox){
+                impl->expandWorldBox(topModel, model, T);
+            }
         } else {
             model->setPosition(position);
+            if(doUpdateBox){
+                impl->expandWorldBox(topModel, model, position);
+            }
         }
         model = model->sibling;
     } while(model);
@@ -346,14 +706,31 @@ void AISTCollisionDetector::updatePositions
 (std::function<void(Referenced* object, Position*& out_Position)> positionQuery)
 {
     for(ColdetModelEx* model : impl->models){ // Do not use auto&
+        if(model->isResting){
+            continue;
+        }
+        ColdetModelEx* topModel = model;
+        const bool doUpdateBoxes = (topModel->index >= 0);
+        if(doUpdateBoxes){
+            impl->clearWorldBox(topModel);
+        }
         do {
             Position* T;
             positionQuery(model->object, T);
+            if(model == topModel){
+                impl->checkMovement(topModel, *T);
+            }
             if(model->localPosition){
                 Position T2 = (*T) * (*model->localPosition);
                 model->setPosition(T2);
+                if(doUpdateBoxes){
+                    impl->expandWorldBox(topModel, model, T2);
+                }
             } else {
                 model->setPosition(*T);
+                if(doUpdateBoxes){
+                    impl->expandWorldBox(topModel, model, *T);
+                }
             }
             model = model->sibling; // Elements in models are overridden here if auto& is used
         } while(model);
@@ -361,106 +738,290 @@ void AISTCollisionDetector::updatePositions
 }
 
 
+/**
+   The rotation difference is evaluated by the Frobenius norm of the difference of the
+   rotation matrices, which is about sqrt(2) times the rotation angle for a small rotation.
+*/
+void AISTCollisionDetectorImpl::checkMovement(ColdetModelEx* topModel, const Position& T)
+{
+    if(!topModel->isMoved){
+        if((T.translation() - topModel->referencePosition.translation()).norm() > translationTolerance ||
+           (T.linear() - topModel->referencePosition.linear()).norm() > rotationTolerance * M_SQRT2){
+            topModel->isMoved = true;
+        }
+    }
+    if(topModel->isMoved){
+        topModel->referencePosition = T;
+    }
+}
+
+
 void AISTCollisionDetector::detectCollisions(std::function<void(const CollisionPair&)> callback)
 {
+    impl->beginDetection();
+    
     if(impl->numThreads > 0){
         impl->detectCollisionsInParallel(callback);
     } else {
         impl->detectCollisions(callback);
     }
+
+    impl->endDetection();
 } 
 
 
-/**
-   \todo Remeber which geometry positions are updated after the last collision detection
-   and do the actual collision detection only for the updated geometry pairs.
-*/
-void AISTCollisionDetectorImpl::detectCollisions(std::function<void(const CollisionPair&)> callback)
+void AISTCollisionDetectorImpl::beginDetection()
 {
-    CollisionPair collisionPair;
-    auto& collisions = collisionPair.collisions();
-    
-    for(ColdetModelPairEx* modelPair : modelPairs){ // Do not use auto&
-        collisions.clear();
-        do {
-            if(!modelPair->detectCollisions().empty()){
-                copyCollisionPairCollisions(modelPair, collisionPair);
-            }
-            modelPair = modelPair->sibling;  // Elements in models are overridden here if auto& is used
-        } while(modelPair);
+    ++detectionCounter;
 
-        if(!collisions.empty()){
-            callback(collisionPair);
+    numDirtyGeometries = 0;
+    for(auto& model : models){
+        if(model->isMoved){
+            ++numDirtyGeometries;
         }
     }
 }
 
 
-void AISTCollisionDetectorImpl::detectCollisionsInParallel(std::function<void(const CollisionPair&)> callback)
+void AISTCollisionDetectorImpl::endDetection()
 {
-    if(ENABLE_SHUFFLE){
-        std::random_shuffle(shuffledPairIndices.begin(), shuffledPairIndices.end());
+    for(auto& model : models){
+        model->isMoved = false;
     }
+}
 
-    const int numPairs = modelPairs.size();
-    const int minSize = numPairs / numThreads;
-    int remainder = numPairs % numThreads;
-    int index = 0;
-    for(int i=0; i < numThreads; ++i){
-        int size = minSize;
-        if(remainder > 0){
-            ++size;
-            --remainder;
-        }
-        if(size == 0){
-            break;
+
+/**
+   \return true if the pair has collisions
+*/
+bool AISTCollisionDetectorImpl::testPair(ColdetModelPairEx* modelPair)
+{
+    CollisionPair& collisionPair = modelPair->collisionPair;
+
+    const bool isReusable =
+        isTemporalCoherenceEnabled &&
+        modelPair->lastDetectionCounter == detectionCounter - 1 &&
+        !modelPair->model(0)->isMoved &&
+        !modelPair->model(1)->isMoved;
+
+    modelPair->lastDetectionCounter = detectionCounter;
+
+    if(!isReusable){
+        collisionPair.collisions().clear();
+        if(!detectPrimitiveCollisions(modelPair, collisionPair)){
+            auto pair = modelPair;
+            do {
+                if(!pair->detectCollisions().empty()){
+                    copyCollisionPairCollisions(pair, collisionPair);
+                }
+                pair = pair->sibling;
+            } while(pair);
         }
-        threadPool->start([this, i, index, size](){
-                extractCollisionsOfAssignedPairs(index, index + size, collisionPairArrays[i]); });
-        index += size;
     }
-    threadPool->waitLoop();
-    //threadPool->wait();
 
-    dispatchCollisionsInCollisionPairArrays(callback);
+    return !collisionPair.empty();
 }
 
 
-void AISTCollisionDetectorImpl::extractCollisionsOfAssignedPairs
-(int pairIndexBegin, int pairIndexEnd, vector<CollisionPair>& collisionPairs)
+/**
+   
+eturn false if the pair cannot be handled as primitives
+*/
+bool AISTCollisionDetectorImpl::detectPrimitiveCollisions(ColdetModelPairEx* modelPair, CollisionPair& collisionPair)
 {
-    collisionPairs.clear();
+    if(modelPair->sibling){
+        return false;
+    }
+    ColdetModelEx* model1 = modelPair->model(0);
+    ColdetModelEx* model2 = modelPair->model(1);
+    auto type1 = model1->primitive.type;
+    auto type2 = model2->primitive.type;
+
+    // A height field is always handled as a primitive because it does not have the tree of the triangles
+    if(!isPrimitiveCollisionEnabled &&
+       type1 != CollisionPrimitive::HEIGHT_FIELD && type2 != CollisionPrimitive::HEIGHT_FIELD){
+        return false;
+    }
+    
+    vector<Collision>& collisions = collisionPair.collisions();
+    
+    if(isPrimitivePairSupported(type1, type2)){
+        cnoid::detectPrimitiveCollisions(
+            model1->primitive, model1->position * model1->primitive.localPosition,
+            model2->primitive, model2->position * model2->primitive.localPosition,
+            collisions);
+
+    } else if(type2 == CollisionPrimitive::NONE && isPrimitiveMeshPairSupported(type1)){
+        detectPrimitiveMeshCollisions(
+            model1->primitive, model1->position * model1->primitive.localPosition,
+            model2, model2->position, collisions);
+
+    } else if(type1 == CollisionPrimitive::NONE && isPrimitiveMeshPairSupported(type2)){
+        detectPrimitiveMeshCollisions(
+            model2->primitive, model2->position * model2->primitive.localPosition,
+            model1, model1->position, collisions);
+        for(auto& collision : collisions){
+            collision.normal = -collision.normal;
+        }
+    } else {
+        return false;
+    }
 
-    for(int i=pairIndexBegin; i < pairIndexEnd; ++i){
-        ColdetModelPairEx* modelPair;
-        if(ENABLE_SHUFFLE){
-            modelPair = modelPairs[shuffledPairIndices[i]];
-        } else {
-            modelPair = modelPairs[i];
+    for(int i=0; i < 2; ++i){
+        auto model = modelPair->model(i);
+        collisionPair.object(i) = model->object;
+        collisionPair.geometry(i) = getHandle(model);
+    }
+
+    return true;
+}
+
+
+/**
+   The candidate pairs are stored in the order of modelPairs so that the collisions are
+   given in the same order as the detection without the broad phase.
+*/
+void AISTCollisionDetectorImpl::findCandidatePairs()
+{
+    const int n = sortedModelIndices.size();
+
+    if(isSortingNeeded || n == 0){
+        // The axis with the largest spread of the box centers is used for the sweep
+        Vector3 sum = Vector3::Zero();
+        Vector3 sum2 = Vector3::Zero();
+        for(auto& box : worldBoxes){
+            const Vector3 c = (box.min + box.max) / 2.0;
+            sum += c;
+            sum2 += c.cwiseProduct(c);
+        }
+        const Vector3 variance = sum2 - sum.cwiseProduct(sum) / std::max(n, 1);
+        variance.maxCoeff(&sweepAxis);
+        std::sort(sortedModelIndices.begin(), sortedModelIndices.end(),
+                  [&](int i, int j){ return worldBoxes[i].min[sweepAxis] < worldBoxes[j].min[sweepAxis]; });
+        isSortingNeeded = false;
+    } else {
+        // Insertion sort, which is almost linear for the order of the previous detection
+        for(int i=1; i < n; ++i){
+            const int index = sortedModelIndices[i];
+            const double key = worldBoxes[index].min[sweepAxis];
+            int j = i - 1;
+            while(j >= 0 && worldBoxes[sortedModelIndices[j]].min[sweepAxis] > key){
+                sortedModelIndices[j + 1] = sortedModelIndices[j];
+                --j;
+            }
+            sortedModelIndices[j + 1] = index;
         }
+    }
 
-        collisionPairs.push_back(CollisionPair());
-        CollisionPair& collisionPair = collisionPairs.back();
-        do {
-            if(!modelPair->detectCollisions().empty()){
-                copyCollisionPairCollisions(modelPair, collisionPair, true);
+    const int axis1 = (sweepAxis + 1) % 3;
+    const int axis2 = (sweepAxis + 2) % 3;
+    
+    candidatePairIndices.clear();
+    for(int i=0; i < n; ++i){
+        const int index1 = sortedModelIndices[i];
+        const Box& box1 = worldBoxes[index1];
+        ColdetModelEx* model1 = models[index1];
+        const bool isStatic1 = model1->isStaticOrResting();
+        for(int j = i + 1; j < n; ++j){
+            const int index2 = sortedModelIndices[j];
+            const Box& box2 = worldBoxes[index2];
+            if(box2.min[sweepAxis] > box1.max[sweepAxis]){
+                break;
+            }
+            ColdetModelEx* model2 = models[index2];
+            if((isStatic1 && model2->isStaticOrResting()) || model1->isCollisionFilteredWith(model2)){
+                continue;
+            }
+            if(box1.min[axis1] > box2.max[axis1] || box2.min[axis1] > box1.max[axis1] ||
+               box1.min[axis2] > box2.max[axis2] || box2.min[axis2] > box1.max[axis2]){
+                continue;
+            }
+            const int64_t key = (index1 < index2) ?
+                ((static_cast<int64_t>(index1) << 32) | index2) :
+                ((static_cast<int64_t>(index2) << 32) | index1);
+            auto p = modelIndexPairToPairIndexMap.find(key);
+            if(p != modelIndexPairToPairIndexMap.end()){
+                candidatePairIndices.push_back(p->second);
             }
-            modelPair = modelPair->sibling;
-        } while(modelPair);
+        }
+    }
+    std::sort(candidatePairIndices.begin(), candidatePairIndices.end());
+}
+
+
+int AISTCollisionDetectorImpl::numPairsToTest() const
+{
+    return isBroadPhaseEnabled ? candidatePairIndices.size() : modelPairs.size();
+}
 
-        if(collisionPair.empty()){
-            collisionPairs.pop_back();
+
+ColdetModelPairEx* AISTCollisionDetectorImpl::pairToTest(int index)
+{
+    if(isBroadPhaseEnabled){
+        return modelPairs[candidatePairIndices[index]];
+    }
+    return modelPairs[index];
+}
+
+
+void AISTCollisionDetectorImpl::detectCollisions(std::function<void(const CollisionPair&)> callback)
+{
+    if(isBroadPhaseEnabled){
+        findCandidatePairs();
+    }
+
+    const int numPairs = numPairsToTest();
+    for(int i=0; i < numPairs; ++i){
+        ColdetModelPairEx* modelPair = pairToTest(i);
+        if(modelPair->isSkipped()){
+            continue;
+        }
+        if(testPair(modelPair)){
+            callback(modelPair->collisionPair);
         }
     }
 }
 
-void AISTCollisionDetectorImpl::dispatchCollisionsInCollisionPairArrays
-(std::function<void(const CollisionPair&)> callback)
+
+/**
+   The pairs are tested in the descending order of the costs measured in the previous
+   detection, and each thread takes the next pair when it finishes the current one.
+   The costs of the pairs differ by orders of magnitude, so the expensive pairs should
+   be started first to balance the load. The results are given in the original pair order.
+*/
+void AISTCollisionDetectorImpl::detectCollisionsInParallel(std::function<void(const CollisionPair&)> callback)
 {
-    for(int i=0; i < numThreads; ++i){
-        const vector<CollisionPair>& collisionPairs = collisionPairArrays[i];
-        for(size_t j=0; j < collisionPairs.size(); ++j){
-            callback(collisionPairs[j]);
+    if(isBroadPhaseEnabled){
+        findCandidatePairs();
+    }
+
+    const int numPairs = numPairsToTest();
+    pairsInCostOrder.clear();
+    for(int i=0; i < numPairs; ++i){
+        ColdetModelPairEx* modelPair = pairToTest(i);
+        if(!modelPair->isSkipped()){
+            pairsInCostOrder.push_back(modelPair);
+        }
+    }
+    std::stable_sort(
+        pairsInCostOrder.begin(), pairsInCostOrder.end(),
+        [](ColdetModelPairEx* pair1, ColdetModelPairEx* pair2){ return pair1->cost > pair2->cost; });
+
+    threadPool->parallelFor(
+        0, pairsInCostOrder.size(),
+        [this](int index){
+            ColdetModelPairEx* modelPair = pairsInCostOrder[index];
+            auto startTime = std::chrono::steady_clock::now();
+            modelPair->hasCollisions = testPair(modelPair);
+            modelPair->cost =
+                std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+        },
+        1);
+
+    for(int i=0; i < numPairs; ++i){
+        ColdetModelPairEx* modelPair = pairToTest(i);
+        if(!modelPair->isSkipped() && modelPair->hasCollisions){
+            callback(modelPair->collisionPair);
         }
     }
 }
@@ -472,3 +1033,191 @@ double AISTCollisionDetector::detectDistance
     return ColdetModelPair::computeDistance(
         getColdetModel(geometry1), getColdetModel(geometry2), out_point1.data(), out_point2.data());
 }
+
+
+void AISTCollisionDetector::detectDistances
+(const GeometryHandle* geometryPairs, int numPairs,
+ double* out_distances, Vector3* out_points1, Vector3* out_points2, double maxDistance)
+{
+    impl->detectDistances(
+        numPairs,
+        [geometryPairs](int index, GeometryHandle& out_geometry1, GeometryHandle& out_geometry2){
+            out_geometry1 = geometryPairs[index * 2];
+            out_geometry2 = geometryPairs[index * 2 + 1];
+        },
+        out_distances, out_points1, out_points2, maxDistance);
+}
+
+
+void AISTCollisionDetector::detectDistances
+(GeometryHandle geometry, const GeometryHandle* geometries, int numGeometries,
+ double* out_distances, Vector3* out_points1, Vector3* out_points2, double maxDistance)
+{
+    impl->detectDistances(
+        numGeometries,
+        [geometry, geometries](int index, GeometryHandle& out_geometry1, GeometryHandle& out_geometry2){
+            out_geometry1 = geometry;
+            out_geometry2 = geometries[index];
+        },
+        out_distances, out_points1, out_points2, maxDistance);
+}
+
+
+/**
+   The queries are computed in parallel by the shared thread pool. The models are only read
+   in the computation, so the positions must not be updated until this function returns.
+*/
+template<class PairFunction>
+void AISTCollisionDetectorImpl::detectDistances
+(int numPairs, const PairFunction& getPair,
+ double* out_distances, Vector3* out_points1, Vector3* out_points2, double maxDistance)
+{
+    auto computeDistance = [&](int index){
+        GeometryHandle geometry1, geometry2;
+        getPair(index, geometry1, geometry2);
+        Vector3 p1, p2;
+        out_distances[index] = ColdetModelPair::computeDistance(
+            getColdetModel(geometry1), getColdetModel(geometry2), p1.data(), p2.data(), maxDistance);
+        if(out_points1){
+            out_points1[index] = p1;
+        }
+        if(out_points2){
+            out_points2[index] = p2;
+        }
+    };
+
+    if(numPairs < MIN_NUM_PARALLEL_DISTANCE_QUERIES){
+        for(int i=0; i < numPairs; ++i){
+            computeDistance(i);
+        }
+    } else {
+        ThreadPool::instance()->parallelFor(0, numPairs, computeDistance);
+    }
+}
+
+
+void AISTCollisionDetector::castRays
+(const Vector3& origin, const Vector3* directions, int numRays,
+ double minDistance, double maxDistance, double* out_distances,
+ std::function<bool(Referenced* object)> geometryFilter)
+{
+    impl->castRays(origin, directions, numRays, minDistance, maxDistance, out_distances, geometryFilter);
+}
+
+
+/**
+   The rays are processed in packets of the consecutive rays, which have similar directions when
+   the rays are the beams of a scan. The geometries whose bounding boxes do not overlap the box of
+   the segments of a packet are culled for all the rays of the packet, and the remaining ones are
+   tested in the order of the distances to their boxes so that the farther ones can be skipped
+   when a nearer hit is found. The packets are processed in parallel by the shared thread pool.
+*/
+void AISTCollisionDetectorImpl::castRays
+(const Vector3& origin, const Vector3* directions, int numRays,
+ double minDistance, double maxDistance, double* out_distances,
+ const std::function<bool(Referenced* object)>& geometryFilter)
+{
+    struct Target {
+        ColdetModelEx* model;
+        Box box;
+    };
+    vector<Target> targets;
+    targets.reserve(models.size());
+    for(auto& model : models){
+        if(geometryFilter && !geometryFilter(model->object)){
+            continue;
+        }
+        Target target;
+        target.model = model;
+        target.box.min.setConstant(std::numeric_limits<double>::max());
+        target.box.max = -target.box.min;
+        for(ColdetModelEx* element = model; element; element = element->sibling){
+            const Position& T = element->position;
+            const Vector3 center = T * element->localBoxCenter;
+            const Vector3 extents =
+                T.linear().cwiseAbs() * element->localBoxExtents + Vector3::Constant(BROAD_PHASE_MARGIN);
+            target.box.min = target.box.min.cwiseMin(center - extents);
+            target.box.max = target.box.max.cwiseMax(center + extents);
+        }
+        targets.push_back(target);
+    }
+
+    const double rangeLength = maxDistance - minDistance;
+    const int numPackets = (numRays + RAY_PACKET_SIZE - 1) / RAY_PACKET_SIZE;
+
+    ThreadPool::instance()->parallelFor(
+        0, numPackets,
+        [&](int packetIndex){
+            const int begin = packetIndex * RAY_PACKET_SIZE;
+            const int end = std::min(begin + RAY_PACKET_SIZE, numRays);
+
+            Box packetBox;
+            packetBox.min.setConstant(std::numeric_limits<double>::max());
+            packetBox.max = -packetBox.min;
+            for(int i=begin; i < end; ++i){
+                const Vector3 p0 = origin + minDistance * directions[i];
+                const Vector3 p1 = origin + maxDistance * directions[i];
+                packetBox.min = packetBox.min.cwiseMin(p0.cwiseMin(p1));
+                packetBox.max = packetBox.max.cwiseMax(p0.cwiseMax(p1));
+            }
+
+            vector<pair<double, const Target*>> candidates;
+            for(auto& target : targets){
+                const Box& box = target.box;
+                if((box.min.array() <= packetBox.max.array()).all() &&
+                   (box.max.array() >= packetBox.min.array()).all()){
+                    const Vector3 nearest = origin.cwiseMax(box.min).cwiseMin(box.max);
+                    candidates.emplace_back((nearest - origin).norm(), &target);
+                }
+            }
+            std::sort(candidates.begin(), candidates.end(),
+                      [](const pair<double, const Target*>& c1, const pair<double, const Target*>& c2){
+                          return c1.first < c2.first; });
+
+            for(int i=begin; i < end; ++i){
+                const Vector3& direction = directions[i];
+                const Vector3 start = origin + minDistance * direction;
+                double nearestDistance = std::numeric_limits<double>::max();
+                double distanceLimit = rangeLength;
+                for(auto& candidate : candidates){
+                    if(candidate.first - minDistance > distanceLimit){
+                        break;
+                    }
+                    // Slab test of the ray and the box
+                    const Box& box = candidate.second->box;
+                    double t0 = 0.0;
+                    double t1 = distanceLimit;
+                    for(int j=0; j < 3 && t0 <= t1; ++j){
+                        if(direction[j] == 0.0){
+                            if(start[j] < box.min[j] || start[j] > box.max[j]){
+                                t0 = t1 + 1.0;
+                            }
+                        } else {
+                            double ta = (box.min[j] - start[j]) / direction[j];
+                            double tb = (box.max[j] - start[j]) / direction[j];
+                            if(ta > tb){
+                                std::swap(ta, tb);
+                            }
+                            t0 = std::max(t0, ta);
+                            t1 = std::min(t1, tb);
+                        }
+                    }
+                    if(t0 > t1){
+                        continue;
+                    }
+                    for(ColdetModelEx* element = candidate.second->model; element; element = element->sibling){
+                        if(!element->isValid()){
+                            continue;
+                        }
+                        const double d = element->computeDistanceWithRay(start, direction, distanceLimit);
+                        if(d >= 0.0 && d < distanceLimit){
+                            distanceLimit = d;
+                            nearestDistance = minDistance + d;
+                        }
+                    }
+                }
+                out_distances[i] = nearestDistance;
+            }
+        },
+        1);
+}
@@ -13,7 +13,8 @@ namespace cnoid {
 
 class AISTCollisionDetectorImpl;
 
-class CNOID_EXPORT AISTCollisionDetector : public CollisionDetector, public CollisionDetectorDistanceAPI
+class CNOID_EXPORT AISTCollisionDetector
+    : public CollisionDetector, public CollisionDetectorDistanceAPI, public CollisionDetectorRayCastAPI
 {
 public:
     AISTCollisionDetector();
@@ -25,6 +26,9 @@ public:
     virtual boost::optional<GeometryHandle> addGeometry(SgNode* geometry) override;
     virtual void setCustomObject(GeometryHandle geometry, Referenced* object) override;
     virtual void setGeometryStatic(GeometryHandle geometry, bool isStatic = true) override;
+    virtual void setGeometryResting(GeometryHandle geometry, bool isResting = true) override;
+    virtual void setGeometryCollisionFilter(GeometryHandle geometry, uint32_t category, uint32_t mask) override;
+    virtual void setNumThreads(int n) override;
     virtual void setNonInterfarenceGeometyrPair(GeometryHandle geometry1, GeometryHandle geometry2) override;
     virtual bool makeReady() override;
     virtual void updatePosition(GeometryHandle geometry, const Position& position) override;
@@ -33,9 +37,29 @@ public:
 
     // CollisionDetectorDistanceAPI
     virtual double detectDistance(GeometryHandle geometry1, GeometryHandle geometry2, Vector3& out_point1, Vector3& out_point2) override;
+    virtual void detectDistances(
+        const GeometryHandle* geometryPairs, int numPairs,
+        double* out_distances, Vector3* out_points1, Vector3* out_points2,
+        double maxDistance = std::numeric_limits<double>::max()) override;
+    virtual void detectDistances(
+        GeometryHandle geometry, const GeometryHandle* geometries, int numGeometries,
+        double* out_distances, Vector3* out_points1, Vector3* out_points2,
+        double maxDistance = std::numeric_limits<double>::max()) override;
+
+    // CollisionDetectorRayCastAPI
+    virtual void castRays(
+        const Vector3& origin, const Vector3* directions, int numRays,
+        double minDistance, double maxDistance, double* out_distances,
+        std::function<bool(Referenced* object)> geometryFilter = nullptr) override;
 
     // experimental
-    void setNumThreads(int n);
+    void setBroadPhaseEnabled(bool on);
+    void setTemporalCoherenceEnabled(bool on);
+    void setTemporalCoherenceTolerance(double translation, double rotation);
+    void setPrimitiveCollisionEnabled(bool on);
+
+    //! The number of the geometries which moved beyond the tolerance before the last detection
+    int numDirtyGeometries() const;
 
 private:
     AISTCollisionDetectorImpl* impl;
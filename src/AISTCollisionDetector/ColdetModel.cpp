@@ -4,8 +4,10 @@
 
 #include "ColdetModel.h"
 #include "ColdetModelInternalModel.h"
+#include "ColdetModelCache.h"
 #include "Opcode/Opcode.h"
 #include <map>
+#include <cstring>
 #include <iostream>
 
 using namespace std;
@@ -97,6 +99,45 @@ void ColdetModel::cloneInternalModel()
 }
 
 
+bool ColdetModel::hasSameMesh(const ColdetModel& model) const
+{
+    const ColdetModelInternalModel* other = model.internalModel;
+    if(other == internalModel){
+        return true;
+    }
+    const auto& vertices = internalModel->vertices;
+    const auto& triangles = internalModel->triangles;
+    if(other->vertices.size() != vertices.size() || other->triangles.size() != triangles.size()){
+        return false;
+    }
+    if(vertices.empty() || triangles.empty()){
+        return vertices.empty() && triangles.empty();
+    }
+    return (memcmp(&vertices[0], &other->vertices[0], vertices.size() * sizeof(IceMaths::Point)) == 0 &&
+            memcmp(&triangles[0], &other->triangles[0], triangles.size() * sizeof(IceMaths::IndexedTriangle)) == 0);
+}
+
+
+uint64_t ColdetModel::getMeshHash() const
+{
+    return internalModel->computeMeshHash();
+}
+
+
+void ColdetModel::shareInternalModel(const ColdetModel& model)
+{
+    if(model.internalModel == internalModel){
+        return;
+    }
+    model.internalModel->refCounter++;
+    if(--internalModel->refCounter <= 0){
+        delete internalModel;
+    }
+    internalModel = model.internalModel;
+    isValid_ = model.isValid_;
+}
+
+
 ColdetModelInternalModel::ColdetModelInternalModel()
 {
     refCounter = 0;
@@ -199,6 +240,12 @@ void ColdetModel::build()
 }
 
 
+void ColdetModel::setCacheDirectory(const std::string& directory)
+{
+    ColdetModelCache::setDirectory(directory);
+}
+
+
 int ColdetModel::numofBBtoDepth(int minNumofBB)
 {
     for(int i=0; i < getAABBTreeDepth(); ++i){
@@ -258,21 +305,26 @@ bool ColdetModelInternalModel::build()
     
     if(triangles.size() > 0){
 
-        extractNeghiborTriangles();
-
-        Opcode::OPCODECREATE OPCC;
-
         iMesh.SetPointers(&triangles[0], &vertices[0]);
         iMesh.SetNbTriangles(triangles.size());
         iMesh.SetNbVertices(vertices.size());
+
+        ColdetModelCache cache(this);
+        if(!cache.load()){
+
+            extractNeghiborTriangles();
+
+            Opcode::OPCODECREATE OPCC;
+            OPCC.mIMesh = &iMesh;
+            OPCC.mNoLeaf = false;
+            OPCC.mQuantized = false;
+            OPCC.mKeepOriginal = false;
         
-        OPCC.mIMesh = &iMesh;
-        
-        OPCC.mNoLeaf = false;
-        OPCC.mQuantized = false;
-        OPCC.mKeepOriginal = false;
+            model.Build(OPCC);
+
+            cache.save();
+        }
         
-        model.Build(OPCC);
         if(model.GetTree()){
             AABBTreeMaxDepth = computeDepth(((Opcode::AABBCollisionTree*)model.GetTree())->GetNodes(), 0, -1) + 1;
             for(int i=0; i<AABBTreeMaxDepth; i++)
@@ -378,6 +430,23 @@ double ColdetModel::computeDistanceWithRay(const double *point,
 }
 
 
+double ColdetModel::computeDistanceWithRay
+(const Vector3& point, const Vector3& dir, double maxDistance) const
+{
+    Opcode::RayCollider RC;
+    Ray world_ray(Point(point[0], point[1], point[2]), Point(dir[0], dir[1], dir[2]));
+    Opcode::CollisionFace CF;
+    Opcode::SetupClosestHit(RC, CF);
+    RC.SetCulling(false);
+    RC.SetMaxDist(static_cast<float>(maxDistance));
+    RC.Collide(world_ray, internalModel->model, transform, nullptr);
+    if(CF.mDistance == FLT_MAX){
+        return -1.0;
+    }
+    return CF.mDistance;
+}
+
+
 bool ColdetModel::checkCollisionWithPointCloud(const std::vector<Vector3> &i_cloud, double i_radius)
 {
     Opcode::SphereCollider SC;
@@ -399,6 +468,24 @@ bool ColdetModel::checkCollisionWithPointCloud(const std::vector<Vector3> &i_clo
 }
 
 
+void ColdetModel::getTrianglesInSphere(const Vector3& center, double radius, std::vector<int>& out_triangles)
+{
+    out_triangles.clear();
+    Opcode::SphereCollider SC;
+    Opcode::SphereCache Cache;
+    IceMaths::Sphere sphere(IceMaths::Point(0, 0, 0), radius);
+    IceMaths::Matrix4x4 sphereTrans(1,0,0,0, 0,1,0,0, 0,0,1,0,  center[0],center[1],center[2],1);
+    bool isOk = SC.Collide(Cache, sphere, internalModel->model, &sphereTrans, transform);
+    if (!isOk){
+        std::cerr << "SphereCollider::Collide() failed" << std::endl;
+    } else if (SC.GetContactStatus()){
+        const int n = SC.GetNbTouchedPrimitives();
+        const udword* touched = SC.GetTouchedPrimitives();
+        out_triangles.assign(touched, touched + n);
+    }
+}
+
+
 namespace {
 
 inline bool extractNeighborTriangle
@@ -456,6 +543,36 @@ void ColdetModelInternalModel::extractNeghiborTriangles()
 }
 
 
+namespace {
+
+uint64_t computeHash(const void* data, size_t size, uint64_t hash)
+{
+    // FNV-1a
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for(size_t i=0; i < size; ++i){
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+}
+
+
+uint64_t ColdetModelInternalModel::computeMeshHash() const
+{
+    const uint32_t counts[] = { static_cast<uint32_t>(vertices.size()), static_cast<uint32_t>(triangles.size()) };
+    uint64_t hash = computeHash(counts, sizeof(counts), 14695981039346656037ULL);
+    if(!vertices.empty()){
+        hash = computeHash(&vertices[0], vertices.size() * sizeof(IceMaths::Point), hash);
+    }
+    if(!triangles.empty()){
+        hash = computeHash(&triangles[0], triangles.size() * sizeof(IceMaths::IndexedTriangle), hash);
+    }
+    return hash;
+}
+
+
 int ColdetModelInternalModel::computeDepth(const Opcode::AABBCollisionNode* node, int currentDepth, int max)
 {
     /*
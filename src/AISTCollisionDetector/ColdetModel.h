@@ -9,6 +9,7 @@
 #include <cnoid/EigenTypes>
 #include <string>
 #include <vector>
+#include <cstdint>
 #include "exportdecl.h"
 
 namespace IceMaths {
@@ -123,6 +124,32 @@ public:
      */
     void build();
 
+    /**
+     * @brief check if this model has the same vertices and triangles as another model
+     */
+    bool hasSameMesh(const ColdetModel& model) const;
+
+    /**
+     * @brief get the hash value of the vertices and triangles
+     */
+    uint64_t getMeshHash() const;
+
+    /**
+     * @brief share the mesh and the built tree of another model
+     *
+     * The position of this model is not changed.
+     */
+    void shareInternalModel(const ColdetModel& model);
+
+    /**
+     * @brief set the directory to cache the built trees of large meshes
+     *
+     * A tree is loaded from the cache in build() when the cache has the tree of the same mesh.
+     * The cache is disabled when the directory is empty, which is the default unless the
+     * environment variable CNOID_COLDET_CACHE_DIR is set.
+     */
+    static void setCacheDirectory(const std::string& directory);
+
     /**
      * @brief check if build() is already called or not
      * @return true if build() is already called, false otherwise
@@ -195,6 +222,18 @@ public:
      */
     double computeDistanceWithRay(const double *point, const double *dir);
 
+    /**
+     * @brief compute distance between a point and this mesh along ray
+     * @param point a point in the world coordinate
+     * @param dir unit direction vector of ray in the world coordinate
+     * @param maxDistance the triangles farther than this distance are not tested
+     * @return distance if ray hits the front or back face of a triangle within maxDistance,
+     * a negative value otherwise
+     *
+     * This function can be called from multiple threads at the same time
+     */
+    double computeDistanceWithRay(const Vector3& point, const Vector3& dir, double maxDistance) const;
+
     /**
      * @brief check collision between this triangle mesh and a point cloud
      * @param i_cloud points
@@ -204,6 +243,14 @@ public:
     bool checkCollisionWithPointCloud(const std::vector<Vector3> &i_cloud,
                                       double i_radius);
 
+    /**
+     * @brief find the triangles which overlap a sphere
+     * @param center center of the sphere in the world coordinate
+     * @param radius radius of the sphere
+     * @param out_triangles indices of the triangles
+     */
+    void getTrianglesInSphere(const Vector3& center, double radius, std::vector<int>& out_triangles);
+
     void getBoundingBoxData(const int depth, std::vector<Vector3>& out_boxes);
         
     int getAABBTreeDepth();
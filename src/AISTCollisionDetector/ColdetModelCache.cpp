@@ -0,0 +1,268 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#include "ColdetModelCache.h"
+#include "ColdetModelInternalModel.h"
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <fmt/format.h>
+#include <fstream>
+#include <mutex>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace cnoid;
+namespace filesystem = boost::filesystem;
+namespace interprocess = boost::interprocess;
+
+namespace {
+
+// This must be incremented when the format of the file or the tree building is changed
+const uint32_t CACHE_VERSION = 1;
+
+const char CACHE_MAGIC[8] = { 'C', 'N', 'O', 'I', 'D', 'C', 'D', 'T' };
+
+// Building the tree of a small mesh is faster than loading the file
+const size_t MIN_NUM_TRIANGLES_TO_CACHE = 10000;
+
+std::mutex directoryMutex;
+std::string directory;
+bool isDirectoryInitialized = false;
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t hash;
+    uint32_t numVertices;
+    uint32_t numTriangles;
+    uint32_t numNodes;
+    uint32_t reserved;
+};
+
+struct NodeRecord
+{
+    float center[3];
+    float extents[3];
+    // The primitive index shifted with 1 for a leaf, or the index of the positive child shifted with 0
+    uint32_t data;
+    uint32_t parent;
+};
+
+string getDirectory()
+{
+    std::lock_guard<std::mutex> lock(directoryMutex);
+    if(!isDirectoryInitialized){
+        if(const char* dir = getenv("CNOID_COLDET_CACHE_DIR")){
+            directory = dir;
+        }
+        isDirectoryInitialized = true;
+    }
+    return directory;
+}
+
+}
+
+
+void ColdetModelCache::setDirectory(const std::string& dir)
+{
+    std::lock_guard<std::mutex> lock(directoryMutex);
+    directory = dir;
+    isDirectoryInitialized = true;
+}
+
+
+ColdetModelCache::ColdetModelCache(ColdetModelInternalModel* model)
+    : model(model),
+      hash(0)
+{
+    if(model->triangles.size() < MIN_NUM_TRIANGLES_TO_CACHE){
+        return;
+    }
+    string dir = getDirectory();
+    if(dir.empty()){
+        return;
+    }
+
+    hash = model->computeMeshHash();
+
+    filename = (filesystem::path(dir) / fmt::format("{:016x}.cdt", hash)).string();
+}
+
+
+bool ColdetModelCache::load()
+{
+    if(!isEnabled()){
+        return false;
+    }
+    boost::system::error_code ec;
+    if(!filesystem::exists(filename, ec)){
+        return false;
+    }
+
+    const uint32_t numVertices = model->vertices.size();
+    const uint32_t numTriangles = model->triangles.size();
+    const uint32_t numNodes = numTriangles * 2 - 1;
+    
+    try {
+        interprocess::file_mapping file(filename.c_str(), interprocess::read_only);
+        interprocess::mapped_region region(file, interprocess::read_only);
+        const char* data = static_cast<const char*>(region.get_address());
+        const size_t size = region.get_size();
+
+        const size_t expectedSize =
+            sizeof(FileHeader) + numNodes * sizeof(NodeRecord) + numTriangles * 3 * sizeof(int32_t);
+        if(size != expectedSize){
+            return false;
+        }
+        FileHeader header;
+        memcpy(&header, data, sizeof(header));
+        if(memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+           header.version != CACHE_VERSION ||
+           header.headerSize != sizeof(FileHeader) ||
+           header.hash != hash ||
+           header.numVertices != numVertices ||
+           header.numTriangles != numTriangles ||
+           header.numNodes != numNodes){
+            return false;
+        }
+
+        const NodeRecord* records = reinterpret_cast<const NodeRecord*>(data + sizeof(FileHeader));
+        std::unique_ptr<Opcode::AABBCollisionNode[]> nodes(new Opcode::AABBCollisionNode[numNodes]);
+        for(uint32_t i=0; i < numNodes; ++i){
+            const NodeRecord& record = records[i];
+            Opcode::AABBCollisionNode& node = nodes[i];
+            node.mAABB.mCenter.Set(record.center[0], record.center[1], record.center[2]);
+            node.mAABB.mExtents.Set(record.extents[0], record.extents[1], record.extents[2]);
+            if(record.data & 1){
+                if((record.data >> 1) >= numTriangles){
+                    return false;
+                }
+                node.mData = record.data;
+            } else {
+                // The negative child is next to the positive child
+                const uint32_t child = record.data >> 1;
+                if(child == 0 || child + 1 >= numNodes){
+                    return false;
+                }
+                node.mData = reinterpret_cast<EXWORD>(&nodes[child]);
+            }
+            if(record.parent >= numNodes){
+                return false;
+            }
+            node.mB = &nodes[record.parent];
+        }
+
+        const int32_t* neighborData = reinterpret_cast<const int32_t*>(
+            data + sizeof(FileHeader) + numNodes * sizeof(NodeRecord));
+        model->neighbors.resize(numTriangles);
+        for(uint32_t i=0; i < numTriangles; ++i){
+            for(int j=0; j < 3; ++j){
+                model->neighbors[i].neighbors[j] = neighborData[i * 3 + j];
+            }
+        }
+        
+        auto tree = new Opcode::AABBCollisionTree;
+        tree->SetNodes(nodes.release(), numNodes);
+        if(!model->model.SetTree(&model->iMesh, tree)){
+            delete tree;
+            model->neighbors.clear();
+            return false;
+        }
+    }
+    catch(const interprocess::interprocess_exception&){
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+   The file is written with a temporary name and renamed so that the other processes
+   loading the same mesh do not read an incomplete file.
+*/
+void ColdetModelCache::save()
+{
+    if(!isEnabled()){
+        return;
+    }
+    auto tree = dynamic_cast<const Opcode::AABBCollisionTree*>(model->model.GetTree());
+    if(!tree){
+        return;
+    }
+    const uint32_t numTriangles = model->triangles.size();
+    const uint32_t numNodes = tree->GetNbNodes();
+    if(numNodes != numTriangles * 2 - 1 || model->neighbors.size() != numTriangles){
+        return;
+    }
+
+    boost::system::error_code ec;
+    filesystem::path path(filename);
+    filesystem::create_directories(path.parent_path(), ec);
+    if(ec){
+        return;
+    }
+    filesystem::path tmpPath = path.parent_path() / filesystem::unique_path("%%%%-%%%%-%%%%.tmp", ec);
+    if(ec){
+        return;
+    }
+
+    {
+        ofstream file(tmpPath.string(), ios::out | ios::binary);
+        if(!file){
+            return;
+        }
+        FileHeader header;
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = CACHE_VERSION;
+        header.headerSize = sizeof(FileHeader);
+        header.hash = hash;
+        header.numVertices = model->vertices.size();
+        header.numTriangles = numTriangles;
+        header.numNodes = numNodes;
+        header.reserved = 0;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        const Opcode::AABBCollisionNode* nodes = tree->GetNodes();
+        vector<NodeRecord> records(numNodes);
+        for(uint32_t i=0; i < numNodes; ++i){
+            const Opcode::AABBCollisionNode& node = nodes[i];
+            NodeRecord& record = records[i];
+            const IceMaths::Point& c = node.mAABB.mCenter;
+            const IceMaths::Point& e = node.mAABB.mExtents;
+            record.center[0] = c.x; record.center[1] = c.y; record.center[2] = c.z;
+            record.extents[0] = e.x; record.extents[1] = e.y; record.extents[2] = e.z;
+            if(node.IsLeaf()){
+                record.data = node.mData;
+            } else {
+                record.data = (node.GetPos() - nodes) << 1;
+            }
+            record.parent = node.GetB() - nodes;
+        }
+        file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(NodeRecord));
+
+        vector<int32_t> neighborData(numTriangles * 3);
+        for(uint32_t i=0; i < numTriangles; ++i){
+            for(int j=0; j < 3; ++j){
+                neighborData[i * 3 + j] = model->neighbors[i][j];
+            }
+        }
+        file.write(reinterpret_cast<const char*>(neighborData.data()), neighborData.size() * sizeof(int32_t));
+
+        if(!file){
+            file.close();
+            filesystem::remove(tmpPath, ec);
+            return;
+        }
+    }
+
+    filesystem::rename(tmpPath, path, ec);
+    if(ec){
+        filesystem::remove(tmpPath, ec);
+    }
+}
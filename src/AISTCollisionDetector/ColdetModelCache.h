@@ -0,0 +1,42 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_AIST_COLLISION_DETECTOR_COLDET_MODEL_CACHE_H
+#define CNOID_AIST_COLLISION_DETECTOR_COLDET_MODEL_CACHE_H
+
+#include <string>
+#include <cstdint>
+
+namespace cnoid {
+
+class ColdetModelInternalModel;
+
+/**
+   The cache files of the built OPCODE trees.
+   A file is identified by the hash of the vertices and the triangles of a mesh and
+   has the ABI version of the nodes. The pointers of the nodes are stored as the
+   indices, which are converted into the pointers when the file is loaded.
+*/
+class ColdetModelCache
+{
+public:
+    static void setDirectory(const std::string& directory);
+    
+    ColdetModelCache(ColdetModelInternalModel* model);
+
+    bool isEnabled() const { return !filename.empty(); }
+
+    //! Sets the tree and the neighbor triangles of the model if the cache has them
+    bool load();
+    void save();
+
+private:
+    ColdetModelInternalModel* model;
+    std::string filename;
+    uint64_t hash;
+};
+
+}
+
+#endif
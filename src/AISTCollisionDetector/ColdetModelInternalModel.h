@@ -46,6 +46,7 @@ public:
     ColdetModelInternalModel();
 
     bool build();
+    uint64_t computeMeshHash() const;
 
     // need two instances ?
     Opcode::Model model;
@@ -587,7 +587,8 @@ bool ColdetModelPair::detectPlaneCylinderCollisions(bool detectAllContacts) {
 }
 
 
-double ColdetModelPair::computeDistance(ColdetModel* model0, ColdetModel* model1, double* point0, double* point1)
+double ColdetModelPair::computeDistance
+(ColdetModel* model0, ColdetModel* model1, double* point0, double* point1, double maxDistance)
 {
     if(model0->isValid() && model1->isValid()){
 
@@ -600,8 +601,10 @@ double ColdetModelPair::computeDistance(ColdetModel* model0, ColdetModel* model1
         
         float d;
         Point p0, p1;
+        const float maxD =
+            (maxDistance < std::numeric_limits<float>::max()) ? maxDistance : std::numeric_limits<float>::max();
         collider.Distance(colCache, d, p0, p1,
-                          model1->transform, model0->transform);
+                          model1->transform, model0->transform, maxD);
         point0[0] = p1.x;
         point0[1] = p1.y;
         point0[2] = p1.z;
@@ -8,6 +8,7 @@
 #include "CollisionData.h"
 #include "ColdetModel.h"
 #include "CollisionPairInserter.h"
+#include <limits>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -41,7 +42,13 @@ public:
         return !detectCollisionsSub(false).empty();
     }
 
-    static double computeDistance(ColdetModel* model0, ColdetModel* model1, double* point0, double* point1);
+    /**
+       @param maxDistance The computation stops when the distance is found to be larger than this value.
+       Then a value larger than maxDistance is returned.
+    */
+    static double computeDistance(
+        ColdetModel* model0, ColdetModel* model1, double* point0, double* point1,
+        double maxDistance = std::numeric_limits<double>::max());
     double computeDistance(double* point0, double* point1);
 
     /**
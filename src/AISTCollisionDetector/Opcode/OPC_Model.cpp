@@ -129,6 +129,28 @@ void Model::Release()
 #endif // __MESHMERIZER_H__
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Sets a collision tree built in advance instead of building it.
+ *	\param		imesh		[in] mesh interface of the tree
+ *	\param		tree		[in] collision tree, which is owned by the model
+ *	\return		true if success
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Modified for Choreonoid
+bool Model::SetTree(const MeshInterface* imesh, AABBCollisionTree* tree)
+{
+	if(!imesh || !imesh->IsValid() || !tree)	return false;
+
+	Release();
+
+	SetMeshInterface(imesh);
+	mModelCode &= ~(OPC_NO_LEAF|OPC_QUANTIZED);
+	mTree = tree;
+
+	return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
  *	Builds a collision model.
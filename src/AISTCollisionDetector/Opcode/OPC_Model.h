@@ -36,6 +36,17 @@
 		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 		override(BaseModel)	bool				Build(const OPCODECREATE& create);
 
+		// Modified for Choreonoid
+		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		/**
+		 *	Sets a collision tree built in advance instead of building it.
+		 *	\param		imesh		[in] mesh interface of the tree
+		 *	\param		tree		[in] collision tree, which is owned by the model
+		 *	\return		true if success
+		 */
+		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+							bool				SetTree(const MeshInterface* imesh, AABBCollisionTree* tree);
+
 #ifdef __MESHMERIZER_H__
 		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 		/**
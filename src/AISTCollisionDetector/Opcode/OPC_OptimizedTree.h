@@ -188,6 +188,10 @@
 	class OPCODE_API AABBCollisionTree : public AABBOptimizedTree
 	{
 		IMPLEMENT_COLLISION_TREE(AABBCollisionTree, AABBCollisionNode)
+		// Modified for Choreonoid
+		public:
+		// Sets the nodes built in advance. The tree owns the array, which must be allocated by new[].
+		inline_						void			SetNodes(AABBCollisionNode* nodes, udword nb_nodes)	{ DELETEARRAY(mNodes); mNodes = nodes; mNbNodes = nb_nodes; }
 	};
 
 	class OPCODE_API AABBNoLeafTree : public AABBOptimizedTree
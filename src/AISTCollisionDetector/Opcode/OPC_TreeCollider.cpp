@@ -52,6 +52,7 @@ AABBTreeCollider::AABBTreeCollider() :
 	mNbBVBVTests		(0),
 	mNbPrimPrimTests	(0),
 	mNbBVPrimTests		(0),
+	mNbPendingPrimTests	(0),
 	mFullBoxBoxTest		(true),
 	mFullPrimBoxTest	(true),
         collisionPairInserter(0)
@@ -356,6 +357,8 @@ bool AABBTreeCollider::Collide(const AABBCollisionTree* tree0, const AABBCollisi
 
 	// Perform collision query
 	_Collide(tree0->GetNodes(), tree1->GetNodes());
+	// Modified for Choreonoid
+	FlushPrimTests();
 
 	UPDATE_CACHE
 
@@ -529,7 +532,8 @@ void AABBTreeCollider::_Collide(const AABBCollisionNode* b0, const AABBCollision
 		{
 		  mNowNode0 = b0;
 		  mNowNode1 = b1;
-			PrimTest(b0->GetPrimitive(), b1->GetPrimitive());
+			// Modified for Choreonoid
+			QueuePrimTest(b0->GetPrimitive(), b1->GetPrimitive());
 		}
 		else
 		{
@@ -619,6 +623,92 @@ inline_ void AABBTreeCollider::PrimTestTriIndex(udword id1)
 	}
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Queues a leaf-leaf test, which is performed with the other queued tests by FlushPrimTests().
+ *	The test is performed immediately when the first contact is requested.
+ *	\param		id0		[in] index from first leaf-triangle
+ *	\param		id1		[in] index from second leaf-triangle
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Modified for Choreonoid
+inline_ void AABBTreeCollider::QueuePrimTest(udword id0, udword id1)
+{
+	if(FirstContactEnabled())
+	{
+		PrimTest(id0, id1);
+		return;
+	}
+
+	PendingPrimTest& test = mPendingPrimTests[mNbPendingPrimTests++];
+	test.id0 = id0;
+	test.id1 = id1;
+	test.node0 = mNowNode0;
+	test.node1 = mNowNode1;
+
+	if(mNbPendingPrimTests == cnoid::TRI_OVERLAP_BATCH_SIZE)	FlushPrimTests();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Performs the queued leaf-leaf tests in the queued order. The pairs separated by the supporting
+ *	plane of either triangle are rejected at once by the batched test, and only the other pairs
+ *	are given to TriTriOverlap().
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Modified for Choreonoid
+void AABBTreeCollider::FlushPrimTests()
+{
+	const udword NbTests = mNbPendingPrimTests;
+	if(!NbTests)	return;
+	mNbPendingPrimTests = 0;
+
+	Point U[cnoid::TRI_OVERLAP_BATCH_SIZE][3];
+	const Point* V[cnoid::TRI_OVERLAP_BATCH_SIZE][3];
+	cnoid::TrianglePairBatch Batch;
+
+	for(udword k=0; k<NbTests; k++)
+	{
+		const PendingPrimTest& test = mPendingPrimTests[k];
+		VertexPointers VP0;
+		VertexPointers VP1;
+		mIMesh0->GetTriangle(VP0, test.id0);
+		mIMesh1->GetTriangle(VP1, test.id1);
+		for(int i=0; i<3; i++)
+		{
+			// Transform from space 0 to space 1 as in PrimTest()
+			TransformPoint(U[k][i], *VP0.Vertex[i], mR0to1, mT0to1);
+			V[k][i] = VP1.Vertex[i];
+			Batch.p[i][0][k] = U[k][i].x;	Batch.p[i][1][k] = U[k][i].y;	Batch.p[i][2][k] = U[k][i].z;
+			Batch.q[i][0][k] = V[k][i]->x;	Batch.q[i][1][k] = V[k][i]->y;	Batch.q[i][2][k] = V[k][i]->z;
+		}
+	}
+
+	const unsigned int Mask = cnoid::findTrianglePairsNotSeparatedByFaces(Batch, NbTests);
+
+	for(udword k=0; k<NbTests; k++)
+	{
+		if(!(Mask & (1u << k)))
+		{
+			// Stats
+			mNbPrimPrimTests++;
+			continue;
+		}
+		const PendingPrimTest& test = mPendingPrimTests[k];
+		mId0 = test.id0;
+		mId1 = test.id1;
+		mNowNode0 = test.node0;
+		mNowNode1 = test.node1;
+		if(TriTriOverlap(U[k][0], U[k][1], U[k][2], *V[k][0], *V[k][1], *V[k][2]))
+		{
+			// Keep track of colliding pairs
+			mPairs.Add(test.id0).Add(test.id1);
+			// Set contact status
+			mFlags |= OPC_CONTACT;
+		}
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
  *	Leaf-leaf test for a previously fetched triangle from tree B (in A's space) and a new leaf from A.
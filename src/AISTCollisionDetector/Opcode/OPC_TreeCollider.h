@@ -210,6 +210,17 @@
 							udword          mId1;
 							const AABBCollisionNode*   mNowNode0;
 							const AABBCollisionNode*   mNowNode1;
+		// Modified for Choreonoid
+		// Leaf-leaf tests which are performed at once by the batched face separation test
+							struct PendingPrimTest
+							{
+								udword						id0;
+								udword						id1;
+								const AABBCollisionNode*	node0;
+								const AABBCollisionNode*	node1;
+							};
+							PendingPrimTest	mPendingPrimTests[cnoid::TRI_OVERLAP_BATCH_SIZE];
+							udword			mNbPendingPrimTests;
 		// Leaf description
 							Point			mLeafVerts[3];		//!< Triangle vertices
 							udword			mLeafIndex;			//!< Triangle index
@@ -233,6 +244,9 @@
 							void			_Collide(const AABBQuantizedNoLeafNode* a, const AABBQuantizedNoLeafNode* b);
 			// Overlap tests
 							void			PrimTest(udword id0, udword id1);
+			// Modified for Choreonoid
+			inline_			void			QueuePrimTest(udword id0, udword id1);
+							void			FlushPrimTests();
 			inline_			void			PrimTestTriIndex(udword id1);
 			inline_			void			PrimTestIndexTri(udword id0);
 
@@ -74,6 +74,8 @@
 	#include "OPC_IceHook.h"
 //#include<iostream>
 #include <stdint.h>
+// Modified for Choreonoid
+#include "../TriOverlapBatch.h"
 
 
 	namespace Opcode
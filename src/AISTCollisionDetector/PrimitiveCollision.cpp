@@ -0,0 +1,1058 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#include "PrimitiveCollision.h"
+#include "ColdetModel.h"
+#include <cnoid/SceneDrawables>
+#include <cnoid/EigenUtil>
+#include <algorithm>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+typedef CollisionPrimitive::Type Type;
+
+const double EPSILON = 1.0e-12;
+
+// The differences of the distances and depths below this value [m] are ignored
+const double DISTANCE_TOLERANCE = 1.0e-6;
+
+// An edge-edge axis of the box-box test is used only when it is clearly better than the face axes
+const double EDGE_AXIS_RELATIVE_TOLERANCE = 0.95;
+
+// Two segments are regarded as parallel when the sine of the angle between them is below this value
+const double PARALLEL_SEGMENTS_TOLERANCE = 1.0e-4;
+
+const int SEGMENT_BOX_SEARCH_ITERATIONS = 40;
+
+// The number of the points on a rim of a cylinder which are tested with a height field
+const int CYLINDER_RIM_DIVISION = 16;
+
+
+void addCollision(CollisionArray& collisions, const Vector3& point, const Vector3& normal, double depth)
+{
+    collisions.emplace_back();
+    Collision& c = collisions.back();
+    c.point = point;
+    c.normal = normal;
+    c.depth = depth;
+    c.id1 = 0;
+    c.id2 = 0;
+}
+
+
+void reverseNormals(CollisionArray& collisions, size_t top)
+{
+    for(size_t i = top; i < collisions.size(); ++i){
+        collisions[i].normal = -collisions[i].normal;
+    }
+}
+
+
+void getCapsuleSegment(const CollisionPrimitive& capsule, const Position& T, Vector3& out_a, Vector3& out_b)
+{
+    const Vector3 h = T.linear().col(1) * capsule.halfHeight;
+    out_a = T.translation() - h;
+    out_b = T.translation() + h;
+}
+
+
+double findClosestPointOnSegment(const Vector3& p, const Vector3& a, const Vector3& b)
+{
+    const Vector3 ab = b - a;
+    const double l2 = ab.squaredNorm();
+    if(l2 < EPSILON){
+        return 0.0;
+    }
+    return std::max(0.0, std::min(1.0, (p - a).dot(ab) / l2));
+}
+
+
+/**
+   The closest points between the segments p1-q1 and p2-q2, which are p1 + s * (q1 - p1)
+   and p2 + t * (q2 - p2). See "Real-Time Collision Detection" by C. Ericson, section 5.1.9.
+*/
+void findClosestPointsOfSegments
+(const Vector3& p1, const Vector3& q1, const Vector3& p2, const Vector3& q2, double& out_s, double& out_t)
+{
+    const Vector3 d1 = q1 - p1;
+    const Vector3 d2 = q2 - p2;
+    const Vector3 r = p1 - p2;
+    const double a = d1.squaredNorm();
+    const double e = d2.squaredNorm();
+    const double f = d2.dot(r);
+    double s, t;
+
+    if(a < EPSILON && e < EPSILON){
+        s = t = 0.0;
+    } else if(a < EPSILON){
+        s = 0.0;
+        t = std::max(0.0, std::min(1.0, f / e));
+    } else {
+        const double c = d1.dot(r);
+        if(e < EPSILON){
+            t = 0.0;
+            s = std::max(0.0, std::min(1.0, -c / a));
+        } else {
+            const double b = d1.dot(d2);
+            const double denom = a * e - b * b;
+            s = (denom > EPSILON) ? std::max(0.0, std::min(1.0, (b * f - c * e) / denom)) : 0.0;
+            t = (b * s + f) / e;
+            if(t < 0.0){
+                t = 0.0;
+                s = std::max(0.0, std::min(1.0, -c / a));
+            } else if(t > 1.0){
+                t = 1.0;
+                s = std::max(0.0, std::min(1.0, (b - c) / a));
+            }
+        }
+    }
+    out_s = s;
+    out_t = t;
+}
+
+
+//! See "Real-Time Collision Detection" by C. Ericson, section 5.1.5.
+Vector3 findClosestPointOnTriangle(const Vector3& p, const Vector3& a, const Vector3& b, const Vector3& c)
+{
+    const Vector3 ab = b - a;
+    const Vector3 ac = c - a;
+    const Vector3 ap = p - a;
+    const double d1 = ab.dot(ap);
+    const double d2 = ac.dot(ap);
+    if(d1 <= 0.0 && d2 <= 0.0){
+        return a;
+    }
+    const Vector3 bp = p - b;
+    const double d3 = ab.dot(bp);
+    const double d4 = ac.dot(bp);
+    if(d3 >= 0.0 && d4 <= d3){
+        return b;
+    }
+    const double vc = d1 * d4 - d3 * d2;
+    if(vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0){
+        return a + ab * (d1 / (d1 - d3));
+    }
+    const Vector3 cp = p - c;
+    const double d5 = ab.dot(cp);
+    const double d6 = ac.dot(cp);
+    if(d6 >= 0.0 && d5 <= d6){
+        return c;
+    }
+    const double vb = d5 * d2 - d1 * d6;
+    if(vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0){
+        return a + ac * (d2 / (d2 - d6));
+    }
+    const double va = d3 * d6 - d5 * d4;
+    if(va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0){
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+    const double denom = 1.0 / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+
+void detectSphereSphereCollision
+(const Vector3& c1, double r1, const Vector3& c2, double r2, CollisionArray& collisions)
+{
+    const Vector3 d = c2 - c1;
+    const double dist2 = d.squaredNorm();
+    const double r = r1 + r2;
+    if(dist2 > r * r){
+        return;
+    }
+    const double dist = sqrt(dist2);
+    const Vector3 normal = (dist > EPSILON) ? Vector3(d / dist) : Vector3::UnitZ();
+    const double depth = r - dist;
+    addCollision(collisions, c1 + normal * (r1 - depth / 2.0), normal, depth);
+}
+
+
+void detectSphereBoxCollision
+(const Vector3& c, double r, const Position& T, const Vector3& halfSize, CollisionArray& collisions)
+{
+    const Matrix3& R = T.linear();
+    const Vector3 q = R.transpose() * (c - T.translation());
+    const Vector3 closest = q.cwiseMax(-halfSize).cwiseMin(halfSize);
+    const Vector3 d = q - closest;
+    const double dist2 = d.squaredNorm();
+    if(dist2 > r * r){
+        return;
+    }
+    Vector3 localNormal;
+    Vector3 boxPoint;
+    double depth;
+    if(dist2 > EPSILON){
+        const double dist = sqrt(dist2);
+        localNormal = -d / dist;
+        boxPoint = closest;
+        depth = r - dist;
+    } else {
+        // The center is inside the box, so the sphere is pushed out through the nearest face
+        const Vector3 margins = halfSize - q.cwiseAbs();
+        int axis;
+        margins.minCoeff(&axis);
+        const double sign = (q[axis] >= 0.0) ? 1.0 : -1.0;
+        localNormal.setZero();
+        localNormal[axis] = -sign;
+        boxPoint = q;
+        boxPoint[axis] = sign * halfSize[axis];
+        depth = r + margins[axis];
+    }
+    const Vector3 normal = R * localNormal;
+    const Vector3 p = (T * boxPoint + c + normal * r) / 2.0;
+    addCollision(collisions, p, normal, depth);
+}
+
+
+void detectSphereCylinderCollision
+(const Vector3& c, double r, const Position& T, double radius, double halfHeight, CollisionArray& collisions)
+{
+    const Matrix3& R = T.linear();
+    const Vector3 q = R.transpose() * (c - T.translation());
+    const double rho = sqrt(q.x() * q.x() + q.z() * q.z());
+    const Vector3 radial = (rho > EPSILON) ? Vector3(q.x() / rho, 0.0, q.z() / rho) : Vector3::UnitX();
+
+    Vector3 localNormal;
+    Vector3 cylinderPoint;
+    double depth;
+
+    if(fabs(q.y()) <= halfHeight && rho <= radius){
+        const double capMargin = halfHeight - fabs(q.y());
+        const double sideMargin = radius - rho;
+        if(capMargin < sideMargin){
+            const double sign = (q.y() >= 0.0) ? 1.0 : -1.0;
+            localNormal = Vector3(0.0, -sign, 0.0);
+            cylinderPoint = Vector3(q.x(), sign * halfHeight, q.z());
+            depth = r + capMargin;
+        } else {
+            localNormal = -radial;
+            cylinderPoint = radial * radius + Vector3(0.0, q.y(), 0.0);
+            depth = r + sideMargin;
+        }
+    } else {
+        cylinderPoint = radial * std::min(rho, radius);
+        cylinderPoint.y() = std::max(-halfHeight, std::min(halfHeight, q.y()));
+        const Vector3 d = q - cylinderPoint;
+        const double dist2 = d.squaredNorm();
+        if(dist2 > r * r){
+            return;
+        }
+        const double dist = sqrt(dist2);
+        if(dist <= EPSILON){
+            return;
+        }
+        localNormal = -d / dist;
+        depth = r - dist;
+    }
+    const Vector3 normal = R * localNormal;
+    const Vector3 p = (T * cylinderPoint + c + normal * r) / 2.0;
+    addCollision(collisions, p, normal, depth);
+}
+
+
+void detectCapsuleCapsuleCollisions
+(const CollisionPrimitive& capsule1, const Position& T1,
+ const CollisionPrimitive& capsule2, const Position& T2, CollisionArray& collisions)
+{
+    Vector3 a1, b1, a2, b2;
+    getCapsuleSegment(capsule1, T1, a1, b1);
+    getCapsuleSegment(capsule2, T2, a2, b2);
+    const double r1 = capsule1.radius;
+    const double r2 = capsule2.radius;
+
+    double s, t;
+    findClosestPointsOfSegments(a1, b1, a2, b2, s, t);
+    const Vector3 p1 = a1 + (b1 - a1) * s;
+    const Vector3 p2 = a2 + (b2 - a2) * t;
+    const double r = r1 + r2;
+    if((p2 - p1).squaredNorm() > r * r){
+        return;
+    }
+
+    // Parallel capsules touch along a line, which is represented by the both ends of the overlap
+    const Vector3 d1 = b1 - a1;
+    const Vector3 d2 = b2 - a2;
+    const double l1 = d1.norm();
+    const double l2 = d2.norm();
+    if(l1 > EPSILON && l2 > EPSILON && d1.cross(d2).norm() < PARALLEL_SEGMENTS_TOLERANCE * l1 * l2){
+        const double sa = (a2 - a1).dot(d1) / (l1 * l1);
+        const double sb = (b2 - a1).dot(d1) / (l1 * l1);
+        const double lower = std::max(0.0, std::min(sa, sb));
+        const double upper = std::min(1.0, std::max(sa, sb));
+        if((upper - lower) * l1 > DISTANCE_TOLERANCE){
+            for(double si : { lower, upper }){
+                const Vector3 q1 = a1 + d1 * si;
+                const Vector3 q2 = a2 + d2 * findClosestPointOnSegment(q1, a2, b2);
+                detectSphereSphereCollision(q1, r1, q2, r2, collisions);
+            }
+            return;
+        }
+    }
+
+    detectSphereSphereCollision(p1, r1, p2, r2, collisions);
+}
+
+
+double getSquaredDistanceToBox(const Vector3& p, const Position& T, const Vector3& halfSize)
+{
+    const Vector3 q = T.linear().transpose() * (p - T.translation());
+    return (q - q.cwiseMax(-halfSize).cwiseMin(halfSize)).squaredNorm();
+}
+
+
+/**
+   The contacts of the end spheres of the capsule are generated, and the contact of the point
+   closest to the box is added when it is inside the segment. The closest point is found by the
+   ternary search because the distance to a convex shape is a convex function along a segment.
+*/
+void detectCapsuleBoxCollisions
+(const CollisionPrimitive& capsule, const Position& T1,
+ const Position& T2, const Vector3& halfSize, CollisionArray& collisions)
+{
+    Vector3 a, b;
+    getCapsuleSegment(capsule, T1, a, b);
+    const double r = capsule.radius;
+
+    detectSphereBoxCollision(a, r, T2, halfSize, collisions);
+    detectSphereBoxCollision(b, r, T2, halfSize, collisions);
+
+    double lower = 0.0;
+    double upper = 1.0;
+    const Vector3 d = b - a;
+    for(int i=0; i < SEGMENT_BOX_SEARCH_ITERATIONS; ++i){
+        const double t1 = (2.0 * lower + upper) / 3.0;
+        const double t2 = (lower + 2.0 * upper) / 3.0;
+        if(getSquaredDistanceToBox(a + d * t1, T2, halfSize) < getSquaredDistanceToBox(a + d * t2, T2, halfSize)){
+            upper = t2;
+        } else {
+            lower = t1;
+        }
+    }
+    const Vector3 p = a + d * ((lower + upper) / 2.0);
+    const double dist = sqrt(getSquaredDistanceToBox(p, T2, halfSize));
+    const double endDist = sqrt(std::min(getSquaredDistanceToBox(a, T2, halfSize), getSquaredDistanceToBox(b, T2, halfSize)));
+    if(dist < endDist - DISTANCE_TOLERANCE){
+        detectSphereBoxCollision(p, r, T2, halfSize, collisions);
+    }
+}
+
+
+/**
+   Clips the incident face of the other box by the side planes of the reference face,
+   and the points below the reference face are the contacts.
+   \param refNormal The outward normal of the reference face
+   \param normal The normal of the contacts
+*/
+void addBoxFaceContacts
+(const Position& refT, const Vector3& refHalfSize, int refAxis, const Vector3& refNormal,
+ const Position& incT, const Vector3& incHalfSize, const Vector3& normal, CollisionArray& collisions)
+{
+    const Matrix3& incR = incT.linear();
+    int incAxis;
+    (incR.transpose() * refNormal).cwiseAbs().maxCoeff(&incAxis);
+    const double incSign = (incR.col(incAxis).dot(refNormal) > 0.0) ? -1.0 : 1.0;
+    const int incAxis1 = (incAxis + 1) % 3;
+    const int incAxis2 = (incAxis + 2) % 3;
+    const Vector3 faceCenter = incT.translation() + incR.col(incAxis) * (incSign * incHalfSize[incAxis]);
+    const Vector3 u1 = incR.col(incAxis1) * incHalfSize[incAxis1];
+    const Vector3 u2 = incR.col(incAxis2) * incHalfSize[incAxis2];
+
+    const Matrix3 refRt = refT.linear().transpose();
+    const Vector3& refP = refT.translation();
+    vector<Vector3> polygon = {
+        refRt * (faceCenter + u1 + u2 - refP),
+        refRt * (faceCenter - u1 + u2 - refP),
+        refRt * (faceCenter - u1 - u2 - refP),
+        refRt * (faceCenter + u1 - u2 - refP)
+    };
+
+    // Sutherland-Hodgman clipping by the four side planes
+    vector<Vector3> clipped;
+    for(int i=1; i <= 2; ++i){
+        const int axis = (refAxis + i) % 3;
+        for(double sign : { 1.0, -1.0 }){
+            clipped.clear();
+            const int n = polygon.size();
+            for(int j=0; j < n; ++j){
+                const Vector3& p1 = polygon[j];
+                const Vector3& p2 = polygon[(j + 1) % n];
+                const double d1 = refHalfSize[axis] - sign * p1[axis];
+                const double d2 = refHalfSize[axis] - sign * p2[axis];
+                if(d1 >= 0.0){
+                    clipped.push_back(p1);
+                }
+                if((d1 >= 0.0) != (d2 >= 0.0)){
+                    clipped.push_back(p1 + (p2 - p1) * (d1 / (d1 - d2)));
+                }
+            }
+            polygon.swap(clipped);
+            if(polygon.empty()){
+                return;
+            }
+        }
+    }
+
+    const double refSign = (refT.linear().col(refAxis).dot(refNormal) > 0.0) ? 1.0 : -1.0;
+    for(auto& p : polygon){
+        const double depth = refHalfSize[refAxis] - refSign * p[refAxis];
+        if(depth >= 0.0){
+            addCollision(collisions, refT * p + refNormal * (depth / 2.0), normal, depth);
+        }
+    }
+}
+
+
+/**
+   The separating axis test of the 15 axes. The contacts are generated from the axis
+   of the minimum penetration.
+*/
+void detectBoxBoxCollisions
+(const Position& T1, const Vector3& h1, const Position& T2, const Vector3& h2, CollisionArray& collisions)
+{
+    const Matrix3& R1 = T1.linear();
+    const Matrix3& R2 = T2.linear();
+    const Vector3 d = T2.translation() - T1.translation();
+    const Matrix3 absC = (R1.transpose() * R2).cwiseAbs();
+
+    double minFacePenetration = std::numeric_limits<double>::max();
+    int faceBox = 0;
+    int faceAxis = 0;
+    Vector3 faceNormal;
+
+    for(int i=0; i < 3; ++i){
+        const Vector3 L = R1.col(i);
+        const double dist = d.dot(L);
+        const double penetration = h1[i] + h2.dot(absC.row(i)) - fabs(dist);
+        if(penetration < 0.0){
+            return;
+        }
+        if(penetration < minFacePenetration){
+            minFacePenetration = penetration;
+            faceBox = 0;
+            faceAxis = i;
+            faceNormal = (dist >= 0.0) ? L : Vector3(-L);
+        }
+    }
+    for(int i=0; i < 3; ++i){
+        const Vector3 L = R2.col(i);
+        const double dist = d.dot(L);
+        const double penetration = h2[i] + h1.dot(absC.col(i)) - fabs(dist);
+        if(penetration < 0.0){
+            return;
+        }
+        if(penetration < minFacePenetration){
+            minFacePenetration = penetration;
+            faceBox = 1;
+            faceAxis = i;
+            faceNormal = (dist >= 0.0) ? L : Vector3(-L);
+        }
+    }
+
+    double minEdgePenetration = std::numeric_limits<double>::max();
+    int edgeAxis1 = 0;
+    int edgeAxis2 = 0;
+    Vector3 edgeNormal;
+
+    for(int i=0; i < 3; ++i){
+        for(int j=0; j < 3; ++j){
+            Vector3 L = R1.col(i).cross(R2.col(j));
+            const double l = L.norm();
+            if(l < PARALLEL_SEGMENTS_TOLERANCE){
+                continue;
+            }
+            L /= l;
+            const double dist = d.dot(L);
+            const double penetration =
+                h1.dot((R1.transpose() * L).cwiseAbs()) + h2.dot((R2.transpose() * L).cwiseAbs()) - fabs(dist);
+            if(penetration < 0.0){
+                return;
+            }
+            if(penetration < minEdgePenetration){
+                minEdgePenetration = penetration;
+                edgeAxis1 = i;
+                edgeAxis2 = j;
+                edgeNormal = (dist >= 0.0) ? L : Vector3(-L);
+            }
+        }
+    }
+
+    if(minEdgePenetration <
+       minFacePenetration * EDGE_AXIS_RELATIVE_TOLERANCE - DISTANCE_TOLERANCE){
+        // The support edges of the both boxes in the direction of the normal
+        const Vector3& n = edgeNormal;
+        Vector3 p1 = T1.translation();
+        Vector3 p2 = T2.translation();
+        for(int k=0; k < 3; ++k){
+            if(k != edgeAxis1){
+                p1 += R1.col(k) * ((R1.col(k).dot(n) > 0.0) ? h1[k] : -h1[k]);
+            }
+            if(k != edgeAxis2){
+                p2 -= R2.col(k) * ((R2.col(k).dot(n) > 0.0) ? h2[k] : -h2[k]);
+            }
+        }
+        const Vector3& u = R1.col(edgeAxis1);
+        const Vector3& v = R2.col(edgeAxis2);
+        const Vector3 w = p1 - p2;
+        const double b = u.dot(v);
+        const double du = u.dot(w);
+        const double dv = v.dot(w);
+        const double denom = 1.0 - b * b;
+        double s = 0.0;
+        double t = 0.0;
+        if(denom > EPSILON){
+            s = std::max(-h1[edgeAxis1], std::min(h1[edgeAxis1], (b * dv - du) / denom));
+            t = std::max(-h2[edgeAxis2], std::min(h2[edgeAxis2], (dv - b * du) / denom));
+        }
+        addCollision(collisions, ((p1 + u * s) + (p2 + v * t)) / 2.0, n, minEdgePenetration);
+
+    } else if(faceBox == 0){
+        addBoxFaceContacts(T1, h1, faceAxis, faceNormal, T2, h2, faceNormal, collisions);
+    } else {
+        addBoxFaceContacts(T2, h2, faceAxis, -faceNormal, T1, h1, faceNormal, collisions);
+    }
+}
+
+
+struct TriangleContact
+{
+    Vector3 point;
+    Vector3 normal;
+    double depth;
+};
+
+
+/**
+   The contact of a sphere with the front side of a triangle.
+   \param faceNormal The unit normal of the triangle, which is directed to the outside of the mesh
+*/
+bool findSphereTriangleContact
+(const Vector3& c, double r, const Vector3& v0, const Vector3& v1, const Vector3& v2,
+ const Vector3& faceNormal, TriangleContact& out_contact)
+{
+    if((c - v0).dot(faceNormal) < 0.0){
+        return false;
+    }
+    const Vector3 q = findClosestPointOnTriangle(c, v0, v1, v2);
+    const Vector3 d = q - c;
+    const double dist2 = d.squaredNorm();
+    if(dist2 >= r * r){
+        return false;
+    }
+    const double dist = sqrt(dist2);
+    out_contact.normal = (dist > EPSILON) ? Vector3(d / dist) : Vector3(-faceNormal);
+    out_contact.depth = r - dist;
+    out_contact.point = (q + c + out_contact.normal * r) / 2.0;
+    return true;
+}
+
+
+/**
+   The contacts of a triangle with a sphere or a capsule whose segment is from a to b.
+*/
+void findSphereSegmentTriangleContacts
+(const Vector3& a, const Vector3& b, double r, bool isSegment, const Vector3 v[3], vector<TriangleContact>& contacts)
+{
+    Vector3 faceNormal = (v[1] - v[0]).cross(v[2] - v[0]);
+    const double l = faceNormal.norm();
+    if(l < EPSILON){
+        return;
+    }
+    faceNormal /= l;
+
+    TriangleContact contact;
+    double endDepth = 0.0;
+    if(findSphereTriangleContact(a, r, v[0], v[1], v[2], faceNormal, contact)){
+        endDepth = contact.depth;
+        contacts.push_back(contact);
+    }
+    if(isSegment){
+        if(findSphereTriangleContact(b, r, v[0], v[1], v[2], faceNormal, contact)){
+            endDepth = std::max(endDepth, contact.depth);
+            contacts.push_back(contact);
+        }
+        // The point of the segment closest to the triangle edges
+        double minDist2 = std::numeric_limits<double>::max();
+        Vector3 p;
+        for(int i=0; i < 3; ++i){
+            double s, t;
+            findClosestPointsOfSegments(a, b, v[i], v[(i + 1) % 3], s, t);
+            const Vector3 ps = a + (b - a) * s;
+            const double dist2 = (v[i] + (v[(i + 1) % 3] - v[i]) * t - ps).squaredNorm();
+            if(dist2 < minDist2){
+                minDist2 = dist2;
+                p = ps;
+            }
+        }
+        if(findSphereTriangleContact(p, r, v[0], v[1], v[2], faceNormal, contact) &&
+           contact.depth > endDepth + DISTANCE_TOLERANCE){
+            contacts.push_back(contact);
+        }
+    }
+}
+
+
+/**
+   The contacts of the spheres on a capsule are sorted by the depth, and a contact is discarded
+   when it is closer than the radius to a deeper one. This removes the contacts of the adjacent
+   triangles of the same surface while the contacts with the different surfaces remain.
+*/
+void addFilteredTriangleContacts
+(vector<TriangleContact>& contacts, double radius, CollisionArray& collisions)
+{
+    std::sort(contacts.begin(), contacts.end(),
+              [](const TriangleContact& c1, const TriangleContact& c2){ return c1.depth > c2.depth; });
+    const size_t top = collisions.size();
+    const double r2 = radius * radius;
+    for(auto& contact : contacts){
+        bool isRedundant = false;
+        for(size_t i = top; i < collisions.size(); ++i){
+            if((collisions[i].point - contact.point).squaredNorm() < r2){
+                isRedundant = true;
+                break;
+            }
+        }
+        if(!isRedundant){
+            addCollision(collisions, contact.point, contact.normal, contact.depth);
+        }
+    }
+}
+
+
+float getHeight(const CollisionPrimitive& field, int x, int z)
+{
+    return (*field.heights)[z * field.xDimension + x];
+}
+
+
+/**
+   Finds the triangle of the height field under a point in the local coordinate of the field.
+   The cell of the point is directly computed from the coordinate.
+   \return false if the point is outside the grid
+*/
+bool findHeightFieldSurface
+(const CollisionPrimitive& field, const Vector3& p, double& out_height, Vector3& out_normal)
+{
+    const double u = p.x() / field.xSpacing;
+    const double v = p.z() / field.zSpacing;
+    if(u < 0.0 || v < 0.0 || u > field.xDimension - 1 || v > field.zDimension - 1){
+        return false;
+    }
+    const int x = std::min(static_cast<int>(u), field.xDimension - 2);
+    const int z = std::min(static_cast<int>(v), field.zDimension - 2);
+    const double fx = u - x;
+    const double fz = v - z;
+    const double h00 = getHeight(field, x, z);
+    double a, b;
+    // The cell is divided by the diagonal from (x, z) to (x + 1, z + 1)
+    if(fz >= fx){
+        a = getHeight(field, x + 1, z + 1) - getHeight(field, x, z + 1);
+        b = getHeight(field, x, z + 1) - h00;
+    } else {
+        a = getHeight(field, x + 1, z) - h00;
+        b = getHeight(field, x + 1, z + 1) - getHeight(field, x + 1, z);
+    }
+    out_height = h00 + a * fx + b * fz;
+    out_normal = Vector3(-a / field.xSpacing, 1.0, -b / field.zSpacing).normalized();
+    return true;
+}
+
+
+/**
+   The points below the surface of the height field are the contacts.
+   The normals are directed from the height field to the points.
+   \param T The position of the height field in the world coordinate
+*/
+void detectHeightFieldPointCollisions
+(const CollisionPrimitive& field, const Position& T, const vector<Vector3>& points, CollisionArray& collisions)
+{
+    const Position Tinv = T.inverse(Eigen::Isometry);
+    for(auto& point : points){
+        const Vector3 p = Tinv * point;
+        if(p.y() > field.maxHeight){
+            continue;
+        }
+        double height;
+        Vector3 normal;
+        if(findHeightFieldSurface(field, p, height, normal)){
+            const double depth = (height - p.y()) * normal.y();
+            if(depth > 0.0){
+                const Vector3 worldNormal = T.linear() * normal;
+                addCollision(collisions, point + worldNormal * (depth / 2.0), worldNormal, depth);
+            }
+        }
+    }
+}
+
+
+/**
+   Calls the function for the triangles of the cells overlapping the range of the x-z plane.
+   The range is given in the local coordinate of the field, and the vertices of the triangles
+   are given in the world coordinate.
+*/
+template<class Function>
+void forEachHeightFieldTriangle
+(const CollisionPrimitive& field, const Position& T, const Vector3& localMin, const Vector3& localMax,
+ Function function)
+{
+    if(localMax.y() < field.minHeight || localMin.y() > field.maxHeight){
+        return;
+    }
+    const int x0 = std::max(0, static_cast<int>(floor(localMin.x() / field.xSpacing)));
+    const int x1 = std::min(field.xDimension - 2, static_cast<int>(floor(localMax.x() / field.xSpacing)));
+    const int z0 = std::max(0, static_cast<int>(floor(localMin.z() / field.zSpacing)));
+    const int z1 = std::min(field.zDimension - 2, static_cast<int>(floor(localMax.z() / field.zSpacing)));
+
+    auto vertex = [&](int x, int z){
+        return T * Vector3(x * field.xSpacing, getHeight(field, x, z), z * field.zSpacing); };
+    
+    Vector3 v[3];
+    for(int z = z0; z <= z1; ++z){
+        for(int x = x0; x <= x1; ++x){
+            const Vector3 v00 = vertex(x, z);
+            const Vector3 v11 = vertex(x + 1, z + 1);
+            v[0] = v00;
+            v[1] = vertex(x, z + 1);
+            v[2] = v11;
+            function(v);
+            v[0] = v00;
+            v[1] = v11;
+            v[2] = vertex(x + 1, z);
+            function(v);
+        }
+    }
+}
+
+
+/**
+   The triangles of the cells under a sphere or a capsule are tested in the same way as the triangles of a mesh.
+   The normals are directed from the primitive to the height field.
+*/
+void detectSphereCapsuleHeightFieldCollisions
+(const CollisionPrimitive& primitive, const Position& T1,
+ const CollisionPrimitive& field, const Position& T2, CollisionArray& collisions)
+{
+    Vector3 a, b;
+    const bool isSegment = (primitive.type == CollisionPrimitive::CAPSULE);
+    if(isSegment){
+        getCapsuleSegment(primitive, T1, a, b);
+    } else {
+        a = b = T1.translation();
+    }
+    const double r = primitive.radius;
+    const Position Tinv = T2.inverse(Eigen::Isometry);
+    const Vector3 la = Tinv * a;
+    const Vector3 lb = Tinv * b;
+    const Vector3 margin = Vector3::Constant(r);
+
+    vector<TriangleContact> contacts;
+    forEachHeightFieldTriangle(
+        field, T2, la.cwiseMin(lb) - margin, la.cwiseMax(lb) + margin,
+        [&](const Vector3 v[3]){ findSphereSegmentTriangleContacts(a, b, r, isSegment, v, contacts); });
+
+    addFilteredTriangleContacts(contacts, r, collisions);
+}
+
+
+/**
+   The corners of a box and the points on the rims of a cylinder are tested with the surface.
+   The normals are directed from the height field to the primitive.
+*/
+void detectBoxCylinderHeightFieldCollisions
+(const CollisionPrimitive& primitive, const Position& T1,
+ const CollisionPrimitive& field, const Position& T2, CollisionArray& collisions)
+{
+    vector<Vector3> points;
+    if(primitive.type == CollisionPrimitive::BOX){
+        const Vector3& h = primitive.halfSize;
+        for(int i=0; i < 8; ++i){
+            points.push_back(T1 * Vector3((i & 1) ? h.x() : -h.x(), (i & 2) ? h.y() : -h.y(), (i & 4) ? h.z() : -h.z()));
+        }
+    } else {
+        for(int i=0; i < CYLINDER_RIM_DIVISION; ++i){
+            const double angle = 2.0 * PI * i / CYLINDER_RIM_DIVISION;
+            const double x = primitive.radius * cos(angle);
+            const double z = primitive.radius * sin(angle);
+            points.push_back(T1 * Vector3(x, primitive.halfHeight, z));
+            points.push_back(T1 * Vector3(x, -primitive.halfHeight, z));
+        }
+    }
+    detectHeightFieldPointCollisions(field, T2, points, collisions);
+}
+
+}
+
+
+bool CollisionPrimitive::set(const SgMesh* mesh, const Affine3& T)
+{
+    type = NONE;
+
+    switch(mesh->primitiveType()){
+    case SgMesh::BOX:
+        type = BOX;
+        halfSize = mesh->primitive<SgMesh::Box>().size / 2.0;
+        break;
+    case SgMesh::SPHERE:
+        type = SPHERE;
+        radius = mesh->primitive<SgMesh::Sphere>().radius;
+        break;
+    case SgMesh::CAPSULE: {
+        auto& capsule = mesh->primitive<SgMesh::Capsule>();
+        type = CAPSULE;
+        radius = capsule.radius;
+        halfHeight = capsule.height / 2.0;
+        break;
+    }
+    case SgMesh::CYLINDER: {
+        // A cylinder without a cap is not a solid
+        auto& cylinder = mesh->primitive<SgMesh::Cylinder>();
+        if(cylinder.top && cylinder.bottom && cylinder.side){
+            type = CYLINDER;
+            radius = cylinder.radius;
+            halfHeight = cylinder.height / 2.0;
+        }
+        break;
+    }
+    case SgMesh::HEIGHT_FIELD: {
+        auto& field = mesh->primitive<SgMesh::HeightField>();
+        if(field.heights && field.xDimension >= 2 && field.zDimension >= 2 &&
+           static_cast<int>(field.heights->size()) == field.xDimension * field.zDimension){
+            type = HEIGHT_FIELD;
+            heights = field.heights;
+            xDimension = field.xDimension;
+            zDimension = field.zDimension;
+            xSpacing = field.xSpacing;
+            zSpacing = field.zSpacing;
+            auto range = std::minmax_element(heights->begin(), heights->end());
+            minHeight = *range.first;
+            maxHeight = *range.second;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    if(type != NONE){
+        localPosition.linear() = T.linear();
+        localPosition.translation() = T.translation();
+    }
+
+    return (type != NONE);
+}
+
+
+void CollisionPrimitive::getLocalBox(Vector3& out_center, Vector3& out_extents) const
+{
+    Vector3 center = Vector3::Zero();
+    Vector3 extents;
+    switch(type){
+    case BOX:
+        extents = halfSize;
+        break;
+    case SPHERE:
+        extents.setConstant(radius);
+        break;
+    case CAPSULE:
+        extents = Vector3(radius, halfHeight + radius, radius);
+        break;
+    case CYLINDER:
+        extents = Vector3(radius, halfHeight, radius);
+        break;
+    case HEIGHT_FIELD:
+        extents = Vector3(xSpacing * (xDimension - 1), maxHeight - minHeight, zSpacing * (zDimension - 1)) / 2.0;
+        center = Vector3(extents.x(), (minHeight + maxHeight) / 2.0, extents.z());
+        break;
+    default:
+        extents.setZero();
+        break;
+    }
+    out_center = localPosition * center;
+    out_extents = localPosition.linear().cwiseAbs() * extents;
+}
+
+
+bool cnoid::isPrimitivePairSupported(Type type1, Type type2)
+{
+    if(type1 == CollisionPrimitive::NONE || type2 == CollisionPrimitive::NONE){
+        return false;
+    }
+    // A pair of height fields is not handled because they are usually static
+    if(type1 == CollisionPrimitive::HEIGHT_FIELD || type2 == CollisionPrimitive::HEIGHT_FIELD){
+        return (type1 != type2);
+    }
+    if(type1 == CollisionPrimitive::CYLINDER || type2 == CollisionPrimitive::CYLINDER){
+        return (type1 == CollisionPrimitive::SPHERE || type2 == CollisionPrimitive::SPHERE);
+    }
+    return true;
+}
+
+
+bool cnoid::isPrimitiveMeshPairSupported(Type type)
+{
+    return (type == CollisionPrimitive::SPHERE ||
+            type == CollisionPrimitive::CAPSULE ||
+            type == CollisionPrimitive::HEIGHT_FIELD);
+}
+
+
+void cnoid::addHeightFieldTriangles(const CollisionPrimitive& field, ColdetModel* model)
+{
+    const int top = model->getNumVertices();
+    for(int z=0; z < field.zDimension; ++z){
+        for(int x=0; x < field.xDimension; ++x){
+            const Vector3 v = field.localPosition * Vector3(x * field.xSpacing, getHeight(field, x, z), z * field.zSpacing);
+            model->addVertex(v.x(), v.y(), v.z());
+        }
+    }
+    for(int z=0; z < field.zDimension - 1; ++z){
+        for(int x=0; x < field.xDimension - 1; ++x){
+            const int v00 = top + z * field.xDimension + x;
+            const int v01 = v00 + field.xDimension;
+            model->addTriangle(v00, v01, v01 + 1);
+            model->addTriangle(v00, v01 + 1, v00 + 1);
+        }
+    }
+}
+
+
+void cnoid::detectPrimitiveCollisions
+(const CollisionPrimitive& primitive1, const Position& T1,
+ const CollisionPrimitive& primitive2, const Position& T2,
+ CollisionArray& collisions)
+{
+    // The pair is swapped so that the type of the first primitive is not greater than the second one
+    if(primitive1.type > primitive2.type){
+        const size_t top = collisions.size();
+        detectPrimitiveCollisions(primitive2, T2, primitive1, T1, collisions);
+        reverseNormals(collisions, top);
+        return;
+    }
+
+    switch(primitive1.type){
+
+    case CollisionPrimitive::SPHERE: {
+        const Vector3& c = T1.translation();
+        const double r = primitive1.radius;
+        switch(primitive2.type){
+        case CollisionPrimitive::SPHERE:
+            detectSphereSphereCollision(c, r, T2.translation(), primitive2.radius, collisions);
+            break;
+        case CollisionPrimitive::BOX:
+            detectSphereBoxCollision(c, r, T2, primitive2.halfSize, collisions);
+            break;
+        case CollisionPrimitive::CAPSULE: {
+            Vector3 a, b;
+            getCapsuleSegment(primitive2, T2, a, b);
+            const Vector3 p = a + (b - a) * findClosestPointOnSegment(c, a, b);
+            detectSphereSphereCollision(c, r, p, primitive2.radius, collisions);
+            break;
+        }
+        case CollisionPrimitive::CYLINDER:
+            detectSphereCylinderCollision(c, r, T2, primitive2.radius, primitive2.halfHeight, collisions);
+            break;
+        case CollisionPrimitive::HEIGHT_FIELD:
+            detectSphereCapsuleHeightFieldCollisions(primitive1, T1, primitive2, T2, collisions);
+            break;
+        default:
+            break;
+        }
+        break;
+    }
+
+    case CollisionPrimitive::BOX:
+        if(primitive2.type == CollisionPrimitive::BOX){
+            detectBoxBoxCollisions(T1, primitive1.halfSize, T2, primitive2.halfSize, collisions);
+        } else if(primitive2.type == CollisionPrimitive::CAPSULE){
+            const size_t top = collisions.size();
+            detectCapsuleBoxCollisions(primitive2, T2, T1, primitive1.halfSize, collisions);
+            reverseNormals(collisions, top);
+        } else if(primitive2.type == CollisionPrimitive::HEIGHT_FIELD){
+            const size_t top = collisions.size();
+            detectBoxCylinderHeightFieldCollisions(primitive1, T1, primitive2, T2, collisions);
+            reverseNormals(collisions, top);
+        }
+        break;
+
+    case CollisionPrimitive::CAPSULE:
+        if(primitive2.type == CollisionPrimitive::CAPSULE){
+            detectCapsuleCapsuleCollisions(primitive1, T1, primitive2, T2, collisions);
+        } else if(primitive2.type == CollisionPrimitive::HEIGHT_FIELD){
+            detectSphereCapsuleHeightFieldCollisions(primitive1, T1, primitive2, T2, collisions);
+        }
+        break;
+
+    case CollisionPrimitive::CYLINDER:
+        if(primitive2.type == CollisionPrimitive::HEIGHT_FIELD){
+            const size_t top = collisions.size();
+            detectBoxCylinderHeightFieldCollisions(primitive1, T1, primitive2, T2, collisions);
+            reverseNormals(collisions, top);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+/**
+   The triangles overlapping the bounding sphere of the primitive are tested with the spheres
+   of the primitive, which are the sphere itself or the end spheres of a capsule. The point of a
+   capsule segment closest to a triangle is also tested when it is deeper than the end spheres.
+   The vertices of a mesh below the surface of a height field are its contacts.
+*/
+void cnoid::detectPrimitiveMeshCollisions
+(const CollisionPrimitive& primitive, const Position& T,
+ ColdetModel* mesh, const Position& meshPosition, CollisionArray& collisions)
+{
+    if(primitive.type == CollisionPrimitive::HEIGHT_FIELD){
+        const int n = mesh->getNumVertices();
+        vector<Vector3> points(n);
+        for(int i=0; i < n; ++i){
+            float x, y, z;
+            mesh->getVertex(i, x, y, z);
+            points[i] = meshPosition * Vector3(x, y, z);
+        }
+        detectHeightFieldPointCollisions(primitive, T, points, collisions);
+        return;
+    }
+
+    Vector3 a, b;
+    double boundingRadius;
+    if(primitive.type == CollisionPrimitive::SPHERE){
+        a = b = T.translation();
+        boundingRadius = primitive.radius;
+    } else if(primitive.type == CollisionPrimitive::CAPSULE){
+        getCapsuleSegment(primitive, T, a, b);
+        boundingRadius = primitive.halfHeight + primitive.radius;
+    } else {
+        return;
+    }
+    const double r = primitive.radius;
+    const bool isSegment = (primitive.type == CollisionPrimitive::CAPSULE);
+
+    vector<int> triangles;
+    mesh->getTrianglesInSphere(T.translation(), boundingRadius, triangles);
+    if(triangles.empty()){
+        return;
+    }
+
+    vector<TriangleContact> contacts;
+    for(auto triangle : triangles){
+        int indices[3];
+        mesh->getTriangle(triangle, indices[0], indices[1], indices[2]);
+        Vector3 v[3];
+        for(int i=0; i < 3; ++i){
+            float x, y, z;
+            mesh->getVertex(indices[i], x, y, z);
+            v[i] = meshPosition * Vector3(x, y, z);
+        }
+        findSphereSegmentTriangleContacts(a, b, r, isSegment, v, contacts);
+    }
+
+    addFilteredTriangleContacts(contacts, r, collisions);
+}
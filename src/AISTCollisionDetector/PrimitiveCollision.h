@@ -0,0 +1,91 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_AIST_COLLISION_DETECTOR_PRIMITIVE_COLLISION_H
+#define CNOID_AIST_COLLISION_DETECTOR_PRIMITIVE_COLLISION_H
+
+#include <cnoid/Collision>
+#include <cnoid/EigenTypes>
+#include <vector>
+#include <memory>
+
+namespace cnoid {
+
+class SgMesh;
+class ColdetModel;
+
+/**
+   The shape of a geometry which consists of a single primitive.
+   The axis of a capsule or a cylinder is the y axis as in the primitives of SgMesh.
+   A height field is the grid on the x-z plane whose heights are the y coordinates.
+*/
+struct CollisionPrimitive
+{
+    enum Type { NONE, SPHERE, BOX, CAPSULE, CYLINDER, HEIGHT_FIELD };
+
+    Type type;
+    Vector3 halfSize;  //!< for a box
+    double radius;     //!< for a sphere, a capsule and a cylinder
+    double halfHeight; //!< for a capsule and a cylinder. The length of the cylinder part of a capsule.
+
+    // for a height field
+    std::shared_ptr<const std::vector<float>> heights;
+    int xDimension;
+    int zDimension;
+    double xSpacing;
+    double zSpacing;
+    double minHeight;
+    double maxHeight;
+
+    //! The position in the coordinate of the geometry
+    Position localPosition;
+
+    CollisionPrimitive() : type(NONE) { }
+
+    /**
+       \param T The transform of the mesh without the scaling
+       \return false if the mesh is not a primitive which can be handled
+    */
+    bool set(const SgMesh* mesh, const Affine3& T);
+
+    void clear() { type = NONE; heights.reset(); }
+
+    //! The axis-aligned bounding box in the coordinate of the geometry
+    void getLocalBox(Vector3& out_center, Vector3& out_extents) const;
+};
+
+bool isPrimitivePairSupported(CollisionPrimitive::Type type1, CollisionPrimitive::Type type2);
+bool isPrimitiveMeshPairSupported(CollisionPrimitive::Type type);
+
+/**
+   Appends the vertices and the triangles of a height field to the model. This is used when
+   a height field is combined with other meshes in a geometry.
+*/
+void addHeightFieldTriangles(const CollisionPrimitive& heightField, ColdetModel* model);
+
+/**
+   Appends the contacts between two primitives to collisions.
+   The normals are directed from the first primitive to the second one.
+   \param T1 The position of the first primitive in the world coordinate
+   \param T2 The position of the second primitive in the world coordinate
+*/
+void detectPrimitiveCollisions(
+    const CollisionPrimitive& primitive1, const Position& T1,
+    const CollisionPrimitive& primitive2, const Position& T2,
+    CollisionArray& collisions);
+
+/**
+   Appends the contacts between a primitive and the triangles of a mesh to collisions.
+   The normals are directed from the primitive to the mesh.
+   \param T The position of the primitive in the world coordinate
+   \param meshPosition The position of the mesh, which must also be set to the mesh model
+*/
+void detectPrimitiveMeshCollisions(
+    const CollisionPrimitive& primitive, const Position& T,
+    ColdetModel* mesh, const Position& meshPosition,
+    CollisionArray& collisions);
+
+}
+
+#endif
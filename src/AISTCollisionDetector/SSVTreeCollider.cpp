@@ -13,7 +13,8 @@ SSVTreeCollider::SSVTreeCollider()
     
 bool SSVTreeCollider::Distance(BVTCache& cache, 
                                float& minD, Point &point0, Point&point1,
-                               const Matrix4x4* world0, const Matrix4x4* world1)
+                               const Matrix4x4* world0, const Matrix4x4* world1,
+                               float maxD)
 {
     // Checkings
     if(!cache.Model0 || !cache.Model1)                             return false;
@@ -26,14 +27,14 @@ bool SSVTreeCollider::Distance(BVTCache& cache,
     // Simple double-dispatch
     const AABBCollisionTree* T0 = (const AABBCollisionTree*)cache.Model0->GetTree();
     const AABBCollisionTree* T1 = (const AABBCollisionTree*)cache.Model1->GetTree();
-    Distance(T0, T1, world0, world1, &cache, minD, point0, point1);
+    Distance(T0, T1, world0, world1, &cache, minD, point0, point1, maxD);
     return true;
 }
 
 void SSVTreeCollider::Distance(const AABBCollisionTree* tree0, 
                                const AABBCollisionTree* tree1, 
                                const Matrix4x4* world0, const Matrix4x4* world1, 
-                               Pair* cache, float& minD, Point &point0, Point&point1)
+                               Pair* cache, float& minD, Point &point0, Point&point1, float maxD)
 {
     if (debug) std::cout << "Distance()" << std::endl;
     // Init collision query
@@ -59,10 +60,21 @@ void SSVTreeCollider::Distance(const AABBCollisionTree* tree0,
     } 
     Point p0, p1;
     minD = PrimDist(mId0, mId1, p0, p1);
+
+    // Modified for Choreonoid
+    // The nodes beyond maxD are pruned. The initial pair is kept if no pair within maxD is found.
+    const float initialD = minD;
+    if(minD > maxD){
+        minD = maxD;
+    }
     
     // Perform distance computation
     _Distance(tree0->GetNodes(), tree1->GetNodes(), minD, p0, p1);
 
+    if(initialD > maxD && minD >= maxD){
+        minD = initialD;
+    }
+
     // transform points
     TransformPoint4x3(point0, p0, *world1);
     TransformPoint4x3(point1, p1, *world1);
@@ -0,0 +1,188 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#include "TriOverlapBatch.h"
+#include <cmath>
+
+#if defined(CNOID_TRI_OVERLAP_BATCH_AVX2)
+#include <immintrin.h>
+#elif defined(CNOID_TRI_OVERLAP_BATCH_SSE4)
+#include <smmintrin.h>
+#elif defined(CNOID_TRI_OVERLAP_BATCH_NEON)
+#include <arm_neon.h>
+#endif
+
+using namespace cnoid;
+
+namespace {
+
+// The relative tolerance of the signed distances for the rounding errors
+const double SIGN_TOLERANCE = 1.0e-10;
+
+/*
+  Each of the following types is a set of the lanes which corresponds to the pairs processed at once.
+  The test is written once as a template for the types.
+*/
+
+struct ScalarLanes
+{
+    static const int size = 1;
+    double v;
+    ScalarLanes() { }
+    ScalarLanes(double x) : v(x) { }
+    static ScalarLanes load(const double* p) { return ScalarLanes(*p); }
+    friend ScalarLanes operator+(ScalarLanes a, ScalarLanes b) { return a.v + b.v; }
+    friend ScalarLanes operator-(ScalarLanes a, ScalarLanes b) { return a.v - b.v; }
+    friend ScalarLanes operator*(ScalarLanes a, ScalarLanes b) { return a.v * b.v; }
+    friend ScalarLanes abs(ScalarLanes a) { return std::fabs(a.v); }
+    // Returns the bits of the lanes where a > b
+    friend unsigned int greaterMask(ScalarLanes a, ScalarLanes b) { return a.v > b.v ? 1 : 0; }
+};
+
+#if defined(CNOID_TRI_OVERLAP_BATCH_AVX2)
+
+struct SimdLanes
+{
+    static const int size = 4;
+    __m256d v;
+    SimdLanes() { }
+    SimdLanes(__m256d x) : v(x) { }
+    SimdLanes(double x) : v(_mm256_set1_pd(x)) { }
+    static SimdLanes load(const double* p) { return _mm256_loadu_pd(p); }
+    friend SimdLanes operator+(SimdLanes a, SimdLanes b) { return _mm256_add_pd(a.v, b.v); }
+    friend SimdLanes operator-(SimdLanes a, SimdLanes b) { return _mm256_sub_pd(a.v, b.v); }
+    friend SimdLanes operator*(SimdLanes a, SimdLanes b) { return _mm256_mul_pd(a.v, b.v); }
+    friend SimdLanes abs(SimdLanes a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v); }
+    friend unsigned int greaterMask(SimdLanes a, SimdLanes b) {
+        return _mm256_movemask_pd(_mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ));
+    }
+};
+
+#elif defined(CNOID_TRI_OVERLAP_BATCH_SSE4)
+
+struct SimdLanes
+{
+    static const int size = 2;
+    __m128d v;
+    SimdLanes() { }
+    SimdLanes(__m128d x) : v(x) { }
+    SimdLanes(double x) : v(_mm_set1_pd(x)) { }
+    static SimdLanes load(const double* p) { return _mm_loadu_pd(p); }
+    friend SimdLanes operator+(SimdLanes a, SimdLanes b) { return _mm_add_pd(a.v, b.v); }
+    friend SimdLanes operator-(SimdLanes a, SimdLanes b) { return _mm_sub_pd(a.v, b.v); }
+    friend SimdLanes operator*(SimdLanes a, SimdLanes b) { return _mm_mul_pd(a.v, b.v); }
+    friend SimdLanes abs(SimdLanes a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a.v); }
+    friend unsigned int greaterMask(SimdLanes a, SimdLanes b) { return _mm_movemask_pd(_mm_cmpgt_pd(a.v, b.v)); }
+};
+
+#elif defined(CNOID_TRI_OVERLAP_BATCH_NEON)
+
+struct SimdLanes
+{
+    static const int size = 2;
+    float64x2_t v;
+    SimdLanes() { }
+    SimdLanes(float64x2_t x) : v(x) { }
+    SimdLanes(double x) : v(vdupq_n_f64(x)) { }
+    static SimdLanes load(const double* p) { return vld1q_f64(p); }
+    friend SimdLanes operator+(SimdLanes a, SimdLanes b) { return vaddq_f64(a.v, b.v); }
+    friend SimdLanes operator-(SimdLanes a, SimdLanes b) { return vsubq_f64(a.v, b.v); }
+    friend SimdLanes operator*(SimdLanes a, SimdLanes b) { return vmulq_f64(a.v, b.v); }
+    friend SimdLanes abs(SimdLanes a) { return vabsq_f64(a.v); }
+    friend unsigned int greaterMask(SimdLanes a, SimdLanes b) {
+        uint64x2_t c = vcgtq_f64(a.v, b.v);
+        return (vgetq_lane_u64(c, 0) & 1) | ((vgetq_lane_u64(c, 1) & 1) << 1);
+    }
+};
+
+#else
+
+typedef ScalarLanes SimdLanes;
+
+#endif
+
+template<class T>
+struct Vec3
+{
+    T x, y, z;
+    Vec3() { }
+    Vec3(T x, T y, T z) : x(x), y(y), z(z) { }
+    Vec3 operator-(const Vec3& b) const { return Vec3(x - b.x, y - b.y, z - b.z); }
+    // The same order of the operations as Eigen's cross and dot
+    Vec3 cross(const Vec3& b) const { return Vec3(y * b.z - z * b.y, z * b.x - x * b.z, x * b.y - y * b.x); }
+    T dot(const Vec3& b) const { return x * b.x + y * b.y + z * b.z; }
+    T absDot(const Vec3& b) const { return abs(x * b.x) + abs(y * b.y) + abs(z * b.z); }
+};
+
+template<class T>
+Vec3<T> loadVertex(const double (&vertex)[3][TRI_OVERLAP_BATCH_SIZE], int lane)
+{
+    return Vec3<T>(T::load(&vertex[0][lane]), T::load(&vertex[1][lane]), T::load(&vertex[2][lane]));
+}
+
+template<class T>
+unsigned int isSeparated(const T (&d)[3], const T (&tol)[3])
+{
+    const T zero(0.0);
+    unsigned int positive = greaterMask(d[0] - tol[0], zero);
+    unsigned int negative = greaterMask(zero, d[0] + tol[0]);
+    for(int i=1; i < 3; ++i){
+        positive &= greaterMask(d[i] - tol[i], zero);
+        negative &= greaterMask(zero, d[i] + tol[i]);
+    }
+    return positive | negative;
+}
+
+/**
+   The vertices are translated so that the first vertex of the first triangle is the origin
+   as in tri_tri_overlap().
+*/
+template<class T>
+unsigned int findNotSeparatedPairs(const TrianglePairBatch& batch, int lane)
+{
+    const Vec3<T> P1 = loadVertex<T>(batch.p[0], lane);
+    const Vec3<T> p2 = loadVertex<T>(batch.p[1], lane) - P1;
+    const Vec3<T> p3 = loadVertex<T>(batch.p[2], lane) - P1;
+    const Vec3<T> q1 = loadVertex<T>(batch.q[0], lane) - P1;
+    const Vec3<T> q2 = loadVertex<T>(batch.q[1], lane) - P1;
+    const Vec3<T> q3 = loadVertex<T>(batch.q[2], lane) - P1;
+
+    const T EPS(SIGN_TOLERANCE);
+
+    const Vec3<T> e1 = p2;
+    const Vec3<T> e2 = p3 - p2;
+    const Vec3<T> n1 = e1.cross(e2);
+    const T nq[3] = { n1.dot(q1), n1.dot(q2), n1.dot(q3) };
+    const T nqTol[3] = { EPS * n1.absDot(q1), EPS * n1.absDot(q2), EPS * n1.absDot(q3) };
+    unsigned int separated = isSeparated(nq, nqTol);
+
+    const Vec3<T> f1 = q2 - q1;
+    const Vec3<T> f2 = q3 - q2;
+    const Vec3<T> m1 = f1.cross(f2);
+    const T mq = m1.dot(q1);
+    const T mqTol = EPS * m1.absDot(q1);
+    const T mp[3] = { T(0.0) - mq, m1.dot(p2) - mq, m1.dot(p3) - mq };
+    const T mpTol[3] = { mqTol, EPS * m1.absDot(p2) + mqTol, EPS * m1.absDot(p3) + mqTol };
+    separated |= isSeparated(mp, mpTol);
+
+    return ~separated & ((1u << T::size) - 1);
+}
+
+}
+
+
+unsigned int cnoid::findTrianglePairsNotSeparatedByFaces(const TrianglePairBatch& batch, int n)
+{
+    unsigned int mask = 0;
+    int lane = 0;
+    while(lane + SimdLanes::size <= n){
+        mask |= findNotSeparatedPairs<SimdLanes>(batch, lane) << lane;
+        lane += SimdLanes::size;
+    }
+    while(lane < n){
+        mask |= findNotSeparatedPairs<ScalarLanes>(batch, lane) << lane;
+        ++lane;
+    }
+    return mask;
+}
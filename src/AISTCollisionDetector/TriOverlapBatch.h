@@ -0,0 +1,35 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_AIST_COLLISION_DETECTOR_TRI_OVERLAP_BATCH_H
+#define CNOID_AIST_COLLISION_DETECTOR_TRI_OVERLAP_BATCH_H
+
+namespace cnoid {
+
+const int TRI_OVERLAP_BATCH_SIZE = 8;
+
+/**
+   The vertices of the triangle pairs tested at once, which are stored in the structure-of-arrays
+   layout. p[i][j][k] is the j-th coordinate of the i-th vertex of the first triangle of the k-th pair.
+*/
+struct TrianglePairBatch
+{
+    double p[3][3][TRI_OVERLAP_BATCH_SIZE];
+    double q[3][3][TRI_OVERLAP_BATCH_SIZE];
+};
+
+/**
+   Tests whether each pair is separated by the supporting plane of either triangle, which is
+   the early rejection of tri_tri_overlap(). A pair is regarded as separated only when the signs
+   are clear beyond the rounding errors, so a pair rejected by this function is always rejected
+   by tri_tri_overlap().
+
+   \param n The number of the pairs, which must not exceed TRI_OVERLAP_BATCH_SIZE
+   \return The bit mask of the pairs which are not separated
+*/
+unsigned int findTrianglePairsNotSeparatedByFaces(const TrianglePairBatch& batch, int n);
+
+}
+
+#endif
@@ -10,15 +10,59 @@
 #include <cnoid/FileUtil>
 #include <cnoid/Exception>
 #include <cnoid/NullOut>
+#include <cnoid/ThreadPool>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 #include <boost/optional.hpp>
 #include <map>
+#include <memory>
+#include <type_traits>
+#include <cstring>
 
 using namespace std;
 using namespace cnoid;
 
+namespace {
+
+/*
+  The importer is kept for each thread and reused by the loaders used in the thread because
+  creating an importer instantiates all the importers and the post-processing steps of Assimp.
+*/
+Assimp::Importer& getImporterOfCurrentThread()
+{
+    thread_local unique_ptr<Assimp::Importer> importer;
+    if(!importer){
+        importer.reset(new Assimp::Importer);
+#ifdef AI_CONFIG_IMPORT_COLLADA_IGNORE_UP_DIRECTION
+        importer->SetPropertyBool(AI_CONFIG_IMPORT_COLLADA_IGNORE_UP_DIRECTION, true);
+#endif
+    }
+    return *importer;
+}
+
+
+template<class ArrayType>
+void copyAiVectors(const aiVector3D* srcVectors, unsigned int numVectors, ArrayType& out_array)
+{
+    typedef typename ArrayType::value_type VectorType;
+    out_array.resize(numVectors);
+    if(numVectors == 0){
+        return;
+    }
+    if(std::is_same<decltype(aiVector3D::x), typename VectorType::Scalar>::value &&
+       sizeof(aiVector3D) == sizeof(VectorType)){
+        std::memcpy(out_array.data(), srcVectors, numVectors * sizeof(VectorType));
+    } else {
+        for(unsigned int i=0; i < numVectors; ++i){
+            const auto& v = srcVectors[i];
+            out_array[i] << v.x, v.y, v.z;
+        }
+    }
+}
+
+}
+
 namespace cnoid {
 
 class AssimpSceneLoaderImpl
@@ -26,15 +70,25 @@ class AssimpSceneLoaderImpl
 public:
     ostream* os_;
     ostream& os() { return *os_; }
-    Assimp::Importer importer;
     const aiScene* scene;
     boost::filesystem::path directoryPath;
     ImageIO imageIO;
+    bool isAppearanceLoadingEnabled;
 
     boost::optional<Affine3f> T_local;
-    
-    typedef map<unsigned int, SgNodePtr> AiIndexToSgShapeMap;
-    AiIndexToSgShapeMap aiIndexToSgShapeMap;
+
+    struct ConvertedMesh
+    {
+        bool isTarget;
+        boost::optional<Affine3f> T_local;
+        SgNodePtr node;
+        SgPlot* pointSet;
+        SgPlot* lineSet;
+        SgShape* shape;
+        ConvertedMesh() : isTarget(false), pointSet(nullptr), lineSet(nullptr), shape(nullptr) { }
+    };
+    vector<ConvertedMesh> convertedMeshes;
+    vector<unsigned int> meshesToConvert;
     typedef map<unsigned int, SgMaterialPtr> AiIndexToSgMaterialMap;
     AiIndexToSgMaterialMap  aiIndexToSgMaterialMap;
     typedef map<unsigned int, SgTexturePtr> AiIndexToSgTextureMap;
@@ -47,9 +101,13 @@ public:
     AssimpSceneLoaderImpl();
     void clear();
     SgNode* load(const std::string& filename);
+    void applyAiNodeTransform(aiNode* node, Affine3& out_T);
+    void collectAiMeshes(aiNode* node);
+    void convertAiMeshes();
     SgGroup* convertAiNode(aiNode* node);
-    SgNode* convertAiMesh(unsigned int);
-    SgNode* convertAiMeshFaces(aiMesh* srcMesh);
+    void convertAiMeshFaces(
+        aiMesh* srcMesh, const boost::optional<Affine3f>& T_local, MeshFilter& meshFilter,
+        ConvertedMesh& out_converted);
     SgMaterial* convertAiMaterial(unsigned int);
     SgTexture* convertAiTexture(unsigned int index);
 };
@@ -83,11 +141,8 @@ AssimpSceneLoaderImpl* AssimpSceneLoader::getOrCreateImpl()
 
 AssimpSceneLoaderImpl::AssimpSceneLoaderImpl()
 {
-#ifdef AI_CONFIG_IMPORT_COLLADA_IGNORE_UP_DIRECTION
-    importer.SetPropertyBool(AI_CONFIG_IMPORT_COLLADA_IGNORE_UP_DIRECTION, true);
-#endif
-
     imageIO.setUpsideDown(true);
+    isAppearanceLoadingEnabled = true;
     os_ = &nullout();
 }
 
@@ -106,9 +161,16 @@ void AssimpSceneLoader::setMessageSink(std::ostream& os)
 }
 
 
+void AssimpSceneLoader::setAppearanceLoadingEnabled(bool on)
+{
+    getOrCreateImpl()->isAppearanceLoadingEnabled = on;
+}
+
+
 void AssimpSceneLoaderImpl::clear()
 {
-    aiIndexToSgShapeMap.clear();
+    convertedMeshes.clear();
+    meshesToConvert.clear();
     aiIndexToSgMaterialMap.clear();
     aiIndexToSgTextureMap.clear();
     imagePathToSgImageMap.clear();
@@ -125,6 +187,7 @@ SgNode* AssimpSceneLoaderImpl::load(const std::string& filename)
 {
     clear();
 
+    Assimp::Importer& importer = getImporterOfCurrentThread();
     scene = importer.ReadFile(
         filename,
         aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
@@ -137,30 +200,36 @@ SgNode* AssimpSceneLoaderImpl::load(const std::string& filename)
     boost::filesystem::path path(filename);
     directoryPath = path.remove_filename();
 
+    convertedMeshes.resize(scene->mNumMeshes);
     T_local = boost::none;
+    collectAiMeshes(scene->mRootNode);
+    convertAiMeshes();
 
+    T_local = boost::none;
     SgNode* node = convertAiNode(scene->mRootNode);
 
     importer.FreeScene();
+    scene = nullptr;
+    clear();
 
     return node;
 }
 
 
-SgGroup* AssimpSceneLoaderImpl::convertAiNode(aiNode* node)
+/**
+   The transform of the node is returned as out_T. The transforms which cannot be expressed
+   by the transform nodes are accumulated in T_local and applied to the vertices of the meshes.
+*/
+void AssimpSceneLoaderImpl::applyAiNodeTransform(aiNode* node, Affine3& out_T)
 {
-    static const bool USE_AFFINE_TRANSFORM = false;
-    
     const aiMatrix4x4& S = node->mTransformation;
-    Affine3 T;
+    Affine3& T = out_T;
     T.translation() << S[0][3], S[1][3], S[2][3];
     T.linear() << 
         S[0][0], S[0][1], S[0][2],
         S[1][0], S[1][1], S[1][2],
         S[2][0], S[2][1], S[2][2];
 
-    boost::optional<Affine3f> prev_T_local = T_local;
-    
     double d = T.linear().determinant();
     if(T_local || d < 0){ // include coordinate reflection
         if(T_local){
@@ -170,6 +239,101 @@ SgGroup* AssimpSceneLoaderImpl::convertAiNode(aiNode* node)
         }
         T.setIdentity();
     }
+}
+
+
+/**
+   A mesh referred from multiple nodes is converted with the local transform of the node
+   which refers to it first.
+*/
+void AssimpSceneLoaderImpl::collectAiMeshes(aiNode* node)
+{
+    boost::optional<Affine3f> prev_T_local = T_local;
+    Affine3 T;
+    applyAiNodeTransform(node, T);
+
+    for(unsigned int i=0; i < node->mNumMeshes; ++i){
+        const unsigned int index = node->mMeshes[i];
+        ConvertedMesh& converted = convertedMeshes[index];
+        if(!converted.isTarget){
+            converted.isTarget = true;
+            converted.T_local = T_local;
+            meshesToConvert.push_back(index);
+        }
+    }
+    for(unsigned int i=0; i < node->mNumChildren; ++i){
+        collectAiMeshes(node->mChildren[i]);
+    }
+
+    T_local = prev_T_local;
+}
+
+
+/**
+   The meshes are converted in parallel. The materials and the textures are shared by the
+   meshes, so they are converted before the meshes and set to the converted shapes after
+   the meshes in this thread.
+*/
+void AssimpSceneLoaderImpl::convertAiMeshes()
+{
+    if(isAppearanceLoadingEnabled){
+        for(auto& index : meshesToConvert){
+            aiMesh* srcMesh = scene->mMeshes[index];
+            if(srcMesh->HasFaces()){
+                convertAiMaterial(srcMesh->mMaterialIndex);
+                if(srcMesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE){
+                    convertAiTexture(srcMesh->mMaterialIndex);
+                }
+            }
+        }
+    }
+
+    ThreadPool::instance()->parallelFor(
+        0, meshesToConvert.size(),
+        [&](int i){
+            const unsigned int index = meshesToConvert[i];
+            aiMesh* srcMesh = scene->mMeshes[index];
+            if(srcMesh->HasFaces()){
+                ConvertedMesh& converted = convertedMeshes[index];
+                MeshFilter filter(meshFilter);
+                convertAiMeshFaces(srcMesh, converted.T_local, filter, converted);
+            }
+        },
+        1);
+
+    if(isAppearanceLoadingEnabled){
+        for(auto& index : meshesToConvert){
+            ConvertedMesh& converted = convertedMeshes[index];
+            if(!converted.node){
+                continue;
+            }
+            const unsigned int materialIndex = scene->mMeshes[index]->mMaterialIndex;
+            SgMaterial* material = aiIndexToSgMaterialMap[materialIndex];
+            if(converted.pointSet){
+                converted.pointSet->setMaterial(material);
+            }
+            if(converted.lineSet){
+                converted.lineSet->setMaterial(material);
+            }
+            if(converted.shape){
+                converted.shape->setMaterial(material);
+                if(SgTexture* texture = aiIndexToSgTextureMap[materialIndex]){
+                    converted.shape->setTexture(texture);
+                }
+            }
+        }
+    }
+}
+
+
+SgGroup* AssimpSceneLoaderImpl::convertAiNode(aiNode* node)
+{
+    static const bool USE_AFFINE_TRANSFORM = false;
+    
+    boost::optional<Affine3f> prev_T_local = T_local;
+
+    Affine3 T;
+    applyAiNodeTransform(node, T);
 
     SgGroupPtr group;
     SgGroup* groupToAddChildren = nullptr;
@@ -208,7 +372,7 @@ SgGroup* AssimpSceneLoaderImpl::convertAiNode(aiNode* node)
         groupToAddChildren = group;
     }
     for(unsigned int i=0; i < node->mNumMeshes; ++i){
-        SgNode* shape = convertAiMesh(node->mMeshes[i]);
+        SgNode* shape = convertedMeshes[node->mMeshes[i]].node;
         if(shape){
             groupToAddChildren->addChild(shape);
         }
@@ -231,38 +395,20 @@ SgGroup* AssimpSceneLoaderImpl::convertAiNode(aiNode* node)
 }
 
 
-SgNode* AssimpSceneLoaderImpl::convertAiMesh(unsigned int index)
-{
-    AiIndexToSgShapeMap::iterator p = aiIndexToSgShapeMap.find(index);
-    if(p != aiIndexToSgShapeMap.end()){
-        return p->second;
-    }
-
-    SgNode* node = 0;
-    aiMesh* srcMesh = scene->mMeshes[index];
-    if(srcMesh->HasFaces()){
-        node = convertAiMeshFaces(srcMesh);
-    }
-    aiIndexToSgShapeMap[index] = node;
-
-    return node;;
-}
-
-
-SgNode* AssimpSceneLoaderImpl::convertAiMeshFaces(aiMesh* srcMesh)
+/**
+   This function is called in the threads of the thread pool, so it must not modify the objects
+   shared with the other meshes. The materials and the textures are set by convertAiMeshes.
+*/
+void AssimpSceneLoaderImpl::convertAiMeshFaces
+(aiMesh* srcMesh, const boost::optional<Affine3f>& T_local, MeshFilter& meshFilter, ConvertedMesh& out_converted)
 {
     const unsigned int types = srcMesh->mPrimitiveTypes;
     SgGroupPtr group = new SgGroup;
     group->setName(srcMesh->mName.C_Str());
 
     const unsigned int numVertices = srcMesh->mNumVertices;
-    const auto srcVertices = srcMesh->mVertices;
     SgVertexArrayPtr vertices = new SgVertexArray;
-    vertices->resize(numVertices);
-    for(unsigned int i=0; i < numVertices; ++i){
-        const auto& v = srcVertices[i];
-        vertices->at(i) << v.x, v.y, v.z;
-    }
+    copyAiVectors(srcMesh->mVertices, numVertices, *vertices);
     if(T_local){
         for(auto& v : *vertices){
             v = (*T_local) * v;
@@ -271,13 +417,8 @@ SgNode* AssimpSceneLoaderImpl::convertAiMeshFaces(aiMesh* srcMesh)
 
     SgNormalArrayPtr normals;
     if(srcMesh->HasNormals()){
-        const auto srcNormals = srcMesh->mNormals;
         normals = new SgNormalArray;
-        normals->resize(numVertices);
-        for(unsigned int i=0; i < numVertices; ++i){
-            const auto& n = srcNormals[i];
-            normals->at(i) << n.x, n.y, n.z;
-        }
+        copyAiVectors(srcMesh->mNormals, numVertices, *normals);
         if(T_local){
             const Matrix3f R = (*T_local).linear();
             for(auto& n : *normals){
@@ -287,7 +428,7 @@ SgNode* AssimpSceneLoaderImpl::convertAiMeshFaces(aiMesh* srcMesh)
     }
 
     SgColorArrayPtr colors;
-    if(srcMesh->HasVertexColors(0)){
+    if(isAppearanceLoadingEnabled && srcMesh->HasVertexColors(0)){
         const auto srcColors = srcMesh->mColors[0];
         colors = new SgColorArray;
         colors->resize(numVertices);
@@ -297,8 +438,6 @@ SgNode* AssimpSceneLoaderImpl::convertAiMeshFaces(aiMesh* srcMesh)
         }
     }
 
-    SgMaterialPtr material = convertAiMaterial(srcMesh->mMaterialIndex);
-
     const unsigned int numFaces = srcMesh->mNumFaces;
     const aiFace* srcFaces = srcMesh->mFaces;
     
@@ -307,9 +446,9 @@ SgNode* AssimpSceneLoaderImpl::convertAiMeshFaces(aiMesh* srcMesh)
         pointSet->setVertices(vertices);
         pointSet->setNormals(normals);
         pointSet->setColors(colors);
-        pointSet->setMaterial(material);
         pointSet->updateBoundingBox();
         group->addChild(pointSet);
+        out_converted.pointSet = pointSet;
     }
     
     if(types & aiPrimitiveType_LINE){
@@ -317,7 +456,6 @@ SgNode* AssimpSceneLoaderImpl::convertAiMeshFaces(aiMesh* srcMesh)
         lineSet->setVertices(vertices);
         lineSet->setNormals(normals);
         lineSet->setColors(colors);
-        lineSet->setMaterial(material);
 
         if(types == aiPrimitiveType_LINE){
             lineSet->reserveNumLines(numFaces);
@@ -332,40 +470,47 @@ SgNode* AssimpSceneLoaderImpl::convertAiMeshFaces(aiMesh* srcMesh)
         lineSet->updateBoundingBox();
         
         group->addChild(lineSet);
+        out_converted.lineSet = lineSet;
     }
     
     if(types & aiPrimitiveType_TRIANGLE){
         auto shape = new SgShape;
-        shape->setMaterial(material);
         auto mesh = shape->getOrCreateMesh();
         mesh->setVertices(vertices);
         mesh->setNormals(normals);
         mesh->setColors(colors);
 
         if(types == aiPrimitiveType_TRIANGLE){
-            mesh->reserveNumTriangles(numFaces);
-        }
-        for(unsigned int i = 0; i < numFaces; ++i){
-            const aiFace& face = srcFaces[i];
-            if(face.mNumIndices == 3){
-                const unsigned int* indices = face.mIndices;
-                mesh->addTriangle(indices[0], indices[1], indices[2]);
+            // All the faces are triangles, so the indices are written without checking the faces
+            mesh->setNumTriangles(numFaces);
+            int* dest = mesh->triangleVertices().data();
+            for(unsigned int i = 0; i < numFaces; ++i){
+                const unsigned int* indices = srcFaces[i].mIndices;
+                *dest++ = indices[0];
+                *dest++ = indices[1];
+                *dest++ = indices[2];
+            }
+        } else {
+            for(unsigned int i = 0; i < numFaces; ++i){
+                const aiFace& face = srcFaces[i];
+                if(face.mNumIndices == 3){
+                    const unsigned int* indices = face.mIndices;
+                    mesh->addTriangle(indices[0], indices[1], indices[2]);
+                }
             }
         }
 
-        if(srcMesh->HasTextureCoords(0)){
-            const auto srcTexCoords = srcMesh->mTextureCoords[0];
-            auto& texCoords = *mesh->getOrCreateTexCoords();
-            texCoords.resize(numVertices);
-            for(unsigned int i=0; i < numVertices; ++i){
-                const auto& p = srcTexCoords[i];
-                texCoords[i] << p.x, p.y;
+        if(isAppearanceLoadingEnabled){
+            if(srcMesh->HasTextureCoords(0)){
+                const auto srcTexCoords = srcMesh->mTextureCoords[0];
+                auto& texCoords = *mesh->getOrCreateTexCoords();
+                texCoords.resize(numVertices);
+                for(unsigned int i=0; i < numVertices; ++i){
+                    const auto& p = srcTexCoords[i];
+                    texCoords[i] << p.x, p.y;
+                }
             }
         }
-        SgTexture* texture = convertAiTexture(srcMesh->mMaterialIndex);
-        if(texture){
-            shape->setTexture(texture);
-        }
 
         meshFilter.removeRedundantVertices(mesh);
         if(normals){
@@ -377,17 +522,19 @@ SgNode* AssimpSceneLoaderImpl::convertAiMeshFaces(aiMesh* srcMesh)
         mesh->updateBoundingBox();
 
         group->addChild(shape);
+        out_converted.shape = shape;
     }
 
     if(group->empty()){
-        return nullptr;
+        out_converted.node = nullptr;
     } else if(group->numChildren() == 1){
         SgNodePtr node = group->child(0);
         node->setName(group->name());
         group->clearChildren();
-        return node.retn();
+        out_converted.node = node;
+    } else {
+        out_converted.node = group;
     }
-    return group.retn();
 }
 
 
@@ -472,8 +619,7 @@ SgTexture* AssimpSceneLoaderImpl::convertAiTexture(unsigned int index)
                 image = p->second;
             } else {
                 try {
-                    image = new SgImage;
-                    imageIO.load(image->image(), textureFile);
+                    image = new SgImage(imageIO.loadSharedImage(textureFile));
                     imagePathToSgImageMap[textureFile] = image;
                 } catch(const exception_base& ex){
                     os() << *boost::get_error_info<error_info_message>(ex) << endl;
@@ -21,6 +21,7 @@ public:
     AssimpSceneLoader();
     ~AssimpSceneLoader();
     void setMessageSink(std::ostream& os) override;
+    void setAppearanceLoadingEnabled(bool on) override;
     virtual SgNode* load(const std::string& filename) override;
 
 private:
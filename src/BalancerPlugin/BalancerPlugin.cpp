@@ -38,6 +38,7 @@ namespace {
         QDoubleSpinBox timeToStartBalancerSpin;
         QSpinBox balancerIterationSpin;
         QCheckBox plainBalancerModeCheck;
+        QCheckBox warmStartCheck;
         QComboBox boundaryConditionCombo;
         QComboBox boundarySmootherCombo;
         QDoubleSpinBox boundarySmootherTimeSpin;
@@ -86,6 +87,11 @@ namespace {
             plainBalancerModeCheck.setText(_("Plain-initial"));
             plainBalancerModeCheck.setToolTip(_("Initial balanced trajectory only depends on the desired ZMP"));
             hbox->addWidget(&plainBalancerModeCheck);
+
+            hbox->addSpacing(8);
+            warmStartCheck.setText(_("Warm start"));
+            warmStartCheck.setToolTip(_("The last balanced trajectory is used as the initial trajectory"));
+            hbox->addWidget(&warmStartCheck);
             hbox->addStretch();
             
             hbox = newRow(vbox);
@@ -161,6 +167,7 @@ namespace {
             archive.write("timeToStartBalancer", timeToStartBalancerSpin.value());
             archive.write("balancerIterations", balancerIterationSpin.value());
             archive.write("plainBalancerMode", plainBalancerModeCheck.isChecked());
+            archive.write("balancerWarmStart", warmStartCheck.isChecked());
             archive.write("boundaryConditionType",
                           WaistBalancer::boundaryConditionTypeNameOf(boundaryConditionCombo.currentIndex()));
             archive.write("boundarySmootherType",
@@ -177,6 +184,7 @@ namespace {
             timeToStartBalancerSpin.setValue(archive.get("timeToStartBalancer", timeToStartBalancerSpin.value()));
             balancerIterationSpin.setValue(archive.get("balancerIterations", balancerIterationSpin.value()));
             plainBalancerModeCheck.setChecked(archive.get("plainBalancerMode", plainBalancerModeCheck.isChecked()));
+            warmStartCheck.setChecked(archive.get("balancerWarmStart", warmStartCheck.isChecked()));
 
             boundaryConditionCombo.setCurrentIndex(
                 WaistBalancer::boundaryConditionTypeOf(
@@ -216,6 +224,7 @@ namespace {
             balancer->enableBoundaryCmAdjustment(boundaryCmAdjustmentCheck.isChecked(),
                                                  boundaryCmAdjustmentTimeSpin.value());
             balancer->setInitialWaistTrajectoryMode(plainBalancerModeCheck.isChecked() ? 0 : 1);
+            balancer->enableWarmStart(warmStartCheck.isChecked());
             balancer->enableWaistHeightRelaxation(waistHeightRelaxationCheck.isChecked());
             balancer->setGravity(gravitySpin.value());
             balancer->setDynamicsTimeRatio(dynamicsTimeRatioSpin.value());
@@ -18,6 +18,9 @@ using namespace cnoid;
 namespace {
 
     const bool DoVerticalAccCompensation = true;
+
+    // A frame is evaluated again when a related waist translation changes more than this value
+    const double FrameReevaluationThresh = 1.0e-8;
     
 #if defined(_MSC_VER) && _MSC_VER < 1800
     inline long lround(double x) {
@@ -48,6 +51,14 @@ WaistBalancer::WaistBalancer()
     dynamicsTimeRatio = 1.0;
     isBoundaryCmAdjustmentEnabled = false;
     isWaistHeightRelaxationEnabled = false;
+    convergenceThreshold = 1.0e-5;
+    maxCorrection = 0.0;
+    isWarmStartEnabled = false;
+    lastBody = nullptr;
+    lastProvider = nullptr;
+    lastFrameToStartBalancer = 0;
+    lastEndingFrame = 0;
+    lastFrameRate = 0.0;
 
     setBoundarySmoother(QUINTIC_SMOOTHER, 0.5);
     setFullTimeRange();
@@ -202,6 +213,21 @@ void WaistBalancer::enableWaistHeightRelaxation(bool on)
 }
 
 
+void WaistBalancer::setConvergenceThreshold(double threshold)
+{
+    convergenceThreshold = threshold;
+}
+
+
+void WaistBalancer::enableWarmStart(bool on)
+{
+    isWarmStartEnabled = on;
+    if(!on){
+        lastCmTranslations.clear();
+    }
+}
+
+
 bool WaistBalancer::apply(PoseProvider* provider_, BodyMotion& motion, bool putAllLinkPositions)
 {
     if(!body_){
@@ -287,7 +313,17 @@ bool WaistBalancer::apply2(BodyMotion& motion, bool putAllLinkPositions)
         doBoundarySmoother = (numBoundarySmoothingFrames < numFilteredFrames / 3);
     }
 
-    if(numIterations_ == 0 || initialWaistTrajectoryMode == ORG_TRAJECTORY){
+    const bool doWarmStart =
+        isWarmStartEnabled && numIterations_ > 0 && !lastCmTranslations.empty() &&
+        lastBody == body_ && lastProvider == provider && lastFrameToStartBalancer == frameToStartBalancer &&
+        lastEndingFrame == endingFrame && lastFrameRate == frameRate;
+
+    if(doWarmStart){
+        totalCmTranslations = lastCmTranslations;
+        if(isBoundaryCmAdjustmentEnabled){
+            calcBoundaryCmAdjustmentTrajectory();
+        }
+    } else if(numIterations_ == 0 || initialWaistTrajectoryMode == ORG_TRAJECTORY){
         totalCmTranslations.clear();
         totalCmTranslations.resize(endingFrame + 1, Vector3::Zero());
 
@@ -301,16 +337,30 @@ bool WaistBalancer::apply2(BodyMotion& motion, bool putAllLinkPositions)
     }
 
     coeffSeq.resize(numFilteredFrames);
+    frameCaches.clear();
+    frameCaches.resize(numFilteredFrames);
+    for(auto& cache : frameCaches){
+        cache.isValid = false;
+    }
 
     bool result = true;
     
     for(int i=0; i < numIterations_; ++i){
         result = calcCmTranslations();
-        if(!result){
+        if(!result || maxCorrection < convergenceThreshold){
             break;
         }
     }
 
+    if(result && isWarmStartEnabled){
+        lastCmTranslations = totalCmTranslations;
+        lastBody = body_;
+        lastProvider = provider;
+        lastFrameToStartBalancer = frameToStartBalancer;
+        lastEndingFrame = endingFrame;
+        lastFrameRate = frameRate;
+    }
+
     if(result){
         result = applyCmTranslations(motion, putAllLinkPositions);
     }
@@ -584,15 +634,31 @@ void WaistBalancer::updateBodyKinematics2()
 }
 
 
+/**
+   The frames whose values evaluated in the last iteration are still valid are skipped.
+   The dynamics of a frame depends on the waist translations of the frame and the adjacent
+   frames because the velocities and the momentum derivatives are calculated by differences.
+*/
 bool WaistBalancer::calcCmTranslations()
 {
     initBodyKinematics(frameToStartBalancer, totalCmTranslations[frameToStartBalancer]);
 
-    //const double gdt2 = g * dt2;
+    bool isResumingNeeded = false;
     
     for(int i = 0; i < numFilteredFrames; ++i){
 
-        updateBodyKinematics1(i + frameToStartBalancer);
+        const int frame = i + frameToStartBalancer;
+
+        if(i > 0 && isFrameCacheAvailable(i)){
+            isResumingNeeded = true;
+            continue;
+        }
+        if(isResumingNeeded){
+            resumeBodyKinematics(frame, frameCaches[i - 1]);
+            isResumingNeeded = false;
+        }
+
+        updateBodyKinematics1(frame);
 
         if(doStoreOriginalWaistFeetPositionsForWaistHeightRelaxation){
             // store waist and feet positions
@@ -606,6 +672,12 @@ bool WaistBalancer::calcCmTranslations()
             }
         }
 
+        if(isCalculatingInitialWaistTrajectory){
+            frameCaches[i].isValid = false;
+        } else {
+            storeFrameCache(i);
+        }
+
         updateBodyKinematics2();
 
         Coeff& c = coeffSeq[i];
@@ -626,64 +698,123 @@ bool WaistBalancer::calcCmTranslations()
         }
         c.d = zmpDiff;
     }
-    
-    double bet;
-    vector<double> gam(numFilteredFrames);
-    vector<Vector3> u(numFilteredFrames, Vector3::Zero());
-    int last = numFilteredFrames - 1;
 
-    Coeff& c0 = coeffSeq[0];
-    Coeff& clast = coeffSeq[last];
+    solveCmTranslationCorrections();
 
-    if(boundaryConditionType == ZERO_VELOCITY){
-        c0.b += c0.a;
-        clast.b += clast.a;
+    if(doWaistHeightRelaxation){
+        doStoreOriginalWaistFeetPositionsForWaistHeightRelaxation = false;
+        relaxWaistHeightTrajectory();
     }
 
-    bet = c0.b;
-    
-    u[0].x() = c0.d.x() / bet;
-    u[0].y() = c0.d.y() / bet;
+    isCalculatingInitialWaistTrajectory = false;
 
-    for(int i=1; i < numFilteredFrames - 2; ++i){
-        Coeff& cprev = coeffSeq[i-1];
-        Coeff& c = coeffSeq[i];
-        gam[i] = cprev.a / bet;
-        bet = c.b - c.a * gam[i];
-        u[i].x() = (c.d.x() - c.a * u[i-1].x()) / bet;
-        u[i].y() = (c.d.y() - c.a * u[i-1].y()) / bet;
+    return true;
+}
+
+
+bool WaistBalancer::isFrameCacheAvailable(int index)
+{
+    const FrameCache& cache = frameCaches[index];
+    if(!cache.isValid){
+        return false;
     }
+    const int frame = index + frameToStartBalancer;
+    for(int i=0; i < 3; ++i){
+        const int adjacentFrame = std::max(0, std::min(endingFrame, frame + i - 1));
+        if((totalCmTranslations[adjacentFrame] - cache.translations[i]).cwiseAbs().maxCoeff() > FrameReevaluationThresh){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void WaistBalancer::storeFrameCache(int index)
+{
+    FrameCache& cache = frameCaches[index];
+    const int frame = index + frameToStartBalancer;
+    for(int i=0; i < 3; ++i){
+        const int adjacentFrame = std::max(0, std::min(endingFrame, frame + i - 1));
+        cache.translations[i] = totalCmTranslations[adjacentFrame];
+    }
+    // P0 and L0 are the momentum of the frame after updateCmAndZmp is called
+    cache.P = P0;
+    cache.L = L0;
+    cache.isValid = true;
+}
+
 
-    gam[last] = coeffSeq[last-1].a / bet;
+/**
+   Sets the body state to the state which updateBodyKinematics2 gives after the previous frame
+   is processed so that the processing can be resumed from the frame after skipped frames.
+*/
+void WaistBalancer::resumeBodyKinematics(int frame, const FrameCache& prevCache)
+{
+    provider->seek(timeOfFrame(frame), waistLinkIndex, totalCmTranslations[frame]);
 
-    bet = clast.b - clast.a * gam[last];
+    const int baseLinkIndex = provider->baseLinkIndex();
+    if(baseLinkIndex != baseLink->index() && baseLinkIndex >= 0){
+        baseLink = body_->link(baseLinkIndex);
+        fkTraverse.find(baseLink);
+    }
+    updateBodyKinematics2();
     
-    u[last].x() = (clast.d.x() - clast.a * u[last-1].x()) / bet;
-    u[last].y() = (clast.d.y() - clast.a * u[last-1].y()) / bet;
-    totalCmTranslations[last + frameToStartBalancer] += u[last];
+    desiredZmp = *provider->ZMP();
+    P0 = prevCache.P;
+    L0 = prevCache.L;
+}
+
 
-    for(int i = numFilteredFrames - 2; i >= 0; --i){
-        u[i].x() -= gam[i+1] * u[i+1].x();
-        u[i].y() -= gam[i+1] * u[i+1].y();
+/**
+   Solves the tridiagonal system of the corrections of the horizontal waist translations
+   with the Thomas algorithm in O(n). The row of a frame is a * x[i-1] + b * x[i] + a * x[i+1] = d.
+*/
+void WaistBalancer::solveCmTranslationCorrections()
+{
+    const int n = numFilteredFrames;
+    const int last = n - 1;
+    gam.resize(n);
+    corrections.resize(n);
+
+    double b0 = coeffSeq[0].b;
+    double blast = coeffSeq[last].b;
+    if(boundaryConditionType == ZERO_VELOCITY){
+        b0 += coeffSeq[0].a;
+        blast += coeffSeq[last].a;
+    }
+
+    double bet = b0;
+    corrections[0].x() = coeffSeq[0].d.x() / bet;
+    corrections[0].y() = coeffSeq[0].d.y() / bet;
+    
+    for(int i=1; i < n; ++i){
+        const Coeff& c = coeffSeq[i];
+        const double b = (i == last) ? blast : c.b;
+        gam[i] = coeffSeq[i-1].a / bet;
+        bet = b - c.a * gam[i];
+        corrections[i].x() = (c.d.x() - c.a * corrections[i-1].x()) / bet;
+        corrections[i].y() = (c.d.y() - c.a * corrections[i-1].y()) / bet;
+    }
+
+    for(int i = n - 2; i >= 0; --i){
+        corrections[i].x() -= gam[i+1] * corrections[i+1].x();
+        corrections[i].y() -= gam[i+1] * corrections[i+1].y();
+    }
+
+    maxCorrection = 0.0;
+    static const double thresh = 1.0;
+    for(int i=0; i < n; ++i){
+        const Vector3& u = corrections[i];
+        maxCorrection = std::max(maxCorrection, std::max(fabs(u.x()), fabs(u.y())));
         Vector3& translation = totalCmTranslations[i + frameToStartBalancer];
-        translation.x() += u[i].x();
-        translation.y() += u[i].y();
+        translation.x() += u.x();
+        translation.y() += u.y();
         double sqrlen = translation.squaredNorm();
-        static const double thresh = 1.0;
         if(sqrlen > thresh * thresh){ // divergence error
             translation *= thresh / sqrt(sqrlen);
             // Error should be notified ?
         }
     }
-
-    if(doWaistHeightRelaxation){
-        doStoreOriginalWaistFeetPositionsForWaistHeightRelaxation = false;
-        relaxWaistHeightTrajectory();
-    }
-
-    isCalculatingInitialWaistTrajectory = false;
-
-    return true;
 }
 
 
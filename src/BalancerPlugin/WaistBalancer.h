@@ -65,6 +65,18 @@ namespace cnoid {
         void setInitialWaistTrajectoryMode(int mode);
 
         void enableWaistHeightRelaxation(bool on);
+
+        /**
+           The iterations are finished when the maximum correction of the waist translations
+           in an iteration is smaller than this value. Zero means all the iterations are done.
+        */
+        void setConvergenceThreshold(double threshold);
+
+        /**
+           When this is enabled, the waist translations balanced in the last application are used
+           as the initial translations if the body, the pose provider and the frame range are same.
+        */
+        void enableWarmStart(bool on);
             
         bool apply(PoseProvider* provider, BodyMotion& motion, bool putAllLinkPositions = false);
 
@@ -120,6 +132,31 @@ namespace cnoid {
             Vector3 d;
         };
         std::vector<Coeff> coeffSeq;
+        std::vector<double> gam;
+        std::vector<Vector3> corrections;
+        double convergenceThreshold;
+        double maxCorrection;
+
+        /*
+          The values of a frame evaluated in the last iteration, which are reused when the
+          waist translations of the frame and the adjacent frames are not changed.
+        */
+        struct FrameCache {
+            bool isValid;
+            Vector3 translations[3];
+            Vector3 P;
+            Vector3 L;
+        };
+        std::vector<FrameCache> frameCaches;
+
+        bool isWarmStartEnabled;
+        // The pointers are only compared to decide whether the last translations are used
+        Body* lastBody;
+        PoseProvider* lastProvider;
+        int lastFrameToStartBalancer;
+        int lastEndingFrame;
+        double lastFrameRate;
+        std::vector<Vector3> lastCmTranslations;
 
         std::vector<Vector3> totalCmTranslations;
 
@@ -170,6 +207,10 @@ namespace cnoid {
         bool updateBodyKinematics1(int frame);
         void updateBodyKinematics2();
         bool calcCmTranslations();
+        bool isFrameCacheAvailable(int index);
+        void storeFrameCache(int index);
+        void resumeBodyKinematics(int frame, const FrameCache& prevCache);
+        void solveCmTranslationCorrections();
         void initWaistHeightRelaxation();
         void relaxWaistHeightTrajectory();
         void applyCubicBoundarySmoother(int begin, int direction);
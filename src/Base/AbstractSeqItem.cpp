@@ -30,6 +30,18 @@ AbstractSeqItem::~AbstractSeqItem()
 }
 
 
+void AbstractSeqItem::countMemoryUsage(MemoryUsageCounter& counter)
+{
+    Item::countMemoryUsage(counter);
+
+    // The sequence may be shared with other items such as the sub items of a body motion item
+    auto seq = abstractSeq();
+    if(seq && counter.visit(seq.get())){
+        seq->countMemoryUsage(counter);
+    }
+}
+
+
 void AbstractSeqItem::doPutProperties(PutPropertyFunction& putProperty)
 {
     auto seq = abstractSeq();
@@ -21,6 +21,8 @@ public:
 
     virtual std::shared_ptr<AbstractSeq> abstractSeq() = 0;
 
+    virtual void countMemoryUsage(MemoryUsageCounter& counter) override;
+
 protected:
     virtual void doPutProperties(PutPropertyFunction& putProperty) override;
     virtual bool store(Archive& archive) override;
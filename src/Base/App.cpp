@@ -42,9 +42,11 @@
 #include "PathVariableEditor.h"
 #include "Licenses.h"
 #include "MovieRecorder.h"
+#include "TraceRecordingMenu.h"
 #include "LazyCaller.h"
 #include "TextEditView.h"
 #include "GeneralSliderView.h"
+#include "MemoryUsageView.h"
 #include "VirtualJoystickView.h"
 #include "DescriptionDialog.h"
 #include "MessageLogItem.h"
@@ -53,6 +55,7 @@
 #include <cnoid/ValueTree>
 #include <cnoid/CnoidUtil>
 #include <cnoid/ParametricPathProcessor>
+#include <cnoid/PhaseProfiler>
 #include <fmt/format.h>
 #include <Eigen/Core>
 #include <QApplication>
@@ -169,6 +172,8 @@ void App::initialize(const char* appName, const char* vendorName, const QIcon& i
 
 void AppImpl::initialize( const char* appName, const char* vendorName, const QIcon& icon, const char* pluginPathList)
 {
+    PhaseProfiler::Scope baseScope("Base initialization");
+    
     this->appName = appName;
     this->vendorName = vendorName;
 
@@ -210,6 +215,7 @@ void AppImpl::initialize( const char* appName, const char* vendorName, const QIc
     ImageView::initializeClass(ext);
     TextEditView::initializeClass(ext);
     GeneralSliderView::initializeClass(ext);
+    MemoryUsageView::initializeClass(ext);
     GraphBar::initialize(ext);
     MultiValueSeqGraphView::initializeClass(ext);
     MultiSE3SeqGraphView::initializeClass(ext);
@@ -237,6 +243,8 @@ void AppImpl::initialize( const char* appName, const char* vendorName, const QIc
     
     PathVariableEditor::initialize(ext);
 
+    TraceRecordingMenu::initialize(ext);
+
     ext->menuManager().setPath("/Help").addItem(_("About Choreonoid"))
         ->sigTriggered().connect([&](){ showInformationDialog(); });
 
@@ -245,6 +253,8 @@ void AppImpl::initialize( const char* appName, const char* vendorName, const QIc
                     EIGEN_WORLD_VERSION, EIGEN_MAJOR_VERSION, EIGEN_MINOR_VERSION,
                     Eigen::SimdInstructionSetsInUse()));
 
+    baseScope.end();
+
     PluginManager::initialize(ext);
     PluginManager::instance()->doStartupLoading(pluginPathList);
 
@@ -318,11 +328,17 @@ int AppImpl::exec()
         //exit
     }
 
+    PhaseProfiler::Scope showScope("Main window showing");
     if(!mainWindow->isVisible()){
         mainWindow->show();
     }
+    showScope.end();
 
+    PhaseProfiler::Scope optionScope("Command line option processing");
     ext->optionManager().parseCommandLine2();
+    optionScope.end();
+
+    ProjectManager::putPhaseProfilerReport();
 
     int result = 0;
     
@@ -13,6 +13,10 @@
 #include <cnoid/NullOut>
 #include <GL/glu.h>
 #include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <mutex>
 #include <iostream>
 #include <stdexcept>
@@ -29,6 +33,12 @@ const bool USE_GL_FLOAT_FOR_NORMALS = false;
 
 const float MinLineWidthForPicking = 5.0f;
 
+// The first location of the four vertex attributes which store the instance matrix
+const GLuint INSTANCE_MATRIX_LOCATION = 4;
+
+// The number of the frames whose timer queries can be in flight at the same time
+const int NumProfilingFrames = 3;
+
 typedef vector<Affine3, Eigen::aligned_allocator<Affine3>> Affine3Array;
 
 std::mutex extensionMutex;
@@ -69,8 +79,11 @@ public:
     static const int MAX_NUM_BUFFERS = 4;
     GLuint vao;
     GLuint vbos[MAX_NUM_BUFFERS];
-    GLsizei numVertices;
+    GLsizeiptr bufferCapacities[MAX_NUM_BUFFERS];
+    GLsizei numVertices; // The number of the indices when indexType is not zero
+    GLenum indexType; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT for the indexed vertices
     int numBuffers;
+    bool isStreaming; // true when the buffers are rewritten for the updates of the object
     SgObjectPtr sceneObject;
     ScopedConnection connection;
     Matrix4* pLocalTransform;
@@ -91,15 +104,18 @@ public:
         clearHandles();
         glGenVertexArrays(1, &vao);
         pLocalTransform = nullptr;
+        isStreaming = false;
     }
 
     void clearHandles(){
         vao = 0;
         for(int i=0; i < MAX_NUM_BUFFERS; ++i){
             vbos[i] = 0;
+            bufferCapacities[i] = 0;
         }
         numBuffers = 0;
         numVertices = 0;
+        indexType = 0;
     }
 
     virtual void discard() override { clearHandles(); }
@@ -125,6 +141,7 @@ public:
             glDeleteBuffers(numBuffers, vbos);
             for(int i=0; i < numBuffers; ++i){
                 vbos[i] = 0;
+                bufferCapacities[i] = 0;
             }
             numBuffers = 0;
         }
@@ -266,6 +283,71 @@ public:
     Matrix4 projectionMatrix;
     Matrix4 PV;
 
+    bool isFrustumCullingEnabled;
+    double cullingDistance;
+    bool isFrustumCullingBeingProcessed;
+    // The planes (a, b, c, d) in the world coordinate, where ax + by + cz + d >= 0 is inside
+    Vector4 cullingPlanes[7];
+    int numCullingPlanes;
+
+    bool isLODEnabled;
+
+    bool isInstancingEnabled;
+    bool isShapeQueueBeingProcessed;
+    ShaderProgram* shapeQueueProgram;
+    GLuint instanceMatrixBuffer;
+    vector<Matrix4f, Eigen::aligned_allocator<Matrix4f>> instanceMatrices;
+    TextureResource* boundTextureResource;
+
+    /*
+      The opaque shapes are queued in the batches of the shapes sharing the mesh, the material
+      and the texture, and the batches are rendered in the order which minimizes the state changes.
+    */
+    struct InstanceKey {
+        SgMesh* mesh;
+        SgMaterial* material;
+        SgTexture* texture;
+        bool operator==(const InstanceKey& rhs) const {
+            return mesh == rhs.mesh && material == rhs.material && texture == rhs.texture;
+        }
+    };
+    struct InstanceKeyHash {
+        size_t operator()(const InstanceKey& key) const {
+            return std::hash<void*>()(key.mesh) ^
+                (std::hash<void*>()(key.material) << 1) ^ (std::hash<void*>()(key.texture) << 2);
+        }
+    };
+    struct InstanceBatch {
+        SgShape* shape; // the shape rendered for the instances
+        SgTexture* texture;
+        Affine3Array positions;
+    };
+    unordered_map<InstanceKey, int, InstanceKeyHash> instanceBatchMap;
+    vector<InstanceBatch> instanceBatches;
+    vector<int> instanceBatchOrder;
+    int numInstanceBatches;
+
+    /*
+      The GPU time of a pass is measured by the timer queries of the intervals in which the pass
+      is being rendered because an overlay may be rendered in the middle of the main pass.
+    */
+    struct ProfilingFrame {
+        vector<GLuint> queries;
+        vector<int> queryPasses;
+        int numQueries;
+        bool isPending;
+        GLSLSceneRenderer::FrameStatistics statistics;
+        ProfilingFrame() : numQueries(0), isPending(false) { }
+    };
+    bool isFrameProfilingEnabled;
+    ProfilingFrame profilingFrames[NumProfilingFrames];
+    int profilingFrameIndex;
+    ProfilingFrame* currentProfilingFrame;
+    int currentRenderingPass;
+    std::chrono::steady_clock::time_point frameStartTime;
+    GLSLSceneRenderer::FrameStatistics frameStatistics;
+    bool hasFrameStatistics;
+
     vector<function<void()>> postRenderingFunctions;
 
     struct RenderingFunction {
@@ -281,8 +363,15 @@ public:
         void operator()(){ func(object, position, id); }
     };
     vector<RenderingFunction, Eigen::aligned_allocator<RenderingFunction>> transparentRenderingFunctions;
+    vector<std::pair<double, int>> transparentRenderingOrder;
     
     std::set<int> shadowLightIndices;
+    int shadowMapWidth;
+    int shadowMapHeight;
+    bool isShadowMapCacheEnabled;
+    std::unordered_set<SgObject*> dynamicShadowCasters;
+    int shadowMapGenerationMode;
+    bool isDynamicShadowCasterBeingProcessed;
 
     int lightingMode;
     SgMaterialPtr defaultMaterial;
@@ -343,8 +432,40 @@ public:
     vector<std::function<void(GLSLSceneRenderer* renderer)>> newExtendFunctions;
 
     void renderChildNodes(SgGroup* group){
-        for(auto p = group->cbegin(); p != group->cend(); ++p){
-            renderingFunctions.dispatch(*p);
+        if(shadowMapGenerationMode != PhongShadowLightingProgram::FULL_SHADOW_MAP &&
+           !isDynamicShadowCasterBeingProcessed && dynamicShadowCasters.count(group)){
+            isDynamicShadowCasterBeingProcessed = true;
+            for(auto p = group->cbegin(); p != group->cend(); ++p){
+                renderingFunctions.dispatch(*p);
+            }
+            isDynamicShadowCasterBeingProcessed = false;
+        } else {
+            for(auto p = group->cbegin(); p != group->cend(); ++p){
+                renderingFunctions.dispatch(*p);
+            }
+        }
+    }
+
+    void countDrawCall(){
+        if(currentProfilingFrame){
+            ++currentProfilingFrame->statistics.numDrawCalls;
+        }
+    }
+
+    void countUploadedBytes(size_t size){
+        if(currentProfilingFrame){
+            currentProfilingFrame->statistics.numUploadedBytes += size;
+        }
+    }
+
+    bool isExcludedShadowCaster() const {
+        switch(shadowMapGenerationMode){
+        case PhongShadowLightingProgram::STATIC_SHADOW_MAP:
+            return isDynamicShadowCasterBeingProcessed;
+        case PhongShadowLightingProgram::DYNAMIC_SHADOW_MAP:
+            return !isDynamicShadowCasterBeingProcessed;
+        default:
+            return false;
         }
     }
     
@@ -355,11 +476,19 @@ public:
     void updateDefaultFramebufferObject();
     bool initializeGL();
     void doRender();
+    void beginFrameProfiling();
+    void endFrameProfiling();
+    void collectFrameProfilingResults();
+    int switchRenderingPass(int pass);
     bool doPick(int x, int y);
     void renderScene();
     bool renderShadowMap(int lightIndex);
+    void renderShadowMapWithCache();
+    void onSceneGraphUpdated(const SgUpdate& update);
     void beginRendering();
     void renderCamera(SgCamera* camera, const Affine3& cameraPosition);
+    void updateCullingPlanes();
+    bool isCulled(const BoundingBox& bbox, const Affine3& T) const;
     void renderLights(LightingProgram* program);
     void renderFog(LightingProgram* program);
     void endRendering();
@@ -372,12 +501,17 @@ public:
     void renderGroup(SgGroup* group);
     void renderTransform(SgTransform* transform);
     void renderSwitch(SgSwitch* node);
+    void renderLOD(SgLOD* lod);
     void renderUnpickableGroup(SgUnpickableGroup* group);
     VertexResource* getOrCreateVertexResource(SgObject* obj);
     void drawVertexResource(VertexResource* resource, GLenum primitiveMode, const Affine3& position);
     void drawBoundingBox(VertexResource* resource, const BoundingBox& bbox);
     void renderShape(SgShape* shape);
     void renderShapeMain(SgShape* shape, const Affine3& position, int pickId);
+    VertexResource* prepareShapeRendering(SgShape* shape, SgTexture* texture, int pickId);
+    bool enqueueShape(SgShape* shape);
+    void renderShapeQueue();
+    void drawVertexResourceInstances(VertexResource* resource, const InstanceBatch& batch);
     void applyCullingMode(SgMesh* mesh);
     void renderPointSet(SgPointSet* pointSet);        
     void renderLineSet(SgLineSet* lineSet);        
@@ -391,6 +525,9 @@ public:
     bool renderTexture(SgTexture* texture);
     bool loadTextureImage(TextureResource* resource, const Image& image);
     void makeVertexBufferObjects(SgShape* shape, VertexResource* resource);
+    bool canWriteIndexedMeshVertices(SgMesh* mesh, bool doWriteTexCoords);
+    void writeIndexedMeshVertices(SgMesh* mesh, SgTexture* texture, VertexResource* resource);
+    SgTexCoordArrayPtr getTransformedTexCoords(SgMesh* mesh, SgTexture* texture);
     void writeMeshVertices(SgMesh* mesh, VertexResource* resource, SgTexture* texResource);
     template<typename value_type, GLenum gltype, GLboolean normalized, class VertexArrayWrapper>
     void writeMeshVerticesSub(SgMesh* mesh, VertexResource* resource, VertexArrayWrapper& normals);
@@ -409,7 +546,10 @@ public:
     void writeMeshTexCoordsHalfFloat(SgMesh* mesh, SgTexture* texture, VertexResource* resource);
     void writeMeshTexCoordsUnsignedShort(SgMesh* mesh, SgTexture* texture, VertexResource* resource);
     void writeMeshColors(SgMesh* mesh, VertexResource* resource);
-    void renderPlot(SgPlot* plot, GLenum primitiveMode, std::function<SgVertexArrayPtr()> getVertices);
+    void renderPlot(
+        SgPlot* plot, GLenum primitiveMode, int numVertices, std::function<void(Vector3f* vertices)> writeVertices);
+    template<class Writer>
+    void writePlotBuffer(VertexResource* resource, int index, GLsizeiptr size, Writer write);
     void clearGLState();
     void setPointSize(float size);
     void setLineWidth(float width);
@@ -464,6 +604,11 @@ void GLSLSceneRendererImpl::initialize()
     isActuallyRendering = false;
     isPicking = false;
     isRenderingShadowMap = false;
+    shadowMapWidth = 2048;
+    shadowMapHeight = 2048;
+    isShadowMapCacheEnabled = false;
+    shadowMapGenerationMode = PhongShadowLightingProgram::FULL_SHADOW_MAP;
+    isDynamicShadowCasterBeingProcessed = false;
     isLowMemoryConsumptionMode = false;
     isBoundingBoxRenderingMode = false;
     isBoundingBoxRenderingForLightweightRenderingGroupEnabled = false;
@@ -481,6 +626,26 @@ void GLSLSceneRendererImpl::initialize()
     viewTransform.setIdentity();
     projectionMatrix.setIdentity();
 
+    isFrustumCullingEnabled = false;
+    cullingDistance = 0.0;
+    isFrustumCullingBeingProcessed = false;
+    numCullingPlanes = 0;
+
+    isLODEnabled = true;
+
+    isInstancingEnabled = true;
+    isShapeQueueBeingProcessed = false;
+    shapeQueueProgram = nullptr;
+    instanceMatrixBuffer = 0;
+    boundTextureResource = nullptr;
+    numInstanceBatches = 0;
+
+    isFrameProfilingEnabled = false;
+    profilingFrameIndex = 0;
+    currentProfilingFrame = nullptr;
+    currentRenderingPass = -1;
+    hasFrameStatistics = false;
+
     lightingMode = GLSceneRenderer::FULL_LIGHTING;
     defaultSmoothShading = true;
     defaultMaterial = new SgMaterial;
@@ -510,6 +675,8 @@ void GLSLSceneRendererImpl::initialize()
         [&](SgTransform* node){ renderTransform(node); });
     renderingFunctions.setFunction<SgSwitch>(
         [&](SgSwitch* node){ renderSwitch(node); });
+    renderingFunctions.setFunction<SgLOD>(
+        [&](SgLOD* node){ renderLOD(node); });
     renderingFunctions.setFunction<SgUnpickableGroup>(
         [&](SgUnpickableGroup* node){ renderUnpickableGroup(node); });
     renderingFunctions.setFunction<SgShape>(
@@ -555,6 +722,14 @@ GLSLSceneRendererImpl::~GLSLSceneRendererImpl()
         glDeleteRenderbuffers(1, &depthBufferForPicking);
         glDeleteFramebuffers(1, &fboForPicking);
     }
+    if(instanceMatrixBuffer){
+        glDeleteBuffers(1, &instanceMatrixBuffer);
+    }
+    for(auto& frame : profilingFrames){
+        if(!frame.queries.empty()){
+            glDeleteQueries(frame.queries.size(), &frame.queries.front());
+        }
+    }
 }
 
 
@@ -658,6 +833,8 @@ bool GLSLSceneRendererImpl::initializeGL()
 
     glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
 
+    glGenBuffers(1, &instanceMatrixBuffer);
+
     isResourceClearRequested = true;
 
     isCurrentFogUpdated = false;
@@ -699,11 +876,27 @@ void GLSLSceneRenderer::onSceneGraphUpdated(const SgUpdate& update)
     if(SgLightweightRenderingGroup* group = dynamic_cast<SgLightweightRenderingGroup*>(update.path().front())){
         requestToClearResources();
     }
+
+    impl->onSceneGraphUpdated(update);
     
     GLSceneRenderer::onSceneGraphUpdated(update);
 }
 
 
+void GLSLSceneRendererImpl::onSceneGraphUpdated(const SgUpdate& update)
+{
+    // The updates of the dynamic shadow casters do not affect the cached static shadow maps
+    if(isShadowMapCacheEnabled){
+        for(auto& object : update.path()){
+            if(dynamicShadowCasters.count(object)){
+                return;
+            }
+        }
+        phongShadowLightingProgram.invalidateShadowMapCache();
+    }
+}
+
+
 ScopedShaderProgramActivator::ScopedShaderProgramActivator
 (ShaderProgram& program, GLSLSceneRendererImpl* renderer)
     : renderer(renderer)
@@ -797,6 +990,10 @@ void GLSLSceneRendererImpl::doRender()
         renderingFunctions.updateDispatchTable();
     }
 
+    if(isFrameProfilingEnabled){
+        beginFrameProfiling();
+    }
+
     self->extractPreprocessedNodes();
     beginRendering();
 
@@ -826,9 +1023,10 @@ void GLSLSceneRendererImpl::doRender()
             // FULL_LIGHTING with shadows
             auto& program = phongShadowLightingProgram;
             Array4i vp = self->viewport();
-            int w, h;
-            program.getShadowMapSize(w, h);
-            self->setViewport(0, 0, w, h);
+            program.setShadowMapSize(shadowMapWidth, shadowMapHeight);
+            program.setShadowMapCacheEnabled(isShadowMapCacheEnabled);
+            self->setViewport(0, 0, shadowMapWidth, shadowMapHeight);
+            switchRenderingPass(GLSLSceneRenderer::SHADOW_PASS);
             pushProgram(program.shadowMapProgram());
             isRenderingShadowMap = true;
             isActuallyRendering = false;
@@ -874,6 +1072,103 @@ void GLSLSceneRendererImpl::doRender()
 
     popProgram();
     endRendering();
+
+    if(currentProfilingFrame){
+        endFrameProfiling();
+    }
+}
+
+
+void GLSLSceneRendererImpl::beginFrameProfiling()
+{
+    collectFrameProfilingResults();
+
+    auto& frame = profilingFrames[profilingFrameIndex];
+    if(frame.isPending){
+        // The frame is not measured to avoid waiting for the GPU
+        return;
+    }
+    frame.numQueries = 0;
+    auto& statistics = frame.statistics;
+    statistics.cpuTime = 0.0;
+    std::fill(statistics.gpuTimes, statistics.gpuTimes + GLSLSceneRenderer::NUM_RENDERING_PASSES, 0.0);
+    statistics.numDrawCalls = 0;
+    statistics.numUploadedBytes = 0;
+    currentProfilingFrame = &frame;
+    frameStartTime = std::chrono::steady_clock::now();
+}
+
+
+void GLSLSceneRendererImpl::endFrameProfiling()
+{
+    switchRenderingPass(-1);
+
+    auto& frame = *currentProfilingFrame;
+    frame.statistics.cpuTime =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStartTime).count();
+    frame.isPending = true;
+    currentProfilingFrame = nullptr;
+    profilingFrameIndex = (profilingFrameIndex + 1) % NumProfilingFrames;
+}
+
+
+void GLSLSceneRendererImpl::collectFrameProfilingResults()
+{
+    // The pending frames are checked from the oldest one
+    for(int i=0; i < NumProfilingFrames; ++i){
+        auto& frame = profilingFrames[(profilingFrameIndex + i) % NumProfilingFrames];
+        if(!frame.isPending){
+            continue;
+        }
+        if(frame.numQueries > 0){
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(frame.queries[frame.numQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if(!available){
+                break;
+            }
+        }
+        for(int j=0; j < frame.numQueries; ++j){
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(frame.queries[j], GL_QUERY_RESULT, &elapsed);
+            frame.statistics.gpuTimes[frame.queryPasses[j]] += elapsed * 1.0e-6;
+        }
+        frameStatistics = frame.statistics;
+        hasFrameStatistics = true;
+        frame.isPending = false;
+    }
+}
+
+
+/**
+   \return The pass which has been measured so that it can be resumed.
+   The measurement is finished when the pass is -1.
+*/
+int GLSLSceneRendererImpl::switchRenderingPass(int pass)
+{
+    const int prevPass = currentRenderingPass;
+    
+    if(!currentProfilingFrame || pass == currentRenderingPass){
+        return prevPass;
+    }
+    if(currentRenderingPass >= 0){
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+    currentRenderingPass = pass;
+    
+    if(pass >= 0){
+        auto& frame = *currentProfilingFrame;
+        if(frame.numQueries == static_cast<int>(frame.queries.size())){
+            GLuint query;
+            glGenQueries(1, &query);
+            frame.queries.push_back(query);
+            frame.queryPasses.push_back(pass);
+        } else {
+            frame.queryPasses[frame.numQueries] = pass;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.numQueries++]);
+    }
+
+    return prevPass;
 }
 
 
@@ -992,6 +1287,7 @@ void GLSLSceneRendererImpl::renderScene()
         postRenderingFunctions.clear();
         transparentRenderingFunctions.clear();
 
+        switchRenderingPass(GLSLSceneRenderer::MAIN_PASS);
         renderSceneGraphNodes();
 
         for(auto&& func : postRenderingFunctions){
@@ -1000,6 +1296,7 @@ void GLSLSceneRendererImpl::renderScene()
         postRenderingFunctions.clear();
         
         if(!transparentRenderingFunctions.empty()){
+            switchRenderingPass(GLSLSceneRenderer::TRANSPARENT_PASS);
             renderTransparentObjects();
         }
     }
@@ -1016,7 +1313,11 @@ bool GLSLSceneRendererImpl::renderShadowMap(int lightIndex)
         if(shadowMapCamera){
             renderCamera(shadowMapCamera, T);
             phongShadowLightingProgram.setShadowMapViewProjection(PV);
-            renderSceneGraphNodes();
+            if(isShadowMapCacheEnabled){
+                renderShadowMapWithCache();
+            } else {
+                renderSceneGraphNodes();
+            }
             glFlush();
             glFinish();
             return true;
@@ -1026,6 +1327,25 @@ bool GLSLSceneRendererImpl::renderShadowMap(int lightIndex)
 }
     
 
+void GLSLSceneRendererImpl::renderShadowMapWithCache()
+{
+    auto& program = phongShadowLightingProgram;
+    
+    if(!program.isStaticShadowMapValid()){
+        shadowMapGenerationMode = PhongShadowLightingProgram::STATIC_SHADOW_MAP;
+        program.setShadowMapGenerationMode(shadowMapGenerationMode);
+        renderSceneGraphNodes();
+    }
+
+    shadowMapGenerationMode = PhongShadowLightingProgram::DYNAMIC_SHADOW_MAP;
+    program.setShadowMapGenerationMode(shadowMapGenerationMode);
+    renderSceneGraphNodes();
+
+    shadowMapGenerationMode = PhongShadowLightingProgram::FULL_SHADOW_MAP;
+    program.setShadowMapGenerationMode(shadowMapGenerationMode);
+}
+
+
 void GLSLSceneRendererImpl::renderCamera(SgCamera* camera, const Affine3& cameraPosition)
 {
     if(SgPerspectiveCamera* pers = dynamic_cast<SgPerspectiveCamera*>(camera)){
@@ -1057,6 +1377,57 @@ void GLSLSceneRendererImpl::renderCamera(SgCamera* camera, const Affine3& camera
 
     modelMatrixStack.clear();
     modelMatrixStack.push_back(Affine3::Identity());
+
+    isFrustumCullingBeingProcessed = isFrustumCullingEnabled;
+    if(isFrustumCullingBeingProcessed){
+        updateCullingPlanes();
+    }
+}
+
+
+/**
+   The planes of the view frustum are extracted from the view projection matrix.
+   The distance plane is not used for the shadow maps because the objects out of the
+   distance may cast the shadows.
+*/
+void GLSLSceneRendererImpl::updateCullingPlanes()
+{
+    const auto r0 = PV.row(0);
+    const auto r1 = PV.row(1);
+    const auto r2 = PV.row(2);
+    const auto r3 = PV.row(3);
+    cullingPlanes[0] = (r3 + r0).transpose();
+    cullingPlanes[1] = (r3 - r0).transpose();
+    cullingPlanes[2] = (r3 + r1).transpose();
+    cullingPlanes[3] = (r3 - r1).transpose();
+    cullingPlanes[4] = (r3 + r2).transpose();
+    cullingPlanes[5] = (r3 - r2).transpose();
+    numCullingPlanes = 6;
+
+    if(cullingDistance > 0.0 && !isRenderingShadowMap){
+        // The camera looks at the -z direction in the view coordinate
+        cullingPlanes[6] = viewTransform.matrix().row(2).transpose();
+        cullingPlanes[6][3] += cullingDistance;
+        numCullingPlanes = 7;
+    }
+}
+
+
+bool GLSLSceneRendererImpl::isCulled(const BoundingBox& bbox, const Affine3& T) const
+{
+    if(bbox.empty()){
+        return false;
+    }
+    const Vector3 c = T * bbox.center();
+    const Vector3 e = T.linear().cwiseAbs() * (0.5 * bbox.size());
+    for(int i=0; i < numCullingPlanes; ++i){
+        const Vector4& plane = cullingPlanes[i];
+        const auto n = plane.head<3>();
+        if(n.dot(c) + plane[3] + n.cwiseAbs().dot(e) < 0.0){
+            return true;
+        }
+    }
+    return false;
 }
 
 
@@ -1098,7 +1469,18 @@ void GLSLSceneRendererImpl::renderSceneGraphNodes()
         renderFog(currentLightingProgram);
     }
 
+    // The texture unit may have been used by another renderer sharing the context
+    boundTextureResource = nullptr;
+
+    isShapeQueueBeingProcessed = !isPicking;
+    shapeQueueProgram = currentProgram;
+
     renderingFunctions.dispatch(self->sceneRoot());
+
+    if(isShapeQueueBeingProcessed){
+        renderShapeQueue();
+        isShapeQueueBeingProcessed = false;
+    }
 }
 
 
@@ -1306,6 +1688,41 @@ void GLSLSceneRendererImpl::renderSwitch(SgSwitch* node)
 }
 
 
+/**
+   The projected size is the diameter of the bounding sphere in pixels. The full detail is
+   used in picking so that the picked points are on the actual shapes.
+*/
+void GLSLSceneRendererImpl::renderLOD(SgLOD* lod)
+{
+    SgNode* level = nullptr;
+    
+    if(isLODEnabled && !isPicking && lod->numLevels() > 0){
+        const BoundingBox& bbox = lod->boundingBox();
+        if(!bbox.empty()){
+            const Affine3& T = modelMatrixStack.back();
+            const Vector3 c = viewTransform * (T * bbox.center());
+            const double w = projectionMatrix.row(3).dot(Vector4(c.x(), c.y(), c.z(), 1.0));
+            if(w > 0.0){
+                const double radius = 0.5 * (T.linear() * bbox.size()).norm();
+                const double size = radius * projectionMatrix(1, 1) * viewportHeight / w;
+                for(int i=0; i < lod->numLevels(); ++i){
+                    if(size >= lod->switchingSize(i)){
+                        break;
+                    }
+                    level = lod->level(i);
+                }
+            }
+        }
+    }
+
+    if(!level){
+        renderGroup(lod);
+    } else {
+        renderingFunctions.dispatch(level);
+    }
+}
+
+
 void GLSLSceneRendererImpl::renderUnpickableGroup(SgUnpickableGroup* group)
 {
     if(!isPicking){
@@ -1319,6 +1736,14 @@ void GLSLSceneRendererImpl::renderTransform(SgTransform* transform)
     Affine3 T;
     transform->getTransform(T);
     modelMatrixStack.push_back(modelMatrixStack.back() * T);
+
+    if(isFrustumCullingBeingProcessed){
+        if(isCulled(transform->untransformedBoundingBox(), modelMatrixStack.back())){
+            modelMatrixStack.pop_back();
+            return;
+        }
+    }
+    
     pushPickId(transform);
 
     renderChildNodes(transform);
@@ -1365,7 +1790,12 @@ void GLSLSceneRendererImpl::drawVertexResource(VertexResource* resource, GLenum
 {
     currentProgram->setTransform(PV, viewTransform, position, resource->pLocalTransform);
     glBindVertexArray(resource->vao);
-    glDrawArrays(primitiveMode, 0, resource->numVertices);
+    if(resource->indexType){
+        glDrawElements(primitiveMode, resource->numVertices, resource->indexType, nullptr);
+    } else {
+        glDrawArrays(primitiveMode, 0, resource->numVertices);
+    }
+    countDrawCall();
 }
 
 
@@ -1408,6 +1838,14 @@ void GLSLSceneRendererImpl::renderShape(SgShape* shape)
 {
     SgMesh* mesh = shape->mesh();
     if(mesh && mesh->hasVertices()){
+        if(isRenderingShadowMap && isExcludedShadowCaster()){
+            return;
+        }
+        if(isFrustumCullingBeingProcessed){
+            if(isCulled(mesh->boundingBox(), modelMatrixStack.back())){
+                return;
+            }
+        }
         SgMaterial* material = shape->material();
         if(material && material->transparency() > 0.0){
             if(!isRenderingShadowMap){
@@ -1419,7 +1857,7 @@ void GLSLSceneRendererImpl::renderShape(SgShape* shape)
                         renderShapeMain(static_cast<SgShape*>(object), position, id); });
                 popPickId();
             }
-        } else {
+        } else if(!isShapeQueueBeingProcessed || !enqueueShape(shape)){
             auto pickId = pushPickId(shape, false);
             renderShapeMain(shape, modelMatrixStack.back(), pickId);
             popPickId();
@@ -1429,6 +1867,27 @@ void GLSLSceneRendererImpl::renderShape(SgShape* shape)
 
 
 void GLSLSceneRendererImpl::renderShapeMain(SgShape* shape, const Affine3& position, int pickId)
+{
+    auto mesh = shape->mesh();
+    VertexResource* resource =
+        prepareShapeRendering(shape, isTextureBeingRendered ? shape->texture() : nullptr, pickId);
+    
+    if(isBoundingBoxRenderingMode){
+        drawBoundingBox(resource, mesh->boundingBox());
+    } else {
+        if(!isRenderingShadowMap){
+            applyCullingMode(mesh);
+        }
+        drawVertexResource(resource, GL_TRIANGLES, position);
+
+        if(isNormalVisualizationEnabled && isActuallyRendering && resource->normalVisualization){
+            renderLineSet(resource->normalVisualization);
+        }
+    }
+}
+
+
+VertexResource* GLSLSceneRendererImpl::prepareShapeRendering(SgShape* shape, SgTexture* texture, int pickId)
 {
     auto mesh = shape->mesh();
     
@@ -1442,10 +1901,8 @@ void GLSLSceneRendererImpl::renderShapeMain(SgShape* shape, const Affine3& posit
 
         if(currentMaterialLightingProgram){
             bool isTextureValid = false;
-            if(isTextureBeingRendered){
-                if(auto texture = shape->texture()){
-                    isTextureValid = renderTexture(texture);
-                }
+            if(texture){
+                isTextureValid = renderTexture(texture);
             }
             currentMaterialLightingProgram->setTextureEnabled(isTextureValid);
         }
@@ -1455,18 +1912,132 @@ void GLSLSceneRendererImpl::renderShapeMain(SgShape* shape, const Affine3& posit
     if(!resource->isValid()){
         makeVertexBufferObjects(shape, resource);
     }
-    if(isBoundingBoxRenderingMode){
-        drawBoundingBox(resource, mesh->boundingBox());
-    } else {
+    return resource;
+}
+
+
+/**
+   The shape is added to the batch of the shapes sharing the mesh, the material and the texture
+   instead of being rendered immediately. The batches are rendered after the scene graph traversal.
+   \return false if the shape must be rendered immediately
+*/
+bool GLSLSceneRendererImpl::enqueueShape(SgShape* shape)
+{
+    // The vertex positions in the low memory consumption mode require the local transform
+    if(currentProgram != shapeQueueProgram || isLowMemoryConsumptionRenderingBeingProcessed ||
+       isBoundingBoxRenderingMode || isNormalVisualizationEnabled){
+        return false;
+    }
+
+    InstanceKey key;
+    key.mesh = shape->mesh();
+    key.material = shape->material();
+    key.texture = isTextureBeingRendered ? shape->texture() : nullptr;
+
+    auto inserted = instanceBatchMap.emplace(key, numInstanceBatches);
+    if(inserted.second){
+        if(numInstanceBatches == static_cast<int>(instanceBatches.size())){
+            instanceBatches.emplace_back();
+        }
+        auto& batch = instanceBatches[numInstanceBatches++];
+        batch.shape = shape;
+        batch.texture = key.texture;
+        batch.positions.clear();
+    }
+    instanceBatches[inserted.first->second].positions.push_back(modelMatrixStack.back());
+
+    return true;
+}
+
+
+void GLSLSceneRendererImpl::renderShapeQueue()
+{
+    /*
+      The batches are sorted by the texture and the material so that the texture binding and
+      the material uniforms are only updated when they actually change between the batches.
+    */
+    instanceBatchOrder.resize(numInstanceBatches);
+    for(int i=0; i < numInstanceBatches; ++i){
+        instanceBatchOrder[i] = i;
+    }
+    std::sort(instanceBatchOrder.begin(), instanceBatchOrder.end(),
+              [&](int i1, int i2){
+                  auto& b1 = instanceBatches[i1];
+                  auto& b2 = instanceBatches[i2];
+                  if(b1.texture != b2.texture){
+                      return b1.texture < b2.texture;
+                  }
+                  auto m1 = b1.shape->material();
+                  auto m2 = b2.shape->material();
+                  if(m1 != m2){
+                      return m1 < m2;
+                  }
+                  return i1 < i2;
+              });
+
+    const bool isInstancingAvailable = isInstancingEnabled && currentProgram->isInstancingAvailable();
+    
+    for(auto index : instanceBatchOrder){
+        auto& batch = instanceBatches[index];
+        auto mesh = batch.shape->mesh();
+        VertexResource* resource = prepareShapeRendering(batch.shape, batch.texture, 0);
         if(!isRenderingShadowMap){
             applyCullingMode(mesh);
         }
-        drawVertexResource(resource, GL_TRIANGLES, position);
+        if(isInstancingAvailable && batch.positions.size() > 1 && !resource->pLocalTransform){
+            drawVertexResourceInstances(resource, batch);
+        } else {
+            for(auto& position : batch.positions){
+                drawVertexResource(resource, GL_TRIANGLES, position);
+            }
+        }
+        batch.shape = nullptr;
+        batch.texture = nullptr;
+    }
+    numInstanceBatches = 0;
+    instanceBatchMap.clear();
+}
 
-        if(isNormalVisualizationEnabled && isActuallyRendering && resource->normalVisualization){
-            renderLineSet(resource->normalVisualization);
+
+void GLSLSceneRendererImpl::drawVertexResourceInstances(VertexResource* resource, const InstanceBatch& batch)
+{
+    const GLsizei numInstances = batch.positions.size();
+    instanceMatrices.resize(numInstances);
+    for(GLsizei i=0; i < numInstances; ++i){
+        instanceMatrices[i] = batch.positions[i].matrix().cast<float>();
+    }
+
+    currentProgram->setTransform(PV, viewTransform, Affine3::Identity(), nullptr);
+    currentProgram->setInstancingEnabled(true);
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceMatrixBuffer);
+    glBufferData(GL_ARRAY_BUFFER, numInstances * sizeof(Matrix4f), instanceMatrices.data(), GL_STREAM_DRAW);
+    countUploadedBytes(numInstances * sizeof(Matrix4f));
+    {
+        LockVertexArrayAPI lock;
+        glBindVertexArray(resource->vao);
+        for(GLuint i=0; i < 4; ++i){
+            const GLuint location = INSTANCE_MATRIX_LOCATION + i;
+            glVertexAttribPointer(
+                location, 4, GL_FLOAT, GL_FALSE, sizeof(Matrix4f), ((GLubyte*)NULL + (i * 4 * sizeof(float))));
+            glVertexAttribDivisor(location, 1);
+            glEnableVertexAttribArray(location);
         }
     }
+
+    if(resource->indexType){
+        glDrawElementsInstanced(GL_TRIANGLES, resource->numVertices, resource->indexType, nullptr, numInstances);
+    } else {
+        glDrawArraysInstanced(GL_TRIANGLES, 0, resource->numVertices, numInstances);
+    }
+    countDrawCall();
+
+    // The attributes are disabled so that the usual drawing of the vertex array is not affected
+    for(GLuint i=0; i < 4; ++i){
+        glDisableVertexAttribArray(INSTANCE_MATRIX_LOCATION + i);
+    }
+    
+    currentProgram->setInstancingEnabled(false);
 }
 
 
@@ -1525,10 +2096,22 @@ void GLSLSceneRendererImpl::renderTransparentObjects()
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         glDepthMask(GL_FALSE);
-    }
 
-    for(auto& func : transparentRenderingFunctions){
-        func();
+        // The objects are rendered from back to front so that they are blended correctly
+        const int n = transparentRenderingFunctions.size();
+        transparentRenderingOrder.resize(n);
+        for(int i=0; i < n; ++i){
+            const Vector3 p = viewTransform * transparentRenderingFunctions[i].position.translation();
+            transparentRenderingOrder[i] = std::make_pair(p.z(), i);
+        }
+        std::sort(transparentRenderingOrder.begin(), transparentRenderingOrder.end());
+        for(auto& order : transparentRenderingOrder){
+            transparentRenderingFunctions[order.second]();
+        }
+    } else {
+        for(auto& func : transparentRenderingFunctions){
+            func();
+        }
     }
 
     if(!isPicking){
@@ -1558,9 +2141,12 @@ bool GLSLSceneRendererImpl::renderTexture(SgTexture* texture)
     if(p != currentResourceMap->end()){
         resource = static_cast<TextureResource*>(p->second.get());
         if(resource->isLoaded){
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, resource->textureId);
-            glBindSampler(0, resource->samplerId);
+            if(resource != boundTextureResource || resource->isImageUpdateNeeded){
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, resource->textureId);
+                glBindSampler(0, resource->samplerId);
+                boundTextureResource = resource;
+            }
             if(resource->isImageUpdateNeeded){
                 loadTextureImage(resource, sgImage->constImage());
             }
@@ -1573,6 +2159,7 @@ bool GLSLSceneRendererImpl::renderTexture(SgTexture* texture)
         glActiveTexture(GL_TEXTURE0);
         glGenTextures(1, &resource->textureId);
         glBindTexture(GL_TEXTURE_2D, resource->textureId);
+        boundTextureResource = resource;
 
         if(loadTextureImage(resource, sgImage->constImage())){
             glGenSamplers(1, &samplerId);
@@ -1618,6 +2205,7 @@ bool GLSLSceneRendererImpl::loadTextureImage(TextureResource* resource, const Im
 
     if(resource->isLoaded && resource->isSameSizeAs(image)){
         glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, image.pixels());
+        countUploadedBytes(width * height * image.numComponents());
 
     } else {
         double w2 = log2(width);
@@ -1626,6 +2214,7 @@ bool GLSLSceneRendererImpl::loadTextureImage(TextureResource* resource, const Im
         double ph = ceil(h2);
         if((pw - w2 == 0.0) && (ph - h2 == 0.0)){
             glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, image.pixels());
+            countUploadedBytes(width * height * image.numComponents());
         } else{
             GLsizei potWidth = pow(2.0, pw);
             GLsizei potHeight = pow(2.0, ph);
@@ -1633,6 +2222,7 @@ bool GLSLSceneRendererImpl::loadTextureImage(TextureResource* resource, const Im
             gluScaleImage(format, width, height, GL_UNSIGNED_BYTE, image.pixels(),
                           potWidth, potHeight, GL_UNSIGNED_BYTE, &scaledImageBuf.front());
             glTexImage2D(GL_TEXTURE_2D, 0, format, potWidth, potHeight, 0, format, GL_UNSIGNED_BYTE, &scaledImageBuf.front());
+            countUploadedBytes(scaledImageBuf.size());
         }
         resource->isLoaded = true;
         resource->width = width;
@@ -1660,6 +2250,15 @@ void GLSLSceneRenderer::onImageUpdated(SgImage* image)
 void GLSLSceneRendererImpl::makeVertexBufferObjects(SgShape* shape, VertexResource* resource)
 {
     auto mesh = shape->mesh();
+    auto texture = shape->texture();
+    const bool doWriteTexCoords = texture && mesh->hasTexCoords() && isTextureBeingRendered;
+
+    resource->indexType = 0;
+
+    if(canWriteIndexedMeshVertices(mesh, doWriteTexCoords)){
+        writeIndexedMeshVertices(mesh, doWriteTexCoords ? texture : nullptr, resource);
+        return;
+    }
 
     if(isLowMemoryConsumptionRenderingBeingProcessed){
         writeMeshVerticesNormalizedShort(mesh, resource);
@@ -1676,8 +2275,7 @@ void GLSLSceneRendererImpl::makeVertexBufferObjects(SgShape* shape, VertexResour
         writeMeshNormalsShort(mesh, resource);
     } 
 
-    auto texture = shape->texture();
-    if(texture && mesh->hasTexCoords() && isTextureBeingRendered){
+    if(doWriteTexCoords){
         if(isLowMemoryConsumptionRenderingBeingProcessed){
             writeMeshTexCoordsHalfFloat(mesh, texture, resource);
         } else {
@@ -1691,6 +2289,115 @@ void GLSLSceneRendererImpl::makeVertexBufferObjects(SgShape* shape, VertexResour
 }
 
 
+/**
+   The indexed vertices are available when all the attributes of a vertex are determined by the
+   vertex index. The vertices shared by the triangles are then written only once.
+*/
+bool GLSLSceneRendererImpl::canWriteIndexedMeshVertices(SgMesh* mesh, bool doWriteTexCoords)
+{
+    if(isLowMemoryConsumptionRenderingBeingProcessed || !defaultSmoothShading || isNormalVisualizationEnabled){
+        return false;
+    }
+    const size_t numVertices = mesh->vertices()->size();
+    if(!mesh->normals() || !mesh->normalIndices().empty() || mesh->normals()->size() != numVertices){
+        return false;
+    }
+    if(mesh->hasColors() && (!mesh->colorIndices().empty() || mesh->colors()->size() != numVertices)){
+        return false;
+    }
+    if(doWriteTexCoords && (!mesh->texCoordIndices().empty() || mesh->texCoords()->size() != numVertices)){
+        return false;
+    }
+    return true;
+}
+
+
+/**
+   The attributes are interleaved in a buffer in the order of the position, the normal,
+   the texture coordinate and the color. The indices are written as 16-bit values when
+   the number of the vertices allows it.
+*/
+void GLSLSceneRendererImpl::writeIndexedMeshVertices(SgMesh* mesh, SgTexture* texture, VertexResource* resource)
+{
+    const auto& vertices = *mesh->vertices();
+    const auto& normals = *mesh->normals();
+    const int numVertices = vertices.size();
+
+    SgTexCoordArrayPtr texCoords;
+    if(texture){
+        texCoords = getTransformedTexCoords(mesh, texture);
+    }
+    const bool hasColors = mesh->hasColors();
+
+    const size_t normalOffset = sizeof(Vector3f);
+    const size_t texCoordOffset = normalOffset + sizeof(Vector3f);
+    const size_t colorOffset = texCoordOffset + (texCoords ? sizeof(Vector2f) : 0);
+    const size_t stride = colorOffset + (hasColors ? 4 : 0);
+
+    vector<GLubyte> buf(stride * numVertices);
+    GLubyte* p = buf.data();
+    for(int i=0; i < numVertices; ++i){
+        std::memcpy(p, vertices[i].data(), sizeof(Vector3f));
+        std::memcpy(p + normalOffset, normals[i].data(), sizeof(Vector3f));
+        if(texCoords){
+            std::memcpy(p + texCoordOffset, (*texCoords)[i].data(), sizeof(Vector2f));
+        }
+        if(hasColors){
+            const Vector3f c = 255.0f * (*mesh->colors())[i];
+            GLubyte* q = p + colorOffset;
+            q[0] = c[0];
+            q[1] = c[1];
+            q[2] = c[2];
+            q[3] = 255;
+        }
+        p += stride;
+    }
+
+    {
+        LockVertexArrayAPI lock;
+        glBindVertexArray(resource->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, resource->newBuffer());
+        glVertexAttribPointer((GLuint)0, 3, GL_FLOAT, GL_FALSE, stride, ((GLubyte*)NULL + (0)));
+        glVertexAttribPointer((GLuint)1, 3, GL_FLOAT, GL_FALSE, stride, ((GLubyte*)NULL + (normalOffset)));
+        if(texCoords){
+            glVertexAttribPointer((GLuint)2, 2, GL_FLOAT, GL_FALSE, stride, ((GLubyte*)NULL + (texCoordOffset)));
+        }
+        if(hasColors){
+            glVertexAttribPointer((GLuint)3, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride, ((GLubyte*)NULL + (colorOffset)));
+        }
+    }
+    glBufferData(GL_ARRAY_BUFFER, buf.size(), buf.data(), GL_STATIC_DRAW);
+    countUploadedBytes(buf.size());
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    if(texCoords){
+        glEnableVertexAttribArray(2);
+    }
+    if(hasColors){
+        glEnableVertexAttribArray(3);
+    }
+
+    // The element array buffer binding is a state of the vertex array object
+    const auto& triangleVertices = mesh->triangleVertices();
+    const size_t numIndices = triangleVertices.size();
+    {
+        LockVertexArrayAPI lock;
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, resource->newBuffer());
+    }
+    if(numVertices <= 65536){
+        vector<GLushort> indices(triangleVertices.begin(), triangleVertices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+        countUploadedBytes(numIndices * sizeof(GLushort));
+        resource->indexType = GL_UNSIGNED_SHORT;
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(GLuint), triangleVertices.data(), GL_STATIC_DRAW);
+        countUploadedBytes(numIndices * sizeof(GLuint));
+        resource->indexType = GL_UNSIGNED_INT;
+    }
+    resource->numVertices = numIndices;
+}
+
+
 template<typename value_type, GLenum gltype, GLboolean normalized, class VertexArrayWrapper>
 void GLSLSceneRendererImpl::writeMeshVerticesSub
 (SgMesh* mesh, VertexResource* resource, VertexArrayWrapper& vertices)
@@ -1720,6 +2427,7 @@ void GLSLSceneRendererImpl::writeMeshVerticesSub
     }
     auto size = vertices.array.size() * sizeof(value_type);
     glBufferData(GL_ARRAY_BUFFER, size, vertices.array.data(), GL_STATIC_DRAW);
+    countUploadedBytes(size);
     glEnableVertexAttribArray(0);
 }
 
@@ -1836,6 +2544,7 @@ bool GLSLSceneRendererImpl::writeMeshNormalsSub
             glVertexAttribPointer((GLuint)1, glsize, gltype, normalized, 0, ((GLubyte*)NULL + (0)));
         }
         glBufferData(GL_ARRAY_BUFFER, normals.array.size() * sizeof(value_type), normals.array.data(), GL_STATIC_DRAW);
+        countUploadedBytes(normals.array.size() * sizeof(value_type));
         glEnableVertexAttribArray(1);
     }
     
@@ -1954,29 +2663,9 @@ void GLSLSceneRendererImpl::writeMeshTexCoordsSub
 {
     auto& triangleVertices = mesh->triangleVertices();
     const int totalNumVertices = triangleVertices.size();
-    SgTexCoordArrayPtr pOrgTexCoords;
+    SgTexCoordArrayPtr pOrgTexCoords = getTransformedTexCoords(mesh, texture);
     const auto& texCoordIndices = mesh->texCoordIndices();
 
-    auto tt = texture->textureTransform();
-    if(!tt){
-        pOrgTexCoords = mesh->texCoords();
-    } else {
-        Eigen::Rotation2Df R(tt->rotation());
-        const auto& c = tt->center();
-        Eigen::Translation<float, 2> C(c.x(), c.y());
-        const auto& t = tt->translation();
-        Eigen::Translation<float, 2> T(t.x(), t.y());
-        const auto s = tt->scale().cast<float>();
-        Eigen::Affine2f M = T * C * R * Eigen::Scaling(s.x(), s.y()) * C.inverse();
-
-        const auto& orgTexCoords = *mesh->texCoords();
-        const size_t n = orgTexCoords.size();
-        pOrgTexCoords = new SgTexCoordArray(n);
-        for(size_t i=0; i < n; ++i){
-            (*pOrgTexCoords)[i] = M * orgTexCoords[i];
-        }
-    }
-
     texCoords.array.reserve(totalNumVertices);
     const int numTriangles = mesh->numTriangles();
     int faceVertexIndex = 0;
@@ -2003,10 +2692,36 @@ void GLSLSceneRendererImpl::writeMeshTexCoordsSub
     }
     auto size = texCoords.array.size() * sizeof(value_type);
     glBufferData(GL_ARRAY_BUFFER, size, texCoords.array.data(), GL_STATIC_DRAW);
+    countUploadedBytes(size);
     glEnableVertexAttribArray(2);
 }
 
 
+SgTexCoordArrayPtr GLSLSceneRendererImpl::getTransformedTexCoords(SgMesh* mesh, SgTexture* texture)
+{
+    auto tt = texture->textureTransform();
+    if(!tt){
+        return mesh->texCoords();
+    }
+    
+    Eigen::Rotation2Df R(tt->rotation());
+    const auto& c = tt->center();
+    Eigen::Translation<float, 2> C(c.x(), c.y());
+    const auto& t = tt->translation();
+    Eigen::Translation<float, 2> T(t.x(), t.y());
+    const auto s = tt->scale().cast<float>();
+    Eigen::Affine2f M = T * C * R * Eigen::Scaling(s.x(), s.y()) * C.inverse();
+
+    const auto& orgTexCoords = *mesh->texCoords();
+    const size_t n = orgTexCoords.size();
+    SgTexCoordArrayPtr texCoords = new SgTexCoordArray(n);
+    for(size_t i=0; i < n; ++i){
+        (*texCoords)[i] = M * orgTexCoords[i];
+    }
+    return texCoords;
+}
+
+
 void GLSLSceneRendererImpl::writeMeshTexCoordsFloat
 (SgMesh* mesh, SgTexture* texture, VertexResource* resource)
 {
@@ -2121,6 +2836,7 @@ void GLSLSceneRendererImpl::writeMeshColors(SgMesh* mesh, VertexResource* resour
         glVertexAttribPointer((GLuint)3, 3, GL_UNSIGNED_BYTE, GL_TRUE, 0, ((GLubyte*)NULL + (0)));
     }
     glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(Color), colors.data(), GL_STATIC_DRAW);
+    countUploadedBytes(colors.size() * sizeof(Color));
     glEnableVertexAttribArray(3);
 }
     
@@ -2130,6 +2846,9 @@ void GLSLSceneRendererImpl::renderPointSet(SgPointSet* pointSet)
     if(!pointSet->hasVertices()){
         return;
     }
+    if(isRenderingShadowMap && isExcludedShadowCaster()){
+        return;
+    }
 
     ScopedShaderProgramActivator programActivator(solidColorProgram, this);
 
@@ -2140,13 +2859,14 @@ void GLSLSceneRendererImpl::renderPointSet(SgPointSet* pointSet)
         setPointSize(defaultPointSize);
     }
     
-    renderPlot(pointSet, GL_POINTS,
-               [pointSet]() -> SgVertexArrayPtr { return pointSet->vertices(); });
+    auto vertices = pointSet->vertices();
+    renderPlot(pointSet, GL_POINTS, vertices->size(),
+               [vertices](Vector3f* dest){ std::copy(vertices->begin(), vertices->end(), dest); });
 }
 
 
 void GLSLSceneRendererImpl::renderPlot
-(SgPlot* plot, GLenum primitiveMode, std::function<SgVertexArrayPtr()> getVertices)
+(SgPlot* plot, GLenum primitiveMode, int numVertices, std::function<void(Vector3f* vertices)> writeVertices)
 {
     pushPickId(plot);
 
@@ -2161,80 +2881,127 @@ void GLSLSceneRendererImpl::renderPlot
             solidColorProgram.setVertexColorEnabled(true);
         }
     }
-    
-    VertexResource* resource = getOrCreateVertexResource(plot);
-    if(!resource->isValid()){
-        glBindVertexArray(resource->vao);
-        SgVertexArrayPtr vertices = getVertices();
-        const size_t n = vertices->size();
-        resource->numVertices = n;
 
+    /*
+      The buffers are not deleted when the plot is updated. The plots updated every frame
+      such as the point clouds of range sensors are then streamed into the existing buffers.
+    */
+    VertexResource* resource = getOrCreateVertexResource(plot);
+    if(resource->numVertices == 0 && numVertices > 0){
+        if(resource->numBuffers > 0){
+            resource->isStreaming = true;
+        }
+        const size_t n = numVertices;
+        
         {
             LockVertexArrayAPI lock;
-            glBindBuffer(GL_ARRAY_BUFFER, resource->newBuffer());
-            glVertexAttribPointer((GLuint)0, 3, GL_FLOAT, GL_FALSE, 0, ((GLubyte *)NULL + (0)));
-        }
-        glBufferData(GL_ARRAY_BUFFER, vertices->size() * sizeof(Vector3f), vertices->data(), GL_STATIC_DRAW);
-        glEnableVertexAttribArray(0);
-
-        if(hasColors){
-            typedef Eigen::Array<GLubyte,3,1> Color;
-            vector<Color> colors;
-            colors.reserve(n);
-            const SgColorArray& orgColors = *plot->colors();
-            const SgIndexArray& colorIndices = plot->colorIndices();
-            size_t i = 0;
-            if(plot->colorIndices().empty()){
-                const size_t m = std::min(n, orgColors.size());
-                while(i < m){
-                    Vector3f c = 255.0f * orgColors[i];
-                    colors.emplace_back(c[0], c[1], c[2]);
-                    ++i;
-                }
-            } else {
-                const size_t m = std::min(n, colorIndices.size());
-                size_t i = 0;
-                while(i < m){
-                    Vector3f c = 255.0f * orgColors[colorIndices[i]];
-                    colors.emplace_back(c[0], c[1], c[2]);
-                    ++i;
-                }
-            }
-            if(i < n){
-                const auto& c = colors.back();
-                while(i < n){
-                    colors.push_back(c);
-                    ++i;
-                }
+            glBindVertexArray(resource->vao);
+            if(resource->numBuffers == 0){
+                glBindBuffer(GL_ARRAY_BUFFER, resource->newBuffer());
+                glVertexAttribPointer((GLuint)0, 3, GL_FLOAT, GL_FALSE, 0, ((GLubyte *)NULL + (0)));
+                glEnableVertexAttribArray(0);
             }
-            {
-                LockVertexArrayAPI lock;
+            if(hasColors && resource->numBuffers == 1){
                 glBindBuffer(GL_ARRAY_BUFFER, resource->newBuffer());
                 glVertexAttribPointer((GLuint)3, 3, GL_UNSIGNED_BYTE, GL_TRUE, 0, ((GLubyte*)NULL +(0)));
             }
-            glBufferData(GL_ARRAY_BUFFER, n * sizeof(Color), colors.data(), GL_STATIC_DRAW);
+        }
+
+        writePlotBuffer(resource, 0, n * sizeof(Vector3f),
+                        [&](void* buf){ writeVertices(static_cast<Vector3f*>(buf)); });
+
+        if(hasColors){
+            typedef Eigen::Array<GLubyte,3,1> Color;
+            writePlotBuffer(
+                resource, 1, n * sizeof(Color),
+                [&](void* buf){
+                    Color* colors = static_cast<Color*>(buf);
+                    const SgColorArray& orgColors = *plot->colors();
+                    const SgIndexArray& colorIndices = plot->colorIndices();
+                    size_t i = 0;
+                    if(plot->colorIndices().empty()){
+                        const size_t m = std::min(n, orgColors.size());
+                        while(i < m){
+                            Vector3f c = 255.0f * orgColors[i];
+                            colors[i] << c[0], c[1], c[2];
+                            ++i;
+                        }
+                    } else {
+                        const size_t m = std::min(n, colorIndices.size());
+                        while(i < m){
+                            Vector3f c = 255.0f * orgColors[colorIndices[i]];
+                            colors[i] << c[0], c[1], c[2];
+                            ++i;
+                        }
+                    }
+                    if(i < n){
+                        const Color c = (i > 0) ? colors[i - 1] : Color(255, 255, 255);
+                        while(i < n){
+                            colors[i++] = c;
+                        }
+                    }
+                });
             glEnableVertexAttribArray(3);
+        } else if(resource->numBuffers > 1){
+            glDisableVertexAttribArray(3);
         }
-    }        
+        
+        resource->numVertices = n;
+    }
 
-    drawVertexResource(resource, primitiveMode, modelMatrixStack.back());
+    if(resource->numVertices > 0){
+        drawVertexResource(resource, primitiveMode, modelMatrixStack.back());
+    }
     
     popPickId();
 }
 
 
-static SgVertexArrayPtr getLineSetVertices(SgLineSet* lineSet)
+/**
+   The buffer storage is reallocated with some margin only when the data does not fit in it,
+   and the previous storage is orphaned when the buffer is rewritten for streaming so that
+   the writing does not wait for the completion of the draw calls using the previous data.
+*/
+template<class Writer>
+void GLSLSceneRendererImpl::writePlotBuffer(VertexResource* resource, int index, GLsizeiptr size, Writer write)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, resource->vbo(index));
+
+    auto& capacity = resource->bufferCapacities[index];
+    if(!resource->isStreaming){
+        capacity = size;
+        glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_STATIC_DRAW);
+    } else {
+        if(size > capacity){
+            capacity = std::max(size, capacity + capacity / 2);
+        }
+        glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+    }
+    countUploadedBytes(size);
+
+    if(auto buf = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)){
+        write(buf);
+        if(glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE){
+            return;
+        }
+    }
+
+    // The data is written through the client memory when the mapping fails
+    vector<char> buf(size);
+    write(buf.data());
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, buf.data());
+}
+
+
+static void writeLineSetVertices(SgLineSet* lineSet, Vector3f* vertices)
 {
     const SgVertexArray& orgVertices = *lineSet->vertices();
-    SgVertexArray* vertices = new SgVertexArray;
     const int n = lineSet->numLines();
-    vertices->reserve(n * 2);
     for(int i=0; i < n; ++i){
         SgLineSet::LineRef line = lineSet->line(i);
-        vertices->push_back(orgVertices[line[0]]);
-        vertices->push_back(orgVertices[line[1]]);
+        *vertices++ = orgVertices[line[0]];
+        *vertices++ = orgVertices[line[1]];
     }
-    return vertices;
 }
 
 
@@ -2257,8 +3024,8 @@ void GLSLSceneRendererImpl::renderLineSet(SgLineSet* lineSet)
         setLineWidth(defaultLineWidth);
     }
 
-    renderPlot(lineSet, GL_LINES,
-               [lineSet](){ return getLineSetVertices(lineSet); });
+    renderPlot(lineSet, GL_LINES, lineSet->numLines() * 2,
+               [lineSet](Vector3f* vertices){ writeLineSetVertices(lineSet, vertices); });
 }
 
 
@@ -2269,9 +3036,17 @@ void GLSLSceneRendererImpl::renderOverlay(SgOverlay* overlay)
     }
 
     ScopedShaderProgramActivator programActivator(solidColorProgram, this);
+    const int prevPass = switchRenderingPass(GLSLSceneRenderer::OVERLAY_PASS);
     
     modelMatrixStack.push_back(Affine3::Identity());
 
+    // The culling planes do not correspond to the projection of the overlay
+    const bool wasFrustumCullingBeingProcessed = isFrustumCullingBeingProcessed;
+    isFrustumCullingBeingProcessed = false;
+    // The overlay must be rendered over the other objects
+    const bool wasShapeQueueBeingProcessed = isShapeQueueBeingProcessed;
+    isShapeQueueBeingProcessed = false;
+
     const Matrix4 PV0 = PV;
     SgOverlay::ViewVolume v;
     const Array4i vp = self->viewport();
@@ -2281,7 +3056,10 @@ void GLSLSceneRendererImpl::renderOverlay(SgOverlay* overlay)
     renderGroup(overlay);
 
     PV = PV0;
+    isFrustumCullingBeingProcessed = wasFrustumCullingBeingProcessed;
+    isShapeQueueBeingProcessed = wasShapeQueueBeingProcessed;
     modelMatrixStack.pop_back();
+    switchRenderingPass(prevPass);
 }
 
 
@@ -2393,6 +3171,7 @@ void GLSLSceneRenderer::setColor(const Vector3f& color)
 void GLSLSceneRenderer::clearShadows()
 {
     impl->shadowLightIndices.clear();
+    impl->phongShadowLightingProgram.invalidateShadowMapCache();
 }
 
 
@@ -2403,6 +3182,51 @@ void GLSLSceneRenderer::enableShadowOfLight(int index, bool on)
     } else {
         impl->shadowLightIndices.erase(index);
     }
+    impl->phongShadowLightingProgram.invalidateShadowMapCache();
+}
+
+
+void GLSLSceneRenderer::setShadowMapSize(int width, int height)
+{
+    impl->shadowMapWidth = width;
+    impl->shadowMapHeight = height;
+}
+
+
+void GLSLSceneRenderer::getShadowMapSize(int& out_width, int& out_height) const
+{
+    out_width = impl->shadowMapWidth;
+    out_height = impl->shadowMapHeight;
+}
+
+
+void GLSLSceneRenderer::setShadowMapCacheEnabled(bool on)
+{
+    impl->isShadowMapCacheEnabled = on;
+}
+
+
+bool GLSLSceneRenderer::isShadowMapCacheEnabled() const
+{
+    return impl->isShadowMapCacheEnabled;
+}
+
+
+void GLSLSceneRenderer::setDynamicShadowCaster(SgNode* node, bool on)
+{
+    if(on){
+        impl->dynamicShadowCasters.insert(node);
+    } else {
+        impl->dynamicShadowCasters.erase(node);
+    }
+    impl->phongShadowLightingProgram.invalidateShadowMapCache();
+}
+
+
+void GLSLSceneRenderer::clearDynamicShadowCasters()
+{
+    impl->dynamicShadowCasters.clear();
+    impl->phongShadowLightingProgram.invalidateShadowMapCache();
 }
 
 
@@ -2530,6 +3354,79 @@ void GLSLSceneRenderer::setBoundingBoxRenderingForLightweightRenderingGroupEnabl
 }
 
 
+void GLSLSceneRenderer::setFrustumCullingEnabled(bool on)
+{
+    impl->isFrustumCullingEnabled = on;
+}
+
+
+bool GLSLSceneRenderer::isFrustumCullingEnabled() const
+{
+    return impl->isFrustumCullingEnabled;
+}
+
+
+void GLSLSceneRenderer::setCullingDistance(double distance)
+{
+    impl->cullingDistance = distance;
+}
+
+
+double GLSLSceneRenderer::cullingDistance() const
+{
+    return impl->cullingDistance;
+}
+
+
+void GLSLSceneRenderer::setLODEnabled(bool on)
+{
+    impl->isLODEnabled = on;
+}
+
+
+bool GLSLSceneRenderer::isLODEnabled() const
+{
+    return impl->isLODEnabled;
+}
+
+
+void GLSLSceneRenderer::setInstancedRenderingEnabled(bool on)
+{
+    impl->isInstancingEnabled = on;
+}
+
+
+bool GLSLSceneRenderer::isInstancedRenderingEnabled() const
+{
+    return impl->isInstancingEnabled;
+}
+
+
+void GLSLSceneRenderer::setFrameProfilingEnabled(bool on)
+{
+    if(on && !impl->isFrameProfilingEnabled){
+        impl->hasFrameStatistics = false;
+    }
+    impl->isFrameProfilingEnabled = on;
+}
+
+
+bool GLSLSceneRenderer::isFrameProfilingEnabled() const
+{
+    return impl->isFrameProfilingEnabled;
+}
+
+
+bool GLSLSceneRenderer::getFrameStatistics(FrameStatistics& out_statistics) const
+{
+    if(impl->hasFrameStatistics){
+        out_statistics = impl->frameStatistics;
+        return true;
+    }
+    return false;
+}
+
+
 void GLSLSceneRenderer::setLowMemoryConsumptionMode(bool on)
 {
     if(impl->isLowMemoryConsumptionMode != on){
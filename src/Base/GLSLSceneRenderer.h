@@ -65,6 +65,22 @@ class CNOID_EXPORT GLSLSceneRenderer : public GLSceneRenderer
     virtual void clearShadows() override;
     virtual void enableShadowOfLight(int index, bool on) override;
     virtual void enableShadowAntiAliasing(bool on) override;
+
+    //! The default size is 2048 x 2048
+    void setShadowMapSize(int width, int height);
+    void getShadowMapSize(int& out_width, int& out_height) const;
+
+    /**
+       The depth of the static shadow casters is cached and only the dynamic shadow casters are
+       rendered into the shadow maps every frame. The cache is invalidated by the update notifications
+       of the nodes except the dynamic shadow casters and their descendants, and by the change of the
+       shadow map projections. Note that the nodes which are changed without any update notification
+       must be registered as the dynamic shadow casters. The default value is false.
+    */
+    void setShadowMapCacheEnabled(bool on);
+    bool isShadowMapCacheEnabled() const;
+    void setDynamicShadowCaster(SgNode* node, bool on = true);
+    void clearDynamicShadowCasters();
     virtual void setDefaultSmoothShading(bool on) override;
     virtual SgMaterial* defaultMaterial() override;
     virtual void enableTexture(bool on) override;
@@ -81,6 +97,72 @@ class CNOID_EXPORT GLSLSceneRenderer : public GLSceneRenderer
 
     void setLowMemoryConsumptionMode(bool on);
 
+    /**
+       The transforms and the shapes whose bounding boxes are out of the view frustum are not
+       rendered. The bounding boxes cached in the scene graph are used, so they must be
+       invalidated when the transforms in the descendant nodes are changed without any
+       update notification. The default value is false.
+    */
+    void setFrustumCullingEnabled(bool on);
+    bool isFrustumCullingEnabled() const;
+
+    /**
+       The objects which are farther than the given distance along the view direction are
+       culled in addition to the view frustum. No distance is used when it is zero, which is
+       the default value. This is only effective when the frustum culling is enabled.
+    */
+    void setCullingDistance(double distance);
+    double cullingDistance() const;
+
+    /**
+       A level of a SgLOD node is rendered instead of the full detail when the diameter of the
+       bounding sphere projected on the viewport is smaller than the switching size of the level.
+       The level is chosen by the viewport size, so the renderers of the vision sensors choose
+       the levels by their own resolutions. The default value is true.
+    */
+    void setLODEnabled(bool on);
+    bool isLODEnabled() const;
+
+    /**
+       The opaque shapes which share the same mesh, material and texture are rendered with
+       a single instanced draw call. The default value is true.
+    */
+    void setInstancedRenderingEnabled(bool on);
+    bool isInstancedRenderingEnabled() const;
+
+    enum RenderingPass {
+        SHADOW_PASS,
+        MAIN_PASS,
+        TRANSPARENT_PASS,
+        OVERLAY_PASS,
+        NUM_RENDERING_PASSES
+    };
+
+    struct FrameStatistics {
+        //! The CPU time spent in render() including the time to issue the GL commands [ms]
+        double cpuTime;
+        //! The GPU time of each rendering pass [ms]
+        double gpuTimes[NUM_RENDERING_PASSES];
+        int numDrawCalls;
+        //! The size of the vertex buffer and texture data transferred to the GPU
+        size_t numUploadedBytes;
+    };
+
+    /**
+       The costs of the rendered frames are measured. The GPU times are measured with the
+       GL_TIME_ELAPSED queries, whose results are read a few frames later so that the measurement
+       does not stall the pipeline. The draw calls and the uploads issued by the rendering
+       functions of the extensions are not counted. The default value is false.
+    */
+    void setFrameProfilingEnabled(bool on);
+    bool isFrameProfilingEnabled() const;
+
+    /**
+       \return false if no frame has been measured since the profiling was enabled
+       \note The statistics are those of the latest frame whose GPU times are available.
+    */
+    bool getFrameStatistics(FrameStatistics& out_statistics) const;
+
   protected:
     virtual void onSceneGraphUpdated(const SgUpdate& update) override;
     virtual void doRender() override;
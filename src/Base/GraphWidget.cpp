@@ -17,6 +17,7 @@
 #include <fmt/format.h>
 #include <boost/dynamic_bitset.hpp>
 #include <cmath>
+#include <cstdint>
 #include <deque>
 #include <limits>
 #include <algorithm>
@@ -49,6 +50,127 @@ struct EditHistory
 typedef std::shared_ptr<EditHistory> EditHistoryPtr;
 typedef deque<EditHistoryPtr> EditHistoryList;
 
+/**
+   The minimum and maximum values of the blocks of frames in multiple resolutions.
+   A block of level 0 consists of BlockSize frames and a block of level i consists of BlockSize
+   blocks of level i - 1, so the extreme values of any frame range are obtained by visiting
+   O(BlockSize * log(n)) elements. The blocks overlapping the invalidated frames are updated
+   when the pyramid is used next time.
+*/
+class MinMaxPyramid
+{
+public:
+    static const int BlockSizeBits = 3;
+    static const int BlockSize = 1 << BlockSizeBits;
+
+    MinMaxPyramid() {
+        numFrames = 0;
+        dirtyBegin = 0;
+        dirtyEnd = 0;
+    }
+
+    void invalidate(int frameBegin, int frameEnd) {
+        frameBegin = std::max(frameBegin, 0);
+        if(frameBegin < frameEnd){
+            if(dirtyBegin < dirtyEnd){
+                dirtyBegin = std::min(dirtyBegin, frameBegin);
+                dirtyEnd = std::max(dirtyEnd, frameEnd);
+            } else {
+                dirtyBegin = frameBegin;
+                dirtyEnd = frameEnd;
+            }
+        }
+    }
+
+    template<class ValueFunction>
+    void update(int newNumFrames, const ValueFunction& value) {
+        if(newNumFrames != numFrames){
+            // The last block of the shorter one is also updated because it may be a partial block
+            invalidate(std::min(numFrames, newNumFrames) - 1, newNumFrames);
+            numFrames = newNumFrames;
+        }
+        int begin = dirtyBegin;
+        int end = std::min(dirtyEnd, numFrames);
+        dirtyBegin = dirtyEnd = 0;
+
+        int numElements = numFrames;
+        int level = 0;
+        while(numElements > BlockSize){
+            const int numBlocks = (numElements + BlockSize - 1) >> BlockSizeBits;
+            if(static_cast<int>(mins.size()) <= level){
+                mins.emplace_back();
+                maxs.emplace_back();
+            }
+            vector<double>& levelMins = mins[level];
+            vector<double>& levelMaxs = maxs[level];
+            levelMins.resize(numBlocks);
+            levelMaxs.resize(numBlocks);
+            const int blockBegin = begin >> BlockSizeBits;
+            const int blockEnd = std::min((end + BlockSize - 1) >> BlockSizeBits, numBlocks);
+            for(int i = blockBegin; i < blockEnd; ++i){
+                const int elementBegin = i << BlockSizeBits;
+                const int elementEnd = std::min(elementBegin + BlockSize, numElements);
+                double minValue = std::numeric_limits<double>::max();
+                double maxValue = -std::numeric_limits<double>::max();
+                scan(level - 1, elementBegin, elementEnd, value, minValue, maxValue);
+                levelMins[i] = minValue;
+                levelMaxs[i] = maxValue;
+            }
+            numElements = numBlocks;
+            begin = blockBegin;
+            end = blockEnd;
+            ++level;
+        }
+        mins.resize(level);
+        maxs.resize(level);
+    }
+
+    template<class ValueFunction>
+    void getMinMax(int frameBegin, int frameEnd, const ValueFunction& value, double& out_min, double& out_max) const {
+        out_min = std::numeric_limits<double>::max();
+        out_max = -std::numeric_limits<double>::max();
+        int begin = frameBegin;
+        int end = frameEnd;
+        int level = -1;
+        while(level + 1 < static_cast<int>(mins.size()) && end - begin > 2 * BlockSize){
+            const int upperBegin = (begin + BlockSize - 1) >> BlockSizeBits;
+            const int upperEnd = end >> BlockSizeBits;
+            scan(level, begin, upperBegin << BlockSizeBits, value, out_min, out_max);
+            scan(level, upperEnd << BlockSizeBits, end, value, out_min, out_max);
+            begin = upperBegin;
+            end = upperEnd;
+            ++level;
+        }
+        scan(level, begin, end, value, out_min, out_max);
+    }
+
+private:
+    int numFrames;
+    int dirtyBegin;
+    int dirtyEnd;
+    vector<vector<double>> mins;
+    vector<vector<double>> maxs;
+
+    //! Level -1 corresponds to the frames
+    template<class ValueFunction>
+    void scan(int level, int begin, int end, const ValueFunction& value, double& io_min, double& io_max) const {
+        if(level < 0){
+            for(int i = begin; i < end; ++i){
+                const double v = value(i);
+                io_min = std::min(io_min, v);
+                io_max = std::max(io_max, v);
+            }
+        } else {
+            const vector<double>& levelMins = mins[level];
+            const vector<double>& levelMaxs = maxs[level];
+            for(int i = begin; i < end; ++i){
+                io_min = std::min(io_min, levelMins[i]);
+                io_max = std::max(io_max, levelMaxs[i]);
+            }
+        }
+    }
+};
+
 }
 
 namespace cnoid {
@@ -87,6 +209,19 @@ public:
     boost::dynamic_bitset<> controlPointMask;
     bool isControlPointUpdateNeeded;
 
+    // The number of frames and the step of the values obtained by the last data request
+    int numRequestedFrames;
+    double requestedStepRatio;
+
+    MinMaxPyramid valuePyramid;
+    MinMaxPyramid velocityPyramid;
+
+    void invalidateMinMax(int frameBegin, int frameEnd){
+        valuePyramid.invalidate(frameBegin, frameEnd);
+        // The velocity of a frame depends on the values of the adjacent frames
+        velocityPyramid.invalidate(frameBegin - 1, frameEnd + 1);
+    }
+
     GraphDataHandler::DataRequestCallback dataRequestCallback;
     GraphDataHandler::DataModifiedCallback dataModifiedCallback;
 };
@@ -194,6 +329,7 @@ public:
     void addDataHandler(GraphDataHandlerPtr handler);
     void clearDataHandlers();
     void updateData(GraphDataHandlerPtr handler);
+    int findFirstFrameToRequest(GraphDataHandlerImpl* data);
     bool setCursorPosition(double x, bool enableTimeBarSync, bool forceTimeChange);
     bool setCursorPositionWithScreenX(double screenX, bool enableTimeBarSync, bool forceTimeChange);
 
@@ -231,6 +367,10 @@ public:
     void selectEditTargetByClicking(double screenX, double screenY);
     bool onScreenPaintEvent(QPaintEvent* event);
     void drawTrajectory(QPainter& painter, const QRect& rect, GraphDataHandlerImpl* data);
+    template<class ValueFunction>
+    void setMinMaxPolyline(
+        const MinMaxPyramid& pyramid, const ValueFunction& value, double valueScale,
+        int frame, int frameBegin, int frameEnd, double screenOffsetX, double xratio);
     void drawLimits(QPainter& painter, GraphDataHandlerImpl* data);
     void updateControlPoints(GraphDataHandlerImpl* data);
     void drawGrid(QPainter& painter);
@@ -265,6 +405,9 @@ GraphDataHandlerImpl::GraphDataHandlerImpl()
 
     isControlPointUpdateNeeded = true;
 
+    numRequestedFrames = 0;
+    requestedStepRatio = 0.0;
+
     currentHistory = 0;
 }
 
@@ -535,13 +678,52 @@ void GraphWidgetImpl::updateData(GraphDataHandlerPtr handler)
     }
     
     if(data->dataRequestCallback){
-        vector<double>& values = data->values;
-        data->dataRequestCallback(0, data->numFrames, &(values[1]));
+        double* values = &data->values[1];
+        const int numFrames = data->numFrames;
+        const int frameBegin = findFirstFrameToRequest(data);
+        if(frameBegin < numFrames){
+            data->dataRequestCallback(frameBegin, numFrames - frameBegin, &values[frameBegin]);
+        }
+        if(numFrames > 0){
+            values[-1] = values[0];
+            values[numFrames] = values[numFrames - 1];
+        }
+        data->invalidateMinMax(frameBegin, numFrames);
+        data->numRequestedFrames = numFrames;
+        data->requestedStepRatio = data->stepRatio;
     }
     screen->update();
 }
 
 
+/**
+   When the frames seem to have been only appended as in the recording of a simulation, only the
+   values of the new frames are requested so that the cost of an update does not depend on the
+   length of the data. This is detected by checking that the values of the last frame and some
+   sampled frames of the previous data are not changed.
+*/
+int GraphWidgetImpl::findFirstFrameToRequest(GraphDataHandlerImpl* data)
+{
+    static const int NumSampleFrames = 32;
+    
+    const int prevNumFrames = data->numRequestedFrames;
+    if(prevNumFrames == 0 || data->numFrames <= prevNumFrames || data->stepRatio != data->requestedStepRatio){
+        return 0;
+    }
+    const double* values = &data->values[1];
+    const int n = std::min(NumSampleFrames, prevNumFrames);
+    for(int i=0; i < n; ++i){
+        const int frame = (i == n - 1) ? (prevNumFrames - 1) : (static_cast<int64_t>(prevNumFrames) * i / n);
+        double value;
+        data->dataRequestCallback(frame, 1, &value);
+        if(value != values[frame]){
+            return 0;
+        }
+    }
+    return prevNumFrames;
+}
+
+
 void GraphWidget::setRenderingTypes
 (bool showOriginalValues, bool showVelocities, bool showAccelerations)
 {
@@ -1404,6 +1586,7 @@ void GraphWidgetImpl::doTrajectoryEdit(int screenX, int screenY, Qt::KeyboardMod
     if(editMode == GraphWidget::LINE_MODE){
         EditHistoryPtr& history = editTarget->editHistories.back();
         std::copy(history->orgValues.begin(), history->orgValues.end(), &values[history->frame]);
+        editTarget->invalidateMinMax(history->frame, history->frame + history->orgValues.size());
     }
 
     if(frameBegin < frameEnd){
@@ -1444,6 +1627,8 @@ void GraphWidgetImpl::doTrajectoryEdit(int screenX, int screenY, Qt::KeyboardMod
             }
         }
 
+        editTarget->invalidateMinMax(frameBegin, frameEnd);
+
         editedFrameBegin = std::min(editedFrameBegin, frameBegin);
         editedFrameEnd = std::max(editedFrameEnd, frameEnd);
 
@@ -1504,6 +1689,7 @@ void GraphWidgetImpl::undoTrajectoryEdit()
             EditHistoryPtr history = editTarget->editHistories[currentHistory];
             std::copy(history->orgValues.begin(), history->orgValues.end(),
                       editTarget->values.begin() + history->frame + 1);
+            editTarget->invalidateMinMax(history->frame, history->frame + history->orgValues.size());
             editTarget->dataModifiedCallback(history->frame, history->orgValues.size(), &history->orgValues[0]);
             screen->update();
         }
@@ -1520,6 +1706,7 @@ void GraphWidgetImpl::redoTrajectoryEdit()
             EditHistoryPtr history = editTarget->editHistories[currentHistory];
             std::copy(history->newValues.begin(), history->newValues.end(),
                       editTarget->values.begin() + history->frame + 1);
+            editTarget->invalidateMinMax(history->frame, history->frame + history->newValues.size());
             editTarget->dataModifiedCallback(history->frame, history->newValues.size(), &history->newValues[0]);
             currentHistory++;
             screen->update();
@@ -1641,6 +1828,44 @@ static inline double calcVelocity(int frame, double* values, double stepRatio2)
 }
 
 
+/**
+   The frames are divided into the columns of half a pixel width, and each column has the line
+   between the minimum and maximum values of its frames, which are obtained from the min/max
+   pyramid so that the cost does not depend on the number of frames. The extreme value closer
+   to the end of the previous column is connected first.
+*/
+template<class ValueFunction>
+void GraphWidgetImpl::setMinMaxPolyline
+(const MinMaxPyramid& pyramid, const ValueFunction& value, double valueScale,
+ int frame, int frameBegin, int frameEnd, double screenOffsetX, double xratio)
+{
+    const int m = (int)(0.5 / xratio);
+    const int n = ceil(double(frameEnd - frame) / m);
+    polyline.resize(n * 2);
+    for(int i=0; i < n; ++i){
+        const double px = screenOffsetX + (frame - frameBegin) * xratio;
+        const int next = std::min(frame + m, frameEnd);
+        double min, max;
+        pyramid.getMinMax(frame, next, value, min, max);
+        const double upper = screenCenterY - (max * valueScale + centerY) * scaleY;
+        const double lower = screenCenterY - (min * valueScale + centerY) * scaleY;
+        bool isUpperFirst = false;
+        if(i > 0){
+            const double prevY = polyline[i*2-1].y();
+            isUpperFirst = fabs(upper - prevY) < fabs(lower - prevY);
+        }
+        if(isUpperFirst){
+            polyline[i*2] = QPointF(px, upper);
+            polyline[i*2+1] = QPointF(px, lower);
+        } else {
+            polyline[i*2] = QPointF(px, lower);
+            polyline[i*2+1] = QPointF(px, upper);
+        }
+        frame = next;
+    }
+}
+
+
 void GraphWidgetImpl::drawTrajectory
 (QPainter& painter, const QRect& rect, GraphDataHandlerImpl* data)
 {
@@ -1701,37 +1926,11 @@ void GraphWidgetImpl::drawTrajectory
                     ++frame;
                 }
             } else {
-                const int m = (int)(0.5 / xratio);
-                const int n = ceil(double(frame_end - frame) / m);
-                polyline.resize(n * 2);
-                for(int i=0; i < n; ++i){
-                    double px_min = screenOffsetX + (frame - frame_begin) * xratio;
-                    double px_max = px_min;
-                    const int next = std::min(frame + m, frame_end);
-                    double min = calcVelocity(frame++, values, stepRatio2);
-                    double max = min;
-                    while(frame < next){
-                        const double v = calcVelocity(frame, values, stepRatio2);
-                        if(v > max){
-                            max = v;
-                            px_max = screenOffsetX + (frame - frame_begin) * xratio;
-                        } else if(v < min){
-                            min = v;
-                            px_min = screenOffsetX + (frame - frame_begin) * xratio;
-                        }
-                        frame++;
-                    }
-                    const double upper = screenCenterY - (max + centerY) * scaleY;
-                    const double lower = screenCenterY - (min + centerY) * scaleY;
-
-                    if(px_min <= px_max){
-                        polyline[i*2] = QPointF(px_min, lower);
-                        polyline[i*2+1] = QPointF(px_max, upper);
-                    } else {
-                        polyline[i*2] = QPointF(px_max, upper);
-                        polyline[i*2+1] = QPointF(px_min, lower);
-                    }
-                }
+                auto velocityDiff = [values](int frame){ return values[frame + 1] - values[frame - 1]; };
+                data->velocityPyramid.update(numFrames, velocityDiff);
+                setMinMaxPolyline(
+                    data->velocityPyramid, velocityDiff, 1.0 / stepRatio2,
+                    frame, frame_begin, frame_end, screenOffsetX, xratio);
             }
 
             painter.drawPolyline(polyline);
@@ -1757,35 +1956,11 @@ void GraphWidgetImpl::drawTrajectory
                     ++frame;
                 }
             } else {
-                const int m = (int)(0.5 / xratio);
-                const int n = ceil(double(frame_end - frame) / m);
-                polyline.resize(n * 2);
-                for(int i=0; i < n; ++i){
-                    double px_min = screenOffsetX + (frame - frame_begin) * xratio;
-                    double px_max = px_min;
-                    const int next = std::min(frame + m, frame_end);
-                    double min = values[frame++];
-                    double max = min;
-                    while(frame < next){
-                        const double v = values[frame++];
-                        if(v > max){
-                            max = v;
-                            px_max = screenOffsetX + (frame - frame_begin) * xratio;
-                        } else if(v < min){
-                            min = v;
-                            px_min = screenOffsetX + (frame - frame_begin) * xratio;
-                        }
-                    }
-                    const double upper = screenCenterY - (max + centerY) * scaleY;
-                    const double lower = screenCenterY - (min + centerY) * scaleY;
-                    if(px_min <= px_max){
-                        polyline[i*2] = QPointF(px_min, lower);
-                        polyline[i*2+1] = QPointF(px_max, upper);
-                    } else {
-                        polyline[i*2] = QPointF(px_max, upper);
-                        polyline[i*2+1] = QPointF(px_min, lower);
-                    }
-                }
+                auto value = [values](int frame){ return values[frame]; };
+                data->valuePyramid.update(numFrames, value);
+                setMinMaxPolyline(
+                    data->valuePyramid, value, 1.0,
+                    frame, frame_begin, frame_end, screenOffsetX, xratio);
             }
 
             painter.drawPolyline(polyline);
@@ -2,26 +2,62 @@
    @author Shin'ichiro Nakaoka
 */
 
+// The OpenGL loader header must be included before the Qt headers which include gl.h
+#include "GLSLProgram.h"
 #include "ImageWidget.h"
 #include <cnoid/Image>
 #include <QImage>
-#include <QPaintEvent>
-#include <QPainter>
+#include <QOpenGLContext>
+#include <QResizeEvent>
+#include <cstring>
 #include <iostream>
 #include <math.h>
 
 using namespace std;
 using namespace cnoid;
 
+namespace cnoid {
 
-ImageWidget::ImageWidget(QWidget* parent) :
-    QWidget(parent)
+class ImageWidgetImpl
 {
-    QPalette p(palette());
-    p.setColor(QPalette::Background, Qt::black);
-    setPalette(p);
-    setAutoFillBackground(true);
+public:
+    ImageWidget* self;
+    
+    // The latest image which has not been uploaded, which is guarded by the mutex of the widget
+    vector<unsigned char> pendingPixels;
+    int pendingWidth;
+    int pendingHeight;
+    int pendingNumComponents;
+    bool hasPendingImage;
+    bool isImageVisible;
+
+    bool isGLInitialized;
+    GLSLProgram program;
+    GLint transformLocation;
+    GLuint vao;
+    GLuint vertexBuffer;
+    GLuint texture;
+    GLuint pixelBuffers[2];
+    int pixelBufferIndex;
+    int textureWidth;
+    int textureHeight;
+    int textureNumComponents;
+
+    ImageWidgetImpl(ImageWidget* self);
+    void setPendingImage(const unsigned char* pixels, int width, int height, int numComponents, int bytesPerLine);
+    bool initializeGL();
+    void releaseGLResources();
+    void uploadPendingImage();
+};
+
+}
 
+
+ImageWidget::ImageWidget(QWidget* parent) :
+    QOpenGLWidget(parent)
+{
+    impl = new ImageWidgetImpl(this);
+    
     isScalingEnabled_ = false;
     fitted = false;
     settedT = false;
@@ -30,12 +66,44 @@ ImageWidget::ImageWidget(QWidget* parent) :
 }
 
 
+ImageWidgetImpl::ImageWidgetImpl(ImageWidget* self)
+    : self(self)
+{
+    pendingWidth = 0;
+    pendingHeight = 0;
+    pendingNumComponents = 0;
+    hasPendingImage = false;
+    isImageVisible = false;
+    isGLInitialized = false;
+    transformLocation = -1;
+    vao = 0;
+    vertexBuffer = 0;
+    texture = 0;
+    pixelBuffers[0] = pixelBuffers[1] = 0;
+    pixelBufferIndex = 0;
+    textureWidth = 0;
+    textureHeight = 0;
+    textureNumComponents = 0;
+}
+
+
+ImageWidget::~ImageWidget()
+{
+    if(impl->isGLInitialized){
+        makeCurrent();
+        impl->releaseGLResources();
+        doneCurrent();
+    }
+    delete impl;
+}
+
+
 void ImageWidget::setScalingEnabled(bool on)
 {
     if(on != isScalingEnabled_){
         isScalingEnabled_ = on;
 
-        if(pixmap_.isNull())
+        if(imageSize_.isEmpty())
             return;
         reset();
     }
@@ -50,17 +118,18 @@ bool ImageWidget::isScalingEnabled() const
 
 void ImageWidget::setPixmap(const QPixmap& pixmap)
 {
-    std::lock_guard<std::mutex> lock(mtx);
-    pixmap_ = pixmap;
-    fitCenter();
-    update();
+    setImage(pixmap.toImage());
 }
 
 
 void ImageWidget::setImage(const QImage& image)
 {
+    QImage rgbImage = image.convertToFormat(QImage::Format_RGB888);
+    if(rgbImage.isNull()){
+        return;
+    }
     std::lock_guard<std::mutex> lock(mtx);
-    pixmap_ = QPixmap::fromImage(image);
+    impl->setPendingImage(rgbImage.constBits(), rgbImage.width(), rgbImage.height(), 3, rgbImage.bytesPerLine());
     fitCenter();
     update();
 }
@@ -71,30 +140,231 @@ void ImageWidget::setImage(const Image& image)
     if(image.width() * image.height()==0)
         return;
 
-    std::lock_guard<std::mutex> lock(mtx);
-    static QImage::Format componentSizeToFormat[] = {
-        QImage::Format_Invalid,
-        QImage::Format_Invalid, //! \todo convert a gray scale image to RGB888
-        QImage::Format_Invalid,
-        QImage::Format_RGB888
-    };
-
-    QImage::Format f = componentSizeToFormat[image.numComponents()];
-
-    if(f != QImage::Format_Invalid){
-        pixmap_ = QPixmap::fromImage(
-            QImage(image.pixels(), image.width(), image.height(), f));
+    // The gray scale images are shown by swizzling the components of the texture
+    const int n = image.numComponents();
+    if(n != 1 && n != 3 && n != 4){
+        return;
     }
-
+    
+    std::lock_guard<std::mutex> lock(mtx);
+    impl->setPendingImage(image.pixels(), image.width(), image.height(), n, image.width() * n);
     fitCenter();
     update();
 }
 
 
+/**
+   The image is copied into the buffer which is reused for the following images.
+   The image which has not been uploaded yet is overwritten.
+*/
+void ImageWidgetImpl::setPendingImage
+(const unsigned char* pixels, int width, int height, int numComponents, int bytesPerLine)
+{
+    const int lineSize = width * numComponents;
+    pendingPixels.resize(lineSize * height);
+    if(bytesPerLine == lineSize){
+        std::memcpy(pendingPixels.data(), pixels, pendingPixels.size());
+    } else {
+        for(int i=0; i < height; ++i){
+            std::memcpy(&pendingPixels[i * lineSize], pixels + i * bytesPerLine, lineSize);
+        }
+    }
+    pendingWidth = width;
+    pendingHeight = height;
+    pendingNumComponents = numComponents;
+    hasPendingImage = true;
+    isImageVisible = true;
+    self->imageSize_ = QSize(width, height);
+}
+
+
+void ImageWidget::initializeGL()
+{
+    if(impl->isGLInitialized){
+        impl->releaseGLResources();
+    }
+    impl->isGLInitialized = impl->initializeGL();
+
+    // The resources are released before the context is destroyed when the widget is reparented
+    connect(context(), &QOpenGLContext::aboutToBeDestroyed,
+            [this](){
+                if(impl->isGLInitialized){
+                    makeCurrent();
+                    impl->releaseGLResources();
+                    doneCurrent();
+                }
+            });
+}
+
+
+bool ImageWidgetImpl::initializeGL()
+{
+    if(ogl_LoadFunctions() == ogl_LOAD_FAILED){
+        return false;
+    }
+    try {
+        program.loadVertexShader(":/Base/shader/image.vert");
+        program.loadFragmentShader(":/Base/shader/image.frag");
+        program.link();
+    }
+    catch(std::runtime_error& error){
+        cout << error.what() << endl;
+        program.release();
+        return false;
+    }
+    transformLocation = program.getUniformLocation("transform");
+
+    // The unit square is drawn as a triangle strip
+    static const GLfloat vertices[] = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    textureWidth = 0;
+    textureHeight = 0;
+    textureNumComponents = 0;
+
+    glGenBuffers(2, pixelBuffers);
+    pixelBufferIndex = 0;
+
+    // The image is uploaded again to the new texture
+    if(isImageVisible && !pendingPixels.empty()){
+        hasPendingImage = true;
+    }
+
+    return true;
+}
+
+
+void ImageWidgetImpl::releaseGLResources()
+{
+    program.release();
+    if(vao){
+        glDeleteVertexArrays(1, &vao);
+        vao = 0;
+    }
+    if(vertexBuffer){
+        glDeleteBuffers(1, &vertexBuffer);
+        vertexBuffer = 0;
+    }
+    if(texture){
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+    if(pixelBuffers[0]){
+        glDeleteBuffers(2, pixelBuffers);
+        pixelBuffers[0] = pixelBuffers[1] = 0;
+    }
+    isGLInitialized = false;
+}
+
+
+/**
+   The pixel buffer objects are used alternately, and the storage of the buffer is orphaned
+   before it is written so that the copy does not wait for the transfer of the previous image.
+*/
+void ImageWidgetImpl::uploadPendingImage()
+{
+    const GLsizeiptr size = pendingPixels.size();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers[pixelBufferIndex]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    bool isWritten = false;
+    if(auto buf = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)){
+        std::memcpy(buf, pendingPixels.data(), size);
+        isWritten = (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE);
+    }
+    const GLvoid* data = nullptr;
+    if(!isWritten){
+        // The image is directly uploaded from the client memory when the mapping fails
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        data = pendingPixels.data();
+    }
+    pixelBufferIndex = 1 - pixelBufferIndex;
+
+    static const GLenum formats[] = { 0, GL_RED, 0, GL_RGB, GL_RGBA };
+    const GLenum format = formats[pendingNumComponents];
+    
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if(pendingWidth != textureWidth || pendingHeight != textureHeight ||
+       pendingNumComponents != textureNumComponents){
+        const GLint internalFormat = (pendingNumComponents == 1) ? GL_R8 : ((pendingNumComponents == 3) ? GL_RGB8 : GL_RGBA8);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, pendingWidth, pendingHeight, 0, format, GL_UNSIGNED_BYTE, data);
+        const GLint green = (pendingNumComponents == 1) ? GL_RED : GL_GREEN;
+        const GLint blue = (pendingNumComponents == 1) ? GL_RED : GL_BLUE;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, green);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, blue);
+        textureWidth = pendingWidth;
+        textureHeight = pendingHeight;
+        textureNumComponents = pendingNumComponents;
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, pendingWidth, pendingHeight, format, GL_UNSIGNED_BYTE, data);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    hasPendingImage = false;
+}
+
+
+void ImageWidget::paintGL()
+{
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if(!impl->isGLInitialized){
+        return;
+    }
+
+    QTransform T;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!impl->isImageVisible){
+            return;
+        }
+        if(impl->hasPendingImage){
+            impl->uploadPendingImage();
+        }
+        T = transform_;
+    }
+    if(impl->textureWidth == 0){
+        return;
+    }
+
+    // The unit square is scaled to the image size, transformed, and mapped to the normalized device coordinate
+    QTransform M;
+    M.scale(impl->textureWidth, impl->textureHeight);
+    M *= T;
+    M *= QTransform(2.0 / width(), 0.0, 0.0, -2.0 / height(), -1.0, 1.0);
+    const GLfloat matrix[] = {
+        (GLfloat)M.m11(), (GLfloat)M.m12(), 0.0f,
+        (GLfloat)M.m21(), (GLfloat)M.m22(), 0.0f,
+        (GLfloat)M.dx(), (GLfloat)M.dy(), 1.0f };
+
+    glDisable(GL_DEPTH_TEST);
+    impl->program.use();
+    glUniformMatrix3fv(impl->transformLocation, 1, GL_FALSE, matrix);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, impl->texture);
+    glBindVertexArray(impl->vao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+}
+
+
 void ImageWidget::zoom(double scale)
 {
     std::lock_guard<std::mutex> lock(mtx);
-    if(pixmap_.isNull())
+    if(imageSize_.isEmpty())
         return;
 
     QSize r = rect().size();
@@ -113,7 +383,7 @@ void ImageWidget::zoom(double scale)
 void ImageWidget::translate(QPoint pos)
 {
     std::lock_guard<std::mutex> lock(mtx);
-    if(pixmap_.isNull()){
+    if(imageSize_.isEmpty()){
         return;
     }
 
@@ -143,34 +413,13 @@ void ImageWidget::rotate(double angle)
 }
 
 
-void ImageWidget::paintEvent(QPaintEvent* event)
-{
-    QWidget::paintEvent(event);
-
-    if(pixmap_.isNull()){
-        return;
-    }
-
-    //for(int i=0; i<r.width(); i+=50)
-    //   	painter.drawLine(i,0,i,r.height());
-    //for( int j=0; j<r.height(); j+=50)
-    //   	painter.drawLine(0,j,r.width(),j);
-
-    QPainter painter(this);
-    painter.setRenderHint(QPainter::SmoothPixmapTransform);
-    painter.setWorldTransform(transform_);
-
-    painter.drawPixmap(0, 0, pixmap_);
-}
-
-
 void ImageWidget::fitCenter()
 {
     if(fitted)
         return;
 
     if(settedT){
-        oldSize = pixmap_.size();
+        oldSize = imageSize_;
         oldScale = 1.0;
         resize(rect().size());
         fitted = true;
@@ -178,11 +427,11 @@ void ImageWidget::fitCenter()
     }
 
     QSize r = rect().size();
-    QSize s = pixmap_.size();
+    QSize s = imageSize_;
     double scale = 1.0;
     if(isScalingEnabled_){
         s.scale(r, Qt::KeepAspectRatio);
-        scale = (double)s.width() / (double)pixmap_.size().width();
+        scale = (double)s.width() / (double)imageSize_.width();
         transform_.scale(scale, scale);
     }
     double x = (r.width() - s.width()) / 2;
@@ -201,15 +450,17 @@ QSize ImageWidget::sizeHint() const
     if(isScalingEnabled_){
         return QSize(-1, -1);
     } else {
-        return pixmap_.size();
+        return imageSize_;
     }
 }
 
 
 void ImageWidget::resizeEvent(QResizeEvent *event)
 {
+    QOpenGLWidget::resizeEvent(event);
+    
     std::lock_guard<std::mutex> lock(mtx);
-    if(pixmap_.isNull())
+    if(imageSize_.isEmpty())
             return;
 
     resize(event->size());
@@ -223,9 +474,9 @@ void ImageWidget::resize(const QSize& size)
     }
 
     if(isScalingEnabled_ ){
-        QSize s = pixmap_.size();
+        QSize s = imageSize_;
         s.scale(size, Qt::KeepAspectRatio);
-        double newScale = (double)s.width() / (double)pixmap_.size().width();
+        double newScale = (double)s.width() / (double)imageSize_.width();
         double scale = newScale / oldScale;
         oldScale = newScale;
 
@@ -261,12 +512,12 @@ void ImageWidget::setTransform(const QTransform& transform)
 
 bool ImageWidget::getTransform(QTransform& transform)
 {
-    if(pixmap_.isNull())
+    if(imageSize_.isEmpty())
         return false;
 
     notScaledTransform_ = transform_;
-    if(isScalingEnabled_ && !pixmap_.isNull()){
-        QSize size = pixmap_.size();
+    if(isScalingEnabled_ && !imageSize_.isEmpty()){
+        QSize size = imageSize_;
         double scale = 1.0 / oldScale;
 
         QTransform invT = transform_.inverted();
@@ -291,7 +542,7 @@ bool ImageWidget::getTransform(QTransform& transform)
 
 double ImageWidget::getAngle(){
     double scale;
-    if(pixmap_.isNull())
+    if(imageSize_.isEmpty())
         scale = 1.0;
     else
         scale = oldScale;
@@ -326,19 +577,18 @@ void ImageWidget::reset()
 
 Image& ImageWidget::getImage()
 {
-    std::lock_guard<std::mutex> lock(mtx);
-
-    if(pixmap_.isNull()){
+    bool isEmpty;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        isEmpty = imageSize_.isEmpty();
+    }
+    if(isEmpty){
         transformedImage.setSize(0,0,1);
         return transformedImage;
     }
 
-    QImage image(rect().size(), QImage::Format_RGB888);
-    image.fill(QColor(0,0,0));
-    QPainter painter(&image);
-    painter.setRenderHint(QPainter::SmoothPixmapTransform);
-    painter.setWorldTransform(transform_);
-    painter.drawPixmap(0, 0, pixmap_);
+    // The mutex must not be locked here because the image is rendered by paintGL
+    QImage image = grabFramebuffer().convertToFormat(QImage::Format_RGB888);
 
     transformedImage.setSize(image.width(), image.height(), 3);
     unsigned char* p = transformedImage.pixels();
@@ -357,7 +607,8 @@ Image& ImageWidget::getImage()
 void ImageWidget::clear()
 {
     std::lock_guard<std::mutex> lock(mtx);
-    pixmap_.fill(Qt::black);
+    impl->isImageVisible = false;
+    impl->hasPendingImage = false;
     update();
 }
 
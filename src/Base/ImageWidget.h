@@ -5,7 +5,7 @@
 #ifndef CNOID_BASE_IMAGE_WIDGET_H
 #define CNOID_BASE_IMAGE_WIDGET_H
 
-#include <QWidget>
+#include <QOpenGLWidget>
 #include <cnoid/Image>
 #include <thread>
 #include <mutex>
@@ -14,13 +14,21 @@
 namespace cnoid {
 
 class Image;
+class ImageWidgetImpl;
 
-class CNOID_EXPORT ImageWidget : public QWidget
+/**
+   This widget shows the image with OpenGL. A new image is only copied into a buffer in setImage,
+   and it is uploaded to the texture through a pixel buffer object when the widget is painted.
+   The images given more often than the widget is painted are dropped except for the latest one,
+   and the image is scaled and rotated by the GPU.
+*/
+class CNOID_EXPORT ImageWidget : public QOpenGLWidget
 {
     Q_OBJECT
 
 public:
     explicit ImageWidget(QWidget* parent = 0);
+    ~ImageWidget();
 
 //public Q_SLOTS:
     void setPixmap(const QPixmap& pixmap);
@@ -44,12 +52,15 @@ public:
     std::mutex mtx;
 
   protected:
-    virtual void paintEvent(QPaintEvent* event);
+    virtual void initializeGL();
+    virtual void paintGL();
     virtual QSize sizeHint() const;
     virtual void resizeEvent(QResizeEvent *event);
         
 private:
-    QPixmap pixmap_;
+    ImageWidgetImpl* impl;
+    friend class ImageWidgetImpl;
+    QSize imageSize_;
     bool isScalingEnabled_;
     QTransform transform_;
     QTransform notScaledTransform_;
@@ -7,6 +7,7 @@
 #include "RootItem.h"
 #include "ItemPath.h"
 #include "ItemManager.h"
+#include <cnoid/MemoryUsage>
 #include <boost/filesystem.hpp>
 #include <typeinfo>
 #include <unordered_set>
@@ -807,3 +808,9 @@ bool Item::restore(const Archive& archive)
 {
     return true;
 }
+
+
+void Item::countMemoryUsage(MemoryUsageCounter& counter)
+{
+    counter.add(sizeof(Item) + name_.capacity());
+}
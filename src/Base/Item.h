@@ -22,6 +22,7 @@ typedef ref_ptr<Item> ItemPtr;
 class RootItem;
 class Archive;
 class ExtensionManager;
+class MemoryUsageCounter;
 
 
 class CNOID_EXPORT Item : public Referenced
@@ -206,6 +207,13 @@ public:
     virtual bool store(Archive& archive);
     virtual bool restore(const Archive& archive);
 
+    /**
+       Adds the bytes owned by the item to the counter. The data shared with the items counted
+       before with the same counter is not counted again, so the bytes of an item depend on the
+       order of counting. The default implementation only counts the item object itself.
+    */
+    virtual void countMemoryUsage(MemoryUsageCounter& counter);
+
 protected:
     /**
        This function is called when the item has been connected to the tree including the root item.
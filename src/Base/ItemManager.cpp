@@ -78,6 +78,7 @@ public:
         list<SaverPtr> savers;
         ItemPtr singletonInstance;
         bool isSingleton;
+        function<function<void()>(const Archive& archive)> restorePrefetchFunction;
     };
     typedef shared_ptr<ClassInfo> ClassInfoPtr;
     
@@ -520,6 +521,34 @@ ItemPtr ItemManager::create(const std::string& moduleName, const std::string& cl
 }
 
 
+void ItemManager::addRestorePrefetcherSub
+(const std::string& typeId, std::function<std::function<void()>(const Archive& archive)> prefetch)
+{
+    ClassInfoMap::iterator p = typeIdToClassInfoMap.find(typeId);
+    if(p != typeIdToClassInfoMap.end()){
+        p->second->restorePrefetchFunction = prefetch;
+    }
+}
+
+
+std::function<void()> ItemManager::getRestorePrefetchTask
+(const std::string& moduleName, const std::string& className, const Archive& archive)
+{
+    ModuleNameToItemManagerImplMap::iterator p = moduleNameToItemManagerImplMap.find(moduleName);
+    if(p != moduleNameToItemManagerImplMap.end()){
+        ClassInfoMap& classNameToClassInfoMap = p->second->classNameToClassInfoMap;
+        ClassInfoMap::iterator q = classNameToClassInfoMap.find(className);
+        if(q != classNameToClassInfoMap.end()){
+            ItemManagerImpl::ClassInfoPtr& info = q->second;
+            if(!info->isSingleton && info->restorePrefetchFunction){
+                return info->restorePrefetchFunction(archive);
+            }
+        }
+    }
+    return std::function<void()>();
+}
+
+
 void ItemManager::addCreationPanelSub(const std::string& typeId, ItemCreationPanel* panel)
 {
     impl->addCreationPanel(typeId, panel);
@@ -17,6 +17,7 @@
 namespace cnoid {
 
 class MenuManager;
+class Archive;
 
 class Item;
 typedef ref_ptr<Item> ItemPtr;
@@ -198,6 +199,24 @@ public:
         return *this;
     }
     
+    /**
+       The prefetch function is called with the data archive of an item of the type before the
+       items of a project are restored. It returns the task which loads the files of the item in
+       a worker thread while the preceding items are being restored, or an empty function if there
+       is nothing to load in advance. The task must not access the item tree or the GUI, so this
+       is only available for the types whose loading does not depend on the other items.
+       The data loaded by the task should be owned by the task object, which is released when the
+       restoration of the project is finished.
+    */
+    template <class ItemType>
+    ItemManager& addRestorePrefetcher(std::function<std::function<void()>(const Archive& archive)> prefetch){
+        addRestorePrefetcherSub(typeid(ItemType).name(), prefetch);
+        return *this;
+    }
+
+    static std::function<void()> getRestorePrefetchTask(
+        const std::string& moduleName, const std::string& className, const Archive& archive);
+    
     void addMenuItemToImport(const std::string& caption, std::function<void()> slot);
 
     static void reloadItems(const ItemList<>& items);
@@ -215,6 +234,8 @@ private:
     void addSaverSub(
         const std::string& typeId, const std::string& caption, const std::string& formatId,
         std::function<std::string()> getExtensions, std::shared_ptr<FileFunctionBase> function, int priority);
+    void addRestorePrefetcherSub(
+        const std::string& typeId, std::function<std::function<void()>(const Archive& archive)> prefetch);
 
     static Item* getSingletonInstance(const std::string& typeId);
 
@@ -11,7 +11,11 @@
 #include "Archive.h"
 #include <cnoid/YAMLReader>
 #include <cnoid/YAMLWriter>
+#include <cnoid/ThreadPool>
+#include <cnoid/PhaseProfiler>
 #include <set>
+#include <map>
+#include <memory>
 #include <fmt/format.h>
 #include "gettext.h"
 
@@ -31,10 +35,19 @@ public:
     int numRestoredItems;
     const std::set<std::string>* pOptionalPlugins;
 
+    struct PrefetchEntry
+    {
+        std::function<void()> task;
+        ThreadPool::TaskGroup group;
+    };
+    std::map<const Archive*, std::unique_ptr<PrefetchEntry>> prefetchEntries;
+
     ItemTreeArchiverImpl();
     ArchivePtr store(Archive& parentArchive, Item* item);
     ArchivePtr storeIter(Archive& parentArchive, Item* item, bool& isComplete);
     ItemList<> restore(Archive& archive, Item* parentItem, const std::set<std::string>& optionalPlugins);
+    void startPrefetchingIter(Archive& archive);
+    void waitForPrefetching(const Archive* dataArchive);
     void restoreItemIter(Archive& archive, Item* parentItem, ItemList<>& restoredItems);
     ItemPtr restoreItem(
         Archive& archive, Item* parentItem, ItemList<>& restoredItems, string& out_itemName, bool& io_isOptional);
@@ -197,17 +210,73 @@ ItemList<> ItemTreeArchiverImpl::restore
 
     archive.setCurrentParentItem(0);
     try {
+        startPrefetchingIter(archive);
         restoreItemIter(archive, parentItem, restoredItems);
     } catch (const ValueNode::Exception& ex){
         mv->putln(ex.message(), MessageView::ERROR);
     }
     archive.setCurrentParentItem(0);
 
+    // The destructors of the task groups wait for the tasks of the items which were not restored
+    prefetchEntries.clear();
+
     numRestoredItems = restoredItems.size();
     return restoredItems;
 }
 
 
+/**
+   The files of the items whose types have the restore prefetchers are loaded in the worker
+   threads in advance so that they are loaded in parallel while the items are restored one
+   by one in the original order on the main thread.
+*/
+void ItemTreeArchiverImpl::startPrefetchingIter(Archive& archive)
+{
+    string pluginName;
+    string className;
+    
+    if(!archive.get("isSubItem", false) && archive.read("plugin", pluginName) && archive.read("class", className)){
+        const char* actualPluginName = PluginManager::instance()->guessActualPluginName(pluginName);
+        ValueNodePtr dataNode = archive.find("data");
+        if(actualPluginName && dataNode->isValid() && dataNode->isMapping()){
+            Archive* dataArchive = static_cast<Archive*>(dataNode->toMapping());
+            dataArchive->inheritSharedInfoFrom(archive);
+            auto task = ItemManager::getRestorePrefetchTask(actualPluginName, className, *dataArchive);
+            if(task){
+                auto& entry = prefetchEntries[dataArchive];
+                entry.reset(new PrefetchEntry);
+                entry->task = task;
+                auto pEntry = entry.get();
+                entry->group.run([pEntry, className](){
+                        PhaseProfiler::Scope scope("Item prefetching", className);
+                        pEntry->task();
+                    });
+            }
+        }
+    }
+
+    ListingPtr children = archive.findListing("children");
+    if(children->isValid()){
+        for(int i=0; i < children->size(); ++i){
+            Archive* childArchive = dynamic_cast<Archive*>(children->at(i)->toMapping());
+            if(childArchive){
+                childArchive->inheritSharedInfoFrom(archive);
+                startPrefetchingIter(*childArchive);
+            }
+        }
+    }
+}
+
+
+void ItemTreeArchiverImpl::waitForPrefetching(const Archive* dataArchive)
+{
+    auto p = prefetchEntries.find(dataArchive);
+    if(p != prefetchEntries.end()){
+        p->second->group.wait();
+    }
+}
+
+
 void ItemTreeArchiverImpl::restoreItemIter(Archive& archive, Item* parentItem, ItemList<>& restoredItems)
 {
     ItemPtr item;
@@ -303,6 +372,8 @@ ItemPtr ItemTreeArchiverImpl::restoreItem
     } else {
         mv->putln(format(_("Restoring {0} \"{1}\""), className, name));
         mv->flush();
+
+        PhaseProfiler::Scope scope("Item restoration", format("{0} \"{1}\"", className, name));
         
         ValueNodePtr dataNode = archive.find("data");
         if(dataNode->isValid()){
@@ -313,6 +384,7 @@ ItemPtr ItemTreeArchiverImpl::restoreItem
                 Archive* dataArchive = static_cast<Archive*>(dataNode->toMapping());
                 dataArchive->inheritSharedInfoFrom(archive);
                 dataArchive->setCurrentParentItem(parentItem);
+                waitForPrefetching(dataArchive);
                 if(!item->restore(*dataArchive)){
                     item.reset();
                 }
@@ -114,6 +114,8 @@ public:
     bool isItemBeingOperated(Item* item);
     void onSubTreeAddedOrMoved(Item* item);
     void insertItem(QTreeWidgetItem* parentTwItem, Item* item, Item* nextItem);
+    ItvItem* createSubTree(Item* item);
+    void expandSubTree(QTreeWidgetItem* twItem);
     void onSubTreeRemoved(Item* item, bool isMoving);
     void onItemAssigned(Item* assigned, Item* srcItem);
 
@@ -144,6 +146,7 @@ public:
     void storeItemIds(Archive& archive, const char* key, const ItemList<>& items);
     bool restoreState(const Archive& archive);
     bool restoreItemStates(const Archive& archive, const char* key, std::function<void(Item*)> stateChangeFunc);
+    void selectItems(const ItemList<>& items);
     void storeExpandedItems(Archive& archive);
     void storeExpandedItemsSub(QTreeWidgetItem* parentTwItem, Archive& archive, ListingPtr& expanded);
     void restoreExpandedItems(const Archive& archive);
@@ -165,9 +168,10 @@ ItvItem::ItvItem(Item* item, ItemTreeViewImpl* itemTreeViewImpl)
 
     setToolTip(0, QString());
 
+    // The initial states are set without emitting the check toggle signals for every new item
     vector<CheckColumnPtr>& checkColumns = itemTreeViewImpl->checkColumns;
     for(size_t i=0; i < checkColumns.size(); ++i){
-        setCheckState(i + 1, Qt::Unchecked);
+        QTreeWidgetItem::setData(i + 1, Qt::CheckStateRole, Qt::Unchecked);
         setToolTip(i + 1, checkColumns[i]->tooltip);
     }
 
@@ -617,9 +621,13 @@ void ItemTreeViewImpl::onSubTreeAddedOrMoved(Item* item)
 }
 
 
+/**
+   The tree widget items of the whole sub tree are created before the top item is inserted
+   so that the view only processes a single insertion for the sub tree.
+*/
 void ItemTreeViewImpl::insertItem(QTreeWidgetItem* parentTwItem, Item* item, Item* nextItem)
 {
-    ItvItem* itvItem = getOrCreateItvItem(item);
+    ItvItem* itvItem = createSubTree(item);
     bool inserted = false;
     if(nextItem){
         ItvItem* nextItvItem = getItvItem(nextItem);
@@ -637,10 +645,39 @@ void ItemTreeViewImpl::insertItem(QTreeWidgetItem* parentTwItem, Item* item, Ite
         if(!parentTwItem->isExpanded() && !item->isSubItem()){
             parentTwItem->setExpanded(true);
         }
+        expandSubTree(itvItem);
     }
+}
 
+
+ItvItem* ItemTreeViewImpl::createSubTree(Item* item)
+{
+    ItvItem* itvItem = getOrCreateItvItem(item);
+    QList<QTreeWidgetItem*> children;
     for(Item* childItem = item->childItem(); childItem; childItem = childItem->nextItem()){
-        insertItem(itvItem, childItem, 0);
+        children.append(createSubTree(childItem));
+    }
+    if(!children.isEmpty()){
+        itvItem->addChildren(children);
+    }
+    return itvItem;
+}
+
+
+//! The items cannot be expanded until they are inserted into the tree widget
+void ItemTreeViewImpl::expandSubTree(QTreeWidgetItem* twItem)
+{
+    const int n = twItem->childCount();
+    for(int i=0; i < n; ++i){
+        ItvItem* childItvItem = dynamic_cast<ItvItem*>(twItem->child(i));
+        if(childItvItem){
+            if(!twItem->isExpanded() && !childItvItem->item->isSubItem()){
+                twItem->setExpanded(true);
+            }
+            if(childItvItem->childCount() > 0){
+                expandSubTree(childItvItem);
+            }
+        }
     }
 }
 
@@ -1202,7 +1239,9 @@ bool ItemTreeView::restoreState(const Archive& archive)
 bool ItemTreeViewImpl::restoreState(const Archive& archive)
 {
     restoreItemStates(archive, "checked", [&](Item* item){ checkItem(item, true, 0); });
-    restoreItemStates(archive, "selected", [&](Item* item){ selectItem(item, true); });
+    ItemList<> selected;
+    restoreItemStates(archive, "selected", [&](Item* item){ selected.push_back(item); });
+    selectItems(selected);
     restoreExpandedItems(archive);
     return true;
 }
@@ -1239,6 +1278,25 @@ bool ItemTreeViewImpl::restoreItemStates
 }
 
 
+/**
+   The items are selected at once so that the selection change is only notified once.
+*/
+void ItemTreeViewImpl::selectItems(const ItemList<>& items)
+{
+    QItemSelection selection;
+    for(auto& item : items){
+        ItvItem* itvItem = getItvItem(item);
+        if(itvItem){
+            QModelIndex index = indexFromItem(itvItem);
+            selection.select(index, index);
+        }
+    }
+    if(!selection.isEmpty()){
+        selectionModel()->select(selection, QItemSelectionModel::Select);
+    }
+}
+
+
 void ItemTreeViewImpl::storeExpandedItems(Archive& archive)
 {
     ListingPtr expanded = new Listing();
@@ -0,0 +1,206 @@
+/**
+   @file
+*/
+
+#include "MemoryUsageView.h"
+#include "ViewManager.h"
+#include "RootItem.h"
+#include "ItemManager.h"
+#include "ItemTreeView.h"
+#include "TreeWidget.h"
+#include "Buttons.h"
+#include "LazyCaller.h"
+#include <cnoid/ConnectionSet>
+#include <cnoid/MemoryUsage>
+#include <QBoxLayout>
+#include <QLabel>
+#include <QHeaderView>
+#include <algorithm>
+#include "gettext.h"
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+MemoryUsageView* instance_ = nullptr;
+
+enum ColumnId { NAME_COLUMN, CLASS_COLUMN, MEMORY_COLUMN, NUM_COLUMNS };
+
+class ItemRow : public QTreeWidgetItem
+{
+public:
+    weak_ref_ptr<Item> item;
+};
+
+struct ItemUsage
+{
+    ItemPtr item;
+    size_t bytes;
+};
+
+QString toMegaBytesString(size_t bytes)
+{
+    return QString("%1 MB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 2);
+}
+
+}
+
+namespace cnoid {
+
+class MemoryUsageViewImpl
+{
+public:
+    MemoryUsageView* self;
+    TreeWidget treeWidget;
+    QLabel totalLabel;
+    PushButton updateButton;
+    LazyCaller updateLater;
+    ScopedConnection treeChangedConnection;
+
+    MemoryUsageViewImpl(MemoryUsageView* self);
+    void onActivated(bool on);
+    void updateList();
+    void onRowDoubleClicked(QTreeWidgetItem* row);
+};
+
+}
+
+
+void MemoryUsageView::initializeClass(ExtensionManager* ext)
+{
+    instance_ =
+        ext->viewManager().registerClass<MemoryUsageView>(
+            "MemoryUsageView", N_("Memory Usage"), ViewManager::SINGLE_OPTIONAL);
+}
+
+
+MemoryUsageView* MemoryUsageView::instance()
+{
+    return instance_;
+}
+
+
+MemoryUsageView::MemoryUsageView()
+{
+    impl = new MemoryUsageViewImpl(this);
+}
+
+
+MemoryUsageViewImpl::MemoryUsageViewImpl(MemoryUsageView* self)
+    : self(self),
+      updateButton(_("Update"))
+{
+    self->setDefaultLayoutArea(View::BOTTOM);
+
+    QVBoxLayout* vbox = new QVBoxLayout;
+    vbox->setSpacing(0);
+
+    QHBoxLayout* hbox = new QHBoxLayout;
+    hbox->addWidget(&totalLabel);
+    hbox->addStretch();
+    updateButton.sigClicked().connect([&](){ updateList(); });
+    hbox->addWidget(&updateButton);
+    vbox->addLayout(hbox);
+
+    treeWidget.setColumnCount(NUM_COLUMNS);
+    treeWidget.setHeaderLabels({ _("Item"), _("Class"), _("Memory") });
+    treeWidget.setRootIsDecorated(false);
+    treeWidget.setAlternatingRowColors(true);
+    treeWidget.setAllColumnsShowFocus(true);
+    treeWidget.setSelectionMode(QAbstractItemView::SingleSelection);
+    QHeaderView* header = treeWidget.header();
+    header->setStretchLastSection(false);
+    header->setSectionResizeMode(NAME_COLUMN, QHeaderView::Stretch);
+    header->setSectionResizeMode(CLASS_COLUMN, QHeaderView::ResizeToContents);
+    header->setSectionResizeMode(MEMORY_COLUMN, QHeaderView::ResizeToContents);
+    treeWidget.sigItemDoubleClicked().connect(
+        [&](QTreeWidgetItem* row, int){ onRowDoubleClicked(row); });
+    vbox->addWidget(&treeWidget);
+
+    self->setLayout(vbox);
+
+    updateLater.setFunction([&](){ updateList(); });
+    updateLater.setPriority(LazyCaller::PRIORITY_LOW);
+
+    self->sigActivated().connect([&](){ onActivated(true); });
+    self->sigDeactivated().connect([&](){ onActivated(false); });
+}
+
+
+MemoryUsageView::~MemoryUsageView()
+{
+    delete impl;
+}
+
+
+void MemoryUsageViewImpl::onActivated(bool on)
+{
+    treeChangedConnection.disconnect();
+    if(on){
+        treeChangedConnection =
+            RootItem::instance()->sigTreeChanged().connect([&](){ updateLater(); });
+        updateList();
+    }
+}
+
+
+void MemoryUsageView::updateList()
+{
+    impl->updateList();
+}
+
+
+/**
+   The items are counted in the order of the item tree with the same counter so that
+   the data shared with the parent item such as the sequences of a body motion item is
+   only counted for the parent item.
+*/
+void MemoryUsageViewImpl::updateList()
+{
+    MemoryUsageCounter counter;
+    vector<ItemUsage> usages;
+
+    RootItem::instance()->traverse(
+        [&](Item* item){
+            if(item != RootItem::instance()){
+                size_t bytes = counter.bytes();
+                item->countMemoryUsage(counter);
+                usages.push_back({ item, counter.bytes() - bytes });
+            }
+            return false;
+        });
+
+    stable_sort(usages.begin(), usages.end(),
+                [](const ItemUsage& lhs, const ItemUsage& rhs){ return lhs.bytes > rhs.bytes; });
+
+    treeWidget.clear();
+    string moduleName;
+    string className;
+    for(auto& usage : usages){
+        auto row = new ItemRow;
+        row->item = usage.item;
+        row->setText(NAME_COLUMN, usage.item->name().c_str());
+        if(ItemManager::getClassIdentifier(usage.item, moduleName, className)){
+            row->setText(CLASS_COLUMN, className.c_str());
+        }
+        row->setText(MEMORY_COLUMN, toMegaBytesString(usage.bytes));
+        row->setTextAlignment(MEMORY_COLUMN, Qt::AlignRight | Qt::AlignVCenter);
+        treeWidget.addTopLevelItem(row);
+    }
+
+    totalLabel.setText(
+        QString(_("Items: %1, Peak process memory: %2"))
+        .arg(toMegaBytesString(counter.bytes()))
+        .arg(toMegaBytesString(getPeakMemoryUsage())));
+}
+
+
+void MemoryUsageViewImpl::onRowDoubleClicked(QTreeWidgetItem* row)
+{
+    if(auto item = static_cast<ItemRow*>(row)->item.lock()){
+        auto itemTreeView = ItemTreeView::instance();
+        itemTreeView->clearSelection();
+        itemTreeView->selectItem(item);
+    }
+}
@@ -0,0 +1,36 @@
+/**
+   @file
+*/
+
+#ifndef CNOID_BASE_MEMORY_USAGE_VIEW_H
+#define CNOID_BASE_MEMORY_USAGE_VIEW_H
+
+#include <cnoid/View>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class MemoryUsageViewImpl;
+
+/**
+   This view lists the items in the descending order of the bytes counted by Item::countMemoryUsage.
+   The data shared by several items is only counted for the item which comes first in the item tree.
+*/
+class CNOID_EXPORT MemoryUsageView : public View
+{
+public:
+    static void initializeClass(ExtensionManager* ext);
+    static MemoryUsageView* instance();
+
+    MemoryUsageView();
+    virtual ~MemoryUsageView();
+
+    void updateList();
+
+private:
+    MemoryUsageViewImpl* impl;
+};
+
+}
+
+#endif
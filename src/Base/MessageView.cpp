@@ -8,13 +8,18 @@
 #include "InfoBar.h"
 #include "Item.h"
 #include "TextEdit.h"
+#include "Timer.h"
 #include <QBoxLayout>
 #include <QMessageBox>
 #include <QCoreApplication>
 #include <QThread>
+#include <QElapsedTimer>
 #include <boost/iostreams/concepts.hpp>
 #include <boost/iostreams/stream_buffer.hpp>
 #include <stack>
+#include <deque>
+#include <mutex>
+#include <memory>
 #include <iostream>
 #include "gettext.h"
 
@@ -28,6 +33,11 @@ MessageView* messageView = 0;
 
 const bool PUT_COUT_TOO = false;
 
+// The messages from the other threads are inserted into the text at this interval at most
+const int pendingMessageDrainInterval = 50; // [ms]
+const int defaultMaxNumPendingMessages = 10000;
+const int defaultMaxLineCount = 100000;
+
 class TextSink : public iostreams::sink
 {
 public:
@@ -44,32 +54,24 @@ struct StdioInfo {
     streambuf* cerr;
 };
 
-enum MvCommand { MV_PUT, MV_CLEAR };
-
-
-class MessageViewEvent : public QEvent
+struct PendingMessage
 {
-public:
-    MessageViewEvent(const QString& message, bool doLF, bool doNotify, bool doFlush)
-        : QEvent(QEvent::User),
-          command(MV_PUT),
-          message(message),
-          doLF(doLF),
-          doNotify(doNotify),
-          doFlush(doFlush) {
-    }
-
-    MessageViewEvent(MvCommand command)
-        : QEvent(QEvent::User),
-          command(command) {
-
-    }
-        
-    MvCommand command;
+    PendingMessage(const QString& message, bool doLF, bool doNotify, bool doFlush)
+        : message(message), doLF(doLF), doNotify(doNotify), doFlush(doFlush), isClear(false) { }
+    PendingMessage()
+        : doLF(false), doNotify(false), doFlush(false), isClear(true) { }
     QString message;
     bool doLF;
     bool doNotify;
     bool doFlush;
+    bool isClear;
+};
+
+//! This event requests to insert the pending messages into the text
+class MessageViewEvent : public QEvent
+{
+public:
+    MessageViewEvent() : QEvent(QEvent::User) { }
 };
 
 int flushingRef = 0;
@@ -115,6 +117,16 @@ public:
     std::stack<StdioInfo> stdios;
     bool exitEventLoopRequested;
 
+    // The messages put from the other threads are queued and inserted together
+    std::mutex pendingMessageMutex;
+    std::deque<PendingMessage> pendingMessages;
+    bool isPendingMessageDrainRequested;
+    int maxNumPendingMessages;
+    int numDroppedMessages;
+    int totalNumDroppedMessages;
+    Timer pendingMessageDrainTimer;
+    QElapsedTimer lastDrainTimer;
+
     Signal<void(const std::string& text)> sigMessage;
 
     MessageViewImpl(MessageView* self);
@@ -122,7 +134,9 @@ public:
     void put(const QString& message, bool doLF, bool doNotify, bool doFlush);
     void put(int type, const QString& message, bool doLF, bool doNotify, bool doFlush);
     void doPut(const QString& message, bool doLF, bool doNotify, bool doFlush);
-    void handleMessageViewEvent(MessageViewEvent* event);
+    void insertMessage(const QString& message, bool doLF);
+    void pushPendingMessage(PendingMessage&& message);
+    void drainPendingMessages(bool doForce = false);
     void flush();
     void doClear();
     void clear();
@@ -266,6 +280,15 @@ MessageViewImpl::MessageViewImpl(MessageView* self) :
     orgCharFormat = currentCharFormat;
     orgCharFormat.setForeground(orgForeColor);
     orgCharFormat.setBackground(orgBackColor);
+
+    textEdit.document()->setMaximumBlockCount(defaultMaxLineCount);
+
+    isPendingMessageDrainRequested = false;
+    maxNumPendingMessages = defaultMaxNumPendingMessages;
+    numDroppedMessages = 0;
+    totalNumDroppedMessages = 0;
+    pendingMessageDrainTimer.setSingleShot(true);
+    pendingMessageDrainTimer.sigTimeout().connect([&](){ drainPendingMessages(); });
 }
 
 
@@ -446,8 +469,91 @@ void MessageViewImpl::put(const QString& message, bool doLF, bool doNotify, bool
     if(QThread::currentThreadId() == mainThreadId){
         doPut(message, doLF, doNotify, doFlush);
     } else {
-        MessageViewEvent* event = new MessageViewEvent(message, doLF, doNotify, doFlush);
-        QCoreApplication::postEvent(self, event, Qt::NormalEventPriority);
+        pushPendingMessage(PendingMessage(message, doLF, doNotify, doFlush));
+    }
+}
+
+
+/**
+   Only one event is posted for the messages queued until they are drained
+   so that the event loop is not flooded by a thread which outputs many messages.
+*/
+void MessageViewImpl::pushPendingMessage(PendingMessage&& message)
+{
+    {
+        std::lock_guard<std::mutex> lock(pendingMessageMutex);
+        if(!message.isClear && static_cast<int>(pendingMessages.size()) >= maxNumPendingMessages){
+            ++numDroppedMessages;
+            return;
+        }
+        pendingMessages.push_back(std::move(message));
+        if(isPendingMessageDrainRequested){
+            return;
+        }
+        isPendingMessageDrainRequested = true;
+    }
+    QCoreApplication::postEvent(self, new MessageViewEvent, Qt::NormalEventPriority);
+}
+
+
+void MessageViewImpl::drainPendingMessages(bool doForce)
+{
+    if(!doForce && lastDrainTimer.isValid()){
+        const qint64 elapsed = lastDrainTimer.elapsed();
+        if(elapsed < pendingMessageDrainInterval){
+            if(!pendingMessageDrainTimer.isActive()){
+                pendingMessageDrainTimer.start(pendingMessageDrainInterval - elapsed);
+            }
+            return;
+        }
+    }
+    lastDrainTimer.start();
+
+    std::deque<PendingMessage> messages;
+    int numDropped;
+    {
+        std::lock_guard<std::mutex> lock(pendingMessageMutex);
+        messages.swap(pendingMessages);
+        numDropped = numDroppedMessages;
+        numDroppedMessages = 0;
+        isPendingMessageDrainRequested = false;
+    }
+
+    bool isLatestMessageVisible = textEdit.isLatestMessageVisible();
+    if(isLatestMessageVisible){
+        textEdit.moveCursor(QTextCursor::End);
+    }
+    const PendingMessage* messageToNotify = nullptr;
+    bool doFlush = false;
+    for(auto& message : messages){
+        if(message.isClear){
+            doClear();
+            messageToNotify = nullptr;
+        } else {
+            insertMessage(message.message, message.doLF);
+            if(message.doNotify){
+                messageToNotify = &message;
+            }
+            doFlush |= message.doFlush;
+        }
+    }
+    if(numDropped > 0){
+        totalNumDroppedMessages += numDropped;
+        insertMessage(
+            QString("\033[31m") +
+            QString(_("Warning: %1 messages were dropped because they were output too frequently."))
+            .arg(numDropped) + "\033[0m", true);
+    }
+    if(isLatestMessageVisible){
+        textEdit.ensureCursorVisible();
+    }
+
+    // Only the last message is notified because the previous ones are overwritten immediately
+    if(messageToNotify){
+        InfoBar::instance()->notify(messageToNotify->message);
+    }
+    if(doFlush){
+        flush();
     }
 }
 
@@ -479,6 +585,23 @@ void MessageViewImpl::doPut(const QString& message, bool doLF, bool doNotify, bo
         textEdit.moveCursor(QTextCursor::End);
     }
 
+    insertMessage(message, doLF);
+
+    if(isLatestMessageVisible){
+        textEdit.ensureCursorVisible();
+    }
+    
+    if(doNotify){
+        InfoBar::instance()->notify(message);
+    }
+    if(doFlush){
+        flush();
+    }
+}
+
+
+void MessageViewImpl::insertMessage(const QString& message, bool doLF)
+{
     QString txt(message);
     while(true){
         int i = txt.indexOf("\x1b");
@@ -493,10 +616,6 @@ void MessageViewImpl::doPut(const QString& message, bool doLF, bool doNotify, bo
     }
     insertPlainText(txt, doLF);
 
-    if(isLatestMessageVisible){
-        textEdit.ensureCursorVisible();
-    }
-    
     if(PUT_COUT_TOO){
         cout << message.toStdString();
         if(doLF){
@@ -511,13 +630,6 @@ void MessageViewImpl::doPut(const QString& message, bool doLF, bool doNotify, bo
         }
         sigMessage(boost::ref(text));
     }
-    
-    if(doNotify){
-        InfoBar::instance()->notify(message);
-    }
-    if(doFlush){
-        flush();
-    }
 }
 
 
@@ -525,25 +637,35 @@ bool MessageView::event(QEvent* e)
 {
     MessageViewEvent* event = dynamic_cast<MessageViewEvent*>(e);
     if(event){
-        impl->handleMessageViewEvent(event);
+        impl->drainPendingMessages();
         return true;
     }
     return false;
 }
 
 
-void MessageViewImpl::handleMessageViewEvent(MessageViewEvent* event)
+void MessageView::setMaxLineCount(int n)
 {
-    switch(event->command){
-    case MV_PUT:
-        doPut(event->message, event->doLF, event->doNotify, event->doFlush);
-        break;
-    case MV_CLEAR:
-        doClear();
-        break;
-    default:
-        break;
-    }
+    impl->textEdit.document()->setMaximumBlockCount(n);
+}
+
+
+int MessageView::maxLineCount() const
+{
+    return impl->textEdit.document()->maximumBlockCount();
+}
+
+
+void MessageView::setMaxNumPendingMessages(int n)
+{
+    std::lock_guard<std::mutex> lock(impl->pendingMessageMutex);
+    impl->maxNumPendingMessages = n;
+}
+
+
+int MessageView::numDroppedMessages() const
+{
+    return impl->totalNumDroppedMessages;
 }
 
 
@@ -568,6 +690,14 @@ void MessageView::flush()
 void MessageViewImpl::flush()
 {
     if(QThread::currentThreadId() == mainThreadId){
+        bool hasPendingMessages;
+        {
+            std::lock_guard<std::mutex> lock(pendingMessageMutex);
+            hasPendingMessages = !pendingMessages.empty();
+        }
+        if(hasPendingMessages){
+            drainPendingMessages(true);
+        }
         ++flushingRef;
         QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents|QEventLoop::ExcludeSocketNotifiers, 1.0);
         --flushingRef;
@@ -613,7 +743,7 @@ void MessageViewImpl::clear()
     if(QThread::currentThreadId() == mainThreadId){
         doClear();
     } else {
-        QCoreApplication::postEvent(self, new MessageViewEvent(MV_CLEAR), Qt::NormalEventPriority);
+        pushPendingMessage(PendingMessage());
     }
 }
 
@@ -33,6 +33,12 @@ public:
 
     enum MessageType { NORMAL, ERROR, WARNING, HIGHLIGHT };
 
+    /**
+       The functions to put messages can be called from any thread. The messages put from
+       the threads other than the main thread are queued and inserted into the text together
+       at a limited rate. The messages which exceed the capacity of the queue are dropped.
+       Note that the stream returned by cout() must not be shared by multiple threads.
+    */
     void put(const char* message, int type = NORMAL);
     void put(const std::string& message, int type = NORMAL);
     void put(const QString& message, int type = NORMAL);
@@ -76,6 +82,15 @@ public:
       
     std::ostream& cout(bool doFlush = false);
 
+    //! The oldest lines are removed when the number of lines exceeds this. Zero means no limit.
+    void setMaxLineCount(int n);
+    int maxLineCount() const;
+
+    //! The capacity of the queue for the messages put from the other threads
+    void setMaxNumPendingMessages(int n);
+    //! The number of the messages dropped because the queue was full
+    int numDroppedMessages() const;
+
     void beginStdioRedirect();
     void endStdioRedirect();
 
@@ -38,6 +38,15 @@
 #include <deque>
 #include <fmt/format.h>
 #include <fmt/ostream.h>
+#include <cstdio>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#else
+#include <csignal>
+#include <pthread.h>
+#endif
 
 #ifdef Q_OS_LINUX
 #include <QX11Info>
@@ -107,6 +116,8 @@ public:
     LineEdit directoryEntry;
     PushButton directoryButton;
     LineEdit basenameEntry;
+    CheckBox videoOutputCheck;
+    LineEdit encoderEntry;
     CheckBox startTimeCheck;
     DoubleSpinBox startTimeSpin;
     CheckBox finishTimeCheck;
@@ -220,7 +231,16 @@ public:
     std::thread imageOutputThread;
     std::mutex imageQueueMutex;
     std::condition_variable imageQueueCondition;
-   string filenameFormat;
+    string filenameFormat;
+
+    // The frames are streamed into the standard input of an FFmpeg process in the video output mode
+    bool isVideoOutputMode;
+    string videoFilename;
+    string videoEncoder;
+    double videoFrameRate;
+    FILE* videoPipe;
+    int videoWidth;
+    int videoHeight;
 
     MovieRecorderImpl(ExtensionManager* ext);
     ~MovieRecorderImpl();
@@ -245,6 +265,9 @@ public:
     void captureSceneWidgets(QWidget* widget, QPixmap& pixmap);
     void startImageOutput();
     void outputImages();
+    bool openVideoPipe(int width, int height);
+    bool writeVideoFrame(QImage image);
+    bool closeVideoPipe();
     void onImageOutputFailed(std::string message);
     void stopRecording(bool isFinished);
     void onViewMarkerToggled(bool on);
@@ -300,6 +323,9 @@ MovieRecorderImpl::MovieRecorderImpl(ExtensionManager* ext)
 
     targetView = 0;
     
+    isVideoOutputMode = false;
+    videoPipe = nullptr;
+    
     isRecording = false;
     isBeforeFirstFrameCapture = false;
     requestStopRecording = false;
@@ -383,6 +409,16 @@ ConfigDialog::ConfigDialog(MovieRecorderImpl* recorder)
     hbox->addStretch();
     vbox->addLayout(hbox);
 
+    hbox = new QHBoxLayout();
+    videoOutputCheck.setText(_("Output a video file with FFmpeg"));
+    hbox->addWidget(&videoOutputCheck);
+    hbox->addWidget(new QLabel(_("Encoder")));
+    encoderEntry.setText("libx264");
+    encoderEntry.setToolTip(_("The hardware encoders such as h264_nvenc and h264_vaapi can also be specified"));
+    hbox->addWidget(&encoderEntry);
+    hbox->addStretch();
+    vbox->addLayout(hbox);
+
     hbox = new QHBoxLayout();
     hbox->addWidget(new QLabel(_("Frame rate")));
     fpsSpin.setDecimals(1);
@@ -714,6 +750,16 @@ bool MovieRecorderImpl::setupViewAndFilenameFormat()
     filesystem::path directory(dialog->directoryEntry.string());
     filesystem::path basename(dialog->basenameEntry.string() + "{:08d}.png");
 
+    isVideoOutputMode = dialog->videoOutputCheck.isChecked();
+    if(isVideoOutputMode){
+        videoEncoder = dialog->encoderEntry.string();
+        if(videoEncoder.empty()){
+            showWarningDialog(_("Please set the encoder of the video."));
+            return false;
+        }
+        videoFrameRate = dialog->frameRate();
+    }
+
     if(directory.empty()){
         showWarningDialog(_("Please set a directory to output image files."));
         return false;
@@ -730,6 +776,7 @@ bool MovieRecorderImpl::setupViewAndFilenameFormat()
     }
 
     filenameFormat = (directory / basename).string();
+    videoFilename = (directory / filesystem::path(dialog->basenameEntry.string() + ".mp4")).string();
 
     if(dialog->imageSizeCheck.isChecked()){
         int width = dialog->imageWidthSpin.value();
@@ -968,6 +1015,16 @@ void MovieRecorderImpl::startImageOutput()
 
 void MovieRecorderImpl::outputImages()
 {
+#ifndef _WIN32
+    if(isVideoOutputMode){
+        // Writing to the pipe of the terminated encoder must not kill the application
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    }
+#endif
+    
     while(true){
         CapturedImagePtr captured;
         {
@@ -985,12 +1042,21 @@ void MovieRecorderImpl::outputImages()
         
         bool saved = false;
 
-        string filename = format(filenameFormat, captured->frame);
-        
-        if(captured->image.which() == 0){
+        string filename;
+
+        if(isVideoOutputMode){
+            filename = videoFilename;
+            if(captured->image.which() == 0){
+                saved = writeVideoFrame(boost::get<QPixmap>(captured->image).toImage());
+            } else {
+                saved = writeVideoFrame(boost::get<QImage>(captured->image));
+            }
+        } else if(captured->image.which() == 0){
+            filename = format(filenameFormat, captured->frame);
             QPixmap& pixmap = boost::get<QPixmap>(captured->image);
             saved = pixmap.save(filename.c_str());
         } else {
+            filename = format(filenameFormat, captured->frame);
             QImage& image = boost::get<QImage>(captured->image);
             saved = image.save(filename.c_str());
         }
@@ -998,6 +1064,9 @@ void MovieRecorderImpl::outputImages()
         if(!saved){
             string message = format(_("Saving an image to \"{}\" failed."), filename);
             callLater(std::bind(&MovieRecorderImpl::onImageOutputFailed, this, message));
+            if(videoPipe){
+                closeVideoPipe();
+            }
             {
                 std::lock_guard<std::mutex> lock(imageQueueMutex);
                 capturedImages.clear();
@@ -1006,6 +1075,77 @@ void MovieRecorderImpl::outputImages()
             break;
         }
     }
+
+    if(videoPipe && !closeVideoPipe()){
+        string message = format(_("Encoding the video \"{}\" failed."), videoFilename);
+        callLater(std::bind(&MovieRecorderImpl::onImageOutputFailed, this, message));
+    }
+}
+
+
+/**
+   The size of the video is fixed to that of the first frame. The padding filter makes the
+   size even because the YUV 4:2:0 formats used by most encoders require it.
+*/
+bool MovieRecorderImpl::openVideoPipe(int width, int height)
+{
+    videoWidth = width;
+    videoHeight = height;
+
+    string filter("pad=ceil(iw/2)*2:ceil(ih/2)*2");
+    string deviceOption;
+    string pixelFormatOption;
+    if(videoEncoder.find("vaapi") != string::npos){
+        deviceOption = "-vaapi_device /dev/dri/renderD128 ";
+        filter += ",format=nv12,hwupload";
+    } else {
+        pixelFormatOption = "-pix_fmt yuv420p ";
+    }
+    string command =
+        format("ffmpeg -y -loglevel error {0}-f rawvideo -pix_fmt bgra -s {1}x{2} -r {3} -i - "
+               "-vf \"{4}\" -c:v {5} {6}\"{7}\"",
+               deviceOption, width, height, videoFrameRate, filter, videoEncoder,
+               pixelFormatOption, videoFilename);
+
+#ifdef _WIN32
+    videoPipe = popen(command.c_str(), "wb");
+#else
+    videoPipe = popen(command.c_str(), "w");
+#endif
+    return (videoPipe != nullptr);
+}
+
+
+bool MovieRecorderImpl::writeVideoFrame(QImage image)
+{
+    if(!videoPipe){
+        if(!openVideoPipe(image.width(), image.height())){
+            return false;
+        }
+    }
+    if(image.width() != videoWidth || image.height() != videoHeight){
+        image = image.scaled(videoWidth, videoHeight);
+    }
+    if(image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32){
+        image = image.convertToFormat(QImage::Format_RGB32);
+    }
+    // The 32-bit pixels are stored as B, G, R and A bytes on the little endian machines
+    const size_t lineSize = videoWidth * 4;
+    for(int y=0; y < videoHeight; ++y){
+        if(fwrite(image.constScanLine(y), 1, lineSize, videoPipe) != lineSize){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//! \return false if the encoder process failed
+bool MovieRecorderImpl::closeVideoPipe()
+{
+    int status = pclose(videoPipe);
+    videoPipe = nullptr;
+    return (status == 0);
 }
 
 
@@ -1030,7 +1170,9 @@ void MovieRecorderImpl::stopRecording(bool isFinished)
             numRemainingImages = capturedImages.size();
         }
         if(numRemainingImages > 1){
-            QProgressDialog progress(_("Outputting sequential image files..."), _("Abort Output"), 0, numRemainingImages, MainWindow::instance());
+            QProgressDialog progress(
+                isVideoOutputMode ? _("Encoding the video...") : _("Outputting sequential image files..."),
+                _("Abort Output"), 0, numRemainingImages, MainWindow::instance());
             progress.setWindowTitle(_("Movie Recorder's Output Status"));
             progress.setWindowModality(Qt::WindowModal);
             while(true){
@@ -1190,6 +1332,8 @@ bool ConfigDialog::store(Mapping& archive)
     archive.write("showViewMarker", viewMarkerCheck.isChecked());
     archive.write("directory", directoryEntry.string());
     archive.write("basename", basenameEntry.string());
+    archive.write("videoOutput", videoOutputCheck.isChecked());
+    archive.write("videoEncoder", encoderEntry.string());
     archive.write("checkStartTime", startTimeCheck.isChecked());
     archive.write("startTime", startTimeSpin.value());
     archive.write("checkFinishTime", finishTimeCheck.isChecked());
@@ -1221,6 +1365,8 @@ void ConfigDialog::restore(const Mapping& archive)
     viewMarkerCheck.setChecked(archive.get("showViewMarker", viewMarkerCheck.isChecked()));
     directoryEntry.setText(archive.get("directory", directoryEntry.string()));
     basenameEntry.setText(archive.get("basename", basenameEntry.string()));
+    videoOutputCheck.setChecked(archive.get("videoOutput", videoOutputCheck.isChecked()));
+    encoderEntry.setText(archive.get("videoEncoder", encoderEntry.string()));
     startTimeCheck.setChecked(archive.get("checkStartTime", startTimeCheck.isChecked()));
     startTimeSpin.setValue(archive.get("startTime", startTimeSpin.value()));
     finishTimeCheck.setChecked(archive.get("checkFinishTime", finishTimeCheck.isChecked()));
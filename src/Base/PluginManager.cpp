@@ -14,6 +14,7 @@
 #include <cnoid/ExecutablePath>
 #include <cnoid/FileUtil>
 #include <cnoid/Config>
+#include <cnoid/PhaseProfiler>
 #include <QLibrary>
 #include <QRegExp>
 #include <QFileDialog>
@@ -22,6 +23,7 @@
 #include <map>
 #include <set>
 #include <list>
+#include <ctime>
 #include <iostream>
 #include <fmt/format.h>
 
@@ -65,6 +67,7 @@ public:
 
     Action* startupLoadingCheck;
     Action* namingConventionCheck;
+    Action* onDemandLoadingCheck;
         
     MessageView* mv;
 
@@ -81,6 +84,7 @@ public:
             status = PluginManager::NOT_LOADED;
             areAllRequisitiesResolved = false;
             doReloading = false;
+            isLoadingDeferred = false;
             aboutMenuItem = 0;
             aboutDialog = 0;
         }
@@ -91,9 +95,11 @@ public:
         vector<string> requisites;
         vector<string> dependents;
         set<string> subsequences;
+        vector<string> oldNames;
         int status;
         bool areAllRequisitiesResolved;
         bool doReloading;
+        bool isLoadingDeferred;
         Action* aboutMenuItem;
         DescriptionDialog* aboutDialog;
     };
@@ -114,6 +120,10 @@ public:
     typedef list<PluginInfoPtr> PluginInfoList;
     PluginInfoList pluginsInDeactivationOrder;
 
+    // The name, requisites and the other information of each plugin file are recorded in the
+    // config so that the plugin file can be registered in the next run without loading it
+    MappingPtr manifests;
+
     PluginInfoArray pluginsToUnload;
     LazyCaller unloadPluginsLater;
     LazyCaller reloadPluginsLater;
@@ -127,6 +137,11 @@ public:
     bool finalizePlugins();
     bool loadPlugin(int index);
     bool activatePlugin(int index);
+    void storeManifest(PluginInfo* info);
+    bool deferLoadingWithManifest(PluginInfoPtr info);
+    bool loadDeferredPlugin(PluginInfoPtr info);
+    void loadDeferredPlugins();
+    void registerOldNames(PluginInfo* info);
     void onLoadPluginTriggered();
     void onAboutDialogTriggered(PluginInfo* info);
     const char* guessActualPluginName(const std::string& name);
@@ -216,6 +231,14 @@ PluginManagerImpl::PluginManagerImpl(ExtensionManager* ext)
 
     namingConventionCheck = mm.addCheckItem(_("Check the naming convention of plugin files"));
     namingConventionCheck->setChecked(config->get("checkPluginfileNamingConvention", true));
+
+    onDemandLoadingCheck = mm.addCheckItem(_("On-demand Plugin Loading"));
+    onDemandLoadingCheck->setChecked(config->get("onDemandPluginLoading", false));
+
+    mm.addItem(_("Load Deferred Plugins"))
+        ->sigTriggered().connect(std::bind(&PluginManagerImpl::loadDeferredPlugins, this));
+
+    manifests = config->openMapping("pluginManifests");
     
     mm.addSeparator();
 }
@@ -234,6 +257,7 @@ PluginManagerImpl::~PluginManagerImpl()
     auto config = AppConfig::archive()->openMapping("PluginManager");
     config->write("startupPluginLoading", startupLoadingCheck->isChecked());
     config->write("checkPluginfileNamingConvention", namingConventionCheck->isChecked());
+    config->write("onDemandPluginLoading", onDemandLoadingCheck->isChecked());
 }
 
 
@@ -273,11 +297,20 @@ Plugin* PluginManager::findPlugin(const std::string& name)
 
 void PluginManager::doStartupLoading(const char* pluginPathList)
 {
+    PhaseProfiler::Scope scope("Plugin loading");
+    
     if(impl->startupLoadingCheck->isChecked()){
         if(pluginPathList){
             scanPluginFilesInPathList(pluginPathList);
         }
         scanPluginFilesInDirectoyOfExecFile();
+        if(impl->onDemandLoadingCheck->isChecked()){
+            for(auto& info : impl->allPluginInfos){
+                if(info->status == NOT_LOADED){
+                    impl->deferLoadingWithManifest(info);
+                }
+            }
+        }
         loadPlugins();
     }
 }
@@ -399,7 +432,8 @@ void PluginManagerImpl::loadPlugins()
         int numLoaded = 0;
         int numNotLoaded = 0;
         for(size_t i=0; i < allPluginInfos.size(); ++i){
-            if(allPluginInfos[i]->status == PluginManager::NOT_LOADED){
+            auto& info = allPluginInfos[i];
+            if(info->status == PluginManager::NOT_LOADED && !info->isLoadingDeferred){
                 if(loadPlugin(i)){
                     ++numLoaded;
                 } else {
@@ -473,6 +507,8 @@ bool PluginManagerImpl::loadPlugin(int index)
     } else if(info->status == PluginManager::NOT_LOADED){
         mv->putln(fmt::format(_("Detecting plugin file \"{}\""), info->pathString));
 
+        PhaseProfiler::Scope scope("Plugin file loading", info->pathString);
+
         info->dll.setFileName(info->pathString.c_str());
 
         // Some Python modules written in C/C++ requires the following options
@@ -521,6 +557,11 @@ bool PluginManagerImpl::loadPlugin(int index)
                         info->requisites.push_back(plugin->requisite(i));
                     }
 
+                    const int numOldNames = plugin->numOldNames();
+                    for(int i=0; i < numOldNames; ++i){
+                        info->oldNames.push_back(plugin->oldName(i));
+                    }
+
                     const int numSubsequences = plugin->numSubsequences();
                     for(int i=0; i < numSubsequences; ++i){
                         const string subsequence(plugin->subsequence(i));
@@ -536,6 +577,7 @@ bool PluginManagerImpl::loadPlugin(int index)
                     PluginMap::iterator p = nameToPluginInfoMap.find(info->name);
                     if(p == nameToPluginInfoMap.end()){
                         nameToPluginInfoMap.insert(make_pair(info->name, info));
+                        storeManifest(info.get());
                     } else {
                         info->status = PluginManager::CONFLICT;
                         PluginInfoPtr& another = p->second;
@@ -587,7 +629,10 @@ bool PluginManagerImpl::activatePlugin(int index)
                 requisitesActive = false;
                 break;
             }
-            PluginInfoPtr& requisite = q->second;
+            PluginInfoPtr requisite = q->second;
+            if(requisite->isLoadingDeferred){
+                loadDeferredPlugin(requisite);
+            }
             if(info->subsequences.find(requisiteName) != info->subsequences.end()){
                 if(requisite->status != PluginManager::LOADED){
                     requisitesActive = false;
@@ -602,6 +647,8 @@ bool PluginManagerImpl::activatePlugin(int index)
         if(requisitesActive){
 
             info->areAllRequisitiesResolved = true;
+
+            PhaseProfiler::Scope scope("Plugin activation", info->name);
                 
             if(!info->plugin->initialize()){
                 info->status = PluginManager::INVALID;
@@ -633,12 +680,7 @@ bool PluginManagerImpl::activatePlugin(int index)
                 info->aboutMenuItem->sigTriggered().connect(
                     std::bind(&PluginManagerImpl::onAboutDialogTriggered, this, info.get()));
                 
-                // register old names
-                int numOldNames = info->plugin->numOldNames();
-                for(int i=0; i < numOldNames; ++i){
-                    oldNameToCurrentPluginNameMap.insert(
-                        make_pair(info->plugin->oldName(i), info->name));
-                }
+                registerOldNames(info.get());
                 
                 mv->putln(fmt::format(_("{}-plugin has been activated."), info->name));
                 mv->flush();
@@ -657,6 +699,172 @@ bool PluginManagerImpl::activatePlugin(int index)
 }
 
 
+void PluginManagerImpl::registerOldNames(PluginInfo* info)
+{
+    for(auto& oldName : info->oldNames){
+        bool registered = false;
+        auto range = oldNameToCurrentPluginNameMap.equal_range(oldName);
+        for(auto p = range.first; p != range.second; ++p){
+            if(p->second == info->name){
+                registered = true;
+                break;
+            }
+        }
+        if(!registered){
+            oldNameToCurrentPluginNameMap.insert(make_pair(oldName, info->name));
+        }
+    }
+}
+
+
+static string getModifiedTimeString(const string& pathString)
+{
+    boost::system::error_code ec;
+    std::time_t time = filesystem::last_write_time(filesystem::path(pathString), ec);
+    if(ec){
+        return string();
+    }
+    return std::to_string(time);
+}
+
+
+void PluginManagerImpl::storeManifest(PluginInfo* info)
+{
+    string modifiedTime = getModifiedTimeString(info->pathString);
+    if(modifiedTime.empty()){
+        return;
+    }
+    Mapping* manifest = manifests->createMapping(info->pathString);
+    manifest->write("modifiedTime", modifiedTime);
+    manifest->write("name", info->name);
+    if(!info->requisites.empty()){
+        Listing* requisites = manifest->createListing("requisites");
+        for(auto& name : info->requisites){
+            requisites->append(name);
+        }
+    }
+    if(!info->oldNames.empty()){
+        Listing* oldNames = manifest->createListing("oldNames");
+        for(auto& name : info->oldNames){
+            oldNames->append(name);
+        }
+    }
+    manifest->write("hasSubsequences", !info->subsequences.empty());
+}
+
+
+/**
+   The loading is deferred only when the manifest recorded in the previous run is still valid.
+   The plugins which have the subsequent plugins are always loaded because their loading order
+   matters.
+*/
+bool PluginManagerImpl::deferLoadingWithManifest(PluginInfoPtr info)
+{
+    Mapping* manifest = manifests->findMapping(info->pathString);
+    if(!manifest->isValid()){
+        return false;
+    }
+    string name;
+    if(!manifest->read("name", name) ||
+       manifest->get("modifiedTime", "") != getModifiedTimeString(info->pathString) ||
+       manifest->get("hasSubsequences", true) ||
+       nameToPluginInfoMap.find(name) != nameToPluginInfoMap.end()){
+        return false;
+    }
+
+    info->name = name;
+    info->requisites.clear();
+    Listing* requisites = manifest->findListing("requisites");
+    for(int i=0; i < requisites->size(); ++i){
+        info->requisites.push_back(requisites->at(i)->toString());
+    }
+    info->oldNames.clear();
+    Listing* oldNames = manifest->findListing("oldNames");
+    for(int i=0; i < oldNames->size(); ++i){
+        info->oldNames.push_back(oldNames->at(i)->toString());
+    }
+    info->isLoadingDeferred = true;
+    nameToPluginInfoMap.insert(make_pair(name, info));
+    registerOldNames(info.get());
+
+    return true;
+}
+
+
+bool PluginManager::loadDeferredPlugin(const std::string& name)
+{
+    auto p = impl->nameToPluginInfoMap.find(name);
+    if(p != impl->nameToPluginInfoMap.end()){
+        auto& info = p->second;
+        if(info->isLoadingDeferred){
+            impl->loadDeferredPlugin(info);
+        }
+        return (info->status == PluginManager::ACTIVE);
+    }
+    return false;
+}
+
+
+bool PluginManagerImpl::loadDeferredPlugin(PluginInfoPtr info)
+{
+    info->isLoadingDeferred = false;
+
+    for(auto& requisiteName : info->requisites){
+        auto p = nameToPluginInfoMap.find(requisiteName);
+        if(p != nameToPluginInfoMap.end() && p->second->isLoadingDeferred){
+            loadDeferredPlugin(p->second);
+        }
+    }
+
+    auto it = std::find(allPluginInfos.begin(), allPluginInfos.end(), info);
+    if(it == allPluginInfos.end()){
+        return false;
+    }
+    int index = it - allPluginInfos.begin();
+
+    // The information from the manifest is replaced with that of the actual plugin object
+    nameToPluginInfoMap.erase(info->name);
+    info->requisites.clear();
+    info->oldNames.clear();
+    
+    bool activated = false;
+    if(loadPlugin(index)){
+        activated = activatePlugin(index);
+    } else {
+        manifests->remove(info->pathString);
+    }
+    return activated;
+}
+
+
+void PluginManager::loadDeferredPlugins()
+{
+    impl->loadDeferredPlugins();
+}
+
+
+void PluginManagerImpl::loadDeferredPlugins()
+{
+    for(size_t i=0; i < allPluginInfos.size(); ++i){
+        auto info = allPluginInfos[i];
+        if(info->isLoadingDeferred){
+            loadDeferredPlugin(info);
+        }
+    }
+}
+
+
+bool PluginManager::hasDeferredPlugins() const
+{
+    for(auto& info : impl->allPluginInfos){
+        if(info->isLoadingDeferred){
+            return true;
+        }
+    }
+    return false;
+}
+
+
 void PluginManagerImpl::onLoadPluginTriggered()
 {
     QFileDialog dialog(MainWindow::instance());
@@ -719,7 +927,11 @@ const char* PluginManagerImpl::guessActualPluginName(const std::string& name)
 {
     PluginMap::iterator p = nameToPluginInfoMap.find(name);
     if(p != nameToPluginInfoMap.end()){
-        return p->second->name.c_str();
+        PluginInfoPtr info = p->second;
+        if(info->isLoadingDeferred && !loadDeferredPlugin(info)){
+            return 0;
+        }
+        return info->name.c_str();
     }
 
     MultiNameMap::iterator q, upper_bound;
@@ -729,7 +941,11 @@ const char* PluginManagerImpl::guessActualPluginName(const std::string& name)
         const string& candidate = q->second;
         PluginMap::iterator r = nameToPluginInfoMap.find(candidate);
         if(r != nameToPluginInfoMap.end()){
-            return r->second->name.c_str();
+            PluginInfoPtr info = r->second;
+            if(info->isLoadingDeferred && !loadDeferredPlugin(info)){
+                return 0;
+            }
+            return info->name.c_str();
         }
     }
 
@@ -47,7 +47,21 @@ public:
     bool unloadPlugin(const std::string& name);
     bool reloadPlugin(const std::string& name);
 
+    /**
+       This function also loads and activates the plugin of the name when its loading
+       has been deferred by the on-demand plugin loading.
+    */
     const char* guessActualPluginName(const std::string& name);
+
+    /**
+       When the on-demand plugin loading is enabled, the plugin files whose manifests have been
+       recorded in the previous runs are not loaded at the startup. Each of them is loaded when
+       a project or another plugin requires it, or when this function is called.
+       \return true if the plugin is active
+    */
+    bool loadDeferredPlugin(const std::string& name);
+    void loadDeferredPlugins();
+    bool hasDeferredPlugins() const;
 	
 private:
     PluginManager(ExtensionManager* ext);
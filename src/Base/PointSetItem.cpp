@@ -18,7 +18,10 @@
 #include <cnoid/Exception>
 #include <cnoid/FileUtil>
 #include <cnoid/PolyhedralRegion>
-#include <boost/dynamic_bitset.hpp>
+#include <cnoid/MemoryUsage>
+#include <cnoid/ThreadPool>
+#include <queue>
+#include <mutex>
 #include "gettext.h"
 
 using namespace std;
@@ -26,6 +29,148 @@ using namespace cnoid;
 
 namespace {
 
+const int MaxNumOctreeNodePoints = 20000;
+const int MaxOctreeDepth = 20;
+const double MinOctreeNodePixelSize = 50.0;
+const int MaxNumGridCellsAlongAxis = 128;
+const double AttentionPointSnapDistance = 0.02;
+
+/**
+   This node renders a large point set with level of detail.
+   The points are stored in an octree where each node has a sparse subset of the points in its
+   region and the descendant nodes add the remaining points. The nodes are rendered in order of
+   their sizes on the screen until the point budget is used up.
+   \note The point sets of the octree nodes are the children of this node so that the bounding box
+   and the other operations on the group work as usual.
+*/
+class SgPointSetLODGroup : public SgGroup
+{
+    struct OctreeNode {
+        Vector3f center;
+        float halfSize;
+        int pointSetIndex;
+        int children[8];
+    };
+    vector<OctreeNode> nodes;
+    int pointBudget;
+
+    // Used in building the octree
+    const SgVertexArray* orgVertices;
+    const SgColorArray* orgColors;
+    const SgIndexArray* orgColorIndices;
+    vector<int> nodePointIndices;
+    double pointSize;
+    
+public:
+    SgPointSetLODGroup()
+        : SgGroup(findPolymorphicId<SgPointSetLODGroup>()) {
+        pointBudget = 0;
+    }
+
+    SgPointSetLODGroup(const SgPointSetLODGroup& org, SgCloneMap& cloneMap)
+        : SgGroup(org, cloneMap) {
+        nodes = org.nodes;
+        pointBudget = org.pointBudget;
+    }
+
+    virtual SgObject* clone(SgCloneMap& cloneMap) const override {
+        return new SgPointSetLODGroup(*this, cloneMap);
+    }
+
+    virtual void countOwnMemoryUsage(MemoryUsageCounter& counter) const override {
+        SgGroup::countOwnMemoryUsage(counter);
+        counter.add(nodes.capacity() * sizeof(OctreeNode) + nodePointIndices.capacity() * sizeof(int));
+    }
+
+    void setPointBudget(int n) {
+        pointBudget = n;
+    }
+
+    void setPointSize(double size) {
+        for(auto& node : nodes){
+            static_cast<SgPointSet*>(child(node.pointSetIndex))->setPointSize(size);
+        }
+    }
+
+    void build(SgPointSet* pointSet, double pointSize);
+    int buildNode(int* begin, int* end, const Vector3f& center, float halfSize, int depth);
+    int addNodePointSet();
+    double calcNodePixelSize(const OctreeNode& node, const Affine3& V, bool isPerspective, double scale);
+    void render(SceneRenderer* renderer);
+};
+
+typedef ref_ptr<SgPointSetLODGroup> SgPointSetLODGroupPtr;
+
+
+struct NodeTypeRegistration {
+    NodeTypeRegistration() {
+        SgNode::registerType<SgPointSetLODGroup, SgGroup>();
+
+        SceneRenderer::addExtension(
+            [](SceneRenderer* renderer){
+                auto functions = renderer->renderingFunctions();
+                functions->setFunction<SgPointSetLODGroup>(
+                    [=](SgNode* node){
+                        static_cast<SgPointSetLODGroup*>(node)->render(renderer);
+                    });
+            });
+    }
+} registration;
+
+
+/**
+   This grid indexes the points for the region removal and the nearest point queries.
+   The indices of the points in each cell are stored contiguously in the order of the cells.
+   The grid is built when it is first used after the point set is updated, and it is kept
+   valid by the point removal because the removal does not change the order of the points.
+*/
+class PointSetGrid
+{
+public:
+    Vector3f origin;
+    float cellSize;
+    Vector3i dims;
+    vector<int> cellBegins;
+    vector<int> pointIndices;
+    bool isValid;
+
+    PointSetGrid() : isValid(false) { }
+
+    void invalidate() {
+        isValid = false;
+        vector<int>().swap(cellBegins);
+        vector<int>().swap(pointIndices);
+    }
+
+    int numCells() const { return cellBegins.empty() ? 0 : cellBegins.size() - 1; }
+
+    int cellIndex(const Vector3i& c) const { return (c.z() * dims.y() + c.y()) * dims.x() + c.x(); }
+
+    Vector3i cellCoordOf(const Vector3f& p) const {
+        Vector3i c;
+        for(int i=0; i < 3; ++i){
+            float x = (p[i] - origin[i]) / cellSize;
+            c[i] = (x < 0.0f) ? 0 : ((x >= dims[i]) ? (dims[i] - 1) : static_cast<int>(x));
+        }
+        return c;
+    }
+
+    Vector3f cellCenter(int index) const {
+        const int x = index % dims.x();
+        const int y = (index / dims.x()) % dims.y();
+        const int z = index / (dims.x() * dims.y());
+        return origin + cellSize * Vector3f(x + 0.5f, y + 0.5f, z + 0.5f);
+    }
+
+    size_t memoryUsage() const {
+        return (cellBegins.capacity() + pointIndices.capacity()) * sizeof(int);
+    }
+
+    void build(const SgVertexArray& points);
+    void removePoints(const vector<char>& removed);
+    int findNearestPoint(const SgVertexArray& points, const Vector3f& p, float maxDistance) const;
+};
+
 class ScenePointSet;
 
 class ScenePointSet : public SgPosTransform, public SceneWidgetEditable
@@ -36,6 +181,8 @@ public:
     weak_ref_ptr<PointSetItem> weakPointSetItem;
     SgPointSetPtr orgPointSet;
     SgPointSetPtr visiblePointSet;
+    SgPointSetLODGroupPtr lodGroup;
+    int pointBudget;
     SgUpdate update;
     SgShapePtr voxels;
     float voxelSize;
@@ -54,6 +201,7 @@ public:
 
     void setPointSize(double size);
     void setVoxelSize(double size);
+    void setPointBudget(int n);
     int numAttentionPoints() const;
     Vector3 attentionPoint(int index) const;
     void clearAttentionPoints(bool doNotify);
@@ -88,14 +236,16 @@ public:
     ScenePointSetPtr scene;
     ScopedConnection pointSetUpdateConnection;
     Signal<void(const PolyhedralRegion& region)> sigPointsInRegionRemoved;
+    PointSetGrid grid;
+    bool isGridKeptOnUpdate;
 
     PointSetItemImpl(PointSetItem* self);
     PointSetItemImpl(PointSetItem* self, const PointSetItemImpl& org);
+    void onPointSetUpdated();
     void setRenderingMode(int mode);
     bool onEditableChanged(bool on);
+    int findNearestPoint(const Vector3& p, double maxDistance);
     void removePoints(const PolyhedralRegion& region);
-    template<class ElementContainer>
-    void removeSubElements(ElementContainer& elements, SgIndexArray& indices, const vector<int>& indicesToRemove);
     bool onRenderingModePropertyChanged(int mode);
     bool onTranslationPropertyChanged(const std::string& value);
     bool onRotationPropertyChanged(const std::string& value);
@@ -104,10 +254,82 @@ public:
 }
 
 
+namespace {
+
+/**
+   The point set loaded by a restore prefetch task. It is owned by the task so that it is released
+   when the restoration of the project is finished even if the item is not restored.
+*/
+struct PrefetchedPointSet
+{
+    SgPointSetPtr pointSet;
+};
+
+map<string, weak_ptr<PrefetchedPointSet>> prefetchedPointSets;
+mutex prefetchedPointSetMutex;
+
+std::function<void()> prefetchPCD(const Archive& archive)
+{
+    string filename, formatId;
+    if(!(archive.readRelocatablePath("file", filename) && archive.read("format", formatId) &&
+         formatId == "PCD-FILE")){
+        return nullptr;
+    }
+    auto prefetched = make_shared<PrefetchedPointSet>();
+    {
+        lock_guard<mutex> lock(prefetchedPointSetMutex);
+        auto p = prefetchedPointSets.begin();
+        while(p != prefetchedPointSets.end()){
+            if(p->second.expired()){
+                p = prefetchedPointSets.erase(p);
+            } else {
+                ++p;
+            }
+        }
+        prefetchedPointSets[getAbsolutePathString(filename)] = prefetched;
+    }
+    return [prefetched, filename](){
+        SgPointSetPtr pointSet = new SgPointSet;
+        try {
+            cnoid::loadPCD(pointSet, filename);
+            prefetched->pointSet = pointSet;
+        } catch (boost::exception&) {
+            // The error is reported when the file is loaded again by the item
+        }
+    };
+}
+
+SgPointSetPtr takePrefetchedPointSet(const std::string& filename)
+{
+    SgPointSetPtr pointSet;
+    lock_guard<mutex> lock(prefetchedPointSetMutex);
+    auto p = prefetchedPointSets.find(getAbsolutePathString(filename));
+    if(p != prefetchedPointSets.end()){
+        if(auto prefetched = p->second.lock()){
+            pointSet = prefetched->pointSet;
+            prefetched->pointSet.reset();
+        }
+        prefetchedPointSets.erase(p);
+    }
+    return pointSet;
+}
+
+}
+
+
 static bool loadPCD(PointSetItem* item, const std::string& filename, std::ostream& os)
 {
     try {
-        cnoid::loadPCD(item->pointSet(), filename);
+        if(auto prefetched = takePrefetchedPointSet(filename)){
+            SgPointSet* pointSet = item->pointSet();
+            pointSet->setVertices(prefetched->vertices());
+            pointSet->setNormals(prefetched->normals());
+            pointSet->normalIndices().clear();
+            pointSet->setColors(prefetched->colors());
+            pointSet->colorIndices().clear();
+        } else {
+            cnoid::loadPCD(item->pointSet(), filename);
+        }
         os << item->pointSet()->vertices()->size() << " points have been loaded.";
         item->pointSet()->notifyUpdate();
         return true;
@@ -146,6 +368,7 @@ void PointSetItem::initializeClass(ExtensionManager* ext)
             [](PointSetItem* item, const std::string& filename, std::ostream& os, Item*){ return ::loadPCD(item, filename, os); },
             [](PointSetItem* item, const std::string& filename, std::ostream& os, Item*){ return ::saveAsPCD(item, filename, os); },
             ItemManager::PRIORITY_CONVERSION);
+        im.addRestorePrefetcher<PointSetItem>(prefetchPCD);
         
         initialized = true;
     }
@@ -164,6 +387,7 @@ PointSetItemImpl::PointSetItemImpl(PointSetItem* self)
 {
     pointSet = new SgPointSet;
     scene = new ScenePointSet(this);
+    isGridKeptOnUpdate = false;
 }
 
 
@@ -181,13 +405,23 @@ PointSetItemImpl::PointSetItemImpl(PointSetItem* self, const PointSetItemImpl& o
     pointSet = new SgPointSet(*org.pointSet);
     scene = new ScenePointSet(this);
     scene->T() = org.scene->T();
+    isGridKeptOnUpdate = false;
 }
 
 
 void PointSetItem::initialize()
 {
     impl->pointSetUpdateConnection.reset(
-        impl->pointSet->sigUpdated().connect([&](const SgUpdate&){ notifyUpdate(); }));
+        impl->pointSet->sigUpdated().connect([&](const SgUpdate&){ impl->onPointSetUpdated(); }));
+}
+
+
+void PointSetItemImpl::onPointSetUpdated()
+{
+    if(!isGridKeptOnUpdate){
+        grid.invalidate();
+    }
+    self->notifyUpdate();
 }
 
 
@@ -224,6 +458,27 @@ void PointSetItem::notifyUpdate()
 }
 
 
+void PointSetItem::countMemoryUsage(MemoryUsageCounter& counter)
+{
+    Item::countMemoryUsage(counter);
+    impl->pointSet->countMemoryUsage(counter);
+
+    // The point sets for the level of detail and the voxels are kept while they are not shown
+    auto scene = impl->scene;
+    scene->countMemoryUsage(counter);
+    if(scene->visiblePointSet){
+        scene->visiblePointSet->countMemoryUsage(counter);
+    }
+    if(scene->lodGroup){
+        scene->lodGroup->countMemoryUsage(counter);
+    }
+    if(scene->voxels){
+        scene->voxels->countMemoryUsage(counter);
+    }
+    counter.add(impl->grid.memoryUsage());
+}
+
+
 const SgPointSet* PointSetItem::pointSet() const
 {
     return impl->pointSet;
@@ -322,6 +577,18 @@ void PointSetItem::setVoxelSize(double size)
 }
 
 
+int PointSetItem::pointBudget() const
+{
+    return impl->scene->pointBudget;
+}
+
+
+void PointSetItem::setPointBudget(int n)
+{
+    impl->scene->setPointBudget(n);
+}
+
+
 void PointSetItem::setEditable(bool on)
 {
     impl->scene->setEditable(on);
@@ -416,98 +683,310 @@ void PointSetItem::removePoints(const PolyhedralRegion& region)
 }
 
 
-void PointSetItemImpl::removePoints(const PolyhedralRegion& region)
+void PointSetGrid::build(const SgVertexArray& points)
 {
-    vector<int> indicesToRemove;
-    const Affine3 T = scene->T();
-    SgVertexArray orgPoints(*pointSet->vertices());
-    const int numOrgPoints = orgPoints.size();
+    const int numPoints = points.size();
+    auto threadPool = ThreadPool::instance();
+
+    // The points which have non-finite coordinates are not registered in any cell
+    typedef std::pair<Vector3f, Vector3f> Range;
+    const Range emptyRange(
+        Vector3f::Constant(std::numeric_limits<float>::max()),
+        Vector3f::Constant(-std::numeric_limits<float>::max()));
+    const Range range = threadPool->parallelReduce(
+        0, numPoints, emptyRange,
+        [&](int i){
+            return points[i].allFinite() ? Range(points[i], points[i]) : emptyRange;
+        },
+        [](const Range& r1, const Range& r2){
+            return Range(r1.first.cwiseMin(r2.first), r1.second.cwiseMax(r2.second));
+        },
+        65536);
 
-    for(int i=0; i < numOrgPoints; ++i){
-        if(region.checkInside(T * orgPoints[i].cast<Vector3::Scalar>())){
-            indicesToRemove.push_back(i);
+    isValid = true;
+    pointIndices.clear();
+    
+    if(range.first.x() > range.second.x()){
+        dims.setZero();
+        cellBegins.assign(1, 0);
+        return;
+    }
+
+    const Vector3f size = range.second - range.first;
+    const float maxExtent = size.maxCoeff();
+    origin = range.first;
+    cellSize = (maxExtent > 0.0f) ? (maxExtent / MaxNumGridCellsAlongAxis) : 1.0f;
+    for(int i=0; i < 3; ++i){
+        dims[i] = std::max(1, std::min(MaxNumGridCellsAlongAxis, static_cast<int>(std::ceil(size[i] / cellSize))));
+    }
+
+    vector<int> pointCells(numPoints);
+    threadPool->parallelFor(
+        0, numPoints,
+        [&](int i){
+            pointCells[i] = points[i].allFinite() ? cellIndex(cellCoordOf(points[i])) : -1;
+        },
+        65536);
+
+    // Counting sort of the point indices by the cells
+    cellBegins.assign(dims.prod() + 1, 0);
+    int numRegisteredPoints = 0;
+    for(int i=0; i < numPoints; ++i){
+        const int cell = pointCells[i];
+        if(cell >= 0){
+            ++cellBegins[cell + 1];
+            ++numRegisteredPoints;
+        }
+    }
+    for(size_t i=1; i < cellBegins.size(); ++i){
+        cellBegins[i] += cellBegins[i - 1];
+    }
+    vector<int> positions(cellBegins.begin(), cellBegins.end() - 1);
+    pointIndices.resize(numRegisteredPoints);
+    for(int i=0; i < numPoints; ++i){
+        const int cell = pointCells[i];
+        if(cell >= 0){
+            pointIndices[positions[cell]++] = i;
         }
     }
+}
 
-    if(!indicesToRemove.empty()){
-        SgVertexArray& points = *pointSet->vertices();
-        points.clear();
-        int j = 0;
-        int nextIndexToRemove = indicesToRemove[j++];
-        for(int i=0; i < numOrgPoints; ++i){
-            if(i == nextIndexToRemove){
-                if(j < static_cast<int>(indicesToRemove.size())){
-                    nextIndexToRemove = indicesToRemove[j++];
-                }
-            } else {
-                points.push_back(orgPoints[i]);
-                
+
+/**
+   Removes the points flagged in the removed array from the cells and renumbers the remaining
+   points in the same way as the compaction of the point set.
+*/
+void PointSetGrid::removePoints(const vector<char>& removed)
+{
+    const int numPoints = removed.size();
+    vector<int> newIndices(numPoints);
+    int newIndex = 0;
+    for(int i=0; i < numPoints; ++i){
+        newIndices[i] = removed[i] ? -1 : newIndex++;
+    }
+    const int n = numCells();
+    int orgBegin = 0;
+    int j = 0;
+    for(int cell=0; cell < n; ++cell){
+        const int orgEnd = cellBegins[cell + 1];
+        cellBegins[cell] = j;
+        for(int k = orgBegin; k < orgEnd; ++k){
+            const int index = newIndices[pointIndices[k]];
+            if(index >= 0){
+                pointIndices[j++] = index;
             }
         }
-        if(pointSet->hasNormals()){
-            removeSubElements(*pointSet->normals(), pointSet->normalIndices(), indicesToRemove);
-        }
-        if(pointSet->hasColors()){
-            removeSubElements(*pointSet->colors(), pointSet->colorIndices(), indicesToRemove);
+        orgBegin = orgEnd;
+    }
+    if(n > 0){
+        cellBegins[n] = j;
+    }
+    pointIndices.resize(j);
+}
+
+
+int PointSetGrid::findNearestPoint(const SgVertexArray& points, const Vector3f& p, float maxDistance) const
+{
+    int nearest = -1;
+    if(numCells() == 0 || !p.allFinite()){
+        return nearest;
+    }
+    float minSquaredDistance = maxDistance * maxDistance;
+    const Vector3i lower = cellCoordOf(p - Vector3f::Constant(maxDistance));
+    const Vector3i upper = cellCoordOf(p + Vector3f::Constant(maxDistance));
+    Vector3i c;
+    for(c.z() = lower.z(); c.z() <= upper.z(); ++c.z()){
+        for(c.y() = lower.y(); c.y() <= upper.y(); ++c.y()){
+            for(c.x() = lower.x(); c.x() <= upper.x(); ++c.x()){
+                const int cell = cellIndex(c);
+                const int end = cellBegins[cell + 1];
+                for(int k = cellBegins[cell]; k < end; ++k){
+                    const int index = pointIndices[k];
+                    const float d = (points[index] - p).squaredNorm();
+                    if(d <= minSquaredDistance){
+                        minSquaredDistance = d;
+                        nearest = index;
+                    }
+                }
+            }
         }
+    }
+    return nearest;
+}
 
-        pointSet->notifyUpdate();
+
+int PointSetItem::findNearestPoint(const Vector3& p, double maxDistance) const
+{
+    return impl->findNearestPoint(p, maxDistance);
+}
+
+
+int PointSetItemImpl::findNearestPoint(const Vector3& p, double maxDistance)
+{
+    const SgVertexArray* points = pointSet->vertices();
+    if(!points){
+        return -1;
     }
+    if(!grid.isValid){
+        grid.build(*points);
+    }
+    const Vector3f localPoint = (scene->T().inverse() * p).cast<float>();
+    return grid.findNearestPoint(*points, localPoint, maxDistance);
+}
 
-    sigPointsInRegionRemoved(region);
+
+namespace {
+
+template<class Array>
+void compactArray(Array& array, const vector<char>& removed)
+{
+    const int n = removed.size();
+    int j = 0;
+    for(int i=0; i < n; ++i){
+        if(!removed[i]){
+            if(j != i){
+                array[j] = array[i];
+            }
+            ++j;
+        }
+    }
+    array.resize(j);
 }
 
 
 template<class ElementContainer>
-void PointSetItemImpl::removeSubElements(ElementContainer& elements, SgIndexArray& indices, const vector<int>& indicesToRemove)
+void compactSubElements(ElementContainer& elements, SgIndexArray& indices, const vector<char>& removed)
 {
-    const ElementContainer orgElements(elements);
-    const int numOrgElements = orgElements.size();
-    elements.clear();
-    
     if(indices.empty()){
-        int j = 0;
-        int nextIndexToRemove = indicesToRemove[j++];
-        for(int i=0; i < numOrgElements; ++i){
-            if(i == nextIndexToRemove){
-                if(j < static_cast<int>(indicesToRemove.size())){
-                    nextIndexToRemove = indicesToRemove[j++];
+        if(elements.size() == removed.size()){
+            compactArray(elements, removed);
+        }
+    } else if(indices.size() == removed.size()){
+        compactArray(indices, removed);
+
+        // The elements which are not referred to by the remaining indices are removed
+        const int numElements = elements.size();
+        vector<int> indexMap(numElements, -1);
+        for(auto& index : indices){
+            indexMap[index] = 0;
+        }
+        int newIndex = 0;
+        for(int i=0; i < numElements; ++i){
+            if(indexMap[i] >= 0){
+                if(newIndex != i){
+                    elements[newIndex] = elements[i];
                 }
-            } else {
-                elements.push_back(orgElements[i]);
+                indexMap[i] = newIndex++;
             }
         }
-    } else {
-        const SgIndexArray orgIndices(indices);
-        const int numOrgIndices = orgIndices.size();
-        indices.clear();
-        boost::dynamic_bitset<> elementValidness(numOrgElements);
-        int j = 0;
-        int nextIndexToRemove = indicesToRemove[j++];
-        for(int i=0; i < numOrgIndices; ++i){
-            if(i == nextIndexToRemove){
-                if(j < static_cast<int>(indicesToRemove.size())){
-                    nextIndexToRemove = indicesToRemove[j++];
+        elements.resize(newIndex);
+        for(auto& index : indices){
+            index = indexMap[index];
+        }
+    }
+}
+
+}
+
+
+/**
+   The planes of the region are transformed into the local coordinate of the point set, and the
+   cells of the grid are classified by them. Only the points in the cells crossing the boundary of
+   the region are tested one by one.
+*/
+void PointSetItemImpl::removePoints(const PolyhedralRegion& region)
+{
+    SgVertexArray* vertices = pointSet->vertices();
+    if(!vertices || vertices->empty()){
+        sigPointsInRegionRemoved(region);
+        return;
+    }
+    SgVertexArray& points = *vertices;
+    if(!grid.isValid){
+        grid.build(points);
+    }
+
+    struct LocalPlane {
+        Vector3 normal;
+        double d;
+        double cellRadius;
+    };
+    const Affine3 T = scene->T();
+    const double halfCellSize = grid.cellSize / 2.0;
+    const int numPlanes = region.numBoundingPlanes();
+    vector<LocalPlane> planes(numPlanes);
+    for(int i=0; i < numPlanes; ++i){
+        auto& plane = region.plane(i);
+        auto& localPlane = planes[i];
+        localPlane.normal = T.linear().transpose() * plane.normal;
+        localPlane.d = plane.d - plane.normal.dot(T.translation());
+        localPlane.cellRadius = halfCellSize * localPlane.normal.cwiseAbs().sum();
+    }
+
+    vector<char> removed(points.size(), 0);
+
+    const int numRemovedPoints = ThreadPool::instance()->parallelReduce(
+        0, grid.numCells(), 0,
+        [&](int cell){
+            const int begin = grid.cellBegins[cell];
+            const int end = grid.cellBegins[cell + 1];
+            if(begin == end){
+                return 0;
+            }
+            const Vector3 center = grid.cellCenter(cell).cast<double>();
+            bool isCellInside = true;
+            for(auto& plane : planes){
+                const double distance = center.dot(plane.normal) - plane.d;
+                if(distance + plane.cellRadius < 0.0){
+                    return 0;
+                }
+                if(distance - plane.cellRadius < 0.0){
+                    isCellInside = false;
                 }
-            } else {
-                int index = orgIndices[i];
-                elementValidness.set(index);
-                indices.push_back(index);
             }
-        }
-        vector<int> indexMap(numOrgElements);
-        int newIndex = 0;
-        for(int i=0; i < numOrgElements; ++i){
-            if(elementValidness.test(i)){
-                elements.push_back(orgElements[i]);
-                ++newIndex;
+            if(isCellInside){
+                for(int k = begin; k < end; ++k){
+                    removed[grid.pointIndices[k]] = 1;
+                }
+                return end - begin;
             }
-            indexMap[i] = newIndex;
+            int numRemoved = 0;
+            for(int k = begin; k < end; ++k){
+                const int index = grid.pointIndices[k];
+                const Vector3 p = points[index].cast<double>();
+                bool isInside = true;
+                for(auto& plane : planes){
+                    if(p.dot(plane.normal) - plane.d < 0.0){
+                        isInside = false;
+                        break;
+                    }
+                }
+                if(isInside){
+                    removed[index] = 1;
+                    ++numRemoved;
+                }
+            }
+            return numRemoved;
+        },
+        [](int n1, int n2){ return n1 + n2; },
+        256);
+
+    if(numRemovedPoints > 0){
+        if(pointSet->hasNormals()){
+            compactSubElements(*pointSet->normals(), pointSet->normalIndices(), removed);
         }
-        for(size_t i=0; i < indices.size(); ++i){
-            indices[i] = indexMap[i];
+        if(pointSet->hasColors()){
+            compactSubElements(*pointSet->colors(), pointSet->colorIndices(), removed);
         }
+        compactArray(points, removed);
+        grid.removePoints(removed);
+
+        isGridKeptOnUpdate = true;
+        pointSet->notifyUpdate();
+        isGridKeptOnUpdate = false;
     }
+
+    sigPointsInRegionRemoved(region);
 }
 
 
@@ -521,6 +1000,8 @@ void PointSetItem::doPutProperties(PutPropertyFunction& putProperty)
                                      [=](double size){ scene->setPointSize(size); return true; });
     putProperty.decimals(4)(_("Voxel size"), voxelSize(),
                             [=](double size){ scene->setVoxelSize(size); return true; });
+    putProperty.min(0)(_("Point budget"), pointBudget(),
+                       [=](int n){ scene->setPointBudget(n); return true; });
     putProperty(_("Editable"), isEditable(), [&](bool on){ return impl->onEditableChanged(on); });
     const SgVertexArray* points = impl->pointSet->vertices();
     putProperty(_("Num points"), static_cast<int>(points ? points->size() : 0));
@@ -577,6 +1058,7 @@ bool PointSetItem::store(Archive& archive)
     archive.write("renderingMode", scene->renderingMode.selectedSymbol());
     archive.write("pointSize", pointSize());
     archive.write("voxelSize", scene->voxelSize);
+    archive.write("pointBudget", scene->pointBudget);
     archive.write("isEditable", isEditable());
     return true;
 }
@@ -591,6 +1073,7 @@ bool PointSetItem::restore(const Archive& archive)
     }
     scene->setPointSize(archive.get("pointSize", pointSize()));
     scene->setVoxelSize(archive.get("voxelSize", voxelSize()));
+    scene->setPointBudget(archive.get("pointBudget", pointBudget()));
     setEditable(archive.get("isEditable", isEditable()));
     
     std::string filename, formatId;
@@ -611,6 +1094,7 @@ ScenePointSet::ScenePointSet(PointSetItemImpl* pointSetItemImpl)
     voxels = new SgShape;
     voxels->getOrCreateMaterial();
     voxelSize = 0.01f;
+    pointBudget = 2000000;
 
     renderingMode.setSymbol(PointSetItem::POINT, N_("Point"));
     renderingMode.setSymbol(PointSetItem::VOXEL, N_("Voxel"));
@@ -631,6 +1115,9 @@ void ScenePointSet::setPointSize(double size)
 {
     if(size != visiblePointSet->pointSize()){
         visiblePointSet->setPointSize(size);
+        if(lodGroup){
+            lodGroup->setPointSize(size);
+        }
         if(renderingMode.is(PointSetItem::POINT) && invariant){
             updateVisualization(false);
         }
@@ -648,6 +1135,17 @@ void ScenePointSet::setVoxelSize(double size)
 }
 
 
+void ScenePointSet::setPointBudget(int n)
+{
+    if(n != pointBudget){
+        pointBudget = n;
+        if(renderingMode.is(PointSetItem::POINT) && invariant){
+            updateVisualization(true);
+        }
+    }
+}
+
+
 int ScenePointSet::numAttentionPoints() const
 {
     return attentionPointMarkerGroup ? attentionPointMarkerGroup->numChildren() : 0;
@@ -708,10 +1206,11 @@ bool ScenePointSet::removeAttentionPoint(const Vector3& point, double distanceTh
 {
     bool removed = false;
     if(attentionPointMarkerGroup){
+        const Vector3 localPoint = T().inverse() * point;
         SgGroup::iterator iter = attentionPointMarkerGroup->begin();
         while(iter != attentionPointMarkerGroup->end()){
             CrossMarker* marker = dynamic_cast<CrossMarker*>(iter->get());
-            if(point.isApprox(marker->translation(), distanceThresh)){
+            if((marker->translation() - localPoint).norm() <= distanceThresh){
                 iter = attentionPointMarkerGroup->erase(iter);
                 removed = true;
             } else {
@@ -743,6 +1242,9 @@ void ScenePointSet::updateVisualization(bool updateContents)
         removeChild(invariant);
         invariant->removeChild(visiblePointSet);
         invariant->removeChild(voxels);
+        if(lodGroup){
+            invariant->removeChild(lodGroup);
+        }
     }
     invariant = new SgInvariantGroup;
     
@@ -750,7 +1252,11 @@ void ScenePointSet::updateVisualization(bool updateContents)
         if(updateContents){
             updateVisiblePointSet();
         }
-        invariant->addChild(visiblePointSet);
+        if(lodGroup){
+            invariant->addChild(lodGroup);
+        } else {
+            invariant->addChild(visiblePointSet);
+        }
     } else {
         if(updateContents){
             updateVoxels();
@@ -765,6 +1271,18 @@ void ScenePointSet::updateVisualization(bool updateContents)
 
 void ScenePointSet::updateVisiblePointSet()
 {
+    // The points exceeding the budget are rendered with the level of detail
+    const SgVertexArray* points = orgPointSet->vertices();
+    if(pointBudget > 0 && points && static_cast<int>(points->size()) > pointBudget){
+        lodGroup = new SgPointSetLODGroup;
+        lodGroup->setPointBudget(pointBudget);
+        lodGroup->build(orgPointSet, visiblePointSet->pointSize());
+        visiblePointSet->setVertices(nullptr);
+        visiblePointSet->setColors(nullptr);
+        return;
+    }
+    lodGroup.reset();
+    
     visiblePointSet->setVertices(orgPointSet->vertices());
     visiblePointSet->setNormals(orgPointSet->normals());
     visiblePointSet->normalIndices() = orgPointSet->normalIndices();
@@ -861,6 +1379,192 @@ void ScenePointSet::updateVoxels()
 }
 
 
+void SgPointSetLODGroup::build(SgPointSet* pointSet, double pointSize)
+{
+    clearChildren();
+    nodes.clear();
+
+    orgVertices = pointSet->vertices();
+    orgColors = pointSet->hasColors() ? pointSet->colors() : nullptr;
+    orgColorIndices = &pointSet->colorIndices();
+    this->pointSize = pointSize;
+
+    const int n = orgVertices->size();
+    Vector3f pmin = (*orgVertices)[0];
+    Vector3f pmax = pmin;
+    for(int i=1; i < n; ++i){
+        pmin = pmin.cwiseMin((*orgVertices)[i]);
+        pmax = pmax.cwiseMax((*orgVertices)[i]);
+    }
+    const Vector3f center = (pmin + pmax) / 2.0f;
+    // The margin makes the points on the upper bounds inside the root cube
+    const float halfSize = 0.5001f * (pmax - pmin).maxCoeff() + 1.0e-6f;
+
+    vector<int> indices(n);
+    for(int i=0; i < n; ++i){
+        indices[i] = i;
+    }
+    buildNode(indices.data(), indices.data() + n, center, halfSize, 0);
+
+    orgVertices = nullptr;
+    orgColors = nullptr;
+    orgColorIndices = nullptr;
+    nodePointIndices.clear();
+    nodePointIndices.shrink_to_fit();
+}
+
+
+/**
+   \return the index of the node
+*/
+int SgPointSetLODGroup::buildNode(int* begin, int* end, const Vector3f& center, float halfSize, int depth)
+{
+    const int nodeIndex = nodes.size();
+    nodes.emplace_back();
+    nodes[nodeIndex].center = center;
+    nodes[nodeIndex].halfSize = halfSize;
+    std::fill(nodes[nodeIndex].children, nodes[nodeIndex].children + 8, -1);
+
+    const int n = end - begin;
+    if(n <= MaxNumOctreeNodePoints || depth >= MaxOctreeDepth){
+        nodePointIndices.assign(begin, end);
+        nodes[nodeIndex].pointSetIndex = addNodePointSet();
+        return nodeIndex;
+    }
+
+    // Split the points into the octants. The bits 2, 1 and 0 of the octant index correspond to x, y and z.
+    const auto& points = *orgVertices;
+    int* bounds[9];
+    bounds[0] = begin;
+    bounds[8] = end;
+    bounds[4] = std::partition(begin, end, [&](int i){ return points[i].x() < center.x(); });
+    for(int j=0; j < 8; j += 4){
+        bounds[j + 2] = std::partition(
+            bounds[j], bounds[j + 4], [&](int i){ return points[i].y() < center.y(); });
+    }
+    for(int j=0; j < 8; j += 2){
+        bounds[j + 1] = std::partition(
+            bounds[j], bounds[j + 2], [&](int i){ return points[i].z() < center.z(); });
+    }
+
+    // Every stride-th point of each octant is stored in this node and the rest go to the child
+    const int stride = (n + MaxNumOctreeNodePoints - 1) / MaxNumOctreeNodePoints;
+    int* childBegins[8];
+    nodePointIndices.clear();
+    for(int j=0; j < 8; ++j){
+        int* p = bounds[j];
+        for(int* q = bounds[j]; q < bounds[j + 1]; q += stride){
+            std::swap(*p++, *q);
+        }
+        nodePointIndices.insert(nodePointIndices.end(), bounds[j], p);
+        childBegins[j] = p;
+    }
+    nodes[nodeIndex].pointSetIndex = addNodePointSet();
+
+    const float h = halfSize / 2.0f;
+    for(int j=0; j < 8; ++j){
+        if(childBegins[j] < bounds[j + 1]){
+            Vector3f c(center.x() + ((j & 4) ? h : -h),
+                       center.y() + ((j & 2) ? h : -h),
+                       center.z() + ((j & 1) ? h : -h));
+            const int childIndex = buildNode(childBegins[j], bounds[j + 1], c, h, depth + 1);
+            nodes[nodeIndex].children[j] = childIndex;
+        }
+    }
+
+    return nodeIndex;
+}
+
+
+int SgPointSetLODGroup::addNodePointSet()
+{
+    auto pointSet = new SgPointSet;
+    pointSet->setPointSize(pointSize);
+    const int n = nodePointIndices.size();
+    auto& vertices = *pointSet->getOrCreateVertices();
+    vertices.resize(n);
+    for(int i=0; i < n; ++i){
+        vertices[i] = (*orgVertices)[nodePointIndices[i]];
+    }
+    if(orgColors){
+        auto& colors = *pointSet->getOrCreateColors();
+        colors.resize(n);
+        const int numColors = orgColors->size();
+        const int numColorIndices = orgColorIndices->size();
+        for(int i=0; i < n; ++i){
+            int index = nodePointIndices[i];
+            if(numColorIndices > 0){
+                index = (index < numColorIndices) ? (*orgColorIndices)[index] : -1;
+            }
+            colors[i] = (index >= 0 && index < numColors) ? (*orgColors)[index] : Vector3f::Ones();
+        }
+    }
+    addChild(pointSet);
+    return numChildren() - 1;
+}
+
+
+double SgPointSetLODGroup::calcNodePixelSize
+(const OctreeNode& node, const Affine3& V, bool isPerspective, double scale)
+{
+    const double radius = sqrt(3.0) * node.halfSize;
+    if(!isPerspective){
+        return radius * scale;
+    }
+    const Vector3 p = V * node.center.cast<double>();
+    const double distance = p.norm();
+    if(distance <= radius){
+        return std::numeric_limits<double>::max();
+    }
+    if(-p.z() < -radius){
+        return 0.0; // behind the camera
+    }
+    return radius * scale / distance;
+}
+
+
+void SgPointSetLODGroup::render(SceneRenderer* renderer)
+{
+    if(nodes.empty()){
+        return;
+    }
+    
+    const Affine3 V = renderer->currentCameraPosition().inverse(Eigen::Isometry) * renderer->currentModelTransform();
+    const Matrix4& P = renderer->projectionMatrix();
+    const bool isPerspective = (P(3, 3) == 0.0);
+    const double scale = P(1, 1) * renderer->viewport()[3] / 2.0;
+
+    std::priority_queue<std::pair<double, int>> queue;
+    queue.emplace(std::numeric_limits<double>::max(), 0);
+    int numRemainingPoints = (pointBudget > 0) ? pointBudget : std::numeric_limits<int>::max();
+
+    renderer->renderCustomGroup(
+        this,
+        [&](){
+            while(!queue.empty()){
+                const OctreeNode& node = nodes[queue.top().second];
+                queue.pop();
+                auto pointSet = static_cast<SgPointSet*>(child(node.pointSetIndex));
+                const int n = pointSet->vertices()->size();
+                if(n > numRemainingPoints && &node != &nodes.front()){
+                    break;
+                }
+                renderer->renderNode(pointSet);
+                numRemainingPoints -= n;
+                
+                for(int j=0; j < 8; ++j){
+                    if(node.children[j] >= 0){
+                        const double size = calcNodePixelSize(nodes[node.children[j]], V, isPerspective, scale);
+                        if(size >= MinOctreeNodePixelSize){
+                            queue.emplace(size, node.children[j]);
+                        }
+                    }
+                }
+            }
+        });
+}
+
+
 bool ScenePointSet::onButtonPressEvent(const SceneWidgetEvent& event)
 {
 	if(!isEditable_){
@@ -870,12 +1574,20 @@ bool ScenePointSet::onButtonPressEvent(const SceneWidgetEvent& event)
     bool processed = false;
     
     if(event.button() == Qt::LeftButton){
+        // The picked position is snapped to the nearest point of the point set
+        Vector3 point = event.point();
+        if(auto item = weakPointSetItem.lock()){
+            int index = item->findNearestPoint(point, AttentionPointSnapDistance);
+            if(index >= 0){
+                point = T() * orgPointSet->vertices()->at(index).cast<Vector3::Scalar>();
+            }
+        }
         if(event.modifiers() & Qt::ControlModifier){
-            if(!removeAttentionPoint(event.point(), 0.01, true)){
-                addAttentionPoint(event.point(), true);
+            if(!removeAttentionPoint(point, 0.01, true)){
+                addAttentionPoint(point, true);
             }
         } else {
-            setAttentionPoint(event.point(), true);
+            setAttentionPoint(point, true);
         }
         processed = true;
     }
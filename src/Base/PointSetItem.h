@@ -52,6 +52,13 @@ public:
 
     double voxelSize() const;
     void setVoxelSize(double size);
+
+    /**
+       The point set is rendered with the level of detail when it has more points than the budget,
+       which is the maximum number of the points rendered in a frame. Zero disables it.
+    */
+    int pointBudget() const;
+    void setPointBudget(int n);
     
     void setEditable(bool on);
     bool isEditable() const;
@@ -68,12 +75,19 @@ public:
     void clearAttentionPoint();  // deprecated
     void setAttentionPoint(const Vector3& p);  // deprecated
 
+    /**
+       Returns the index of the point nearest to the given position within maxDistance,
+       or -1 if there is no such point. The position is given in the world coordinate.
+    */
+    int findNearestPoint(const Vector3& p, double maxDistance) const;
+
     void removePoints(const PolyhedralRegion& region);
 
     SignalProxy<void(const PolyhedralRegion& region)> sigPointsInRegionRemoved();
 
     virtual bool store(Archive& archive);
     virtual bool restore(const Archive& archive);
+    virtual void countMemoryUsage(MemoryUsageCounter& counter);
 
 protected:
     virtual Item* doDuplicate() const;
@@ -10,6 +10,7 @@
 #include "ToolBar.h"
 #include "Archive.h"
 #include "ItemTreeArchiver.h"
+#include "PluginManager.h"
 #include "ExtensionManager.h"
 #include "OptionManager.h"
 #include "MenuManager.h"
@@ -20,11 +21,16 @@
 #include <cnoid/YAMLWriter>
 #include <cnoid/FileUtil>
 #include <cnoid/ExecutablePath>
+#include <cnoid/PhaseProfiler>
+#include <cnoid/MemoryUsage>
 #include <QFileDialog>
 #include <QCoreApplication>
 #include <boost/filesystem.hpp>
 #include <string>
 #include <vector>
+#include <sstream>
+#include <fstream>
+#include <chrono>
 #include <fmt/format.h>
 #include "gettext.h"
 
@@ -67,6 +73,9 @@ public:
         
     void onProjectOptionsParsed(boost::program_options::variables_map& v);
     void onInputFileOptionsParsed(std::vector<std::string>& inputFiles);
+    void loadProjectGivenAsOption(const string& filename);
+    void onOptionsParsedAfterProjectLoading(boost::program_options::variables_map& v);
+    bool writeProjectLoadingBenchmark(const string& filename);
     void openDialogToLoadProject();
     void openDialogToSaveProject();
 
@@ -83,6 +92,9 @@ public:
     string currentProjectName;
     string lastAccessedProjectFile;
 
+    // The loading times of the projects given as the command line options
+    vector<pair<string, double>> projectLoadingTimes;
+
     struct ArchiverInfo {
         std::function<bool(Archive&)> storeFunction;
         std::function<void(const Archive&)> restoreFunction;
@@ -166,10 +178,14 @@ ProjectManagerImpl::ProjectManagerImpl(ProjectManager* self, ExtensionManager* e
 
     OptionManager& om = ext->optionManager();
     om.addOption("project", boost::program_options::value<vector<string>>(), "load a project file");
+    om.addOption("project-loading-benchmark", boost::program_options::value<string>(),
+                 "write the loading times of the projects and the peak memory usage to a JSON file");
     om.sigInputFileOptionsParsed().connect(
         [&](std::vector<std::string>& inputFiles){ onInputFileOptionsParsed(inputFiles); });
     om.sigOptionsParsed().connect(
         [&](boost::program_options::variables_map& v){ onProjectOptionsParsed(v); });
+    om.sigOptionsParsed(1).connect(
+        [&](boost::program_options::variables_map& v){ onOptionsParsedAfterProjectLoading(v); });
 
     mainWindow = MainWindow::instance();
     mv = MessageView::instance();
@@ -215,6 +231,74 @@ bool ProjectManagerImpl::restoreObjectStates
 }
 
 
+static void collectPluginNames(const Mapping* archive, std::set<string>& names)
+{
+    string name;
+    if(archive->read("plugin", name)){
+        names.insert(name);
+    }
+    const Listing* children = archive->findListing("children");
+    for(int i=0; i < children->size(); ++i){
+        auto node = children->at(i);
+        if(node->isMapping()){
+            collectPluginNames(node->toMapping(), names);
+        }
+    }
+}
+
+
+/**
+   The plugins whose loading has been deferred are loaded before restoring anything so that
+   the project archivers of the plugins can also restore their states.
+*/
+static void loadDeferredPluginsUsedIn(Archive* archive)
+{
+    auto pluginManager = PluginManager::instance();
+    if(!pluginManager->hasDeferredPlugins()){
+        return;
+    }
+    std::set<string> names;
+    // The top level keys include the module names of the project archivers
+    for(auto& kv : *archive){
+        names.insert(kv.first);
+    }
+    Mapping* items = archive->findMapping("items");
+    if(items->isValid()){
+        collectPluginNames(items, names);
+    }
+    Listing* views = archive->findListing("views");
+    for(int i=0; i < views->size(); ++i){
+        auto node = views->at(i);
+        if(node->isMapping()){
+            collectPluginNames(node->toMapping(), names);
+        }
+    }
+    for(auto& name : names){
+        pluginManager->loadDeferredPlugin(name);
+    }
+}
+
+
+/**
+   The phases recorded after the previous report are put to the message view
+   and all the recorded phases are written to the trace file if it is specified.
+*/
+void ProjectManager::putPhaseProfilerReport()
+{
+    if(PhaseProfiler::isEnabled()){
+        std::ostringstream os;
+        if(PhaseProfiler::putReport(os)){
+            mv->put(os.str());
+            mv->flush();
+        }
+        auto& filename = PhaseProfiler::traceFilename();
+        if(!filename.empty() && !PhaseProfiler::writeTraceFile(filename)){
+            mv->putln(format(_("The trace file \"{}\" cannot be written."), filename), MessageView::WARNING);
+        }
+    }
+}
+
+
 ItemList<> ProjectManager::loadProject(const std::string& filename, Item* parentItem)
 {
     return impl->loadProject(filename, parentItem, false);
@@ -226,6 +310,8 @@ ItemList<> ProjectManagerImpl::loadProject(const std::string& filename, Item* pa
     ItemList<> loadedItems;
     
     ++projectBeingLoadedCounter;
+
+    PhaseProfiler::Scope projectScope("Project loading", filename);
     
     bool loaded = false;
     YAMLReader reader;
@@ -240,7 +326,11 @@ ItemList<> ProjectManagerImpl::loadProject(const std::string& filename, Item* pa
         int numArchivedItems = 0;
         int numRestoredItems = 0;
         
-        if(!reader.load(filename)){
+        PhaseProfiler::Scope parsingScope("Project file parsing");
+        bool isParsed = reader.load(filename);
+        parsingScope.end();
+        
+        if(!isParsed){
             mv->put(reader.errorMessage() + "\n");
 
         } else if(reader.numDocuments() == 0){
@@ -250,6 +340,8 @@ ItemList<> ProjectManagerImpl::loadProject(const std::string& filename, Item* pa
             Archive* archive = static_cast<Archive*>(reader.document()->toMapping());
             archive->initSharedInfo(filename);
 
+            loadDeferredPluginsUsedIn(archive);
+
             std::set<string> optionalPlugins;
             Listing& optionalPluginsNode = *archive->findListing("optionalPlugins");
             if(optionalPluginsNode.isValid()){
@@ -259,9 +351,11 @@ ItemList<> ProjectManagerImpl::loadProject(const std::string& filename, Item* pa
             }
 
             ViewManager::ViewStateInfo viewStateInfo;
+            PhaseProfiler::Scope viewScope("View restoration");
             if(ViewManager::restoreViews(archive, "views", viewStateInfo)){
                 loaded = true;
             }
+            viewScope.end();
 
             MainWindow* mainWindow = MainWindow::instance();
             if(isInvokingApplication){
@@ -332,7 +426,9 @@ ItemList<> ProjectManagerImpl::loadProject(const std::string& filename, Item* pa
             if(items->isValid()){
                 items->inheritSharedInfoFrom(*archive);
 
+                PhaseProfiler::Scope itemScope("Item tree restoration");
                 loadedItems = itemTreeArchiver.restore(items, parentItem, optionalPlugins);
+                itemScope.end();
                 
                 numArchivedItems = itemTreeArchiver.numArchivedItems();
                 numRestoredItems = itemTreeArchiver.numRestoredItems();
@@ -357,7 +453,9 @@ ItemList<> ProjectManagerImpl::loadProject(const std::string& filename, Item* pa
 
                 mv->flush();
                 
+                PhaseProfiler::Scope postProcessScope("Post processes");
                 archive->callPostProcesses();
+                postProcessScope.end();
 
                 if(numRestoredItems == numArchivedItems){
                     mv->notify(format(_("Project \"{}\" has been completely loaded."), filename));
@@ -379,6 +477,12 @@ ItemList<> ProjectManagerImpl::loadProject(const std::string& filename, Item* pa
 
     --projectBeingLoadedCounter;
 
+    projectScope.end();
+    // The report of the startup including the project given as an option is put by App
+    if(projectBeingLoadedCounter == 0 && !isInvokingApplication){
+        ProjectManager::putPhaseProfilerReport();
+    }
+
     return loadedItems;
 }
 
@@ -549,7 +653,7 @@ void ProjectManagerImpl::onProjectOptionsParsed(boost::program_options::variable
     if(v.count("project")){
         vector<string> projectFileNames = v["project"].as<vector<string>>();
         for(size_t i=0; i < projectFileNames.size(); ++i){
-            loadProject(toActualPathName(projectFileNames[i]), nullptr, true);
+            loadProjectGivenAsOption(projectFileNames[i]);
         }
     }
 }
@@ -560,7 +664,7 @@ void ProjectManagerImpl::onInputFileOptionsParsed(std::vector<std::string>& inpu
     auto iter = inputFiles.begin();
     while(iter != inputFiles.end()){
         if(getExtension(*iter) == "cnoid"){
-            loadProject(toActualPathName(*iter), nullptr, true);
+            loadProjectGivenAsOption(*iter);
             iter = inputFiles.erase(iter);
         } else {
             ++iter;
@@ -569,6 +673,58 @@ void ProjectManagerImpl::onInputFileOptionsParsed(std::vector<std::string>& inpu
 }
 
 
+void ProjectManagerImpl::loadProjectGivenAsOption(const string& filename)
+{
+    const string actualFilename = toActualPathName(filename);
+    auto startTime = std::chrono::steady_clock::now();
+    loadProject(actualFilename, nullptr, true);
+    projectLoadingTimes.emplace_back(
+        actualFilename,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+}
+
+
+void ProjectManagerImpl::onOptionsParsedAfterProjectLoading(boost::program_options::variables_map& v)
+{
+    if(v.count("project-loading-benchmark")){
+        writeProjectLoadingBenchmark(v["project-loading-benchmark"].as<string>());
+    }
+}
+
+
+/**
+   The file is written in JSON, which can also be read by YAMLReader.
+   The loading times include the restoration of the items and the views.
+*/
+bool ProjectManagerImpl::writeProjectLoadingBenchmark(const string& filename)
+{
+    ofstream ofs(filename.c_str());
+    if(!ofs){
+        mv->putln(format(_("\"{}\" cannot be opened."), filename), MessageView::ERROR);
+        return false;
+    }
+    ofs << "{\n  \"projects\": [";
+    for(size_t i=0; i < projectLoadingTimes.size(); ++i){
+        auto& info = projectLoadingTimes[i];
+        string quoted;
+        for(auto c : info.first){
+            if(c == '"' || c == '\\'){
+                quoted += '\\';
+            }
+            quoted += c;
+        }
+        ofs << (i == 0 ? "\n" : ",\n");
+        ofs << "    { \"file\": \"" << quoted << "\", \"time\": " << info.second << " }";
+    }
+    if(!projectLoadingTimes.empty()){
+        ofs << "\n  ";
+    }
+    ofs << "],\n";
+    ofs << "  \"peakMemory\": " << getPeakMemoryUsage() << "\n}\n";
+    return ofs.good();
+}
+
+
 void ProjectManagerImpl::openDialogToLoadProject()
 {
     QFileDialog dialog(MainWindow::instance());
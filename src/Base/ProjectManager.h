@@ -23,6 +23,9 @@ public:
     static ProjectManager* instance();
     static bool isProjectBeingLoaded();
 
+    //! Puts the timing report of the phases when the CNOID_PHASE_PROFILE environment variable is set
+    static void putPhaseProfilerReport();
+
     //The constructor used to create a sub instance for recursive loading / saving
     ProjectManager();
     
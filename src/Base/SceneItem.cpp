@@ -11,6 +11,7 @@
 #include <cnoid/FileUtil>
 #include <cnoid/EigenArchive>
 #include <cnoid/SceneEffects>
+#include <cnoid/MemoryUsage>
 #include "gettext.h"
 
 using namespace std;
@@ -114,6 +115,13 @@ SgNode* SceneItem::getScene()
 }
 
 
+void SceneItem::countMemoryUsage(MemoryUsageCounter& counter)
+{
+    Item::countMemoryUsage(counter);
+    topNode_->countMemoryUsage(counter);
+}
+
+
 void SceneItem::setTranslation(const Vector3f& translation)
 {
     topNode_->setTranslation(translation);
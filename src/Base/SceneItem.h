@@ -33,6 +33,8 @@ public:
     void setLightweightRenderingEnabled(bool on);
     bool isLightweightRenderingEnabled() const { return isLightweightRenderingEnabled_; }
 
+    virtual void countMemoryUsage(MemoryUsageCounter& counter);
+
 protected:
     virtual Item* doDuplicate() const;
     virtual bool store(Archive& archive);
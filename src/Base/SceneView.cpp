@@ -9,17 +9,79 @@
 #include "RootItem.h"
 #include "Buttons.h"
 #include "CheckBox.h"
+#include "OptionManager.h"
+#include "ProjectManager.h"
+#include "MessageView.h"
 #include <cnoid/SceneProvider>
+#include <fmt/format.h>
 #include <list>
+#include <fstream>
 #include "gettext.h"
 
 using namespace std;
 using namespace std::placeholders;
 using namespace cnoid;
+using fmt::format;
 
 namespace {
 vector<SceneView*> instances;
 Connection sigItemAddedConnection;
+
+string toJsonString(const string& s)
+{
+    string quoted("\"");
+    for(auto c : s){
+        if(c == '"' || c == '\\'){
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    quoted += '"';
+    return quoted;
+}
+
+bool writeRenderingBenchmark(const string& filename, int numFrames)
+{
+    auto mv = MessageView::instance();
+    auto view = SceneView::instance();
+    if(!view){
+        mv->putln(_("There is no scene view for the rendering benchmark."), MessageView::ERROR);
+        return false;
+    }
+    SceneWidget::RenderingBenchmarkResult result;
+    if(!view->sceneWidget()->runRenderingBenchmark(numFrames, true, result)){
+        mv->putln(_("The rendering benchmark cannot be run."), MessageView::ERROR);
+        return false;
+    }
+    ofstream ofs(filename.c_str());
+    if(!ofs){
+        mv->putln(format(_("\"{}\" cannot be opened."), filename), MessageView::ERROR);
+        return false;
+    }
+    ofs << "{\n";
+    ofs << "  \"project\": " << toJsonString(ProjectManager::instance()->currentProjectFile()) << ",\n";
+    ofs << "  \"width\": " << result.width << ",\n";
+    ofs << "  \"height\": " << result.height << ",\n";
+    ofs << "  \"frames\": " << result.numFrames << ",\n";
+    ofs << "  \"frameRate\": " << result.frameRate << ",\n";
+    ofs << "  \"frameTime\": { \"p50\": " << result.frameTimeP50 << ", \"p90\": " << result.frameTimeP90
+        << ", \"p99\": " << result.frameTimeP99 << ", \"max\": " << result.maxFrameTime << " },\n";
+    ofs << "  \"cpuTime\": " << result.cpuTime << ",\n";
+    ofs << "  \"gpuTime\": " << result.gpuTime << ",\n";
+    ofs << "  \"drawCalls\": " << result.numDrawCalls << ",\n";
+    ofs << "  \"readbackTime\": " << result.readbackTime << "\n";
+    ofs << "}\n";
+    return ofs.good();
+}
+
+void onSigOptionsParsed(boost::program_options::variables_map& v)
+{
+    if(v.count("rendering-benchmark")){
+        writeRenderingBenchmark(
+            v["rendering-benchmark"].as<string>(), v["rendering-benchmark-frames"].as<int>());
+    }
+}
+
 }
 
 namespace cnoid {
@@ -87,6 +149,13 @@ void SceneView::initializeClass(ExtensionManager* ext)
         sigItemAddedConnection =
             RootItem::mainInstance()->sigItemAdded().connect(
                 std::bind(&SceneView::onItemAdded, _1));
+
+        OptionManager& om = ext->optionManager();
+        om.addOption("rendering-benchmark", boost::program_options::value<string>(),
+                     "render the scene view with an orbiting camera and write the performance data to a JSON file");
+        om.addOption("rendering-benchmark-frames", boost::program_options::value<int>()->default_value(720),
+                     "number of the frames rendered in the rendering benchmark");
+        om.sigOptionsParsed(1).connect(onSigOptionsParsed);
     }
 }
 
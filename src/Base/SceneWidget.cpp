@@ -27,10 +27,13 @@
 #include <cnoid/EigenArchive>
 #include <cnoid/SceneCameras>
 #include <cnoid/SceneLights>
+#include <cnoid/ScenePicker>
 #include <cnoid/CoordinateAxesOverlay>
 #include <cnoid/ConnectionSet>
+#include <cnoid/TraceRecorder>
 #include <QOpenGLWidget>
 #include <QOpenGLContext>
+#include <QOpenGLFunctions>
 #include <QSurfaceFormat>
 #include <QLabel>
 #include <QKeyEvent>
@@ -43,6 +46,7 @@
 #include <QCoreApplication>
 #include <fmt/format.h>
 #include <set>
+#include <algorithm>
 #include <iostream>
 #include "gettext.h"
 
@@ -128,6 +132,8 @@ public:
     };
     Shadow shadows[NUM_SHADOWS];
     CheckBox shadowAntiAliasingCheck;
+    SpinBox shadowResolutionSpin;
+    CheckBox shadowCacheCheck;
     CheckBox fogCheck;
     CheckBox gridCheck[3];
     DoubleSpinBox gridSpanSpin[3];
@@ -147,6 +153,7 @@ public:
     CheckBox fpsCheck;
     PushButton fpsTestButton;
     SpinBox fpsTestIterationSpin;
+    CheckBox frameStatisticsCheck;
     CheckBox newDisplayListDoubleRenderingCheck;
     CheckBox collisionVisualizationButtonsCheck;
     CheckBox upsideDownCheck;
@@ -207,6 +214,7 @@ public:
     SgGroupPtr systemGroup;
     SgGroup* scene;
     GLSceneRenderer* renderer;
+    ScenePicker scenePicker;
     LazyCaller extractPreprocessedNodesLater;
     SgUpdate modified;
     SgUpdate added;
@@ -285,6 +293,9 @@ public:
     bool isDoingFPSTest;
     bool isFPSTestCanceled;
 
+    QLabel* frameStatisticsLabel;
+    Timer frameStatisticsTimer;
+
     ConfigDialog* config;
     QLabel* indicatorLabel;
 
@@ -324,6 +335,8 @@ public:
     void onFPSUpdateRequest();
     void onFPSRenderingRequest();
     void renderFPS();
+    void showFrameStatistics(bool on);
+    void updateFrameStatisticsLabel();
 
     void showBackgroundColorDialog();
     void showGridColorDialog(int index);
@@ -401,6 +414,7 @@ public:
 
     bool saveImage(const std::string& filename);
     void setScreenSize(int width, int height);
+    bool runRenderingBenchmark(int numFrames, bool doReadback, SceneWidget::RenderingBenchmarkResult& result);
     void updateIndicator(const std::string& text);
     bool storeState(Archive& archive);
     void writeCameraPath(Mapping& archive, const std::string& key, int cameraIndex);
@@ -643,6 +657,9 @@ SceneWidgetImpl::SceneWidgetImpl(SceneWidget* self, bool useGLSL)
     }
     isDoingFPSTest = false;
 
+    frameStatisticsLabel = nullptr;
+    frameStatisticsTimer.sigTimeout().connect([&](){ updateFrameStatisticsLabel(); });
+
     sigVSyncModeChanged.connect([&](){ onVSyncModeChanged(); });
     sigLowMemoryConsumptionModeChanged.connect(
         [&](bool on){ onLowMemoryConsumptionModeChanged(on); });
@@ -750,6 +767,8 @@ void SceneWidgetImpl::resizeGL(int width, int height)
 
 void SceneWidgetImpl::onSceneGraphUpdated(const SgUpdate& update)
 {
+    scenePicker.onSceneGraphUpdated(update);
+
     SgNode* node = dynamic_cast<SgNode*>(update.path().front());
 
     if(node && (update.action() & (SgUpdate::ADDED | SgUpdate::REMOVED))){
@@ -793,6 +812,8 @@ void SceneWidgetImpl::paintGL()
         os << "SceneWidgetImpl::paintGL() " << counter++ << endl;
     }
 
+    TraceRecorder::Scope trace("Scene redraw", "gui");
+
     bool isLightweightViewChangeActive = false;
     if(isLightweightViewChangeEnabled){
         isLightweightViewChangeActive = isCameraPositionInteractivelyChanged;
@@ -902,6 +923,70 @@ void SceneWidgetImpl::showFPS(bool on)
 }
 
 
+/**
+   The statistics are shown by a label over the view because the text rendering is not
+   available in the GLSL rendering. The label is updated periodically with the latest
+   statistics which the renderer has obtained in the rendered frames.
+*/
+void SceneWidgetImpl::showFrameStatistics(bool on)
+{
+    auto glslRenderer = dynamic_cast<GLSLSceneRenderer*>(renderer);
+    if(!glslRenderer){
+        return;
+    }
+    glslRenderer->setFrameProfilingEnabled(on);
+    
+    if(on){
+        if(!frameStatisticsLabel){
+            frameStatisticsLabel = new QLabel(this);
+            frameStatisticsLabel->setAttribute(Qt::WA_TransparentForMouseEvents);
+            frameStatisticsLabel->setStyleSheet(
+                "QLabel { color: white; background-color: rgba(0, 0, 0, 128); padding: 4px; }");
+            QFont font("monospace");
+            font.setStyleHint(QFont::Monospace);
+            frameStatisticsLabel->setFont(font);
+            frameStatisticsLabel->move(8, 8);
+        }
+        frameStatisticsLabel->setText(_("Measuring ..."));
+        frameStatisticsLabel->adjustSize();
+        frameStatisticsLabel->show();
+        frameStatisticsTimer.start(500);
+    } else {
+        frameStatisticsTimer.stop();
+        if(frameStatisticsLabel){
+            frameStatisticsLabel->hide();
+        }
+    }
+    update();
+}
+
+
+void SceneWidgetImpl::updateFrameStatisticsLabel()
+{
+    GLSLSceneRenderer::FrameStatistics statistics;
+    auto glslRenderer = dynamic_cast<GLSLSceneRenderer*>(renderer);
+    if(!glslRenderer || !glslRenderer->getFrameStatistics(statistics)){
+        return;
+    }
+
+    static const char* passNames[] = { "Shadow", "Main", "Transparent", "Overlay" };
+
+    QString text = QString("CPU:              %1 ms").arg(statistics.cpuTime, 7, 'f', 2);
+    double totalGpuTime = 0.0;
+    for(int i=0; i < GLSLSceneRenderer::NUM_RENDERING_PASSES; ++i){
+        const double time = statistics.gpuTimes[i];
+        text += QString("\nGPU %1 %2 ms").arg(QString(passNames[i]) + ":", -13).arg(time, 7, 'f', 2);
+        totalGpuTime += time;
+    }
+    text += QString("\nGPU total:        %1 ms").arg(totalGpuTime, 7, 'f', 2);
+    text += QString("\nDraw calls:       %1").arg(statistics.numDrawCalls, 7);
+    text += QString("\nUploaded:         %1 KB").arg(statistics.numUploadedBytes / 1024.0, 7, 'f', 1);
+
+    frameStatisticsLabel->setText(text);
+    frameStatisticsLabel->adjustSize();
+}
+
+
 void SceneWidgetImpl::onFPSTestButtonClicked()
 {
     if(!isDoingFPSTest){
@@ -1137,23 +1222,49 @@ void SceneWidgetImpl::updateLatestEventPath(bool forceFullPicking)
         return;
     }
     
-    makeCurrent();
+    bool picked = false;
+    bool isPickingDetermined = false;
+
+    /*
+      The ray casting is tried first because the picking by rendering reads back the pixels
+      from the GPU, which stalls the pipeline.
+    */
+    Vector3 nearPoint, farPoint;
+    if(!SHOW_IMAGE_FOR_PICKING &&
+       renderer->unproject(latestEvent.x(), latestEvent.y(), 0.0, nearPoint) &&
+       renderer->unproject(latestEvent.x(), latestEvent.y(), 1.0, farPoint)){
+        scenePicker.setBackFaceCullingMode(renderer->backFaceCullingMode());
+        ScenePicker::Result result = scenePicker.pick(sceneRoot, nearPoint, farPoint);
+        if(result != ScenePicker::UNDETERMINED){
+            picked = (result == ScenePicker::PICKED);
+            isPickingDetermined = true;
+        }
+    }
+
+    if(!isPickingDetermined){
+        makeCurrent();
 
-    bool picked = renderer->pick(latestEvent.x(), latestEvent.y());
+        picked = renderer->pick(latestEvent.x(), latestEvent.y());
 
-    if(SHOW_IMAGE_FOR_PICKING){
-        // This does not work
-        auto cxt = context();
-        cxt->swapBuffers(cxt->surface());
+        if(SHOW_IMAGE_FOR_PICKING){
+            // This does not work
+            auto cxt = context();
+            cxt->swapBuffers(cxt->surface());
+        }
+        doneCurrent();
     }
-    doneCurrent();
 
     latestEvent.nodePath_.clear();
     pointedEditablePath.clear();
 
     if(picked){
-        latestEvent.point_ = renderer->pickedPoint();
-        latestEvent.nodePath_ = renderer->pickedNodePath();
+        if(isPickingDetermined){
+            latestEvent.point_ = scenePicker.pickedPoint();
+            latestEvent.nodePath_ = scenePicker.pickedNodePath();
+        } else {
+            latestEvent.point_ = renderer->pickedPoint();
+            latestEvent.nodePath_ = renderer->pickedNodePath();
+        }
 
         SgNodePath& path = latestEvent.nodePath_;
         for(size_t i=0; i < path.size(); ++i){
@@ -2373,6 +2484,11 @@ void SceneWidgetImpl::updateDefaultLights()
         }
     }
     renderer->enableShadowAntiAliasing(config->shadowAntiAliasingCheck.isChecked());
+    if(auto glslRenderer = dynamic_cast<GLSLSceneRenderer*>(renderer)){
+        const int resolution = config->shadowResolutionSpin.value();
+        glslRenderer->setShadowMapSize(resolution, resolution);
+        glslRenderer->setShadowMapCacheEnabled(config->shadowCacheCheck.isChecked());
+    }
 
     renderer->enableFog(config->fogCheck.isChecked());
 
@@ -2511,6 +2627,12 @@ void SceneWidget::setShowFPS(bool on)
 }
 
 
+void SceneWidget::setShowFrameStatistics(bool on)
+{
+    impl->config->frameStatisticsCheck.setChecked(on);
+}
+
+
 void SceneWidget::setCameraPosition(const Vector3& eye, const Vector3& direction, const Vector3& up)
 {
     impl->builtinCameraTransform->setPosition(SgCamera::positionLookingFor(eye, direction, up));
@@ -2584,6 +2706,112 @@ void SceneWidgetImpl::setScreenSize(int width, int height)
 }
 
 
+bool SceneWidget::runRenderingBenchmark(int numFrames, bool doReadback, RenderingBenchmarkResult& out_result)
+{
+    return impl->runRenderingBenchmark(numFrames, doReadback, out_result);
+}
+
+
+bool SceneWidgetImpl::runRenderingBenchmark(int numFrames, bool doReadback, SceneWidget::RenderingBenchmarkResult& result)
+{
+    if(numFrames <= 0 || isDoingFPSTest){
+        return false;
+    }
+    isDoingFPSTest = true;
+
+    auto glslRenderer = dynamic_cast<GLSLSceneRenderer*>(renderer);
+    bool wasFrameProfilingEnabled = false;
+    if(glslRenderer){
+        wasFrameProfilingEnabled = glslRenderer->isFrameProfilingEnabled();
+        glslRenderer->setFrameProfilingEnabled(true);
+    }
+
+    const Vector3 p = lastClickedPoint;
+    const Affine3 C = builtinCameraTransform->T();
+    const int width = this->width() * devicePixelRatio();
+    const int height = this->height() * devicePixelRatio();
+    vector<unsigned char> pixels;
+    if(doReadback){
+        pixels.resize(width * height * 4);
+    }
+
+    vector<double> frameTimes;
+    frameTimes.reserve(numFrames);
+    double readbackTime = 0.0;
+    double cpuTime = 0.0;
+    double gpuTime = 0.0;
+    double numDrawCalls = 0.0;
+    int numStatistics = 0;
+
+    QElapsedTimer totalTimer;
+    QElapsedTimer timer;
+    totalTimer.start();
+
+    for(int i=0; i < numFrames; ++i){
+        double a = radian(static_cast<double>(i + 1));
+        builtinCameraTransform->setTransform(
+            Translation3(p) *
+            AngleAxis(a, Vector3::UnitZ()) *
+            Translation3(-p) *
+            C);
+        timer.start();
+        repaint();
+        makeCurrent();
+        auto gl = context()->functions();
+        gl->glFinish();
+        frameTimes.push_back(timer.nsecsElapsed() * 1.0e-6);
+
+        if(doReadback){
+            timer.start();
+            gl->glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+            gl->glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            gl->glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+            readbackTime += timer.nsecsElapsed() * 1.0e-6;
+        }
+
+        GLSLSceneRenderer::FrameStatistics statistics;
+        if(glslRenderer && glslRenderer->getFrameStatistics(statistics)){
+            cpuTime += statistics.cpuTime;
+            for(int j=0; j < GLSLSceneRenderer::NUM_RENDERING_PASSES; ++j){
+                gpuTime += statistics.gpuTimes[j];
+            }
+            numDrawCalls += statistics.numDrawCalls;
+            ++numStatistics;
+        }
+        QCoreApplication::processEvents();
+    }
+
+    const double totalTime = totalTimer.nsecsElapsed() * 1.0e-9;
+
+    builtinCameraTransform->setTransform(C);
+    if(glslRenderer){
+        glslRenderer->setFrameProfilingEnabled(wasFrameProfilingEnabled);
+    }
+    update();
+
+    std::sort(frameTimes.begin(), frameTimes.end());
+    auto percentile = [&frameTimes](double p){
+        return frameTimes[static_cast<size_t>(p * (frameTimes.size() - 1))];
+    };
+    result.width = width;
+    result.height = height;
+    result.numFrames = numFrames;
+    result.frameRate = (totalTime > 0.0) ? (numFrames / totalTime) : 0.0;
+    result.frameTimeP50 = percentile(0.5);
+    result.frameTimeP90 = percentile(0.9);
+    result.frameTimeP99 = percentile(0.99);
+    result.maxFrameTime = frameTimes.back();
+    result.cpuTime = (numStatistics > 0) ? (cpuTime / numStatistics) : 0.0;
+    result.gpuTime = (numStatistics > 0) ? (gpuTime / numStatistics) : 0.0;
+    result.numDrawCalls = (numStatistics > 0) ? (numDrawCalls / numStatistics) : 0.0;
+    result.readbackTime = doReadback ? (readbackTime / numFrames) : 0.0;
+
+    isDoingFPSTest = false;
+
+    return true;
+}
+
+
 void SceneWidget::updateIndicator(const std::string& text)
 {
     impl->indicatorLabel->setText(text.c_str());
@@ -3164,6 +3392,20 @@ ConfigDialog::ConfigDialog(SceneWidgetImpl* impl, bool useGLSL)
     hbox->addStretch();
     vbox->addLayout(hbox);
 
+    hbox = new QHBoxLayout();
+    hbox->addWidget(new QLabel(_("Shadow resolution")));
+    shadowResolutionSpin.setRange(256, 8192);
+    shadowResolutionSpin.setSingleStep(256);
+    shadowResolutionSpin.setValue(2048);
+    shadowResolutionSpin.sigValueChanged().connect([&](int){ updateDefaultLightsLater(); });
+    hbox->addWidget(&shadowResolutionSpin);
+    shadowCacheCheck.setText(_("Cache the shadows of unchanged objects"));
+    shadowCacheCheck.setChecked(false);
+    shadowCacheCheck.sigToggled().connect([&](bool){ updateDefaultLightsLater(); });
+    hbox->addWidget(&shadowCacheCheck);
+    hbox->addStretch();
+    vbox->addLayout(hbox);
+
     hbox = new QHBoxLayout();
     fogCheck.setText(_("Fog"));
     fogCheck.setChecked(true);
@@ -3301,6 +3543,15 @@ ConfigDialog::ConfigDialog(SceneWidgetImpl* impl, bool useGLSL)
     hbox->addStretch();
     vbox->addLayout(hbox);
 
+    hbox = new QHBoxLayout();
+    frameStatisticsCheck.setText(_("Show frame statistics (CPU / GPU time, draw calls and uploads)"));
+    frameStatisticsCheck.setEnabled(useGLSL);
+    frameStatisticsCheck.setChecked(false);
+    frameStatisticsCheck.sigToggled().connect([=](bool on){ impl->showFrameStatistics(on); });
+    hbox->addWidget(&frameStatisticsCheck);
+    hbox->addStretch();
+    vbox->addLayout(hbox);
+
     hbox = new QHBoxLayout();
     newDisplayListDoubleRenderingCheck.setText(_("Do double rendering when a new display list is created."));
     newDisplayListDoubleRenderingCheck.sigToggled().connect(
@@ -3380,6 +3631,8 @@ void ConfigDialog::storeState(Archive& archive)
     if(!shadowLights->empty()){
         archive.insert("shadowLights", shadowLights);
     }
+    archive.write("shadowResolution", shadowResolutionSpin.value());
+    archive.write("shadowCache", shadowCacheCheck.isChecked());
     
     archive.write("fog", fogCheck.isChecked());
     archive.write("floorGrid", gridCheck[FLOOR_GRID].isChecked());
@@ -3400,6 +3653,7 @@ void ConfigDialog::storeState(Archive& archive)
     archive.write("coordinateAxes", coordinateAxesCheck.isChecked());
     archive.write("fpsTestIteration", fpsTestIterationSpin.value());
     archive.write("showFPS", fpsCheck.isChecked());
+    archive.write("showFrameStatistics", frameStatisticsCheck.isChecked());
     archive.write("enableNewDisplayListDoubleRendering", newDisplayListDoubleRenderingCheck.isChecked());
     archive.write("upsideDown", upsideDownCheck.isChecked());
 }
@@ -3443,6 +3697,8 @@ void ConfigDialog::restoreState(const Archive& archive)
             shadow.check.setChecked(true);
         }
     }
+    shadowResolutionSpin.setValue(archive.get("shadowResolution", shadowResolutionSpin.value()));
+    shadowCacheCheck.setChecked(archive.get("shadowCache", shadowCacheCheck.isChecked()));
 
     fogCheck.setChecked(archive.get("fog", fogCheck.isChecked()));
     gridCheck[FLOOR_GRID].setChecked(archive.get("floorGrid", gridCheck[FLOOR_GRID].isChecked()));
@@ -3464,6 +3720,7 @@ void ConfigDialog::restoreState(const Archive& archive)
 
     fpsTestIterationSpin.setValue(archive.get("fpsTestIteration", fpsTestIterationSpin.value()));
     fpsCheck.setChecked(archive.get("showFPS", fpsCheck.isChecked()));
+    frameStatisticsCheck.setChecked(archive.get("showFrameStatistics", frameStatisticsCheck.isChecked()));
     newDisplayListDoubleRenderingCheck.setChecked(
         archive.get("enableNewDisplayListDoubleRendering", newDisplayListDoubleRenderingCheck.isChecked()));
     upsideDownCheck.setChecked(archive.get("upsideDown", upsideDownCheck.isChecked()));
@@ -92,6 +92,7 @@ public:
     void setNormalVisualization(bool on);
     void setCoordinateAxes(bool on);
     void setShowFPS(bool on);
+    void setShowFrameStatistics(bool on);
     void setNewDisplayListDoubleRenderingEnabled(bool on);
        
     void setBackgroundColor(const Vector3& color);
@@ -129,6 +130,34 @@ public:
     QImage getImage();
     void setScreenSize(int width, int height);
 
+    struct RenderingBenchmarkResult
+    {
+        int width;
+        int height;
+        int numFrames;
+        //! Frames per second of the whole loop including the readback
+        double frameRate;
+        //! Wall-clock time [ms] of rendering a frame until the GPU commands are completed
+        double frameTimeP50;
+        double frameTimeP90;
+        double frameTimeP99;
+        double maxFrameTime;
+        //! Mean frame statistics of GLSLSceneRenderer [ms], which are zero with the other renderers
+        double cpuTime;
+        double gpuTime;
+        double numDrawCalls;
+        //! Mean time [ms] of reading the pixels of a frame into the main memory
+        double readbackTime;
+    };
+
+    /**
+       The scene is rendered for the specified number of frames with the built-in camera orbiting
+       around the last clicked point by one degree per frame as the FPS test of the config dialog.
+       The pixels are read after each frame when doReadback is true. The readback is not included
+       in the frame time.
+    */
+    bool runRenderingBenchmark(int numFrames, bool doReadback, RenderingBenchmarkResult& out_result);
+
     void updateIndicator(const std::string& text);
     QWidget* indicator();
 
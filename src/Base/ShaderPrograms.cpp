@@ -24,6 +24,8 @@ class ShaderProgramImpl
 public:
     string vertexShader;
     string fragmentShader;
+    GLint isInstancingEnabledLocation;
+    bool isInstancingEnabled;
 };
    
 
@@ -183,6 +185,8 @@ public:
 
     static const int maxNumShadows = 2;
     int currentShadowIndex;
+    bool isShadowMapCacheEnabled;
+    int shadowMapGenerationMode;
 
     struct ShadowInfo {
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -193,6 +197,12 @@ public:
         GLuint depthTexture;
         GLuint frameBuffer;
         Matrix4 BPV;
+
+        // The depth of the static shadow casters is cached in the following buffers
+        GLuint staticDepthBuffer;
+        GLuint staticFrameBuffer;
+        bool isStaticShadowMapValid;
+        Matrix4 staticBPV;
     };
     std::vector<ShadowInfo, Eigen::aligned_allocator<ShadowInfo>> shadowInfos;
 
@@ -201,6 +211,7 @@ public:
     PhongShadowLightingProgramImpl(PhongShadowLightingProgram* self);
     void initialize(GLSLProgram& glsl);
     void initializeShadowInfo(GLSLProgram& glsl, int index);
+    void initializeStaticShadowMapBuffers(ShadowInfo& shadow);
 };
 
 }
@@ -212,6 +223,8 @@ ShaderProgram::ShaderProgram(const char* vertexShader, const char* fragmentShade
     impl = new ShaderProgramImpl;
     impl->vertexShader = vertexShader;
     impl->fragmentShader = fragmentShader;
+    impl->isInstancingEnabledLocation = -1;
+    impl->isInstancingEnabled = false;
 }
 
 
@@ -227,6 +240,9 @@ void ShaderProgram::initialize()
     glslProgram_->loadVertexShader(impl->vertexShader.c_str());
     glslProgram_->loadFragmentShader(impl->fragmentShader.c_str());
     glslProgram_->link();
+
+    impl->isInstancingEnabledLocation = glslProgram_->getUniformLocation("isInstancingEnabled");
+    impl->isInstancingEnabled = false;
 }
 
 
@@ -265,6 +281,21 @@ void ShaderProgram::setVertexColorEnabled(bool on)
 }
 
 
+bool ShaderProgram::isInstancingAvailable() const
+{
+    return impl->isInstancingEnabledLocation >= 0;
+}
+
+
+void ShaderProgram::setInstancingEnabled(bool on)
+{
+    if(impl->isInstancingEnabledLocation >= 0 && on != impl->isInstancingEnabled){
+        glUniform1i(impl->isInstancingEnabledLocation, on);
+        impl->isInstancingEnabled = on;
+    }
+}
+
+
 NolightingProgram::NolightingProgram()
     : NolightingProgram(":/Base/shader/nolighting.vert", ":/Base/shader/nolighting.frag")
 {
@@ -879,6 +910,8 @@ PhongShadowLightingProgramImpl::PhongShadowLightingProgramImpl(PhongShadowLighti
     orthoShadowCamera = new SgOrthographicCamera;
     orthoShadowCamera->setHeight(15.0);
     currentShadowIndex = 0;
+    isShadowMapCacheEnabled = false;
+    shadowMapGenerationMode = PhongShadowLightingProgram::FULL_SHADOW_MAP;
 
     shadowBias <<
         0.5, 0.0, 0.0, 0.5,
@@ -964,6 +997,31 @@ void PhongShadowLightingProgramImpl::initializeShadowInfo(GLSLProgram& glsl, int
     if(result != GL_FRAMEBUFFER_COMPLETE) {
         throw std::runtime_error(_("Framebuffer is not complete.\n"));
     }
+
+    // The buffers are created when the cache is used first
+    shadow.staticDepthBuffer = 0;
+    shadow.staticFrameBuffer = 0;
+    shadow.isStaticShadowMapValid = false;
+}
+
+
+void PhongShadowLightingProgramImpl::initializeStaticShadowMapBuffers(ShadowInfo& shadow)
+{
+    glGenRenderbuffers(1, &shadow.staticDepthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, shadow.staticDepthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, shadowMapWidth, shadowMapHeight);
+
+    glGenFramebuffers(1, &shadow.staticFrameBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadow.staticFrameBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, shadow.staticDepthBuffer);
+
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    GLenum result = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if(result != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error(_("Framebuffer is not complete.\n"));
+    }
 }
 
 
@@ -1027,6 +1085,66 @@ void PhongShadowLightingProgram::getShadowMapSize(int& width, int& height) const
 }
 
 
+void PhongShadowLightingProgram::setShadowMapSize(int width, int height)
+{
+    if(width == impl->shadowMapWidth && height == impl->shadowMapHeight){
+        return;
+    }
+    impl->shadowMapWidth = width;
+    impl->shadowMapHeight = height;
+
+    for(size_t i=0; i < impl->shadowInfos.size(); ++i){
+        auto& shadow = impl->shadowInfos[i];
+        glActiveTexture(GL_TEXTURE1 + i);
+        glBindTexture(GL_TEXTURE_2D, shadow.depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height,
+                     0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        if(shadow.staticDepthBuffer){
+            glBindRenderbuffer(GL_RENDERBUFFER, shadow.staticDepthBuffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        }
+        shadow.isStaticShadowMapValid = false;
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+
+void PhongShadowLightingProgram::setShadowMapCacheEnabled(bool on)
+{
+    impl->isShadowMapCacheEnabled = on;
+    if(!on){
+        invalidateShadowMapCache();
+    }
+}
+
+
+bool PhongShadowLightingProgram::isShadowMapCacheEnabled() const
+{
+    return impl->isShadowMapCacheEnabled;
+}
+
+
+void PhongShadowLightingProgram::invalidateShadowMapCache()
+{
+    for(auto& shadow : impl->shadowInfos){
+        shadow.isStaticShadowMapValid = false;
+    }
+}
+
+
+bool PhongShadowLightingProgram::isStaticShadowMapValid() const
+{
+    auto& shadow = impl->shadowInfos[impl->currentShadowIndex];
+    return shadow.isStaticShadowMapValid && shadow.staticBPV == shadow.BPV;
+}
+
+
+void PhongShadowLightingProgram::setShadowMapGenerationMode(int mode)
+{
+    impl->shadowMapGenerationMode = mode;
+}
+
+
 SgCamera* PhongShadowLightingProgram::getShadowMapCamera(SgLight* light, Affine3& io_T)
 {
     SgCamera* camera = 0;
@@ -1118,7 +1236,28 @@ void ShadowMapProgram::initializeFrameRendering()
 {
     auto& mainImpl = mainProgram->impl;
     auto& shadow = mainImpl->shadowInfos[mainImpl->currentShadowIndex];
-    glBindFramebuffer(GL_FRAMEBUFFER, shadow.frameBuffer);
+    const int mode = mainImpl->shadowMapGenerationMode;
+
+    if(mode == PhongShadowLightingProgram::STATIC_SHADOW_MAP){
+        if(!shadow.staticFrameBuffer){
+            mainImpl->initializeStaticShadowMapBuffers(shadow);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, shadow.staticFrameBuffer);
+        shadow.staticBPV = shadow.BPV;
+        shadow.isStaticShadowMapValid = true;
+
+    } else if(mode == PhongShadowLightingProgram::DYNAMIC_SHADOW_MAP){
+        // The dynamic shadow casters are rendered over the cached depth of the static ones
+        const int w = mainImpl->shadowMapWidth;
+        const int h = mainImpl->shadowMapHeight;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, shadow.staticFrameBuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadow.frameBuffer);
+        glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, shadow.frameBuffer);
+
+    } else {
+        glBindFramebuffer(GL_FRAMEBUFFER, shadow.frameBuffer);
+    }
         
     if(mainImpl->isShadowAntiAliasingEnabled){
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -1128,7 +1267,9 @@ void ShadowMapProgram::initializeFrameRendering()
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     }
 
-    glClear(GL_DEPTH_BUFFER_BIT);
+    if(mode != PhongShadowLightingProgram::DYNAMIC_SHADOW_MAP){
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
 }
 
 
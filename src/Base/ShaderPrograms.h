@@ -49,6 +49,16 @@ public:
     virtual void setMaterial(const SgMaterial* material);
     virtual void setVertexColorEnabled(bool on);
 
+    /**
+       The instanced rendering is available when the vertex shader has the uniform variable
+       "isInstancingEnabled". Then the model matrix of each instance is given by the vertex
+       attribute of location 4, and M of setTransform must be the identity.
+    */
+    bool isInstancingAvailable() const;
+
+    //! This must be called while the program is active
+    void setInstancingEnabled(bool on);
+
 protected:
     ShaderProgram(const char* vertexShader, const char* fragmentShader);
 
@@ -242,6 +252,24 @@ public:
     void setNumShadows(int n);
     ShadowMapProgram& shadowMapProgram();
     void getShadowMapSize(int& width, int& height) const;
+
+    //! This must be called while the OpenGL context is current
+    void setShadowMapSize(int width, int height);
+
+    /**
+       When the cache is enabled, the depth of the static shadow casters is rendered into the
+       cache only when the cache is invalid or the view projection of the shadow map is changed.
+       The shadow map is then made by rendering the dynamic shadow casters over the cached depth.
+    */
+    void setShadowMapCacheEnabled(bool on);
+    bool isShadowMapCacheEnabled() const;
+    void invalidateShadowMapCache();
+
+    //! This checks the cache of the shadow map activated by activateShadowMapGenerationPass
+    bool isStaticShadowMapValid() const;
+
+    enum ShadowMapGenerationMode { FULL_SHADOW_MAP, STATIC_SHADOW_MAP, DYNAMIC_SHADOW_MAP };
+    void setShadowMapGenerationMode(int mode);
     SgCamera* getShadowMapCamera(SgLight* light, Affine3& io_T);
     void setShadowMapViewProjection(const Matrix4& PV);
     void setShadowAntiAliasingEnabled(bool on);
@@ -7,6 +7,7 @@
 #include "ProjectManager.h"
 #include "MessageView.h"
 #include "ItemTreeView.h"
+#include "LazyCaller.h"
 #include <cnoid/ConnectionSet>
 #include <fmt/format.h>
 #include <set>
@@ -28,8 +29,12 @@ public:
     SubProjectItem* self;
     std::string projectFileToLoad;
     Selection saveMode;
+    Selection loadMode;
     bool isSavingSubProject;
+    bool isLoadingDeferred;
+    int deferredLoadingPriority;
     ScopedConnectionSet updateConnections;
+    ScopedConnectionSet demandConnections;
     unique_ptr<ProjectManager> projectManager_;
 
     SubProjectItemImpl(SubProjectItem* self);
@@ -37,6 +42,9 @@ public:
     bool loadSubProject(const std::string& filename);
     ProjectManager* projectManager();
     void doLoadSubProject(const std::string& filename);
+    void deferLoading();
+    void scheduleDeferredLoading(int priority);
+    void loadDeferredSubProject();
     void enableSubProjectUpdateDetection();
     void onSubProjectUpdated();
     bool saveSubProject(const std::string& filename);
@@ -71,13 +79,21 @@ SubProjectItem::SubProjectItem()
 
 SubProjectItemImpl::SubProjectItemImpl(SubProjectItem* self)
     : self(self),
-      saveMode(SubProjectItem::N_SAVE_MODE, CNOID_GETTEXT_DOMAIN_NAME)
+      saveMode(SubProjectItem::N_SAVE_MODE, CNOID_GETTEXT_DOMAIN_NAME),
+      loadMode(SubProjectItem::N_LOAD_MODES, CNOID_GETTEXT_DOMAIN_NAME)
 {
     isSavingSubProject = false;
+    isLoadingDeferred = false;
+    deferredLoadingPriority = LazyCaller::PRIORITY_LOW;
 
     saveMode.setSymbol(SubProjectItem::MANUAL_SAVE, N_("Manual save"));
     saveMode.setSymbol(SubProjectItem::AUTOMATIC_SAVE, N_("Automatic save"));
     saveMode.select(SubProjectItem::MANUAL_SAVE);
+
+    loadMode.setSymbol(SubProjectItem::IMMEDIATE_LOAD, N_("Immediate"));
+    loadMode.setSymbol(SubProjectItem::IDLE_LOAD, N_("Idle"));
+    loadMode.setSymbol(SubProjectItem::ON_DEMAND_LOAD, N_("On demand"));
+    loadMode.select(SubProjectItem::IMMEDIATE_LOAD);
 }
 
 
@@ -93,6 +109,7 @@ SubProjectItemImpl::SubProjectItemImpl(SubProjectItem* self, const SubProjectIte
 {
     projectFileToLoad = org.projectFileToLoad;
     saveMode = org.saveMode;
+    loadMode = org.loadMode;
 }
 
 
@@ -111,8 +128,12 @@ Item* SubProjectItem::doDuplicate() const
 void SubProjectItem::onConnectedToRoot()
 {
     if(!impl->projectFileToLoad.empty()){
-        impl->doLoadSubProject(impl->projectFileToLoad);
-        impl->projectFileToLoad.clear();
+        if(impl->loadMode.is(IMMEDIATE_LOAD)){
+            impl->doLoadSubProject(impl->projectFileToLoad);
+            impl->projectFileToLoad.clear();
+        } else if(!impl->isLoadingDeferred){
+            impl->deferLoading();
+        }
     }
 }
 
@@ -126,6 +147,15 @@ bool SubProjectItemImpl::loadSubProject(const std::string& filename)
         return false;
     }
 
+    if(!loadMode.is(SubProjectItem::IMMEDIATE_LOAD)){
+        projectFileToLoad = filename;
+        isLoadingDeferred = false;
+        if(self->isConnectedToRoot()){
+            deferLoading();
+        }
+        return true;
+    }
+
     if(self->isConnectedToRoot()){
         doLoadSubProject(filename);
         return true;
@@ -138,6 +168,87 @@ bool SubProjectItemImpl::loadSubProject(const std::string& filename)
 }
 
 
+/**
+   The items of a sub project are created by the item loaders in the main thread, so the deferred
+   sub projects are loaded one by one in the idle time of the event loop instead of in other threads.
+*/
+void SubProjectItemImpl::deferLoading()
+{
+    isLoadingDeferred = true;
+    demandConnections.disconnect();
+
+    if(loadMode.is(SubProjectItem::IDLE_LOAD)){
+        scheduleDeferredLoading(LazyCaller::PRIORITY_LOW);
+
+    } else {
+        auto itemTreeView = ItemTreeView::instance();
+        demandConnections.add(
+            itemTreeView->sigCheckToggled(self).connect(
+                [&](bool isChecked){
+                    if(isChecked){
+                        scheduleDeferredLoading(LazyCaller::PRIORITY_HIGH);
+                    }
+                }));
+        demandConnections.add(
+            itemTreeView->sigSelectionChanged().connect(
+                [&](const ItemList<>& items){
+                    for(auto& item : items){
+                        if(item == self){
+                            scheduleDeferredLoading(LazyCaller::PRIORITY_HIGH);
+                            break;
+                        }
+                    }
+                }));
+    }
+}
+
+
+void SubProjectItemImpl::scheduleDeferredLoading(int priority)
+{
+    deferredLoadingPriority = priority;
+
+    // The item may be removed before the function is called
+    weak_ref_ptr<SubProjectItem> weakSelf = self;
+    callLater(
+        [weakSelf](){
+            if(auto item = weakSelf.lock()){
+                item->loadSubProjectContents();
+            }
+        },
+        priority);
+}
+
+
+void SubProjectItemImpl::loadDeferredSubProject()
+{
+    if(!isLoadingDeferred){
+        return;
+    }
+    if(ProjectManager::isProjectBeingLoaded()){
+        scheduleDeferredLoading(deferredLoadingPriority);
+
+    } else if(self->isConnectedToRoot()){
+        demandConnections.disconnect();
+        isLoadingDeferred = false;
+        string filename = projectFileToLoad;
+        projectFileToLoad.clear();
+        doLoadSubProject(filename);
+    }
+}
+
+
+bool SubProjectItem::isSubProjectLoaded() const
+{
+    return !impl->isLoadingDeferred && impl->projectFileToLoad.empty();
+}
+
+
+void SubProjectItem::loadSubProjectContents()
+{
+    impl->loadDeferredSubProject();
+}
+
+
 ProjectManager* SubProjectItemImpl::projectManager()
 {
     if(!projectManager_){
@@ -196,6 +307,9 @@ void SubProjectItemImpl::onSubProjectUpdated()
 
 bool SubProjectItemImpl::saveSubProject(const std::string& filename)
 {
+    // A placeholder must not overwrite the project file with the empty contents
+    loadDeferredSubProject();
+
     isSavingSubProject = true;
     projectManager()->saveProject(filename, self);
     isSavingSubProject = false;
@@ -228,10 +342,34 @@ void SubProjectItem::setSaveMode(int mode)
 }
 
 
+int SubProjectItem::loadMode() const
+{
+    return impl->loadMode.which();
+}
+
+
+void SubProjectItem::setLoadMode(int mode)
+{
+    impl->loadMode.select(mode);
+}
+
+
 void SubProjectItem::doPutProperties(PutPropertyFunction& putProperty)
 {
     putProperty(_("Save mode"), impl->saveMode,
                 [&](int index){ setSaveMode(index); return true; });
+    putProperty(_("Load mode"), impl->loadMode,
+                [&](int index){ setLoadMode(index); return true; });
+
+    if(impl->isLoadingDeferred){
+        putProperty(_("Loaded"), false,
+                    [&](bool on){
+                        if(on){
+                            impl->scheduleDeferredLoading(LazyCaller::PRIORITY_HIGH);
+                        }
+                        return on;
+                    });
+    }
 
     if(impl->saveMode.is(AUTOMATIC_SAVE)){
         putProperty(_("Updated"), !isConsistentWithFile());
@@ -246,6 +384,9 @@ bool SubProjectItem::store(Archive& archive)
             archive.writeRelocatablePath("filename", filePath());
             archive.write("format", fileFormat());
             archive.write("saveMode", impl->saveMode.selectedSymbol(), DOUBLE_QUOTED);
+            if(!impl->loadMode.is(IMMEDIATE_LOAD)){
+                archive.write("loadMode", impl->loadMode.selectedSymbol(), DOUBLE_QUOTED);
+            }
         }
     }
     return true;
@@ -258,6 +399,9 @@ bool SubProjectItem::restore(const Archive& archive)
     if(archive.read("saveMode", symbol)){
         impl->saveMode.select(symbol);
     }
+    if(archive.read("loadMode", symbol)){
+        impl->loadMode.select(symbol);
+    }
     string filename, format;
     if(archive.readRelocatablePath("filename", filename) && archive.read("format", format)){
         return load(filename, format);
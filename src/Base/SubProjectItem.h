@@ -27,6 +27,27 @@ public:
     void setSaveMode(int mode);
     int saveMode() const;
 
+    /**
+       IMMEDIATE_LOAD loads the sub project when the item is loaded, which is the default mode.
+       With IDLE_LOAD, the item is put in the item tree as a placeholder and the sub project is
+       loaded when the application becomes idle after the parent project is loaded. With
+       ON_DEMAND_LOAD, the sub project is loaded when the placeholder is first checked or
+       selected in the item tree view, or when loadSubProjectContents() is called.
+       The mode must be set before the item is loaded to defer the loading.
+    */
+    enum LoadMode { IMMEDIATE_LOAD, IDLE_LOAD, ON_DEMAND_LOAD, N_LOAD_MODES };
+    void setLoadMode(int mode);
+    int loadMode() const;
+
+    //! False while the item is a placeholder whose sub project has not been loaded
+    bool isSubProjectLoaded() const;
+
+    /**
+       Loads the deferred sub project of the placeholder. This is postponed until the current
+       project is loaded when it is called while the project is being loaded.
+    */
+    void loadSubProjectContents();
+
 protected:
     virtual Item* doDuplicate() const override;
     virtual void onConnectedToRoot() override;
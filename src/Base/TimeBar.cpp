@@ -14,6 +14,7 @@
 #include "Buttons.h"
 #include "CheckBox.h"
 #include "Dialog.h"
+#include <cnoid/TraceRecorder>
 #include <QDialogButtonBox>
 #include <boost/lexical_cast.hpp>
 #include <cmath>
@@ -795,6 +796,8 @@ double TimeBar::realPlaybackTime() const
 
 void TimeBarImpl::timerEvent(QTimerEvent*)
 {
+    TraceRecorder::Scope trace("Time bar tick", "gui");
+
     double time = animationTimeOffset + playbackSpeedScale * (elapsedTimer.elapsed() / 1000.0);
 
     bool doStopAtLastFillLevel = false;
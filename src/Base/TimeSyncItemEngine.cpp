@@ -6,6 +6,11 @@
 #include "ItemTreeView.h"
 #include "TimeBar.h"
 #include "LazyCaller.h"
+#include "Timer.h"
+#include <cnoid/ThreadPool>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QElapsedTimer>
 #include <vector>
 #include <map>
 
@@ -28,16 +33,31 @@ Connection connectionOfTimeChanged;
 
 LazyCaller updateLater;
 
+/*
+  The time changes during the playback are coalesced so that the engines are not updated
+  more frequently than the display refresh rate.
+*/
+Timer* pendingUpdateTimer;
+QElapsedTimer lastUpdateTimer;
+int minUpdateInterval; // [ms]
+bool isLastUpdateActive = false;
+
 bool setTime(double time)
 {
     bool isActive = false;
 
     currentTime = time;
+    pendingUpdateTimer->stop();
+    lastUpdateTimer.start();
+
+    TimeSyncItemEngine::prepareTimeChanges(engines, time);
 
     for(size_t i=0; i < engines.size(); ++i){
         isActive |= engines[i]->onTimeChanged(time);
     }
 
+    isLastUpdateActive = isActive;
+
     return isActive;
 }
 
@@ -45,6 +65,21 @@ void update() {
     setTime(currentTime);
 }
 
+bool onTimeChanged(double time)
+{
+    if(TimeBar::instance()->isDoingPlayback() && lastUpdateTimer.isValid()){
+        const qint64 elapsed = lastUpdateTimer.elapsed();
+        if(elapsed < minUpdateInterval){
+            currentTime = time;
+            if(!pendingUpdateTimer->isActive()){
+                pendingUpdateTimer->start(minUpdateInterval - elapsed);
+            }
+            return isLastUpdateActive;
+        }
+    }
+    return setTime(time);
+}
+
 void onItemSelectionOrTreeChanged(const ItemList<>& selectedItems)
 {
     engines.clear();
@@ -69,18 +104,58 @@ void onItemSelectionOrTreeChanged(const ItemList<>& selectedItems)
 }
 
 
+TimeSyncItemEngine::TimeSyncItemEngine()
+{
+    preparationTarget_ = nullptr;
+}
+
+
 TimeSyncItemEngine::~TimeSyncItemEngine()
 {
 
 }
 
 
+void TimeSyncItemEngine::prepareTimeChange(double /* time */)
+{
+
+}
+
+
 bool TimeSyncItemEngine::onTimeChanged(double time)
 {
     return false;
 }
 
 
+void TimeSyncItemEngine::prepareTimeChangesSub(const std::vector<TimeSyncItemEngine*>& engines, double time)
+{
+    // The engines with the same target are prepared in the same task
+    map<Referenced*, vector<TimeSyncItemEngine*>> targetToEnginesMap;
+    for(auto& engine : engines){
+        if(auto target = engine->preparationTarget()){
+            targetToEnginesMap[target].push_back(engine);
+        }
+    }
+    if(targetToEnginesMap.size() == 1){
+        for(auto& engine : targetToEnginesMap.begin()->second){
+            engine->prepareTimeChange(time);
+        }
+    } else if(targetToEnginesMap.size() > 1){
+        ThreadPool::TaskGroup group;
+        for(auto& kv : targetToEnginesMap){
+            auto& targetEngines = kv.second;
+            group.run([&targetEngines, time](){
+                    for(auto& engine : targetEngines){
+                        engine->prepareTimeChange(time);
+                    }
+                });
+        }
+        group.wait();
+    }
+}
+
+
 void TimeSyncItemEngine::notifyUpdate()
 {
     updateLater();
@@ -98,11 +173,23 @@ void TimeSyncItemEngineManager::initialize()
         connectionOfSelectionOrTreeChanged =
             ItemTreeView::mainInstance()->sigSelectionOrTreeChanged().connect(onItemSelectionOrTreeChanged);
         
-        connectionOfTimeChanged = TimeBar::instance()->sigTimeChanged().connect(setTime);
+        connectionOfTimeChanged = TimeBar::instance()->sigTimeChanged().connect(onTimeChanged);
         
         updateLater.setFunction(update);
         updateLater.setPriority(LazyCaller::PRIORITY_LOW);
 
+        pendingUpdateTimer = new Timer;
+        pendingUpdateTimer->setSingleShot(true);
+        pendingUpdateTimer->sigTimeout().connect(update);
+
+        double refreshRate = 60.0;
+        if(auto screen = QGuiApplication::primaryScreen()){
+            if(screen->refreshRate() > 0.0){
+                refreshRate = screen->refreshRate();
+            }
+        }
+        minUpdateInterval = static_cast<int>(1000.0 / refreshRate);
+
         initialized = true;
     }
 }
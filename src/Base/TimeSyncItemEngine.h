@@ -9,6 +9,7 @@
 #include <cnoid/Referenced>
 #include <functional>
 #include <string>
+#include <vector>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -18,9 +19,41 @@ class Item;
 class CNOID_EXPORT TimeSyncItemEngine : public Referenced
 {
 public:
+    TimeSyncItemEngine();
     virtual ~TimeSyncItemEngine();
+
+    /**
+       This function is called in a worker thread before onTimeChanged is called with the same
+       time if the engine has a preparation target. The state at the time should be computed here
+       without accessing the GUI and the objects other than the target so that the states of the
+       engines are computed in parallel. The engines with the same target are not prepared at the
+       same time.
+    */
+    virtual void prepareTimeChange(double time);
+    
     virtual bool onTimeChanged(double time);
     void notifyUpdate();
+
+    Referenced* preparationTarget() const { return preparationTarget_; }
+
+    //! Calls prepareTimeChange of the engines which have the preparation targets in parallel
+    template<class EngineContainer>
+    static void prepareTimeChanges(const EngineContainer& engines, double time) {
+        std::vector<TimeSyncItemEngine*> engineArray;
+        engineArray.reserve(engines.size());
+        for(auto& engine : engines){
+            engineArray.push_back(&*engine);
+        }
+        prepareTimeChangesSub(engineArray, time);
+    }
+
+protected:
+    void setPreparationTarget(Referenced* target) { preparationTarget_ = target; }
+
+private:
+    Referenced* preparationTarget_;
+    
+    static void prepareTimeChangesSub(const std::vector<TimeSyncItemEngine*>& engines, double time);
 };
 
 typedef ref_ptr<TimeSyncItemEngine> TimeSyncItemEnginePtr;
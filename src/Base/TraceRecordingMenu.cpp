@@ -0,0 +1,159 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#include "TraceRecordingMenu.h"
+#include "ExtensionManager.h"
+#include "MenuManager.h"
+#include "OptionManager.h"
+#include "MainWindow.h"
+#include "MessageView.h"
+#include "AppConfig.h"
+#include "AppUtil.h"
+#include "Action.h"
+#include <cnoid/TraceRecorder>
+#include <QFileDialog>
+#include <fmt/format.h>
+#include "gettext.h"
+
+using namespace std;
+using namespace cnoid;
+using fmt::format;
+
+namespace {
+
+class TraceRecordingManager
+{
+public:
+    Action* recordingCheck;
+    string outputFileOption;
+    
+    TraceRecordingManager(ExtensionManager* ext);
+    ~TraceRecordingManager();
+    void onOptionsParsed(boost::program_options::variables_map& v);
+    void onRecordingCheckToggled(bool on);
+    void startRecording();
+    void writeTraceFile(const string& filename);
+};
+
+}
+
+
+void TraceRecordingMenu::initialize(ExtensionManager* ext)
+{
+    static bool initialized = false;
+    if(!initialized){
+        ext->manage(new TraceRecordingManager(ext));
+        initialized = true;
+    }
+}
+
+
+TraceRecordingManager::TraceRecordingManager(ExtensionManager* ext)
+{
+    TraceRecorder::setThreadName("GUI");
+    
+    MenuManager& mm = ext->menuManager();
+    mm.setPath("/Tools");
+    recordingCheck = mm.addCheckItem(_("Trace Recording"));
+    recordingCheck->sigToggled().connect([&](bool on){ onRecordingCheckToggled(on); });
+
+    OptionManager& om = ext->optionManager();
+    om.addOption("trace", boost::program_options::value<string>(),
+                 "record the timeline of the simulation, rendering and GUI work to a trace event file");
+    om.sigOptionsParsed().connect(
+        [&](boost::program_options::variables_map& v){ onOptionsParsed(v); });
+}
+
+
+TraceRecordingManager::~TraceRecordingManager()
+{
+    // The file is written here so that it is also written when the application is quit with "--quit"
+    if(!outputFileOption.empty() && TraceRecorder::isRecording()){
+        TraceRecorder::stopRecording();
+        TraceRecorder::writeTraceFile(outputFileOption);
+    }
+}
+
+
+void TraceRecordingManager::onOptionsParsed(boost::program_options::variables_map& v)
+{
+    if(v.count("trace")){
+        outputFileOption = v["trace"].as<string>();
+        recordingCheck->blockSignals(true);
+        recordingCheck->setChecked(true);
+        recordingCheck->blockSignals(false);
+        startRecording();
+    }
+}
+
+
+void TraceRecordingManager::onRecordingCheckToggled(bool on)
+{
+    if(on){
+        outputFileOption.clear();
+        startRecording();
+        return;
+    }
+
+    TraceRecorder::stopRecording();
+
+    if(!outputFileOption.empty()){
+        writeTraceFile(outputFileOption);
+        outputFileOption.clear();
+        return;
+    }
+
+    QFileDialog dialog(MainWindow::instance());
+    dialog.setWindowTitle(_("Save the trace events"));
+    dialog.setFileMode(QFileDialog::AnyFile);
+    dialog.setAcceptMode(QFileDialog::AcceptSave);
+    dialog.setViewMode(QFileDialog::List);
+    dialog.setLabelText(QFileDialog::Accept, _("Save"));
+    dialog.setLabelText(QFileDialog::Reject, _("Cancel"));
+    dialog.setDefaultSuffix("json");
+
+    QStringList filters;
+    filters << _("Trace event files (*.json)");
+    filters << _("Any files (*)");
+    dialog.setNameFilters(filters);
+
+    MappingPtr config = AppConfig::archive()->openMapping("TraceRecording");
+    string directory;
+    if(config->read("directory", directory)){
+        dialog.setDirectory(directory.c_str());
+    }
+
+    if(dialog.exec() == QDialog::Accepted){
+        config->write("directory", dialog.directory().absolutePath().toStdString());
+        writeTraceFile(dialog.selectedFiles().front().toStdString());
+    } else {
+        TraceRecorder::clear();
+    }
+}
+
+
+void TraceRecordingManager::startRecording()
+{
+    TraceRecorder::clear();
+    TraceRecorder::startRecording();
+    MessageView::instance()->putln(_("Trace recording has been started."));
+}
+
+
+void TraceRecordingManager::writeTraceFile(const string& filename)
+{
+    auto mv = MessageView::instance();
+    if(TraceRecorder::writeTraceFile(filename)){
+        mv->putln(format(_("The trace events have been written to \"{}\"."), filename));
+        auto numDiscarded = TraceRecorder::numDiscardedEvents();
+        if(numDiscarded > 0){
+            mv->putln(format(_("{} events were discarded because the buffer of their thread was full."),
+                             numDiscarded), MessageView::WARNING);
+        }
+    } else {
+        mv->putln(format(_("The trace events cannot be written to \"{}\"."), filename),
+                  MessageView::ERROR);
+    }
+    TraceRecorder::clear();
+}
@@ -0,0 +1,24 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_BASE_TRACE_RECORDING_MENU_H
+#define CNOID_BASE_TRACE_RECORDING_MENU_H
+
+namespace cnoid {
+
+class ExtensionManager;
+
+/**
+   This provides the "Trace Recording" check item of the Tools menu and the "--trace" option,
+   which record the timeline of the simulation, rendering and GUI work with TraceRecorder.
+*/
+class TraceRecordingMenu
+{
+public:
+    static void initialize(ExtensionManager* ext);
+};
+
+}
+
+#endif
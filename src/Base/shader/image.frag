@@ -0,0 +1,12 @@
+#version 330
+
+in vec2 texCoord;
+
+out vec4 color;
+
+uniform sampler2D imageTexture;
+
+void main()
+{
+    color = vec4(texture(imageTexture, texCoord).rgb, 1.0);
+}
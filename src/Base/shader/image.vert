@@ -0,0 +1,15 @@
+#version 330
+
+layout (location = 0) in vec2 vertexPosition;
+
+out vec2 texCoord;
+
+// The unit square is transformed to the normalized device coordinate
+uniform mat3 transform;
+
+void main()
+{
+    vec3 p = transform * vec3(vertexPosition, 1.0);
+    gl_Position = vec4(p.xy, 0.0, 1.0);
+    texCoord = vertexPosition;
+}
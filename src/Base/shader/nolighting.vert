@@ -2,15 +2,26 @@
 
 layout (location = 0) in vec3 vertexPosition;
 layout (location = 3) in vec3 vertexColor;
+layout (location = 4) in mat4 instanceMatrix;
 
 out vec3 colorV;
 
 uniform mat4 MVP;
 uniform float pointSize = 1.0;
 
+/*
+  The model matrix of each instance is given by instanceMatrix in the instanced rendering,
+  where the other matrices do not include the model matrix.
+*/
+uniform bool isInstancingEnabled = false;
+
 void main()
 {
-    gl_Position = MVP * vec4(vertexPosition, 1.0);
+    if(isInstancingEnabled){
+        gl_Position = MVP * (instanceMatrix * vec4(vertexPosition, 1.0));
+    } else {
+        gl_Position = MVP * vec4(vertexPosition, 1.0);
+    }
     gl_PointSize = pointSize;
     colorV = vertexColor;
 }
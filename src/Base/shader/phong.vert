@@ -4,6 +4,7 @@ layout (location = 0) in vec4 vertexPosition;
 layout (location = 1) in vec3 vertexNormal;
 layout (location = 2) in vec2 vertexTexCoord;
 layout (location = 3) in vec3 vertexColor;
+layout (location = 4) in mat4 instanceMatrix;
 
 out vec3 position;
 out vec3 normal;
@@ -29,13 +30,26 @@ uniform mat4 modelViewMatrix;
 uniform mat4 MVP;
 uniform mat3 normalMatrix;
 
+/*
+  The model matrix of each instance is given by instanceMatrix in the instanced rendering,
+  where the other matrices do not include the model matrix.
+*/
+uniform bool isInstancingEnabled = false;
+
 void main()
 {
-    normal = normalize(normalMatrix * vertexNormal);
-    position = vec3(modelViewMatrix * vertexPosition);
+    vec4 p;
+    if(isInstancingEnabled){
+        p = instanceMatrix * vertexPosition;
+        normal = normalize(normalMatrix * (mat3(instanceMatrix) * vertexNormal));
+    } else {
+        p = vertexPosition;
+        normal = normalize(normalMatrix * vertexNormal);
+    }
+    position = vec3(modelViewMatrix * p);
 
     texCoord = vertexTexCoord;
     colorV = vertexColor;
     
-    gl_Position = MVP * vertexPosition;
+    gl_Position = MVP * p;
 }
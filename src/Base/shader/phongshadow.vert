@@ -6,6 +6,7 @@ layout (location = 0) in vec4 vertexPosition;
 layout (location = 1) in vec3 vertexNormal;
 layout (location = 2) in vec2 vertexTexCoord;
 layout (location = 3) in vec3 vertexColor;
+layout (location = 4) in mat4 instanceMatrix;
 
 out vec3 position;
 out vec3 normal;
@@ -35,17 +36,30 @@ uniform mat3 normalMatrix;
 uniform int numShadows;
 uniform mat4 shadowMatrices[MAX_NUM_SHADOWS];
 
+/*
+  The model matrix of each instance is given by instanceMatrix in the instanced rendering,
+  where the other matrices do not include the model matrix.
+*/
+uniform bool isInstancingEnabled = false;
+
 void main()
 {
-    normal = normalize(normalMatrix * vertexNormal);
-    position = vec3(modelViewMatrix * vertexPosition);
+    vec4 p;
+    if(isInstancingEnabled){
+        p = instanceMatrix * vertexPosition;
+        normal = normalize(normalMatrix * (mat3(instanceMatrix) * vertexNormal));
+    } else {
+        p = vertexPosition;
+        normal = normalize(normalMatrix * vertexNormal);
+    }
+    position = vec3(modelViewMatrix * p);
 
     texCoord = vertexTexCoord;
     colorV = vertexColor;
     
     for(int i=0; i < numShadows; ++i){
-        shadowCoords[i] = shadowMatrices[i] * vertexPosition;
+        shadowCoords[i] = shadowMatrices[i] * p;
     }
     
-    gl_Position = MVP * vertexPosition;
+    gl_Position = MVP * p;
 }
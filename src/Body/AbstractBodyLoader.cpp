@@ -38,6 +38,12 @@ void AbstractBodyLoader::setShapeLoadingEnabled(bool on)
 }
 
 
+void AbstractBodyLoader::setVisualShapeLoadingEnabled(bool on)
+{
+
+}
+
+
 void AbstractBodyLoader::setDefaultDivisionNumber(int n)
 {
 
@@ -48,3 +54,9 @@ void AbstractBodyLoader::setDefaultCreaseAngle(double theta)
 {
 
 }
+
+
+bool AbstractBodyLoader::getDependentFiles(std::vector<std::string>& out_files) const
+{
+    return false;
+}
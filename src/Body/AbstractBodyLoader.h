@@ -7,6 +7,7 @@
 #define CNOID_BODY_ABSTRACT_BODY_LOADER_H
 
 #include <string>
+#include <vector>
 #include <memory>
 #include <iosfwd>
 #include "exportdecl.h"
@@ -23,9 +24,23 @@ public:
     virtual void setMessageSink(std::ostream& os);
     virtual void setVerbose(bool on);
     virtual void setShapeLoadingEnabled(bool on);
+
+    /**
+       Only the collision shapes are loaded when this is disabled. The shapes used for both the
+       visualization and the collision detection are loaded without their appearances, and the
+       visual shapes of the links are the same as the collision shapes. The default value is true.
+    */
+    virtual void setVisualShapeLoadingEnabled(bool on);
+
     virtual void setDefaultDivisionNumber(int n);
     virtual void setDefaultCreaseAngle(double theta);
     virtual bool load(Body* body, const std::string& filename) = 0;
+
+    /**
+       Gets the files other than the main file which were read in the last load.
+       \return false if the loader does not track the files read in the load
+    */
+    virtual bool getDependentFiles(std::vector<std::string>& out_files) const;
 };
 
 typedef std::shared_ptr<AbstractBodyLoader> AbstractBodyLoaderPtr;
@@ -5,6 +5,7 @@
 
 #include "BasicSensorSimulationHelper.h"
 #include "Body.h"
+#include <cnoid/TimeMeasure>
 
 using namespace std;
 using namespace cnoid;
@@ -39,6 +40,10 @@ public:
 
     BasicSensorSimulationHelperImpl(BasicSensorSimulationHelper* self);
     void initialize(Body* body, double timeStep, const Vector3& gravityAcceleration);
+    void calcRateGyroSensorStates();
+    void calcAccelerationSensorStates();
+    void notifyRateGyroSensorStateChanges();
+    void notifyAccelerationSensorStateChanges();
 };
 }
 
@@ -50,6 +55,8 @@ typedef BasicSensorSimulationHelperImpl Impl;
 BasicSensorSimulationHelper::BasicSensorSimulationHelper()
 {
     isActive_ = false;
+    isTimeMeasurementEnabled_ = false;
+    isBatchUpdateEnabled_ = false;
     impl = new BasicSensorSimulationHelperImpl(this);
 }
 
@@ -76,6 +83,9 @@ void BasicSensorSimulationHelper::setOldAccelSensorCalcMode(bool on)
 void BasicSensorSimulationHelper::initialize(Body* body, double timeStep, const Vector3& gravityAcceleration)
 {
     isActive_ = false;
+    forceSensorTimeStatistics_.clear();
+    rateGyroSensorTimeStatistics_.clear();
+    accelerationSensorTimeStatistics_.clear();
 
     DeviceList<> devices = body->devices();
     if(!devices.empty()){
@@ -163,42 +173,111 @@ void Impl::initialize(Body* body, double timeStep, const Vector3& gravityAcceler
 
 void BasicSensorSimulationHelper::updateGyroAndAccelerationSensors()
 {
-    for(size_t i=0; i < rateGyroSensors_.size(); ++i){
-        RateGyroSensor* gyro = rateGyroSensors_[i];
+    TimeMeasure timer;
+    if(isTimeMeasurementEnabled_){
+        timer.begin();
+    }
+
+    impl->calcRateGyroSensorStates();
+    impl->notifyRateGyroSensorStateChanges();
+
+    if(isTimeMeasurementEnabled_){
+        if(!rateGyroSensors_.empty()){
+            rateGyroSensorTimeStatistics_.record(timer.measure());
+        }
+        timer.begin();
+    }
+
+    impl->calcAccelerationSensorStates();
+    impl->notifyAccelerationSensorStateChanges();
+
+    if(isTimeMeasurementEnabled_ && !accelerationSensors_.empty()){
+        accelerationSensorTimeStatistics_.record(timer.measure());
+    }
+}
+
+
+void BasicSensorSimulationHelper::updateGyroAndAccelerationSensors
+(const std::vector<BasicSensorSimulationHelper*>& helpers)
+{
+    for(auto& helper : helpers){
+        if(helper->isTimeMeasurementEnabled_){
+            helper->updateGyroAndAccelerationSensors();
+        } else {
+            helper->impl->calcRateGyroSensorStates();
+            helper->impl->calcAccelerationSensorStates();
+        }
+    }
+    for(auto& helper : helpers){
+        if(!helper->isTimeMeasurementEnabled_){
+            helper->impl->notifyRateGyroSensorStateChanges();
+            helper->impl->notifyAccelerationSensorStateChanges();
+        }
+    }
+}
+
+
+/*
+  The rotations are applied to the vectors one by one so that no matrix-matrix product
+  is calculated for each sensor.
+*/
+void Impl::calcRateGyroSensorStates()
+{
+    auto& rateGyroSensors = self->rateGyroSensors_;
+    for(size_t i=0; i < rateGyroSensors.size(); ++i){
+        RateGyroSensor* gyro = rateGyroSensors[i];
         const Link* link = gyro->link();
-        gyro->w() = gyro->R_local().transpose() * link->R().transpose() * link->w();
-        gyro->notifyStateChange();
+        gyro->w().noalias() = gyro->R_local().transpose() * (link->R().transpose() * link->w());
     }
+}
+
+
+void Impl::calcAccelerationSensorStates()
+{
+    auto& accelerationSensors = self->accelerationSensors_;
 
-    if(!impl->isOldAccelSensorCalcMode){
-        for(size_t i=0; i < accelerationSensors_.size(); ++i){
-            AccelerationSensor* sensor = accelerationSensors_[i];
+    if(!isOldAccelSensorCalcMode){
+        for(size_t i=0; i < accelerationSensors.size(); ++i){
+            AccelerationSensor* sensor = accelerationSensors[i];
             const Link* link = sensor->link();
-            sensor->dv() = sensor->R_local().transpose() * link->R().transpose() * (link->dv() - impl->g);
-            sensor->notifyStateChange();
+            sensor->dv().noalias() = sensor->R_local().transpose() * (link->R().transpose() * (link->dv() - g));
         }
 
-    } else if(!accelerationSensors_.empty()){
-        const Matrix2& A = impl->A;
-        const Vector2& B = impl->B;
-
-        for(size_t i=0; i < accelerationSensors_.size(); ++i){
+    } else {
+        for(size_t i=0; i < accelerationSensors.size(); ++i){
 
-            AccelerationSensor* sensor = accelerationSensors_[i];
+            AccelerationSensor* sensor = accelerationSensors[i];
             const Link* link = sensor->link();
             
             // kalman filtering
-            Impl::KFState& s = impl->kfStates[i];
+            KFState& s = kfStates[i];
             const Vector3 o_Vgsens = link->R() * (link->R().transpose() * link->w()).cross(sensor->p_local()) + link->v();
             for(int i=0; i < 3; ++i){
                 s.x[i] = A * s.x[i] + o_Vgsens(i) * B;
             }
             
             Vector3 o_Agsens(s.x[0](1), s.x[1](1), s.x[2](1));
-            o_Agsens -= impl->g;
+            o_Agsens -= g;
             
-            sensor->dv() = sensor->R_local().transpose() * link->R().transpose() * o_Agsens;
-            sensor->notifyStateChange();
+            sensor->dv().noalias() = sensor->R_local().transpose() * (link->R().transpose() * o_Agsens);
         }
     }
 }
+
+
+void Impl::notifyRateGyroSensorStateChanges()
+{
+    auto& rateGyroSensors = self->rateGyroSensors_;
+    for(size_t i=0; i < rateGyroSensors.size(); ++i){
+        rateGyroSensors[i]->notifyStateChange();
+    }
+}
+
+
+void Impl::notifyAccelerationSensorStateChanges()
+{
+    auto& accelerationSensors = self->accelerationSensors_;
+    for(size_t i=0; i < accelerationSensors.size(); ++i){
+        accelerationSensors[i]->notifyStateChange();
+    }
+}
@@ -10,6 +10,8 @@
 #include "ForceSensor.h"
 #include "RateGyroSensor.h"
 #include "AccelerationSensor.h"
+#include <cnoid/TimeStatistics>
+#include <vector>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -36,9 +38,42 @@ public:
         
     void updateGyroAndAccelerationSensors();
 
+    /**
+       The rate gyro sensors and the acceleration sensors of the helpers are updated in a single
+       pass. The states of all the sensors are calculated first and the state changes are notified
+       after that, so that the calculation loop is not interleaved with the signal emissions.
+       A helper whose time measurement is enabled is updated by updateGyroAndAccelerationSensors()
+       to keep its statistics.
+    */
+    static void updateGyroAndAccelerationSensors(const std::vector<BasicSensorSimulationHelper*>& helpers);
+
+    /**
+       When the batch update is enabled, the dynamics calculator does not update the rate gyro
+       sensors and the acceleration sensors, and the owner of the calculators such as WorldBase
+       updates them with the static updateGyroAndAccelerationSensors().
+    */
+    void setBatchUpdateEnabled(bool on) { isBatchUpdateEnabled_ = on; }
+    bool isBatchUpdateEnabled() const { return isBatchUpdateEnabled_; }
+
+    /**
+       When the time measurement is enabled, the computation times of the sensor updates are
+       accumulated into the statistics below. The force sensors are updated by the dynamics
+       calculators, which record their times into forceSensorTimeStatistics().
+    */
+    void setTimeMeasurementEnabled(bool on) { isTimeMeasurementEnabled_ = on; }
+    bool isTimeMeasurementEnabled() const { return isTimeMeasurementEnabled_; }
+    TimeStatistics& forceSensorTimeStatistics() { return forceSensorTimeStatistics_; }
+    TimeStatistics& rateGyroSensorTimeStatistics() { return rateGyroSensorTimeStatistics_; }
+    TimeStatistics& accelerationSensorTimeStatistics() { return accelerationSensorTimeStatistics_; }
+
 private:
     BasicSensorSimulationHelperImpl* impl;
     bool isActive_;
+    bool isTimeMeasurementEnabled_;
+    bool isBatchUpdateEnabled_;
+    TimeStatistics forceSensorTimeStatistics_;
+    TimeStatistics rateGyroSensorTimeStatistics_;
+    TimeStatistics accelerationSensorTimeStatistics_;
     DeviceList<ForceSensor> forceSensors_;
     DeviceList<RateGyroSensor> rateGyroSensors_;
     DeviceList<AccelerationSensor> accelerationSensors_;
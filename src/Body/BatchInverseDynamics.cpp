@@ -0,0 +1,438 @@
+/**
+   \file
+   \author Shin'ichiro Nakaoka
+*/
+
+#include "BatchInverseDynamics.h"
+#include "Body.h"
+#include <cnoid/EigenUtil>
+#include <cnoid/ThreadPool>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+struct LinkInfo
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    int parentIndex;
+    int jointId;
+    Link::JointType jointType;
+    Vector3 a;
+    Vector3 b;
+    double m;
+    Vector3 c;
+    Matrix3 I;
+    double Jm2;
+    double q; // used for the joint without a joint id
+};
+
+/**
+   The spatial quantities are expressed at the origin of the world coordinate
+   as in calcInverseDynamics() of InverseDynamics.cpp.
+*/
+struct Workspace
+{
+    typedef std::vector<Vector3, Eigen::aligned_allocator<Vector3>> Vector3Array;
+    typedef std::vector<Matrix3, Eigen::aligned_allocator<Matrix3>> Matrix3Array;
+
+    Matrix3Array R;
+    Vector3Array p;
+    Vector3Array sv;
+    Vector3Array sw;
+    Vector3Array vo;
+    Vector3Array w;
+    Vector3Array dvo;
+    Vector3Array dw;
+    BatchInverseDynamics::Vector6Array f;
+    std::vector<double> masses;
+    Vector3Array mc;
+    Matrix3Array Iww;
+    VectorXd q;
+    VectorXd dq;
+    VectorXd ddq;
+    VectorXd u;
+
+    void resize(int numLinks, int numJoints){
+        R.resize(numLinks);
+        p.resize(numLinks);
+        sv.resize(numLinks);
+        sw.resize(numLinks);
+        vo.resize(numLinks);
+        w.resize(numLinks);
+        dvo.resize(numLinks);
+        dw.resize(numLinks);
+        f.resize(numLinks);
+        masses.resize(numLinks);
+        mc.resize(numLinks);
+        Iww.resize(numLinks);
+        q.resize(numJoints);
+        dq.resize(numJoints);
+        ddq.resize(numJoints);
+        u.resize(numJoints);
+    }
+};
+
+}
+
+namespace cnoid {
+
+class BatchInverseDynamicsImpl
+{
+public:
+    std::vector<LinkInfo, Eigen::aligned_allocator<LinkInfo>> links;
+    int numJoints;
+    bool isRootFixed;
+    BatchInverseDynamics::RootState rootState;
+    Vector3 g;
+    std::vector<unique_ptr<Workspace>> workspaces;
+
+    BatchInverseDynamicsImpl(Body* body);
+    Workspace& workspace(int index);
+    void calcPositions(Workspace& ws, const BatchInverseDynamics::RootState& root, const VectorXd& q);
+    Vector6 calcInverseDynamics(
+        Workspace& ws, const BatchInverseDynamics::RootState& root,
+        const VectorXd& q, const VectorXd& dq, const VectorXd& ddq, VectorXd& out_u);
+};
+
+}
+
+
+BatchInverseDynamics::BatchInverseDynamics(Body* body)
+{
+    impl = new BatchInverseDynamicsImpl(body);
+}
+
+
+BatchInverseDynamicsImpl::BatchInverseDynamicsImpl(Body* body)
+{
+    const int numLinks = body->numLinks();
+    numJoints = body->numJoints();
+    links.resize(numLinks);
+    for(int i=0; i < numLinks; ++i){
+        Link* link = body->link(i);
+        LinkInfo& info = links[i];
+        info.parentIndex = link->parent() ? link->parent()->index() : -1;
+        info.jointId = link->jointId();
+        if(info.jointId >= numJoints){
+            info.jointId = -1;
+        }
+        info.jointType = link->jointType();
+        info.a = link->a();
+        info.b = link->b();
+        info.m = link->m();
+        info.c = link->c();
+        info.I = link->I();
+        info.Jm2 = link->Jm2();
+        info.q = link->q();
+    }
+
+    Link* root = body->rootLink();
+    isRootFixed = root->isFixedJoint();
+    rootState.T = root->T();
+    rootState.v = root->v();
+    rootState.w = root->w();
+    rootState.dv = root->dv();
+    rootState.dw = root->dw();
+    g.setZero();
+}
+
+
+BatchInverseDynamics::~BatchInverseDynamics()
+{
+    delete impl;
+}
+
+
+int BatchInverseDynamics::numJoints() const
+{
+    return impl->numJoints;
+}
+
+
+void BatchInverseDynamics::setRootState(const RootState& state)
+{
+    impl->rootState = state;
+}
+
+
+const BatchInverseDynamics::RootState& BatchInverseDynamics::rootState() const
+{
+    return impl->rootState;
+}
+
+
+void BatchInverseDynamics::setGravityAcceleration(const Vector3& g)
+{
+    impl->g = g;
+}
+
+
+Workspace& BatchInverseDynamicsImpl::workspace(int index)
+{
+    if(index >= static_cast<int>(workspaces.size())){
+        workspaces.resize(index + 1);
+    }
+    auto& ws = workspaces[index];
+    if(!ws){
+        ws.reset(new Workspace);
+        ws->resize(links.size(), numJoints);
+    }
+    return *ws;
+}
+
+
+void BatchInverseDynamicsImpl::calcPositions
+(Workspace& ws, const BatchInverseDynamics::RootState& root, const VectorXd& q)
+{
+    const int numLinks = links.size();
+
+    ws.R[0] = root.T.linear();
+    ws.p[0] = root.T.translation();
+    ws.sv[0].setZero();
+    ws.sw[0].setZero();
+
+    for(int i=1; i < numLinks; ++i){
+        const LinkInfo& link = links[i];
+        const int parent = link.parentIndex;
+        const Matrix3& Rp = ws.R[parent];
+        const double qi = (link.jointId >= 0) ? q[link.jointId] : link.q;
+        switch(link.jointType){
+        case Link::ROTATIONAL_JOINT:
+            ws.R[i].noalias() = Rp * AngleAxisd(qi, link.a);
+            ws.p[i].noalias() = ws.p[parent] + Rp * link.b;
+            ws.sw[i].noalias() = Rp * link.a;
+            ws.sv[i] = ws.p[i].cross(ws.sw[i]);
+            break;
+        case Link::SLIDE_JOINT:
+            ws.R[i] = Rp;
+            ws.p[i].noalias() = ws.p[parent] + Rp * (link.b + qi * link.a);
+            ws.sw[i].setZero();
+            ws.sv[i].noalias() = Rp * link.a;
+            break;
+        case Link::FIXED_JOINT:
+        default:
+            ws.R[i] = Rp;
+            ws.p[i].noalias() = ws.p[parent] + Rp * link.b;
+            ws.sw[i].setZero();
+            ws.sv[i].setZero();
+            break;
+        }
+    }
+}
+
+
+/**
+   see Kajita et al. Humanoid Robot Ohm-sha,  p.210
+*/
+Vector6 BatchInverseDynamicsImpl::calcInverseDynamics
+(Workspace& ws, const BatchInverseDynamics::RootState& root,
+ const VectorXd& q, const VectorXd& dq, const VectorXd& ddq, VectorXd& out_u)
+{
+    const int numLinks = links.size();
+
+    calcPositions(ws, root, q);
+
+    const Vector3& p0 = ws.p[0];
+    ws.w[0] = root.w;
+    ws.vo[0] = root.v - root.w.cross(p0);
+    ws.dw[0] = root.dw;
+    ws.dvo[0] = root.dv - g - root.dw.cross(p0) - root.w.cross(root.v);
+
+    for(int i=1; i < numLinks; ++i){
+        const LinkInfo& link = links[i];
+        const int parent = link.parentIndex;
+        double dqi = 0.0;
+        double ddqi = 0.0;
+        if(link.jointId >= 0){
+            dqi = dq[link.jointId];
+            ddqi = ddq[link.jointId];
+        }
+        const Vector3& sv = ws.sv[i];
+        const Vector3& sw = ws.sw[i];
+        const Vector3& wp = ws.w[parent];
+        const Vector3 dsv = wp.cross(sv) + ws.vo[parent].cross(sw);
+        const Vector3 dsw = wp.cross(sw);
+        ws.w[i] = wp + sw * dqi;
+        ws.vo[i] = ws.vo[parent] + sv * dqi;
+        ws.dw[i] = ws.dw[parent] + dsw * dqi + sw * ddqi;
+        ws.dvo[i] = ws.dvo[parent] + dsv * dqi + sv * ddqi;
+    }
+
+    for(int i=0; i < numLinks; ++i){
+        const LinkInfo& link = links[i];
+        const Matrix3& R = ws.R[i];
+        const Vector3& w = ws.w[i];
+        const Vector3& vo = ws.vo[i];
+        const Vector3& dw = ws.dw[i];
+        const Vector3& dvo = ws.dvo[i];
+        const Vector3 c = R * link.c + ws.p[i];
+        Matrix3 I = R * link.I * R.transpose();
+        const Matrix3 c_hat = hat(c);
+        I.noalias() += link.m * c_hat * c_hat.transpose();
+        const Vector3 P = link.m * (vo + w.cross(c));
+        const Vector3 L = link.m * c.cross(vo) + I * w;
+        Vector6& f = ws.f[i];
+        f.head<3>() = link.m * (dvo + dw.cross(c)) + w.cross(P);
+        f.tail<3>() = link.m * c.cross(dvo) + I * dw + vo.cross(P) + w.cross(L);
+    }
+
+    out_u.setZero();
+    for(int i = numLinks - 1; i > 0; --i){
+        const LinkInfo& link = links[i];
+        const Vector6& f = ws.f[i];
+        if(link.jointId >= 0){
+            out_u[link.jointId] =
+                ws.sv[i].dot(f.head<3>()) + ws.sw[i].dot(f.tail<3>()) + ddq[link.jointId] * link.Jm2;
+        }
+        ws.f[link.parentIndex] += f;
+    }
+
+    return ws.f[0];
+}
+
+
+Vector6 BatchInverseDynamics::calcInverseDynamics
+(const VectorXd& q, const VectorXd& dq, const VectorXd& ddq, VectorXd& out_u)
+{
+    out_u.resize(impl->numJoints);
+    return impl->calcInverseDynamics(impl->workspace(0), impl->rootState, q, dq, ddq, out_u);
+}
+
+
+void BatchInverseDynamics::calcInverseDynamics
+(const MatrixXd& q, const MatrixXd& dq, const MatrixXd& ddq, const RootStateArray* rootStates,
+ MatrixXd& out_u, Vector6Array* out_rootForces)
+{
+    const int numFrames = q.rows();
+    const int numJoints = impl->numJoints;
+    out_u.resize(numFrames, numJoints);
+    if(out_rootForces){
+        out_rootForces->resize(numFrames);
+    }
+    if(numFrames == 0){
+        return;
+    }
+
+    auto pool = ThreadPool::instance();
+    const int numSegments = std::min(pool->size() + 1, numFrames);
+    for(int i=0; i < numSegments; ++i){
+        // The workspaces are created in this thread
+        impl->workspace(i);
+    }
+
+    auto calcSegment = [&](int segment){
+        const int begin = static_cast<int64_t>(numFrames) * segment / numSegments;
+        const int end = static_cast<int64_t>(numFrames) * (segment + 1) / numSegments;
+        Workspace& ws = *impl->workspaces[segment];
+        for(int frame = begin; frame < end; ++frame){
+            ws.q = q.row(frame).transpose();
+            ws.dq = dq.row(frame).transpose();
+            ws.ddq = ddq.row(frame).transpose();
+            const RootState& root = rootStates ? (*rootStates)[frame] : impl->rootState;
+            Vector6 f = impl->calcInverseDynamics(ws, root, ws.q, ws.dq, ws.ddq, ws.u);
+            out_u.row(frame) = ws.u.transpose();
+            if(out_rootForces){
+                (*out_rootForces)[frame] = f;
+            }
+        }
+    };
+    if(numSegments == 1){
+        calcSegment(0);
+    } else {
+        pool->parallelFor(0, numSegments, calcSegment, 1);
+    }
+}
+
+
+/**
+   The spatial force for the unit motion of a joint is given by the composite inertia of the
+   subtree of the joint, and an element of the matrix is its product with the motion axis of
+   an ancestor joint because the quantities are expressed at the origin.
+*/
+void BatchInverseDynamics::calcMassMatrix(const VectorXd& q, MatrixXd& out_M)
+{
+    Workspace& ws = impl->workspace(0);
+    auto& links = impl->links;
+    const int numLinks = links.size();
+    const int rootDof = impl->isRootFixed ? 0 : 6;
+    const int n = rootDof + impl->numJoints;
+
+    impl->calcPositions(ws, impl->rootState, q);
+
+    for(int i=0; i < numLinks; ++i){
+        const LinkInfo& link = links[i];
+        const Matrix3& R = ws.R[i];
+        const Vector3 c = R * link.c + ws.p[i];
+        const Matrix3 c_hat = hat(c);
+        ws.masses[i] = link.m;
+        ws.mc[i] = link.m * c;
+        ws.Iww[i].noalias() = R * link.I * R.transpose();
+        ws.Iww[i].noalias() += link.m * c_hat * c_hat.transpose();
+    }
+    for(int i = numLinks - 1; i > 0; --i){
+        const int parent = links[i].parentIndex;
+        ws.masses[parent] += ws.masses[i];
+        ws.mc[parent] += ws.mc[i];
+        ws.Iww[parent] += ws.Iww[i];
+    }
+
+    out_M.resize(n, n);
+    out_M.setZero();
+
+    const Vector3& p0 = ws.p[0];
+    auto setRootRows = [&](const Vector3& f, const Vector3& tau, int column){
+        out_M.block<3, 1>(0, column) = f;
+        out_M.block<3, 1>(3, column) = tau - p0.cross(f);
+    };
+
+    if(rootDof){
+        const double m = ws.masses[0];
+        const Vector3& mc = ws.mc[0];
+        const Matrix3& Iww = ws.Iww[0];
+        for(int k=0; k < 6; ++k){
+            Vector3 sv, sw;
+            if(k < 3){
+                sv = Vector3::Unit(k);
+                sw.setZero();
+            } else {
+                sw = Vector3::Unit(k - 3);
+                sv = p0.cross(sw);
+            }
+            const Vector3 f = m * sv - mc.cross(sw);
+            const Vector3 tau = mc.cross(sv) + Iww * sw;
+            setRootRows(f, tau, k);
+        }
+    }
+
+    for(int i=1; i < numLinks; ++i){
+        const LinkInfo& link = links[i];
+        if(link.jointId < 0){
+            continue;
+        }
+        const Vector3& sv = ws.sv[i];
+        const Vector3& sw = ws.sw[i];
+        const Vector3 f = ws.masses[i] * sv - ws.mc[i].cross(sw);
+        const Vector3 tau = ws.mc[i].cross(sv) + ws.Iww[i] * sw;
+        const int column = rootDof + link.jointId;
+
+        for(int j = i; j > 0; j = links[j].parentIndex){
+            const int jointId = links[j].jointId;
+            if(jointId >= 0){
+                const int row = rootDof + jointId;
+                const double h = ws.sv[j].dot(f) + ws.sw[j].dot(tau);
+                out_M(row, column) = h;
+                out_M(column, row) = h;
+            }
+        }
+        if(rootDof){
+            setRootRows(f, tau, column);
+            out_M.block<1, 6>(column, 0) = out_M.block<6, 1>(0, column).transpose();
+        }
+        out_M(column, column) += link.Jm2; // motor inertia
+    }
+}
@@ -0,0 +1,94 @@
+/**
+   \file
+   \author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_BODY_BATCH_INVERSE_DYNAMICS_H
+#define CNOID_BODY_BATCH_INVERSE_DYNAMICS_H
+
+#include <cnoid/EigenTypes>
+#include <vector>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class Body;
+class BatchInverseDynamicsImpl;
+
+/**
+   This class calculates the inverse dynamics and the mass matrix of a body for the given
+   joint states without writing any values into the links of the body.
+   The structure and the inertial parameters of the body are copied when the object is
+   created, and the workspaces are kept in the object so that the repeated calls do not
+   allocate memory. The sequences of the joint states are processed in parallel on the
+   shared thread pool. The external forces of the links are not considered.
+*/
+class CNOID_EXPORT BatchInverseDynamics
+{
+public:
+    struct RootState
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        Position T;
+        Vector3 v;
+        Vector3 w;
+        Vector3 dv;
+        Vector3 dw;
+    };
+    typedef std::vector<RootState, Eigen::aligned_allocator<RootState>> RootStateArray;
+    typedef std::vector<Vector6, Eigen::aligned_allocator<Vector6>> Vector6Array;
+
+    //! The current state of the root link of the body is used as the initial root state
+    BatchInverseDynamics(Body* body);
+    ~BatchInverseDynamics();
+
+    BatchInverseDynamics(const BatchInverseDynamics&) = delete;
+    BatchInverseDynamics& operator=(const BatchInverseDynamics&) = delete;
+
+    int numJoints() const;
+
+    //! The root state used for the frames when the sequence of the root states is not given
+    void setRootState(const RootState& state);
+    const RootState& rootState() const;
+
+    /**
+       The gravity acceleration is equivalent to the acceleration -g of the root link.
+       The default value is zero, which gives the same results as calcInverseDynamics(),
+       where the gravity is given as the acceleration of the root link.
+    */
+    void setGravityAcceleration(const Vector3& g);
+
+    /**
+       \param q, dq, ddq The joint states indexed by the joint ids
+       \param out_u The joint torques indexed by the joint ids
+       \return The force and the torque around the origin which are applied to the root link
+    */
+    Vector6 calcInverseDynamics(
+        const VectorXd& q, const VectorXd& dq, const VectorXd& ddq, VectorXd& out_u);
+
+    /**
+       \param q, dq, ddq The joint states of the frames, where a row is a frame and a column
+       corresponds to a joint id
+       \param rootStates The root states of the frames. The root state given by setRootState()
+       is used for all the frames when this is null.
+       \param out_u The joint torques of the frames in the same layout as q
+       \param out_rootForces The forces applied to the root link for the frames if not null
+    */
+    void calcInverseDynamics(
+        const MatrixXd& q, const MatrixXd& dq, const MatrixXd& ddq, const RootStateArray* rootStates,
+        MatrixXd& out_u, Vector6Array* out_rootForces = nullptr);
+
+    /**
+       The mass matrix is calculated by the composite rigid body method in the same form as
+       calcMassMatrix() of MassMatrix.h. The first six rows and columns correspond to the
+       translation and the rotation of the root link when the root link is not fixed.
+    */
+    void calcMassMatrix(const VectorXd& q, MatrixXd& out_M);
+
+private:
+    BatchInverseDynamicsImpl* impl;
+};
+
+}
+
+#endif
@@ -0,0 +1,289 @@
+/**
+   \file
+   \author Shin'ichiro Nakaoka
+*/
+
+#include "BatchInverseKinematics.h"
+#include "CompositeIK.h"
+#include "JointPath.h"
+#include "Body.h"
+#include <cnoid/EigenUtil>
+#include <cnoid/ThreadPool>
+#include <random>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+// The random seeds of the joints are limited to this range in addition to the joint limits
+const double MAX_SEED_RANGE = PI;
+
+struct Worker
+{
+    BodyPtr body;
+    Link* targetLink;
+    shared_ptr<JointPath> jointPath;
+    unique_ptr<CompositeIK> compositeIK;
+    vector<Link*> joints;
+    vector<double> q0;
+
+    int numIterations() const {
+        if(jointPath){
+            return jointPath->numIterations();
+        }
+        int n = 0;
+        for(int i=0; i < compositeIK->numJointPaths(); ++i){
+            n += compositeIK->jointPath(i)->numIterations();
+        }
+        return n;
+    }
+
+    bool calcInverseKinematics(const Position& T){
+        if(jointPath){
+            return jointPath->calcInverseKinematics(T);
+        }
+        return compositeIK->calcInverseKinematics(T);
+    }
+};
+
+}
+
+namespace cnoid {
+
+class BatchInverseKinematicsImpl
+{
+public:
+    BodyPtr body;
+    int baseLinkIndex;
+    int targetLinkIndex;
+    vector<int> compositeBaseLinkIndices;
+    bool isComposite;
+    double maxIKerror;
+    bool isWarmStartEnabled;
+    int maxNumRandomSeeds;
+    int numSegments;
+
+    BatchInverseKinematicsImpl();
+    unique_ptr<Worker> createWorker();
+    void solveSegment(
+        Worker& worker, const BatchInverseKinematics::PositionArray& targets, int begin, int end,
+        MatrixXd& out_configurations, vector<BatchInverseKinematics::Result>& out_results);
+};
+
+}
+
+
+BatchInverseKinematicsImpl::BatchInverseKinematicsImpl()
+{
+    baseLinkIndex = -1;
+    targetLinkIndex = -1;
+    isComposite = false;
+    maxIKerror = JointPath::numericalIKdefaultMaxIKerror();
+    isWarmStartEnabled = true;
+    maxNumRandomSeeds = 0;
+    numSegments = 0;
+}
+
+
+BatchInverseKinematics::BatchInverseKinematics(Body* body, Link* baseLink, Link* targetLink)
+{
+    impl = new BatchInverseKinematicsImpl;
+    impl->body = body;
+    impl->baseLinkIndex = baseLink->index();
+    impl->targetLinkIndex = targetLink->index();
+}
+
+
+BatchInverseKinematics::BatchInverseKinematics(CompositeIK* ik)
+{
+    impl = new BatchInverseKinematicsImpl;
+    impl->body = ik->body();
+    impl->isComposite = true;
+    impl->targetLinkIndex = ik->targetLink()->index();
+    for(int i=0; i < ik->numJointPaths(); ++i){
+        impl->compositeBaseLinkIndices.push_back(ik->baseLink(i)->index());
+    }
+}
+
+
+BatchInverseKinematics::~BatchInverseKinematics()
+{
+    delete impl;
+}
+
+
+void BatchInverseKinematics::setMaxIKerror(double e)
+{
+    impl->maxIKerror = e;
+}
+
+
+void BatchInverseKinematics::setWarmStartEnabled(bool on)
+{
+    impl->isWarmStartEnabled = on;
+}
+
+
+void BatchInverseKinematics::setMaxNumRandomSeeds(int n)
+{
+    impl->maxNumRandomSeeds = n;
+}
+
+
+void BatchInverseKinematics::setNumSegments(int n)
+{
+    impl->numSegments = n;
+}
+
+
+unique_ptr<Worker> BatchInverseKinematicsImpl::createWorker()
+{
+    unique_ptr<Worker> worker(new Worker);
+    worker->body = body->clone();
+    worker->body->calcForwardKinematics();
+    worker->targetLink = worker->body->link(targetLinkIndex);
+
+    vector<JointPath*> paths;
+    if(isComposite){
+        worker->compositeIK.reset(new CompositeIK(worker->body, worker->targetLink));
+        for(auto index : compositeBaseLinkIndices){
+            worker->compositeIK->addBaseLink(worker->body->link(index));
+        }
+        worker->compositeIK->setMaxIKerror(maxIKerror);
+        for(int i=0; i < worker->compositeIK->numJointPaths(); ++i){
+            paths.push_back(worker->compositeIK->jointPath(i).get());
+        }
+    } else {
+        worker->jointPath = getCustomJointPath(
+            worker->body, worker->body->link(baseLinkIndex), worker->targetLink);
+        worker->jointPath->setNumericalIKmaxIKerror(maxIKerror);
+        paths.push_back(worker->jointPath.get());
+    }
+
+    for(auto path : paths){
+        for(int i=0; i < path->numJoints(); ++i){
+            Link* joint = path->joint(i);
+            if(std::find(worker->joints.begin(), worker->joints.end(), joint) == worker->joints.end()){
+                worker->joints.push_back(joint);
+            }
+        }
+    }
+    worker->q0.resize(worker->joints.size());
+
+    return worker;
+}
+
+
+bool BatchInverseKinematics::solve
+(const PositionArray& targets, MatrixXd& out_configurations, std::vector<Result>& out_results)
+{
+    const int numTargets = targets.size();
+    out_configurations.resize(numTargets, impl->body->numJoints());
+    out_results.resize(numTargets);
+    if(numTargets == 0){
+        return true;
+    }
+
+    auto pool = ThreadPool::instance();
+    int numSegments = impl->numSegments;
+    if(numSegments <= 0){
+        numSegments = pool->size() + 1;
+    }
+    numSegments = std::min(numSegments, numTargets);
+
+    // The body is cloned in this thread because the cloning may not be thread-safe
+    vector<unique_ptr<Worker>> workers(numSegments);
+    for(auto& worker : workers){
+        worker = impl->createWorker();
+    }
+
+    auto solveSegment = [&](int segment){
+        const int begin = static_cast<int64_t>(numTargets) * segment / numSegments;
+        const int end = static_cast<int64_t>(numTargets) * (segment + 1) / numSegments;
+        impl->solveSegment(*workers[segment], targets, begin, end, out_configurations, out_results);
+    };
+    if(numSegments == 1){
+        solveSegment(0);
+    } else {
+        pool->parallelFor(0, numSegments, solveSegment, 1);
+    }
+
+    for(auto& result : out_results){
+        if(!result.isConverged){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void BatchInverseKinematicsImpl::solveSegment
+(Worker& worker, const BatchInverseKinematics::PositionArray& targets, int begin, int end,
+ MatrixXd& out_configurations, vector<BatchInverseKinematics::Result>& out_results)
+{
+    Body* body = worker.body;
+    const int numJoints = worker.joints.size();
+    std::mt19937 random;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    for(int i=0; i < numJoints; ++i){
+        worker.q0[i] = worker.joints[i]->q();
+    }
+
+    for(int index = begin; index < end; ++index){
+        const Position& T = targets[index];
+        BatchInverseKinematics::Result& result = out_results[index];
+
+        if(!isWarmStartEnabled){
+            for(int i=0; i < numJoints; ++i){
+                worker.joints[i]->q() = worker.q0[i];
+            }
+            body->calcForwardKinematics();
+        }
+
+        result.isConverged = worker.calcInverseKinematics(T);
+        result.numIterations = worker.numIterations();
+        result.numSeeds = 0;
+
+        if(!result.isConverged && maxNumRandomSeeds > 0){
+            // The seeds of a target do not depend on the division into the segments
+            random.seed(index);
+            vector<double> qStart(numJoints);
+            for(int i=0; i < numJoints; ++i){
+                qStart[i] = worker.joints[i]->q();
+            }
+            while(result.numSeeds < maxNumRandomSeeds){
+                ++result.numSeeds;
+                for(auto joint : worker.joints){
+                    const double lower = std::max(joint->q_lower(), -MAX_SEED_RANGE);
+                    const double upper = std::min(joint->q_upper(), MAX_SEED_RANGE);
+                    joint->q() = lower + (upper - lower) * uniform(random);
+                }
+                body->calcForwardKinematics();
+                result.isConverged = worker.calcInverseKinematics(T);
+                result.numIterations += worker.numIterations();
+                if(result.isConverged){
+                    break;
+                }
+            }
+            if(!result.isConverged){
+                for(int i=0; i < numJoints; ++i){
+                    worker.joints[i]->q() = qStart[i];
+                }
+                body->calcForwardKinematics();
+            }
+        }
+
+        const Link* target = worker.targetLink;
+        result.positionError = (T.translation() - target->p()).norm();
+        result.orientationError = omegaFromRot(target->R().transpose() * T.linear()).norm();
+
+        for(int i=0; i < body->numJoints(); ++i){
+            out_configurations(index, i) = body->joint(i)->q();
+        }
+    }
+}
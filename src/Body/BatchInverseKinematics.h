@@ -0,0 +1,86 @@
+/**
+   \file
+   \author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_BODY_BATCH_INVERSE_KINEMATICS_H
+#define CNOID_BODY_BATCH_INVERSE_KINEMATICS_H
+
+#include <cnoid/EigenTypes>
+#include <vector>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class Body;
+class Link;
+class CompositeIK;
+class BatchInverseKinematicsImpl;
+
+/**
+   This class solves the inverse kinematics for an array of the target positions.
+   The problem is given as a joint path or a composite IK of a body, and the body is cloned
+   for each worker thread so that the state of the original body is not changed.
+   The targets are divided into contiguous segments which are processed in parallel.
+   In a segment, each solve starts from the solution of the previous target, and the random
+   configurations are tried as the seeds when the solve from the previous solution fails.
+*/
+class CNOID_EXPORT BatchInverseKinematics
+{
+public:
+    typedef std::vector<Position, Eigen::aligned_allocator<Position>> PositionArray;
+
+    struct Result
+    {
+        bool isConverged;
+        //! The total number of the iterations of the numerical IK including the tried seeds
+        int numIterations;
+        //! The number of the random seeds tried after the solve from the previous solution
+        int numSeeds;
+        double positionError;
+        double orientationError;
+    };
+
+    //! The problem of the joint path from baseLink to targetLink
+    BatchInverseKinematics(Body* body, Link* baseLink, Link* targetLink);
+
+    //! The problem of the composite IK. The base links of the IK must be added in advance.
+    BatchInverseKinematics(CompositeIK* ik);
+
+    ~BatchInverseKinematics();
+
+    BatchInverseKinematics(const BatchInverseKinematics&) = delete;
+    BatchInverseKinematics& operator=(const BatchInverseKinematics&) = delete;
+
+    void setMaxIKerror(double e);
+
+    //! The default value is true
+    void setWarmStartEnabled(bool on);
+
+    //! The maximum number of the random seeds tried for a target. The default value is zero.
+    void setMaxNumRandomSeeds(int n);
+
+    /**
+       The number of the segments into which the targets are divided.
+       The default value is zero, which means the number of the threads of the thread pool.
+       The segments must be fixed to get the same results on the machines of the different
+       numbers of the cores because a solution depends on the previous target in the segment.
+    */
+    void setNumSegments(int n);
+
+    /**
+       \param out_configurations The displacements of the joints of the body for the targets,
+       where a row corresponds to a target and a column corresponds to a joint id.
+       The row of a target which is not converged is the configuration from which the solve
+       has been started.
+       \return true if the solves of all the targets are converged
+    */
+    bool solve(const PositionArray& targets, MatrixXd& out_configurations, std::vector<Result>& out_results);
+
+private:
+    BatchInverseKinematicsImpl* impl;
+};
+
+}
+
+#endif
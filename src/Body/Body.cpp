@@ -9,6 +9,7 @@
 #include <cnoid/SceneGraph>
 #include <cnoid/EigenUtil>
 #include <cnoid/ValueTree>
+#include <cnoid/ThreadPool>
 #include <iostream>
 
 using namespace std;
@@ -30,6 +31,30 @@ typedef std::map<std::string, LinkPtr> NameToLinkMap;
 typedef std::map<std::string, Device*> DeviceNameMap;
 typedef std::map<std::string, ReferencedPtr> CacheMap;
 
+struct LinkStateBuffer
+{
+    std::vector<Position, Eigen::aligned_allocator<Position>> T;
+    std::vector<Vector3, Eigen::aligned_allocator<Vector3>> v;
+    std::vector<Vector3, Eigen::aligned_allocator<Vector3>> w;
+    std::vector<Vector3, Eigen::aligned_allocator<Vector3>> dv;
+    std::vector<Vector3, Eigen::aligned_allocator<Vector3>> dw;
+    std::vector<double> q;
+    std::vector<double> dq;
+    std::vector<double> ddq;
+    std::vector<int> parentIndices;
+    std::vector<LinkPtr> links;
+};
+
+/*
+  The configurations are processed in blocks of this number, and each element of the link
+  positions is stored in a contiguous array of the block so that the operations on the
+  configurations are vectorized.
+*/
+const int NUM_BATCH_LANES = 4;
+
+// The number of the blocks processed by a task of the thread pool
+const int NUM_BATCH_BLOCKS_PER_TASK = 16;
+
 double getCurrentTime()
 {
     return 0.0;
@@ -53,6 +78,8 @@ public:
 
     std::vector<BodyHandlerPtr> handlers;
 
+    std::unique_ptr<LinkStateBuffer> linkStateBuffer;
+
     // Members for the customizer
     BodyCustomizerHandle customizerHandle;
     BodyCustomizerInterface* customizerInterface;
@@ -63,6 +90,8 @@ public:
     void expandLinkOffsetRotations(Body* body, Link* link, const Matrix3& parentRs, vector<bool>& validRsFlags);
     void setRsToShape(const Matrix3& Rs, SgNode* shape, std::function<void(SgNode* node)> setShape);
     void applyLinkOffsetRotationsToDevices(Body* body, vector<bool>& validRsFlags);    
+    void updateLinkStateBuffer(Body* body);
+    void releaseLinkStateBuffer();
 };
 
 }
@@ -84,6 +113,7 @@ Body::Body()
 void Body::initialize()
 {
     impl = new BodyImpl;
+    hasLinkStateBuffer_ = false;
     
     impl->customizerHandle = 0;
     impl->customizerInterface = 0;
@@ -142,6 +172,10 @@ void Body::copy(const Body& org)
     if(org.impl->customizerInterface){
         installCustomizer(org.impl->customizerInterface);
     }
+
+    if(org.hasLinkStateBuffer_){
+        setLinkStateBufferEnabled(true);
+    }
 }
 
 
@@ -190,6 +224,7 @@ void Body::cloneShapes(SgCloneMap& cloneMap)
 
 Body::~Body()
 {
+    setLinkStateBufferEnabled(false);
     setRootLink(0);
     
     if(impl->customizerHandle){
@@ -208,6 +243,8 @@ void Body::setRootLink(Link* link)
     if(rootLink_){
         rootLink_->setBody(this);
         updateLinkTree();
+    } else if(hasLinkStateBuffer_){
+        impl->releaseLinkStateBuffer();
     }
 }
 
@@ -275,6 +312,151 @@ void Body::updateLinkTree()
     }
 
     impl->mass = m;
+
+    if(hasLinkStateBuffer_){
+        impl->updateLinkStateBuffer(this);
+    }
+}
+
+
+void Body::setLinkStateBufferEnabled(bool on)
+{
+    if(on != hasLinkStateBuffer_){
+        hasLinkStateBuffer_ = on;
+        if(on){
+            impl->updateLinkStateBuffer(this);
+        } else {
+            impl->releaseLinkStateBuffer();
+        }
+    }
+}
+
+
+void BodyImpl::updateLinkStateBuffer(Body* body)
+{
+    const int n = body->numLinks();
+    std::unique_ptr<LinkStateBuffer> buffer(new LinkStateBuffer);
+    buffer->T.resize(n);
+    buffer->v.resize(n);
+    buffer->w.resize(n);
+    buffer->dv.resize(n);
+    buffer->dw.resize(n);
+    buffer->q.resize(n);
+    buffer->dq.resize(n);
+    buffer->ddq.resize(n);
+    buffer->parentIndices.resize(n);
+    buffer->links.reserve(n);
+
+    for(int i=0; i < n; ++i){
+        Link* link = body->link(i);
+        link->bindStateBuffer(
+            &buffer->T[i], &buffer->v[i], &buffer->w[i], &buffer->dv[i], &buffer->dw[i],
+            &buffer->q[i], &buffer->dq[i], &buffer->ddq[i]);
+        buffer->parentIndices[i] = link->parent() ? link->parent()->index() : -1;
+        buffer->links.push_back(link);
+    }
+
+    // The links removed from the tree still refer to the old buffer
+    if(linkStateBuffer && !linkStateBuffer->T.empty()){
+        const Position* begin = &linkStateBuffer->T.front();
+        const Position* end = begin + linkStateBuffer->T.size();
+        for(auto& link : linkStateBuffer->links){
+            if(link->pT_ >= begin && link->pT_ < end){
+                link->unbindStateBuffer();
+            }
+        }
+    }
+
+    linkStateBuffer = std::move(buffer);
+}
+
+
+void BodyImpl::releaseLinkStateBuffer()
+{
+    if(linkStateBuffer){
+        for(auto& link : linkStateBuffer->links){
+            link->unbindStateBuffer();
+        }
+        linkStateBuffer.reset();
+    }
+}
+
+
+/**
+   This is equivalent to LinkTraverse::calcForwardKinematics for the traverse from the root link,
+   but the states of a link and its parent are directly accessed in the arrays of the buffer.
+*/
+void Body::calcForwardKinematicsWithLinkStateBuffer(bool calcVelocity, bool calcAcceleration)
+{
+    LinkStateBuffer& buf = *impl->linkStateBuffer;
+    Vector3 arm;
+    const int n = buf.links.size();
+
+    for(int i=1; i < n; ++i){
+
+        const Link* link = buf.links[i];
+        const int j = buf.parentIndices[i];
+        const Position& Tp = buf.T[j];
+        Position& T = buf.T[i];
+
+        switch(link->jointType()){
+            
+        case Link::ROTATIONAL_JOINT:
+        {
+            T.linear().noalias() = Tp.linear() * AngleAxisd(buf.q[i], link->a());
+            arm.noalias() = Tp.linear() * link->b();
+            T.translation().noalias() = Tp.translation() + arm;
+
+            if(calcVelocity){
+                const Vector3 sw(Tp.linear() * link->a());
+                buf.w[i].noalias() = buf.w[j] + sw * buf.dq[i];
+                buf.v[i].noalias() = buf.v[j] + buf.w[j].cross(arm);
+
+                if(calcAcceleration){
+                    buf.dw[i].noalias() = buf.dw[j] + buf.dq[i] * buf.w[j].cross(sw) + (buf.ddq[i] * sw);
+                    buf.dv[i].noalias() = buf.dv[j] + buf.w[j].cross(buf.w[j].cross(arm)) + buf.dw[j].cross(arm);
+                }
+            }
+            break;
+        }
+        case Link::SLIDE_JOINT:
+        {
+            T.linear() = Tp.linear();
+            arm.noalias() = Tp.linear() * (link->b() + buf.q[i] * link->d());
+            T.translation() = Tp.translation() + arm;
+
+            if(calcVelocity){
+                const Vector3 sv(Tp.linear() * link->d());
+                buf.w[i] = buf.w[j];
+                buf.v[i].noalias() = buf.v[j] + sv * buf.dq[i];
+
+                if(calcAcceleration){
+                    buf.dw[i] = buf.dw[j];
+                    buf.dv[i].noalias() = buf.dv[j] + buf.w[j].cross(buf.w[j].cross(arm)) + buf.dw[j].cross(arm)
+                        + 2.0 * buf.dq[i] * buf.w[j].cross(sv) + buf.ddq[i] * sv;
+                }
+            }
+            break;
+        }
+        case Link::FIXED_JOINT:
+        default:
+            arm.noalias() = Tp.linear() * link->b();
+            T.linear() = Tp.linear();
+            T.translation().noalias() = arm + Tp.translation();
+
+            if(calcVelocity){
+                buf.w[i] = buf.w[j];
+                buf.v[i] = buf.v[j] + buf.w[j].cross(arm);
+
+                if(calcAcceleration){
+                    buf.dw[i] = buf.dw[j];
+                    buf.dv[i].noalias() = buf.dv[j] +
+                        buf.w[j].cross(buf.w[j].cross(arm)) + buf.dw[j].cross(arm);
+                }
+            }
+            break;
+        }
+    }
 }
 
 
@@ -748,3 +930,157 @@ BodyInterface* Body::bodyInterface()
 
     return &interface;
 }
+
+
+void Body::calcForwardKinematics(const MatrixXd& configurations, PositionArray& out_positions) const
+{
+    const int L = NUM_BATCH_LANES;
+    const int numConfigurations = configurations.rows();
+    const int n = numLinks();
+    out_positions.resize(numConfigurations * n);
+    if(numConfigurations == 0 || n == 0){
+        return;
+    }
+
+    struct JointInfo {
+        int parentIndex;
+        int type; // 0: revolute, 1: prismatic, 2: fixed
+        int column;
+        double q;
+        Vector3 a;
+        Vector3 b;
+    };
+    vector<JointInfo> joints(n);
+    for(int i=1; i < n; ++i){
+        const Link* link = this->link(i);
+        JointInfo& joint = joints[i];
+        joint.parentIndex = link->parent()->index();
+        if(link->isRevoluteJoint()){
+            joint.type = 0;
+        } else if(link->isPrismaticJoint()){
+            joint.type = 1;
+        } else {
+            joint.type = 2;
+        }
+        const int id = link->jointId();
+        joint.column = (id >= 0 && id < configurations.cols()) ? id : -1;
+        joint.q = link->q();
+        joint.a = link->a();
+        joint.b = link->b();
+    }
+    const Position T0 = rootLink_->T();
+
+    // The element e of link i for lane l is stored at ((i * 12) + e) * L + l.
+    // e = 0 ... 8 is the rotation in row-major order and e = 9 ... 11 is the translation.
+    auto calcBlock = [&](int block, vector<double>& x){
+        const int top = block * L;
+        double* x0 = &x[0];
+        for(int e=0; e < 9; ++e){
+            for(int l=0; l < L; ++l){
+                x0[e * L + l] = T0.linear()(e / 3, e % 3);
+            }
+        }
+        for(int e=0; e < 3; ++e){
+            for(int l=0; l < L; ++l){
+                x0[(9 + e) * L + l] = T0.translation()[e];
+            }
+        }
+        double q[L];
+        double Rj[9][L];
+        for(int i=1; i < n; ++i){
+            const JointInfo& joint = joints[i];
+            const double* xp = &x[joint.parentIndex * 12 * L];
+            double* xi = &x[i * 12 * L];
+            for(int l=0; l < L; ++l){
+                const int k = std::min(top + l, numConfigurations - 1);
+                q[l] = (joint.column >= 0) ? configurations(k, joint.column) : joint.q;
+            }
+            const Vector3& a = joint.a;
+            const Vector3& b = joint.b;
+
+            // The translation
+            if(joint.type == 1){
+                for(int r=0; r < 3; ++r){
+                    for(int l=0; l < L; ++l){
+                        xi[(9 + r) * L + l] = xp[(9 + r) * L + l] +
+                            xp[(r * 3) * L + l] * (b.x() + q[l] * a.x()) +
+                            xp[(r * 3 + 1) * L + l] * (b.y() + q[l] * a.y()) +
+                            xp[(r * 3 + 2) * L + l] * (b.z() + q[l] * a.z());
+                    }
+                }
+            } else {
+                for(int r=0; r < 3; ++r){
+                    for(int l=0; l < L; ++l){
+                        xi[(9 + r) * L + l] = xp[(9 + r) * L + l] +
+                            xp[(r * 3) * L + l] * b.x() +
+                            xp[(r * 3 + 1) * L + l] * b.y() +
+                            xp[(r * 3 + 2) * L + l] * b.z();
+                    }
+                }
+            }
+
+            // The rotation
+            if(joint.type != 0){
+                for(int e=0; e < 9 * L; ++e){
+                    xi[e] = xp[e];
+                }
+            } else {
+                for(int l=0; l < L; ++l){
+                    const double c = cos(q[l]);
+                    const double s = sin(q[l]);
+                    const double c1 = 1.0 - c;
+                    Rj[0][l] = c + c1 * a.x() * a.x();
+                    Rj[1][l] = c1 * a.x() * a.y() - s * a.z();
+                    Rj[2][l] = c1 * a.x() * a.z() + s * a.y();
+                    Rj[3][l] = c1 * a.y() * a.x() + s * a.z();
+                    Rj[4][l] = c + c1 * a.y() * a.y();
+                    Rj[5][l] = c1 * a.y() * a.z() - s * a.x();
+                    Rj[6][l] = c1 * a.z() * a.x() - s * a.y();
+                    Rj[7][l] = c1 * a.z() * a.y() + s * a.x();
+                    Rj[8][l] = c + c1 * a.z() * a.z();
+                }
+                for(int r=0; r < 3; ++r){
+                    for(int c=0; c < 3; ++c){
+                        for(int l=0; l < L; ++l){
+                            xi[(r * 3 + c) * L + l] =
+                                xp[(r * 3) * L + l] * Rj[c][l] +
+                                xp[(r * 3 + 1) * L + l] * Rj[3 + c][l] +
+                                xp[(r * 3 + 2) * L + l] * Rj[6 + c][l];
+                        }
+                    }
+                }
+            }
+        }
+
+        const int numLanes = std::min(L, numConfigurations - top);
+        for(int l=0; l < numLanes; ++l){
+            Position* T = &out_positions[(top + l) * n];
+            T[0] = T0;
+            for(int i=1; i < n; ++i){
+                const double* xi = &x[i * 12 * L];
+                auto& M = T[i].matrix();
+                for(int e=0; e < 9; ++e){
+                    M(e / 3, e % 3) = xi[e * L + l];
+                }
+                for(int e=0; e < 3; ++e){
+                    M(e, 3) = xi[(9 + e) * L + l];
+                }
+            }
+        }
+    };
+
+    const int numBlocks = (numConfigurations + L - 1) / L;
+    const int numTasks = (numBlocks + NUM_BATCH_BLOCKS_PER_TASK - 1) / NUM_BATCH_BLOCKS_PER_TASK;
+    auto calcTask = [&](int task){
+        vector<double> x(n * 12 * L);
+        const int end = std::min(numBlocks, (task + 1) * NUM_BATCH_BLOCKS_PER_TASK);
+        for(int block = task * NUM_BATCH_BLOCKS_PER_TASK; block < end; ++block){
+            calcBlock(block, x);
+        }
+    };
+    if(numTasks == 1){
+        calcTask(0);
+    } else {
+        ThreadPool::instance()->parallelFor(0, numTasks, calcTask, 1);
+    }
+}
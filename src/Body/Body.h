@@ -34,6 +34,7 @@ public:
     Body();
     Body(const Body& org);
 
+    //! The clone shares the shape nodes and the info mappings with the original body
     virtual Body* clone() const;
 
     virtual Link* createLink(const Link* org = 0) const;
@@ -212,8 +213,36 @@ public:
     void calcTotalMomentum(Vector3& out_P, Vector3& out_L);
 
     void calcForwardKinematics(bool calcVelocity = false, bool calcAcceleration = false) {
-        linkTraverse_.calcForwardKinematics(calcVelocity, calcAcceleration);
+        if(hasLinkStateBuffer_){
+            calcForwardKinematicsWithLinkStateBuffer(calcVelocity, calcAcceleration);
+        } else {
+            linkTraverse_.calcForwardKinematics(calcVelocity, calcAcceleration);
+        }
     }
+
+    /**
+       When the link state buffer is enabled, the positions, velocities, accelerations and
+       joint displacements of the links are stored in the arrays owned by the body in the
+       order of the link indices, and the accessors of the links refer to the elements.
+       The forward kinematics is then a sequential sweep over the arrays.
+       The pointers and references to the state obtained from the links before the change
+       of this mode or the link tree become invalid.
+    */
+    void setLinkStateBufferEnabled(bool on);
+
+    typedef std::vector<Position, Eigen::aligned_allocator<Position>> PositionArray;
+
+    /**
+       Computes the link positions for a set of joint configurations without changing
+       the state of the body. The root link is fixed at its current position, and the
+       displacements of the joints without joint ids are their current values.
+       \param configurations The joint displacements, where a row is a configuration
+       and a column corresponds to a joint id. The number of the columns must be numJoints().
+       \param out_positions The position of link i for configuration k is stored to
+       the element k * numLinks() + i.
+    */
+    void calcForwardKinematics(const MatrixXd& configurations, PositionArray& out_positions) const;
+    bool isLinkStateBufferEnabled() const { return hasLinkStateBuffer_; }
         
     void clearExternalForces();
 
@@ -277,6 +306,7 @@ private:
     LinkTraverse linkTraverse_;
     LinkPtr rootLink_;
     bool isStaticModel_;
+    bool hasLinkStateBuffer_;
     std::vector<LinkPtr> jointIdToLinkArray;
     int numActualJoints;
     DeviceList<> devices_;
@@ -293,6 +323,7 @@ private:
     void insertCache(const std::string& name, Referenced* cache);
     BodyHandler* findHandler(std::function<bool(BodyHandler*)> isTargetHandlerType);
     void setVirtualJointForcesSub(); // deprecated
+    void calcForwardKinematicsWithLinkStateBuffer(bool calcVelocity, bool calcAcceleration);
 };
 
 }
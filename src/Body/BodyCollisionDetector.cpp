@@ -280,6 +280,24 @@ bool BodyCollisionDetector::makeReady()
 }
 
 
+bool BodyCollisionDetector::setLinkCollisionFilter(Link* link, uint32_t category, uint32_t mask)
+{
+    if(auto handle = findGeometryHandle(link)){
+        impl->collisionDetector->setGeometryCollisionFilter(*handle, category, mask);
+        return true;
+    }
+    return false;
+}
+
+
+void BodyCollisionDetector::setBodyCollisionFilter(Body* body, uint32_t category, uint32_t mask)
+{
+    for(auto& link : body->links()){
+        setLinkCollisionFilter(link, category, mask);
+    }
+}
+
+
 boost::optional<CollisionDetector::GeometryHandle> BodyCollisionDetector::findGeometryHandle(Link* link)
 {
     auto iter = impl->linkToGeometryHandleMap.find(link);
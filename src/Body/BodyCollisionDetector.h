@@ -34,6 +34,17 @@ public:
                  std::function<Referenced*(Link* link, CollisionDetector::GeometryHandle geometry)> getObjectAssociatedWithLink);
     bool makeReady();
 
+    /**
+       Sets the collision filter of the geometry of a link, which can be changed after makeReady().
+       The geometry handle map must be enabled.
+       \return false if the link does not have a geometry
+       \see CollisionDetector::setGeometryCollisionFilter
+    */
+    bool setLinkCollisionFilter(Link* link, uint32_t category, uint32_t mask);
+
+    //! Sets the collision filter of all the links of a body
+    void setBodyCollisionFilter(Body* body, uint32_t category, uint32_t mask);
+
     void updatePositions();
     void updatePositions(std::function<void(Referenced* object, Position*& out_position)> positionQuery);
 
@@ -14,8 +14,12 @@
 #include <cnoid/Exception>
 #include <cnoid/FileUtil>
 #include <cnoid/NullOut>
+#include <cnoid/SceneGraph>
+#include <cnoid/MeshFilter>
+#include <cnoid/PhaseProfiler>
 #include <fmt/format.h>
 #include <mutex>
+#include <ctime>
 #include "gettext.h"
 
 using namespace std;
@@ -29,6 +33,57 @@ typedef function<AbstractBodyLoaderPtr()> LoaderFactory;
 map<string, LoaderFactory> loaderFactoryMap;
 mutex loaderMapMutex;
 
+struct FileStamp
+{
+    string filename;
+    std::time_t time;
+    uintmax_t size;
+};
+
+struct ModelCacheEntry
+{
+    BodyPtr body;
+    vector<FileStamp> fileStamps;
+    bool isShapeLoadingEnabled;
+    bool isVisualShapeLoadingEnabled;
+    int defaultDivisionNumber;
+    double defaultCreaseAngle;
+    bool isLODGenerationEnabled;
+    double collisionMeshReductionRatio;
+};
+
+map<string, ModelCacheEntry> modelCache;
+mutex modelCacheMutex;
+
+bool getFileStamp(const string& filename, FileStamp& out_stamp)
+{
+    boost::system::error_code ec;
+    out_stamp.filename = filename;
+    out_stamp.time = filesystem::last_write_time(filename, ec);
+    if(ec){
+        return false;
+    }
+    out_stamp.size = filesystem::file_size(filename, ec);
+    return !ec;
+}
+
+bool isFileUnchanged(const FileStamp& stamp)
+{
+    FileStamp current;
+    return getFileStamp(stamp.filename, current) && current.time == stamp.time && current.size == stamp.size;
+}
+
+/*
+  The cached model is used as a template of the instances. An instance only has its own links,
+  devices and extra joints, and the shape nodes and the info mappings are shared with the template
+  and the other instances. They are never modified after loading, and an instance which modifies
+  them must clone them by itself with Body::cloneShapes or Body::resetInfo.
+*/
+Body* instantiateModel(const Body* modelTemplate)
+{
+    return modelTemplate->clone();
+}
+
 class SceneLoaderAdapter : public AbstractBodyLoader
 {
     SceneLoader loader;
@@ -43,6 +98,10 @@ public:
         os = &os_;
     }
 
+    virtual void setVisualShapeLoadingEnabled(bool on) override {
+        loader.setAppearanceLoadingEnabled(on);
+    }
+
     virtual bool load(Body* body, const std::string& filename) override {
 
         body->clearDevices();
@@ -107,13 +166,19 @@ public:
     AbstractBodyLoaderPtr generalLoader;
     bool isVerbose;
     bool isShapeLoadingEnabled;
+    bool isVisualShapeLoadingEnabled;
     int defaultDivisionNumber;
     double defaultCreaseAngle;
+    bool isModelCacheEnabled;
+    bool isLODGenerationEnabled;
+    double collisionMeshReductionRatio;
 
     BodyLoaderImpl();
     ~BodyLoaderImpl();
     bool load(Body* body, const std::string& filename);
+    Body* loadWithModelCache(const std::string& filename);
     void mergeExtraLinkInfos(Body* body, Mapping* info);
+    void simplifyShapes(Body* body);
 };
 
 }
@@ -130,8 +195,12 @@ BodyLoaderImpl::BodyLoaderImpl()
     os = &nullout();
     isVerbose = false;
     isShapeLoadingEnabled = true;
+    isVisualShapeLoadingEnabled = true;
     defaultDivisionNumber = -1;
     defaultCreaseAngle = -1.0;
+    isModelCacheEnabled = false;
+    isLODGenerationEnabled = false;
+    collisionMeshReductionRatio = 1.0;
 }
 
 
@@ -163,6 +232,12 @@ void BodyLoader::setShapeLoadingEnabled(bool on)
 {
     impl->isShapeLoadingEnabled = on;
 }
+
+
+void BodyLoader::setVisualShapeLoadingEnabled(bool on)
+{
+    impl->isVisualShapeLoadingEnabled = on;
+}
     
 
 void BodyLoader::setDefaultDivisionNumber(int n)
@@ -179,13 +254,43 @@ void BodyLoader::setDefaultCreaseAngle(double theta)
 
 bool BodyLoader::load(Body* body, const std::string& filename)
 {
+    PhaseProfiler::Scope scope("Body loading", filename);
     body->info()->clear();    
     return impl->load(body, filename);
 }
 
 
+void BodyLoader::setModelCacheEnabled(bool on)
+{
+    impl->isModelCacheEnabled = on;
+}
+
+
+void BodyLoader::clearModelCache()
+{
+    lock_guard<mutex> lock(modelCacheMutex);
+    modelCache.clear();
+}
+
+
+void BodyLoader::setLODGenerationEnabled(bool on)
+{
+    impl->isLODGenerationEnabled = on;
+}
+
+
+void BodyLoader::setCollisionMeshReductionRatio(double ratio)
+{
+    impl->collisionMeshReductionRatio = ratio;
+}
+
+
 Body* BodyLoader::load(const std::string& filename)
 {
+    if(impl->isModelCacheEnabled){
+        return impl->loadWithModelCache(filename);
+    }
+    
     Body* body = new Body();
     if(load(body, filename)){
         return body;
@@ -227,6 +332,7 @@ bool BodyLoaderImpl::load(Body* body, const std::string& filename)
     actualLoader->setMessageSink(*os);
     actualLoader->setVerbose(isVerbose);
     actualLoader->setShapeLoadingEnabled(isShapeLoadingEnabled);
+    actualLoader->setVisualShapeLoadingEnabled(isVisualShapeLoadingEnabled);
     actualLoader->setDefaultDivisionNumber(defaultDivisionNumber);
     actualLoader->setDefaultCreaseAngle(defaultCreaseAngle);
 
@@ -243,12 +349,129 @@ bool BodyLoaderImpl::load(Body* body, const std::string& filename)
     } catch(const std::exception& ex){
         (*os) << ex.what();
     }
+
+    if(result && isShapeLoadingEnabled){
+        simplifyShapes(body);
+    }
+    
     os->flush();
     
     return result;
 }
 
 
+/**
+   The collision shapes are simplified before the levels of detail are generated so that the
+   collision shapes which are the same as the visual shapes do not have the levels.
+*/
+void BodyLoaderImpl::simplifyShapes(Body* body)
+{
+    const bool doReduceCollisionMeshes = collisionMeshReductionRatio > 0.0 && collisionMeshReductionRatio < 1.0;
+    if(!doReduceCollisionMeshes && !isLODGenerationEnabled){
+        return;
+    }
+    
+    PhaseProfiler::Scope scope("Mesh simplification");
+    MeshFilter meshFilter;
+    
+    for(auto& link : body->links()){
+        if(doReduceCollisionMeshes){
+            if(auto collisionShape = link->collisionShape()){
+                link->setCollisionShape(meshFilter.createSimplifiedScene(collisionShape, collisionMeshReductionRatio));
+            }
+        }
+        if(isLODGenerationEnabled){
+            if(auto visualShape = link->visualShape()){
+                const bool isCollisionShapeShared = (link->collisionShape() == visualShape);
+                SgNode* shape = meshFilter.generateLevelsOfDetail(visualShape);
+                link->setVisualShape(shape);
+                if(isCollisionShapeShared){
+                    link->setCollisionShape(shape);
+                }
+            }
+        }
+    }
+}
+
+
+Body* BodyLoaderImpl::loadWithModelCache(const std::string& filename)
+{
+    const string key = getAbsolutePathString(filesystem::path(filename));
+
+    {
+        lock_guard<mutex> lock(modelCacheMutex);
+        auto p = modelCache.find(key);
+        if(p != modelCache.end()){
+            auto& entry = p->second;
+            bool isValid =
+                entry.isShapeLoadingEnabled == isShapeLoadingEnabled &&
+                entry.isVisualShapeLoadingEnabled == isVisualShapeLoadingEnabled &&
+                entry.defaultDivisionNumber == defaultDivisionNumber &&
+                entry.defaultCreaseAngle == defaultCreaseAngle &&
+                entry.isLODGenerationEnabled == isLODGenerationEnabled &&
+                entry.collisionMeshReductionRatio == collisionMeshReductionRatio;
+            if(isValid){
+                for(auto& stamp : entry.fileStamps){
+                    if(!isFileUnchanged(stamp)){
+                        isValid = false;
+                        break;
+                    }
+                }
+            }
+            if(isValid){
+                return instantiateModel(entry.body);
+            }
+            modelCache.erase(p);
+        }
+    }
+
+    // The stamp of the main file is taken before loading so that a modification during the load is detected
+    ModelCacheEntry entry;
+    FileStamp mainFileStamp;
+    bool isCacheable = getFileStamp(key, mainFileStamp);
+    
+    BodyPtr body = new Body;
+    if(!load(body, filename)){
+        return nullptr;
+    }
+
+    vector<string> dependentFiles;
+    if(isCacheable && actualLoader->getDependentFiles(dependentFiles)){
+        entry.fileStamps.push_back(mainFileStamp);
+        for(auto& file : dependentFiles){
+            FileStamp stamp;
+            if(!getFileStamp(file, stamp)){
+                isCacheable = false;
+                break;
+            }
+            entry.fileStamps.push_back(stamp);
+        }
+        if(isCacheable){
+            entry.body = instantiateModel(body);
+            entry.isShapeLoadingEnabled = isShapeLoadingEnabled;
+            entry.isVisualShapeLoadingEnabled = isVisualShapeLoadingEnabled;
+            entry.defaultDivisionNumber = defaultDivisionNumber;
+            entry.defaultCreaseAngle = defaultCreaseAngle;
+            entry.isLODGenerationEnabled = isLODGenerationEnabled;
+            entry.collisionMeshReductionRatio = collisionMeshReductionRatio;
+            lock_guard<mutex> lock(modelCacheMutex);
+            modelCache[key] = entry;
+        }
+    }
+
+    return body.retn();
+}
+
+
+bool BodyLoader::getDependentFiles(std::vector<std::string>& out_files) const
+{
+    if(!impl->actualLoader){
+        return false;
+    }
+    return impl->actualLoader->getDependentFiles(out_files);
+}
+
+
 AbstractBodyLoaderPtr BodyLoader::lastActualBodyLoader() const
 {
     return impl->actualLoader;
@@ -24,12 +24,40 @@ public:
     virtual void setMessageSink(std::ostream& os);
     virtual void setVerbose(bool on);
     virtual void setShapeLoadingEnabled(bool on);
+    virtual void setVisualShapeLoadingEnabled(bool on);
     virtual void setDefaultDivisionNumber(int n);
     virtual void setDefaultCreaseAngle(double theta);
     virtual bool load(Body* body, const std::string& filename);
+    virtual bool getDependentFiles(std::vector<std::string>& out_files) const;
     Body* load(const std::string& filename);
     AbstractBodyLoaderPtr lastActualBodyLoader() const;
 
+    /**
+       The models loaded by load(const std::string& filename) are kept in the process-wide cache,
+       and the copies of the cached models are returned when the same files are loaded again with
+       the same settings. A cached model is loaded again when the main file or any dependent file
+       is modified, and the models of the loaders which do not track the dependent files are not
+       cached. The copies share the shape nodes and the info mappings with the cached model, and
+       only the links and the devices are copied. Call Body::cloneShapes or Body::resetInfo
+       before modifying the shared objects of a copy. The default value is false.
+    */
+    void setModelCacheEnabled(bool on);
+    static void clearModelCache();
+
+    /**
+       The levels of detail of the visual shapes are generated by MeshFilter::generateLevelsOfDetail
+       when the model is loaded. The generated levels are also kept in the model cache.
+       The default value is false.
+    */
+    void setLODGenerationEnabled(bool on);
+
+    /**
+       The meshes of the collision shapes are simplified to the given ratio of the triangles when the
+       model is loaded. The visual shapes are not affected. The meshes are not simplified when the
+       ratio is not less than 1.0, which is the default value.
+    */
+    void setCollisionMeshReductionRatio(double ratio);
+
 private:
     BodyLoaderImpl* impl;
 };
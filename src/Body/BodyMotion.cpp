@@ -10,7 +10,16 @@
 #include <cnoid/Vector3Seq>
 #include <cnoid/YAMLReader>
 #include <cnoid/YAMLWriter>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/filesystem.hpp>
 #include <fmt/format.h>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include "gettext.h"
 
 using namespace std;
@@ -19,6 +28,72 @@ using fmt::format;
 
 namespace {
 //bool TRACE_FUNCTIONS = false;
+
+/*
+  The binary format begins with BinaryHeader, which is followed by the entries of the sequences.
+  Each entry is followed by the name of the sequence, which is padded to a multiple of eight bytes.
+  The data of each sequence is the array of the double values in the order of frames, which begins
+  at an aligned offset so that the values are accessed directly in the memory mapped file.
+  The data of the joint position sequence is followed by a spare frame filled with zeros so that
+  the mapped data can be used as the storage of the sequence without copying.
+*/
+const char binaryFormatMagic[8] = { 'C', 'N', 'O', 'I', 'D', 'M', 'O', 'T' };
+const uint32_t binaryFormatVersion = 1;
+const uint32_t binaryFormatByteOrderMark = 0x01020304;
+const int64_t binaryDataAlignment = 64;
+
+enum BinarySeqType {
+    BINARY_JOINT_POSITION_SEQ = 1,
+    BINARY_LINK_POSITION_SEQ = 2,
+    BINARY_VECTOR3_SEQ = 3
+};
+
+enum BinarySeqFlag {
+    BINARY_ZMP_ROOT_RELATIVE = 1
+};
+
+struct BinaryHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    double frameRate;
+    double offsetTime;
+    int32_t numSeqs;
+    int32_t reserved;
+};
+
+struct BinarySeqEntry
+{
+    int32_t type;
+    int32_t numFrames;
+    int32_t numParts;
+    int32_t flags;
+    int32_t nameSize;
+    int32_t reserved;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+};
+
+static_assert(sizeof(BinaryHeader) == 40, "Unexpected padding in BinaryHeader");
+static_assert(sizeof(BinarySeqEntry) == 40, "Unexpected padding in BinarySeqEntry");
+
+int64_t alignOffset(int64_t offset, int64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+//! The number of the double values of an element
+int getBinarySeqElementSize(int type)
+{
+    switch(type){
+    case BINARY_JOINT_POSITION_SEQ: return 1;
+    case BINARY_LINK_POSITION_SEQ:  return 7;
+    case BINARY_VECTOR3_SEQ:        return 3;
+    default: return 0;
+    }
+}
+
 }
 
 
@@ -139,6 +214,23 @@ void BodyMotion::setNumFrames(int n, bool clearNewArea)
 }
 
 
+void BodyMotion::countMemoryUsage(MemoryUsageCounter& counter) const
+{
+    AbstractSeq::countMemoryUsage(counter);
+    if(counter.visit(linkPosSeq_.get())){
+        linkPosSeq_->countMemoryUsage(counter);
+    }
+    if(counter.visit(jointPosSeq_.get())){
+        jointPosSeq_->countMemoryUsage(counter);
+    }
+    for(auto& kv : extraSeqs){
+        if(counter.visit(kv.second.get())){
+            kv.second->countMemoryUsage(counter);
+        }
+    }
+}
+
+
 double BodyMotion::getOffsetTime() const
 {
     return linkPosSeq_->offsetTime();
@@ -284,8 +376,14 @@ Body& operator<<(Body& body, BodyMotion::ConstFrame frame)
 
 bool BodyMotion::load(const std::string& filename, std::ostream& os)
 {
+    if(isBinaryFile(filename)){
+        return loadBinary(filename, os);
+    }
+    
     YAMLReader reader;
     reader.expectRegularMultiListing();
+    // The loaded nodes are only used while the reader exists
+    reader.setArenaAllocationEnabled(true);
     bool result = false;
 
     try {
@@ -480,3 +578,331 @@ bool BodyMotion::save(const std::string& filename, double version, std::ostream&
 
     return writeSeq(writer);
 }
+
+
+bool BodyMotion::isBinaryFile(const std::string& filename)
+{
+    ifstream ifs(filename.c_str(), ios::in | ios::binary);
+    char magic[sizeof(binaryFormatMagic)];
+    if(ifs.read(magic, sizeof(magic))){
+        return std::memcmp(magic, binaryFormatMagic, sizeof(magic)) == 0;
+    }
+    return false;
+}
+
+
+bool BodyMotion::saveBinary(const std::string& filename, std::ostream& os)
+{
+    struct SeqSource {
+        BinarySeqEntry entry;
+        string name;
+        std::function<void(ofstream& ofs)> writeData;
+        int64_t spareSize;
+    };
+    vector<SeqSource> sources;
+
+    auto addSource = [&](int type, const string& name, int numFrames, int numParts, int flags,
+                         std::function<void(ofstream& ofs)> writeData, int64_t spareSize = 0){
+        SeqSource source;
+        BinarySeqEntry& entry = source.entry;
+        std::memset(&entry, 0, sizeof(entry));
+        entry.type = type;
+        entry.numFrames = numFrames;
+        entry.numParts = numParts;
+        entry.flags = flags;
+        entry.nameSize = name.size();
+        entry.dataSize = static_cast<uint64_t>(numFrames) * numParts * getBinarySeqElementSize(type) * sizeof(double);
+        source.name = name;
+        source.writeData = writeData;
+        source.spareSize = spareSize;
+        sources.push_back(source);
+    };
+
+    auto jointPosSeq = jointPosSeq_;
+    if(jointPosSeq->numFrames() > 0){
+        addSource(
+            BINARY_JOINT_POSITION_SEQ, jointPosSeq->seqContentName(),
+            jointPosSeq->numFrames(), jointPosSeq->numParts(), 0,
+            [jointPosSeq](ofstream& ofs){
+                const int n = jointPosSeq->numParts();
+                for(int i=0; i < jointPosSeq->numFrames(); ++i){
+                    auto frame = jointPosSeq->frame(i);
+                    ofs.write(reinterpret_cast<const char*>(frame.begin()), n * sizeof(double));
+                }
+                const vector<double> spareFrame(n, 0.0);
+                ofs.write(reinterpret_cast<const char*>(spareFrame.data()), n * sizeof(double));
+            },
+            jointPosSeq->numParts() * sizeof(double));
+    }
+
+    auto linkPosSeq = linkPosSeq_;
+    if(linkPosSeq->numFrames() > 0){
+        addSource(
+            BINARY_LINK_POSITION_SEQ, linkPosSeq->seqContentName(),
+            linkPosSeq->numFrames(), linkPosSeq->numParts(), 0,
+            [linkPosSeq](ofstream& ofs){
+                const int n = linkPosSeq->numParts();
+                vector<double> buf(n * 7);
+                for(int i=0; i < linkPosSeq->numFrames(); ++i){
+                    auto frame = linkPosSeq->frame(i);
+                    double* p = &buf.front();
+                    for(int j=0; j < n; ++j){
+                        const Vector3& t = frame[j].translation();
+                        const Quat& q = frame[j].rotation();
+                        p[0] = t.x();
+                        p[1] = t.y();
+                        p[2] = t.z();
+                        p[3] = q.w();
+                        p[4] = q.x();
+                        p[5] = q.y();
+                        p[6] = q.z();
+                        p += 7;
+                    }
+                    ofs.write(reinterpret_cast<const char*>(&buf.front()), buf.size() * sizeof(double));
+                }
+            });
+    }
+
+    for(auto& kv : extraSeqs){
+        auto vector3Seq = std::dynamic_pointer_cast<Vector3Seq>(kv.second);
+        if(!vector3Seq){
+            os << format(_("Extra sequence \"{}\" is not saved because its type is not supported "
+                           "in the binary format."), kv.first) << endl;
+            continue;
+        }
+        int flags = 0;
+        if(auto zmpSeq = std::dynamic_pointer_cast<ZMPSeq>(vector3Seq)){
+            if(zmpSeq->isRootRelative()){
+                flags |= BINARY_ZMP_ROOT_RELATIVE;
+            }
+        }
+        addSource(
+            BINARY_VECTOR3_SEQ, kv.first, vector3Seq->numFrames(), 1, flags,
+            [vector3Seq](ofstream& ofs){
+                for(int i=0; i < vector3Seq->numFrames(); ++i){
+                    ofs.write(reinterpret_cast<const char*>((*vector3Seq)[i].data()), 3 * sizeof(double));
+                }
+            });
+    }
+
+    // Determine the offset of each sequence data
+    int64_t offset = sizeof(BinaryHeader);
+    for(auto& source : sources){
+        offset = alignOffset(offset + sizeof(BinarySeqEntry) + source.name.size(), 8);
+    }
+    for(auto& source : sources){
+        offset = alignOffset(offset, binaryDataAlignment);
+        source.entry.dataOffset = offset;
+        offset += source.entry.dataSize + source.spareSize;
+    }
+
+    /*
+      The data is written to a temporary file which replaces the target file at the end because
+      the target file may be mapped as the storage of this motion or another one.
+    */
+    const string tmpFilename = filename + ".tmp";
+    ofstream ofs(tmpFilename.c_str(), ios::out | ios::binary | ios::trunc);
+    if(!ofs.is_open()){
+        os << format(_("\"{}\" cannot be opened."), filename) << endl;
+        return false;
+    }
+
+    auto writePadding = [&ofs](int64_t alignment){
+        static const char zeros[binaryDataAlignment] = { 0 };
+        const int64_t pos = ofs.tellp();
+        ofs.write(zeros, alignOffset(pos, alignment) - pos);
+    };
+
+    BinaryHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, binaryFormatMagic, sizeof(header.magic));
+    header.version = binaryFormatVersion;
+    header.byteOrderMark = binaryFormatByteOrderMark;
+    header.frameRate = frameRate();
+    header.offsetTime = getOffsetTime();
+    header.numSeqs = sources.size();
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for(auto& source : sources){
+        ofs.write(reinterpret_cast<const char*>(&source.entry), sizeof(source.entry));
+        ofs.write(source.name.data(), source.name.size());
+        writePadding(8);
+    }
+    for(auto& source : sources){
+        writePadding(binaryDataAlignment);
+        source.writeData(ofs);
+    }
+
+    ofs.close();
+    
+    if(!ofs){
+        os << format(_("Writing \"{}\" failed."), filename) << endl;
+        boost::system::error_code ec;
+        boost::filesystem::remove(tmpFilename, ec);
+        return false;
+    }
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmpFilename, filename, ec);
+    if(ec){
+        os << format(_("Writing \"{0}\" failed: {1}"), filename, ec.message()) << endl;
+        boost::filesystem::remove(tmpFilename, ec);
+        return false;
+    }
+    return true;
+}
+
+
+void BodyMotion::prefetchFrames(int frameBegin, int frameEnd) const
+{
+#ifndef _WIN32
+    if(!jointPosSeq_->hasExternalBuffer()){
+        return;
+    }
+    const int numFrames = jointPosSeq_->numFrames();
+    frameBegin = std::max(frameBegin, 0);
+    frameEnd = std::min(frameEnd, numFrames);
+    if(frameBegin >= frameEnd){
+        return;
+    }
+    const int numParts = jointPosSeq_->numParts();
+    const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(&jointPosSeq_->at(frameBegin, 0));
+    const uintptr_t end = reinterpret_cast<uintptr_t>(&jointPosSeq_->at(frameEnd - 1, 0) + numParts);
+    if(end <= begin){ // The rows wrap around the ring buffer
+        return;
+    }
+    const uintptr_t alignedBegin = begin / pageSize * pageSize;
+    posix_madvise(reinterpret_cast<void*>(alignedBegin), end - alignedBegin, POSIX_MADV_WILLNEED);
+#endif
+}
+
+
+bool BodyMotion::loadBinary(const std::string& filename, std::ostream& os)
+{
+    /*
+      The file is mapped as the private mapping so that the joint position sequence can use the
+      mapped data as its storage and the modification of the sequence does not change the file.
+    */
+    auto file = std::make_shared<boost::iostreams::mapped_file>();
+    try {
+        boost::iostreams::mapped_file_params params(filename);
+        params.flags = boost::iostreams::mapped_file::priv;
+        file->open(params);
+    } catch(const std::exception& ex){
+        os << format(_("\"{}\" cannot be opened."), filename) << endl;
+        return false;
+    }
+    char* data = file->data();
+    const uint64_t fileSize = file->size();
+
+    BinaryHeader header;
+    if(fileSize < sizeof(header)){
+        os << format(_("\"{}\" is not a body motion file."), filename) << endl;
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if(std::memcmp(header.magic, binaryFormatMagic, sizeof(header.magic)) != 0){
+        os << format(_("\"{}\" is not a body motion file."), filename) << endl;
+        return false;
+    }
+    if(header.byteOrderMark != binaryFormatByteOrderMark){
+        os << _("The byte order of the binary body motion file is different from that of this platform.") << endl;
+        return false;
+    }
+    if(header.version > binaryFormatVersion){
+        os << format(_("Format version {} is not supported"), header.version) << endl;
+        return false;
+    }
+
+    setDimension(0, 1, 1);
+    
+    uint64_t pos = sizeof(header);
+    for(int i=0; i < header.numSeqs; ++i){
+        BinarySeqEntry entry;
+        if(pos + sizeof(entry) > fileSize){
+            os << _("The binary body motion file is truncated.") << endl;
+            setDimension(0, 1, 1);
+            return false;
+        }
+        std::memcpy(&entry, data + pos, sizeof(entry));
+        pos += sizeof(entry);
+        if(entry.nameSize < 0 || pos + entry.nameSize > fileSize){
+            os << _("The binary body motion file is truncated.") << endl;
+            setDimension(0, 1, 1);
+            return false;
+        }
+        const string name(data + pos, entry.nameSize);
+        pos = alignOffset(pos + entry.nameSize, 8);
+
+        const int elementSize = getBinarySeqElementSize(entry.type);
+        if(elementSize == 0){
+            os << format(_("Sequence \"{0}\" has unknown type {1}."), name, entry.type) << endl;
+            continue;
+        }
+        const int numFrames = entry.numFrames;
+        const int numParts = entry.numParts;
+        if(numFrames < 0 || numParts < 0 ||
+           entry.dataSize != static_cast<uint64_t>(numFrames) * numParts * elementSize * sizeof(double) ||
+           entry.dataOffset % sizeof(double) != 0 ||
+           entry.dataOffset + entry.dataSize > fileSize){
+            os << format(_("The data of sequence \"{}\" is broken."), name) << endl;
+            setDimension(0, 1, 1);
+            return false;
+        }
+        const double* values = reinterpret_cast<const double*>(data + entry.dataOffset);
+        
+        switch(entry.type){
+
+        case BINARY_JOINT_POSITION_SEQ:
+            if(numFrames > 0 && numParts > 0 &&
+               entry.dataOffset + entry.dataSize + numParts * sizeof(double) <= fileSize){
+                // The mapped pages are read on demand and the kernel evicts them when memory is short
+                jointPosSeq_->setExternalBuffer(
+                    reinterpret_cast<double*>(data + entry.dataOffset), numFrames, numParts, file);
+                break;
+            }
+            jointPosSeq_->setDimension(numFrames, numParts);
+            for(int j=0; j < numFrames; ++j){
+                auto frame = jointPosSeq_->frame(j);
+                std::copy(values, values + numParts, frame.begin());
+                values += numParts;
+            }
+            break;
+
+        case BINARY_LINK_POSITION_SEQ:
+            linkPosSeq_->setDimension(numFrames, numParts);
+            for(int j=0; j < numFrames; ++j){
+                auto frame = linkPosSeq_->frame(j);
+                for(int k=0; k < numParts; ++k){
+                    frame[k].set(Vector3(values[0], values[1], values[2]),
+                                 Quat(values[3], values[4], values[5], values[6]));
+                    values += 7;
+                }
+            }
+            break;
+
+        case BINARY_VECTOR3_SEQ:
+        {
+            std::shared_ptr<Vector3Seq> seq;
+            if(name == ZMPSeq::key()){
+                auto zmpSeq = getOrCreateZMPSeq(*this);
+                zmpSeq->setRootRelative(entry.flags & BINARY_ZMP_ROOT_RELATIVE);
+                seq = zmpSeq;
+            } else {
+                seq = getOrCreateExtraSeq<Vector3Seq>(name);
+            }
+            seq->setNumFrames(numFrames);
+            for(int j=0; j < numFrames; ++j){
+                (*seq)[j] = Vector3(values[0], values[1], values[2]);
+                values += 3;
+            }
+            break;
+        }
+        }
+    }
+
+    setFrameRate(header.frameRate);
+    setOffsetTime(header.offsetTime);
+    
+    return true;
+}
@@ -46,6 +46,9 @@ public:
     virtual int getNumFrames() const override;
     virtual void setNumFrames(int n, bool clearNewArea = false) override;
 
+    //! The sequences shared with other objects are counted only once
+    virtual void countMemoryUsage(MemoryUsageCounter& counter) const override;
+
     std::shared_ptr<MultiSE3Seq> linkPosSeq() {
         return linkPosSeq_;
     }
@@ -95,10 +98,30 @@ public:
     Frame frame(int frame) { return Frame(*this, frame); }
     ConstFrame frame(int frame) const { return ConstFrame(*this, frame); }
 
+    /**
+       The file of the binary format is also loaded by this function.
+    */
     bool load(const std::string& filename, std::ostream& os = nullout());
     bool save(const std::string& filename, std::ostream& os = nullout());
     bool save(const std::string& filename, double version, std::ostream& os = nullout());
 
+    /**
+       The binary format stores the sequences as the arrays of the native double values.
+       The joint position sequence directly uses the privately mapped file as its storage,
+       whose frames are read on demand, and the other sequences are copied from the file.
+       The YAML format should be used for the interchange between the different platforms.
+       The extra sequences other than Vector3Seq are not supported in the binary format.
+    */
+    bool loadBinary(const std::string& filename, std::ostream& os = nullout());
+    bool saveBinary(const std::string& filename, std::ostream& os = nullout());
+    static bool isBinaryFile(const std::string& filename);
+
+    /**
+       Requests to read the frames in the given range in advance when the joint position
+       sequence uses the mapped file of the binary format. Nothing is done otherwise.
+    */
+    void prefetchFrames(int frameBegin, int frameEnd) const;
+
     typedef std::map<std::string, std::shared_ptr<AbstractSeq>> ExtraSeqMap;
     typedef ExtraSeqMap::const_iterator ConstSeqIterator;
         
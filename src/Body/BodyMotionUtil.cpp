@@ -10,13 +10,16 @@
 #include "ForceSensor.h"
 #include "RateGyroSensor.h"
 #include "AccelerationSensor.h"
+#include "BatchInverseDynamics.h"
 #include <cnoid/EigenUtil>
 #include <cnoid/Vector3Seq>
 #include <cnoid/GaussianFilter>
 #include <cnoid/RangeLimiter>
+#include <cnoid/ThreadPool>
 #include <cnoid/FileUtil>
 #include <fmt/format.h>
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <limits>
 #include <cmath>
@@ -28,6 +31,8 @@ using namespace cnoid;
 using fmt::format;
 namespace filesystem = boost::filesystem;
 
+static const size_t maxPlainFormatBufferSize = 1024 * 1024;
+
 static bool saveRootLinkAttAsRpyFormat(BodyMotion& motion, const std::string& filename, std::ostream& os)
 {
     auto linkPosSeq = motion.linkPosSeq();
@@ -43,6 +48,7 @@ static bool saveRootLinkAttAsRpyFormat(BodyMotion& motion, const std::string& fi
             
         const double r = linkPosSeq->frameRate();
         MultiSE3Seq::Part root = linkPosSeq->part(0);
+        fmt::memory_buffer buf;
         for(int i=0; i < nFrames; ++i){
             Vector3 rpy(rpyFromRot(Matrix3(root[i].rotation())));
             for(int j=0; j < 3; ++j){
@@ -50,8 +56,13 @@ static bool saveRootLinkAttAsRpyFormat(BodyMotion& motion, const std::string& fi
                     rpy[j] = 0.0;
                 }
             }
-            ofs << format("{0:.4f} {1:g} {2:g} {3:g}\n", (i / r), rpy[0], rpy[1], rpy[2]);
+            fmt::format_to(buf, "{0:.4f} {1:g} {2:g} {3:g}\n", (i / r), rpy[0], rpy[1], rpy[2]);
+            if(buf.size() >= maxPlainFormatBufferSize){
+                ofs.write(buf.data(), buf.size());
+                buf.clear();
+            }
         }
+        ofs.write(buf.data(), buf.size());
             
         return true;
     }
@@ -92,6 +103,7 @@ static bool saveRootLinkAccAsGsensFile(BodyMotion& motion, Body* body, const std
         calcLinkAccSeq(*linkPosSeq, gsens, 0, nFrames, accSeq);
 
         const double r = linkPosSeq->frameRate();
+        fmt::memory_buffer buf;
         for(int i=0; i < nFrames; ++i){
             Vector3 a = accSeq[i];
             for(int j=0; j < 3; ++j){
@@ -99,8 +111,13 @@ static bool saveRootLinkAccAsGsensFile(BodyMotion& motion, Body* body, const std
                     a[j] = 0.0;
                 }
             }
-            ofs << format("{0:.4f} {1:g} {2:g} {3:g}\n", (i / r), a[0], a[1], a[2]);
+            fmt::format_to(buf, "{0:.4f} {1:g} {2:g} {3:g}\n", (i / r), a[0], a[1], a[2]);
+            if(buf.size() >= maxPlainFormatBufferSize){
+                ofs.write(buf.data(), buf.size());
+                buf.clear();
+            }
         }
+        ofs.write(buf.data(), buf.size());
             
         return true;
     }
@@ -145,6 +162,156 @@ void cnoid::calcLinkAccSeq
 }
 
 
+/**
+   The derivatives of the rows are calculated by the central differences.
+   The one-sided differences are used for the first and the last rows.
+*/
+static void calcRowDerivatives(const MatrixXd& x, double dt, MatrixXd& out_dx, MatrixXd& out_ddx)
+{
+    const int n = x.rows();
+    out_dx.setZero(n, x.cols());
+    out_ddx.setZero(n, x.cols());
+    if(n < 2){
+        return;
+    }
+    out_dx.row(0) = (x.row(1) - x.row(0)) / dt;
+    out_dx.row(n - 1) = (x.row(n - 1) - x.row(n - 2)) / dt;
+    if(n >= 3){
+        out_dx.middleRows(1, n - 2) = (x.bottomRows(n - 2) - x.topRows(n - 2)) / (2.0 * dt);
+        out_ddx.middleRows(1, n - 2) =
+            (x.bottomRows(n - 2) - 2.0 * x.middleRows(1, n - 2) + x.topRows(n - 2)) / (dt * dt);
+        out_ddx.row(0) = out_ddx.row(1);
+        out_ddx.row(n - 1) = out_ddx.row(n - 2);
+    }
+}
+
+
+bool cnoid::calcZMPAndJointTorqueSeqs
+(Body* body, const BodyMotion& motion, ZMPSeq* out_zmpSeq, MultiValueSeq* out_jointTorqueSeq, double zmpHeight)
+{
+    const int numFrames = motion.numFrames();
+    if(numFrames == 0){
+        return false;
+    }
+    const double frameRate = motion.frameRate();
+    const double dt = 1.0 / frameRate;
+    const int numJoints = body->numJoints();
+
+    auto qseq = motion.jointPosSeq();
+    const int numJointParts = std::min(numJoints, qseq->numParts());
+    MatrixXd q = MatrixXd::Zero(numFrames, numJoints);
+    for(int i=0; i < std::min(numFrames, qseq->numFrames()); ++i){
+        auto frame = qseq->frame(i);
+        for(int j=0; j < numJointParts; ++j){
+            q(i, j) = frame[j];
+        }
+    }
+    MatrixXd dq, ddq;
+    calcRowDerivatives(q, dt, dq, ddq);
+
+    BatchInverseDynamics inverseDynamics(body);
+    inverseDynamics.setGravityAcceleration(Vector3(0.0, 0.0, -9.80665));
+
+    // The root link position sequence is used if the motion has it
+    BatchInverseDynamics::RootStateArray rootStates;
+    auto pseq = motion.linkPosSeq();
+    const bool hasRootSeq = (pseq->numParts() > 0 && pseq->numFrames() >= numFrames);
+    if(hasRootSeq){
+        rootStates.resize(numFrames);
+        MatrixXd p(numFrames, 3);
+        MatrixXd w(numFrames, 3);
+        for(int i=0; i < numFrames; ++i){
+            const SE3& T = pseq->at(i, 0);
+            rootStates[i].T.translation() = T.translation();
+            rootStates[i].T.linear() = T.rotation().toRotationMatrix();
+            p.row(i) = T.translation().transpose();
+        }
+        for(int i=0; i < numFrames; ++i){
+            const int prev = std::max(0, i - 1);
+            const int next = std::min(numFrames - 1, i + 1);
+            if(next == prev){
+                w.row(i).setZero();
+            } else {
+                const Matrix3 R = rootStates[next].T.linear() * rootStates[prev].T.linear().transpose();
+                w.row(i) = omegaFromRot(R).transpose() / ((next - prev) * dt);
+            }
+        }
+        MatrixXd v, dv, dw, ddw;
+        calcRowDerivatives(p, dt, v, dv);
+        calcRowDerivatives(w, dt, dw, ddw);
+        for(int i=0; i < numFrames; ++i){
+            auto& state = rootStates[i];
+            state.v = v.row(i).transpose();
+            state.w = w.row(i).transpose();
+            state.dv = dv.row(i).transpose();
+            state.dw = dw.row(i).transpose();
+        }
+    }
+
+    MatrixXd u;
+    BatchInverseDynamics::Vector6Array rootForces;
+    inverseDynamics.calcInverseDynamics(
+        q, dq, ddq, hasRootSeq ? &rootStates : nullptr, u, out_zmpSeq ? &rootForces : nullptr);
+
+    if(out_zmpSeq){
+        out_zmpSeq->setFrameRate(frameRate);
+        out_zmpSeq->setNumFrames(numFrames);
+        out_zmpSeq->setRootRelative(false);
+        for(int i=0; i < numFrames; ++i){
+            const Vector6& f = rootForces[i];
+            Vector3& zmp = (*out_zmpSeq)[i];
+            if(f[2] > 1.0e-6){
+                zmp.x() = (zmpHeight * f[0] - f[4]) / f[2];
+                zmp.y() = (zmpHeight * f[1] + f[3]) / f[2];
+            } else {
+                // The body is not supported by the ground
+                const Position& T = hasRootSeq ? rootStates[i].T : inverseDynamics.rootState().T;
+                const Vector3 p = T.translation();
+                zmp.x() = p.x();
+                zmp.y() = p.y();
+            }
+            zmp.z() = zmpHeight;
+        }
+    }
+
+    if(out_jointTorqueSeq){
+        out_jointTorqueSeq->setFrameRate(frameRate);
+        out_jointTorqueSeq->setDimension(numFrames, numJoints);
+        for(int i=0; i < numFrames; ++i){
+            auto frame = out_jointTorqueSeq->frame(i);
+            for(int j=0; j < numJoints; ++j){
+                frame[j] = u(i, j);
+            }
+        }
+    }
+
+    return true;
+}
+
+
+namespace {
+
+/**
+   A member file of a hrpsys sequence file set, which is loaded or saved in a task.
+   The messages are output after all the tasks finish.
+*/
+struct HrpsysSeqMemberFile
+{
+    HrpsysSeqMemberFile(const filesystem::path& orgpath, const char* extension){
+        filesystem::path path = filesystem::change_extension(orgpath, extension);
+        exists = filesystem::exists(path) && !filesystem::is_directory(path);
+        filename = getNativePathString(path);
+        isDone = false;
+    }
+    string filename;
+    bool exists;
+    bool isDone;
+    ostringstream message;
+};
+
+}
+
+
 bool cnoid::loadHrpsysSeqFileSet(BodyMotion& motion, const std::string& filename, std::ostream& os)
 {
     motion.setNumFrames(0);
@@ -153,76 +320,97 @@ bool cnoid::loadHrpsysSeqFileSet(BodyMotion& motion, const std::string& filename
     
     bool loaded = false;
 
-    shared_ptr<MultiValueSeq> jointPosSeq;
-    filesystem::path posFile = filesystem::change_extension(orgpath, ".pos");
-    if(filesystem::exists(posFile) && !filesystem::is_directory(posFile)){
-        string posFileString = getNativePathString(posFile);
-        jointPosSeq = motion.jointPosSeq();
-        if(!jointPosSeq->loadPlainFormat(posFileString)){
-            os << jointPosSeq->seqMessage();
-            jointPosSeq.reset();
-        } else {
-            if(posFileString == filename){
-                loaded = true;
-            }
+    HrpsysSeqMemberFile posFile(orgpath, ".pos");
+    HrpsysSeqMemberFile hipFile(orgpath, ".hip");
+    HrpsysSeqMemberFile waistFile(orgpath, ".waist");
+    HrpsysSeqMemberFile zmpFile(orgpath, ".zmp");
+
+    shared_ptr<MultiValueSeq> jointPosSeq = motion.jointPosSeq();
+    shared_ptr<MultiSE3Seq> linkPosSeq = motion.linkPosSeq();
+
+    /*
+      The member files are loaded in parallel. The .hip file is loaded into a separate sequence
+      because the .waist file also gives the root link positions and has priority over it.
+    */
+    MultiSE3Seq rootLinkAttSeq;
+    ZMPSeq loadedZmpSeq;
+    ThreadPool::TaskGroup tasks;
+    if(posFile.exists){
+        tasks.run([&](){
+                posFile.isDone = jointPosSeq->loadPlainFormat(posFile.filename, posFile.message); });
+    }
+    if(hipFile.exists){
+        tasks.run([&](){
+                hipFile.isDone = rootLinkAttSeq.loadPlainRpyFormat(hipFile.filename, hipFile.message); });
+    }
+    if(waistFile.exists){
+        tasks.run([&](){
+                waistFile.isDone = linkPosSeq->loadPlainMatrixFormat(waistFile.filename, waistFile.message); });
+    }
+    // The ZMP is only used with the joint positions or the root link positions
+    if(zmpFile.exists && (posFile.exists || waistFile.exists)){
+        tasks.run([&](){
+                zmpFile.isDone = loadedZmpSeq.loadPlainFormat(zmpFile.filename, zmpFile.message); });
+    }
+    tasks.wait();
+
+    if(!posFile.isDone){
+        if(posFile.exists){
+            os << posFile.message.str();
         }
+        jointPosSeq.reset();
+    } else if(posFile.filename == filename){
+        loaded = true;
     }
 
-    shared_ptr<MultiSE3Seq> rootLinkAttSeq;
-    filesystem::path hipFile = filesystem::change_extension(orgpath, ".hip");
-    if(filesystem::exists(hipFile) && !filesystem::is_directory(hipFile)){
-        string hipFileString = getNativePathString(hipFile);
-        rootLinkAttSeq = motion.linkPosSeq();
-        if(!rootLinkAttSeq->loadPlainRpyFormat(hipFileString)){
-            os << rootLinkAttSeq->seqMessage();
-            rootLinkAttSeq.reset();
+    if(hipFile.exists){
+        if(!hipFile.isDone){
+            os << hipFile.message.str();
         } else {
-            if(hipFileString == filename){
+            if(!waistFile.isDone){
+                linkPosSeq->setDimension(rootLinkAttSeq.numFrames(), rootLinkAttSeq.numParts());
+                linkPosSeq->setFrameRate(rootLinkAttSeq.frameRate());
+                for(int i=0; i < rootLinkAttSeq.numFrames(); ++i){
+                    auto src = rootLinkAttSeq.frame(i);
+                    std::copy(src.begin(), src.end(), linkPosSeq->frame(i).begin());
+                }
+            }
+            if(hipFile.filename == filename){
                 loaded = true;
             }
         }
     }
 
-    shared_ptr<MultiSE3Seq> linkPosSeq;
-    filesystem::path waistFile = filesystem::change_extension(orgpath, ".waist");
-    if(filesystem::exists(waistFile) && !filesystem::is_directory(waistFile)){
-        string waistFileString = getNativePathString(waistFile);
-        linkPosSeq = motion.linkPosSeq();
-        if(!linkPosSeq->loadPlainMatrixFormat(waistFileString)){
-            os << linkPosSeq->seqMessage();
-            linkPosSeq.reset();
-        } else {
-            if(waistFileString == filename){
-                loaded = true;
-            }
+    if(!waistFile.isDone){
+        if(waistFile.exists){
+            os << waistFile.message.str();
         }
+        linkPosSeq.reset();
+    } else if(waistFile.filename == filename){
+        loaded = true;
     }
 
     shared_ptr<ZMPSeq> zmpseq;
-    if(jointPosSeq || linkPosSeq){
-        filesystem::path zmpFile = filesystem::change_extension(orgpath, ".zmp");
-        if(filesystem::exists(zmpFile) && !filesystem::is_directory(zmpFile)){
-            string zmpFileString = getNativePathString(zmpFile);
+    if((jointPosSeq || linkPosSeq) && zmpFile.exists){
+        if(!zmpFile.isDone){
+            os << zmpFile.message.str();
+            clearZMPSeq(motion);
+        } else {
             zmpseq = getOrCreateZMPSeq(motion);
-            if(!zmpseq->loadPlainFormat(zmpFileString)){
-                os << zmpseq->seqMessage();
-                clearZMPSeq(motion);
-                zmpseq.reset();
+            *zmpseq = loadedZmpSeq;
+            if(!linkPosSeq){
+                zmpseq->setRootRelative(true);
             } else {
-                if(!linkPosSeq){
-                    zmpseq->setRootRelative(true);
-                } else {
-                    // make the coordinate global
-                    MultiSE3Seq::Part rootSeq = linkPosSeq->part(0);
-                    for(int i=0; i < zmpseq->numFrames(); ++i){
-                        const SE3& p = rootSeq[std::min(i, rootSeq.size() - 1)];
-                        (*zmpseq)[i] = p.rotation() * (*zmpseq)[i] + p.translation();
-                    }
-                    zmpseq->setRootRelative(false);
-                }
-                if(zmpFileString == filename){
-                    loaded = true;
+                // make the coordinate global
+                MultiSE3Seq::Part rootSeq = linkPosSeq->part(0);
+                for(int i=0; i < zmpseq->numFrames(); ++i){
+                    const SE3& p = rootSeq[std::min(i, rootSeq.size() - 1)];
+                    (*zmpseq)[i] = p.rotation() * (*zmpseq)[i] + p.translation();
                 }
+                zmpseq->setRootRelative(false);
+            }
+            if(zmpFile.filename == filename){
+                loaded = true;
             }
         }
     }
@@ -256,45 +444,60 @@ bool cnoid::loadHrpsysSeqFileSet(BodyMotion& motion, const std::string& filename
 bool cnoid::saveHrpsysSeqFileSet(BodyMotion& motion, Body* body, const std::string& filename, std::ostream& os)
 {
     filesystem::path orgpath(filename);
-    filesystem::path bpath(orgpath.branch_path() / filesystem::path(basename(orgpath)));
-
-    if(motion.jointPosSeq()->saveAsPlainFormat(
-           getNativePathString(filesystem::change_extension(orgpath, ".pos"))) &&
-           
-       motion.linkPosSeq()->saveTopPartAsPlainMatrixFormat(
-           getNativePathString(filesystem::change_extension(orgpath, ".waist"))) &&
-           
-       saveRootLinkAttAsRpyFormat(
-           motion, getNativePathString(filesystem::change_extension(orgpath, ".hip")), os)) {
-
-        saveRootLinkAccAsGsensFile(
-            motion, body, getNativePathString(filesystem::change_extension(orgpath, ".gsens")), os);
-
-        auto zmpseq = getZMPSeq(motion);
-        if(zmpseq){
-            // make the coordinate relative to the waist
-            Vector3Seq relZMP(zmpseq->numFrames());
-            relZMP.setFrameRate(zmpseq->frameRate());
-            MultiSE3Seq::Part rootSeq = motion.linkPosSeq()->part(0);
-            for(int i=0; i < zmpseq->numFrames(); ++i){
-                const SE3& p = rootSeq[std::min(i, rootSeq.size() - 1)];
-                relZMP[i].noalias() = p.rotation().inverse() * (zmpseq->at(i) - p.translation());
-            }
-            return relZMP.saveAsPlainFormat(
-                getNativePathString(filesystem::change_extension(orgpath, ".zmp")));
-        }
-        return true;
+
+    HrpsysSeqMemberFile posFile(orgpath, ".pos");
+    HrpsysSeqMemberFile waistFile(orgpath, ".waist");
+    HrpsysSeqMemberFile hipFile(orgpath, ".hip");
+    HrpsysSeqMemberFile gsensFile(orgpath, ".gsens");
+    HrpsysSeqMemberFile zmpFile(orgpath, ".zmp");
+
+    auto jointPosSeq = motion.jointPosSeq();
+    auto linkPosSeq = motion.linkPosSeq();
+
+    // The member files are formatted and written in parallel
+    ThreadPool::TaskGroup tasks;
+    tasks.run([&](){
+            posFile.isDone = jointPosSeq->saveAsPlainFormat(posFile.filename); });
+    tasks.run([&](){
+            waistFile.isDone = linkPosSeq->saveTopPartAsPlainMatrixFormat(waistFile.filename); });
+    tasks.run([&](){
+            hipFile.isDone = saveRootLinkAttAsRpyFormat(motion, hipFile.filename, hipFile.message); });
+    tasks.wait();
+    os << hipFile.message.str();
+
+    if(!(posFile.isDone && waistFile.isDone && hipFile.isDone)){
+        return false;
     }
-    return false;
+
+    tasks.run([&](){
+            saveRootLinkAccAsGsensFile(motion, body, gsensFile.filename, gsensFile.message); });
+
+    auto zmpseq = getZMPSeq(motion);
+    if(zmpseq){
+        tasks.run([&](){
+                // make the coordinate relative to the waist
+                Vector3Seq relZMP(zmpseq->numFrames());
+                relZMP.setFrameRate(zmpseq->frameRate());
+                MultiSE3Seq::Part rootSeq = linkPosSeq->part(0);
+                for(int i=0; i < zmpseq->numFrames(); ++i){
+                    const SE3& p = rootSeq[std::min(i, rootSeq.size() - 1)];
+                    relZMP[i].noalias() = p.rotation().inverse() * (zmpseq->at(i) - p.translation());
+                }
+                zmpFile.isDone = relZMP.saveAsPlainFormat(zmpFile.filename);
+            });
+    }
+    tasks.wait();
+    os << gsensFile.message.str();
+
+    return zmpseq ? zmpFile.isDone : true;
 }
 
 
 static void applyPollardVelocityLimitFilterSub
-(MultiValueSeq::Part seq, double deltaUVLimit, double deltaLVLimit, double deltaKs,
+(double* seq, int n, double deltaUVLimit, double deltaLVLimit, double deltaKs,
  vector<double>& forward, vector<double>& backward)
 {
     const double sqrtDeltaKs = sqrt(deltaKs);
-    const int n = seq.size();
     const int last = n - 1;
     
     double v0, vv0, vv1; 
@@ -342,10 +545,9 @@ static void applyPollardVelocityLimitFilterSub
 
 
 static void applyVelocityLimitFilterSub
-(MultiValueSeq::Part seq, double deltaUVLimit, double deltaLVLimit,
+(double* seq, int n, double deltaUVLimit, double deltaLVLimit,
  vector<double>& forward, vector<double>& backward)
 {
-    const int n = seq.size();
     const int last = n - 1;
 
     // forward pass
@@ -379,15 +581,35 @@ static void applyVelocityLimitFilterSub
 }
 
 
+/**
+   The frames of the sequence are stored as contiguous rows, so the values of a part are
+   copied into a contiguous buffer before the filters processing a part are applied.
+*/
+static void copyPart(const MultiValueSeq& seq, int part, vector<double>& out_values)
+{
+    out_values.resize(seq.numFrames());
+    seq.copyColumnTo(part, out_values.begin());
+}
+
+
+static void putPart(const vector<double>& values, int part, MultiValueSeq& seq)
+{
+    seq.setColumnFrom(part, values.begin());
+}
+
+
 bool cnoid::applyVelocityLimitFilter2(MultiValueSeq& seq, int part, double absLimit)
 {
     const int numFrames = seq.numFrames();
     const double frameRate = seq.frameRate();
+    vector<double> values;
     vector<double> forward(numFrames);
     vector<double> backward(numFrames);
     const double deltaUVLimit = absLimit / frameRate;
     const double deltaLVLimit = -absLimit / frameRate;
-    applyVelocityLimitFilterSub(seq.part(part), deltaUVLimit, deltaLVLimit, forward, backward);
+    copyPart(seq, part, values);
+    applyVelocityLimitFilterSub(values.data(), numFrames, deltaUVLimit, deltaLVLimit, forward, backward);
+    putPart(values, part, seq);
 
     return true;
 }
@@ -402,41 +624,55 @@ bool cnoid::applyVelocityLimitFilterDummy()
 static bool applyVelocityLimitFilterMain
 (MultiValueSeq& seq, Body* body, double ks, bool usePollardMethod, std::ostream& os)
 {
-    bool applied = false;
-    
     os << "applying the velocity limit filter ..." << endl;
     
     const int numParts = seq.numParts();
     const int numFrames = seq.numFrames();
     const double frameRate = seq.frameRate();
     const double deltaKs = ks / frameRate;
-    
-    vector<double> forward(numFrames);
-    vector<double> backward(numFrames);
-    
+
+    vector<int> targetParts;
     int n = std::min(numParts, body->numJoints());
     for(int i=0; i < n; ++i){
         Link* joint = body->joint(i);
         if(joint->dq_upper() != std::numeric_limits<double>::max() ||
            joint->dq_lower() != -std::numeric_limits<double>::max()){
-            const double deltaUVLimit = joint->dq_upper() / frameRate;
-            const double deltaLVLimit = joint->dq_lower() / frameRate;
-            
             os << format(" seq {0}: lower limit = {1}, upper limit = {2}",
                     i, joint->dq_lower(), joint->dq_upper()) << endl;
+            targetParts.push_back(i);
+        }
+    }
+    if(targetParts.empty()){
+        return false;
+    }
+    if(numFrames == 0){
+        return true;
+    }
 
+    // The parts are filtered independently of each other
+    ThreadPool::instance()->parallelFor(
+        0, targetParts.size(),
+        [&](int index){
+            const int part = targetParts[index];
+            Link* joint = body->joint(part);
+            const double deltaUVLimit = joint->dq_upper() / frameRate;
+            const double deltaLVLimit = joint->dq_lower() / frameRate;
+            vector<double> values;
+            vector<double> forward(numFrames);
+            vector<double> backward(numFrames);
+            copyPart(seq, part, values);
             if(usePollardMethod){
                 applyPollardVelocityLimitFilterSub(
-                    seq.part(i), deltaUVLimit, deltaLVLimit, deltaKs, forward, backward);
+                    values.data(), numFrames, deltaUVLimit, deltaLVLimit, deltaKs, forward, backward);
             } else {
                 applyVelocityLimitFilterSub(
-                    seq.part(i), deltaUVLimit, deltaLVLimit, forward, backward);
+                    values.data(), numFrames, deltaUVLimit, deltaLVLimit, forward, backward);
             }
-                    
-            applied = true;
-        }
-    }
-    return applied;
+            putPart(values, part, seq);
+        },
+        1);
+
+    return true;
 }
 
 
@@ -454,37 +690,96 @@ bool cnoid::applyVelocityLimitFilter
 }
 
 
+/**
+   Applies the gaussian filter to the parts [beginPart, endPart) in place. The frames are
+   processed in order, and the original values of the last 'range' frames, which have been
+   overwritten, are kept in a ring buffer. The values of a frame are contiguous, so the inner
+   loops over the parts are vectorized. The result is same as the one of the applyGaussianFilter
+   template function applied to each part.
+*/
+static void applyGaussianFilterToParts
+(MultiValueSeq& seq, const vector<double>& gwin, int beginPart, int endPart)
+{
+    typedef Eigen::Map<Eigen::ArrayXd> ArrayMap;
+    
+    const int range = (gwin.size() - 1) / 2;
+    const int numFrames = seq.numFrames();
+    const int width = endPart - beginPart;
+
+    Eigen::ArrayXXd orgFrames(width, std::max(1, range));
+    Eigen::ArrayXd result(width);
+
+    for(int i=0; i < numFrames; ++i){
+        const int jmin = std::max(-range, -i);
+        const int jmax = std::min(range, numFrames - 1 - i);
+        result.setZero();
+        double ave = 0.0;
+        for(int j = jmin; j <= jmax; ++j){
+            const double w = gwin[j + range];
+            if(j < 0){
+                result += orgFrames.col((i + j) % range) * w;
+            } else {
+                result += ArrayMap(seq.frame(i + j).begin() + beginPart, width) * w;
+            }
+            ave += w;
+        }
+        ArrayMap frame(seq.frame(i).begin() + beginPart, width);
+        if(range > 0){
+            orgFrames.col(i % range) = frame;
+        }
+        if(jmin > -range || jmax < range){
+            frame = result / ave;
+        } else {
+            frame = result;
+        }
+    }
+}
+
+
 void cnoid::applyGaussianFilter
 (MultiValueSeq& seq, double sigma, int range, std::ostream& os)
 {
     vector<double> gwin;
     setGaussWindow(sigma, range, gwin);
     
-    vector<double> orgseq(seq.numFrames());
+    const int numParts = seq.numParts();
     
-    for(int i=0; i < seq.numParts(); ++i){
+    for(int i=0; i < numParts; ++i){
         if(i==0){
             os << format(_("applying the gaussian filter (sigma = {0}, range = {1}) to seq"),
                     sigma, range) << endl;
         }
         os << " " << i;
+    }
 
-        MultiValueSeq::Part part = seq.part(i);
-        std::copy(part.begin(), part.end(), orgseq.begin());
-        applyGaussianFilter(part, orgseq, gwin, 0.0);
+    if(numParts == 0 || seq.numFrames() == 0){
+        return;
     }
+
+    // The parts are divided into the blocks filtered in parallel
+    ThreadPool* threadPool = ThreadPool::instance();
+    const int minBlockSize = 8;
+    const int numBlocks =
+        std::max(1, std::min(threadPool->size() + 1, (numParts + minBlockSize - 1) / minBlockSize));
+    threadPool->parallelFor(
+        0, numBlocks,
+        [&](int block){
+            const int beginPart = numParts * block / numBlocks;
+            const int endPart = numParts * (block + 1) / numBlocks;
+            applyGaussianFilterToParts(seq, gwin, beginPart, endPart);
+        },
+        1);
 }
 
 
 void cnoid::applyRangeLimitFilter
 (MultiValueSeq& seq, Body* body, double limitGrad, double edgeGradRatio, double margin, std::ostream& os)
 {
-    RangeLimiter limiter;
-
     os << "applying the joint position range limit filter ..." << endl;
     
     const int numParts = seq.numParts();
-    
+
+    vector<int> targetParts;
     int n = std::min(numParts, body->numJoints());
     for(int i=0; i < n; ++i){
         Link* joint = body->joint(i);
@@ -495,10 +790,22 @@ void cnoid::applyRangeLimitFilter
             if(upper > lower){
                 os << format(" seq {0}: lower limit = {1}, upper limit = {2}",
                         i, joint->q_lower(), joint->q_upper()) << endl;
-
-                MultiValueSeq::Part part = seq.part(i);
-                limiter.apply(part, upper, lower, limitGrad, edgeGradRatio);
+                targetParts.push_back(i);
             }
         }
     }
+
+    // The parts are filtered independently of each other
+    ThreadPool::instance()->parallelFor(
+        0, targetParts.size(),
+        [&](int index){
+            const int part = targetParts[index];
+            Link* joint = body->joint(part);
+            RangeLimiter limiter;
+            vector<double> values;
+            copyPart(seq, part, values);
+            limiter.apply(values, joint->q_upper() - margin, joint->q_lower() + margin, limitGrad, edgeGradRatio);
+            putPart(values, part, seq);
+        },
+        1);
 }
@@ -17,6 +17,7 @@ class BodyMotion;
 class Vector3Seq;
 class MultiSE3Seq;
 class MultiValueSeq;
+class ZMPSeq;
 class PoseProvider;
 class AccelerationSensor;
 
@@ -42,6 +43,23 @@ CNOID_EXPORT bool applyPollardVelocityLimitFilter(
 CNOID_EXPORT void applyGaussianFilter(
     MultiValueSeq& seq, double sigma, int range, std::ostream& os = nullout());
     
+/**
+   Calculates the ZMP and the joint torques of all the frames of a motion by the inverse dynamics.
+   The velocities and the accelerations of the joints and the root link are calculated from the
+   joint position sequence and the root link position sequence by the central differences, and
+   the inverse dynamics of the frames is calculated in parallel. The external forces other than
+   the ground reaction force are not considered.
+   
+   \param out_zmpSeq The ZMP sequence in the global coordinate, which is not calculated if null.
+   The ZMP is the point on the horizontal plane of zmpHeight.
+   \param out_jointTorqueSeq The joint torque sequence, whose parts correspond to the joint ids,
+   which is not calculated if null.
+   \return false if the motion does not have any frames
+*/
+CNOID_EXPORT bool calcZMPAndJointTorqueSeqs(
+    Body* body, const BodyMotion& motion, ZMPSeq* out_zmpSeq, MultiValueSeq* out_jointTorqueSeq,
+    double zmpHeight = 0.0);
+
 CNOID_EXPORT void applyRangeLimitFilter(
     MultiValueSeq& seq, Body* body, double limitGrad, double edgeGradRatio, double margin,
     std::ostream& os = nullout());
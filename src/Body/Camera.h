@@ -71,6 +71,12 @@ public:
 
     const Image& image() const;
     const Image& constImage() const { return *image_; }
+
+    /**
+       The image is copied if it is shared with other objects such as the devices of the
+       simulator or the controllers. Use constImage() or sharedImage() to refer to the image
+       without copying it.
+    */
     Image& image();
     Image& newImage();
 
@@ -0,0 +1,501 @@
+/**
+   The benchmark of the collision detectors registered to the CollisionDetector factory.
+   The detectors implemented in plugins are registered by loading the plugin files
+   given with the --plugin option.
+
+   Each scene is registered to a new detector instance for each number of threads, and
+   the geometries are moved along the scripted trajectories for the specified number of
+   frames. The times of the registration, updatePositions and detectCollisions are output.
+*/
+
+#include "BodyLoader.h"
+#include "Body.h"
+#include <cnoid/CollisionDetector>
+#include <cnoid/MeshGenerator>
+#include <cnoid/SceneDrawables>
+#include <cnoid/ExecutablePath>
+#include <cnoid/EigenUtil>
+#include <fmt/format.h>
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+using namespace std;
+using namespace cnoid;
+using fmt::format;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+class GeometryObject : public Referenced
+{
+public:
+    Position T;
+    GeometryObject() { T.setIdentity(); }
+};
+typedef ref_ptr<GeometryObject> GeometryObjectPtr;
+
+struct Geometry
+{
+    SgNodePtr node;
+    GeometryObjectPtr object;
+    bool isStatic;
+    // The index of the link in the robot for the robot scene, and -1 for the others
+    int linkIndex;
+};
+
+/**
+   A scene is a set of the geometries and the trajectories of them.
+   The position of each non-static geometry is updated by setFrame().
+*/
+class Scene
+{
+public:
+    string name;
+    vector<Geometry> geometries;
+    vector<pair<int, int>> nonInterferencePairs;
+
+    virtual ~Scene() { }
+    virtual void setFrame(int frame, double time) = 0;
+
+    int addGeometry(SgNode* node, bool isStatic = false, int linkIndex = -1){
+        Geometry geometry;
+        geometry.node = node;
+        geometry.object = new GeometryObject;
+        geometry.isStatic = isStatic;
+        geometry.linkIndex = linkIndex;
+        geometries.push_back(geometry);
+        return geometries.size() - 1;
+    }
+};
+
+
+SgNode* createShape(SgMesh* mesh)
+{
+    auto shape = new SgShape;
+    shape->setMesh(mesh);
+    return shape;
+}
+
+
+/**
+   The primitive shapes in a grid moving along the circles of different phases,
+   which make the pairs of the neighbors collide intermittently.
+*/
+class PrimitiveScene : public Scene
+{
+public:
+    vector<Vector3> basePositions;
+
+    PrimitiveScene(int size){
+        name = "primitives";
+        MeshGenerator generator;
+        auto floor = addGeometry(createShape(generator.generateBox(Vector3(size + 2.0, size + 2.0, 0.1))), true);
+        geometries[floor].object->T.translation() << 0.0, 0.0, -0.05;
+
+        for(int i=0; i < size; ++i){
+            for(int j=0; j < size; ++j){
+                for(int k=0; k < 2; ++k){
+                    SgMesh* mesh;
+                    switch((i + j + k) % 4){
+                    case 0: mesh = generator.generateBox(Vector3(0.4, 0.3, 0.2)); break;
+                    case 1: mesh = generator.generateSphere(0.2); break;
+                    case 2: mesh = generator.generateCylinder(0.15, 0.4); break;
+                    default: mesh = generator.generateCapsule(0.1, 0.3); break;
+                    }
+                    addGeometry(createShape(mesh));
+                    basePositions.emplace_back(i - (size - 1) / 2.0, j - (size - 1) / 2.0, 0.25 + k * 0.5);
+                }
+            }
+        }
+    }
+
+    virtual void setFrame(int /* frame */, double time) override {
+        for(size_t i=1; i < geometries.size(); ++i){
+            const double phase = time * 2.0 + i * 0.7;
+            auto& T = geometries[i].object->T;
+            T.linear() = rotFromRpy(0.0, 0.0, phase) * rotFromRpy(phase * 0.5, 0.0, 0.0);
+            T.translation() = basePositions[i - 1] + Vector3(0.4 * cos(phase), 0.4 * sin(phase), 0.1 * sin(phase * 1.3));
+        }
+    }
+};
+
+
+/**
+   The robots swinging the joints. The pairs of the links connected by a joint are not tested.
+*/
+class RobotScene : public Scene
+{
+public:
+    vector<BodyPtr> bodies;
+    vector<vector<int>> linkGeometries;
+
+    RobotScene(Body* body, int numBodies){
+        name = "robots";
+        MeshGenerator generator;
+        auto floor = addGeometry(createShape(generator.generateBox(Vector3(numBodies * 1.0 + 2.0, 2.0, 0.1))), true);
+        geometries[floor].object->T.translation() << 0.0, 0.0, -0.05;
+
+        for(int i=0; i < numBodies; ++i){
+            BodyPtr clone = body->clone();
+            clone->rootLink()->p() << (i - (numBodies - 1) / 2.0) * 0.8, 0.0, clone->rootLink()->p().z();
+            bodies.push_back(clone);
+            linkGeometries.emplace_back(clone->numLinks(), -1);
+            for(int j=0; j < clone->numLinks(); ++j){
+                Link* link = clone->link(j);
+                if(link->collisionShape()){
+                    linkGeometries.back()[j] = addGeometry(link->collisionShape(), false, j);
+                }
+            }
+            for(int j=0; j < clone->numLinks(); ++j){
+                Link* link = clone->link(j);
+                if(link->parent()){
+                    int g1 = linkGeometries.back()[j];
+                    int g2 = linkGeometries.back()[link->parent()->index()];
+                    if(g1 >= 0 && g2 >= 0){
+                        nonInterferencePairs.emplace_back(g1, g2);
+                    }
+                }
+            }
+        }
+    }
+
+    virtual void setFrame(int /* frame */, double time) override {
+        for(size_t i=0; i < bodies.size(); ++i){
+            Body* body = bodies[i];
+            for(int j=0; j < body->numJoints(); ++j){
+                Link* joint = body->joint(j);
+                double range = std::min(joint->q_upper() - joint->q_lower(), PI);
+                double center = (joint->q_upper() + joint->q_lower()) / 2.0;
+                if(!std::isfinite(range) || !std::isfinite(center)){
+                    range = PI / 2.0;
+                    center = 0.0;
+                }
+                joint->q() = center + 0.5 * range * sin(time * 1.5 + j * 0.9 + i);
+            }
+            body->calcForwardKinematics();
+            const auto& geometryIndices = linkGeometries[i];
+            for(int j=0; j < body->numLinks(); ++j){
+                if(geometryIndices[j] >= 0){
+                    geometries[geometryIndices[j]].object->T = body->link(j)->position();
+                }
+            }
+        }
+    }
+};
+
+
+/**
+   The objects moving over the static terrain given as a large mesh.
+*/
+class TerrainScene : public Scene
+{
+public:
+    double extent;
+    int numObjects;
+
+    static double height(double x, double y){
+        return 0.3 * sin(x * 1.3) * cos(y * 0.9) + 0.1 * sin(x * 4.1 + y * 3.7);
+    }
+
+    TerrainScene(int resolution, int numObjects)
+        : numObjects(numObjects) {
+        name = "terrain";
+        extent = 10.0;
+
+        auto mesh = new SgMesh;
+        auto& vertices = *mesh->getOrCreateVertices();
+        const int n = resolution;
+        const double d = extent / n;
+        vertices.reserve((n + 1) * (n + 1));
+        for(int i=0; i <= n; ++i){
+            for(int j=0; j <= n; ++j){
+                double x = i * d - extent / 2.0;
+                double y = j * d - extent / 2.0;
+                vertices.push_back(Vector3f(x, y, height(x, y)));
+            }
+        }
+        mesh->reserveNumTriangles(n * n * 2);
+        for(int i=0; i < n; ++i){
+            for(int j=0; j < n; ++j){
+                const int v0 = i * (n + 1) + j;
+                const int v1 = v0 + n + 1;
+                mesh->addTriangle(v0, v1, v1 + 1);
+                mesh->addTriangle(v0, v1 + 1, v0 + 1);
+            }
+        }
+        mesh->updateBoundingBox();
+        addGeometry(createShape(mesh), true);
+
+        MeshGenerator generator;
+        for(int i=0; i < numObjects; ++i){
+            if(i % 2 == 0){
+                addGeometry(createShape(generator.generateSphere(0.15)));
+            } else {
+                addGeometry(createShape(generator.generateBox(Vector3(0.3, 0.3, 0.3))));
+            }
+        }
+    }
+
+    // The objects move along the lines across the terrain touching the surface
+    virtual void setFrame(int /* frame */, double time) override {
+        for(int i=0; i < numObjects; ++i){
+            const double angle = 2.0 * PI * i / numObjects;
+            const double s = fmod(time * 0.5 + i * 0.37, 1.0) * 2.0 - 1.0;
+            const double x = 0.4 * extent * s * cos(angle);
+            const double y = 0.4 * extent * s * sin(angle);
+            auto& T = geometries[i + 1].object->T;
+            T.linear() = rotFromRpy(0.0, 0.0, angle);
+            T.translation() << x, y, height(x, y) + 0.12;
+        }
+    }
+};
+
+
+struct Options
+{
+    vector<string> detectors;
+    vector<int> numThreadsList { 0 };
+    int numFrames = 1000;
+    double timeStep = 0.001;
+    int primitiveGridSize = 6;
+    int numRobots = 4;
+    int terrainResolution = 256;
+    int numTerrainObjects = 32;
+    string robotFile;
+};
+
+
+void runBenchmark(int factoryIndex, Scene& scene, int numThreads, const Options& options)
+{
+    CollisionDetectorPtr detector = CollisionDetector::create(factoryIndex);
+    detector->setNumThreads(numThreads);
+
+    scene.setFrame(0, 0.0);
+
+    auto start = Clock::now();
+    vector<CollisionDetector::GeometryHandle> handles(scene.geometries.size(), -1);
+    for(size_t i=0; i < scene.geometries.size(); ++i){
+        auto& geometry = scene.geometries[i];
+        if(auto handle = detector->addGeometry(geometry.node)){
+            handles[i] = *handle;
+            detector->setCustomObject(*handle, geometry.object);
+            if(geometry.isStatic){
+                detector->setGeometryStatic(*handle);
+            }
+        }
+    }
+    for(auto& pair : scene.nonInterferencePairs){
+        if(handles[pair.first] >= 0 && handles[pair.second] >= 0){
+            detector->setNonInterfarenceGeometyrPair(handles[pair.first], handles[pair.second]);
+        }
+    }
+    const double addTime = elapsedSince(start);
+    start = Clock::now();
+    detector->makeReady();
+    const double readyTime = elapsedSince(start);
+
+    for(size_t i=0; i < scene.geometries.size(); ++i){
+        if(handles[i] >= 0){
+            detector->updatePosition(handles[i], scene.geometries[i].object->T);
+        }
+    }
+
+    double updateTime = 0.0;
+    double detectionTime = 0.0;
+    long numPairs = 0;
+    long numContacts = 0;
+
+    for(int frame=1; frame <= options.numFrames; ++frame){
+        scene.setFrame(frame, frame * options.timeStep);
+
+        start = Clock::now();
+        detector->updatePositions(
+            [](Referenced* object, Position*& out_position){
+                out_position = &static_cast<GeometryObject*>(object)->T;
+            });
+        updateTime += elapsedSince(start);
+
+        start = Clock::now();
+        detector->detectCollisions(
+            [&](const CollisionPair& collisionPair){
+                ++numPairs;
+                numContacts += collisionPair.numCollisions();
+            });
+        detectionTime += elapsedSince(start);
+    }
+
+    const double n = options.numFrames;
+    cout << format("{:<12} {:<28} {:>7} {:>10} {:>12.3f} {:>12.3f} {:>12.2f} {:>12.2f} {:>10.2f} {:>10.2f}",
+                   scene.name, detector->name(), numThreads, detector->numGeometries(),
+                   addTime * 1.0e3, readyTime * 1.0e3,
+                   updateTime / n * 1.0e6, detectionTime / n * 1.0e6,
+                   numPairs / n, numContacts / n)
+         << endl;
+}
+
+
+bool loadPlugin(const string& filename)
+{
+    // The factories of the detectors are registered in the initialization of the plugins
+#ifdef _WIN32
+    return LoadLibrary(filename.c_str()) != nullptr;
+#else
+    return dlopen(filename.c_str(), RTLD_NOW | RTLD_GLOBAL) != nullptr;
+#endif
+}
+
+
+vector<int> parseIntegerList(const string& text)
+{
+    vector<int> values;
+    size_t pos = 0;
+    while(pos < text.size()){
+        size_t next = text.find(',', pos);
+        if(next == string::npos){
+            next = text.size();
+        }
+        values.push_back(std::atoi(text.substr(pos, next - pos).c_str()));
+        pos = next + 1;
+    }
+    return values;
+}
+
+
+void showUsage()
+{
+    cout <<
+        "Usage: cnoid-collision-benchmark [options]\n"
+        "  --plugin <file>       load a plugin file which registers collision detectors\n"
+        "  --detector <name>     benchmark the detector (all the registered detectors by default)\n"
+        "  --threads <n,n,...>   numbers of threads given to setNumThreads (default: 0)\n"
+        "  --frames <n>          number of frames of each trajectory (default: 1000)\n"
+        "  --scene <name>        primitives, robots or terrain (all the scenes by default)\n"
+        "  --robot <file>        body file of the robot scene (default: SR1)\n"
+        "  --grid <n>            grid size of the primitive scene (default: 6)\n"
+        "  --robots <n>          number of robots (default: 4)\n"
+        "  --terrain <n>         resolution of the terrain mesh (default: 256)\n"
+        "  --objects <n>         number of objects on the terrain (default: 32)\n";
+}
+
+}
+
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    vector<string> sceneNames;
+
+    for(int i=1; i < argc; ++i){
+        string arg = argv[i];
+        if(arg == "--help" || arg == "-h"){
+            showUsage();
+            return 0;
+        }
+        if(i + 1 >= argc){
+            cerr << format("Option {} requires a value.", arg) << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        if(arg == "--plugin"){
+            if(!loadPlugin(value)){
+                cerr << format("Plugin \"{}\" cannot be loaded.", value) << endl;
+                return 1;
+            }
+        } else if(arg == "--detector"){
+            options.detectors.push_back(value);
+        } else if(arg == "--threads"){
+            options.numThreadsList = parseIntegerList(value);
+        } else if(arg == "--frames"){
+            options.numFrames = std::max(1, std::atoi(value.c_str()));
+        } else if(arg == "--scene"){
+            sceneNames.push_back(value);
+        } else if(arg == "--robot"){
+            options.robotFile = value;
+        } else if(arg == "--grid"){
+            options.primitiveGridSize = std::atoi(value.c_str());
+        } else if(arg == "--robots"){
+            options.numRobots = std::atoi(value.c_str());
+        } else if(arg == "--terrain"){
+            options.terrainResolution = std::atoi(value.c_str());
+        } else if(arg == "--objects"){
+            options.numTerrainObjects = std::atoi(value.c_str());
+        } else {
+            cerr << format("Unknown option {}.", arg) << endl;
+            showUsage();
+            return 1;
+        }
+    }
+
+    vector<int> factoryIndices;
+    if(options.detectors.empty()){
+        // The first detector is NullCollisionDetector
+        for(int i=1; i < CollisionDetector::numFactories(); ++i){
+            factoryIndices.push_back(i);
+        }
+    } else {
+        for(auto& name : options.detectors){
+            int index = CollisionDetector::factoryIndex(name);
+            if(index < 0){
+                cerr << format("Collision detector \"{}\" is not registered.", name) << endl;
+                return 1;
+            }
+            factoryIndices.push_back(index);
+        }
+    }
+
+    auto isSceneEnabled = [&](const char* name){
+        return sceneNames.empty() || std::find(sceneNames.begin(), sceneNames.end(), name) != sceneNames.end();
+    };
+
+    vector<unique_ptr<Scene>> scenes;
+    if(isSceneEnabled("primitives")){
+        scenes.emplace_back(new PrimitiveScene(options.primitiveGridSize));
+    }
+    if(isSceneEnabled("robots")){
+        string filename = options.robotFile;
+        if(filename.empty()){
+            filename = shareDirectory() + "/model/SR1/SR1.body";
+        }
+        BodyLoader loader;
+        BodyPtr body = loader.load(filename);
+        if(!body){
+            cerr << format("Body file \"{}\" cannot be loaded.", filename) << endl;
+            return 1;
+        }
+        scenes.emplace_back(new RobotScene(body, options.numRobots));
+    }
+    if(isSceneEnabled("terrain")){
+        scenes.emplace_back(new TerrainScene(options.terrainResolution, options.numTerrainObjects));
+    }
+
+    cout << format("{:<12} {:<28} {:>7} {:>10} {:>12} {:>12} {:>12} {:>12} {:>10} {:>10}",
+                   "scene", "detector", "threads", "geometries",
+                   "add [ms]", "ready [ms]", "update [us]", "detect [us]", "pairs", "contacts")
+         << endl;
+
+    for(auto& scene : scenes){
+        for(auto factoryIndex : factoryIndices){
+            for(auto numThreads : options.numThreadsList){
+                runBenchmark(factoryIndex, *scene, numThreads, options);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -18,10 +18,14 @@
 #include <cnoid/IdPair>
 #include <cnoid/EigenUtil>
 #include <cnoid/AISTCollisionDetector>
+#include <cnoid/ContactReduction>
 #include <cnoid/TimeMeasure>
+#include <cnoid/ThreadPool>
 #include <fmt/format.h>
 #include <boost/random.hpp>
 #include <unordered_map>
+#include <mutex>
+#include <atomic>
 #include <limits>
 #include <fstream>
 #include <iomanip>
@@ -71,6 +75,13 @@ static const double THRESH_TO_SWITCH_REL_ERROR = 1.0e-8;
 
 static const bool USE_PREVIOUS_LCP_SOLUTION = true;
 
+// The initial solution of the iterative solver is given by the forces of the previous step
+// stored for each link pair. This is only effective when USE_PREVIOUS_LCP_SOLUTION is true.
+static const bool USE_CONTACT_CACHE = true;
+
+// A contact point is regarded as the same one as a cached point within this distance
+static const double CONTACT_CACHE_MATCHING_DISTANCE = 0.005;
+
 static const bool ENABLE_CONTACT_DEPTH_CORRECTION = true;
 
 // normal setting
@@ -106,6 +117,26 @@ static const bool CFS_MCP_DEBUG_SHOW_ITERATION_STOP = false;
 
 static const bool CFS_PUT_NUM_CONTACT_POINTS = false;
 
+/**
+   The collision lists returned by getCollisions are recycled with their link pair objects
+   and the buffers of the contacts when all the references to a list are released.
+   The lists are released by the other threads when the recorded frames are flushed,
+   and the pool is kept alive by the lists even after the solver is destroyed.
+*/
+class CollisionLinkPairListPool
+{
+public:
+    std::mutex mutex;
+    vector<CollisionLinkPairList*> lists;
+    CollisionLinkPairList linkPairs;
+
+    ~CollisionLinkPairListPool(){
+        for(auto list : lists){
+            delete list;
+        }
+    }
+};
+
 static const Vector3 local2dConstraintPoints[3] = {
     Vector3( 1.0, 0.0, (-sqrt(3.0) / 2.0)),
     Vector3(-1.0, 0.0, (-sqrt(3.0) / 2.0)),
@@ -138,9 +169,23 @@ public:
         int globalFrictionIndex;
         int numFrictionVectors;
         Vector3 frictionVector[4][2];
+        unsigned long long featureId; // the id of the colliding primitive pair
     };
     typedef std::vector<ConstraintPoint> ConstraintPointArray;
 
+    /**
+       The forces of a constraint point solved in the previous step.
+       The friction force is kept as a vector so that it can be projected
+       onto the friction vectors of the next step.
+    */
+    struct ContactCacheEntry {
+        unsigned long long featureId;
+        Vector3 point;
+        double normalForce;
+        Vector3 frictionForce;
+        bool isMatched;
+    };
+
     struct LinkData
     {
         Vector3 dvo;
@@ -156,6 +201,14 @@ public:
     };
     typedef std::vector<LinkData> LinkDataArray;
 
+    // The range of the consecutive non-root links whose joints are all movable or all fixed
+    struct LinkSegment
+    {
+        bool isMovable;
+        int begin;
+        int end;
+    };
+
     struct BodyData
     {
         DyBodyPtr body;
@@ -164,6 +217,13 @@ public:
         bool isTestForceBeingApplied;
         LinkDataArray linksData;
 
+        // The ABM routines process the links segment by segment without branching on the joint types
+        vector<LinkSegment> linkSegments;
+
+        // The sleeping state applied to the collision detector and isStatic
+        bool isSleeping;
+        vector<CollisionDetector::GeometryHandle> geometryHandles;
+
         Vector3 dpf;
         Vector3 dptau;
 
@@ -180,6 +240,9 @@ public:
 
     MaterialTablePtr orgMaterialTable;
     MaterialTablePtr materialTable;
+    // Set when the material table is replaced during a simulation. It is applied at the next solve().
+    std::atomic<bool> isMaterialTableUpdateRequested;
+    std::mutex materialTableMutex;
 
     typedef ConstraintForceSolver::CollisionHandler CollisionHandler;
 
@@ -188,6 +251,7 @@ public:
     public:
         double cullingDistance;
         double cullingDepth;
+        int maxNumContactPoints;
         CollisionHandler collisionHandler;
         Connection collisionHandlerConnection;
 
@@ -216,6 +280,7 @@ public:
     class LinkPair
     {
     public:
+        LinkPair() : collisionHandler(nullptr), contactCacheFrame(-1) { }
         virtual ~LinkPair() { }
         bool isSameBodyPair;
         int bodyIndex[2];
@@ -225,6 +290,10 @@ public:
         ConstraintPointArray constraintPoints;
         bool isNonContactConstraint;
         ContactMaterialExPtr contactMaterial;
+        // Resolved when the pair is created. Null if the contact material does not have a handler.
+        CollisionHandler* collisionHandler;
+        std::vector<ContactCacheEntry> contactCache;
+        int contactCacheFrame;
     };
 
     BodyCollisionDetector bodyCollisionDetector;
@@ -238,8 +307,11 @@ public:
     double defaultSlipFriction;
     double defaultContactCullingDistance;
     double defaultContactCullingDepth;
+    int defaultMaxNumContactPoints;
     double defaultCoefficientOfRestitution;
 
+    vector<int> contactManifoldIndices;
+
     class ExtraJointLinkPair : public LinkPair
     {
     public:
@@ -263,6 +335,50 @@ public:
         
     std::vector<LinkPair*> constrainedLinkPairs;
 
+    /**
+       A set of constraints which does not interact with the other constraints.
+       A contact island consists of the non-static bodies connected via constraints,
+       and the corresponding part of the MCP can be solved independently.
+    */
+    struct ConstraintIsland
+    {
+        int contactIndexBegin;
+        int numContacts;
+        int jointIndexBegin;
+        int numJointConstraints;
+        int frictionIndexBegin;
+        int numFrictionVectors;
+        int size() const { return numContacts + numJointConstraints + numFrictionVectors; }
+
+        /*
+          Work space of the iterative solver. The elements of the island are packed into
+          a compact problem where the normal and friction components of each contact are
+          adjacent and the joint constraints follow the contacts.
+        */
+        std::vector<int> numFrictionVectorsOfContacts;
+        std::vector<int> globalIndices;
+        Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> M;
+        VectorXd b;
+        VectorXd x;
+        VectorXd mu;
+
+        // The results of the iterative solver
+        int numIterations;
+        double error;
+        bool isIterationLimitReached;
+    };
+    std::vector<ConstraintIsland> islands;
+    std::vector<int> islandParentBodyIndices;
+    std::vector<int> islandIndicesOfRootBodies;
+    std::vector<int> linkPairIslandIndices;
+    std::vector<int> sortedLinkPairIndices;
+    std::vector<LinkPair*> linkPairBuf;
+
+    int numThreads;
+    std::unique_ptr<ThreadPool> threadPool;
+
+    int solveFrame;
+
     int globalNumConstraintVectors;
 
     int globalNumContactNormalVectors;
@@ -271,6 +387,8 @@ public:
     int prevGlobalNumConstraintVectors;
     int prevGlobalNumFrictionVectors;
 
+    ConstraintForceSolver::Statistics statistics;
+
     bool areThereImpacts;
     int numUnconverged;
 
@@ -297,7 +415,6 @@ public:
     // for special version of gauss sidel iterative solver
     std::vector<int> frictionIndexToContactIndex;
     VectorX contactIndexToMu;
-    VectorX mcpHi;
 
     int  maxNumGaussSeidelIteration;
     int  numGaussSeidelInitialIteration;
@@ -319,15 +436,22 @@ public:
     void init2Dconstraint(int bodyIndex);
     void initialize(void);
     void initializeContactMaterials();
+    void setMaterialTable(MaterialTable* table);
+    void updateMaterialTable();
     ContactMaterialEx* createContactMaterialFromMaterialPair(int material1, int material2);
+    void bindContactMaterial(LinkPair& linkPair);
     void clearExternalForces();
     void solve();
+    void updateSleepingBodies();
     void setConstraintPoints();
+    void detectConstraintPoints();
     void extractConstraintPoints(const CollisionPair& collisionPair);
     bool setContactConstraintPoint(LinkPair& linkPair, const Collision& collision);
     void setFrictionVectors(ConstraintPoint& constraintPoint);
     void setExtraJointConstraintPoints(const ExtraJointLinkPairPtr& linkPair);
     void set2dConstraintPoints(const Constrain2dLinkPairPtr& linkPair);
+    int findIslandRoot(int bodyIndex);
+    void decomposeIntoIslands();
     void putContactPoints();
     void solveImpactConstraints();
     void initMatrices();
@@ -335,9 +459,11 @@ public:
     void setDefaultAccelerationVector();
     void setAccelerationMatrix();
     void initABMForceElementsWithNoExtForce(BodyData& bodyData);
+    template<bool isMovable> void initABMForceElementsWithNoExtForce(BodyData& bodyData, int begin, int end);
     void calcABMForceElementsWithTestForce(
         BodyData& bodyData, DyLink* linkToApplyForce, const Vector3& f, const Vector3& tau);
     void calcAccelsABM(BodyData& bodyData, int constraintIndex);
+    template<bool isMovable> void calcAccelsABM(BodyData& bodyData, int skipCheckNumber, int begin, int end);
     void calcAccelsMM(BodyData& bodyData, int constraintIndex);
     void extractRelAccelsOfConstraintPoints(
         Eigen::Block<MatrixX>& Kxn, Eigen::Block<MatrixX>& Kxt, int testForceIndex, int constraintIndex);
@@ -356,10 +482,13 @@ public:
     void setConstantVectorAndMuBlock();
     void addConstraintForceToLinks();
     void addConstraintForceToLink(LinkPair* linkPair, int ipair);
-    void solveMCPByProjectedGaussSeidel(const MatrixX& M, const VectorX& b, VectorX& x);
-    void solveMCPByProjectedGaussSeidelMainStep(const MatrixX& M, const VectorX& b, VectorX& x);
-    void solveMCPByProjectedGaussSeidelInitial(
-        const MatrixX& M, const VectorX& b, VectorX& x, const int numIteration);
+    void setInitialSolutionFromContactCache();
+    void updateContactCache();
+    void solveMCP(const MatrixX& M, const VectorX& b, VectorX& x);
+    void solveIslandMCP(ConstraintIsland& island, const MatrixX& M, const VectorX& b, VectorX& x);
+    void solveMCPByProjectedGaussSeidel(ConstraintIsland& island);
+    void solveMCPByProjectedGaussSeidelMainStep(ConstraintIsland& island);
+    void solveMCPByProjectedGaussSeidelInitial(ConstraintIsland& island, const int numIteration);
     void checkLCPResult(MatrixX& M, VectorX& b, VectorX& x);
     void checkMCPResult(MatrixX& M, VectorX& b, VectorX& x);
 
@@ -406,12 +535,39 @@ public:
         if(CFS_DEBUG_VERBOSE) putVector(M, name);
     }
 
+    shared_ptr<CollisionLinkPairListPool> collisionListPool;
     shared_ptr<CollisionLinkPairList> getCollisions();
 
-#ifdef ENABLE_SIMULATION_PROFILING
+    /**
+       The state which is carried over to the next step.
+       The other variables are calculated from the body states in each step.
+    */
+    struct State : public Referenced
+    {
+        struct ContactCache {
+            std::vector<ContactCacheEntry> entries;
+            int frame;
+        };
+        unordered_map<IdPair<GeometryHandle>, ContactCache> contactCaches;
+        vector<ContactCache> extraJointContactCaches;
+        vector<ContactCache> constrain2dContactCaches;
+        int solveFrame;
+        int numConstraintVectors;
+        int numContactNormalVectors;
+        int numFrictionVectors;
+        VectorX solution;
+        boost::mt19937 randomEngine;
+    };
+    typedef ref_ptr<State> StatePtr;
+
+    ReferencedPtr storeState();
+    bool restoreState(Referenced* state);
+
+    bool isProfilingEnabled;
     double collisionTime;
     TimeMeasure timer;
-#endif
+
+    bool areBodiesWokenUpByContacts;
 
 };
 
@@ -437,6 +593,7 @@ CFSImpl::ConstraintForceSolverImpl(WorldBase& world) :
     defaultSlipFriction = 1.0;
     defaultContactCullingDistance = DEFAULT_CONTACT_CULLING_DISTANCE;
     defaultContactCullingDepth = DEFAULT_CONTACT_CULLING_DEPTH;
+    defaultMaxNumContactPoints = 0;
     defaultCoefficientOfRestitution = 0.0;
     
     maxNumGaussSeidelIteration = DEFAULT_MAX_NUM_GAUSS_SEIDEL_ITERATION;
@@ -446,8 +603,17 @@ CFSImpl::ConstraintForceSolverImpl(WorldBase& world) :
     contactCorrectionVelocityRatio = DEFAULT_CONTACT_CORRECTION_VELOCITY_RATIO;
 
     isConstraintForceOutputMode = false;
+    isMaterialTableUpdateRequested = false;
     isSelfCollisionDetectionEnabled.clear();
     is2Dmode = false;
+
+    numThreads = 0;
+
+    isProfilingEnabled = false;
+    collisionTime = 0.0;
+    statistics = ConstraintForceSolver::Statistics();
+
+    collisionListPool = std::make_shared<CollisionLinkPairListPool>();
 }
 
 
@@ -467,6 +633,8 @@ void CFSImpl::initBody(const DyBodyPtr& body, BodyData& bodyData)
     bodyData.hasConstrainedLinks = false;
     bodyData.isTestForceBeingApplied = false;
     bodyData.isStatic = body->isStaticModel();
+    bodyData.isSleeping = false;
+    bodyData.geometryHandles.clear();
 
     LinkDataArray& linksData = bodyData.linksData;
     const int n = body->numLinks();
@@ -475,6 +643,20 @@ void CFSImpl::initBody(const DyBodyPtr& body, BodyData& bodyData)
         linksData[link->index()].link = link;
         linksData[link->index()].parentIndex = link->parent() ? link->parent()->index() : -1;
     }
+
+    bodyData.linkSegments.clear();
+    for(int i=1; i < n; ++i){
+        const bool isMovable = !linksData[i].link->isFixedJoint();
+        if(!bodyData.linkSegments.empty() && bodyData.linkSegments.back().isMovable == isMovable){
+            bodyData.linkSegments.back().end = i + 1;
+        } else {
+            LinkSegment segment;
+            segment.isMovable = isMovable;
+            segment.begin = i;
+            segment.end = i + 1;
+            bodyData.linkSegments.push_back(segment);
+        }
+    }
 }
 
 
@@ -556,6 +738,9 @@ void CFSImpl::initExtraJointSub(ExtraJoint& extrajoint, int bodyIndex0, int body
         BodyData& bodyData = bodiesData[index[k]];
         linkPair->linkData[k] = &(bodyData.linksData[link->index()]);
         linkPair->jointPoint[k] = link->Rs() * extrajoint.point[k];
+
+        // A sleeping body would be a fixed base of the joint
+        world.disallowBodySleeping(index[k]);
     }
 
     extraJointLinkPairs.push_back(linkPair);
@@ -633,7 +818,14 @@ void CFSImpl::initialize(void)
     geometryPairToLinkPairMap.clear();
     constrainedLinkPairs.clear();
 
-    initializeContactMaterials();
+    // The geometries of a body are switched to the resting state when the body sleeps
+    bodyCollisionDetector.enableGeometryHandleMap(world.isSleepingEnabled());
+
+    {
+        std::lock_guard<std::mutex> lock(materialTableMutex);
+        initializeContactMaterials();
+        isMaterialTableUpdateRequested = false;
+    }
     
     extraJointLinkPairs.clear();
     constrain2dLinkPairs.clear();
@@ -658,6 +850,14 @@ void CFSImpl::initialize(void)
         }
 
         bodyCollisionDetector.addBody(body, isSelfCollisionDetectionEnabled[bodyIndex]);
+
+        if(world.isSleepingEnabled()){
+            for(int j=0; j < body->numLinks(); ++j){
+                if(auto handle = bodyCollisionDetector.findGeometryHandle(body->link(j))){
+                    bodyData.geometryHandles.push_back(*handle);
+                }
+            }
+        }
         
         initBodyExtraJoints(bodyIndex);
 
@@ -670,9 +870,19 @@ void CFSImpl::initialize(void)
 
     bodyCollisionDetector.makeReady();
 
+    if(numThreads > 0){
+        if(!threadPool || threadPool->size() != numThreads){
+            threadPool.reset(new ThreadPool(numThreads));
+        }
+    } else {
+        threadPool.reset();
+    }
+
     prevGlobalNumConstraintVectors = 0;
     prevGlobalNumFrictionVectors = 0;
     numUnconverged = 0;
+    solveFrame = 0;
+    areBodiesWokenUpByContacts = false;
 
     randomAngle.engine().seed();
 }
@@ -691,6 +901,7 @@ void CFSImpl::initializeContactMaterials()
                     auto cm = new ContactMaterialEx(*org);
                     cm->cullingDistance = cm->info("cullingDistance", defaultContactCullingDistance);
                     cm->cullingDepth = cm->info("cullingDepth", defaultContactCullingDepth);
+                    cm->maxNumContactPoints = cm->info("maxNumContactPoints", defaultMaxNumContactPoints);
 
                     if(cm->info()->read("collisionHandler", collisionHandlerName)){
                         auto iter = collisionHandlerMap.find(collisionHandlerName);
@@ -709,6 +920,36 @@ void CFSImpl::initializeContactMaterials()
 }
 
 
+void CFSImpl::setMaterialTable(MaterialTable* table)
+{
+    std::lock_guard<std::mutex> lock(materialTableMutex);
+    orgMaterialTable = table;
+    if(materialTable){
+        isMaterialTableUpdateRequested = true;
+    }
+}
+
+
+/**
+   Replaces the runtime material table with the one given during the simulation
+   and rebinds the contact materials of the link pairs that have already been in contact.
+*/
+void CFSImpl::updateMaterialTable()
+{
+    std::lock_guard<std::mutex> lock(materialTableMutex);
+
+    initializeContactMaterials();
+    isMaterialTableUpdateRequested = false;
+
+    for(auto& kv : geometryPairToLinkPairMap){
+        LinkPair& linkPair = kv.second;
+        if(!linkPair.isNonContactConstraint){
+            bindContactMaterial(linkPair);
+        }
+    }
+}
+
+
 CFSImpl::ContactMaterialEx* CFSImpl::createContactMaterialFromMaterialPair(int material1, int material2)
 {
     Material* m1 = materialTable->material(material1);
@@ -719,6 +960,7 @@ CFSImpl::ContactMaterialEx* CFSImpl::createContactMaterialFromMaterialPair(int m
     cm->setRestitution(std::max(m1->viscosity(), m2->viscosity()));
     cm->cullingDistance = defaultContactCullingDistance;
     cm->cullingDepth = defaultContactCullingDepth;
+    cm->maxNumContactPoints = defaultMaxNumContactPoints;
     materialTable->setContactMaterial(material1, material2, cm);
 
     return cm;
@@ -750,13 +992,17 @@ void CFSImpl::solve()
         }
     }
 
-    bodyCollisionDetector.updatePositions();
+    if(world.isSleepingEnabled()){
+        updateSleepingBodies();
+    }
 
-    globalNumConstraintVectors = 0;
-    globalNumFrictionVectors = 0;
-    areThereImpacts = false;
+    if(isMaterialTableUpdateRequested){
+        updateMaterialTable();
+    }
 
-    constrainedLinkPairs.clear();
+    bodyCollisionDetector.updatePositions();
+
+    ++solveFrame;
 
     setConstraintPoints();
 
@@ -764,10 +1010,19 @@ void CFSImpl::solve()
         cout << globalNumContactNormalVectors;
     }
 
+    statistics = ConstraintForceSolver::Statistics();
+    statistics.numContacts = globalNumContactNormalVectors;
+
     if(globalNumConstraintVectors > 0){
 
+        decomposeIntoIslands();
+
+        statistics.problemSize = globalNumConstraintVectors + globalNumFrictionVectors;
+        statistics.numIslands = islands.size();
+
         if(CFS_DEBUG){
             os << "Num Collisions: " << globalNumContactNormalVectors << std::endl;
+            os << "Num Islands: " << islands.size() << std::endl;
         }
         if(CFS_DEBUG_VERBOSE) putContactPoints();
 
@@ -805,11 +1060,27 @@ void CFSImpl::solve()
 #ifdef USE_PIVOTING_LCP
         isConverged = callPathLCPSolver(Mlcp, b, solution);
 #else
-        if(!USE_PREVIOUS_LCP_SOLUTION || constraintsSizeChanged){
+        if(!USE_PREVIOUS_LCP_SOLUTION){
+            solution.setZero();
+        } else if(USE_CONTACT_CACHE){
+            setInitialSolutionFromContactCache();
+        } else if(constraintsSizeChanged){
             solution.setZero();
         }
-        solveMCPByProjectedGaussSeidel(Mlcp, b, solution);
+        solveMCP(Mlcp, b, solution);
         isConverged = true;
+
+        for(auto& island : islands){
+            statistics.numIterations = std::max(statistics.numIterations, island.numIterations);
+            statistics.error = std::max(statistics.error, island.error);
+            if(island.isIterationLimitReached){
+                statistics.isIterationLimitReached = true;
+            }
+        }
+
+        if(USE_PREVIOUS_LCP_SOLUTION && USE_CONTACT_CACHE){
+            updateContactCache();
+        }
 #endif
 
         if(!isConverged){
@@ -833,19 +1104,57 @@ void CFSImpl::solve()
 }
 
 
+/**
+   A sleeping body is treated as a static body until it is woken up, and the collision
+   detector does not test the pairs of the geometries of the sleeping and static bodies.
+*/
+void CFSImpl::updateSleepingBodies()
+{
+    CollisionDetector* collisionDetector = bodyCollisionDetector.collisionDetector();
+    for(size_t i=0; i < bodiesData.size(); ++i){
+        BodyData& bodyData = bodiesData[i];
+        const bool isSleeping = world.isBodySleeping(i);
+        if(isSleeping != bodyData.isSleeping){
+            for(auto& handle : bodyData.geometryHandles){
+                collisionDetector->setGeometryResting(handle, isSleeping);
+            }
+            bodyData.isSleeping = isSleeping;
+            bodyData.isStatic = isSleeping || bodyData.body->isStaticModel();
+            if(isSleeping){
+                for(auto& linkData : bodyData.linksData){
+                    linkData.dw.setZero();
+                    linkData.dvo.setZero();
+                }
+            }
+        }
+    }
+}
+
+
 void CFSImpl::setConstraintPoints()
 {
-#ifdef ENABLE_SIMULATION_PROFILING
-    timer.begin();
-#endif
+    if(isProfilingEnabled){
+        timer.begin();
+    }
 
-    bodyCollisionDetector.detectCollisions(
-        [&](const CollisionPair& collisionPair){
-            extractConstraintPoints(collisionPair); });
+    detectConstraintPoints();
+
+    /*
+      The contacts of a body woken up by a contact are not detected in the detection
+      which wakes up the body, so the detection is done again with the awake body.
+    */
+    while(areBodiesWokenUpByContacts){
+        areBodiesWokenUpByContacts = false;
+        for(auto& bodyData : bodiesData){
+            bodyData.hasConstrainedLinks = false;
+        }
+        updateSleepingBodies();
+        detectConstraintPoints();
+    }
 
-#ifdef ENABLE_SIMULATION_PROFILING
+    if(isProfilingEnabled){
         collisionTime = timer.measure();
-#endif
+    }
 
     globalNumContactNormalVectors = globalNumConstraintVectors;
 
@@ -854,7 +1163,40 @@ void CFSImpl::setConstraintPoints()
     }
 
     for(size_t i=0; i < constrain2dLinkPairs.size(); ++i){
-        set2dConstraintPoints(constrain2dLinkPairs[i]);
+        auto& linkPair = constrain2dLinkPairs[i];
+        if(!world.isBodySleeping(linkPair->bodyIndex[1])){
+            set2dConstraintPoints(linkPair);
+        }
+    }
+}
+
+
+void CFSImpl::detectConstraintPoints()
+{
+    globalNumConstraintVectors = 0;
+    globalNumFrictionVectors = 0;
+    areThereImpacts = false;
+    constrainedLinkPairs.clear();
+
+    bodyCollisionDetector.detectCollisions(
+        [&](const CollisionPair& collisionPair){
+            extractConstraintPoints(collisionPair); });
+}
+
+
+void CFSImpl::bindContactMaterial(LinkPair& linkPair)
+{
+    const int material1 = linkPair.link[0]->materialId();
+    const int material2 = linkPair.link[1]->materialId();
+
+    linkPair.contactMaterial = static_cast<ContactMaterialEx*>(materialTable->contactMaterial(material1, material2));
+    if(!linkPair.contactMaterial){
+        linkPair.contactMaterial = createContactMaterialFromMaterialPair(material1, material2);
+    }
+    if(linkPair.contactMaterial->collisionHandler){
+        linkPair.collisionHandler = &linkPair.contactMaterial->collisionHandler;
+    } else {
+        linkPair.collisionHandler = nullptr;
     }
 }
 
@@ -871,8 +1213,6 @@ void CFSImpl::extractConstraintPoints(const CollisionPair& collisionPair)
         pLinkPair->constraintPoints.clear();
     } else {
         LinkPair& linkPair = geometryPairToLinkPairMap.insert(make_pair(idPair, LinkPair())).first->second;
-        int material[2];
-        
         for(int i=0; i < 2; ++i){
             DyLink* link = static_cast<DyLink*>(collisionPair.object(i));
             const int bodyIndex = bodyIndexMap[link->body()];
@@ -881,25 +1221,39 @@ void CFSImpl::extractConstraintPoints(const CollisionPair& collisionPair)
             linkPair.bodyData[i] = &bodyData;
             linkPair.link[i] = link;
             linkPair.linkData[i] = &bodyData.linksData[link->index()];
-            material[i] = link->materialId();
         }
         linkPair.isSameBodyPair = (linkPair.bodyIndex[0] == linkPair.bodyIndex[1]);
         linkPair.isNonContactConstraint = false;
 
-        linkPair.contactMaterial = static_cast<ContactMaterialEx*>(materialTable->contactMaterial(material[0], material[1]));
-        if(!linkPair.contactMaterial){
-            linkPair.contactMaterial = createContactMaterialFromMaterialPair(material[0], material[1]);
-        }
+        bindContactMaterial(linkPair);
         
         pLinkPair = &linkPair;
     }
 
+    if(world.isSleepingEnabled()){
+        // The pairs of sleeping bodies are skipped even if the collision detector tests them
+        if(pLinkPair->bodyData[0]->isStatic && pLinkPair->bodyData[1]->isStatic){
+            return;
+        }
+        for(int i=0; i < 2; ++i){
+            const int bodyIndex = pLinkPair->bodyIndex[i];
+            if(world.isBodySleeping(bodyIndex) && !world.isBodyResting(pLinkPair->bodyIndex[1 - i])){
+                world.wakeUpBody(bodyIndex);
+                areBodiesWokenUpByContacts = true;
+            }
+        }
+        if(areBodiesWokenUpByContacts){
+            return; // All the pairs are extracted in the detection done again
+        }
+    }
+
     const vector<Collision>& collisions = collisionPair.collisions();
 
-    auto& collisionHandler = pLinkPair->contactMaterial->collisionHandler;
-    if(collisionHandler){
-        if(collisionHandler(
-               pLinkPair->link[0], pLinkPair->link[1], collisions, pLinkPair->contactMaterial)){
+    // The handler receives all the contact points of the pair in a single call.
+    // It may have been unregistered after the pair was created.
+    if(auto collisionHandler = pLinkPair->collisionHandler){
+        if(*collisionHandler &&
+           (*collisionHandler)(pLinkPair->link[0], pLinkPair->link[1], collisions, pLinkPair->contactMaterial)){
             return; // skip the contact force calculation
         }
     }
@@ -907,8 +1261,17 @@ void CFSImpl::extractConstraintPoints(const CollisionPair& collisionPair)
     pLinkPair->bodyData[0]->hasConstrainedLinks = true;
     pLinkPair->bodyData[1]->hasConstrainedLinks = true;
     
-    for(size_t i=0; i < collisions.size(); ++i){
-        setContactConstraintPoint(*pLinkPair, collisions[i]);
+    const int maxNumContactPoints = pLinkPair->contactMaterial->maxNumContactPoints;
+    if(maxNumContactPoints > 0 && static_cast<int>(collisions.size()) > maxNumContactPoints){
+        // The deepest point and the points spanning the largest area are used
+        selectContactManifoldPoints(collisions, maxNumContactPoints, contactManifoldIndices);
+        for(auto index : contactManifoldIndices){
+            setContactConstraintPoint(*pLinkPair, collisions[index]);
+        }
+    } else {
+        for(size_t i=0; i < collisions.size(); ++i){
+            setContactConstraintPoint(*pLinkPair, collisions[i]);
+        }
     }
 
     if(!pLinkPair->constraintPoints.empty()){
@@ -945,6 +1308,7 @@ bool CFSImpl::setContactConstraintPoint(LinkPair& linkPair, const Collision& col
     contact.normalTowardInside[1] = collision.normal;
     contact.normalTowardInside[0] = -contact.normalTowardInside[1];
     contact.depth = collision.depth;
+    contact.featureId = collision.id;
     contact.globalIndex = globalNumConstraintVectors++;
 
     // check velocities
@@ -1140,6 +1504,157 @@ void CFSImpl::set2dConstraintPoints(const Constrain2dLinkPairPtr& linkPair)
 
 
 
+int CFSImpl::findIslandRoot(int bodyIndex)
+{
+    int root = bodyIndex;
+    while(islandParentBodyIndices[root] != root){
+        root = islandParentBodyIndices[root];
+    }
+    // path compression
+    while(islandParentBodyIndices[bodyIndex] != root){
+        int parent = islandParentBodyIndices[bodyIndex];
+        islandParentBodyIndices[bodyIndex] = root;
+        bodyIndex = parent;
+    }
+    return root;
+}
+
+
+/**
+   Group the constrained link pairs into the islands which do not interact with each other,
+   and renumber the global indices of the constraints so that the constraints of each island
+   occupy contiguous ranges of the contact, joint and friction blocks. Static bodies do not
+   connect the islands because the test forces are never applied to them.
+*/
+void CFSImpl::decomposeIntoIslands()
+{
+    const int numBodies = bodiesData.size();
+    islandParentBodyIndices.resize(numBodies);
+    for(int i=0; i < numBodies; ++i){
+        islandParentBodyIndices[i] = i;
+    }
+
+    const int numLinkPairs = constrainedLinkPairs.size();
+
+    for(int i=0; i < numLinkPairs; ++i){
+        LinkPair* linkPair = constrainedLinkPairs[i];
+        int roots[2];
+        int numDynamicBodies = 0;
+        for(int j=0; j < 2; ++j){
+            const int bodyIndex = linkPair->bodyIndex[j];
+            if(bodyIndex >= 0 && !linkPair->bodyData[j]->isStatic){
+                roots[numDynamicBodies++] = findIslandRoot(bodyIndex);
+            }
+        }
+        if(numDynamicBodies == 2 && roots[0] != roots[1]){
+            islandParentBodyIndices[roots[1]] = roots[0];
+        }
+    }
+
+    islandIndicesOfRootBodies.assign(numBodies, -1);
+    linkPairIslandIndices.resize(numLinkPairs);
+    int numIslands = 0;
+
+    for(int i=0; i < numLinkPairs; ++i){
+        LinkPair* linkPair = constrainedLinkPairs[i];
+        int keyBodyIndex = -1;
+        for(int j=0; j < 2; ++j){
+            const int bodyIndex = linkPair->bodyIndex[j];
+            if(bodyIndex >= 0){
+                if(!linkPair->bodyData[j]->isStatic){
+                    keyBodyIndex = bodyIndex;
+                    break;
+                } else if(keyBodyIndex < 0){
+                    keyBodyIndex = bodyIndex;
+                }
+            }
+        }
+        int& islandIndex = islandIndicesOfRootBodies[findIslandRoot(keyBodyIndex)];
+        if(islandIndex < 0){
+            islandIndex = numIslands++;
+        }
+        linkPairIslandIndices[i] = islandIndex;
+    }
+
+    // Sort the link pairs so that the contact pairs come first and the pairs are grouped by islands
+    sortedLinkPairIndices.resize(numLinkPairs);
+    for(int i=0; i < numLinkPairs; ++i){
+        sortedLinkPairIndices[i] = i;
+    }
+    std::stable_sort(
+        sortedLinkPairIndices.begin(), sortedLinkPairIndices.end(),
+        [&](int i1, int i2){
+            const bool nc1 = constrainedLinkPairs[i1]->isNonContactConstraint;
+            const bool nc2 = constrainedLinkPairs[i2]->isNonContactConstraint;
+            if(nc1 != nc2){
+                return nc2;
+            }
+            return linkPairIslandIndices[i1] < linkPairIslandIndices[i2];
+        });
+
+    islands.resize(numIslands);
+    for(auto& island : islands){
+        island.numContacts = 0;
+        island.numJointConstraints = 0;
+        island.numFrictionVectors = 0;
+        island.numFrictionVectorsOfContacts.clear();
+    }
+
+    int constraintIndex = 0;
+    int frictionIndex = 0;
+    int currentIsland = -1;
+    bool isInJointBlock = false;
+    linkPairBuf.resize(numLinkPairs);
+
+    for(int i=0; i < numLinkPairs; ++i){
+        const int pairIndex = sortedLinkPairIndices[i];
+        LinkPair* linkPair = constrainedLinkPairs[pairIndex];
+        linkPairBuf[i] = linkPair;
+        const int islandIndex = linkPairIslandIndices[pairIndex];
+        ConstraintIsland& island = islands[islandIndex];
+        const bool isNewBlock =
+            (islandIndex != currentIsland) || (linkPair->isNonContactConstraint != isInJointBlock);
+        currentIsland = islandIndex;
+        isInJointBlock = linkPair->isNonContactConstraint;
+        ConstraintPointArray& constraintPoints = linkPair->constraintPoints;
+        if(!linkPair->isNonContactConstraint){
+            if(isNewBlock){
+                island.contactIndexBegin = constraintIndex;
+                island.frictionIndexBegin = frictionIndex;
+            }
+            for(auto& constraint : constraintPoints){
+                constraint.globalIndex = constraintIndex++;
+                constraint.globalFrictionIndex = frictionIndex;
+                frictionIndex += constraint.numFrictionVectors;
+                island.numFrictionVectors += constraint.numFrictionVectors;
+                island.numFrictionVectorsOfContacts.push_back(constraint.numFrictionVectors);
+            }
+            island.numContacts += constraintPoints.size();
+        } else {
+            if(isNewBlock){
+                island.jointIndexBegin = constraintIndex;
+            }
+            for(auto& constraint : constraintPoints){
+                constraint.globalIndex = constraintIndex++;
+            }
+            island.numJointConstraints += constraintPoints.size();
+        }
+    }
+
+    for(auto& island : islands){
+        if(island.numContacts == 0){
+            island.contactIndexBegin = 0;
+            island.frictionIndexBegin = 0;
+        }
+        if(island.numJointConstraints == 0){
+            island.jointIndexBegin = 0;
+        }
+    }
+
+    constrainedLinkPairs.swap(linkPairBuf);
+}
+
+
 void CFSImpl::putContactPoints()
 {
     os << "Contact Points\n";
@@ -1209,7 +1724,6 @@ void CFSImpl::initMatrices()
     } else {
         frictionIndexToContactIndex.resize(m);
         contactIndexToMu.resize(globalNumContactNormalVectors);
-        mcpHi.resize(globalNumContactNormalVectors);
     }
 
     an0.resize(n);
@@ -1254,8 +1768,8 @@ void CFSImpl::setAccelCalcSkipInformation()
 void CFSImpl::setDefaultAccelerationVector()
 {
     // calculate accelerations with no constraint force
-    for(size_t i=0; i < bodiesData.size(); ++i){
-        BodyData& bodyData = bodiesData[i];
+    auto calcDefaultAccels = [&](int bodyIndex){
+        BodyData& bodyData = bodiesData[bodyIndex];
         if(bodyData.hasConstrainedLinks && ! bodyData.isStatic){
 
             if(bodyData.forwardDynamicsCBM){
@@ -1268,6 +1782,15 @@ void CFSImpl::setDefaultAccelerationVector()
                 calcAccelsABM(bodyData, numeric_limits<int>::max());
             }
         }
+    };
+    const int numBodies = bodiesData.size();
+    if(world.isParallelForwardDynamicsEnabled() && numBodies > 1){
+        // The calculation only writes the data of each body
+        ThreadPool::instance()->parallelFor(0, numBodies, calcDefaultAccels, 1);
+    } else {
+        for(int i=0; i < numBodies; ++i){
+            calcDefaultAccels(i);
+        }
     }
 
     // extract accelerations
@@ -1393,39 +1916,53 @@ void CFSImpl::initABMForceElementsWithNoExtForce(BodyData& bodyData)
     bodyData.dptau.setZero();
 
     std::vector<LinkData>& linksData = bodyData.linksData;
-    const LinkTraverse& traverse = bodyData.body->linkTraverse();
-    const int n = traverse.numLinks();
+    const int n = linksData.size();
 
-    for(int i = n-1; i >= 0; --i){
-        DyLink* link = static_cast<DyLink*>(traverse[i]);
+    for(int i=0; i < n; ++i){
         LinkData& data = linksData[i];
-
+        DyLink* link = data.link;
         /*
           data.pf0   = link->pf;
           data.ptau0 = link->ptau;
         */
         data.pf0   = link->pf() - link->f_ext();
         data.ptau0 = link->ptau() - link->tau_ext();
+    }
+
+    /*
+      The forces of each link are pushed to the parent link. The child links come after
+      the parent link, so the forces of a link are complete when it is visited in reverse order.
+    */
+    auto& segments = bodyData.linkSegments;
+    for(auto p = segments.rbegin(); p != segments.rend(); ++p){
+        if(p->isMovable){
+            initABMForceElementsWithNoExtForce<true>(bodyData, p->begin, p->end);
+        } else {
+            initABMForceElementsWithNoExtForce<false>(bodyData, p->begin, p->end);
+        }
+    }
+}
 
-        for(DyLink* child = link->child(); child; child = child->sibling()){
 
-            LinkData& childData = linksData[child->index()];
+template<bool isMovable>
+void CFSImpl::initABMForceElementsWithNoExtForce(BodyData& bodyData, int begin, int end)
+{
+    std::vector<LinkData>& linksData = bodyData.linksData;
 
-            data.pf0   += childData.pf0;
-            data.ptau0 += childData.ptau0;
+    for(int i = end - 1; i >= begin; --i){
+        LinkData& data = linksData[i];
+        DyLink* link = data.link;
+        LinkData& parentData = linksData[data.parentIndex];
 
-            if(!child->isFixedJoint()){
-                double uu_dd = childData.uu0 / child->dd();
-                data.pf0   += uu_dd * child->hhv();
-                data.ptau0 += uu_dd * child->hhw();
-            }
-        }
+        parentData.pf0   += data.pf0;
+        parentData.ptau0 += data.ptau0;
 
-        if(i > 0){
-            if(!link->isFixedJoint()){
-                data.uu0  = link->uu() + link->u() - (link->sv().dot(data.pf0) + link->sw().dot(data.ptau0));
-                data.uu = data.uu0;
-            }
+        if(isMovable){
+            data.uu0  = link->uu() + link->u() - (link->sv().dot(data.pf0) + link->sw().dot(data.ptau0));
+            data.uu = data.uu0;
+            double uu_dd = data.uu0 / link->dd();
+            parentData.pf0   += uu_dd * link->hhv();
+            parentData.ptau0 += uu_dd * link->hhw();
         }
     }
 }
@@ -1489,8 +2026,22 @@ void CFSImpl::calcAccelsABM(BodyData& bodyData, int constraintIndex)
     bodyData.dptau.setZero();
 
     int skipCheckNumber = ASSUME_SYMMETRIC_MATRIX ? constraintIndex : (numeric_limits<int>::max() - 1);
-    int n = linksData.size();
-    for(int linkIndex = 1; linkIndex < n; ++linkIndex){
+    for(auto& segment : bodyData.linkSegments){
+        if(segment.isMovable){
+            calcAccelsABM<true>(bodyData, skipCheckNumber, segment.begin, segment.end);
+        } else {
+            calcAccelsABM<false>(bodyData, skipCheckNumber, segment.begin, segment.end);
+        }
+    }
+}
+
+
+template<bool isMovable>
+void CFSImpl::calcAccelsABM(BodyData& bodyData, int skipCheckNumber, int begin, int end)
+{
+    std::vector<LinkData>& linksData = bodyData.linksData;
+
+    for(int linkIndex = begin; linkIndex < end; ++linkIndex){
 
         LinkData& linkData = linksData[linkIndex];
 
@@ -1499,7 +2050,7 @@ void CFSImpl::calcAccelsABM(BodyData& bodyData, int constraintIndex)
             DyLink* link = linkData.link;
             LinkData& parentData = linksData[linkData.parentIndex];
 
-            if(!link->isFixedJoint()){
+            if(isMovable){
                 linkData.ddq = (linkData.uu - (link->hhv().dot(parentData.dvo) + link->hhw().dot(parentData.dw))) / link->dd();
                 linkData.dvo = parentData.dvo + link->cv() + link->sv() * linkData.ddq;
                 linkData.dw  = parentData.dw  + link->cw() + link->sw() * linkData.ddq;
@@ -1731,7 +2282,7 @@ void CFSImpl::clearSingularPointConstraintsOfClosedLoopConnections()
 
 void CFSImpl::setConstantVectorAndMuBlock()
 {
-    double dtinv = 1.0 / world.timeStep();
+    double dtinv = 1.0 / world.subTimeStep();
     const int block2 = globalNumConstraintVectors;
     const int block3 = globalNumConstraintVectors + globalNumFrictionVectors;
 
@@ -1858,12 +2409,181 @@ void CFSImpl::addConstraintForceToLink(LinkPair* linkPair, int ipair)
 
 
 
-void CFSImpl::solveMCPByProjectedGaussSeidel(const MatrixX& M, const VectorX& b, VectorX& x)
+/**
+   Give the forces of the previous step to the initial solution of the iterative solver.
+   The points of a contact link pair are matched with the cached points by the feature id
+   and the distance, and the points of a non-contact constraint are matched by the order.
+*/
+void CFSImpl::setInitialSolutionFromContactCache()
+{
+    solution.setZero();
+
+    const int n = globalNumConstraintVectors;
+    static const double r2 = CONTACT_CACHE_MATCHING_DISTANCE * CONTACT_CACHE_MATCHING_DISTANCE;
+
+    for(auto& linkPair : constrainedLinkPairs){
+
+        if(linkPair->contactCacheFrame != solveFrame - 1){
+            continue; // there is no cache of the previous step
+        }
+        auto& cache = linkPair->contactCache;
+        ConstraintPointArray& constraintPoints = linkPair->constraintPoints;
+        
+        if(linkPair->isNonContactConstraint){
+            if(cache.size() == constraintPoints.size()){
+                for(size_t i=0; i < constraintPoints.size(); ++i){
+                    solution(constraintPoints[i].globalIndex) = cache[i].normalForce;
+                }
+            }
+            continue;
+        }
+
+        for(auto& entry : cache){
+            entry.isMatched = false;
+        }
+        
+        for(auto& constraint : constraintPoints){
+            ContactCacheEntry* matched = nullptr;
+            bool isSameFeature = false;
+            double minDistance2 = r2;
+            for(auto& entry : cache){
+                if(entry.isMatched){
+                    continue;
+                }
+                const double d2 = (entry.point - constraint.point).squaredNorm();
+                if(d2 < r2){
+                    // the point of the same feature has priority
+                    const bool same = (entry.featureId == constraint.featureId);
+                    if((same && !isSameFeature) || (same == isSameFeature && d2 < minDistance2)){
+                        matched = &entry;
+                        isSameFeature = same;
+                        minDistance2 = d2;
+                    }
+                }
+            }
+            if(matched){
+                matched->isMatched = true;
+                solution(constraint.globalIndex) = matched->normalForce;
+                for(int j=0; j < constraint.numFrictionVectors; ++j){
+                    double f = matched->frictionForce.dot(constraint.frictionVector[j][1]);
+                    if(!STATIC_FRICTION_BY_TWO_CONSTRAINTS && f < 0.0){
+                        f = 0.0;
+                    }
+                    solution(n + constraint.globalFrictionIndex + j) = f;
+                }
+            }
+        }
+    }
+}
+
+
+void CFSImpl::updateContactCache()
+{
+    const int n = globalNumConstraintVectors;
+
+    for(auto& linkPair : constrainedLinkPairs){
+        auto& cache = linkPair->contactCache;
+        ConstraintPointArray& constraintPoints = linkPair->constraintPoints;
+        cache.resize(constraintPoints.size());
+        for(size_t i=0; i < constraintPoints.size(); ++i){
+            ConstraintPoint& constraint = constraintPoints[i];
+            ContactCacheEntry& entry = cache[i];
+            entry.featureId = constraint.featureId;
+            entry.point = constraint.point;
+            entry.normalForce = solution(constraint.globalIndex);
+            entry.frictionForce.setZero();
+            for(int j=0; j < constraint.numFrictionVectors; ++j){
+                entry.frictionForce +=
+                    solution(n + constraint.globalFrictionIndex + j) * constraint.frictionVector[j][1];
+            }
+        }
+        linkPair->contactCacheFrame = solveFrame;
+    }
+}
+
+
+void CFSImpl::solveMCP(const MatrixX& M, const VectorX& b, VectorX& x)
+{
+    const int numIslands = islands.size();
+
+    if(!threadPool || numIslands < 2 || CFS_MCP_DEBUG){
+        for(auto& island : islands){
+            solveIslandMCP(island, M, b, x);
+        }
+        return;
+    }
+
+    // The largest island is solved in the current thread while the others are solved in the pool
+    int largestIslandIndex = 0;
+    for(int i=1; i < numIslands; ++i){
+        if(islands[i].size() > islands[largestIslandIndex].size()){
+            largestIslandIndex = i;
+        }
+    }
+    for(int i=0; i < numIslands; ++i){
+        if(i != largestIslandIndex){
+            ConstraintIsland* island = &islands[i];
+            threadPool->start([this, &M, &b, &x, island](){ solveIslandMCP(*island, M, b, x); });
+        }
+    }
+    solveIslandMCP(islands[largestIslandIndex], M, b, x);
+
+    threadPool->wait();
+}
+
+
+/**
+   Extract the part of the MCP corresponding to the island, solve it and write back the solution.
+   The elements between different islands are zero and they are not included in the extracted problem.
+*/
+void CFSImpl::solveIslandMCP(ConstraintIsland& island, const MatrixX& M, const VectorX& b, VectorX& x)
+{
+    const int size = island.size();
+    auto& globalIndices = island.globalIndices;
+    globalIndices.resize(size);
+    island.mu.resize(island.numContacts);
+
+    int index = 0;
+    int frictionIndex = globalNumConstraintVectors + island.frictionIndexBegin;
+    for(int i=0; i < island.numContacts; ++i){
+        const int contactIndex = island.contactIndexBegin + i;
+        globalIndices[index++] = contactIndex;
+        island.mu[i] = contactIndexToMu[contactIndex];
+        const int nf = island.numFrictionVectorsOfContacts[i];
+        for(int j=0; j < nf; ++j){
+            globalIndices[index++] = frictionIndex++;
+        }
+    }
+    for(int i=0; i < island.numJointConstraints; ++i){
+        globalIndices[index++] = island.jointIndexBegin + i;
+    }
+
+    island.M.resize(size, size);
+    island.b.resize(size);
+    island.x.resize(size);
+    for(int i=0; i < size; ++i){
+        const int row = globalIndices[i];
+        for(int j=0; j < size; ++j){
+            island.M(i, j) = M(row, globalIndices[j]);
+        }
+        island.b[i] = b[row];
+        island.x[i] = x[row];
+    }
+
+    solveMCPByProjectedGaussSeidel(island);
+
+    for(int i=0; i < size; ++i){
+        x[globalIndices[i]] = island.x[i];
+    }
+}
+
+
+void CFSImpl::solveMCPByProjectedGaussSeidel(ConstraintIsland& island)
 {
     static const int loopBlockSize = DEFAULT_NUM_GAUSS_SEIDEL_ITERATION_BLOCK;
 
     if(numGaussSeidelInitialIteration > 0){
-        solveMCPByProjectedGaussSeidelInitial(M, b, x, numGaussSeidelInitialIteration);
+        solveMCPByProjectedGaussSeidelInitial(island, numGaussSeidelInitialIteration);
     }
 
     int numBlockLoops = maxNumGaussSeidelIteration / loopBlockSize;
@@ -1875,6 +2595,7 @@ void CFSImpl::solveMCPByProjectedGaussSeidel(const MatrixX& M, const VectorX& b,
         os << "Iteration ";
     }
 
+    const VectorXd& x = island.x;
     double error = 0.0;
     VectorXd x0;
     int i = 0;
@@ -1882,30 +2603,17 @@ void CFSImpl::solveMCPByProjectedGaussSeidel(const MatrixX& M, const VectorX& b,
         i++;
 
         for(int j=0; j < loopBlockSize - 1; ++j){
-            solveMCPByProjectedGaussSeidelMainStep(M, b, x);
+            solveMCPByProjectedGaussSeidelMainStep(island);
         }
 
         x0 = x;
-        solveMCPByProjectedGaussSeidelMainStep(M, b, x);
+        solveMCPByProjectedGaussSeidelMainStep(island);
 
-        if(true){
-            double n = x.norm();
-            if(n > THRESH_TO_SWITCH_REL_ERROR){
-                error = (x - x0).norm() / x.norm();
-            } else {
-                error = (x - x0).norm();
-            }
+        double n = x.norm();
+        if(n > THRESH_TO_SWITCH_REL_ERROR){
+            error = (x - x0).norm() / n;
         } else {
-            error = 0.0;
-            for(int j=0; j < x.size(); ++j){
-                double d = fabs(x(j) - x0(j));
-                if(d > THRESH_TO_SWITCH_REL_ERROR){
-                    d /= x(j);
-                }
-                if(d > error){
-                    error = d;
-                }
-            }
+            error = (x - x0).norm();
         }
 
         if(error < gaussSeidelErrorCriterion){
@@ -1916,6 +2624,10 @@ void CFSImpl::solveMCPByProjectedGaussSeidel(const MatrixX& M, const VectorX& b,
         }
     }
 
+    island.numIterations = std::max(0, numGaussSeidelInitialIteration) + i * loopBlockSize;
+    island.error = error;
+    island.isIterationLimitReached = (error >= gaussSeidelErrorCriterion);
+
     if(CFS_MCP_DEBUG){
 
         if(i == numBlockLoops){
@@ -1933,242 +2645,185 @@ void CFSImpl::solveMCPByProjectedGaussSeidel(const MatrixX& M, const VectorX& b,
 }
 
 
-void CFSImpl::solveMCPByProjectedGaussSeidelMainStep(const MatrixX& M, const VectorX& b, VectorX& x)
+/**
+   The normal component and the friction components of a contact are updated as one unit.
+   The rows of the packed matrix are contiguous, so the row products are computed by the
+   vectorized operations of Eigen, which use the SIMD instructions enabled for the compiler
+   (the ENABLE_NATIVE_CPU_ARCHITECTURE option enables AVX2 or NEON on the supported CPUs).
+*/
+void CFSImpl::solveMCPByProjectedGaussSeidelMainStep(ConstraintIsland& island)
 {
-    const int size = globalNumConstraintVectors + globalNumFrictionVectors;
+    static const double inf = numeric_limits<double>::max();
+
+    const auto& M = island.M;
+    const VectorXd& b = island.b;
+    VectorXd& x = island.x;
 
-    for(int j=0; j < globalNumContactNormalVectors; ++j){
+    int j = 0;
+    for(int i=0; i < island.numContacts; ++i){
 
-        double xx;
-        if(M(j,j) == numeric_limits<double>::max()){
-            xx=0.0;
+        double xn;
+        if(M(j,j) == inf){
+            xn = 0.0;
         } else {
-            double sum = -M(j, j) * x(j);
-            for(int k=0; k < size; ++k){
-                sum += M(j, k) * x(k);
+            const double sum = M.row(j).dot(x) - M(j, j) * x(j);
+            xn = (-b(j) - sum) / M(j, j);
+            if(xn < 0.0){
+                xn = 0.0;
             }
-            xx = (-b(j) - sum) / M(j, j);
-        }
-        if(xx < 0.0){
-            x(j) = 0.0;
-        } else {
-            x(j) = xx;
         }
-        mcpHi[j] = contactIndexToMu[j] * x(j);
-    }
-    
-    for(int j=globalNumContactNormalVectors; j < globalNumConstraintVectors; ++j){
-        
-        if(M(j,j) == numeric_limits<double>::max()){
-            x(j)=0.0;
-        } else {
-            double sum = -M(j, j) * x(j);
-            for(int k=0; k < size; ++k){
-                sum += M(j, k) * x(k);
-            }
-            x(j) = (-b(j) - sum) / M(j, j);
-        }
-    }
-    
-    
-    if(ENABLE_TRUE_FRICTION_CONE){
+        x(j) = xn;
+        const double fmax = island.mu[i] * xn;
+        ++j;
 
-        int contactIndex = 0;
-        for(int j=globalNumConstraintVectors; j < size; ++j, ++contactIndex){
-            
-            double fx0;
-            if(M(j,j) == numeric_limits<double>::max()) {
-                fx0 = 0.0;
-            } else {
-                double sum = -M(j, j) * x(j);
-                for(int k=0; k < size; ++k){
-                    sum += M(j, k) * x(k);
-                }
-                fx0 = (-b(j) - sum) / M(j, j);
+        const int nf = island.numFrictionVectorsOfContacts[i];
+
+        if(ENABLE_TRUE_FRICTION_CONE && nf == 2){
+            // The two friction components are computed from the same state and projected onto the cone
+            const Eigen::Vector2d sums = M.middleRows(j, 2) * x;
+            double fx0 = 0.0;
+            if(M(j,j) != inf){
+                fx0 = (-b(j) - (sums[0] - M(j, j) * x(j))) / M(j, j);
             }
-            double& fx = x(j);
-            
-            ++j;
-            
-            double fy0;
-            if(M(j,j) == numeric_limits<double>::max()) {
-                fy0=0.0;
-            } else {
-                double sum = -M(j, j) * x(j);
-                for(int k=0; k < size; ++k){
-                    sum += M(j, k) * x(k);
-                }
-                fy0 = (-b(j) - sum) / M(j, j);
+            const int k = j + 1;
+            double fy0 = 0.0;
+            if(M(k,k) != inf){
+                fy0 = (-b(k) - (sums[1] - M(k, k) * x(k))) / M(k, k);
             }
-            double& fy = x(j);
-            
-            const double fmax = mcpHi[contactIndex];
             const double fmax2 = fmax * fmax;
             const double fmag2 = fx0 * fx0 + fy0 * fy0;
-
             if(fmag2 > fmax2){
                 const double s = fmax / sqrt(fmag2);
-                fx = s * fx0;
-                fy = s * fy0;
+                x(j) = s * fx0;
+                x(k) = s * fy0;
             } else {
-                fx = fx0;
-                fy = fy0;
+                x(j) = fx0;
+                x(k) = fy0;
             }
-        }
-        
-    } else {
-
-        int frictionIndex = 0;
-        for(int j=globalNumConstraintVectors; j < size; ++j, ++frictionIndex){
+            j += 2;
 
-            double xx;
-            if(M(j,j) == numeric_limits<double>::max()) {
-                xx=0.0;
-            } else {
-                double sum = -M(j, j) * x(j);
-                for(int k=0; k < size; ++k){
-                    sum += M(j, k) * x(k);
-                }
-                xx = (-b(j) - sum) / M(j, j);
-            }
-            
-            const int contactIndex = frictionIndexToContactIndex[frictionIndex];
-            const double fmax = mcpHi[contactIndex];
+        } else {
             const double fmin = (STATIC_FRICTION_BY_TWO_CONSTRAINTS ? -fmax : 0.0);
-            
-            if(xx < fmin){
-                x(j) = fmin;
-            } else if(xx > fmax){
-                x(j) = fmax;
-            } else {
-                x(j) = xx;
+            for(int l=0; l < nf; ++l, ++j){
+                double xx;
+                if(M(j,j) == inf){
+                    xx = 0.0;
+                } else {
+                    const double sum = M.row(j).dot(x) - M(j, j) * x(j);
+                    xx = (-b(j) - sum) / M(j, j);
+                }
+                if(xx < fmin){
+                    x(j) = fmin;
+                } else if(xx > fmax){
+                    x(j) = fmax;
+                } else {
+                    x(j) = xx;
+                }
             }
         }
     }
+
+    const int size = x.size();
+    for( ; j < size; ++j){
+        if(M(j,j) == inf){
+            x(j) = 0.0;
+        } else {
+            const double sum = M.row(j).dot(x) - M(j, j) * x(j);
+            x(j) = (-b(j) - sum) / M(j, j);
+        }
+    }
 }
 
 
-void CFSImpl::solveMCPByProjectedGaussSeidelInitial
-(const MatrixX& M, const VectorX& b, VectorX& x, const int numIteration)
+void CFSImpl::solveMCPByProjectedGaussSeidelInitial(ConstraintIsland& island, const int numIteration)
 {
-    const int size = globalNumConstraintVectors + globalNumFrictionVectors;
+    static const double inf = numeric_limits<double>::max();
+
+    const auto& M = island.M;
+    const VectorXd& b = island.b;
+    VectorXd& x = island.x;
+    const int size = x.size();
 
     const double rstep = 1.0 / (numIteration * size);
     double r = 0.0;
 
-    for(int i=0; i < numIteration; ++i){
-
-        for(int j=0; j < globalNumContactNormalVectors; ++j){
+    for(int iteration=0; iteration < numIteration; ++iteration){
 
-            double xx;
-            if(M(j,j)==numeric_limits<double>::max()){
-                xx=0.0;
-            } else {
-                double sum = -M(j, j) * x(j);
-                for(int k=0; k < size; ++k){
-                    sum += M(j, k) * x(k);
-                }
-                xx = (-b(j) - sum) / M(j, j);
-            }
-            if(xx < 0.0){
-                x(j) = 0.0;
-            } else {
-                x(j) = r * xx;
-            }
-            r += rstep;
-            mcpHi[j] = contactIndexToMu[j] * x(j);
-        }
+        int j = 0;
+        for(int i=0; i < island.numContacts; ++i){
 
-        for(int j=globalNumContactNormalVectors; j < globalNumConstraintVectors; ++j){
-
-            if(M(j,j)==numeric_limits<double>::max()){
-                x(j) = 0.0;
+            double xn;
+            if(M(j,j) == inf){
+                xn = 0.0;
             } else {
-                double sum = -M(j, j) * x(j);
-                for(int k=0; k < size; ++k){
-                    sum += M(j, k) * x(k);
+                const double sum = M.row(j).dot(x) - M(j, j) * x(j);
+                xn = (-b(j) - sum) / M(j, j);
+                if(xn < 0.0){
+                    xn = 0.0;
                 }
-                x(j) = r * (-b(j) - sum) / M(j, j);
             }
+            x(j) = r * xn;
             r += rstep;
-        }
-
-        if(ENABLE_TRUE_FRICTION_CONE){
+            const double fmax = island.mu[i] * x(j);
+            ++j;
 
-            int contactIndex = 0;
-            for(int j=globalNumConstraintVectors; j < size; ++j, ++contactIndex){
+            const int nf = island.numFrictionVectorsOfContacts[i];
 
-                double fx0;
-                if(M(j,j)==numeric_limits<double>::max())
-                    fx0 = 0.0;
-                else{
-                    double sum = -M(j, j) * x(j);
-                    for(int k=0; k < size; ++k){
-                        sum += M(j, k) * x(k);
-                    }
-                    fx0 = (-b(j) - sum) / M(j, j);
+            if(ENABLE_TRUE_FRICTION_CONE && nf == 2){
+                const Eigen::Vector2d sums = M.middleRows(j, 2) * x;
+                double fx0 = 0.0;
+                if(M(j,j) != inf){
+                    fx0 = (-b(j) - (sums[0] - M(j, j) * x(j))) / M(j, j);
                 }
-                double& fx = x(j);
-
-                ++j;
-
-                double fy0;
-                if(M(j,j)==numeric_limits<double>::max())
-                    fy0 = 0.0;
-                else{
-                    double sum = -M(j, j) * x(j);
-                    for(int k=0; k < size; ++k){
-                        sum += M(j, k) * x(k);
-                    }
-                    fy0 = (-b(j) - sum) / M(j, j);
+                const int k = j + 1;
+                double fy0 = 0.0;
+                if(M(k,k) != inf){
+                    fy0 = (-b(k) - (sums[1] - M(k, k) * x(k))) / M(k, k);
                 }
-                double& fy = x(j);
-
-                const double fmax = mcpHi[contactIndex];
                 const double fmax2 = fmax * fmax;
                 const double fmag2 = fx0 * fx0 + fy0 * fy0;
-
                 if(fmag2 > fmax2){
                     const double s = r * fmax / sqrt(fmag2);
-                    fx = s * fx0;
-                    fy = s * fy0;
+                    x(j) = s * fx0;
+                    x(k) = s * fy0;
                 } else {
-                    fx = r * fx0;
-                    fy = r * fy0;
+                    x(j) = r * fx0;
+                    x(k) = r * fy0;
                 }
                 r += (rstep + rstep);
-            }
-
-        } else {
-
-            int frictionIndex = 0;
-            for(int j=globalNumConstraintVectors; j < size; ++j, ++frictionIndex){
+                j += 2;
 
-                double xx;
-                if(M(j,j)==numeric_limits<double>::max())
-                    xx = 0.0;
-                else{
-                    double sum = -M(j, j) * x(j);
-                    for(int k=0; k < size; ++k){
-                        sum += M(j, k) * x(k);
+            } else {
+                const double fmin = (STATIC_FRICTION_BY_TWO_CONSTRAINTS ? -fmax : 0.0);
+                for(int l=0; l < nf; ++l, ++j){
+                    double xx;
+                    if(M(j,j) == inf){
+                        xx = 0.0;
+                    } else {
+                        const double sum = M.row(j).dot(x) - M(j, j) * x(j);
+                        xx = (-b(j) - sum) / M(j, j);
                     }
-                    xx = (-b(j) - sum) / M(j, j);
+                    if(xx < fmin){
+                        x(j) = fmin;
+                    } else if(xx > fmax){
+                        x(j) = fmax;
+                    } else {
+                        x(j) = xx;
+                    }
+                    x(j) *= r;
+                    r += rstep;
                 }
+            }
+        }
 
-                const int contactIndex = frictionIndexToContactIndex[frictionIndex];
-                const double fmax = mcpHi[contactIndex];
-                const double fmin = (STATIC_FRICTION_BY_TWO_CONSTRAINTS ? -fmax : 0.0);
-
-                if(xx < fmin){
-                    x(j) = fmin;
-                } else if(xx > fmax){
-                    x(j) = fmax;
-                } else {
-                    x(j) = xx;
-                }
-                x(j) *= r;
-                r += rstep;
+        for( ; j < size; ++j){
+            if(M(j,j) == inf){
+                x(j) = 0.0;
+            } else {
+                const double sum = M.row(j).dot(x) - M(j, j) * x(j);
+                x(j) = r * (-b(j) - sum) / M(j, j);
             }
+            r += rstep;
         }
     }
 }
@@ -2317,7 +2972,7 @@ CollisionDetector* ConstraintForceSolver::collisionDetector()
 
 void ConstraintForceSolver::setMaterialTable(MaterialTable* table)
 {
-    impl->orgMaterialTable = table;
+    impl->setMaterialTable(table);
 }
 
 
@@ -2399,6 +3054,18 @@ double ConstraintForceSolver::contactCullingDepth()
 }
 
 
+void ConstraintForceSolver::setMaxNumContactPoints(int n)
+{
+    impl->defaultMaxNumContactPoints = n;
+}
+
+
+int ConstraintForceSolver::maxNumContactPoints() const
+{
+    return impl->defaultMaxNumContactPoints;
+}
+
+
 void ConstraintForceSolver::setCoefficientOfRestitution(double epsilon)
 {
     impl->defaultCoefficientOfRestitution = epsilon;
@@ -2435,6 +3102,24 @@ int ConstraintForceSolver::gaussSeidelMaxNumIterations()
 }
 
 
+void ConstraintForceSolver::setNumThreads(int n)
+{
+    impl->numThreads = std::max(0, n);
+}
+
+
+int ConstraintForceSolver::numThreads() const
+{
+    return impl->numThreads;
+}
+
+
+const ConstraintForceSolver::Statistics& ConstraintForceSolver::statistics() const
+{
+    return impl->statistics;
+}
+
+
 void ConstraintForceSolver::setContactDepthCorrection(double depth, double velocityRatio)
 {
     impl->contactCorrectionDepth = depth;
@@ -2492,16 +3177,35 @@ shared_ptr<CollisionLinkPairList> ConstraintForceSolver::getCollisions()
 
 shared_ptr<CollisionLinkPairList> CFSImpl::getCollisions()
 {
-    auto collisionPairs = std::make_shared<CollisionLinkPairList>();
+    auto& pool = *collisionListPool;
+    CollisionLinkPairList* list;
+    CollisionLinkPairList linkPairs;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if(pool.lists.empty()){
+            list = new CollisionLinkPairList;
+        } else {
+            list = pool.lists.back();
+            pool.lists.pop_back();
+        }
+        linkPairs.swap(pool.linkPairs);
+    }
+    
     for(size_t i=0; i < constrainedLinkPairs.size(); ++i){
         LinkPair& source = *constrainedLinkPairs[i];
-        auto dest = std::make_shared<CollisionLinkPair>();
+        CollisionLinkPairPtr dest;
+        if(linkPairs.empty()){
+            dest = std::make_shared<CollisionLinkPair>();
+        } else {
+            dest = std::move(linkPairs.back());
+            linkPairs.pop_back();
+        }
         int numConstraintsInPair = source.constraintPoints.size();
 
+        dest->collisions.resize(numConstraintsInPair);
         for(int j=0; j < numConstraintsInPair; ++j){
             ConstraintPoint& constraint = source.constraintPoints[j];
-            dest->collisions.push_back(Collision());
-            Collision& col = dest->collisions.back();
+            Collision& col = dest->collisions[j];
             col.point = constraint.point;
             col.normal = constraint.normalTowardInside[1];
             col.depth = constraint.depth;
@@ -2510,16 +3214,142 @@ shared_ptr<CollisionLinkPairList> CFSImpl::getCollisions()
             dest->body[j] = source.bodyData[j]->body;
             dest->link[j] = source.link[j];
         }
-        collisionPairs->push_back(dest);
+        list->push_back(std::move(dest));
+    }
+
+    if(!linkPairs.empty()){
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.linkPairs.insert(pool.linkPairs.end(), linkPairs.begin(), linkPairs.end());
+    }
+
+    std::weak_ptr<CollisionLinkPairListPool> weakPool = collisionListPool;
+    
+    return shared_ptr<CollisionLinkPairList>(
+        list,
+        [weakPool](CollisionLinkPairList* list){
+            auto pool = weakPool.lock();
+            if(!pool){
+                delete list;
+                return;
+            }
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            for(auto& linkPair : *list){
+                // The link pairs shared with other objects are not recycled
+                if(linkPair.use_count() == 1){
+                    linkPair->body[0].reset();
+                    linkPair->body[1].reset();
+                    pool->linkPairs.push_back(std::move(linkPair));
+                }
+            }
+            list->clear();
+            pool->lists.push_back(list);
+        });
+}
+
+
+/**
+   The returned object keeps the internal state which affects the following steps,
+   such as the cached contact forces used for the warm start.
+*/
+ReferencedPtr ConstraintForceSolver::storeState()
+{
+    return impl->storeState();
+}
+
+
+ReferencedPtr CFSImpl::storeState()
+{
+    StatePtr state = new State;
+
+    for(auto& kv : geometryPairToLinkPairMap){
+        LinkPair& linkPair = kv.second;
+        if(!linkPair.contactCache.empty()){
+            State::ContactCache& cache = state->contactCaches[kv.first];
+            cache.entries = linkPair.contactCache;
+            cache.frame = linkPair.contactCacheFrame;
+        }
+    }
+    for(auto& linkPair : extraJointLinkPairs){
+        state->extraJointContactCaches.push_back({ linkPair->contactCache, linkPair->contactCacheFrame });
     }
+    for(auto& linkPair : constrain2dLinkPairs){
+        state->constrain2dContactCaches.push_back({ linkPair->contactCache, linkPair->contactCacheFrame });
+    }
+    state->solveFrame = solveFrame;
+    state->numConstraintVectors = prevGlobalNumConstraintVectors;
+    state->numContactNormalVectors = globalNumContactNormalVectors;
+    state->numFrictionVectors = prevGlobalNumFrictionVectors;
+    state->solution = solution;
+    state->randomEngine = randomAngle.engine();
+
+    return state;
+}
+
 
-    return collisionPairs;
+/**
+   The state must be the one stored from the solver initialized with the same bodies.
+*/
+bool ConstraintForceSolver::restoreState(Referenced* state)
+{
+    return impl->restoreState(state);
+}
+
+
+bool CFSImpl::restoreState(Referenced* state_)
+{
+    State* state = dynamic_cast<State*>(state_);
+    if(!state ||
+       state->extraJointContactCaches.size() != extraJointLinkPairs.size() ||
+       state->constrain2dContactCaches.size() != constrain2dLinkPairs.size()){
+        return false;
+    }
+
+    for(auto& kv : geometryPairToLinkPairMap){
+        LinkPair& linkPair = kv.second;
+        auto p = state->contactCaches.find(kv.first);
+        if(p == state->contactCaches.end()){
+            linkPair.contactCache.clear();
+            linkPair.contactCacheFrame = -1;
+        } else {
+            linkPair.contactCache = p->second.entries;
+            linkPair.contactCacheFrame = p->second.frame;
+        }
+    }
+    for(size_t i=0; i < extraJointLinkPairs.size(); ++i){
+        extraJointLinkPairs[i]->contactCache = state->extraJointContactCaches[i].entries;
+        extraJointLinkPairs[i]->contactCacheFrame = state->extraJointContactCaches[i].frame;
+    }
+    for(size_t i=0; i < constrain2dLinkPairs.size(); ++i){
+        constrain2dLinkPairs[i]->contactCache = state->constrain2dContactCaches[i].entries;
+        constrain2dLinkPairs[i]->contactCacheFrame = state->constrain2dContactCaches[i].frame;
+    }
+    solveFrame = state->solveFrame;
+
+    // The matrices are resized for the previous solution so that it is used as it was
+    globalNumConstraintVectors = state->numConstraintVectors;
+    globalNumContactNormalVectors = state->numContactNormalVectors;
+    globalNumFrictionVectors = state->numFrictionVectors;
+    initMatrices();
+    prevGlobalNumConstraintVectors = state->numConstraintVectors;
+    prevGlobalNumFrictionVectors = state->numFrictionVectors;
+    if(state->solution.size() == solution.size()){
+        solution = state->solution;
+    } else {
+        solution.setZero();
+    }
+    randomAngle.engine() = state->randomEngine;
+
+    return true;
+}
+
+
+void ConstraintForceSolver::setProfilingEnabled(bool on)
+{
+    impl->isProfilingEnabled = on;
 }
 
 
-#ifdef ENABLE_SIMULATION_PROFILING
 double ConstraintForceSolver::getCollisionTime()
 {
     return impl->collisionTime;
 }
-#endif
@@ -6,6 +6,7 @@
 #define CNOID_BODY_CONSTRAINT_FORCE_SOLVER_H
 
 #include <cnoid/CollisionSeq>
+#include <cnoid/Referenced>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -42,6 +43,15 @@ public:
     
     void setContactCullingDepth(double depth);
     double contactCullingDepth();
+
+    /**
+       Set the maximum number of the contact points of a link pair. When a pair has more points,
+       the deepest point and the points spanning the largest contact area are used.
+       Zero means using all the points. The value can be overridden by the "maxNumContactPoints"
+       parameter of a contact material.
+    */
+    void setMaxNumContactPoints(int n);
+    int maxNumContactPoints() const;
     
     void setCoefficientOfRestitution(double epsilon);
     double coefficientOfRestitution() const;
@@ -52,6 +62,13 @@ public:
     void setGaussSeidelMaxNumIterations(int n);
     int gaussSeidelMaxNumIterations();
 
+    /**
+       Set the number of threads used to solve independent groups of constraints
+       (contact islands) in parallel. Zero means solving them in the calling thread.
+    */
+    void setNumThreads(int n);
+    int numThreads() const;
+
     void setContactDepthCorrection(double depth, double velocityRatio);
     double contactCorrectionDepth();
     double contactCorrectionVelocityRatio();
@@ -65,11 +82,37 @@ public:
 
     std::shared_ptr<CollisionLinkPairList> getCollisions();
 
-#ifdef ENABLE_SIMULATION_PROFILING
+    ReferencedPtr storeState();
+    bool restoreState(Referenced* state);
+
+    void setProfilingEnabled(bool on);
     double getCollisionTime();
-#endif
 
-    // experimental functions
+    /**
+       The statistics of the last call of solve(). The number of iterations and the error are
+       the maximum values of the independent groups of constraints, which are solved separately.
+       The error is the relative change of the solution in the last block of the iterations,
+       which is compared with the Gauss-Seidel error criterion.
+    */
+    struct Statistics
+    {
+        int numContacts;
+        //! The dimension of the mixed complementarity problem including the friction components
+        int problemSize;
+        int numIslands;
+        int numIterations;
+        double error;
+        //! True when a group of constraints did not converge within the maximum number of iterations
+        bool isIterationLimitReached;
+    };
+    const Statistics& statistics() const;
+
+    /**
+       experimental functions.
+       A handler is resolved for each link pair when the pair first collides, and it is called
+       once per step with all the contact points of the pair. Returning true skips the contact
+       force calculation of the pair.
+    */
     typedef std::function<bool(Link* link1, Link* link2,
                                const CollisionArray& collisions,
                                ContactMaterial* contactMaterial)>  CollisionHandler;
@@ -7,6 +7,7 @@
 #include "ForwardDynamicsABM.h"
 #include "ForwardDynamicsCBM.h"
 #include <cnoid/EigenUtil>
+#include <cnoid/ThreadPool>
 #include <string>
 #include <iostream>
 
@@ -14,6 +15,13 @@ using namespace std;
 using namespace cnoid;
 
 static const double DEFAULT_GRAVITY_ACCELERATION = 9.80665;
+static const double DEFAULT_SLEEPING_LINEAR_VELOCITY_THRESHOLD = 0.01;
+static const double DEFAULT_SLEEPING_ANGULAR_VELOCITY_THRESHOLD = 0.05;
+static const double DEFAULT_SLEEPING_RESTING_TIME = 0.5;
+static const double DEFAULT_MIN_SUB_TIME_STEP = 0.0001;
+static const double DEFAULT_SUB_STEP_ERROR_TOLERANCE = 0.001;
+// The ratio of the time step which is regarded as the end of a step
+static const double SUB_STEP_TIME_EPSILON = 1.0e-9;
 
 static const bool debugMode = false;
 
@@ -22,6 +30,7 @@ WorldBase::WorldBase()
 {
     currentTime_ = 0.0;
     timeStep_ = 0.005;
+    subTimeStep_ = timeStep_;
 
     g << 0.0, 0.0, -DEFAULT_GRAVITY_ACCELERATION;
 
@@ -29,6 +38,22 @@ WorldBase::WorldBase()
     sensorsAreEnabled = false;
     isOldAccelSensorCalcMode = false;
     numRegisteredLinkPairs = 0;
+
+    isParallelForwardDynamicsEnabled_ = false;
+
+    isAdaptiveTimeStepEnabled_ = false;
+    minSubTimeStep = DEFAULT_MIN_SUB_TIME_STEP;
+    subStepErrorTolerance = DEFAULT_SUB_STEP_ERROR_TOLERANCE;
+    nextSubTimeStep = timeStep_;
+    elapsedTimeInStep = 0.0;
+    numSubSteps_ = 1;
+    numRejectedSubSteps_ = 0;
+
+    isSleepingEnabled_ = false;
+    sleepingLinearVelocityThreshold = DEFAULT_SLEEPING_LINEAR_VELOCITY_THRESHOLD;
+    sleepingAngularVelocityThreshold = DEFAULT_SLEEPING_ANGULAR_VELOCITY_THRESHOLD;
+    sleepingRestingTime = DEFAULT_SLEEPING_RESTING_TIME;
+    numSleepingBodies_ = 0;
 }
 
 
@@ -67,6 +92,7 @@ DyBody* WorldBase::body(const std::string& name) const
 void WorldBase::setTimeStep(double ts)
 {
     timeStep_ = ts;
+    subTimeStep_ = ts;
 }
 
 
@@ -116,7 +142,266 @@ void WorldBase::initialize()
         info.forwardDynamics->enableSensors(sensorsAreEnabled);
         info.forwardDynamics->setOldAccelSensorCalcMode(isOldAccelSensorCalcMode);
         info.forwardDynamics->initialize();
+
+        // The high-gain mode joints are driven by the commands every step
+        info.canSleep =
+            isSleepingEnabled_ &&
+            !info.body->isStaticModel() &&
+            !info.hasVirtualJointForces &&
+            !dynamic_pointer_cast<ForwardDynamicsCBM>(info.forwardDynamics);
+        info.isSleeping = false;
+        info.restingTime = 0.0;
+    }
+    numSleepingBodies_ = 0;
+
+    sensorBodyIndices.clear();
+    if(sensorsAreEnabled){
+        for(int i=0; i < n; ++i){
+            auto& helper = bodyInfoArray[i].forwardDynamics->sensorSimulationHelper();
+            if(helper.hasGyroOrAccelerationSensors()){
+                helper.setBatchUpdateEnabled(true);
+                sensorBodyIndices.push_back(i);
+            }
+        }
+    }
+
+    subTimeStep_ = timeStep_;
+    nextSubTimeStep = timeStep_;
+    numSubSteps_ = 1;
+    numRejectedSubSteps_ = 0;
+    for(auto& info : bodyInfoArray){
+        info.highGainJointIndices.clear();
+        info.hasGivenJointMotions = static_cast<bool>(dynamic_pointer_cast<ForwardDynamicsCBM>(info.forwardDynamics));
+        if(isAdaptiveTimeStepEnabled_ && info.hasGivenJointMotions){
+            DyBody* body = info.body;
+            for(int i=1; i < body->numLinks(); ++i){
+                if(body->link(i)->actuationMode() == Link::JOINT_DISPLACEMENT){
+                    info.highGainJointIndices.push_back(i);
+                }
+            }
+        }
+        info.initialJointDisplacements.resize(info.highGainJointIndices.size());
+        info.targetJointDisplacements.resize(info.highGainJointIndices.size());
+        info.hasAccelerations = false;
+    }
+}
+
+
+void WorldBase::setAdaptiveTimeStepEnabled(bool on)
+{
+    isAdaptiveTimeStepEnabled_ = on;
+}
+
+
+void WorldBase::setAdaptiveTimeStepParameters(double minTimeStep, double errorTolerance)
+{
+    minSubTimeStep = minTimeStep;
+    subStepErrorTolerance = errorTolerance;
+}
+
+
+void WorldBase::setSubTimeStep(double h)
+{
+    subTimeStep_ = h;
+    for(auto& info : bodyInfoArray){
+        info.forwardDynamics->setTimeStep(h);
+    }
+}
+
+
+/**
+   The external forces and the joint targets given for the step are preserved
+   so that they can be applied to every sub-step.
+*/
+void WorldBase::beginSubSteps()
+{
+    elapsedTimeInStep = 0.0;
+    numSubSteps_ = 0;
+    numRejectedSubSteps_ = 0;
+
+    for(auto& info : bodyInfoArray){
+        DyBody* body = info.body;
+        const int n = body->numLinks();
+        info.externalForces.resize(n);
+        for(int i=0; i < n; ++i){
+            info.externalForces[i] = body->link(i)->F_ext();
+        }
+        for(size_t i=0; i < info.highGainJointIndices.size(); ++i){
+            DyLink* joint = body->link(info.highGainJointIndices[i]);
+            info.initialJointDisplacements[i] = joint->q();
+            info.targetJointDisplacements[i] = joint->q_target();
+        }
+    }
+}
+
+
+void WorldBase::beginSubStep()
+{
+    const double remainingTime = timeStep_ - elapsedTimeInStep;
+    double h = std::max(std::min(nextSubTimeStep, timeStep_), minSubTimeStep);
+    if(remainingTime <= h){
+        h = remainingTime;
+    } else if(remainingTime - h < minSubTimeStep){
+        // The remaining time is divided so that the last sub-step does not get too short
+        h = remainingTime / 2.0;
+    }
+    setSubTimeStep(h);
+
+    const double r = (elapsedTimeInStep + h) / timeStep_;
+    for(auto& info : bodyInfoArray){
+        DyBody* body = info.body;
+        // The constraint forces of the previous sub-step have been added
+        const int n = body->numLinks();
+        for(int i=0; i < n; ++i){
+            body->link(i)->F_ext() = info.externalForces[i];
+        }
+        if(!body->isStaticModel()){
+            storeSubStepState(info);
+        }
+        for(size_t i=0; i < info.highGainJointIndices.size(); ++i){
+            const double q0 = info.initialJointDisplacements[i];
+            body->link(info.highGainJointIndices[i])->q_target() =
+                q0 + r * (info.targetJointDisplacements[i] - q0);
+        }
+    }
+}
+
+
+/**
+   @return true if the step needs more sub-steps
+*/
+bool WorldBase::endSubStep()
+{
+    const double h = subTimeStep_;
+
+    double error = 0.0;
+    for(auto& info : bodyInfoArray){
+        error = std::max(error, calcSubStepError(info));
+    }
+    // The step is changed by the square root of the error ratio for the first order error
+    double ratio = 2.0;
+    if(error > 0.0){
+        ratio = std::min(2.0, std::max(0.2, 0.9 * sqrt(subStepErrorTolerance / error)));
+    }
+    nextSubTimeStep = std::max(minSubTimeStep, std::min(timeStep_, h * ratio));
+
+    if(error > subStepErrorTolerance && nextSubTimeStep < h){
+        for(auto& info : bodyInfoArray){
+            if(!info.body->isStaticModel()){
+                restoreSubStepState(info);
+            }
+        }
+        currentTime_ -= h;
+        ++numRejectedSubSteps_;
+        return true;
+    }
+
+    for(auto& info : bodyInfoArray){
+        info.accelerations.swap(info.newAccelerations);
+        info.hasAccelerations = info.accelerations.size() > 0;
+    }
+    ++numSubSteps_;
+    elapsedTimeInStep += h;
+
+    if(elapsedTimeInStep < timeStep_ * (1.0 - SUB_STEP_TIME_EPSILON)){
+        return true;
+    }
+
+    for(auto& info : bodyInfoArray){
+        for(size_t i=0; i < info.highGainJointIndices.size(); ++i){
+            info.body->link(info.highGainJointIndices[i])->q_target() = info.targetJointDisplacements[i];
+        }
+    }
+    return false;
+}
+
+
+void WorldBase::storeSubStepState(BodyInfo& info)
+{
+    DyBody* body = info.body;
+    const int n = body->numLinks();
+    info.subStepJointStates.resize(n * 3);
+    for(int i=0; i < n; ++i){
+        DyLink* link = body->link(i);
+        info.subStepJointStates[i * 3] = link->q();
+        info.subStepJointStates[i * 3 + 1] = link->dq();
+        info.subStepJointStates[i * 3 + 2] = link->ddq();
+    }
+    DyLink* rootLink = body->rootLink();
+    info.subStepRootStates[0] = rootLink->p();
+    info.subStepRootStates[1] = rootLink->v();
+    info.subStepRootStates[2] = rootLink->w();
+    info.subStepRootStates[3] = rootLink->vo();
+    info.subStepRootStates[4] = rootLink->dv();
+    info.subStepRootStates[5] = rootLink->dw();
+    info.subStepRootStates[6] = rootLink->dvo();
+    info.subStepRootRotation = rootLink->R();
+}
+
+
+void WorldBase::restoreSubStepState(BodyInfo& info)
+{
+    DyBody* body = info.body;
+    const int n = body->numLinks();
+    for(int i=0; i < n; ++i){
+        DyLink* link = body->link(i);
+        link->q() = info.subStepJointStates[i * 3];
+        link->dq() = info.subStepJointStates[i * 3 + 1];
+        link->ddq() = info.subStepJointStates[i * 3 + 2];
+    }
+    DyLink* rootLink = body->rootLink();
+    rootLink->p() = info.subStepRootStates[0];
+    rootLink->v() = info.subStepRootStates[1];
+    rootLink->w() = info.subStepRootStates[2];
+    rootLink->vo() = info.subStepRootStates[3];
+    rootLink->dv() = info.subStepRootStates[4];
+    rootLink->dw() = info.subStepRootStates[5];
+    rootLink->dvo() = info.subStepRootStates[6];
+    rootLink->R() = info.subStepRootRotation;
+    info.forwardDynamics->refreshState();
+}
+
+
+/**
+   The difference between the velocity given by the explicit Euler method and that of
+   the trapezoidal rule is used as the estimate of the error of a sub-step.
+   The accelerations of the sub-step are kept in newAccelerations until it is accepted.
+*/
+double WorldBase::calcSubStepError(BodyInfo& info)
+{
+    if(info.isSleeping || info.body->isStaticModel()){
+        info.hasAccelerations = false;
+        info.newAccelerations.resize(0);
+        return 0.0;
+    }
+    DyBody* body = info.body;
+    DyLink* rootLink = body->rootLink();
+    const int numJoints = body->numJoints();
+    const VectorXd& a0 = info.accelerations;
+    VectorXd& a = info.newAccelerations;
+    a.resize(numJoints + 6);
+    const bool hasPrevAccelerations = info.hasAccelerations && a0.size() == a.size();
+    for(int i=0; i < 3; ++i){
+        a[i] = rootLink->dvo()[i];
+        a[i + 3] = rootLink->dw()[i];
+    }
+    for(int i=0; i < numJoints; ++i){
+        a[i + 6] = body->joint(i)->ddq();
+    }
+    if(!hasPrevAccelerations){
+        return 0.0;
+    }
+    double error = 0.0;
+    for(int i=0; i < 6; ++i){
+        error = std::max(error, fabs(a[i] - a0[i]));
     }
+    for(int i=0; i < numJoints; ++i){
+        // The accelerations of the high-gain mode joints are given by the commands
+        if(!(info.hasGivenJointMotions && body->joint(i)->actuationMode() != Link::JOINT_TORQUE)){
+            error = std::max(error, fabs(a[i + 6] - a0[i + 6]));
+        }
+    }
+    return 0.5 * subTimeStep_ * error;
 }
 
 
@@ -138,11 +423,193 @@ void WorldBase::calcNextState()
     }
     const int n = bodyInfoArray.size();
 
+    if(isParallelForwardDynamicsEnabled_ && n - numSleepingBodies_ > 1){
+        ThreadPool::instance()->parallelFor(
+            0, n,
+            [&](int i){
+                BodyInfo& info = bodyInfoArray[i];
+                if(!info.isSleeping){
+                    info.forwardDynamics->calcNextState();
+                }
+            },
+            1);
+    } else {
+        for(int i=0; i < n; ++i){
+            BodyInfo& info = bodyInfoArray[i];
+            if(!info.isSleeping){
+                info.forwardDynamics->calcNextState();
+            }
+        }
+    }
+    if(!sensorBodyIndices.empty()){
+        updateGyroAndAccelerationSensors();
+    }
+    if(isSleepingEnabled_){
+        updateSleepingStates();
+    }
+    currentTime_ += subTimeStep_;
+}
+
+
+/**
+   The sensors of all the bodies are updated in a single pass instead of being updated in the
+   forward dynamics of each body. The sensors of the sleeping bodies are not updated as well as
+   those updated in the forward dynamics.
+*/
+void WorldBase::updateGyroAndAccelerationSensors()
+{
+    sensorHelpersToUpdate.clear();
+    for(auto& index : sensorBodyIndices){
+        BodyInfo& info = bodyInfoArray[index];
+        if(!info.isSleeping){
+            sensorHelpersToUpdate.push_back(&info.forwardDynamics->sensorSimulationHelper());
+        }
+    }
+    BasicSensorSimulationHelper::updateGyroAndAccelerationSensors(sensorHelpersToUpdate);
+}
+
+
+void WorldBase::setParallelForwardDynamicsEnabled(bool on)
+{
+    isParallelForwardDynamicsEnabled_ = on;
+}
+
+
+void WorldBase::setSleepingEnabled(bool on)
+{
+    isSleepingEnabled_ = on;
+}
+
+
+void WorldBase::setSleepingThresholds(double linearVelocity, double angularVelocity, double restingTime)
+{
+    sleepingLinearVelocityThreshold = linearVelocity;
+    sleepingAngularVelocityThreshold = angularVelocity;
+    sleepingRestingTime = restingTime;
+}
+
+
+void WorldBase::disallowBodySleeping(int bodyIndex)
+{
+    wakeUpBody(bodyIndex);
+    bodyInfoArray[bodyIndex].canSleep = false;
+}
+
+
+void WorldBase::wakeUpBody(int bodyIndex)
+{
+    BodyInfo& info = bodyInfoArray[bodyIndex];
+    if(info.isSleeping){
+        info.isSleeping = false;
+        --numSleepingBodies_;
+    }
+    info.restingTime = 0.0;
+}
+
+
+void WorldBase::wakeUpAllBodies()
+{
+    for(size_t i=0; i < bodyInfoArray.size(); ++i){
+        wakeUpBody(i);
+    }
+}
+
+
+void WorldBase::wakeUpDisturbedBodies()
+{
+    if(numSleepingBodies_ == 0){
+        return;
+    }
+    for(size_t i=0; i < bodyInfoArray.size(); ++i){
+        BodyInfo& info = bodyInfoArray[i];
+        if(info.isSleeping && isSleepingBodyDisturbed(info)){
+            wakeUpBody(i);
+        }
+    }
+}
+
+
+bool WorldBase::isSleepingBodyDisturbed(BodyInfo& info) const
+{
+    DyBody* body = info.body;
+    DyLink* rootLink = body->rootLink();
+    if(rootLink->p() != info.sleepingRootTranslation || rootLink->R() != info.sleepingRootRotation){
+        return true;
+    }
+    if(!rootLink->vo().isZero(0.0) || !rootLink->w().isZero(0.0)){
+        return true;
+    }
+    const int n = body->numLinks();
     for(int i=0; i < n; ++i){
+        DyLink* link = body->link(i);
+        if(!link->F_ext().isZero(0.0) || link->u() != 0.0 || link->dq() != 0.0){
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void WorldBase::updateSleepingStates()
+{
+    for(size_t i=0; i < bodyInfoArray.size(); ++i){
         BodyInfo& info = bodyInfoArray[i];
-        info.forwardDynamics->calcNextState();
+        if(info.canSleep && !info.isSleeping){
+            if(!areBodyVelocitiesBelowThresholds(info)){
+                info.restingTime = 0.0;
+            } else {
+                info.restingTime += subTimeStep_;
+                if(info.restingTime >= sleepingRestingTime){
+                    putBodyToSleep(info);
+                }
+            }
+        }
+    }
+}
+
+
+bool WorldBase::areBodyVelocitiesBelowThresholds(BodyInfo& info) const
+{
+    DyBody* body = info.body;
+    DyLink* rootLink = body->rootLink();
+    const Vector3 v = rootLink->vo() + rootLink->w().cross(rootLink->p());
+    if(v.norm() > sleepingLinearVelocityThreshold ||
+       rootLink->w().norm() > sleepingAngularVelocityThreshold){
+        return false;
+    }
+    const int n = body->numJoints();
+    for(int i=0; i < n; ++i){
+        DyLink* joint = body->joint(i);
+        const double threshold =
+            joint->isSlideJoint() ? sleepingLinearVelocityThreshold : sleepingAngularVelocityThreshold;
+        if(fabs(joint->dq()) > threshold){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void WorldBase::putBodyToSleep(BodyInfo& info)
+{
+    DyBody* body = info.body;
+    const int n = body->numLinks();
+    for(int i=0; i < n; ++i){
+        DyLink* link = body->link(i);
+        link->v().setZero();
+        link->w().setZero();
+        link->vo().setZero();
+        link->dv().setZero();
+        link->dw().setZero();
+        link->dvo().setZero();
+        link->dq() = 0.0;
+        link->ddq() = 0.0;
     }
-    currentTime_ += timeStep_;
+    DyLink* rootLink = body->rootLink();
+    info.sleepingRootTranslation = rootLink->p();
+    info.sleepingRootRotation = rootLink->R();
+    info.isSleeping = true;
+    ++numSleepingBodies_;
 }
 
 
@@ -154,6 +621,11 @@ int WorldBase::addBody(DyBody* body)
     BodyInfo info;
     info.body = body;
     info.hasVirtualJointForces = body->hasVirtualJointForces();
+    info.canSleep = false;
+    info.isSleeping = false;
+    info.restingTime = 0.0;
+    info.hasAccelerations = false;
+    info.hasGivenJointMotions = false;
     bodyInfoArray.push_back(info);
 
     return bodyInfoArray.size() - 1;
@@ -172,6 +644,7 @@ void WorldBase::clearBodies()
 {
     nameToBodyIndexMap.clear();
     bodyInfoArray.clear();
+    numSleepingBodies_ = 0;
 }
 
 
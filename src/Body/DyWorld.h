@@ -18,12 +18,6 @@ class DyLink;
 class DyBody;
 typedef ref_ptr<DyBody> DyBodyPtr;
 
-#ifdef ENABLE_SIMULATION_PROFILING
-const bool BODY_SIMULATION_PROFILING = true;
-#else
-const bool BODY_SIMULATION_PROFILING = false;
-#endif
-
 class CNOID_EXPORT WorldBase
 {
 public:
@@ -101,6 +95,42 @@ public:
        @return time step[s]
     */
     double timeStep(void) const { return timeStep_; }
+
+    /**
+       @brief get the time step of the current sub-step
+       @return the time step of the sub-step[s], which is the same as timeStep()
+       when the adaptive time step mode is disabled
+    */
+    double subTimeStep() const { return subTimeStep_; }
+
+    /**
+       @brief enable/disable the adaptive time step mode
+       In this mode, a step of timeStep() is divided into the sub-steps, and the time step
+       of the sub-steps is changed by the estimated error of the velocities, which is
+       given by the change of the accelerations over a sub-step. A sub-step whose error
+       exceeds the tolerance is retried from its initial state with a smaller time step
+       unless the time step is the minimum one. The time step is reduced
+       around the events such as the impacts and is extended in the quiet phases up to
+       timeStep(), so the controllers and the recording keep the fixed rate of timeStep().
+       The external forces of the links and the targets of the high-gain mode joints given
+       for a step are applied to all the sub-steps, where the targets are interpolated.
+       @note The old acceleration sensor mode assumes the fixed time step.
+    */
+    void setAdaptiveTimeStepEnabled(bool on);
+    bool isAdaptiveTimeStepEnabled() const { return isAdaptiveTimeStepEnabled_; }
+
+    /**
+       @param minTimeStep the minimum time step of the sub-steps [s]
+       @param errorTolerance the tolerance of the estimated velocity error of a sub-step
+       [m/s] or [rad/s]
+    */
+    void setAdaptiveTimeStepParameters(double minTimeStep, double errorTolerance);
+
+    //! @return the number of the sub-steps in the last step
+    int numSubSteps() const { return numSubSteps_; }
+
+    //! @return the number of the sub-steps which are rejected and retried in the last step
+    int numRejectedSubSteps() const { return numRejectedSubSteps_; }
 	
     /**
        @brief set current time
@@ -158,6 +188,64 @@ public:
     */
     virtual void calcNextState();
 
+    /**
+       @brief enable/disable the parallel calculation of the forward dynamics of the bodies
+       The bodies are processed on the shared thread pool both in the calculation of the
+       accelerations without the constraint forces and in the integration of the states.
+       Each task only writes the states of its own body, and the updates over the bodies
+       such as the sleeping states are done in the order of the bodies after the tasks finish,
+       so the results are the same as those of the sequential calculation.
+       @note The forward dynamics objects of the bodies must not share any data.
+    */
+    void setParallelForwardDynamicsEnabled(bool on);
+    bool isParallelForwardDynamicsEnabled() const { return isParallelForwardDynamicsEnabled_; }
+
+    /**
+       @brief enable/disable the sleeping of the bodies at rest
+       A body whose velocities stay below the thresholds for the resting time falls asleep,
+       and its forward dynamics is not calculated until it is woken up.
+       A sleeping body is woken up by an external force, a joint torque, a change of its
+       position or velocity by the outside of the world, or a contact with a moving body.
+       @note This must be called before initialize() is called.
+    */
+    void setSleepingEnabled(bool on);
+    bool isSleepingEnabled() const { return isSleepingEnabled_; }
+
+    /**
+       @param linearVelocity threshold of the linear velocity of the root link and the slide joints [m/s]
+       @param angularVelocity threshold of the angular velocity of the root link and the rotational joints [rad/s]
+       @param restingTime time for which a body must be at rest to fall asleep [s]
+    */
+    void setSleepingThresholds(double linearVelocity, double angularVelocity, double restingTime);
+
+    /**
+       @brief disallow a body to sleep. This is used for the bodies with the constraints
+       which do not work with the sleeping.
+       @note This must be called after initialize() is called.
+    */
+    void disallowBodySleeping(int bodyIndex);
+
+    bool isBodySleeping(int bodyIndex) const { return bodyInfoArray[bodyIndex].isSleeping; }
+
+    /**
+       @return true if the body is sleeping or its velocities were below the thresholds
+       in the last step. A contact with a resting body does not wake up a sleeping body.
+    */
+    bool isBodyResting(int bodyIndex) const {
+        const BodyInfo& info = bodyInfoArray[bodyIndex];
+        return info.isSleeping || info.restingTime > 0.0;
+    }
+    void wakeUpBody(int bodyIndex);
+    void wakeUpAllBodies();
+
+    /**
+       @brief wake up the sleeping bodies which are disturbed by the external forces,
+       the joint torques or the changes of their states since the bodies fell asleep
+    */
+    void wakeUpDisturbedBodies();
+
+    int numSleepingBodies() const { return numSleepingBodies_; }
+
     /**
        @brief get index of link pairs
        @param link1 link1
@@ -177,12 +265,66 @@ protected:
         DyBodyPtr body;
         std::shared_ptr<ForwardDynamics> forwardDynamics;
         bool hasVirtualJointForces;
+        bool canSleep;
+        bool isSleeping;
+        double restingTime;
+        // The root link position when the body fell asleep
+        Vector3 sleepingRootTranslation;
+        Matrix3 sleepingRootRotation;
+        // The states kept over the sub-steps of the adaptive time step mode
+        std::vector<Vector6, Eigen::aligned_allocator<Vector6>> externalForces;
+        std::vector<int> highGainJointIndices;
+        std::vector<double> initialJointDisplacements;
+        std::vector<double> targetJointDisplacements;
+        VectorXd accelerations;
+        VectorXd newAccelerations;
+        bool hasAccelerations;
+        bool hasGivenJointMotions;
+        // The state at the beginning of a sub-step, which is restored when the sub-step is rejected
+        std::vector<double> subStepJointStates;
+        Vector3 subStepRootStates[7];
+        Matrix3 subStepRootRotation;
     };
     std::vector<BodyInfo> bodyInfoArray;
 
     bool sensorsAreEnabled;
     bool isOldAccelSensorCalcMode;
 
+    // The bodies whose rate gyro and acceleration sensors are updated in a batch after the forward dynamics
+    std::vector<int> sensorBodyIndices;
+    std::vector<BasicSensorSimulationHelper*> sensorHelpersToUpdate;
+    void updateGyroAndAccelerationSensors();
+
+    bool isParallelForwardDynamicsEnabled_;
+
+    double subTimeStep_;
+    bool isAdaptiveTimeStepEnabled_;
+    double minSubTimeStep;
+    double subStepErrorTolerance;
+    double nextSubTimeStep;
+    double elapsedTimeInStep;
+    int numSubSteps_;
+    int numRejectedSubSteps_;
+
+    void beginSubSteps();
+    void beginSubStep();
+    bool endSubStep();
+    void storeSubStepState(BodyInfo& info);
+    void restoreSubStepState(BodyInfo& info);
+    double calcSubStepError(BodyInfo& info);
+    void setSubTimeStep(double h);
+
+    bool isSleepingEnabled_;
+    double sleepingLinearVelocityThreshold;
+    double sleepingAngularVelocityThreshold;
+    double sleepingRestingTime;
+    int numSleepingBodies_;
+
+    void updateSleepingStates();
+    bool areBodyVelocitiesBelowThresholds(BodyInfo& info) const;
+    bool isSleepingBodyDisturbed(BodyInfo& info) const;
+    void putBodyToSleep(BodyInfo& info);
+
 private:
     typedef std::map<std::string, int> NameToIndexMap;
     NameToIndexMap nameToBodyIndexMap;
@@ -211,14 +353,28 @@ template <class TConstraintForceSolver> class World : public WorldBase
 public:
     TConstraintForceSolver constraintForceSolver;
 
-#ifdef ENABLE_SIMULATION_PROFILING
     double forceSolveTime;
     double forwardDynamicsTime;
     double customizerTime;
     TimeMeasure timer;
-#endif
 
-    World() : constraintForceSolver(*this) { }
+    World() : constraintForceSolver(*this) {
+        isProfilingEnabled_ = false;
+        forceSolveTime = 0.0;
+        forwardDynamicsTime = 0.0;
+        customizerTime = 0.0;
+    }
+
+    /**
+       The computation times of the phases are measured when the profiling is enabled.
+       The measurement is cheap enough to keep it enabled in the usual simulation.
+    */
+    void setProfilingEnabled(bool on){
+        isProfilingEnabled_ = on;
+        constraintForceSolver.setProfilingEnabled(on);
+    }
+
+    bool isProfilingEnabled() const { return isProfilingEnabled_; }
 
     virtual void initialize() {
         WorldBase::initialize();
@@ -226,23 +382,44 @@ public:
     }
 
     virtual void calcNextState(){
-#ifdef ENABLE_SIMULATION_PROFILING
+        if(isProfilingEnabled_){
+            customizerTime = 0.0;
+            forceSolveTime = 0.0;
+            forwardDynamicsTime = 0.0;
+        }
+        if(!isAdaptiveTimeStepEnabled_){
+            calcNextSubState();
+        } else {
+            WorldBase::beginSubSteps();
+            do {
+                WorldBase::beginSubStep();
+                calcNextSubState();
+            } while(WorldBase::endSubStep());
+        }
+    }
+
+private:
+    bool isProfilingEnabled_;
+
+    void calcNextSubState(){
+        if(isSleepingEnabled_){
+            WorldBase::wakeUpDisturbedBodies();
+        }
+        if(!isProfilingEnabled_){
+            WorldBase::setVirtualJointForces();
+            constraintForceSolver.solve();
+            WorldBase::calcNextState();
+        } else {
             timer.begin();
-#endif
-        WorldBase::setVirtualJointForces();
-#ifdef ENABLE_SIMULATION_PROFILING
-        customizerTime = timer.measure();
-        timer.begin();
-#endif
-        constraintForceSolver.solve();
-#ifdef ENABLE_SIMULATION_PROFILING
-        forceSolveTime = timer.measure();
-        timer.begin();
-#endif
-        WorldBase::calcNextState();
-#ifdef ENABLE_SIMULATION_PROFILING
-        forwardDynamicsTime = timer.measure();
-#endif
+            WorldBase::setVirtualJointForces();
+            customizerTime += timer.measure();
+            timer.begin();
+            constraintForceSolver.solve();
+            forceSolveTime += timer.measure();
+            timer.begin();
+            WorldBase::calcNextState();
+            forwardDynamicsTime += timer.measure();
+        }
     }
 };
 
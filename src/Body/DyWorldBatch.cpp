@@ -0,0 +1,364 @@
+/**
+   \file
+*/
+
+#include "DyWorldBatch.h"
+#include "DyWorld.h"
+#include "DyBody.h"
+#include "ConstraintForceSolver.h"
+#include <cnoid/MaterialTable>
+#include <cnoid/ThreadPool>
+#include <memory>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+/**
+   The state of a link including the internal variables of the dynamics computation
+   which are carried over to the next step
+*/
+struct LinkSnapshot
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Position T;
+    Vector3 v, w, dv, dw;
+    double q, dq, ddq, u;
+    Vector3 vo, dvo, sw, sv, cv, cw;
+    Matrix3 Iww, Iwv, Ivv;
+    Vector3 pf, ptau, hhv, hhw;
+    double uu, dd;
+
+    void store(DyLink* link){
+        T = link->T(); v = link->v(); w = link->w(); dv = link->dv(); dw = link->dw();
+        q = link->q(); dq = link->dq(); ddq = link->ddq(); u = link->u();
+        vo = link->vo(); dvo = link->dvo(); sw = link->sw(); sv = link->sv(); cv = link->cv(); cw = link->cw();
+        Iww = link->Iww(); Iwv = link->Iwv(); Ivv = link->Ivv();
+        pf = link->pf(); ptau = link->ptau(); hhv = link->hhv(); hhw = link->hhw();
+        uu = link->uu(); dd = link->dd();
+    }
+    void restore(DyLink* link) const {
+        link->T() = T; link->v() = v; link->w() = w; link->dv() = dv; link->dw() = dw;
+        link->q() = q; link->dq() = dq; link->ddq() = ddq; link->u() = u;
+        link->vo() = vo; link->dvo() = dvo; link->sw() = sw; link->sv() = sv; link->cv() = cv; link->cw() = cw;
+        link->Iww() = Iww; link->Iwv() = Iwv; link->Ivv() = Ivv;
+        link->pf() = pf; link->ptau() = ptau; link->hhv() = hhv; link->hhw() = hhw;
+        link->uu() = uu; link->dd() = dd;
+    }
+};
+
+typedef vector<LinkSnapshot, Eigen::aligned_allocator<LinkSnapshot>> LinkSnapshotArray;
+
+struct WorldInstance
+{
+    World<ConstraintForceSolver> world;
+    vector<DyBodyPtr> bodies;
+    vector<LinkSnapshotArray> initialLinkStates;
+    ReferencedPtr initialSolverState;
+};
+
+struct TemplateBody
+{
+    BodyPtr body;
+    bool isSelfCollisionDetectionEnabled;
+};
+
+}
+
+namespace cnoid {
+
+class DyWorldBatchImpl
+{
+public:
+    vector<TemplateBody> templateBodies;
+    vector<unique_ptr<WorldInstance>> worlds;
+    vector<int> jointOffsets;
+    int numJoints;
+    double timeStep;
+    Vector3 g;
+    bool isEulerMethod;
+    double staticFriction;
+    double slipFriction;
+    MaterialTablePtr materialTable;
+
+    DyWorldBatchImpl();
+    void createWorld(WorldInstance& instance);
+    void reset(WorldInstance& instance);
+};
+
+}
+
+
+DyWorldBatch::DyWorldBatch()
+{
+    impl = new DyWorldBatchImpl;
+}
+
+
+DyWorldBatchImpl::DyWorldBatchImpl()
+{
+    numJoints = 0;
+    timeStep = 0.001;
+    g << 0.0, 0.0, -9.80665;
+    isEulerMethod = true;
+    staticFriction = 1.0;
+    slipFriction = 1.0;
+}
+
+
+DyWorldBatch::~DyWorldBatch()
+{
+    delete impl;
+}
+
+
+int DyWorldBatch::addBody(Body* body, bool isSelfCollisionDetectionEnabled)
+{
+    impl->templateBodies.push_back({ body->clone(), isSelfCollisionDetectionEnabled });
+    return impl->templateBodies.size() - 1;
+}
+
+
+void DyWorldBatch::clearBodies()
+{
+    impl->templateBodies.clear();
+    impl->worlds.clear();
+}
+
+
+int DyWorldBatch::numBodies() const
+{
+    return impl->templateBodies.size();
+}
+
+
+void DyWorldBatch::setTimeStep(double dt)
+{
+    impl->timeStep = dt;
+}
+
+
+double DyWorldBatch::timeStep() const
+{
+    return impl->timeStep;
+}
+
+
+void DyWorldBatch::setGravityAcceleration(const Vector3& g)
+{
+    impl->g = g;
+}
+
+
+void DyWorldBatch::setEulerMethod()
+{
+    impl->isEulerMethod = true;
+}
+
+
+void DyWorldBatch::setRungeKuttaMethod()
+{
+    impl->isEulerMethod = false;
+}
+
+
+void DyWorldBatch::setFriction(double staticFriction, double slipFriction)
+{
+    impl->staticFriction = staticFriction;
+    impl->slipFriction = slipFriction;
+}
+
+
+void DyWorldBatch::setMaterialTable(MaterialTable* table)
+{
+    impl->materialTable = table;
+}
+
+
+void DyWorldBatch::createWorlds(int numWorlds)
+{
+    impl->worlds.clear();
+
+    impl->jointOffsets.clear();
+    impl->numJoints = 0;
+    for(auto& templateBody : impl->templateBodies){
+        impl->jointOffsets.push_back(impl->numJoints);
+        impl->numJoints += templateBody.body->numJoints();
+    }
+
+    impl->worlds.resize(numWorlds);
+    for(auto& instance : impl->worlds){
+        instance.reset(new WorldInstance);
+    }
+    // The collision detectors build the bounding volume hierarchies of the copies here
+    ThreadPool::instance()->parallelFor(
+        0, numWorlds, [&](int i){ impl->createWorld(*impl->worlds[i]); }, 1);
+}
+
+
+void DyWorldBatchImpl::createWorld(WorldInstance& instance)
+{
+    auto& world = instance.world;
+
+    if(isEulerMethod){
+        world.setEulerMethod();
+    } else {
+        world.setRungeKuttaMethod();
+    }
+    world.setGravityAcceleration(g);
+    world.setTimeStep(timeStep);
+    world.setCurrentTime(0.0);
+    // The worlds are processed in parallel instead
+    world.setParallelForwardDynamicsEnabled(false);
+
+    auto& cfs = world.constraintForceSolver;
+    cfs.setNumThreads(0);
+    cfs.setMaterialTable(materialTable);
+    cfs.setFriction(staticFriction, slipFriction);
+
+    for(auto& templateBody : templateBodies){
+        DyBodyPtr body = new DyBody(*templateBody.body);
+        int bodyIndex = world.addBody(body);
+        cfs.setSelfCollisionDetectionEnabled(bodyIndex, templateBody.isSelfCollisionDetectionEnabled);
+        instance.bodies.push_back(body);
+    }
+
+    world.initialize();
+
+    instance.initialLinkStates.resize(instance.bodies.size());
+    for(size_t i=0; i < instance.bodies.size(); ++i){
+        DyBody* body = instance.bodies[i];
+        auto& states = instance.initialLinkStates[i];
+        states.resize(body->numLinks());
+        for(int j=0; j < body->numLinks(); ++j){
+            states[j].store(body->link(j));
+        }
+    }
+    instance.initialSolverState = cfs.storeState();
+}
+
+
+int DyWorldBatch::numWorlds() const
+{
+    return impl->worlds.size();
+}
+
+
+int DyWorldBatch::numJoints() const
+{
+    return impl->numJoints;
+}
+
+
+DyBody* DyWorldBatch::body(int worldIndex, int bodyIndex)
+{
+    return impl->worlds[worldIndex]->bodies[bodyIndex];
+}
+
+
+double DyWorldBatch::currentTime(int worldIndex) const
+{
+    return impl->worlds[worldIndex]->world.currentTime();
+}
+
+
+void DyWorldBatch::setJointTorques(const MatrixXd& u)
+{
+    const int n = impl->worlds.size();
+    for(int i=0; i < n; ++i){
+        auto& bodies = impl->worlds[i]->bodies;
+        for(size_t j=0; j < bodies.size(); ++j){
+            DyBody* body = bodies[j];
+            const int offset = impl->jointOffsets[j];
+            for(int k=0; k < body->numJoints(); ++k){
+                body->joint(k)->u() = u(i, offset + k);
+            }
+        }
+    }
+}
+
+
+void DyWorldBatch::step()
+{
+    ThreadPool::instance()->parallelFor(
+        0, impl->worlds.size(),
+        [&](int i){
+            auto& world = impl->worlds[i]->world;
+            world.constraintForceSolver.clearExternalForces();
+            world.calcNextState();
+        });
+}
+
+
+void DyWorldBatch::reset(int worldIndex)
+{
+    impl->reset(*impl->worlds[worldIndex]);
+}
+
+
+void DyWorldBatch::resetAll()
+{
+    ThreadPool::instance()->parallelFor(
+        0, impl->worlds.size(), [&](int i){ impl->reset(*impl->worlds[i]); });
+}
+
+
+void DyWorldBatchImpl::reset(WorldInstance& instance)
+{
+    auto& world = instance.world;
+    world.setCurrentTime(0.0);
+    for(size_t i=0; i < instance.bodies.size(); ++i){
+        DyBody* body = instance.bodies[i];
+        auto& states = instance.initialLinkStates[i];
+        for(int j=0; j < body->numLinks(); ++j){
+            states[j].restore(body->link(j));
+        }
+    }
+    world.wakeUpAllBodies();
+    world.constraintForceSolver.restoreState(instance.initialSolverState);
+}
+
+
+void DyWorldBatch::getJointStates(MatrixXd& out_q, MatrixXd& out_dq) const
+{
+    const int n = impl->worlds.size();
+    out_q.resize(n, impl->numJoints);
+    out_dq.resize(n, impl->numJoints);
+    for(int i=0; i < n; ++i){
+        auto& bodies = impl->worlds[i]->bodies;
+        for(size_t j=0; j < bodies.size(); ++j){
+            DyBody* body = bodies[j];
+            const int offset = impl->jointOffsets[j];
+            for(int k=0; k < body->numJoints(); ++k){
+                DyLink* joint = body->joint(k);
+                out_q(i, offset + k) = joint->q();
+                out_dq(i, offset + k) = joint->dq();
+            }
+        }
+    }
+}
+
+
+void DyWorldBatch::getRootStates(MatrixXd& out_states) const
+{
+    const int n = impl->worlds.size();
+    const int numBodies = impl->templateBodies.size();
+    out_states.resize(n, numBodies * 13);
+    for(int i=0; i < n; ++i){
+        auto& bodies = impl->worlds[i]->bodies;
+        for(int j=0; j < numBodies; ++j){
+            DyLink* root = bodies[j]->rootLink();
+            auto s = out_states.block<1, 13>(i, j * 13);
+            s.segment<3>(0) = root->p();
+            const Quat quat(root->R());
+            s(3) = quat.w();
+            s(4) = quat.x();
+            s(5) = quat.y();
+            s(6) = quat.z();
+            s.segment<3>(7) = root->v();
+            s.segment<3>(10) = root->w();
+        }
+    }
+}
@@ -0,0 +1,90 @@
+/**
+   \file
+*/
+
+#ifndef CNOID_BODY_DYWORLD_BATCH_H
+#define CNOID_BODY_DYWORLD_BATCH_H
+
+#include <cnoid/EigenTypes>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class Body;
+class DyBody;
+class MaterialTable;
+class DyWorldBatchImpl;
+
+/**
+   This class runs many independent copies of the same world for the applications such as
+   reinforcement learning. Each copy has its own World<ConstraintForceSolver> and the copies
+   of the template bodies, and all the copies are stepped together on the shared thread pool.
+   The joints are driven by the torques given for each copy, and the joint states and the root
+   link states of the copies are exchanged as matrices where a row corresponds to a copy.
+   The columns of the joint values are the joints of the bodies in the order of the bodies
+   and the joint ids.
+*/
+class CNOID_EXPORT DyWorldBatch
+{
+public:
+    DyWorldBatch();
+    ~DyWorldBatch();
+
+    DyWorldBatch(const DyWorldBatch&) = delete;
+    DyWorldBatch& operator=(const DyWorldBatch&) = delete;
+
+    /**
+       The current state of the body is the initial state of the copies.
+       The body is copied when createWorlds() is called.
+       \return The index of the body in a world
+    */
+    int addBody(Body* body, bool isSelfCollisionDetectionEnabled = false);
+    void clearBodies();
+    int numBodies() const;
+
+    void setTimeStep(double dt);
+    double timeStep() const;
+    void setGravityAcceleration(const Vector3& g);
+    void setEulerMethod();
+    void setRungeKuttaMethod();
+    void setFriction(double staticFriction, double slipFriction);
+    void setMaterialTable(MaterialTable* table);
+
+    //! The existing copies are discarded
+    void createWorlds(int numWorlds);
+    int numWorlds() const;
+
+    //! The number of the joint columns
+    int numJoints() const;
+
+    DyBody* body(int worldIndex, int bodyIndex);
+    double currentTime(int worldIndex) const;
+
+    //! \param u The joint torques, where a row corresponds to a world
+    void setJointTorques(const MatrixXd& u);
+
+    void step();
+    void step(const MatrixXd& u) {
+        setJointTorques(u);
+        step();
+    }
+
+    //! Restores the initial state of a world
+    void reset(int worldIndex);
+    void resetAll();
+
+    void getJointStates(MatrixXd& out_q, MatrixXd& out_dq) const;
+
+    /**
+       The state of the root link of each body consists of 13 columns, which are the position,
+       the quaternion in the order of w, x, y, z, the linear velocity and the angular velocity.
+    */
+    void getRootStates(MatrixXd& out_states) const;
+
+private:
+    DyWorldBatchImpl* impl;
+};
+
+}
+
+#endif
@@ -62,6 +62,12 @@ void ForwardDynamics::setOldAccelSensorCalcMode(bool on)
 }
 
 
+void ForwardDynamics::setSensorTimeMeasurementEnabled(bool on)
+{
+    sensorHelper.setTimeMeasurementEnabled(on);
+}
+
+
 /// function from Murray, Li and Sastry p.42
 void ForwardDynamics::SE3exp
 (Position& out_T, const Position& T0, const Vector3& w, const Vector3& vo, double dt)
@@ -83,6 +89,12 @@ void ForwardDynamics::SE3exp
 }
 
 
+void ForwardDynamics::refreshState()
+{
+
+}
+
+
 void ForwardDynamics::initializeSensors()
 {
     body->initializeDeviceStates();
@@ -35,9 +35,20 @@ public:
     void enableSensors(bool on);
     void setOldAccelSensorCalcMode(bool on);
 
+    //! The computation times of the sensors are accumulated in the sensor simulation helper
+    void setSensorTimeMeasurementEnabled(bool on);
+    BasicSensorSimulationHelper& sensorSimulationHelper() { return sensorHelper; }
+
     virtual void initialize() = 0;
     virtual void calcNextState() = 0;
 
+    /**
+       Recalculates the internal states of the dynamics from the joint displacements,
+       the joint velocities and the root link state of the body when they have been
+       restored from the outside to those of a previous step.
+    */
+    virtual void refreshState();
+
 protected:
 
     virtual void initializeSensors();
@@ -7,6 +7,7 @@
 #include "DyBody.h"
 #include "LinkTraverse.h"
 #include <cnoid/EigenUtil>
+#include <cnoid/TimeMeasure>
 
 using namespace std;
 using namespace cnoid;
@@ -14,6 +15,84 @@ using namespace cnoid;
 static const bool debugMode = false;
 static const bool rootAttitudeNormalizationEnabled = false;
 
+namespace {
+
+enum LinkKernelType {
+    // The revolute joints whose axes are the coordinate axes of the link frames
+    REVOLUTE_X_KERNEL = 0,
+    REVOLUTE_Y_KERNEL = 1,
+    REVOLUTE_Z_KERNEL = 2,
+    REVOLUTE_KERNEL,
+    PRISMATIC_KERNEL,
+    FIXED_KERNEL,
+    // Used for the segments of the dynamics calculation, which only depends on whether the joint is fixed
+    MOVABLE_KERNEL
+};
+
+template<class SegmentArray>
+void addLinkToKernelSegments(SegmentArray& segments, int kernel, int index)
+{
+    if(!segments.empty() && segments.back().kernel == kernel){
+        segments.back().end = index + 1;
+    } else {
+        typename SegmentArray::value_type segment;
+        segment.kernel = kernel;
+        segment.begin = index;
+        segment.end = index + 1;
+        segments.push_back(segment);
+    }
+}
+
+//! R = parentR * (the rotation of q about the coordinate axis)
+template<int axis, class RotationBlock, class ParentRotation>
+inline void setRotationAboutCoordinateAxis(RotationBlock R, const ParentRotation& parentR, double q)
+{
+    const int j = (axis + 1) % 3;
+    const int k = (axis + 2) % 3;
+    const double c = cos(q);
+    const double s = sin(q);
+    R.col(axis) = parentR.col(axis);
+    R.col(j) = c * parentR.col(j) + s * parentR.col(k);
+    R.col(k) = c * parentR.col(k) - s * parentR.col(j);
+}
+
+void calcInertiaAndBiasForces(DyLink* link, const Vector3& g, bool updateNonSpatialVariables)
+{
+    if(updateNonSpatialVariables){
+        link->v().noalias() = link->vo() + link->w().cross(link->p());
+    }
+    link->wc().noalias() = link->R() * link->c() + link->p();
+        
+    // compute I^s (Eq.(6.24) of Kajita's textbook))
+    const Matrix3 Iw = link->R() * link->I() * link->R().transpose();
+        
+    const double m = link->m();
+    const Matrix3 c_hat = hat(link->wc());
+    link->Iww().noalias() = m * c_hat * c_hat.transpose() + Iw;
+
+    link->Ivv() <<
+        m,  0.0, 0.0,
+        0.0,  m,  0.0,
+        0.0, 0.0,  m;
+        
+    link->Iwv() = m * c_hat;
+        
+    // compute P and L (Eq.(6.25) of Kajita's textbook)
+    const Vector3 P = m * (link->vo() + link->w().cross(link->wc()));
+    const Vector3 L = link->Iww() * link->w() + m * link->wc().cross(link->vo());
+        
+    link->pf().noalias() = link->w().cross(P);
+    link->ptau().noalias() = link->vo().cross(P) + link->w().cross(L);
+        
+    const Vector3 fg = m * g;
+    const Vector3 tg = link->wc().cross(fg);
+        
+    link->pf() -= fg;
+    link->ptau() -= tg;
+}
+
+}
+
 
 ForwardDynamicsABM::ForwardDynamicsABM(DyBody* body) :
     ForwardDynamics(body),
@@ -44,6 +123,7 @@ void ForwardDynamicsABM::initialize()
     rootLink->uu() = 0.0;
     rootLink->dd() = 0.0;
 
+    initializeLinkKernels();
     initializeSensors();
     calcABMFirstHalf();
 }
@@ -63,6 +143,12 @@ inline void ForwardDynamicsABM::calcABMLastHalf()
 }
 
 
+void ForwardDynamicsABM::refreshState()
+{
+    calcABMFirstHalf();
+}
+
+
 void ForwardDynamicsABM::calcNextState()
 {
     switch(integrationMode){
@@ -82,7 +168,7 @@ void ForwardDynamicsABM::calcNextState()
 
     calcABMFirstHalf();
 
-    if(sensorsEnabled){
+    if(sensorsEnabled && !sensorHelper.isBatchUpdateEnabled()){
         sensorHelper.updateGyroAndAccelerationSensors();
     }
 }
@@ -211,41 +297,117 @@ void ForwardDynamicsABM::calcMotionWithRungeKuttaMethod()
 }
 
 
+void ForwardDynamicsABM::initializeLinkKernels()
+{
+    linkKernels.clear();
+    kinematicsSegments.clear();
+    dynamicsSegments.clear();
+
+    const LinkTraverse& traverse = body->linkTraverse();
+    const int n = traverse.numLinks();
+
+    for(int i=1; i < n; ++i){
+        DyLink* link = static_cast<DyLink*>(traverse[i]);
+        LinkKernel lk;
+        lk.link = link;
+        lk.parent = link->parent();
+        lk.axisSign = 1.0;
+
+        switch(link->jointType()){
+
+        case Link::REVOLUTE_JOINT:
+        {
+            lk.kernel = REVOLUTE_KERNEL;
+            const Vector3& a = link->a();
+            for(int j=0; j < 3; ++j){
+                if(fabs(a[j]) == 1.0 && a[(j + 1) % 3] == 0.0 && a[(j + 2) % 3] == 0.0){
+                    lk.kernel = REVOLUTE_X_KERNEL + j;
+                    lk.axisSign = a[j];
+                    break;
+                }
+            }
+            break;
+        }
+
+        case Link::PRISMATIC_JOINT:
+            lk.kernel = PRISMATIC_KERNEL;
+            break;
+
+        default:
+            lk.kernel = FIXED_KERNEL;
+            break;
+        }
+
+        const int index = linkKernels.size();
+        linkKernels.push_back(lk);
+        addLinkToKernelSegments(kinematicsSegments, lk.kernel, index);
+        addLinkToKernelSegments(dynamicsSegments, link->isFixedJoint() ? FIXED_KERNEL : MOVABLE_KERNEL, index);
+    }
+}
+
+
 /**
    \note v, dv, dw are not used in the forward dynamics, but are calculated
    for forward dynamics users.
 */
 void ForwardDynamicsABM::calcABMPhase1(bool updateNonSpatialVariables)
 {
-    const LinkTraverse& traverse = body->linkTraverse();
-    const int n = traverse.numLinks();
+    calcInertiaAndBiasForces(body->rootLink(), g, updateNonSpatialVariables);
+
+    for(auto& segment : kinematicsSegments){
+        switch(segment.kernel){
+        case REVOLUTE_X_KERNEL:
+            calcABMPhase1Segment<REVOLUTE_X_KERNEL>(segment.begin, segment.end, updateNonSpatialVariables);
+            break;
+        case REVOLUTE_Y_KERNEL:
+            calcABMPhase1Segment<REVOLUTE_Y_KERNEL>(segment.begin, segment.end, updateNonSpatialVariables);
+            break;
+        case REVOLUTE_Z_KERNEL:
+            calcABMPhase1Segment<REVOLUTE_Z_KERNEL>(segment.begin, segment.end, updateNonSpatialVariables);
+            break;
+        case REVOLUTE_KERNEL:
+            calcABMPhase1Segment<REVOLUTE_KERNEL>(segment.begin, segment.end, updateNonSpatialVariables);
+            break;
+        case PRISMATIC_KERNEL:
+            calcABMPhase1Segment<PRISMATIC_KERNEL>(segment.begin, segment.end, updateNonSpatialVariables);
+            break;
+        default:
+            calcABMPhase1Segment<FIXED_KERNEL>(segment.begin, segment.end, updateNonSpatialVariables);
+            break;
+        }
+    }
+}
 
-    for(int i=0; i < n; ++i){
-        DyLink* link = static_cast<DyLink*>(traverse[i]);
-        const DyLink* parent = link->parent();
-
-        if(parent){
-            
-            switch(link->jointType()){
-                
-            case Link::ROTATIONAL_JOINT:
-            {
+
+template<int kernel>
+void ForwardDynamicsABM::calcABMPhase1Segment(int begin, int end, bool updateNonSpatialVariables)
+{
+    // The coordinate axis used when the kernel is for a revolute joint aligned with it
+    const int axis = (kernel <= REVOLUTE_Z_KERNEL) ? kernel : 0;
+
+    for(int i = begin; i < end; ++i){
+        const LinkKernel& lk = linkKernels[i];
+        DyLink* link = lk.link;
+        const DyLink* parent = lk.parent;
+
+        if(kernel == FIXED_KERNEL){
+            link->p().noalias() = parent->R() * link->b() + parent->p();
+            link->R() = parent->R();
+            link->w() = parent->w();
+            link->vo() = parent->vo();
+            link->sw().setZero();
+            link->sv().setZero();
+            link->cv().setZero();
+            link->cw().setZero();
+            if(updateNonSpatialVariables){
+                link->dw() = parent->dw();
                 const Vector3 arm = parent->R() * link->b();
-                link->R().noalias() = parent->R() * AngleAxisd(link->q(), link->a());
-                link->p().noalias() = arm + parent->p();
-                link->sw().noalias() = parent->R() * link->a();
-                link->sv().noalias() = link->p().cross(link->sw());
-                link->w().noalias() = link->dq() * link->sw() + parent->w();
-                if(updateNonSpatialVariables){
-                    link->dw().noalias() =
-                        parent->dw() + link->dq() * parent->w().cross(link->sw()) + (link->ddq() * link->sw());
-                    link->dv().noalias() =
-                        parent->dv() + parent->w().cross(parent->w().cross(arm)) + parent->dw().cross(arm);
-                }
-                break;
+                link->dv().noalias() = parent->dv() +
+                    parent->w().cross(parent->w().cross(arm)) + parent->dw().cross(arm);
             }
-                
-            case Link::SLIDE_JOINT:
+
+        } else {
+            if(kernel == PRISMATIC_KERNEL){
                 link->p().noalias() = parent->R() * (link->b() + link->q() * link->d()) + parent->p();
                 link->R() = parent->R();
                 link->sw().setZero();
@@ -258,28 +420,26 @@ void ForwardDynamicsABM::calcABMPhase1(bool updateNonSpatialVariables)
                         parent->dv() + parent->w().cross(parent->w().cross(arm)) + parent->dw().cross(arm)
                         + 2.0 * link->dq() * parent->w().cross(link->sv()) + link->ddq() * link->sv();
                 }
-                break;
-                
-            case Link::FIXED_JOINT:
-            default:
-                link->p().noalias() = parent->R() * link->b() + parent->p();
-                link->R() = parent->R();
-                link->w() = parent->w();
-                link->vo() = parent->vo();
-                link->sw().setZero();
-                link->sv().setZero();
-                link->cv().setZero();
-                link->cw().setZero();
+            } else {
+                const Vector3 arm = parent->R() * link->b();
+                if(kernel == REVOLUTE_KERNEL){
+                    link->R().noalias() = parent->R() * AngleAxisd(link->q(), link->a());
+                    link->sw().noalias() = parent->R() * link->a();
+                } else {
+                    setRotationAboutCoordinateAxis<axis>(link->R(), parent->R(), lk.axisSign * link->q());
+                    link->sw() = lk.axisSign * parent->R().col(axis);
+                }
+                link->p().noalias() = arm + parent->p();
+                link->sv().noalias() = link->p().cross(link->sw());
+                link->w().noalias() = link->dq() * link->sw() + parent->w();
                 if(updateNonSpatialVariables){
-                    link->dw() = parent->dw();
-                    const Vector3 arm = parent->R() * link->b();
-                    link->dv().noalias() = parent->dv() +
-                        parent->w().cross(parent->w().cross(arm)) + parent->dw().cross(arm);
+                    link->dw().noalias() =
+                        parent->dw() + link->dq() * parent->w().cross(link->sw()) + (link->ddq() * link->sw());
+                    link->dv().noalias() =
+                        parent->dv() + parent->w().cross(parent->w().cross(arm)) + parent->dw().cross(arm);
                 }
-                
-                goto COMMON_CALCS_FOR_ALL_JOINT_TYPES;
             }
-            
+
             // Common for ROTATE and SLIDE
             link->vo().noalias() = link->dq() * link->sv() + parent->vo();
             const Vector3 dsv = parent->w().cross(link->sv()) + parent->vo().cross(link->sw());
@@ -287,92 +447,74 @@ void ForwardDynamicsABM::calcABMPhase1(bool updateNonSpatialVariables)
             link->cv() = link->dq() * dsv;
             link->cw() = link->dq() * dsw;
         }
-        
-COMMON_CALCS_FOR_ALL_JOINT_TYPES:
 
-        if(updateNonSpatialVariables){
-            link->v().noalias() = link->vo() + link->w().cross(link->p());
-        }
-        link->wc().noalias() = link->R() * link->c() + link->p();
-        
-        // compute I^s (Eq.(6.24) of Kajita's textbook))
-        const Matrix3 Iw = link->R() * link->I() * link->R().transpose();
-        
-        const double m = link->m();
-        const Matrix3 c_hat = hat(link->wc());
-        link->Iww().noalias() = m * c_hat * c_hat.transpose() + Iw;
-
-        link->Ivv() <<
-            m,  0.0, 0.0,
-            0.0,  m,  0.0,
-            0.0, 0.0,  m;
-        
-        link->Iwv() = m * c_hat;
-        
-        // compute P and L (Eq.(6.25) of Kajita's textbook)
-        const Vector3 P = m * (link->vo() + link->w().cross(link->wc()));
-        const Vector3 L = link->Iww() * link->w() + m * link->wc().cross(link->vo());
-        
-        link->pf().noalias() = link->w().cross(P);
-        link->ptau().noalias() = link->vo().cross(P) + link->w().cross(L);
-        
-        const Vector3 fg = m * g;
-        const Vector3 tg = link->wc().cross(fg);
-        
-        link->pf() -= fg;
-        link->ptau() -= tg;
+        calcInertiaAndBiasForces(link, g, updateNonSpatialVariables);
     }
 }
 
 
+/**
+   The articulated inertia and the bias forces of each link are pushed to its parent link
+   instead of being pulled from the child links. Because the child links come after the parent
+   in the traverse order, the values of a link are complete when it is visited in reverse order.
+*/
 void ForwardDynamicsABM::calcABMPhase2()
 {
-    const LinkTraverse& traverse = body->linkTraverse();
-    const int n = traverse.numLinks();
-
-    for(int i = n-1; i >= 0; --i){
-        DyLink* link = static_cast<DyLink*>(traverse[i]);
-
-        link->pf()   -= link->f_ext();
-        link->ptau() -= link->tau_ext();
-
-        // compute articulated inertia (Eq.(6.48) of Kajita's textbook)
-        for(DyLink* child = link->child(); child; child = child->sibling()){
+    for(auto p = dynamicsSegments.rbegin(); p != dynamicsSegments.rend(); ++p){
+        if(p->kernel == MOVABLE_KERNEL){
+            calcABMPhase2Segment<true>(p->begin, p->end);
+        } else {
+            calcABMPhase2Segment<false>(p->begin, p->end);
+        }
+    }
 
-            if(child->isFixedJoint()){
-                link->Ivv() += child->Ivv();
-                link->Iwv() += child->Iwv();
-                link->Iww() += child->Iww();
+    DyLink* root = body->rootLink();
+    root->pf()   -= root->f_ext();
+    root->ptau() -= root->tau_ext();
+}
 
-            }else{
-                const Vector3 hhv_dd = child->hhv() / child->dd();
-                link->Ivv().noalias() += child->Ivv() - child->hhv() * hhv_dd.transpose();
-                link->Iwv().noalias() += child->Iwv() - child->hhw() * hhv_dd.transpose();
-                link->Iww().noalias() += child->Iww() - child->hhw() * (child->hhw() / child->dd()).transpose();
-            }
 
-            link->pf()  .noalias() += child->Ivv() * child->cv() + child->Iwv().transpose() * child->cw() + child->pf();
-            link->ptau().noalias() += child->Iwv() * child->cv() + child->Iww() * child->cw() + child->ptau();
+template<bool isMovable>
+void ForwardDynamicsABM::calcABMPhase2Segment(int begin, int end)
+{
+    for(int i = end - 1; i >= begin; --i){
+        const LinkKernel& lk = linkKernels[i];
+        DyLink* link = lk.link;
+        DyLink* parent = lk.parent;
 
-            if(!child->isFixedJoint()){
-                const double uu_dd = child->uu() / child->dd();
-                link->pf()   += uu_dd * child->hhv();
-                link->ptau() += uu_dd * child->hhw();
-            }
-        }
+        link->pf()   -= link->f_ext();
+        link->ptau() -= link->tau_ext();
 
-        if(i > 0){
-            if(!link->isFixedJoint()){
-                // hh = Ia * s
-                link->hhv().noalias() = link->Ivv() * link->sv() + link->Iwv().transpose() * link->sw();
-                link->hhw().noalias() = link->Iwv() * link->sv() + link->Iww() * link->sw();
-                // dd = Ia * s * s^T
-                link->dd() = link->sv().dot(link->hhv()) + link->sw().dot(link->hhw()) + link->Jm2();
-                // uu = u - hh^T*c + s^T*pp
-                link->uu() = link->u() -
-                    (link->hhv().dot(link->cv()) + link->hhw().dot(link->cw()) +
-                     link->sv().dot(link->pf()) + link->sw().dot(link->ptau()));
-            }
+        if(isMovable){
+            // hh = Ia * s
+            link->hhv().noalias() = link->Ivv() * link->sv() + link->Iwv().transpose() * link->sw();
+            link->hhw().noalias() = link->Iwv() * link->sv() + link->Iww() * link->sw();
+            // dd = Ia * s * s^T
+            link->dd() = link->sv().dot(link->hhv()) + link->sw().dot(link->hhw()) + link->Jm2();
+            // uu = u - hh^T*c + s^T*pp
+            link->uu() = link->u() -
+                (link->hhv().dot(link->cv()) + link->hhw().dot(link->cw()) +
+                 link->sv().dot(link->pf()) + link->sw().dot(link->ptau()));
+
+            // compute articulated inertia (Eq.(6.48) of Kajita's textbook)
+            const Vector3 hhv_dd = link->hhv() / link->dd();
+            parent->Ivv().noalias() += link->Ivv() - link->hhv() * hhv_dd.transpose();
+            parent->Iwv().noalias() += link->Iwv() - link->hhw() * hhv_dd.transpose();
+            parent->Iww().noalias() += link->Iww() - link->hhw() * (link->hhw() / link->dd()).transpose();
+
+            const double uu_dd = link->uu() / link->dd();
+            parent->pf().noalias() +=
+                link->Ivv() * link->cv() + link->Iwv().transpose() * link->cw() + link->pf() + uu_dd * link->hhv();
+            parent->ptau().noalias() +=
+                link->Iwv() * link->cv() + link->Iww() * link->cw() + link->ptau() + uu_dd * link->hhw();
+
+        } else {
+            // cv and cw of a fixed joint are zero
+            parent->Ivv() += link->Ivv();
+            parent->Iwv() += link->Iwv();
+            parent->Iww() += link->Iww();
+            parent->pf()   += link->pf();
+            parent->ptau() += link->ptau();
         }
     }
 }
@@ -381,37 +523,42 @@ void ForwardDynamicsABM::calcABMPhase2()
 // A part of phase 2 (inbound loop) that can be calculated before external forces are given
 void ForwardDynamicsABM::calcABMPhase2Part1()
 {
-    const LinkTraverse& traverse = body->linkTraverse();
-    const int n = traverse.numLinks();
-
-    for(int i = n-1; i >= 0; --i){
-        DyLink* link = static_cast<DyLink*>(traverse[i]);
-
-        for(DyLink* child = link->child(); child; child = child->sibling()){
-
-            if(child->isFixedJoint()){
-                link->Ivv() += child->Ivv();
-                link->Iwv() += child->Iwv();
-                link->Iww() += child->Iww();
-
-            }else{
-                const Vector3 hhv_dd = child->hhv() / child->dd();
-                link->Ivv().noalias() += child->Ivv() - child->hhv() * hhv_dd.transpose();
-                link->Iwv().noalias() += child->Iwv() - child->hhw() * hhv_dd.transpose();
-                link->Iww().noalias() += child->Iww() - child->hhw() * (child->hhw() / child->dd()).transpose();
-            }
-
-            link->pf()  .noalias() += child->Ivv() * child->cv() + child->Iwv().transpose() * child->cw();
-            link->ptau().noalias() += child->Iwv() * child->cv() + child->Iww() * child->cw();
+    for(auto p = dynamicsSegments.rbegin(); p != dynamicsSegments.rend(); ++p){
+        if(p->kernel == MOVABLE_KERNEL){
+            calcABMPhase2Part1Segment<true>(p->begin, p->end);
+        } else {
+            calcABMPhase2Part1Segment<false>(p->begin, p->end);
         }
+    }
+}
 
-        if(i > 0){
-            if(!link->isFixedJoint()){
-                link->hhv().noalias() = link->Ivv() * link->sv() + link->Iwv().transpose() * link->sw();
-                link->hhw().noalias() = link->Iwv() * link->sv() + link->Iww() * link->sw();
-                link->dd() = link->sv().dot(link->hhv()) + link->sw().dot(link->hhw()) + link->Jm2();
-                link->uu() = -(link->hhv().dot(link->cv()) + link->hhw().dot(link->cw()));
-            }
+
+template<bool isMovable>
+void ForwardDynamicsABM::calcABMPhase2Part1Segment(int begin, int end)
+{
+    for(int i = end - 1; i >= begin; --i){
+        const LinkKernel& lk = linkKernels[i];
+        DyLink* link = lk.link;
+        DyLink* parent = lk.parent;
+
+        if(isMovable){
+            link->hhv().noalias() = link->Ivv() * link->sv() + link->Iwv().transpose() * link->sw();
+            link->hhw().noalias() = link->Iwv() * link->sv() + link->Iww() * link->sw();
+            link->dd() = link->sv().dot(link->hhv()) + link->sw().dot(link->hhw()) + link->Jm2();
+            link->uu() = -(link->hhv().dot(link->cv()) + link->hhw().dot(link->cw()));
+
+            const Vector3 hhv_dd = link->hhv() / link->dd();
+            parent->Ivv().noalias() += link->Ivv() - link->hhv() * hhv_dd.transpose();
+            parent->Iwv().noalias() += link->Iwv() - link->hhw() * hhv_dd.transpose();
+            parent->Iww().noalias() += link->Iww() - link->hhw() * (link->hhw() / link->dd()).transpose();
+
+            parent->pf()  .noalias() += link->Ivv() * link->cv() + link->Iwv().transpose() * link->cw();
+            parent->ptau().noalias() += link->Iwv() * link->cv() + link->Iww() * link->cw();
+
+        } else {
+            parent->Ivv() += link->Ivv();
+            parent->Iwv() += link->Iwv();
+            parent->Iww() += link->Iww();
         }
     }
 }
@@ -420,30 +567,39 @@ void ForwardDynamicsABM::calcABMPhase2Part1()
 // A remaining part of phase 2 that requires external forces
 void ForwardDynamicsABM::calcABMPhase2Part2()
 {
-    const LinkTraverse& traverse = body->linkTraverse();
-    const int n = traverse.numLinks();
+    for(auto p = dynamicsSegments.rbegin(); p != dynamicsSegments.rend(); ++p){
+        if(p->kernel == MOVABLE_KERNEL){
+            calcABMPhase2Part2Segment<true>(p->begin, p->end);
+        } else {
+            calcABMPhase2Part2Segment<false>(p->begin, p->end);
+        }
+    }
 
-    for(int i = n-1; i >= 0; --i){
-        DyLink* link = static_cast<DyLink*>(traverse[i]);
+    DyLink* root = body->rootLink();
+    root->pf()   -= root->f_ext();
+    root->ptau() -= root->tau_ext();
+}
 
-        link->pf()   -= link->f_ext();
-        link->ptau() -= link->tau_ext();
 
-        for(DyLink* child = link->child(); child; child = child->sibling()){
-            link->pf()   += child->pf();
-            link->ptau() += child->ptau();
+template<bool isMovable>
+void ForwardDynamicsABM::calcABMPhase2Part2Segment(int begin, int end)
+{
+    for(int i = end - 1; i >= begin; --i){
+        const LinkKernel& lk = linkKernels[i];
+        DyLink* link = lk.link;
+        DyLink* parent = lk.parent;
 
-            if(!child->isFixedJoint()){
-                const double uu_dd = child->uu() / child->dd();
-                link->pf()   += uu_dd * child->hhv();
-                link->ptau() += uu_dd * child->hhw();
-            }
-        }
+        link->pf()   -= link->f_ext();
+        link->ptau() -= link->tau_ext();
 
-        if(i > 0){
-            if(!link->isFixedJoint()){
-                link->uu() += link->u() - (link->sv().dot(link->pf()) + link->sw().dot(link->ptau()));
-            }
+        if(isMovable){
+            link->uu() += link->u() - (link->sv().dot(link->pf()) + link->sw().dot(link->ptau()));
+            const double uu_dd = link->uu() / link->dd();
+            parent->pf()   += link->pf()   + uu_dd * link->hhv();
+            parent->ptau() += link->ptau() + uu_dd * link->hhw();
+        } else {
+            parent->pf()   += link->pf();
+            parent->ptau() += link->ptau();
         }
     }
 }
@@ -451,9 +607,7 @@ void ForwardDynamicsABM::calcABMPhase2Part2()
 
 void ForwardDynamicsABM::calcABMPhase3()
 {
-    const LinkTraverse& traverse = body->linkTraverse();
-
-    DyLink* root = static_cast<DyLink*>(traverse[0]);
+    DyLink* root = body->rootLink();
 
     if(root->isFreeJoint()){
 
@@ -463,7 +617,7 @@ void ForwardDynamicsABM::calcABMPhase3()
         Eigen::Matrix<double, 6, 6> M;
         M << root->Ivv(), root->Iwv().transpose(),
             root->Iwv(), root->Iww();
-        
+
         Eigen::Matrix<double, 6, 1> f;
         f << root->pf(),
             root->ptau();
@@ -479,18 +633,31 @@ void ForwardDynamicsABM::calcABMPhase3()
         root->dw().setZero();
     }
 
-    const int n = traverse.numLinks();
-    for(int i=1; i < n; ++i){
-        DyLink* link = static_cast<DyLink*>(traverse[i]);
-        const DyLink* parent = link->parent();
-        if(!link->isFixedJoint()){
+    for(auto& segment : dynamicsSegments){
+        if(segment.kernel == MOVABLE_KERNEL){
+            calcABMPhase3Segment<true>(segment.begin, segment.end);
+        } else {
+            calcABMPhase3Segment<false>(segment.begin, segment.end);
+        }
+    }
+}
+
+
+template<bool isMovable>
+void ForwardDynamicsABM::calcABMPhase3Segment(int begin, int end)
+{
+    for(int i = begin; i < end; ++i){
+        const LinkKernel& lk = linkKernels[i];
+        DyLink* link = lk.link;
+        const DyLink* parent = lk.parent;
+        if(isMovable){
             link->ddq() = (link->uu() - (link->hhv().dot(parent->dvo()) + link->hhw().dot(parent->dw()))) / link->dd();
             link->dvo().noalias() = parent->dvo() + link->cv() + link->sv() * link->ddq();
             link->dw().noalias()  = parent->dw()  + link->cw() + link->sw() * link->ddq();
         }else{
             link->ddq() = 0.0;
             link->dvo() = parent->dvo();
-            link->dw()  = parent->dw(); 
+            link->dw()  = parent->dw();
         }
     }
 }
@@ -499,6 +666,12 @@ void ForwardDynamicsABM::calcABMPhase3()
 void ForwardDynamicsABM::updateForceSensors()
 {
     const DeviceList<ForceSensor>& sensors = sensorHelper.forceSensors();
+    const bool doMeasureTime = sensorHelper.isTimeMeasurementEnabled();
+    TimeMeasure timer;
+    if(doMeasureTime){
+        timer.begin();
+    }
+
     for(size_t i=0; i < sensors.size(); ++i){
         ForceSensor* sensor = sensors[i];
         const DyLink* link = static_cast<DyLink*>(sensor->link());
@@ -514,4 +687,8 @@ void ForwardDynamicsABM::updateForceSensors()
         sensor->tau().noalias() = R.transpose() * (tau - p.cross(f));
         sensor->notifyStateChange();
     }
+
+    if(doMeasureTime){
+        sensorHelper.forceSensorTimeStatistics().record(timer.measure());
+    }
 }
@@ -7,10 +7,13 @@
 #define CNOID_BODY_FORWARD_DYNAMICS_ABM_H
 
 #include "ForwardDynamics.h"
+#include <vector>
 #include "exportdecl.h"
 
 namespace cnoid
 {
+class DyLink;
+
 /**
    Forward dynamics calculation using Featherstone's Articulated Body Method (ABM)
 */
@@ -24,6 +27,7 @@ public:
         
     virtual void initialize();
     virtual void calcNextState();
+    virtual void refreshState();
 
 private:
         
@@ -31,10 +35,13 @@ private:
     void integrateRungeKuttaOneStep(double r, double dt);
     void calcMotionWithRungeKuttaMethod();
 
+    void initializeLinkKernels();
+
     /**
        compute position/orientation/velocity
     */
     void calcABMPhase1(bool updateNonSpatialVariables);
+    template<int kernel> void calcABMPhase1Segment(int begin, int end, bool updateNonSpatialVariables);
 
     /**
        compute articulated inertia
@@ -42,17 +49,46 @@ private:
     void calcABMPhase2();
     void calcABMPhase2Part1();
     void calcABMPhase2Part2();
+    template<bool isMovable> void calcABMPhase2Segment(int begin, int end);
+    template<bool isMovable> void calcABMPhase2Part1Segment(int begin, int end);
+    template<bool isMovable> void calcABMPhase2Part2Segment(int begin, int end);
 
     /**
        compute joint acceleration/spatial acceleration
     */
     void calcABMPhase3();
+    template<bool isMovable> void calcABMPhase3Segment(int begin, int end);
 
     inline void calcABMFirstHalf();
     inline void calcABMLastHalf();
 
     void updateForceSensors();
 
+    /**
+       The kernel of each non-root link is selected from its joint type when the
+       forward dynamics is initialized so that the per-link loops do not branch on it.
+    */
+    struct LinkKernel
+    {
+        DyLink* link;
+        DyLink* parent;
+        int kernel;
+        // The sign of the joint axis of a revolute joint aligned with a coordinate axis
+        double axisSign;
+    };
+    // The non-root links in the traverse order
+    std::vector<LinkKernel> linkKernels;
+
+    // The range of the consecutive links in linkKernels that are processed by the same code path
+    struct KernelSegment
+    {
+        int kernel;
+        int begin;
+        int end;
+    };
+    std::vector<KernelSegment> kinematicsSegments;
+    std::vector<KernelSegment> dynamicsSegments;
+
     // Buffers for the Runge Kutta Method
     Position T0;
     Vector3 vo0;
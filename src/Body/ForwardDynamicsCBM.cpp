@@ -7,6 +7,7 @@
 #include "DyBody.h"
 #include "LinkTraverse.h"
 #include <cnoid/EigenUtil>
+#include <cnoid/TimeMeasure>
 #include <iostream>
 
 using namespace std;
@@ -45,7 +46,13 @@ static void putVector(TVector& M, char* name)
 ForwardDynamicsCBM::ForwardDynamicsCBM(DyBody* body) :
     ForwardDynamics(body)
 {
+    isCompositeRigidBodyMode_ = false;
+}
+
 
+void ForwardDynamicsCBM::setCompositeRigidBodyMode(bool on)
+{
+    isCompositeRigidBodyMode_ = on;
 }
 
 
@@ -115,6 +122,35 @@ void ForwardDynamicsCBM::initialize()
     ddqorg.resize(numLinks);
     uorg.  resize(numLinks);
 
+    if(isCompositeRigidBodyMode_){
+        unknownDofIndices.assign(numLinks, -1);
+        givenDofIndices.assign(numLinks, -1);
+        for(size_t i=0; i < torqueModeJoints.size(); ++i){
+            unknownDofIndices[torqueModeJoints[i]->index()] = i + unknown_rootDof;
+        }
+        for(size_t i=0; i < highGainModeJoints.size(); ++i){
+            givenDofIndices[highGainModeJoints[i]->index()] = i + given_rootDof;
+        }
+        // The dofs of the root are regarded as a chain
+        unknownDofParents.resize(n);
+        for(int i=0; i < unknown_rootDof; ++i){
+            unknownDofParents[i] = i - 1;
+        }
+        for(size_t i=0; i < torqueModeJoints.size(); ++i){
+            int parentDof = unknown_rootDof - 1;
+            for(Link* link = torqueModeJoints[i]->parent(); link; link = link->parent()){
+                if(unknownDofIndices[link->index()] >= 0){
+                    parentDof = unknownDofIndices[link->index()];
+                    break;
+                }
+            }
+            unknownDofParents[i + unknown_rootDof] = parentDof;
+        }
+        compositeMasses.resize(numLinks);
+        compositeIwv.resize(numLinks);
+        compositeIww.resize(numLinks);
+    }
+
     calcPositionAndVelocityFK();
 
     if(!isNoUnknownAccelMode){
@@ -169,6 +205,17 @@ inline void ForwardDynamicsCBM::calcAccelFKandForceSensorValues()
 }
 
 
+void ForwardDynamicsCBM::refreshState()
+{
+    calcPositionAndVelocityFK();
+    if(!isNoUnknownAccelMode){
+        calcMassMatrix();
+    }
+    ddqGivenCopied = false;
+    preserveHighGainModeJointState();
+}
+
+
 void ForwardDynamicsCBM::calcNextState()
 {
     if(isNoUnknownAccelMode && !sensorHelper.isActive()){
@@ -197,7 +244,9 @@ void ForwardDynamicsCBM::calcNextState()
 		
     if(sensorHelper.isActive()){
         updateForceSensors();
-        sensorHelper.updateGyroAndAccelerationSensors();
+        if(!sensorHelper.isBatchUpdateEnabled()){
+            sensorHelper.updateGyroAndAccelerationSensors();
+        }
     }
 	
     ddqGivenCopied = false;
@@ -448,12 +497,19 @@ COMMON_CALCS_FOR_ALL_JOINT_TYPES:
 
 
 /**
-   calculate the mass matrix using the unit vector method
-   \todo replace the unit vector method here with
-   a more efficient method that only requires O(n) computation time
+   calculate the mass matrix using the unit vector method,
+   or the composite rigid body method when isCompositeRigidBodyMode() is true
 */
 void ForwardDynamicsCBM::calcMassMatrix()
 {
+    if(isCompositeRigidBodyMode_){
+        calcBiasOfMotionEquation();
+        calcMassMatrixWithCompositeRigidBodyMethod();
+        factorizeMassMatrix();
+        accelSolverInitialized = false;
+        return;
+    }
+
     DyLink* root = body->rootLink();
     const int numLinks = body->numLinks();
 
@@ -540,6 +596,195 @@ void ForwardDynamicsCBM::calcMassMatrix()
 }
 
 
+/**
+   The constant term b1 of the motion equation, which is the joint torques for the zero accelerations
+*/
+void ForwardDynamicsCBM::calcBiasOfMotionEquation()
+{
+    DyLink* root = body->rootLink();
+    const int numLinks = body->numLinks();
+
+    for(int i=1; i < numLinks; ++i){
+        DyLink* link = body->link(i);
+        ddqorg[i] = link->ddq();
+        uorg  [i] = link->u();
+        link->ddq() = 0.0;
+    }
+    dvoorg = root->dvo();
+    dworg  = root->dw();
+    root->dvo() = -g - root_w_x_v;
+    root->dw().setZero();
+	
+    setColumnOfMassMatrix(b1, 0);
+
+    for(int i=1; i < numLinks; ++i){
+        DyLink* link = body->link(i);
+        link->ddq() = ddqorg[i];
+        link->u()   = uorg  [i];
+    }
+    root->dvo() = dvoorg;
+    root->dw()  = dworg;
+}
+
+
+/**
+   The spatial quantities of the links are expressed at the origin of the world coordinate,
+   so the force for a motion of a joint is transmitted to the ancestor joints without any
+   transformation. An element of the mass matrix for a joint and its ancestor joint is the
+   product of the motion axis of the ancestor and the force for the unit motion of the joint,
+   which is given by the composite inertia of the subtree of the joint.
+*/
+void ForwardDynamicsCBM::calcMassMatrixWithCompositeRigidBodyMethod()
+{
+    DyLink* root = body->rootLink();
+    const int numLinks = body->numLinks();
+
+    for(int i=0; i < numLinks; ++i){
+        compositeMasses[i] = body->link(i)->m();
+        compositeIwv[i] = body->link(i)->Iwv();
+        compositeIww[i] = body->link(i)->Iww();
+    }
+    for(int i = numLinks - 1; i > 0; --i){
+        const int parent = body->link(i)->parent()->index();
+        compositeMasses[parent] += compositeMasses[i];
+        compositeIwv[parent] += compositeIwv[i];
+        compositeIww[parent] += compositeIww[i];
+    }
+
+    M11.setZero();
+    M12.setZero();
+
+    // The forces of the root motions, which are the translations and the rotations around the root
+    const Vector3& p = root->p();
+    const double m0 = compositeMasses[0];
+    const Matrix3& Iwv0 = compositeIwv[0];
+    const Matrix3& Iww0 = compositeIww[0];
+    auto calcRootRows = [&](const Vector3& f, const Vector3& tau, double* out_rows){
+        const Vector3 tau_p = tau - p.cross(f);
+        for(int k=0; k < 3; ++k){
+            out_rows[k] = f[k];
+            out_rows[k + 3] = tau_p[k];
+        }
+    };
+    if(unknown_rootDof){
+        for(int k=0; k < 6; ++k){
+            Vector3 sv, sw;
+            if(k < 3){
+                sv = Vector3::Unit(k);
+                sw.setZero();
+            } else {
+                sw = Vector3::Unit(k - 3);
+                sv = p.cross(sw);
+            }
+            const Vector3 f = m0 * sv + Iwv0.transpose() * sw;
+            const Vector3 tau = Iwv0 * sv + Iww0 * sw;
+            double rows[6];
+            calcRootRows(f, tau, rows);
+            for(int r=0; r < 6; ++r){
+                M11(r, k) = rows[r];
+            }
+        }
+    }
+
+    for(int i=1; i < numLinks; ++i){
+        const int unknownDof = unknownDofIndices[i];
+        const int givenDof = givenDofIndices[i];
+        if(unknownDof < 0 && givenDof < 0){
+            continue;
+        }
+        DyLink* link = body->link(i);
+        const Vector3 f = compositeMasses[i] * link->sv() + compositeIwv[i].transpose() * link->sw();
+        const Vector3 tau = compositeIwv[i] * link->sv() + compositeIww[i] * link->sw();
+
+        for(DyLink* ancestor = link; ancestor != root; ancestor = ancestor->parent()){
+            const int j = ancestor->index();
+            const int ancestorUnknownDof = unknownDofIndices[j];
+            const int ancestorGivenDof = givenDofIndices[j];
+            if(ancestorUnknownDof < 0 && ancestorGivenDof < 0){
+                continue;
+            }
+            const double h = ancestor->sv().dot(f) + ancestor->sw().dot(tau);
+            if(unknownDof >= 0){
+                if(ancestorUnknownDof >= 0){
+                    M11(ancestorUnknownDof, unknownDof) = h;
+                    M11(unknownDof, ancestorUnknownDof) = h;
+                } else {
+                    M12(unknownDof, ancestorGivenDof) = h;
+                }
+            } else if(ancestorUnknownDof >= 0){
+                M12(ancestorUnknownDof, givenDof) = h;
+            }
+        }
+
+        double rows[6];
+        calcRootRows(f, tau, rows);
+        if(unknownDof >= 0){
+            if(unknown_rootDof){
+                for(int r=0; r < 6; ++r){
+                    M11(r, unknownDof) = rows[r];
+                    M11(unknownDof, r) = rows[r];
+                }
+            } else if(given_rootDof){
+                for(int r=0; r < 6; ++r){
+                    M12(unknownDof, r) = rows[r];
+                }
+            }
+        } else if(unknown_rootDof){
+            for(int r=0; r < 6; ++r){
+                M12(r, givenDof) = rows[r];
+            }
+        }
+    }
+
+    for(size_t i=0; i < torqueModeJoints.size(); ++i){
+        const int j = i + unknown_rootDof;
+        M11(j, j) += torqueModeJoints[i]->Jm2();
+    }
+}
+
+
+/**
+   M11 is overwritten with the LDL^T factorization of it where L is stored in the lower part.
+   The elements which are not on the path of the ancestor dofs are kept zero because the dofs are
+   ordered so that the ancestor dofs precede the descendant ones.
+   See R. Featherstone, "Efficient factorization of the joint-space inertia matrix for branched
+   kinematic trees", The International Journal of Robotics Research, 24(6), 2005.
+*/
+void ForwardDynamicsCBM::factorizeMassMatrix()
+{
+    const int n = M11.rows();
+    for(int k = n - 1; k >= 0; --k){
+        for(int i = unknownDofParents[k]; i >= 0; i = unknownDofParents[i]){
+            const double a = M11(k, i) / M11(k, k);
+            for(int j = i; j >= 0; j = unknownDofParents[j]){
+                M11(i, j) -= M11(k, j) * a;
+            }
+            M11(k, i) = a;
+        }
+    }
+}
+
+
+void ForwardDynamicsCBM::solveWithFactorizedMassMatrix(VectorXd& inout_x)
+{
+    VectorXd& x = inout_x;
+    const int n = M11.rows();
+    for(int k = n - 1; k >= 0; --k){
+        for(int i = unknownDofParents[k]; i >= 0; i = unknownDofParents[i]){
+            x(i) -= M11(k, i) * x(k);
+        }
+    }
+    for(int k=0; k < n; ++k){
+        x(k) /= M11(k, k);
+    }
+    for(int k=0; k < n; ++k){
+        for(int i = unknownDofParents[k]; i >= 0; i = unknownDofParents[i]){
+            x(k) -= M11(k, i) * x(i);
+        }
+    }
+}
+
+
 void ForwardDynamicsCBM::setColumnOfMassMatrix(MatrixXd& M, int column)
 {
     Vector3 f;
@@ -733,7 +978,12 @@ void ForwardDynamicsCBM::solveUnknownAccels(const Vector3& fext, const Vector3&
     c1 -= d1;
     c1 -= b1.col(0);
 
-    const VectorXd a(M11.colPivHouseholderQr().solve(c1));
+    if(isCompositeRigidBodyMode_){
+        solveWithFactorizedMassMatrix(c1);
+    } else {
+        c1 = M11.colPivHouseholderQr().solve(c1);
+    }
+    const VectorXd& a = c1;
     
     if(unknown_rootDof){
         DyLink* root = body->rootLink();
@@ -829,6 +1079,12 @@ void ForwardDynamicsCBM::updateForceSensorInfo(DyLink* link, bool hasSensorsAbov
 void ForwardDynamicsCBM::updateForceSensors()
 {
     const DeviceList<ForceSensor>& sensors = sensorHelper.forceSensors();
+    const bool doMeasureTime = sensorHelper.isTimeMeasurementEnabled();
+    TimeMeasure timer;
+    if(doMeasureTime){
+        timer.begin();
+    }
+
 
     for(size_t i=0; i < sensors.size(); ++i){
         
@@ -843,4 +1099,8 @@ void ForwardDynamicsCBM::updateForceSensors()
         sensor->tau() = R.transpose() * (info.tau - p.cross(info.f));
         sensor->notifyStateChange();
     }
+
+    if(doMeasureTime){
+        sensorHelper.forceSensorTimeStatistics().record(timer.measure());
+    }
 }
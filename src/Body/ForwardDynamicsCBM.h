@@ -32,6 +32,7 @@ public:
 
     virtual void initialize();
     virtual void calcNextState();
+    virtual void refreshState();
 
     void complementHighGainModeCommandValues();
 
@@ -41,6 +42,16 @@ public:
     void solveUnknownAccels(const Vector3& fext, const Vector3& tauext);
     bool solveUnknownAccels(DyLink* link, const Vector3& fext, const Vector3& tauext, const Vector3& rootfext, const Vector3& roottauext);
 
+    /**
+       When this mode is enabled, the mass matrix is calculated by the composite rigid body method
+       instead of the unit vector method, and it is factorized by the LDL^T decomposition whose
+       sparsity is induced by the branches of the link tree. The factorization is reused for the
+       accelerations calculated in the constraint force solver. This mode must be set before
+       calling initialize(). The default value is false.
+    */
+    void setCompositeRigidBodyMode(bool on);
+    bool isCompositeRigidBodyMode() const { return isCompositeRigidBodyMode_; }
+
     //! \deprecated Use Link::setActuationMode() instead.
     void setHighGainModeForAllJoints();
     //! \deprecated Use Link::setActuationMode() instead.
@@ -72,6 +83,15 @@ private:
     std::vector<DyLink*> torqueModeJoints;
     std::vector<DyLink*> highGainModeJoints;
 
+    // Members for the composite rigid body mode
+    bool isCompositeRigidBodyMode_;
+    std::vector<int> unknownDofIndices; // the index in M11 of the joint of each link or -1
+    std::vector<int> givenDofIndices; // the column in M12 of the joint of each link or -1
+    std::vector<int> unknownDofParents; // the nearest ancestor dof of each dof in M11 or -1
+    std::vector<double> compositeMasses;
+    std::vector<Matrix3> compositeIwv;
+    std::vector<Matrix3> compositeIww;
+
     //int rootDof; // dof of dv and dw (0 or 6)
     int unknown_rootDof;
     int given_rootDof;
@@ -145,6 +165,10 @@ private:
     void preserveHighGainModeJointState();
     void calcPositionAndVelocityFK();
     void calcMassMatrix();
+    void calcBiasOfMotionEquation();
+    void calcMassMatrixWithCompositeRigidBodyMethod();
+    void factorizeMassMatrix();
+    void solveWithFactorizedMassMatrix(VectorXd& inout_x);
     void setColumnOfMassMatrix(MatrixXd& M, int column);
     void calcInverseDynamics(DyLink* link, Vector3& out_f, Vector3& out_tau);
     void calcd1(DyLink* link, Vector3& out_f, Vector3& out_tau);
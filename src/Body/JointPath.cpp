@@ -10,6 +10,7 @@
 #include "BodyCustomizerInterface.h"
 #include <cnoid/EigenUtil>
 #include <cnoid/TruncatedSVD>
+#include <Eigen/Cholesky>
 
 using namespace std;
 using namespace cnoid;
@@ -41,8 +42,59 @@ double JointPath::numericalIKdefaultDampingConstant()
 }
 
 
+namespace {
+
+/**
+   The size of the matrix must be set in advance so that the function can also be used with
+   the fixed size matrices.
+*/
+template<class Derived>
+void calcJointPathJacobian(const JointPath& path, Eigen::MatrixBase<Derived>& out_J)
+{
+    const int n = path.numJoints();
+    Link* targetLink = path.endLink();
+		
+    for(int i=0; i < n; ++i){
+        Link* link = path.joint(i);
+        switch(link->jointType()){
+				
+        case Link::REVOLUTE_JOINT:
+        {
+            Vector3 omega = link->R() * link->a();
+            const Vector3 arm = targetLink->p() - link->p();
+            if(!path.isJointDownward(i)){
+                omega = -omega;
+            }
+            out_J.col(i) << omega.cross(arm), omega;
+        }
+        break;
+				
+        case Link::PRISMATIC_JOINT:
+        {
+            Vector3 dp = link->R() * link->d();
+            if(!path.isJointDownward(i)){
+                dp = -dp;
+            }
+            out_J.col(i) << dp, Vector3::Zero();
+        }
+        break;
+				
+        default:
+            out_J.col(i).setZero();
+        }
+    }
+}
+
+}
+
 namespace cnoid {
 
+/**
+   The matrices and the decompositions are kept as the workspace so that the iterations of
+   the numerical IK do not allocate the memory once they have been sized by the first call.
+   The paths of six or seven joints for the position and orientation of the end link are
+   solved with the fixed size matrices.
+*/
 class JointPathIkImpl
 {
 public:
@@ -57,11 +109,20 @@ public:
     VectorXd dq;
     vector<double> q0;
     MatrixXd JJ;
+    VectorXd y;
     Eigen::ColPivHouseholderQR<MatrixXd> QR;
+    Eigen::LDLT<MatrixXd> LDLT;
     TruncatedSVD<MatrixXd> svd;
     std::function<double(VectorXd& out_error)> errorFunc;
     std::function<void(MatrixXd& out_Jacobian)> jacobianFunc;
 
+    // The workspace for the fixed size problems
+    Eigen::Matrix<double, 6, 6> J6;
+    Eigen::Matrix<double, 6, 7> J7;
+    Eigen::Matrix<double, 6, 6> JJ6;
+    Vector6 y6;
+    Eigen::LDLT<Eigen::Matrix<double, 6, 6>> LDLT6;
+
     JointPathIkImpl() {
         deltaScale = JointPath::numericalIKdefaultDeltaScale();
         maxIterations = JointPath::numericalIKdefaultMaxIterations();
@@ -77,6 +138,25 @@ public:
     void resize(int numJoints){
         J.resize(dTask.size(), numJoints);
         dq.resize(numJoints);
+        JJ.resize(dTask.size(), dTask.size());
+        y.resize(dTask.size());
+    }
+
+    void calcDampedLeastSquaresSolution(){
+        // The damped least squares (singurality robust inverse) method
+        JJ.noalias() = J * J.transpose();
+        JJ.diagonal().array() += dampingConstantSqr;
+        y.noalias() = LDLT.compute(JJ).solve(dTask);
+        dq.noalias() = J.transpose() * y;
+    }
+
+    template<int N>
+    void calcDampedLeastSquaresSolution(const JointPath& path, Eigen::Matrix<double, 6, N>& J){
+        calcJointPathJacobian(path, J);
+        JJ6.noalias() = J * J.transpose();
+        JJ6.diagonal().array() += dampingConstantSqr;
+        y6.noalias() = LDLT6.compute(JJ6).solve(dTask.head<6>());
+        dq.noalias() = J.transpose() * y6;
     }
 };
 
@@ -174,52 +254,8 @@ int JointPath::indexOf(const Link* link) const
 
 void JointPath::calcJacobian(Eigen::MatrixXd& out_J) const
 {
-    const int n = joints_.size();
-    out_J.resize(6, n);
-	
-    if(n > 0){
-
-        //! \todo compare the efficiency for the following codes
-        if(false){
-            setJacobian<0x3f, 0, 0>(*this, linkPath.endLink(), out_J);
-
-        } else {
-        
-            Link* targetLink = linkPath.endLink();
-		
-            for(int i=0; i < n; ++i){
-			
-                Link* link = joints_[i];
-			
-                switch(link->jointType()){
-				
-                case Link::REVOLUTE_JOINT:
-                {
-                    Vector3 omega = link->R() * link->a();
-                    const Vector3 arm = targetLink->p() - link->p();
-                    if(!isJointDownward(i)){
-                        omega = -omega;
-                    }
-                    out_J.col(i) << omega.cross(arm), omega;
-                }
-                break;
-				
-                case Link::PRISMATIC_JOINT:
-                {
-                    Vector3 dp = link->R() * link->d();
-                    if(!isJointDownward(i)){
-                        dp = -dp;
-                    }
-                    out_J.col(i) << dp, Vector3::Zero();
-                }
-                break;
-				
-                default:
-                    out_J.col(i).setZero();
-                }
-            }
-        }
-    }
+    out_J.resize(6, joints_.size());
+    calcJointPathJacobian(*this, out_J);
 }
 
 
@@ -355,6 +391,13 @@ bool JointPath::calcInverseKinematics(const Position& T)
         }
     }
         
+    int fixedSizeJacobianColumns = 0;
+    if(!nuIK->errorFunc && !useUsualInverseSolution && !USE_SVD_FOR_BEST_EFFORT_IK){
+        if(n == 6 || n == 7){
+            fixedSizeJacobianColumns = n;
+        }
+    }
+
     if(USE_SVD_FOR_BEST_EFFORT_IK && !useUsualInverseSolution && !nuIK->isBestEffortIKmode){
         // disable truncation
         nuIK->svd.setTruncateRatio(std::numeric_limits<double>::max());
@@ -385,17 +428,21 @@ bool JointPath::calcInverseKinematics(const Position& T)
         }
         prevErrsqr = errorSqr;
 
-        nuIK->jacobianFunc(nuIK->J);
-
-        if(useUsualInverseSolution){
-            nuIK->dq = nuIK->QR.compute(nuIK->J).solve(nuIK->dTask);
+        if(fixedSizeJacobianColumns == 6){
+            nuIK->calcDampedLeastSquaresSolution(*this, nuIK->J6);
+        } else if(fixedSizeJacobianColumns == 7){
+            nuIK->calcDampedLeastSquaresSolution(*this, nuIK->J7);
         } else {
-            if(USE_SVD_FOR_BEST_EFFORT_IK){
-                nuIK->svd.compute(nuIK->J).solve(nuIK->dTask, nuIK->dq);
+            nuIK->jacobianFunc(nuIK->J);
+
+            if(useUsualInverseSolution){
+                nuIK->dq = nuIK->QR.compute(nuIK->J).solve(nuIK->dTask);
             } else {
-                // The damped least squares (singurality robust inverse) method
-                nuIK->JJ = nuIK->J * nuIK->J.transpose() + nuIK->dampingConstantSqr * MatrixXd::Identity(nuIK->J.rows(), nuIK->J.rows());
-                nuIK->dq = nuIK->J.transpose() * nuIK->QR.compute(nuIK->JJ).solve(nuIK->dTask);
+                if(USE_SVD_FOR_BEST_EFFORT_IK){
+                    nuIK->svd.compute(nuIK->J).solve(nuIK->dTask, nuIK->dq);
+                } else {
+                    nuIK->calcDampedLeastSquaresSolution();
+                }
             }
         }
 
@@ -47,6 +47,7 @@ Link::Link()
     dq_lower_ = -std::numeric_limits<double>::max();
     materialId_ = 0;
     info_ = new Mapping;
+    initializeStatePointers();
 }
 
 
@@ -59,7 +60,7 @@ Link::Link(const Link& org)
     parent_ = 0;
     body_ = 0;
 
-    T_ = org.T_;
+    T_ = org.T();
     Tb_ = org.Tb_;
     Rs_ = org.Rs_;
     
@@ -67,18 +68,18 @@ Link::Link(const Link& org)
     jointType_ = org.jointType_;
     actuationMode_ = org.actuationMode_;
 
-    q_ = org.q_;
-    dq_ = org.dq_;
-    ddq_ = org.ddq_;
+    q_ = org.q();
+    dq_ = org.dq();
+    ddq_ = org.ddq();
     u_ = org.u_;
 
     q_target_ = org.q_target_;
     dq_target_ = org.dq_target_;
 
-    v_ = org.v_;
-    w_ = org.w_;
-    dv_ = org.dv_;
-    dw_ = org.dw_;
+    v_ = org.v();
+    w_ = org.w();
+    dv_ = org.dv();
+    dw_ = org.dw();
     
     c_ = org.c_;
     wc_ = org.wc_;
@@ -100,6 +101,64 @@ Link::Link(const Link& org)
     visualShape_ = org.visualShape_;
     collisionShape_ = org.collisionShape_;
     info_ = org.info_;
+
+    initializeStatePointers();
+}
+
+
+void Link::initializeStatePointers()
+{
+    pT_ = &T_;
+    pv_ = &v_;
+    pw_ = &w_;
+    pdv_ = &dv_;
+    pdw_ = &dw_;
+    pq_ = &q_;
+    pdq_ = &dq_;
+    pddq_ = &ddq_;
+}
+
+
+/**
+   The current state is copied to the given storage, which is used as the state of the link
+   until unbindStateBuffer() is called.
+*/
+void Link::bindStateBuffer
+(Position* T, Vector3* v, Vector3* w, Vector3* dv, Vector3* dw, double* q, double* dq, double* ddq)
+{
+    *T = *pT_;
+    *v = *pv_;
+    *w = *pw_;
+    *dv = *pdv_;
+    *dw = *pdw_;
+    *q = *pq_;
+    *dq = *pdq_;
+    *ddq = *pddq_;
+
+    pT_ = T;
+    pv_ = v;
+    pw_ = w;
+    pdv_ = dv;
+    pdw_ = dw;
+    pq_ = q;
+    pdq_ = dq;
+    pddq_ = ddq;
+}
+
+
+void Link::unbindStateBuffer()
+{
+    if(pT_ != &T_){
+        T_ = *pT_;
+        v_ = *pv_;
+        w_ = *pw_;
+        dv_ = *pdv_;
+        dw_ = *pdw_;
+        q_ = *pq_;
+        dq_ = *pdq_;
+        ddq_ = *pddq_;
+        initializeStatePointers();
+    }
 }
 
 
@@ -124,14 +183,14 @@ Link::~Link()
 void Link::initializeState()
 {
     u_ = 0.0;
-    dq_ = 0.0;
-    ddq_ = 0.0;
-    q_target_ = q_;
-    dq_target_ = dq_;
-    v_.setZero();
-    w_.setZero();
-    dv_.setZero();
-    dw_.setZero();
+    dq() = 0.0;
+    ddq() = 0.0;
+    q_target_ = q();
+    dq_target_ = dq();
+    v().setZero();
+    w().setZero();
+    dv().setZero();
+    dw().setZero();
     F_ext_.setZero();
 }
 
@@ -61,46 +61,46 @@ public:
     Body* body() { return body_; }
     const Body* body() const { return body_; }
 
-    Position& T() { return T_; }
-    const Position& T() const { return T_; }
+    Position& T() { return *pT_; }
+    const Position& T() const { return *pT_; }
 
-    Position& position() { return T_; }
-    const Position& position() const { return T_; }
+    Position& position() { return *pT_; }
+    const Position& position() const { return *pT_; }
 
     template<class Scalar, int Mode, int Options>
         void setPosition(const Eigen::Transform<Scalar, 3, Mode, Options>& T) {
-        T_ = T.template cast<Position::Scalar>();
+        *pT_ = T.template cast<Position::Scalar>();
     }
 
     template<typename Derived1, typename Derived2>
         void setPosition(const Eigen::MatrixBase<Derived1>& rotation, const Eigen::MatrixBase<Derived2>& translation) {
-        T_.linear() = rotation;
-        T_.translation() = translation;
+        pT_->linear() = rotation;
+        pT_->translation() = translation;
     }
 
-    Position::TranslationPart p() { return T_.translation(); }
-    Position::ConstTranslationPart p() const { return T_.translation(); }
-    Position::TranslationPart translation() { return T_.translation(); }
-    Position::ConstTranslationPart translation() const { return T_.translation(); }
+    Position::TranslationPart p() { return pT_->translation(); }
+    Position::ConstTranslationPart p() const { return T().translation(); }
+    Position::TranslationPart translation() { return pT_->translation(); }
+    Position::ConstTranslationPart translation() const { return T().translation(); }
 
     template<typename Derived>
     void setTranslation(const Eigen::MatrixBase<Derived>& p) {
-        T_.translation() = p.template cast<Affine3::Scalar>();
+        pT_->translation() = p.template cast<Affine3::Scalar>();
     }
 
-    Position::LinearPart R() { return T_.linear(); }
-    Position::ConstLinearPart R() const { return T_.linear(); }
-    Position::LinearPart rotation() { return T_.linear(); }
-    Position::ConstLinearPart rotation() const { return T_.linear(); }
+    Position::LinearPart R() { return pT_->linear(); }
+    Position::ConstLinearPart R() const { return T().linear(); }
+    Position::LinearPart rotation() { return pT_->linear(); }
+    Position::ConstLinearPart rotation() const { return T().linear(); }
 
     template<typename Derived>
     void setRotation(const Eigen::MatrixBase<Derived>& R) {
-        T_.linear() = R.template cast<Affine3::Scalar>();
+        pT_->linear() = R.template cast<Affine3::Scalar>();
     }
 
     template<typename T>
     void setRotation(const Eigen::AngleAxis<T>& a) {
-        T_.linear() = a.template cast<Affine3::Scalar>().toRotationMatrix();
+        pT_->linear() = a.template cast<Affine3::Scalar>().toRotationMatrix();
     }
     
     // To, Ro?
@@ -177,12 +177,12 @@ public:
     void setActuationMode(ActuationMode mode) { actuationMode_ = mode; }
     std::string actuationModeString() const;
     
-    double q() const { return q_; }
-    double& q() { return q_; }
-    double dq() const { return dq_; }
-    double& dq() { return dq_; }
-    double ddq() const { return ddq_; }
-    double& ddq() { return ddq_; }
+    double q() const { return *pq_; }
+    double& q() { return *pq_; }
+    double dq() const { return *pdq_; }
+    double& dq() { return *pdq_; }
+    double ddq() const { return *pddq_; }
+    double& ddq() { return *pddq_; }
     double u() const { return u_; }
     double& u() { return u_; }
 
@@ -197,14 +197,14 @@ public:
     double dq_upper() const { return dq_upper_; } ///< the upper limit of joint velocities
     double dq_lower() const { return dq_lower_; } ///< the upper limit of joint velocities
 
-    const Vector3& v() const { return v_; }
-    Vector3& v() { return v_; }
-    const Vector3& w() const { return w_; }
-    Vector3& w() { return w_; }
-    const Vector3& dv() const { return dv_; }
-    Vector3& dv() { return dv_; }
-    const Vector3& dw() const { return dw_; }
-    Vector3& dw() { return dw_; }
+    const Vector3& v() const { return *pv_; }
+    Vector3& v() { return *pv_; }
+    const Vector3& w() const { return *pw_; }
+    Vector3& w() { return *pw_; }
+    const Vector3& dv() const { return *pdv_; }
+    Vector3& dv() { return *pdv_; }
+    const Vector3& dw() const { return *pdw_; }
+    Vector3& dw() { return *pdw_; }
 
     /// center of mass (self local)
     const Vector3& c() const { return c_; }
@@ -231,7 +231,7 @@ public:
 
     void addExternalForce(const Vector3& f_global, const Vector3& p_local){
         f_ext() += f_global;
-        tau_ext() += (T_ * p_local).cross(f_global);
+        tau_ext() += (*pT_ * p_local).cross(f_global);
     }
     
     int materialId() const { return materialId_; }
@@ -359,10 +359,28 @@ private:
     SgNodePtr collisionShape_;
     MappingPtr info_;
 
+    /*
+      The kinematic state is accessed through the following pointers, which point to the
+      above members or to the elements of the link state buffer of the body.
+    */
+    Position* pT_;
+    Vector3* pv_;
+    Vector3* pw_;
+    Vector3* pdv_;
+    Vector3* pdw_;
+    double* pq_;
+    double* pdq_;
+    double* pddq_;
+
     friend class Body;
+    friend class BodyImpl;
     
     void setBody(Body* newBody);
     void setBodySub(Body* newBody);
+    void initializeStatePointers();
+    void bindStateBuffer(
+        Position* T, Vector3* v, Vector3* w, Vector3* dv, Vector3* dw, double* q, double* dq, double* ddq);
+    void unbindStateBuffer();
 };
 
 template<> CNOID_EXPORT double Link::info(const std::string& key) const;
@@ -0,0 +1,523 @@
+/**
+   The benchmark of the model loading and the project loading.
+
+   Each case is run by a separate process, which is this program itself or choreonoid for
+   the project files, so that the peak memory usage of a case is not affected by the other
+   cases. The body files are loaded with BodyLoader, the mesh and scene files with SceneLoader,
+   and the YAML files with YAMLReader. The models which can only be loaded by the GUI plugins,
+   such as the SDF models, are measured as the projects which contain them.
+
+   The allocations are counted by replacing the global operator new of this program. The count
+   does not include the allocations done by malloc directly or, on Windows, by the DLLs, and it
+   is not available for the projects. When a baseline file written with the --output option is
+   given, the program exits with status 2 if the time, the allocation count or the peak memory
+   usage of any case exceeds that of the baseline by more than the threshold.
+*/
+
+#include "BodyLoader.h"
+#include "Body.h"
+#include <cnoid/SceneLoader>
+#include <cnoid/YAMLReader>
+#include <cnoid/MemoryUsage>
+#include <cnoid/ExecutablePath>
+#include <cnoid/NullOut>
+#ifdef CNOID_ENABLE_ASSIMP_SCENE_LOADER
+#include <cnoid/AssimpSceneLoader>
+#endif
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+using namespace cnoid;
+namespace filesystem = boost::filesystem;
+using fmt::format;
+
+namespace {
+
+std::atomic<long> numAllocations(0);
+
+}
+
+void* operator new(std::size_t size)
+{
+    ++numAllocations;
+    if(void* p = std::malloc(size ? size : 1)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Case
+{
+    string type; // "body", "scene", "yaml" or "project"
+    string file;
+};
+
+struct Result
+{
+    Case case_;
+    int numRepetitions = 0;
+    double minTime = 0.0;
+    double meanTime = 0.0;
+    // The count of a repetition, which is -1 when it is not available
+    long numAllocations = -1;
+    double peakMemory = 0.0;
+    string error;
+};
+
+struct Options
+{
+    vector<Case> cases;
+    int numRepetitions = 5;
+    string output;
+    string baseline;
+    double threshold = 10.0;
+    string choreonoid;
+    int numGeneratedYamlNodes = 100000;
+    bool doMeasureSampleModels = false;
+};
+
+
+string quote(const string& s)
+{
+    string quoted("\"");
+    for(auto c : s){
+        if(c == '"' || c == '\\'){
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    quoted += '"';
+    return quoted;
+}
+
+
+bool loadOnce(const Case& c, string& out_error)
+{
+    if(c.type == "body"){
+        BodyLoader loader;
+        loader.setMessageSink(nullout());
+        BodyPtr body = loader.load(c.file);
+        if(!body){
+            out_error = "The body cannot be loaded.";
+            return false;
+        }
+    } else if(c.type == "scene"){
+        SceneLoader loader;
+        loader.setMessageSink(nullout());
+        SgNodePtr scene = loader.load(c.file);
+        if(!scene){
+            out_error = "The scene cannot be loaded.";
+            return false;
+        }
+    } else if(c.type == "yaml"){
+        YAMLReader reader;
+        if(!reader.load(c.file)){
+            out_error = reader.errorMessage();
+            return false;
+        }
+    } else {
+        out_error = format("Case type \"{}\" is not supported.", c.type);
+        return false;
+    }
+    return true;
+}
+
+
+//! This is run in the child process
+Result runCase(const Case& c, int numRepetitions)
+{
+    Result result;
+    result.case_ = c;
+    double totalTime = 0.0;
+
+    for(int i=0; i < numRepetitions; ++i){
+        const long numAllocationsBefore = numAllocations;
+        auto start = Clock::now();
+        if(!loadOnce(c, result.error)){
+            break;
+        }
+        const double time = elapsedSince(start);
+        result.numAllocations = numAllocations - numAllocationsBefore;
+        result.minTime = (i == 0) ? time : std::min(result.minTime, time);
+        totalTime += time;
+        ++result.numRepetitions;
+    }
+    if(result.numRepetitions > 0){
+        result.meanTime = totalTime / result.numRepetitions;
+    }
+    result.peakMemory = getPeakMemoryUsage();
+
+    return result;
+}
+
+
+void writeResult(ostream& os, const Result& result)
+{
+    os << "    { \"type\": " << quote(result.case_.type)
+       << ", \"file\": " << quote(result.case_.file);
+    if(!result.error.empty()){
+        os << ", \"error\": " << quote(result.error);
+    }
+    os << ", \"repetitions\": " << result.numRepetitions
+       << ", \"minTime\": " << result.minTime
+       << ", \"meanTime\": " << result.meanTime
+       << ", \"allocations\": " << result.numAllocations
+       << ", \"peakMemory\": " << static_cast<size_t>(result.peakMemory) << " }";
+}
+
+
+bool writeResults(const string& filename, const vector<Result>& results)
+{
+    ofstream ofs(filename.c_str());
+    if(!ofs){
+        return false;
+    }
+    ofs << "{\n  \"results\": [";
+    for(size_t i=0; i < results.size(); ++i){
+        ofs << (i == 0 ? "\n" : ",\n");
+        writeResult(ofs, results[i]);
+    }
+    ofs << "\n  ]\n}\n";
+    return ofs.good();
+}
+
+
+//! The JSON files are read as YAML
+Listing* readListing(YAMLReader& reader, const string& filename, const char* key)
+{
+    try {
+        if(reader.load(filename) && reader.numDocuments() > 0){
+            if(auto mapping = dynamic_cast<Mapping*>(reader.document())){
+                auto listing = mapping->findListing(key);
+                if(listing->isValid()){
+                    return listing;
+                }
+            }
+        }
+    } catch(const ValueNode::Exception&){
+
+    }
+    return nullptr;
+}
+
+
+Result readResult(const Mapping& info)
+{
+    Result result;
+    info.read("type", result.case_.type);
+    info.read("file", result.case_.file);
+    info.read("error", result.error);
+    info.read("repetitions", result.numRepetitions);
+    info.read("minTime", result.minTime);
+    info.read("meanTime", result.meanTime);
+    double numAllocations = -1.0;
+    info.read("allocations", numAllocations);
+    result.numAllocations = static_cast<long>(numAllocations);
+    info.read("peakMemory", result.peakMemory);
+    return result;
+}
+
+
+Result runChildProcess(const Case& c, const Options& options, const string& resultFile)
+{
+    Result result;
+    result.case_ = c;
+    filesystem::remove(resultFile);
+
+    if(c.type == "project"){
+        double totalTime = 0.0;
+        for(int i=0; i < options.numRepetitions; ++i){
+            const string command =
+                format("{} {} --project-loading-benchmark {} --quit",
+                       quote(options.choreonoid), quote(c.file), quote(resultFile));
+            if(std::system(command.c_str()) != 0){
+                result.error = "The choreonoid process failed.";
+                break;
+            }
+            YAMLReader reader;
+            auto projects = readListing(reader, resultFile, "projects");
+            double time;
+            if(!projects || projects->size() == 0 || !projects->at(0)->toMapping()->read("time", time)){
+                result.error = "The project cannot be loaded.";
+                break;
+            }
+            reader.document()->toMapping()->read("peakMemory", result.peakMemory);
+            result.minTime = (i == 0) ? time : std::min(result.minTime, time);
+            totalTime += time;
+            ++result.numRepetitions;
+        }
+        if(result.numRepetitions > 0){
+            result.meanTime = totalTime / result.numRepetitions;
+        }
+    } else {
+        const string command =
+            format("{} --run-case {} {} --repeat {} --output {}",
+                   quote(executablePath()), c.type, quote(c.file), options.numRepetitions, quote(resultFile));
+        std::system(command.c_str());
+        YAMLReader reader;
+        auto results = readListing(reader, resultFile, "results");
+        if(results && results->size() > 0){
+            result = readResult(*results->at(0)->toMapping());
+        } else {
+            result.error = "The benchmark process failed.";
+        }
+    }
+
+    return result;
+}
+
+
+string generateYamlFile(int numNodes, const string& directory)
+{
+    string filename = (filesystem::path(directory) / "generated.yaml").string();
+    ofstream ofs(filename.c_str());
+    ofs << "items:\n";
+    for(int i=0; i < numNodes; ++i){
+        ofs << format("  - {{ id: {}, name: \"node{}\", position: [ {}, {}, {} ], enabled: {} }}\n",
+                      i, i, i * 0.1, i * 0.2, i * 0.3, (i % 2 == 0) ? "true" : "false");
+    }
+    return filename;
+}
+
+
+void addSampleModelCases(Options& options, const string& workDirectory)
+{
+    const string modelDir = shareDirectory() + "/model";
+    options.cases.push_back({ "body", modelDir + "/SR1/SR1.body" });
+    options.cases.push_back({ "body", modelDir + "/SR1/SR1-2D.wrl" });
+    options.cases.push_back({ "body", modelDir + "/WAREC1/WAREC1.body" });
+    options.cases.push_back({ "body", modelDir + "/DoubleArmV7/DoubleArmV7S.body" });
+    options.cases.push_back({ "scene", modelDir + "/JACO2/parts/HAND.stl" });
+    options.cases.push_back({ "scene", modelDir + "/house/cassette.wrl" });
+#ifdef CNOID_ENABLE_ASSIMP_SCENE_LOADER
+    options.cases.push_back({ "body", modelDir + "/UniversalRobots/UR5.body" });
+    options.cases.push_back({ "scene", modelDir + "/UniversalRobots/UR5/base.dae" });
+#endif
+    options.cases.push_back({ "yaml", modelDir + "/WAREC1/WAREC1.body" });
+    options.cases.push_back({ "yaml", generateYamlFile(options.numGeneratedYamlNodes, workDirectory) });
+}
+
+
+//! \return the number of the regressions
+int compareWithBaseline(const vector<Result>& results, const Options& options)
+{
+    YAMLReader reader;
+    auto baseline = readListing(reader, options.baseline, "results");
+    if(!baseline){
+        cerr << format("Baseline file \"{}\" cannot be read.", options.baseline) << endl;
+        return 1;
+    }
+    const double ratio = 1.0 + options.threshold / 100.0;
+    int numRegressions = 0;
+
+    auto check = [&](const Result& result, const char* metric, double value, double baseValue){
+        if(baseValue > 0.0 && value > baseValue * ratio){
+            cout << format("Regression: {} {} {}: {:.6g} -> {:.6g} (+{:.1f}%)",
+                           result.case_.type, result.case_.file, metric,
+                           baseValue, value, (value / baseValue - 1.0) * 100.0) << endl;
+            ++numRegressions;
+        }
+    };
+
+    for(auto& result : results){
+        if(!result.error.empty()){
+            continue;
+        }
+        for(int i=0; i < baseline->size(); ++i){
+            Result base = readResult(*baseline->at(i)->toMapping());
+            if(base.case_.type == result.case_.type && base.case_.file == result.case_.file && base.error.empty()){
+                check(result, "time", result.minTime, base.minTime);
+                if(result.numAllocations >= 0){
+                    check(result, "allocations", result.numAllocations, base.numAllocations);
+                }
+                check(result, "peak memory", result.peakMemory, base.peakMemory);
+                break;
+            }
+        }
+    }
+
+    return numRegressions;
+}
+
+
+void showUsage()
+{
+    cout <<
+        "Usage: cnoid-loading-benchmark [options]\n"
+        "  --body <file>         measure the loading of a body file with BodyLoader\n"
+        "  --scene <file>        measure the loading of a mesh or scene file with SceneLoader\n"
+        "  --yaml <file>         measure the loading of a YAML file with YAMLReader\n"
+        "  --project <file>      measure the loading of a project file with choreonoid\n"
+        "  --repeat <n>          number of the repetitions of each case (default: 5)\n"
+        "  --choreonoid <file>   choreonoid executable for the projects\n"
+        "  --output <file>       write the results to a JSON file\n"
+        "  --baseline <file>     compare the results with a file written with --output\n"
+        "  --threshold <p>       percentage of the increase detected as a regression (default: 10)\n"
+        "  --yaml-nodes <n>      number of the nodes of the generated YAML file (default: 100000)\n"
+        "  --sample-models       measure the sample models, which are measured when no case is given\n";
+}
+
+}
+
+
+int main(int argc, char* argv[])
+{
+#ifdef CNOID_ENABLE_ASSIMP_SCENE_LOADER
+    AssimpSceneLoader::initializeClass();
+#endif
+
+    Options options;
+    bool isChildProcess = false;
+
+    for(int i=1; i < argc; ++i){
+        string arg = argv[i];
+        if(arg == "--help" || arg == "-h"){
+            showUsage();
+            return 0;
+        }
+        if(arg == "--run-case"){
+            if(i + 2 >= argc){
+                return 1;
+            }
+            isChildProcess = true;
+            string type = argv[++i];
+            string file = argv[++i];
+            options.cases.push_back({ type, file });
+            continue;
+        }
+        if(arg == "--sample-models"){
+            options.doMeasureSampleModels = true;
+            continue;
+        }
+        if(i + 1 >= argc){
+            cerr << format("Option {} requires a value.", arg) << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        if(arg == "--body" || arg == "--scene" || arg == "--yaml" || arg == "--project"){
+            options.cases.push_back({ arg.substr(2), value });
+        } else if(arg == "--repeat"){
+            options.numRepetitions = std::max(1, std::atoi(value.c_str()));
+        } else if(arg == "--choreonoid"){
+            options.choreonoid = value;
+        } else if(arg == "--output"){
+            options.output = value;
+        } else if(arg == "--baseline"){
+            options.baseline = value;
+        } else if(arg == "--threshold"){
+            options.threshold = std::atof(value.c_str());
+        } else if(arg == "--yaml-nodes"){
+            options.numGeneratedYamlNodes = std::max(1, std::atoi(value.c_str()));
+        } else {
+            cerr << format("Unknown option {}.", arg) << endl;
+            showUsage();
+            return 1;
+        }
+    }
+
+    if(isChildProcess){
+        vector<Result> results;
+        results.push_back(runCase(options.cases.front(), options.numRepetitions));
+        return writeResults(options.output, results) ? 0 : 1;
+    }
+
+    // The directory is not unique so that the generated file is compared with the baseline
+    const filesystem::path workDirectory = filesystem::temp_directory_path() / "cnoid-loading-benchmark";
+    filesystem::create_directories(workDirectory);
+
+    if(options.cases.empty() || options.doMeasureSampleModels){
+        addSampleModelCases(options, workDirectory.string());
+    }
+
+    if(options.choreonoid.empty()){
+#ifdef _WIN32
+        options.choreonoid = executableDirectory() + "/choreonoid.exe";
+#else
+        options.choreonoid = executableDirectory() + "/choreonoid";
+#endif
+    }
+
+    // The projects are loaded without showing the windows
+#ifdef _WIN32
+    _putenv("QT_QPA_PLATFORM=offscreen");
+#else
+    setenv("QT_QPA_PLATFORM", "offscreen", 1);
+#endif
+
+    cout << format("{:<8} {:<40} {:>12} {:>12} {:>12} {:>12}",
+                   "type", "file", "min [ms]", "mean [ms]", "allocations", "peak [MB]") << endl;
+
+    const string resultFile = (workDirectory / "result.json").string();
+    vector<Result> results;
+    for(auto& c : options.cases){
+        results.push_back(runChildProcess(c, options, resultFile));
+        auto& result = results.back();
+        const string name = filesystem::path(c.file).filename().string();
+        if(!result.error.empty()){
+            cout << format("{:<8} {:<40} {}", c.type, name, result.error) << endl;
+        } else {
+            cout << format("{:<8} {:<40} {:>12.2f} {:>12.2f} {:>12} {:>12.1f}",
+                           c.type, name, result.minTime * 1.0e3, result.meanTime * 1.0e3,
+                           (result.numAllocations >= 0) ? std::to_string(result.numAllocations) : string("-"),
+                           result.peakMemory / (1024.0 * 1024.0))
+                 << endl;
+        }
+    }
+
+    if(!options.output.empty() && !writeResults(options.output, results)){
+        cerr << format("\"{}\" cannot be written.", options.output) << endl;
+        return 1;
+    }
+
+    if(!options.baseline.empty()){
+        int numRegressions = compareWithBaseline(results, options);
+        if(numRegressions > 0){
+            cout << format("{} regressions exceeding {}% were detected.", numRegressions, options.threshold) << endl;
+            return 2;
+        }
+    }
+
+    return 0;
+}
@@ -19,10 +19,11 @@ void setColumnOfMassMatrix(Body* body, MatrixXd& out_M, int column)
         f.tail<3>() -= rootLink->p().cross(f.head<3>());
         out_M.block<6, 1>(0, column) = f;
     }
+    const int rootDof = rootLink->isFixedJoint() ? 0 : 6;
     const int n = body->numJoints();
     for(int i = 0; i < n; ++i){
         Link* joint = body->joint(i);
-        out_M(i + 6, column) = joint->u();
+        out_M(i + rootDof, column) = joint->u();
     }
 }
 }
@@ -75,7 +76,7 @@ void calcMassMatrix(Body* body, const Vector3& g, Eigen::MatrixXd& out_M)
         for(int i=0; i < 3; ++i){
             rootLink->dv()[i] += 1.0;
             setColumnOfMassMatrix(body, out_M, i);
-            rootLink->dv()[i] -= 0.0;
+            rootLink->dv()[i] -= 1.0;
         }
         for(int i=0; i < 3; ++i){
             rootLink->dw()[i] = 1.0;
@@ -87,9 +88,9 @@ void calcMassMatrix(Body* body, const Vector3& g, Eigen::MatrixXd& out_M)
     for(int i = 0; i < nj; ++i){
         Link* joint = body->joint(i);
         joint->ddq() = 1.0;
-        int j = i + 6;
+        int j = i + (rootLink->isFixedJoint() ? 0 : 6);
+        // The motor inertia is included in the joint torque given by the inverse dynamics
         setColumnOfMassMatrix(body, out_M, j);
-        out_M(j, j) += joint->Jm2(); // motor inertia
         joint->ddq() = 0.0;
     }
 
@@ -10,6 +10,7 @@
 #include <vector>
 #include <unordered_set>
 #include <unordered_map>
+#include <algorithm>
 #include "gettext.h"
 
 using namespace std;
@@ -25,6 +26,14 @@ public:
 
     typedef unordered_map<IdPair<>, ContactMaterialPtr> ContactMaterialMap;
     ContactMaterialMap contactMaterialMap;
+
+    /*
+      Dense symmetric matrix of the contact materials indexed by the material ids.
+      This is the runtime representation looked up by contactMaterial() and is
+      rebuilt from contactMaterialMap when the id range grows.
+    */
+    vector<ContactMaterial*> contactMaterialMatrix;
+    int matrixSize;
     
     MaterialTableImpl();
     MaterialTableImpl(const MaterialTableImpl& org);
@@ -33,6 +42,13 @@ public:
     void loadMaterials(Mapping* topNode, std::ostream& os);
     void loadContactMaterials(Mapping* topNode, std::ostream& os);
     void setContactMaterialPairs(ContactMaterial* contactMaterial, const vector<int>& materialIndices, int index1);
+    void updateContactMaterialMatrix(int minSize = 0);
+    ContactMaterial* contactMaterial(int id1, int id2) const {
+        if(id1 >= 0 && id2 >= 0 && id1 < matrixSize && id2 < matrixSize){
+            return contactMaterialMatrix[id1 * matrixSize + id2];
+        }
+        return nullptr;
+    }
 };
 
 }
@@ -51,6 +67,7 @@ MaterialTableImpl::MaterialTableImpl()
     defaultMaterial->setRoughness(0.5);
     defaultMaterial->setViscosity(0.0);
     materials.push_back(defaultMaterial);
+    updateContactMaterialMatrix();
 }
 
 
@@ -99,6 +116,8 @@ MaterialTableImpl::MaterialTableImpl(const MaterialTableImpl& org, MaterialTable
         }
         contactMaterialMap.insert(ContactMaterialMap::value_type(idPair, copy));
     }
+
+    updateContactMaterialMatrix();
 }
 
 
@@ -129,11 +148,7 @@ Material* MaterialTable::material(int id) const
         
 ContactMaterial* MaterialTable::contactMaterial(int id1, int id2) const
 {
-    auto iter = impl->contactMaterialMap.find(IdPair<>(id1, id2));
-    if(iter != impl->contactMaterialMap.end()){
-        return iter->second;
-    }
-    return 0;
+    return impl->contactMaterial(id1, id2);
 }
 
 
@@ -180,6 +195,9 @@ int MaterialTableImpl::addMaterial(Material* material)
             materials.resize(id + 1);
         }
         materials[id] = material;
+        if(id >= matrixSize){
+            updateContactMaterialMatrix();
+        }
     }
 
     return id;
@@ -189,6 +207,34 @@ int MaterialTableImpl::addMaterial(Material* material)
 void MaterialTable::setContactMaterial(int id1, int id2, ContactMaterial* cm)
 {
     impl->contactMaterialMap[IdPair<>(id1, id2)] = cm;
+
+    auto& matrix = impl->contactMaterialMatrix;
+    const int n = impl->matrixSize;
+    if(id1 < n && id2 < n){
+        matrix[id1 * n + id2] = cm;
+        matrix[id2 * n + id1] = cm;
+    } else {
+        impl->updateContactMaterialMatrix(std::max(id1, id2) + 1);
+    }
+}
+
+
+void MaterialTableImpl::updateContactMaterialMatrix(int minSize)
+{
+    int n = std::max(static_cast<int>(materials.size()), minSize);
+    for(auto& kv : contactMaterialMap){
+        const IdPair<>& idPair = kv.first;
+        n = std::max(n, idPair(1) + 1); // idPair(0) <= idPair(1)
+    }
+    matrixSize = n;
+    contactMaterialMatrix.assign(n * n, nullptr);
+    for(auto& kv : contactMaterialMap){
+        const IdPair<>& idPair = kv.first;
+        const int id1 = idPair(0);
+        const int id2 = idPair(1);
+        contactMaterialMatrix[id1 * n + id2] = kv.second;
+        contactMaterialMatrix[id2 * n + id1] = kv.second;
+    }
 }
 
 
@@ -208,6 +254,8 @@ bool MaterialTable::load(const std::string& filename, std::ostream& os)
         os << ex.message();
     }
 
+    impl->updateContactMaterialMatrix();
+
     os.flush();
     
     return result;
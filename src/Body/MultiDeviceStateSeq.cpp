@@ -123,6 +123,23 @@ const std::string& MultiDeviceStateSeq::partLabel(int partIndex) const
 }
 
 
+void MultiDeviceStateSeq::countMemoryUsage(MemoryUsageCounter& counter) const
+{
+    BaseSeqType::countMemoryUsage(counter);
+
+    // The size of each state is estimated from the number of the state values
+    const int nf = numFrames();
+    const int np = numParts();
+    for(int i=0; i < nf; ++i){
+        for(int j=0; j < np; ++j){
+            if(auto& state = at(i, j)){
+                counter.addShared(state.get(), sizeof(DeviceState) + state->stateSize() * sizeof(double));
+            }
+        }
+    }
+}
+
+
 bool MultiDeviceStateSeq::doWriteSeq(YAMLWriter& writer, std::function<void()> additionalPartCallback)
 {
     double version = writer.info("formatVersion", 3.0);
@@ -154,7 +171,8 @@ void MultiDeviceStateSeq::writeDeviceStateSeq(YAMLWriter& writer, int deviceInde
     auto seq = part(deviceIndex);
     DeviceState* state = seq[0];
     const int stateSize = state->stateSize();
-    vector<double> buf(stateSize);
+    // The first element is used for the frame time
+    vector<double> buf(stateSize + 1);
     writer.startMapping();
     writer.putKeyValue("type", "DeviceStateSeq");
     writer.putKeyValue("content", string(state->typeName()) + "StateSeq");
@@ -181,15 +199,13 @@ void MultiDeviceStateSeq::writeDeviceStateSeq(YAMLWriter& writer, int deviceInde
     const double dt = timeStep();
     for(int i=0; i < numFrames; ++i){
         int index = validFrameIndices[i];
-        seq[index]->writeState(&buf.front());
-        writer.startFlowStyleListing();
+        seq[index]->writeState(&buf[1]);
         if(hasFrameTime){
-            writer.putScalar(dt * index);
-        }
-        for(int j=0; j < stateSize; ++j){
-            writer.putScalar(buf[j]);
+            buf[0] = dt * index;
+            writer.putFlowStyleListing(&buf[0], stateSize + 1);
+        } else {
+            writer.putFlowStyleListing(&buf[1], stateSize);
         }
-        writer.endListing();
     }
         
     writer.endListing();
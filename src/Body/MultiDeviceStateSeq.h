@@ -34,6 +34,9 @@ public:
     virtual int partIndex(const std::string& partLabel) const override;
     virtual const std::string& partLabel(int partIndex) const override;
 
+    //! The states shared by the successive frames are counted only once
+    virtual void countMemoryUsage(MemoryUsageCounter& counter) const override;
+
 protected:
     virtual bool doWriteSeq(YAMLWriter& writer, std::function<void()> additionalPartCallback) override;
 
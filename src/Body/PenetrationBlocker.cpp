@@ -3,6 +3,12 @@
 */
 
 #include "PenetrationBlocker.h"
+#include <cnoid/MeshExtractor>
+#include <cnoid/SceneDrawables>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <cmath>
 
 using namespace std;
 using namespace std::placeholders;
@@ -14,6 +20,340 @@ const bool TRACE_FUNCTIONS = false;
 
 typedef CollisionDetector::GeometryHandle GeometryHandle;
 
+// The resolution of the longest side of a distance field
+const int distanceFieldResolution = 128;
+const int maxNumDistanceFieldCells = 1 << 22;
+// The distances are exactly computed within this number of the cells from the surface
+const int distanceFieldBandCells = 3;
+const int maxNumSurfacePoints = 4096;
+
+struct Triangle
+{
+    Vector3 a, b, c;
+};
+
+void extractTriangles(SgNode* shape, vector<Triangle>& out_triangles)
+{
+    MeshExtractor extractor;
+    extractor.extract(
+        shape,
+        [&](){
+            SgMesh* mesh = extractor.currentMesh();
+            const Affine3& T = extractor.currentTransform();
+            const SgVertexArray& vertices = *mesh->vertices();
+            const int numTriangles = mesh->numTriangles();
+            for(int i=0; i < numTriangles; ++i){
+                auto tri = mesh->triangle(i);
+                out_triangles.push_back(
+                    { T * vertices[tri[0]].cast<double>(),
+                      T * vertices[tri[1]].cast<double>(),
+                      T * vertices[tri[2]].cast<double>() });
+            }
+        });
+}
+
+//! Returns the closest point on the triangle to the point p
+Vector3 getClosestPointOnTriangle(const Vector3& p, const Triangle& t)
+{
+    const Vector3 ab = t.b - t.a;
+    const Vector3 ac = t.c - t.a;
+    const Vector3 ap = p - t.a;
+    const double d1 = ab.dot(ap);
+    const double d2 = ac.dot(ap);
+    if(d1 <= 0.0 && d2 <= 0.0){
+        return t.a;
+    }
+    const Vector3 bp = p - t.b;
+    const double d3 = ab.dot(bp);
+    const double d4 = ac.dot(bp);
+    if(d3 >= 0.0 && d4 <= d3){
+        return t.b;
+    }
+    const double vc = d1 * d4 - d3 * d2;
+    if(vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0){
+        return t.a + (d1 / (d1 - d3)) * ab;
+    }
+    const Vector3 cp = p - t.c;
+    const double d5 = ab.dot(cp);
+    const double d6 = ac.dot(cp);
+    if(d6 >= 0.0 && d5 <= d6){
+        return t.c;
+    }
+    const double vb = d5 * d2 - d1 * d6;
+    if(vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0){
+        return t.a + (d2 / (d2 - d6)) * ac;
+    }
+    const double va = d3 * d6 - d5 * d4;
+    if(va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0){
+        return t.b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (t.c - t.b);
+    }
+    const double denom = 1.0 / (va + vb + vc);
+    return t.a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+/**
+   The signed distances on the grid points around a geometry, which are negative inside the
+   geometry. The exact distances are only computed in the narrow band around the surface, and
+   the sign of a grid point out of the band is determined by whether the grid point is reached
+   from the boundary of the grid without crossing the surface.
+*/
+class DistanceField : public Referenced
+{
+public:
+    Vector3 origin;
+    double cellSize;
+    int nx, ny, nz;
+    double bandWidth;
+    vector<float> values;
+
+    bool build(SgNode* shape);
+
+    int index(int x, int y, int z) const { return (z * ny + y) * nx + x; }
+
+    //! Returns false when the point is out of the field
+    bool getDistance(const Vector3& p, double& out_distance, Vector3& out_gradient) const;
+};
+
+typedef ref_ptr<DistanceField> DistanceFieldPtr;
+
+
+bool DistanceField::build(SgNode* shape)
+{
+    vector<Triangle> triangles;
+    extractTriangles(shape, triangles);
+    if(triangles.empty()){
+        return false;
+    }
+
+    Vector3 bmin = triangles.front().a;
+    Vector3 bmax = bmin;
+    for(auto& t : triangles){
+        bmin = bmin.cwiseMin(t.a).cwiseMin(t.b).cwiseMin(t.c);
+        bmax = bmax.cwiseMax(t.a).cwiseMax(t.b).cwiseMax(t.c);
+    }
+    const Vector3 extents = bmax - bmin;
+    cellSize = extents.maxCoeff() / distanceFieldResolution;
+    if(cellSize <= 0.0){
+        return false;
+    }
+    const double volume = 
+        (extents.x() + 2.0 * (distanceFieldBandCells + 1) * cellSize) *
+        (extents.y() + 2.0 * (distanceFieldBandCells + 1) * cellSize) *
+        (extents.z() + 2.0 * (distanceFieldBandCells + 1) * cellSize);
+    cellSize = std::max(cellSize, std::cbrt(volume / maxNumDistanceFieldCells));
+    bandWidth = distanceFieldBandCells * cellSize;
+    
+    const double margin = (distanceFieldBandCells + 1) * cellSize;
+    origin = bmin - Vector3::Constant(margin);
+    nx = static_cast<int>(std::ceil((extents.x() + 2.0 * margin) / cellSize)) + 1;
+    ny = static_cast<int>(std::ceil((extents.y() + 2.0 * margin) / cellSize)) + 1;
+    nz = static_cast<int>(std::ceil((extents.z() + 2.0 * margin) / cellSize)) + 1;
+    const int numCells = nx * ny * nz;
+
+    // The unsigned distances in the band and the signs given by the closest triangles
+    vector<float> distances(numCells, std::numeric_limits<float>::max());
+    vector<signed char> faceSigns(numCells, 1);
+
+    for(auto& t : triangles){
+        const Vector3 normal = (t.b - t.a).cross(t.c - t.a);
+        const Vector3 tmin = t.a.cwiseMin(t.b).cwiseMin(t.c) - Vector3::Constant(bandWidth);
+        const Vector3 tmax = t.a.cwiseMax(t.b).cwiseMax(t.c) + Vector3::Constant(bandWidth);
+        const int x0 = std::max(0, static_cast<int>(std::floor((tmin.x() - origin.x()) / cellSize)));
+        const int y0 = std::max(0, static_cast<int>(std::floor((tmin.y() - origin.y()) / cellSize)));
+        const int z0 = std::max(0, static_cast<int>(std::floor((tmin.z() - origin.z()) / cellSize)));
+        const int x1 = std::min(nx - 1, static_cast<int>(std::ceil((tmax.x() - origin.x()) / cellSize)));
+        const int y1 = std::min(ny - 1, static_cast<int>(std::ceil((tmax.y() - origin.y()) / cellSize)));
+        const int z1 = std::min(nz - 1, static_cast<int>(std::ceil((tmax.z() - origin.z()) / cellSize)));
+        for(int z=z0; z <= z1; ++z){
+            for(int y=y0; y <= y1; ++y){
+                for(int x=x0; x <= x1; ++x){
+                    const Vector3 p = origin + cellSize * Vector3(x, y, z);
+                    const Vector3 v = p - getClosestPointOnTriangle(p, t);
+                    const float d = v.norm();
+                    const int i = index(x, y, z);
+                    if(d < distances[i]){
+                        distances[i] = d;
+                        faceSigns[i] = (v.dot(normal) >= 0.0) ? 1 : -1;
+                    }
+                }
+            }
+        }
+    }
+
+    /*
+      The grid points which are close enough to the surface to be in a cell crossed by the surface
+      block the flood fill from the boundary, which is always outside the geometry.
+    */
+    const float wallDistance = 0.5 * std::sqrt(3.0) * cellSize;
+    vector<char> isOutside(numCells, 0);
+    std::deque<int> queue;
+    for(int z=0; z < nz; ++z){
+        for(int y=0; y < ny; ++y){
+            for(int x=0; x < nx; ++x){
+                if(x == 0 || y == 0 || z == 0 || x == nx - 1 || y == ny - 1 || z == nz - 1){
+                    const int i = index(x, y, z);
+                    if(distances[i] >= wallDistance){
+                        isOutside[i] = 1;
+                        queue.push_back(i);
+                    }
+                }
+            }
+        }
+    }
+    const int strides[] = { 1, nx, nx * ny };
+    while(!queue.empty()){
+        const int i = queue.front();
+        queue.pop_front();
+        const int coords[] = { i % nx, (i / nx) % ny, i / (nx * ny) };
+        const int sizes[] = { nx, ny, nz };
+        for(int axis=0; axis < 3; ++axis){
+            if(coords[axis] > 0){
+                const int j = i - strides[axis];
+                if(!isOutside[j] && distances[j] >= wallDistance){
+                    isOutside[j] = 1;
+                    queue.push_back(j);
+                }
+            }
+            if(coords[axis] < sizes[axis] - 1){
+                const int j = i + strides[axis];
+                if(!isOutside[j] && distances[j] >= wallDistance){
+                    isOutside[j] = 1;
+                    queue.push_back(j);
+                }
+            }
+        }
+    }
+
+    values.resize(numCells);
+    for(int i=0; i < numCells; ++i){
+        const float d = std::min(distances[i], static_cast<float>(bandWidth));
+        if(distances[i] < wallDistance){
+            values[i] = faceSigns[i] * d;
+        } else if(isOutside[i]){
+            values[i] = d;
+        } else {
+            values[i] = -d;
+        }
+    }
+
+    return true;
+}
+
+
+bool DistanceField::getDistance(const Vector3& p, double& out_distance, Vector3& out_gradient) const
+{
+    const Vector3 g = (p - origin) / cellSize;
+    const int x = static_cast<int>(std::floor(g.x()));
+    const int y = static_cast<int>(std::floor(g.y()));
+    const int z = static_cast<int>(std::floor(g.z()));
+    if(x < 0 || y < 0 || z < 0 || x >= nx - 1 || y >= ny - 1 || z >= nz - 1){
+        return false;
+    }
+    const double u = g.x() - x;
+    const double v = g.y() - y;
+    const double w = g.z() - z;
+    const int i = index(x, y, z);
+    const int sy = nx;
+    const int sz = nx * ny;
+    const double c000 = values[i];
+    const double c100 = values[i + 1];
+    const double c010 = values[i + sy];
+    const double c110 = values[i + sy + 1];
+    const double c001 = values[i + sz];
+    const double c101 = values[i + sz + 1];
+    const double c011 = values[i + sz + sy];
+    const double c111 = values[i + sz + sy + 1];
+
+    // Trilinear interpolation and its derivatives
+    const double c00 = c000 + (c100 - c000) * u;
+    const double c10 = c010 + (c110 - c010) * u;
+    const double c01 = c001 + (c101 - c001) * u;
+    const double c11 = c011 + (c111 - c011) * u;
+    const double c0 = c00 + (c10 - c00) * v;
+    const double c1 = c01 + (c11 - c01) * v;
+    out_distance = c0 + (c1 - c0) * w;
+
+    const double dx0 = (c100 - c000) + ((c110 - c010) - (c100 - c000)) * v;
+    const double dx1 = (c101 - c001) + ((c111 - c011) - (c101 - c001)) * v;
+    out_gradient.x() = dx0 + (dx1 - dx0) * w;
+    out_gradient.y() = (c10 - c00) + ((c11 - c01) - (c10 - c00)) * w;
+    out_gradient.z() = c1 - c0;
+
+    return true;
+}
+
+
+// The distance fields are shared by the blockers for the same geometries
+std::mutex distanceFieldCacheMutex;
+unordered_map<SgNode*, pair<weak_ref_ptr<SgNode>, DistanceFieldPtr>> distanceFieldCache;
+
+DistanceFieldPtr getDistanceField(SgNode* shape)
+{
+    std::lock_guard<std::mutex> lock(distanceFieldCacheMutex);
+
+    auto p = distanceFieldCache.find(shape);
+    if(p != distanceFieldCache.end()){
+        if(p->second.first.lock() == shape){
+            return p->second.second;
+        }
+        distanceFieldCache.erase(p);
+    }
+    DistanceFieldPtr field = new DistanceField;
+    if(!field->build(shape)){
+        field.reset();
+    }
+    distanceFieldCache[shape] = std::make_pair(weak_ref_ptr<SgNode>(shape), field);
+
+    // Remove the fields of the deleted geometries
+    auto q = distanceFieldCache.begin();
+    while(q != distanceFieldCache.end()){
+        if(!q->second.first.lock()){
+            q = distanceFieldCache.erase(q);
+        } else {
+            ++q;
+        }
+    }
+    return field;
+}
+
+/**
+   The points are sampled on the triangles of the target link with a spacing which keeps the
+   number of the points within the limit.
+*/
+void sampleSurfacePoints(SgNode* shape, vector<Vector3>& out_points)
+{
+    vector<Triangle> triangles;
+    extractTriangles(shape, triangles);
+
+    out_points.clear();
+    if(triangles.empty()){
+        return;
+    }
+    double area = 0.0;
+    for(auto& t : triangles){
+        area += 0.5 * (t.b - t.a).cross(t.c - t.a).norm();
+    }
+    const int numTriangles = triangles.size();
+    const int budget = std::max(maxNumSurfacePoints - 3 * numTriangles, numTriangles);
+    const double spacing = std::sqrt(2.0 * area / budget);
+
+    for(auto& t : triangles){
+        const double maxEdge =
+            std::max({ (t.b - t.a).norm(), (t.c - t.b).norm(), (t.a - t.c).norm() });
+        const int n = (spacing > 0.0) ? std::max(1, static_cast<int>(std::ceil(maxEdge / spacing))) : 1;
+        for(int i=0; i <= n; ++i){
+            for(int j=0; j <= n - i; ++j){
+                const double a = static_cast<double>(i) / n;
+                const double b = static_cast<double>(j) / n;
+                out_points.push_back(t.a + a * (t.b - t.a) + b * (t.c - t.a));
+            }
+        }
+        if(static_cast<int>(out_points.size()) >= 2 * maxNumSurfacePoints){
+            break;
+        }
+    }
+}
+
 }
 
 namespace cnoid {
@@ -34,6 +374,16 @@ public:
             : link(link), geometry(geometry) { }
     };
     vector<LinkInfo> opponentLinkInfos;
+
+    bool isDistanceFieldEnabled;
+    struct FieldInfo {
+        Link* link;
+        DistanceFieldPtr field;
+    };
+    vector<FieldInfo> opponentFieldInfos;
+    vector<Vector3> targetSurfacePoints;
+    Vector3 targetSurfaceCenter;
+    double targetSurfaceRadius;
         
     double targetDepth;
     Vector3 pPrevGiven;
@@ -49,7 +399,9 @@ public:
     void addOpponentLink(Link* link);
     void start();
     bool adjust(Position& io_T, const Vector3& pushDirection);
+    void detectPenetrationsWithDistanceFields(const Position& T);
     void onCollisionDetected(const CollisionPair& collisionPair);
+    void checkPenetration(double depth, const Vector3& normal);
 };
 }
 
@@ -70,6 +422,14 @@ PenetrationBlockerImpl::PenetrationBlockerImpl(CollisionDetectorPtr& collisionDe
     pPrevGiven = targetLink->p();
     targetDepth = 0.001;
     isPrevBlocked = false;
+    isDistanceFieldEnabled = true;
+    targetSurfaceRadius = 0.0;
+}
+
+
+void PenetrationBlocker::setDistanceFieldEnabled(bool on)
+{
+    impl->isDistanceFieldEnabled = on;
 }
 
 
@@ -81,6 +441,28 @@ void PenetrationBlocker::addOpponentLink(Link* link)
 
 void PenetrationBlockerImpl::addOpponentLink(Link* link)
 {
+    if(isDistanceFieldEnabled && targetLinkGeometry && link->collisionShape()){
+        if(targetSurfacePoints.empty()){
+            sampleSurfacePoints(targetLink->collisionShape(), targetSurfacePoints);
+            if(!targetSurfacePoints.empty()){
+                Vector3 pmin = targetSurfacePoints.front();
+                Vector3 pmax = pmin;
+                for(auto& p : targetSurfacePoints){
+                    pmin = pmin.cwiseMin(p);
+                    pmax = pmax.cwiseMax(p);
+                }
+                targetSurfaceCenter = (pmin + pmax) / 2.0;
+                targetSurfaceRadius = (pmax - pmin).norm() / 2.0;
+            }
+        }
+        if(!targetSurfacePoints.empty()){
+            if(auto field = getDistanceField(link->collisionShape())){
+                opponentFieldInfos.push_back({ link, field });
+                return;
+            }
+        }
+    }
+    
     auto handle = collisionDetector->addGeometry(link->collisionShape());
     if(handle){
         opponentLinkInfos.push_back(LinkInfo(link, *handle));
@@ -151,13 +533,17 @@ bool PenetrationBlockerImpl::adjust(Position& io_T, const Vector3& pushDirection
     
     for(loop = 0; loop < 100; ++loop){
 
-        collisionDetector->updatePosition(*targetLinkGeometry, io_T);
-
         maxsdepth = 0.0;
         maxdepth = 0.0;
 
-        collisionDetector->detectCollisions(
-            [&](const CollisionPair& pair){ onCollisionDetected(pair);});
+        if(!opponentFieldInfos.empty()){
+            detectPenetrationsWithDistanceFields(io_T);
+        }
+        if(!opponentLinkInfos.empty()){
+            collisionDetector->updatePosition(*targetLinkGeometry, io_T);
+            collisionDetector->detectCollisions(
+                [&](const CollisionPair& pair){ onCollisionDetected(pair);});
+        }
         
         if(maxsdepth > 0.0){
             io_T.translation() += (maxdepth - targetDepth) * maxnormal;
@@ -175,6 +561,39 @@ bool PenetrationBlockerImpl::adjust(Position& io_T, const Vector3& pushDirection
 }
 
 
+void PenetrationBlockerImpl::detectPenetrationsWithDistanceFields(const Position& T)
+{
+    for(auto& info : opponentFieldInfos){
+        // The transform from the target link to the opponent link
+        const Position T_local = info.link->T().inverse(Eigen::Isometry) * T;
+        const DistanceField* field = info.field;
+
+        // The target link is skipped when its bounding sphere is out of the field
+        const Vector3 c = T_local * targetSurfaceCenter - field->origin;
+        const Vector3 size = field->cellSize * Vector3(field->nx - 1, field->ny - 1, field->nz - 1);
+        if((c.array() + targetSurfaceRadius < 0.0).any() || (c.array() - targetSurfaceRadius > size.array()).any()){
+            continue;
+        }
+        
+        const Matrix3 R = info.link->R();
+        double distance;
+        Vector3 gradient;
+        for(auto& p : targetSurfacePoints){
+            if(field->getDistance(T_local * p, distance, gradient)){
+                const double depth = -distance;
+                if(depth > targetDepth){
+                    const double norm = gradient.norm();
+                    if(norm > 0.0){
+                        // The gradient points to the outside of the opponent
+                        checkPenetration(depth, R * (gradient / norm));
+                    }
+                }
+            }
+        }
+    }
+}
+
+
 void PenetrationBlockerImpl::onCollisionDetected(const CollisionPair& collisionPair)
 {
     double normalSign = (collisionPair.geometry(0) == *targetLinkGeometry) ? -1.0 : 1.0;
@@ -182,16 +601,21 @@ void PenetrationBlockerImpl::onCollisionDetected(const CollisionPair& collisionP
     for(size_t i=0; i < collisions.size(); ++i){
         const Collision& c = collisions[i];
         if(c.depth > targetDepth){
-            const Vector3 normal = normalSign * c.normal;
-            double d = -normal.dot(s);
-            if(d > 0.0){
-                double sdepth = c.depth * d;
-                if(sdepth > maxsdepth){
-                    maxsdepth = sdepth;
-                    maxdepth = c.depth;
-                    maxnormal = normal;
-                }
-            }
+            checkPenetration(c.depth, normalSign * c.normal);
+        }
+    }
+}
+
+
+void PenetrationBlockerImpl::checkPenetration(double depth, const Vector3& normal)
+{
+    double d = -normal.dot(s);
+    if(d > 0.0){
+        double sdepth = depth * d;
+        if(sdepth > maxsdepth){
+            maxsdepth = sdepth;
+            maxdepth = depth;
+            maxnormal = normal;
         }
     }
 }
@@ -24,6 +24,18 @@ public:
     */
     PenetrationBlocker(CollisionDetectorPtr collisionDetector, Link* targetLink);
         
+    /**
+       The penetrations into the opponent links are detected by looking up the signed distance
+       fields of the opponent geometries at the points sampled on the surface of the target link
+       instead of detecting the collisions with the collision detector. The fields are built when
+       the opponent links are added and they are shared by the blockers for the same geometries,
+       so the costs of the collision detection during a drag operation do not depend on the
+       complexity of the opponent geometries. An opponent whose field cannot be built is handled
+       by the collision detector. The default value is true. This must be set before adding the
+       opponent links.
+    */
+    void setDistanceFieldEnabled(bool on);
+
     void addOpponentLink(Link* link);
     void setDepth(double depth);
     void start();
@@ -16,17 +16,18 @@ using namespace cnoid;
 
 namespace {
 
-const bool SOLVE_CONSTRAINTS_BY_SR_INVERSE = false;
-const bool SOLVE_CONSTRAINTS_BY_SVD = !SOLVE_CONSTRAINTS_BY_SR_INVERSE;
-    
+const bool SOLVE_CONSTRAINTS_BY_SVD = false;
+
+// Damping added to the diagonal of S S^T so that the normal equation can be solved near singular postures
+const double constraintDamping = 1.0e-6;
+
+// The dimension of the target space is 3 or 6, so the matrices of that size are not allocated on the heap
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, 6, 6> TargetSpaceMatrix;
+
 double calcLU(int n, MatrixXd& a, vector<int>& pivots);
 void solveByLU(int n, MatrixXd& a, vector<int>& pivots, const MatrixXd::ColXpr& x, const VectorXd& b);
 bool makeInverseMatrix(int n, MatrixXd& org, MatrixXd& inv, double minValidDet);
 bool makePseudoInverseType1(int m, int n, const MatrixXd& J, MatrixXd& Jinv, MatrixXd& JJ, MatrixXd& JJinv, double minValidDet);
-bool makePseudoInverseType2(int m, int n, const MatrixXd& J, MatrixXd& Jinv, MatrixXd& JJ, MatrixXd& JJinv,
-                            const VectorXd& weights, double minValidDet);
-bool makeSRInverseMatrix(int m, int n, const MatrixXd& J, MatrixXd& Jinv, MatrixXd& JJ, MatrixXd& JJ2, MatrixXd& JJinv,
-                         vector<int>& pivots, double srk0, double srw0);
 }
 
 
@@ -46,11 +47,11 @@ public:
 
     // number of joints (body->numJoints())
     int NJ;
-            
+
     // dimension of joint space (this can includes elements of 6-DOF free root)
-    int N; 
+    int N;
     // dimension of target space. 3 means position only, 6 means position and orientation.
-    int M; 
+    int M;
 
     Link* baseLink;
     Link* targetLink;
@@ -63,47 +64,58 @@ public:
 
     MatrixXd J;       // Jacobian Matrix (M x N)
     MatrixXd Jinv;    // J^-1 (N x N) or pseudo inverse of J (N x M)
-            
-    // temporary matrix variables
-    MatrixXd JJ;      // (J^T * J) (N < M, N x N) or (J * J^T) (N > M, M x M)
+
+    // temporary matrix variables used when N < M
+    MatrixXd JJ;      // (J^T * J) (N x N)
     MatrixXd JJinv;   // JJ^-1
 
+    // temporary matrix variables used when N >= M
+    TargetSpaceMatrix JJw;    // (J * W^-1 * J^T) (M x M)
+    TargetSpaceMatrix JJwinv; // JJw^-1
+    Eigen::PartialPivLU<TargetSpaceMatrix> JJwLU;
+
     VectorXd dr_p; // d(x, y, z, w_x, w_y, w_z) / dt
-            
+
     double minValidDet;
 
-    // dimension of constrained variables (vector p_aux)
+    // dimension of constrained variables of the pins (vector p_aux)
     int C;
-            
+
+    // dimension of all the constrained variables including the joint range constraints
+    int Caux;
+
     // Matrices
     MatrixXd Jaux;       // Jacobian Matrix (C x N)
-    MatrixXd Jauxinv;    
-    MatrixXd W;       
-            
+    MatrixXd W;
+
     MatrixXd S;        // (C x N)
-    MatrixXd Sinv;    
-            
-    MatrixXd JJ2;    
-            
+    MatrixXd SS;       // S * S^T (C x C)
+    Eigen::LDLT<MatrixXd> SSLDLT;
+    VectorXd z;        // (S * S^T)^-1 * deltaPaux (size C)
+
     // Joint space vector to solve (size N)
     // This vector includes elements of 6-DOF root joint (dx, dy, dz, OmegaX, OmegaY, OmegaZ)
     // in the tail when root free model is enabled.
     VectorXd dq;
-            
+
     // weight of joint space vector (size N)
     // this includes 6-DOF root joint like dq
     VectorXd qWeights;
-            
+
     VectorXd y;   // size N
-            
-    vector<int> pivots;
-            
+
     bool isBaseLinkFreeMode;
     bool isTargetAttitudeEnabled;
 
+    // The joint paths and the matrix sizes are only updated when this flag is set
+    bool isStructureUpdateNeeded;
+
     LinkTraverse fkTraverse;
     shared_ptr<JointPath> targetJointPath;
-            
+
+    // Columns of the joint space which the target Jacobian depends on
+    vector<int> targetColumns;
+
     struct PinProperty {
         double weight;
         InverseKinematics::AxisSet axes;
@@ -114,12 +126,24 @@ public:
         Matrix3 prevStep_R;
         PinProperty() : jointPath(new JointPath()) { }
     };
-            
+
     typedef map<Link*, PinProperty> PinPropertyMap;
-            
+
     PinPropertyMap pinPropertyMap;
     vector<double> constraintWeightsSqrt; // size C
 
+    // The rows of the pins in the stacked Jacobian, which are cached between the initialize() calls
+    struct PinConstraint
+    {
+        Link* link;
+        PinProperty* property;
+        int row;
+        int size;
+        // Columns of the joint space which the rows of the pin depend on
+        vector<int> columns;
+    };
+    vector<PinConstraint> pinConstraints;
+
     struct JointConstrain
     {
         JointConstrain(int jointId, double dq) : jointId(jointId), dq(dq) { }
@@ -141,20 +165,23 @@ public:
     void setJointWeight(int jointId, double weight);
     void setPin(Link* link, InverseKinematics::AxisSet axes, double weight);
     InverseKinematics::AxisSet pinAxes(Link* link);
+    void clearPins();
     void setIKErrorThresh(double e);
     void setSRInverseParameters(double k0, double w0);
     void enableJointRangeConstraints(bool on);
     bool initialize();
-            
+    bool updateConstraintStructure();
+    void setColumns(vector<int>& columns, JointPath& jointPath);
+
     bool calcInverseKinematics(const Position& T);
-            
+
     IKStepResult calcOneStep(const Vector3& v, const Vector3& omega);
+    bool makeWeightedPseudoInverse();
     void solveConstraints();
     void setJacobianForOnePath(MatrixXd& J, int row, JointPath& jointPath, int axes);
     void setJacobianForFreeRoot(MatrixXd& J, int row, JointPath& jointPath, int axes);
     void addPinConstraints();
     void addJointRangeConstraints();
-    int solveLinearEquationWithSVD(MatrixXd& A, VectorXd& b, VectorXd& x, double sv_ratio);
 };
 }
 
@@ -173,17 +200,26 @@ PinDragIKImpl::PinDragIKImpl(Body* body)
 {
     M = 0;
     N = 0;
-    
+    C = 0;
+    Caux = 0;
+
     maxIteration = 50;
     //minValidDet = 1.0e-12;
     //minValidDet = 1.0e-5
     minValidDet = 1.0e-9;
-    
+
+    baseLink = nullptr;
+    targetLink = nullptr;
+    isBaseLinkFreeMode = false;
+    isTargetAttitudeEnabled = false;
+    isJointRangeConstraintsEnabled = false;
+    isStructureUpdateNeeded = true;
+
     setBaseLink(0);
     setTargetLink(0, false);
 
     qWeights.head(qWeights.size() - 6).fill(1.0);
-    
+
     setFreeRootWeight(30.0, 1.0);
 
     setIKErrorThresh(1.0e-5);
@@ -215,6 +251,8 @@ void PinDragIK::setBaseLink(Link* baseLink)
 //! if root is zero, root is virtual free 6-DOF link on the top link
 void PinDragIKImpl::setBaseLink(Link* baseLink)
 {
+    Link* prevBaseLink = this->baseLink;
+    bool wasBaseLinkFreeMode = isBaseLinkFreeMode;
     if(baseLink){
         this->baseLink = baseLink;
         isBaseLinkFreeMode = false;
@@ -222,6 +260,9 @@ void PinDragIKImpl::setBaseLink(Link* baseLink)
         this->baseLink = body_->rootLink();
         isBaseLinkFreeMode = true;
     }
+    if(this->baseLink != prevBaseLink || isBaseLinkFreeMode != wasBaseLinkFreeMode){
+        isStructureUpdateNeeded = true;
+    }
 }
 
 
@@ -248,6 +289,9 @@ void PinDragIK::setTargetLink(Link* targetLink, bool isAttitudeEnabled)
 
 void PinDragIKImpl::setTargetLink(Link* targetLink, bool isAttitudeEnabled)
 {
+    if(targetLink != this->targetLink || isAttitudeEnabled != isTargetAttitudeEnabled){
+        isStructureUpdateNeeded = true;
+    }
     this->targetLink = targetLink;
     isTargetAttitudeEnabled = isAttitudeEnabled;
     M = isAttitudeEnabled ? 6 : 3;
@@ -282,6 +326,7 @@ void PinDragIKImpl::setPin(Link* link, InverseKinematics::AxisSet axes, double w
             property.axes = axes;
             property.weight = weight;
         }
+        isStructureUpdateNeeded = true;
     }
 }
 
@@ -304,7 +349,14 @@ InverseKinematics::AxisSet PinDragIKImpl::pinAxes(Link* link)
 
 void PinDragIK::clearPins()
 {
-    impl->pinPropertyMap.clear();
+    impl->clearPins();
+}
+
+
+void PinDragIKImpl::clearPins()
+{
+    pinPropertyMap.clear();
+    isStructureUpdateNeeded = true;
 }
 
 
@@ -360,7 +412,10 @@ void PinDragIK::enableJointRangeConstraints(bool on)
 
 void PinDragIKImpl::enableJointRangeConstraints(bool on)
 {
-    isJointRangeConstraintsEnabled = on;
+    if(on != isJointRangeConstraintsEnabled){
+        isJointRangeConstraintsEnabled = on;
+        isStructureUpdateNeeded = true;
+    }
 }
 
 
@@ -376,22 +431,52 @@ bool PinDragIKImpl::initialize()
         return false;
     }
 
-    N = body_->numJoints();
-    
-    if(baseLink == targetLink){
+    if(baseLink == targetLink && !isBaseLinkFreeMode){
         isBaseLinkFreeMode = true;
+        isStructureUpdateNeeded = true;
+    }
+
+    if(pinPropertyMap.erase(targetLink) > 0){
+        isStructureUpdateNeeded = true;
+    }
+
+    if(isStructureUpdateNeeded){
+        if(!updateConstraintStructure()){
+            return false;
+        }
+    }
+
+    for(auto& pin : pinConstraints){
+        if(pin.property->axes & InverseKinematics::TRANSLATION_3D){
+            pin.property->p = pin.link->p();
+        }
+        if(pin.property->axes & InverseKinematics::ROTATION_3D){
+            pin.property->R = pin.link->R();
+        }
     }
+
+    return true;
+}
+
+
+/**
+   The joint paths, the rows of the pins and the sizes of the matrices only depend on the
+   settings, so they are kept while the same pins are dragged repeatedly.
+*/
+bool PinDragIKImpl::updateConstraintStructure()
+{
+    N = body_->numJoints();
     if(isBaseLinkFreeMode){
         N += 6;
     }
-    
-    targetJointPath = make_shared<JointPath>(baseLink, targetLink);
 
-    pinPropertyMap.erase(targetLink);
+    targetJointPath = make_shared<JointPath>(baseLink, targetLink);
+    setColumns(targetColumns, *targetJointPath);
 
     C = 0;
-
     constraintWeightsSqrt.clear();
+    pinConstraints.clear();
+
     PinPropertyMap::iterator p = pinPropertyMap.begin();
     while(p != pinPropertyMap.end()){
         Link* link = p->first;
@@ -401,68 +486,80 @@ bool PinDragIKImpl::initialize()
             return false;
         }
 
-        double weightSqrt = sqrt(property.weight);
-
+        PinConstraint pin;
+        pin.link = link;
+        pin.property = &property;
+        pin.row = C;
+        pin.size = 0;
         if(property.axes & InverseKinematics::TRANSLATION_3D){
-            property.p = link->p();
-            for(int i=0; i < 3; i++){
-                constraintWeightsSqrt.push_back(weightSqrt);
-            }
-            C += 3;
+            pin.size += 3;
         }
-
         if(property.axes & InverseKinematics::ROTATION_3D){
-            property.R = link->R();
-            for(int i=0; i < 3; i++){
-                constraintWeightsSqrt.push_back(weightSqrt);
-            }
-            C += 3;
+            pin.size += 3;
         }
+        setColumns(pin.columns, *property.jointPath);
+
+        double weightSqrt = sqrt(property.weight);
+        for(int i=0; i < pin.size; i++){
+            constraintWeightsSqrt.push_back(weightSqrt);
+        }
+        C += pin.size;
+
+        pinConstraints.push_back(std::move(pin));
         p++;
     }
 
     dq.resize(N);
     y.resize(N);
-    
+
     dr_p.resize(M);
 
-    J.resize(M, N);
-    Jinv.resize(N, M);
-    
-    J.setZero();
+    J.setZero(M, N);
+    Jinv.setZero(N, M);
 
-    jointConstraints.clear();
+    if(N < M){
+        JJ.resize(N, N);
+        JJinv.resize(N, N);
+    }
 
-    Jaux.resize(C, N);
-    Jauxinv.resize(N, C);
-    S.resize(C, N);
-    Sinv.resize(N, C);
+    jointConstraints.clear();
+    jointConstraints.reserve(NJ);
 
-    Jaux.setZero();
+    Jaux.setZero(C, N);
 
-    dPaux.resize(C);
-
-    int JJsize;
-    if(C <= N && M <= N){
-        JJsize = C > M ? C : M;
-    } else {
-        JJsize = N;
-    }
-
-    JJ.resize(JJsize, JJsize);
-    JJ2.resize(JJsize, JJsize);
-    JJinv.resize(JJsize, JJsize);
+    // The rows for the joint range constraints are also allocated here
+    const int maxCaux = isJointRangeConstraintsEnabled ? (C + NJ) : C;
+    S.resize(maxCaux, N);
+    dPaux.resize(maxCaux);
+    SS.resize(C, C);
+    z.resize(C);
+    SSLDLT = Eigen::LDLT<MatrixXd>(C);
+    Caux = C;
 
     W.resize(N, N);
-  
-    pivots.resize(C);  
 
     fkTraverse.find(baseLink, true, true);
 
+    isStructureUpdateNeeded = false;
+
     return true;
 }
 
 
+void PinDragIKImpl::setColumns(vector<int>& columns, JointPath& jointPath)
+{
+    columns.clear();
+    for(int i=0; i < jointPath.numJoints(); ++i){
+        columns.push_back(jointPath.joint(i)->jointId());
+    }
+    if(isBaseLinkFreeMode){
+        for(int i=0; i < 6; ++i){
+            columns.push_back(NJ + i);
+        }
+    }
+}
+
+
 bool PinDragIK::calcInverseKinematics(const Position& T)
 {
     return impl->calcInverseKinematics(T);
@@ -478,22 +575,20 @@ bool PinDragIKImpl::calcInverseKinematics(const Position& T)
         base_p_org = baseLink->p();
         base_R_org = baseLink->R();
     }
-    
-    for(PinPropertyMap::iterator p = pinPropertyMap.begin(); p != pinPropertyMap.end(); p++){
-        Link* link = p->first;
-        PinProperty& property = p->second;
-        property.prevStep_p = link->p();
-        property.prevStep_R = link->R();
+
+    for(auto& pin : pinConstraints){
+        pin.property->prevStep_p = pin.link->p();
+        pin.property->prevStep_R = pin.link->R();
     }
 
     IKStepResult result = (C > 0) ? PINS_CONVERGED : PINS_NOT_CONVERGED;
 
     int i;
     for(i=0; i < maxIteration; i++){
-        
+
         const Vector3 dp = T.translation() - targetLink->p();
         const Vector3 omega = targetLink->R() * omegaFromRot(targetLink->R().transpose() * T.linear());
-        
+
         if((dp.squaredNorm() + omega.squaredNorm()) < ikErrorSqrThresh && result == PINS_CONVERGED){
             break;
         }
@@ -531,7 +626,7 @@ PinDragIKImpl::IKStepResult PinDragIKImpl::calcOneStep(const Vector3& v, const V
 
     bool isOk;
     if(N >= M){
-        isOk = makePseudoInverseType2(M, N, J, Jinv, JJ, JJinv, qWeights, minValidDet);
+        isOk = makeWeightedPseudoInverse();
     } else {
         isOk = makePseudoInverseType1(M, N, J, Jinv, JJ, JJinv, minValidDet);
     }
@@ -559,13 +654,13 @@ PinDragIKImpl::IKStepResult PinDragIKImpl::calcOneStep(const Vector3& v, const V
     if(maxq > thresh){
         dq *= (thresh / maxq);
     }
-    
+
     for(int i=0; i < NJ; i++){
         body_->joint(i)->q() += dq[i];
     }
 
     if(isBaseLinkFreeMode){
-    
+
         base_p_org = baseLink->p();
         base_R_org = baseLink->R();
 
@@ -580,9 +675,9 @@ PinDragIKImpl::IKStepResult PinDragIKImpl::calcOneStep(const Vector3& v, const V
     fkTraverse.calcForwardKinematics();
 
     double maxErrorSqr = 0.0;
-    for(PinPropertyMap::iterator p = pinPropertyMap.begin(); p != pinPropertyMap.end(); p++){
-        Link* link = p->first;
-        PinProperty& property = p->second;
+    for(auto& pin : pinConstraints){
+        Link* link = pin.link;
+        PinProperty& property = *pin.property;
         double errsqr = 0.0;
         if(property.axes & InverseKinematics::TRANSLATION_3D){
             const Vector3 dp = property.prevStep_p - link->p();
@@ -596,16 +691,70 @@ PinDragIKImpl::IKStepResult PinDragIKImpl::calcOneStep(const Vector3& v, const V
         }
         maxErrorSqr = std::max(errsqr, maxErrorSqr);
     }
-    
+
     return (maxErrorSqr < ikErrorSqrThresh) ? PINS_CONVERGED : PINS_NOT_CONVERGED;
 }
 
 
+/**
+   Jinv = W^-1 * J^T * (J * W^-1 * J^T)^-1 for N >= M.
+   Only the columns of J on the target path are non-zero, so the other columns are skipped
+   and the corresponding rows of Jinv are kept zero.
+*/
+bool PinDragIKImpl::makeWeightedPseudoInverse()
+{
+    const int numColumns = targetColumns.size();
+
+    // JJw = J * W^-1 * J^T
+    JJw.setZero(M, M);
+    for(int i=0; i < numColumns; ++i){
+        const int col = targetColumns[i];
+        const double w = qWeights(col);
+        for(int j=0; j < M; ++j){
+            const double a = J(j, col) / w;
+            for(int k=0; k <= j; ++k){
+                JJw(j, k) += a * J(k, col);
+            }
+        }
+    }
+    for(int j=0; j < M; ++j){
+        for(int k=0; k < j; ++k){
+            JJw(k, j) = JJw(j, k);
+        }
+    }
+
+    JJwLU.compute(JJw);
+    const double det = JJwLU.determinant();
+    if(det <= minValidDet && det >= -minValidDet){
+        return false;
+    }
+    JJwinv = JJwLU.inverse();
+
+    for(int i=0; i < numColumns; ++i){
+        const int col = targetColumns[i];
+        const double w = qWeights(col);
+        for(int j=0; j < M; ++j){
+            double a = 0.0;
+            for(int k=0; k < M; ++k){
+                a += J(k, col) * JJwinv(k, j);
+            }
+            Jinv(col, j) = a / w;
+        }
+    }
+
+    return true;
+}
+
+
 void PinDragIKImpl::solveConstraints()
 {
     // W = (E - J# J)  (size N x N)
-    W.noalias() = MatrixXd::Identity(N, N) - Jinv * J;
-    
+    // Only the columns of J on the target path are non-zero
+    W.setIdentity();
+    for(auto col : targetColumns){
+        W.col(col).noalias() -= Jinv * J.col(col);
+    }
+
     // normalize W for weighted theta
     /*
       for(int i=0; i < N; i++){
@@ -625,15 +774,33 @@ void PinDragIKImpl::solveConstraints()
 
     addPinConstraints();
 
+    Caux = C;
     if(isJointRangeConstraintsEnabled){
         addJointRangeConstraints();
     }
 
-    // deltaPaux = dPaux - dPaux0, (dPaux0 = Jaux dq0)
-    dPaux.noalias() -= Jaux * dq;
-    VectorXd& deltaPaux = dPaux;
+    /*
+      S = Jaux W and deltaPaux = dPaux - dPaux0 (dPaux0 = Jaux dq0) are calculated with the
+      columns on the path of each pin because the other elements of Jaux are zero.
+    */
+    for(auto& pin : pinConstraints){
+        auto Spin = S.middleRows(pin.row, pin.size);
+        auto dPpin = dPaux.segment(pin.row, pin.size);
+        Spin.setZero();
+        for(auto col : pin.columns){
+            auto Jcol = Jaux.block(pin.row, col, pin.size, 1);
+            Spin.noalias() += Jcol * W.row(col);
+            dPpin.noalias() -= Jcol * dq[col];
+        }
+    }
+    for(int i = C; i < Caux; ++i){
+        const int jointId = jointConstraints[i - C].jointId;
+        S.row(i) = W.row(jointId);
+        dPaux[i] -= dq[jointId];
+    }
 
-    S.noalias() = Jaux * W;
+    auto Sa = S.topRows(Caux);
+    auto deltaPaux = dPaux.head(Caux);
 
     // normalize S and deltaPaux for weighted targets (weights of constraned positions)
     /*
@@ -646,12 +813,18 @@ void PinDragIKImpl::solveConstraints()
       }
     */
 
-    if(SOLVE_CONSTRAINTS_BY_SR_INVERSE){
-        makeSRInverseMatrix(C, N, S, Sinv, JJ, JJ2, JJinv, pivots, srk0, srw0);
-        y.noalias() = Sinv * deltaPaux;
+    if(SOLVE_CONSTRAINTS_BY_SVD){
+        y = Eigen::JacobiSVD<MatrixXd>(Sa, Eigen::ComputeThinU | Eigen::ComputeThinV).solve(deltaPaux);
 
-    } else if(SOLVE_CONSTRAINTS_BY_SVD){
-        y = Eigen::JacobiSVD<MatrixXd>(S, Eigen::ComputeThinU | Eigen::ComputeThinV).solve(deltaPaux);
+    } else {
+        // y = S^T (S S^T + kI)^-1 deltaPaux
+        SS.resize(Caux, Caux);
+        SS.noalias() = Sa * Sa.transpose();
+        SS.diagonal().array() += constraintDamping;
+        SSLDLT.compute(SS);
+        z.resize(Caux);
+        z = SSLDLT.solve(deltaPaux);
+        y.noalias() = Sa.transpose() * z;
     }
 
     // dq = dq0 + W y
@@ -661,7 +834,6 @@ void PinDragIKImpl::solveConstraints()
 
 void PinDragIKImpl::setJacobianForOnePath(MatrixXd& J, int row, JointPath& jointPath, int axes)
 {
-    int col;
     const int n = jointPath.numJoints();
 
     if(n > 0){
@@ -670,25 +842,21 @@ void PinDragIKImpl::setJacobianForOnePath(MatrixXd& J, int row, JointPath& joint
         for(int i=0; i < n; i++){
 
             Link* link = jointPath.joint(i);
-            col = link->jointId();
+            const int col = link->jointId();
 
             Vector3 omega(link->R() * link->a());
             if(!jointPath.isJointDownward(i)){
                 omega = -omega;
             }
-   
+
             int r = row;
             if(axes & InverseKinematics::TRANSLATION_3D){
-                const Vector3 dp = omega.cross(target->p() - link->p());
-                J(r++, col) = dp(0);
-                J(r++, col) = dp(1);
-                J(r++, col) = dp(2);
+                J.block<3, 1>(r, col) = omega.cross(target->p() - link->p());
+                r += 3;
             }
-    
+
             if(axes & InverseKinematics::ROTATION_3D){
-                J(r++, col) = omega(0);
-                J(r++, col) = omega(1);
-                J(r++, col) = omega(2);
+                J.block<3, 1>(r, col) = omega;
             }
         }
     }
@@ -711,7 +879,7 @@ void PinDragIKImpl::setJacobianForFreeRoot(MatrixXd& J, int row, JointPath& join
         for(int i=0; i < 3; i++){
             omega[i] = 1.0;
             const Vector3 dp = omega.cross(target->p() - baseLink->p());
-            
+
             for(int j=0; j < 3; j++){
                 if(j == i){
                     J(row + j, col + i) = 1.0;
@@ -722,7 +890,7 @@ void PinDragIKImpl::setJacobianForFreeRoot(MatrixXd& J, int row, JointPath& join
         }
         row += 3;
     }
-    
+
     if(axes & InverseKinematics::ROTATION_3D){
         for(int i=0; i < 3; i++){
             J(row + i, col + i + 3) = 1.0;
@@ -733,12 +901,11 @@ void PinDragIKImpl::setJacobianForFreeRoot(MatrixXd& J, int row, JointPath& join
 
 void PinDragIKImpl::addPinConstraints()
 {
-    int row = 0;
+    for(auto& pin : pinConstraints){
 
-    for(PinPropertyMap::iterator p = pinPropertyMap.begin(); p != pinPropertyMap.end(); p++){
-
-        Link* link = p->first;
-        PinProperty& property = p->second;
+        Link* link = pin.link;
+        PinProperty& property = *pin.property;
+        int row = pin.row;
 
         setJacobianForOnePath(Jaux, row, *property.jointPath, property.axes);
         if(isBaseLinkFreeMode){
@@ -746,26 +913,25 @@ void PinDragIKImpl::addPinConstraints()
         }
 
         if(property.axes & InverseKinematics::TRANSLATION_3D){
-            const Vector3 dp = property.p - link->p();
-            dPaux[row++] = dp[0];
-            dPaux[row++] = dp[1];
-            dPaux[row++] = dp[2];
+            dPaux.segment<3>(row) = property.p - link->p();
+            row += 3;
         }
-    
+
         if(property.axes & InverseKinematics::ROTATION_3D){
-            const Vector3 omega = link->R() * omegaFromRot(link->R().transpose() * property.R);
-            dPaux[row++] = omega[0];
-            dPaux[row++] = omega[1];
-            dPaux[row++] = omega[2];
+            dPaux.segment<3>(row) = link->R() * omegaFromRot(link->R().transpose() * property.R);
         }
     }
 }
 
 
+/**
+   The rows of the joint range constraints are placed after the rows of the pins.
+   These rows are not stored in Jaux because each of them only has the element of the joint.
+*/
 void PinDragIKImpl::addJointRangeConstraints()
 {
     jointConstraints.clear();
-    
+
     for(int i=0; i < NJ; ++i){
         Link* link = body_->joint(i);
         if(link->q() < link->q_lower()){
@@ -777,19 +943,11 @@ void PinDragIKImpl::addJointRangeConstraints()
 
     const int C2 = jointConstraints.size();
 
-    Jaux.conservativeResize(C + C2, N);
-    dPaux.conservativeResize(C + C2);
-    S.resize(C + C2, N);
-
     for(int i=0; i < C2; ++i){
-        int r = C + i;
-        for(int j=0; j < N; ++j){
-            Jaux(r, j) = 0.0;
-        }
-        JointConstrain& limit = jointConstraints[i];
-        Jaux(r, limit.jointId) = 1.0;
-        dPaux[r] = limit.dq;
+        dPaux[C + i] = jointConstraints[i].dq;
     }
+
+    Caux = C + C2;
 }
 
 
@@ -916,74 +1074,4 @@ bool makePseudoInverseType1
     return false;
 }
 
-
-// N > M
-bool makePseudoInverseType2
-(int m, int n, const MatrixXd& J, MatrixXd& Jinv, MatrixXd& JJ, MatrixXd& JJinv,
- const VectorXd& weights, double minValidDet)
-{
-    // JJ = J * W^-1 * J^T
-    for(int i=0; i < m; i++){
-        for(int j=0; j < m; j++){
-            JJ(i, j) = 0.0;
-            for(int k=0; k < n; k++){
-                JJ(i,j) += J(i,k) * (J(j,k) / weights(k));
-            }
-        }
-    }
-
-    // Jinv = W^-1 * J^T * (J * W^-1 * J^T)^-1
-    if(makeInverseMatrix(m, JJ, JJinv, minValidDet)){
-        for(int i=0; i < n; i++){
-            for(int j=0; j < m; j++){
-                Jinv(i,j) = 0.0;
-                for(int k=0; k < m; k++){
-                    Jinv(i,j) += J(k,i) * JJinv(k,j);
-                }
-                Jinv(i,j) /= weights(i);
-            }
-        }
-        return true;
-    }
-
-    return false;
-}
-
-
-// calculate J^T(J J^T + kI)^-1
-bool makeSRInverseMatrix
-(int m, int n, const MatrixXd& J, MatrixXd& Jinv, MatrixXd& JJ, MatrixXd& JJ2, MatrixXd& JJinv,
- vector<int>& pivots, double srk0, double srw0)
-{
-    // JJ = J J^T
-    JJ.noalias() = J * J.transpose();
-
-    JJ2 = JJ;
-    double det = calcLU(m, JJ2, pivots);
-    double w = sqrt(det);
-    
-    double k;
-    if(w < srw0){
-        double a = 1.0 - (w / srw0);
-        k = srk0 * a * a;
-        static int counter = 0;
-        cout << "srk0 enabled(" << counter++ << ")" << endl;
-    } else {
-        k = 0.0;
-    }
-    
-    // JJ' = JJ + kI
-    for(int i=0; i < m; i++){
-        JJ(i,i) += k;
-    }
-
-    // J^T JJ'^-1
-    if(makeInverseMatrix(m, JJ, JJinv, 0.0)){
-        Jinv.noalias() = J.transpose() * JJinv;
-        return true;
-    }
-    
-    return false;
-}
-
 }
@@ -42,6 +42,8 @@ public:
     /**
        this must be called before the initial calcInverseKinematics() call
        after settings have been changed.
+       The joint paths of the pins and the matrices are kept while the base link,
+       the target link and the pins are not changed.
     */
     bool initialize();
 
@@ -27,6 +27,12 @@ public:
     virtual void getJointPositions(std::vector< boost::optional<double> >& out_q) const = 0;
     virtual boost::optional<Vector3> ZMP() const = 0;
 
+    /**
+       Creates a provider which gives the same poses and can be used in another thread
+       independently of this provider. Null is returned if the provider does not support it.
+    */
+    virtual PoseProvider* clone() const { return nullptr; }
+
 #ifdef CNOID_BACKWARD_COMPATIBILITY
     bool getBaseLinkPosition(Vector3& out_p, Matrix3& out_R) const {
         Position T;
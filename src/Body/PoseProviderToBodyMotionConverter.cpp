@@ -9,14 +9,163 @@
 #include "BodyMotion.h"
 #include "ZMPSeq.h"
 #include "PoseProvider.h"
+#include <cnoid/ThreadPool>
+#include <memory>
+#include <thread>
+#include <chrono>
 
 using namespace std;
 using namespace cnoid;
 
+namespace {
+
+// The number of the frames processed between the calls of the progress callback
+const int PROGRESS_INTERVAL = 100;
+
+/**
+   The base link keeps the position given at the last frame where the provider specifies
+   the base link, so this state is carried over to the following frames.
+*/
+struct BaseLinkState
+{
+    int linkIndex;
+    Position T;
+};
+
+class FrameConverter
+{
+public:
+    Body* body;
+    PoseProvider* provider;
+    double frameRate;
+    MultiValueSeq& qseq;
+    MultiSE3Seq& pseq;
+    ZMPSeq& zmpseq;
+    bool allLinkPositionOutputMode;
+    int numJoints;
+    int numLinksToPut;
+    Link* baseLink;
+    std::shared_ptr<LinkTraverse> fkTraverse;
+    std::vector<boost::optional<double>> jointPositions;
+
+    FrameConverter(Body* body, PoseProvider* provider, BodyMotion& motion, bool allLinkPositionOutputMode);
+    void setBaseLinkState(const BaseLinkState& state);
+    void getBaseLinkState(BaseLinkState& out_state) const;
+    void setBaseLink(Link* link);
+    bool convertFrame(int frame);
+    void updateLinkPositions(int frame);
+};
+
+}
+
+
+FrameConverter::FrameConverter
+(Body* body, PoseProvider* provider, BodyMotion& motion, bool allLinkPositionOutputMode)
+    : body(body),
+      provider(provider),
+      frameRate(motion.frameRate()),
+      qseq(*motion.jointPosSeq()),
+      pseq(*motion.linkPosSeq()),
+      zmpseq(*getOrCreateZMPSeq(motion)),
+      allLinkPositionOutputMode(allLinkPositionOutputMode)
+{
+    numJoints = body->numJoints();
+    numLinksToPut = (allLinkPositionOutputMode ? body->numLinks() : 1);
+    jointPositions.resize(numJoints);
+
+    Link* rootLink = body->rootLink();
+    baseLink = rootLink;
+    if(allLinkPositionOutputMode){
+        fkTraverse = make_shared<LinkTraverse>(baseLink, true, true);
+    } else {
+        fkTraverse = make_shared<LinkPath>(baseLink, rootLink);
+    }
+}
+
+
+void FrameConverter::setBaseLinkState(const BaseLinkState& state)
+{
+    setBaseLink(body->link(state.linkIndex));
+    baseLink->T() = state.T;
+}
+
+
+void FrameConverter::getBaseLinkState(BaseLinkState& out_state) const
+{
+    out_state.linkIndex = baseLink->index();
+    out_state.T = baseLink->T();
+}
+
+
+void FrameConverter::setBaseLink(Link* link)
+{
+    if(link != baseLink){
+        baseLink = link;
+        if(allLinkPositionOutputMode){
+            fkTraverse->find(baseLink, true, true);
+        } else {
+            static_pointer_cast<LinkPath>(fkTraverse)->setPath(baseLink, body->rootLink());
+        }
+    }
+}
+
+
+/**
+   @return true if the provider specifies the base link at the frame
+*/
+bool FrameConverter::convertFrame(int frame)
+{
+    provider->seek(frame / frameRate);
+
+    const int baseLinkIndex = provider->baseLinkIndex();
+    if(baseLinkIndex >= 0){
+        setBaseLink(body->link(baseLinkIndex));
+        provider->getBaseLinkPosition(baseLink->T());
+    }
+
+    MultiValueSeq::Frame qs = qseq.frame(frame);
+    provider->getJointPositions(jointPositions);
+    for(int i=0; i < numJoints; ++i){
+        const boost::optional<double>& q = jointPositions[i];
+        qs[i] = q ? *q : 0.0;
+    }
+
+    updateLinkPositions(frame);
+
+    boost::optional<Vector3> zmp = provider->ZMP();
+    if(zmp){
+        zmpseq[frame] = *zmp;
+    }
+
+    return (baseLinkIndex >= 0);
+}
+
+
+void FrameConverter::updateLinkPositions(int frame)
+{
+    MultiValueSeq::Frame qs = qseq.frame(frame);
+    for(int i=0; i < numJoints; ++i){
+        body->joint(i)->q() = qs[i];
+    }
+    
+    if(allLinkPositionOutputMode || baseLink != body->rootLink()){
+        fkTraverse->calcForwardKinematics();
+    }
+
+    for(int i=0; i < numLinksToPut; ++i){
+        SE3& p = pseq(frame, i);
+        Link* link = body->link(i);
+        p.set(link->p(), link->R());
+    }
+}
+
+
 PoseProviderToBodyMotionConverter::PoseProviderToBodyMotionConverter()
 {
     setFullTimeRange();
     allLinkPositionOutputMode = true;
+    isParallelConversionEnabled = true;
+    maxNumThreads_ = 0;
 }
 
     
@@ -41,95 +190,159 @@ void PoseProviderToBodyMotionConverter::setAllLinkPositionOutput(bool on)
 }
 
 
+void PoseProviderToBodyMotionConverter::setParallelConversionEnabled(bool on)
+{
+    isParallelConversionEnabled = on;
+}
+
+
+void PoseProviderToBodyMotionConverter::setMaxNumThreads(int n)
+{
+    maxNumThreads_ = std::max(0, n);
+}
+
+
+int PoseProviderToBodyMotionConverter::maxNumThreads() const
+{
+    return maxNumThreads_;
+}
+
+
+void PoseProviderToBodyMotionConverter::setProgressCallback
+(std::function<bool(int numConvertedFrames, int numFrames)> callback)
+{
+    progressCallback = callback;
+}
+
+
 bool PoseProviderToBodyMotionConverter::convert(Body* body, PoseProvider* provider, BodyMotion& motion)
 {
     const double frameRate = motion.frameRate();
     const int beginningFrame = static_cast<int>(frameRate * std::max(provider->beginningTime(), lowerTime));
     const int endingFrame = static_cast<int>(frameRate * std::min(provider->endingTime(), upperTime));
+    const int numFrames = endingFrame - beginningFrame + 1;
     const int numJoints = body->numJoints();
     const int numLinksToPut = (allLinkPositionOutputMode ? body->numLinks() : 1);
     
     motion.setDimension(endingFrame + 1, numJoints, numLinksToPut, true);
 
-    MultiValueSeq& qseq = *motion.jointPosSeq();
-    MultiSE3Seq& pseq = *motion.linkPosSeq();
-    ZMPSeq& zmpseq = *getOrCreateZMPSeq(motion);
-    bool isZmpValid = false;
-
     Link* rootLink = body->rootLink();
-    Link* baseLink = rootLink;
-
-    std::shared_ptr<LinkTraverse> fkTraverse;
-    if(allLinkPositionOutputMode){
-        fkTraverse = make_shared<LinkTraverse>(baseLink, true, true);
-    } else {
-        fkTraverse = make_shared<LinkPath>(baseLink, rootLink);
-    }
 
     // store the original state
     vector<double> orgq(numJoints);
     for(int i=0; i < numJoints; ++i){
         orgq[i] = body->joint(i)->q();
     }
-    Vector3 p0 = rootLink->p();
-    Matrix3 R0 = rootLink->R();
+    const BaseLinkState initialState = { rootLink->index(), rootLink->T() };
 
-    std::vector< boost::optional<double> > jointPositions(numJoints);
-
-    for(int frame = beginningFrame; frame <= endingFrame; ++frame){
-
-        provider->seek(frame / frameRate);
-
-        const int baseLinkIndex = provider->baseLinkIndex();
-        if(baseLinkIndex >= 0){
-            if(baseLinkIndex != baseLink->index()){
-                baseLink = body->link(baseLinkIndex);
-                if(allLinkPositionOutputMode){
-                    fkTraverse->find(baseLink, true, true);
-                } else {
-                    static_pointer_cast<LinkPath>(fkTraverse)->setPath(baseLink, rootLink);
-                }
+    bool canceled = false;
+    
+    ThreadPool* threadPool = ThreadPool::instance();
+    int numTasks = std::min(threadPool->size(), numFrames / PROGRESS_INTERVAL);
+    if(maxNumThreads_ > 0){
+        numTasks = std::min(numTasks, maxNumThreads_);
+    }
+    vector<unique_ptr<PoseProvider>> clonedProviders;
+    if(isParallelConversionEnabled && numTasks >= 2){
+        for(int i=0; i < numTasks; ++i){
+            unique_ptr<PoseProvider> clonedProvider(provider->clone());
+            if(!clonedProvider){
+                clonedProviders.clear();
+                break;
             }
-            provider->getBaseLinkPosition(baseLink->T());
+            clonedProviders.push_back(std::move(clonedProvider));
         }
+    }
 
-        MultiValueSeq::Frame qs = qseq.frame(frame);
-        provider->getJointPositions(jointPositions);
-        for(int i=0; i < numJoints; ++i){
-            const boost::optional<double>& q = jointPositions[i];
-            qs[i] = q ? *q : 0.0;
-            body->joint(i)->q() = qs[i];
+    if(clonedProviders.empty()){
+        FrameConverter converter(body, provider, motion, allLinkPositionOutputMode);
+        for(int frame = beginningFrame; frame <= endingFrame; ++frame){
+            converter.convertFrame(frame);
+            const int numConvertedFrames = frame - beginningFrame + 1;
+            if(progressCallback && (numConvertedFrames % PROGRESS_INTERVAL == 0)){
+                if(!progressCallback(numConvertedFrames, numFrames)){
+                    canceled = true;
+                    break;
+                }
+            }
         }
+    } else {
+        /*
+          Each task converts the chunks with its own copies of the body and the provider.
+          A chunk is converted from the initial base link state, and the frames before the
+          first frame where the provider specifies the base link are corrected later with
+          the state carried over from the previous chunks.
+        */
+        const int chunkSize = std::max(PROGRESS_INTERVAL, numFrames / (numTasks * 4));
+        const int numChunks = (numFrames + chunkSize - 1) / chunkSize;
+        vector<int> firstBaseLinkFrames(numChunks);
+        vector<BaseLinkState> lastStates(numChunks);
+        std::atomic<int> chunkCounter(0);
+        std::atomic<int> numConvertedFrames(0);
+        std::atomic<bool> isCanceling(false);
 
-        if(allLinkPositionOutputMode || baseLink != rootLink){
-            fkTraverse->calcForwardKinematics();
+        ThreadPool::TaskGroup group(threadPool);
+        for(int i=0; i < numTasks; ++i){
+            BodyPtr clonedBody = body->clone();
+            PoseProvider* clonedProvider = clonedProviders[i].get();
+            group.run(
+                [&, clonedBody, clonedProvider](){
+                    FrameConverter converter(clonedBody, clonedProvider, motion, allLinkPositionOutputMode);
+                    int chunk;
+                    while((chunk = chunkCounter.fetch_add(1)) < numChunks && !isCanceling){
+                        const int chunkBegin = beginningFrame + chunk * chunkSize;
+                        const int chunkEnd = std::min(chunkBegin + chunkSize, endingFrame + 1);
+                        converter.setBaseLinkState(initialState);
+                        int firstBaseLinkFrame = chunkEnd;
+                        for(int frame = chunkBegin; frame < chunkEnd; ++frame){
+                            if(converter.convertFrame(frame) && firstBaseLinkFrame == chunkEnd){
+                                firstBaseLinkFrame = frame;
+                            }
+                        }
+                        firstBaseLinkFrames[chunk] = firstBaseLinkFrame;
+                        converter.getBaseLinkState(lastStates[chunk]);
+                        numConvertedFrames += chunkEnd - chunkBegin;
+                    }
+                });
         }
-
-        for(int i=0; i < numLinksToPut; ++i){
-            SE3& p = pseq(frame, i);
-            Link* link = body->link(i);
-            p.set(link->p(), link->R());
+        while(group.isRunning()){
+            if(progressCallback && !isCanceling){
+                if(!progressCallback(numConvertedFrames, numFrames)){
+                    isCanceling = true;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
         }
+        group.wait();
+        canceled = isCanceling;
 
-        boost::optional<Vector3> zmp = provider->ZMP();
-        if(zmp){
-            zmpseq[frame] = *zmp;
-            isZmpValid = true;
+        if(!canceled){
+            FrameConverter converter(body, provider, motion, allLinkPositionOutputMode);
+            BaseLinkState state = initialState;
+            for(int chunk=0; chunk < numChunks; ++chunk){
+                const int chunkBegin = beginningFrame + chunk * chunkSize;
+                const int firstBaseLinkFrame = firstBaseLinkFrames[chunk];
+                if(chunkBegin < firstBaseLinkFrame &&
+                   (state.linkIndex != initialState.linkIndex ||
+                    state.T.matrix() != initialState.T.matrix())){
+                    converter.setBaseLinkState(state);
+                    for(int frame = chunkBegin; frame < firstBaseLinkFrame; ++frame){
+                        converter.updateLinkPositions(frame);
+                    }
+                }
+                if(firstBaseLinkFrame < std::min(chunkBegin + chunkSize, endingFrame + 1)){
+                    state = lastStates[chunk];
+                }
+            }
         }
-
-    }
-
-    if(!isZmpValid){
-        //bodyMotionItem->clearRelativeZmpSeq();
     }
 
     // restore the original state
     for(int i=0; i < numJoints; ++i){
         body->joint(i)->q() = orgq[i];
     }
-    rootLink->p() = p0;
-    rootLink->R() = R0;
+    rootLink->T() = initialState.T;
     body->calcForwardKinematics();
 
-    return true;
+    return !canceled;
 }
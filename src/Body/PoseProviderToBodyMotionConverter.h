@@ -5,6 +5,7 @@
 #ifndef CNOID_BODY_POSE_PROVIDER_TO_BODY_MOTION_CONVERTER_H
 #define CNOID_BODY_POSE_PROVIDER_TO_BODY_MOTION_CONVERTER_H
 
+#include <functional>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -20,12 +21,38 @@ public:
     void setTimeRange(double lower, double upper);
     void setFullTimeRange();
     void setAllLinkPositionOutput(bool on);
+
+    /**
+       When this is enabled and the provider can be cloned, the frames are divided into chunks
+       which are converted in parallel with the copies of the body and the provider.
+       The output is the same as the one of the sequential conversion.
+       This is enabled by default.
+    */
+    void setParallelConversionEnabled(bool on);
+
+    /**
+       Set the maximum number of the tasks converting the chunks in parallel.
+       Zero means the number of the threads of the shared thread pool.
+    */
+    void setMaxNumThreads(int n);
+    int maxNumThreads() const;
+
+    /**
+       The callback is called in the thread calling convert() while the frames are converted.
+       The conversion is canceled when the callback returns false.
+    */
+    void setProgressCallback(std::function<bool(int numConvertedFrames, int numFrames)> callback);
+
+    //! \return false if the conversion is canceled
     bool convert(Body* body, PoseProvider* provider, BodyMotion& motion);
 
 private:
     double lowerTime;
     double upperTime;
     bool allLinkPositionOutputMode;
+    bool isParallelConversionEnabled;
+    int maxNumThreads_;
+    std::function<bool(int numConvertedFrames, int numFrames)> progressCallback;
 };
 
 }
@@ -31,6 +31,8 @@ public:
 
     const PointData& points() const { return *points_; }
     const PointData& constPoints() const { return *points_; }
+
+    //! The points are copied if they are shared. Use constPoints() to refer to them without copying.
     PointData& points();
     PointData& newPoints();
 
@@ -427,6 +427,18 @@ void SceneBody::updateLinkPositions(SgUpdate& update)
 }
 
 
+void SceneBody::updateLinkPositionsWithSingleNotification(SgUpdate& update)
+{
+    const int n = sceneLinks_.size();
+    for(int i=0; i < n; ++i){
+        SceneLinkPtr& sLink = sceneLinks_[i];
+        sLink->setRotation(sLink->link()->attitude());
+        sLink->setTranslation(sLink->link()->translation());
+    }
+    impl->sceneLinkGroup->notifyChildPositionsUpdate(update);
+}
+
+
 SceneDevice* SceneBody::getSceneDevice(Device* device)
 {
     const int linkIndex = device->link()->index();
@@ -72,6 +72,12 @@ public:
     void updateLinkPositions();
     void updateLinkPositions(SgUpdate& update);
 
+    /**
+       The update is only notified from this node instead of every scene link.
+       The bounding boxes of the scene links are invalidated without the notifications.
+    */
+    void updateLinkPositionsWithSingleNotification(SgUpdate& update);
+
     SceneDevice* getSceneDevice(Device* device);
     void setSceneDeviceUpdateConnection(bool on);
     void updateSceneDevices(double time);
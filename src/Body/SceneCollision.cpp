@@ -5,12 +5,16 @@
 
 #include "SceneCollision.h"
 #include <cnoid/SceneRenderer>
+#include <cnoid/MeshGenerator>
 
 using namespace std;
 using namespace cnoid;
 
 namespace {
 
+const double GlyphRadius = 0.003;
+const int DefaultMaxNumContactGlyphs = 10000;
+
 struct NodeTypeRegistration {
     NodeTypeRegistration() {
         SgNode::registerType<SceneCollision, SgLineSet>();
@@ -33,8 +37,19 @@ SceneCollision::SceneCollision(std::shared_ptr< std::vector<CollisionLinkPairPtr
     : SgLineSet(findPolymorphicId<SceneCollision>()),
       collisionPairs(collisionPairs)
 {
-    vertices_ = setVertices(new SgVertexArray);
-    setMaterial(new SgMaterial)->setDiffuseColor(Vector3f(0.0f, 1.0f, 0.0f));
+    // The glyph is a thin cylinder of the unit length along the Y axis, which is scaled for each contact
+    MeshGenerator meshGenerator;
+    meshGenerator.setDivisionNumber(6);
+    glyphShape = new SgShape;
+    glyphShape->setMesh(meshGenerator.generateCylinder(GlyphRadius, 1.0, false, false));
+    auto glyphMaterial = glyphShape->setMaterial(new SgMaterial);
+    glyphMaterial->setDiffuseColor(Vector3f::Zero());
+    glyphMaterial->setEmissiveColor(Vector3f(0.0f, 1.0f, 0.0f));
+    glyphTransform = new SgAffineTransform;
+    glyphTransform->addChild(glyphShape);
+
+    glyphLengthRatio = 0.0;
+    maxNumContactGlyphs_ = DefaultMaxNumContactGlyphs;
     isDirty = true;
 }
 
@@ -45,6 +60,60 @@ SceneCollision::SceneCollision(const SceneCollision&)
 }
 
 
+void SceneCollision::updateContacts()
+{
+    contacts.clear();
+
+    int numCollisions = 0;
+    for(auto& pair : *collisionPairs){
+        numCollisions += pair->collisions.size();
+    }
+    // The contacts are sampled at a regular interval when there are too many contacts
+    int interval = 1;
+    if(maxNumContactGlyphs_ > 0 && numCollisions > maxNumContactGlyphs_){
+        interval = (numCollisions + maxNumContactGlyphs_ - 1) / maxNumContactGlyphs_;
+    }
+    contacts.reserve(numCollisions / interval + 1);
+    
+    int counter = 0;
+    for(auto& pair : *collisionPairs){
+        // flip the line direction so that the line is always from the staic object to the dynamic one
+        double direction = 1.0;
+        if(pair->body[1] && pair->body[0]){
+            direction = (pair->body[1]->isStaticModel() && !pair->body[0]->isStaticModel()) ? -1.0 : 1.0;
+        }
+        for(auto& collision : pair->collisions){
+            if(counter++ % interval == 0){
+                contacts.emplace_back();
+                Contact& contact = contacts.back();
+                contact.point = collision.point;
+                contact.vector = (direction * collision.depth) * collision.normal;
+            }
+        }
+    }
+}
+
+
+void SceneCollision::updateGlyphPositions(double lengthRatio)
+{
+    glyphPositions.clear();
+    glyphPositions.reserve(contacts.size());
+    for(auto& contact : contacts){
+        const Vector3 v = lengthRatio * contact.vector;
+        const double length = v.norm();
+        if(length > 0.0){
+            glyphPositions.emplace_back();
+            Affine3& T = glyphPositions.back();
+            T.linear() =
+                Quaternion::FromTwoVectors(Vector3::UnitY(), v / length).toRotationMatrix() *
+                Eigen::Scaling(1.0, length, 1.0);
+            T.translation() = contact.point + v / 2.0;
+        }
+    }
+    glyphLengthRatio = lengthRatio;
+}
+
+
 void SceneCollision::render(SceneRenderer* renderer)
 {
     static const SceneRenderer::PropertyKey key("collisionLineRatio");
@@ -55,29 +124,16 @@ void SceneCollision::render(SceneRenderer* renderer)
     }
     
     if(isDirty){
-        vertices_->clear();
-        lineVertices().clear();
-        for(size_t i=0; i < collisionPairs->size(); ++i){
-            const CollisionLinkPair& pair = *(*collisionPairs)[i];
-            const vector<Collision>& cols = pair.collisions;
-
-            // flip the line direction so that the line is always from the staic object to the dynamic one
-            double direction = 1.0;
-            if(pair.body[1] && pair.body[0]){
-                direction = (pair.body[1]->isStaticModel() && !pair.body[0]->isStaticModel()) ? -1.0 : 1.0;
-            }
-
-            for(size_t j=0; j < cols.size(); ++j){
-                const Collision& c = cols[j];
-                const int index = vertices_->size();
-                addLine(index, index + 1);
-                vertices_->push_back(c.point.cast<float>());
-                vertices_->push_back((c.point + direction * collisionLineRatio * c.depth * c.normal).cast<float>());
-            }
-        }
-        vertices_->notifyUpdate();
+        updateContacts();
+        updateGlyphPositions(collisionLineRatio);
         isDirty = false;
+    } else if(collisionLineRatio != glyphLengthRatio){
+        updateGlyphPositions(collisionLineRatio);
+    }
+
+    for(auto& T : glyphPositions){
+        glyphTransform->setTransform(T);
+        renderer->renderCustomTransform(
+            glyphTransform, [&](){ renderer->renderNode(glyphShape); });
     }
-    
-    renderer->renderingFunctions()->dispatchAs<SgLineSet>(this);
 }
@@ -13,18 +13,42 @@ namespace cnoid {
 
 class SceneRenderer;
 
+/**
+   The contacts are rendered as the glyphs of a shared shape so that the renderer draws them
+   with an instanced draw call. The glyphs are only recalculated when the collisions are updated
+   or the length ratio of the renderer is changed.
+*/
 class CNOID_EXPORT SceneCollision : public SgLineSet
 {
 public:
     SceneCollision(std::shared_ptr<std::vector<CollisionLinkPairPtr>> collisionPairs);
     void setDirty() { isDirty = true; }
+
+    /**
+       The contacts are decimated to this number when there are more contacts.
+       Zero disables the decimation.
+    */
+    void setMaxNumContactGlyphs(int n) { maxNumContactGlyphs_ = n; isDirty = true; }
+    int maxNumContactGlyphs() const { return maxNumContactGlyphs_; }
+    
     void render(SceneRenderer* renderer);
 
 private:
     SceneCollision(const SceneCollision& org);
+    void updateContacts();
+    void updateGlyphPositions(double lengthRatio);
 
     std::shared_ptr<std::vector<CollisionLinkPairPtr>> collisionPairs;
-    SgVertexArrayPtr vertices_;
+    struct Contact {
+        Vector3 point;
+        Vector3 vector; // the normal scaled by the depth
+    };
+    std::vector<Contact> contacts;
+    std::vector<Affine3, Eigen::aligned_allocator<Affine3>> glyphPositions;
+    double glyphLengthRatio;
+    SgAffineTransformPtr glyphTransform;
+    SgShapePtr glyphShape;
+    int maxNumContactGlyphs_;
     bool isDirty;
 };
     
@@ -0,0 +1,764 @@
+/**
+   @file
+*/
+
+#include "SharedMemoryControllerChannel.h"
+#include "Body.h"
+#include "Link.h"
+#include "Device.h"
+#include "SimpleController.h"
+#include <cnoid/ConnectionSet>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <climits>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include <fmt/format.h>
+#include "gettext.h"
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+const uint32_t Magic = 0x434e4f53;
+const uint32_t Version = 1;
+const int MaxStringLength = 1024;
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "The atomic integers must be lock-free to be shared between processes");
+
+struct Header
+{
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> requestCounter;
+    std::atomic<uint32_t> responseCounter;
+    int32_t command;
+    int32_t result;
+    std::atomic<int32_t> simulatorPid;
+    std::atomic<int32_t> controllerPid;
+    std::atomic<int32_t> isClosed;
+    int32_t numLinks;
+    int32_t numDevices;
+    int32_t totalDeviceStateSize;
+    double timeStep;
+    double currentTime;
+    char bodyFilename[MaxStringLength];
+    char controllerFilename[MaxStringLength];
+    char controllerName[MaxStringLength];
+    char optionString[MaxStringLength];
+    char message[MaxStringLength];
+};
+
+// Link input: q, dq, ddq, u, p(3), R(9)
+enum { IN_Q, IN_DQ, IN_DDQ, IN_U, IN_P, IN_R = IN_P + 3, LinkInputSize = IN_R + 9 };
+
+// Link output: flags, mode, targets, q, dq, u, p(3), R(9), F_ext(6)
+enum { OUT_ENABLED, OUT_FORCE_ENABLED, OUT_MODE, OUT_Q_TARGET, OUT_DQ_TARGET, OUT_Q, OUT_DQ, OUT_U,
+       OUT_P, OUT_R = OUT_P + 3, OUT_F_EXT = OUT_R + 9, LinkOutputSize = OUT_F_EXT + 6 };
+
+size_t getAlignedSize(size_t size)
+{
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+void copyString(char* dest, const std::string& src)
+{
+    strncpy(dest, src.c_str(), MaxStringLength - 1);
+    dest[MaxStringLength - 1] = '\0';
+}
+
+void waitOnCounter(std::atomic<uint32_t>& counter, uint32_t value, int timeoutMsec)
+{
+#ifdef __linux__
+    struct timespec ts;
+    ts.tv_sec = timeoutMsec / 1000;
+    ts.tv_nsec = (timeoutMsec % 1000) * 1000000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&counter), FUTEX_WAIT, value, &ts, nullptr, 0);
+#else
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+}
+
+void wakeOnCounter(std::atomic<uint32_t>& counter)
+{
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&counter), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+bool isProcessAlive(int pid)
+{
+    return (pid <= 0) || (kill(pid, 0) == 0) || (errno != ESRCH);
+}
+
+}
+
+namespace cnoid {
+
+class SharedMemoryControllerChannelImpl
+{
+public:
+    string name;
+    string errorMessage;
+    bool isCreator;
+    int fd;
+    void* memory;
+    size_t memorySize;
+    Header* header;
+    double* linkInputs;
+    double* linkOutputs;
+    double* deviceInputCounters;
+    double* deviceInputStates;
+    double* deviceOutputCounters;
+    double* deviceOutputStates;
+    vector<int> deviceStateOffsets;
+    Body* body;
+    ScopedConnectionSet deviceConnections;
+    vector<bool> deviceStateChangeFlags;
+    vector<double> lastPeerDeviceCounters;
+    uint32_t lastRequestCounter;
+
+    // Used in the controller side
+    vector<int> linkInputStateTypes;
+    vector<bool> inputEnabledDeviceFlags;
+
+    SharedMemoryControllerChannelImpl();
+    ~SharedMemoryControllerChannelImpl();
+    static size_t calcMemorySize(int numLinks, int numDevices, int totalDeviceStateSize);
+    bool mapMemory(size_t size);
+    void setupPointers();
+    bool setBody(Body* body);
+    void close();
+    bool waitForCounterValue(
+        std::atomic<uint32_t>& counter, uint32_t value, bool isEqual, double timeout, std::atomic<int32_t>& peerPid);
+    int waitForRequest();
+    bool request(int command, double timeout);
+    void writeInput(double time);
+    void readInput(bool readsAllStates);
+    void writeOutput();
+    void readOutput(bool isOldTargetVariableMode);
+};
+
+}
+
+
+SharedMemoryControllerChannel::SharedMemoryControllerChannel()
+{
+    impl = new SharedMemoryControllerChannelImpl;
+}
+
+
+SharedMemoryControllerChannelImpl::SharedMemoryControllerChannelImpl()
+{
+    isCreator = false;
+    fd = -1;
+    memory = nullptr;
+    memorySize = 0;
+    header = nullptr;
+    body = nullptr;
+    lastRequestCounter = 0;
+}
+
+
+SharedMemoryControllerChannel::~SharedMemoryControllerChannel()
+{
+    delete impl;
+}
+
+
+SharedMemoryControllerChannelImpl::~SharedMemoryControllerChannelImpl()
+{
+    close();
+}
+
+
+size_t SharedMemoryControllerChannelImpl::calcMemorySize(int numLinks, int numDevices, int totalDeviceStateSize)
+{
+    size_t numValues =
+        numLinks * (LinkInputSize + LinkOutputSize) + 2 * (numDevices + totalDeviceStateSize);
+    return getAlignedSize(sizeof(Header)) + numValues * sizeof(double);
+}
+
+
+bool SharedMemoryControllerChannelImpl::mapMemory(size_t size)
+{
+    memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(memory == MAP_FAILED){
+        memory = nullptr;
+        errorMessage = fmt::format(_("The shared memory \"{0}\" cannot be mapped: {1}"), name, strerror(errno));
+        return false;
+    }
+    memorySize = size;
+    header = static_cast<Header*>(memory);
+    return true;
+}
+
+
+void SharedMemoryControllerChannelImpl::setupPointers()
+{
+    double* p = reinterpret_cast<double*>(static_cast<char*>(memory) + getAlignedSize(sizeof(Header)));
+    linkInputs = p;
+    p += header->numLinks * LinkInputSize;
+    linkOutputs = p;
+    p += header->numLinks * LinkOutputSize;
+    deviceInputCounters = p;
+    p += header->numDevices;
+    deviceInputStates = p;
+    p += header->totalDeviceStateSize;
+    deviceOutputCounters = p;
+    p += header->numDevices;
+    deviceOutputStates = p;
+}
+
+
+bool SharedMemoryControllerChannel::create(const std::string& name, Body* body)
+{
+    close();
+
+    impl->name = name;
+    impl->isCreator = true;
+
+    const int numDevices = body->numDevices();
+    int totalDeviceStateSize = 0;
+    for(int i=0; i < numDevices; ++i){
+        totalDeviceStateSize += body->device(i)->stateSize();
+    }
+    size_t size = impl->calcMemorySize(body->numLinks(), numDevices, totalDeviceStateSize);
+
+    impl->fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(impl->fd < 0){
+        impl->errorMessage = fmt::format(_("The shared memory \"{0}\" cannot be created: {1}"), name, strerror(errno));
+        return false;
+    }
+    if(ftruncate(impl->fd, size) != 0){
+        impl->errorMessage = fmt::format(_("The shared memory \"{0}\" cannot be allocated: {1}"), name, strerror(errno));
+        close();
+        return false;
+    }
+    if(!impl->mapMemory(size)){
+        close();
+        return false;
+    }
+
+    memset(impl->memory, 0, size);
+    Header* header = new(impl->memory) Header;
+    header->magic = Magic;
+    header->version = Version;
+    header->requestCounter = 0;
+    header->responseCounter = 0;
+    header->command = NO_COMMAND;
+    header->result = 0;
+    header->simulatorPid = getpid();
+    header->controllerPid = 0;
+    header->isClosed = 0;
+    header->numLinks = body->numLinks();
+    header->numDevices = numDevices;
+    header->totalDeviceStateSize = totalDeviceStateSize;
+    impl->setupPointers();
+
+    impl->setBody(body);
+
+    // The initial states of all the devices are given to the controller
+    impl->deviceStateChangeFlags.assign(numDevices, true);
+
+    return true;
+}
+
+
+bool SharedMemoryControllerChannel::open(const std::string& name)
+{
+    close();
+
+    impl->name = name;
+    impl->isCreator = false;
+
+    impl->fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if(impl->fd < 0){
+        impl->errorMessage = fmt::format(_("The shared memory \"{0}\" cannot be opened: {1}"), name, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if(fstat(impl->fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)){
+        impl->errorMessage = fmt::format(_("The shared memory \"{}\" is broken."), name);
+        close();
+        return false;
+    }
+    if(!impl->mapMemory(st.st_size)){
+        close();
+        return false;
+    }
+    Header* header = impl->header;
+    if(header->magic != Magic || header->version != Version ||
+       impl->calcMemorySize(header->numLinks, header->numDevices, header->totalDeviceStateSize) != impl->memorySize){
+        impl->errorMessage = fmt::format(_("The shared memory \"{}\" does not have the valid layout."), name);
+        close();
+        return false;
+    }
+    impl->setupPointers();
+    impl->lastRequestCounter = header->responseCounter.load(std::memory_order_acquire);
+    header->controllerPid.store(getpid(), std::memory_order_release);
+
+    return true;
+}
+
+
+void SharedMemoryControllerChannel::close()
+{
+    impl->close();
+}
+
+
+void SharedMemoryControllerChannelImpl::close()
+{
+    deviceConnections.disconnect();
+    body = nullptr;
+
+    if(header){
+        if(isCreator){
+            // Wakes the controller side waiting for a request to let it exit
+            header->isClosed.store(1, std::memory_order_release);
+            header->requestCounter.fetch_add(1, std::memory_order_release);
+            wakeOnCounter(header->requestCounter);
+        }
+        munmap(memory, memorySize);
+        memory = nullptr;
+        header = nullptr;
+    }
+    if(fd >= 0){
+        ::close(fd);
+        fd = -1;
+        if(isCreator){
+            shm_unlink(name.c_str());
+        }
+    }
+}
+
+
+bool SharedMemoryControllerChannel::isOpen() const
+{
+    return impl->header != nullptr;
+}
+
+
+const std::string& SharedMemoryControllerChannel::name() const
+{
+    return impl->name;
+}
+
+
+const std::string& SharedMemoryControllerChannel::errorMessage() const
+{
+    return impl->errorMessage;
+}
+
+
+void SharedMemoryControllerChannel::setBodyFilename(const std::string& filename)
+{
+    copyString(impl->header->bodyFilename, filename);
+}
+
+
+std::string SharedMemoryControllerChannel::bodyFilename() const
+{
+    return impl->header->bodyFilename;
+}
+
+
+void SharedMemoryControllerChannel::setControllerFilename(const std::string& filename)
+{
+    copyString(impl->header->controllerFilename, filename);
+}
+
+
+std::string SharedMemoryControllerChannel::controllerFilename() const
+{
+    return impl->header->controllerFilename;
+}
+
+
+void SharedMemoryControllerChannel::setControllerName(const std::string& name)
+{
+    copyString(impl->header->controllerName, name);
+}
+
+
+std::string SharedMemoryControllerChannel::controllerName() const
+{
+    return impl->header->controllerName;
+}
+
+
+void SharedMemoryControllerChannel::setOptionString(const std::string& option)
+{
+    copyString(impl->header->optionString, option);
+}
+
+
+std::string SharedMemoryControllerChannel::optionString() const
+{
+    return impl->header->optionString;
+}
+
+
+void SharedMemoryControllerChannel::setTimeStep(double timeStep)
+{
+    impl->header->timeStep = timeStep;
+}
+
+
+double SharedMemoryControllerChannel::timeStep() const
+{
+    return impl->header->timeStep;
+}
+
+
+double SharedMemoryControllerChannel::currentTime() const
+{
+    return impl->header->currentTime;
+}
+
+
+bool SharedMemoryControllerChannel::attachBody(Body* ioBody)
+{
+    Header* header = impl->header;
+    int totalDeviceStateSize = 0;
+    for(int i=0; i < ioBody->numDevices(); ++i){
+        totalDeviceStateSize += ioBody->device(i)->stateSize();
+    }
+    if(ioBody->numLinks() != header->numLinks || ioBody->numDevices() != header->numDevices ||
+       totalDeviceStateSize != header->totalDeviceStateSize){
+        impl->errorMessage = _("The body model of the controller does not match that of the simulation.");
+        return false;
+    }
+    impl->setBody(ioBody);
+    impl->deviceStateChangeFlags.assign(header->numDevices, false);
+    impl->linkInputStateTypes.assign(header->numLinks, 0);
+    impl->inputEnabledDeviceFlags.assign(header->numDevices, false);
+    return true;
+}
+
+
+bool SharedMemoryControllerChannelImpl::setBody(Body* body)
+{
+    this->body = body;
+
+    const int numDevices = body->numDevices();
+    deviceStateOffsets.resize(numDevices);
+    lastPeerDeviceCounters.assign(numDevices, 0.0);
+    deviceConnections.disconnect();
+    int offset = 0;
+    for(int i=0; i < numDevices; ++i){
+        Device* device = body->device(i);
+        deviceStateOffsets[i] = offset;
+        offset += device->stateSize();
+        deviceConnections.add(
+            device->sigStateChanged().connect(
+                [this, i](){ deviceStateChangeFlags[i] = true; }));
+    }
+    return true;
+}
+
+
+bool SharedMemoryControllerChannelImpl::waitForCounterValue
+(std::atomic<uint32_t>& counter, uint32_t value, bool isEqual, double timeout, std::atomic<int32_t>& peerPid)
+{
+    auto isSatisfied = [&](uint32_t current){ return (current == value) == isEqual; };
+
+    // The peer usually responds in a few microseconds
+    for(int i=0; i < 2000; ++i){
+        if(isSatisfied(counter.load(std::memory_order_acquire))){
+            return true;
+        }
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+    while(true){
+        uint32_t current = counter.load(std::memory_order_acquire);
+        if(isSatisfied(current)){
+            return true;
+        }
+        if(timeout > 0.0 && std::chrono::steady_clock::now() > deadline){
+            errorMessage = _("The controller process does not respond.");
+            return false;
+        }
+        // The process ID of the controller side is zero until it opens the channel
+        if(!isProcessAlive(peerPid.load(std::memory_order_acquire))){
+            errorMessage = _("The peer process has terminated.");
+            return false;
+        }
+        waitOnCounter(counter, current, 100);
+    }
+}
+
+
+bool SharedMemoryControllerChannel::request(int command, double timeout)
+{
+    return impl->request(command, timeout);
+}
+
+
+bool SharedMemoryControllerChannelImpl::request(int command, double timeout)
+{
+    header->command = command;
+    header->result = 0;
+    uint32_t counter = header->requestCounter.load(std::memory_order_relaxed) + 1;
+    header->requestCounter.store(counter, std::memory_order_release);
+    wakeOnCounter(header->requestCounter);
+
+    bool responded = waitForCounterValue(header->responseCounter, counter, true, timeout, header->controllerPid);
+    if(responded && !header->result && header->message[0]){
+        errorMessage = header->message;
+    }
+    return responded;
+}
+
+
+bool SharedMemoryControllerChannel::result() const
+{
+    return impl->header->result;
+}
+
+
+int SharedMemoryControllerChannel::waitForRequest()
+{
+    return impl->waitForRequest();
+}
+
+
+int SharedMemoryControllerChannelImpl::waitForRequest()
+{
+    if(!waitForCounterValue(header->requestCounter, lastRequestCounter, false, 0.0, header->simulatorPid)){
+        return SharedMemoryControllerChannel::NO_COMMAND;
+    }
+    lastRequestCounter = header->requestCounter.load(std::memory_order_acquire);
+    if(header->isClosed.load(std::memory_order_acquire)){
+        return SharedMemoryControllerChannel::NO_COMMAND;
+    }
+    return header->command;
+}
+
+
+void SharedMemoryControllerChannel::respond(bool result, const std::string& message)
+{
+    Header* header = impl->header;
+    header->result = result;
+    copyString(header->message, message);
+    header->responseCounter.store(impl->lastRequestCounter, std::memory_order_release);
+    wakeOnCounter(header->responseCounter);
+}
+
+
+void SharedMemoryControllerChannel::writeInput(double time)
+{
+    impl->writeInput(time);
+}
+
+
+void SharedMemoryControllerChannelImpl::writeInput(double time)
+{
+    header->currentTime = time;
+
+    const int numLinks = header->numLinks;
+    for(int i=0; i < numLinks; ++i){
+        const Link* link = body->link(i);
+        double* in = linkInputs + i * LinkInputSize;
+        in[IN_Q] = link->q();
+        in[IN_DQ] = link->dq();
+        in[IN_DDQ] = link->ddq();
+        in[IN_U] = link->u();
+        Eigen::Map<Vector3>(in + IN_P) = link->p();
+        Eigen::Map<Matrix3>(in + IN_R) = link->R();
+    }
+
+    const int numDevices = header->numDevices;
+    for(int i=0; i < numDevices; ++i){
+        if(deviceStateChangeFlags[i]){
+            body->device(i)->writeState(deviceInputStates + deviceStateOffsets[i]);
+            deviceInputCounters[i] += 1.0;
+            deviceStateChangeFlags[i] = false;
+        }
+    }
+}
+
+
+void SharedMemoryControllerChannel::enableInput(Link* link, int stateTypes)
+{
+    impl->linkInputStateTypes[link->index()] |= stateTypes;
+}
+
+
+void SharedMemoryControllerChannel::enableOutput(Link* link)
+{
+    impl->linkOutputs[link->index() * LinkOutputSize + OUT_ENABLED] = 1.0;
+}
+
+
+void SharedMemoryControllerChannel::enableForceOutput(Link* link)
+{
+    impl->linkOutputs[link->index() * LinkOutputSize + OUT_FORCE_ENABLED] = 1.0;
+}
+
+
+void SharedMemoryControllerChannel::enableInput(Device* device)
+{
+    impl->inputEnabledDeviceFlags[device->index()] = true;
+}
+
+
+void SharedMemoryControllerChannel::readInput(bool readsAllStates)
+{
+    impl->readInput(readsAllStates);
+}
+
+
+void SharedMemoryControllerChannelImpl::readInput(bool readsAllStates)
+{
+    const int numLinks = header->numLinks;
+    const int allTypes = ~0;
+    for(int i=0; i < numLinks; ++i){
+        const int types = readsAllStates ? allTypes : linkInputStateTypes[i];
+        if(types){
+            Link* link = body->link(i);
+            const double* in = linkInputs + i * LinkInputSize;
+            if(types & SimpleControllerIO::JOINT_DISPLACEMENT){
+                link->q() = in[IN_Q];
+            }
+            if(types & SimpleControllerIO::JOINT_VELOCITY){
+                link->dq() = in[IN_DQ];
+            }
+            if(types & SimpleControllerIO::JOINT_ACCELERATION){
+                link->ddq() = in[IN_DDQ];
+            }
+            if(types & SimpleControllerIO::JOINT_EFFORT){
+                link->u() = in[IN_U];
+            }
+            if(types & SimpleControllerIO::LINK_POSITION){
+                link->p() = Eigen::Map<const Vector3>(in + IN_P);
+                link->R() = Eigen::Map<const Matrix3>(in + IN_R);
+            }
+        }
+    }
+
+    const int numDevices = header->numDevices;
+    for(int i=0; i < numDevices; ++i){
+        if((readsAllStates || inputEnabledDeviceFlags[i]) && deviceInputCounters[i] != lastPeerDeviceCounters[i]){
+            lastPeerDeviceCounters[i] = deviceInputCounters[i];
+            Device* device = body->device(i);
+            device->readState(deviceInputStates + deviceStateOffsets[i]);
+            deviceConnections.block(i);
+            device->notifyStateChange();
+            deviceConnections.unblock(i);
+        }
+    }
+}
+
+
+void SharedMemoryControllerChannel::writeOutput()
+{
+    impl->writeOutput();
+}
+
+
+void SharedMemoryControllerChannelImpl::writeOutput()
+{
+    const int numLinks = header->numLinks;
+    for(int i=0; i < numLinks; ++i){
+        double* out = linkOutputs + i * LinkOutputSize;
+        if(out[OUT_ENABLED] != 0.0 || out[OUT_FORCE_ENABLED] != 0.0){
+            const Link* link = body->link(i);
+            out[OUT_MODE] = link->actuationMode();
+            out[OUT_Q_TARGET] = link->q_target();
+            out[OUT_DQ_TARGET] = link->dq_target();
+            out[OUT_Q] = link->q();
+            out[OUT_DQ] = link->dq();
+            out[OUT_U] = link->u();
+            Eigen::Map<Vector3>(out + OUT_P) = link->p();
+            Eigen::Map<Matrix3>(out + OUT_R) = link->R();
+            Eigen::Map<Vector6>(out + OUT_F_EXT) = link->F_ext();
+        }
+    }
+
+    const int numDevices = header->numDevices;
+    for(int i=0; i < numDevices; ++i){
+        if(deviceStateChangeFlags[i]){
+            body->device(i)->writeState(deviceOutputStates + deviceStateOffsets[i]);
+            deviceOutputCounters[i] += 1.0;
+            deviceStateChangeFlags[i] = false;
+        }
+    }
+}
+
+
+void SharedMemoryControllerChannel::applyActuationModes()
+{
+    const int numLinks = impl->header->numLinks;
+    for(int i=0; i < numLinks; ++i){
+        const double* out = impl->linkOutputs + i * LinkOutputSize;
+        if(out[OUT_ENABLED] != 0.0){
+            impl->body->link(i)->setActuationMode(static_cast<Link::ActuationMode>(static_cast<int>(out[OUT_MODE])));
+        }
+    }
+}
+
+
+void SharedMemoryControllerChannel::readOutput(bool isOldTargetVariableMode)
+{
+    impl->readOutput(isOldTargetVariableMode);
+}
+
+
+void SharedMemoryControllerChannelImpl::readOutput(bool isOldTargetVariableMode)
+{
+    const int numLinks = header->numLinks;
+    for(int i=0; i < numLinks; ++i){
+        const double* out = linkOutputs + i * LinkOutputSize;
+        if(out[OUT_ENABLED] != 0.0){
+            Link* link = body->link(i);
+            switch(static_cast<int>(out[OUT_MODE])){
+            case Link::JOINT_EFFORT:
+                link->u() = out[OUT_U];
+                break;
+            case Link::JOINT_DISPLACEMENT:
+                link->q_target() = isOldTargetVariableMode ? out[OUT_Q] : out[OUT_Q_TARGET];
+                break;
+            case Link::JOINT_VELOCITY:
+            case Link::JOINT_SURFACE_VELOCITY:
+                link->dq_target() = isOldTargetVariableMode ? out[OUT_DQ] : out[OUT_DQ_TARGET];
+                break;
+            case Link::LINK_POSITION:
+                link->p() = Eigen::Map<const Vector3>(out + OUT_P);
+                link->R() = Eigen::Map<const Matrix3>(out + OUT_R);
+                break;
+            default:
+                break;
+            }
+        }
+        if(out[OUT_FORCE_ENABLED] != 0.0){
+            body->link(i)->F_ext() += Eigen::Map<const Vector6>(out + OUT_F_EXT);
+        }
+    }
+
+    const int numDevices = header->numDevices;
+    for(int i=0; i < numDevices; ++i){
+        if(deviceOutputCounters[i] != lastPeerDeviceCounters[i]){
+            lastPeerDeviceCounters[i] = deviceOutputCounters[i];
+            Device* device = body->device(i);
+            device->readState(deviceOutputStates + deviceStateOffsets[i]);
+            deviceConnections.block(i);
+            device->notifyStateChange();
+            deviceConnections.unblock(i);
+        }
+    }
+}
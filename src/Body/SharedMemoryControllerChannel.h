@@ -0,0 +1,98 @@
+/**
+   @file
+*/
+
+#ifndef CNOID_BODY_SHARED_MEMORY_CONTROLLER_CHANNEL_H
+#define CNOID_BODY_SHARED_MEMORY_CONTROLLER_CHANNEL_H
+
+#include <string>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class Body;
+class Link;
+class Device;
+class SharedMemoryControllerChannelImpl;
+
+/**
+   The channel to run a simple controller in another process on the same host.
+   The states of the links and devices are exchanged through a POSIX shared memory segment
+   whose layout is fixed by the body model, and each step is synchronized by the sequence
+   counters in the segment. A waiting side spins for a while and then sleeps on the counter
+   with futex on Linux, so a step only adds a few microseconds when the controller responds
+   immediately. The simulator side detects the termination of the controller process while
+   it is waiting for a response.
+*/
+class CNOID_EXPORT SharedMemoryControllerChannel
+{
+public:
+    enum Command { NO_COMMAND = 0, INITIALIZE, START, CONTROL, STOP };
+
+    SharedMemoryControllerChannel();
+    ~SharedMemoryControllerChannel();
+
+    SharedMemoryControllerChannel(const SharedMemoryControllerChannel&) = delete;
+    SharedMemoryControllerChannel& operator=(const SharedMemoryControllerChannel&) = delete;
+
+    //! The segment is unlinked by close() or the destructor of the creator
+    bool create(const std::string& name, Body* body);
+    bool open(const std::string& name);
+    void close();
+    bool isOpen() const;
+    const std::string& name() const;
+    const std::string& errorMessage() const;
+
+    // The information given by the simulator side
+    void setBodyFilename(const std::string& filename);
+    std::string bodyFilename() const;
+    void setControllerFilename(const std::string& filename);
+    std::string controllerFilename() const;
+    void setControllerName(const std::string& name);
+    std::string controllerName() const;
+    void setOptionString(const std::string& option);
+    std::string optionString() const;
+    void setTimeStep(double timeStep);
+    double timeStep() const;
+    double currentTime() const;
+
+    /**
+       Functions for the simulator side.
+       The states of all the links and the changed devices of the body given to create()
+       are written by writeInput, and the outputs enabled by the controller are applied to
+       the body by readOutput.
+    */
+    void writeInput(double time);
+    /**
+       \return false if the controller process does not respond in the timeout or terminates.
+       The result of the command is given by result().
+    */
+    bool request(int command, double timeout);
+    bool result() const;
+    //! Sets the actuation modes of the links whose outputs are enabled by the controller
+    void applyActuationModes();
+    void readOutput(bool isOldTargetVariableMode = false);
+
+    /**
+       Functions for the controller side.
+       The body must be loaded from the same model as the body of the simulator side.
+    */
+    bool attachBody(Body* ioBody);
+    void enableInput(Link* link, int stateTypes);
+    void enableOutput(Link* link);
+    void enableForceOutput(Link* link);
+    void enableInput(Device* device);
+    //! Returns NO_COMMAND when the simulator side is closed
+    int waitForRequest();
+    //! The states of the links whose inputs are not enabled are also read when readsAllStates is true
+    void readInput(bool readsAllStates = false);
+    void writeOutput();
+    void respond(bool result, const std::string& message = std::string());
+
+private:
+    SharedMemoryControllerChannelImpl* impl;
+};
+
+}
+
+#endif
@@ -0,0 +1,193 @@
+/**
+   The process which runs a simple controller isolated from the simulator process.
+   The simulator side creates the shared memory channel and invokes this program
+   with the name of the channel.
+*/
+
+#include "SharedMemoryControllerChannel.h"
+#include "SimpleController.h"
+#include "BodyLoader.h"
+#include "Body.h"
+#include <iostream>
+#include <dlfcn.h>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+class HostIO : public SimpleControllerIO
+{
+public:
+    SharedMemoryControllerChannel& channel;
+    BodyPtr ioBody;
+
+    HostIO(SharedMemoryControllerChannel& channel, Body* body)
+        : channel(channel), ioBody(body) { }
+
+    virtual Body* body() override { return ioBody; }
+    virtual std::string optionString() const override { return channel.optionString(); }
+    virtual std::ostream& os() const override { return cout; }
+    virtual double timeStep() const override { return channel.timeStep(); }
+    virtual double currentTime() const override { return channel.currentTime(); }
+    virtual std::string controllerName() const override { return channel.controllerName(); }
+
+    virtual void enableIO(Link* link) override {
+        enableInput(link);
+        enableOutput(link);
+    }
+
+    virtual void enableInput(Link* link) override {
+        int types = 0;
+        switch(link->actuationMode()){
+        case Link::JOINT_EFFORT:
+        case Link::JOINT_SURFACE_VELOCITY:
+            types = JOINT_DISPLACEMENT;
+            break;
+        case Link::JOINT_DISPLACEMENT:
+        case Link::JOINT_VELOCITY:
+            types = JOINT_DISPLACEMENT | JOINT_EFFORT;
+            break;
+        case Link::LINK_POSITION:
+            types = LINK_POSITION;
+            break;
+        default:
+            break;
+        }
+        enableInput(link, types);
+    }
+
+    virtual void enableInput(Link* link, int stateTypes) override {
+        channel.enableInput(link, stateTypes);
+    }
+
+    virtual void enableOutput(Link* link) override {
+        channel.enableOutput(link);
+    }
+
+    virtual void enableOutput(Link* link, int stateTypes) override {
+        Link::ActuationMode mode = Link::NO_ACTUATION;
+        if(stateTypes & LINK_POSITION){
+            mode = Link::LINK_POSITION;
+        } else if(stateTypes & JOINT_DISPLACEMENT){
+            mode = Link::JOINT_DISPLACEMENT;
+        } else if(stateTypes & JOINT_VELOCITY){
+            mode = Link::JOINT_VELOCITY;
+        } else if(stateTypes & JOINT_EFFORT){
+            mode = Link::JOINT_EFFORT;
+        }
+        if(mode != Link::NO_ACTUATION){
+            link->setActuationMode(mode);
+            enableOutput(link);
+        }
+        if(stateTypes & LINK_FORCE){
+            channel.enableForceOutput(link);
+            enableInput(link, LINK_POSITION);
+        }
+    }
+
+    virtual void enableInput(Device* device) override {
+        channel.enableInput(device);
+    }
+};
+
+}
+
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2){
+        cerr << "Usage: " << argv[0] << " channel-name" << endl;
+        return 1;
+    }
+
+    SharedMemoryControllerChannel channel;
+    if(!channel.open(argv[1])){
+        cerr << channel.errorMessage() << endl;
+        return 1;
+    }
+
+    string errorMessage;
+    SimpleController* controller = nullptr;
+    void* module = nullptr;
+
+    BodyLoader loader;
+    loader.setMessageSink(cerr);
+    BodyPtr body = new Body;
+    if(!loader.load(body, channel.bodyFilename())){
+        errorMessage = "The body model \"" + channel.bodyFilename() + "\" cannot be loaded.";
+    } else if(!channel.attachBody(body)){
+        errorMessage = channel.errorMessage();
+    } else {
+        module = dlopen(channel.controllerFilename().c_str(), RTLD_NOW);
+        if(!module){
+            errorMessage = dlerror();
+        } else {
+            auto factory = (SimpleController::Factory)dlsym(module, "createSimpleController");
+            if(!factory){
+                errorMessage = "The factory function \"createSimpleController()\" is not found in the controller module.";
+            } else {
+                controller = factory();
+            }
+        }
+    }
+
+    HostIO io(channel, body);
+    SimpleControllerConfig config(&io);
+    if(controller && !controller->configure(&config)){
+        errorMessage = "The controller failed to configure itself.";
+        delete controller;
+        controller = nullptr;
+    }
+
+    bool isActive = true;
+    while(isActive){
+        int command = channel.waitForRequest();
+        switch(command){
+        case SharedMemoryControllerChannel::INITIALIZE:
+            if(!controller){
+                channel.respond(false, errorMessage);
+                isActive = false;
+            } else {
+                channel.readInput(true);
+                bool initialized = controller->initialize(&io);
+                channel.writeOutput();
+                channel.respond(initialized);
+            }
+            break;
+        case SharedMemoryControllerChannel::START:
+            channel.respond(controller && controller->start());
+            break;
+        case SharedMemoryControllerChannel::CONTROL:
+            if(controller){
+                channel.readInput();
+                bool result = controller->control();
+                channel.writeOutput();
+                channel.respond(result);
+            } else {
+                channel.respond(false);
+            }
+            break;
+        case SharedMemoryControllerChannel::STOP:
+            if(controller){
+                controller->stop();
+            }
+            channel.respond(true);
+            isActive = false;
+            break;
+        default:
+            isActive = false;
+            break;
+        }
+    }
+
+    delete controller;
+    // The body may refer to the objects defined in the controller module
+    body.reset();
+    channel.close();
+    if(module){
+        dlclose(module);
+    }
+
+    return 0;
+}
@@ -271,12 +271,17 @@ public:
     vector<BodyPtr> subBodies;
     bool isSubLoader;
 
+    // The sub-body files and the files read by the loaders of them
+    vector<string> dependentFiles;
+    bool areDependentFilesTracked;
+
     ostream* os_;
     ostream& os() { return *os_; }
     int defaultDivisionNumber;
     double defaultCreaseAngle;
     bool isVerbose;
     bool isShapeLoadingEnabled;
+    bool isVisualShapeLoadingEnabled;
 
     BodyHandlerManager bodyHandlerManager;
 
@@ -509,9 +514,11 @@ YAMLBodyLoaderImpl::YAMLBodyLoaderImpl(YAMLBodyLoader* self)
 
     body = nullptr;
     isSubLoader = false;
+    areDependentFilesTracked = false;
     os_ = &cout;
     isVerbose = false;
     isShapeLoadingEnabled = true;
+    isVisualShapeLoadingEnabled = true;
     defaultDivisionNumber = -1;
     defaultCreaseAngle = -1.0;
 }
@@ -537,6 +544,17 @@ void YAMLBodyLoader::setMessageSink(std::ostream& os)
 }
 
 
+bool YAMLBodyLoader::getDependentFiles(std::vector<std::string>& out_files) const
+{
+    if(!impl->areDependentFilesTracked){
+        return false;
+    }
+    out_files.insert(out_files.end(), impl->dependentFiles.begin(), impl->dependentFiles.end());
+    impl->sceneReader.getResourceFiles(out_files);
+    return true;
+}
+
+
 void YAMLBodyLoader::setVerbose(bool on)
 {
     impl->isVerbose = on;
@@ -549,6 +567,13 @@ void YAMLBodyLoader::setShapeLoadingEnabled(bool on)
 }
 
 
+void YAMLBodyLoader::setVisualShapeLoadingEnabled(bool on)
+{
+    impl->isVisualShapeLoadingEnabled = on;
+    impl->sceneReader.setAppearanceLoadingEnabled(on);
+}
+
+
 void YAMLBodyLoader::setDefaultDivisionNumber(int n)
 {
     impl->defaultDivisionNumber = n;
@@ -630,6 +655,8 @@ bool YAMLBodyLoaderImpl::clear()
     numValidJointIds = 0;
     subBodyMap.clear();
     subBodies.clear();
+    dependentFiles.clear();
+    areDependentFilesTracked = true;
     return true;
 }    
 
@@ -763,6 +790,7 @@ bool YAMLBodyLoaderImpl::loadAnotherFormatBodyFile(Mapping* topNode)
     bodyLoader->setMessageSink(os());
     bodyLoader->setVerbose(isVerbose);
     bodyLoader->setShapeLoadingEnabled(isShapeLoadingEnabled);
+    bodyLoader->setVisualShapeLoadingEnabled(isVisualShapeLoadingEnabled);
     bodyLoader->setDefaultCreaseAngle(defaultCreaseAngle);
 
     int dn = defaultDivisionNumber;
@@ -774,6 +802,11 @@ bool YAMLBodyLoaderImpl::loadAnotherFormatBodyFile(Mapping* topNode)
 
     bool loaded = bodyLoader->load(body, path.string());
 
+    dependentFiles.push_back(path.string());
+    if(!bodyLoader->getDependentFiles(dependentFiles)){
+        areDependentFilesTracked = false;
+    }
+
     if(loaded){
         auto linkInfo = topNode->findMapping("linkInfo");
         if(linkInfo->isValid()){
@@ -811,6 +844,7 @@ bool YAMLBodyLoaderImpl::readBody(Mapping* topNode)
     sceneReader.setBaseDirectory(mainFilePath.parent_path().string());
     sceneReader.setDefaultDivisionNumber(defaultDivisionNumber);
     sceneReader.readHeader(*topNode);
+    sceneReader.prefetchResources(*topNode);
 
     if(extract(topNode, "name", symbol)){
         body->setModelName(symbol);
@@ -1551,6 +1585,9 @@ bool YAMLBodyLoaderImpl::readVisualOrCollision(Mapping& node, bool isVisual)
             node.throwException(
                 _("The visual node is conflicting with the Collision node defined at the higher level"));
         }
+        if(!isVisualShapeLoadingEnabled){
+            return false;
+        }
         currentModelType = VISUAL;
     } else {
         if(currentModelType == VISUAL){
@@ -1866,10 +1903,13 @@ void YAMLBodyLoaderImpl::readSubBodyNode(Mapping* node)
                 subLoader->impl->isSubLoader = true;
             }
             subLoader->setDefaultDivisionNumber(sceneReader.defaultDivisionNumber());
+            subLoader->setVisualShapeLoadingEnabled(isVisualShapeLoadingEnabled);
                 
             subBody = new Body;
             if(subLoader->load(subBody, filename)){
                 subBodyMap[filename] = subBody;
+                dependentFiles.push_back(filename);
+                subLoader->getDependentFiles(dependentFiles);
             } else {
                 os() << format(_("SubBody specified by uri \"{}\" cannot be loaded."), uri) << endl;
                 subBody.reset();
@@ -27,9 +27,11 @@ public:
     virtual void setMessageSink(std::ostream& os) override;
     virtual void setVerbose(bool on) override;
     virtual void setShapeLoadingEnabled(bool on) override;
+    virtual void setVisualShapeLoadingEnabled(bool on) override;
     virtual void setDefaultDivisionNumber(int n) override;
     virtual void setDefaultCreaseAngle(double theta) override;
     virtual bool load(Body* body, const std::string& filename) override;
+    virtual bool getDependentFiles(std::vector<std::string>& out_files) const override;
 
     bool read(Body* body, Mapping* data);
 
@@ -149,7 +149,31 @@ extern "C" CNOID_EXPORT int luaopen_cnoid_Body(lua_State* L)
         "hasVirtualJointForces", &Body::hasVirtualJointForces,
         "setVirtualJointForces", &Body::setVirtualJointForces,
         "addCustomizerDirectory", &Body::addCustomizerDirectory,
-        "calcTotalMomentum", [](Body* self) { Vector3 P, L; self->calcTotalMomentum(P, L); return std::make_tuple(P, L); }
+        "calcTotalMomentum", [](Body* self) { Vector3 P, L; self->calcTotalMomentum(P, L); return std::make_tuple(P, L); },
+        "setLinkStateBufferEnabled", &Body::setLinkStateBufferEnabled,
+        "isLinkStateBufferEnabled", &Body::isLinkStateBufferEnabled,
+        /*
+          Returns the address of an array of the link state buffer as a light userdata so that
+          the array can be accessed with the FFI of LuaJIT, e.g. ffi.cast("double*", address).
+          The arrays are in the order of the link indices. "T" gives the column major 4x4
+          matrices, and "v", "w", "dv" and "dw" give the 3D vectors. The address becomes invalid
+          when the link tree is updated or the buffer is disabled.
+        */
+        "linkStateBufferAddress", [](Body* self, const std::string& element) -> void* {
+            if(!self->isLinkStateBufferEnabled()){
+                return nullptr;
+            }
+            Link* root = self->rootLink();
+            if(element == "q"){ return &root->q(); }
+            if(element == "dq"){ return &root->dq(); }
+            if(element == "ddq"){ return &root->ddq(); }
+            if(element == "T"){ return root->T().data(); }
+            if(element == "v"){ return root->v().data(); }
+            if(element == "w"){ return root->w().data(); }
+            if(element == "dv"){ return root->dv().data(); }
+            if(element == "dw"){ return root->dw().data(); }
+            return nullptr;
+        }
         );
     
     sol::stack::push(L, module);
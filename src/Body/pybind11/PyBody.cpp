@@ -8,11 +8,86 @@
 #include <cnoid/PyReferenced>
 #include <cnoid/PyEigenTypes>
 #include <pybind11/operators.h>
+#include <pybind11/numpy.h>
 
 using namespace std;
 using namespace cnoid;
 namespace py = pybind11;
 
+namespace {
+
+typedef py::array_t<double, py::array::c_style | py::array::forcecast> InputArray;
+
+template<class Accessor>
+py::array_t<double> getJointValues(Body& body, Accessor get)
+{
+    const int n = body.numJoints();
+    py::array_t<double> values(n);
+    auto r = values.mutable_unchecked<1>();
+    for(int i=0; i < n; ++i){
+        r(i) = get(body.joint(i));
+    }
+    return values;
+}
+
+template<class Accessor>
+void setJointValues(Body& body, InputArray values, Accessor get)
+{
+    const int n = body.numJoints();
+    if(values.ndim() != 1 || values.shape(0) != n){
+        throw py::value_error("The size of the array must be the number of the joints");
+    }
+    auto r = values.unchecked<1>();
+    for(int i=0; i < n; ++i){
+        get(body.joint(i)) = r(i);
+    }
+}
+
+/**
+   The returned array refers to the link state buffer of the body without copying it,
+   and the array keeps the Python object of the body alive. The array becomes invalid
+   when the link tree is updated or the buffer is disabled.
+*/
+py::array_t<double> getLinkStateView(py::object pyBody, const string& element)
+{
+    Body* body = pyBody.cast<Body*>();
+    if(!body->isLinkStateBufferEnabled()){
+        throw py::value_error("The link state buffer of the body is not enabled");
+    }
+    const py::ssize_t n = body->numLinks();
+    Link* link = body->rootLink();
+    const py::ssize_t d = sizeof(double);
+
+    if(element == "q"){
+        return py::array_t<double>({ n }, { d }, &link->q(), pyBody);
+    } else if(element == "dq"){
+        return py::array_t<double>({ n }, { d }, &link->dq(), pyBody);
+    } else if(element == "ddq"){
+        return py::array_t<double>({ n }, { d }, &link->ddq(), pyBody);
+    } else if(element == "T"){
+        // Position is a column major 4x4 matrix
+        return py::array_t<double>(
+            { n, (py::ssize_t)4, (py::ssize_t)4 }, { (py::ssize_t)sizeof(Position), d, 4 * d },
+            link->T().data(), pyBody);
+    }
+    const py::ssize_t vs = sizeof(Vector3);
+    const double* data = nullptr;
+    if(element == "v"){
+        data = link->v().data();
+    } else if(element == "w"){
+        data = link->w().data();
+    } else if(element == "dv"){
+        data = link->dv().data();
+    } else if(element == "dw"){
+        data = link->dw().data();
+    } else {
+        throw py::value_error("Unknown link state element: " + element);
+    }
+    return py::array_t<double>({ n, (py::ssize_t)3 }, { vs, d }, data, pyBody);
+}
+
+}
+
 namespace cnoid {
 
 void exportPyBody(py::module& m)
@@ -54,9 +129,28 @@ void exportPyBody(py::module& m)
             self.calcTotalMomentum(P, L);
             return py::make_tuple(P, L);
             })
-        .def("calcForwardKinematics", &Body::calcForwardKinematics)
+        .def("calcForwardKinematics", (void(Body::*)(bool, bool)) &Body::calcForwardKinematics)
         .def("calcForwardKinematics", [](Body& self, bool calcVelocity){ self.calcForwardKinematics(calcVelocity); })
         .def("calcForwardKinematics", [](Body& self){ self.calcForwardKinematics(); })
+        .def("setLinkStateBufferEnabled", &Body::setLinkStateBufferEnabled)
+        .def("isLinkStateBufferEnabled", &Body::isLinkStateBufferEnabled)
+        .def("linkStateView", &getLinkStateView)
+        .def("jointPositions", [](Body& self){
+                return getJointValues(self, [](Link* joint) -> double { return joint->q(); }); })
+        .def("setJointPositions", [](Body& self, InputArray q){
+                setJointValues(self, q, [](Link* joint) -> double& { return joint->q(); }); })
+        .def("jointVelocities", [](Body& self){
+                return getJointValues(self, [](Link* joint) -> double { return joint->dq(); }); })
+        .def("setJointVelocities", [](Body& self, InputArray dq){
+                setJointValues(self, dq, [](Link* joint) -> double& { return joint->dq(); }); })
+        .def("jointAccelerations", [](Body& self){
+                return getJointValues(self, [](Link* joint) -> double { return joint->ddq(); }); })
+        .def("setJointAccelerations", [](Body& self, InputArray ddq){
+                setJointValues(self, ddq, [](Link* joint) -> double& { return joint->ddq(); }); })
+        .def("jointTorques", [](Body& self){
+                return getJointValues(self, [](Link* joint) -> double { return joint->u(); }); })
+        .def("setJointTorques", [](Body& self, InputArray u){
+                setJointValues(self, u, [](Link* joint) -> double& { return joint->u(); }); })
         .def("clearExternalForces", &Body::clearExternalForces)
         .def_property_readonly("numExtraJoints", &Body::numExtraJoints)
         .def("clearExtraJoints", &Body::clearExtraJoints)
@@ -19,6 +19,7 @@ namespace cnoid {
 void exportPyBody(py::module& m);
 void exportPyLink(py::module& m);
 void exportPyDeviceTypes(py::module& m);
+void exportPyDyWorldBatch(py::module& m);
 
 }
 
@@ -31,6 +32,7 @@ PYBIND11_MODULE(Body, m)
     exportPyBody(m);
     exportPyLink(m);
     exportPyDeviceTypes(m);
+    exportPyDyWorldBatch(m);
 
     py::class_<AbstractBodyLoader>(m, "AbstractBodyLoader")
         .def("setVerbose", &AbstractBodyLoader::setVerbose)
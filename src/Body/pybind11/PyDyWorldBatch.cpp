@@ -0,0 +1,55 @@
+/*!
+  @file
+*/
+
+#include "../DyWorldBatch.h"
+#include "../DyBody.h"
+#include <cnoid/PyEigenTypes>
+
+using namespace std;
+using namespace cnoid;
+namespace py = pybind11;
+
+namespace cnoid {
+
+void exportPyDyWorldBatch(py::module& m)
+{
+    typedef py::call_guard<py::gil_scoped_release> release_gil;
+
+    py::class_<DyWorldBatch>(m, "DyWorldBatch")
+        .def(py::init<>())
+        .def("addBody", &DyWorldBatch::addBody,
+             py::arg("body"), py::arg("isSelfCollisionDetectionEnabled") = false)
+        .def("clearBodies", &DyWorldBatch::clearBodies)
+        .def_property_readonly("numBodies", &DyWorldBatch::numBodies)
+        .def_property("timeStep", &DyWorldBatch::timeStep, &DyWorldBatch::setTimeStep)
+        .def("setTimeStep", &DyWorldBatch::setTimeStep)
+        .def("setGravityAcceleration", &DyWorldBatch::setGravityAcceleration)
+        .def("setEulerMethod", &DyWorldBatch::setEulerMethod)
+        .def("setRungeKuttaMethod", &DyWorldBatch::setRungeKuttaMethod)
+        .def("setFriction", &DyWorldBatch::setFriction)
+        .def("createWorlds", &DyWorldBatch::createWorlds, release_gil())
+        .def_property_readonly("numWorlds", &DyWorldBatch::numWorlds)
+        .def_property_readonly("numJoints", &DyWorldBatch::numJoints)
+        .def("body", [](DyWorldBatch& self, int worldIndex, int bodyIndex) -> Body* {
+                return self.body(worldIndex, bodyIndex); })
+        .def("currentTime", &DyWorldBatch::currentTime)
+        .def("setJointTorques", &DyWorldBatch::setJointTorques)
+        .def("step", (void(DyWorldBatch::*)()) &DyWorldBatch::step, release_gil())
+        .def("step", (void(DyWorldBatch::*)(const MatrixXd&)) &DyWorldBatch::step, release_gil())
+        .def("reset", &DyWorldBatch::reset)
+        .def("resetAll", &DyWorldBatch::resetAll, release_gil())
+        .def("jointStates", [](DyWorldBatch& self){
+                MatrixXd q, dq;
+                self.getJointStates(q, dq);
+                return py::make_tuple(q, dq);
+            })
+        .def("rootStates", [](DyWorldBatch& self){
+                MatrixXd states;
+                self.getRootStates(states);
+                return states;
+            })
+        ;
+}
+
+}
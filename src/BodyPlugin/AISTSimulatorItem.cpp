@@ -45,11 +45,55 @@ namespace {
 const bool TRACE_FUNCTIONS = false;
 const bool ENABLE_DEBUG_OUTPUT = false;
 const double DEFAULT_GRAVITY_ACCELERATION = 9.80665;
+const double DEFAULT_SLEEPING_LINEAR_VELOCITY = 0.01;
+const double DEFAULT_SLEEPING_ANGULAR_VELOCITY = 0.05;
+const double DEFAULT_SLEEPING_TIME = 0.5;
+const double DEFAULT_MIN_SUB_TIME_STEP = 0.0001;
+const double DEFAULT_SUB_STEP_ERROR_TOLERANCE = 0.001;
+
+/**
+   The internal variables of the dynamics computation carried over to the next step.
+   The basic link states are stored by SimulatorItem.
+*/
+class DyLinkState
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Vector3 vo, dvo, sw, sv, cv, cw;
+    Matrix3 Iww, Iwv, Ivv;
+    Vector3 pf, ptau, hhv, hhw;
+    double uu, dd;
+
+    void store(const DyLink* link){
+        vo = link->vo(); dvo = link->dvo(); sw = link->sw(); sv = link->sv(); cv = link->cv(); cw = link->cw();
+        Iww = link->Iww(); Iwv = link->Iwv(); Ivv = link->Ivv();
+        pf = link->pf(); ptau = link->ptau(); hhv = link->hhv(); hhw = link->hhw();
+        uu = link->uu(); dd = link->dd();
+    }
+    void restore(DyLink* link) const {
+        link->vo() = vo; link->dvo() = dvo; link->sw() = sw; link->sv() = sv; link->cv() = cv; link->cw() = cw;
+        link->Iww() = Iww; link->Iwv() = Iwv; link->Ivv() = Ivv;
+        link->pf() = pf; link->ptau() = ptau; link->hhv() = hhv; link->hhw() = hhw;
+        link->uu() = uu; link->dd() = dd;
+    }
+};
+
+class AISTEngineState : public Referenced
+{
+public:
+    double time;
+    vector<vector<DyLinkState, Eigen::aligned_allocator<DyLinkState>>> bodyLinkStates;
+    ReferencedPtr constraintForceSolverState;
+};
+typedef ref_ptr<AISTEngineState> AISTEngineStatePtr;
+
 
 class AISTSimBody : public SimulationBody
 {
 public:
-    AISTSimBody(DyBody* body) : SimulationBody(body) { }
+    AISTSimBody(DyBody* body) : SimulationBody(body), bodyIndex(-1) { }
+    int bodyIndex;
 };
     
 
@@ -95,14 +139,24 @@ public:
     double dynamicFriction;
     FloatingNumberString contactCullingDistance;
     FloatingNumberString contactCullingDepth;
+    int maxNumContactPoints;
     FloatingNumberString errorCriterion;
     int maxNumIterations;
+    int numConstraintSolverThreads;
+    bool isParallelForwardDynamicsEnabled;
+    bool isAdaptiveTimeStepEnabled;
+    double minSubTimeStep;
+    double subStepErrorTolerance;
     FloatingNumberString contactCorrectionDepth;
     FloatingNumberString contactCorrectionVelocityRatio;
     double epsilon;
     bool is2Dmode;
     bool isKinematicWalkingEnabled;
     bool isOldAccelSensorMode;
+    bool isBodySleepingEnabled;
+    double sleepingLinearVelocity;
+    double sleepingAngularVelocity;
+    double sleepingTime;
 
     typedef std::map<Body*, int> BodyIndexMap;
     BodyIndexMap bodyIndexMap;
@@ -110,6 +164,9 @@ public:
     typedef std::map<Link*, Link*> LinkMap;
     LinkMap orgLinkToInternalLinkMap;
 
+    AISTSimulatorItem::SolverStatistics solverStatistics;
+    mutable std::mutex solverStatisticsMutex;
+
     boost::optional<int> forcedBodyPositionFunctionId;
     std::mutex forcedBodyPositionMutex;
     DyBody* forcedPositionBody;
@@ -120,7 +177,12 @@ public:
     bool initializeSimulation(const std::vector<SimulationBody*>& simBodies);
     void addBody(AISTSimBody* simBody);
     void clearExternalForces();
+    ReferencedPtr storeEngineState();
+    bool restoreEngineState(Referenced* state);
     void stepKinematicsSimulation(const std::vector<SimulationBody*>& activeSimBodies);
+    void clearSolverStatistics();
+    void updateSolverStatistics();
+    void updateRestingStates(const std::vector<SimulationBody*>& activeSimBodies);
     void setForcedPosition(BodyItem* bodyItem, const Position& T);
     void doSetForcedPosition();
     void doPutProperties(PutPropertyFunction& putProperty);
@@ -169,16 +231,26 @@ AISTSimulatorItemImpl::AISTSimulatorItemImpl(AISTSimulatorItem* self)
     dynamicFriction = cfs.slipFriction();
     contactCullingDistance = cfs.contactCullingDistance();
     contactCullingDepth = cfs.contactCullingDepth();
+    maxNumContactPoints = cfs.maxNumContactPoints();
     epsilon = cfs.coefficientOfRestitution();
     
     errorCriterion = cfs.gaussSeidelErrorCriterion();
     maxNumIterations = cfs.gaussSeidelMaxNumIterations();
+    numConstraintSolverThreads = cfs.numThreads();
+    isParallelForwardDynamicsEnabled = false;
+    isAdaptiveTimeStepEnabled = false;
+    minSubTimeStep = DEFAULT_MIN_SUB_TIME_STEP;
+    subStepErrorTolerance = DEFAULT_SUB_STEP_ERROR_TOLERANCE;
     contactCorrectionDepth = cfs.contactCorrectionDepth();
     contactCorrectionVelocityRatio = cfs.contactCorrectionVelocityRatio();
 
     isKinematicWalkingEnabled = false;
     is2Dmode = false;
     isOldAccelSensorMode = false;
+    isBodySleepingEnabled = false;
+    sleepingLinearVelocity = DEFAULT_SLEEPING_LINEAR_VELOCITY;
+    sleepingAngularVelocity = DEFAULT_SLEEPING_ANGULAR_VELOCITY;
+    sleepingTime = DEFAULT_SLEEPING_TIME;
 }
 
 
@@ -200,14 +272,24 @@ AISTSimulatorItemImpl::AISTSimulatorItemImpl(AISTSimulatorItem* self, const AIST
     dynamicFriction = org.dynamicFriction;
     contactCullingDistance = org.contactCullingDistance;
     contactCullingDepth = org.contactCullingDepth;
+    maxNumContactPoints = org.maxNumContactPoints;
     errorCriterion = org.errorCriterion;
     maxNumIterations = org.maxNumIterations;
+    numConstraintSolverThreads = org.numConstraintSolverThreads;
+    isParallelForwardDynamicsEnabled = org.isParallelForwardDynamicsEnabled;
+    isAdaptiveTimeStepEnabled = org.isAdaptiveTimeStepEnabled;
+    minSubTimeStep = org.minSubTimeStep;
+    subStepErrorTolerance = org.subStepErrorTolerance;
     contactCorrectionDepth = org.contactCorrectionDepth;
     contactCorrectionVelocityRatio = org.contactCorrectionVelocityRatio;
     epsilon = org.epsilon;
     isKinematicWalkingEnabled = org.isKinematicWalkingEnabled;
     is2Dmode = org.is2Dmode;
     isOldAccelSensorMode = org.isOldAccelSensorMode;
+    isBodySleepingEnabled = org.isBodySleepingEnabled;
+    sleepingLinearVelocity = org.sleepingLinearVelocity;
+    sleepingAngularVelocity = org.sleepingAngularVelocity;
+    sleepingTime = org.sleepingTime;
 }
 
 
@@ -293,6 +375,12 @@ void AISTSimulatorItem::setContactCullingDepth(double value)
     impl->contactCullingDepth = value;
 }
 
+
+void AISTSimulatorItem::setMaxNumContactPoints(int n)
+{
+    impl->maxNumContactPoints = n;
+}
+
     
 void AISTSimulatorItem::setErrorCriterion(double value)    
 {
@@ -306,6 +394,12 @@ void AISTSimulatorItem::setMaxNumIterations(int value)
 }
 
 
+void AISTSimulatorItem::setNumConstraintSolverThreads(int n)
+{
+    impl->numConstraintSolverThreads = n;
+}
+
+
 void AISTSimulatorItem::setContactCorrectionDepth(double value)
 {
     impl->contactCorrectionDepth = value;
@@ -342,6 +436,39 @@ void AISTSimulatorItem::setConstraintForceOutputEnabled(bool on)
 }
 
 
+void AISTSimulatorItem::setParallelForwardDynamicsEnabled(bool on)
+{
+    impl->isParallelForwardDynamicsEnabled = on;
+}
+
+
+void AISTSimulatorItem::setAdaptiveTimeStepEnabled(bool on)
+{
+    impl->isAdaptiveTimeStepEnabled = on;
+}
+
+
+void AISTSimulatorItem::setAdaptiveTimeStepParameters(double minTimeStep, double errorTolerance)
+{
+    impl->minSubTimeStep = minTimeStep;
+    impl->subStepErrorTolerance = errorTolerance;
+}
+
+
+void AISTSimulatorItem::setBodySleepingEnabled(bool on)
+{
+    impl->isBodySleepingEnabled = on;
+}
+
+
+void AISTSimulatorItem::setBodySleepingThresholds(double linearVelocity, double angularVelocity, double restingTime)
+{
+    impl->sleepingLinearVelocity = linearVelocity;
+    impl->sleepingAngularVelocity = angularVelocity;
+    impl->sleepingTime = restingTime;
+}
+
+
 Item* AISTSimulatorItem::doDuplicate() const
 {
     return new AISTSimulatorItem(*this);
@@ -411,11 +538,18 @@ bool AISTSimulatorItemImpl::initializeSimulation(const std::vector<SimulationBod
     world.setOldAccelSensorCalcMode(isOldAccelSensorMode);
     world.setTimeStep(self->worldTimeStep());
     world.setCurrentTime(0.0);
+    world.setProfilingEnabled(self->isProfilingEnabled());
+    world.setParallelForwardDynamicsEnabled(isParallelForwardDynamicsEnabled);
+    world.setAdaptiveTimeStepEnabled(isAdaptiveTimeStepEnabled && dynamicsMode.is(AISTSimulatorItem::FORWARD_DYNAMICS));
+    world.setAdaptiveTimeStepParameters(minSubTimeStep, subStepErrorTolerance);
+    world.setSleepingEnabled(isBodySleepingEnabled && dynamicsMode.is(AISTSimulatorItem::FORWARD_DYNAMICS));
+    world.setSleepingThresholds(sleepingLinearVelocity, sleepingAngularVelocity, sleepingTime);
 
     ConstraintForceSolver& cfs = world.constraintForceSolver;
     cfs.setMaterialTable(self->worldItem()->materialTable());
     cfs.setGaussSeidelErrorCriterion(errorCriterion.value());
     cfs.setGaussSeidelMaxNumIterations(maxNumIterations);
+    cfs.setNumThreads(numConstraintSolverThreads);
     cfs.setContactDepthCorrection(contactCorrectionDepth.value(), contactCorrectionVelocityRatio.value());
     
     self->addPreDynamicsFunction([&](){ clearExternalForces(); });
@@ -436,6 +570,7 @@ bool AISTSimulatorItemImpl::initializeSimulation(const std::vector<SimulationBod
     cfs.setFriction(staticFriction, dynamicFriction);
     cfs.setContactCullingDistance(contactCullingDistance.value());
     cfs.setContactCullingDepth(contactCullingDepth.value());
+    cfs.setMaxNumContactPoints(maxNumContactPoints);
     cfs.setCoefficientOfRestitution(epsilon);
     cfs.setCollisionDetector(self->getOrCreateCollisionDetector());
 
@@ -445,6 +580,14 @@ bool AISTSimulatorItemImpl::initializeSimulation(const std::vector<SimulationBod
 
     world.initialize();
 
+    clearSolverStatistics();
+
+    if(self->isProfilingEnabled()){
+        for(int i=0; i < world.numBodies(); ++i){
+            world.forwardDynamics(i)->setSensorTimeMeasurementEnabled(true);
+        }
+    }
+
     return true;
 }
 
@@ -471,6 +614,7 @@ void AISTSimulatorItemImpl::addBody(AISTSimBody* simBody)
         bodyIndex = world.addBody(body);
     }
     bodyIndexMap[body] = bodyIndex;
+    simBody->bodyIndex = bodyIndex;
 
     world.constraintForceSolver.setSelfCollisionDetectionEnabled(
         bodyIndex, simBody->bodyItem()->isSelfCollisionDetectionEnabled());
@@ -483,6 +627,67 @@ void AISTSimulatorItemImpl::clearExternalForces()
 }
 
 
+ReferencedPtr AISTSimulatorItem::storeEngineState()
+{
+    return impl->storeEngineState();
+}
+
+
+ReferencedPtr AISTSimulatorItemImpl::storeEngineState()
+{
+    AISTEngineStatePtr state = new AISTEngineState;
+    state->time = world.currentTime();
+
+    const int numBodies = world.numBodies();
+    state->bodyLinkStates.resize(numBodies);
+    for(int i=0; i < numBodies; ++i){
+        DyBody* body = world.body(i);
+        auto& linkStates = state->bodyLinkStates[i];
+        linkStates.resize(body->numLinks());
+        for(int j=0; j < body->numLinks(); ++j){
+            linkStates[j].store(body->link(j));
+        }
+    }
+    state->constraintForceSolverState = world.constraintForceSolver.storeState();
+
+    return state;
+}
+
+
+bool AISTSimulatorItem::restoreEngineState(Referenced* state)
+{
+    return impl->restoreEngineState(state);
+}
+
+
+bool AISTSimulatorItemImpl::restoreEngineState(Referenced* state_)
+{
+    auto state = dynamic_cast<AISTEngineState*>(state_);
+    const int numBodies = world.numBodies();
+    if(!state || static_cast<int>(state->bodyLinkStates.size()) != numBodies){
+        return false;
+    }
+    for(int i=0; i < numBodies; ++i){
+        if(static_cast<int>(state->bodyLinkStates[i].size()) != world.body(i)->numLinks()){
+            return false;
+        }
+    }
+
+    world.setCurrentTime(state->time);
+    for(int i=0; i < numBodies; ++i){
+        DyBody* body = world.body(i);
+        auto& linkStates = state->bodyLinkStates[i];
+        for(int j=0; j < body->numLinks(); ++j){
+            linkStates[j].restore(body->link(j));
+        }
+    }
+    // The sleeping states are not stored, and the bodies fall asleep again if they are at rest
+    world.wakeUpAllBodies();
+    
+    return world.constraintForceSolver.restoreState(state->constraintForceSolverState);
+}
+
+
 bool AISTSimulatorItem::stepSimulation(const std::vector<SimulationBody*>& activeSimBodies)
 {
     switch(impl->dynamicsMode.which()){
@@ -491,6 +696,10 @@ bool AISTSimulatorItem::stepSimulation(const std::vector<SimulationBody*>& activ
             dynamics->complementHighGainModeCommandValues();
         }
         impl->world.calcNextState();
+        impl->updateSolverStatistics();
+        if(impl->world.isSleepingEnabled()){
+            impl->updateRestingStates(activeSimBodies);
+        }
         break;
     case KINEMATICS:
         impl->stepKinematicsSimulation(activeSimBodies);
@@ -500,6 +709,42 @@ bool AISTSimulatorItem::stepSimulation(const std::vector<SimulationBody*>& activ
 }
 
 
+void AISTSimulatorItemImpl::clearSolverStatistics()
+{
+    std::lock_guard<std::mutex> lock(solverStatisticsMutex);
+    solverStatistics = AISTSimulatorItem::SolverStatistics();
+}
+
+
+/**
+   When the adaptive time step is enabled, the solver statistics of the last sub-step are used.
+*/
+void AISTSimulatorItemImpl::updateSolverStatistics()
+{
+    auto& step = world.constraintForceSolver.statistics();
+    
+    std::lock_guard<std::mutex> lock(solverStatisticsMutex);
+    auto& s = solverStatistics;
+    s.lastStep = step;
+    ++s.numSteps;
+    if(step.isIterationLimitReached){
+        ++s.numIterationLimitHits;
+    }
+    s.totalNumIterations += step.numIterations;
+    s.maxNumContacts = std::max(s.maxNumContacts, step.numContacts);
+    s.maxProblemSize = std::max(s.maxProblemSize, step.problemSize);
+    s.maxNumIterations = std::max(s.maxNumIterations, step.numIterations);
+    s.maxError = std::max(s.maxError, step.error);
+}
+
+
+AISTSimulatorItem::SolverStatistics AISTSimulatorItem::solverStatistics() const
+{
+    std::lock_guard<std::mutex> lock(impl->solverStatisticsMutex);
+    return impl->solverStatistics;
+}
+
+
 void AISTSimulatorItemImpl::stepKinematicsSimulation(const std::vector<SimulationBody*>& activeSimBodies)
 {
     for(size_t i=0; i < activeSimBodies.size(); ++i){
@@ -548,6 +793,15 @@ void AISTSimulatorItemImpl::stepKinematicsSimulation(const std::vector<Simulatio
 }
 
 
+void AISTSimulatorItemImpl::updateRestingStates(const std::vector<SimulationBody*>& activeSimBodies)
+{
+    for(auto& simBody : activeSimBodies){
+        auto aistSimBody = static_cast<AISTSimBody*>(simBody);
+        aistSimBody->setResting(world.isBodySleeping(aistSimBody->bodyIndex));
+    }
+}
+
+
 void AISTSimulatorItem::finalizeSimulation()
 {
     if(ENABLE_DEBUG_OUTPUT){
@@ -672,9 +926,20 @@ void AISTSimulatorItemImpl::doPutProperties(PutPropertyFunction& putProperty)
                 [&](const string& v){ return contactCullingDistance.setNonNegativeValue(v); });
     putProperty(_("Contact culling depth"), contactCullingDepth,
                 [&](const string& v){ return contactCullingDepth.setNonNegativeValue(v); });
+    putProperty.min(0)(_("Max contact points per pair"), maxNumContactPoints,
+                       changeProperty(maxNumContactPoints));
     putProperty(_("Error criterion"), errorCriterion,
                 [&](const string& v){ return errorCriterion.setPositiveValue(v); });
     putProperty.min(1.0)(_("Max iterations"), maxNumIterations, changeProperty(maxNumIterations));
+    putProperty.min(0)(_("Solver threads"), numConstraintSolverThreads,
+                       changeProperty(numConstraintSolverThreads));
+    putProperty(_("Parallel forward dynamics"), isParallelForwardDynamicsEnabled,
+                changeProperty(isParallelForwardDynamicsEnabled));
+    putProperty(_("Adaptive time step"), isAdaptiveTimeStepEnabled, changeProperty(isAdaptiveTimeStepEnabled));
+    putProperty.decimals(5).min(0.0)(_("Min sub time step"), minSubTimeStep, changeProperty(minSubTimeStep));
+    putProperty.decimals(5).min(0.0)(_("Sub-step error tolerance"), subStepErrorTolerance,
+                                     changeProperty(subStepErrorTolerance));
+    putProperty.decimals(3).min(0.0);
     putProperty(_("CC depth"), contactCorrectionDepth,
                 [&](const string& v){ return contactCorrectionDepth.setNonNegativeValue(v); });
     putProperty(_("CC v-ratio"), contactCorrectionVelocityRatio,
@@ -683,6 +948,11 @@ void AISTSimulatorItemImpl::doPutProperties(PutPropertyFunction& putProperty)
                 changeProperty(isKinematicWalkingEnabled));
     putProperty(_("2D mode"), is2Dmode, changeProperty(is2Dmode));
     putProperty(_("Old accel sensor mode"), isOldAccelSensorMode, changeProperty(isOldAccelSensorMode));
+    putProperty(_("Body sleeping"), isBodySleepingEnabled, changeProperty(isBodySleepingEnabled));
+    putProperty.decimals(3).min(0.0);
+    putProperty(_("Sleeping linear velocity"), sleepingLinearVelocity, changeProperty(sleepingLinearVelocity));
+    putProperty(_("Sleeping angular velocity"), sleepingAngularVelocity, changeProperty(sleepingAngularVelocity));
+    putProperty(_("Sleeping time"), sleepingTime, changeProperty(sleepingTime));
 }
 
 
@@ -702,13 +972,23 @@ bool AISTSimulatorItemImpl::store(Archive& archive)
     archive.write("dynamicFriction", dynamicFriction);
     archive.write("cullingThresh", contactCullingDistance);
     archive.write("contactCullingDepth", contactCullingDepth);
+    archive.write("maxNumContactPoints", maxNumContactPoints);
     archive.write("errorCriterion", errorCriterion);
     archive.write("maxNumIterations", maxNumIterations);
+    archive.write("constraintSolverThreads", numConstraintSolverThreads);
+    archive.write("parallelForwardDynamics", isParallelForwardDynamicsEnabled);
+    archive.write("adaptiveTimeStep", isAdaptiveTimeStepEnabled);
+    archive.write("minSubTimeStep", minSubTimeStep);
+    archive.write("subStepErrorTolerance", subStepErrorTolerance);
     archive.write("contactCorrectionDepth", contactCorrectionDepth);
     archive.write("contactCorrectionVelocityRatio", contactCorrectionVelocityRatio);
     archive.write("kinematicWalking", isKinematicWalkingEnabled);
     archive.write("2Dmode", is2Dmode);
     archive.write("oldAccelSensorMode", isOldAccelSensorMode);
+    archive.write("bodySleeping", isBodySleepingEnabled);
+    archive.write("sleepingLinearVelocity", sleepingLinearVelocity);
+    archive.write("sleepingAngularVelocity", sleepingAngularVelocity);
+    archive.write("sleepingTime", sleepingTime);
     return true;
 }
 
@@ -736,17 +1016,27 @@ bool AISTSimulatorItemImpl::restore(const Archive& archive)
     }
     contactCullingDistance = archive.get("cullingThresh", contactCullingDistance.string());
     contactCullingDepth = archive.get("contactCullingDepth", contactCullingDepth.string());
+    archive.read("maxNumContactPoints", maxNumContactPoints);
     errorCriterion = archive.get("errorCriterion", errorCriterion.string());
     archive.read("maxNumIterations", maxNumIterations);
+    archive.read("constraintSolverThreads", numConstraintSolverThreads);
+    archive.read("parallelForwardDynamics", isParallelForwardDynamicsEnabled);
+    archive.read("adaptiveTimeStep", isAdaptiveTimeStepEnabled);
+    archive.read("minSubTimeStep", minSubTimeStep);
+    archive.read("subStepErrorTolerance", subStepErrorTolerance);
     contactCorrectionDepth = archive.get("contactCorrectionDepth", contactCorrectionDepth.string());
     contactCorrectionVelocityRatio = archive.get("contactCorrectionVelocityRatio", contactCorrectionVelocityRatio.string());
     archive.read("kinematicWalking", isKinematicWalkingEnabled);
     archive.read("2Dmode", is2Dmode);
     archive.read("oldAccelSensorMode", isOldAccelSensorMode);
+    archive.read("bodySleeping", isBodySleepingEnabled);
+    archive.read("sleepingLinearVelocity", sleepingLinearVelocity);
+    archive.read("sleepingAngularVelocity", sleepingAngularVelocity);
+    archive.read("sleepingTime", sleepingTime);
     return true;
 }
 
-#ifdef ENABLE_SIMULATION_PROFILING
+
 void AISTSimulatorItem::getProfilingNames(vector<string>& profilingNames)
 {
     profilingNames.push_back("Collision detection time");
@@ -764,4 +1054,23 @@ void AISTSimulatorItem::getProfilingTimes(vector<double>& profilingToimes)
     profilingToimes.push_back(impl->world.forwardDynamicsTime);
     profilingToimes.push_back(impl->world.customizerTime);
 }
-#endif
+
+
+void AISTSimulatorItem::getDeviceTimeStatistics(vector<SimulationTimeStatistics>& out_statistics)
+{
+    auto& world = impl->world;
+    for(int i=0; i < world.numBodies(); ++i){
+        auto& helper = world.forwardDynamics(i)->sensorSimulationHelper();
+        const string& bodyName = world.body(i)->name();
+        if(helper.forceSensorTimeStatistics().count() > 0){
+            out_statistics.push_back({ bodyName, "Force sensors", helper.forceSensorTimeStatistics() });
+        }
+        if(helper.rateGyroSensorTimeStatistics().count() > 0){
+            out_statistics.push_back({ bodyName, "Rate gyro sensors", helper.rateGyroSensorTimeStatistics() });
+        }
+        if(helper.accelerationSensorTimeStatistics().count() > 0){
+            out_statistics.push_back(
+                { bodyName, "Acceleration sensors", helper.accelerationSensorTimeStatistics() });
+        }
+    }
+}
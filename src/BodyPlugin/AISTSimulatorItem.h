@@ -8,6 +8,7 @@
 
 #include "SimulatorItem.h"
 #include <cnoid/Collision>
+#include <cnoid/ConstraintForceSolver>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -38,8 +39,10 @@ public:
     double dynamicFriction() const;
     void setContactCullingDistance(double value);        
     void setContactCullingDepth(double value);        
+    void setMaxNumContactPoints(int n);
     void setErrorCriterion(double value);        
     void setMaxNumIterations(int value);
+    void setNumConstraintSolverThreads(int n);
     void setContactCorrectionDepth(double value);
     void setContactCorrectionVelocityRatio(double value);
     void setEpsilon(double epsilon);
@@ -47,9 +50,46 @@ public:
     void setKinematicWalkingEnabled(bool on);
     void setConstraintForceOutputEnabled(bool on);
 
+    //! The forward dynamics of the bodies is calculated in parallel on the shared thread pool
+    void setParallelForwardDynamicsEnabled(bool on);
+
+    /**
+       A step of the world time step is divided into the sub-steps whose time step is
+       changed by the estimated error. This is only available in the forward dynamics mode.
+    */
+    void setAdaptiveTimeStepEnabled(bool on);
+    void setAdaptiveTimeStepParameters(double minTimeStep, double errorTolerance);
+
+    /**
+       The bodies at rest fall asleep and they are skipped by the dynamics calculation,
+       the collision detection between the resting bodies and the result buffering
+       until they are woken up by a contact, an external force or a joint torque.
+       This is only available in the forward dynamics mode.
+    */
+    void setBodySleepingEnabled(bool on);
+    void setBodySleepingThresholds(double linearVelocity, double angularVelocity, double restingTime);
+
     void addExtraJoint(ExtraJoint& extrajoint);
     void clearExtraJoint();
 
+    /**
+       The statistics of the constraint force solver accumulated over the steps of the current
+       or last simulation in the forward dynamics mode. The function can be called from any thread
+       while the simulation is running.
+    */
+    struct SolverStatistics
+    {
+        ConstraintForceSolver::Statistics lastStep;
+        int64_t numSteps;
+        int64_t numIterationLimitHits;
+        int64_t totalNumIterations;
+        int maxNumContacts;
+        int maxProblemSize;
+        int maxNumIterations;
+        double maxError;
+    };
+    SolverStatistics solverStatistics() const;
+
     virtual Vector3 getGravity() const override;
     virtual void setForcedPosition(BodyItem* bodyItem, const Position& T);
     virtual bool isForcedPositionActiveFor(BodyItem* bodyItem) const;
@@ -71,15 +111,16 @@ protected:
     virtual bool stepSimulation(const std::vector<SimulationBody*>& activeSimBodies);
     virtual void finalizeSimulation();
     virtual std::shared_ptr<CollisionLinkPairList> getCollisions();
+    virtual ReferencedPtr storeEngineState() override;
+    virtual bool restoreEngineState(Referenced* state) override;
         
     virtual Item* doDuplicate() const;
     virtual void doPutProperties(PutPropertyFunction& putProperty);
     virtual bool store(Archive& archive);
     virtual bool restore(const Archive& archive);
-#ifdef ENABLE_SIMULATION_PROFILING
-    virtual void getProfilingNames(std::vector<std::string>& profilingNames);
-    virtual void getProfilingTimes(std::vector<double>& profilingTimes);
-#endif
+    virtual void getProfilingNames(std::vector<std::string>& profilingNames) override;
+    virtual void getProfilingTimes(std::vector<double>& profilingTimes) override;
+    virtual void getDeviceTimeStatistics(std::vector<SimulationTimeStatistics>& out_statistics) override;
 
 private:
     AISTSimulatorItemImpl* impl;
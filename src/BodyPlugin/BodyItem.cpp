@@ -17,6 +17,7 @@
 #include <cnoid/LazySignal>
 #include <cnoid/LazyCaller>
 #include <cnoid/MessageView>
+#include <cnoid/AppConfig>
 #include <cnoid/TimeBar>
 #include <cnoid/ItemManager>
 #include <cnoid/OptionManager>
@@ -30,9 +31,11 @@
 #include <cnoid/PinDragIK>
 #include <cnoid/PenetrationBlocker>
 #include <cnoid/FileUtil>
+#include <cnoid/MemoryUsage>
 #include <fmt/format.h>
 #include <bitset>
 #include <deque>
+#include <chrono>
 #include <iostream>
 #include <algorithm>
 #include "gettext.h"
@@ -50,9 +53,102 @@ const bool TRACE_FUNCTIONS = false;
 BodyLoader bodyLoader;
 BodyState kinematicStateCopy;
 
+// The mesh simplification settings given by the "Body" mapping of the application config
+bool isLODGenerationEnabled = false;
+double collisionMeshReductionRatio = 1.0;
+
+int kinematicStateChangeBatchDepth = 0;
+vector<BodyItemPtr> bodyItemsWithBatchedKinematicStateChanges;
+bool isEmittingBatchedKinematicStateChanges_ = false;
+
+// The history entries are removed from the oldest one when their total size exceeds this value
+const size_t maxKinematicStateHistoryMemorySize = 1024 * 1024;
+
+/*
+  Edits made within this interval after the previous one are merged into the previous history
+  entry when they only change the values changed by the entry, which is the case of the
+  continuous edits by dragging a link or a slider.
+*/
+const double kinematicStateHistoryMergeInterval = 0.5; // [s]
+
+/**
+   A history entry only stores the values changed from the previous entry so that an entry of
+   a large body is small when the edit only moves a few joints. Both the values before and
+   after the change are stored to move the state of the history in both directions.
+*/
+struct KinematicStateDelta
+{
+    vector<int> jointIndices;
+    vector<double> oldJointPositions;
+    vector<double> newJointPositions;
+    bool isRootPositionChanged;
+    Vector3 oldRootTranslation;
+    Vector3 newRootTranslation;
+    Matrix3 oldRootRotation;
+    Matrix3 newRootRotation;
+    bool isZmpChanged;
+    Vector3 oldZmp;
+    Vector3 newZmp;
+
+    KinematicStateDelta() : isRootPositionChanged(false), isZmpChanged(false) { }
+
+    bool empty() const {
+        return jointIndices.empty() && !isRootPositionChanged && !isZmpChanged;
+    }
+
+    size_t memorySize() const {
+        return sizeof(KinematicStateDelta) + jointIndices.capacity() * sizeof(int) +
+            (oldJointPositions.capacity() + newJointPositions.capacity()) * sizeof(double);
+    }
+
+    bool merge(const KinematicStateDelta& delta);
+};
+
+
+/**
+   @return false if the delta changes a value which is not changed by this delta
+*/
+bool KinematicStateDelta::merge(const KinematicStateDelta& delta)
+{
+    if((delta.isRootPositionChanged && !isRootPositionChanged) || (delta.isZmpChanged && !isZmpChanged)){
+        return false;
+    }
+    // The joint indices of both the deltas are sorted
+    vector<int> positions;
+    positions.reserve(delta.jointIndices.size());
+    size_t j = 0;
+    for(auto index : delta.jointIndices){
+        while(j < jointIndices.size() && jointIndices[j] < index){
+            ++j;
+        }
+        if(j == jointIndices.size() || jointIndices[j] != index){
+            return false;
+        }
+        positions.push_back(j);
+    }
+    for(size_t i=0; i < positions.size(); ++i){
+        newJointPositions[positions[i]] = delta.newJointPositions[i];
+    }
+    if(delta.isRootPositionChanged){
+        newRootTranslation = delta.newRootTranslation;
+        newRootRotation = delta.newRootRotation;
+    }
+    if(delta.isZmpChanged){
+        newZmp = delta.newZmp;
+    }
+    return true;
+}
+
 /// \todo move this to hrpUtil ?
 inline double radian(double deg) { return (3.14159265358979 * deg / 180.0); }
 
+void applyMeshSimplificationSettings(BodyLoader& loader)
+{
+    loader.setLODGenerationEnabled(isLODGenerationEnabled);
+    loader.setCollisionMeshReductionRatio(collisionMeshReductionRatio);
+}
+
+
 bool loadBodyItem(BodyItem* item, const std::string& filename)
 {
     if(item->loadModelFile(filename)){
@@ -64,6 +160,29 @@ bool loadBodyItem(BodyItem* item, const std::string& filename)
     }
     return false;
 }
+
+/**
+   The model is loaded into the model cache of BodyLoader in a worker thread, and the copy of
+   the cached model is given to the item when it is restored. Only the YAML format is prefetched
+   because the models of the other formats are not cached.
+*/
+std::function<void()> prefetchBodyModel(const Archive& archive)
+{
+    string filename;
+    if(!archive.readRelocatablePath("modelFile", filename)){
+        return nullptr;
+    }
+    string ext = getExtension(boost::filesystem::path(filename));
+    if(ext != "body" && ext != "yaml" && ext != "yml"){
+        return nullptr;
+    }
+    return [filename](){
+        BodyLoader loader;
+        loader.setModelCacheEnabled(true);
+        applyMeshSimplificationSettings(loader);
+        BodyPtr body = loader.load(filename);
+    };
+}
     
 void onSigOptionsParsed(boost::program_options::variables_map& variables)
 {
@@ -120,14 +239,22 @@ public:
     bool isFkRequested;
     bool isVelFkRequested;
     bool isAccFkRequested;
+    bool isKinematicStateChangeBatched;
     bool isCollisionDetectionEnabled;
     bool isSelfCollisionDetectionEnabled;
 
     BodyState initialState;
             
-    typedef std::shared_ptr<BodyState> BodyStatePtr;
-    std::deque<BodyStatePtr> kinematicStateHistory;
+    std::deque<KinematicStateDelta> kinematicStateHistory;
     size_t currentHistoryIndex;
+    size_t kinematicStateHistoryMemorySize;
+    // The full kinematic state at the current history index
+    vector<double> historyJointPositions;
+    Vector3 historyRootTranslation;
+    Matrix3 historyRootRotation;
+    Vector3 historyZmp;
+    std::chrono::steady_clock::time_point lastHistoryAppendTime;
+    bool isLastHistoryEntryMergeable;
     bool isCurrentKinematicStateInHistory;
     bool needToAppendKinematicStateToHistory;
 
@@ -152,7 +279,9 @@ public:
     bool enableCollisionDetection(bool on);
     bool enableSelfCollisionDetection(bool on);
     void updateCollisionDetectorLater();
+    void clearKinematicStateHistory();
     void appendKinematicStateToHistory();
+    void restoreKinematicStateInHistory();
     bool onStaticModelPropertyChanged(bool on);
     void createSceneBody();
     void onPositionChanged();
@@ -185,12 +314,20 @@ void BodyItem::initializeClass(ExtensionManager* ext)
         im.registerClass<BodyItem>(N_("BodyItem"));
         im.addLoader<BodyItem>(
             _("Body"), "OpenHRP-VRML-MODEL", "body;scen;wrl;yaml;yml;dae;stl", std::bind(loadBodyItem, _1, _2));
+        im.addRestorePrefetcher<BodyItem>(prefetchBodyModel);
 
         OptionManager& om = ext->optionManager();
         om.addOption("hrpmodel", boost::program_options::value< vector<string> >(), "load an OpenHRP model file");
         om.addOption("body", boost::program_options::value< vector<string> >(), "load a body file");
         om.sigOptionsParsed().connect(onSigOptionsParsed);
 
+        const Mapping& config = *AppConfig::archive()->findMapping("Body");
+        if(config.isValid()){
+            config.read("generateLODs", isLODGenerationEnabled);
+            config.read("collisionMeshReductionRatio", collisionMeshReductionRatio);
+        }
+        applyMeshSimplificationSettings(bodyLoader);
+
         initialized = true;
     }
 }
@@ -247,7 +384,10 @@ void BodyItemImpl::init(bool calledFromCopyConstructor)
     
     kinematicsBar = KinematicsBar::instance();
     isFkRequested = isVelFkRequested = isAccFkRequested = false;
+    isKinematicStateChangeBatched = false;
     currentHistoryIndex = 0;
+    kinematicStateHistoryMemorySize = 0;
+    isLastHistoryEntryMergeable = false;
     isCurrentKinematicStateInHistory = false;
     needToAppendKinematicStateToHistory = false;
     isCallingSlotsOnKinematicStateEdited = false;
@@ -331,12 +471,12 @@ bool BodyItem::loadModelFile(const std::string& filename)
 bool BodyItemImpl::loadModelFile(const std::string& filename)
 {
     bodyLoader.setMessageSink(MessageView::instance()->cout());
+    bodyLoader.setModelCacheEnabled(true);
 
-    BodyPtr newBody = new Body;
-    newBody->setName(self->name());
-
-    bool loaded = bodyLoader.load(newBody, filename);
+    BodyPtr newBody = bodyLoader.load(filename);
+    bool loaded = (newBody != nullptr);
     if(loaded){
+        newBody->setName(self->name());
         body = newBody;
         body->initializePosition();
         body->setCurrentTimeFunction(getCurrentTime);
@@ -476,6 +616,12 @@ void BodyItem::getInitialState(BodyState& out_state)
 }
 
 
+void BodyItem::setInitialState(const BodyState& in_state)
+{
+    impl->initialState = in_state;
+}
+
+
 void BodyItem::beginKinematicStateEdit()
 {
     if(TRACE_FUNCTIONS){
@@ -500,30 +646,127 @@ void BodyItem::acceptKinematicStateEdit()
 }
 
 
+void BodyItemImpl::clearKinematicStateHistory()
+{
+    kinematicStateHistory.clear();
+    currentHistoryIndex = 0;
+    kinematicStateHistoryMemorySize = 0;
+    isLastHistoryEntryMergeable = false;
+}
+
+
 void BodyItemImpl::appendKinematicStateToHistory()
 {
     if(TRACE_FUNCTIONS){
         cout << "BodyItem::appendKinematicStateToHistory()" << endl;
     }
 
-    BodyStatePtr state = std::make_shared<BodyState>();
-    self->storeKinematicState(*state);
+    const int numJoints = body->numAllJoints();
+    Link* rootLink = body->rootLink();
+
+    if(kinematicStateHistory.empty() || historyJointPositions.size() != static_cast<size_t>(numJoints)){
+        // The first entry only has the full state
+        clearKinematicStateHistory();
+        historyJointPositions.resize(numJoints);
+        for(int i=0; i < numJoints; ++i){
+            historyJointPositions[i] = body->joint(i)->q();
+        }
+        historyRootTranslation = rootLink->translation();
+        historyRootRotation = rootLink->rotation();
+        historyZmp = zmp;
+        kinematicStateHistory.emplace_back();
+        kinematicStateHistoryMemorySize = kinematicStateHistory.back().memorySize();
+        isCurrentKinematicStateInHistory = true;
+        return;
+    }
+
+    KinematicStateDelta delta;
+    for(int i=0; i < numJoints; ++i){
+        const double q = body->joint(i)->q();
+        if(q != historyJointPositions[i]){
+            delta.jointIndices.push_back(i);
+            delta.oldJointPositions.push_back(historyJointPositions[i]);
+            delta.newJointPositions.push_back(q);
+        }
+    }
+    if(rootLink->translation() != historyRootTranslation || rootLink->rotation() != historyRootRotation){
+        delta.isRootPositionChanged = true;
+        delta.oldRootTranslation = historyRootTranslation;
+        delta.oldRootRotation = historyRootRotation;
+        delta.newRootTranslation = rootLink->translation();
+        delta.newRootRotation = rootLink->rotation();
+    }
+    if(zmp != historyZmp){
+        delta.isZmpChanged = true;
+        delta.oldZmp = historyZmp;
+        delta.newZmp = zmp;
+    }
+
+    isCurrentKinematicStateInHistory = true;
+
+    if(delta.empty()){
+        return;
+    }
+
+    for(size_t i = currentHistoryIndex + 1; i < kinematicStateHistory.size(); ++i){
+        kinematicStateHistoryMemorySize -= kinematicStateHistory[i].memorySize();
+    }
+    kinematicStateHistory.resize(currentHistoryIndex + 1);
+
+    for(size_t i=0; i < delta.jointIndices.size(); ++i){
+        historyJointPositions[delta.jointIndices[i]] = delta.newJointPositions[i];
+    }
+    if(delta.isRootPositionChanged){
+        historyRootTranslation = delta.newRootTranslation;
+        historyRootRotation = delta.newRootRotation;
+    }
+    if(delta.isZmpChanged){
+        historyZmp = delta.newZmp;
+    }
 
-    if(kinematicStateHistory.empty() || (currentHistoryIndex == kinematicStateHistory.size() - 1)){
-        kinematicStateHistory.push_back(state);
+    auto now = std::chrono::steady_clock::now();
+    bool merged = false;
+    if(isLastHistoryEntryMergeable && currentHistoryIndex > 0 &&
+       std::chrono::duration<double>(now - lastHistoryAppendTime).count() < kinematicStateHistoryMergeInterval){
+        merged = kinematicStateHistory.back().merge(delta);
+    }
+    if(!merged){
+        kinematicStateHistoryMemorySize += delta.memorySize();
+        kinematicStateHistory.push_back(std::move(delta));
         currentHistoryIndex = kinematicStateHistory.size() - 1;
-    } else {
-        ++currentHistoryIndex;
-        kinematicStateHistory.resize(currentHistoryIndex + 1);
-        kinematicStateHistory[currentHistoryIndex] = state;
+
+        while(kinematicStateHistoryMemorySize > maxKinematicStateHistoryMemorySize && currentHistoryIndex > 1){
+            kinematicStateHistoryMemorySize -= kinematicStateHistory.front().memorySize();
+            kinematicStateHistory.pop_front();
+            --currentHistoryIndex;
+            // The delta of the oldest entry is not used any more
+            auto& front = kinematicStateHistory.front();
+            kinematicStateHistoryMemorySize -= front.memorySize();
+            front = KinematicStateDelta();
+            kinematicStateHistoryMemorySize += front.memorySize();
+        }
     }
-        
-    if(kinematicStateHistory.size() > 20){
-        kinematicStateHistory.pop_front();
-        currentHistoryIndex--;
+    lastHistoryAppendTime = now;
+    isLastHistoryEntryMergeable = true;
+}
+
+
+void BodyItemImpl::restoreKinematicStateInHistory()
+{
+    const int numJoints = historyJointPositions.size();
+    for(int i=0; i < numJoints; ++i){
+        body->joint(i)->q() = historyJointPositions[i];
     }
+    Link* rootLink = body->rootLink();
+    rootLink->translation() = historyRootTranslation;
+    rootLink->rotation() = historyRootRotation;
+    zmp = historyZmp;
+    body->calcForwardKinematics();
 
+    self->notifyKinematicStateChange(false);
     isCurrentKinematicStateInHistory = true;
+    isLastHistoryEntryMergeable = false;
+    sigKinematicStateEdited.request();
 }
 
 
@@ -539,33 +782,31 @@ bool BodyItem::undoKinematicState()
 
 bool BodyItemImpl::undoKinematicState()
 {
-    bool done = false;
-    bool modified = false;
+    if(kinematicStateHistory.empty() ||
+       historyJointPositions.size() != static_cast<size_t>(body->numAllJoints())){
+        return false;
+    }
 
-    if(!isCurrentKinematicStateInHistory){
-        if(currentHistoryIndex < kinematicStateHistory.size()){
-            done = true;
-            modified = self->restoreKinematicState(*kinematicStateHistory[currentHistoryIndex]);
+    if(isCurrentKinematicStateInHistory){
+        if(currentHistoryIndex == 0){
+            return false;
         }
-    } else {
-        if(currentHistoryIndex > 0){
-            done = true;
-            modified = self->restoreKinematicState(*kinematicStateHistory[--currentHistoryIndex]);
+        const auto& delta = kinematicStateHistory[currentHistoryIndex--];
+        for(size_t i=0; i < delta.jointIndices.size(); ++i){
+            historyJointPositions[delta.jointIndices[i]] = delta.oldJointPositions[i];
         }
-    }
-
-    if(done){
-        if(modified){
-            self->notifyKinematicStateChange(false);
-            isCurrentKinematicStateInHistory = true;
-            sigKinematicStateEdited.request();
-        } else {
-            isCurrentKinematicStateInHistory = true;
-            done = undoKinematicState();
+        if(delta.isRootPositionChanged){
+            historyRootTranslation = delta.oldRootTranslation;
+            historyRootRotation = delta.oldRootRotation;
+        }
+        if(delta.isZmpChanged){
+            historyZmp = delta.oldZmp;
         }
     }
 
-    return done;
+    restoreKinematicStateInHistory();
+    
+    return true;
 }
 
 
@@ -581,14 +822,26 @@ bool BodyItem::redoKinematicState()
 
 bool BodyItemImpl::redoKinematicState()
 {
-    if(currentHistoryIndex + 1 < kinematicStateHistory.size()){
-        self->restoreKinematicState(*kinematicStateHistory[++currentHistoryIndex]);
-        self->notifyKinematicStateChange(false);
-        isCurrentKinematicStateInHistory = true;
-        sigKinematicStateEdited.request();
-        return true;
+    if(currentHistoryIndex + 1 >= kinematicStateHistory.size() ||
+       historyJointPositions.size() != static_cast<size_t>(body->numAllJoints())){
+        return false;
     }
-    return false;
+
+    const auto& delta = kinematicStateHistory[++currentHistoryIndex];
+    for(size_t i=0; i < delta.jointIndices.size(); ++i){
+        historyJointPositions[delta.jointIndices[i]] = delta.newJointPositions[i];
+    }
+    if(delta.isRootPositionChanged){
+        historyRootTranslation = delta.newRootTranslation;
+        historyRootRotation = delta.newRootRotation;
+    }
+    if(delta.isZmpChanged){
+        historyZmp = delta.newZmp;
+    }
+
+    restoreKinematicStateInHistory();
+
+    return true;
 }
         
 
@@ -894,7 +1147,14 @@ void BodyItemImpl::notifyKinematicStateChange(bool requestFK, bool requestVelFK,
     updateFlags.reset();
 
     if(isDirect){
-        sigKinematicStateChanged.emit();
+        if(kinematicStateChangeBatchDepth > 0){
+            if(!isKinematicStateChangeBatched){
+                bodyItemsWithBatchedKinematicStateChanges.push_back(self);
+                isKinematicStateChangeBatched = true;
+            }
+        } else {
+            sigKinematicStateChanged.emit();
+        }
     } else {
         sigKinematicStateChanged.request();
     }
@@ -945,6 +1205,39 @@ void BodyItem::notifyKinematicStateChangeLater
 }
 
 
+BodyItem::KinematicStateChangeBatch::KinematicStateChangeBatch()
+{
+    ++kinematicStateChangeBatchDepth;
+}
+
+
+BodyItem::KinematicStateChangeBatch::~KinematicStateChangeBatch()
+{
+    if(--kinematicStateChangeBatchDepth > 0 || isEmittingBatchedKinematicStateChanges_){
+        return;
+    }
+    isEmittingBatchedKinematicStateChanges_ = true;
+    vector<BodyItemPtr> bodyItems;
+    // The changes batched by the slots are also emitted here
+    while(!bodyItemsWithBatchedKinematicStateChanges.empty()){
+        bodyItems.swap(bodyItemsWithBatchedKinematicStateChanges);
+        for(auto& bodyItem : bodyItems){
+            BodyItemImpl* impl = bodyItem->impl;
+            impl->isKinematicStateChangeBatched = false;
+            impl->sigKinematicStateChanged.emit();
+        }
+        bodyItems.clear();
+    }
+    isEmittingBatchedKinematicStateChanges_ = false;
+}
+
+
+bool BodyItem::isEmittingBatchedKinematicStateChanges()
+{
+    return isEmittingBatchedKinematicStateChanges_;
+}
+
+
 void BodyItemImpl::emitSigKinematicStateEdited()
 {
     isCallingSlotsOnKinematicStateEdited = true;
@@ -1130,6 +1423,26 @@ SgNode* BodyItem::getScene()
 }
 
 
+void BodyItem::countMemoryUsage(MemoryUsageCounter& counter)
+{
+    Item::countMemoryUsage(counter);
+
+    for(auto& link : body()->links()){
+        if(auto shape = link->visualShape()){
+            shape->countMemoryUsage(counter);
+        }
+        if(auto shape = link->collisionShape()){
+            shape->countMemoryUsage(counter);
+        }
+    }
+    if(impl->sceneBody){
+        impl->sceneBody->countMemoryUsage(counter);
+    }
+    counter.add(impl->kinematicStateHistoryMemorySize +
+                impl->historyJointPositions.capacity() * sizeof(double));
+}
+
+
 EditableSceneBody* BodyItem::existingSceneBody()
 {
     return impl->sceneBody;
@@ -100,6 +100,28 @@ public:
         Connection& connectionToBlock,
         bool requestFK = false, bool requestVelFK = false, bool requestAccFK = false);
     
+    /**
+       The kinematic state changes notified by notifyKinematicStateChange while any instance
+       of this class exists are deferred until the outermost instance is destroyed. The signal
+       of each changed body item is then emitted only once, so the results of many bodies
+       should be notified in this scope.
+    */
+    class CNOID_EXPORT KinematicStateChangeBatch
+    {
+    public:
+        KinematicStateChangeBatch();
+        ~KinematicStateChangeBatch();
+    private:
+        KinematicStateChangeBatch(const KinematicStateChangeBatch&);
+        KinematicStateChangeBatch& operator=(const KinematicStateChangeBatch&);
+    };
+
+    /**
+       True while the signals deferred by KinematicStateChangeBatch are being emitted.
+       The slots can use this to aggregate their updates over the bodies.
+    */
+    static bool isEmittingBatchedKinematicStateChanges();
+
     SignalProxy<void()> sigKinematicStateEdited();
 
     void enableCollisionDetection(bool on);
@@ -138,6 +160,9 @@ public:
     EditableSceneBody* sceneBody();
     EditableSceneBody* existingSceneBody();
 
+    //! The shapes of the links and the scene body which has already been created are counted
+    virtual void countMemoryUsage(MemoryUsageCounter& counter) override;
+
 protected:
     virtual Item* doDuplicate() const override;
     virtual void doAssign(Item* item) override;
@@ -7,9 +7,11 @@
 #include "BodyItem.h"
 #include "BodyMotionItem.h"
 #include <cnoid/MenuManager>
+#include <cnoid/ItemTreeView>
 #include <cnoid/ConnectionSet>
 #include <cnoid/Archive>
 #include <map>
+#include <atomic>
 #include "gettext.h"
 
 using namespace std;
@@ -25,17 +27,25 @@ ExtraSeqEngineFactoryMap extraSeqEngineFactories;
 
 Action* updateVelocityCheck;
 
+// The state of updateVelocityCheck, which is read by the engines prepared in the worker threads
+bool isVelocityUpdateEnabled = false;
+
+Action* skipHiddenBodyCheck;
+std::atomic<bool> isHiddenBodySkipEnabled(true);
+
 }
 
 static bool storeProperties(Archive& archive)
 {
     archive.write("updateJointVelocities", updateVelocityCheck->isChecked());
+    archive.write("skipHiddenBodies", skipHiddenBodyCheck->isChecked());
     return true;
 }
 
 static void restoreProperties(const Archive& archive)
 {
     updateVelocityCheck->setChecked(archive.get("updateJointVelocities", updateVelocityCheck->isChecked()));
+    skipHiddenBodyCheck->setChecked(archive.get("skipHiddenBodies", skipHiddenBodyCheck->isChecked()));
 }
 
 namespace cnoid {
@@ -49,8 +59,20 @@ public:
     shared_ptr<MultiValueSeq> qSeq;
     shared_ptr<MultiSE3Seq> positions;
     bool calcForwardKinematics;
+    int prefetchedFrameBegin;
+    int prefetchedFrameEnd;
     std::vector<TimeSyncItemEnginePtr> extraSeqEngines;
     ConnectionSet connections;
+
+    bool isPrepared;
+    double preparedTime;
+    bool isPreparedStateActive;
+    bool isPreparedStateFkDone;
+
+    // A body is hidden when its item is not checked in the item tree view
+    std::atomic<bool> isBodyHidden;
+    bool isBodyStateStale;
+    double lastTime;
         
     BodyMotionEngineImpl(BodyMotionEngine* self, BodyItem* bodyItem, BodyMotionItem* motionItem){
 
@@ -62,8 +84,20 @@ public:
         qSeq = motion->jointPosSeq();
         positions = motion->linkPosSeq();
         calcForwardKinematics = !(positions && positions->numParts() > 1);
+        prefetchedFrameBegin = 0;
+        prefetchedFrameEnd = 0;
+        isPrepared = false;
+        isBodyStateStale = false;
+        lastTime = 0.0;
+
+        auto itemTreeView = ItemTreeView::instance();
+        isBodyHidden = !itemTreeView->isItemChecked(bodyItem);
         
         updateExtraSeqEngines();
+
+        connections.add(
+            itemTreeView->sigCheckToggled(bodyItem).connect(
+                [this](bool on){ onBodyItemCheckToggled(on); }));
         
         connections.add(
             motionItem->sigUpdated().connect(
@@ -94,10 +128,96 @@ public:
         connections.disconnect();
     }
         
+    /**
+       The frames of the next second are read in advance when the motion is played back from
+       the mapped file of the binary format so that the playback is not blocked by the disk.
+    */
+    void prefetchFrames(int frame){
+        const int numPrefetchFrames = std::max(2, static_cast<int>(qSeq->frameRate()));
+        if(frame < prefetchedFrameBegin || frame + numPrefetchFrames / 2 > prefetchedFrameEnd){
+            motionItem->motion()->prefetchFrames(frame, frame + numPrefetchFrames);
+            prefetchedFrameBegin = frame;
+            prefetchedFrameEnd = frame + numPrefetchFrames;
+        }
+    }
+        
+    bool isSkipped() const {
+        return isBodyHidden && isHiddenBodySkipEnabled;
+    }
+
+    void prepareTimeChange(double time){
+        if(isSkipped()){
+            return;
+        }
+        isPreparedStateActive = updateBodyState(time, isPreparedStateFkDone);
+        preparedTime = time;
+        isPrepared = true;
+    }
+
     bool onTimeChanged(double time){
 
-        bool isActive = false;
+        bool isActive;
         bool fkDone = false;
+        bool isUpdated = true;
+        if(isPrepared && preparedTime == time){
+            isActive = isPreparedStateActive;
+            fkDone = isPreparedStateFkDone;
+        } else if(isSkipped()){
+            isActive = isActiveTime(time);
+            isUpdated = false;
+        } else {
+            isActive = updateBodyState(time, fkDone);
+        }
+        isPrepared = false;
+        isBodyStateStale = !isUpdated;
+        lastTime = time;
+
+        for(size_t i=0; i < extraSeqEngines.size(); ++i){
+            isActive |= extraSeqEngines[i]->onTimeChanged(time);
+        }
+
+        if(isUpdated){
+            bodyItem->notifyKinematicStateChange(!fkDone && calcForwardKinematics);
+        }
+
+        return isActive;
+    }
+
+    //! The state skipped while the body is hidden is applied when the body is shown
+    void onBodyItemCheckToggled(bool on){
+        isBodyHidden = !on;
+        if(on && isBodyStateStale){
+            bool fkDone;
+            updateBodyState(lastTime, fkDone);
+            isBodyStateStale = false;
+            bodyItem->notifyKinematicStateChange(!fkDone && calcForwardKinematics);
+        }
+    }
+
+    //! Returns the same value as updateBodyState without updating the body
+    bool isActiveTime(double time) const {
+        bool isActive = false;
+        if(qSeq){
+            const int numAllJoints = std::min(body->numAllJoints(), qSeq->numParts());
+            const int numFrames = qSeq->numFrames();
+            if(numAllJoints > 0 && numFrames > 0){
+                isActive = (qSeq->frameOfTime(time) < numFrames);
+            }
+        }
+        if(positions){
+            const int numFrames = positions->numFrames();
+            if(positions->numParts() > 0 && numFrames > 0){
+                isActive |= (positions->frameOfTime(time) < numFrames);
+            }
+        }
+        return isActive;
+    }
+
+    //! This function only accesses the body so that it can be executed in a worker thread
+    bool updateBodyState(double time, bool& out_fkDone){
+
+        bool isActive = false;
+        out_fkDone = false;
             
         if(qSeq){
             bool isValid = false;
@@ -106,12 +226,13 @@ public:
             if(numAllJoints > 0 && numFrames > 0){
                 const int frame = qSeq->frameOfTime(time);
                 isValid = (frame < numFrames);
+                prefetchFrames(frame);
                 const int clampedFrame = qSeq->clampFrameIndex(frame);
                 const MultiValueSeq::Frame q = qSeq->frame(clampedFrame);
                 for(int i=0; i < numAllJoints; ++i){
                     body->joint(i)->q() = q[i];
                 }
-                if(updateVelocityCheck->isChecked()){
+                if(isVelocityUpdateEnabled){
                     const double dt = qSeq->timeStep();
                     const MultiValueSeq::Frame q_prev = qSeq->frame((clampedFrame == 0) ? 0 : (clampedFrame -1));
                     for(int i=0; i < numAllJoints; ++i){
@@ -141,16 +262,10 @@ public:
 
             if(positions->numParts() == 1){
                 body->calcForwardKinematics(); // FK from the root
-                fkDone = true;
+                out_fkDone = true;
             }
         }
 
-        for(size_t i=0; i < extraSeqEngines.size(); ++i){
-            isActive |= extraSeqEngines[i]->onTimeChanged(time);
-        }
-
-        bodyItem->notifyKinematicStateChange(!fkDone && calcForwardKinematics);
-
         return isActive;
     }
 };
@@ -174,6 +289,7 @@ TimeSyncItemEngine* createBodyMotionEngine(Item* sourceItem)
 BodyMotionEngine::BodyMotionEngine(BodyItem* bodyItem, BodyMotionItem* motionItem)
 {
     impl = new BodyMotionEngineImpl(this, bodyItem, motionItem);
+    setPreparationTarget(bodyItem);
 }
 
 
@@ -195,6 +311,12 @@ BodyMotionItem* BodyMotionEngine::motionItem()
 }
 
 
+void BodyMotionEngine::prepareTimeChange(double time)
+{
+    impl->prepareTimeChange(time);
+}
+
+
 bool BodyMotionEngine::onTimeChanged(double time)
 {
     return impl->onTimeChanged(time);
@@ -208,6 +330,10 @@ void BodyMotionEngine::initialize(ExtensionManager* ext)
     MenuManager& mm = ext->menuManager();
     mm.setPath("/Options").setPath(N_("Body Motion Engine"));
     updateVelocityCheck = mm.addCheckItem(_("Update Joint Velocities"));
+    updateVelocityCheck->sigToggled().connect([](bool on){ isVelocityUpdateEnabled = on; });
+    skipHiddenBodyCheck = mm.addCheckItem(_("Skip Hidden Bodies"));
+    skipHiddenBodyCheck->setChecked(true);
+    skipHiddenBodyCheck->sigToggled().connect([](bool on){ isHiddenBodySkipEnabled = on; });
 
     ext->setProjectArchiver("BodyMotionEngine", storeProperties, restoreProperties);
 }
@@ -32,7 +32,8 @@ public:
     BodyItem* bodyItem();
     BodyMotionItem* motionItem();
         
-    virtual bool onTimeChanged(double time);
+    virtual void prepareTimeChange(double time) override;
+    virtual bool onTimeChanged(double time) override;
 
 private:
     BodyMotionEngineImpl* impl;
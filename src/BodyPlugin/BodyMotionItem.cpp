@@ -11,7 +11,10 @@
 #include <cnoid/ZMPSeq>
 #include <cnoid/LazyCaller>
 #include <cnoid/MessageView>
+#include <cnoid/FileUtil>
 #include <fmt/format.h>
+#include <sstream>
+#include <mutex>
 #include "gettext.h"
 
 using namespace std;
@@ -41,6 +44,16 @@ typedef ref_ptr<ExtraSeqItemInfo> ExtraSeqItemInfoPtr;
     
 typedef std::map<std::string, ExtraSeqItemInfoPtr> ExtraSeqItemInfoMap;
 
+//! The motion of the YAML format parsed by a restore prefetch task
+struct PrefetchedMotion
+{
+    shared_ptr<BodyMotion> motion;
+    string message;
+};
+
+map<string, weak_ptr<PrefetchedMotion>> prefetchedMotions;
+mutex prefetchedMotionMutex;
+
 }
 
 namespace cnoid {
@@ -108,6 +121,61 @@ static bool bodyMotionItemPostFilter(BodyMotionItem* protoItem, Item* parentItem
 }
 
 
+/**
+   The binary format is not prefetched because its joint position sequence is read on demand
+   from the mapped file.
+*/
+static std::function<void()> prefetchYAMLMotion(const Archive& archive)
+{
+    string filename, format;
+    if(!(archive.readRelocatablePath("filename", filename) && archive.read("format", format) &&
+         format == "BODY-MOTION-YAML")){
+        return nullptr;
+    }
+    auto prefetched = make_shared<PrefetchedMotion>();
+    {
+        lock_guard<mutex> lock(prefetchedMotionMutex);
+        for(auto p = prefetchedMotions.begin(); p != prefetchedMotions.end(); ){
+            if(p->second.expired()){
+                p = prefetchedMotions.erase(p);
+            } else {
+                ++p;
+            }
+        }
+        prefetchedMotions[getAbsolutePathString(filename)] = prefetched;
+    }
+    return [prefetched, filename](){
+        auto motion = make_shared<BodyMotion>();
+        ostringstream os;
+        if(motion->load(filename, os)){
+            prefetched->motion = motion;
+            prefetched->message = os.str();
+        }
+    };
+}
+
+
+static bool loadYAMLMotion(BodyMotionItem* item, const std::string& filename, std::ostream& os)
+{
+    shared_ptr<PrefetchedMotion> prefetched;
+    {
+        lock_guard<mutex> lock(prefetchedMotionMutex);
+        auto p = prefetchedMotions.find(getAbsolutePathString(filename));
+        if(p != prefetchedMotions.end()){
+            prefetched = p->second.lock();
+            prefetchedMotions.erase(p);
+        }
+    }
+    if(prefetched && prefetched->motion){
+        *item->motion() = *prefetched->motion;
+        os << prefetched->message;
+        prefetched->motion.reset();
+        return true;
+    }
+    return item->motion()->load(filename, os);
+}
+
+
 void BodyMotionItem::initializeClass(ExtensionManager* ext)
 {
     static bool initialized = false;
@@ -127,7 +195,7 @@ void BodyMotionItem::initializeClass(ExtensionManager* ext)
     im.addLoaderAndSaver<BodyMotionItem>(
         _("Body Motion"), "BODY-MOTION-YAML", "seq;yaml",
         [](BodyMotionItem* item, const std::string& filename, std::ostream& os, Item* /* parentItem */){
-            return item->motion()->load(filename, os);
+            return loadYAMLMotion(item, filename, os);
         },
         [](BodyMotionItem* item, const std::string& filename, std::ostream& os, Item* /* parentItem */){
             return item->motion()->save(filename, os);
@@ -139,6 +207,17 @@ void BodyMotionItem::initializeClass(ExtensionManager* ext)
             return item->motion()->save(filename, 1.0, os);
         });
 
+    im.addLoaderAndSaver<BodyMotionItem>(
+        _("Body Motion (binary)"), "BODY-MOTION-BINARY", "cnoid-motion",
+        [](BodyMotionItem* item, const std::string& filename, std::ostream& os, Item* /* parentItem */){
+            return item->motion()->loadBinary(filename, os);
+        },
+        [](BodyMotionItem* item, const std::string& filename, std::ostream& os, Item* /* parentItem */){
+            return item->motion()->saveBinary(filename, os);
+        });
+
+    im.addRestorePrefetcher<BodyMotionItem>(prefetchYAMLMotion);
+
     initialized = true;
 }
 
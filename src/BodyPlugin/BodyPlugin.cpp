@@ -12,7 +12,10 @@
 #include "SimpleControllerItem.h"
 #include "BodyMotionControllerItem.h"
 #include "GLVisionSimulatorItem.h"
+#include "RayCastRangeSensorSimulatorItem.h"
 #include "WorldLogFileItem.h"
+#include "SimulationStreamServerItem.h"
+#include "SimulationStreamClientItem.h"
 #include "SensorVisualizerItem.h"
 #include "BodyTrackingCameraItem.h"
 #include "BodyMarkerItem.h"
@@ -28,8 +31,10 @@
 #include "BodyStateView.h"
 #include "JointGraphView.h"
 #include "LinkGraphView.h"
+#include "SimulationTimeStatisticsView.h"
 #include "KinematicsBar.h"
 #include "SimulationBar.h"
+#include "SimulationSweepRunner.h"
 #include "BodyMotionEngine.h"
 #include "EditableSceneBody.h"
 #include "HrpsysFileIO.h"
@@ -75,7 +80,10 @@ public:
         SimpleControllerItem::initializeClass(this);
         BodyMotionControllerItem::initializeClass(this);
         GLVisionSimulatorItem::initializeClass(this);
+        RayCastRangeSensorSimulatorItem::initializeClass(this);
         WorldLogFileItem::initializeClass(this);
+        SimulationStreamServerItem::initializeClass(this);
+        SimulationStreamClientItem::initializeClass(this);
         SensorVisualizerItem::initializeClass(this);
         BodyTrackingCameraItem::initializeClass(this);
         BodyMarkerItem::initializeClass(this);
@@ -92,6 +100,7 @@ public:
         EditableSceneBody::initializeClass(this);
 
         SimulationBar::initialize(this);
+        SimulationSweepRunner::initialize(this);
         addToolBar(BodyBar::instance());
         addToolBar(LeggedBodyBar::instance());
         addToolBar(KinematicsBar::instance());
@@ -104,6 +113,7 @@ public:
         BodyStateView::initializeClass(this);
         JointGraphView::initializeClass(this);
         LinkGraphView::initializeClass(this);
+        SimulationTimeStatisticsView::initializeClass(this);
 
         CollisionSeqItem::initislizeClass(this);
 
@@ -23,6 +23,222 @@ CollisionSeq::CollisionSeq(CollisionSeqItem* collisionSeqItem)
 {
     collisionSeqItem_ = collisionSeqItem;
     setSeqContentName(mdskey);
+    pairRecordOffset = 0;
+    contactOffset = 0;
+}
+
+
+CollisionSeq::CollisionSeq(const CollisionSeq& org)
+    : BaseSeqType(org),
+      linkPairs(org.linkPairs),
+      linkPairIdMap(org.linkPairIdMap),
+      pairRecords(org.pairRecords),
+      pairRecordOffset(org.pairRecordOffset),
+      contactPoints(org.contactPoints),
+      contactNormals(org.contactNormals),
+      contactDepths(org.contactDepths),
+      contactOffset(org.contactOffset)
+{
+    collisionSeqItem_ = nullptr;
+}
+
+
+CollisionSeq& CollisionSeq::operator=(const CollisionSeq& rhs)
+{
+    if(this != &rhs){
+        BaseSeqType::operator=(rhs);
+        linkPairs = rhs.linkPairs;
+        linkPairIdMap = rhs.linkPairIdMap;
+        pairRecords = rhs.pairRecords;
+        pairRecordOffset = rhs.pairRecordOffset;
+        contactPoints = rhs.contactPoints;
+        contactNormals = rhs.contactNormals;
+        contactDepths = rhs.contactDepths;
+        contactOffset = rhs.contactOffset;
+    }
+    return *this;
+}
+
+
+AbstractSeq& CollisionSeq::operator=(const AbstractSeq& rhs)
+{
+    if(auto rhsSeq = dynamic_cast<const CollisionSeq*>(&rhs)){
+        return operator=(*rhsSeq);
+    }
+    return AbstractSeq::operator=(rhs);
+}
+
+
+std::shared_ptr<AbstractSeq> CollisionSeq::cloneSeq() const
+{
+    return std::make_shared<CollisionSeq>(*this);
+}
+
+
+CollisionSeqFrameEntry CollisionSeq::defaultValue() const
+{
+    CollisionSeqFrameEntry entry;
+    entry.pairIndex = pairRecordOffset + pairRecords.size();
+    entry.numPairs = 0;
+    return entry;
+}
+
+
+void CollisionSeq::setDimension(int newNumFrames, int newNumParts, bool fillNewElements)
+{
+    // The number of parts is always one
+    const int prevNumFrames = (numParts() == 1) ? numFrames() : 0;
+    BaseSeqType::setDimension(newNumFrames, 1, false);
+    for(int i = prevNumFrames; i < newNumFrames; ++i){
+        if(fillNewElements && i > 0){
+            at(i, 0) = at(i - 1, 0);
+        } else {
+            at(i, 0) = defaultValue();
+        }
+    }
+    removeUnreferencedRecords();
+}
+
+
+void CollisionSeq::appendFrame(const CollisionLinkPairList& collisionPairs)
+{
+    CollisionSeqFrameEntry entry = defaultValue();
+    for(auto& linkPair : collisionPairs){
+        PairRecord record;
+        record.linkPairId = findOrAddLinkPair(*linkPair);
+        record.numContacts = linkPair->collisions.size();
+        record.contactIndex = contactOffset + contactPoints.size();
+        for(auto& collision : linkPair->collisions){
+            contactPoints.push_back(collision.point);
+            contactNormals.push_back(collision.normal);
+            contactDepths.push_back(collision.depth);
+        }
+        pairRecords.push_back(record);
+        ++entry.numPairs;
+    }
+    BaseSeqType::appendFrame()[0] = entry;
+}
+
+
+void CollisionSeq::popFrontFrame()
+{
+    popFrontFrames(1);
+}
+
+
+void CollisionSeq::popFrontFrames(int numFrames)
+{
+    BaseSeqType::popFrontFrames(numFrames);
+    removeUnreferencedRecords();
+}
+
+
+int CollisionSeq::findOrAddLinkPair(const CollisionLinkPair& linkPair)
+{
+    const std::pair<const Link*, const Link*> key(linkPair.link[0], linkPair.link[1]);
+    auto p = linkPairIdMap.find(key);
+    if(p != linkPairIdMap.end()){
+        return p->second;
+    }
+    const int id = linkPairs.size();
+    LinkPair newLinkPair;
+    for(int i=0; i < 2; ++i){
+        newLinkPair.body[i] = linkPair.body[i];
+        newLinkPair.link[i] = linkPair.link[i];
+    }
+    linkPairs.push_back(newLinkPair);
+    linkPairIdMap[key] = id;
+    return id;
+}
+
+
+/**
+   The records are referenced by the frames in the order of the frames,
+   so the records outside the range referenced by the first and last frames are removed.
+*/
+void CollisionSeq::removeUnreferencedRecords()
+{
+    int64_t pairBegin = pairRecordOffset + pairRecords.size();
+    int64_t pairEnd = pairBegin;
+    if(numFrames() > 0){
+        const CollisionSeqFrameEntry& first = at(0, 0);
+        const CollisionSeqFrameEntry& last = at(numFrames() - 1, 0);
+        pairBegin = std::max(first.pairIndex, pairRecordOffset);
+        pairEnd = std::max(last.pairIndex + last.numPairs, pairBegin);
+    }
+    pairRecords.erase(pairRecords.begin() + (pairEnd - pairRecordOffset), pairRecords.end());
+    pairRecords.erase(pairRecords.begin(), pairRecords.begin() + (pairBegin - pairRecordOffset));
+    pairRecordOffset = pairBegin;
+
+    int64_t contactBegin = contactOffset + contactPoints.size();
+    int64_t contactEnd = contactBegin;
+    if(!pairRecords.empty()){
+        contactBegin = pairRecords.front().contactIndex;
+        contactEnd = pairRecords.back().contactIndex + pairRecords.back().numContacts;
+    }
+    const int64_t numFrontContacts = contactBegin - contactOffset;
+    const int64_t numContacts = contactEnd - contactBegin;
+    contactPoints.erase(contactPoints.begin(), contactPoints.begin() + numFrontContacts);
+    contactPoints.resize(numContacts);
+    contactNormals.erase(contactNormals.begin(), contactNormals.begin() + numFrontContacts);
+    contactNormals.resize(numContacts);
+    contactDepths.erase(contactDepths.begin(), contactDepths.begin() + numFrontContacts);
+    contactDepths.resize(numContacts);
+    contactOffset = contactBegin;
+}
+
+
+void CollisionSeq::getContacts(int frame, int index, std::vector<Collision>& out_collisions) const
+{
+    const PairRecord& record = pairRecord(frame, index);
+    out_collisions.resize(record.numContacts);
+    const int64_t top = record.contactIndex - contactOffset;
+    for(int i=0; i < record.numContacts; ++i){
+        Collision& collision = out_collisions[i];
+        collision.point = contactPoints[top + i];
+        collision.normal = contactNormals[top + i];
+        collision.depth = contactDepths[top + i];
+        collision.id = 0;
+    }
+}
+
+
+CollisionLinkPairList CollisionSeq::collisionLinkPairs(int frame) const
+{
+    CollisionLinkPairList collisionPairs;
+    const int n = numLinkPairs(frame);
+    for(int i=0; i < n; ++i){
+        auto collisionPair = std::make_shared<CollisionLinkPair>();
+        const LinkPair& pair = linkPair(frame, i);
+        for(int j=0; j < 2; ++j){
+            collisionPair->body[j] = pair.body[j];
+            collisionPair->link[j] = pair.link[j];
+        }
+        getContacts(frame, i, collisionPair->collisions);
+        collisionPairs.push_back(collisionPair);
+    }
+    return collisionPairs;
+}
+
+
+size_t CollisionSeq::memorySize() const
+{
+    return numFrames() * sizeof(CollisionSeqFrameEntry) + sharedArraySize();
+}
+
+
+void CollisionSeq::countMemoryUsage(MemoryUsageCounter& counter) const
+{
+    BaseSeqType::countMemoryUsage(counter);
+    counter.add(sharedArraySize());
+}
+
+
+size_t CollisionSeq::sharedArraySize() const
+{
+    return pairRecords.size() * sizeof(PairRecord) +
+        contactPoints.size() * (2 * sizeof(Vector3) + sizeof(double)) +
+        linkPairs.capacity() * sizeof(LinkPair);
 }
 
 
@@ -82,7 +298,7 @@ bool CollisionSeq::doReadSeq(const Mapping* archive, std::ostream& os)
     const Listing& values = *archive->findListing("frames");
     if(values.isValid()){
         const int nFrames = values.size();
-        setDimension(nFrames, 1);
+        setDimension(0, 1);
         readCollisionData(nFrames, values);
     }
     return true;
@@ -108,8 +324,7 @@ void CollisionSeq::readCollisionData(int nFrames, const Listing& values)
     for(int i=0; i < nFrames; ++i){
         const Mapping& frameNode = *values[i].toMapping();
         const Listing& linkPairs = *frameNode.findListing("LinkPairs");
-        Frame f = frame(i);
-        f[0] = std::make_shared<CollisionLinkPairList>();
+        CollisionLinkPairList collisionPairs;
         for(int j=0; j<linkPairs.size(); j++){
             CollisionLinkPairPtr destLinkPair = std::make_shared<CollisionLinkPair>();
             const Mapping& linkPair = *linkPairs[j].toMapping();
@@ -144,8 +359,9 @@ void CollisionSeq::readCollisionData(int nFrames, const Listing& values)
                 destCol.normal = Vector3(collision[3].toDouble(), collision[4].toDouble(), collision[5].toDouble());
                 destCol.depth = collision[6].toDouble();
             }
-            f[0]->push_back(destLinkPair);
+            collisionPairs.push_back(destLinkPair);
         }
+        appendFrame(collisionPairs);
     }
 }
 
@@ -202,8 +418,7 @@ bool CollisionSeq::doWriteSeq(YAMLWriter& writer, std::function<void()> addition
             writer.startListing();
             const int n = numFrames();
             for(int i=0; i < n; ++i){
-                Frame f = frame(i);
-                writeCollsionData(writer, f[0]);
+                writeCollsionData(writer, std::make_shared<CollisionLinkPairList>(collisionLinkPairs(i)));
             }
             writer.endListing();
         });
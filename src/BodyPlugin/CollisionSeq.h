@@ -9,6 +9,9 @@
 #include <cnoid/CollisionLinkPair>
 #include <cnoid/MultiSeq>
 #include <cnoid/YAMLWriter>
+#include <deque>
+#include <map>
+#include <cstdint>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -18,15 +21,63 @@ class CollisionSeqItem;
 
 typedef std::vector<CollisionLinkPairPtr> CollisionLinkPairList;
 
-class CNOID_EXPORT CollisionSeq : public MultiSeq<std::shared_ptr<CollisionLinkPairList>>
+struct CollisionSeqFrameEntry
 {
-    typedef MultiSeq<std::shared_ptr<CollisionLinkPairList>> BaseSeqType;
+    //! The index of the first link pair record of the frame
+    int64_t pairIndex;
+    int numPairs;
+};
+
+/**
+   The collisions are stored in the shared columnar arrays instead of the lists of the
+   collision link pair objects. Each frame only has the range of the link pair records,
+   each of which has the ID of the link pair in the dictionary and the range of the contacts.
+   The frames given by filling the new elements share the records with the previous frame.
+   \note The elements of the frames must not be modified directly.
+*/
+class CNOID_EXPORT CollisionSeq : public MultiSeq<CollisionSeqFrameEntry>
+{
+    typedef MultiSeq<CollisionSeqFrameEntry> BaseSeqType;
 
 public:
     CollisionSeqItem* collisionSeqItem_;
     CollisionSeq(CollisionSeqItem* collisionSeqItem);
+    CollisionSeq(const CollisionSeq& org);
+
+    CollisionSeq& operator=(const CollisionSeq& rhs);
+    virtual AbstractSeq& operator=(const AbstractSeq& rhs) override;
+    virtual std::shared_ptr<AbstractSeq> cloneSeq() const override;
+
+    virtual void setDimension(int numFrames, int numParts, bool fillNewElements = false) override;
+
+    void appendFrame(const CollisionLinkPairList& collisionPairs);
+    void popFrontFrame();
+    void popFrontFrames(int numFrames);
+
+    struct LinkPair {
+        BodyPtr body[2];
+        Link* link[2];
+    };
 
-    using BaseSeqType::operator=;
+    int numLinkPairs(int frame) const {
+        return BaseSeqType::at(frame, 0).numPairs;
+    }
+    const LinkPair& linkPair(int frame, int index) const {
+        return linkPairs[pairRecord(frame, index).linkPairId];
+    }
+    int numContacts(int frame, int index) const {
+        return pairRecord(frame, index).numContacts;
+    }
+    //! The collisions of the link pair are stored to out_collisions without reallocating the memory
+    void getContacts(int frame, int index, std::vector<Collision>& out_collisions) const;
+
+    //! Gets the collisions of a frame as the list of the newly allocated collision link pair objects
+    CollisionLinkPairList collisionLinkPairs(int frame) const;
+
+    //! The number of bytes used by the frames and the shared arrays
+    size_t memorySize() const;
+
+    virtual void countMemoryUsage(MemoryUsageCounter& counter) const override;
 
     bool loadStandardYAMLformat(const std::string& filename);
     bool saveAsStandardYAMLformat(const std::string& filename);
@@ -34,8 +85,37 @@ public:
     void readCollisionData(int nFrames, const Listing& values);
 
 protected:
+    virtual CollisionSeqFrameEntry defaultValue() const override;
     virtual bool doReadSeq(const Mapping* archive, std::ostream& os) override;
     virtual bool doWriteSeq(YAMLWriter& writer, std::function<void()> additionalPartCallback) override;
+
+private:
+    struct PairRecord {
+        int linkPairId;
+        int numContacts;
+        //! The index of the first contact of the link pair
+        int64_t contactIndex;
+    };
+
+    const PairRecord& pairRecord(int frame, int index) const {
+        return pairRecords[BaseSeqType::at(frame, 0).pairIndex + index - pairRecordOffset];
+    }
+    int findOrAddLinkPair(const CollisionLinkPair& linkPair);
+    void removeUnreferencedRecords();
+    size_t sharedArraySize() const;
+
+    std::vector<LinkPair> linkPairs;
+    std::map<std::pair<const Link*, const Link*>, int> linkPairIdMap;
+
+    std::deque<PairRecord> pairRecords;
+    // The index of the front element of pairRecords
+    int64_t pairRecordOffset;
+
+    std::deque<Vector3> contactPoints;
+    std::deque<Vector3> contactNormals;
+    std::deque<double> contactDepths;
+    // The index of the front elements of the contact arrays
+    int64_t contactOffset;
 };
 
 }
@@ -21,6 +21,8 @@ public:
     WorldItemPtr worldItem;
     CollisionSeqItemPtr collisionSeqItem;
     shared_ptr<CollisionSeq> colSeq;
+    // The link pair objects reused in every frame
+    CollisionLinkPairList linkPairPool;
     CollisionSeqEngineImpl(CollisionSeqEngine* self, WorldItem* worldItem, CollisionSeqItem* collisionSeqItem){
         this->worldItem = worldItem;
         this->collisionSeqItem = collisionSeqItem;
@@ -36,11 +38,21 @@ public:
                 const int frame = colSeq->frameOfTime(time);
                 isValid = (frame < numFrames);
                 const int clampedFrame = colSeq->clampFrameIndex(frame);
-                const CollisionSeq::Frame collisionPairs0 = colSeq->frame(clampedFrame);
+                const int numLinkPairs = colSeq->numLinkPairs(clampedFrame);
+                while(static_cast<int>(linkPairPool.size()) < numLinkPairs){
+                    linkPairPool.push_back(std::make_shared<CollisionLinkPair>());
+                }
                 CollisionLinkPairList& collisionPairs = worldItem->collisions();
                 collisionPairs.clear();
-                for(size_t i=0; i < collisionPairs0[0]->size(); i++){
-                    collisionPairs.push_back(collisionPairs0[0]->at(i));
+                for(int i=0; i < numLinkPairs; ++i){
+                    CollisionLinkPair& collisionPair = *linkPairPool[i];
+                    const CollisionSeq::LinkPair& linkPair = colSeq->linkPair(clampedFrame, i);
+                    for(int j=0; j < 2; ++j){
+                        collisionPair.body[j] = linkPair.body[j];
+                        collisionPair.link[j] = linkPair.link[j];
+                    }
+                    colSeq->getContacts(clampedFrame, i, collisionPair.collisions);
+                    collisionPairs.push_back(linkPairPool[i]);
                 }
             }
         }
@@ -117,7 +117,19 @@ bool ControllerItem::restore(const Archive& archive)
     return true;
 }
 
-#ifdef ENABLE_SIMULATION_PROFILING
+
+ReferencedPtr ControllerItem::storeCheckpointState()
+{
+    return nullptr;
+}
+
+
+bool ControllerItem::restoreCheckpointState(Referenced* /* state */)
+{
+    return true;
+}
+
+
 void ControllerItem::getProfilingNames(vector<string>& profilingNames)
 {
 
@@ -128,4 +140,3 @@ void ControllerItem::getProfilingTimes(vector<double>& profilingToimes)
 {
 
 }
-#endif
@@ -72,10 +72,23 @@ public:
     */
     virtual void stop();
 
-#ifdef ENABLE_SIMULATION_PROFILING
+    /**
+       A controller which has internal states can override these functions to be restored
+       with SimulatorItem::restoreCheckpoint(). The object returned by storeCheckpointState()
+       is given to restoreCheckpointState(). A null object means that the controller
+       does not have states to restore.
+       @note These functions are called from the simulation thread between the simulation steps.
+    */
+    virtual ReferencedPtr storeCheckpointState();
+    virtual bool restoreCheckpointState(Referenced* state);
+
+    /**
+       These functions are used to add the computation times of the controller to the
+       simulation profiling data. The times are given in seconds.
+       @note getProfilingTimes() is called from the simulation thread when the profiling is enabled.
+    */
     virtual void getProfilingNames(std::vector<std::string>& profilingNames);
     virtual void getProfilingTimes(std::vector<double>& profilingTimes);
-#endif
 
     //! \deprecated Use isNoDelayMode.
     bool isImmediateMode() const { return isNoDelayMode(); }
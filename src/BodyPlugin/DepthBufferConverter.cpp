@@ -0,0 +1,359 @@
+/**
+   \author Shin'ichiro Nakaoka
+*/
+
+#include "DepthBufferConverter.h"
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+// A triangle covering the whole viewport is generated from the vertex ids
+const char* vertexShaderSource =
+    "#version 330\n"
+    "void main() {\n"
+    "    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+    "    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+// The same calculation as SensorScreenRenderer::getRangeCameraData
+const char* pointFragmentShaderSource =
+    "#version 330\n"
+    "uniform sampler2D depthTexture;\n"
+    "uniform mat4 inverseProjectionMatrix;\n"
+    "uniform vec2 depthSize;\n"
+    "out vec4 point;\n"
+    "void main() {\n"
+    "    ivec2 pixel = ivec2(gl_FragCoord.xy);\n"
+    "    float z = texelFetch(depthTexture, pixel, 0).r;\n"
+    "    if(z > 0.0 && z < 1.0){\n"
+    "        vec4 n = vec4(2.0 * pixel.x / depthSize.x - 1.0, 2.0 * pixel.y / depthSize.y - 1.0, 2.0 * z - 1.0, 1.0);\n"
+    "        vec4 o = inverseProjectionMatrix * n;\n"
+    "        point = vec4(o.xyz / o.w, 1.0);\n"
+    "    } else {\n"
+    "        point = vec4(0.0, 0.0, 0.0, (z <= 0.0) ? 0.0 : 2.0);\n"
+    "    }\n"
+    "}\n";
+
+// The same calculation as SensorScreenRenderer::getRangeSensorData
+const char* rangeFragmentShaderSource =
+    "#version 330\n"
+    "uniform sampler2D depthTexture;\n"
+    "uniform sampler2D sampleTexture;\n"
+    "uniform mat4 inverseProjectionMatrix;\n"
+    "uniform float depthError;\n"
+    "out float range;\n"
+    "void main() {\n"
+    "    vec4 s = texelFetch(sampleTexture, ivec2(gl_FragCoord.xy), 0);\n"
+    "    float depth = texelFetch(depthTexture, ivec2(s.xy), 0).r;\n"
+    "    if(depth > 0.0 && depth < 1.0){\n"
+    "        float w = inverseProjectionMatrix[2][3] * (2.0 * depth - 1.0) + inverseProjectionMatrix[3][3];\n"
+    "        range = abs((-1.0 / w + depthError) * s.z);\n"
+    "    } else {\n"
+    "        range = -1.0;\n"
+    "    }\n"
+    "}\n";
+
+}
+
+
+DepthBufferConverter::DepthBufferConverter()
+{
+    isPointMode = true;
+    depthWidth = 0;
+    depthHeight = 0;
+    sourceX = 0;
+    sourceY = 0;
+    outputWidth_ = 0;
+    outputHeight_ = 0;
+    depthError = 0.0f;
+    program = 0;
+    vertexArray = 0;
+    depthTexture = 0;
+    depthFrameBuffer = 0;
+    sampleTexture = 0;
+    outputTexture = 0;
+    outputFrameBuffer = 0;
+}
+
+
+bool DepthBufferConverter::resolveFunctions(GetProcAddressFunction& getProcAddress)
+{
+#define CNOID_RESOLVE_GL_FUNCTION(name) (name = reinterpret_cast<decltype(name)>(getProcAddress(#name)))
+    return
+        CNOID_RESOLVE_GL_FUNCTION(glActiveTexture) &&
+        CNOID_RESOLVE_GL_FUNCTION(glCreateShader) &&
+        CNOID_RESOLVE_GL_FUNCTION(glShaderSource) &&
+        CNOID_RESOLVE_GL_FUNCTION(glCompileShader) &&
+        CNOID_RESOLVE_GL_FUNCTION(glGetShaderiv) &&
+        CNOID_RESOLVE_GL_FUNCTION(glDeleteShader) &&
+        CNOID_RESOLVE_GL_FUNCTION(glCreateProgram) &&
+        CNOID_RESOLVE_GL_FUNCTION(glAttachShader) &&
+        CNOID_RESOLVE_GL_FUNCTION(glLinkProgram) &&
+        CNOID_RESOLVE_GL_FUNCTION(glGetProgramiv) &&
+        CNOID_RESOLVE_GL_FUNCTION(glDeleteProgram) &&
+        CNOID_RESOLVE_GL_FUNCTION(glUseProgram) &&
+        CNOID_RESOLVE_GL_FUNCTION(glGetUniformLocation) &&
+        CNOID_RESOLVE_GL_FUNCTION(glUniform1i) &&
+        CNOID_RESOLVE_GL_FUNCTION(glUniform1f) &&
+        CNOID_RESOLVE_GL_FUNCTION(glUniform2f) &&
+        CNOID_RESOLVE_GL_FUNCTION(glUniformMatrix4fv) &&
+        CNOID_RESOLVE_GL_FUNCTION(glGenVertexArrays) &&
+        CNOID_RESOLVE_GL_FUNCTION(glBindVertexArray) &&
+        CNOID_RESOLVE_GL_FUNCTION(glDeleteVertexArrays) &&
+        CNOID_RESOLVE_GL_FUNCTION(glGenFramebuffers) &&
+        CNOID_RESOLVE_GL_FUNCTION(glBindFramebuffer) &&
+        CNOID_RESOLVE_GL_FUNCTION(glFramebufferTexture2D) &&
+        CNOID_RESOLVE_GL_FUNCTION(glCheckFramebufferStatus) &&
+        CNOID_RESOLVE_GL_FUNCTION(glBlitFramebuffer) &&
+        CNOID_RESOLVE_GL_FUNCTION(glDeleteFramebuffers);
+#undef CNOID_RESOLVE_GL_FUNCTION
+}
+
+
+bool DepthBufferConverter::initializeProgram(const char* fragmentShaderSource)
+{
+    const char* sources[] = { vertexShaderSource, fragmentShaderSource };
+    const GLenum types[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    GLuint shaders[2];
+    bool compiled = true;
+    for(int i=0; i < 2; ++i){
+        shaders[i] = glCreateShader(types[i]);
+        glShaderSource(shaders[i], 1, &sources[i], nullptr);
+        glCompileShader(shaders[i]);
+        GLint status;
+        glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &status);
+        compiled = compiled && (status == GL_TRUE);
+    }
+    if(compiled){
+        program = glCreateProgram();
+        glAttachShader(program, shaders[0]);
+        glAttachShader(program, shaders[1]);
+        glLinkProgram(program);
+        GLint status;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if(status != GL_TRUE){
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    glDeleteShader(shaders[0]);
+    glDeleteShader(shaders[1]);
+
+    if(!program){
+        return false;
+    }
+
+    depthTextureLocation = glGetUniformLocation(program, "depthTexture");
+    sampleTextureLocation = glGetUniformLocation(program, "sampleTexture");
+    inverseProjectionMatrixLocation = glGetUniformLocation(program, "inverseProjectionMatrix");
+    depthSizeLocation = glGetUniformLocation(program, "depthSize");
+    depthErrorLocation = glGetUniformLocation(program, "depthError");
+
+    glGenVertexArrays(1, &vertexArray);
+
+    // The depth format must be the same as the frame buffer object to blit the depth buffer
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, depthWidth, depthHeight, 0,
+                 GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint drawFrameBuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFrameBuffer);
+    glGenFramebuffers(1, &depthFrameBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, depthFrameBuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    const bool isComplete = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, drawFrameBuffer);
+
+    return isComplete;
+}
+
+
+bool DepthBufferConverter::createOutputFrameBuffer(GLint internalFormat, GLenum format)
+{
+    glGenTextures(1, &outputTexture);
+    glBindTexture(GL_TEXTURE_2D, outputTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, outputWidth_, outputHeight_, 0, format, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint drawFrameBuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFrameBuffer);
+    glGenFramebuffers(1, &outputFrameBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFrameBuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, outputTexture, 0);
+    const bool isComplete = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, drawFrameBuffer);
+
+    return isComplete;
+}
+
+
+bool DepthBufferConverter::initializeForPoints(int width, int height, GetProcAddressFunction getProcAddress)
+{
+    release();
+    isPointMode = true;
+    depthWidth = width;
+    depthHeight = height;
+    outputWidth_ = width;
+    outputHeight_ = height;
+
+    if(resolveFunctions(getProcAddress) &&
+       initializeProgram(pointFragmentShaderSource) &&
+       createOutputFrameBuffer(GL_RGBA32F, GL_RGBA)){
+        return true;
+    }
+    release();
+    return false;
+}
+
+
+bool DepthBufferConverter::initializeForRanges
+(int depthWidth, int depthHeight, int numColumns, int numRows,
+ const std::vector<Vector2f>& pixels, const std::vector<double>& scales, GetProcAddressFunction getProcAddress)
+{
+    release();
+    isPointMode = false;
+    this->depthWidth = depthWidth;
+    this->depthHeight = depthHeight;
+    outputWidth_ = numColumns;
+    outputHeight_ = numRows;
+
+    if(!(resolveFunctions(getProcAddress) &&
+         initializeProgram(rangeFragmentShaderSource) &&
+         createOutputFrameBuffer(GL_R32F, GL_RED))){
+        release();
+        return false;
+    }
+
+    const int numSamples = numColumns * numRows;
+    vector<float> samples(numSamples * 3);
+    for(int i=0; i < numSamples; ++i){
+        samples[i * 3] = pixels[i].x();
+        samples[i * 3 + 1] = pixels[i].y();
+        samples[i * 3 + 2] = scales[i];
+    }
+    glGenTextures(1, &sampleTexture);
+    glBindTexture(GL_TEXTURE_2D, sampleTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, numColumns, numRows, 0, GL_RGB, GL_FLOAT, &samples[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return true;
+}
+
+
+void DepthBufferConverter::release()
+{
+    if(program){
+        glDeleteProgram(program);
+        program = 0;
+    }
+    if(vertexArray){
+        glDeleteVertexArrays(1, &vertexArray);
+        vertexArray = 0;
+    }
+    if(depthFrameBuffer){
+        glDeleteFramebuffers(1, &depthFrameBuffer);
+        depthFrameBuffer = 0;
+    }
+    if(outputFrameBuffer){
+        glDeleteFramebuffers(1, &outputFrameBuffer);
+        outputFrameBuffer = 0;
+    }
+    GLuint textures[] = { depthTexture, sampleTexture, outputTexture };
+    for(auto texture : textures){
+        if(texture){
+            glDeleteTextures(1, &texture);
+        }
+    }
+    depthTexture = 0;
+    sampleTexture = 0;
+    outputTexture = 0;
+}
+
+
+void DepthBufferConverter::convert(const Matrix4& projectionMatrix)
+{
+    GLint drawFrameBuffer, readFrameBuffer, currentProgram, currentVertexArray, activeTexture;
+    GLint textureBindings[2];
+    GLint viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFrameBuffer);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFrameBuffer);
+    glGetIntegerv(GL_CURRENT_PROGRAM, &currentProgram);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &currentVertexArray);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    const GLenum capabilities[] = { GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST };
+    GLboolean isEnabled[5];
+    for(int i=0; i < 5; ++i){
+        isEnabled[i] = glIsEnabled(capabilities[i]);
+        glDisable(capabilities[i]);
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFrameBuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFrameBuffer);
+    glBlitFramebuffer(sourceX, sourceY, sourceX + depthWidth, sourceY + depthHeight,
+                      0, 0, depthWidth, depthHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, outputFrameBuffer);
+    glViewport(0, 0, outputWidth_, outputHeight_);
+    glUseProgram(program);
+    glBindVertexArray(vertexArray);
+
+    glActiveTexture(GL_TEXTURE0);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &textureBindings[0]);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glUniform1i(depthTextureLocation, 0);
+    if(sampleTexture){
+        glActiveTexture(GL_TEXTURE1);
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &textureBindings[1]);
+        glBindTexture(GL_TEXTURE_2D, sampleTexture);
+        glUniform1i(sampleTextureLocation, 1);
+    }
+    const Matrix4f Pinv = projectionMatrix.inverse().cast<float>();
+    glUniformMatrix4fv(inverseProjectionMatrixLocation, 1, GL_FALSE, Pinv.data());
+    if(isPointMode){
+        glUniform2f(depthSizeLocation, depthWidth, depthHeight);
+    } else {
+        glUniform1f(depthErrorLocation, depthError);
+    }
+
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    if(sampleTexture){
+        glBindTexture(GL_TEXTURE_2D, textureBindings[1]);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    glBindTexture(GL_TEXTURE_2D, textureBindings[0]);
+    glActiveTexture(activeTexture);
+    glBindVertexArray(currentVertexArray);
+    glUseProgram(currentProgram);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    for(int i=0; i < 5; ++i){
+        if(isEnabled[i]){
+            glEnable(capabilities[i]);
+        }
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFrameBuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFrameBuffer);
+}
+
+
+void DepthBufferConverter::readOutput(void* buffer)
+{
+    GLint readFrameBuffer;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFrameBuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, outputFrameBuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, outputWidth_, outputHeight_, isPointMode ? GL_RGBA : GL_RED, GL_FLOAT, buffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFrameBuffer);
+}
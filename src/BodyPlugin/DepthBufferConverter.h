@@ -0,0 +1,131 @@
+/**
+   \author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_BODYPLUGIN_DEPTH_BUFFER_CONVERTER_H
+#define CNOID_BODYPLUGIN_DEPTH_BUFFER_CONVERTER_H
+
+#include <cnoid/EigenTypes>
+#include <qopengl.h>
+#include <functional>
+#include <vector>
+
+namespace cnoid {
+
+/**
+   This class converts the depth buffer of the current frame buffer object into the points
+   or the ranges with a shader so that only the converted data has to be read back.
+   All the functions must be called while the OpenGL context used for the initialization is
+   current, and OpenGL 3.3 is required.
+*/
+class DepthBufferConverter
+{
+public:
+    typedef void (*FunctionPointer)();
+    typedef std::function<FunctionPointer(const char* name)> GetProcAddressFunction;
+
+    DepthBufferConverter();
+
+    /**
+       Each pixel is converted into the point (x, y, z, s) in the camera coordinate, where s is
+       1 for a valid point, 0 for the pixel without any object and 2 for the pixel at the far
+       clip plane. The coordinates are zero when s is not 1.
+    */
+    bool initializeForPoints(int width, int height, GetProcAddressFunction getProcAddress);
+
+    /**
+       The ranges are sampled from the depth buffer at the given pixels.
+       \param pixels The pixel (px, py) of each sample. The samples are stored in the row-major
+       order of numRows rows and numColumns columns.
+       \param scales The scale of each sample from the depth to the range
+       The range is -1 when a sample does not hit any object.
+    */
+    bool initializeForRanges(
+        int depthWidth, int depthHeight, int numColumns, int numRows,
+        const std::vector<Vector2f>& pixels, const std::vector<double>& scales,
+        GetProcAddressFunction getProcAddress);
+
+    //! This must be called before the context is destroyed
+    void release();
+
+    bool isInitialized() const { return program != 0; }
+    int outputWidth() const { return outputWidth_; }
+    int outputHeight() const { return outputHeight_; }
+    int numOutputComponents() const { return isPointMode ? 4 : 1; }
+
+    //! The depth error is added to the depth of each range
+    void setDepthError(float e) { depthError = e; }
+
+    //! The position of the depth region to convert in the frame buffer. The default is (0, 0).
+    void setSourceOffset(int x, int y) { sourceX = x; sourceY = y; }
+
+    /**
+       The depth buffer of the frame buffer object bound to GL_DRAW_FRAMEBUFFER is converted.
+       The states of the context which are changed by the conversion are restored.
+    */
+    void convert(const Matrix4& projectionMatrix);
+
+    /**
+       The converted data is read into the buffer of outputWidth() * outputHeight() *
+       numOutputComponents() floats. When a pixel pack buffer is bound, buffer is the offset in it.
+    */
+    void readOutput(void* buffer);
+
+private:
+    bool isPointMode;
+    int depthWidth;
+    int depthHeight;
+    int sourceX;
+    int sourceY;
+    int outputWidth_;
+    int outputHeight_;
+    float depthError;
+
+    GLuint program;
+    GLint depthTextureLocation;
+    GLint sampleTextureLocation;
+    GLint inverseProjectionMatrixLocation;
+    GLint depthSizeLocation;
+    GLint depthErrorLocation;
+    GLuint vertexArray;
+    GLuint depthTexture;
+    GLuint depthFrameBuffer;
+    GLuint sampleTexture;
+    GLuint outputTexture;
+    GLuint outputFrameBuffer;
+
+    PFNGLACTIVETEXTUREPROC glActiveTexture;
+    PFNGLCREATESHADERPROC glCreateShader;
+    PFNGLSHADERSOURCEPROC glShaderSource;
+    PFNGLCOMPILESHADERPROC glCompileShader;
+    PFNGLGETSHADERIVPROC glGetShaderiv;
+    PFNGLDELETESHADERPROC glDeleteShader;
+    PFNGLCREATEPROGRAMPROC glCreateProgram;
+    PFNGLATTACHSHADERPROC glAttachShader;
+    PFNGLLINKPROGRAMPROC glLinkProgram;
+    PFNGLGETPROGRAMIVPROC glGetProgramiv;
+    PFNGLDELETEPROGRAMPROC glDeleteProgram;
+    PFNGLUSEPROGRAMPROC glUseProgram;
+    PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation;
+    PFNGLUNIFORM1IPROC glUniform1i;
+    PFNGLUNIFORM1FPROC glUniform1f;
+    PFNGLUNIFORM2FPROC glUniform2f;
+    PFNGLUNIFORMMATRIX4FVPROC glUniformMatrix4fv;
+    PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
+    PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
+    PFNGLDELETEVERTEXARRAYSPROC glDeleteVertexArrays;
+    PFNGLGENFRAMEBUFFERSPROC glGenFramebuffers;
+    PFNGLBINDFRAMEBUFFERPROC glBindFramebuffer;
+    PFNGLFRAMEBUFFERTEXTURE2DPROC glFramebufferTexture2D;
+    PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus;
+    PFNGLBLITFRAMEBUFFERPROC glBlitFramebuffer;
+    PFNGLDELETEFRAMEBUFFERSPROC glDeleteFramebuffers;
+
+    bool resolveFunctions(GetProcAddressFunction& getProcAddress);
+    bool initializeProgram(const char* fragmentShaderSource);
+    bool createOutputFrameBuffer(GLint internalFormat, GLenum format);
+};
+
+}
+
+#endif
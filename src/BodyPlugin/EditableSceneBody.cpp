@@ -448,7 +448,11 @@ void EditableSceneBodyImpl::onKinematicStateChanged()
         }
     }
 
-    self->updateLinkPositions(modified);
+    if(BodyItem::isEmittingBatchedKinematicStateChanges()){
+        self->updateLinkPositionsWithSingleNotification(modified);
+    } else {
+        self->updateLinkPositions(modified);
+    }
 }
 
 
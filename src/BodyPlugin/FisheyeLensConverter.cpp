@@ -14,6 +14,11 @@ namespace {
 
 static const bool DEBUG_MESSAGE2 = false;
 
+// The bilinear weights are represented in this fixed point precision
+static const int WeightBits = 14;
+
+static const unsigned char blackPixel[3] = { 0, 0, 0 };
+
 int clamp(int i, int min, int max)
 {
     return i < min ? min : i < max ? i : max - 1;
@@ -53,6 +58,8 @@ void FisheyeLensConverter::initialize(int width_, int height_, double fov_, int
     screenWidth = screenWidth_;
     fisheyeLensMap.clear();
     fisheyeLensInterpolationMap.clear();
+    remapTable.clear();
+    interpolationRemapTable.clear();
 
     screenImages.clear();
 }
@@ -69,6 +76,8 @@ void FisheyeLensConverter::setImageRotationEnabled(bool on)
     if(on != isImageRotationEnabled){
         fisheyeLensMap.clear();
         fisheyeLensInterpolationMap.clear();
+        remapTable.clear();
+        interpolationRemapTable.clear();
         isImageRotationEnabled = on;
     }
 }
@@ -80,6 +89,74 @@ void FisheyeLensConverter::setAntiAliasingEnabled(bool on)
 }
 
 
+void FisheyeLensConverter::updateRemapTables()
+{
+    auto toEntry = [&](const ScreenIndex& index){
+        RemapEntry entry;
+        if(index.screenId == NO_SCREEN){
+            entry.source = NUM_SOURCES - 1;
+            entry.offset = 0;
+        } else {
+            entry.source = index.screenId;
+            entry.offset = (index.ix + index.iy * screenWidth) * 3;
+        }
+        return entry;
+    };
+    
+    if(!fisheyeLensMap.empty()){
+        remapTable.resize(width * height);
+        for(int j=0; j < height; ++j){
+            for(int i=0; i < width; ++i){
+                remapTable[i + j * width] = toEntry(fisheyeLensMap[j][i]);
+            }
+        }
+        fisheyeLensMap.clear();
+    }
+    
+    if(!fisheyeLensInterpolationMap.empty()){
+        interpolationRemapTable.resize(width * height);
+        for(int j=0; j < height; ++j){
+            for(int i=0; i < width; ++i){
+                ScreenIndex4& map = fisheyeLensInterpolationMap[j][i];
+                RemapEntry4& entry = interpolationRemapTable[i + j * width];
+                if(map.screenIndex[0].screenId == NO_SCREEN){
+                    for(int k=0; k < 4; ++k){
+                        entry.entries[k] = toEntry(map.screenIndex[0]);
+                        entry.weights[k] = 0;
+                    }
+                } else {
+                    // The rounding error is put on the largest weight so that the sum is exactly one
+                    int sum = 0;
+                    int maxIndex = 0;
+                    for(int k=0; k < 4; ++k){
+                        entry.entries[k] = toEntry(map.screenIndex[k]);
+                        entry.weights[k] = myNearByInt(map.bias[k] * (1 << WeightBits));
+                        sum += entry.weights[k];
+                        if(map.bias[k] > map.bias[maxIndex]){
+                            maxIndex = k;
+                        }
+                    }
+                    entry.weights[maxIndex] += (1 << WeightBits) - sum;
+                }
+            }
+        }
+        fisheyeLensInterpolationMap.clear();
+    }
+}
+
+
+void FisheyeLensConverter::getSourcePixels(const unsigned char* sources[])
+{
+    for(int i=0; i < NUM_SOURCES; ++i){
+        if(i < static_cast<int>(screenImages.size()) && i < NUM_SOURCES - 1){
+            sources[i] = screenImages[i]->pixels();
+        } else {
+            sources[i] = blackPixel;
+        }
+    }
+}
+
+
 void FisheyeLensConverter::setCornerPoint(int i, Corner corner)
 {
     switch(corner){
@@ -227,7 +304,7 @@ void FisheyeLensConverter::convertImageWithoutAntiAliasing(Image* image)
     image->setSize(width, height, 3);
     unsigned char* pixels = image->pixels();
 
-    if(fisheyeLensMap.empty()){
+    if(remapTable.empty()){
         fisheyeLensMap.resize(height);
         for(int i=0; i<height; i++){
             fisheyeLensMap[i].resize(width);
@@ -403,21 +480,19 @@ void FisheyeLensConverter::convertImageWithoutAntiAliasing(Image* image)
                 }
             }
         }
+        updateRemapTables();
     }else{
-        for(int j=0; j<height; j++){
-            for(int i=0; i<width; i++){
-                unsigned char* pix = &pixels[(i+j*width)*3];
-                ScreenIndex& screenIndex = fisheyeLensMap[j][i];
-                if(screenIndex.screenId != NO_SCREEN){
-                    unsigned char* tempPixels = screenImages[screenIndex.screenId]->pixels();
-                    unsigned char* tempPix = &tempPixels[(int)((screenIndex.ix + screenIndex.iy * screenWidth) * 3)];
-                    pix[0] = tempPix[0];
-                    pix[1] = tempPix[1];
-                    pix[2] = tempPix[2];
-                }else{
-                    pix[0] = pix[1] = pix[2] = 0;
-                }
-            }
+        const unsigned char* sources[NUM_SOURCES];
+        getSourcePixels(sources);
+        const int n = width * height;
+        const RemapEntry* entry = &remapTable[0];
+        for(int i=0; i < n; ++i){
+            const unsigned char* src = sources[entry->source] + entry->offset;
+            pixels[0] = src[0];
+            pixels[1] = src[1];
+            pixels[2] = src[2];
+            pixels += 3;
+            ++entry;
         }
     }
 }
@@ -428,7 +503,7 @@ void  FisheyeLensConverter::convertImageWithAntiAliasing(Image* image)
     image->setSize(width, height, 3);
     unsigned char* pixels = image->pixels();
 
-    if(fisheyeLensInterpolationMap.empty()){
+    if(interpolationRemapTable.empty()){
         fisheyeLensInterpolationMap.resize(height);
         for(int i=0; i<height; i++){
             fisheyeLensInterpolationMap[i].resize(width);
@@ -900,27 +975,27 @@ void  FisheyeLensConverter::convertImageWithAntiAliasing(Image* image)
                 }
             }
         }
+        updateRemapTables();
     }else{
-        for(int j=0; j<height; j++){
-            for(int i=0; i<width; i++){
-                unsigned char* pix = &pixels[(i+j*width)*3];
-                ScreenIndex4& map = fisheyeLensInterpolationMap[j][i];
-                if(map.screenIndex[0].screenId != NO_SCREEN){
-                    double pixd[3] = {0.0,0.0,0.0};
-                    for(int k=0; k<4; k++){
-                        unsigned char* tempPixels = screenImages[map.screenIndex[k].screenId]->pixels();
-                        unsigned char* tempPix = &tempPixels[(int)((map.screenIndex[k].ix + map.screenIndex[k].iy * screenWidth) * 3)];
-                        for(int kk=0; kk<3; kk++){
-                            pixd[kk] += map.bias[k] * tempPix[kk];
-                        }
-                    }
-                    for(int kk=0; kk<3; kk++){
-                        pix[kk] = myNearByInt(pixd[kk]);
-                    }
-                }else{
-                    pix[0] = pix[1] = pix[2] = 0;
-                }
+        const unsigned char* sources[NUM_SOURCES];
+        getSourcePixels(sources);
+        const int n = width * height;
+        const RemapEntry4* entry = &interpolationRemapTable[0];
+        const int half = 1 << (WeightBits - 1);
+        for(int i=0; i < n; ++i){
+            int sum[3] = { half, half, half };
+            for(int k=0; k < 4; ++k){
+                const unsigned char* src = sources[entry->entries[k].source] + entry->entries[k].offset;
+                const int w = entry->weights[k];
+                sum[0] += w * src[0];
+                sum[1] += w * src[1];
+                sum[2] += w * src[2];
             }
+            pixels[0] = sum[0] >> WeightBits;
+            pixels[1] = sum[1] >> WeightBits;
+            pixels[2] = sum[2] >> WeightBits;
+            pixels += 3;
+            ++entry;
         }
     }
 }
@@ -52,6 +52,23 @@ private:
     };
     std::vector<std::vector<ScreenIndex4>> fisheyeLensInterpolationMap;
 
+    /*
+      The maps are flattened into the following tables after they are built by the first
+      conversion, and the following conversions only look up the tables. The pixels out of
+      the screens refer to a black pixel whose source index is NUM_SOURCES - 1.
+    */
+    enum { NUM_SOURCES = 7 };
+    struct RemapEntry {
+        int source;
+        int offset;
+    };
+    std::vector<RemapEntry> remapTable;
+    struct RemapEntry4 {
+        RemapEntry entries[4];
+        int weights[4];
+    };
+    std::vector<RemapEntry4> interpolationRemapTable;
+
     enum Corner {
         FRONT_UR,  FRONT_UL,  FRONT_DR,  FRONT_DL,
         LEFT_UR,   LEFT_UL,   LEFT_DR,   LEFT_DL,
@@ -68,6 +85,8 @@ private:
     void setHorizontalBorder(int id0, int id1, double sx);
     void convertImageWithoutAntiAliasing(Image* image);
     void convertImageWithAntiAliasing(Image* image);
+    void updateRemapTables();
+    void getSourcePixels(const unsigned char* sources[]);
 };
 
 }
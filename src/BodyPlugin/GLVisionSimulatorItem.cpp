@@ -7,7 +7,11 @@
 #include "SimulatorItem.h"
 #include "WorldItem.h"
 #include "FisheyeLensConverter.h"
+#include "DepthBufferConverter.h"
+#include "SimulationStreamProtocol.h"
 #include <cnoid/ItemManager>
+#include <cnoid/OptionManager>
+#include <cnoid/RootItem>
 #include <cnoid/MessageView>
 #include <cnoid/Archive>
 #include <cnoid/ValueTreeUtil>
@@ -22,17 +26,37 @@
 #include <cnoid/SceneCameras>
 #include <cnoid/SceneLights>
 #include <cnoid/EigenUtil>
+#include <cnoid/SharedObjectPool>
+#include <cnoid/MemoryUsage>
+#include <cnoid/TraceRecorder>
 #include <QThread>
 #include <QApplication>
 #include <QOpenGLContext>
 #include <QOffscreenSurface>
 #include <QOpenGLFramebufferObject>
+#include <QTcpSocket>
+#include <QTcpServer>
+#include <QHostAddress>
+#ifdef CNOID_ENABLE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 #include <fmt/format.h>
 #include <boost/tokenizer.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
 #include <mutex>
 #include <condition_variable>
 #include <queue>
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
 #include <iostream>
 #include "gettext.h"
 
@@ -40,10 +64,33 @@ static const bool DEBUG_MESSAGE = false;
 
 using namespace std;
 using namespace cnoid;
+using simulation_stream::MessageWriter;
+using simulation_stream::MessageReader;
+using simulation_stream::NotEnoughDataException;
+using simulation_stream::maxMessageSize;
 using fmt::format;
 
 namespace {
 
+/*
+  The messages of the remote rendering, which are framed in the same way as the simulation
+  stream. The client sends SETUP with the names of the simulation bodies and the target sensors,
+  and the render node replies SETUP_RESULT after initializing the renderers of the sensors.
+  Then the client sends RENDER with the positions of the links moved and the device states
+  changed since the last request, and the render node replies RENDER_RESULT for each of the
+  requested sensors. The images and the depth data are compressed with zlib.
+*/
+const char* const remoteRenderingMagic = "CNOID-VISION-RENDERING";
+const int remoteRenderingProtocolVersion = 1;
+const int defaultRemoteRenderingPort = 47111;
+
+enum RemoteRenderingMessageID {
+    SETUP,
+    SETUP_RESULT,
+    RENDER,
+    RENDER_RESULT
+};
+
 enum ScreenId {
     NO_SCREEN = FisheyeLensConverter::NO_SCREEN,
     FRONT_SCREEN = FisheyeLensConverter::FRONT_SCREEN,
@@ -101,6 +148,69 @@ bool updateNames(const string& nameListString, string& newNameListString, vector
     return true;
 }
 
+void writeCompressedData(MessageWriter& writer, const char* data, size_t size)
+{
+    namespace io = boost::iostreams;
+    
+    vector<char> compressed;
+    if(size > 0){
+        io::filtering_ostream out;
+        out.push(io::zlib_compressor(io::zlib::best_speed));
+        out.push(io::back_inserter(compressed));
+        out.write(data, size);
+    }
+    writer.writeInt(size);
+    writer.writeInt(compressed.size());
+    writer.writeBytes(compressed.data(), compressed.size());
+}
+
+void readCompressedData(MessageReader& reader, char* out_data, size_t size)
+{
+    namespace io = boost::iostreams;
+
+    const size_t rawSize = reader.readInt();
+    const int compressedSize = reader.readInt();
+    if(rawSize != size || compressedSize < 0 || reader.remainingSize() < static_cast<size_t>(compressedSize)){
+        throw NotEnoughDataException();
+    }
+    if(size > 0){
+        io::filtering_istream in;
+        in.push(io::zlib_decompressor());
+        in.push(io::array_source(reader.current(), compressedSize));
+        in.read(out_data, size);
+        if(static_cast<size_t>(in.gcount()) != size){
+            throw NotEnoughDataException();
+        }
+    }
+    reader.skip(compressedSize);
+}
+
+/**
+   The complete messages in the buffer are processed and removed from the buffer.
+   False is returned when the buffer has an invalid message.
+*/
+bool processReceivedMessages(vector<char>& buffer, std::function<void(MessageReader& reader)> process)
+{
+    size_t pos = 0;
+    bool isValid = true;
+    while(buffer.size() - pos >= 4){
+        MessageReader header(buffer.data() + pos, 4);
+        const uint32_t size = header.readInt();
+        if(size == 0 || size > maxMessageSize){
+            isValid = false;
+            break;
+        }
+        if(buffer.size() - pos < size + 4){
+            break;
+        }
+        MessageReader reader(buffer.data() + pos + 4, size);
+        process(reader);
+        pos += size + 4;
+    }
+    buffer.erase(buffer.begin(), buffer.begin() + pos);
+    return isValid;
+}
+
 class QThreadEx : public QThread
 {
     std::function<void()> function;
@@ -114,13 +224,268 @@ public:
     }
 };
 
+/**
+   The functions for the readback with the pixel buffer objects and the fences.
+   They are resolved from the context because the functions of OpenGL 3.2 are not
+   exported by the OpenGL libraries of some platforms.
+*/
+class PixelBufferFunctions
+{
+public:
+    PFNGLGENBUFFERSPROC glGenBuffers;
+    PFNGLDELETEBUFFERSPROC glDeleteBuffers;
+    PFNGLBINDBUFFERPROC glBindBuffer;
+    PFNGLBUFFERDATAPROC glBufferData;
+    PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+    PFNGLUNMAPBUFFERPROC glUnmapBuffer;
+    PFNGLFENCESYNCPROC glFenceSync;
+    PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+    PFNGLDELETESYNCPROC glDeleteSync;
+
+    //! The context must be current and support OpenGL 3.2
+    template<class GetProcAddress>
+    bool resolve(GetProcAddress getProcAddress){
+        glGenBuffers = (PFNGLGENBUFFERSPROC) getProcAddress("glGenBuffers");
+        glDeleteBuffers = (PFNGLDELETEBUFFERSPROC) getProcAddress("glDeleteBuffers");
+        glBindBuffer = (PFNGLBINDBUFFERPROC) getProcAddress("glBindBuffer");
+        glBufferData = (PFNGLBUFFERDATAPROC) getProcAddress("glBufferData");
+        glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC) getProcAddress("glMapBufferRange");
+        glUnmapBuffer = (PFNGLUNMAPBUFFERPROC) getProcAddress("glUnmapBuffer");
+        glFenceSync = (PFNGLFENCESYNCPROC) getProcAddress("glFenceSync");
+        glClientWaitSync = (PFNGLCLIENTWAITSYNCPROC) getProcAddress("glClientWaitSync");
+        glDeleteSync = (PFNGLDELETESYNCPROC) getProcAddress("glDeleteSync");
+        return glGenBuffers && glDeleteBuffers && glBindBuffer && glBufferData && glMapBufferRange &&
+            glUnmapBuffer && glFenceSync && glClientWaitSync && glDeleteSync;
+    }
+};
+
+// The timeout of a wait for the fence of a readback in nanoseconds
+const GLuint64 READBACK_WAIT_TIMEOUT = 100000000;
+
+// The maximum width and height of the frame buffer shared by the screens of a sensor
+const int MAX_ATLAS_SIZE = 4096;
+
+#ifdef CNOID_ENABLE_EGL
+
+const int MAX_NUM_EGL_DEVICES = 16;
+
+/**
+   The EGL display is shared by all the contexts. A GPU device is used directly through
+   EGL_EXT_platform_device when it is available so that no windowing system is required.
+*/
+EGLDisplay getHeadlessEglDisplay()
+{
+    static std::once_flag flag;
+    static EGLDisplay display = EGL_NO_DISPLAY;
+
+    std::call_once(flag, [](){
+        auto eglQueryDevices = (PFNEGLQUERYDEVICESEXTPROC) eglGetProcAddress("eglQueryDevicesEXT");
+        auto eglGetPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if(eglQueryDevices && eglGetPlatformDisplay){
+            EGLDeviceEXT devices[MAX_NUM_EGL_DEVICES];
+            EGLint numDevices = 0;
+            if(eglQueryDevices(MAX_NUM_EGL_DEVICES, devices, &numDevices)){
+                for(int i=0; i < numDevices; ++i){
+                    display = eglGetPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, devices[i], nullptr);
+                    if(display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)){
+                        break;
+                    }
+                    display = EGL_NO_DISPLAY;
+                }
+            }
+        }
+        if(display == EGL_NO_DISPLAY){
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            if(display != EGL_NO_DISPLAY && !eglInitialize(display, nullptr, nullptr)){
+                display = EGL_NO_DISPLAY;
+            }
+        }
+    });
+
+    return display;
+}
+
+
+/**
+   The rendering context which does not depend on any windowing system.
+   The rendering is done into the frame buffer object of the context.
+*/
+class EglRenderingContext
+{
+public:
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface surface;
+    GLuint frameBuffer;
+    GLuint renderBuffers[2];
+    PFNGLDELETEFRAMEBUFFERSPROC glDeleteFramebuffers;
+    PFNGLDELETERENDERBUFFERSPROC glDeleteRenderbuffers;
+
+    EglRenderingContext(){
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+        surface = EGL_NO_SURFACE;
+        frameBuffer = 0;
+        glDeleteFramebuffers = nullptr;
+        glDeleteRenderbuffers = nullptr;
+    }
+
+    ~EglRenderingContext(){
+        if(context != EGL_NO_CONTEXT){
+            if(frameBuffer && makeCurrent()){
+                glDeleteFramebuffers(1, &frameBuffer);
+                glDeleteRenderbuffers(2, renderBuffers);
+                doneCurrent();
+            }
+            eglDestroyContext(display, context);
+        }
+        if(surface != EGL_NO_SURFACE){
+            eglDestroySurface(display, surface);
+        }
+    }
+
+    bool initialize(int width, int height, bool useCoreProfile, string& out_message);
+    
+    bool makeCurrent(){
+        return eglMakeCurrent(display, surface, surface, context);
+    }
+
+    void doneCurrent(){
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+};
+
+
+bool EglRenderingContext::initialize(int width, int height, bool useCoreProfile, string& out_message)
+{
+    display = getHeadlessEglDisplay();
+    if(display == EGL_NO_DISPLAY){
+        out_message = _("No EGL display is available.");
+        return false;
+    }
+    if(!eglBindAPI(EGL_OPENGL_API)){
+        out_message = _("The OpenGL API is not supported by the EGL display.");
+        return false;
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if(!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0){
+        out_message = _("No EGL frame buffer configuration for OpenGL is available.");
+        return false;
+    }
+
+    const EGLint coreProfileAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE };
+    context = eglCreateContext(
+        display, config, EGL_NO_CONTEXT, useCoreProfile ? coreProfileAttributes : nullptr);
+    if(context == EGL_NO_CONTEXT){
+        out_message = _("The EGL context cannot be created.");
+        return false;
+    }
+
+    // The small pbuffer surface is only used when the context cannot be current without any surface
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if(!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")){
+        const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+        if(surface == EGL_NO_SURFACE){
+            out_message = _("The EGL surface cannot be created.");
+            return false;
+        }
+    }
+    
+    if(!makeCurrent()){
+        out_message = _("The EGL context cannot be made current.");
+        return false;
+    }
+
+    auto glGenFramebuffers = (PFNGLGENFRAMEBUFFERSPROC) eglGetProcAddress("glGenFramebuffers");
+    auto glBindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC) eglGetProcAddress("glBindFramebuffer");
+    auto glGenRenderbuffers = (PFNGLGENRENDERBUFFERSPROC) eglGetProcAddress("glGenRenderbuffers");
+    auto glBindRenderbuffer = (PFNGLBINDRENDERBUFFERPROC) eglGetProcAddress("glBindRenderbuffer");
+    auto glRenderbufferStorage = (PFNGLRENDERBUFFERSTORAGEPROC) eglGetProcAddress("glRenderbufferStorage");
+    auto glFramebufferRenderbuffer =
+        (PFNGLFRAMEBUFFERRENDERBUFFERPROC) eglGetProcAddress("glFramebufferRenderbuffer");
+    auto glCheckFramebufferStatus =
+        (PFNGLCHECKFRAMEBUFFERSTATUSPROC) eglGetProcAddress("glCheckFramebufferStatus");
+    glDeleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSPROC) eglGetProcAddress("glDeleteFramebuffers");
+    glDeleteRenderbuffers = (PFNGLDELETERENDERBUFFERSPROC) eglGetProcAddress("glDeleteRenderbuffers");
+
+    if(!(glGenFramebuffers && glBindFramebuffer && glGenRenderbuffers && glBindRenderbuffer &&
+         glRenderbufferStorage && glFramebufferRenderbuffer && glCheckFramebufferStatus &&
+         glDeleteFramebuffers && glDeleteRenderbuffers)){
+        out_message = _("The frame buffer object is not supported by the EGL context.");
+        doneCurrent();
+        return false;
+    }
+
+    glGenFramebuffers(1, &frameBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    glGenRenderbuffers(2, renderBuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderBuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderBuffers[0]);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderBuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderBuffers[1]);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+        out_message = _("The frame buffer object of the EGL context is not complete.");
+        doneCurrent();
+        return false;
+    }
+
+    return true;
+}
+
+#endif
+
+/**
+   This class detects the links which have moved since the previous update so that
+   only the moved links are updated in the scenes of the sensors. The detection is done
+   once for all the scenes in a time step, and each scene records the update count
+   with which it has been synchronized.
+*/
+class LinkPositionTracker
+{
+public:
+    struct BodyInfo
+    {
+        Body* body;
+        vector<Position, Eigen::aligned_allocator<Position>> positions;
+        vector<int> linkUpdateCounts;
+        int updateCount;
+    };
+    vector<BodyInfo> bodies;
+    int updateCount;
+    bool isUpdated;
+
+    LinkPositionTracker() : updateCount(0), isUpdated(false) { }
+    void initialize(const vector<SimulationBody*>& simBodies);
+    void update();
+};
+
 class SensorScreenRenderer;
+typedef ref_ptr<SensorScreenRenderer> SensorScreenRendererPtr;
 
 class SensorScene : public Referenced
 {
 public:
     SgGroupPtr root;
     vector<SceneBodyPtr> sceneBodies;
+    int linkPositionUpdateCount;
     QThreadEx renderingThread;
     std::condition_variable renderingCondition;
     std::mutex renderingMutex;
@@ -129,12 +494,13 @@ public:
     bool isTerminationRequested;
 
     SensorScene() {
+        linkPositionUpdateCount = 0;
         isRenderingRequested = false;
         isRenderingFinished = false;
         isTerminationRequested = false;
     }
 
-    void updateScene(double currentTime);
+    void updateScene(LinkPositionTracker& tracker, double currentTime);
     void startConcurrentRendering();
     void concurrentRenderingLoop(std::function<void(SensorScreenRenderer*&)> render, std::function<void()> finalizeRendering);
     void terminate();
@@ -142,9 +508,23 @@ public:
 
 typedef ref_ptr<SensorScene> SensorScenePtr;
 
+//! The sensor data returned by the render node
+struct RemoteVisionData
+{
+    bool isValid;
+    std::shared_ptr<Image> image;
+    std::shared_ptr<RangeCamera::PointData> points;
+    bool isDense;
+    std::shared_ptr<RangeSensor::RangeData> rangeData;
+
+    RemoteVisionData() : isValid(false), isDense(false) { }
+};
+
 class SensorScreenRenderer : public Referenced
 {
 public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
     GLVisionSimulatorItemImpl* simImpl;
 
     SensorScenePtr scene;
@@ -163,8 +543,22 @@ public:
     QOpenGLContext* glContext;
     QOffscreenSurface* offscreenSurface;
     QOpenGLFramebufferObject* frameBuffer;
+#ifdef CNOID_ENABLE_EGL
+    std::unique_ptr<EglRenderingContext> eglContext;
+#endif
 
     GLSceneRenderer* renderer;
+    SgCamera* sceneCamera;
+    Matrix4 projectionMatrix;
+
+    // The screen which owns the context, the frame buffer and the renderer shared as an atlas
+    SensorScreenRendererPtr atlasOwner;
+    bool isAtlasRendering;
+    int frameBufferWidth;
+    int frameBufferHeight;
+    int viewportX;
+    int viewportY;
+    
     int numYawSamples;
     int numUniqueYawSamples;
     int pixelWidth;
@@ -172,14 +566,38 @@ public:
     std::shared_ptr<Image> tmpImage;
     std::shared_ptr<RangeCamera::PointData> tmpPoints;
     std::shared_ptr<RangeSensor::RangeData> tmpRangeData;
+    SharedObjectPool<Image> imagePool;
+    SharedObjectPool<RangeCamera::PointData> pointPool;
+    SharedObjectPool<RangeSensor::RangeData> rangeDataPool;
     int screenId;
     bool isDense;
 
+    bool isAsyncReadbackEnabled;
+    PixelBufferFunctions pixelBufferFunctions;
+    GLuint colorPixelBuffer;
+    GLuint depthPixelBuffer;
+    GLsync readbackFence;
+    bool isColorPixelBufferMapped;
+    bool isDepthPixelBufferMapped;
+    vector<unsigned char> colorBuf;
+    vector<float> depthBuf;
+
+    DepthBufferConverter depthConverter;
+    vector<Vector2f> rangeSamplePixels;
+    vector<double> rangeSampleScales;
+
+    // for the performance measurement
+    int numRenderedFrames;
+    double renderingTimeSum;
+    double readbackTimeSum;
+
     SensorScreenRenderer(GLVisionSimulatorItemImpl* simImpl, Device* device, Device* deviceForRendering);
     ~SensorScreenRenderer();
     bool initialize(SensorScenePtr scene, int bodyIndex);
     SgCamera* initializeCamera(int bodyIndex);
-    void initializeGL(SgCamera* sceneCamera);
+    bool initializeGL(SgCamera* sceneCamera);
+    bool createGLContext();
+    void setHeadLightDirection();
     void startRenderingThread();
     void moveRenderingBufferToThread(QThread& thread);
     void moveRenderingBufferToMainThread();
@@ -187,13 +605,28 @@ public:
     void doneGLContextCurrent();
     void updateSensorScene();
     void render(SensorScreenRenderer*& currentGLContextScreen);
+    void startRendering(SensorScreenRenderer*& currentGLContextScreen);
+    void finishRendering(SensorScreenRenderer*& currentGLContextScreen);
     void finalizeRendering();
+    bool readsColorPixels() const;
+    bool readsDepthPixels() const;
+    DepthBufferConverter::GetProcAddressFunction getProcAddressFunction();
+    bool isGLVersionAtLeast(int major, int minor);
+    void initializeRangeSamples();
+    void initializeDepthConverter();
+    void initializePixelBuffers();
+    void releaseReadbackResources();
+    int numDepthValuesToRead() const;
+    void startReadback();
+    void waitForReadback();
+    const unsigned char* readColorPixels();
+    const float* readDepthPixels();
+    void releasePixels();
     void storeResultToTmpDataBuffer();
     bool getCameraImage(Image& image);
     bool getRangeCameraData(Image& image, vector<Vector3f>& points);
     bool getRangeSensorData(vector<double>& rangeData);
 };
-typedef ref_ptr<SensorScreenRenderer> SensorScreenRendererPtr;
 
 class SensorRenderer : public Referenced
 {
@@ -215,24 +648,42 @@ public:
     vector<SensorScreenRendererPtr> screens;
     bool wasDeviceOn;
     bool isRendering;  // only updated and referred to in the simulation thread
+    bool wasCycleSkipped;
     bool needToClearVisionDataByTurningOff;
     std::shared_ptr<RangeSensor::RangeData> rangeData;
+    SharedObjectPool<Image> imagePool;
+    SharedObjectPool<RangeSensor::RangeData> rangeDataPool;
     FisheyeLensConverter fisheyeLensConverter;
+    bool isAtlasRendering;
+    std::chrono::steady_clock::time_point onsetWallTime;
+    vector<double> latencies;
+
+    // for the remote rendering
+    RemoteVisionData remoteData;
+    bool isRemoteDataReady; // guarded by the remote mutex
 
     SensorRenderer(GLVisionSimulatorItemImpl* simImpl, Device* sensor, SimulationBody* simBody, int bodyIndex);
     ~SensorRenderer();
     bool initialize(const vector<SimulationBody*>& simBodies);
+    void initializeCycle();
+    bool initializeAtlasScreens();
     SensorScenePtr createSensorScene(const vector<SimulationBody*>& simBodies);
     void startSharedRenderingThread();
     void moveRenderingBufferToMainThread();
     void startConcurrentRendering();
     void updateSensorScene(bool updateSensorForRenderingThread);
     void render(SensorScreenRenderer*& currentGLContextScreen, bool doDoneGLContextCurrent);
+    void startRendering(SensorScreenRenderer*& currentGLContextScreen, bool doDoneGLContextCurrent);
+    void finishRendering(SensorScreenRenderer*& currentGLContextScreen, bool doDoneGLContextCurrent);
     void finalizeRendering();
     bool waitForRenderingToFinish();
     void clearVisionData();
-    void copyVisionData();
+    bool copyVisionData();
     bool waitForRenderingToFinish(std::unique_lock<std::mutex>& lock);
+    bool waitForRemoteRenderingToFinish(std::unique_lock<std::mutex>& lock);
+    void copyRemoteVisionData();
+    void writeRemoteVisionData(MessageWriter& writer);
+    void readRemoteVisionData(MessageReader& reader, RemoteVisionData& out_data);
 };
 typedef ref_ptr<SensorRenderer> SensorRendererPtr;
 
@@ -282,17 +733,62 @@ public:
     double maxLatency;
     SgCloneMap cloneMap;
     bool isAntiAliasingEnabled;
+    bool isAsyncReadbackEnabled;
+    bool isHeadlessRenderingEnabled;
+    bool useEglContexts;
+    bool isGpuDepthConversionEnabled;
+    bool isAtlasRenderingEnabled;
+    bool isFrustumCullingEnabled;
+    bool isLODEnabled;
+    bool isPerformanceMeasurementEnabled;
+    std::chrono::steady_clock::time_point measurementStartTime;
+    vector<GLVisionSimulatorItem::SensorStatistics> sensorStatistics;
+    bool isTimeStatisticsEnabled;
+    TimeStatistics sensorUpdateTimes;
+    TimeStatistics sensorOutputTimes;
+    LinkPositionTracker linkPositionTracker;
+
+    // for the remote rendering client
+    string remoteRendererAddress;
+    bool useRemoteRenderer;
+    QThreadEx remoteThread;
+    std::condition_variable remoteCondition;
+    std::mutex remoteMutex;
+    vector<vector<char>> remoteRequests;
+    int numPendingRemoteResults;
+    bool isRemoteRenderingTerminationRequested;
+    bool isRemoteRendererReady;
+    bool isRemoteRendererDisconnected;
+    bool wasRemoteRendererDisconnectionReported;
+    string remoteRendererError;
+    vector<int> remoteRenderingSensorIndices;
+    int remoteLinkPositionUpdateCount;
+    std::unordered_map<Device*, vector<double>> remoteDeviceStates;
+
+    // for the render node
+    bool isRemoteRenderingSession;
+    vector<SimulationBodyPtr> remoteSessionBodies;
         
     GLVisionSimulatorItemImpl(GLVisionSimulatorItem* self);
     GLVisionSimulatorItemImpl(GLVisionSimulatorItem* self, const GLVisionSimulatorItemImpl& org);
     ~GLVisionSimulatorItemImpl();
     bool initializeSimulation(SimulatorItem* simulatorItem);
+    void initializeRenderingContexts();
+    bool initializeRemoteRendererClient(const vector<SimulationBody*>& simBodies);
+    void remoteRenderingLoop(const string& host, int port, const vector<char>& setupMessage);
     void onPreDynamics();
     void queueRenderingLoop();
+    void requestRemoteRendering();
     void onPostDynamics();
     void getVisionDataInThreadsForSensors();
     void getVisionDataInQueueThread();
+    void getVisionDataFromRemoteRenderer();
     void finalizeSimulation();
+    void finalizeRemoteRendererClient();
+    bool initializeRemoteRenderingSession(MessageReader& reader, string& out_error);
+    void renderRemoteRequest(MessageReader& reader, vector<char>& out_data);
+    void finalizeRemoteRenderingSession();
+    void collectSensorStatistics();
     void doPutProperties(PutPropertyFunction& putProperty);
     bool store(Archive& archive);
     bool restore(const Archive& archive);
@@ -307,11 +803,57 @@ public:
 
 }
 
+namespace {
+
+/**
+   The render node serves a client at a time. The requests of the client are processed in the
+   main thread, where the sensors are rendered with the settings of the GLVisionSimulatorItem
+   of the loaded project.
+*/
+class RemoteRenderingServer
+{
+public:
+    GLVisionSimulatorItemPtr item;
+    GLVisionSimulatorItemImpl* simImpl;
+    QTcpServer server;
+    QTcpSocket* socket;
+    vector<char> receivedData;
+
+    RemoteRenderingServer(GLVisionSimulatorItem* item, GLVisionSimulatorItemImpl* simImpl);
+    bool start(int port);
+    void onNewConnection();
+    void onDataReceived();
+    void processMessage(MessageReader& reader);
+    void closeSession();
+};
+
+RemoteRenderingServer* remoteRenderingServer = nullptr;
+
+}
+
 
 void GLVisionSimulatorItem::initializeClass(ExtensionManager* ext)
 {
     ext->itemManager().registerClass<GLVisionSimulatorItem>(N_("GLVisionSimulatorItem"));
     ext->itemManager().addCreationPanel<GLVisionSimulatorItem>();
+
+    OptionManager& om = ext->optionManager();
+    om.addOption("vision-render-server", boost::program_options::value<int>()->implicit_value(defaultRemoteRenderingPort),
+                 "render the vision sensors for the simulations of the other processes with the GLVisionSimulatorItem of the loaded project (default port: 47111)");
+    om.sigOptionsParsed(1).connect(
+        [](boost::program_options::variables_map& v){
+            if(v.count("vision-render-server") && !remoteRenderingServer){
+                ItemList<GLVisionSimulatorItem> items;
+                GLVisionSimulatorItemPtr item;
+                if(items.extractSubTreeItems(RootItem::instance())){
+                    item = items.front();
+                } else {
+                    item = new GLVisionSimulatorItem;
+                }
+                remoteRenderingServer = new RemoteRenderingServer(item, item->impl);
+                remoteRenderingServer->start(v["vision-render-server"].as<int>());
+            }
+        });
 }
 
 
@@ -346,6 +888,17 @@ GLVisionSimulatorItemImpl::GLVisionSimulatorItemImpl(GLVisionSimulatorItem* self
     threadMode.select(GLVisionSimulatorItem::SENSOR_THREAD_MODE);
 
     isAntiAliasingEnabled = false;
+    isAsyncReadbackEnabled = true;
+    isHeadlessRenderingEnabled = false;
+    useEglContexts = false;
+    isGpuDepthConversionEnabled = true;
+    isAtlasRenderingEnabled = true;
+    isFrustumCullingEnabled = true;
+    isLODEnabled = true;
+    isPerformanceMeasurementEnabled = false;
+    isTimeStatisticsEnabled = false;
+    useRemoteRenderer = false;
+    isRemoteRenderingSession = false;
 }
 
 
@@ -360,7 +913,8 @@ GLVisionSimulatorItemImpl::GLVisionSimulatorItemImpl(GLVisionSimulatorItem* self
     : self(self),
       os(MessageView::instance()->cout()),
       bodyNames(org.bodyNames),
-      sensorNames(org.sensorNames)
+      sensorNames(org.sensorNames),
+      remoteRendererAddress(org.remoteRendererAddress)
 {
     simulatorItem = 0;
 
@@ -378,6 +932,17 @@ GLVisionSimulatorItemImpl::GLVisionSimulatorItemImpl(GLVisionSimulatorItem* self
     maxFrameRate = org.maxFrameRate;
     maxLatency = org.maxLatency;
     isAntiAliasingEnabled = org.isAntiAliasingEnabled;
+    isAsyncReadbackEnabled = org.isAsyncReadbackEnabled;
+    isHeadlessRenderingEnabled = org.isHeadlessRenderingEnabled;
+    useEglContexts = false;
+    isGpuDepthConversionEnabled = org.isGpuDepthConversionEnabled;
+    isAtlasRenderingEnabled = org.isAtlasRenderingEnabled;
+    isFrustumCullingEnabled = org.isFrustumCullingEnabled;
+    isLODEnabled = org.isLODEnabled;
+    isPerformanceMeasurementEnabled = org.isPerformanceMeasurementEnabled;
+    isTimeStatisticsEnabled = false;
+    useRemoteRenderer = false;
+    isRemoteRenderingSession = false;
 }
 
 
@@ -476,6 +1041,82 @@ void GLVisionSimulatorItem::setAdditionalLightsEnabled(bool on)
 }
 
 
+void GLVisionSimulatorItem::setAsyncReadbackEnabled(bool on)
+{
+    impl->setProperty(impl->isAsyncReadbackEnabled, on);
+}
+
+
+void GLVisionSimulatorItem::setHeadlessRenderingEnabled(bool on)
+{
+    impl->setProperty(impl->isHeadlessRenderingEnabled, on);
+}
+
+
+void GLVisionSimulatorItem::setGpuDepthConversionEnabled(bool on)
+{
+    impl->setProperty(impl->isGpuDepthConversionEnabled, on);
+}
+
+
+void GLVisionSimulatorItem::setAtlasRenderingEnabled(bool on)
+{
+    impl->setProperty(impl->isAtlasRenderingEnabled, on);
+}
+
+
+void GLVisionSimulatorItem::setFrustumCullingEnabled(bool on)
+{
+    impl->setProperty(impl->isFrustumCullingEnabled, on);
+}
+
+
+void GLVisionSimulatorItem::setLODEnabled(bool on)
+{
+    impl->setProperty(impl->isLODEnabled, on);
+}
+
+
+void GLVisionSimulatorItem::setRemoteRenderer(const std::string& address)
+{
+    impl->setProperty(impl->remoteRendererAddress, address);
+}
+
+
+void GLVisionSimulatorItem::setPerformanceMeasurementEnabled(bool on)
+{
+    impl->isPerformanceMeasurementEnabled = on;
+}
+
+
+const std::vector<GLVisionSimulatorItem::SensorStatistics>& GLVisionSimulatorItem::sensorStatistics() const
+{
+    return impl->sensorStatistics;
+}
+
+
+void GLVisionSimulatorItem::countMemoryUsage(MemoryUsageCounter& counter)
+{
+    SubSimulatorItem::countMemoryUsage(counter);
+
+    for(auto& renderer : impl->sensorRenderers){
+        counter.add(sizeof(SensorRenderer) + renderer->latencies.capacity() * sizeof(double));
+        for(auto& scene : renderer->scenes){
+            if(counter.visit(scene.get())){
+                // The positions of the nodes are updated during the simulation but the structure is not
+                scene->root->countMemoryUsage(counter);
+            }
+        }
+        for(auto& screen : renderer->screens){
+            counter.add(sizeof(SensorScreenRenderer));
+            if(screen->tmpImage){
+                counter.addShared(screen->tmpImage.get(), screen->tmpImage->memorySize());
+            }
+        }
+    }
+}
+
+
 bool GLVisionSimulatorItem::initializeSimulation(SimulatorItem* simulatorItem)
 {
     return impl->initializeSimulation(simulatorItem);
@@ -488,6 +1129,10 @@ bool GLVisionSimulatorItemImpl::initializeSimulation(SimulatorItem* simulatorIte
     worldTimeStep = simulatorItem->worldTimeStep();
     currentTime = 0;
     sensorRenderers.clear();
+    sensorStatistics.clear();
+    isTimeStatisticsEnabled = simulatorItem->isProfilingEnabled();
+    sensorUpdateTimes.clear();
+    sensorOutputTimes.clear();
 
     switch(threadMode.which()){
     case GLVisionSimulatorItem::SINGLE_THREAD_MODE:
@@ -508,17 +1153,9 @@ bool GLVisionSimulatorItemImpl::initializeSimulation(SimulatorItem* simulatorIte
     }
     
     isBestEffortMode = isBestEffortModeProperty;
-    renderersInRendering.clear();
-    renderersToTurnOff.clear();
+    useRemoteRenderer = false;
 
-    cloneMap.clear();
-
-    /*
-      If this is set to false, rendering may crach in multi-thread rendering
-      even if the non node objects in the scene are not modified because
-      the signal connection / disconnection operations may collide.
-    */
-    cloneMap.setNonNodeCloning(true);
+    initializeRenderingContexts();
 
     std::set<string> bodyNameSet;
     for(size_t i=0; i < bodyNames.size(); ++i){
@@ -551,6 +1188,10 @@ bool GLVisionSimulatorItemImpl::initializeSimulation(SimulatorItem* simulatorIte
         os << format(_("{} has no target sensors"), self->name()) << endl;
         return false;
     }
+
+    if(!remoteRendererAddress.empty()){
+        return initializeRemoteRendererClient(simBodies);
+    }
         
 #ifdef Q_OS_LINUX
     /**
@@ -567,6 +1208,8 @@ bool GLVisionSimulatorItemImpl::initializeSimulation(SimulatorItem* simulatorIte
     }
 #endif
     
+    linkPositionTracker.initialize(simBodies);
+
     vector<SensorRendererPtr>::iterator p = sensorRenderers.begin();
     while(p != sensorRenderers.end()){
         SensorRenderer* renderer = p->get();
@@ -596,6 +1239,10 @@ bool GLVisionSimulatorItemImpl::initializeSimulation(SimulatorItem* simulatorIte
             }
         }
 
+        if(isPerformanceMeasurementEnabled){
+            measurementStartTime = std::chrono::steady_clock::now();
+        }
+
         return true;
     }
 
@@ -603,73 +1250,313 @@ bool GLVisionSimulatorItemImpl::initializeSimulation(SimulatorItem* simulatorIte
 }
 
 
-SensorRenderer::SensorRenderer(GLVisionSimulatorItemImpl* simImpl, Device* device, SimulationBody* simBody, int bodyIndex)
-    : simImpl(simImpl),
-      device(device),
-      simBody(simBody),
-      bodyIndex(bodyIndex)
+void GLVisionSimulatorItemImpl::initializeRenderingContexts()
 {
-    deviceForRendering = device->clone();
-    camera = dynamic_cast<Camera*>(device);
-    rangeCamera = dynamic_pointer_cast<RangeCamera>(camera);
-    rangeSensor = dynamic_cast<RangeSensor*>(device);
+#ifdef CNOID_ENABLE_EGL
+    const QString platformName = QGuiApplication::platformName();
+    useEglContexts =
+        isHeadlessRenderingEnabled || platformName == "offscreen" || platformName == "minimal";
+#else
+    useEglContexts = false;
+    if(isHeadlessRenderingEnabled){
+        os << format(_("{} cannot do the headless rendering because it is built without EGL."),
+                     self->name()) << endl;
+    }
+#endif
     
-    if(camera){
-        auto lensType = camera->lensType();
+    renderersInRendering.clear();
+    renderersToTurnOff.clear();
 
-        if(lensType == Camera::NORMAL_LENS){
-            screens.push_back(new SensorScreenRenderer(simImpl, device, deviceForRendering));
+    cloneMap.clear();
 
-        } else if(lensType == Camera::FISHEYE_LENS || lensType ==  Camera::DUAL_FISHEYE_LENS){
-            int numScreens = 5;
-            double fov = camera->fieldOfView();
-            if(fov <= radian(90)){
-                numScreens = 1;
-            }
-            int resolution = camera->resolutionX();
-            int width = resolution;
-            int height = resolution;
-            if(camera->lensType()==Camera::DUAL_FISHEYE_LENS){
-                numScreens = 6;
-                resolution /= 2;
-                height /=2;
-                fov = radian(180);
-            }
-            if(fov > radian(180)){
-                fov = radian(180);
-            }
-            resolution /= 2;   //screen resolution
+    /*
+      If this is set to false, rendering may crach in multi-thread rendering
+      even if the non node objects in the scene are not modified because
+      the signal connection / disconnection operations may collide.
+    */
+    cloneMap.setNonNodeCloning(true);
+}
 
-            Matrix3 R[6];
-            R[FRONT_SCREEN] = camera->localRotaion();
-            if(numScreens > 1){
-                R[RIGHT_SCREEN]  = R[FRONT_SCREEN] * AngleAxis(radian(-90.0), Vector3::UnitY());
-                R[LEFT_SCREEN]   = R[FRONT_SCREEN] * AngleAxis(radian(90.0),  Vector3::UnitY());
-                R[TOP_SCREEN]    = R[FRONT_SCREEN] * AngleAxis(radian(90.0),  Vector3::UnitX());
-                R[BOTTOM_SCREEN] = R[FRONT_SCREEN] * AngleAxis(radian(-90.0), Vector3::UnitX());
-                if(numScreens == 6){
-                    R[BACK_SCREEN] = R[FRONT_SCREEN] * AngleAxis(radian(180.0), Vector3::UnitY());
-                }
-            }
 
-            fisheyeLensConverter.initialize(width, height, fov, resolution);
-            fisheyeLensConverter.setImageRotationEnabled(camera->lensType() == Camera::DUAL_FISHEYE_LENS);
-            fisheyeLensConverter.setAntiAliasingEnabled(simImpl->isAntiAliasingEnabled);
-            
-            for(int i=0; i < numScreens; ++i){
-                auto cameraForRendering = new Camera(*camera);
-                auto screen = new SensorScreenRenderer(simImpl, device, cameraForRendering);
-                screen->screenId = i;
-                cameraForRendering->setLocalRotation(R[i]);
-                cameraForRendering->setResolution(resolution,resolution);
+/**
+   Only the timing of the sensors is processed in this process and the sensors are rendered by
+   the render node. The communication is done in a dedicated thread so that the simulation
+   thread is not blocked by the network until the data of a sensor is output.
+*/
+bool GLVisionSimulatorItemImpl::initializeRemoteRendererClient(const vector<SimulationBody*>& simBodies)
+{
+    string host = remoteRendererAddress;
+    int port = defaultRemoteRenderingPort;
+    auto pos = host.rfind(':');
+    if(pos != string::npos){
+        port = std::atoi(host.substr(pos + 1).c_str());
+        host = host.substr(0, pos);
+    }
+    if(host.empty() || port <= 0 || port > 65535){
+        os << format(_("{0}: \"{1}\" is not a valid address of the remote renderer."),
+                     self->name(), remoteRendererAddress) << endl;
+        return false;
+    }
 
-                screen->tmpImage = std::make_shared<Image>();
-                fisheyeLensConverter.addScreenImage(screen->tmpImage);
+    useQueueThreadForAllSensors = false;
+    useThreadsForSensors = false;
+    useThreadsForScreens = false;
+    useRemoteRenderer = true;
 
-                screens.push_back(screen);
-            }
-        }
-    } else if(rangeSensor){
+    MessageWriter writer;
+    writer.begin(SETUP);
+    writer.writeString(remoteRenderingMagic);
+    writer.writeShort(remoteRenderingProtocolVersion);
+    writer.writeShort(simBodies.size());
+    for(auto& simBody : simBodies){
+        Body* body = simBody->body();
+        BodyItem* bodyItem = simBody->bodyItem();
+        writer.writeString(bodyItem ? bodyItem->name() : body->name());
+        writer.writeShort(body->numLinks());
+        writer.writeShort(body->numDevices());
+    }
+    writer.writeShort(sensorRenderers.size());
+    for(auto& renderer : sensorRenderers){
+        writer.writeShort(renderer->bodyIndex);
+        writer.writeShort(renderer->device->index());
+        renderer->initializeCycle();
+        renderer->isRemoteDataReady = false;
+    }
+    writer.end();
+
+    linkPositionTracker.initialize(simBodies);
+    remoteLinkPositionUpdateCount = 0;
+    remoteDeviceStates.clear();
+    remoteRequests.clear();
+    remoteRenderingSensorIndices.clear();
+    numPendingRemoteResults = 0;
+    isRemoteRenderingTerminationRequested = false;
+    isRemoteRendererReady = false;
+    isRemoteRendererDisconnected = false;
+    wasRemoteRendererDisconnectionReported = false;
+    remoteRendererError.clear();
+
+    os << format(_("{0} is connecting to the remote renderer {1}:{2}."), self->name(), host, port) << endl;
+
+    vector<char> setupMessage;
+    setupMessage.swap(writer.data);
+    remoteThread.start([this, host, port, setupMessage](){ remoteRenderingLoop(host, port, setupMessage); });
+
+    {
+        std::unique_lock<std::mutex> lock(remoteMutex);
+        while(!isRemoteRendererReady && !isRemoteRendererDisconnected){
+            remoteCondition.wait(lock);
+        }
+    }
+    if(!isRemoteRendererReady){
+        os << format(_("{0} cannot use the remote renderer {1}:{2}. {3}"),
+                     self->name(), host, port, remoteRendererError) << endl;
+        remoteThread.wait();
+        sensorRenderers.clear();
+        return false;
+    }
+
+    simulatorItem->addPreDynamicsFunction([&](){ onPreDynamics(); });
+    simulatorItem->addPostDynamicsFunction([&](){ onPostDynamics(); });
+
+    if(isPerformanceMeasurementEnabled){
+        measurementStartTime = std::chrono::steady_clock::now();
+    }
+
+    return true;
+}
+
+
+void GLVisionSimulatorItemImpl::remoteRenderingLoop(const string& host, int port, const vector<char>& setupMessage)
+{
+    TraceRecorder::setThreadName("Vision sensor remote rendering");
+
+    // The socket is used with the blocking functions in this thread without the event loop
+    QTcpSocket socket;
+    vector<char> receivedData;
+    string error;
+
+    auto receiveMessages = [&](int timeout, std::function<void(MessageReader& reader)> process){
+        if(!socket.waitForReadyRead(timeout)){
+            if(socket.state() != QAbstractSocket::ConnectedState){
+                error = socket.errorString().toStdString();
+            }
+            return false;
+        }
+        QByteArray data = socket.readAll();
+        receivedData.insert(receivedData.end(), data.constData(), data.constData() + data.size());
+        try {
+            if(!processReceivedMessages(receivedData, process)){
+                error = _("An invalid message is received.");
+            }
+        }
+        catch(const NotEnoughDataException&){
+            error = _("A broken message is received.");
+        }
+        return true;
+    };
+
+    socket.connectToHost(host.c_str(), port);
+    if(!socket.waitForConnected(5000)){
+        error = socket.errorString().toStdString();
+    } else {
+        socket.write(setupMessage.data(), setupMessage.size());
+        bool isReplied = false;
+        while(!isReplied && error.empty()){
+            // The reply is waited for while the render node initializes the renderers
+            bool isReceived = receiveMessages(
+                30000,
+                [&](MessageReader& reader){
+                    if(reader.readOctet() == SETUP_RESULT){
+                        isReplied = true;
+                        const bool isAccepted = reader.readOctet();
+                        const string message = reader.readString();
+                        if(!isAccepted){
+                            error = message;
+                        }
+                    }
+                });
+            if(!isReceived && error.empty()){
+                error = _("The render node does not respond.");
+            }
+        }
+    }
+
+    if(error.empty()){
+        {
+            std::lock_guard<std::mutex> lock(remoteMutex);
+            isRemoteRendererReady = true;
+        }
+        remoteCondition.notify_all();
+    }
+
+    auto processResult = [&](MessageReader& reader){
+        if(reader.readOctet() != RENDER_RESULT){
+            return;
+        }
+        const int sensorIndex = reader.readShort();
+        if(sensorIndex < 0 || sensorIndex >= static_cast<int>(sensorRenderers.size())){
+            throw NotEnoughDataException();
+        }
+        auto renderer = sensorRenderers[sensorIndex];
+        RemoteVisionData data;
+        if(reader.readOctet()){
+            renderer->readRemoteVisionData(reader, data);
+        }
+        {
+            std::lock_guard<std::mutex> lock(remoteMutex);
+            renderer->remoteData = std::move(data);
+            renderer->isRemoteDataReady = true;
+            --numPendingRemoteResults;
+        }
+        remoteCondition.notify_all();
+    };
+    
+    while(error.empty()){
+        vector<vector<char>> requests;
+        {
+            std::unique_lock<std::mutex> lock(remoteMutex);
+            while(!isRemoteRenderingTerminationRequested &&
+                  remoteRequests.empty() && numPendingRemoteResults == 0){
+                remoteCondition.wait(lock);
+            }
+            if(isRemoteRenderingTerminationRequested){
+                break;
+            }
+            requests.swap(remoteRequests);
+        }
+        for(auto& request : requests){
+            socket.write(request.data(), request.size());
+        }
+        /*
+          The results are waited for with a short timeout so that the requests issued by the
+          simulation thread in the meantime are sent without a delay.
+        */
+        receiveMessages(1, processResult);
+    }
+
+    if(!error.empty()){
+        {
+            std::lock_guard<std::mutex> lock(remoteMutex);
+            remoteRendererError = error;
+            isRemoteRendererDisconnected = true;
+        }
+        remoteCondition.notify_all();
+    }
+
+    socket.abort();
+}
+
+
+SensorRenderer::SensorRenderer(GLVisionSimulatorItemImpl* simImpl, Device* device, SimulationBody* simBody, int bodyIndex)
+    : simImpl(simImpl),
+      device(device),
+      simBody(simBody),
+      bodyIndex(bodyIndex)
+{
+    deviceForRendering = device->clone();
+    camera = dynamic_cast<Camera*>(device);
+    rangeCamera = dynamic_pointer_cast<RangeCamera>(camera);
+    rangeSensor = dynamic_cast<RangeSensor*>(device);
+    isAtlasRendering = false;
+    isRemoteDataReady = false;
+    
+    if(camera){
+        auto lensType = camera->lensType();
+
+        if(lensType == Camera::NORMAL_LENS){
+            screens.push_back(new SensorScreenRenderer(simImpl, device, deviceForRendering));
+
+        } else if(lensType == Camera::FISHEYE_LENS || lensType ==  Camera::DUAL_FISHEYE_LENS){
+            int numScreens = 5;
+            double fov = camera->fieldOfView();
+            if(fov <= radian(90)){
+                numScreens = 1;
+            }
+            int resolution = camera->resolutionX();
+            int width = resolution;
+            int height = resolution;
+            if(camera->lensType()==Camera::DUAL_FISHEYE_LENS){
+                numScreens = 6;
+                resolution /= 2;
+                height /=2;
+                fov = radian(180);
+            }
+            if(fov > radian(180)){
+                fov = radian(180);
+            }
+            resolution /= 2;   //screen resolution
+
+            Matrix3 R[6];
+            R[FRONT_SCREEN] = camera->localRotaion();
+            if(numScreens > 1){
+                R[RIGHT_SCREEN]  = R[FRONT_SCREEN] * AngleAxis(radian(-90.0), Vector3::UnitY());
+                R[LEFT_SCREEN]   = R[FRONT_SCREEN] * AngleAxis(radian(90.0),  Vector3::UnitY());
+                R[TOP_SCREEN]    = R[FRONT_SCREEN] * AngleAxis(radian(90.0),  Vector3::UnitX());
+                R[BOTTOM_SCREEN] = R[FRONT_SCREEN] * AngleAxis(radian(-90.0), Vector3::UnitX());
+                if(numScreens == 6){
+                    R[BACK_SCREEN] = R[FRONT_SCREEN] * AngleAxis(radian(180.0), Vector3::UnitY());
+                }
+            }
+
+            fisheyeLensConverter.initialize(width, height, fov, resolution);
+            fisheyeLensConverter.setImageRotationEnabled(camera->lensType() == Camera::DUAL_FISHEYE_LENS);
+            fisheyeLensConverter.setAntiAliasingEnabled(simImpl->isAntiAliasingEnabled);
+            
+            for(int i=0; i < numScreens; ++i){
+                auto cameraForRendering = new Camera(*camera);
+                auto screen = new SensorScreenRenderer(simImpl, device, cameraForRendering);
+                screen->screenId = i;
+                cameraForRendering->setLocalRotation(R[i]);
+                cameraForRendering->setResolution(resolution,resolution);
+
+                screen->tmpImage = std::make_shared<Image>();
+                fisheyeLensConverter.addScreenImage(screen->tmpImage);
+
+                screens.push_back(screen);
+            }
+        }
+    } else if(rangeSensor){
 
         int numScreens = 1;
         double yawRangePerScreen = rangeSensor->yawRange();
@@ -731,14 +1618,38 @@ bool SensorRenderer::initialize(const vector<SimulationBody*>& simBodies)
         }
     } else {
         sharedScene = createSensorScene(simBodies);
-        for(auto& screen : screens){
-            if(!screen->initialize(sharedScene, bodyIndex)){
+        if(simImpl->isAtlasRenderingEnabled && screens.size() >= 2){
+            if(!initializeAtlasScreens()){
                 return false;
             }
+        } else {
+            for(auto& screen : screens){
+                if(!screen->initialize(sharedScene, bodyIndex)){
+                    return false;
+                }
+            }
         }
         scenes.push_back(sharedScene);
     }
-        
+
+    initializeCycle();
+
+    if(simImpl->useThreadsForSensors){
+        if(sharedScene){
+            startSharedRenderingThread();
+        } else {
+            for(auto& screen : screens){
+                screen->startRenderingThread();
+            }
+        }
+    }
+
+    return true;
+}
+
+
+void SensorRenderer::initializeCycle()
+{
     if(camera){
         double frameRate = std::max(0.1, std::min(camera->frameRate(), simImpl->maxFrameRate));
         cycleTime = 1.0 / frameRate;
@@ -758,18 +1669,62 @@ bool SensorRenderer::initialize(const vector<SimulationBody*>& simBodies)
     onsetTime = 0.0;
     wasDeviceOn = false;
     isRendering = false;
+    wasCycleSkipped = false;
     needToClearVisionDataByTurningOff = false;
+}
 
-    if(simImpl->useThreadsForSensors){
-        if(sharedScene){
-            startSharedRenderingThread();
-        } else {
-            for(auto& screen : screens){
-                screen->startRenderingThread();
+
+/**
+   The screens are arranged in a grid on the frame buffer of the first screen, and the other
+   screens share the context and the renderer of the first screen. The cameras of all the
+   screens are added to the scene before the renderer extracts the cameras from the scene.
+*/
+bool SensorRenderer::initializeAtlasScreens()
+{
+    const int numScreens = screens.size();
+    vector<SgCamera*> sceneCameras(numScreens);
+    int cellWidth = 0;
+    int cellHeight = 0;
+    for(int i=0; i < numScreens; ++i){
+        auto& screen = screens[i];
+        screen->scene = sharedScene;
+        sceneCameras[i] = screen->initializeCamera(bodyIndex);
+        if(!sceneCameras[i]){
+            return false;
+        }
+        cellWidth = std::max(cellWidth, screen->pixelWidth);
+        cellHeight = std::max(cellHeight, screen->pixelHeight);
+    }
+
+    const int numColumns = static_cast<int>(ceil(sqrt(static_cast<double>(numScreens))));
+    const int numRows = (numScreens + numColumns - 1) / numColumns;
+    const int width = numColumns * cellWidth;
+    const int height = numRows * cellHeight;
+    isAtlasRendering = (width <= MAX_ATLAS_SIZE && height <= MAX_ATLAS_SIZE);
+
+    if(isAtlasRendering){
+        auto& owner = screens[0];
+        owner->frameBufferWidth = width;
+        owner->frameBufferHeight = height;
+        for(int i=0; i < numScreens; ++i){
+            auto& screen = screens[i];
+            screen->isAtlasRendering = true;
+            screen->viewportX = (i % numColumns) * cellWidth;
+            screen->viewportY = (i / numColumns) * cellHeight;
+            if(i > 0){
+                screen->atlasOwner = owner;
             }
         }
     }
 
+    for(int i=0; i < numScreens; ++i){
+        auto& screen = screens[i];
+        if(!screen->initializeGL(sceneCameras[i])){
+            return false;
+        }
+        screen->hasUpdatedData = false;
+    }
+
     return true;
 }
 
@@ -824,7 +1779,23 @@ SensorScreenRenderer::SensorScreenRenderer(GLVisionSimulatorItemImpl* simImpl, D
     offscreenSurface = 0;
     frameBuffer = 0;
     renderer = 0;
+    sceneCamera = nullptr;
+    isAtlasRendering = false;
+    frameBufferWidth = 0;
+    frameBufferHeight = 0;
+    viewportX = 0;
+    viewportY = 0;
     screenId = FRONT_SCREEN;
+
+    isAsyncReadbackEnabled = false;
+    colorPixelBuffer = 0;
+    depthPixelBuffer = 0;
+    readbackFence = 0;
+    isColorPixelBufferMapped = false;
+    isDepthPixelBufferMapped = false;
+    numRenderedFrames = 0;
+    renderingTimeSum = 0.0;
+    readbackTimeSum = 0.0;
 }
 
 
@@ -837,7 +1808,9 @@ bool SensorScreenRenderer::initialize(SensorScenePtr scene, int bodyIndex)
         return false;
     }
 
-    initializeGL(sceneCamera);
+    if(!initializeGL(sceneCamera)){
+        return false;
+    }
 
     hasUpdatedData = false;
 
@@ -937,8 +1910,21 @@ SgCamera* SensorScreenRenderer::initializeCamera(int bodyIndex)
 }
 
 
-void SensorScreenRenderer::initializeGL(SgCamera* sceneCamera)
+bool SensorScreenRenderer::createGLContext()
 {
+#ifdef CNOID_ENABLE_EGL
+    if(simImpl->useEglContexts){
+        eglContext.reset(new EglRenderingContext);
+        string message;
+        if(!eglContext->initialize(frameBufferWidth, frameBufferHeight, simImpl->useGLSL, message)){
+            simImpl->os << message << endl;
+            eglContext.reset();
+            return false;
+        }
+        return true;
+    }
+#endif
+    
     glContext = new QOpenGLContext;
     QSurfaceFormat format;
     format.setSwapBehavior(QSurfaceFormat::SingleBuffer);
@@ -952,53 +1938,246 @@ void SensorScreenRenderer::initializeGL(SgCamera* sceneCamera)
     offscreenSurface->setFormat(format);
     offscreenSurface->create();
     glContext->makeCurrent(offscreenSurface);
-    frameBuffer = new QOpenGLFramebufferObject(pixelWidth, pixelHeight, QOpenGLFramebufferObject::CombinedDepthStencil);
+    frameBuffer = new QOpenGLFramebufferObject(
+        frameBufferWidth, frameBufferHeight, QOpenGLFramebufferObject::CombinedDepthStencil);
     frameBuffer->bind();
 
-    if(!renderer){
-        if(simImpl->useGLSL){
-            renderer = new GLSLSceneRenderer;
-        } else {
-            renderer = new GL1SceneRenderer;
+    return true;
+}
+
+
+bool SensorScreenRenderer::initializeGL(SgCamera* sceneCamera)
+{
+    this->sceneCamera = sceneCamera;
+    
+    if(atlasOwner){
+        atlasOwner->makeGLContextCurrent();
+        renderer = atlasOwner->renderer;
+
+    } else {
+        if(!isAtlasRendering){
+            frameBufferWidth = pixelWidth;
+            frameBufferHeight = pixelHeight;
+        }
+        if(!createGLContext()){
+            return false;
         }
+        if(!renderer){
+            if(simImpl->useGLSL){
+                auto glslRenderer = new GLSLSceneRenderer;
+                glslRenderer->setFrustumCullingEnabled(simImpl->isFrustumCullingEnabled);
+                glslRenderer->setLODEnabled(simImpl->isLODEnabled);
+                renderer = glslRenderer;
+            } else {
+                renderer = new GL1SceneRenderer;
+            }
+        }
+        renderer->initializeGL();
+        renderer->sceneRoot()->addChild(scene->root);
+        renderer->extractPreprocessedNodes();
     }
-
-    renderer->initializeGL();
-    renderer->setViewport(0, 0, pixelWidth, pixelHeight);
-    renderer->sceneRoot()->addChild(scene->root);
-    renderer->extractPreprocessedNodes();
+    
+    renderer->setViewport(viewportX, viewportY, pixelWidth, pixelHeight);
     renderer->setCurrentCamera(sceneCamera);
 
     if(rangeSensorForRendering){
         renderer->setLightingMode(GLSceneRenderer::NO_LIGHTING);
     } else {
-        if(screenId != FRONT_SCREEN){
-            SgDirectionalLight* headLight = dynamic_cast<SgDirectionalLight*>(renderer->headLight());
-            if(headLight){
-                switch(screenId){
-                case LEFT_SCREEN:
-                    headLight->setDirection(Vector3( 1, 0, 0));
-                    break;
-                case RIGHT_SCREEN:
-                    headLight->setDirection(Vector3( -1, 0 ,0));
-                    break;
-                case TOP_SCREEN:
-                    headLight->setDirection(Vector3( 0, -1 ,0));
-                    break;
-                case BOTTOM_SCREEN:
-                    headLight->setDirection(Vector3( 0, 1 ,0));
-                    break;
-                case BACK_SCREEN:
-                    headLight->setDirection(Vector3( 0, 0 ,1));
-                    break;
-                }
-            }
-        }
+        setHeadLightDirection();
         renderer->headLight()->on(simImpl->isHeadLightEnabled);
         renderer->enableAdditionalLights(simImpl->areAdditionalLightsEnabled);
     }
 
+    if(rangeSensorForRendering){
+        initializeRangeSamples();
+    }
+    if(simImpl->isGpuDepthConversionEnabled && readsDepthPixels()){
+        initializeDepthConverter();
+    }
+    if(simImpl->isAsyncReadbackEnabled){
+        initializePixelBuffers();
+    }
+
     doneGLContextCurrent();
+
+    return true;
+}
+
+
+void SensorScreenRenderer::setHeadLightDirection()
+{
+    SgDirectionalLight* headLight = dynamic_cast<SgDirectionalLight*>(renderer->headLight());
+    if(headLight){
+        switch(screenId){
+        case FRONT_SCREEN:
+            // The direction may have been changed for another screen sharing the renderer
+            if(isAtlasRendering){
+                headLight->setDirection(Vector3( 0, 0, -1));
+            }
+            break;
+        case LEFT_SCREEN:
+            headLight->setDirection(Vector3( 1, 0, 0));
+            break;
+        case RIGHT_SCREEN:
+            headLight->setDirection(Vector3( -1, 0 ,0));
+            break;
+        case TOP_SCREEN:
+            headLight->setDirection(Vector3( 0, -1 ,0));
+            break;
+        case BOTTOM_SCREEN:
+            headLight->setDirection(Vector3( 0, 1 ,0));
+            break;
+        case BACK_SCREEN:
+            headLight->setDirection(Vector3( 0, 0 ,1));
+            break;
+        }
+    }
+}
+
+
+DepthBufferConverter::GetProcAddressFunction SensorScreenRenderer::getProcAddressFunction()
+{
+    typedef DepthBufferConverter::FunctionPointer FunctionPointer;
+    if(atlasOwner){
+        return atlasOwner->getProcAddressFunction();
+    }
+#ifdef CNOID_ENABLE_EGL
+    if(eglContext){
+        return [](const char* name){ return reinterpret_cast<FunctionPointer>(eglGetProcAddress(name)); };
+    }
+#endif
+    QOpenGLContext* context = glContext;
+    return [context](const char* name){ return reinterpret_cast<FunctionPointer>(context->getProcAddress(name)); };
+}
+
+
+bool SensorScreenRenderer::isGLVersionAtLeast(int major, int minor)
+{
+    if(atlasOwner){
+        return atlasOwner->isGLVersionAtLeast(major, minor);
+    }
+    if(glContext && glContext->isOpenGLES()){
+        return false;
+    }
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    int majorVersion = 0;
+    int minorVersion = 0;
+    if(!version || sscanf(version, "%d.%d", &majorVersion, &minorVersion) != 2){
+        return false;
+    }
+    return majorVersion > major || (majorVersion == major && minorVersion >= minor);
+}
+
+
+/**
+   The pixels sampled for the ranges and the scales from the depths to the ranges do not
+   change during the simulation, so they are calculated in advance.
+*/
+void SensorScreenRenderer::initializeRangeSamples()
+{
+    const double yawRange = rangeSensorForRendering->yawRange();
+    const double yawStep = rangeSensorForRendering->yawStep();
+    const double maxTanYawAngle = tan(yawRange / 2.0);
+
+    const double pitchRange = rangeSensorForRendering->pitchRange();
+    const int numPitchSamples = rangeSensorForRendering->numPitchSamples();
+    const double pitchStep = rangeSensorForRendering->pitchStep();
+    const double maxTanPitchAngle = tan(pitchRange / 2.0) / cos(yawRange / 2.0);
+
+    const double fw = pixelWidth;
+    const double fh = pixelHeight;
+
+    rangeSamplePixels.clear();
+    rangeSampleScales.clear();
+    rangeSamplePixels.reserve(numUniqueYawSamples * numPitchSamples);
+    rangeSampleScales.reserve(numUniqueYawSamples * numPitchSamples);
+
+    for(int pitch=0; pitch < numPitchSamples; ++pitch){
+        const double pitchAngle = pitch * pitchStep - pitchRange / 2.0;
+        const double cosPitchAngle = cos(pitchAngle);
+
+        for(int yaw=0; yaw < numUniqueYawSamples; ++yaw){
+            const double yawAngle = yaw * yawStep - yawRange / 2.0;
+
+            int py;
+            if(pitchRange == 0.0){
+                py = 0;
+            } else {
+                const double r = (tan(pitchAngle)/cos(yawAngle) + maxTanPitchAngle) / (maxTanPitchAngle * 2.0);
+                py = myNearByInt(r * (fh - 1.0));
+            }
+            int px;
+            if(yawRange == 0.0){
+                px = 0;
+            } else {
+                const double r = (maxTanYawAngle - tan(yawAngle)) / (maxTanYawAngle * 2.0);
+                px = myNearByInt(r * (fw - 1.0));
+            }
+            rangeSamplePixels.push_back(Vector2f(px, py));
+            rangeSampleScales.push_back(1.0 / (cosPitchAngle * cos(yawAngle)));
+        }
+    }
+}
+
+
+void SensorScreenRenderer::initializeDepthConverter()
+{
+    if(!isGLVersionAtLeast(3, 3)){
+        return;
+    }
+    if(rangeCameraForRendering){
+        depthConverter.initializeForPoints(pixelWidth, pixelHeight, getProcAddressFunction());
+    } else if(rangeSensorForRendering){
+        depthConverter.initializeForRanges(
+            pixelWidth, pixelHeight, numUniqueYawSamples, rangeSensorForRendering->numPitchSamples(),
+            rangeSamplePixels, rangeSampleScales, getProcAddressFunction());
+        depthConverter.setDepthError(depthError);
+    }
+    depthConverter.setSourceOffset(viewportX, viewportY);
+}
+
+
+int SensorScreenRenderer::numDepthValuesToRead() const
+{
+    if(depthConverter.isInitialized()){
+        return depthConverter.outputWidth() * depthConverter.outputHeight() * depthConverter.numOutputComponents();
+    }
+    return pixelWidth * pixelHeight;
+}
+
+
+void SensorScreenRenderer::initializePixelBuffers()
+{
+    if(isGLVersionAtLeast(3, 2)){
+        isAsyncReadbackEnabled = pixelBufferFunctions.resolve(getProcAddressFunction());
+    }
+    if(!isAsyncReadbackEnabled){
+        return;
+    }
+    auto& gl = pixelBufferFunctions;
+    if(readsColorPixels()){
+        gl.glGenBuffers(1, &colorPixelBuffer);
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, colorPixelBuffer);
+        gl.glBufferData(GL_PIXEL_PACK_BUFFER, pixelWidth * pixelHeight * 3, nullptr, GL_STREAM_READ);
+    }
+    if(readsDepthPixels()){
+        gl.glGenBuffers(1, &depthPixelBuffer);
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, depthPixelBuffer);
+        gl.glBufferData(GL_PIXEL_PACK_BUFFER, numDepthValuesToRead() * sizeof(float), nullptr, GL_STREAM_READ);
+    }
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+bool SensorScreenRenderer::readsColorPixels() const
+{
+    return cameraForRendering && cameraForRendering->imageType() == Camera::COLOR_IMAGE;
+}
+
+
+bool SensorScreenRenderer::readsDepthPixels() const
+{
+    return rangeCameraForRendering || rangeSensorForRendering;
 }
 
 
@@ -1008,7 +2187,7 @@ void SensorRenderer::startSharedRenderingThread()
     // This may be unnecessary
     std::unique_lock<std::mutex> lock(sharedScene->renderingMutex);
 
-    bool doDoneGLContextCurrent = (screens.size() >= 2);
+    bool doDoneGLContextCurrent = (screens.size() >= 2) && !isAtlasRendering;
     
     sharedScene->renderingThread.start([=](){
             sharedScene->concurrentRenderingLoop(
@@ -1042,7 +2221,10 @@ void SensorScreenRenderer::startRenderingThread()
 
 void SensorScreenRenderer::moveRenderingBufferToThread(QThread& thread)
 {
-    glContext->moveToThread(&thread);
+    // An EGL context is not bound to any thread while it is not current
+    if(glContext){
+        glContext->moveToThread(&thread);
+    }
 }
 
 
@@ -1056,27 +2238,110 @@ void SensorRenderer::moveRenderingBufferToMainThread()
 
 void SensorScreenRenderer::moveRenderingBufferToMainThread()
 {
-    QThread* mainThread = QApplication::instance()->thread();
-    glContext->moveToThread(mainThread);
+    if(glContext){
+        QThread* mainThread = QApplication::instance()->thread();
+        glContext->moveToThread(mainThread);
+    }
 }
 
 
 void SensorScreenRenderer::makeGLContextCurrent()
 {
+    if(atlasOwner){
+        atlasOwner->makeGLContextCurrent();
+        return;
+    }
+#ifdef CNOID_ENABLE_EGL
+    if(eglContext){
+        eglContext->makeCurrent();
+        return;
+    }
+#endif
     glContext->makeCurrent(offscreenSurface);
 }
 
 
 void SensorScreenRenderer::doneGLContextCurrent()
 {
+    if(atlasOwner){
+        atlasOwner->doneGLContextCurrent();
+        return;
+    }
+#ifdef CNOID_ENABLE_EGL
+    if(eglContext){
+        eglContext->doneCurrent();
+        return;
+    }
+#endif
     glContext->doneCurrent();
 }
 
 
+void LinkPositionTracker::initialize(const vector<SimulationBody*>& simBodies)
+{
+    bodies.clear();
+    bodies.resize(simBodies.size());
+    for(size_t i=0; i < simBodies.size(); ++i){
+        auto& info = bodies[i];
+        info.body = simBodies[i]->body();
+        const int n = info.body->numLinks();
+        info.positions.resize(n);
+        for(int j=0; j < n; ++j){
+            info.positions[j] = info.body->link(j)->position();
+        }
+        // All the links are updated in the first update of each scene
+        info.linkUpdateCounts.assign(n, 1);
+        info.updateCount = 1;
+    }
+    updateCount = 1;
+    isUpdated = true;
+}
+
+
+void LinkPositionTracker::update()
+{
+    if(isUpdated){
+        return;
+    }
+    ++updateCount;
+    for(auto& info : bodies){
+        if(info.body->isStaticModel()){
+            continue;
+        }
+        const int n = info.positions.size();
+        for(int i=0; i < n; ++i){
+            Link* link = info.body->link(i);
+            Position& T = info.positions[i];
+            if(link->translation() != T.translation() || link->rotation() != T.linear()){
+                T = link->position();
+                info.linkUpdateCounts[i] = updateCount;
+                info.updateCount = updateCount;
+            }
+        }
+    }
+    isUpdated = true;
+}
+
+
 void GLVisionSimulatorItemImpl::onPreDynamics()
 {
+    TraceRecorder::Scope trace("Vision sensor update", "vision");
+
+    std::chrono::steady_clock::time_point startTime;
+    if(isTimeStatisticsEnabled){
+        startTime = std::chrono::steady_clock::now();
+    }
+
     currentTime = simulatorItem->currentTime();
 
+    // The positions are checked when a sensor scene is updated first in this time step
+    linkPositionTracker.isUpdated = false;
+
+    // Every other rendering cycle is skipped while the simulation is behind the real time
+    const bool doReduceRate =
+        simulatorItem->realtimeSyncCatchUpPolicy() == SimulatorItem::CATCH_UP_REDUCE_VISION_RATE &&
+        simulatorItem->isBehindRealtime();
+
     std::mutex* pQueueMutex = nullptr;
     
     for(size_t i=0; i < sensorRenderers.size(); ++i){
@@ -1092,10 +2357,19 @@ void GLVisionSimulatorItemImpl::onPreDynamics()
                 renderer->elapsedTime = renderer->cycleTime;
             }
             if(renderer->elapsedTime >= renderer->cycleTime){
-                if(!renderer->isRendering){
+                if(!renderer->isRendering && doReduceRate && !renderer->wasCycleSkipped){
+                    renderer->elapsedTime -= renderer->cycleTime;
+                    renderer->wasCycleSkipped = true;
+                } else if(!renderer->isRendering){
+                    renderer->wasCycleSkipped = false;
                     renderer->onsetTime = currentTime;
+                    if(isPerformanceMeasurementEnabled){
+                        renderer->onsetWallTime = std::chrono::steady_clock::now();
+                    }
                     renderer->isRendering = true;
-                    if(useThreadsForSensors){
+                    if(useRemoteRenderer){
+                        remoteRenderingSensorIndices.push_back(i);
+                    } else if(useThreadsForSensors){
                         renderer->startConcurrentRendering();
                     } else {
                         if(!pQueueMutex){
@@ -1123,12 +2397,22 @@ void GLVisionSimulatorItemImpl::onPreDynamics()
         pQueueMutex->unlock();
         queueCondition.notify_all();
     }
+
+    if(!remoteRenderingSensorIndices.empty()){
+        requestRemoteRendering();
+    }
+
+    if(isTimeStatisticsEnabled){
+        sensorUpdateTimes.record(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+    }
 }
 
 
 void GLVisionSimulatorItemImpl::queueRenderingLoop()
 {
-    SensorRenderer* renderer = nullptr;
+    TraceRecorder::setThreadName("Vision sensor queue");
+    vector<SensorRenderer*> renderers;
     SensorScreenRenderer* currentGLContextScreen = nullptr;
     
     while(true){
@@ -1139,20 +2423,32 @@ void GLVisionSimulatorItemImpl::queueRenderingLoop()
                     goto exitRenderingQueueLoop;
                 }
                 if(!sensorQueue.empty()){
-                    renderer = sensorQueue.front();
-                    sensorQueue.pop();
+                    renderers.clear();
+                    while(!sensorQueue.empty()){
+                        renderers.push_back(sensorQueue.front());
+                        sensorQueue.pop();
+                    }
                     break;
                 }
                 queueCondition.wait(lock);
             }
         }
-        renderer->render(currentGLContextScreen, true);
-        
-        {
-            std::lock_guard<std::mutex> lock(queueMutex);
-            renderer->sharedScene->isRenderingFinished = true;
+
+        /*
+          All the queued sensors are rendered before any readback is waited for so that
+          the transfers of a sensor overlap the rendering of the following sensors.
+        */
+        for(auto renderer : renderers){
+            renderer->startRendering(currentGLContextScreen, true);
+        }
+        for(auto renderer : renderers){
+            renderer->finishRendering(currentGLContextScreen, true);
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                renderer->sharedScene->isRenderingFinished = true;
+            }
+            queueCondition.notify_all();
         }
-        queueCondition.notify_all();
     }
     
 exitRenderingQueueLoop:
@@ -1163,10 +2459,106 @@ exitRenderingQueueLoop:
 }
 
 
+/**
+   The sensors which start rendering in this time step are requested to the render node
+   with the positions of the links moved and the device states changed since the last request.
+*/
+void GLVisionSimulatorItemImpl::requestRemoteRendering()
+{
+    linkPositionTracker.update();
+
+    MessageWriter writer;
+    writer.begin(RENDER);
+    writer.writeFloat(currentTime);
+
+    auto& bodies = linkPositionTracker.bodies;
+    int numUpdatedBodies = 0;
+    for(auto& info : bodies){
+        if(info.updateCount > remoteLinkPositionUpdateCount){
+            ++numUpdatedBodies;
+        }
+    }
+    writer.writeShort(numUpdatedBodies);
+    for(size_t i=0; i < bodies.size(); ++i){
+        auto& info = bodies[i];
+        if(info.updateCount > remoteLinkPositionUpdateCount){
+            writer.writeShort(i);
+            const int n = info.positions.size();
+            int numUpdatedLinks = 0;
+            for(int j=0; j < n; ++j){
+                if(info.linkUpdateCounts[j] > remoteLinkPositionUpdateCount){
+                    ++numUpdatedLinks;
+                }
+            }
+            writer.writeVarInt(numUpdatedLinks);
+            for(int j=0; j < n; ++j){
+                if(info.linkUpdateCounts[j] > remoteLinkPositionUpdateCount){
+                    const Position& T = info.positions[j];
+                    const Vector3 p = T.translation();
+                    const Quat q(T.linear());
+                    writer.writeVarInt(j);
+                    writer.writeFloat(p.x());
+                    writer.writeFloat(p.y());
+                    writer.writeFloat(p.z());
+                    writer.writeFloat(q.w());
+                    writer.writeFloat(q.x());
+                    writer.writeFloat(q.y());
+                    writer.writeFloat(q.z());
+                }
+            }
+        }
+    }
+    remoteLinkPositionUpdateCount = linkPositionTracker.updateCount;
+
+    MessageWriter deviceWriter;
+    int numChangedDevices = 0;
+    vector<double> state;
+    for(size_t i=0; i < bodies.size(); ++i){
+        Body* body = bodies[i].body;
+        for(int j=0; j < body->numDevices(); ++j){
+            Device* device = body->device(j);
+            state.resize(device->stateSize());
+            device->writeState(state.data());
+            auto& lastState = remoteDeviceStates[device];
+            if(state != lastState){
+                deviceWriter.writeShort(i);
+                deviceWriter.writeShort(j);
+                deviceWriter.writeShort(state.size());
+                for(auto& value : state){
+                    deviceWriter.writeFloat(value);
+                }
+                lastState = state;
+                ++numChangedDevices;
+            }
+        }
+    }
+    writer.writeShort(numChangedDevices);
+    writer.writeBytes(deviceWriter.data.data(), deviceWriter.data.size());
+
+    writer.writeShort(remoteRenderingSensorIndices.size());
+    for(auto& index : remoteRenderingSensorIndices){
+        writer.writeShort(index);
+    }
+    writer.end();
+
+    {
+        std::lock_guard<std::mutex> lock(remoteMutex);
+        if(!isRemoteRendererDisconnected){
+            remoteRequests.push_back(std::move(writer.data));
+            numPendingRemoteResults += remoteRenderingSensorIndices.size();
+        }
+    }
+    remoteCondition.notify_all();
+
+    remoteRenderingSensorIndices.clear();
+}
+
+
 void SensorRenderer::updateSensorScene(bool updateSensorForRenderingThread)
 {
+    simImpl->linkPositionTracker.update();
     for(auto& scene : scenes){
-        scene->updateScene(simImpl->currentTime);
+        scene->updateScene(simImpl->linkPositionTracker, simImpl->currentTime);
     }
     if(updateSensorForRenderingThread){
         deviceForRendering->copyStateFrom(*device);
@@ -1174,12 +2566,28 @@ void SensorRenderer::updateSensorScene(bool updateSensorForRenderingThread)
 }
     
 
-void SensorScene::updateScene(double currentTime)
-{
-    for(auto& sceneBody : sceneBodies){
-        sceneBody->updateLinkPositions();
+void SensorScene::updateScene(LinkPositionTracker& tracker, double currentTime)
+{
+    for(size_t i=0; i < sceneBodies.size(); ++i){
+        auto& sceneBody = sceneBodies[i];
+        auto& info = tracker.bodies[i];
+        if(info.updateCount > linkPositionUpdateCount){
+            const int n = sceneBody->numSceneLinks();
+            for(int j=0; j < n; ++j){
+                if(info.linkUpdateCounts[j] > linkPositionUpdateCount){
+                    auto sceneLink = sceneBody->sceneLink(j);
+                    const Position& T = info.positions[j];
+                    sceneLink->setRotation(T.linear() * sceneLink->link()->Rs());
+                    sceneLink->setTranslation(T.translation());
+                    // The cached bounding boxes are used for the frustum culling
+                    sceneLink->invalidateBoundingBoxForTransformUpdate();
+                }
+            }
+            sceneBody->invalidateBoundingBox();
+        }
         sceneBody->updateSceneDevices(currentTime);
     }
+    linkPositionUpdateCount = tracker.updateCount;
 }
 
 
@@ -1206,6 +2614,7 @@ void SensorScene::startConcurrentRendering()
 
 void SensorScene::concurrentRenderingLoop(std::function<void(SensorScreenRenderer*&)> render, std::function<void()> finalizeRendering)
 {
+    TraceRecorder::setThreadName("Vision sensor rendering");
     SensorScreenRenderer* currentGLContextScreen = nullptr;
     
     while(true){
@@ -1238,26 +2647,211 @@ exitConcurrentRenderingLoop:
 
 
 void SensorRenderer::render(SensorScreenRenderer*& currentGLContextScreen, bool doDoneGLContextCurrent)
+{
+    startRendering(currentGLContextScreen, doDoneGLContextCurrent);
+    finishRendering(currentGLContextScreen, doDoneGLContextCurrent);
+}
+
+
+void SensorRenderer::startRendering(SensorScreenRenderer*& currentGLContextScreen, bool doDoneGLContextCurrent)
 {
     for(auto& screen : screens){
-        screen->render(currentGLContextScreen);
-        if(doDoneGLContextCurrent){
+        screen->startRendering(currentGLContextScreen);
+        if(doDoneGLContextCurrent && !isAtlasRendering){
             screen->doneGLContextCurrent();
             currentGLContextScreen = nullptr;
         }
     }
+    if(doDoneGLContextCurrent && isAtlasRendering){
+        screens[0]->doneGLContextCurrent();
+        currentGLContextScreen = nullptr;
+    }
+}
+
+
+void SensorRenderer::finishRendering(SensorScreenRenderer*& currentGLContextScreen, bool doDoneGLContextCurrent)
+{
+    for(auto& screen : screens){
+        screen->finishRendering(currentGLContextScreen);
+        if(doDoneGLContextCurrent && !isAtlasRendering){
+            screen->doneGLContextCurrent();
+            currentGLContextScreen = nullptr;
+        }
+    }
+    if(doDoneGLContextCurrent && isAtlasRendering){
+        screens[0]->doneGLContextCurrent();
+        currentGLContextScreen = nullptr;
+    }
 }
 
 
 void SensorScreenRenderer::render(SensorScreenRenderer*& currentGLContextScreen)
 {
-    if(this != currentGLContextScreen){
-        makeGLContextCurrent();
-        currentGLContextScreen = this;
+    startRendering(currentGLContextScreen);
+    finishRendering(currentGLContextScreen);
+}
+
+
+void SensorScreenRenderer::startRendering(SensorScreenRenderer*& currentGLContextScreen)
+{
+    TraceRecorder::Scope trace("Sensor rendering", "vision");
+
+    std::chrono::steady_clock::time_point startTime;
+    if(simImpl->isPerformanceMeasurementEnabled){
+        startTime = std::chrono::steady_clock::now();
+    }
+    
+    SensorScreenRenderer* contextScreen = atlasOwner ? atlasOwner.get() : this;
+    if(contextScreen != currentGLContextScreen){
+        contextScreen->makeGLContextCurrent();
+        currentGLContextScreen = contextScreen;
+    }
+    if(isAtlasRendering){
+        renderer->setViewport(viewportX, viewportY, pixelWidth, pixelHeight);
+        renderer->setCurrentCamera(sceneCamera);
+        if(!rangeSensorForRendering){
+            setHeadLightDirection();
+        }
+        // The frame buffer is cleared in the rendering, which must not affect the other screens
+        glScissor(viewportX, viewportY, pixelWidth, pixelHeight);
+        glEnable(GL_SCISSOR_TEST);
+        renderer->render();
+        glDisable(GL_SCISSOR_TEST);
+    } else {
+        renderer->render();
     }
-    renderer->render();
     renderer->flush();
+    projectionMatrix = renderer->projectionMatrix();
+    if(depthConverter.isInitialized()){
+        depthConverter.convert(projectionMatrix);
+    }
+    if(isAsyncReadbackEnabled){
+        startReadback();
+    }
+
+    if(simImpl->isPerformanceMeasurementEnabled){
+        renderingTimeSum += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    }
+}
+
+
+void SensorScreenRenderer::finishRendering(SensorScreenRenderer*& currentGLContextScreen)
+{
+    TraceRecorder::Scope trace("Sensor readback", "vision");
+
+    std::chrono::steady_clock::time_point startTime;
+    if(simImpl->isPerformanceMeasurementEnabled){
+        startTime = std::chrono::steady_clock::now();
+    }
+    
+    SensorScreenRenderer* contextScreen = atlasOwner ? atlasOwner.get() : this;
+    if(contextScreen != currentGLContextScreen){
+        contextScreen->makeGLContextCurrent();
+        currentGLContextScreen = contextScreen;
+    }
     storeResultToTmpDataBuffer();
+
+    if(simImpl->isPerformanceMeasurementEnabled){
+        readbackTimeSum += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        ++numRenderedFrames;
+    }
+}
+
+
+/**
+   The pixels are copied into the pixel buffer objects by the GPU, and the fence is inserted
+   to know the completion of the copy. The commands are flushed without waiting for them.
+*/
+void SensorScreenRenderer::startReadback()
+{
+    auto& gl = pixelBufferFunctions;
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    if(colorPixelBuffer){
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, colorPixelBuffer);
+        glReadPixels(viewportX, viewportY, pixelWidth, pixelHeight, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    }
+    if(depthPixelBuffer){
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, depthPixelBuffer);
+        if(depthConverter.isInitialized()){
+            depthConverter.readOutput(0);
+        } else {
+            glReadPixels(viewportX, viewportY, pixelWidth, pixelHeight, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+        }
+    }
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readbackFence = gl.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+}
+
+
+void SensorScreenRenderer::waitForReadback()
+{
+    if(readbackFence){
+        auto& gl = pixelBufferFunctions;
+        GLenum result;
+        do {
+            result = gl.glClientWaitSync(readbackFence, GL_SYNC_FLUSH_COMMANDS_BIT, READBACK_WAIT_TIMEOUT);
+        } while(result == GL_TIMEOUT_EXPIRED);
+        gl.glDeleteSync(readbackFence);
+        readbackFence = 0;
+    }
+}
+
+
+const unsigned char* SensorScreenRenderer::readColorPixels()
+{
+    if(isAsyncReadbackEnabled){
+        waitForReadback();
+        auto& gl = pixelBufferFunctions;
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, colorPixelBuffer);
+        auto pixels = gl.glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixelWidth * pixelHeight * 3, GL_MAP_READ_BIT);
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        isColorPixelBufferMapped = true;
+        return static_cast<const unsigned char*>(pixels);
+    }
+    colorBuf.resize(pixelWidth * pixelHeight * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(viewportX, viewportY, pixelWidth, pixelHeight, GL_RGB, GL_UNSIGNED_BYTE, &colorBuf[0]);
+    return &colorBuf[0];
+}
+
+
+const float* SensorScreenRenderer::readDepthPixels()
+{
+    if(isAsyncReadbackEnabled){
+        waitForReadback();
+        auto& gl = pixelBufferFunctions;
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, depthPixelBuffer);
+        auto pixels = gl.glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER, 0, numDepthValuesToRead() * sizeof(float), GL_MAP_READ_BIT);
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        isDepthPixelBufferMapped = true;
+        return static_cast<const float*>(pixels);
+    }
+    depthBuf.resize(numDepthValuesToRead());
+    if(depthConverter.isInitialized()){
+        depthConverter.readOutput(&depthBuf[0]);
+    } else {
+        glReadPixels(viewportX, viewportY, pixelWidth, pixelHeight, GL_DEPTH_COMPONENT, GL_FLOAT, &depthBuf[0]);
+    }
+    return &depthBuf[0];
+}
+
+
+void SensorScreenRenderer::releasePixels()
+{
+    auto& gl = pixelBufferFunctions;
+    if(isColorPixelBufferMapped){
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, colorPixelBuffer);
+        gl.glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        isColorPixelBufferMapped = false;
+    }
+    if(isDepthPixelBufferMapped){
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, depthPixelBuffer);
+        gl.glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        isDepthPixelBufferMapped = false;
+    }
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 }
 
 
@@ -1276,28 +2870,46 @@ void SensorScreenRenderer::finalizeRendering()
 }
 
 
+/**
+   The buffers are taken from the pools so that the buffers released by the devices and the
+   other modules are reused. The screen images of a fisheye camera are kept in the screens.
+*/
 void SensorScreenRenderer::storeResultToTmpDataBuffer()
 {
     if(cameraForRendering){
         if(!tmpImage){
-            tmpImage = std::make_shared<Image>();
+            tmpImage = imagePool.get();
         }
         if(rangeCameraForRendering){
-            tmpPoints = std::make_shared<vector<Vector3f>>();
+            tmpPoints = pointPool.get();
             hasUpdatedData = getRangeCameraData(*tmpImage, *tmpPoints);
         } else {
             hasUpdatedData = getCameraImage(*tmpImage);
         }
     } else if(rangeSensorForRendering){
-        tmpRangeData =  std::make_shared<vector<double>>();
+        tmpRangeData = rangeDataPool.get();
         hasUpdatedData = getRangeSensorData(*tmpRangeData);
     }
+    if(isAsyncReadbackEnabled){
+        // The fence remains when no pixels are read, as for a camera without the color image
+        waitForReadback();
+        releasePixels();
+    }
 }
 
 
 void GLVisionSimulatorItemImpl::onPostDynamics()
 {
-    if(useThreadsForSensors){
+    TraceRecorder::Scope trace("Vision sensor data", "vision");
+
+    std::chrono::steady_clock::time_point startTime;
+    if(isTimeStatisticsEnabled){
+        startTime = std::chrono::steady_clock::now();
+    }
+
+    if(useRemoteRenderer){
+        getVisionDataFromRemoteRenderer();
+    } else if(useThreadsForSensors){
         getVisionDataInThreadsForSensors();
     } else {
         getVisionDataInQueueThread();
@@ -1315,6 +2927,11 @@ void GLVisionSimulatorItemImpl::onPostDynamics()
             }
         }
     }
+
+    if(isTimeStatisticsEnabled){
+        sensorOutputTimes.record(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+    }
 }
 
 
@@ -1392,19 +3009,74 @@ void GLVisionSimulatorItemImpl::getVisionDataInQueueThread()
 
 bool SensorRenderer::waitForRenderingToFinish(std::unique_lock<std::mutex>& lock)
 {
-    if(!sharedScene->isRenderingFinished){
+    if(!sharedScene->isRenderingFinished){
+        if(simImpl->isBestEffortMode){
+            if(elapsedTime > cycleTime){
+                elapsedTime = cycleTime;
+            }
+            return false;
+        } else {
+            while(!sharedScene->isRenderingFinished){
+                simImpl->queueCondition.wait(lock);
+            }
+        }
+    }
+    sharedScene->isRenderingFinished = false;
+
+    return true;
+}
+
+
+void GLVisionSimulatorItemImpl::getVisionDataFromRemoteRenderer()
+{
+    std::unique_lock<std::mutex> lock(remoteMutex);
+    
+    auto p = renderersInRendering.begin();
+    while(p != renderersInRendering.end()){
+        SensorRenderer* renderer = *p;
+        if(renderer->elapsedTime >= renderer->latency){
+            if(renderer->waitForRemoteRenderingToFinish(lock)){
+                if(!renderer->needToClearVisionDataByTurningOff){
+                    renderer->copyRemoteVisionData();
+                }
+                renderer->remoteData = RemoteVisionData();
+                renderer->isRendering = false;
+            }
+        }
+        if(renderer->isRendering){
+            ++p;
+        } else {
+            p = renderersInRendering.erase(p);
+        }
+    }
+
+    if(isRemoteRendererDisconnected && !wasRemoteRendererDisconnectionReported){
+        os << format(_("{0} lost the connection to the remote renderer. {1}"),
+                     self->name(), remoteRendererError) << endl;
+        wasRemoteRendererDisconnectionReported = true;
+    }
+}
+
+
+bool SensorRenderer::waitForRemoteRenderingToFinish(std::unique_lock<std::mutex>& lock)
+{
+    if(!isRemoteDataReady && !simImpl->isRemoteRendererDisconnected){
         if(simImpl->isBestEffortMode){
             if(elapsedTime > cycleTime){
                 elapsedTime = cycleTime;
             }
             return false;
         } else {
-            while(!sharedScene->isRenderingFinished){
-                simImpl->queueCondition.wait(lock);
+            while(!isRemoteDataReady && !simImpl->isRemoteRendererDisconnected){
+                simImpl->remoteCondition.wait(lock);
             }
         }
     }
-    sharedScene->isRenderingFinished = false;
+    // The data is not returned any more when the connection is lost
+    if(!isRemoteDataReady){
+        remoteData.isValid = false;
+    }
+    isRemoteDataReady = false;
 
     return true;
 }
@@ -1431,14 +3103,20 @@ void SensorRenderer::clearVisionData()
 }
    
         
-void SensorRenderer::copyVisionData()
+bool SensorRenderer::copyVisionData()
 {
+    TraceRecorder::Scope trace("Sensor data output", "vision");
+
     bool hasUpdatedData = true;
     for(auto& screen : screens){
         hasUpdatedData = hasUpdatedData && screen->hasUpdatedData;
     }
 
     if(hasUpdatedData){
+        if(simImpl->isPerformanceMeasurementEnabled){
+            latencies.push_back(
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - onsetWallTime).count());
+        }
         double delay = simImpl->currentTime - onsetTime;
         if(camera){
             auto lensType = camera->lensType();
@@ -1452,18 +3130,20 @@ void SensorRenderer::copyVisionData()
                     rangeCamera->setDense(screen->isDense);
                 }
             } else if(lensType == Camera::FISHEYE_LENS || lensType == Camera::DUAL_FISHEYE_LENS){
-                std::shared_ptr<Image> image = std::make_shared<Image>();
+                std::shared_ptr<Image> image = imagePool.get();
                 fisheyeLensConverter.convertImage(image.get());
                 camera->setImage(image);
             }
             camera->setDelay(delay);
         } else if(rangeSensor){
             if(screens.empty()){
-                rangeData = std::make_shared<vector<double>>();
+                rangeData = rangeDataPool.get();
+                rangeData->clear();
             } else if(screens.size() == 1){
-                rangeData = screens[0]->tmpRangeData;
+                // Moved so that the data is not copied by setRangeData
+                rangeData = std::move(screens[0]->tmpRangeData);
             } else {
-                rangeData = std::make_shared<vector<double>>();
+                rangeData = rangeDataPool.get();
                 vector<double>::iterator src[4];
                 int size = 0;
                 for(size_t i=0; i < screens.size(); ++i){
@@ -1490,7 +3170,8 @@ void SensorRenderer::copyVisionData()
             rangeSensor->setDelay(delay);
         }
 
-        if(simImpl->isVisionDataRecordingEnabled){
+        // The bodies of the render node are not managed by any simulator
+        if(simImpl->isVisionDataRecordingEnabled || simImpl->isRemoteRenderingSession){
             device->notifyStateChange();
         } else {
             simBody->notifyUnrecordedDeviceStateChange(device);
@@ -1500,6 +3181,113 @@ void SensorRenderer::copyVisionData()
             screen->hasUpdatedData = false;
         }
     }
+
+    return hasUpdatedData;
+}
+
+
+void SensorRenderer::copyRemoteVisionData()
+{
+    if(!remoteData.isValid){
+        return;
+    }
+    if(simImpl->isPerformanceMeasurementEnabled){
+        latencies.push_back(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - onsetWallTime).count());
+    }
+    double delay = simImpl->currentTime - onsetTime;
+    if(camera){
+        if(remoteData.image && !remoteData.image->empty()){
+            camera->setImage(remoteData.image);
+        }
+        if(rangeCamera && remoteData.points){
+            rangeCamera->setPoints(remoteData.points);
+            rangeCamera->setDense(remoteData.isDense);
+        }
+        camera->setDelay(delay);
+    } else if(rangeSensor && remoteData.rangeData){
+        rangeSensor->setRangeData(remoteData.rangeData);
+        rangeSensor->setDelay(delay);
+    }
+
+    if(simImpl->isVisionDataRecordingEnabled){
+        device->notifyStateChange();
+    } else {
+        simBody->notifyUnrecordedDeviceStateChange(device);
+    }
+}
+
+
+/**
+   The data output to the sensor by copyVisionData is written for the client of the render node.
+   The range data is converted into the float values.
+*/
+void SensorRenderer::writeRemoteVisionData(MessageWriter& writer)
+{
+    if(camera){
+        const Image& image = camera->constImage();
+        writer.writeShort(image.width());
+        writer.writeShort(image.height());
+        writer.writeOctet(image.numComponents());
+        const size_t size = image.width() * image.height() * image.numComponents();
+        writeCompressedData(writer, size > 0 ? reinterpret_cast<const char*>(image.pixels()) : nullptr, size);
+        if(rangeCamera){
+            auto& points = rangeCamera->constPoints();
+            writer.writeOctet(rangeCamera->isDense());
+            writer.writeInt(points.size());
+            writeCompressedData(
+                writer, reinterpret_cast<const char*>(points.data()), points.size() * sizeof(Vector3f));
+        }
+    } else if(rangeSensor){
+        auto& rangeData = rangeSensor->constRangeData();
+        vector<float> values(rangeData.begin(), rangeData.end());
+        writer.writeInt(values.size());
+        writeCompressedData(writer, reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+    }
+}
+
+
+//! This is called in the thread communicating with the render node
+void SensorRenderer::readRemoteVisionData(MessageReader& reader, RemoteVisionData& out_data)
+{
+    if(camera){
+        const int width = reader.readShort();
+        const int height = reader.readShort();
+        const int numComponents = reader.readOctet();
+        if(width < 0 || height < 0){
+            throw NotEnoughDataException();
+        }
+        const size_t size = static_cast<size_t>(width) * height * numComponents;
+        if(size > maxMessageSize){
+            throw NotEnoughDataException();
+        }
+        out_data.image = std::make_shared<Image>();
+        if(size > 0){
+            out_data.image->setSize(width, height, numComponents);
+            readCompressedData(reader, reinterpret_cast<char*>(out_data.image->pixels()), size);
+        } else {
+            readCompressedData(reader, nullptr, 0);
+        }
+        if(rangeCamera){
+            out_data.isDense = reader.readOctet();
+            const int numPoints = reader.readInt();
+            if(numPoints < 0 || static_cast<size_t>(numPoints) * sizeof(Vector3f) > maxMessageSize){
+                throw NotEnoughDataException();
+            }
+            out_data.points = std::make_shared<RangeCamera::PointData>(numPoints);
+            readCompressedData(
+                reader, reinterpret_cast<char*>(out_data.points->data()), numPoints * sizeof(Vector3f));
+        }
+    } else if(rangeSensor){
+        const int numValues = reader.readInt();
+        if(numValues < 0 || static_cast<size_t>(numValues) * sizeof(float) > maxMessageSize){
+            throw NotEnoughDataException();
+        }
+        vector<float> values(numValues);
+        readCompressedData(reader, reinterpret_cast<char*>(values.data()), numValues * sizeof(float));
+        out_data.rangeData = std::make_shared<RangeSensor::RangeData>(values.begin(), values.end());
+    }
+    out_data.isValid = true;
 }
 
 
@@ -1508,34 +3296,29 @@ bool SensorScreenRenderer::getCameraImage(Image& image)
     if(cameraForRendering->imageType() != Camera::COLOR_IMAGE){
         return false;
     }
-    image.setSize(pixelWidth, pixelHeight, 3);
-    glPixelStorei(GL_PACK_ALIGNMENT, 1);
-    glReadPixels(0, 0, pixelWidth, pixelHeight, GL_RGB, GL_UNSIGNED_BYTE, image.pixels());
-    image.applyVerticalFlip();
+    if(isAsyncReadbackEnabled){
+        // The lines are flipped in the copy from the mapped buffer to avoid another pass
+        ImageRegion region(readColorPixels(), pixelWidth, pixelHeight, 3, pixelWidth * 3);
+        image.assign(region.flipped());
+    } else {
+        // The pixels are directly read into the image
+        image.setSize(pixelWidth, pixelHeight, 3);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(viewportX, viewportY, pixelWidth, pixelHeight, GL_RGB, GL_UNSIGNED_BYTE, image.pixels());
+        image.applyVerticalFlip();
+    }
     return true;
 }
 
 
 bool SensorScreenRenderer::getRangeCameraData(Image& image, vector<Vector3f>& points)
 {
-#ifndef _WIN32
-    unsigned char* colorBuf = 0;
-#else
-    vector<unsigned char> colorBuf;
-#endif
-
+    const unsigned char* colorPixels = 0;
     unsigned char* pixels = 0;
 
-    const bool extractColors = (cameraForRendering->imageType() == Camera::COLOR_IMAGE);
+    const bool extractColors = readsColorPixels();
     if(extractColors){
-        glPixelStorei(GL_PACK_ALIGNMENT, 1);
-#ifndef _WIN32
-        colorBuf = (unsigned char*)alloca(pixelWidth * pixelHeight * 3 * sizeof(unsigned char));
-        glReadPixels(0, 0, pixelWidth, pixelHeight, GL_RGB, GL_UNSIGNED_BYTE, colorBuf);
-#else
-        colorBuf.resize(pixelWidth * pixelHeight * 3 * sizeof(unsigned char));
-        glReadPixels(0, 0, pixelWidth, pixelHeight, GL_RGB, GL_UNSIGNED_BYTE, &colorBuf[0]);
-#endif
+        colorPixels = readColorPixels();
         if(rangeCameraForRendering->isOrganized()){
             image.setSize(pixelWidth, pixelHeight, 3);
         } else {
@@ -1544,14 +3327,10 @@ bool SensorScreenRenderer::getRangeCameraData(Image& image, vector<Vector3f>& po
         pixels = image.pixels();
     }
 
-#ifndef _WIN32
-    float* depthBuf = (float*)alloca(pixelWidth * pixelHeight * sizeof(float));
-    glReadPixels(0, 0, pixelWidth, pixelHeight, GL_DEPTH_COMPONENT, GL_FLOAT, depthBuf);
-#else
-    vector<float> depthBuf(pixelWidth * pixelHeight * sizeof(float));
-    glReadPixels(0, 0, pixelWidth, pixelHeight, GL_DEPTH_COMPONENT, GL_FLOAT, &depthBuf[0]);
-#endif
-    const Matrix4f Pinv = renderer->projectionMatrix().inverse().cast<float>();
+    const float* depthPixels = readDepthPixels();
+    // The points have been calculated with the depth converter if it is initialized
+    const bool isConverted = depthConverter.isInitialized();
+    const Matrix4f Pinv = projectionMatrix.inverse().cast<float>();
     const float fw = pixelWidth;
     const float fh = pixelHeight;
     const int cx = pixelWidth / 2;
@@ -1561,28 +3340,39 @@ bool SensorScreenRenderer::getRangeCameraData(Image& image, vector<Vector3f>& po
     n[3] = 1.0f;
     points.clear();
     points.reserve(pixelWidth * pixelHeight);
-    unsigned char* colorSrc = 0;
+    const unsigned char* colorSrc = 0;
 
     isDense = true;
     
     for(int y = pixelHeight - 1; y >= 0; --y){
         int srcpos = y * pixelWidth;
         if(extractColors){
-#ifndef _WIN32
-            colorSrc = colorBuf + y * pixelWidth * 3;
-#else
-            colorSrc = &colorBuf[0] + y *pixelWidth * 3;
-#endif
+            colorSrc = colorPixels + y * pixelWidth * 3;
         }
         for(int x=0; x < pixelWidth; ++x){
-            const float z = depthBuf[srcpos + x];
-            if(z > 0.0f && z < 1.0f){
-                n.x() = 2.0f * x / fw - 1.0f;
-                n.y() = 2.0f * y / fh - 1.0f;
-                n.z() = 2.0f * z - 1.0f;
-                const Vector4f o = Pinv * n;
-                const float& w = o[3];
-                points.push_back(Vector3f(o[0] / w, o[1] / w, o[2] / w));
+            bool isValid;
+            bool isNearest;
+            if(isConverted){
+                const float* point = depthPixels + (srcpos + x) * 4;
+                isValid = (point[3] == 1.0f);
+                isNearest = (point[3] == 0.0f);
+                if(isValid){
+                    points.push_back(Vector3f(point[0], point[1], point[2]));
+                }
+            } else {
+                const float z = depthPixels[srcpos + x];
+                isValid = (z > 0.0f && z < 1.0f);
+                isNearest = (z <= 0.0f);
+                if(isValid){
+                    n.x() = 2.0f * x / fw - 1.0f;
+                    n.y() = 2.0f * y / fh - 1.0f;
+                    n.z() = 2.0f * z - 1.0f;
+                    const Vector4f o = Pinv * n;
+                    const float& w = o[3];
+                    points.push_back(Vector3f(o[0] / w, o[1] / w, o[2] / w));
+                }
+            }
+            if(isValid){
                 if(pixels){
                     pixels[0] = colorSrc[0];
                     pixels[1] = colorSrc[1];
@@ -1592,7 +3382,7 @@ bool SensorScreenRenderer::getRangeCameraData(Image& image, vector<Vector3f>& po
             } else if(isOrganized){
                 points.push_back(Vector3f());
                 Vector3f& p = points.back();
-                if(z <= 0.0f){
+                if(isNearest){
                     p.z() = numeric_limits<float>::infinity();
                 } else {
                     p.z() = -numeric_limits<float>::infinity();
@@ -1629,114 +3419,82 @@ bool SensorScreenRenderer::getRangeCameraData(Image& image, vector<Vector3f>& po
 
 bool SensorScreenRenderer::getRangeSensorData(vector<double>& rangeData)
 {
-    const double yawRange = rangeSensorForRendering->yawRange();
-    const double yawStep = rangeSensorForRendering->yawStep();
-    const double maxTanYawAngle = tan(yawRange / 2.0);
+    const float* depthBuf = readDepthPixels();
+    const int numSamples = rangeSamplePixels.size();
+    rangeData.clear();
+    rangeData.reserve(numSamples);
 
-    const double pitchRange = rangeSensorForRendering->pitchRange();
-    const int numPitchSamples = rangeSensorForRendering->numPitchSamples();
-    const double pitchStep = rangeSensorForRendering->pitchStep();
-    const double maxTanPitchAngle = tan(pitchRange / 2.0) / cos(yawRange / 2.0);
+    if(depthConverter.isInitialized()){
+        for(int i=0; i < numSamples; ++i){
+            const float range = depthBuf[i];
+            if(range >= 0.0f){
+                rangeData.push_back(range);
+            } else {
+                rangeData.push_back(std::numeric_limits<double>::infinity());
+            }
+        }
+        return true;
+    }
 
-    const Matrix4 Pinv = renderer->projectionMatrix().inverse();
+    const Matrix4 Pinv = projectionMatrix.inverse();
     const double Pinv_32 = Pinv(3, 2);
     const double Pinv_33 = Pinv(3, 3);
-    const double fw = pixelWidth;
-    const double fh = pixelHeight;
-    const int wh = pixelWidth * pixelHeight;
-
-#ifndef _WIN32
-    float* depthBuf;
-    if(wh > 1e6){
-        depthBuf = (float*)malloc(pixelWidth * pixelHeight * sizeof(float));
-    }else{
-        depthBuf = (float*)alloca(pixelWidth * pixelHeight * sizeof(float));
-    }
-    glReadPixels(0, 0, pixelWidth, pixelHeight, GL_DEPTH_COMPONENT, GL_FLOAT, depthBuf);
-#else
-    vector<float> depthBuf(pixelWidth * pixelHeight * sizeof(float));
-    glReadPixels(0, 0, pixelWidth, pixelHeight, GL_DEPTH_COMPONENT, GL_FLOAT, &depthBuf[0]);
-#endif
-
-    rangeData.reserve(numUniqueYawSamples * numPitchSamples);
-
-    for(int pitch=0; pitch < numPitchSamples; ++pitch){
-        const double pitchAngle = pitch * pitchStep - pitchRange / 2.0;
-        const double cosPitchAngle = cos(pitchAngle);
-
-        for(int yaw=0; yaw < numUniqueYawSamples; ++yaw){
-            const double yawAngle = yaw * yawStep - yawRange / 2.0;
 
-            int py;
-            if(pitchRange == 0.0){
-                py = 0;
-            } else {
-                const double r = (tan(pitchAngle)/cos(yawAngle) + maxTanPitchAngle) / (maxTanPitchAngle * 2.0);
-                py = myNearByInt(r * (fh - 1.0));
-            }
-            const int srcpos = py * pixelWidth;
+    for(int i=0; i < numSamples; ++i){
+        const int px = rangeSamplePixels[i].x();
+        const int py = rangeSamplePixels[i].y();
+        //! \todo add the option to do the interpolation between the adjacent two pixel depths
+        const float depth = depthBuf[py * pixelWidth + px];
+        if(depth > 0.0f && depth < 1.0f){
+            const double z0 = 2.0 * depth - 1.0;
+            const double w = Pinv_32 * z0 + Pinv_33;
+            const double z = -1.0 / w + depthError;
+            rangeData.push_back(fabs(z * rangeSampleScales[i]));
 
-            int px;
-            if(yawRange == 0.0){
-                px = 0;
-            } else {
-                const double r = (maxTanYawAngle - tan(yawAngle)) / (maxTanYawAngle * 2.0);
-                px = myNearByInt(r * (fw - 1.0));
-            }
-            //! \todo add the option to do the interpolation between the adjacent two pixel depths
-            const float depth = depthBuf[srcpos + px];
-            if(depth > 0.0f && depth < 1.0f){
-                const double z0 = 2.0 * depth - 1.0;
-                const double w = Pinv_32 * z0 + Pinv_33;
-                const double z = -1.0 / w + depthError;
-                rangeData.push_back(fabs((z / cosPitchAngle) / cos(yawAngle)));
-
-                if(DEBUG_MESSAGE){
-                    const Matrix4 Pinv = renderer->projectionMatrix().inverse();
-                    const float fw = pixelWidth;
-                    const float fh = pixelHeight;
-                    const int cx = pixelWidth / 2;
-                    const int cy = pixelHeight / 2;
-                    Vector4 n;
-                    n[3] = 1.0f;
-                    n.x() = 2.0 * px / fw - 1.0;
-                    n.y() = 2.0 * py / fh - 1.0;
-                    n.z() = 2.0 * depth - 1.0f;
-                    const Vector4 o = Pinv * n;
-                    const double& ww = o[3];
-                    double x_ = o[0] / ww;
-                    double y_ = o[1] / ww;
-                    double z_ = o[2] / ww;
-                    double distance_ = sqrt(x_*x_ + y_*y_ + z_*z_);
-                    double pitchAngle_ = asin( y_ / distance_);
-                    double yawAngle_ = -asin( x_ / sqrt(x_*x_ + z_*z_) );
-
-                    cout << "pixelX= " << px << "  pixelY= " << py << endl;
-                    cout << "pitch= " << degree(pitchAngle_)  << " yaw= " << degree(yawAngle_) << endl;
-                    cout << "pitch= " << degree(pitchAngle)  << " yaw= " << degree(yawAngle) << endl;
-                    cout << "x= " << x_ << " "
-                         << "y= " << y_ << " "
-                         << "z= " << z_ << endl;
-                    double distance = fabs((z / cosPitchAngle) / cos(yawAngle));
-                    double x = distance *  cosPitchAngle * sin(-yawAngle);
-                    double y  = distance * sin(pitchAngle);
-                    cout << "x= " << x << " "
-                         << "y= " << y << " "
-                         << "z= " << z  << endl;
-                    cout << endl;
-                }
-            } else {
-                rangeData.push_back(std::numeric_limits<double>::infinity());
+            if(DEBUG_MESSAGE){
+                const double pitchAngle = (i / numUniqueYawSamples) * rangeSensorForRendering->pitchStep()
+                    - rangeSensorForRendering->pitchRange() / 2.0;
+                const double yawAngle = (i % numUniqueYawSamples) * rangeSensorForRendering->yawStep()
+                    - rangeSensorForRendering->yawRange() / 2.0;
+                const double cosPitchAngle = cos(pitchAngle);
+                const Matrix4 Pinv = projectionMatrix.inverse();
+                const float fw = pixelWidth;
+                const float fh = pixelHeight;
+                const int cx = pixelWidth / 2;
+                const int cy = pixelHeight / 2;
+                Vector4 n;
+                n[3] = 1.0f;
+                n.x() = 2.0 * px / fw - 1.0;
+                n.y() = 2.0 * py / fh - 1.0;
+                n.z() = 2.0 * depth - 1.0f;
+                const Vector4 o = Pinv * n;
+                const double& ww = o[3];
+                double x_ = o[0] / ww;
+                double y_ = o[1] / ww;
+                double z_ = o[2] / ww;
+                double distance_ = sqrt(x_*x_ + y_*y_ + z_*z_);
+                double pitchAngle_ = asin( y_ / distance_);
+                double yawAngle_ = -asin( x_ / sqrt(x_*x_ + z_*z_) );
+
+                cout << "pixelX= " << px << "  pixelY= " << py << endl;
+                cout << "pitch= " << degree(pitchAngle_)  << " yaw= " << degree(yawAngle_) << endl;
+                cout << "pitch= " << degree(pitchAngle)  << " yaw= " << degree(yawAngle) << endl;
+                cout << "x= " << x_ << " "
+                     << "y= " << y_ << " "
+                     << "z= " << z_ << endl;
+                double distance = fabs((z / cosPitchAngle) / cos(yawAngle));
+                double x = distance *  cosPitchAngle * sin(-yawAngle);
+                double y  = distance * sin(pitchAngle);
+                cout << "x= " << x << " "
+                     << "y= " << y << " "
+                     << "z= " << z  << endl;
+                cout << endl;
             }
+        } else {
+            rangeData.push_back(std::numeric_limits<double>::infinity());
         }
     }
 
-#ifndef _WIN32
-    if(wh > 1e6){
-        free(depthBuf);
-    }
-#endif
-
     return true;
 }
 
@@ -1747,8 +3505,21 @@ void GLVisionSimulatorItem::finalizeSimulation()
 }
 
 
+void GLVisionSimulatorItem::getDeviceTimeStatistics(std::vector<SimulationTimeStatistics>& out_statistics)
+{
+    if(impl->sensorUpdateTimes.count() > 0){
+        out_statistics.push_back({ name(), "Vision sensor update", impl->sensorUpdateTimes });
+        out_statistics.push_back({ name(), "Vision sensor output", impl->sensorOutputTimes });
+    }
+}
+
+
 void GLVisionSimulatorItemImpl::finalizeSimulation()
 {
+    if(useRemoteRenderer){
+        finalizeRemoteRendererClient();
+    }
+    
     if(useQueueThreadForAllSensors){
         {
             std::lock_guard<std::mutex> lock(queueMutex);
@@ -1760,11 +3531,71 @@ void GLVisionSimulatorItemImpl::finalizeSimulation()
             sensorQueue.pop();
         }
     }
+
+    if(isPerformanceMeasurementEnabled){
+        collectSensorStatistics();
+    }
         
     sensorRenderers.clear();
 }
 
 
+void GLVisionSimulatorItemImpl::finalizeRemoteRendererClient()
+{
+    {
+        std::lock_guard<std::mutex> lock(remoteMutex);
+        isRemoteRenderingTerminationRequested = true;
+    }
+    remoteCondition.notify_all();
+    remoteThread.wait();
+    remoteRequests.clear();
+    remoteDeviceStates.clear();
+}
+
+
+void GLVisionSimulatorItemImpl::collectSensorStatistics()
+{
+    double elapsedTime =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - measurementStartTime).count();
+
+    // The rendering threads are stopped so that the accumulated times are not updated any more
+    if(useThreadsForSensors){
+        for(auto& renderer : sensorRenderers){
+            for(auto& scene : renderer->scenes){
+                scene->terminate();
+            }
+        }
+    }
+    
+    for(auto& renderer : sensorRenderers){
+        GLVisionSimulatorItem::SensorStatistics stat;
+        stat.bodyName = renderer->simBody->body()->name();
+        stat.sensorName = renderer->device->name();
+        stat.numScreens = renderer->screens.size();
+        stat.numFrames = renderer->latencies.size();
+        stat.frameRate = (elapsedTime > 0.0) ? (stat.numFrames / elapsedTime) : 0.0;
+        stat.renderingTime = 0.0;
+        stat.readbackTime = 0.0;
+        for(auto& screen : renderer->screens){
+            if(screen->numRenderedFrames > 0){
+                stat.renderingTime += screen->renderingTimeSum / screen->numRenderedFrames;
+                stat.readbackTime += screen->readbackTimeSum / screen->numRenderedFrames;
+            }
+        }
+        auto& latencies = renderer->latencies;
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double p){
+            return latencies.empty() ? 0.0 : latencies[static_cast<size_t>(p * (latencies.size() - 1))];
+        };
+        stat.latencyP50 = percentile(0.5);
+        stat.latencyP90 = percentile(0.9);
+        stat.latencyP99 = percentile(0.99);
+        stat.maxLatency = latencies.empty() ? 0.0 : latencies.back();
+        sensorStatistics.push_back(stat);
+    }
+}
+
+
 SensorRenderer::~SensorRenderer()
 {
     if(simImpl->useThreadsForSensors){
@@ -1789,8 +3620,25 @@ void SensorScene::terminate()
 
 SensorScreenRenderer::~SensorScreenRenderer()
 {
+    if(atlasOwner){
+        // The renderer is deleted by the owner
+        atlasOwner->makeGLContextCurrent();
+        releaseReadbackResources();
+        atlasOwner->doneGLContextCurrent();
+        return;
+    }
+#ifdef CNOID_ENABLE_EGL
+    if(eglContext){
+        if(eglContext->makeCurrent()){
+            releaseReadbackResources();
+            eglContext->doneCurrent();
+        }
+        eglContext.reset();
+    }
+#endif
     if(glContext){
         makeGLContextCurrent();
+        releaseReadbackResources();
         frameBuffer->release();
         delete frameBuffer;
         delete glContext;
@@ -1800,7 +3648,323 @@ SensorScreenRenderer::~SensorScreenRenderer()
         delete renderer;
     }
 }
+
+
+void SensorScreenRenderer::releaseReadbackResources()
+{
+    depthConverter.release();
+    if(isAsyncReadbackEnabled){
+        auto& gl = pixelBufferFunctions;
+        if(readbackFence){
+            gl.glDeleteSync(readbackFence);
+        }
+        if(colorPixelBuffer){
+            gl.glDeleteBuffers(1, &colorPixelBuffer);
+        }
+        if(depthPixelBuffer){
+            gl.glDeleteBuffers(1, &depthPixelBuffer);
+        }
+    }
+}
+    
+
+/**
+   The bodies of the client are replaced with the copies of the body items of the same names
+   in the project of the render node, and the renderers of the requested sensors are initialized
+   with the settings of this item. The sensors are rendered in the main thread.
+*/
+bool GLVisionSimulatorItemImpl::initializeRemoteRenderingSession(MessageReader& reader, string& out_error)
+{
+    if(reader.readString() != remoteRenderingMagic || reader.readShort() != remoteRenderingProtocolVersion){
+        out_error = _("The protocol of the client is not supported.");
+        return false;
+    }
+    
+    ItemList<BodyItem> bodyItems;
+    if(auto worldItem = self->findOwnerItem<WorldItem>()){
+        bodyItems.extractSubTreeItems(worldItem);
+    } else {
+        bodyItems.extractSubTreeItems(RootItem::instance());
+    }
+
+    remoteSessionBodies.clear();
+    vector<SimulationBody*> simBodies;
+    const int numBodies = reader.readShort();
+    for(int i=0; i < numBodies; ++i){
+        const string name = reader.readString();
+        const int numLinks = reader.readShort();
+        const int numDevices = reader.readShort();
+        BodyItem* bodyItem = nullptr;
+        for(size_t j=0; j < bodyItems.size(); ++j){
+            if(bodyItems.get(j)->name() == name){
+                bodyItem = bodyItems.get(j);
+                break;
+            }
+        }
+        if(!bodyItem){
+            out_error = format(_("Body \"{}\" is not found in the render node."), name);
+            return false;
+        }
+        Body* orgBody = bodyItem->body();
+        if(orgBody->numLinks() != numLinks || orgBody->numDevices() != numDevices){
+            out_error = format(_("The model of body \"{}\" is different in the render node."), name);
+            return false;
+        }
+        SimulationBodyPtr simBody = new SimulationBody(orgBody->clone());
+        remoteSessionBodies.push_back(simBody);
+        simBodies.push_back(simBody);
+    }
+
+    simulatorItem = nullptr;
+    currentTime = 0.0;
+    sensorRenderers.clear();
+    useQueueThreadForAllSensors = false;
+    useThreadsForSensors = false;
+    useThreadsForScreens = false;
+    useRemoteRenderer = false;
+    isBestEffortMode = false;
+    isTimeStatisticsEnabled = false;
+    isRemoteRenderingSession = true;
+
+    initializeRenderingContexts();
+
+    const int numSensors = reader.readShort();
+    for(int i=0; i < numSensors; ++i){
+        const int bodyIndex = reader.readShort();
+        const int deviceIndex = reader.readShort();
+        if(bodyIndex < 0 || bodyIndex >= numBodies){
+            throw NotEnoughDataException();
+        }
+        Body* body = simBodies[bodyIndex]->body();
+        Device* device = (deviceIndex >= 0 && deviceIndex < body->numDevices()) ? body->device(deviceIndex) : nullptr;
+        if(!dynamic_cast<Camera*>(device) && !dynamic_cast<RangeSensor*>(device)){
+            out_error = format(_("A vision sensor of body \"{}\" is not found in the render node."), body->name());
+            return false;
+        }
+        sensorRenderers.push_back(new SensorRenderer(this, device, simBodies[bodyIndex], bodyIndex));
+    }
+
+    linkPositionTracker.initialize(simBodies);
+
+    for(auto& renderer : sensorRenderers){
+        if(!renderer->initialize(simBodies)){
+            out_error = format(_("Vision sensor \"{0}\" of {1} cannot be initialized in the render node."),
+                               renderer->device->name(), renderer->simBody->body()->name());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void GLVisionSimulatorItemImpl::renderRemoteRequest(MessageReader& reader, vector<char>& out_data)
+{
+    currentTime = reader.readFloat();
+
+    const int numBodies = reader.readShort();
+    for(int i=0; i < numBodies; ++i){
+        const int bodyIndex = reader.readShort();
+        if(bodyIndex < 0 || bodyIndex >= static_cast<int>(remoteSessionBodies.size())){
+            throw NotEnoughDataException();
+        }
+        Body* body = remoteSessionBodies[bodyIndex]->body();
+        const int numLinks = reader.readVarInt();
+        for(int j=0; j < numLinks; ++j){
+            const int linkIndex = reader.readVarInt();
+            if(linkIndex < 0 || linkIndex >= body->numLinks()){
+                throw NotEnoughDataException();
+            }
+            Vector3 p;
+            p.x() = reader.readFloat();
+            p.y() = reader.readFloat();
+            p.z() = reader.readFloat();
+            Quat q;
+            q.w() = reader.readFloat();
+            q.x() = reader.readFloat();
+            q.y() = reader.readFloat();
+            q.z() = reader.readFloat();
+            Link* link = body->link(linkIndex);
+            link->setTranslation(p);
+            link->setRotation(q.normalized().toRotationMatrix());
+        }
+    }
+
+    const int numDevices = reader.readShort();
+    vector<double> state;
+    for(int i=0; i < numDevices; ++i){
+        const int bodyIndex = reader.readShort();
+        const int deviceIndex = reader.readShort();
+        const int stateSize = reader.readShort();
+        if(bodyIndex < 0 || bodyIndex >= static_cast<int>(remoteSessionBodies.size())){
+            throw NotEnoughDataException();
+        }
+        Body* body = remoteSessionBodies[bodyIndex]->body();
+        if(deviceIndex < 0 || deviceIndex >= body->numDevices()){
+            throw NotEnoughDataException();
+        }
+        Device* device = body->device(deviceIndex);
+        if(stateSize != device->stateSize()){
+            throw NotEnoughDataException();
+        }
+        state.resize(stateSize);
+        for(auto& value : state){
+            value = reader.readFloat();
+        }
+        device->readState(state.data());
+    }
+
+    vector<int> indices(reader.readShort());
+    for(auto& index : indices){
+        index = reader.readShort();
+        if(index < 0 || index >= static_cast<int>(sensorRenderers.size())){
+            throw NotEnoughDataException();
+        }
+    }
+
+    // The link positions are checked when a sensor scene is updated first
+    linkPositionTracker.isUpdated = false;
+
+    /*
+      All the requested sensors are rendered before any readback is waited for in the same way
+      as the queue thread.
+    */
+    SensorScreenRenderer* currentGLContextScreen = nullptr;
+    for(auto& index : indices){
+        auto& renderer = sensorRenderers[index];
+        renderer->updateSensorScene(true);
+        renderer->startRendering(currentGLContextScreen, true);
+    }
+    MessageWriter writer;
+    for(auto& index : indices){
+        auto& renderer = sensorRenderers[index];
+        renderer->finishRendering(currentGLContextScreen, true);
+        writer.begin(RENDER_RESULT);
+        writer.writeShort(index);
+        const bool hasUpdatedData = renderer->copyVisionData();
+        writer.writeOctet(hasUpdatedData);
+        if(hasUpdatedData){
+            renderer->writeRemoteVisionData(writer);
+        }
+        writer.end();
+        out_data.insert(out_data.end(), writer.data.begin(), writer.data.end());
+    }
+}
+
+
+void GLVisionSimulatorItemImpl::finalizeRemoteRenderingSession()
+{
+    sensorRenderers.clear();
+    remoteSessionBodies.clear();
+    isRemoteRenderingSession = false;
+}
+
+
+RemoteRenderingServer::RemoteRenderingServer(GLVisionSimulatorItem* item, GLVisionSimulatorItemImpl* simImpl)
+    : item(item),
+      simImpl(simImpl)
+{
+    socket = nullptr;
+    QObject::connect(&server, &QTcpServer::newConnection, [this](){ onNewConnection(); });
+}
+
+
+bool RemoteRenderingServer::start(int port)
+{
+    auto& os = simImpl->os;
+    if(!server.listen(QHostAddress::Any, port)){
+        os << format(_("The vision render server cannot listen to port {0}: {1}"),
+                     port, server.errorString().toStdString()) << endl;
+        return false;
+    }
+    os << format(_("The vision render server is listening to port {0} with the settings of {1}."),
+                 port, item->name()) << endl;
+    return true;
+}
+
+
+void RemoteRenderingServer::onNewConnection()
+{
+    while(QTcpSocket* newSocket = server.nextPendingConnection()){
+        if(socket){
+            newSocket->abort();
+            newSocket->deleteLater();
+            continue;
+        }
+        socket = newSocket;
+        receivedData.clear();
+        QObject::connect(socket, &QTcpSocket::readyRead, [this](){ onDataReceived(); });
+        QObject::connect(socket, &QTcpSocket::disconnected, [this](){ closeSession(); });
+        simImpl->os << format(_("A vision rendering client is connected from {}."),
+                              socket->peerAddress().toString().toStdString()) << endl;
+    }
+}
+
+
+void RemoteRenderingServer::onDataReceived()
+{
+    QByteArray data = socket->readAll();
+    receivedData.insert(receivedData.end(), data.constData(), data.constData() + data.size());
+
+    bool isValid;
+    try {
+        isValid = processReceivedMessages(
+            receivedData, [this](MessageReader& reader){ processMessage(reader); });
+    }
+    catch(const NotEnoughDataException&){
+        isValid = false;
+    }
+    if(!isValid){
+        simImpl->os << _("The vision render server received a broken message.") << endl;
+        closeSession();
+    }
+}
+
+
+void RemoteRenderingServer::processMessage(MessageReader& reader)
+{
+    const int id = reader.readOctet();
     
+    if(id == SETUP){
+        string error;
+        bool isAccepted = simImpl->initializeRemoteRenderingSession(reader, error);
+        if(isAccepted){
+            simImpl->os << format(_("{0} vision sensors are rendered for the client."),
+                                  simImpl->sensorRenderers.size()) << endl;
+        } else {
+            simImpl->os << error << endl;
+            simImpl->finalizeRemoteRenderingSession();
+        }
+        MessageWriter writer;
+        writer.begin(SETUP_RESULT);
+        writer.writeOctet(isAccepted);
+        writer.writeString(error);
+        writer.end();
+        socket->write(writer.data.data(), writer.data.size());
+
+    } else if(id == RENDER){
+        if(!simImpl->isRemoteRenderingSession){
+            throw NotEnoughDataException();
+        }
+        vector<char> results;
+        simImpl->renderRemoteRequest(reader, results);
+        socket->write(results.data(), results.size());
+    }
+}
+
+
+void RemoteRenderingServer::closeSession()
+{
+    if(socket){
+        socket->disconnect();
+        socket->abort();
+        socket->deleteLater();
+        socket = nullptr;
+        simImpl->finalizeRemoteRenderingSession();
+        simImpl->os << _("The vision rendering client is disconnected.") << endl;
+    }
+}
+
 
 void GLVisionSimulatorItem::doPutProperties(PutPropertyFunction& putProperty)
 {
@@ -1827,6 +3991,13 @@ void GLVisionSimulatorItemImpl::doPutProperties(PutPropertyFunction& putProperty
     putProperty.reset()(_("Head light"), isHeadLightEnabled, changeProperty(isHeadLightEnabled));
     putProperty.reset()(_("Additional lights"), areAdditionalLightsEnabled, changeProperty(areAdditionalLightsEnabled));
     putProperty(_("Anti-aliasing"), isAntiAliasingEnabled, changeProperty(isAntiAliasingEnabled));
+    putProperty(_("Asynchronous readback"), isAsyncReadbackEnabled, changeProperty(isAsyncReadbackEnabled));
+    putProperty(_("Headless rendering"), isHeadlessRenderingEnabled, changeProperty(isHeadlessRenderingEnabled));
+    putProperty(_("GPU depth conversion"), isGpuDepthConversionEnabled, changeProperty(isGpuDepthConversionEnabled));
+    putProperty(_("Atlas rendering"), isAtlasRenderingEnabled, changeProperty(isAtlasRenderingEnabled));
+    putProperty(_("Frustum culling"), isFrustumCullingEnabled, changeProperty(isFrustumCullingEnabled));
+    putProperty(_("Levels of detail"), isLODEnabled, changeProperty(isLODEnabled));
+    putProperty(_("Remote renderer"), remoteRendererAddress, changeProperty(remoteRendererAddress));
 }
 
 
@@ -1852,6 +4023,15 @@ bool GLVisionSimulatorItemImpl::store(Archive& archive)
     archive.write("enableHeadLight", isHeadLightEnabled);    
     archive.write("enableAdditionalLights", areAdditionalLightsEnabled);
     archive.write("antiAliasing", isAntiAliasingEnabled);
+    archive.write("asyncReadback", isAsyncReadbackEnabled);
+    archive.write("headlessRendering", isHeadlessRenderingEnabled);
+    archive.write("gpuDepthConversion", isGpuDepthConversionEnabled);
+    archive.write("atlasRendering", isAtlasRenderingEnabled);
+    archive.write("frustumCulling", isFrustumCullingEnabled);
+    archive.write("levelsOfDetail", isLODEnabled);
+    if(!remoteRendererAddress.empty()){
+        archive.write("remoteRenderer", remoteRendererAddress);
+    }
     return true;
 }
 
@@ -1880,6 +4060,13 @@ bool GLVisionSimulatorItemImpl::restore(const Archive& archive)
     archive.read("enableHeadLight", isHeadLightEnabled);
     archive.read("enableAdditionalLights", areAdditionalLightsEnabled);
     archive.read("antiAliasing", isAntiAliasingEnabled);
+    archive.read("asyncReadback", isAsyncReadbackEnabled);
+    archive.read("headlessRendering", isHeadlessRenderingEnabled);
+    archive.read("gpuDepthConversion", isGpuDepthConversionEnabled);
+    archive.read("atlasRendering", isAtlasRenderingEnabled);
+    archive.read("frustumCulling", isFrustumCullingEnabled);
+    archive.read("levelsOfDetail", isLODEnabled);
+    archive.read("remoteRenderer", remoteRendererAddress);
 
     string symbol;
     if(archive.read("threadMode", symbol)){
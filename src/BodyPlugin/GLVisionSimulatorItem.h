@@ -7,6 +7,8 @@
 #define CNOID_BODYPLUGIN_GL_VISION_SIMULATOREX_ITEM_H
 
 #include "SubSimulatorItem.h"
+#include <vector>
+#include <string>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -36,9 +38,99 @@ public:
     void setHeadLightEnabled(bool on);
     void setAdditionalLightsEnabled(bool on);
 
+    /**
+       The rendered images are read back through the pixel buffer objects so that the
+       rendering of the other screens is not stalled by the transfers. The default value is true.
+       The synchronous readback is used when the OpenGL context does not support OpenGL 3.2.
+    */
+    void setAsyncReadbackEnabled(bool on);
+
+    /**
+       The vision sensors are rendered with the EGL contexts, which do not require any windowing
+       system, instead of the Qt contexts. The EGL contexts are also used when the Qt platform is
+       "offscreen" or "minimal". This is only available when the plugin is built with
+       ENABLE_EGL_VISION_RENDERING.
+    */
+    void setHeadlessRenderingEnabled(bool on);
+
+    /**
+       The depth buffers of the range cameras and the range sensors are converted into the points
+       and the ranges by a shader so that only the converted data is read back. The default
+       value is true. The conversion is done by the CPU when OpenGL 3.3 is not available.
+    */
+    void setGpuDepthConversionEnabled(bool on);
+
+    /**
+       The screens of a sensor which requires multiple screens, such as a fisheye camera or a
+       range sensor with a wide yaw range, are rendered into the viewports of a frame buffer
+       shared by the screens so that the scene is only set up once for the screens. The default
+       value is true. This is not applied in the screen thread mode.
+    */
+    void setAtlasRenderingEnabled(bool on);
+
+    /**
+       The objects out of the view frustum of each screen are not rendered. The default value
+       is true. This is only applied when the GLSL renderer is used.
+    */
+    void setFrustumCullingEnabled(bool on);
+
+    /**
+       The simplified levels of the SgLOD nodes are used for the objects which are small in the
+       image of each sensor. The default value is true. This is only applied when the GLSL
+       renderer is used.
+    */
+    void setLODEnabled(bool on);
+
+    /**
+       The sensors are rendered by the render node of the address "host[:port]", which is a
+       Choreonoid process loading the same project with the "--vision-render-server [port]" option,
+       so that the simulation can be executed on a host without GPU. The positions of the moved
+       links and the changed device states are sent to the render node at the onset of the
+       rendering, and the returned data is output with the latency and the best effort mode in the
+       same way as the local rendering. An empty address, which is the default, disables it.
+    */
+    void setRemoteRenderer(const std::string& address);
+
+    /**
+       The rendering of each target sensor is timed with the wall-clock time during the simulation.
+       The statistics are available from sensorStatistics() after the simulation is finished.
+       The default value is false.
+    */
+    void setPerformanceMeasurementEnabled(bool on);
+
+    struct SensorStatistics
+    {
+        std::string bodyName;
+        std::string sensorName;
+        int numScreens;
+        int numFrames;
+        //! Output frames per second of the wall-clock time
+        double frameRate;
+        //! Mean time [s] of issuing the rendering commands of a frame
+        double renderingTime;
+        //! Mean time [s] of waiting for the rendered pixels and converting them into the sensor data
+        double readbackTime;
+        //! Wall-clock time [s] from the onset of rendering to the output to the sensor
+        double latencyP50;
+        double latencyP90;
+        double latencyP99;
+        double maxLatency;
+    };
+
+    const std::vector<SensorStatistics>& sensorStatistics() const;
+
     virtual bool initializeSimulation(SimulatorItem* simulatorItem);
     virtual void finalizeSimulation();
 
+    /**
+       The times of updating the sensor scenes before the dynamics and those of outputting
+       the sensor data after the dynamics are reported when the profiling is enabled.
+    */
+    virtual void getDeviceTimeStatistics(std::vector<SimulationTimeStatistics>& out_statistics);
+
+    //! The scene graphs cloned for the sensors and the image buffers are counted while simulating
+    virtual void countMemoryUsage(MemoryUsageCounter& counter);
+
     // deprecated
     void setDedicatedSensorThreadsEnabled(bool on); // setThreadMode(SENSOR_THREAD_MODE);
 
@@ -23,12 +23,14 @@
 #include <cnoid/BodyCollisionDetector>
 #include <cnoid/AISTCollisionDetector>
 #include <cnoid/IdPair>
+#include <cnoid/ThreadPool>
 #include <QDialogButtonBox>
 #include <QBoxLayout>
 #include <QFrame>
 #include <QLabel>
 #include <fmt/format.h>
 #include <map>
+#include <memory>
 #include "gettext.h"
 
 using namespace std;
@@ -40,6 +42,22 @@ namespace {
 
 bool USE_DUPLICATED_BODY = false;
 
+// The collisions of a frame are not detected again when no link moves more than these values
+const double COLLISION_CHECK_TRANSLATION_TOLERANCE = 1.0e-6;
+const double COLLISION_CHECK_ROTATION_TOLERANCE = 1.0e-6;
+
+// The minimum number of the frames checked by a collision check task
+const int MIN_NUM_COLLISION_CHECK_FRAMES = 100;
+
+typedef IdPair<int> LinkIndexPair;
+
+struct CollisionCheckTask
+{
+    BodyPtr body;
+    BodyCollisionDetector detector;
+    vector<Position, Eigen::aligned_allocator<Position>> lastCheckedPositions;
+};
+
 KinematicFaultChecker* checkerInstance = 0;
 
 #if defined(_MSC_VER) && _MSC_VER < 1800
@@ -75,8 +93,7 @@ public:
     int numFaults;
     vector<int> lastPosFaultFrames;
     vector<int> lastVelFaultFrames;
-    typedef IdPair<CollisionDetector::GeometryHandle> GeometryPair;
-    typedef std::map<GeometryPair, int> LastCollisionFrameMap;
+    typedef std::map<LinkIndexPair, int> LastCollisionFrameMap;
     LastCollisionFrameMap lastCollisionFrames;
 
     double frameRate;
@@ -94,7 +111,13 @@ public:
         dynamic_bitset<> linkSelection, double beginningTime, double endingTime);
     void putJointPositionFault(int frame, Link* joint, std::ostream& os);
     void putJointVelocityFault(int frame, Link* joint, std::ostream& os);
-    void putSelfCollision(Body* body, int frame, const CollisionPair& collisionPair, std::ostream& os);
+    void detectSelfCollisions(
+        Body* body, WorldItem* worldItem, BodyMotion* motion, int beginningFrame, int endingFrame,
+        vector<vector<LinkIndexPair>>& out_collisions);
+    void checkSelfCollisionsInFrameRange(
+        CollisionCheckTask& task, BodyMotion* motion, int beginningFrame, int endingFrame,
+        int frameOffset, vector<vector<LinkIndexPair>>& out_collisions);
+    void putSelfCollision(Body* body, int frame, const LinkIndexPair& linkPair, std::ostream& os);
 };
 }
 
@@ -351,7 +374,6 @@ int KinematicFaultCheckerImpl::checkFaults
     auto body = bodyItem->body();
     auto motion = motionItem->motion();
     auto qseq = motion->jointPosSeq();;
-    auto pseq = motion->linkPosSeq();
     
     if((!checkPosition && !checkVelocity && !checkCollision) || body->isStaticModel() || !qseq->getNumFrames()){
         return numFaults;
@@ -365,19 +387,7 @@ int KinematicFaultCheckerImpl::checkFaults
         bodyItem->storeKinematicState(orgKinematicState);
     }
 
-    BodyCollisionDetector bodyCollisionDetector;
-    WorldItem* worldItem = bodyItem->findOwnerItem<WorldItem>();
-    if(worldItem){
-        bodyCollisionDetector.setCollisionDetector(worldItem->collisionDetector()->clone());
-    } else {
-        bodyCollisionDetector.setCollisionDetector(new AISTCollisionDetector);
-    }
-
-    bodyCollisionDetector.addBody(body, true);
-    bodyCollisionDetector.makeReady();
-
     const int numJoints = std::min(body->numJoints(), qseq->numParts());
-    const int numLinks = std::min(body->numLinks(), pseq->numParts());
 
     frameRate = motion->frameRate();
     double stepRatio2 = 2.0 / frameRate;
@@ -394,10 +404,10 @@ int KinematicFaultCheckerImpl::checkFaults
     lastVelFaultFrames.resize(numJoints, std::numeric_limits<int>::min());
     lastCollisionFrames.clear();
 
+    vector<vector<LinkIndexPair>> collisions;
     if(checkCollision){
-        Link* root = body->rootLink();
-        root->p().setZero();
-        root->R().setIdentity();
+        detectSelfCollisions(
+            body, bodyItem->findOwnerItem<WorldItem>(), motion.get(), beginningFrame, endingFrame, collisions);
     }
         
     for(int frame = beginningFrame; frame <= endingFrame; ++frame){
@@ -432,46 +442,142 @@ int KinematicFaultCheckerImpl::checkFaults
         }
 
         if(checkCollision){
+            for(auto& linkPair : collisions[frame - beginningFrame]){
+                putSelfCollision(body, frame, linkPair, os);
+            }
+        }
+    }
+
+    if(!USE_DUPLICATED_BODY){
+        bodyItem->restoreKinematicState(orgKinematicState);
+    }
+
+    return numFaults;
+}
+
+
+/**
+   The frame range is divided into the ranges checked in parallel with the copies of the body
+   and the collision detector. The collisions are stored for each frame so that the faults
+   can be reported in the order of the frames.
+*/
+void KinematicFaultCheckerImpl::detectSelfCollisions
+(Body* body, WorldItem* worldItem, BodyMotion* motion, int beginningFrame, int endingFrame,
+ vector<vector<LinkIndexPair>>& out_collisions)
+{
+    const int numFrames = endingFrame - beginningFrame + 1;
+    out_collisions.clear();
+    out_collisions.resize(std::max(0, numFrames));
+    if(numFrames <= 0){
+        return;
+    }
+
+    ThreadPool* threadPool = ThreadPool::instance();
+    // The calling thread also executes a task
+    const int numTasks =
+        std::max(1, std::min(threadPool->size() + 1, numFrames / MIN_NUM_COLLISION_CHECK_FRAMES));
+
+    vector<unique_ptr<CollisionCheckTask>> tasks(numTasks);
+    for(auto& task : tasks){
+        task.reset(new CollisionCheckTask);
+        task->body = body->clone();
+        if(worldItem){
+            task->detector.setCollisionDetector(worldItem->collisionDetector()->clone());
+        } else {
+            task->detector.setCollisionDetector(new AISTCollisionDetector);
+        }
+    }
+
+    threadPool->parallelFor(
+        0, numTasks,
+        [&](int i){
+            auto& task = *tasks[i];
+            task.detector.addBody(task.body, true);
+            task.detector.makeReady();
+            const int first = beginningFrame + static_cast<int64_t>(numFrames) * i / numTasks;
+            const int last = beginningFrame + static_cast<int64_t>(numFrames) * (i + 1) / numTasks - 1;
+            checkSelfCollisionsInFrameRange(task, motion, first, last, beginningFrame, out_collisions);
+        },
+        1);
+}
+
+
+void KinematicFaultCheckerImpl::checkSelfCollisionsInFrameRange
+(CollisionCheckTask& task, BodyMotion* motion, int beginningFrame, int endingFrame,
+ int frameOffset, vector<vector<LinkIndexPair>>& out_collisions)
+{
+    Body* body = task.body;
+    auto qseq = motion->jointPosSeq();
+    auto pseq = motion->linkPosSeq();
+    const int numJoints = std::min(body->numJoints(), qseq->numParts());
+    const int numLinks = std::min(body->numLinks(), pseq->numParts());
+    auto& lastPositions = task.lastCheckedPositions;
+    lastPositions.resize(body->numLinks());
+    bool hasCheckedFrame = false;
+
+    for(int frame = beginningFrame; frame <= endingFrame; ++frame){
 
-            Link* link = body->link(0);
+        for(int i=0; i < numJoints; ++i){
+            body->joint(i)->q() = qseq->at(frame, i);
+        }
+        
+        Link* link = body->link(0);
+        if(!pseq->empty())
+        {
+            const SE3& p = pseq->at(frame, 0);
+            link->p() = p.translation();
+            link->R() = p.rotation().toRotationMatrix();
+        }
+        else
+        {
+            link->p() = Vector3d(0., 0., 0.);
+            link->R() = Matrix3d::Identity();
+        }
+
+        body->calcForwardKinematics();
+
+        for(int i=1; i < numLinks; ++i){
+            link = body->link(i);
             if(!pseq->empty())
             {
-                const SE3& p = pseq->at(frame, 0);
+                const SE3& p = pseq->at(frame, i);
                 link->p() = p.translation();
                 link->R() = p.rotation().toRotationMatrix();
             }
-            else
-            {
-                link->p() = Vector3d(0., 0., 0.);
-                link->R() = Matrix3d::Identity();
-            }
-
-            body->calcForwardKinematics();
+        }
 
-            for(int i=1; i < numLinks; ++i){
-                link = body->link(i);
-                if(!pseq->empty())
-                {
-                    const SE3& p = pseq->at(frame, i);
-                    link->p() = p.translation();
-                    link->R() = p.rotation().toRotationMatrix();
+        auto& collisions = out_collisions[frame - frameOffset];
+
+        bool isMoved = !hasCheckedFrame;
+        if(!isMoved){
+            for(int i=0; i < body->numLinks(); ++i){
+                const Position& T0 = lastPositions[i];
+                const Position& T1 = body->link(i)->T();
+                if((T1.translation() - T0.translation()).cwiseAbs().maxCoeff() > COLLISION_CHECK_TRANSLATION_TOLERANCE ||
+                   (T1.linear() - T0.linear()).cwiseAbs().maxCoeff() > COLLISION_CHECK_ROTATION_TOLERANCE){
+                    isMoved = true;
+                    break;
                 }
             }
-
-            bodyCollisionDetector.updatePositions();
-
-            bodyCollisionDetector.detectCollisions(
-                [&](const CollisionPair& collisionPair){
-                    putSelfCollision(body, frame, collisionPair, os);
-                });
         }
-    }
+        if(!isMoved){
+            collisions = out_collisions[frame - frameOffset - 1];
+            continue;
+        }
 
-    if(!USE_DUPLICATED_BODY){
-        bodyItem->restoreKinematicState(orgKinematicState);
+        for(int i=0; i < body->numLinks(); ++i){
+            lastPositions[i] = body->link(i)->T();
+        }
+        hasCheckedFrame = true;
+
+        task.detector.updatePositions();
+        task.detector.detectCollisions(
+            [&](const CollisionPair& collisionPair){
+                auto link0 = static_cast<Link*>(collisionPair.object(0));
+                auto link1 = static_cast<Link*>(collisionPair.object(1));
+                collisions.emplace_back(link0->index(), link1->index());
+            });
     }
-
-    return numFaults;
 }
 
 
@@ -531,14 +637,13 @@ void KinematicFaultCheckerImpl::putJointVelocityFault(int frame, Link* joint, st
 }
 
 
-void KinematicFaultCheckerImpl::putSelfCollision(Body* body, int frame, const CollisionPair& collisionPair, std::ostream& os)
+void KinematicFaultCheckerImpl::putSelfCollision(Body* body, int frame, const LinkIndexPair& linkPair, std::ostream& os)
 {
     bool putMessage = false;
-    GeometryPair gPair(collisionPair.geometries());
-    auto p = lastCollisionFrames.find(gPair);
+    auto p = lastCollisionFrames.find(linkPair);
     if(p == lastCollisionFrames.end()){
         putMessage = true;
-        lastCollisionFrames[gPair] = frame;
+        lastCollisionFrames[linkPair] = frame;
     } else {
         if(frame > p->second + 1){
             putMessage = true;
@@ -547,8 +652,8 @@ void KinematicFaultCheckerImpl::putSelfCollision(Body* body, int frame, const Co
     }
 
     if(putMessage){
-        Link* link0 = static_cast<Link*>(collisionPair.object(0));
-        Link* link1 = static_cast<Link*>(collisionPair.object(1));
+        Link* link0 = body->link(linkPair(0));
+        Link* link1 = body->link(linkPair(1));
         os << format(_("{0:7.3f} [s]: Collision between {1} and {2}"),
                      (frame / frameRate), link0->name(), link1->name()) << endl;
         numFaults++;
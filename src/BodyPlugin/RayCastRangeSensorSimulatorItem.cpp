@@ -0,0 +1,458 @@
+/*!
+  @file
+  @author Shin'ichiro Nakaoka
+*/
+
+#include "RayCastRangeSensorSimulatorItem.h"
+#include "SimulatorItem.h"
+#include <cnoid/ItemManager>
+#include <cnoid/MessageView>
+#include <cnoid/Archive>
+#include <cnoid/ValueTreeUtil>
+#include <cnoid/CollisionDetector>
+#include <cnoid/Body>
+#include <cnoid/RangeSensor>
+#include <fmt/format.h>
+#include <boost/tokenizer.hpp>
+#include <boost/algorithm/string.hpp>
+#include <set>
+#include <memory>
+#include <cmath>
+#include "gettext.h"
+
+using namespace std;
+using namespace cnoid;
+using fmt::format;
+
+namespace {
+
+string getNameListString(const vector<string>& names)
+{
+    string nameList;
+    if(!names.empty()){
+        size_t n = names.size() - 1;
+        for(size_t i=0; i < n; ++i){
+            nameList += names[i];
+            nameList += ", ";
+        }
+        nameList += names.back();
+    }
+    return nameList;
+}
+
+bool updateNames(const string& nameListString, string& newNameListString, vector<string>& names)
+{
+    using boost::tokenizer;
+    using boost::char_separator;
+
+    names.clear();
+    char_separator<char> sep(",");
+    tokenizer<char_separator<char>> tok(nameListString, sep);
+    for(tokenizer<char_separator<char>>::iterator p = tok.begin(); p != tok.end(); ++p){
+        string name = boost::trim_copy(*p);
+        if(!name.empty()){
+            names.push_back(name);
+        }
+    }
+    newNameListString = nameListString;
+    return true;
+}
+
+class SensorScanner : public Referenced
+{
+public:
+    SimulationBody* simBody;
+    RangeSensor* rangeSensor;
+    Link* link;
+    double cycleTime;
+    double elapsedTime;
+    //! The directions of the beams in the sensor coordinate, which are ordered in the same way as the range data
+    vector<Vector3> localDirections;
+    vector<Vector3> directions;
+    vector<double> distances;
+
+    SensorScanner(SimulationBody* simBody, RangeSensor* rangeSensor);
+};
+
+typedef ref_ptr<SensorScanner> SensorScannerPtr;
+
+}
+
+namespace cnoid {
+
+class RayCastRangeSensorSimulatorItemImpl
+{
+public:
+    RayCastRangeSensorSimulatorItem* self;
+    ostream& os;
+    SimulatorItem* simulatorItem;
+    CollisionDetectorPtr collisionDetector;
+    CollisionDetectorRayCastAPI* rayCaster;
+    vector<SensorScannerPtr> scanners;
+    double worldTimeStep;
+
+    vector<string> bodyNames;
+    string bodyNameListString;
+    vector<string> sensorNames;
+    string sensorNameListString;
+    double maxFrameRate;
+    bool isVisionDataRecordingEnabled;
+
+    RayCastRangeSensorSimulatorItemImpl(RayCastRangeSensorSimulatorItem* self);
+    RayCastRangeSensorSimulatorItemImpl(
+        RayCastRangeSensorSimulatorItem* self, const RayCastRangeSensorSimulatorItemImpl& org);
+    bool initializeSimulation(SimulatorItem* simulatorItem);
+    bool initializeCollisionDetector(const vector<SimulationBody*>& simBodies);
+    void onPostDynamics();
+    void scan(SensorScanner* scanner);
+    void notifyStateChange(SensorScanner* scanner);
+    void finalizeSimulation();
+    void doPutProperties(PutPropertyFunction& putProperty);
+    bool store(Archive& archive);
+    bool restore(const Archive& archive);
+
+    template<typename Type> void setProperty(Type& variable, const Type& value){
+        if(value != variable){
+            variable = value;
+            self->notifyUpdate();
+        }
+    }
+};
+
+}
+
+
+void RayCastRangeSensorSimulatorItem::initializeClass(ExtensionManager* ext)
+{
+    ext->itemManager().registerClass<RayCastRangeSensorSimulatorItem>(N_("RayCastRangeSensorSimulatorItem"));
+    ext->itemManager().addCreationPanel<RayCastRangeSensorSimulatorItem>();
+}
+
+
+RayCastRangeSensorSimulatorItem::RayCastRangeSensorSimulatorItem()
+{
+    impl = new RayCastRangeSensorSimulatorItemImpl(this);
+    setName("RayCastRangeSensorSimulator");
+}
+
+
+RayCastRangeSensorSimulatorItemImpl::RayCastRangeSensorSimulatorItemImpl(RayCastRangeSensorSimulatorItem* self)
+    : self(self),
+      os(MessageView::instance()->cout())
+{
+    simulatorItem = nullptr;
+    rayCaster = nullptr;
+    maxFrameRate = 1000.0;
+    isVisionDataRecordingEnabled = false;
+}
+
+
+RayCastRangeSensorSimulatorItem::RayCastRangeSensorSimulatorItem(const RayCastRangeSensorSimulatorItem& org)
+    : SubSimulatorItem(org)
+{
+    impl = new RayCastRangeSensorSimulatorItemImpl(this, *org.impl);
+}
+
+
+RayCastRangeSensorSimulatorItemImpl::RayCastRangeSensorSimulatorItemImpl
+(RayCastRangeSensorSimulatorItem* self, const RayCastRangeSensorSimulatorItemImpl& org)
+    : self(self),
+      os(MessageView::instance()->cout())
+{
+    simulatorItem = nullptr;
+    rayCaster = nullptr;
+    bodyNames = org.bodyNames;
+    bodyNameListString = getNameListString(bodyNames);
+    sensorNames = org.sensorNames;
+    sensorNameListString = getNameListString(sensorNames);
+    maxFrameRate = org.maxFrameRate;
+    isVisionDataRecordingEnabled = org.isVisionDataRecordingEnabled;
+}
+
+
+Item* RayCastRangeSensorSimulatorItem::doDuplicate() const
+{
+    return new RayCastRangeSensorSimulatorItem(*this);
+}
+
+
+RayCastRangeSensorSimulatorItem::~RayCastRangeSensorSimulatorItem()
+{
+    delete impl;
+}
+
+
+void RayCastRangeSensorSimulatorItem::setTargetBodies(const std::string& names)
+{
+    updateNames(names, impl->bodyNameListString, impl->bodyNames);
+    notifyUpdate();
+}
+
+
+void RayCastRangeSensorSimulatorItem::setTargetSensors(const std::string& names)
+{
+    updateNames(names, impl->sensorNameListString, impl->sensorNames);
+    notifyUpdate();
+}
+
+
+void RayCastRangeSensorSimulatorItem::setMaxFrameRate(double rate)
+{
+    impl->setProperty(impl->maxFrameRate, rate);
+}
+
+
+void RayCastRangeSensorSimulatorItem::setVisionDataRecordingEnabled(bool on)
+{
+    impl->setProperty(impl->isVisionDataRecordingEnabled, on);
+}
+
+
+bool RayCastRangeSensorSimulatorItem::initializeSimulation(SimulatorItem* simulatorItem)
+{
+    return impl->initializeSimulation(simulatorItem);
+}
+
+
+bool RayCastRangeSensorSimulatorItemImpl::initializeSimulation(SimulatorItem* simulatorItem)
+{
+    this->simulatorItem = simulatorItem;
+    worldTimeStep = simulatorItem->worldTimeStep();
+    scanners.clear();
+
+    std::set<string> bodyNameSet(bodyNames.begin(), bodyNames.end());
+    std::set<string> sensorNameSet(sensorNames.begin(), sensorNames.end());
+
+    const vector<SimulationBody*>& simBodies = simulatorItem->simulationBodies();
+    for(auto& simBody : simBodies){
+        Body* body = simBody->body();
+        if(bodyNameSet.empty() || bodyNameSet.find(body->name()) != bodyNameSet.end()){
+            for(int i=0; i < body->numDevices(); ++i){
+                auto rangeSensor = dynamic_cast<RangeSensor*>(body->device(i));
+                if(rangeSensor){
+                    if(sensorNameSet.empty() || sensorNameSet.find(rangeSensor->name()) != sensorNameSet.end()){
+                        os << format(_("{0} detected range sensor \"{1}\" of {2} as a target."),
+                                     self->name(), rangeSensor->name(), body->name()) << endl;
+                        SensorScannerPtr scanner = new SensorScanner(simBody, rangeSensor);
+                        double frameRate = std::max(0.1, std::min(rangeSensor->scanRate(), maxFrameRate));
+                        scanner->cycleTime = 1.0 / frameRate;
+                        if(isVisionDataRecordingEnabled){
+                            rangeSensor->setRangeDataStateClonable(true);
+                        }
+                        scanners.push_back(scanner);
+                    }
+                }
+            }
+        }
+    }
+
+    if(scanners.empty()){
+        os << format(_("{} has no target sensors"), self->name()) << endl;
+        return false;
+    }
+
+    if(!initializeCollisionDetector(simBodies)){
+        scanners.clear();
+        return false;
+    }
+
+    simulatorItem->addPostDynamicsFunction([&](){ onPostDynamics(); });
+
+    return true;
+}
+
+
+SensorScanner::SensorScanner(SimulationBody* simBody, RangeSensor* rangeSensor)
+    : simBody(simBody),
+      rangeSensor(rangeSensor)
+{
+    link = rangeSensor->link();
+    elapsedTime = 0.0;
+
+    const int numYawSamples = rangeSensor->numYawSamples();
+    const int numPitchSamples = rangeSensor->numPitchSamples();
+    const double yawOffset = rangeSensor->yawRange() / 2.0;
+    const double pitchOffset = rangeSensor->pitchRange() / 2.0;
+    localDirections.reserve(numYawSamples * numPitchSamples);
+    for(int j=0; j < numPitchSamples; ++j){
+        const double pitch = j * rangeSensor->pitchStep() - pitchOffset;
+        const double cosPitch = cos(pitch);
+        const double sinPitch = sin(pitch);
+        for(int i=0; i < numYawSamples; ++i){
+            const double yaw = i * rangeSensor->yawStep() - yawOffset;
+            localDirections.emplace_back(-sin(yaw) * cosPitch, sinPitch, -cos(yaw) * cosPitch);
+        }
+    }
+    directions.resize(localDirections.size());
+    distances.resize(localDirections.size());
+}
+
+
+/**
+   A dedicated detector is used so that the geometries of the simulator item, which may be
+   handled by another detector or by a physics engine, are not affected by the ray casting.
+*/
+bool RayCastRangeSensorSimulatorItemImpl::initializeCollisionDetector(const vector<SimulationBody*>& simBodies)
+{
+    int factoryIndex = CollisionDetector::factoryIndex("AISTCollisionDetector");
+    if(factoryIndex >= 0){
+        collisionDetector = CollisionDetector::create(factoryIndex);
+    }
+    rayCaster = dynamic_cast<CollisionDetectorRayCastAPI*>(collisionDetector.get());
+    if(!rayCaster){
+        os << format(_("{} cannot be used because the collision detector supporting the ray casting is not available."),
+                     self->name()) << endl;
+        collisionDetector.reset();
+        return false;
+    }
+
+    collisionDetector->clearGeometries();
+    for(auto& simBody : simBodies){
+        Body* body = simBody->body();
+        for(int i=0; i < body->numLinks(); ++i){
+            Link* link = body->link(i);
+            if(auto handle = collisionDetector->addGeometry(link->collisionShape())){
+                collisionDetector->setCustomObject(*handle, link);
+            }
+        }
+    }
+    collisionDetector->makeReady();
+
+    return true;
+}
+
+
+void RayCastRangeSensorSimulatorItemImpl::onPostDynamics()
+{
+    bool isPositionUpdateNeeded = true;
+    for(auto& scanner : scanners){
+        scanner->elapsedTime += worldTimeStep;
+        if(scanner->elapsedTime < scanner->cycleTime){
+            continue;
+        }
+        scanner->elapsedTime -= scanner->cycleTime;
+
+        if(!scanner->rangeSensor->on()){
+            if(!scanner->rangeSensor->constRangeData().empty()){
+                scanner->rangeSensor->clearRangeData();
+                notifyStateChange(scanner);
+            }
+            continue;
+        }
+        if(isPositionUpdateNeeded){
+            collisionDetector->updatePositions(
+                [](Referenced* object, Position*& out_position){
+                    out_position = &(static_cast<Link*>(object)->T()); });
+            isPositionUpdateNeeded = false;
+        }
+        scan(scanner);
+    }
+}
+
+
+void RayCastRangeSensorSimulatorItemImpl::scan(SensorScanner* scanner)
+{
+    RangeSensor* rangeSensor = scanner->rangeSensor;
+    const Position T = scanner->link->T() * rangeSensor->T_local();
+    const int numRays = scanner->localDirections.size();
+    for(int i=0; i < numRays; ++i){
+        scanner->directions[i].noalias() = T.linear() * scanner->localDirections[i];
+    }
+
+    // The link of the sensor is not hit because it usually encloses the origin of the rays
+    Link* sensorLink = scanner->link;
+    rayCaster->castRays(
+        T.translation(), scanner->directions.data(), numRays,
+        rangeSensor->minDistance(), rangeSensor->maxDistance(), scanner->distances.data(),
+        [sensorLink](Referenced* object){ return object != sensorLink; });
+
+    auto rangeData = std::make_shared<RangeSensor::RangeData>(numRays);
+    const double maxDistance = rangeSensor->maxDistance();
+    for(int i=0; i < numRays; ++i){
+        const double distance = scanner->distances[i];
+        (*rangeData)[i] = (distance <= maxDistance) ? distance : std::numeric_limits<double>::infinity();
+    }
+    rangeSensor->setRangeData(rangeData);
+    rangeSensor->setDelay(0.0);
+
+    notifyStateChange(scanner);
+}
+
+
+void RayCastRangeSensorSimulatorItemImpl::notifyStateChange(SensorScanner* scanner)
+{
+    if(isVisionDataRecordingEnabled){
+        scanner->rangeSensor->notifyStateChange();
+    } else {
+        scanner->simBody->notifyUnrecordedDeviceStateChange(scanner->rangeSensor);
+    }
+}
+
+
+void RayCastRangeSensorSimulatorItem::finalizeSimulation()
+{
+    impl->finalizeSimulation();
+}
+
+
+void RayCastRangeSensorSimulatorItemImpl::finalizeSimulation()
+{
+    scanners.clear();
+    collisionDetector.reset();
+    rayCaster = nullptr;
+    simulatorItem = nullptr;
+}
+
+
+void RayCastRangeSensorSimulatorItem::doPutProperties(PutPropertyFunction& putProperty)
+{
+    SubSimulatorItem::doPutProperties(putProperty);
+    impl->doPutProperties(putProperty);
+}
+
+
+void RayCastRangeSensorSimulatorItemImpl::doPutProperties(PutPropertyFunction& putProperty)
+{
+    putProperty(_("Target bodies"), bodyNameListString,
+                [&](const string& names){ return updateNames(names, bodyNameListString, bodyNames); });
+    putProperty(_("Target sensors"), sensorNameListString,
+                [&](const string& names){ return updateNames(names, sensorNameListString, sensorNames); });
+    putProperty(_("Max frame rate"), maxFrameRate, changeProperty(maxFrameRate));
+    putProperty(_("Record vision data"), isVisionDataRecordingEnabled, changeProperty(isVisionDataRecordingEnabled));
+}
+
+
+bool RayCastRangeSensorSimulatorItem::store(Archive& archive)
+{
+    SubSimulatorItem::store(archive);
+    return impl->store(archive);
+}
+
+
+bool RayCastRangeSensorSimulatorItemImpl::store(Archive& archive)
+{
+    writeElements(archive, "targetBodies", bodyNames, true);
+    writeElements(archive, "targetSensors", sensorNames, true);
+    archive.write("maxFrameRate", maxFrameRate);
+    archive.write("recordVisionData", isVisionDataRecordingEnabled);
+    return true;
+}
+
+
+bool RayCastRangeSensorSimulatorItem::restore(const Archive& archive)
+{
+    SubSimulatorItem::restore(archive);
+    return impl->restore(archive);
+}
+
+
+bool RayCastRangeSensorSimulatorItemImpl::restore(const Archive& archive)
+{
+    readElements(archive, "targetBodies", bodyNames);
+    bodyNameListString = getNameListString(bodyNames);
+    readElements(archive, "targetSensors", sensorNames);
+    sensorNameListString = getNameListString(sensorNames);
+    archive.read("maxFrameRate", maxFrameRate);
+    archive.read("recordVisionData", isVisionDataRecordingEnabled);
+    return true;
+}
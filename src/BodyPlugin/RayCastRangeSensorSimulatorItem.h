@@ -0,0 +1,53 @@
+/*!
+  @file
+  @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_BODYPLUGIN_RAY_CAST_RANGE_SENSOR_SIMULATOR_ITEM_H
+#define CNOID_BODYPLUGIN_RAY_CAST_RANGE_SENSOR_SIMULATOR_ITEM_H
+
+#include "SubSimulatorItem.h"
+#include <string>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class RayCastRangeSensorSimulatorItemImpl;
+
+/**
+   The range sensors are simulated by casting the rays of the beams to the collision shapes of
+   the bodies with the AIST collision detector instead of rendering the depth buffers, so that
+   the sensors can be simulated without OpenGL. The rays of the sensors are cast in parallel.
+*/
+class CNOID_EXPORT RayCastRangeSensorSimulatorItem : public SubSimulatorItem
+{
+public:
+    static void initializeClass(ExtensionManager* ext);
+
+    RayCastRangeSensorSimulatorItem();
+    RayCastRangeSensorSimulatorItem(const RayCastRangeSensorSimulatorItem& org);
+    ~RayCastRangeSensorSimulatorItem();
+
+    void setTargetBodies(const std::string& bodyNames);
+    void setTargetSensors(const std::string& sensorNames);
+    void setMaxFrameRate(double rate);
+    void setVisionDataRecordingEnabled(bool on);
+
+    virtual bool initializeSimulation(SimulatorItem* simulatorItem);
+    virtual void finalizeSimulation();
+
+protected:
+    virtual Item* doDuplicate() const;
+    virtual void doPutProperties(PutPropertyFunction& putProperty);
+    virtual bool store(Archive& archive);
+    virtual bool restore(const Archive& archive);
+
+private:
+    RayCastRangeSensorSimulatorItemImpl* impl;
+};
+
+typedef ref_ptr<RayCastRangeSensorSimulatorItem> RayCastRangeSensorSimulatorItemPtr;
+
+}
+
+#endif
@@ -17,6 +17,7 @@
 #include <cnoid/SceneProvider>
 #include <cnoid/ImageProvider>
 #include <cnoid/ConnectionSet>
+#include <cnoid/LazyCaller>
 #include <cnoid/Archive>
 #include "gettext.h"
 
@@ -70,18 +71,33 @@ public:
 
 typedef ref_ptr<Arrow> ArrowPtr;
 
+/**
+   The signals of the devices and the body item only request the updates, which are done by a lazy
+   call at most once per turn of the event loop. The sensors updated at a rate much higher than the
+   frame rate of the display such as force sensors at 1 kHz then do not waste the CPU time of the GUI.
+*/
 class SensorVisualizerItemBase
 {
 public:
     Item* visualizerItem;
     BodyItem* bodyItem;
     ScopedConnection sigCheckToggledConnection;
+    LazyCaller updateFlusher;
+    bool isPositionUpdateRequested;
+    bool isStateUpdateRequested;
+    
     SensorVisualizerItemBase(Item* visualizerItem);
     void setBodyItem(BodyItem* bodyItem);
     void updateVisualization();
+    void requestPositionUpdate();
+    void requestStateUpdate();
+    void cancelUpdateRequests();
+    void flushUpdates();
 
     virtual void enableVisualization(bool on) = 0;
     virtual void doUpdateVisualization() = 0;
+    virtual void updateSensorPositions() { }
+    virtual void updateSensorStates() = 0;
 };
     
 
@@ -92,7 +108,8 @@ public:
     virtual SgNode* getScene();
     virtual void enableVisualization(bool on) override;
     virtual void doUpdateVisualization() override;
-    void updateSensorPositions();
+    virtual void updateSensorPositions() override;
+    virtual void updateSensorStates() override;
     void updateForceSensorState(int index);
     virtual void doPutProperties(PutPropertyFunction& putProperty);
     virtual bool store(Archive& archive);
@@ -115,6 +132,7 @@ public:
     void setBodyItem(BodyItem* bodyItem, Camera* camera);
     virtual void enableVisualization(bool on) override;
     virtual void doUpdateVisualization() override;
+    virtual void updateSensorStates() override;
 
     CameraPtr camera;
     ScopedConnectionSet connections;
@@ -128,8 +146,8 @@ public:
     void setBodyItem(BodyItem* bodyItem, RangeCamera* rangeCamera);
     virtual void enableVisualization(bool on) override;
     virtual void doUpdateVisualization() override;
-    void updateSensorPosition();
-    void updateRangeCameraState();
+    virtual void updateSensorPositions() override;
+    virtual void updateSensorStates() override;
 
     RangeCameraPtr rangeCamera;
     ScopedConnectionSet connections;
@@ -142,10 +160,14 @@ public:
     void setBodyItem(BodyItem* bodyItem, RangeSensor* rangeSensor);
     virtual void enableVisualization(bool on) override;
     virtual void doUpdateVisualization() override;
-    void updateSensorPosition();
-    void updateRangeSensorState();
+    virtual void updateSensorPositions() override;
+    virtual void updateSensorStates() override;
 
     RangeSensorPtr rangeSensor;
+    vector<double> yawSines;
+    vector<double> yawCosines;
+    double yawStepOfCosines;
+    double yawRangeOfCosines;
     ScopedConnectionSet connections;
 };
 
@@ -352,6 +374,10 @@ SensorVisualizerItemBase::SensorVisualizerItemBase(Item* visualizerItem)
     : visualizerItem(visualizerItem),
       bodyItem(nullptr)
 {
+    updateFlusher.setFunction([&](){ flushUpdates(); });
+    isPositionUpdateRequested = false;
+    isStateUpdateRequested = false;
+    
     sigCheckToggledConnection.reset(
         ItemTreeView::instance()->sigCheckToggled(visualizerItem, ItemTreeView::ID_ANY).connect(
             [&](bool on){ enableVisualization(on); }));
@@ -371,6 +397,41 @@ void SensorVisualizerItemBase::updateVisualization()
         doUpdateVisualization();
     }
 }
+
+
+void SensorVisualizerItemBase::requestPositionUpdate()
+{
+    isPositionUpdateRequested = true;
+    updateFlusher();
+}
+
+
+void SensorVisualizerItemBase::requestStateUpdate()
+{
+    isStateUpdateRequested = true;
+    updateFlusher();
+}
+
+
+void SensorVisualizerItemBase::cancelUpdateRequests()
+{
+    isPositionUpdateRequested = false;
+    isStateUpdateRequested = false;
+    updateFlusher.cancel();
+}
+
+
+void SensorVisualizerItemBase::flushUpdates()
+{
+    if(isPositionUpdateRequested){
+        isPositionUpdateRequested = false;
+        updateSensorPositions();
+    }
+    if(isStateUpdateRequested){
+        isStateUpdateRequested = false;
+        updateSensorStates();
+    }
+}
     
 
 ForceSensorVisualizerItem::ForceSensorVisualizerItem()
@@ -409,13 +470,14 @@ SgNode* ForceSensorVisualizerItem::getScene()
 void ForceSensorVisualizerItem::enableVisualization(bool on)
 {
     connections.disconnect();
+    cancelUpdateRequests();
     scene->clearChildren();
     forceSensors.clear();
 
     if(bodyItem && on){
         connections.add(
             bodyItem->sigKinematicStateChanged().connect(
-                [&](){ updateSensorPositions(); }));
+                [&](){ requestPositionUpdate(); }));
 
         Body* body = bodyItem->body();
         forceSensors = body->devices<ForceSensor>();
@@ -426,7 +488,7 @@ void ForceSensorVisualizerItem::enableVisualization(bool on)
             scene->addChild(arrow);
             connections.add(
                 forceSensors[i]->sigStateChanged().connect(
-                    [this, i](){ updateForceSensorState(i); }));
+                    [&](){ requestStateUpdate(); }));
         }
 
         doUpdateVisualization();
@@ -437,9 +499,7 @@ void ForceSensorVisualizerItem::enableVisualization(bool on)
 void ForceSensorVisualizerItem::doUpdateVisualization()
 {
     updateSensorPositions();
-    for(size_t i=0; i < forceSensors.size(); ++i){
-        updateForceSensorState(i);
-    }
+    updateSensorStates();
 }
 
     
@@ -453,6 +513,14 @@ void ForceSensorVisualizerItem::updateSensorPositions()
 }
 
 
+void ForceSensorVisualizerItem::updateSensorStates()
+{
+    for(size_t i=0; i < forceSensors.size(); ++i){
+        updateForceSensorState(i);
+    }
+}
+
+
 void ForceSensorVisualizerItem::updateForceSensorState(int index)
 {
     if(index < static_cast<int>(forceSensors.size())){
@@ -523,11 +591,12 @@ void CameraImageVisualizerItem::setBodyItem(BodyItem* bodyItem, Camera* camera)
 void CameraImageVisualizerItem::enableVisualization(bool on)
 {
     connections.disconnect();
+    cancelUpdateRequests();
 
     if(camera && on){
         connections.add(
             camera->sigStateChanged().connect(
-                [&](){ doUpdateVisualization(); }));
+                [&](){ requestStateUpdate(); }));
 
         doUpdateVisualization();
     }
@@ -535,6 +604,12 @@ void CameraImageVisualizerItem::enableVisualization(bool on)
 
 
 void CameraImageVisualizerItem::doUpdateVisualization()
+{
+    updateSensorStates();
+}
+
+
+void CameraImageVisualizerItem::updateSensorStates()
 {
     if(camera){
         image = camera->sharedImage();
@@ -545,10 +620,14 @@ void CameraImageVisualizerItem::doUpdateVisualization()
 }
 
 
+/**
+   The level of detail is disabled so that the points updated every frame are streamed into
+   the vertex buffers of the same point set instead of rebuilding the octree.
+*/
 PointCloudVisualizerItem::PointCloudVisualizerItem()
     : SensorVisualizerItemBase(this)
 {
-
+    setPointBudget(0);
 }
 
 
@@ -566,14 +645,15 @@ void PointCloudVisualizerItem::setBodyItem(BodyItem* bodyItem, RangeCamera* rang
 void PointCloudVisualizerItem::enableVisualization(bool on)
 {
     connections.disconnect();
+    cancelUpdateRequests();
 
     if(bodyItem && rangeCamera && on){
         connections.add(
             bodyItem->sigKinematicStateChanged().connect(
-                [&](){ updateSensorPosition(); }));
+                [&](){ requestPositionUpdate(); }));
         connections.add(
             rangeCamera->sigStateChanged().connect(
-                [&](){ updateRangeCameraState(); }));
+                [&](){ requestStateUpdate(); }));
 
         doUpdateVisualization();
     }
@@ -583,20 +663,20 @@ void PointCloudVisualizerItem::enableVisualization(bool on)
 void PointCloudVisualizerItem::doUpdateVisualization()
 {
     if(rangeCamera){
-        updateSensorPosition();
-        updateRangeCameraState();
+        updateSensorPositions();
+        updateSensorStates();
     }
 }
 
 
-void PointCloudVisualizerItem::updateSensorPosition()
+void PointCloudVisualizerItem::updateSensorPositions()
 {
     const Affine3 T =  (rangeCamera->link()->T() * rangeCamera->T_local());
     setOffsetTransform(T);
 }
 
 
-void PointCloudVisualizerItem::updateRangeCameraState()
+void PointCloudVisualizerItem::updateSensorStates()
 {
     auto pointSet_ = pointSet();
     
@@ -631,7 +711,9 @@ void PointCloudVisualizerItem::updateRangeCameraState()
 RangeSensorVisualizerItem::RangeSensorVisualizerItem()
     : SensorVisualizerItemBase(this)
 {
-
+    setPointBudget(0);
+    yawStepOfCosines = 0.0;
+    yawRangeOfCosines = 0.0;
 }
 
 
@@ -649,14 +731,15 @@ void RangeSensorVisualizerItem::setBodyItem(BodyItem* bodyItem, RangeSensor* ran
 void RangeSensorVisualizerItem::enableVisualization(bool on)
 {
     connections.disconnect();
+    cancelUpdateRequests();
 
     if(bodyItem && rangeSensor && on){
         connections.add(
             bodyItem->sigKinematicStateChanged().connect(
-                [&](){ updateSensorPosition(); }));
+                [&](){ requestPositionUpdate(); }));
         connections.add(
             rangeSensor->sigStateChanged().connect(
-                [&](){ updateRangeSensorState(); }));
+                [&](){ requestStateUpdate(); }));
 
         doUpdateVisualization();
     }
@@ -666,20 +749,20 @@ void RangeSensorVisualizerItem::enableVisualization(bool on)
 void RangeSensorVisualizerItem::doUpdateVisualization()
 {
     if(rangeSensor){
-        updateSensorPosition();
-        updateRangeSensorState();
+        updateSensorPositions();
+        updateSensorStates();
     }
 }
 
 
-void RangeSensorVisualizerItem::updateSensorPosition()
+void RangeSensorVisualizerItem::updateSensorPositions()
 {
     const Affine3 T = (rangeSensor->link()->T() * rangeSensor->T_local());
     setOffsetTransform(T);
 }
 
 
-void RangeSensorVisualizerItem::updateRangeSensorState()
+void RangeSensorVisualizerItem::updateSensorStates()
 {
     auto pointSet_ = pointSet();
 
@@ -694,19 +777,34 @@ void RangeSensorVisualizerItem::updateRangeSensorState()
         const double pitchStep = rangeSensor->pitchStep();
         const int numYawSamples = rangeSensor->numYawSamples();
         const double yawStep = rangeSensor->yawStep();
+
+        // The trigonometric functions of the yaw angles are computed only when the sampling is changed
+        const double yawRange = rangeSensor->yawRange();
+        if(static_cast<int>(yawSines.size()) != numYawSamples ||
+           yawStep != yawStepOfCosines || yawRange != yawRangeOfCosines){
+            yawSines.resize(numYawSamples);
+            yawCosines.resize(numYawSamples);
+            yawStepOfCosines = yawStep;
+            yawRangeOfCosines = yawRange;
+            for(int yaw=0; yaw < numYawSamples; ++yaw){
+                const double yawAngle = yaw * yawStep - yawRange / 2.0;
+                yawSines[yaw] = sin(-yawAngle);
+                yawCosines[yaw] = cos(yawAngle);
+            }
+        }
         
         for(int pitch=0; pitch < numPitchSamples; ++pitch){
             const double pitchAngle = pitch * pitchStep - rangeSensor->pitchRange() / 2.0;
             const double cosPitchAngle = cos(pitchAngle);
+            const double sinPitchAngle = sin(pitchAngle);
             const int srctop = pitch * numYawSamples;
             
             for(int yaw=0; yaw < numYawSamples; ++yaw){
                 const double distance = src[srctop + yaw];
                 if(distance <= rangeSensor->maxDistance()){
-                    double yawAngle = yaw * yawStep - rangeSensor->yawRange() / 2.0;
-                    float x = distance *  cosPitchAngle * sin(-yawAngle);
-                    float y  = distance * sin(pitchAngle);
-                    float z  = -distance * cosPitchAngle * cos(yawAngle);
+                    float x = distance *  cosPitchAngle * yawSines[yaw];
+                    float y  = distance * sinPitchAngle;
+                    float z  = -distance * cosPitchAngle * yawCosines[yaw];
                     points.push_back(Vector3f(x, y, z));
                 }
             }
@@ -18,6 +18,12 @@
 #include <fmt/format.h>
 #include <boost/dynamic_bitset.hpp>
 #include <set>
+#include <memory>
+#ifndef _WIN32
+#include <cnoid/SharedMemoryControllerChannel>
+#include <QProcess>
+#include <unistd.h>
+#endif
 #include "gettext.h"
 
 using namespace std;
@@ -47,6 +53,9 @@ struct SharedInfo : public Referenced
 
 typedef ref_ptr<SharedInfo> SharedInfoPtr;
 
+// The timeout of each step of the controller running in an isolated process
+const double isolatedControllerStepTimeout = 5.0;
+
 }
 
 namespace cnoid {
@@ -88,6 +97,12 @@ public:
     bool doReloading;
     Selection baseDirectoryType;
 
+    bool isProcessIsolated;
+#ifndef _WIN32
+    std::unique_ptr<SharedMemoryControllerChannel> channel;
+    QProcess hostProcess;
+#endif
+
     enum BaseDirectoryType {
         NO_BASE_DIRECTORY = 0,
         CONTROLLER_DIRECTORY,
@@ -99,6 +114,7 @@ public:
     SimpleControllerItemImpl(SimpleControllerItem* self, const SimpleControllerItemImpl& org);
     ~SimpleControllerItemImpl();
     void setController(const std::string& name);
+    bool resolveControllerModuleFilename();
     bool loadController();
     void unloadController();
     void initializeIoBody();
@@ -112,6 +128,12 @@ public:
     void onOutputDeviceStateChanged(int deviceIndex);
     void output();
     bool onReloadingChanged(bool on);
+    bool onProcessIsolationChanged(bool on);
+#ifndef _WIN32
+    bool initializeIsolatedController(ControllerIO* io);
+    bool requestToIsolatedController(int command, double timeout);
+    void stopIsolatedController();
+#endif
     void doPutProperties(PutPropertyFunction& putProperty);
     bool store(Archive& archive);
     bool restore(const Archive& archive);
@@ -172,6 +194,7 @@ SimpleControllerItemImpl::SimpleControllerItemImpl(SimpleControllerItem* self)
     isOldTargetVariableMode = false;
     mv = MessageView::instance();
     doReloading = false;
+    isProcessIsolated = false;
 
     controllerDirectory = filesystem::path(executableTopDirectory()) / CNOID_PLUGIN_SUBDIR / "simplecontroller";
 
@@ -202,6 +225,7 @@ SimpleControllerItemImpl::SimpleControllerItemImpl(SimpleControllerItem* self, c
     isOldTargetVariableMode = org.isOldTargetVariableMode;
     mv = MessageView::instance();
     doReloading = org.doReloading;
+    isProcessIsolated = org.isProcessIsolated;
 }
 
 
@@ -213,6 +237,11 @@ SimpleControllerItem::~SimpleControllerItem()
 
 SimpleControllerItemImpl::~SimpleControllerItemImpl()
 {
+#ifndef _WIN32
+    if(channel){
+        stopIsolatedController();
+    }
+#endif
     unloadController();
     outputDeviceStateConnections.disconnect();
 }
@@ -266,13 +295,13 @@ void SimpleControllerItemImpl::setController(const std::string& name)
     controllerModuleName = modulePath.string();
     controllerModuleFilename.clear();
 
-    if(!doReloading){
+    if(!doReloading && !isProcessIsolated){
         loadController();
     }
 }
 
 
-bool SimpleControllerItemImpl::loadController()
+bool SimpleControllerItemImpl::resolveControllerModuleFilename()
 {
     filesystem::path modulePath(controllerModuleName);
     if(!modulePath.is_absolute()){
@@ -295,6 +324,15 @@ bool SimpleControllerItemImpl::loadController()
     }
 
     controllerModuleFilename = modulePath.make_preferred().string();
+    return true;
+}
+
+
+bool SimpleControllerItemImpl::loadController()
+{
+    if(!resolveControllerModuleFilename()){
+        return false;
+    }
     controllerModule.setFileName(controllerModuleFilename.c_str());
         
     if(controllerModule.isLoaded()){
@@ -416,6 +454,15 @@ void SimpleControllerItemImpl::clearIoTargets()
 
 bool SimpleControllerItem::initialize(ControllerIO* io)
 {
+#ifndef _WIN32
+    if(impl->isProcessIsolated){
+        if(impl->initializeIsolatedController(io)){
+            output();
+            return true;
+        }
+        return false;
+    }
+#endif
     if(impl->initialize(io, new SharedInfo)){
         impl->updateInputEnabledDevices();
         output();
@@ -709,6 +756,15 @@ void SimpleControllerItemImpl::setImmediateMode(bool on)
 
 bool SimpleControllerItem::start()
 {
+#ifndef _WIN32
+    if(impl->channel){
+        if(!impl->requestToIsolatedController(SharedMemoryControllerChannel::START, isolatedControllerStepTimeout)){
+            impl->mv->putln(format(_("{} failed to start"), name()), MessageView::WARNING);
+            return false;
+        }
+        return true;
+    }
+#endif
     return impl->start();
 }
 
@@ -736,6 +792,12 @@ bool SimpleControllerItemImpl::start()
 
 void SimpleControllerItem::input()
 {
+#ifndef _WIN32
+    if(impl->channel){
+        impl->channel->writeInput(impl->io->currentTime());
+        return;
+    }
+#endif
     impl->input();
     
     for(size_t i=0; i < impl->childControllerItems.size(); ++i){
@@ -801,6 +863,11 @@ void SimpleControllerItemImpl::onInputDeviceStateChanged(int deviceIndex)
 
 bool SimpleControllerItem::control()
 {
+#ifndef _WIN32
+    if(impl->channel){
+        return impl->requestToIsolatedController(SharedMemoryControllerChannel::CONTROL, isolatedControllerStepTimeout);
+    }
+#endif
     bool result = impl->controller->control();
 
     for(size_t i=0; i < impl->childControllerItems.size(); ++i){
@@ -821,6 +888,12 @@ void SimpleControllerItemImpl::onOutputDeviceStateChanged(int deviceIndex)
 
 void SimpleControllerItem::output()
 {
+#ifndef _WIN32
+    if(impl->channel){
+        impl->channel->readOutput(impl->isOldTargetVariableMode);
+        return;
+    }
+#endif
     impl->output();
     
     for(size_t i=0; i < impl->childControllerItems.size(); ++i){
@@ -885,6 +958,12 @@ void SimpleControllerItemImpl::output()
 
 void SimpleControllerItem::stop()
 {
+#ifndef _WIN32
+    if(impl->channel){
+        impl->stopIsolatedController();
+        return;
+    }
+#endif
     for(auto iter = impl->childControllerItems.rbegin(); iter != impl->childControllerItems.rend(); ++iter){
         (*iter)->stop();
     }
@@ -909,6 +988,116 @@ bool SimpleControllerItemImpl::onReloadingChanged(bool on)
 }
 
 
+bool SimpleControllerItemImpl::onProcessIsolationChanged(bool on)
+{
+    if(self->isActive()){
+        return false;
+    }
+    isProcessIsolated = on;
+    if(on){
+        unloadController();
+    } else if(!doReloading && !controllerModuleName.empty()){
+        loadController();
+    }
+    return true;
+}
+
+
+#ifndef _WIN32
+/**
+   The controller module is loaded by the host program in another process, which loads
+   the body from the model file of the body item and exchanges the states of the body
+   with the simulation through the shared memory channel. The child controller items
+   are not executed in this mode.
+*/
+bool SimpleControllerItemImpl::initializeIsolatedController(ControllerIO* io)
+{
+    this->io = io;
+    simulationBody = io->body();
+
+    string bodyFilename;
+    if(auto bodyItem = self->findOwnerItem<BodyItem>()){
+        bodyFilename = bodyItem->filePath();
+    }
+    if(bodyFilename.empty()){
+        mv->putln(format(_("{} cannot run in an isolated process because the body is not loaded from a model file."),
+                         self->name()),
+                  MessageView::ERROR);
+        return false;
+    }
+    if(!resolveControllerModuleFilename()){
+        return false;
+    }
+
+    static int channelCounter = 0;
+    string channelName = format("/cnoid-simplecontroller-{}-{}", getpid(), channelCounter++);
+    channel.reset(new SharedMemoryControllerChannel);
+    if(!channel->create(channelName, simulationBody)){
+        mv->putln(channel->errorMessage(), MessageView::ERROR);
+        channel.reset();
+        return false;
+    }
+    channel->setBodyFilename(bodyFilename);
+    channel->setControllerFilename(controllerModuleFilename);
+    channel->setControllerName(self->name());
+    channel->setOptionString(optionString());
+    channel->setTimeStep(io->timeStep());
+    channel->writeInput(io->currentTime());
+
+    string program = (filesystem::path(executableDirectory()) / "cnoid-simplecontroller-host").string();
+    hostProcess.setProcessChannelMode(QProcess::ForwardedChannels);
+    hostProcess.start(program.c_str(), QStringList() << channelName.c_str());
+    if(!hostProcess.waitForStarted()){
+        mv->putln(format(_("The host process of {0} cannot be started: {1}"),
+                         self->name(), hostProcess.errorString().toStdString()),
+                  MessageView::ERROR);
+        channel.reset();
+        return false;
+    }
+
+    if(!channel->request(SharedMemoryControllerChannel::INITIALIZE, 10.0) || !channel->result()){
+        mv->putln(format(_("{0}'s initialize method failed. {1}"), self->name(), channel->errorMessage()),
+                  MessageView::ERROR);
+        stopIsolatedController();
+        return false;
+    }
+    channel->applyActuationModes();
+
+    mv->putln(format(_("{0} is running in the isolated process {1}."), self->name(), hostProcess.processId()));
+
+    return true;
+}
+
+
+bool SimpleControllerItemImpl::requestToIsolatedController(int command, double timeout)
+{
+    if(!channel->request(command, timeout)){
+        mv->putln(format(_("The isolated process of {0} does not work: {1}"), self->name(), channel->errorMessage()),
+                  MessageView::ERROR);
+        return false;
+    }
+    return channel->result();
+}
+
+
+void SimpleControllerItemImpl::stopIsolatedController()
+{
+    if(channel){
+        if(hostProcess.state() == QProcess::Running){
+            channel->request(SharedMemoryControllerChannel::STOP, 1.0);
+        }
+        // Closing the channel also lets the host process exit
+        channel.reset();
+    }
+    if(hostProcess.state() != QProcess::NotRunning && !hostProcess.waitForFinished(1000)){
+        hostProcess.kill();
+        hostProcess.waitForFinished();
+    }
+    io = nullptr;
+}
+#endif
+
+
 void SimpleControllerItem::doPutProperties(PutPropertyFunction& putProperty)
 {
     ControllerItem::doPutProperties(putProperty);
@@ -934,6 +1123,10 @@ void SimpleControllerItemImpl::doPutProperties(PutPropertyFunction& putProperty)
 
     putProperty(_("Reloading"), doReloading, [&](bool on){ return onReloadingChanged(on); });
 
+#ifndef _WIN32
+    putProperty(_("Isolated process"), isProcessIsolated, [&](bool on){ return onProcessIsolationChanged(on); });
+#endif
+
     putProperty(_("Old target value variable mode"), isOldTargetVariableMode, changeProperty(isOldTargetVariableMode));
 }
 
@@ -952,6 +1145,9 @@ bool SimpleControllerItemImpl::store(Archive& archive)
     archive.writeRelocatablePath("controller", controllerModuleName);
     archive.write("baseDirectory", baseDirectoryType.selectedSymbol(), DOUBLE_QUOTED);
     archive.write("reloading", doReloading);
+    if(isProcessIsolated){
+        archive.write("isolatedProcess", true);
+    }
     archive.write("isOldTargetVariableMode", isOldTargetVariableMode);
     return true;
 }
@@ -975,10 +1171,11 @@ bool SimpleControllerItemImpl::restore(const Archive& archive)
         baseDirectoryType.select(value);
     }
     archive.read("reloading", doReloading);
+    archive.read("isolatedProcess", isProcessIsolated);
 
     if(archive.read("controller", value)){
         controllerModuleName = archive.expandPathVariables(value);
-        if(!doReloading){
+        if(!doReloading && !isProcessIsolated){
             loadController();
         }
     }
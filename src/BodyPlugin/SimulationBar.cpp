@@ -5,14 +5,26 @@
 #include "SimulationBar.h"
 #include "SimulatorItem.h"
 #include "WorldItem.h"
+#include "BodyItem.h"
+#include "GLVisionSimulatorItem.h"
 #include <cnoid/TimeBar>
 #include <cnoid/RootItem>
 #include <cnoid/ItemTreeView>
 #include <cnoid/MessageView>
 #include <cnoid/OptionManager>
 #include <cnoid/LazyCaller>
+#include <cnoid/ProjectManager>
+#include <cnoid/ItemManager>
+#include <cnoid/CollisionLinkPair>
+#include <cnoid/Camera>
+#include <cnoid/MemoryUsage>
 #include <fmt/format.h>
+#include <boost/algorithm/string.hpp>
 #include <functional>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
 #include "gettext.h"
 
 using namespace std;
@@ -31,15 +43,69 @@ static void onSigOptionsParsed(boost::program_options::variables_map& v)
 }
 
 
+static void onSigOptionsParsedAfterProjectLoading(boost::program_options::variables_map& v)
+{
+    if(v.count("simulation-benchmark")){
+        vector<int> modes;
+        if(v.count("simulation-benchmark-vision-modes")){
+            vector<string> symbols;
+            boost::split(symbols, v["simulation-benchmark-vision-modes"].as<string>(), boost::is_any_of(","));
+            for(auto& symbol : symbols){
+                if(symbol == "single"){
+                    modes.push_back(GLVisionSimulatorItem::SINGLE_THREAD_MODE);
+                } else if(symbol == "sensor"){
+                    modes.push_back(GLVisionSimulatorItem::SENSOR_THREAD_MODE);
+                } else if(symbol == "screen"){
+                    modes.push_back(GLVisionSimulatorItem::SCREEN_THREAD_MODE);
+                } else if(!symbol.empty()){
+                    MessageView::instance()->putln(
+                        format(_("Vision thread mode \"{}\" is not supported."), symbol), MessageView::WARNING);
+                }
+            }
+        }
+        int width = 0;
+        int height = 0;
+        if(v.count("simulation-benchmark-camera-resolution")){
+            const string resolution = v["simulation-benchmark-camera-resolution"].as<string>();
+            if(sscanf(resolution.c_str(), "%dx%d", &width, &height) != 2){
+                MessageView::instance()->putln(
+                    format(_("Camera resolution \"{}\" is invalid."), resolution), MessageView::WARNING);
+                width = 0;
+                height = 0;
+            }
+        }
+        instance_->setVisionSensorBenchmarkConditions(modes, width, height);
+        instance_->setBenchmarkWarmUpTime(v["simulation-benchmark-warm-up-time"].as<double>());
+        instance_->runSimulationBenchmark(
+            v["simulation-benchmark"].as<string>(), v["simulation-benchmark-time"].as<double>());
+    } else if(v.count("batch-simulation")){
+        instance_->runBatchSimulation(true);
+    }
+}
+
+
 void SimulationBar::initialize(ExtensionManager* ext)
 {
     if(!instance_){
         instance_ = new SimulationBar();
         ext->addToolBar(instance_);
         
-        ext->optionManager()
-            .addOption("start-simulation", "start simulation automatically")
-            .sigOptionsParsed().connect(onSigOptionsParsed);
+        OptionManager& om = ext->optionManager();
+        om.addOption("start-simulation", "start simulation automatically");
+        om.addOption("batch-simulation",
+                     "run simulation to the end without the event loop (use with --quit to exit after it)");
+        om.addOption("simulation-benchmark", boost::program_options::value<string>(),
+                     "run all the simulator items in the batch mode and write the performance data to a JSON file");
+        om.addOption("simulation-benchmark-time", boost::program_options::value<double>()->default_value(10.0),
+                     "simulation time of each simulator item in the benchmark");
+        om.addOption("simulation-benchmark-vision-modes", boost::program_options::value<string>(),
+                     "comma-separated thread modes (single, sensor, screen) of the vision simulators in the benchmark");
+        om.addOption("simulation-benchmark-camera-resolution", boost::program_options::value<string>(),
+                     "camera resolution (WIDTHxHEIGHT) set to all the cameras in the benchmark");
+        om.addOption("simulation-benchmark-warm-up-time", boost::program_options::value<double>()->default_value(1.0),
+                     "simulation time after which the steps are expected not to allocate memory in the benchmark");
+        om.sigOptionsParsed().connect(onSigOptionsParsed);
+        om.sigOptionsParsed(1).connect(onSigOptionsParsedAfterProjectLoading);
     }
 }
 
@@ -54,6 +120,10 @@ SimulationBar::SimulationBar()
     : ToolBar(N_("SimulationBar"))
 {
     setVisibleByDefault(true);    
+
+    benchmarkCameraWidth = 0;
+    benchmarkCameraHeight = 0;
+    benchmarkWarmUpTime = 1.0;
     
     addButton(QIcon(":/Body/icons/store-world-initial.png"),
               _("Store body positions to the initial world state"))->
@@ -71,6 +141,9 @@ SimulationBar::SimulationBar()
               _("Start simulation from the current state"))->
         sigClicked().connect(
             std::bind(static_cast<void(SimulationBar::*)(bool)>(&SimulationBar::startSimulation), this, false));
+
+    addButton(_("Branch"), _("Start simulation from the checkpoint nearest to the current time"))->
+        sigClicked().connect(std::bind(&SimulationBar::onBranchSimulationClicked, this));
     
     pauseToggle = addToggleButton(QIcon(":/Body/icons/pause-simulation.png"), _("Pause simulation"));
     pauseToggle->sigClicked().connect(std::bind(&SimulationBar::onPauseSimulationClicked, this));
@@ -220,6 +293,312 @@ void SimulationBar::startSimulation(SimulatorItem* simulator, bool doReset)
 }
 
 
+void SimulationBar::onBranchSimulationClicked()
+{
+    const double time = TimeBar::instance()->time();
+    forEachSimulator([&](SimulatorItem* simulator){ branchSimulation(simulator, time); }, true);
+}
+
+
+void SimulationBar::branchSimulation(SimulatorItem* simulator, double time)
+{
+    sigSimulationAboutToStart_(simulator);
+    simulator->startSimulationFromTime(time);
+    pauseToggle->setChecked(false);
+}
+
+
+void SimulationBar::runBatchSimulation(bool doReset)
+{
+    forEachSimulator(
+        [&](SimulatorItem* simulator){ runBatchSimulation(simulator, doReset); });
+}
+
+
+void SimulationBar::runBatchSimulation(SimulatorItem* simulator, bool doReset)
+{
+    if(!simulator->isRunning()){
+        sigSimulationAboutToStart_(simulator);
+        simulator->runBatchSimulation(doReset);
+    }
+}
+
+
+// The contacts are counted at this interval to keep the overhead of copying the collision data small
+static const int ContactCountInterval = 10;
+
+struct ContactCount
+{
+    int numSampledFrames = 0;
+    long totalContacts = 0;
+    long totalLinkPairs = 0;
+    int maxContacts = 0;
+
+    void count(SimulatorItem* simulator){
+        if(simulator->currentFrame() % ContactCountInterval != 0){
+            return;
+        }
+        auto collisions = simulator->currentCollisions();
+        if(!collisions){
+            return;
+        }
+        int numContacts = 0;
+        for(auto& linkPair : *collisions){
+            numContacts += linkPair->collisions.size();
+        }
+        ++numSampledFrames;
+        totalContacts += numContacts;
+        totalLinkPairs += collisions->size();
+        maxContacts = std::max(maxContacts, numContacts);
+    }
+};
+
+
+static string toJsonString(const string& s)
+{
+    string quoted("\"");
+    for(auto c : s){
+        switch(c){
+        case '"':  quoted += "\\\""; break;
+        case '\\': quoted += "\\\\"; break;
+        case '\n': quoted += "\\n"; break;
+        case '\t': quoted += "\\t"; break;
+        default:
+            if(static_cast<unsigned char>(c) < 0x20){
+                quoted += format("\\u{:04x}", static_cast<int>(c));
+            } else {
+                quoted += c;
+            }
+            break;
+        }
+    }
+    quoted += '"';
+    return quoted;
+}
+
+
+bool SimulationBar::runSimulationBenchmark(const std::string& filename, double timeLength)
+{
+    MessageView* mv = MessageView::instance();
+
+    ofstream ofs(filename.c_str());
+    if(!ofs){
+        mv->putln(format(_("\"{}\" cannot be opened."), filename), MessageView::ERROR);
+        return false;
+    }
+
+    ItemList<SimulatorItem> simulators;
+    simulators.extractChildItems(RootItem::instance());
+    if(simulators.empty()){
+        mv->notify(_("There is no simulator item."));
+    }
+
+    if(benchmarkCameraWidth > 0 && benchmarkCameraHeight > 0){
+        ItemList<BodyItem> bodyItems;
+        bodyItems.extractChildItems(RootItem::instance());
+        for(auto& bodyItem : bodyItems){
+            for(auto camera : bodyItem->body()->devices<Camera>()){
+                camera->setResolution(benchmarkCameraWidth, benchmarkCameraHeight);
+            }
+        }
+    }
+
+    // The mode -1 keeps the thread modes of the vision simulator items
+    vector<int> visionThreadModes = benchmarkVisionThreadModes;
+    if(visionThreadModes.empty()){
+        visionThreadModes.push_back(-1);
+    }
+
+    ofs << "{\n";
+    ofs << "  \"project\": " << toJsonString(ProjectManager::instance()->currentProjectFile()) << ",\n";
+    ofs << "  \"timeLength\": " << timeLength << ",\n";
+    if(benchmarkCameraWidth > 0 && benchmarkCameraHeight > 0){
+        ofs << "  \"cameraResolution\": [" << benchmarkCameraWidth << ", " << benchmarkCameraHeight << "],\n";
+    }
+    ofs << "  \"simulators\": [";
+    bool isFirst = true;
+    for(size_t i=0; i < simulators.size(); ++i){
+        for(auto mode : visionThreadModes){
+            ofs << (isFirst ? "\n" : ",\n");
+            runBenchmarkSimulation(simulators[i], timeLength, mode, ofs);
+            isFirst = false;
+        }
+    }
+    ofs << "\n  ]\n}\n";
+
+    return ofs.good();
+}
+
+
+void SimulationBar::setVisionSensorBenchmarkConditions
+(const std::vector<int>& threadModes, int cameraWidth, int cameraHeight)
+{
+    benchmarkVisionThreadModes = threadModes;
+    benchmarkCameraWidth = cameraWidth;
+    benchmarkCameraHeight = cameraHeight;
+}
+
+
+void SimulationBar::setBenchmarkWarmUpTime(double time)
+{
+    benchmarkWarmUpTime = time;
+}
+
+
+void SimulationBar::runBenchmarkSimulation
+(SimulatorItem* simulator, double timeLength, int visionThreadMode, std::ostream& os)
+{
+    if(simulator->isRunning()){
+        simulator->stopSimulation();
+    }
+    simulator->setTimeRangeMode(SimulatorItem::TR_SPECIFIED);
+    simulator->setSpecifiedRecordingTimeLength(timeLength);
+    simulator->setRealtimeSyncMode(false);
+    simulator->setProfilingEnabled(true);
+
+    ItemList<GLVisionSimulatorItem> visionSimulators;
+    visionSimulators.extractChildItems(simulator);
+    for(auto& visionSimulator : visionSimulators){
+        visionSimulator->setPerformanceMeasurementEnabled(true);
+        if(visionThreadMode >= 0){
+            visionSimulator->setThreadMode(visionThreadMode);
+        }
+    }
+
+    ContactCount contactCount;
+    ScopedConnection connection(
+        simulator->sigSimulationStarted().connect(
+            [&](){
+                simulator->addPostDynamicsFunction(
+                    [&](){ contactCount.count(simulator); });
+            }));
+
+    sigSimulationAboutToStart_(simulator);
+
+    auto startTime = std::chrono::steady_clock::now();
+    bool started = simulator->runBatchSimulation(true);
+    const double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    string className;
+    string moduleName;
+    ItemManager::getClassIdentifier(simulator, moduleName, className);
+
+    os << "    {\n";
+    os << "      \"name\": " << toJsonString(simulator->name()) << ",\n";
+    os << "      \"class\": " << toJsonString(className) << ",\n";
+    if(visionThreadMode >= 0){
+        static const char* modeSymbols[] = { "single", "sensor", "screen" };
+        os << "      \"visionThreadMode\": \"" << modeSymbols[visionThreadMode] << "\",\n";
+    }
+
+    if(!started){
+        os << "      \"error\": \"The simulation cannot be started.\"\n";
+        os << "    }";
+        return;
+    }
+
+    const double simulationTime = simulator->simulationTime();
+    os << "      \"timeStep\": " << simulator->worldTimeStep() << ",\n";
+    os << "      \"frames\": " << simulator->simulationFrame() << ",\n";
+    os << "      \"simulationTime\": " << simulationTime << ",\n";
+    os << "      \"elapsedTime\": " << elapsed << ",\n";
+    os << "      \"realTimeFactor\": " << (elapsed > 0.0 ? simulationTime / elapsed : 0.0) << ",\n";
+
+    // The profiling times are recorded in nanoseconds and output in milliseconds
+    os << "      \"phases\": [";
+    auto seq = simulator->profilingSeq();
+    const auto& names = simulator->profilingNames();
+    if(seq && seq->numFrames() > 0){
+        const int numParts = std::min(seq->numParts(), static_cast<int>(names.size()));
+        for(int i=0; i < numParts; ++i){
+            auto part = seq->part(i);
+            double total = 0.0;
+            double max = 0.0;
+            for(int j=0; j < part.size(); ++j){
+                total += part[j];
+                max = std::max(max, part[j]);
+            }
+            os << (i == 0 ? "\n" : ",\n");
+            os << "        { \"name\": " << toJsonString(names[i])
+               << ", \"meanTime\": " << (total / part.size() * 1.0e-6)
+               << ", \"maxTime\": " << (max * 1.0e-6) << " }";
+        }
+        os << "\n      ";
+    }
+    os << "],\n";
+
+    // The allocations are only counted when Choreonoid is built with ENABLE_ALLOCATION_TRACKING
+    os << "      \"allocations\": ";
+    auto allocations = simulator->stepAllocationStatistics();
+    if(allocations.empty()){
+        os << "null,\n";
+    } else {
+        const int warmUpFrame = static_cast<int>(benchmarkWarmUpTime / simulator->worldTimeStep());
+        int lastAllocationFrame = -1;
+        for(auto& phase : allocations){
+            lastAllocationFrame = std::max(lastAllocationFrame, phase.lastAllocationFrame);
+        }
+        os << "{\n";
+        os << "        \"warmUpFrames\": " << warmUpFrame << ",\n";
+        os << "        \"lastAllocationFrame\": " << lastAllocationFrame << ",\n";
+        os << "        \"isSteadyStateAllocationFree\": "
+           << (lastAllocationFrame <= warmUpFrame ? "true" : "false") << ",\n";
+        os << "        \"phases\": [";
+        for(size_t i=0; i < allocations.size(); ++i){
+            auto& phase = allocations[i];
+            os << (i == 0 ? "\n" : ",\n");
+            os << "          { \"name\": " << toJsonString(phase.phase)
+               << ", \"allocations\": " << phase.numAllocations
+               << ", \"bytes\": " << phase.numAllocatedBytes
+               << ", \"allocatingSteps\": " << phase.numAllocatingSteps
+               << ", \"lastAllocationFrame\": " << phase.lastAllocationFrame << " }";
+        }
+        os << "\n        ]\n";
+        os << "      },\n";
+    }
+
+    os << "      \"contacts\": {";
+    if(contactCount.numSampledFrames > 0){
+        const double n = contactCount.numSampledFrames;
+        os << " \"sampledFrames\": " << contactCount.numSampledFrames
+           << ", \"meanContacts\": " << (contactCount.totalContacts / n)
+           << ", \"maxContacts\": " << contactCount.maxContacts
+           << ", \"meanLinkPairs\": " << (contactCount.totalLinkPairs / n) << " ";
+    }
+    os << "},\n";
+
+    // The times of the vision sensors are output in milliseconds
+    os << "      \"visionSensors\": [";
+    bool isFirstSensor = true;
+    for(auto& visionSimulator : visionSimulators){
+        for(auto& stat : visionSimulator->sensorStatistics()){
+            os << (isFirstSensor ? "\n" : ",\n");
+            os << "        { \"body\": " << toJsonString(stat.bodyName)
+               << ", \"sensor\": " << toJsonString(stat.sensorName)
+               << ", \"screens\": " << stat.numScreens
+               << ", \"frames\": " << stat.numFrames
+               << ", \"frameRate\": " << stat.frameRate
+               << ", \"renderingTime\": " << (stat.renderingTime * 1.0e3)
+               << ", \"readbackTime\": " << (stat.readbackTime * 1.0e3)
+               << ", \"latency\": { \"p50\": " << (stat.latencyP50 * 1.0e3)
+               << ", \"p90\": " << (stat.latencyP90 * 1.0e3)
+               << ", \"p99\": " << (stat.latencyP99 * 1.0e3)
+               << ", \"max\": " << (stat.maxLatency * 1.0e3) << " } }";
+            isFirstSensor = false;
+        }
+    }
+    if(!isFirstSensor){
+        os << "\n      ";
+    }
+    os << "],\n";
+
+    // This is the peak of the whole process, which includes the simulations run before
+    os << "      \"peakMemory\": " << getPeakMemoryUsage() << "\n";
+    os << "    }";
+}
+
+
 void SimulationBar::onStopSimulationClicked()
 {
     forEachSimulator(std::bind(&SimulationBar::stopSimulation, this, _1));
@@ -8,6 +8,9 @@
 #include <cnoid/ToolBar>
 #include <cnoid/Signal>
 #include <functional>
+#include <string>
+#include <vector>
+#include <iosfwd>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -26,6 +29,37 @@ public:
             
     void startSimulation(SimulatorItem* simulator, bool doRest);
     void startSimulation(bool doRest = true);
+
+    //! Starts the simulation from the latest periodic checkpoint of the simulator item at or before the time
+    void branchSimulation(SimulatorItem* simulator, double time);
+    
+    void runBatchSimulation(SimulatorItem* simulator, bool doReset);
+    void runBatchSimulation(bool doReset = true);
+
+    /**
+       Runs all the simulator items of the project in the batch mode for the specified
+       simulation time and writes the real-time factors, the mean computation times of
+       the profiling phases, the contact counts, the heap allocations of the phases when they
+       are tracked, and the peak memory usage as a JSON file.
+       The time range, the realtime sync and the profiling settings of the items are
+       overwritten for the measurement.
+    */
+    bool runSimulationBenchmark(const std::string& filename, double timeLength);
+
+    /**
+       The rendering of the vision sensors simulated by GLVisionSimulatorItem is also measured
+       in the benchmark. Each simulation is repeated for the given thread modes of the items,
+       and the resolutions of the cameras are overwritten when the width and height are positive.
+    */
+    void setVisionSensorBenchmarkConditions(
+        const std::vector<int>& threadModes, int cameraWidth = 0, int cameraHeight = 0);
+
+    /**
+       When the heap allocations are tracked, the benchmark reports whether each simulation
+       step after the warm-up time was done without allocating memory.
+    */
+    void setBenchmarkWarmUpTime(double time);
+    
     void stopSimulation(SimulatorItem* simulator);
     void pauseSimulation(SimulatorItem* simulator);
 
@@ -36,10 +70,16 @@ private:
 
     void onStoreInitialClicked();
     void onRestoreInitialClicked();
+    void onBranchSimulationClicked();
     void forEachSimulator(std::function<void(SimulatorItem* simulator)> callback, bool doSelect = false);
     void onStopSimulationClicked();
     void onPauseSimulationClicked();
+    void runBenchmarkSimulation(SimulatorItem* simulator, double timeLength, int visionThreadMode, std::ostream& os);
     ToolButton* pauseToggle;
+    std::vector<int> benchmarkVisionThreadModes;
+    int benchmarkCameraWidth;
+    int benchmarkCameraHeight;
+    double benchmarkWarmUpTime;
 
     Signal<void(SimulatorItem*)> sigSimulationAboutToStart_;
 };
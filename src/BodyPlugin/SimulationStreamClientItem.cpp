@@ -0,0 +1,640 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#include "SimulationStreamClientItem.h"
+#include "SimulationStreamProtocol.h"
+#include "WorldItem.h"
+#include "CollisionSeq.h"
+#include "BodyItem.h"
+#include <cnoid/ItemManager>
+#include <cnoid/RootItem>
+#include <cnoid/ItemList>
+#include <cnoid/MessageView>
+#include <cnoid/OptionManager>
+#include <cnoid/ExtensionManager>
+#include <cnoid/Archive>
+#include <cnoid/PutPropertyFunction>
+#include <cnoid/SceneCollision>
+#include <cnoid/Camera>
+#include <QTcpSocket>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <fmt/format.h>
+#include "gettext.h"
+
+using namespace std;
+using namespace cnoid;
+using namespace cnoid::simulation_stream;
+using fmt::format;
+
+namespace {
+
+struct StreamedBody
+{
+    string name;
+    int numJoints;
+    BodyItemPtr bodyItem;
+    vector<double> keyframe;
+    vector<double> values;
+    bool isUpdated;
+};
+
+}
+
+namespace cnoid {
+
+class SimulationStreamClientItemImpl
+{
+public:
+    SimulationStreamClientItem* self;
+    MessageView* mv;
+    string host;
+    int port;
+    int bandwidth;
+    bool doReceiveImages;
+    bool isConnectionRequested;
+    QTcpSocket* socket;
+    vector<char> receivedData;
+    bool isHelloReceived;
+    WorldItem* worldItem;
+    double precisions[3];
+    vector<StreamedBody> bodies;
+    CollisionLinkPairList linkPairPool;
+    bool areContactsUpdated;
+    double streamTime;
+
+    SimulationStreamClientItemImpl(SimulationStreamClientItem* self);
+    SimulationStreamClientItemImpl(SimulationStreamClientItem* self, const SimulationStreamClientItemImpl& org);
+    ~SimulationStreamClientItemImpl();
+    bool connectToServer();
+    void disconnectFromServer();
+    void sendStreamRequest();
+    void onDataReceived();
+    void processMessage(MessageReader& reader);
+    void readBodyList(MessageReader& reader);
+    void updateBodyItems();
+    void readPoseFrame(MessageReader& reader);
+    void readContacts(MessageReader& reader);
+    void readImage(MessageReader& reader);
+    void doPutProperties(PutPropertyFunction& putProperty);
+    bool store(Archive& archive);
+    bool restore(const Archive& archive);
+};
+
+}
+
+
+static void onSigOptionsParsedAfterProjectLoading(boost::program_options::variables_map& v)
+{
+    if(v.count("simulation-stream-client")){
+        ItemList<WorldItem> worldItems;
+        if(!worldItems.extractSubTreeItems(RootItem::instance())){
+            MessageView::instance()->putln(
+                _("A world item is required to show the streamed simulation."), MessageView::ERROR);
+            return;
+        }
+        SimulationStreamClientItemPtr clientItem = new SimulationStreamClientItem;
+        string address = v["simulation-stream-client"].as<string>();
+        auto pos = address.rfind(':');
+        if(pos != string::npos){
+            const int port = std::atoi(address.substr(pos + 1).c_str());
+            if(port <= 0){
+                MessageView::instance()->putln(
+                    format(_("\"{}\" is not a valid address of the simulation stream server."), address),
+                    MessageView::ERROR);
+                return;
+            }
+            clientItem->setPort(port);
+            address = address.substr(0, pos);
+        }
+        clientItem->setHost(address);
+        clientItem->setBandwidth(v["simulation-stream-bandwidth"].as<int>() * 1024);
+        clientItem->setImageStreamingEnabled(v.count("simulation-stream-images"));
+        worldItems.front()->addChildItem(clientItem);
+        clientItem->connectToServer();
+    }
+}
+
+
+void SimulationStreamClientItem::initializeClass(ExtensionManager* ext)
+{
+    ext->itemManager().registerClass<SimulationStreamClientItem>(N_("SimulationStreamClientItem"));
+    ext->itemManager().addCreationPanel<SimulationStreamClientItem>();
+
+    OptionManager& om = ext->optionManager();
+    om.addOption("simulation-stream-client", boost::program_options::value<string>(),
+                 "show the simulation streamed from the server of host[:port] with the models of the loaded project");
+    om.addOption("simulation-stream-bandwidth", boost::program_options::value<int>()->default_value(0),
+                 "maximum bandwidth [KB/s] requested to the simulation stream server (0: no limit)");
+    om.addOption("simulation-stream-images", "receive the camera images from the simulation stream server");
+    om.sigOptionsParsed(1).connect(onSigOptionsParsedAfterProjectLoading);
+}
+
+
+SimulationStreamClientItem::SimulationStreamClientItem()
+{
+    setName("SimulationStreamClient");
+    impl = new SimulationStreamClientItemImpl(this);
+}
+
+
+SimulationStreamClientItemImpl::SimulationStreamClientItemImpl(SimulationStreamClientItem* self)
+    : self(self),
+      mv(MessageView::instance()),
+      host("localhost")
+{
+    port = defaultPort;
+    bandwidth = 0;
+    doReceiveImages = false;
+    isConnectionRequested = false;
+    socket = nullptr;
+    isHelloReceived = false;
+    worldItem = nullptr;
+    std::fill(precisions, precisions + 3, 1.0);
+    areContactsUpdated = false;
+    streamTime = 0.0;
+}
+
+
+SimulationStreamClientItem::SimulationStreamClientItem(const SimulationStreamClientItem& org)
+    : Item(org)
+{
+    impl = new SimulationStreamClientItemImpl(this, *org.impl);
+}
+
+
+SimulationStreamClientItemImpl::SimulationStreamClientItemImpl
+(SimulationStreamClientItem* self, const SimulationStreamClientItemImpl& org)
+    : SimulationStreamClientItemImpl(self)
+{
+    host = org.host;
+    port = org.port;
+    bandwidth = org.bandwidth;
+    doReceiveImages = org.doReceiveImages;
+}
+
+
+SimulationStreamClientItem::~SimulationStreamClientItem()
+{
+    delete impl;
+}
+
+
+SimulationStreamClientItemImpl::~SimulationStreamClientItemImpl()
+{
+    disconnectFromServer();
+}
+
+
+Item* SimulationStreamClientItem::doDuplicate() const
+{
+    return new SimulationStreamClientItem(*this);
+}
+
+
+void SimulationStreamClientItem::setHost(const std::string& host)
+{
+    impl->host = host;
+}
+
+
+const std::string& SimulationStreamClientItem::host() const
+{
+    return impl->host;
+}
+
+
+void SimulationStreamClientItem::setPort(int port)
+{
+    impl->port = port;
+}
+
+
+int SimulationStreamClientItem::port() const
+{
+    return impl->port;
+}
+
+
+void SimulationStreamClientItem::setBandwidth(int bytesPerSecond)
+{
+    impl->bandwidth = std::max(0, bytesPerSecond);
+    impl->sendStreamRequest();
+}
+
+
+void SimulationStreamClientItem::setImageStreamingEnabled(bool on)
+{
+    impl->doReceiveImages = on;
+    impl->sendStreamRequest();
+}
+
+
+double SimulationStreamClientItem::streamTime() const
+{
+    return impl->streamTime;
+}
+
+
+void SimulationStreamClientItem::onPositionChanged()
+{
+    auto worldItem = findOwnerItem<WorldItem>();
+    if(worldItem != impl->worldItem){
+        impl->worldItem = worldItem;
+        impl->updateBodyItems();
+    }
+}
+
+
+bool SimulationStreamClientItem::connectToServer()
+{
+    return impl->connectToServer();
+}
+
+
+bool SimulationStreamClientItemImpl::connectToServer()
+{
+    disconnectFromServer();
+
+    isConnectionRequested = true;
+    receivedData.clear();
+    isHelloReceived = false;
+    bodies.clear();
+
+    socket = new QTcpSocket;
+    QObject::connect(socket, &QTcpSocket::connected, [this](){ sendStreamRequest(); });
+    QObject::connect(socket, &QTcpSocket::readyRead, [this](){ onDataReceived(); });
+    QObject::connect(socket, &QTcpSocket::disconnected, [this](){
+            mv->putln(format(_("{0} is disconnected from {1}:{2}."), self->name(), host, port));
+            self->notifyUpdate();
+        });
+    QObject::connect(
+        socket, static_cast<void(QAbstractSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error),
+        [this](QAbstractSocket::SocketError){
+            mv->putln(format(_("{0}: {1}"), self->name(), socket->errorString().toStdString()),
+                      MessageView::WARNING);
+        });
+    socket->connectToHost(host.c_str(), port);
+    return true;
+}
+
+
+void SimulationStreamClientItem::disconnectFromServer()
+{
+    impl->disconnectFromServer();
+}
+
+
+void SimulationStreamClientItemImpl::disconnectFromServer()
+{
+    isConnectionRequested = false;
+    if(socket){
+        socket->disconnect();
+        socket->abort();
+        socket->deleteLater();
+        socket = nullptr;
+    }
+}
+
+
+bool SimulationStreamClientItem::isConnected() const
+{
+    return impl->socket && impl->socket->state() == QAbstractSocket::ConnectedState;
+}
+
+
+void SimulationStreamClientItemImpl::sendStreamRequest()
+{
+    if(socket && socket->state() == QAbstractSocket::ConnectedState){
+        MessageWriter writer;
+        writer.begin(STREAM_REQUEST);
+        writer.writeInt(bandwidth);
+        writer.writeOctet(doReceiveImages);
+        writer.end();
+        socket->write(writer.data.data(), writer.data.size());
+    }
+}
+
+
+/**
+   All the received messages are decoded because the deltas refer to the keyframes,
+   and the body items are only updated with the latest state.
+*/
+void SimulationStreamClientItemImpl::onDataReceived()
+{
+    QByteArray data = socket->readAll();
+    receivedData.insert(receivedData.end(), data.constData(), data.constData() + data.size());
+
+    size_t pos = 0;
+    while(receivedData.size() - pos >= 4){
+        MessageReader header(receivedData.data() + pos, 4);
+        const uint32_t size = header.readInt();
+        if(size == 0 || size > maxMessageSize){
+            mv->putln(format(_("{0} received an invalid message."), self->name()), MessageView::ERROR);
+            disconnectFromServer();
+            return;
+        }
+        if(receivedData.size() - pos < size + 4){
+            break;
+        }
+        MessageReader reader(receivedData.data() + pos + 4, size);
+        try {
+            processMessage(reader);
+        }
+        catch(const NotEnoughDataException&){
+            mv->putln(format(_("{0} received a broken message."), self->name()), MessageView::WARNING);
+        }
+        if(!socket){
+            return;
+        }
+        pos += size + 4;
+    }
+    receivedData.erase(receivedData.begin(), receivedData.begin() + pos);
+
+    for(auto& body : bodies){
+        if(body.isUpdated){
+            body.bodyItem->notifyKinematicStateChange(true);
+            body.isUpdated = false;
+        }
+    }
+    if(areContactsUpdated && worldItem){
+        if(auto sceneCollision = dynamic_cast<SceneCollision*>(worldItem->getScene())){
+            sceneCollision->setDirty();
+            sceneCollision->notifyUpdate(SgUpdate::MODIFIED);
+        }
+        areContactsUpdated = false;
+    }
+}
+
+
+void SimulationStreamClientItemImpl::processMessage(MessageReader& reader)
+{
+    const int id = reader.readOctet();
+
+    if(id == HELLO){
+        if(reader.readString() != magic || reader.readInt() != protocolVersion){
+            mv->putln(format(_("The server at {0}:{1} is not a compatible simulation stream server."), host, port),
+                      MessageView::ERROR);
+            disconnectFromServer();
+            return;
+        }
+        isHelloReceived = true;
+        mv->putln(format(_("{0} is connected to {1}:{2}."), self->name(), host, port));
+        self->notifyUpdate();
+        return;
+    }
+    if(!isHelloReceived){
+        return;
+    }
+    switch(id){
+    case BODY_LIST:
+        readBodyList(reader);
+        break;
+    case POSE_FRAME:
+        readPoseFrame(reader);
+        break;
+    case CONTACTS:
+        readContacts(reader);
+        break;
+    case IMAGE:
+        readImage(reader);
+        break;
+    default:
+        break;
+    }
+}
+
+
+void SimulationStreamClientItemImpl::readBodyList(MessageReader& reader)
+{
+    for(int i=0; i < 3; ++i){
+        precisions[i] = reader.readFloat();
+    }
+    const int numBodies = reader.readShort();
+    bodies.resize(numBodies);
+    for(auto& body : bodies){
+        body.name = reader.readString();
+        body.numJoints = reader.readShort();
+        body.keyframe.clear();
+        body.isUpdated = false;
+    }
+    updateBodyItems();
+}
+
+
+void SimulationStreamClientItemImpl::updateBodyItems()
+{
+    ItemList<BodyItem> bodyItems;
+    if(worldItem){
+        bodyItems.extractSubTreeItems(worldItem);
+    }
+    for(auto& body : bodies){
+        body.bodyItem.reset();
+        for(auto& bodyItem : bodyItems){
+            if(bodyItem->name() == body.name){
+                if(bodyItem->body()->numJoints() == body.numJoints){
+                    body.bodyItem = bodyItem;
+                } else {
+                    mv->putln(format(_("The number of the joints of \"{0}\" is different from the streamed body."),
+                                     body.name), MessageView::WARNING);
+                }
+                break;
+            }
+        }
+        body.isUpdated = false;
+    }
+}
+
+
+void SimulationStreamClientItemImpl::readPoseFrame(MessageReader& reader)
+{
+    streamTime = reader.readFloat();
+    const int numBodies = reader.readShort();
+    if(numBodies != static_cast<int>(bodies.size())){
+        throw NotEnoughDataException();
+    }
+    for(auto& body : bodies){
+        const int type = reader.readOctet();
+        if(type == POSE_KEYFRAME){
+            const int n = reader.readShort();
+            body.keyframe.resize(n);
+            for(int i=0; i < n; ++i){
+                body.keyframe[i] = reader.readFloat();
+            }
+            body.values = body.keyframe;
+        } else {
+            const int n = body.keyframe.size();
+            if(n == 0){
+                throw NotEnoughDataException();
+            }
+            body.values.resize(n);
+            for(int i=0; i < n; ++i){
+                const double precision = precisions[(i < 3) ? 0 : ((i < 7) ? 1 : 2)];
+                body.values[i] = body.keyframe[i] + reader.readVarInt() * precision;
+            }
+        }
+
+        if(body.bodyItem && static_cast<int>(body.values.size()) == 7 + body.numJoints){
+            Body* b = body.bodyItem->body();
+            const double* v = body.values.data();
+            Link* rootLink = b->rootLink();
+            rootLink->setTranslation(Vector3(v[0], v[1], v[2]));
+            rootLink->setRotation(Quat(v[3], v[4], v[5], v[6]).normalized().toRotationMatrix());
+            for(int i=0; i < body.numJoints; ++i){
+                b->joint(i)->q() = v[7 + i];
+            }
+            body.isUpdated = true;
+        }
+    }
+}
+
+
+void SimulationStreamClientItemImpl::readContacts(MessageReader& reader)
+{
+    if(!worldItem){
+        return;
+    }
+    auto& collisions = worldItem->collisions();
+    collisions.clear();
+    const int numPairs = reader.readShort();
+    while(static_cast<int>(linkPairPool.size()) < numPairs){
+        linkPairPool.push_back(std::make_shared<CollisionLinkPair>());
+    }
+    for(int i=0; i < numPairs; ++i){
+        CollisionLinkPair& linkPair = *linkPairPool[i];
+        for(int j=0; j < 2; ++j){
+            const int bodyIndex = reader.readShort();
+            const int linkIndex = reader.readShort();
+            linkPair.body[j].reset();
+            linkPair.link[j] = nullptr;
+            if(bodyIndex >= 0 && bodyIndex < static_cast<int>(bodies.size()) && bodies[bodyIndex].bodyItem){
+                Body* body = bodies[bodyIndex].bodyItem->body();
+                if(linkIndex >= 0 && linkIndex < body->numLinks()){
+                    linkPair.body[j] = body;
+                    linkPair.link[j] = body->link(linkIndex);
+                }
+            }
+        }
+        const int numCollisions = reader.readShort();
+        linkPair.collisions.resize(numCollisions);
+        for(auto& c : linkPair.collisions){
+            for(int j=0; j < 3; ++j){
+                c.point[j] = reader.readFloat();
+            }
+            for(int j=0; j < 3; ++j){
+                c.normal[j] = reader.readFloat();
+            }
+            c.depth = reader.readFloat();
+        }
+        collisions.push_back(linkPairPool[i]);
+    }
+    areContactsUpdated = true;
+}
+
+
+void SimulationStreamClientItemImpl::readImage(MessageReader& reader)
+{
+    namespace io = boost::iostreams;
+
+    const int bodyIndex = reader.readShort();
+    const int deviceIndex = reader.readShort();
+    const int width = reader.readShort();
+    const int height = reader.readShort();
+    const int numComponents = reader.readOctet();
+    const int size = reader.readInt();
+    if(size != width * height * numComponents){
+        throw NotEnoughDataException();
+    }
+    if(bodyIndex < 0 || bodyIndex >= static_cast<int>(bodies.size()) || !bodies[bodyIndex].bodyItem){
+        return;
+    }
+    Body* body = bodies[bodyIndex].bodyItem->body();
+    if(deviceIndex < 0 || deviceIndex >= body->numDevices()){
+        return;
+    }
+    auto camera = dynamic_cast<Camera*>(body->device(deviceIndex));
+    if(!camera){
+        return;
+    }
+
+    Image& image = camera->newImage();
+    image.setSize(width, height, numComponents);
+    io::filtering_istream in;
+    in.push(io::zlib_decompressor());
+    in.push(io::array_source(reader.current(), reader.remainingSize()));
+    in.read(reinterpret_cast<char*>(image.pixels()), size);
+    if(in.gcount() != size){
+        camera->clearState();
+        throw NotEnoughDataException();
+    }
+    camera->notifyStateChange();
+}
+
+
+void SimulationStreamClientItem::doPutProperties(PutPropertyFunction& putProperty)
+{
+    impl->doPutProperties(putProperty);
+}
+
+
+void SimulationStreamClientItemImpl::doPutProperties(PutPropertyFunction& putProperty)
+{
+    putProperty(_("Host"), host, changeProperty(host));
+    putProperty.min(1).max(65535)(_("Port"), port, changeProperty(port));
+    putProperty.min(0)(_("Bandwidth [KB/s]"), bandwidth / 1024,
+                       [&](int value){ self->setBandwidth(value * 1024); return true; });
+    putProperty.reset();
+    putProperty(_("Images"), doReceiveImages,
+                [&](bool on){ self->setImageStreamingEnabled(on); return true; });
+    putProperty(_("Connected"), self->isConnected(),
+                [&](bool on){
+                    if(on){
+                        connectToServer();
+                    } else {
+                        disconnectFromServer();
+                    }
+                    return true;
+                });
+    putProperty(_("Stream time"), streamTime);
+}
+
+
+bool SimulationStreamClientItem::store(Archive& archive)
+{
+    return impl->store(archive);
+}
+
+
+bool SimulationStreamClientItemImpl::store(Archive& archive)
+{
+    archive.write("host", host);
+    archive.write("port", port);
+    archive.write("bandwidth", bandwidth);
+    archive.write("images", doReceiveImages);
+    archive.write("connect", isConnectionRequested);
+    return true;
+}
+
+
+bool SimulationStreamClientItem::restore(const Archive& archive)
+{
+    return impl->restore(archive);
+}
+
+
+bool SimulationStreamClientItemImpl::restore(const Archive& archive)
+{
+    archive.read("host", host);
+    archive.read("port", port);
+    archive.read("bandwidth", bandwidth);
+    archive.read("images", doReceiveImages);
+    if(archive.get("connect", false)){
+        connectToServer();
+    }
+    return true;
+}
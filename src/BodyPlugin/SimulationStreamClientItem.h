@@ -0,0 +1,66 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_BODYPLUGIN_SIMULATION_STREAM_CLIENT_ITEM_H
+#define CNOID_BODYPLUGIN_SIMULATION_STREAM_CLIENT_ITEM_H
+
+#include <cnoid/Item>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class SimulationStreamClientItemImpl;
+
+/**
+   This item receives the states of a remote simulation streamed by SimulationStreamServerItem
+   and applies them to the body items of the same names in the world item which has this item.
+   The contacts are shown as the collisions of the world item, and the received images are set
+   to the camera devices of the bodies so that they are shown in the image views.
+
+   A Choreonoid process becomes a lightweight viewer by loading the project of the models with
+   the "--simulation-stream-client host[:port]" option, which adds this item to the world item
+   and connects to the server. The simulation is not executed in the process.
+*/
+class CNOID_EXPORT SimulationStreamClientItem : public Item
+{
+public:
+    static void initializeClass(ExtensionManager* ext);
+
+    SimulationStreamClientItem();
+    SimulationStreamClientItem(const SimulationStreamClientItem& org);
+    ~SimulationStreamClientItem();
+
+    void setHost(const std::string& host);
+    const std::string& host() const;
+    void setPort(int port);
+    int port() const;
+
+    //! The maximum number of bytes per second requested to the server. Zero means no limit.
+    void setBandwidth(int bytesPerSecond);
+
+    void setImageStreamingEnabled(bool on);
+
+    bool connectToServer();
+    void disconnectFromServer();
+    bool isConnected() const;
+
+    //! The simulation time of the latest received state
+    double streamTime() const;
+
+protected:
+    virtual Item* doDuplicate() const;
+    virtual void onPositionChanged();
+    virtual void doPutProperties(PutPropertyFunction& putProperty);
+    virtual bool store(Archive& archive);
+    virtual bool restore(const Archive& archive);
+
+private:
+    SimulationStreamClientItemImpl* impl;
+};
+
+typedef ref_ptr<SimulationStreamClientItem> SimulationStreamClientItemPtr;
+
+}
+
+#endif
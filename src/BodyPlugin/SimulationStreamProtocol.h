@@ -0,0 +1,196 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_BODYPLUGIN_SIMULATION_STREAM_PROTOCOL_H
+#define CNOID_BODYPLUGIN_SIMULATION_STREAM_PROTOCOL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace cnoid {
+
+namespace simulation_stream {
+
+/*
+  The stream is a sequence of the messages, each of which begins with the 32-bit size of the
+  following data, which consists of the message ID and the content. The values are written in
+  the little endian order as in the world log files.
+
+  The server sends HELLO when a client connects and BODY_LIST, which includes the precisions of
+  the quantized values, when a simulation starts or a client connects during a simulation. Then
+  POSE_FRAME and optionally CONTACTS and IMAGE are sent for each frame. The pose of a body is
+  a keyframe of the float values of the root link position and the joint positions, or the
+  quantized deltas from the last keyframe encoded in the same way as the world log files.
+  The client sends STREAM_REQUEST to specify its bandwidth and whether it needs the images.
+
+  The message framing and the writer / reader are also used by the remote rendering of
+  GLVisionSimulatorItem, which defines its own message IDs.
+*/
+static const char* const magic = "CNOID-SIMULATION-STREAM";
+static const int protocolVersion = 1;
+static const int defaultPort = 47110;
+
+enum MessageID {
+    HELLO,
+    STREAM_REQUEST,
+    BODY_LIST,
+    POSE_FRAME,
+    CONTACTS,
+    IMAGE
+};
+
+enum PoseType {
+    POSE_KEYFRAME,
+    POSE_DELTAS
+};
+
+// The maximum size of a message which is accepted by the receiver
+static const uint32_t maxMessageSize = 64 * 1024 * 1024;
+
+static const int maxQuantizedDelta = (1 << 20) - 1;
+
+class MessageWriter
+{
+public:
+    std::vector<char> data;
+
+    void begin(int id){
+        data.clear();
+        writeInt(0);
+        writeOctet(id);
+    }
+
+    //! The size header is fixed and the message is ready to be sent
+    void end(){
+        const int size = data.size() - 4;
+        for(int i=0; i < 4; ++i){
+            data[i] = (size >> (8 * i)) & 0xff;
+        }
+    }
+
+    void writeOctet(int value){
+        data.push_back(static_cast<char>(value));
+    }
+
+    void writeShort(int value){
+        data.push_back(value & 0xff);
+        data.push_back((value >> 8) & 0xff);
+    }
+
+    void writeInt(int value){
+        for(int i=0; i < 4; ++i){
+            data.push_back((value >> (8 * i)) & 0xff);
+        }
+    }
+
+    void writeFloat(float value){
+        const char* p = reinterpret_cast<const char*>(&value);
+        data.insert(data.end(), p, p + sizeof(float));
+    }
+
+    void writeVarInt(int value){
+        uint32_t v = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+        while(v >= 0x80){
+            data.push_back(static_cast<char>((v & 0x7f) | 0x80));
+            v >>= 7;
+        }
+        data.push_back(static_cast<char>(v));
+    }
+
+    void writeString(const std::string& str){
+        writeShort(str.size());
+        data.insert(data.end(), str.begin(), str.end());
+    }
+
+    void writeBytes(const char* bytes, size_t size){
+        data.insert(data.end(), bytes, bytes + size);
+    }
+};
+
+
+struct NotEnoughDataException { };
+
+class MessageReader
+{
+public:
+    MessageReader(const char* data, size_t size)
+        : p(data), end(data + size) { }
+
+    size_t remainingSize() const { return end - p; }
+
+    const char* current() const { return p; }
+
+    void skip(size_t size){
+        check(size);
+        p += size;
+    }
+
+    int readOctet(){
+        check(1);
+        return static_cast<unsigned char>(*p++);
+    }
+
+    int readShort(){
+        check(2);
+        const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+        p += 2;
+        return static_cast<short>(u[0] | (u[1] << 8));
+    }
+
+    int readInt(){
+        check(4);
+        const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+        p += 4;
+        return static_cast<int>(u[0] | (u[1] << 8) | (u[2] << 16) | (static_cast<uint32_t>(u[3]) << 24));
+    }
+
+    float readFloat(){
+        check(sizeof(float));
+        float value;
+        char* q = reinterpret_cast<char*>(&value);
+        for(size_t i=0; i < sizeof(float); ++i){
+            q[i] = *p++;
+        }
+        return value;
+    }
+
+    int readVarInt(){
+        uint32_t v = 0;
+        int shift = 0;
+        while(true){
+            const int octet = readOctet();
+            v |= static_cast<uint32_t>(octet & 0x7f) << shift;
+            if(!(octet & 0x80) || shift >= 28){
+                break;
+            }
+            shift += 7;
+        }
+        return static_cast<int>(v >> 1) ^ -static_cast<int>(v & 1);
+    }
+
+    std::string readString(){
+        const int size = static_cast<unsigned short>(readShort());
+        check(size);
+        std::string str(p, size);
+        p += size;
+        return str;
+    }
+
+private:
+    const char* p;
+    const char* end;
+
+    void check(size_t size) const {
+        if(static_cast<size_t>(end - p) < size){
+            throw NotEnoughDataException();
+        }
+    }
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,898 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#include "SimulationStreamServerItem.h"
+#include "SimulationStreamProtocol.h"
+#include "SimulatorItem.h"
+#include <cnoid/ItemManager>
+#include <cnoid/MessageView>
+#include <cnoid/LazyCaller>
+#include <cnoid/Archive>
+#include <cnoid/PutPropertyFunction>
+#include <cnoid/Body>
+#include <cnoid/Camera>
+#include <cnoid/EigenTypes>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <fmt/format.h>
+#include "gettext.h"
+
+using namespace std;
+using namespace cnoid;
+using namespace cnoid::simulation_stream;
+using fmt::format;
+
+namespace {
+
+// The number of the delta frames after which a new keyframe is sent
+const int keyframeInterval = 60;
+
+// The size of the data waiting to be sent to a client without the bandwidth limit, over which frames are skipped
+const qint64 maxUnlimitedQueueSize = 256 * 1024;
+
+typedef std::chrono::steady_clock Clock;
+
+struct CameraSnapshot
+{
+    int bodyIndex;
+    int deviceIndex;
+    std::shared_ptr<const Image> image;
+};
+
+struct Snapshot
+{
+    double time;
+    // The root link position (translation and quaternion) followed by the joint positions of each body
+    vector<vector<double>> poses;
+    std::shared_ptr<CollisionLinkPairList> collisions;
+    vector<CameraSnapshot> images;
+};
+
+struct KeyframeState
+{
+    vector<double> values;
+    int numDeltaFrames;
+};
+
+struct Client
+{
+    QTcpSocket* socket;
+    vector<char> receivedData;
+    int requestedBandwidth;
+    bool doSendImages;
+    double tokens;
+    Clock::time_point lastRefillTime;
+    Clock::time_point lastImageTime;
+    vector<KeyframeState> keyframes;
+};
+
+}
+
+namespace cnoid {
+
+class SimulationStreamServerItemImpl
+{
+public:
+    SimulationStreamServerItem* self;
+    MessageView* mv;
+
+    int port;
+    double frameRate;
+    int bandwidth;
+    bool isContactStreamingEnabled;
+    double imageFrameRate;
+    int imageDownscaleFactor;
+    double translationPrecision;
+    double rotationPrecision;
+    double jointPositionPrecision;
+
+    QTcpServer* server;
+    vector<unique_ptr<Client>> clients;
+    vector<char> bodyListMessage;
+    double streamPrecisions[3];
+    std::map<Body*, int> bodyIndexMap;
+    MessageWriter writer;
+    vector<double> quantizingValues;
+    vector<int> quantizedDeltas;
+    vector<vector<char>> imageMessages;
+    bool areImageMessagesReady;
+
+    // Following variables are accessed in the simulation thread
+    SimulatorItem* simulatorItem;
+    vector<Body*> bodies;
+    vector<vector<int>> cameraIndices;
+    int streamIntervalFrames;
+    int frameCounter;
+    Snapshot captureBuf;
+
+    // Following variables are shared by the simulation thread and the main thread
+    std::mutex snapshotMutex;
+    Snapshot latestSnapshot;
+    bool hasNewSnapshot;
+    bool isSendPending;
+    std::atomic<bool> doCaptureImages;
+
+    Snapshot sendingSnapshot;
+
+    SimulationStreamServerItemImpl(SimulationStreamServerItem* self);
+    SimulationStreamServerItemImpl(SimulationStreamServerItem* self, const SimulationStreamServerItemImpl& org);
+    ~SimulationStreamServerItemImpl();
+    bool startListening();
+    void stopListening();
+    void onNewConnection();
+    void onDataReceived(Client* client);
+    void removeClient(Client* client);
+    void updateImageCaptureFlag();
+    bool initializeSimulation(SimulatorItem* simulatorItem);
+    void finalizeSimulation();
+    void capture();
+    void sendLatestSnapshot();
+    bool sendSnapshot(Client* client, Clock::time_point now);
+    int effectiveBandwidth(Client* client) const;
+    void writePoseFrame(Client* client);
+    bool quantize(KeyframeState& keyframe, const double* precisions, int numPrecisions);
+    void writeContacts();
+    void prepareImageMessages();
+    void send(Client* client, const vector<char>& data);
+    void doPutProperties(PutPropertyFunction& putProperty);
+    bool store(Archive& archive);
+    bool restore(const Archive& archive);
+};
+
+}
+
+
+void SimulationStreamServerItem::initializeClass(ExtensionManager* ext)
+{
+    ext->itemManager().registerClass<SimulationStreamServerItem>(N_("SimulationStreamServerItem"));
+    ext->itemManager().addCreationPanel<SimulationStreamServerItem>();
+}
+
+
+SimulationStreamServerItem::SimulationStreamServerItem()
+{
+    setName("SimulationStreamServer");
+    impl = new SimulationStreamServerItemImpl(this);
+}
+
+
+SimulationStreamServerItemImpl::SimulationStreamServerItemImpl(SimulationStreamServerItem* self)
+    : self(self),
+      mv(MessageView::instance())
+{
+    port = defaultPort;
+    frameRate = 30.0;
+    bandwidth = 0;
+    isContactStreamingEnabled = true;
+    imageFrameRate = 5.0;
+    imageDownscaleFactor = 4;
+    translationPrecision = 1.0e-4;
+    rotationPrecision = 1.0e-5;
+    jointPositionPrecision = 1.0e-5;
+    server = nullptr;
+    areImageMessagesReady = false;
+    simulatorItem = nullptr;
+    streamIntervalFrames = 1;
+    streamPrecisions[0] = translationPrecision;
+    streamPrecisions[1] = rotationPrecision;
+    streamPrecisions[2] = jointPositionPrecision;
+    frameCounter = 0;
+    hasNewSnapshot = false;
+    isSendPending = false;
+    doCaptureImages = false;
+}
+
+
+SimulationStreamServerItem::SimulationStreamServerItem(const SimulationStreamServerItem& org)
+    : SubSimulatorItem(org)
+{
+    impl = new SimulationStreamServerItemImpl(this, *org.impl);
+}
+
+
+SimulationStreamServerItemImpl::SimulationStreamServerItemImpl
+(SimulationStreamServerItem* self, const SimulationStreamServerItemImpl& org)
+    : SimulationStreamServerItemImpl(self)
+{
+    port = org.port;
+    frameRate = org.frameRate;
+    bandwidth = org.bandwidth;
+    isContactStreamingEnabled = org.isContactStreamingEnabled;
+    imageFrameRate = org.imageFrameRate;
+    imageDownscaleFactor = org.imageDownscaleFactor;
+    translationPrecision = org.translationPrecision;
+    rotationPrecision = org.rotationPrecision;
+    jointPositionPrecision = org.jointPositionPrecision;
+}
+
+
+SimulationStreamServerItem::~SimulationStreamServerItem()
+{
+    delete impl;
+}
+
+
+SimulationStreamServerItemImpl::~SimulationStreamServerItemImpl()
+{
+    stopListening();
+}
+
+
+Item* SimulationStreamServerItem::doDuplicate() const
+{
+    return new SimulationStreamServerItem(*this);
+}
+
+
+void SimulationStreamServerItem::setPort(int port)
+{
+    if(port != impl->port){
+        impl->port = port;
+        if(impl->server){
+            impl->stopListening();
+            impl->startListening();
+        }
+    }
+}
+
+
+int SimulationStreamServerItem::port() const
+{
+    return impl->port;
+}
+
+
+void SimulationStreamServerItem::setFrameRate(double rate)
+{
+    impl->frameRate = std::max(0.1, rate);
+}
+
+
+void SimulationStreamServerItem::setBandwidth(int bytesPerSecond)
+{
+    impl->bandwidth = std::max(0, bytesPerSecond);
+}
+
+
+void SimulationStreamServerItem::setContactStreamingEnabled(bool on)
+{
+    impl->isContactStreamingEnabled = on;
+}
+
+
+void SimulationStreamServerItem::setImageFrameRate(double rate)
+{
+    impl->imageFrameRate = std::max(0.0, rate);
+}
+
+
+void SimulationStreamServerItem::setImageDownscaleFactor(int factor)
+{
+    impl->imageDownscaleFactor = std::max(1, factor);
+}
+
+
+int SimulationStreamServerItem::numClients() const
+{
+    return impl->clients.size();
+}
+
+
+bool SimulationStreamServerItemImpl::startListening()
+{
+    if(server){
+        return true;
+    }
+    server = new QTcpServer;
+    if(!server->listen(QHostAddress::Any, port)){
+        mv->putln(format(_("{0} cannot listen on port {1}: {2}"),
+                         self->name(), port, server->errorString().toStdString()),
+                  MessageView::ERROR);
+        delete server;
+        server = nullptr;
+        return false;
+    }
+    QObject::connect(server, &QTcpServer::newConnection, [this](){ onNewConnection(); });
+    mv->putln(format(_("{0} is listening on port {1}."), self->name(), port));
+    return true;
+}
+
+
+void SimulationStreamServerItemImpl::stopListening()
+{
+    for(auto& client : clients){
+        client->socket->disconnect();
+        client->socket->abort();
+        client->socket->deleteLater();
+    }
+    clients.clear();
+    if(server){
+        server->close();
+        delete server;
+        server = nullptr;
+    }
+    updateImageCaptureFlag();
+}
+
+
+void SimulationStreamServerItemImpl::onNewConnection()
+{
+    while(QTcpSocket* socket = server->nextPendingConnection()){
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        auto client = new Client;
+        client->socket = socket;
+        client->requestedBandwidth = 0;
+        client->doSendImages = false;
+        client->tokens = 0.0;
+        client->lastRefillTime = Clock::now();
+        client->lastImageTime = client->lastRefillTime;
+        clients.emplace_back(client);
+
+        QObject::connect(socket, &QTcpSocket::readyRead, [this, client](){ onDataReceived(client); });
+        QObject::connect(socket, &QTcpSocket::disconnected, [this, client](){ removeClient(client); });
+
+        writer.begin(HELLO);
+        writer.writeString(magic);
+        writer.writeInt(protocolVersion);
+        writer.end();
+        send(client, writer.data);
+        if(!bodyListMessage.empty()){
+            send(client, bodyListMessage);
+        }
+
+        mv->putln(format(_("A viewer connected to {0} from {1}."),
+                         self->name(), socket->peerAddress().toString().toStdString()));
+    }
+}
+
+
+void SimulationStreamServerItemImpl::onDataReceived(Client* client)
+{
+    QByteArray data = client->socket->readAll();
+    auto& buf = client->receivedData;
+    buf.insert(buf.end(), data.constData(), data.constData() + data.size());
+
+    while(buf.size() >= 4){
+        MessageReader header(buf.data(), 4);
+        const uint32_t size = header.readInt();
+        if(size == 0 || size > maxMessageSize){
+            client->socket->abort();
+            return;
+        }
+        if(buf.size() < size + 4){
+            break;
+        }
+        MessageReader reader(buf.data() + 4, size);
+        try {
+            if(reader.readOctet() == STREAM_REQUEST){
+                client->requestedBandwidth = std::max(0, reader.readInt());
+                client->doSendImages = reader.readOctet();
+                updateImageCaptureFlag();
+            }
+        }
+        catch(const NotEnoughDataException&){
+            // The invalid message is ignored
+        }
+        buf.erase(buf.begin(), buf.begin() + size + 4);
+    }
+}
+
+
+void SimulationStreamServerItemImpl::removeClient(Client* client)
+{
+    for(auto p = clients.begin(); p != clients.end(); ++p){
+        if(p->get() == client){
+            client->socket->deleteLater();
+            clients.erase(p);
+            mv->putln(format(_("A viewer disconnected from {0}."), self->name()));
+            break;
+        }
+    }
+    updateImageCaptureFlag();
+}
+
+
+void SimulationStreamServerItemImpl::updateImageCaptureFlag()
+{
+    bool on = false;
+    if(imageFrameRate > 0.0){
+        for(auto& client : clients){
+            if(client->doSendImages){
+                on = true;
+                break;
+            }
+        }
+    }
+    doCaptureImages = on;
+}
+
+
+bool SimulationStreamServerItem::initializeSimulation(SimulatorItem* simulatorItem)
+{
+    return impl->initializeSimulation(simulatorItem);
+}
+
+
+bool SimulationStreamServerItemImpl::initializeSimulation(SimulatorItem* simulatorItem)
+{
+    if(!startListening()){
+        return false;
+    }
+
+    this->simulatorItem = simulatorItem;
+    bodies.clear();
+    cameraIndices.clear();
+    bodyIndexMap.clear();
+
+    // The precisions are fixed during the simulation because the clients decode the deltas with them
+    streamPrecisions[0] = static_cast<float>(translationPrecision);
+    streamPrecisions[1] = static_cast<float>(rotationPrecision);
+    streamPrecisions[2] = static_cast<float>(jointPositionPrecision);
+
+    writer.begin(BODY_LIST);
+    for(int i=0; i < 3; ++i){
+        writer.writeFloat(streamPrecisions[i]);
+    }
+    auto& simBodies = simulatorItem->simulationBodies();
+    writer.writeShort(simBodies.size());
+    for(auto& simBody : simBodies){
+        Body* body = simBody->body();
+        bodyIndexMap[body] = bodies.size();
+        bodies.push_back(body);
+        writer.writeString(body->name());
+        writer.writeShort(body->numJoints());
+        cameraIndices.emplace_back();
+        for(int i=0; i < body->numDevices(); ++i){
+            if(dynamic_cast<Camera*>(body->device(i))){
+                cameraIndices.back().push_back(i);
+            }
+        }
+    }
+    writer.end();
+    bodyListMessage = writer.data;
+
+    for(auto& client : clients){
+        client->keyframes.clear();
+        send(client.get(), bodyListMessage);
+    }
+
+    streamIntervalFrames = std::max(1, static_cast<int>(std::round(1.0 / (frameRate * simulatorItem->worldTimeStep()))));
+    frameCounter = streamIntervalFrames - 1;
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        hasNewSnapshot = false;
+    }
+
+    simulatorItem->addPostDynamicsFunction([&](){ capture(); });
+
+    return true;
+}
+
+
+/**
+   This function is called in the simulation thread. The captured state replaces the state which
+   has not been sent yet.
+*/
+void SimulationStreamServerItemImpl::capture()
+{
+    if(++frameCounter < streamIntervalFrames){
+        return;
+    }
+    frameCounter = 0;
+
+    const int numBodies = bodies.size();
+    captureBuf.time = simulatorItem->currentTime();
+    captureBuf.poses.resize(numBodies);
+    captureBuf.images.clear();
+    const bool doCaptureImages = this->doCaptureImages;
+
+    for(int i=0; i < numBodies; ++i){
+        Body* body = bodies[i];
+        const int nj = body->numJoints();
+        auto& pose = captureBuf.poses[i];
+        pose.resize(7 + nj);
+        const Position& T = body->rootLink()->T();
+        const Quat q(T.linear());
+        const Vector3 p = T.translation();
+        pose[0] = p.x();
+        pose[1] = p.y();
+        pose[2] = p.z();
+        pose[3] = q.w();
+        pose[4] = q.x();
+        pose[5] = q.y();
+        pose[6] = q.z();
+        for(int j=0; j < nj; ++j){
+            pose[7 + j] = body->joint(j)->q();
+        }
+        if(doCaptureImages){
+            for(auto& index : cameraIndices[i]){
+                auto camera = static_cast<Camera*>(body->device(index));
+                if(camera->sharedImage() && !camera->sharedImage()->empty()){
+                    captureBuf.images.push_back({ i, index, camera->sharedImage() });
+                }
+            }
+        }
+    }
+
+    if(isContactStreamingEnabled){
+        captureBuf.collisions = simulatorItem->currentCollisions();
+    } else {
+        captureBuf.collisions.reset();
+    }
+
+    bool doRequestSending = false;
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        std::swap(captureBuf, latestSnapshot);
+        hasNewSnapshot = true;
+        if(!isSendPending){
+            isSendPending = true;
+            doRequestSending = true;
+        }
+    }
+    if(doRequestSending){
+        // The item is kept until the sending is done
+        SimulationStreamServerItemPtr item = self;
+        callLater([this, item](){ sendLatestSnapshot(); });
+    }
+}
+
+
+void SimulationStreamServerItemImpl::sendLatestSnapshot()
+{
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        isSendPending = false;
+        if(!hasNewSnapshot){
+            return;
+        }
+        std::swap(latestSnapshot, sendingSnapshot);
+        hasNewSnapshot = false;
+    }
+
+    areImageMessagesReady = false;
+    const auto now = Clock::now();
+    for(auto& client : clients){
+        sendSnapshot(client.get(), now);
+    }
+}
+
+
+int SimulationStreamServerItemImpl::effectiveBandwidth(Client* client) const
+{
+    if(bandwidth == 0){
+        return client->requestedBandwidth;
+    } else if(client->requestedBandwidth == 0){
+        return bandwidth;
+    }
+    return std::min(bandwidth, client->requestedBandwidth);
+}
+
+
+/**
+   The frame is skipped when the data of the previous frames has not been sent yet or the client
+   has used up its bandwidth so that the client always receives the latest state.
+*/
+bool SimulationStreamServerItemImpl::sendSnapshot(Client* client, Clock::time_point now)
+{
+    const int limit = effectiveBandwidth(client);
+    if(limit > 0){
+        double dt = std::chrono::duration<double>(now - client->lastRefillTime).count();
+        // The burst is limited to the data for a half second
+        client->tokens = std::min(client->tokens + limit * dt, limit * 0.5);
+    }
+    client->lastRefillTime = now;
+
+    const qint64 maxQueueSize = (limit > 0) ? std::max(4096, limit / 10) : maxUnlimitedQueueSize;
+    if(client->socket->bytesToWrite() > maxQueueSize || (limit > 0 && client->tokens < 0.0)){
+        return false;
+    }
+
+    writePoseFrame(client);
+    send(client, writer.data);
+    if(sendingSnapshot.collisions){
+        writeContacts();
+        send(client, writer.data);
+    }
+
+    if(client->doSendImages && !sendingSnapshot.images.empty() && imageFrameRate > 0.0 &&
+       std::chrono::duration<double>(now - client->lastImageTime).count() >= 1.0 / imageFrameRate &&
+       (limit == 0 || client->tokens > 0.0)){
+        prepareImageMessages();
+        for(auto& message : imageMessages){
+            send(client, message);
+        }
+        client->lastImageTime = now;
+    }
+    return true;
+}
+
+
+void SimulationStreamServerItemImpl::writePoseFrame(Client* client)
+{
+    const int numBodies = sendingSnapshot.poses.size();
+    if(static_cast<int>(client->keyframes.size()) != numBodies){
+        client->keyframes.clear();
+        client->keyframes.resize(numBodies);
+        for(auto& keyframe : client->keyframes){
+            keyframe.numDeltaFrames = 0;
+        }
+    }
+
+    const double tp = streamPrecisions[0];
+    const double rp = streamPrecisions[1];
+    const double jp = streamPrecisions[2];
+    const double precisions[] = { tp, tp, tp, rp, rp, rp, rp, jp };
+
+    writer.begin(POSE_FRAME);
+    writer.writeFloat(sendingSnapshot.time);
+    writer.writeShort(numBodies);
+    for(int i=0; i < numBodies; ++i){
+        const auto& pose = sendingSnapshot.poses[i];
+        auto& keyframe = client->keyframes[i];
+        quantizingValues = pose;
+        if(keyframe.values.size() == pose.size()){
+            // q and -q are the same rotation and the one closer to the keyframe is quantized
+            const double* q = &pose[3];
+            const double* k = &keyframe.values[3];
+            if(q[0] * k[0] + q[1] * k[1] + q[2] * k[2] + q[3] * k[3] < 0.0){
+                for(int j=3; j < 7; ++j){
+                    quantizingValues[j] = -quantizingValues[j];
+                }
+            }
+        }
+        if(quantize(keyframe, precisions, 8)){
+            writer.writeOctet(POSE_DELTAS);
+            for(auto& delta : quantizedDeltas){
+                writer.writeVarInt(delta);
+            }
+        } else {
+            writer.writeOctet(POSE_KEYFRAME);
+            writer.writeShort(quantizingValues.size());
+            keyframe.values.resize(quantizingValues.size());
+            keyframe.numDeltaFrames = 0;
+            for(size_t j=0; j < quantizingValues.size(); ++j){
+                // The client refers to the float values as the keyframe
+                const float value = quantizingValues[j];
+                keyframe.values[j] = value;
+                writer.writeFloat(value);
+            }
+        }
+    }
+    writer.end();
+}
+
+
+/**
+   The values after the seventh one are quantized with the last precision.
+*/
+bool SimulationStreamServerItemImpl::quantize(KeyframeState& keyframe, const double* precisions, int numPrecisions)
+{
+    const int n = quantizingValues.size();
+    if(static_cast<int>(keyframe.values.size()) != n || keyframe.numDeltaFrames >= keyframeInterval){
+        return false;
+    }
+    quantizedDeltas.resize(n);
+    for(int i=0; i < n; ++i){
+        const double precision = precisions[std::min(i, numPrecisions - 1)];
+        const double delta = std::round((quantizingValues[i] - keyframe.values[i]) / precision);
+        if(std::abs(delta) > maxQuantizedDelta){
+            return false;
+        }
+        quantizedDeltas[i] = static_cast<int>(delta);
+    }
+    ++keyframe.numDeltaFrames;
+    return true;
+}
+
+
+void SimulationStreamServerItemImpl::writeContacts()
+{
+    writer.begin(CONTACTS);
+    const int numPairsPos = writer.data.size();
+    writer.writeShort(0);
+    int numPairs = 0;
+    for(auto& linkPair : *sendingSnapshot.collisions){
+        if(linkPair->collisions.empty()){
+            continue;
+        }
+        for(int i=0; i < 2; ++i){
+            int bodyIndex = -1;
+            int linkIndex = -1;
+            auto p = bodyIndexMap.find(linkPair->body[i]);
+            if(p != bodyIndexMap.end() && linkPair->link[i]){
+                bodyIndex = p->second;
+                linkIndex = linkPair->link[i]->index();
+            }
+            writer.writeShort(bodyIndex);
+            writer.writeShort(linkIndex);
+        }
+        const int numCollisions = std::min(static_cast<int>(linkPair->collisions.size()), 0x7fff);
+        writer.writeShort(numCollisions);
+        for(int i=0; i < numCollisions; ++i){
+            auto& c = linkPair->collisions[i];
+            for(int j=0; j < 3; ++j){
+                writer.writeFloat(c.point[j]);
+            }
+            for(int j=0; j < 3; ++j){
+                writer.writeFloat(c.normal[j]);
+            }
+            writer.writeFloat(c.depth);
+        }
+        if(++numPairs == 0x7fff){
+            break;
+        }
+    }
+    writer.data[numPairsPos] = numPairs & 0xff;
+    writer.data[numPairsPos + 1] = (numPairs >> 8) & 0xff;
+    writer.end();
+}
+
+
+/**
+   The images are downscaled by averaging the pixels and compressed once for all the clients.
+*/
+void SimulationStreamServerItemImpl::prepareImageMessages()
+{
+    if(areImageMessagesReady){
+        return;
+    }
+    namespace io = boost::iostreams;
+
+    imageMessages.resize(sendingSnapshot.images.size());
+    vector<unsigned char> pixels;
+    const int f = imageDownscaleFactor;
+
+    for(size_t i=0; i < sendingSnapshot.images.size(); ++i){
+        auto& snapshot = sendingSnapshot.images[i];
+        const Image& image = *snapshot.image;
+        const int width = std::max(1, image.width() / f);
+        const int height = std::max(1, image.height() / f);
+        const int nc = image.numComponents();
+        const int bw = std::min(f, image.width());
+        const int bh = std::min(f, image.height());
+        pixels.resize(width * height * nc);
+        const unsigned char* src = image.pixels();
+        unsigned char* dest = pixels.data();
+        for(int y=0; y < height; ++y){
+            for(int x=0; x < width; ++x){
+                for(int c=0; c < nc; ++c){
+                    int sum = 0;
+                    for(int v=0; v < bh; ++v){
+                        const unsigned char* row = src + ((y * bh + v) * image.width() + x * bw) * nc + c;
+                        for(int u=0; u < bw; ++u){
+                            sum += row[u * nc];
+                        }
+                    }
+                    *dest++ = sum / (bw * bh);
+                }
+            }
+        }
+
+        writer.begin(IMAGE);
+        writer.writeShort(snapshot.bodyIndex);
+        writer.writeShort(snapshot.deviceIndex);
+        writer.writeShort(width);
+        writer.writeShort(height);
+        writer.writeOctet(nc);
+        writer.writeInt(pixels.size());
+        {
+            io::filtering_ostream out;
+            out.push(io::zlib_compressor(io::zlib::best_speed));
+            out.push(io::back_inserter(writer.data));
+            out.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+        }
+        writer.end();
+        imageMessages[i].swap(writer.data);
+    }
+    areImageMessagesReady = true;
+}
+
+
+void SimulationStreamServerItemImpl::send(Client* client, const vector<char>& data)
+{
+    client->socket->write(data.data(), data.size());
+    client->tokens -= data.size();
+}
+
+
+void SimulationStreamServerItem::finalizeSimulation()
+{
+    impl->finalizeSimulation();
+}
+
+
+void SimulationStreamServerItemImpl::finalizeSimulation()
+{
+    // The final state is sent even if the sending has not been requested yet
+    sendLatestSnapshot();
+    simulatorItem = nullptr;
+    bodies.clear();
+}
+
+
+void SimulationStreamServerItem::doPutProperties(PutPropertyFunction& putProperty)
+{
+    SubSimulatorItem::doPutProperties(putProperty);
+    impl->doPutProperties(putProperty);
+}
+
+
+void SimulationStreamServerItemImpl::doPutProperties(PutPropertyFunction& putProperty)
+{
+    putProperty.min(1).max(65535)(_("Port"), port,
+                                  [&](int value){ self->setPort(value); return true; });
+    putProperty.min(0.1)(_("Frame rate"), frameRate,
+                         [&](double value){ self->setFrameRate(value); return true; });
+    putProperty.min(0)(_("Bandwidth [KB/s]"), bandwidth / 1024,
+                       [&](int value){ self->setBandwidth(value * 1024); return true; });
+    putProperty.reset();
+    putProperty(_("Contacts"), isContactStreamingEnabled, changeProperty(isContactStreamingEnabled));
+    putProperty.min(0.0)(_("Image frame rate"), imageFrameRate,
+                         [&](double value){ self->setImageFrameRate(value); updateImageCaptureFlag(); return true; });
+    putProperty.min(1)(_("Image downscale factor"), imageDownscaleFactor,
+                       [&](int value){ self->setImageDownscaleFactor(value); return true; });
+    putProperty.reset();
+    putProperty.decimals(6).min(1.0e-6);
+    putProperty(_("Translation precision"), translationPrecision, changeProperty(translationPrecision));
+    putProperty(_("Rotation precision"), rotationPrecision, changeProperty(rotationPrecision));
+    putProperty(_("Joint position precision"), jointPositionPrecision, changeProperty(jointPositionPrecision));
+    putProperty.reset();
+    putProperty(_("Clients"), static_cast<int>(clients.size()));
+}
+
+
+bool SimulationStreamServerItem::store(Archive& archive)
+{
+    SubSimulatorItem::store(archive);
+    return impl->store(archive);
+}
+
+
+bool SimulationStreamServerItemImpl::store(Archive& archive)
+{
+    archive.write("port", port);
+    archive.write("frameRate", frameRate);
+    archive.write("bandwidth", bandwidth);
+    archive.write("contacts", isContactStreamingEnabled);
+    archive.write("imageFrameRate", imageFrameRate);
+    archive.write("imageDownscaleFactor", imageDownscaleFactor);
+    archive.write("translationPrecision", translationPrecision);
+    archive.write("rotationPrecision", rotationPrecision);
+    archive.write("jointPositionPrecision", jointPositionPrecision);
+    return true;
+}
+
+
+bool SimulationStreamServerItem::restore(const Archive& archive)
+{
+    SubSimulatorItem::restore(archive);
+    return impl->restore(archive);
+}
+
+
+bool SimulationStreamServerItemImpl::restore(const Archive& archive)
+{
+    archive.read("port", port);
+    archive.read("frameRate", frameRate);
+    archive.read("bandwidth", bandwidth);
+    archive.read("contacts", isContactStreamingEnabled);
+    archive.read("imageFrameRate", imageFrameRate);
+    archive.read("imageDownscaleFactor", imageDownscaleFactor);
+    archive.read("translationPrecision", translationPrecision);
+    archive.read("rotationPrecision", rotationPrecision);
+    archive.read("jointPositionPrecision", jointPositionPrecision);
+    return true;
+}
@@ -0,0 +1,72 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_BODYPLUGIN_SIMULATION_STREAM_SERVER_ITEM_H
+#define CNOID_BODYPLUGIN_SIMULATION_STREAM_SERVER_ITEM_H
+
+#include "SubSimulatorItem.h"
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class SimulationStreamServerItemImpl;
+
+/**
+   This item streams the states of a simulation to the remote viewers, which are
+   SimulationStreamClientItems of the Choreonoid processes loading the same models, over TCP.
+   The poses of the bodies are sent as the quantized deltas from the keyframes, and the contacts
+   and the downscaled camera images are optionally sent. Only the latest state is sent to a client
+   when the client cannot receive every frame within its bandwidth, so that the viewer is not
+   delayed by the network.
+*/
+class CNOID_EXPORT SimulationStreamServerItem : public SubSimulatorItem
+{
+public:
+    static void initializeClass(ExtensionManager* ext);
+
+    SimulationStreamServerItem();
+    SimulationStreamServerItem(const SimulationStreamServerItem& org);
+    ~SimulationStreamServerItem();
+
+    //! The server starts listening when a simulation is initialized
+    void setPort(int port);
+    int port() const;
+
+    //! The maximum frame rate of the streamed states in the simulation time
+    void setFrameRate(double rate);
+
+    /**
+       The maximum number of bytes per second sent to each client.
+       A client can request a smaller bandwidth. Zero means no limit, which is the default.
+    */
+    void setBandwidth(int bytesPerSecond);
+
+    void setContactStreamingEnabled(bool on);
+
+    //! The images of the cameras are sent at this frame rate in the wall-clock time
+    void setImageFrameRate(double rate);
+
+    //! The images are downscaled by this factor. The default value is 4.
+    void setImageDownscaleFactor(int factor);
+
+    int numClients() const;
+
+    virtual bool initializeSimulation(SimulatorItem* simulatorItem);
+    virtual void finalizeSimulation();
+
+protected:
+    virtual Item* doDuplicate() const;
+    virtual void doPutProperties(PutPropertyFunction& putProperty);
+    virtual bool store(Archive& archive);
+    virtual bool restore(const Archive& archive);
+
+private:
+    SimulationStreamServerItemImpl* impl;
+};
+
+typedef ref_ptr<SimulationStreamServerItem> SimulationStreamServerItemPtr;
+
+}
+
+#endif
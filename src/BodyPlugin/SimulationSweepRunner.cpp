@@ -0,0 +1,810 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#include "SimulationSweepRunner.h"
+#include "SimulatorItem.h"
+#include "WorldItem.h"
+#include "BodyItem.h"
+#include <cnoid/RootItem>
+#include <cnoid/ItemList>
+#include <cnoid/PutPropertyFunction>
+#include <cnoid/MessageView>
+#include <cnoid/OptionManager>
+#include <cnoid/ExtensionManager>
+#include <cnoid/BodyState>
+#include <cnoid/EigenUtil>
+#include <QGuiApplication>
+#include <fmt/format.h>
+#include <boost/algorithm/string.hpp>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "gettext.h"
+
+using namespace std;
+using namespace cnoid;
+using fmt::format;
+
+namespace {
+
+/**
+   This gets the value of a property as a string and sets a new value with the change function of the
+   property, which is given to the same function object by Item::putProperties.
+*/
+class PropertyAccessor : public PutPropertyFunction
+{
+public:
+    string name;
+    string newValue;
+    bool doSet;
+    bool isFound;
+    bool isSet;
+    string value;
+    string error;
+
+    PropertyAccessor(const string& name)
+        : name(name), doSet(false), isFound(false), isSet(false) { }
+
+    PropertyAccessor(const string& name, const string& newValue)
+        : name(name), newValue(newValue), doSet(true), isFound(false), isSet(false) { }
+
+    virtual PutPropertyFunction& decimals(int) { return *this; }
+    virtual PutPropertyFunction& min(double) { return *this; }
+    virtual PutPropertyFunction& max(double) { return *this; }
+    virtual PutPropertyFunction& min(int) { return *this; }
+    virtual PutPropertyFunction& max(int) { return *this; }
+    virtual PutPropertyFunction& reset() { return *this; }
+
+    static string toString(bool v) { return v ? "true" : "false"; }
+    static string toString(int v) { return std::to_string(v); }
+    static string toString(double v) { return format("{}", v); }
+    static string toString(const string& v) { return v; }
+
+    static bool parse(const string& s, bool& out) {
+        if(s == "true" || s == "1"){
+            out = true;
+        } else if(s == "false" || s == "0"){
+            out = false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    static bool parse(const string& s, int& out) {
+        char* end;
+        out = strtol(s.c_str(), &end, 10);
+        return !s.empty() && *end == '\0';
+    }
+    static bool parse(const string& s, double& out) {
+        char* end;
+        out = strtod(s.c_str(), &end);
+        return !s.empty() && *end == '\0';
+    }
+    static bool parse(const string& s, string& out) {
+        out = s;
+        return true;
+    }
+
+    template<class T, class ValueType>
+    void access(const string& name_, const ValueType& value_, std::function<bool(const T& v)> apply) {
+        if(isFound || name_ != name){
+            return;
+        }
+        isFound = true;
+        value = toString(value_);
+        if(doSet){
+            T v;
+            if(!parse(newValue, v)){
+                error = format(_("\"{0}\" is not a valid value of \"{1}\""), newValue, name);
+            } else if(!apply){
+                error = format(_("\"{}\" is read-only"), name);
+            } else if(!apply(v)){
+                error = format(_("\"{0}\" of \"{1}\" is rejected"), newValue, name);
+            } else {
+                isSet = true;
+            }
+        }
+    }
+
+    template<class T>
+    void put(const string& name_, const T& value_) {
+        access<T>(name_, value_, nullptr);
+    }
+    template<class T, class ArgType>
+    void put(const string& name_, const T& value_, const std::function<bool(ArgType)>& func) {
+        access<T>(name_, value_, [&](const T& v){ return func(v); });
+    }
+    template<class T, class ArgType>
+    void put(const string& name_, const T& value_, const std::function<void(ArgType)>& func) {
+        access<T>(name_, value_, [&](const T& v){ func(v); return true; });
+    }
+
+    virtual void operator()(const string& name, bool value) { put(name, value); }
+    virtual void operator()(const string& name, bool value, const std::function<bool(bool)>& func) {
+        put(name, value, func);
+    }
+    virtual void operator()(const string& name, bool value, const std::function<void(bool)>& func, bool) {
+        put(name, value, func);
+    }
+    virtual void operator()(const string& name, int value) { put(name, value); }
+    virtual void operator()(const string& name, int value, const std::function<bool(int)>& func) {
+        put(name, value, func);
+    }
+    virtual void operator()(const string& name, int value, const std::function<void(int)>& func, bool) {
+        put(name, value, func);
+    }
+    virtual void operator()(const string& name, double value) { put(name, value); }
+    virtual void operator()(const string& name, double value, const std::function<bool(double)>& func) {
+        put(name, value, func);
+    }
+    virtual void operator()(const string& name, double value, const std::function<void(double)>& func, bool) {
+        put(name, value, func);
+    }
+    virtual void operator()(const string& name, const string& value) { put(name, value); }
+    virtual void operator()(const string& name, const string& value,
+                            const std::function<bool(const string&)>& func) {
+        put(name, value, func);
+    }
+    virtual void operator()(const string& name, const string& value,
+                            const std::function<void(const string&)>& func, bool) {
+        put(name, value, func);
+    }
+
+    // A selection is given by its symbol or index
+    static string toString(const Selection& selection) {
+        auto symbol = selection.selectedSymbol();
+        return symbol ? symbol : "";
+    }
+    static int toIndex(const Selection& selection, const string& s) {
+        int index = selection.index(s);
+        if(index < 0){
+            int i;
+            if(parse(s, i) && i >= 0 && i < selection.size()){
+                index = i;
+            }
+        }
+        return index;
+    }
+    virtual void operator()(const string& name, const Selection& selection) {
+        put(name, toString(selection));
+    }
+    virtual void operator()(const string& name, const Selection& selection,
+                            const std::function<bool(int which)>& func) {
+        access<string>(name, toString(selection), [&](const string& v){
+                int index = toIndex(selection, v);
+                return index >= 0 && func(index); });
+    }
+    virtual void operator()(const string& name, const Selection& selection,
+                            const std::function<void(int which)>& func, bool) {
+        access<string>(name, toString(selection), [&](const string& v){
+                int index = toIndex(selection, v);
+                if(index < 0){
+                    return false;
+                }
+                func(index);
+                return true; });
+    }
+
+    virtual void operator()(const string& name, const FilePathProperty& filepath) {
+        put(name, filepath.filename());
+    }
+    virtual void operator()(const string& name, const FilePathProperty& filepath,
+                            const std::function<bool(const string&)>& func) {
+        put(name, filepath.filename(), func);
+    }
+    virtual void operator()(const string& name, const FilePathProperty& filepath,
+                            const std::function<void(const string&)>& func, bool) {
+        put(name, filepath.filename(), func);
+    }
+};
+
+enum ColumnType { ITEM_PROPERTY, INITIAL_POSITION, LINK_MASS };
+
+struct Column
+{
+    string label;
+    ItemPtr item;
+    BodyItemPtr bodyItem;
+    ColumnType type;
+    string property;
+    string originalValue;
+    BodyState originalState;
+    Link* link;
+    double originalMass;
+    Matrix3 originalInertia;
+};
+
+struct RunResult
+{
+    bool isStarted;
+    double simulationTime;
+    double elapsedTime;
+    vector<Vector3> rootPositions;
+    vector<bool> isRootPositionValid;
+};
+
+string escapeCell(string text)
+{
+    std::replace(text.begin(), text.end(), ',', ';');
+    std::replace(text.begin(), text.end(), '\n', ' ');
+    return text;
+}
+
+}
+
+namespace cnoid {
+
+class SimulationSweepRunnerImpl
+{
+public:
+    SimulatorItemPtr simulatorItem;
+    double timeLength;
+    int numWorkers;
+    vector<Column> columns;
+    vector<vector<string>> rows;
+    ItemList<BodyItem> bodyItems;
+    MessageView* mv;
+
+    SimulationSweepRunnerImpl();
+    bool loadTable(const string& filename);
+    bool initializeColumn(Column& column);
+    bool applyValue(Column& column, const string& value, string& out_error);
+    bool applyRow(const vector<string>& row, string& out_error);
+    void restoreOriginalValues();
+    void runSimulation(RunResult& result);
+    string runRow(int index);
+    void runRows(int worker, int numWorkers, ostream& os);
+    bool run(const string& outputFilename);
+    bool canForkWorkers();
+    bool runWorkers(const string& outputFilename, vector<string>& out_results);
+    string header() const;
+    string unfinishedRow(int index) const;
+};
+
+}
+
+
+static void onSigOptionsParsedAfterProjectLoading(boost::program_options::variables_map& v)
+{
+    if(v.count("simulation-sweep")){
+        SimulationSweepRunner runner;
+        if(v.count("simulation-sweep-simulator")){
+            const string path = v["simulation-sweep-simulator"].as<string>();
+            auto simulatorItem = dynamic_cast<SimulatorItem*>(Item::find(path));
+            if(!simulatorItem){
+                MessageView::instance()->putln(
+                    format(_("Simulator item \"{}\" is not found."), path), MessageView::ERROR);
+                return;
+            }
+            runner.setSimulatorItem(simulatorItem);
+        }
+        runner.setTimeLength(v["simulation-sweep-time"].as<double>());
+        runner.setNumWorkers(v["simulation-sweep-workers"].as<int>());
+        if(runner.loadTable(v["simulation-sweep"].as<string>())){
+            runner.run(v["simulation-sweep-output"].as<string>());
+        }
+    }
+}
+
+
+void SimulationSweepRunner::initialize(ExtensionManager* ext)
+{
+    static bool initialized = false;
+    if(!initialized){
+        OptionManager& om = ext->optionManager();
+        om.addOption("simulation-sweep", boost::program_options::value<string>(),
+                     "run a batch simulation for each row of a CSV table of the item property values");
+        om.addOption("simulation-sweep-output",
+                     boost::program_options::value<string>()->default_value("simulation-sweep.csv"),
+                     "CSV file to which the results of the simulation sweep are written");
+        om.addOption("simulation-sweep-workers", boost::program_options::value<int>()->default_value(1),
+                     "number of the worker processes forked for the simulation sweep");
+        om.addOption("simulation-sweep-time", boost::program_options::value<double>()->default_value(10.0),
+                     "simulation time of each row of the simulation sweep");
+        om.addOption("simulation-sweep-simulator", boost::program_options::value<string>(),
+                     "path of the simulator item used in the simulation sweep");
+        om.sigOptionsParsed(1).connect(onSigOptionsParsedAfterProjectLoading);
+        initialized = true;
+    }
+}
+
+
+SimulationSweepRunner::SimulationSweepRunner()
+{
+    impl = new SimulationSweepRunnerImpl;
+}
+
+
+SimulationSweepRunnerImpl::SimulationSweepRunnerImpl()
+{
+    timeLength = 10.0;
+    numWorkers = 1;
+    mv = MessageView::instance();
+}
+
+
+SimulationSweepRunner::~SimulationSweepRunner()
+{
+    delete impl;
+}
+
+
+void SimulationSweepRunner::setSimulatorItem(SimulatorItem* simulatorItem)
+{
+    impl->simulatorItem = simulatorItem;
+}
+
+
+void SimulationSweepRunner::setTimeLength(double length)
+{
+    impl->timeLength = length;
+}
+
+
+void SimulationSweepRunner::setNumWorkers(int n)
+{
+    impl->numWorkers = std::max(1, n);
+}
+
+
+bool SimulationSweepRunner::loadTable(const std::string& filename)
+{
+    return impl->loadTable(filename);
+}
+
+
+static vector<string> splitCells(const string& line)
+{
+    vector<string> cells;
+    boost::split(cells, line, boost::is_any_of(","));
+    for(auto& cell : cells){
+        boost::trim(cell);
+    }
+    return cells;
+}
+
+
+bool SimulationSweepRunnerImpl::loadTable(const string& filename)
+{
+    columns.clear();
+    rows.clear();
+
+    ifstream ifs(filename.c_str());
+    if(!ifs){
+        mv->putln(format(_("\"{}\" cannot be opened."), filename), MessageView::ERROR);
+        return false;
+    }
+
+    string line;
+    int lineNumber = 0;
+    while(getline(ifs, line)){
+        ++lineNumber;
+        boost::trim(line);
+        if(line.empty() || line[0] == '#'){
+            continue;
+        }
+        auto cells = splitCells(line);
+        if(columns.empty()){
+            for(auto& label : cells){
+                Column column;
+                column.label = label;
+                if(!initializeColumn(column)){
+                    columns.clear();
+                    return false;
+                }
+                columns.push_back(column);
+            }
+        } else if(cells.size() != columns.size()){
+            mv->putln(format(_("Line {0} of \"{1}\" does not have {2} values."),
+                             lineNumber, filename, columns.size()), MessageView::ERROR);
+            return false;
+        } else {
+            rows.push_back(cells);
+        }
+    }
+
+    if(columns.empty()){
+        mv->putln(format(_("\"{}\" does not have the header line."), filename), MessageView::ERROR);
+        return false;
+    }
+
+    return true;
+}
+
+
+bool SimulationSweepRunnerImpl::initializeColumn(Column& column)
+{
+    auto pos = column.label.find(':');
+    if(pos == string::npos){
+        mv->putln(format(_("Column \"{}\" is not in the form of \"<item path>:<property name>\"."),
+                         column.label), MessageView::ERROR);
+        return false;
+    }
+    const string path = column.label.substr(0, pos);
+    column.property = column.label.substr(pos + 1);
+    column.item = Item::find(path);
+    if(!column.item){
+        mv->putln(format(_("Item \"{}\" is not found."), path), MessageView::ERROR);
+        return false;
+    }
+    column.bodyItem = dynamic_cast<BodyItem*>(column.item.get());
+    column.type = ITEM_PROPERTY;
+    column.link = nullptr;
+
+    if(column.bodyItem){
+        auto body = column.bodyItem->body();
+        if(column.property == "Initial position"){
+            column.type = INITIAL_POSITION;
+            column.bodyItem->getInitialState(column.originalState);
+            Position T;
+            if(!column.originalState.getRootLinkPosition(T)){
+                column.originalState.storePositions(*body);
+            }
+            return true;
+        }
+        static const string linkMassPrefix = "Link mass:";
+        if(column.property.compare(0, linkMassPrefix.size(), linkMassPrefix) == 0){
+            const string linkName = column.property.substr(linkMassPrefix.size());
+            column.type = LINK_MASS;
+            column.link = body->link(linkName);
+            if(!column.link){
+                mv->putln(format(_("Link \"{0}\" of \"{1}\" is not found."), linkName, path),
+                          MessageView::ERROR);
+                return false;
+            }
+            column.originalMass = column.link->m();
+            column.originalInertia = column.link->I();
+            return true;
+        }
+    }
+
+    PropertyAccessor accessor(column.property);
+    column.item->putProperties(accessor);
+    if(!accessor.isFound){
+        mv->putln(format(_("Item \"{0}\" does not have property \"{1}\"."), path, column.property),
+                  MessageView::ERROR);
+        return false;
+    }
+    column.originalValue = accessor.value;
+
+    return true;
+}
+
+
+bool SimulationSweepRunnerImpl::applyValue(Column& column, const string& value, string& out_error)
+{
+    if(column.type == INITIAL_POSITION){
+        if(value.empty()){
+            column.bodyItem->setInitialState(column.originalState);
+            return true;
+        }
+        double v[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+        istringstream is(value);
+        int n = 0;
+        while(n < 6 && (is >> v[n])){
+            ++n;
+        }
+        if((n != 3 && n != 6) || !is.eof()){
+            out_error = format(_("\"{0}\" is not a valid value of \"{1}\""), value, column.label);
+            return false;
+        }
+        BodyState state = column.originalState;
+        Position T;
+        state.getRootLinkPosition(T);
+        T.translation() << v[0], v[1], v[2];
+        if(n == 6){
+            T.linear() = rotFromRpy(radian(v[3]), radian(v[4]), radian(v[5]));
+        }
+        state.setRootLinkPosition(T);
+        column.bodyItem->setInitialState(state);
+        return true;
+    }
+
+    if(column.type == LINK_MASS){
+        double m = column.originalMass;
+        if(!value.empty() && !PropertyAccessor::parse(value, m)){
+            out_error = format(_("\"{0}\" is not a valid value of \"{1}\""), value, column.label);
+            return false;
+        }
+        // The inertia tensor is scaled with the mass to keep the mass distribution
+        column.link->setMass(m);
+        if(column.originalMass > 0.0){
+            column.link->setInertia(column.originalInertia * (m / column.originalMass));
+        }
+        return true;
+    }
+
+    PropertyAccessor accessor(column.property, value.empty() ? column.originalValue : value);
+    column.item->putProperties(accessor);
+    if(!accessor.isSet){
+        out_error = accessor.isFound ? accessor.error : format(_("\"{}\" is not found"), column.label);
+        return false;
+    }
+    return true;
+}
+
+
+bool SimulationSweepRunnerImpl::applyRow(const vector<string>& row, string& out_error)
+{
+    for(size_t i=0; i < columns.size(); ++i){
+        if(!applyValue(columns[i], row[i], out_error)){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void SimulationSweepRunnerImpl::restoreOriginalValues()
+{
+    string error;
+    for(auto& column : columns){
+        applyValue(column, string(), error);
+    }
+}
+
+
+void SimulationSweepRunnerImpl::runSimulation(RunResult& result)
+{
+    const int numBodies = bodyItems.size();
+    vector<SimulationBody*> simBodies(numBodies, nullptr);
+    result.rootPositions.assign(numBodies, Vector3::Zero());
+    result.isRootPositionValid.assign(numBodies, false);
+
+    ScopedConnection connection(
+        simulatorItem->sigSimulationStarted().connect(
+            [&](){
+                for(int i=0; i < numBodies; ++i){
+                    simBodies[i] = simulatorItem->findSimulationBody(bodyItems[i]);
+                    result.isRootPositionValid[i] = (simBodies[i] != nullptr);
+                }
+                simulatorItem->addPostDynamicsFunction(
+                    [&](){
+                        for(int i=0; i < numBodies; ++i){
+                            if(simBodies[i]){
+                                result.rootPositions[i] = simBodies[i]->body()->rootLink()->p();
+                            }
+                        }
+                    });
+            }));
+
+    auto startTime = std::chrono::steady_clock::now();
+    result.isStarted = simulatorItem->runBatchSimulation(true);
+    result.elapsedTime =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    result.simulationTime = simulatorItem->simulationTime();
+}
+
+
+string SimulationSweepRunnerImpl::runRow(int index)
+{
+    const auto& row = rows[index];
+    string status;
+    RunResult result;
+    string error;
+    if(!applyRow(row, error)){
+        status = escapeCell(error);
+    } else {
+        runSimulation(result);
+        status = result.isStarted ? "ok" : "not started";
+    }
+
+    string line = format("{},{}", index, status);
+    if(result.isStarted && status == "ok"){
+        line += format(",{},{}", result.simulationTime, result.elapsedTime);
+    } else {
+        line += ",,";
+    }
+    for(auto& value : row){
+        line += "," + value;
+    }
+    for(size_t i=0; i < bodyItems.size(); ++i){
+        if(result.isStarted && result.isRootPositionValid[i]){
+            auto& p = result.rootPositions[i];
+            line += format(",{},{},{}", p.x(), p.y(), p.z());
+        } else {
+            line += ",,,";
+        }
+    }
+    return line;
+}
+
+
+void SimulationSweepRunnerImpl::runRows(int worker, int numWorkers, ostream& os)
+{
+    for(size_t i = worker; i < rows.size(); i += numWorkers){
+        // Each row is flushed so that the finished rows are kept when a later run crashes
+        os << runRow(i) << endl;
+    }
+}
+
+
+string SimulationSweepRunnerImpl::header() const
+{
+    string line = "row,status,simulationTime,elapsedTime";
+    for(auto& column : columns){
+        line += "," + column.label;
+    }
+    for(auto& bodyItem : bodyItems){
+        auto& name = bodyItem->name();
+        line += format(",{0}.x,{0}.y,{0}.z", name);
+    }
+    return line;
+}
+
+
+string SimulationSweepRunnerImpl::unfinishedRow(int index) const
+{
+    string line = format("{},not finished,,", index);
+    for(auto& value : rows[index]){
+        line += "," + value;
+    }
+    for(size_t i=0; i < bodyItems.size(); ++i){
+        line += ",,,";
+    }
+    return line;
+}
+
+
+bool SimulationSweepRunner::run(const std::string& outputFilename)
+{
+    return impl->run(outputFilename);
+}
+
+
+bool SimulationSweepRunnerImpl::run(const string& outputFilename)
+{
+    if(!simulatorItem){
+        ItemList<SimulatorItem> simulators;
+        simulators.extractChildItems(RootItem::instance());
+        if(simulators.empty()){
+            mv->putln(_("There is no simulator item."), MessageView::ERROR);
+            return false;
+        }
+        simulatorItem = simulators.front();
+    }
+    auto worldItem = simulatorItem->worldItem();
+    if(!worldItem){
+        mv->putln(format(_("Simulator item \"{}\" is not in a world item."), simulatorItem->name()),
+                  MessageView::ERROR);
+        return false;
+    }
+
+    if(simulatorItem->isRunning()){
+        simulatorItem->stopSimulation();
+    }
+    simulatorItem->setTimeRangeMode(SimulatorItem::TR_SPECIFIED);
+    simulatorItem->setSpecifiedRecordingTimeLength(timeLength);
+    simulatorItem->setRealtimeSyncMode(false);
+
+    bodyItems.clear();
+    ItemList<BodyItem> allBodyItems;
+    allBodyItems.extractChildItems(worldItem);
+    for(auto& bodyItem : allBodyItems){
+        if(!bodyItem->body()->isStaticModel()){
+            bodyItems.push_back(bodyItem);
+        }
+    }
+
+    ofstream ofs(outputFilename.c_str());
+    if(!ofs){
+        mv->putln(format(_("\"{}\" cannot be opened."), outputFilename), MessageView::ERROR);
+        return false;
+    }
+    ofs << header() << "\n";
+
+    mv->putln(format(_("Simulation sweep of {0} rows with \"{1}\" is started."),
+                     rows.size(), simulatorItem->name()));
+
+    if(numWorkers > 1 && rows.size() > 1 && canForkWorkers()){
+        vector<string> results;
+        runWorkers(outputFilename, results);
+        for(auto& line : results){
+            ofs << line << "\n";
+        }
+    } else {
+        runRows(0, 1, ofs);
+        restoreOriginalValues();
+    }
+
+    mv->putln(format(_("Simulation sweep is finished and the results are written to \"{}\"."),
+                     outputFilename));
+
+    return ofs.good();
+}
+
+
+bool SimulationSweepRunnerImpl::canForkWorkers()
+{
+#ifdef _WIN32
+    mv->putln(_("The simulation sweep is run in a single process because fork is not available."),
+              MessageView::WARNING);
+    return false;
+#else
+    /*
+      A forked child must not use the connection to the window system shared with the parent,
+      which is not used by the offscreen and minimal platforms.
+    */
+    auto platform = QGuiApplication::platformName();
+    if(platform != "offscreen" && platform != "minimal"){
+        mv->putln(format(_("The simulation sweep is run in a single process because the workers cannot be "
+                           "forked with the \"{}\" platform. Set QT_QPA_PLATFORM=offscreen to fork them."),
+                         platform.toStdString()), MessageView::WARNING);
+        return false;
+    }
+    return true;
+#endif
+}
+
+
+bool SimulationSweepRunnerImpl::runWorkers(const string& outputFilename, vector<string>& out_results)
+{
+    out_results.clear();
+
+#ifndef _WIN32
+    const int n = std::min(numWorkers, static_cast<int>(rows.size()));
+    vector<pid_t> pids;
+    vector<string> workerFilenames;
+
+    std::fflush(nullptr);
+    for(int i=0; i < n; ++i){
+        const string workerFilename = format("{}.worker{}", outputFilename, i);
+        pid_t pid = fork();
+        if(pid == 0){
+            // The child shares the loaded project and models with the parent by copy-on-write
+            int status = 1;
+            {
+                ofstream ofs(workerFilename.c_str());
+                if(ofs){
+                    runRows(i, n, ofs);
+                    status = ofs.good() ? 0 : 1;
+                }
+            }
+            _exit(status);
+        } else if(pid < 0){
+            mv->putln(format(_("Simulation sweep worker {} cannot be forked."), i), MessageView::ERROR);
+        } else {
+            pids.push_back(pid);
+            workerFilenames.push_back(workerFilename);
+        }
+    }
+
+    for(size_t i=0; i < pids.size(); ++i){
+        int status;
+        if(waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+            mv->putln(format(_("Simulation sweep worker {} did not finish normally."), i),
+                      MessageView::WARNING);
+        }
+    }
+
+    vector<string> results(rows.size());
+    for(auto& filename : workerFilenames){
+        ifstream ifs(filename.c_str());
+        string line;
+        while(getline(ifs, line)){
+            char* end;
+            long index = strtol(line.c_str(), &end, 10);
+            if(*end == ',' && index >= 0 && index < static_cast<long>(rows.size())){
+                results[index] = line;
+            }
+        }
+        ifs.close();
+        std::remove(filename.c_str());
+    }
+    for(size_t i=0; i < rows.size(); ++i){
+        out_results.push_back(results[i].empty() ? unfinishedRow(i) : results[i]);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
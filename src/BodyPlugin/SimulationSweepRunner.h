@@ -0,0 +1,50 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_BODYPLUGIN_SIMULATION_SWEEP_RUNNER_H
+#define CNOID_BODYPLUGIN_SIMULATION_SWEEP_RUNNER_H
+
+#include <string>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class ExtensionManager;
+class SimulatorItem;
+class SimulationSweepRunnerImpl;
+
+/**
+   This class runs a simulation for each row of a parameter table and writes the summary of the runs
+   to a CSV file. The project is loaded only once and the rows are distributed to the worker processes
+   forked from the loaded process, so that the model data is shared between the workers by copy-on-write.
+
+   The first row of the table is the header, each column of which is "<item path>:<property name>".
+   The values are set with the change functions that the items give to the property view.
+   A BodyItem also accepts the columns "Initial position" (x y z [roll pitch yaw] in degrees) and
+   "Link mass:<link name>". An empty cell restores the value of the loaded project.
+*/
+class CNOID_EXPORT SimulationSweepRunner
+{
+public:
+    static void initialize(ExtensionManager* ext);
+
+    SimulationSweepRunner();
+    ~SimulationSweepRunner();
+
+    void setSimulatorItem(SimulatorItem* simulatorItem);
+    void setTimeLength(double length);
+
+    //! The workers are forked only when the GUI is not shown on the screen (e.g. QT_QPA_PLATFORM=offscreen)
+    void setNumWorkers(int n);
+
+    bool loadTable(const std::string& filename);
+    bool run(const std::string& outputFilename);
+
+private:
+    SimulationSweepRunnerImpl* impl;
+};
+
+}
+
+#endif
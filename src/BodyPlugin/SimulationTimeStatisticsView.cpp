@@ -0,0 +1,242 @@
+/**
+   @file
+*/
+
+#include "SimulationTimeStatisticsView.h"
+#include "SimulatorItem.h"
+#include "SimulationBar.h"
+#include <cnoid/ViewManager>
+#include <cnoid/ItemTreeView>
+#include <cnoid/TreeWidget>
+#include <cnoid/Timer>
+#include <cnoid/ConnectionSet>
+#include <QBoxLayout>
+#include <QLabel>
+#include <QHeaderView>
+#include "gettext.h"
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+enum ColumnId {
+    TARGET_COLUMN, PHASE_COLUMN, COUNT_COLUMN, MEAN_COLUMN,
+    P50_COLUMN, P90_COLUMN, P99_COLUMN, MAX_COLUMN, NUM_COLUMNS
+};
+
+const int UPDATE_INTERVAL = 1000; // [ms]
+
+QString toMillisecondsString(double time)
+{
+    return QString::number(time * 1000.0, 'f', 3);
+}
+
+}
+
+namespace cnoid {
+
+class SimulationTimeStatisticsViewImpl
+{
+public:
+    SimulationTimeStatisticsView* self;
+    TreeWidget treeWidget;
+    QLabel targetLabel;
+    Timer updateTimer;
+    SimulatorItemPtr currentSimulatorItem;
+    ScopedConnectionSet connections;
+    ScopedConnectionSet simulatorConnections;
+
+    SimulationTimeStatisticsViewImpl(SimulationTimeStatisticsView* self);
+    void onActivated(bool on);
+    void onSelectionChanged(const ItemList<>& selectedItems);
+    void setCurrentSimulatorItem(SimulatorItem* simulatorItem);
+    void onSimulationStarted();
+    void onSimulationFinished();
+    void updateList();
+    void addRow(const std::string& target, const std::string& phase, const TimeStatistics& statistics);
+};
+
+}
+
+
+void SimulationTimeStatisticsView::initializeClass(ExtensionManager* ext)
+{
+    ext->viewManager().registerClass<SimulationTimeStatisticsView>(
+        "SimulationTimeStatisticsView", N_("Simulation Time Statistics"), ViewManager::SINGLE_OPTIONAL);
+}
+
+
+SimulationTimeStatisticsView::SimulationTimeStatisticsView()
+{
+    impl = new SimulationTimeStatisticsViewImpl(this);
+}
+
+
+SimulationTimeStatisticsViewImpl::SimulationTimeStatisticsViewImpl(SimulationTimeStatisticsView* self)
+    : self(self)
+{
+    self->setDefaultLayoutArea(View::BOTTOM);
+
+    QVBoxLayout* vbox = new QVBoxLayout;
+    vbox->setSpacing(0);
+
+    QHBoxLayout* hbox = new QHBoxLayout;
+    hbox->addWidget(&targetLabel);
+    hbox->addStretch();
+    vbox->addLayout(hbox);
+
+    treeWidget.setColumnCount(NUM_COLUMNS);
+    treeWidget.setHeaderLabels(
+        { _("Target"), _("Phase"), _("Count"), _("Mean [ms]"),
+          _("P50 [ms]"), _("P90 [ms]"), _("P99 [ms]"), _("Max [ms]") });
+    treeWidget.setRootIsDecorated(false);
+    treeWidget.setAlternatingRowColors(true);
+    treeWidget.setAllColumnsShowFocus(true);
+    treeWidget.setSelectionMode(QAbstractItemView::SingleSelection);
+    QHeaderView* header = treeWidget.header();
+    header->setStretchLastSection(false);
+    header->setSectionResizeMode(TARGET_COLUMN, QHeaderView::Stretch);
+    for(int i = PHASE_COLUMN; i < NUM_COLUMNS; ++i){
+        header->setSectionResizeMode(i, QHeaderView::ResizeToContents);
+    }
+    vbox->addWidget(&treeWidget);
+
+    self->setLayout(vbox);
+
+    updateTimer.setInterval(UPDATE_INTERVAL);
+    updateTimer.sigTimeout().connect([&](){ updateList(); });
+
+    self->sigActivated().connect([&](){ onActivated(true); });
+    self->sigDeactivated().connect([&](){ onActivated(false); });
+
+    targetLabel.setText(_("No simulator item"));
+}
+
+
+SimulationTimeStatisticsView::~SimulationTimeStatisticsView()
+{
+    delete impl;
+}
+
+
+void SimulationTimeStatisticsViewImpl::onActivated(bool on)
+{
+    connections.disconnect();
+    updateTimer.stop();
+    
+    if(on){
+        connections.add(
+            SimulationBar::instance()->sigSimulationAboutToStart().connect(
+                [&](SimulatorItem* simulatorItem){ setCurrentSimulatorItem(simulatorItem); }));
+        connections.add(
+            ItemTreeView::instance()->sigSelectionChanged().connect(
+                [&](const ItemList<>& selectedItems){ onSelectionChanged(selectedItems); }));
+        if(currentSimulatorItem){
+            if(currentSimulatorItem->isRunning()){
+                updateTimer.start();
+            }
+            updateList();
+        } else {
+            onSelectionChanged(ItemTreeView::instance()->selectedItems());
+        }
+    }
+}
+
+
+void SimulationTimeStatisticsViewImpl::onSelectionChanged(const ItemList<>& selectedItems)
+{
+    if(auto simulatorItem = ItemList<SimulatorItem>(selectedItems).toSingle()){
+        setCurrentSimulatorItem(simulatorItem);
+    }
+}
+
+
+void SimulationTimeStatisticsViewImpl::setCurrentSimulatorItem(SimulatorItem* simulatorItem)
+{
+    if(simulatorItem == currentSimulatorItem.get()){
+        return;
+    }
+
+    simulatorConnections.disconnect();
+    updateTimer.stop();
+    currentSimulatorItem = simulatorItem;
+
+    simulatorConnections.add(
+        simulatorItem->sigSimulationStarted().connect([&](){ onSimulationStarted(); }));
+    simulatorConnections.add(
+        simulatorItem->sigSimulationFinished().connect([&](){ onSimulationFinished(); }));
+    if(simulatorItem->isRunning()){
+        updateTimer.start();
+    }
+
+    updateList();
+}
+
+
+void SimulationTimeStatisticsViewImpl::onSimulationStarted()
+{
+    if(self->isActive()){
+        updateTimer.start();
+    }
+}
+
+
+void SimulationTimeStatisticsViewImpl::onSimulationFinished()
+{
+    updateTimer.stop();
+    // The statistics of the whole simulation have been copied when the simulation loop exited
+    updateList();
+}
+
+
+void SimulationTimeStatisticsViewImpl::updateList()
+{
+    treeWidget.clear();
+
+    if(!currentSimulatorItem){
+        targetLabel.setText(_("No simulator item"));
+        return;
+    }
+
+    QString label;
+    if(!currentSimulatorItem->isProfilingEnabled()){
+        label = QString(_("%1 (The statistics are recorded when the profiling is enabled)"))
+            .arg(currentSimulatorItem->name().c_str());
+    } else {
+        label = currentSimulatorItem->name().c_str();
+    }
+
+    // The real-time sync statistics are recorded regardless of the profiling
+    auto realtimeSync = currentSimulatorItem->realtimeSyncStatistics();
+    if(realtimeSync.numSteps > 0){
+        label += QString(_("  Missed real-time deadlines: %1 / %2, Skipped result frames: %3"))
+            .arg(realtimeSync.numMissedDeadlines).arg(realtimeSync.numSteps)
+            .arg(realtimeSync.numSkippedResultFrames);
+        addRow(_("Real-time sync"), _("Lateness"), realtimeSync.lateness);
+    }
+    targetLabel.setText(label);
+
+    for(auto& entry : currentSimulatorItem->timeStatistics()){
+        addRow(entry.target, entry.phase, entry.statistics);
+    }
+}
+
+
+void SimulationTimeStatisticsViewImpl::addRow
+(const std::string& target, const std::string& phase, const TimeStatistics& statistics)
+{
+    auto row = new QTreeWidgetItem;
+    row->setText(TARGET_COLUMN, target.c_str());
+    row->setText(PHASE_COLUMN, phase.c_str());
+    row->setText(COUNT_COLUMN, QString::number(statistics.count()));
+    row->setText(MEAN_COLUMN, toMillisecondsString(statistics.meanTime()));
+    row->setText(P50_COLUMN, toMillisecondsString(statistics.percentile(0.5)));
+    row->setText(P90_COLUMN, toMillisecondsString(statistics.percentile(0.9)));
+    row->setText(P99_COLUMN, toMillisecondsString(statistics.percentile(0.99)));
+    row->setText(MAX_COLUMN, toMillisecondsString(statistics.maxTime()));
+    for(int i = COUNT_COLUMN; i < NUM_COLUMNS; ++i){
+        row->setTextAlignment(i, Qt::AlignRight | Qt::AlignVCenter);
+    }
+    treeWidget.addTopLevelItem(row);
+}
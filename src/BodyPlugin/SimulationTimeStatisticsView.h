@@ -0,0 +1,34 @@
+/**
+   @file
+*/
+
+#ifndef CNOID_BODY_PLUGIN_SIMULATION_TIME_STATISTICS_VIEW_H
+#define CNOID_BODY_PLUGIN_SIMULATION_TIME_STATISTICS_VIEW_H
+
+#include <cnoid/View>
+
+namespace cnoid {
+
+class SimulationTimeStatisticsViewImpl;
+
+/**
+   This view shows the statistics of the computation times of the controllers and the
+   device simulations given by SimulatorItem::timeStatistics(). The statistics of the
+   simulator item which has been started last or which is selected in the item tree view
+   are shown, and they are updated every second while the simulation is running.
+*/
+class SimulationTimeStatisticsView : public View
+{
+public:
+    static void initializeClass(ExtensionManager* ext);
+
+    SimulationTimeStatisticsView();
+    virtual ~SimulationTimeStatisticsView();
+
+private:
+    SimulationTimeStatisticsViewImpl* impl;
+};
+
+}
+
+#endif
@@ -21,21 +21,31 @@
 #include <cnoid/TimeBar>
 #include <cnoid/ItemTreeView>
 #include <cnoid/MessageView>
+#include <cnoid/InfoBar>
 #include <cnoid/LazyCaller>
 #include <cnoid/Archive>
 #include <cnoid/MultiDeviceStateSeq>
 #include <cnoid/Timer>
-#include <cnoid/Deque2D>
 #include <cnoid/ConnectionSet>
 #include <cnoid/FloatingNumberString>
 #include <cnoid/SceneGraph>
+#include <cnoid/MultiValueSeqItem>
+#include <cnoid/ThreadPool>
+#include <cnoid/TraceRecorder>
+#include <cnoid/AllocationTracker>
 #include <QThread>
-#include <QMutex>
 #include <QElapsedTimer>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <algorithm>
 #include <set>
+#include <map>
+#include <fstream>
+#include <cmath>
 #include <fmt/format.h>
 
 #ifdef ENABLE_SIMULATION_PROFILING
@@ -54,7 +64,163 @@ namespace {
 
 enum { RESOLUTION_TIMESTEP, RESOLUTION_FRAMERATE, RESOLUTION_TIMEBAR, N_TEMPORARL_RESOLUTION_TYPES };
 
-typedef Deque2D<SE3, Eigen::aligned_allocator<SE3> > MultiSE3Deque;
+// The number of frames buffered between flushes in the batch mode
+const int NUM_BATCH_FLUSH_FRAMES = 1000;
+
+// The number of frames that the result buffers can keep without allocating memory
+const int NUM_RESULT_BUFFER_FRAMES = 1024;
+
+// The time [ms] busy-waited before each step in the real-time sync mode with the busy-wait enabled
+const double REALTIME_SYNC_BUSY_WAIT_TIME = 0.5;
+
+// Only one of this number of result flushes notifies the GUI with CATCH_UP_DROP_GUI_FRAMES
+const int NUM_GUI_FLUSHES_PER_NOTIFICATION_BEHIND_REALTIME = 4;
+
+// The time length of the latest profiling data kept in the profiling sequence
+const double PROFILING_SEQ_TIME_LENGTH = 60.0;
+
+// Every other periodic checkpoint is discarded and the interval is doubled over this number
+const size_t MAX_NUM_PERIODIC_CHECKPOINTS = 512;
+
+// The phases of a simulation step whose computation times are measured by the profiler
+enum ProfilingPhase {
+    PROF_CONTROLLER_INPUT,
+    PROF_CONTROLLER_CONTROL,
+    PROF_CONTROLLER_OUTPUT,
+    PROF_PRE_DYNAMICS_FUNCTIONS,
+    PROF_MID_DYNAMICS_FUNCTIONS,
+    PROF_POST_DYNAMICS_FUNCTIONS,
+    PROF_SIMULATION_ENGINE,
+    PROF_RESULT_BUFFERING,
+    NUM_PROFILING_PHASES
+};
+
+const char* profilingPhaseNames[] = {
+    "Controller input time",
+    "Controller control time",
+    "Controller output time",
+    "Pre-dynamics function time",
+    "Mid-dynamics function time",
+    "Post-dynamics function time",
+    "Simulation engine time",
+    "Result buffering time"
+};
+
+/**
+   A single-producer / single-consumer ring buffer of fixed width frames.
+   The simulation thread writes frames and the main thread reads them without locks.
+   When the ring is full, the producer moves the new frames into an overflow queue
+   which is only accessed by the producer, so that the producer is never blocked by
+   the consumer and no frame is lost. The overflow frames are moved to the ring when
+   it has free slots again, and the consumer can also read the overflow frames
+   directly after the producer has stopped.
+*/
+template<class ElementType, class Allocator = std::allocator<ElementType>>
+class ResultFrameRing
+{
+public:
+    ResultFrameRing() : capacity(1), width_(0), head(0), tail(0), isWritingToOverflow(false) { }
+
+    //! This must not be called while the producer or the consumer is accessing the ring
+    void initialize(int numFrames, int width){
+        capacity = numFrames + 1;
+        width_ = width;
+        slots.clear();
+        slots.resize(capacity * width_);
+        overflow.clear();
+        newOverflowFrame.resize(width_);
+        head.store(0);
+        tail.store(0);
+        isWritingToOverflow = false;
+    }
+
+    int width() const { return width_; }
+    
+    // Following functions are called by the producer
+    
+    ElementType* beginFrame(){
+        moveOverflowFramesToRing();
+        const int t = tail.load(std::memory_order_relaxed);
+        if(overflow.empty() && ((t + 1) % capacity != head.load(std::memory_order_acquire))){
+            isWritingToOverflow = false;
+            return &slots[t * width_];
+        }
+        isWritingToOverflow = true;
+        overflow.push_back(newOverflowFrame);
+        return overflow.back().data();
+    }
+
+    void endFrame(){
+        if(!isWritingToOverflow){
+            tail.store((tail.load(std::memory_order_relaxed) + 1) % capacity, std::memory_order_release);
+        }
+    }
+
+    // Following functions are called by the consumer.
+    // includeOverflow must be false while the producer is running.
+
+    int numFrames(bool includeOverflow = false) const {
+        int n = numRingFrames();
+        if(includeOverflow){
+            n += overflow.size();
+        }
+        return n;
+    }
+
+    ElementType* frame(int index) {
+        const int n = numRingFrames();
+        if(index < n){
+            return &slots[((head.load(std::memory_order_relaxed) + index) % capacity) * width_];
+        }
+        return overflow[index - n].data();
+    }
+
+    void popFrames(int numFramesToPop){
+        const int n = std::min(numFramesToPop, numRingFrames());
+        head.store((head.load(std::memory_order_relaxed) + n) % capacity, std::memory_order_release);
+        const int numOverflowFramesToPop = numFramesToPop - n;
+        if(numOverflowFramesToPop > 0){
+            overflow.erase(overflow.begin(), overflow.begin() + numOverflowFramesToPop);
+        }
+    }
+
+private:
+    typedef std::vector<ElementType, Allocator> Frame;
+    std::vector<ElementType, Allocator> slots;
+    std::deque<Frame> overflow;
+    Frame newOverflowFrame;
+    int capacity;
+    int width_;
+    std::atomic<int> head;
+    std::atomic<int> tail;
+    bool isWritingToOverflow;
+
+    int numRingFrames() const {
+        return (tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed) + capacity) % capacity;
+    }
+
+    void moveOverflowFramesToRing(){
+        while(!overflow.empty()){
+            const int t = tail.load(std::memory_order_relaxed);
+            const int next = (t + 1) % capacity;
+            if(next == head.load(std::memory_order_acquire)){
+                break;
+            }
+            std::copy(overflow.front().begin(), overflow.front().end(), slots.begin() + t * width_);
+            overflow.pop_front();
+            tail.store(next, std::memory_order_release);
+        }
+    }
+};
+
+typedef ResultFrameRing<SE3, Eigen::aligned_allocator<SE3>> SE3FrameRing;
+
+struct BufferedFrameInfo
+{
+    int frame;
+    bool hasCollisionData;
+    shared_ptr<CollisionLinkPairList> collisionPairs;
+};
 
 typedef map<weak_ref_ptr<BodyItem>, SimulationBodyPtr> BodyItemToSimBodyMap;
 
@@ -100,6 +266,44 @@ struct FunctionSet
     void updateFunctions();
 };
 
+
+/**
+   A result sequence of the recording whose frames correspond to the simulation frames
+   which are multiples of the interval.
+*/
+struct RecordingChannel
+{
+    string bodyName;
+    string channelName;
+    int numFrames;
+    // The simulation frame of the first frame
+    int firstFrame;
+    int interval;
+    size_t numBytes;
+    // Discards the frames of the sequence before the given frame of the sequence
+    std::function<void(int frame)> discardFramesBefore;
+};
+
+
+/**
+   The state of a simulation body stored in a checkpoint.
+*/
+class BodyCheckpointState : public Referenced
+{
+public:
+    struct LinkState {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        Position T;
+        Vector3 v, w, dv, dw;
+        Vector6 F_ext;
+        double q, dq, ddq, u, q_target, dq_target;
+    };
+    vector<LinkState, Eigen::aligned_allocator<LinkState>> linkStates;
+    vector<DeviceStatePtr> deviceStates;
+    bool isActive;
+};
+typedef ref_ptr<BodyCheckpointState> BodyCheckpointStatePtr;
+
 }
 
 namespace cnoid {
@@ -115,15 +319,20 @@ public:
     SimulatorItemImpl* simImpl;
 
     bool isActive;
+    bool isResting;
     bool isDynamic;
     bool areShapesCloned;
 
-    Deque2D<double> jointPosBuf;
-    MultiSE3Deque linkPosBuf;
+    // The simulation frames of the buffered frames. This is written after the other buffers.
+    ResultFrameRing<int> frameNumberBuf;
+    ResultFrameRing<double> jointPosBuf;
+    SE3FrameRing linkPosBuf;
     vector<Device*> devicesToNotifyResults;
     ScopedConnectionSet deviceStateConnections;
     vector<bool> deviceStateChangeFlag;
-    Deque2D<DeviceStatePtr> deviceStateBuf;
+    ResultFrameRing<DeviceStatePtr> deviceStateBuf;
+    // The states stored in the last buffered frame, which are shared with the next frame if unchanged
+    vector<DeviceStatePtr> lastBufferedDeviceStates;
 
     ItemPtr parentOfResultItems;
     string resultItemPrefix;
@@ -133,6 +342,11 @@ public:
     MultiSE3SeqItemPtr linkPosResultItem;
     vector<DeviceStatePtr> prevFlushedDeviceStateInDirectMode;
     shared_ptr<MultiDeviceStateSeq> deviceStateResults;
+    // The simulation frame corresponding to the next frame appended to the result sequences
+    int nextResultFrame;
+    // The intervals of the simulation frames recorded in the result sequences
+    int linkPosRecordingInterval;
+    int jointPosRecordingInterval;
 
     SimulationBodyImpl(SimulationBody* self, Body* body);
     void findControlSrcItems(Item* item, vector<Item*>& io_items, bool doPickCheckedItems = false);
@@ -148,10 +362,14 @@ public:
     void setActive(bool on);
     void bufferResults();
     void flushResults();
-    void flushResultsToBodyMotionItems();
-    void flushResultsToBody();
+    void flushResultsToBodyMotionItems(int numBufferedFrames);
+    void flushResultsToBody(int numBufferedFrames);
     void flushResultsToWorldLogFile(int bufferFrame);
     void notifyResults(double time);
+    ReferencedPtr storeCheckpointState();
+    bool restoreCheckpointState(Referenced* state);
+    void discardResultsAfter(int frame);
+    void startResultsFrom(int frame);
 
     // Following functions are defined in the ControllerIO class
     virtual Body* body() override;
@@ -185,8 +403,11 @@ public:
     int currentFrame;
     double worldFrameRate;
     double worldTimeStep_;
-    int frameAtLastBufferWriting;
-    int numBufferedFrames;
+    std::atomic<int> frameAtLastBufferWriting;
+    ResultFrameRing<BufferedFrameInfo> frameInfoBuf;
+    int numFramesToFlush;
+    int lastFrameToFlush;
+    bool isFlushingStoppedLoop;
     Timer flushTimer;
 
     FunctionSet preDynamicsFunctions;
@@ -197,7 +418,11 @@ public:
     ItemList<SubSimulatorItem> subSimulatorItems;
 
     vector<ControllerItem*> activeControllers;
+    // The indices of activeControllers where the controllers of each body begin
+    vector<int> controllerGroupHeads;
     std::thread controlThread;
+    std::unique_ptr<ThreadPool> controlThreadPool;
+    vector<char> controlResults;
     std::condition_variable controlCondition;
     std::mutex controlMutex;
     bool isExitingControlLoopRequested;
@@ -209,7 +434,6 @@ public:
     CollisionDetectorPtr collisionDetector;
 
     shared_ptr<CollisionSeq> collisionSeq;
-    deque<shared_ptr<CollisionLinkPairList>> collisionPairsBuf;
 
     Selection recordingMode;
     Selection timeRangeMode;
@@ -220,21 +444,33 @@ public:
     bool isRingBufferMode;
     bool useControllerThreads;
     bool useControllerThreadsProperty;
+    bool isParallelControlEnabled;
     bool isAllLinkPositionOutputMode;
     bool isDeviceStateOutputEnabled;
+    map<string, SimulatorItem::BodyRecordingSetting> bodyRecordingSettings;
     bool isDoingSimulationLoop;
+    bool isBatchMode;
     volatile bool stopRequested;
     volatile bool pauseRequested;
     bool isRealtimeSyncMode;
+    Selection realtimeSyncCatchUpPolicy;
+    bool isRealtimeSyncBusyWaitEnabled;
+    std::atomic<bool> isBehindRealtime;
+    SimulatorItem::RealtimeSyncStatistics realtimeSyncStatistics;
+    int numGuiFlushesBehindRealtime;
+    std::atomic<bool> isFastForwardMode;
+    bool isGuiUpdateSuspended;
     bool needToUpdateSimBodyLists;
     bool hasActiveFreeBodies;
     bool recordCollisionData;
+    size_t recordingMemoryBudget;
 
     string controllerOptionString_;
 
     TimeBar* timeBar;
     int fillLevelId;
-    QMutex resultBufMutex;
+    // True while the time bar shows the progress of this simulation
+    bool isTimeBarOwner;
     double actualSimulationTime;
     double finishTime;
     MessageView* mv;
@@ -282,23 +518,135 @@ public:
         
     ItemTreeView* itemTreeView;
 
+    bool isProfilingEnabled;
+    bool isProfiling;
+    QElapsedTimer stepTimer;
+    QElapsedTimer phaseTimer;
+    QElapsedTimer controlTimer;
+    double phaseTimes[NUM_PROFILING_PHASES];
+    vector<double> profilingTimes;
+    vector<string> profilingNames;
+    ResultFrameRing<double> simProfilingBuf;
+    MultiValueSeqItemPtr profilingSeqItem;
+    shared_ptr<MultiValueSeq> simProfilingSeq;
+    int profilingSeqSize;
+    int numFlushedProfilingFrames;
+
+    struct ControllerTimeRecord
+    {
+        ControllerItem* controller;
+        string name;
+        TimeStatistics inputTimes;
+        TimeStatistics controlTimes;
+        TimeStatistics outputTimes;
+        // The control time [s] of the current step measured in the control thread
+        double controlTime;
+    };
+    // The deque keeps the addresses of the records while the records are added
+    std::deque<ControllerTimeRecord> controllerTimeRecords;
+    vector<ControllerTimeRecord*> activeControllerTimeRecords;
+    std::atomic<bool> isTimeStatisticsRequested;
+    std::mutex timeStatisticsMutex;
+    vector<SimulationTimeStatistics> timeStatisticsCopy;
+    SimulatorItem::RealtimeSyncStatistics realtimeSyncStatisticsCopy;
+
+    bool isTrackingAllocations;
+    struct PhaseAllocationRecord
+    {
+        int64_t numAllocations;
+        int64_t numAllocatedBytes;
+        int64_t numAllocatingSteps;
+        int lastAllocationFrame;
+    };
+    PhaseAllocationRecord phaseAllocationRecords[NUM_PROFILING_PHASES];
+    // The counters of the simulation thread at the end of the last phase
+    int64_t numThreadAllocationsAtPhaseEnd;
+    int64_t numThreadAllocatedBytesAtPhaseEnd;
+    // The allocations of the control thread in the current step
+    int64_t numControlThreadAllocations;
+    int64_t numControlThreadAllocatedBytes;
+    vector<SimulatorItem::StepAllocationStatistics> stepAllocationStatisticsCopy;
+
+    enum CheckpointRequestType { NO_CHECKPOINT_REQUEST, STORE_CHECKPOINT, RESTORE_CHECKPOINT };
+    std::thread::id loopThreadId;
+    int simulationId;
+    int frameOfBodyStates;
+    std::mutex checkpointMutex;
+    std::condition_variable checkpointCondition;
+    std::atomic<bool> hasCheckpointRequest;
+    int checkpointRequestType;
+    SimulationCheckpointPtr requestedCheckpoint;
+    bool isLoopHeldForCheckpoint;
+    bool areResultsFlushedForCheckpoint;
+    bool isCheckpointRequestDone;
+    bool checkpointRequestResult;
+    // The checkpoint requested to restore in the simulation loop thread
+    SimulationCheckpointPtr checkpointToRestore;
+    // The checkpoint from which the simulation being started is branched
+    SimulationCheckpointPtr branchCheckpoint;
+    double branchTime;
+    double checkpointInterval;
+    int periodicCheckpointIntervalFrames;
+    std::deque<SimulationCheckpointPtr> periodicCheckpoints;
+    mutable std::mutex periodicCheckpointMutex;
 #ifdef ENABLE_SIMULATION_PROFILING
-    double controllerTime;
-    QElapsedTimer timer;
-    Deque2D<double> simProfilingBuf;
-    MultiValueSeq simProfilingSeq;
     SceneWidget* sw;
 #endif
 
     void findTargetItems(Item* item, bool isUnderBodyItem, ItemList<Item>& out_targetItems);
     void clearSimulation();
     bool startSimulation(bool doReset);
+    bool runBatchSimulation(bool doReset);
     virtual void run();
+    void runBatchLoop();
+    void finishConcurrentControlLoop();
     void onSimulationLoopStarted();
     void updateSimBodyLists();
     bool stepSimulationMain();
     void concurrentControlLoop();
-    void flushResults();
+    bool controlControllersInParallel();
+    void initializeProfiling();
+    //! \return The time of the phase in nanoseconds
+    double addPhaseTime(int phase) {
+        double time = phaseTimer.nsecsElapsed();
+        phaseTimes[phase] += time;
+        if(isTrackingAllocations){
+            addThreadAllocationsToPhase(phase);
+        }
+        phaseTimer.start();
+        return time;
+    }
+    void initializeAllocationTracking();
+    void markThreadAllocations();
+    void addThreadAllocationsToPhase(int phase);
+    void addPhaseAllocations(int phase, int64_t numAllocations, int64_t numAllocatedBytes);
+    void updateActiveControllerTimeRecords();
+    void copyTimeStatistics();
+    void clearRealtimeSyncStatistics();
+    void recordRealtimeSyncLateness(double lateness, double timeStep);
+    void waitForRealtime(QElapsedTimer& timer, double time);
+    void bufferProfilingData();
+    void flushProfilingData(bool isLoopStopped);
+    bool saveProfilingData(const string& filename, ostream& os);
+    bool isInSimulationLoopThread() const { return std::this_thread::get_id() == loopThreadId; }
+    SimulationCheckpointPtr storeCheckpoint();
+    bool restoreCheckpoint(SimulationCheckpoint* checkpoint);
+    bool isValidCheckpoint(SimulationCheckpoint* checkpoint) const;
+    bool isCompatibleCheckpoint(SimulationCheckpoint* checkpoint) const;
+    SimulationCheckpointPtr doStoreCheckpoint();
+    bool doRestoreCheckpoint(SimulationCheckpoint* checkpoint);
+    void storePeriodicCheckpoint();
+    void restoreBranchCheckpoint();
+    bool startSimulationFromCheckpoint(SimulationCheckpoint* checkpoint);
+    SimulationCheckpointPtr findPeriodicCheckpoint(double time) const;
+    void processCheckpointRequests();
+    void cancelCheckpointRequests();
+    void discardResultsAfter(int frame);
+    void flushResults(bool isLoopStopped = false);
+    void setTimeBarOwner(bool on);
+    void setGuiUpdateSuspended(bool on);
+    size_t getRecordingChannels(vector<RecordingChannel>& channels) const;
+    void limitRecordingMemory();
     void stopSimulation(bool doSync);
     void pauseSimulation();
     void restartSimulation();
@@ -328,14 +676,28 @@ public:
 };
 
 
+/**
+   This class plays back the results of the selected simulator items, or the running ones when
+   no simulator item is selected, at the time of the time bar. It also decides the simulator item
+   whose progress is shown by the time bar when several simulator items are running at the same time.
+   The first running item among the selected ones is chosen, and the last started item is chosen
+   when none of them is running. The other items continue their simulations and flush their results
+   independently without updating the time bar.
+*/
 class SimulatedMotionEngineManager
 {
 public:
+    static SimulatedMotionEngineManager* instance;
     ItemList<SimulatorItem> simulatorItems;
     ScopedConnection selectionOrTreeChangedConnection;
     ScopedConnection timeChangeConnection;
+    // The running simulator items which are not in the batch mode, in the order of their start
+    vector<SimulatorItem*> runningSimulatorItems;
+    SimulatorItem* timeBarOwner;
 
     SimulatedMotionEngineManager(){
+        instance = this;
+        timeBarOwner = nullptr;
         selectionOrTreeChangedConnection.reset(
             ItemTreeView::instance()->sigSelectionOrTreeChanged().connect(
                 [&](const ItemList<SimulatorItem>& selected){
@@ -364,6 +726,7 @@ public:
             }
         }
         if(changed){
+            updateTimeBarOwner();
             if(simulatorItems.empty()){
                 timeChangeConnection.disconnect();
             } else {
@@ -376,8 +739,18 @@ public:
         }
     }
 
+    ~SimulatedMotionEngineManager(){
+        instance = nullptr;
+    }
+
     bool setTime(double time);
+    void onSimulationStarted(SimulatorItem* simulatorItem);
+    void onSimulationFinished(SimulatorItem* simulatorItem);
+    void updateTimeBarOwner();
+    void setTimeBarOwner(SimulatorItem* simulatorItem);
 };
+
+SimulatedMotionEngineManager* SimulatedMotionEngineManager::instance = nullptr;
     
 }
 
@@ -496,7 +869,9 @@ SimulationBodyImpl::SimulationBodyImpl(SimulationBody* self, Body* body)
     simImpl = nullptr;
     areShapesCloned = false;
     isActive = false;
+    isResting = false;
     isDynamic = false;
+    nextResultFrame = 0;
 }
 
 
@@ -695,14 +1070,36 @@ void SimulationBody::initializeResultBuffers()
 }
 
 
+static int getRecordingInterval(double rate, double worldFrameRate)
+{
+    if(rate <= 0.0 || rate >= worldFrameRate){
+        return 1;
+    }
+    return std::max(1, static_cast<int>(std::round(worldFrameRate / rate)));
+}
+
+
 void SimulationBodyImpl::initializeResultBuffers()
 {
-    jointPosBuf.resizeColumn(body_->numAllJoints());
+    isResting = false;
+    nextResultFrame = 0;
+
+    SimulatorItem::BodyRecordingSetting setting;
+    auto p = simImpl->bodyRecordingSettings.find(body_->name());
+    if(p != simImpl->bodyRecordingSettings.end()){
+        setting = p->second;
+    }
+    linkPosRecordingInterval = getRecordingInterval(setting.linkPositionRate, frameRate);
+    jointPosRecordingInterval = getRecordingInterval(setting.jointPositionRate, frameRate);
+    
+    frameNumberBuf.initialize(NUM_RESULT_BUFFER_FRAMES, 1);
+    jointPosBuf.initialize(
+        NUM_RESULT_BUFFER_FRAMES, setting.isJointPositionRecordingEnabled ? body_->numAllJoints() : 0);
     int numLinksToRecord = 0;
-    if(isDynamic){
+    if(isDynamic && setting.isLinkPositionRecordingEnabled){
         numLinksToRecord = simImpl->isAllLinkPositionOutputMode ? body_->numLinks() : 1;
     }
-    linkPosBuf.resizeColumn(numLinksToRecord);
+    linkPosBuf.initialize(NUM_RESULT_BUFFER_FRAMES, numLinksToRecord);
 
     const DeviceList<>& devices = body_->devices();
     const int numDevices = devices.size();
@@ -711,18 +1108,15 @@ void SimulationBodyImpl::initializeResultBuffers()
     deviceStateChangeFlag.resize(numDevices, true); // set all the bits to store the initial states
     devicesToNotifyResults.clear();
     
-    if(devices.empty() || !simImpl->isDeviceStateOutputEnabled){
-        deviceStateBuf.clear();
+    if(devices.empty() || !simImpl->isDeviceStateOutputEnabled || !setting.isDeviceStateRecordingEnabled){
+        deviceStateBuf.initialize(NUM_RESULT_BUFFER_FRAMES, 0);
+        lastBufferedDeviceStates.clear();
         prevFlushedDeviceStateInDirectMode.clear();
     } else {
-        /**
-           Temporary code to avoid a bug in storing device states by reserving sufficient buffer size.
-           The original bug is in Deque2D's resize operation.
-        */
-        deviceStateBuf.resize(100, numDevices); 
-        
-        // This buf always has the first element to keep unchanged states
-        deviceStateBuf.resize(1, numDevices); 
+        deviceStateBuf.initialize(NUM_RESULT_BUFFER_FRAMES, numDevices);
+        lastBufferedDeviceStates.clear();
+        lastBufferedDeviceStates.resize(numDevices);
+        prevFlushedDeviceStateInDirectMode.clear();
         prevFlushedDeviceStateInDirectMode.resize(numDevices);
         for(size_t i=0; i < devices.size(); ++i){
             deviceStateConnections.add(
@@ -759,19 +1153,33 @@ void SimulationBodyImpl::initializeResultItems()
     }
 
     motion = motionItem->motion();
-    motion->setFrameRate(frameRate);
-    motion->setDimension(0, jointPosBuf.colSize(), linkPosBuf.colSize());
-    motion->setOffsetTime(0.0);
+    // The frames recorded before the checkpoint are kept when the simulation is branched from it
+    const bool doKeepFrames =
+        simImpl->branchCheckpoint &&
+        motion->numJoints() == jointPosBuf.width() &&
+        motion->numLinks() == linkPosBuf.width() &&
+        motion->jointPosSeq()->frameRate() == frameRate / jointPosRecordingInterval &&
+        motion->linkPosSeq()->frameRate() == frameRate / linkPosRecordingInterval;
+    if(!doKeepFrames){
+        motion->setFrameRate(frameRate);
+        motion->setDimension(0, jointPosBuf.width(), linkPosBuf.width());
+        motion->setOffsetTime(0.0);
+    }
     simImpl->addBodyMotionEngine(motionItem);
     jointPosResults = motion->jointPosSeq();
+    jointPosResults->setFrameRate(frameRate / jointPosRecordingInterval);
     linkPosResultItem = motionItem->linkPosSeqItem();
     linkPosResults = motion->linkPosSeq();
+    linkPosResults->setFrameRate(frameRate / linkPosRecordingInterval);
 
-    const int numDevices = deviceStateBuf.colSize();
+    const int numDevices = deviceStateBuf.width();
     if(numDevices == 0 || !simImpl->isDeviceStateOutputEnabled){
         clearMultiDeviceStateSeq(*motion);
     } else {
         deviceStateResults = getOrCreateMultiDeviceStateSeq(*motion);
+        if(deviceStateResults->numParts() != numDevices){
+            deviceStateResults->setNumFrames(0);
+        }
         deviceStateResults->initialize(body_->devices());
     }
 }
@@ -821,10 +1229,12 @@ void SimulationBodyImpl::setActive(bool on)
     if(body_){
         if(on){
             if(!isActive){
-                simImpl->resultBufMutex.lock();
-                self->initializeResultBuffers();
+                /*
+                  The buffers are not initialized again here because the main thread may be
+                  reading them. Only the device states are marked to be stored as the initial states.
+                */
+                deviceStateChangeFlag.assign(deviceStateChangeFlag.size(), true);
                 self->bufferResults();
-                simImpl->resultBufMutex.unlock();
                 isActive = true;
                 simImpl->needToUpdateSimBodyLists = true;
             }
@@ -838,6 +1248,18 @@ void SimulationBodyImpl::setActive(bool on)
 }
 
 
+bool SimulationBody::isResting() const
+{
+    return impl->isResting;
+}
+
+
+void SimulationBody::setResting(bool on)
+{
+    impl->isResting = on;
+}
+
+
 void SimulationBody::notifyUnrecordedDeviceStateChange(Device* device)
 {
     bool flag = impl->deviceStateChangeFlag[device->index()];
@@ -846,6 +1268,268 @@ void SimulationBody::notifyUnrecordedDeviceStateChange(Device* device)
 }
 
 
+ReferencedPtr SimulationBodyImpl::storeCheckpointState()
+{
+    BodyCheckpointStatePtr state = new BodyCheckpointState;
+
+    const int numLinks = body_->numLinks();
+    state->linkStates.resize(numLinks);
+    for(int i=0; i < numLinks; ++i){
+        Link* link = body_->link(i);
+        auto& linkState = state->linkStates[i];
+        linkState.T = link->T();
+        linkState.v = link->v();
+        linkState.w = link->w();
+        linkState.dv = link->dv();
+        linkState.dw = link->dw();
+        linkState.F_ext = link->F_ext();
+        linkState.q = link->q();
+        linkState.dq = link->dq();
+        linkState.ddq = link->ddq();
+        linkState.u = link->u();
+        linkState.q_target = link->q_target();
+        linkState.dq_target = link->dq_target();
+    }
+
+    const DeviceList<>& devices = body_->devices();
+    state->deviceStates.resize(devices.size());
+    for(size_t i=0; i < devices.size(); ++i){
+        state->deviceStates[i] = devices[i]->cloneState();
+    }
+
+    state->isActive = isActive;
+
+    return state;
+}
+
+
+bool SimulationBodyImpl::restoreCheckpointState(Referenced* state_)
+{
+    auto state = dynamic_cast<BodyCheckpointState*>(state_);
+    if(!state ||
+       static_cast<int>(state->linkStates.size()) != body_->numLinks() ||
+       state->deviceStates.size() != body_->devices().size()){
+        return false;
+    }
+
+    const int numLinks = body_->numLinks();
+    for(int i=0; i < numLinks; ++i){
+        Link* link = body_->link(i);
+        auto& linkState = state->linkStates[i];
+        link->T() = linkState.T;
+        link->v() = linkState.v;
+        link->w() = linkState.w;
+        link->dv() = linkState.dv;
+        link->dw() = linkState.dw;
+        link->F_ext() = linkState.F_ext;
+        link->q() = linkState.q;
+        link->dq() = linkState.dq;
+        link->ddq() = linkState.ddq;
+        link->u() = linkState.u;
+        link->q_target() = linkState.q_target;
+        link->dq_target() = linkState.dq_target;
+    }
+    body_->calcCenterOfMass();
+
+    const DeviceList<>& devices = body_->devices();
+    for(size_t i=0; i < devices.size(); ++i){
+        Device* device = devices[i];
+        device->copyStateFrom(*state->deviceStates[i]);
+        // The restored states are recorded in the next frame
+        device->notifyStateChange();
+    }
+
+    if(state->isActive != isActive){
+        setActive(state->isActive);
+    }
+
+    return true;
+}
+
+
+namespace {
+
+template<class SeqType>
+void discardFramesAfter(SeqType& seq, int frame)
+{
+    const int numFrames = frame + 1 - seq.offsetTimeFrame();
+    if(numFrames <= 0){
+        seq.setNumFrames(0);
+        seq.setOffsetTimeFrame(frame + 1);
+    } else if(numFrames < seq.numFrames()){
+        seq.setNumFrames(numFrames);
+    }
+}
+
+
+/**
+   Discards the frames of the sequence at and after the given frame of the sequence.
+   The sequence is cleared when it does not have all the frames before the frame.
+*/
+template<class SeqType>
+void discardFramesFrom(SeqType& seq, int frame)
+{
+    const int numFrames = frame - seq.offsetTimeFrame();
+    if(numFrames < 0 || numFrames > seq.numFrames()){
+        seq.setNumFrames(0);
+        seq.setOffsetTimeFrame(frame);
+    } else {
+        seq.setNumFrames(numFrames);
+    }
+}
+
+
+template<class SeqType>
+void discardFramesBefore(SeqType& seq, int frame)
+{
+    const int offset = seq.offsetTimeFrame();
+    const int numFrames = std::min(frame - offset, seq.numFrames());
+    if(numFrames > 0){
+        seq.popFrontFrames(numFrames);
+        seq.setOffsetTimeFrame(offset + numFrames);
+    }
+}
+
+
+template<class SeqType>
+size_t getRecordedDataSize(const SeqType& seq)
+{
+    return static_cast<size_t>(seq.numFrames()) * seq.numParts() * sizeof(typename SeqType::value_type);
+}
+
+
+size_t getRecordedDataSize(const CollisionSeq& seq)
+{
+    return seq.memorySize();
+}
+
+
+template<class SeqType>
+void addRecordingChannel
+(vector<RecordingChannel>& channels, const string& bodyName, const char* channelName,
+ shared_ptr<SeqType> seq, int interval)
+{
+    RecordingChannel channel;
+    channel.bodyName = bodyName;
+    channel.channelName = channelName;
+    channel.numFrames = seq->numFrames();
+    channel.firstFrame = seq->offsetTimeFrame() * interval;
+    channel.interval = interval;
+    channel.numBytes = getRecordedDataSize(*seq);
+    channel.discardFramesBefore = [seq](int frame){ discardFramesBefore(*seq, frame); };
+    channels.push_back(channel);
+}
+
+
+//! \return The first frame of the sequence recorded at the given interval which is not before the simulation frame
+int toRecordedFrame(int frame, int interval)
+{
+    return (frame + interval - 1) / interval;
+}
+
+
+/**
+   Appends the buffered frames to a sequence of the results which ends at nextResultFrame.
+   The frames which have not been buffered because the body has been resting or inactive
+   are filled with the previous frame so that the sequence ends at endFrame, and a frame
+   buffered again in the same simulation frame replaces the previous one.
+   Only the simulation frames which are multiples of the interval are recorded in the sequence.
+   \return true if the front frames have been removed to keep the ring buffer size
+*/
+template<class SeqType, class ElementType>
+bool appendResultFrames
+(SeqType& seq, ResultFrameRing<ElementType>& buf, ResultFrameRing<int>& frameNumberBuf,
+ int numBufferedFrames, int nextResultFrame, int endFrame, int ringBufferSize, int interval = 1)
+{
+    bool offsetChanged = false;
+    const int width = buf.width();
+    nextResultFrame = toRecordedFrame(nextResultFrame, interval);
+    endFrame = toRecordedFrame(endFrame, interval);
+
+    auto appendFrame = [&](){
+        if(seq.numFrames() >= ringBufferSize){
+            seq.popFrontFrame();
+            offsetChanged = true;
+        }
+        return seq.appendFrame();
+    };
+    auto fillFramesUntil = [&](int frame){
+        if(seq.numFrames() > 0){
+            while(nextResultFrame < frame){
+                appendFrame();
+                const int n = seq.numFrames();
+                if(n >= 2){
+                    auto src = seq.frame(n - 2);
+                    std::copy(src.begin(), src.end(), seq.frame(n - 1).begin());
+                }
+                ++nextResultFrame;
+            }
+        }
+        nextResultFrame = std::max(nextResultFrame, frame);
+    };
+    
+    for(int i=0; i < numBufferedFrames; ++i){
+        const int simFrame = *frameNumberBuf.frame(i);
+        if(simFrame % interval != 0){
+            continue;
+        }
+        const int frame = simFrame / interval;
+        ElementType* src = buf.frame(i);
+        if(frame < nextResultFrame && seq.numFrames() > 0){
+            std::copy(src, src + width, seq.frame(seq.numFrames() - 1).begin());
+        } else {
+            fillFramesUntil(frame);
+            std::copy(src, src + width, appendFrame().begin());
+            ++nextResultFrame;
+        }
+    }
+    fillFramesUntil(endFrame);
+
+    return offsetChanged;
+}
+
+}
+
+
+void SimulationBodyImpl::discardResultsAfter(int frame)
+{
+    nextResultFrame = std::min(nextResultFrame, frame + 1);
+    if(linkPosResults){
+        discardFramesAfter(*linkPosResults, frame / linkPosRecordingInterval);
+    }
+    if(jointPosResults){
+        discardFramesAfter(*jointPosResults, frame / jointPosRecordingInterval);
+    }
+    if(deviceStateResults){
+        discardFramesAfter(*deviceStateResults, frame);
+    }
+}
+
+
+/**
+   Makes the results start from the given frame, to which the states have been restored.
+   The buffered results are discarded and the recorded results before the frame are kept.
+*/
+void SimulationBodyImpl::startResultsFrom(int frame)
+{
+    if(!body_ || (!isDynamic && body_->numDevices() == 0)){
+        return;
+    }
+    initializeResultBuffers();
+    if(linkPosResults){
+        discardFramesFrom(*linkPosResults, toRecordedFrame(frame, linkPosRecordingInterval));
+    }
+    if(jointPosResults){
+        discardFramesFrom(*jointPosResults, toRecordedFrame(frame, jointPosRecordingInterval));
+    }
+    if(deviceStateResults){
+        discardFramesFrom(*deviceStateResults, frame);
+    }
+    nextResultFrame = frame;
+    self->bufferResults();
+}
+
+
 void SimulationBody::bufferResults()
 {
     impl->bufferResults();
@@ -854,33 +1538,43 @@ void SimulationBody::bufferResults()
 
 void SimulationBodyImpl::bufferResults()
 {
-    if(jointPosBuf.colSize() > 0){
-        Deque2D<double>::Row q = jointPosBuf.append();
-        for(int i=0; i < q.size() ; ++i){
-            q[i] = body_->joint(i)->q();
+    const int frame = simImpl->currentFrame;
+    // The positions of the frames which are not recorded are only used by the other outputs
+    const bool doBufferAllFrames = !simImpl->isRecordingEnabled || simImpl->worldLogFileItem;
+    
+    if(jointPosBuf.width() > 0){
+        double* q = jointPosBuf.beginFrame();
+        if(doBufferAllFrames || frame % jointPosRecordingInterval == 0){
+            for(int i=0; i < jointPosBuf.width(); ++i){
+                q[i] = body_->joint(i)->q();
+            }
         }
+        jointPosBuf.endFrame();
     }
-    if(linkPosBuf.colSize() > 0){
-        MultiSE3Deque::Row pos = linkPosBuf.append();
-        for(int i=0; i < linkPosBuf.colSize(); ++i){
-            Link* link = body_->link(i);
-            pos[i].set(link->p(), link->R());
+    if(linkPosBuf.width() > 0){
+        SE3* pos = linkPosBuf.beginFrame();
+        if(doBufferAllFrames || frame % linkPosRecordingInterval == 0){
+            for(int i=0; i < linkPosBuf.width(); ++i){
+                Link* link = body_->link(i);
+                pos[i].set(link->p(), link->R());
+            }
         }
+        linkPosBuf.endFrame();
     }
-    if(deviceStateBuf.colSize() > 0){
-        const int prevIndex = std::max(0, deviceStateBuf.rowSize() - 1);
-        Deque2D<DeviceStatePtr>::Row current = deviceStateBuf.append();
-        Deque2D<DeviceStatePtr>::Row prev = deviceStateBuf[prevIndex];
+    if(deviceStateBuf.width() > 0){
+        DeviceStatePtr* current = deviceStateBuf.beginFrame();
         const DeviceList<>& devices = body_->devices();
         for(size_t i=0; i < devices.size(); ++i){
             if(deviceStateChangeFlag[i]){
-                current[i] = devices[i]->cloneState();
+                lastBufferedDeviceStates[i] = devices[i]->cloneState();
                 deviceStateChangeFlag[i] = false;
-            } else {
-                current[i] = prev[i];
             }
+            current[i] = lastBufferedDeviceStates[i];
         }
+        deviceStateBuf.endFrame();
     }
+    *frameNumberBuf.beginFrame() = frame;
+    frameNumberBuf.endFrame();
 }
 
 
@@ -890,86 +1584,75 @@ void SimulationBody::flushResults()
 }
 
 
+/**
+   The number of frames to flush is given by SimulatorItemImpl::flushResults.
+   A body which has been inactive may have fewer frames than the others.
+*/
 void SimulationBodyImpl::flushResults()
 {
+    const int lastFrame = simImpl->lastFrameToFlush;
+    const bool includeOverflow = simImpl->isFlushingStoppedLoop;
+    const int numAvailableFrames = frameNumberBuf.numFrames(includeOverflow);
+    int numBufferedFrames = 0;
+    while(numBufferedFrames < numAvailableFrames && *frameNumberBuf.frame(numBufferedFrames) <= lastFrame){
+        ++numBufferedFrames;
+    }
+    
     if(simImpl->isRecordingEnabled){
-        flushResultsToBodyMotionItems();
-    } else {
-        flushResultsToBody();
+        flushResultsToBodyMotionItems(numBufferedFrames);
+    } else if(!simImpl->isBatchMode){
+        flushResultsToBody(numBufferedFrames);
     }
 
-    // clear buffers
-    linkPosBuf.resizeRow(0);
-    jointPosBuf.resizeRow(0);
-
-    // keep the last state so that unchanged states can be shared
-    const int numPops = (deviceStateBuf.rowSize() >= 2) ? (deviceStateBuf.rowSize() - 1) : 0;
-    deviceStateBuf.pop_front(numPops);
+    // release the flushed frames to the simulation thread
+    linkPosBuf.popFrames(numBufferedFrames);
+    jointPosBuf.popFrames(numBufferedFrames);
+    deviceStateBuf.popFrames(numBufferedFrames);
+    frameNumberBuf.popFrames(numBufferedFrames);
 }
 
 
-void SimulationBodyImpl::flushResultsToBodyMotionItems()
+void SimulationBodyImpl::flushResultsToBodyMotionItems(int numBufferedFrames)
 {
     if(!linkPosResults){
         initializeResultItems();
     }
 
     const int ringBufferSize = simImpl->ringBufferSize;
-    const int numBufFrames = linkPosBuf.rowSize();
-    const int nextFrame = simImpl->currentFrame + 1;
-
-    if(linkPosBuf.colSize() > 0){
-        bool offsetChanged = false;
-        for(int i=0; i < numBufFrames; ++i){
-            MultiSE3Deque::Row buf = linkPosBuf.row(i);
-            if(linkPosResults->numFrames() >= ringBufferSize){
-                linkPosResults->popFrontFrame();
-                offsetChanged = true;
-            }
-            std::copy(buf.begin(), buf.end(), linkPosResults->appendFrame().begin());
-        }
-        if(offsetChanged){
-            linkPosResults->setOffsetTimeFrame(nextFrame - linkPosResults->numFrames());
+    const int nextFrame = simImpl->lastFrameToFlush + 1;
+
+    if(linkPosBuf.width() > 0){
+        const int interval = linkPosRecordingInterval;
+        if(appendResultFrames(*linkPosResults, linkPosBuf, frameNumberBuf, numBufferedFrames,
+                              nextResultFrame, nextFrame, std::max(1, ringBufferSize / interval), interval)){
+            linkPosResults->setOffsetTimeFrame(
+                toRecordedFrame(nextFrame, interval) - linkPosResults->numFrames());
         }
     }
-    if(jointPosBuf.colSize() > 0){
-        bool offsetChanged = false;
-        for(int i=0; i < numBufFrames; ++i){
-            Deque2D<double>::Row buf = jointPosBuf.row(i);
-            if(jointPosResults->numFrames() >= ringBufferSize){
-                jointPosResults->popFrontFrame();
-                offsetChanged = true;
-            }
-            std::copy(buf.begin(), buf.end(), jointPosResults->appendFrame().begin());
-        }
-        if(offsetChanged){
-            jointPosResults->setOffsetTimeFrame(nextFrame - jointPosResults->numFrames());
+    if(jointPosBuf.width() > 0){
+        const int interval = jointPosRecordingInterval;
+        if(appendResultFrames(*jointPosResults, jointPosBuf, frameNumberBuf, numBufferedFrames,
+                              nextResultFrame, nextFrame, std::max(1, ringBufferSize / interval), interval)){
+            jointPosResults->setOffsetTimeFrame(
+                toRecordedFrame(nextFrame, interval) - jointPosResults->numFrames());
         }
     }
-    if(deviceStateBuf.colSize() > 0){
-        bool offsetChanged = false;
-        // This loop begins with the second element to skip the first element to keep the unchanged states
-        for(int i=1; i < deviceStateBuf.rowSize(); ++i){ 
-            Deque2D<DeviceStatePtr>::Row buf = deviceStateBuf.row(i);
-            if(deviceStateResults->numFrames() >= ringBufferSize){
-                deviceStateResults->popFrontFrame();
-                offsetChanged = true;
-            }
-            std::copy(buf.begin(), buf.end(), deviceStateResults->appendFrame().begin());
-        }
-        if(offsetChanged){
+    if(deviceStateBuf.width() > 0){
+        if(appendResultFrames(*deviceStateResults, deviceStateBuf, frameNumberBuf, numBufferedFrames,
+                              nextResultFrame, nextFrame, ringBufferSize)){
             deviceStateResults->setOffsetTimeFrame(nextFrame - deviceStateResults->numFrames());
         }
     }
+    nextResultFrame = nextFrame;
 }
 
 
-void SimulationBodyImpl::flushResultsToBody()
+void SimulationBodyImpl::flushResultsToBody(int numBufferedFrames)
 {
     Body* orgBody = bodyItem->body();
-    if(!linkPosBuf.empty()){
-        MultiSE3Deque::Row last = linkPosBuf.last();
-        const int n = last.size();
+    if(numBufferedFrames > 0 && linkPosBuf.width() > 0){
+        SE3* last = linkPosBuf.frame(numBufferedFrames - 1);
+        const int n = linkPosBuf.width();
         for(int i=0; i < n; ++i){
             SE3& pos = last[i];
             Link* link = orgBody->link(i);
@@ -977,17 +1660,16 @@ void SimulationBodyImpl::flushResultsToBody()
             link->R() = pos.rotation().toRotationMatrix();
         }
     }
-    if(!jointPosBuf.empty()){
-        Deque2D<double>::Row last = jointPosBuf.last();
+    if(numBufferedFrames > 0 && jointPosBuf.width() > 0){
+        double* last = jointPosBuf.frame(numBufferedFrames - 1);
         const int n = body_->numJoints();
         for(int i=0; i < n; ++i){
             orgBody->joint(i)->q() = last[i];
         }
     }
-    if(!deviceStateBuf.empty()){
-        devicesToNotifyResults.clear();
+    if(numBufferedFrames > 0 && deviceStateBuf.width() > 0){
         const DeviceList<>& devices = orgBody->devices();
-        Deque2D<DeviceStatePtr>::Row ds = deviceStateBuf.last();
+        DeviceStatePtr* ds = deviceStateBuf.frame(numBufferedFrames - 1);
         const int ndevices = devices.size();
         for(int i=0; i < ndevices; ++i){
             const DeviceStatePtr& s = ds[i];
@@ -995,7 +1677,10 @@ void SimulationBodyImpl::flushResultsToBody()
                 Device* device = devices[i];
                 device->copyStateFrom(*s);
                 prevFlushedDeviceStateInDirectMode[i] = s;
-                devicesToNotifyResults.push_back(device);
+                if(std::find(devicesToNotifyResults.begin(), devicesToNotifyResults.end(), device)
+                   == devicesToNotifyResults.end()){
+                    devicesToNotifyResults.push_back(device);
+                }
             }
         }
     }
@@ -1004,32 +1689,27 @@ void SimulationBodyImpl::flushResultsToBody()
 
 void SimulationBodyImpl::flushResultsToWorldLogFile(int bufferFrame)
 {
-    //if(bufferFrame < linkPosBuf.rowSize()){
+    const bool includeOverflow = simImpl->isFlushingStoppedLoop;
     
     WorldLogFileItem* log = simImpl->worldLogFileItem;
     log->beginBodyStateOutput();
 
-    if(linkPosBuf.colSize() > 0){
-        MultiSE3Deque::Row posbuf = linkPosBuf.row(bufferFrame);
-        log->outputLinkPositions(posbuf.begin(), posbuf.size());
+    if(linkPosBuf.width() > 0 && bufferFrame < linkPosBuf.numFrames(includeOverflow)){
+        log->outputLinkPositions(linkPosBuf.frame(bufferFrame), linkPosBuf.width());
     }
-    if(jointPosBuf.colSize() > 0){
-        Deque2D<double>::Row jointbuf = jointPosBuf.row(bufferFrame);
-        log->outputJointPositions(jointbuf.begin(), jointbuf.size());
+    if(jointPosBuf.width() > 0 && bufferFrame < jointPosBuf.numFrames(includeOverflow)){
+        log->outputJointPositions(jointPosBuf.frame(bufferFrame), jointPosBuf.width());
     }
-    if(deviceStateBuf.colSize() > 0){
-        // Skip the first element because it is used for sharing an unchanged state
-        Deque2D<DeviceStatePtr>::Row states = deviceStateBuf.row(bufferFrame + 1);
+    if(deviceStateBuf.width() > 0 && bufferFrame < deviceStateBuf.numFrames(includeOverflow)){
+        DeviceStatePtr* states = deviceStateBuf.frame(bufferFrame);
         log->beginDeviceStateOutput();
-        for(int i=0; i < states.size(); ++i){
+        for(int i=0; i < deviceStateBuf.width(); ++i){
             log->outputDeviceState(states[i]);
         }
         log->endDeviceStateOutput();
     }
 
     log->endBodyStateOutput();
-
-    //}
 }
 
 
@@ -1044,6 +1724,7 @@ void SimulationBodyImpl::notifyResults(double time)
     for(Device* device : devicesToNotifyResults){
         device->notifyStateChange();
     }
+    devicesToNotifyResults.clear();
     for(Device* device : bodyItem->body()->devices()){
         device->notifyTimeChange(time);
     }
@@ -1094,6 +1775,7 @@ SimulatorItemImpl::SimulatorItemImpl(SimulatorItem* self)
       postDynamicsFunctions(this),
       recordingMode(SimulatorItem::N_RECORDING_MODES, CNOID_GETTEXT_DOMAIN_NAME),
       timeRangeMode(SimulatorItem::N_TIME_RANGE_MODES, CNOID_GETTEXT_DOMAIN_NAME),
+      realtimeSyncCatchUpPolicy(SimulatorItem::N_CATCH_UP_POLICIES, CNOID_GETTEXT_DOMAIN_NAME),
       mv(MessageView::instance())
 {
     worldItem = nullptr;
@@ -1105,9 +1787,19 @@ SimulatorItemImpl::SimulatorItemImpl(SimulatorItem* self)
     frameRateProperty = 1000;
 
     currentFrame = 0;
+    frameOfBodyStates = 0;
+    simulationId = 0;
+    hasCheckpointRequest = false;
+    checkpointRequestType = NO_CHECKPOINT_REQUEST;
+    branchTime = 0.0;
+    checkpointInterval = 0.0;
+    periodicCheckpointIntervalFrames = 0;
     worldFrameRate = 1.0;
     worldTimeStep_ = 1.0;
     frameAtLastBufferWriting = 0;
+    numFramesToFlush = 0;
+    lastFrameToFlush = 0;
+    isFlushingStoppedLoop = false;
     flushTimer.sigTimeout().connect([&](){ flushResults(); });
 
     recordingMode.setSymbol(SimulatorItem::REC_FULL, N_("full"));
@@ -1123,11 +1815,34 @@ SimulatorItemImpl::SimulatorItemImpl(SimulatorItem* self)
 
     specifiedTimeLength = 180.0; // 3 min.
     useControllerThreadsProperty = true;
+    isParallelControlEnabled = false;
+    isProfilingEnabled = false;
+    isProfiling = false;
+    isTrackingAllocations = false;
+    isTimeStatisticsRequested = false;
     isAllLinkPositionOutputMode = true;
     isDeviceStateOutputEnabled = true;
     isDoingSimulationLoop = false;
+    isBatchMode = false;
+    isTimeBarOwner = false;
     isRealtimeSyncMode = true;
+    realtimeSyncCatchUpPolicy.setSymbol(SimulatorItem::CATCH_UP_NONE, N_("None"));
+    realtimeSyncCatchUpPolicy.setSymbol(SimulatorItem::CATCH_UP_SKIP_RECORDING, N_("Skip recording"));
+    realtimeSyncCatchUpPolicy.setSymbol(SimulatorItem::CATCH_UP_REDUCE_VISION_RATE, N_("Reduce vision rate"));
+    realtimeSyncCatchUpPolicy.setSymbol(SimulatorItem::CATCH_UP_DROP_GUI_FRAMES, N_("Drop GUI frames"));
+    realtimeSyncCatchUpPolicy.select(SimulatorItem::CATCH_UP_NONE);
+    isRealtimeSyncBusyWaitEnabled = false;
+    isBehindRealtime = false;
+    clearRealtimeSyncStatistics();
+    realtimeSyncStatisticsCopy = realtimeSyncStatistics;
+    numGuiFlushesBehindRealtime = 0;
+    isFastForwardMode = false;
+    isGuiUpdateSuspended = false;
+#ifdef ENABLE_SIMULATION_PROFILING
+    sw = nullptr;
+#endif
     recordCollisionData = false;
+    recordingMemoryBudget = 0;
 
     timeBar = TimeBar::instance();
     itemTreeView = ItemTreeView::instance();
@@ -1152,11 +1867,19 @@ SimulatorItemImpl::SimulatorItemImpl(SimulatorItem* self, const SimulatorItemImp
     timeRangeMode = org.timeRangeMode;
 
     specifiedTimeLength = org.specifiedTimeLength;
+    checkpointInterval = org.checkpointInterval;
     useControllerThreadsProperty = org.useControllerThreadsProperty;
+    isParallelControlEnabled = org.isParallelControlEnabled;
+    isProfilingEnabled = org.isProfilingEnabled;
     isAllLinkPositionOutputMode = org.isAllLinkPositionOutputMode;
     isDeviceStateOutputEnabled = org.isDeviceStateOutputEnabled;
+    bodyRecordingSettings = org.bodyRecordingSettings;
     isRealtimeSyncMode = org.isRealtimeSyncMode;
+    realtimeSyncCatchUpPolicy = org.realtimeSyncCatchUpPolicy;
+    isRealtimeSyncBusyWaitEnabled = org.isRealtimeSyncBusyWaitEnabled;
+    isFastForwardMode = org.isFastForwardMode.load();
     recordCollisionData = org.recordCollisionData;
+    recordingMemoryBudget = org.recordingMemoryBudget;
     controllerOptionString_ = org.controllerOptionString_;
 }
     
@@ -1246,72 +1969,168 @@ void SimulatorItem::setRealtimeSyncMode(bool on)
 }
 
 
-void SimulatorItem::setDeviceStateOutputEnabled(bool on)
+void SimulatorItem::setRealtimeSyncCatchUpPolicy(int policy)
 {
-    impl->isDeviceStateOutputEnabled = on;
+    impl->realtimeSyncCatchUpPolicy.select(policy);
 }
 
 
-void SimulatorItem::setAllLinkPositionOutputMode(bool on)
+int SimulatorItem::realtimeSyncCatchUpPolicy() const
 {
-    impl->isAllLinkPositionOutputMode = on;
+    return impl->realtimeSyncCatchUpPolicy.which();
 }
 
 
-bool SimulatorItem::isAllLinkPositionOutputMode()
+void SimulatorItem::setRealtimeSyncBusyWaitEnabled(bool on)
 {
-    return impl->isAllLinkPositionOutputMode;
+    impl->isRealtimeSyncBusyWaitEnabled = on;
 }
 
 
-bool SimulatorItem::isDeviceStateOutputEnabled() const
+bool SimulatorItem::isBehindRealtime() const
 {
-    return impl->isDeviceStateOutputEnabled;
+    return impl->isBehindRealtime.load(std::memory_order_relaxed);
 }
 
-void SimulatorItem::setSpecifiedRecordingTimeLength(double length)
+
+void SimulatorItem::setFastForwardMode(bool on)
 {
-    impl->setSpecifiedRecordingTimeLength(length);
+    impl->isFastForwardMode = on;
 }
 
-void SimulatorItemImpl::setSpecifiedRecordingTimeLength(double length)
+
+bool SimulatorItem::isFastForwardMode() const
 {
-    specifiedTimeLength = length;
+    return impl->isFastForwardMode;
 }
 
-CollisionDetector* SimulatorItem::getOrCreateCollisionDetector()
+
+void SimulatorItem::setParallelControlEnabled(bool on)
 {
-    if(impl->collisionDetector){
-        return impl->collisionDetector;
-    }
-    if(impl->worldItem){
-        return impl->worldItem->collisionDetector()->clone();
-    }
-    return CollisionDetector::create(0); // the null collision detector
+    impl->isParallelControlEnabled = on;
 }
 
 
-CollisionDetector* SimulatorItem::collisionDetector()
+void SimulatorItem::setProfilingEnabled(bool on)
 {
-    return getOrCreateCollisionDetector();
+    impl->isProfilingEnabled = on;
 }
 
 
-void SimulatorItem::setSelfCollisionEnabled(bool on)
+bool SimulatorItem::isProfilingEnabled() const
 {
+    return impl->isProfilingEnabled;
+}
 
+
+std::shared_ptr<MultiValueSeq> SimulatorItem::profilingSeq()
+{
+    return impl->simProfilingSeq;
 }
 
 
-bool SimulatorItem::isSelfCollisionEnabled() const
+const std::vector<std::string>& SimulatorItem::profilingNames() const
 {
-    return false;
+    return impl->profilingNames;
 }
 
 
-const std::string& SimulatorItem::controllerOptionString() const
+bool SimulatorItem::saveProfilingData(const std::string& filename, std::ostream& os)
 {
-    return impl->controllerOptionString_;
+    return impl->saveProfilingData(filename, os);
+}
+
+
+void SimulatorItem::setDeviceStateOutputEnabled(bool on)
+{
+    impl->isDeviceStateOutputEnabled = on;
+}
+
+
+void SimulatorItem::setAllLinkPositionOutputMode(bool on)
+{
+    impl->isAllLinkPositionOutputMode = on;
+}
+
+
+bool SimulatorItem::isAllLinkPositionOutputMode()
+{
+    return impl->isAllLinkPositionOutputMode;
+}
+
+
+bool SimulatorItem::isDeviceStateOutputEnabled() const
+{
+    return impl->isDeviceStateOutputEnabled;
+}
+
+
+void SimulatorItem::setBodyRecordingSetting(const std::string& bodyName, const BodyRecordingSetting& setting)
+{
+    impl->bodyRecordingSettings[bodyName] = setting;
+}
+
+
+bool SimulatorItem::getBodyRecordingSetting(const std::string& bodyName, BodyRecordingSetting& out_setting) const
+{
+    auto p = impl->bodyRecordingSettings.find(bodyName);
+    if(p != impl->bodyRecordingSettings.end()){
+        out_setting = p->second;
+        return true;
+    }
+    out_setting = BodyRecordingSetting();
+    return false;
+}
+
+
+void SimulatorItem::clearBodyRecordingSettings()
+{
+    impl->bodyRecordingSettings.clear();
+}
+
+void SimulatorItem::setSpecifiedRecordingTimeLength(double length)
+{
+    impl->setSpecifiedRecordingTimeLength(length);
+}
+
+void SimulatorItemImpl::setSpecifiedRecordingTimeLength(double length)
+{
+    specifiedTimeLength = length;
+}
+
+CollisionDetector* SimulatorItem::getOrCreateCollisionDetector()
+{
+    if(impl->collisionDetector){
+        return impl->collisionDetector;
+    }
+    if(impl->worldItem){
+        return impl->worldItem->collisionDetector()->clone();
+    }
+    return CollisionDetector::create(0); // the null collision detector
+}
+
+
+CollisionDetector* SimulatorItem::collisionDetector()
+{
+    return getOrCreateCollisionDetector();
+}
+
+
+void SimulatorItem::setSelfCollisionEnabled(bool on)
+{
+
+}
+
+
+bool SimulatorItem::isSelfCollisionEnabled() const
+{
+    return false;
+}
+
+
+const std::string& SimulatorItem::controllerOptionString() const
+{
+    return impl->controllerOptionString_;
 }
 
 
@@ -1485,9 +2304,23 @@ bool SimulatorItemImpl::startSimulation(bool doReset)
     sgCloneMap.clear();
 
     currentFrame = 0;
+    frameOfBodyStates = 0;
+    ++simulationId;
+    checkpointToRestore.reset();
     worldTimeStep_ = self->worldTimeStep();
     worldFrameRate = 1.0 / worldTimeStep_;
 
+    if(checkpointInterval > 0.0){
+        periodicCheckpointIntervalFrames = std::max(1, static_cast<int>(std::round(checkpointInterval * worldFrameRate)));
+    } else {
+        periodicCheckpointIntervalFrames = 0;
+    }
+    branchTime = 0.0;
+    if(!branchCheckpoint){
+        std::lock_guard<std::mutex> lock(periodicCheckpointMutex);
+        periodicCheckpoints.clear();
+    }
+
     if(recordingMode.is(SimulatorItem::REC_NONE)){
         isRecordingEnabled = false;
         isRingBufferMode = false;
@@ -1534,10 +2367,15 @@ bool SimulatorItemImpl::startSimulation(bool doReset)
         }
     }
 
-    numBufferedFrames = 1;
+    // The initial states have been buffered by the simulation bodies
+    frameInfoBuf.initialize(NUM_RESULT_BUFFER_FRAMES, 1);
+    BufferedFrameInfo* initialFrameInfo = frameInfoBuf.beginFrame();
+    initialFrameInfo->frame = currentFrame;
+    initialFrameInfo->hasCollisionData = false;
+    initialFrameInfo->collisionPairs.reset();
+    frameInfoBuf.endFrame();
     
     if(isRecordingEnabled && recordCollisionData){
-        collisionPairsBuf.clear();
         string collisionSeqName = self->name() + "-collisions";
         CollisionSeqItem* collisionSeqItem = worldItem->findChildItem<CollisionSeqItem>(collisionSeqName);
         if(!collisionSeqItem){
@@ -1549,11 +2387,12 @@ bool SimulatorItemImpl::startSimulation(bool doReset)
             addCollisionSeqEngine(collisionSeqItem);
         }
         collisionSeq = collisionSeqItem->collisionSeq();
-        collisionSeq->setFrameRate(worldFrameRate);
-        collisionSeq->setNumParts(1);
-        collisionSeq->setNumFrames(1);
-        CollisionSeq::Frame frame0 = collisionSeq->frame(0);
-        frame0[0]  = std::make_shared<CollisionLinkPairList>();
+        // The frames are discarded from the checkpoint when the simulation is branched from it
+        if(!branchCheckpoint || collisionSeq->frameRate() != worldFrameRate){
+            collisionSeq->setFrameRate(worldFrameRate);
+            collisionSeq->setDimension(0, 1);
+            collisionSeq->appendFrame(CollisionLinkPairList());
+        }
     }
 
     extForceFunctionId = boost::none;
@@ -1641,6 +2480,10 @@ bool SimulatorItemImpl::startSimulation(bool doReset)
 
         updateSimBodyLists();
 
+        if(branchCheckpoint){
+            restoreBranchCheckpoint();
+        }
+
         doCheckContinue = timeRangeMode.is(SimulatorItem::TR_ACTIVE_CONTROL) && !activeControllers.empty();
             
         useControllerThreads = useControllerThreadsProperty;
@@ -1648,6 +2491,15 @@ bool SimulatorItemImpl::startSimulation(bool doReset)
             isExitingControlLoopRequested = false;
             isControlRequested = false;
             isControlFinished = false;
+
+            /*
+              Each controller is given its own thread in the parallel control mode.
+              The control thread executes one of the controllers itself.
+            */
+            controlThreadPool.reset();
+            if(isParallelControlEnabled && controllerGroupHeads.size() > 1){
+                controlThreadPool.reset(new ThreadPool(controllerGroupHeads.size() - 1));
+            }
             controlThread = std::thread([&](){ concurrentControlLoop(); });
         }
 
@@ -1677,52 +2529,52 @@ bool SimulatorItemImpl::startSimulation(bool doReset)
                 }
                 worldLogFileItem->endHeaderOutput();
                 worldLogFileItem->notifyUpdate();
-                nextLogFrame = 0;
-                nextLogTime = 0.0;
                 double r = worldLogFileItem->recordingFrameRate();
                 if(r == 0.0){
                     r = worldFrameRate;
                 }
                 logTimeStep = 1.0 / r;
+                // The log of a branched simulation starts from the checkpoint
+                nextLogFrame = static_cast<int>(std::ceil(branchTime / logTimeStep - 1.0e-9));
+                nextLogTime = nextLogFrame * logTimeStep;
             }
         }
 
-        if(isRecordingEnabled){
-            fillLevelId = timeBar->startFillLevelUpdate();
+        if(!isBatchMode){
+            if(!timeBar->isDoingPlayback()){
+                timeBar->setTime(0.0);
+                timeBar->startPlayback();
+            }
         }
-        if(!timeBar->isDoingPlayback()){
-            timeBar->setTime(0.0);
-            timeBar->startPlayback();
+
+        isProfiling = isProfilingEnabled;
+        isTrackingAllocations = false;
+        if(isProfiling){
+            initializeProfiling();
         }
 
-#ifdef ENABLE_SIMULATION_PROFILING
-        vector<string> profilingNames;
-        self->getProfilingNames(profilingNames);
-        profilingNames.push_back("Controller calculation time");
-        for(size_t i=0; i < activeControllers.size(); ++i){
-            vector<string> profilingNames0;
-            activeControllers[i]->getProfilingNames(profilingNames0);
-            std::copy(profilingNames0.begin(),profilingNames0.end(),std::back_inserter(profilingNames));
-        }
-        profilingNames.push_back("Total computation time");
-        int n = profilingNames.size();
-        SceneView* view = ViewManager::findView<SceneView>("Simulation Scene");
-        if(!view)
-            view = SceneView::instance();
-        sw = view->sceneWidget();
-        sw->profilingNames.resize(n);
-        copy(profilingNames.begin(), profilingNames.end(), sw->profilingNames.begin());
-        simProfilingBuf.resizeColumn(n);
-
-        //simProfilingSeq = std::make_shared<MultiValueSeq>();
-        simProfilingSeq.setFrameRate(worldFrameRate);
-        simProfilingSeq.setNumParts(n);
-        simProfilingSeq.setNumFrames(0);
-#endif
+        clearRealtimeSyncStatistics();
+        isBehindRealtime = false;
+        numGuiFlushesBehindRealtime = 0;
+        isGuiUpdateSuspended = false;
+        isTimeStatisticsRequested = false;
+        {
+            std::lock_guard<std::mutex> lock(timeStatisticsMutex);
+            timeStatisticsCopy.clear();
+            realtimeSyncStatisticsCopy = realtimeSyncStatistics;
+            stepAllocationStatisticsCopy.clear();
+        }
+
+        flushResults(true);
+
+        if(!isBatchMode && SimulatedMotionEngineManager::instance){
+            SimulatedMotionEngineManager::instance->onSimulationStarted(self);
+        }
 
-        flushResults();
-        start();
-        flushTimer.start(1000.0 / timeBar->playbackFrameRate());
+        if(!isBatchMode){
+            start();
+            flushTimer.start(1000.0 / timeBar->playbackFrameRate());
+        }
 
         mv->notify(format(_("Simulation by {} has started."), self->name()));
 
@@ -1733,6 +2585,30 @@ bool SimulatorItemImpl::startSimulation(bool doReset)
 }
 
 
+bool SimulatorItem::runBatchSimulation(bool doReset)
+{
+    return impl->runBatchSimulation(doReset);
+}
+
+
+bool SimulatorItemImpl::runBatchSimulation(bool doReset)
+{
+    isBatchMode = true;
+
+    bool result = startSimulation(doReset);
+    if(result){
+        isWaitingForSimulationToStop = true;
+        runBatchLoop();
+        isWaitingForSimulationToStop = false;
+        onSimulationLoopStopped();
+    }
+
+    isBatchMode = false;
+
+    return result;
+}
+
+
 SgCloneMap& SimulatorItem::sgCloneMap()
 {
     return impl->sgCloneMap;
@@ -1791,16 +2667,15 @@ SimulationBody* SimulatorItem::findSimulationBody(const std::string& name)
 // Simulation loop
 void SimulatorItemImpl::run()
 {
+    loopThreadId = std::this_thread::get_id();
+    TraceRecorder::setThreadName("Simulation");
+
     self->initializeSimulationThread();
 
     double elapsedTime = 0.0;
     QElapsedTimer timer;
     timer.start();
 
-#ifdef ENABLE_SIMULATION_PROFILING
-    QElapsedTimer oneStepTimer;
-#endif
-
     int frame = 0;
     bool isOnPause = false;
 
@@ -1809,16 +2684,19 @@ void SimulatorItemImpl::run()
         const double compensationRatio = (dt > 0.1) ? 0.1 : dt;
         const double dtms = dt * 1000.0;
         double compensatedSimulationTime = 0.0;
+        // The times are measured in milliseconds with the nanosecond resolution of the timer
         while(true){
             if(pauseRequested){
                 if(stopRequested){
                     break;
                 }
                 if(!isOnPause){
-                    elapsedTime += timer.elapsed();
+                    elapsedTime += timer.nsecsElapsed() / 1.0e6;
                     isOnPause = true;
+                    isBehindRealtime = false;
                     sigSimulationPaused();
                 }
+                processCheckpointRequests();
                 QThread::msleep(50);
             } else {
                 if(isOnPause){
@@ -1826,35 +2704,29 @@ void SimulatorItemImpl::run()
                     isOnPause = false;
                     sigSimulationResumed();
                 }
-#ifdef ENABLE_SIMULATION_PROFILING
-                oneStepTimer.start();
-#endif
                 if(!stepSimulationMain() || stopRequested || frame >= maxFrame){
                     break;
                 }
-#ifdef ENABLE_SIMULATION_PROFILING
-                double oneStepTime = oneStepTimer.nsecsElapsed();
-                vector<double> profilingTimes;
-                self->getProfilingTimes(profilingTimes);
-                Deque2D<double>::Row buf = simProfilingBuf.append();
-                int i=0;
-                for(; i<profilingTimes.size(); i++){
-                    buf[i] = profilingTimes[i] * 1.0e9;
+                if(isFastForwardMode.load(std::memory_order_relaxed)){
+                    // The sync is resumed from the current time when the fast-forward mode is turned off
+                    compensatedSimulationTime = elapsedTime + timer.nsecsElapsed() / 1.0e6 + dtms;
+                    isBehindRealtime = false;
+                    ++frame;
+                    continue;
                 }
-                buf[i++] = controllerTime;
-                for(size_t k=0; k < activeControllers.size(); k++){
-                    profilingTimes.clear();
-                    activeControllers[k]->getProfilingTimes(profilingTimes);
-                    for(int j=0; j<profilingTimes.size(); j++){
-                        buf[i++] = profilingTimes[j] * 1.0e9;
-                    }
+                double diff = compensatedSimulationTime - (elapsedTime + timer.nsecsElapsed() / 1.0e6);
+                // The first step has no preceding wait which gives the time to it
+                if(frame > 0){
+                    recordRealtimeSyncLateness(-diff, dtms);
                 }
-                buf[i] = oneStepTime;
-#endif
-                double diff = (double)compensatedSimulationTime - (elapsedTime + timer.elapsed());
-                if(diff >= 1.0){
+                if(isRealtimeSyncBusyWaitEnabled){
+                    if(diff > 0.0){
+                        waitForRealtime(timer, compensatedSimulationTime - elapsedTime);
+                    }
+                } else if(diff >= 1.0){
                     QThread::msleep(diff);
-                } else if(diff < 0.0){
+                }
+                if(diff < 0.0){
                     const double compensationTime = -diff * compensationRatio;
                     compensatedSimulationTime += compensationTime;
                     diff += compensationTime;
@@ -1874,10 +2746,11 @@ void SimulatorItemImpl::run()
                     break;
                 }
                 if(!isOnPause){
-                    elapsedTime += timer.elapsed();
+                    elapsedTime += timer.nsecsElapsed() / 1.0e6;
                     isOnPause = true;
                     sigSimulationPaused();
                 }
+                processCheckpointRequests();
                 QThread::msleep(50);
             } else {
                 if(isOnPause){
@@ -1885,43 +2758,78 @@ void SimulatorItemImpl::run()
                     isOnPause = false;
                     sigSimulationResumed();
                 }
-#ifdef ENABLE_SIMULATION_PROFILING
-                oneStepTimer.start();
-#endif
                 if(!stepSimulationMain() || stopRequested || frame++ >= maxFrame){
                     break;
                 }
-#ifdef ENABLE_SIMULATION_PROFILING
-                double oneStepTime = oneStepTimer.nsecsElapsed();
-                vector<double> profilingTimes;
-                self->getProfilingTimes(profilingTimes);
-                Deque2D<double>::Row buf = simProfilingBuf.append();
-                int i=0;
-                for(; i<profilingTimes.size(); i++){
-                    buf[i] = profilingTimes[i] * 1.0e9;
-                }
-                buf[i++] = controllerTime;
-                for(size_t k=0; k < activeControllers.size(); k++){
-                    profilingTimes.clear();
-                    activeControllers[k]->getProfilingTimes(profilingTimes);
-                    for(int j=0; j<profilingTimes.size(); j++){
-                        buf[i++] = profilingTimes[j] * 1.0e9;
-                    }
-                }
-                buf[i] = oneStepTime;
-#endif
             }
         }
     }
 
     if(!isOnPause){
-    	elapsedTime += timer.elapsed();
+    	elapsedTime += timer.nsecsElapsed() / 1.0e6;
     }
     actualSimulationTime = (elapsedTime / 1000.0);
     finishTime = frame / worldFrameRate;
 
     isDoingSimulationLoop = false;
 
+    cancelCheckpointRequests();
+
+    finishConcurrentControlLoop();
+
+    copyTimeStatistics();
+
+    if(!isWaitingForSimulationToStop){
+        callLater([&](){ onSimulationLoopStopped(); });
+    }
+
+    self->finalizeSimulationThread();
+}
+
+
+/**
+   The simulation loop of the batch mode. This is executed in the thread calling
+   runBatchSimulation. The real-time synchronization and the pause requests are ignored,
+   and the buffered results are flushed in the loop because no timer flushes them.
+*/
+void SimulatorItemImpl::runBatchLoop()
+{
+    loopThreadId = std::this_thread::get_id();
+    TraceRecorder::setThreadName("Simulation (batch)");
+
+    self->initializeSimulationThread();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int frame = 0;
+    while(true){
+        if(!stepSimulationMain() || stopRequested || frame++ >= maxFrame){
+            break;
+        }
+        // The results are flushed in this thread, so the overflow frames can also be flushed
+        if(frameInfoBuf.numFrames(true) >= NUM_BATCH_FLUSH_FRAMES){
+            flushResults(true);
+        }
+    }
+
+    actualSimulationTime = (timer.elapsed() / 1000.0);
+    finishTime = frame / worldFrameRate;
+
+    isDoingSimulationLoop = false;
+
+    cancelCheckpointRequests();
+
+    finishConcurrentControlLoop();
+
+    copyTimeStatistics();
+
+    self->finalizeSimulationThread();
+}
+
+
+void SimulatorItemImpl::finishConcurrentControlLoop()
+{
     if(useControllerThreads){
         {
             std::lock_guard<std::mutex> lock(controlMutex);
@@ -1929,13 +2837,8 @@ void SimulatorItemImpl::run()
         }
         controlCondition.notify_all();
         controlThread.join();
+        controlThreadPool.reset();
     }
-
-    if(!isWaitingForSimulationToStop){
-        callLater([&](){ onSimulationLoopStopped(); });
-    }
-
-    self->finalizeSimulationThread();
 }
 
 
@@ -1943,6 +2846,7 @@ void SimulatorItemImpl::updateSimBodyLists()
 {
     activeSimBodies.clear();
     activeControllers.clear();
+    controllerGroupHeads.clear();
     hasActiveFreeBodies = false;
     
     for(size_t i=0; i < allSimBodies.size(); ++i){
@@ -1955,17 +2859,58 @@ void SimulatorItemImpl::updateSimBodyLists()
                 hasActiveFreeBodies = true;
             }
         }
+        if(!controllers.empty()){
+            controllerGroupHeads.push_back(activeControllers.size());
+        }
         for(size_t j=0; j < controllers.size(); ++j){
             activeControllers.push_back(controllers[j]);
        }
     }
 
+    if(isProfiling){
+        updateActiveControllerTimeRecords();
+    }
+
     needToUpdateSimBodyLists = false;
 }
 
 
+/**
+   The record of a controller is kept while the controller is inactive so that the
+   statistics cover the whole simulation.
+*/
+void SimulatorItemImpl::updateActiveControllerTimeRecords()
+{
+    activeControllerTimeRecords.clear();
+    for(auto controller : activeControllers){
+        ControllerTimeRecord* record = nullptr;
+        for(auto& existing : controllerTimeRecords){
+            if(existing.controller == controller){
+                record = &existing;
+                break;
+            }
+        }
+        if(!record){
+            controllerTimeRecords.emplace_back();
+            record = &controllerTimeRecords.back();
+            record->controller = controller;
+            record->name = controller->name();
+            record->controlTime = 0.0;
+        }
+        activeControllerTimeRecords.push_back(record);
+    }
+}
+
+
 bool SimulatorItemImpl::stepSimulationMain()
 {
+    processCheckpointRequests();
+
+    if(periodicCheckpointIntervalFrames > 0 && currentFrame > 0 &&
+       currentFrame % periodicCheckpointIntervalFrames == 0){
+        storePeriodicCheckpoint();
+    }
+
     currentFrame++;
 
     if(needToUpdateSimBodyLists){
@@ -1974,171 +2919,1027 @@ bool SimulatorItemImpl::stepSimulationMain()
     
     bool doContinue = !doCheckContinue;
 
+    if(isProfiling){
+        std::fill(phaseTimes, phaseTimes + NUM_PROFILING_PHASES, 0.0);
+        stepTimer.start();
+        phaseTimer.start();
+        if(isTrackingAllocations){
+            // The allocations between the steps are not counted
+            markThreadAllocations();
+        }
+    }
+
+    // Each phase is recorded as a trace event from the end of the previous phase
+    const bool isTracing = TraceRecorder::isRecording();
+    const int64_t stepTraceTime = isTracing ? TraceRecorder::now() : 0;
+    int64_t phaseTraceTime = stepTraceTime;
+    auto tracePhase = [&](const char* phase){
+        if(isTracing){
+            int64_t time = TraceRecorder::now();
+            TraceRecorder::addEvent(phase, "simulation", phaseTraceTime, time);
+            phaseTraceTime = time;
+        }
+    };
+
     preDynamicsFunctions.call();
 
+    if(isProfiling){
+        addPhaseTime(PROF_PRE_DYNAMICS_FUNCTIONS);
+    }
+    tracePhase("Pre-dynamics functions");
+
     if(useControllerThreads){
-#ifdef ENABLE_SIMULATION_PROFILING
-        controllerTime = 0.0;
-#endif
         if(activeControllers.empty()){
             isControlFinished = true;
         } else {
-#ifdef ENABLE_SIMULATION_PROFILING
-            timer.start();
-#endif
             for(size_t i=0; i < activeControllers.size(); ++i){
                 activeControllers[i]->input();
+                if(isProfiling){
+                    activeControllerTimeRecords[i]->inputTimes.record(addPhaseTime(PROF_CONTROLLER_INPUT) * 1.0e-9);
+                }
             }
-#ifdef ENABLE_SIMULATION_PROFILING
-            controllerTime += timer.nsecsElapsed();
-#endif
             {
                 std::lock_guard<std::mutex> lock(controlMutex);                
                 isControlRequested = true;
             }
             controlCondition.notify_all();
         }
+    } else if(!isProfiling){
+        for(size_t i=0; i < activeControllers.size(); ++i){
+            ControllerItem* controller = activeControllers[i];
+            controller->input();
+            doContinue |= controller->control();
+            if(controller->isImmediateMode()){
+                controller->output();
+            }
+        }
     } else {
-#ifdef ENABLE_SIMULATION_PROFILING
-        controllerTime = 0.0;
-        timer.start();
-#endif
         for(size_t i=0; i < activeControllers.size(); ++i){
             ControllerItem* controller = activeControllers[i];
+            ControllerTimeRecord* record = activeControllerTimeRecords[i];
             controller->input();
+            record->inputTimes.record(addPhaseTime(PROF_CONTROLLER_INPUT) * 1.0e-9);
             doContinue |= controller->control();
+            record->controlTimes.record(addPhaseTime(PROF_CONTROLLER_CONTROL) * 1.0e-9);
             if(controller->isImmediateMode()){
                 controller->output();
+                record->outputTimes.record(addPhaseTime(PROF_CONTROLLER_OUTPUT) * 1.0e-9);
             }
         }
-#ifdef ENABLE_SIMULATION_PROFILING
-        controllerTime += timer.nsecsElapsed();
-#endif
+    }
+    tracePhase(useControllerThreads ? "Controller input" : "Controllers");
+
+    midDynamicsFunctions.call();
+
+    if(isProfiling){
+        addPhaseTime(PROF_MID_DYNAMICS_FUNCTIONS);
+    }
+    tracePhase("Mid-dynamics functions");
+
+    self->stepSimulation(activeSimBodies);
+    frameOfBodyStates = currentFrame;
+
+    shared_ptr<CollisionLinkPairList> collisionPairs;
+    if(isRecordingEnabled && recordCollisionData){
+        collisionPairs = self->getCollisions();
+    }
+
+    if(isProfiling){
+        addPhaseTime(PROF_SIMULATION_ENGINE);
+    }
+    tracePhase("Dynamics");
+
+    if(useControllerThreads){
+        {
+            std::unique_lock<std::mutex> lock(controlMutex);
+            while(!isControlFinished){
+                controlCondition.wait(lock);
+            }
+        }
+        isControlFinished = false;
+        doContinue |= isControlToBeContinued;
+
+        if(isProfiling){
+            // The control times have been set by the control thread
+            for(auto record : activeControllerTimeRecords){
+                record->controlTimes.record(record->controlTime);
+            }
+            if(isTrackingAllocations){
+                addPhaseAllocations(
+                    PROF_CONTROLLER_CONTROL, numControlThreadAllocations, numControlThreadAllocatedBytes);
+            }
+            phaseTimer.start();
+        }
+        tracePhase("Waiting for controllers");
+    }
+
+    postDynamicsFunctions.call();
+
+    if(isProfiling){
+        addPhaseTime(PROF_POST_DYNAMICS_FUNCTIONS);
+    }
+    tracePhase("Post-dynamics functions");
+
+    /*
+      The frame information is written after the body states so that the main thread
+      finds the body states of all the frames given by the frame information.
+    */
+    // The world log file needs the states of all the bodies in every logged frame
+    const bool doBufferRestingBodies = (worldLogFileItem != nullptr);
+    if(!doBufferRestingBodies &&
+       isBehindRealtime.load(std::memory_order_relaxed) &&
+       realtimeSyncCatchUpPolicy.is(SimulatorItem::CATCH_UP_SKIP_RECORDING)){
+        ++realtimeSyncStatistics.numSkippedResultFrames;
+    } else {
+        for(size_t i=0; i < activeSimBodies.size(); ++i){
+            SimulationBody* simBody = activeSimBodies[i];
+            if(!simBody->impl->isResting || doBufferRestingBodies){
+                simBody->bufferResults();
+            }
+        }
+    }
+    BufferedFrameInfo* frameInfo = frameInfoBuf.beginFrame();
+    frameInfo->frame = currentFrame;
+    frameInfo->hasCollisionData = true;
+    frameInfo->collisionPairs = collisionPairs;
+    frameInfoBuf.endFrame();
+    frameAtLastBufferWriting.store(currentFrame, std::memory_order_release);
+
+    if(isProfiling){
+        addPhaseTime(PROF_RESULT_BUFFERING);
+    }
+    tracePhase("Result buffering");
+
+    for(size_t i=0; i < activeControllers.size(); ++i){
+        ControllerItem* controller = activeControllers[i];
+        if(useControllerThreads || !controller->isImmediateMode()){
+            controller->output();
+            if(isProfiling){
+                activeControllerTimeRecords[i]->outputTimes.record(addPhaseTime(PROF_CONTROLLER_OUTPUT) * 1.0e-9);
+            }
+        }
+    }
+
+    if(isProfiling){
+        addPhaseTime(PROF_CONTROLLER_OUTPUT);
+        bufferProfilingData();
+    }
+    if(isTimeStatisticsRequested.load(std::memory_order_relaxed)){
+        copyTimeStatistics();
+    }
+    tracePhase("Controller output");
+
+    if(isTracing){
+        TraceRecorder::addEvent("Simulation step", "simulation", stepTraceTime, phaseTraceTime);
+    }
+
+    return doContinue;
+}
+
+
+void SimulatorItemImpl::concurrentControlLoop()
+{
+    TraceRecorder::setThreadName("Controller");
+
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(controlMutex);
+            while(true){
+                if(isExitingControlLoopRequested){
+                    goto exitConcurrentControlLoop;
+                }
+                if(isControlRequested){
+                    isControlRequested = false;
+                    isControlToBeContinued = false;
+                    break;
+                }
+                controlCondition.wait(lock);
+            }
+        }
+
+        bool doContinue = false;
+        if(isProfiling){
+            controlTimer.start();
+        }
+        const int64_t numAllocationsBeforeControl = AllocationTracker::numThreadAllocations();
+        const int64_t numAllocatedBytesBeforeControl = AllocationTracker::numThreadAllocatedBytes();
+        TraceRecorder::Scope trace("Control", "controller");
+        if(controlThreadPool && controllerGroupHeads.size() > 1){
+            doContinue = controlControllersInParallel();
+        } else if(!isProfiling){
+            for(size_t i=0; i < activeControllers.size(); ++i){
+                doContinue |= activeControllers[i]->control();
+            }
+        } else {
+            QElapsedTimer timer;
+            for(size_t i=0; i < activeControllers.size(); ++i){
+                timer.start();
+                doContinue |= activeControllers[i]->control();
+                activeControllerTimeRecords[i]->controlTime = timer.nsecsElapsed() * 1.0e-9;
+            }
+        }
+        if(isProfiling){
+            phaseTimes[PROF_CONTROLLER_CONTROL] = controlTimer.nsecsElapsed();
+        }
+        numControlThreadAllocations =
+            AllocationTracker::numThreadAllocations() - numAllocationsBeforeControl;
+        numControlThreadAllocatedBytes =
+            AllocationTracker::numThreadAllocatedBytes() - numAllocatedBytesBeforeControl;
+        trace.end();
+        
+        {
+            std::lock_guard<std::mutex> lock(controlMutex);
+            isControlFinished = true;
+            isControlToBeContinued = doContinue;
+        }
+        controlCondition.notify_all();
+    }
+    
+exitConcurrentControlLoop:
+    return;
+}
+
+
+/**
+   The controllers of different bodies are executed at the same time. The controllers
+   of the same body are executed in their order in a single task because they may depend
+   on each other, as an RTC exchanging the body states and the controller RTCs connected
+   to it do. The function returns after all of them finish, so that the output functions
+   called after this function always see the results of the current step.
+*/
+bool SimulatorItemImpl::controlControllersInParallel()
+{
+    const int n = activeControllers.size();
+    const int numGroups = controllerGroupHeads.size();
+    controlResults.assign(n, 0);
+
+    auto controlGroup = [this, n, numGroups](int groupIndex){
+        const int end = (groupIndex + 1 < numGroups) ? controllerGroupHeads[groupIndex + 1] : n;
+        TraceRecorder::Scope trace("Controller group", "controller");
+        QElapsedTimer timer;
+        for(int i = controllerGroupHeads[groupIndex]; i < end; ++i){
+            if(isProfiling){
+                timer.start();
+            }
+            controlResults[i] = activeControllers[i]->control();
+            if(isProfiling){
+                activeControllerTimeRecords[i]->controlTime = timer.nsecsElapsed() * 1.0e-9;
+            }
+        }
+    };
+
+    ThreadPool::TaskGroup group(controlThreadPool.get());
+    for(int i=1; i < numGroups; ++i){
+        group.run([&controlGroup, i](){ controlGroup(i); });
+    }
+    controlGroup(0);
+    group.wait();
+
+    bool doContinue = false;
+    for(int i=0; i < n; ++i){
+        doContinue |= (controlResults[i] != 0);
+    }
+    return doContinue;
+}
+
+
+/**
+   The columns of the profiling data are the times given by the simulator item,
+   the times of the simulation phases, the times given by the controllers and the
+   total time of a simulation step. All the times are recorded in nanoseconds.
+*/
+void SimulatorItemImpl::initializeProfiling()
+{
+    profilingNames.clear();
+    self->getProfilingNames(profilingNames);
+    for(int i=0; i < NUM_PROFILING_PHASES; ++i){
+        profilingNames.push_back(profilingPhaseNames[i]);
+    }
+    for(size_t i=0; i < activeControllers.size(); ++i){
+        activeControllers[i]->getProfilingNames(profilingNames);
+    }
+    profilingNames.push_back("Total computation time");
+    const int n = profilingNames.size();
+
+    simProfilingBuf.initialize(NUM_RESULT_BUFFER_FRAMES, n);
+    profilingTimes.reserve(n);
+
+    string profilingSeqName = self->name() + "-profiling";
+    profilingSeqItem = worldItem->findChildItem<MultiValueSeqItem>(profilingSeqName);
+    if(!profilingSeqItem){
+        profilingSeqItem = new MultiValueSeqItem();
+        profilingSeqItem->setTemporal();
+        profilingSeqItem->setName(profilingSeqName);
+        worldItem->addChildItem(profilingSeqItem);
+    }
+    simProfilingSeq = profilingSeqItem->seq();
+    simProfilingSeq->setFrameRate(worldFrameRate);
+    simProfilingSeq->setNumParts(n);
+    simProfilingSeq->setNumFrames(0);
+    // The data of the first step corresponds to the frame one
+    simProfilingSeq->setOffsetTimeFrame(1);
+    profilingSeqSize = std::min(ringBufferSize, static_cast<int>(PROFILING_SEQ_TIME_LENGTH / worldTimeStep_));
+    numFlushedProfilingFrames = 0;
+
+    controllerTimeRecords.clear();
+    updateActiveControllerTimeRecords();
+
+    initializeAllocationTracking();
+
+#ifdef ENABLE_SIMULATION_PROFILING
+    SceneView* view = ViewManager::findView<SceneView>("Simulation Scene");
+    if(!view){
+        view = SceneView::instance();
+    }
+    sw = view->sceneWidget();
+    sw->profilingNames = profilingNames;
+#endif
+}
+
+
+void SimulatorItemImpl::initializeAllocationTracking()
+{
+    isTrackingAllocations = AllocationTracker::isAvailable();
+    for(auto& record : phaseAllocationRecords){
+        record.numAllocations = 0;
+        record.numAllocatedBytes = 0;
+        record.numAllocatingSteps = 0;
+        record.lastAllocationFrame = -1;
+    }
+    numControlThreadAllocations = 0;
+    numControlThreadAllocatedBytes = 0;
+}
+
+
+void SimulatorItemImpl::markThreadAllocations()
+{
+    numThreadAllocationsAtPhaseEnd = AllocationTracker::numThreadAllocations();
+    numThreadAllocatedBytesAtPhaseEnd = AllocationTracker::numThreadAllocatedBytes();
+}
+
+
+void SimulatorItemImpl::addThreadAllocationsToPhase(int phase)
+{
+    const int64_t numAllocations = AllocationTracker::numThreadAllocations();
+    const int64_t numAllocatedBytes = AllocationTracker::numThreadAllocatedBytes();
+    addPhaseAllocations(
+        phase,
+        numAllocations - numThreadAllocationsAtPhaseEnd,
+        numAllocatedBytes - numThreadAllocatedBytesAtPhaseEnd);
+    numThreadAllocationsAtPhaseEnd = numAllocations;
+    numThreadAllocatedBytesAtPhaseEnd = numAllocatedBytes;
+}
+
+
+void SimulatorItemImpl::addPhaseAllocations(int phase, int64_t numAllocations, int64_t numAllocatedBytes)
+{
+    if(numAllocations > 0){
+        auto& record = phaseAllocationRecords[phase];
+        record.numAllocations += numAllocations;
+        record.numAllocatedBytes += numAllocatedBytes;
+        if(record.lastAllocationFrame != currentFrame){
+            ++record.numAllocatingSteps;
+            record.lastAllocationFrame = currentFrame;
+        }
+    }
+}
+
+
+void SimulatorItemImpl::bufferProfilingData()
+{
+    double* buf = simProfilingBuf.beginFrame();
+    int index = 0;
+
+    profilingTimes.clear();
+    self->getProfilingTimes(profilingTimes);
+    for(auto& time : profilingTimes){
+        buf[index++] = time * 1.0e9;
+    }
+    for(int i=0; i < NUM_PROFILING_PHASES; ++i){
+        buf[index++] = phaseTimes[i];
+    }
+    for(size_t i=0; i < activeControllers.size(); ++i){
+        profilingTimes.clear();
+        activeControllers[i]->getProfilingTimes(profilingTimes);
+        for(auto& time : profilingTimes){
+            buf[index++] = time * 1.0e9;
+        }
+    }
+    buf[index] = stepTimer.nsecsElapsed();
+
+    simProfilingBuf.endFrame();
+}
+
+
+/**
+   This is called from the simulation thread. The statistics are collected into a local array
+   so that the mutex is only locked while the array is swapped.
+*/
+void SimulatorItemImpl::copyTimeStatistics()
+{
+    isTimeStatisticsRequested = false;
+
+    vector<SimulationTimeStatistics> statistics;
+    for(auto& record : controllerTimeRecords){
+        statistics.push_back({ record.name, "Input", record.inputTimes });
+        statistics.push_back({ record.name, "Control", record.controlTimes });
+        statistics.push_back({ record.name, "Output", record.outputTimes });
+    }
+    self->getDeviceTimeStatistics(statistics);
+    for(auto& subSimulator : subSimulatorItems){
+        subSimulator->getDeviceTimeStatistics(statistics);
+    }
+
+    vector<SimulatorItem::StepAllocationStatistics> allocationStatistics;
+    if(isTrackingAllocations){
+        for(int i=0; i < NUM_PROFILING_PHASES; ++i){
+            auto& record = phaseAllocationRecords[i];
+            // The phase names without the " time" suffix of the profiling names
+            string phase(profilingPhaseNames[i]);
+            phase.erase(phase.rfind(" time"));
+            allocationStatistics.push_back(
+                { phase, record.numAllocations, record.numAllocatedBytes,
+                  record.numAllocatingSteps, record.lastAllocationFrame });
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(timeStatisticsMutex);
+    timeStatisticsCopy.swap(statistics);
+    realtimeSyncStatisticsCopy = realtimeSyncStatistics;
+    stepAllocationStatisticsCopy.swap(allocationStatistics);
+}
+
+
+std::vector<SimulationTimeStatistics> SimulatorItem::timeStatistics() const
+{
+    impl->isTimeStatisticsRequested = true;
+    std::lock_guard<std::mutex> lock(impl->timeStatisticsMutex);
+    return impl->timeStatisticsCopy;
+}
+
+
+std::vector<SimulatorItem::StepAllocationStatistics> SimulatorItem::stepAllocationStatistics() const
+{
+    impl->isTimeStatisticsRequested = true;
+    std::lock_guard<std::mutex> lock(impl->timeStatisticsMutex);
+    return impl->stepAllocationStatisticsCopy;
+}
+
+
+SimulatorItem::RealtimeSyncStatistics SimulatorItem::realtimeSyncStatistics() const
+{
+    impl->isTimeStatisticsRequested = true;
+    std::lock_guard<std::mutex> lock(impl->timeStatisticsMutex);
+    return impl->realtimeSyncStatisticsCopy;
+}
+
+
+void SimulatorItemImpl::clearRealtimeSyncStatistics()
+{
+    realtimeSyncStatistics.numSteps = 0;
+    realtimeSyncStatistics.numMissedDeadlines = 0;
+    realtimeSyncStatistics.numSkippedResultFrames = 0;
+    realtimeSyncStatistics.lateness.clear();
+}
+
+
+/**
+   \param lateness The time [ms] by which the step finished after its wall-clock time,
+   which is negative when the step is in time.
+   \param timeStep The time step [ms]
+*/
+void SimulatorItemImpl::recordRealtimeSyncLateness(double lateness, double timeStep)
+{
+    auto& statistics = realtimeSyncStatistics;
+    ++statistics.numSteps;
+    if(lateness > 0.0){
+        ++statistics.numMissedDeadlines;
+        statistics.lateness.record(lateness * 1.0e-3);
+    } else {
+        statistics.lateness.record(0.0);
+    }
+    isBehindRealtime.store(lateness > timeStep, std::memory_order_relaxed);
+}
+
+
+/**
+   Sleeps until REALTIME_SYNC_BUSY_WAIT_TIME before the given time and busy-waits for the rest
+   of the time, so that the wait is not extended by the coarse wake-up of the sleep.
+   \param time The time [ms] of the timer to wait for
+*/
+void SimulatorItemImpl::waitForRealtime(QElapsedTimer& timer, double time)
+{
+    const double sleepTime = time - REALTIME_SYNC_BUSY_WAIT_TIME - timer.nsecsElapsed() / 1.0e6;
+    if(sleepTime > 0.0){
+        std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(sleepTime * 1000.0)));
+    }
+    const qint64 targetTime = static_cast<qint64>(time * 1.0e6);
+    while(timer.nsecsElapsed() < targetTime){ }
+}
+
+
+void SimulatorItemImpl::flushProfilingData(bool isLoopStopped)
+{
+    const int numFrames = simProfilingBuf.numFrames(isLoopStopped);
+    if(numFrames == 0){
+        return;
+    }
+    const int width = simProfilingBuf.width();
+    bool offsetChanged = false;
+    for(int i=0 ; i < numFrames; ++i){
+        double* buf = simProfilingBuf.frame(i);
+        if(simProfilingSeq->numFrames() >= profilingSeqSize){
+            simProfilingSeq->popFrontFrame();
+            offsetChanged = true;
+        }
+        std::copy(buf, buf + width, simProfilingSeq->appendFrame().begin());
+    }
+    simProfilingBuf.popFrames(numFrames);
+    numFlushedProfilingFrames += numFrames;
+    
+    if(offsetChanged){
+        simProfilingSeq->setOffsetTimeFrame(numFlushedProfilingFrames + 1 - simProfilingSeq->numFrames());
+    }
+    if(!isBatchMode){
+        profilingSeqItem->notifyUpdate();
+    }
+}
+
+
+/**
+   The profiling data is saved as a CSV file whose first column is the simulation time.
+*/
+bool SimulatorItemImpl::saveProfilingData(const string& filename, ostream& os)
+{
+    if(!simProfilingSeq){
+        os << _("There is no profiling data.") << endl;
+        return false;
+    }
+    std::ofstream file(filename.c_str());
+    if(!file){
+        os << format(_("\"{}\" cannot be opened."), filename) << endl;
+        return false;
+    }
+
+    file << "Time";
+    for(auto& name : profilingNames){
+        file << "," << name;
+    }
+    file << "\n";
+
+    const int numFrames = simProfilingSeq->numFrames();
+    const int numParts = simProfilingSeq->numParts();
+    const int offset = simProfilingSeq->offsetTimeFrame();
+    for(int i=0; i < numFrames; ++i){
+        file << ((offset + i) / worldFrameRate);
+        auto frame = simProfilingSeq->frame(i);
+        for(int j=0; j < numParts; ++j){
+            file << "," << frame[j];
+        }
+        file << "\n";
+    }
+    
+    return !file.fail();
+}
+
+
+SimulationCheckpointPtr SimulatorItem::storeCheckpoint()
+{
+    return impl->storeCheckpoint();
+}
+
+
+SimulationCheckpointPtr SimulatorItemImpl::storeCheckpoint()
+{
+    if(!isDoingSimulationLoop){
+        return nullptr;
+    }
+    if(isInSimulationLoopThread()){
+        return doStoreCheckpoint();
+    }
+
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+    checkpointRequestType = STORE_CHECKPOINT;
+    requestedCheckpoint.reset();
+    isCheckpointRequestDone = false;
+    hasCheckpointRequest = true;
+
+    while(!isCheckpointRequestDone && isDoingSimulationLoop){
+        checkpointCondition.wait_for(lock, std::chrono::milliseconds(10));
+    }
+
+    SimulationCheckpointPtr checkpoint = requestedCheckpoint;
+    requestedCheckpoint.reset();
+    checkpointRequestType = NO_CHECKPOINT_REQUEST;
+    hasCheckpointRequest = false;
+    return checkpoint;
+}
+
+
+bool SimulatorItem::restoreCheckpoint(SimulationCheckpoint* checkpoint)
+{
+    return impl->restoreCheckpoint(checkpoint);
+}
+
+
+void SimulatorItem::setCheckpointInterval(double interval)
+{
+    impl->checkpointInterval = std::max(0.0, interval);
+}
+
+
+double SimulatorItem::checkpointInterval() const
+{
+    return impl->checkpointInterval;
+}
+
+
+std::vector<SimulationCheckpointPtr> SimulatorItem::periodicCheckpoints() const
+{
+    std::lock_guard<std::mutex> lock(impl->periodicCheckpointMutex);
+    return std::vector<SimulationCheckpointPtr>(
+        impl->periodicCheckpoints.begin(), impl->periodicCheckpoints.end());
+}
+
+
+bool SimulatorItem::startSimulationFromCheckpoint(SimulationCheckpoint* checkpoint)
+{
+    return impl->startSimulationFromCheckpoint(checkpoint);
+}
+
+
+bool SimulatorItemImpl::startSimulationFromCheckpoint(SimulationCheckpoint* checkpoint)
+{
+    if(!checkpoint || checkpoint->simulator != this){
+        return false;
+    }
+    branchCheckpoint = checkpoint;
+    bool result = self->startSimulation(true);
+    branchCheckpoint.reset();
+    return result;
+}
+
+
+bool SimulatorItem::startSimulationFromTime(double time)
+{
+    if(auto checkpoint = impl->findPeriodicCheckpoint(time)){
+        return impl->startSimulationFromCheckpoint(checkpoint);
+    }
+    return startSimulation(true);
+}
+
+
+bool SimulatorItemImpl::restoreCheckpoint(SimulationCheckpoint* checkpoint)
+{
+    if(!isDoingSimulationLoop || !isValidCheckpoint(checkpoint)){
+        return false;
+    }
+    if(isInSimulationLoopThread()){
+        if(!isBatchMode && isRecordingEnabled){
+            return false;
+        }
+        checkpointToRestore = checkpoint;
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+    checkpointRequestType = RESTORE_CHECKPOINT;
+    requestedCheckpoint = checkpoint;
+    isLoopHeldForCheckpoint = false;
+    areResultsFlushedForCheckpoint = false;
+    isCheckpointRequestDone = false;
+    checkpointRequestResult = false;
+    hasCheckpointRequest = true;
+
+    while(!isLoopHeldForCheckpoint && !isCheckpointRequestDone && isDoingSimulationLoop){
+        checkpointCondition.wait_for(lock, std::chrono::milliseconds(10));
+    }
+    if(isLoopHeldForCheckpoint){
+        /*
+          The simulation thread does not write the result buffers until the flag is set,
+          so the results including the overflow frames can be flushed here.
+        */
+        lock.unlock();
+        flushResults(true);
+        if(isRecordingEnabled){
+            discardResultsAfter(checkpoint->frame());
+        }
+        lock.lock();
+        areResultsFlushedForCheckpoint = true;
+        checkpointCondition.notify_all();
+        while(!isCheckpointRequestDone){
+            checkpointCondition.wait(lock);
+        }
+    }
+
+    bool result = isCheckpointRequestDone && checkpointRequestResult;
+    requestedCheckpoint.reset();
+    checkpointRequestType = NO_CHECKPOINT_REQUEST;
+    hasCheckpointRequest = false;
+    return result;
+}
+
+
+bool SimulatorItemImpl::isValidCheckpoint(SimulationCheckpoint* checkpoint) const
+{
+    return isCompatibleCheckpoint(checkpoint) && checkpoint->simulationId == simulationId;
+}
+
+
+/**
+   A checkpoint stored in a previous simulation is compatible with the current simulation
+   when the simulation has the same numbers of the simulation bodies and the controllers.
+   The states of each body and the engine are checked when they are restored.
+*/
+bool SimulatorItemImpl::isCompatibleCheckpoint(SimulationCheckpoint* checkpoint) const
+{
+    return checkpoint &&
+        checkpoint->simulator == this &&
+        checkpoint->bodyStates.size() == allSimBodies.size() &&
+        checkpoint->controllerStates.size() == activeControllers.size();
+}
+
+
+SimulationCheckpointPtr SimulatorItemImpl::doStoreCheckpoint()
+{
+    SimulationCheckpointPtr checkpoint = new SimulationCheckpoint;
+
+    checkpoint->engineState = self->storeEngineState();
+    if(!checkpoint->engineState){
+        return nullptr;
+    }
+
+    checkpoint->simulator = this;
+    checkpoint->simulationId = simulationId;
+    checkpoint->frame_ = frameOfBodyStates;
+    checkpoint->time_ = frameOfBodyStates / worldFrameRate;
+
+    checkpoint->bodyStates.reserve(allSimBodies.size());
+    for(auto& simBody : allSimBodies){
+        checkpoint->bodyStates.push_back(simBody->impl->storeCheckpointState());
+    }
+    checkpoint->controllerStates.reserve(activeControllers.size());
+    for(auto& controller : activeControllers){
+        checkpoint->controllerStates.push_back(controller->storeCheckpointState());
+    }
+
+    return checkpoint;
+}
+
+
+bool SimulatorItemImpl::doRestoreCheckpoint(SimulationCheckpoint* checkpoint)
+{
+    if(!isCompatibleCheckpoint(checkpoint)){
+        return false;
+    }
+    if(!self->restoreEngineState(checkpoint->engineState)){
+        return false;
+    }
+
+    bool result = true;
+    for(size_t i=0; i < allSimBodies.size(); ++i){
+        result &= allSimBodies[i]->impl->restoreCheckpointState(checkpoint->bodyStates[i]);
+    }
+    for(size_t i=0; i < activeControllers.size(); ++i){
+        if(auto& state = checkpoint->controllerStates[i]){
+            result &= activeControllers[i]->restoreCheckpointState(state);
+        }
+    }
+
+    currentFrame = checkpoint->frame_;
+    frameOfBodyStates = checkpoint->frame_;
+    frameAtLastBufferWriting.store(currentFrame, std::memory_order_release);
+
+    // The periodic checkpoints after the restored one are not in the history of the simulation anymore
+    {
+        std::lock_guard<std::mutex> lock(periodicCheckpointMutex);
+        while(!periodicCheckpoints.empty() && periodicCheckpoints.back()->frame_ > currentFrame){
+            periodicCheckpoints.pop_back();
+        }
+    }
+
+    return result;
+}
+
+
+/**
+   This function is called in the simulation loop thread at the beginning of a step.
+*/
+void SimulatorItemImpl::storePeriodicCheckpoint()
+{
+    SimulationCheckpointPtr checkpoint = doStoreCheckpoint();
+    if(!checkpoint){
+        // The simulator item does not support checkpoints
+        periodicCheckpointIntervalFrames = 0;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(periodicCheckpointMutex);
+    periodicCheckpoints.push_back(checkpoint);
+    if(periodicCheckpoints.size() > MAX_NUM_PERIODIC_CHECKPOINTS){
+        periodicCheckpointIntervalFrames *= 2;
+        const int interval = periodicCheckpointIntervalFrames;
+        periodicCheckpoints.erase(
+            std::remove_if(periodicCheckpoints.begin(), periodicCheckpoints.end(),
+                           [interval](const SimulationCheckpointPtr& c){ return c->frame_ % interval != 0; }),
+            periodicCheckpoints.end());
+    }
+}
+
+
+SimulationCheckpointPtr SimulatorItemImpl::findPeriodicCheckpoint(double time) const
+{
+    std::lock_guard<std::mutex> lock(periodicCheckpointMutex);
+    const int frame = static_cast<int>(std::floor(time * worldFrameRate + 1.0e-6));
+    for(auto p = periodicCheckpoints.rbegin(); p != periodicCheckpoints.rend(); ++p){
+        if((*p)->frame_ <= frame){
+            return *p;
+        }
+    }
+    return nullptr;
+}
+
+
+/**
+   This function is called in startSimulation after the simulation bodies, the engine and the
+   controllers are initialized. The results buffered for the initial states are replaced with
+   the states restored from the checkpoint.
+*/
+void SimulatorItemImpl::restoreBranchCheckpoint()
+{
+    SimulationCheckpointPtr checkpoint = branchCheckpoint;
+    branchCheckpoint.reset();
+
+    if(!isCompatibleCheckpoint(checkpoint)){
+        mv->putln(format(_("The checkpoint at {0} [s] does not match the simulation by {1}. "
+                           "The simulation starts from the beginning."), checkpoint->time(), self->name()),
+                  MessageView::WARNING);
+    } else if(!doRestoreCheckpoint(checkpoint)){
+        mv->putln(format(_("The states at {0} [s] cannot be completely restored by {1}."),
+                         checkpoint->time(), self->name()),
+                  MessageView::WARNING);
     }
 
-    midDynamicsFunctions.call();
+    const int frame = currentFrame;
+    if(frame == 0){
+        std::lock_guard<std::mutex> lock(periodicCheckpointMutex);
+        periodicCheckpoints.clear();
+    }
+    branchTime = frame / worldFrameRate;
+    if(maxFrame != std::numeric_limits<int>::max()){
+        maxFrame = std::max(0, maxFrame - frame);
+    }
 
-    self->stepSimulation(activeSimBodies);
+    for(auto& simBody : allSimBodies){
+        simBody->impl->startResultsFrom(frame);
+    }
+    frameInfoBuf.initialize(NUM_RESULT_BUFFER_FRAMES, 1);
+    BufferedFrameInfo* info = frameInfoBuf.beginFrame();
+    info->frame = frame;
+    info->hasCollisionData = false;
+    info->collisionPairs.reset();
+    frameInfoBuf.endFrame();
 
-    shared_ptr<CollisionLinkPairList> collisionPairs;
     if(isRecordingEnabled && recordCollisionData){
-        collisionPairs = self->getCollisions();
+        discardFramesFrom(*collisionSeq, frame);
+        collisionSeq->appendFrame(CollisionLinkPairList());
+    }
+    if(frame > 0){
+        mv->putln(format(_("Simulation by {0} is branched from the checkpoint at {1} [s]."),
+                         self->name(), branchTime));
     }
+}
 
-    if(useControllerThreads){
-        {
-            std::unique_lock<std::mutex> lock(controlMutex);
-            while(!isControlFinished){
-                controlCondition.wait(lock);
+
+/**
+   This function is called in the simulation loop thread between the simulation steps.
+*/
+void SimulatorItemImpl::processCheckpointRequests()
+{
+    if(checkpointToRestore){
+        SimulationCheckpointPtr checkpoint = checkpointToRestore;
+        checkpointToRestore.reset();
+        if(isBatchMode){
+            // The results are flushed in this thread in the batch mode
+            flushResults(true);
+            if(isRecordingEnabled){
+                discardResultsAfter(checkpoint->frame());
             }
         }
-        isControlFinished = false;
-        doContinue |= isControlToBeContinued;
+        doRestoreCheckpoint(checkpoint);
     }
 
-    postDynamicsFunctions.call();
+    if(!hasCheckpointRequest){
+        return;
+    }
+    
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+    if(isCheckpointRequestDone){
+        return;
+    }
+    if(checkpointRequestType == STORE_CHECKPOINT){
+        requestedCheckpoint = doStoreCheckpoint();
+        checkpointRequestResult = (requestedCheckpoint.get() != nullptr);
+        
+    } else if(checkpointRequestType == RESTORE_CHECKPOINT){
+        isLoopHeldForCheckpoint = true;
+        checkpointCondition.notify_all();
+        while(!areResultsFlushedForCheckpoint){
+            checkpointCondition.wait(lock);
+        }
+        checkpointRequestResult = doRestoreCheckpoint(requestedCheckpoint);
+        isLoopHeldForCheckpoint = false;
+    }
+    isCheckpointRequestDone = true;
+    checkpointCondition.notify_all();
+}
 
-    {
-        resultBufMutex.lock();
 
-        ++numBufferedFrames;
-        for(size_t i=0; i < activeSimBodies.size(); ++i){
-            activeSimBodies[i]->bufferResults();
+void SimulatorItemImpl::cancelCheckpointRequests()
+{
+    checkpointToRestore.reset();
+    {
+        std::lock_guard<std::mutex> lock(checkpointMutex);
+        if(checkpointRequestType != NO_CHECKPOINT_REQUEST){
+            isCheckpointRequestDone = true;
+            checkpointRequestResult = false;
         }
-        collisionPairsBuf.push_back(collisionPairs);
-        frameAtLastBufferWriting = currentFrame;
-
-        resultBufMutex.unlock();
     }
+    checkpointCondition.notify_all();
+}
 
-    if(useControllerThreads){
-#ifdef ENABLE_SIMULATION_PROFILING
-        timer.start();
-#endif
-        for(size_t i=0; i < activeControllers.size(); ++i){
-            activeControllers[i]->output();
-        }
-#ifdef ENABLE_SIMULATION_PROFILING
-        controllerTime += timer.nsecsElapsed();
-#endif
-    } else {
-#ifdef ENABLE_SIMULATION_PROFILING
-        timer.start();
-#endif
-        for(size_t i=0; i < activeControllers.size(); ++i){
-            ControllerItem* controller = activeControllers[i];
-            if(!controller->isImmediateMode()){
-                controller->output(); 
-            }
-        }
-#ifdef ENABLE_SIMULATION_PROFILING
-        controllerTime += timer.nsecsElapsed();
-#endif
+
+/**
+   This function is called in the main thread, or in the simulation loop thread in the batch mode.
+*/
+void SimulatorItemImpl::discardResultsAfter(int frame)
+{
+    for(auto& simBody : allSimBodies){
+        simBody->impl->discardResultsAfter(frame);
     }
+    if(collisionSeq){
+        discardFramesAfter(*collisionSeq, frame);
+    }
+    if(isProfiling && simProfilingSeq){
+        discardFramesAfter(*simProfilingSeq, frame);
+        numFlushedProfilingFrames = std::min(numFlushedProfilingFrames, frame);
+    }
+    lastFrameToFlush = std::min(lastFrameToFlush, frame);
 
-    return doContinue;
+    if(isRecordingEnabled && isTimeBarOwner){
+        timeBar->updateFillLevel(fillLevelId, frame / worldFrameRate);
+    }
 }
 
 
-void SimulatorItemImpl::concurrentControlLoop()
+/**
+   This function is called by the main thread except in the batch mode.
+   The buffers are read without locking the simulation thread, so only the frames
+   whose information has been written when this function begins are flushed.
+   \param isLoopStopped true when the simulation thread does not write the buffers.
+   In this case the frames in the overflow queues of the buffers are also flushed.
+*/
+void SimulatorItemImpl::flushResults(bool isLoopStopped)
 {
-    while(true){
-        {
-            std::unique_lock<std::mutex> lock(controlMutex);
-            while(true){
-                if(isExitingControlLoopRequested){
-                    goto exitConcurrentControlLoop;
-                }
-                if(isControlRequested){
-                    isControlRequested = false;
-                    isControlToBeContinued = false;
-                    break;
-                }
-                controlCondition.wait(lock);
-            }
-        }
+    TraceRecorder::Scope trace("Flush results", "simulation");
 
-        bool doContinue = false;
-#ifdef ENABLE_SIMULATION_PROFILING
-        timer.start();
-#endif
-        for(size_t i=0; i < activeControllers.size(); ++i){
-            doContinue |= activeControllers[i]->control();
+    isFlushingStoppedLoop = isLoopStopped;
+
+    if(!isBatchMode){
+        const bool doSuspend = isFastForwardMode && !isLoopStopped && !pauseRequested;
+        if(doSuspend != isGuiUpdateSuspended){
+            setGuiUpdateSuspended(doSuspend);
         }
-#ifdef ENABLE_SIMULATION_PROFILING
-        controllerTime += timer.nsecsElapsed();
-#endif
-        
-        {
-            std::lock_guard<std::mutex> lock(controlMutex);
-            isControlFinished = true;
-            isControlToBeContinued = doContinue;
+        if(isGuiUpdateSuspended){
+            InfoBar::instance()->notify(
+                format(_("Fast-forwarding {0}: {1:.2f} [s]"), self->name(),
+                       frameAtLastBufferWriting.load(std::memory_order_acquire) / worldFrameRate));
+            // The results are flushed in large blocks to reduce the work of the main thread
+            if(frameInfoBuf.numFrames(false) < NUM_BATCH_FLUSH_FRAMES){
+                return;
+            }
         }
-        controlCondition.notify_all();
     }
-    
-exitConcurrentControlLoop:
-    return;
-}
 
+    if(isProfiling){
+        flushProfilingData(isLoopStopped);
+    }
 
-void SimulatorItemImpl::flushResults()
-{
-    resultBufMutex.lock();
+    numFramesToFlush = frameInfoBuf.numFrames(isLoopStopped);
+    if(numFramesToFlush == 0){
+        return;
+    }
+    lastFrameToFlush = frameInfoBuf.frame(numFramesToFlush - 1)->frame;
 
     if(worldLogFileItem){
-        if(numBufferedFrames > 0){
-            int firstFrame = frameAtLastBufferWriting - (numBufferedFrames - 1);
-            for(int bufFrame = 0; bufFrame < numBufferedFrames; ++bufFrame){
-                double time = (firstFrame + bufFrame) * worldTimeStep_;
-                while(time >= nextLogTime){
-                    worldLogFileItem->beginFrameOutput(time);
-                    for(size_t i=0; i < activeSimBodies.size(); ++i){
-                        activeSimBodies[i]->impl->flushResultsToWorldLogFile(bufFrame);
-                    }
-                    worldLogFileItem->endFrameOutput();
-                    nextLogTime = ++nextLogFrame * logTimeStep;
+        for(int bufFrame = 0; bufFrame < numFramesToFlush; ++bufFrame){
+            double time = frameInfoBuf.frame(bufFrame)->frame * worldTimeStep_;
+            while(time >= nextLogTime){
+                worldLogFileItem->beginFrameOutput(time);
+                for(size_t i=0; i < activeSimBodies.size(); ++i){
+                    activeSimBodies[i]->impl->flushResultsToWorldLogFile(bufFrame);
                 }
+                worldLogFileItem->endFrameOutput();
+                nextLogTime = ++nextLogFrame * logTimeStep;
             }
         }
     }
@@ -2150,52 +3951,219 @@ void SimulatorItemImpl::flushResults()
     bool offsetChanged;
     if(isRecordingEnabled && recordCollisionData){
         offsetChanged = false;
-        for(size_t i=0 ; i < collisionPairsBuf.size(); ++i){
+        for(int i=0 ; i < numFramesToFlush; ++i){
+            BufferedFrameInfo* info = frameInfoBuf.frame(i);
+            if(!info->hasCollisionData){
+                continue;
+            }
             if(collisionSeq->numFrames() >= ringBufferSize){
                 collisionSeq->popFrontFrame();
                 offsetChanged = true;
             }
-            CollisionSeq::Frame collisionSeq0 = collisionSeq->appendFrame();
-            collisionSeq0[0] = collisionPairsBuf[i];
+            collisionSeq->appendFrame(*info->collisionPairs);
         }
         if(offsetChanged){
-            collisionSeq->setOffsetTimeFrame(currentFrame + 1 - collisionSeq->numFrames());
+            collisionSeq->setOffsetTimeFrame(lastFrameToFlush + 1 - collisionSeq->numFrames());
         }
     }
-    collisionPairsBuf.clear();
+    // release the collision data held by the buffer
+    for(int i=0 ; i < numFramesToFlush; ++i){
+        frameInfoBuf.frame(i)->collisionPairs.reset();
+    }
+    frameInfoBuf.popFrames(numFramesToFlush);
 
-#ifdef ENABLE_SIMULATION_PROFILING
-    offsetChanged = false;
-    for(int i=0 ; i < simProfilingBuf.rowSize(); i++){
-        Deque2D<double>::Row buf = simProfilingBuf.row(i);
-        if(simProfilingSeq.numFrames() >= ringBufferSize){
-            simProfilingSeq.popFrontFrame();
-            offsetChanged = true;
-        }
-        std::copy(buf.begin(), buf.end(), simProfilingSeq.appendFrame().begin());
+    if(isRecordingEnabled && recordingMemoryBudget > 0){
+        limitRecordingMemory();
     }
-    if(offsetChanged){
-        simProfilingSeq.setOffsetTimeFrame(currentFrame + 1 - simProfilingSeq.numFrames());
+
+    int frame = lastFrameToFlush;
+
+    if(isBatchMode){
+        return;
     }
-    simProfilingBuf.resizeRow(0);
-#endif
 
-    int frame = frameAtLastBufferWriting;
-    
-    numBufferedFrames = 0;
-    
-    resultBufMutex.unlock();
+    if(isRecordingEnabled){
+        if(isTimeBarOwner){
+            double fillLevel = frame / worldFrameRate;
+            timeBar->updateFillLevel(fillLevelId, fillLevel);
+        }
+    } else if(!isGuiUpdateSuspended){
+        if(!isLoopStopped &&
+           isBehindRealtime.load(std::memory_order_relaxed) &&
+           realtimeSyncCatchUpPolicy.is(SimulatorItem::CATCH_UP_DROP_GUI_FRAMES)){
+            // The devices changed in the dropped flushes are notified in the next notification
+            if(++numGuiFlushesBehindRealtime < NUM_GUI_FLUSHES_PER_NOTIFICATION_BEHIND_REALTIME){
+                return;
+            }
+        }
+        numGuiFlushesBehindRealtime = 0;
+        const double time = frame / worldFrameRate;
+        {
+            BodyItem::KinematicStateChangeBatch batch;
+            for(size_t i=0; i < activeSimBodies.size(); ++i){
+                activeSimBodies[i]->impl->notifyResults(time);
+            }
+        }
+        if(isTimeBarOwner){
+            timeBar->setTime(time);
+        }
+    }
+}
+
+
+/**
+   The playback of the time bar is stopped while the GUI update is suspended in the fast-forward
+   mode, and it is restarted from the fill level, which is updated in the suspension, after it.
+   The results which are not recorded are notified with the state of the last flushed frame.
+*/
+void SimulatorItemImpl::setGuiUpdateSuspended(bool on)
+{
+    isGuiUpdateSuspended = on;
+
+    if(on){
+        if(isRecordingEnabled && isTimeBarOwner && timeBar->isDoingPlayback()){
+            timeBar->stopPlayback();
+        }
+        return;
+    }
 
+    InfoBar::instance()->notify("");
     if(isRecordingEnabled){
-        double fillLevel = frame / worldFrameRate;
-        timeBar->updateFillLevel(fillLevelId, fillLevel);
+        if(isTimeBarOwner){
+            timeBar->startPlaybackFromFillLevel();
+        }
     } else {
-        const double time = frame / worldFrameRate;
-        for(size_t i=0; i < activeSimBodies.size(); ++i){
-            activeSimBodies[i]->impl->notifyResults(time);
+        const double time = lastFrameToFlush / worldFrameRate;
+        {
+            BodyItem::KinematicStateChangeBatch batch;
+            for(size_t i=0; i < activeSimBodies.size(); ++i){
+                activeSimBodies[i]->impl->notifyResults(time);
+            }
+        }
+        if(isTimeBarOwner){
+            timeBar->setTime(time);
+        }
+    }
+}
+
+
+/**
+   The fill level of the time bar is only updated by the owner so that the playback
+   of the owner is not limited by the progress of the other simulations.
+*/
+void SimulatorItemImpl::setTimeBarOwner(bool on)
+{
+    if(on == isTimeBarOwner){
+        return;
+    }
+    isTimeBarOwner = on;
+    if(isRecordingEnabled){
+        if(on){
+            fillLevelId = timeBar->startFillLevelUpdate();
+            timeBar->updateFillLevel(fillLevelId, lastFrameToFlush / worldFrameRate);
+        } else {
+            timeBar->stopFillLevelUpdate(fillLevelId);
+        }
+    } else if(on){
+        timeBar->setTime(lastFrameToFlush / worldFrameRate);
+    }
+}
+
+
+size_t SimulatorItemImpl::getRecordingChannels(vector<RecordingChannel>& channels) const
+{
+    for(auto& simBody : allSimBodies){
+        auto impl = simBody->impl;
+        if(!impl->body_){
+            continue;
+        }
+        const string& name = impl->body_->name();
+        if(impl->linkPosResults && impl->linkPosBuf.width() > 0){
+            addRecordingChannel(
+                channels, name, "link positions", impl->linkPosResults, impl->linkPosRecordingInterval);
+        }
+        if(impl->jointPosResults && impl->jointPosBuf.width() > 0){
+            addRecordingChannel(
+                channels, name, "joint positions", impl->jointPosResults, impl->jointPosRecordingInterval);
+        }
+        if(impl->deviceStateResults && impl->deviceStateBuf.width() > 0){
+            addRecordingChannel(channels, name, "device states", impl->deviceStateResults, 1);
+        }
+    }
+    if(collisionSeq && recordCollisionData){
+        addRecordingChannel(channels, string(), "collisions", collisionSeq, 1);
+    }
+
+    size_t totalBytes = 0;
+    for(auto& channel : channels){
+        totalBytes += channel.numBytes;
+    }
+    return totalBytes;
+}
+
+
+/**
+   The frames before the same simulation frame are discarded from all the channels so that
+   the recorded results keep covering the same time range.
+*/
+void SimulatorItemImpl::limitRecordingMemory()
+{
+    vector<RecordingChannel> channels;
+    const size_t totalBytes = getRecordingChannels(channels);
+    if(totalBytes <= recordingMemoryBudget){
+        return;
+    }
+    int firstFrame = lastFrameToFlush;
+    for(auto& channel : channels){
+        if(channel.numFrames > 0){
+            firstFrame = std::min(firstFrame, channel.firstFrame);
         }
-        timeBar->setTime(time);
     }
+    const int numFrames = lastFrameToFlush + 1 - firstFrame;
+    if(numFrames <= 1){
+        return;
+    }
+
+    // The frames are discarded in blocks so that the discarding is not done in every flush
+    const int blockSize = std::max(1, static_cast<int>(worldFrameRate));
+    const double bytesPerFrame = static_cast<double>(totalBytes) / numFrames;
+    int numFramesToDiscard = static_cast<int>(std::ceil((totalBytes - recordingMemoryBudget) / bytesPerFrame));
+    numFramesToDiscard = (numFramesToDiscard + blockSize - 1) / blockSize * blockSize;
+
+    // The latest frame is always kept
+    const int frame = std::min(firstFrame + numFramesToDiscard, lastFrameToFlush);
+    for(auto& channel : channels){
+        channel.discardFramesBefore(toRecordedFrame(frame, channel.interval));
+    }
+}
+
+
+void SimulatorItem::setRecordingMemoryBudget(size_t numBytes)
+{
+    impl->recordingMemoryBudget = numBytes;
+}
+
+
+size_t SimulatorItem::recordingMemoryBudget() const
+{
+    return impl->recordingMemoryBudget;
+}
+
+
+size_t SimulatorItem::getRecordingMemoryUsage(std::vector<RecordingChannelUsage>& out_usages) const
+{
+    vector<RecordingChannel> channels;
+    const size_t totalBytes = impl->getRecordingChannels(channels);
+    out_usages.clear();
+    for(auto& channel : channels){
+        RecordingChannelUsage usage;
+        usage.bodyName = channel.bodyName;
+        usage.channelName = channel.channelName;
+        usage.numFrames = channel.numFrames;
+        usage.numBytes = channel.numBytes;
+        out_usages.push_back(usage);
+    }
+    return totalBytes;
 }
 
 
@@ -2271,13 +4239,17 @@ void SimulatorItemImpl::onSimulationLoopStopped()
         subSimulatorItems[i]->finalizeSimulation();
     }
 
-    flushResults();
+    flushResults(true);
 
-    if(isRecordingEnabled){
-        timeBar->stopFillLevelUpdate(fillLevelId);
+    if(worldLogFileItem){
+        worldLogFileItem->endOutput();
     }
 
-    mv->notify(format(_("Simulation by {0} has finished at {1} [s]."), self->name(), finishTime));
+    if(!isBatchMode && SimulatedMotionEngineManager::instance){
+        SimulatedMotionEngineManager::instance->onSimulationFinished(self);
+    }
+
+    mv->notify(format(_("Simulation by {0} has finished at {1} [s]."), self->name(), branchTime + finishTime));
     mv->putln(format(_("Computation time is {0} [s], computation time / simulation time = {1}."),
                      actualSimulationTime, (actualSimulationTime / finishTime)));
 
@@ -2325,15 +4297,13 @@ double SimulatorItemImpl::currentTime() const
 
 int SimulatorItem::simulationFrame() const
 {
-    QMutexLocker locker(&impl->resultBufMutex);
-    return impl->frameAtLastBufferWriting;
+    return impl->frameAtLastBufferWriting.load(std::memory_order_acquire);
 }
 
 
 double SimulatorItem::simulationTime() const
 {
-    QMutexLocker locker(&impl->resultBufMutex);
-    return impl->frameAtLastBufferWriting / impl->worldFrameRate;
+    return impl->frameAtLastBufferWriting.load(std::memory_order_acquire) / impl->worldFrameRate;
 }
 
 
@@ -2557,20 +4527,36 @@ void SimulatorItemImpl::doPutProperties(PutPropertyFunction& putProperty)
 
     putProperty(_("Sync with realtime"), isRealtimeSyncMode,
                 [&](bool on){ onRealtimeSyncChanged(on); return true; });
+    putProperty(_("Real-time sync catch-up"), realtimeSyncCatchUpPolicy,
+                [&](int index){ return realtimeSyncCatchUpPolicy.select(index); });
+    putProperty(_("Busy-wait for real-time sync"), isRealtimeSyncBusyWaitEnabled,
+                changeProperty(isRealtimeSyncBusyWaitEnabled));
+    putProperty(_("Fast-forward"), isFastForwardMode.load(),
+                [&](bool on){ isFastForwardMode = on; return true; });
     putProperty(_("Time range"), timeRangeMode,
                 [&](int index){ return timeRangeMode.select(index); });
     putProperty(_("Time length"), specifiedTimeLength,
                 [&](double length){ setSpecifiedRecordingTimeLength(length); return true; });
     putProperty(_("Recording"), recordingMode,
                 [&](int index){ return recordingMode.select(index); });
+    putProperty.min(0.0)(_("Checkpoint interval"), checkpointInterval,
+                         [&](double interval){ self->setCheckpointInterval(interval); return true; });
+    putProperty.reset();
     putProperty(_("All link positions"), isAllLinkPositionOutputMode,
                 [&](bool on){ return onAllLinkPositionOutputModeChanged(on); });
     putProperty(_("Device state output"), isDeviceStateOutputEnabled,
                 changeProperty(isDeviceStateOutputEnabled));
     putProperty(_("Record collision data"), recordCollisionData,
                 changeProperty(recordCollisionData));
+    putProperty.min(0.0).max(1.0e6)
+        (_("Recording memory budget [MiB]"), recordingMemoryBudget / (1024.0 * 1024.0),
+         [&](double size){ recordingMemoryBudget = size * 1024.0 * 1024.0; return true; });
+    putProperty.reset();
     putProperty(_("Controller Threads"), useControllerThreadsProperty,
                 changeProperty(useControllerThreadsProperty));
+    putProperty(_("Parallel controllers"), isParallelControlEnabled,
+                changeProperty(isParallelControlEnabled));
+    putProperty(_("Profiling"), isProfilingEnabled, changeProperty(isProfilingEnabled));
     putProperty(_("Controller options"), controllerOptionString_,
                 changeProperty(controllerOptionString_));
 }
@@ -2590,15 +4576,36 @@ bool SimulatorItemImpl::store(Archive& archive)
         archive.write("frameRate", frameRateProperty);
     }
     archive.write("realtimeSync", isRealtimeSyncMode);
+    archive.write("realtimeSyncCatchUp", realtimeSyncCatchUpPolicy.selectedSymbol(), DOUBLE_QUOTED);
+    archive.write("realtimeSyncBusyWait", isRealtimeSyncBusyWaitEnabled);
+    archive.write("fastForward", isFastForwardMode.load());
     archive.write("recording", recordingMode.selectedSymbol(), DOUBLE_QUOTED);
     archive.write("timeRangeMode", timeRangeMode.selectedSymbol(), DOUBLE_QUOTED);
     archive.write("timeLength", specifiedTimeLength);
+    archive.write("checkpointInterval", checkpointInterval);
     archive.write("allLinkPositionOutputMode", isAllLinkPositionOutputMode);
     archive.write("deviceStateOutput", isDeviceStateOutputEnabled);
     archive.write("controllerThreads", useControllerThreadsProperty);
+    archive.write("parallelControllers", isParallelControlEnabled);
+    archive.write("profiling", isProfilingEnabled);
     archive.write("recordCollisionData", recordCollisionData);
+    archive.write("recordingMemoryBudget", recordingMemoryBudget / (1024.0 * 1024.0));
     archive.write("controllerOptions", controllerOptionString_, DOUBLE_QUOTED);
 
+    if(!bodyRecordingSettings.empty()){
+        Listing& settingsNode = *archive.createListing("bodyRecordingSettings");
+        for(auto& kv : bodyRecordingSettings){
+            auto& setting = kv.second;
+            Mapping& node = *settingsNode.newMapping();
+            node.write("body", kv.first, DOUBLE_QUOTED);
+            node.write("linkPositions", setting.isLinkPositionRecordingEnabled);
+            node.write("jointPositions", setting.isJointPositionRecordingEnabled);
+            node.write("deviceStates", setting.isDeviceStateRecordingEnabled);
+            node.write("linkPositionRate", setting.linkPositionRate);
+            node.write("jointPositionRate", setting.jointPositionRate);
+        }
+    }
+
     ListingPtr idseq = new Listing();
     idseq->setFlowStyle(true);
     for(size_t i=0; i < bodyMotionEngines.size(); ++i){
@@ -2668,13 +4675,45 @@ bool SimulatorItemImpl::restore(const Archive& archive)
         }
     }
     archive.read("realtimeSync", isRealtimeSyncMode);
+    if(archive.read("realtimeSyncCatchUp", symbol)){
+        realtimeSyncCatchUpPolicy.select(symbol);
+    }
+    archive.read("realtimeSyncBusyWait", isRealtimeSyncBusyWaitEnabled);
+    if(archive.read("fastForward", boolValue)){
+        isFastForwardMode = boolValue;
+    }
     archive.read("timeLength", specifiedTimeLength);
+    archive.read("checkpointInterval", checkpointInterval);
     self->setAllLinkPositionOutputMode(archive.get("allLinkPositionOutputMode", isAllLinkPositionOutputMode));
     archive.read("deviceStateOutput", isDeviceStateOutputEnabled);
     archive.read("recordCollisionData", recordCollisionData);
+    double budget;
+    if(archive.read("recordingMemoryBudget", budget)){
+        recordingMemoryBudget = budget * 1024.0 * 1024.0;
+    }
     archive.read("controllerThreads", useControllerThreadsProperty);
+    archive.read("parallelControllers", isParallelControlEnabled);
+    archive.read("profiling", isProfilingEnabled);
     archive.read("controllerOptions", controllerOptionString_);
 
+    bodyRecordingSettings.clear();
+    auto& settingsNode = *archive.findListing("bodyRecordingSettings");
+    if(settingsNode.isValid()){
+        for(int i=0; i < settingsNode.size(); ++i){
+            auto node = settingsNode[i].toMapping();
+            string bodyName;
+            if(node->read("body", bodyName)){
+                SimulatorItem::BodyRecordingSetting setting;
+                node->read("linkPositions", setting.isLinkPositionRecordingEnabled);
+                node->read("jointPositions", setting.isJointPositionRecordingEnabled);
+                node->read("deviceStates", setting.isDeviceStateRecordingEnabled);
+                node->read("linkPositionRate", setting.linkPositionRate);
+                node->read("jointPositionRate", setting.jointPositionRate);
+                bodyRecordingSettings[bodyName] = setting;
+            }
+        }
+    }
+
     archive.addPostProcess([&](){ restoreBodyMotionEngines(archive); });
     
     return true;
@@ -2730,7 +4769,9 @@ void SimulatorItemImpl::addCollisionSeqEngine(CollisionSeqItem* collisionSeqItem
 bool SimulatorItemImpl::setPlaybackTime(double time)
 {
     bool processed = false;
+    BodyItem::KinematicStateChangeBatch batch;
     if(!bodyMotionEngines.empty()){
+        TimeSyncItemEngine::prepareTimeChanges(bodyMotionEngines, time);
         for(size_t i=0; i < bodyMotionEngines.size(); ++i){
             processed |= bodyMotionEngines[i]->onTimeChanged(time);
         }
@@ -2742,11 +4783,10 @@ bool SimulatorItemImpl::setPlaybackTime(double time)
     }
 
 #ifdef ENABLE_SIMULATION_PROFILING
-    const int numFrames = simProfilingSeq.numFrames();
-    if(numFrames > 0){
-        const int frame = simProfilingSeq.frameOfTime(time);
-        const int clampedFrame = simProfilingSeq.clampFrameIndex(frame);
-        const MultiValueSeq::Frame profilingTimes = simProfilingSeq.frame(clampedFrame);
+    if(sw && simProfilingSeq && simProfilingSeq->numFrames() > 0){
+        const int frame = simProfilingSeq->frameOfTime(time);
+        const int clampedFrame = simProfilingSeq->clampFrameIndex(frame);
+        const MultiValueSeq::Frame profilingTimes = simProfilingSeq->frame(clampedFrame);
         sw->profilingTimes.clear();
         for(int i=0; i<profilingTimes.size(); i++)
             sw->profilingTimes.push_back(profilingTimes[i]);
@@ -2767,7 +4807,74 @@ bool SimulatedMotionEngineManager::setTime(double time)
     return isActive;
 }
 
-#ifdef ENABLE_SIMULATION_PROFILING
+
+void SimulatedMotionEngineManager::onSimulationStarted(SimulatorItem* simulatorItem)
+{
+    runningSimulatorItems.push_back(simulatorItem);
+    updateTimeBarOwner();
+}
+
+
+void SimulatedMotionEngineManager::onSimulationFinished(SimulatorItem* simulatorItem)
+{
+    auto p = std::find(runningSimulatorItems.begin(), runningSimulatorItems.end(), simulatorItem);
+    if(p != runningSimulatorItems.end()){
+        runningSimulatorItems.erase(p);
+    }
+    if(simulatorItem == timeBarOwner){
+        setTimeBarOwner(nullptr);
+    }
+    updateTimeBarOwner();
+}
+
+
+void SimulatedMotionEngineManager::updateTimeBarOwner()
+{
+    SimulatorItem* owner = nullptr;
+    for(auto& simulatorItem : simulatorItems){
+        auto p = std::find(runningSimulatorItems.begin(), runningSimulatorItems.end(), simulatorItem.get());
+        if(p != runningSimulatorItems.end()){
+            owner = *p;
+            break;
+        }
+    }
+    if(!owner){
+        if(timeBarOwner){
+            owner = timeBarOwner;
+        } else if(!runningSimulatorItems.empty()){
+            owner = runningSimulatorItems.back();
+        }
+    }
+    setTimeBarOwner(owner);
+}
+
+
+void SimulatedMotionEngineManager::setTimeBarOwner(SimulatorItem* simulatorItem)
+{
+    if(simulatorItem != timeBarOwner){
+        if(timeBarOwner){
+            timeBarOwner->impl->setTimeBarOwner(false);
+        }
+        timeBarOwner = simulatorItem;
+        if(simulatorItem){
+            simulatorItem->impl->setTimeBarOwner(true);
+        }
+    }
+}
+
+
+ReferencedPtr SimulatorItem::storeEngineState()
+{
+    return nullptr;
+}
+
+
+bool SimulatorItem::restoreEngineState(Referenced* /* state */)
+{
+    return false;
+}
+
+
 void SimulatorItem::getProfilingNames(vector<string>& profilingNames)
 {
 
@@ -2778,4 +4885,9 @@ void SimulatorItem::getProfilingTimes(vector<double>& profilingToimes)
 {
 
 }
-#endif
+
+
+void SimulatorItem::getDeviceTimeStatistics(vector<SimulationTimeStatistics>& out_statistics)
+{
+
+}
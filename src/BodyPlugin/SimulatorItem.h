@@ -8,6 +8,8 @@
 
 #include "CollisionSeq.h"
 #include <cnoid/Item>
+#include <cnoid/NullOut>
+#include <cnoid/TimeStatistics>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -24,6 +26,7 @@ class CollisionDetector;
 class WorldItem;
 class BodyItem;
 class ControllerItem;
+class MultiValueSeq;
 class SimulationBodyImpl;
 class SimulatorItemImpl;
 class SimulatedMotionEngineManager;
@@ -52,6 +55,14 @@ public:
     bool isActive() const;
     void setActive(bool on);
 
+    /**
+       A simulation engine sets this flag to the body whose state does not change, such as
+       a sleeping body. The results of a resting body are not buffered in every frame, and
+       they are complemented with the last buffered state. Called from the simulation loop thread.
+    */
+    bool isResting() const;
+    void setResting(bool on);
+
     /**
        Use this instead of Device::notifyStateChange when the state part which
        is not recoreded is changed
@@ -77,6 +88,45 @@ private:
 typedef ref_ptr<SimulationBody> SimulationBodyPtr;
 
 
+/**
+   The state of a running simulation stored by SimulatorItem::storeCheckpoint().
+   The object is only valid during the simulation in which it has been stored.
+*/
+class CNOID_EXPORT SimulationCheckpoint : public Referenced
+{
+public:
+    int frame() const { return frame_; }
+    double time() const { return time_; }
+
+private:
+    SimulationCheckpoint() { }
+    
+    const SimulatorItemImpl* simulator;
+    int simulationId;
+    int frame_;
+    double time_;
+    std::vector<ReferencedPtr> bodyStates;
+    ReferencedPtr engineState;
+    std::vector<ReferencedPtr> controllerStates;
+
+    friend class SimulatorItemImpl;
+};
+
+typedef ref_ptr<SimulationCheckpoint> SimulationCheckpointPtr;
+
+/**
+   The statistics of the computation times of a phase of a controller or a device simulation
+*/
+struct SimulationTimeStatistics
+{
+    //! The name of the controller item, or the name of the body or the item simulating the devices
+    std::string target;
+    //! "Input", "Control" and "Output" for a controller, and the device type for a device simulation
+    std::string phase;
+    TimeStatistics statistics;
+};
+
+
 class CNOID_EXPORT SimulatorItem : public Item
 {
 public:
@@ -92,6 +142,14 @@ public:
     void setTimeStep(double step);
 
     virtual bool startSimulation(bool doReset = true);
+
+    /**
+       Run the simulation in the calling thread until it finishes without using the event loop.
+       In this mode the results are not output to the time bar and the body items.
+       They are only written to the world log file and the result items when recording is enabled.
+    */
+    bool runBatchSimulation(bool doReset = true);
+    
     virtual void stopSimulation();
     virtual void pauseSimulation();
     virtual void restartSimulation();
@@ -105,12 +163,66 @@ public:
     //! This can only be called from the simulation thread
     double currentTime() const;
 
+    /**
+       Returns the collisions of the latest simulation step given by the simulation engine.
+       This can only be called from the simulation thread.
+    */
+    std::shared_ptr<CollisionLinkPairList> currentCollisions() { return getCollisions(); }
+
     //! This can be called from non simulation threads
     int simulationFrame() const;
 
     //! This can be called from non simulation threads
     double simulationTime() const;
     
+    /**
+       Stores the current states of the simulation bodies, the simulation engine and the
+       controllers which support it. Null is returned when the simulation is not running or
+       the simulator item does not support checkpoints.
+       When this is called from a thread other than the simulation thread, the states are
+       stored between the simulation steps and this function waits for it. In the simulation
+       thread, this function should be called in a pre-dynamics function.
+    */
+    SimulationCheckpointPtr storeCheckpoint();
+
+    /**
+       Restores the states stored by storeCheckpoint() before the next simulation step.
+       The recorded results after the checkpoint are discarded.
+       When this is called from a thread other than the simulation thread, this function waits
+       for the restoration. In the simulation thread, the restoration is done at the beginning
+       of the next step. In that case it is only available in the batch mode or when the
+       recording is disabled because the recorded results cannot be discarded from the thread.
+    */
+    bool restoreCheckpoint(SimulationCheckpoint* checkpoint);
+
+    /**
+       When the interval is positive, the checkpoints are stored at the interval during the
+       simulation. Every other checkpoint is discarded and the interval is doubled when the
+       number of the checkpoints exceeds a limit, so the memory for them is kept small in a long
+       simulation. The default interval is zero, which disables the periodic checkpoints.
+    */
+    void setCheckpointInterval(double interval);
+    double checkpointInterval() const;
+
+    /**
+       Returns the periodic checkpoints of the latest simulation in the order of the time.
+       They are kept after the simulation finishes until a simulation is started from the beginning.
+    */
+    std::vector<SimulationCheckpointPtr> periodicCheckpoints() const;
+
+    /**
+       Starts a new simulation branched from a checkpoint of a previous simulation by this item.
+       The simulation is initialized in the same way as startSimulation(true), and then the
+       states are restored from the checkpoint. The recorded results before the checkpoint are
+       kept and the periodic checkpoints after it are discarded. The settings of the items such
+       as the controller parameters can be modified before the branching, but the simulation
+       starts from the beginning when the bodies and the controllers do not match the checkpoint.
+    */
+    bool startSimulationFromCheckpoint(SimulationCheckpoint* checkpoint);
+
+    //! Branches the simulation from the latest periodic checkpoint at or before the time
+    bool startSimulationFromTime(double time);
+
     SignalProxy<void()> sigSimulationStarted();
     SignalProxy<void()> sigSimulationPaused();
     SignalProxy<void()> sigSimulationResumed();
@@ -123,6 +235,118 @@ public:
     Selection recordingMode() const;
     void setTimeRangeMode(int selection);
     void setRealtimeSyncMode(bool on);
+
+    /**
+       The policies applied while the simulation in the real-time sync mode is behind the
+       wall-clock time by more than a time step. In any policy the delay is compensated
+       gradually, and the delay over 100 ms is given up.
+       - CATCH_UP_NONE: Nothing is reduced.
+       - CATCH_UP_SKIP_RECORDING: The results of the late steps are not buffered, and the recorded
+         sequences repeat the last buffered states for the steps. This is not applied when the
+         results are output to a world log file.
+       - CATCH_UP_REDUCE_VISION_RATE: The vision sensors simulated by GLVisionSimulatorItem skip
+         every other frame.
+       - CATCH_UP_DROP_GUI_FRAMES: Only one of four result flushes notifies the body states to the
+         GUI when the results are not recorded.
+    */
+    enum RealtimeSyncCatchUpPolicy {
+        CATCH_UP_NONE,
+        CATCH_UP_SKIP_RECORDING,
+        CATCH_UP_REDUCE_VISION_RATE,
+        CATCH_UP_DROP_GUI_FRAMES,
+        N_CATCH_UP_POLICIES
+    };
+    void setRealtimeSyncCatchUpPolicy(int policy);
+    int realtimeSyncCatchUpPolicy() const;
+
+    /**
+       When this is enabled, the simulation thread sleeps until shortly before the wall-clock time
+       of the next step and busy-waits for the rest of the time with the high-resolution clock.
+       This makes the step timing precise at the cost of a processor core. The default is false.
+    */
+    void setRealtimeSyncBusyWaitEnabled(bool on);
+
+    //! This can be called from non simulation threads
+    bool isBehindRealtime() const;
+
+    /**
+       In the fast-forward mode, the simulation runs as fast as possible without the real-time
+       sync, and the results are flushed in large blocks without notifying the body states to
+       the GUI and without the playback of the time bar. Only the progress is shown in the info
+       bar. The GUI is updated when the simulation is paused or finished or the mode is turned
+       off. The mode can be switched while the simulation is running.
+    */
+    void setFastForwardMode(bool on);
+    bool isFastForwardMode() const;
+
+    struct RealtimeSyncStatistics
+    {
+        int64_t numSteps;
+        //! The number of the steps which finished after their wall-clock time
+        int64_t numMissedDeadlines;
+        //! The number of the steps whose results were not buffered by CATCH_UP_SKIP_RECORDING
+        int64_t numSkippedResultFrames;
+        //! The lateness of every step, which is zero for the steps in time
+        TimeStatistics lateness;
+    };
+
+    /**
+       Returns the statistics of the step timing in the real-time sync mode. They are copied in the
+       same way as timeStatistics(), which also requests the copy of these statistics.
+    */
+    RealtimeSyncStatistics realtimeSyncStatistics() const;
+
+    /**
+       The control functions of the controllers are executed in parallel when
+       the controller threads are enabled and this mode is on. The controllers
+       of the same body are executed in order in the same thread.
+    */
+    void setParallelControlEnabled(bool on);
+
+    /**
+       When the profiling is enabled, the computation times of the phases of each
+       simulation step are recorded into the sequence which is also given as the
+       MultiValueSeqItem named "<simulator name>-profiling" in the world item.
+       The setting is applied when the simulation starts.
+    */
+    void setProfilingEnabled(bool on);
+    bool isProfilingEnabled() const;
+    std::shared_ptr<MultiValueSeq> profilingSeq();
+    const std::vector<std::string>& profilingNames() const;
+
+    //! Saves the recorded profiling data as a CSV file.
+    bool saveProfilingData(const std::string& filename, std::ostream& os = nullout());
+
+    /**
+       When the profiling is enabled, the statistics of the input, control and output times of
+       each controller and those of the device simulation times reported by the simulator item
+       and the sub-simulator items are accumulated over the whole simulation. While the simulation
+       is running, this function requests the simulation thread to copy the statistics at the end
+       of the next step and returns the copy made for the previous request.
+    */
+    std::vector<SimulationTimeStatistics> timeStatistics() const;
+
+    struct StepAllocationStatistics
+    {
+        //! The name of the profiling phase
+        std::string phase;
+        int64_t numAllocations;
+        int64_t numAllocatedBytes;
+        //! The number of the steps in which the phase allocated memory
+        int64_t numAllocatingSteps;
+        //! The last frame in which the phase allocated memory, or -1 if it did not allocate memory
+        int lastAllocationFrame;
+    };
+
+    /**
+       When the profiling is enabled and AllocationTracker is available, the heap allocations
+       done by the simulation thread and the controller thread are counted for each profiling
+       phase of the simulation steps. The allocations done in the thread pools, such as those
+       of the parallel controllers, are not counted. The statistics are copied in the same way
+       as timeStatistics(), and an empty array is returned when the allocations are not tracked.
+    */
+    std::vector<StepAllocationStatistics> stepAllocationStatistics() const;
+
     void setDeviceStateOutputEnabled(bool on);
 
     bool isRecordingEnabled() const;
@@ -130,9 +354,66 @@ public:
 
     void setSpecifiedRecordingTimeLength(double length);
 
+    /**
+       The memory budget of the recorded results, which is shared by all the bodies and the
+       channels. When the recorded results exceed the budget, the oldest results of all the
+       channels are discarded in blocks of one second of the simulation time.
+       The budget is not limited when it is zero, which is the default value.
+    */
+    void setRecordingMemoryBudget(size_t numBytes);
+    size_t recordingMemoryBudget() const;
+
+    struct RecordingChannelUsage
+    {
+        //! Empty for the channels which are not owned by any body
+        std::string bodyName;
+        std::string channelName;
+        int numFrames;
+        size_t numBytes;
+    };
+
+    /**
+       Gets the memory used by each channel of the recorded results. The device states
+       shared by the frames are not included. This can only be called from the main thread.
+       \return The total number of bytes
+    */
+    size_t getRecordingMemoryUsage(std::vector<RecordingChannelUsage>& out_usages) const;
+
     bool isAllLinkPositionOutputMode();
     virtual void setAllLinkPositionOutputMode(bool on);
 
+    /**
+       The recording setting of a body. The link positions and the joint positions are recorded
+       at the given rates [Hz], which are rounded so that the world frame rate is a multiple of
+       them, and the result sequences of the body motion have the corresponding frame rates.
+       The world frame rate is used when a rate is zero. A disabled quantity is neither recorded
+       nor output to the world log file. The world log file is not affected by the rates.
+    */
+    struct BodyRecordingSetting
+    {
+        bool isLinkPositionRecordingEnabled;
+        bool isJointPositionRecordingEnabled;
+        bool isDeviceStateRecordingEnabled;
+        double linkPositionRate;
+        double jointPositionRate;
+
+        BodyRecordingSetting()
+            : isLinkPositionRecordingEnabled(true),
+              isJointPositionRecordingEnabled(true),
+              isDeviceStateRecordingEnabled(true),
+              linkPositionRate(0.0),
+              jointPositionRate(0.0) { }
+    };
+
+    /**
+       Sets the recording setting of the body with the given name.
+       The setting is applied when the simulation starts.
+    */
+    void setBodyRecordingSetting(const std::string& bodyName, const BodyRecordingSetting& setting);
+    //! \return false if the default setting is used for the body
+    bool getBodyRecordingSetting(const std::string& bodyName, BodyRecordingSetting& out_setting) const;
+    void clearBodyRecordingSettings();
+
     void setSelfCollisionEnabled(bool on);
     bool isSelfCollisionEnabled() const ;
 
@@ -234,14 +515,34 @@ protected:
         return std::make_shared<CollisionLinkPairList>();
     }
 
+    /**
+       A simulator item supporting the checkpoints overrides these functions to store and
+       restore the internal states of the simulation engine which are not stored in the
+       simulation bodies. The default implementation returns null, which means that the
+       checkpoints are not supported.
+       \note These functions are called from the simulation thread between the simulation steps.
+    */
+    virtual ReferencedPtr storeEngineState();
+    virtual bool restoreEngineState(Referenced* state);
+
     virtual void doPutProperties(PutPropertyFunction& putProperty) override;
     virtual bool store(Archive& archive) override;
     virtual bool restore(const Archive& archive) override;
 
-#ifdef ENABLE_SIMULATION_PROFILING
+    /**
+       A simulator item can override these functions to add the computation times
+       of its own to the profiling data. The times are given in seconds.
+       \note getProfilingTimes() is called from the simulation thread.
+    */
     virtual void getProfilingNames(std::vector<std::string>& profilingNames);
     virtual void getProfilingTimes(std::vector<double>& profilingTimes);
-#endif
+
+    /**
+       A simulator item can override this function to add the statistics of the device
+       simulation times when the profiling is enabled.
+       \note This function is called from the simulation thread.
+    */
+    virtual void getDeviceTimeStatistics(std::vector<SimulationTimeStatistics>& out_statistics);
             
 private:
             
@@ -4,6 +4,7 @@
 */
 
 #include "SubSimulatorItem.h"
+#include "SimulatorItem.h"
 #include <cnoid/Archive>
 #include "gettext.h"
 
@@ -48,6 +49,12 @@ void SubSimulatorItem::finalizeSimulation()
 }
 
 
+void SubSimulatorItem::getDeviceTimeStatistics(std::vector<SimulationTimeStatistics>& out_statistics)
+{
+
+}
+
+
 void SubSimulatorItem::doPutProperties(PutPropertyFunction& putProperty)
 {
     putProperty(_("Enabled"), isEnabled(),
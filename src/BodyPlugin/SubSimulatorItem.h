@@ -12,6 +12,7 @@
 namespace cnoid {
 
 class SimulatorItem;
+struct SimulationTimeStatistics;
 
 class CNOID_EXPORT SubSimulatorItem : public Item
 {
@@ -24,6 +25,13 @@ public:
     virtual bool initializeSimulation(SimulatorItem* simulatorItem);
     virtual void finalizeSimulation();
 
+    /**
+       A sub-simulator item can override this function to add the statistics of its
+       computation times when the profiling of the simulator item is enabled.
+       \note This function is called from the simulation thread.
+    */
+    virtual void getDeviceTimeStatistics(std::vector<SimulationTimeStatistics>& out_statistics);
+
 protected:
     virtual void doPutProperties(PutPropertyFunction& putProperty);
     virtual bool store(Archive& archive);
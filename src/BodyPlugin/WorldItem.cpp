@@ -72,6 +72,9 @@ public:
     BodyCollisionDetector bodyCollisionDetector;
     vector<ColdetBodyInfo> coldetBodyInfos;
     std::shared_ptr<vector<CollisionLinkPairPtr>> collisions;
+    // The link pair objects are recycled in the following collision detections
+    vector<CollisionLinkPairPtr> linkPairPool;
+    size_t numUsedLinkPairs;
     Signal<void()> sigCollisionsUpdated;
     LazyCaller updateCollisionDetectorLater;
     LazyCaller updateCollisionsLater;
@@ -159,6 +162,7 @@ void WorldItemImpl::init()
     kinematicsBar = KinematicsBar::instance();
     bodyCollisionDetector.setCollisionDetector(CollisionDetector::create(collisionDetectorType.selectedIndex()));
     collisions = std::make_shared<vector<CollisionLinkPairPtr>>();
+    numUsedLinkPairs = 0;
     sceneCollision = new SceneCollision(collisions);
     sceneCollision->setName("Collisions");
     materialTableTimestamp = 0;
@@ -386,6 +390,14 @@ void WorldItemImpl::updateCollisions(bool forceUpdate)
     }
 
     collisions->clear();
+    for(size_t i=0; i < numUsedLinkPairs; ++i){
+        auto& linkPair = linkPairPool[i];
+        if(linkPair.use_count() == 1){
+            linkPair->body[0].reset();
+            linkPair->body[1].reset();
+        }
+    }
+    numUsedLinkPairs = 0;
 
     bodyCollisionDetector.detectCollisions(
         [&](const CollisionPair& pair){ extractCollisions(pair); });
@@ -402,8 +414,15 @@ void WorldItemImpl::updateCollisions(bool forceUpdate)
 
 void WorldItemImpl::extractCollisions(const CollisionPair& collisionPair)
 {
-    CollisionLinkPairPtr collisionLinkPair = std::make_shared<CollisionLinkPair>();
-    collisionLinkPair->collisions = collisionPair.collisions();
+    if(numUsedLinkPairs == linkPairPool.size()){
+        linkPairPool.push_back(std::make_shared<CollisionLinkPair>());
+    } else if(linkPairPool[numUsedLinkPairs].use_count() > 1){
+        // The object is still referred from the outside
+        linkPairPool[numUsedLinkPairs] = std::make_shared<CollisionLinkPair>();
+    }
+    CollisionLinkPairPtr& collisionLinkPair = linkPairPool[numUsedLinkPairs++];
+    collisionLinkPair->collisions.assign(
+        collisionPair.collisions().begin(), collisionPair.collisions().end());
     BodyItem* bodyItem = 0;
     for(int i=0; i < 2; ++i){
         ColdetLinkInfo* linkInfo = static_cast<ColdetLinkInfo*>(collisionPair.object(i));
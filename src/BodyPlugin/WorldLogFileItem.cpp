@@ -10,28 +10,93 @@
 #include <cnoid/TimeSyncItemEngine>
 #include <cnoid/FileUtil>
 #include <cnoid/Archive>
+#include <cnoid/MessageView>
+#include <cnoid/MemoryUsage>
 #include <QDateTime>
 #include <fstream>
 #include <stack>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <fmt/format.h>
 #include "gettext.h"
 
 using namespace std;
 using namespace cnoid;
+using fmt::format;
 namespace filesystem = boost::filesystem;
 
 namespace {
 
+/*
+  The files of version 2 or later begin with the negated version number, which cannot be the
+  header size at the beginning of the version 1 files. The absolute file positions are recorded
+  as 64-bit values in version 2 so that the logs larger than 2 GB can be recorded.
+  Version 3 is skipped because its negated value is the marker of the block compressed files.
+  Version 4 adds the quantized encoding of the link and joint positions.
+*/
+static const int currentFormatVersion = 4;
+
+/*
+  The block compressed files begin with the negated value of this version, which is followed by
+  the blocks of the compressed data of the current version. The file positions recorded in the
+  data are the positions in the uncompressed data.
+*/
+static const int blockCompressedFormatVersion = 3;
+
+// The size of the uncompressed data which is accumulated before a block is compressed
+static const size_t compressionBlockSize = 256 * 1024;
+
+static const int compressionBlockHeaderSize =
+      sizeof(int) // compressed size
+    + sizeof(int) // uncompressed size
+    ;
+
 static const int frameHeaderSize =
       sizeof(int)   // offset to the prev frame
     + sizeof(float) // time
     + sizeof(int)   // data size
     ;
 
+static const char* frameIndexFileHeader = "CNOID-WORLD-LOG-INDEX";
+
+static const int frameIndexEntrySize =
+      sizeof(int64_t) // frame position
+    + sizeof(float) // time
+    ;
+
+/*
+  The quantized positions are the deltas from the positions of the last keyframe.
+  A new keyframe is output instead when a delta exceeds this value because such a delta is
+  encoded into as many bytes as a float value.
+*/
+static const int maxQuantizedDelta = (1 << 20) - 1;
+
+/*
+  The maximum size of the data which is waiting to be written by the output thread.
+  The recording is blocked while the queued data exceeds this size.
+*/
+static const size_t maxOutputQueueSize = 64 * 1024 * 1024;
+
 enum DataTypeID {
     BODY_STATE,
     LINK_POSITIONS,
     JOINT_POSITIONS,
-    DEVICE_STATES
+    DEVICE_STATES,
+    QUANTIZED_LINK_POSITIONS,
+    QUANTIZED_JOINT_POSITIONS
 };
 
 struct NotEnoughDataException { };
@@ -40,24 +105,52 @@ class ReadBuf
 {
 public:
     vector<char> data;
-    ifstream& ifs;
+    istream& ifs;
+    // The memory mapped file which is read instead of the stream if it is given
+    const char* mappedFile;
+    int64_t mappedFileSize;
+    int64_t mappedFilePos;
+    // The beginning of the data, which is in the data buffer or in the memory mapped file
+    const char* top;
+    int dataSize;
     int pos;
 
-    ReadBuf(ifstream& ifs)
+    ReadBuf(istream& ifs)
         : ifs(ifs) {
+        mappedFile = nullptr;
+        mappedFileSize = 0;
+        mappedFilePos = 0;
+        top = nullptr;
+        dataSize = 0;
         pos = 0;
     }
 
+    void setMappedFile(const char* file, int64_t size){
+        mappedFile = file;
+        mappedFileSize = size;
+        clear();
+    }
+
     bool checkSize(int size){
-        int left = data.size() - pos;
+        int left = dataSize - pos;
         if(left < size){
+            if(mappedFile){
+                if(mappedFilePos + pos + size > mappedFileSize){
+                    return false;
+                }
+                dataSize = pos + size;
+                return true;
+            }
             int len = size - left;
-            data.resize(data.size() + len);
-            ifs.read(&data[pos], len);
+            data.resize(dataSize + len);
+            top = &data.front();
+            ifs.read(&data[dataSize], len);
             if(!ifs.fail()){
+                dataSize = data.size();
                 return true;
             } else {
                 ifs.clear();
+                data.resize(dataSize);
                 return false;
             }
         }
@@ -80,62 +173,63 @@ public:
         return pos + size;
     }
 
-    char* buf() {
-        return &data.front();
-    }
-
+    //! The data is read from the current position of the stream
     void clear(){
         data.clear();
+        top = mappedFile ? (mappedFile + mappedFilePos) : nullptr;
+        dataSize = 0;
         pos = 0;
     }
 
-    int size() const {
-        return data.size();
-    }
-
-    char* current() {
-        return &data[pos];
+    //! The data is read from the given position of the file
+    void clear(int64_t filePos){
+        if(mappedFile){
+            mappedFilePos = std::min(filePos, mappedFileSize);
+        } else {
+            ifs.seekg(filePos);
+        }
+        clear();
     }
 
-    char* end() {
-        return &data.front() + data.size();
+    int size() const {
+        return dataSize;
     }
 
     bool isEnd() {
-        return (pos >= static_cast<int>(data.size()));
+        return (pos >= dataSize);
     }
 
     void seek(int pos = 0) { this->pos = pos; }
 
     char readID(){
         ensureSize(1);
-        return data[pos++];
+        return top[pos++];
     }
 
     bool readBool(){
         ensureSize(1);
-        return data[pos++];
+        return top[pos++];
     }
 
     char readOctet(){
         ensureSize(1);
-        return data[pos++];
+        return top[pos++];
     }
 
     short readShort(){
         ensureSize(2);
-        unsigned char low = data[pos++];
-        unsigned char high = data[pos++];
+        unsigned char low = top[pos++];
+        unsigned char high = top[pos++];
         short value = low + (high << 8);
         return value;
     }
 
     int readInt(){
         ensureSize(4);
-        unsigned char d0 = data[pos++];
-        unsigned char d1 = data[pos++];
-        unsigned char d2 = data[pos++];
-        unsigned char d3 = data[pos++];
+        unsigned char d0 = top[pos++];
+        unsigned char d1 = top[pos++];
+        unsigned char d2 = top[pos++];
+        unsigned char d3 = top[pos++];
         int value = d0 + (d1 << 8) + (d2 << 16) + (d3 << 24);
         return value;
     }
@@ -144,13 +238,40 @@ public:
         return readInt();
     }
 
+    int64_t readInt64(){
+        ensureSize(8);
+        uint64_t value = 0;
+        for(int i=0; i < 8; ++i){
+            value |= static_cast<uint64_t>(static_cast<unsigned char>(top[pos++])) << (8 * i);
+        }
+        return static_cast<int64_t>(value);
+    }
+
+    int64_t readSeekPos(){
+        return readInt64();
+    }
+
+    int readVarInt(){
+        uint32_t value = 0;
+        for(int shift = 0; shift < 35; shift += 7){
+            ensureSize(1);
+            const unsigned char byte = top[pos++];
+            value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if(!(byte & 0x80)){
+                break;
+            }
+        }
+        // zigzag decoding
+        return static_cast<int>((value >> 1) ^ (~(value & 1) + 1));
+    }
+
     float readFloat(){
         ensureSize(sizeof(float));
         float value;
         char* p = (char*)&value;
         const int n = sizeof(float);
         for(int i=0; i < n; ++i){
-            p[i] = data[pos++];
+            p[i] = top[pos++];
         }
         return value;
     }
@@ -176,7 +297,7 @@ public:
         std::string str;
         str.reserve(size);
         for(int i=0; i < size; ++i){
-            str.append(1, data[pos++]);
+            str.append(1, top[pos++]);
         }
         return str;
     }
@@ -187,10 +308,10 @@ class WriteBuf
 {
 public:
     vector<char> data;
-    ofstream& ofs;
+    ostream& ofs;
     size_t seekOffset;
 
-    WriteBuf(ofstream& ofs)
+    WriteBuf(ostream& ofs)
         : ofs(ofs) {
         seekOffset = 0;
     }
@@ -221,6 +342,15 @@ public:
         ofs.flush();
         clear();
     }
+
+    /**
+       The data is moved to the given buffer instead of being written to the stream.
+       The given buffer must be empty and its memory is reused for the next data.
+    */
+    void moveDataTo(vector<char>& buf){
+        seekOffset += data.size();
+        data.swap(buf);
+    }
         
     void writeID(DataTypeID id){
         writeOctet((char)id);
@@ -253,8 +383,24 @@ public:
         data[pos++] = (value >> 24) & 0xff;
     }
 
-    void writeSeekPos(int pos){
-        writeInt(pos);
+    void writeInt64(int64_t value){
+        for(int i=0; i < 8; ++i){
+            data.push_back((value >> (8 * i)) & 0xff);
+        }
+    }
+
+    void writeSeekPos(int64_t pos){
+        writeInt64(pos);
+    }
+
+    //! The value is zigzag encoded so that small negative values are also written in a few bytes
+    void writeVarInt(int value){
+        uint32_t v = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+        while(v >= 0x80){
+            data.push_back(static_cast<char>((v & 0x7f) | 0x80));
+            v >>= 7;
+        }
+        data.push_back(static_cast<char>(v));
     }
 
     void writeSeekOffset(int offset){
@@ -296,6 +442,330 @@ public:
 };
 
 
+void writeRawInt(std::streambuf* buf, int value)
+{
+    char data[4];
+    for(int i=0; i < 4; ++i){
+        data[i] = (value >> (8 * i)) & 0xff;
+    }
+    buf->sputn(data, 4);
+}
+
+
+bool readRawInt(std::streambuf* buf, int& out_value)
+{
+    unsigned char data[4];
+    if(buf->sgetn(reinterpret_cast<char*>(data), 4) != 4){
+        return false;
+    }
+    out_value = data[0] + (data[1] << 8) + (data[2] << 16) + (data[3] << 24);
+    return true;
+}
+
+
+/**
+   This buffer compresses the written data into the blocks of the underlying buffer. A block is
+   written when the accumulated data exceeds the block size at a synchronization, which is done at
+   the end of each frame, so that a frame is never split into two blocks. The position given by
+   tellp() is the position in the uncompressed data.
+*/
+class BlockCompressingBuf : public std::streambuf
+{
+public:
+    BlockCompressingBuf(std::streambuf* dest)
+        : dest(dest) {
+        logicalPos = 0;
+    }
+
+    void finish(){
+        if(!block.empty()){
+            writeBlock();
+        }
+        dest->pubsync();
+    }
+
+    size_t bufferSize() const {
+        return block.capacity() + compressed.capacity();
+    }
+
+protected:
+    virtual int_type overflow(int_type c) override {
+        if(!traits_type::eq_int_type(c, traits_type::eof())){
+            block.push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+
+    virtual std::streamsize xsputn(const char* s, std::streamsize n) override {
+        block.insert(block.end(), s, s + n);
+        return n;
+    }
+
+    virtual int sync() override {
+        if(block.size() >= compressionBlockSize){
+            writeBlock();
+        }
+        return dest->pubsync();
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        if(off == 0 && dir == std::ios_base::cur && (which & std::ios_base::out)){
+            return pos_type(logicalPos + block.size());
+        }
+        return pos_type(off_type(-1));
+    }
+
+private:
+    std::streambuf* dest;
+    vector<char> block;
+    vector<char> compressed;
+    int64_t logicalPos;
+
+    void writeBlock(){
+        namespace io = boost::iostreams;
+        compressed.clear();
+        {
+            io::filtering_ostream out;
+            out.push(io::zlib_compressor(io::zlib::best_speed));
+            out.push(io::back_inserter(compressed));
+            out.write(&block.front(), block.size());
+        }
+        writeRawInt(dest, compressed.size());
+        writeRawInt(dest, block.size());
+        dest->sputn(&compressed.front(), compressed.size());
+        logicalPos += block.size();
+        block.clear();
+    }
+};
+
+
+/**
+   This buffer provides the uncompressed data of the blocks written by BlockCompressingBuf with
+   the random access by seekg(). The block headers are scanned when the position beyond the known
+   blocks is accessed, and a few decompressed blocks are cached.
+*/
+class BlockDecompressingBuf : public std::streambuf
+{
+public:
+    BlockDecompressingBuf(std::streambuf* src, int64_t firstBlockPos)
+        : src(src) {
+        nextBlockFilePos = firstBlockPos;
+        nextBlockLogicalPos = 0;
+        currentBlock = -1;
+        currentBlockLogicalPos = 0;
+        pendingPos = 0;
+    }
+
+    size_t bufferSize() const {
+        size_t size =
+            compressed.capacity() +
+            (blockFilePositions.capacity() + blockLogicalPositions.capacity()) * sizeof(int64_t) +
+            (blockCompressedSizes.capacity() + blockUncompressedSizes.capacity()) * sizeof(int);
+        for(auto& block : cachedBlocks){
+            size += block.data.capacity();
+        }
+        return size;
+    }
+
+protected:
+    virtual int_type underflow() override {
+        if(gptr() < egptr()){
+            return traits_type::to_int_type(*gptr());
+        }
+        int64_t pos = (currentBlock >= 0) ? (currentBlockLogicalPos + (gptr() - eback())) : pendingPos;
+        if(!loadBlockAt(pos)){
+            return traits_type::eof();
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        if(dir == std::ios_base::beg){
+            return seekpos(pos_type(off), which);
+        } else if(dir == std::ios_base::cur){
+            int64_t pos = (currentBlock >= 0) ? (currentBlockLogicalPos + (gptr() - eback())) : pendingPos;
+            return seekpos(pos_type(pos + off), which);
+        }
+        return pos_type(off_type(-1));
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+        if(!(which & std::ios_base::in)){
+            return pos_type(off_type(-1));
+        }
+        const int64_t p = pos;
+        if(currentBlock >= 0 &&
+           p >= currentBlockLogicalPos && p < currentBlockLogicalPos + static_cast<int64_t>(blockSize(currentBlock))){
+            setg(eback(), eback() + (p - currentBlockLogicalPos), egptr());
+        } else {
+            // The block is loaded when the data is actually read
+            currentBlock = -1;
+            pendingPos = p;
+            setg(nullptr, nullptr, nullptr);
+        }
+        return pos;
+    }
+
+private:
+    struct CachedBlock {
+        int index;
+        vector<char> data;
+    };
+    
+    std::streambuf* src;
+    vector<int64_t> blockFilePositions;
+    vector<int64_t> blockLogicalPositions;
+    vector<int> blockCompressedSizes;
+    vector<int> blockUncompressedSizes;
+    int64_t nextBlockFilePos;
+    int64_t nextBlockLogicalPos;
+    vector<CachedBlock> cachedBlocks; // The most recently used one is the last element
+    vector<char> compressed;
+    int currentBlock;
+    int64_t currentBlockLogicalPos;
+    int64_t pendingPos;
+
+    size_t blockSize(int index) const {
+        return blockUncompressedSizes[index];
+    }
+
+    bool scanNextBlock(){
+        int compressedSize, uncompressedSize;
+        if(src->pubseekpos(nextBlockFilePos, std::ios_base::in) == pos_type(off_type(-1)) ||
+           !readRawInt(src, compressedSize) || !readRawInt(src, uncompressedSize) ||
+           compressedSize <= 0 || uncompressedSize <= 0){
+            return false;
+        }
+        // Check if the whole block has been written
+        const int64_t lastBytePos = nextBlockFilePos + compressionBlockHeaderSize + compressedSize - 1;
+        if(src->pubseekpos(lastBytePos, std::ios_base::in) == pos_type(off_type(-1)) ||
+           traits_type::eq_int_type(src->sgetc(), traits_type::eof())){
+            return false;
+        }
+        blockFilePositions.push_back(nextBlockFilePos);
+        blockLogicalPositions.push_back(nextBlockLogicalPos);
+        blockCompressedSizes.push_back(compressedSize);
+        blockUncompressedSizes.push_back(uncompressedSize);
+        nextBlockFilePos += compressionBlockHeaderSize + compressedSize;
+        nextBlockLogicalPos += uncompressedSize;
+        return true;
+    }
+
+    vector<char>* getBlockData(int index){
+        for(size_t i=0; i < cachedBlocks.size(); ++i){
+            if(cachedBlocks[i].index == index){
+                std::rotate(cachedBlocks.begin() + i, cachedBlocks.begin() + i + 1, cachedBlocks.end());
+                return &cachedBlocks.back().data;
+            }
+        }
+        const int compressedSize = blockCompressedSizes[index];
+        compressed.resize(compressedSize);
+        src->pubseekpos(blockFilePositions[index] + compressionBlockHeaderSize, std::ios_base::in);
+        if(src->sgetn(&compressed.front(), compressedSize) != compressedSize){
+            return nullptr;
+        }
+        if(cachedBlocks.size() < 4){
+            cachedBlocks.emplace_back();
+        } else {
+            std::rotate(cachedBlocks.begin(), cachedBlocks.begin() + 1, cachedBlocks.end());
+        }
+        auto& block = cachedBlocks.back();
+        block.index = index;
+        block.data.resize(blockUncompressedSizes[index]);
+        namespace io = boost::iostreams;
+        io::filtering_istream in;
+        in.push(io::zlib_decompressor());
+        in.push(io::array_source(&compressed.front(), compressedSize));
+        in.read(&block.data.front(), block.data.size());
+        if(in.gcount() != static_cast<std::streamsize>(block.data.size())){
+            block.index = -1;
+            return nullptr;
+        }
+        return &block.data;
+    }
+
+    bool loadBlockAt(int64_t pos){
+        while(pos >= nextBlockLogicalPos){
+            if(!scanNextBlock()){
+                return false;
+            }
+        }
+        auto p = std::upper_bound(blockLogicalPositions.begin(), blockLogicalPositions.end(), pos);
+        const int index = (p - blockLogicalPositions.begin()) - 1;
+        if(index < 0){
+            return false;
+        }
+        auto data = getBlockData(index);
+        if(!data){
+            currentBlock = -1;
+            pendingPos = pos;
+            setg(nullptr, nullptr, nullptr);
+            return false;
+        }
+        currentBlock = index;
+        currentBlockLogicalPos = blockLogicalPositions[index];
+        char* begin = &data->front();
+        setg(begin, begin + (pos - currentBlockLogicalPos), begin + data->size());
+        return true;
+    }
+};
+
+
+/*
+  The log files which are not compressed are read via the memory mapping, which is shared by
+  the items reading the same file.
+*/
+struct MappedLogFile
+{
+    boost::iostreams::mapped_file_source file;
+    // False when the file has been truncated for a new recording
+    bool isValid;
+};
+
+map<string, std::weak_ptr<MappedLogFile>> mappedLogFiles;
+
+
+/**
+   The file is mapped again if the existing mapping is smaller than minSize because the file
+   may be extended by the recording after it is mapped.
+*/
+std::shared_ptr<MappedLogFile> getMappedLogFile(const string& filename, int64_t minSize)
+{
+    auto& entry = mappedLogFiles[filename];
+    auto mapped = entry.lock();
+    if(!mapped || static_cast<int64_t>(mapped->file.size()) < minSize){
+        mapped = std::make_shared<MappedLogFile>();
+        try {
+            mapped->file.open(filename);
+        } catch(const std::exception& ex){
+            return nullptr;
+        }
+        if(!mapped->file.is_open()){
+            return nullptr;
+        }
+        mapped->isValid = true;
+        entry = mapped;
+    }
+    return mapped;
+}
+
+
+/**
+   This must be called before the file is truncated because accessing the truncated area of
+   the mapping causes a bus error.
+*/
+void invalidateMappedLogFile(const string& filename)
+{
+    auto p = mappedLogFiles.find(filename);
+    if(p != mappedLogFiles.end()){
+        if(auto mapped = p->second.lock()){
+            mapped->isValid = false;
+        }
+        mappedLogFiles.erase(p);
+    }
+}
+
+
 class DeviceInfo {
 public:
     size_t lastStateSeekPos;
@@ -314,9 +784,17 @@ public:
     BodyItem* bodyItem;
     Body* body;
     vector<DeviceInfo> deviceInfos;
+
+    // The keyframes referred by the quantized positions
+    int64_t linkKeyframePos;
+    vector<double> linkKeyframe;
+    int64_t jointKeyframePos;
+    vector<double> jointKeyframe;
     
     BodyInfo(BodyItem* bodyItem){
         this->bodyItem = bodyItem;
+        linkKeyframePos = -1;
+        jointKeyframePos = -1;
         if(bodyItem){
             body = bodyItem->body();
             deviceInfos.resize(body->numDevices());
@@ -377,18 +855,23 @@ public:
     WorldLogFileItem* self;
     QDateTime recordingStartTime;
     bool isTimeStampSuffixEnabled;
+    bool isBlockCompressionEnabled;
     vector<string> bodyNames;
     
     ofstream ofs;
+    // The stream of the log data, which is written to ofs directly or via compressingBuf
+    ostream os;
+    std::unique_ptr<BlockCompressingBuf> compressingBuf;
     WriteBuf writeBuf;
-    int lastOutputFramePos;
+    int64_t lastOutputFramePos;
     double recordingFrameRate;
     stack<int> sizeHeaderStack;
 
     // for device state recording and playback
     struct DeviceStateCache : public Referenced {
         DeviceStatePtr state;
-        int seekPos;
+        vector<float> values;
+        int64_t seekPos;
     };
     typedef ref_ptr<DeviceStateCache> DeviceStateCachePtr;
     
@@ -400,15 +883,63 @@ public:
     int currentDeviceStateCacheArrayIndex;
     vector<double> doubleWriteBuf;
 
+    // for the quantized encoding of the link and joint positions
+    bool isQuantizedEncodingEnabled;
+    double jointPositionPrecision;
+    double linkTranslationPrecision;
+    double linkRotationPrecision;
+    int keyframeInterval;
+    struct KeyframeState {
+        vector<double> values;
+        int64_t seekPos;
+        int numDeltaFrames;
+    };
+    vector<KeyframeState> linkKeyframeStates;
+    vector<KeyframeState> jointKeyframeStates;
+    int bodyStateIndex;
+    vector<double> positionWriteBuf;
+    vector<int> quantizedDeltaBuf;
+
+    // The positions of the frames are also written to the index file for seeking
+    ofstream indexOfs;
+    WriteBuf indexWriteBuf;
+
+    // The encoded data is written to the files by the output thread
+    struct OutputData {
+        vector<char> data;
+        bool isIndex;
+    };
+    std::thread outputThread;
+    std::mutex outputQueueMutex;
+    std::condition_variable outputQueueCondition;
+    deque<OutputData> outputQueue;
+    vector<vector<char>> spareOutputBuffers;
+    size_t outputQueueSize;
+    bool isOutputThreadActive;
+    // The statistics of the stalls caused by the output which does not keep up with the recording
+    int numOutputStalls;
+    double outputStallTime;
+    size_t maxQueuedOutputSize;
+
     ifstream ifs;
+    // The stream of the log data, which is read from ifs directly or via decompressingBuf
+    istream is;
+    std::unique_ptr<BlockDecompressingBuf> decompressingBuf;
+    string inputFilename;
+    std::shared_ptr<MappedLogFile> mappedLogFile;
+    int formatVersion;
     ReadBuf readBuf;
     ReadBuf readBuf2;
-    int currentReadFramePos;
+    int64_t currentReadFramePos;
     int currentReadFrameDataSize;
     int prevReadFrameOffset;
     double currentReadFrameTime;
     bool isCurrentFrameDataLoaded;
     bool isOverRange;
+
+    // The frames whose positions are known, in the order of time
+    vector<int64_t> indexedFramePositions;
+    vector<float> indexedFrameTimes;
         
     vector<BodyInfoPtr> bodyInfos;
     ScopedConnection worldSubTreeChangedConnection;
@@ -421,8 +952,19 @@ public:
     string getActualFilename();
     void updateBodyInfos();
     void onWorldSubTreeChanged();
+    string getFrameIndexFilename();
+    void closeInput();
+    void closeOutput();
+    void queueOutput(WriteBuf& buf, bool isIndex);
+    void outputQueuedData();
+    void stopOutputThread();
     bool readTopHeader();
-    bool readFrameHeader(int pos);
+    void setMappedLogFile(std::shared_ptr<MappedLogFile> file);
+    bool extendMappedLogFile();
+    bool readFrameHeader(int64_t pos);
+    bool loadFrameIndexFile();
+    void saveFrameIndexFile();
+    void extendFrameIndex(double time);
     bool seek(double time);
     bool recallStateAtTime(double time);
     bool loadCurrentFrameData();
@@ -430,6 +972,9 @@ public:
     void readBodyState(BodyInfo* bodyInfo, double time);
     int readLinkPositions(Body* body);
     int readJointPositions(Body* body);
+    bool readKeyframe(int64_t pos, int dataTypeID, int stride, int64_t& io_keyframePos, vector<double>& io_values);
+    int readQuantizedLinkPositions(BodyInfo* bodyInfo);
+    int readQuantizedJointPositions(BodyInfo* bodyInfo);
     void readDeviceStates(BodyInfo* bodyInfo, double time);
     void readDeviceState(DeviceInfo& devInfo, Device* device, ReadBuf& buf, int size);
     void readLastDeviceState(DeviceInfo& devInfo, Device* device);
@@ -438,8 +983,14 @@ public:
     void fixSizeHeader();
     void endHeaderOutput();
     void beginFrameOutput(double time);
+    KeyframeState& keyframeState(vector<KeyframeState>& states);
+    bool quantizePositions(KeyframeState& keyframe, int stride, const double* precisions);
+    void outputKeyframe(KeyframeState& keyframe, DataTypeID dataTypeID, int stride);
+    void outputLinkPositions(SE3* positions, int size);
+    void outputJointPositions(double* values, int size);
     void outputDeviceState(DeviceState* state);
     void exchangeDeviceStateCacheArrays();
+    void countMemoryUsage(MemoryUsageCounter& counter);
 };
 
 }
@@ -468,12 +1019,27 @@ WorldLogFileItem::WorldLogFileItem()
 
 WorldLogFileItemImpl::WorldLogFileItemImpl(WorldLogFileItem* self)
     : self(self),
-      writeBuf(ofs),
-      readBuf(ifs),
-      readBuf2(ifs)
+      os(nullptr),
+      writeBuf(os),
+      indexWriteBuf(indexOfs),
+      is(nullptr),
+      readBuf(is),
+      readBuf2(is)
 {
     isTimeStampSuffixEnabled = false;
+    isBlockCompressionEnabled = false;
     recordingFrameRate = 0.0;
+    isQuantizedEncodingEnabled = false;
+    jointPositionPrecision = 1.0e-5;
+    linkTranslationPrecision = 1.0e-5;
+    linkRotationPrecision = 1.0e-5;
+    keyframeInterval = 100;
+    outputQueueSize = 0;
+    isOutputThreadActive = false;
+    numOutputStalls = 0;
+    outputStallTime = 0.0;
+    maxQueuedOutputSize = 0;
+    formatVersion = currentFormatVersion;
     isBodyInfoUpdateNeeded = true;
 }
 
@@ -487,12 +1053,27 @@ WorldLogFileItem::WorldLogFileItem(const WorldLogFileItem& org)
 
 WorldLogFileItemImpl::WorldLogFileItemImpl(WorldLogFileItem* self, WorldLogFileItemImpl& org)
     : self(self),
-      writeBuf(ofs),
-      readBuf(ifs),
-      readBuf2(ifs)
+      os(nullptr),
+      writeBuf(os),
+      indexWriteBuf(indexOfs),
+      is(nullptr),
+      readBuf(is),
+      readBuf2(is)
 {
     isTimeStampSuffixEnabled = org.isTimeStampSuffixEnabled;
+    isBlockCompressionEnabled = org.isBlockCompressionEnabled;
     recordingFrameRate = org.recordingFrameRate;
+    isQuantizedEncodingEnabled = org.isQuantizedEncodingEnabled;
+    jointPositionPrecision = org.jointPositionPrecision;
+    linkTranslationPrecision = org.linkTranslationPrecision;
+    linkRotationPrecision = org.linkRotationPrecision;
+    keyframeInterval = org.keyframeInterval;
+    outputQueueSize = 0;
+    isOutputThreadActive = false;
+    numOutputStalls = 0;
+    outputStallTime = 0.0;
+    maxQueuedOutputSize = 0;
+    formatVersion = currentFormatVersion;
     isBodyInfoUpdateNeeded = true;
 }
 
@@ -505,7 +1086,8 @@ WorldLogFileItem::~WorldLogFileItem()
 
 WorldLogFileItemImpl::~WorldLogFileItemImpl()
 {
-
+    closeInput();
+    closeOutput();
 }
 
 
@@ -522,6 +1104,63 @@ void WorldLogFileItem::notifyUpdate()
 }
 
 
+void WorldLogFileItem::countMemoryUsage(MemoryUsageCounter& counter)
+{
+    Item::countMemoryUsage(counter);
+    impl->countMemoryUsage(counter);
+}
+
+
+void WorldLogFileItemImpl::countMemoryUsage(MemoryUsageCounter& counter)
+{
+    size_t size = sizeof(WorldLogFileItemImpl);
+
+    size += writeBuf.data.capacity() + indexWriteBuf.data.capacity();
+    size += readBuf.data.capacity() + readBuf2.data.capacity();
+    size += (doubleWriteBuf.capacity() + positionWriteBuf.capacity()) * sizeof(double);
+    size += quantizedDeltaBuf.capacity() * sizeof(int);
+    for(auto& state : linkKeyframeStates){
+        size += sizeof(KeyframeState) + state.values.capacity() * sizeof(double);
+    }
+    for(auto& state : jointKeyframeStates){
+        size += sizeof(KeyframeState) + state.values.capacity() * sizeof(double);
+    }
+    for(auto& caches : deviceStateCacheArrays){
+        for(auto& cache : caches){
+            if(cache){
+                counter.addShared(cache.get(), sizeof(DeviceStateCache) + cache->values.capacity() * sizeof(float));
+            }
+        }
+    }
+    if(compressingBuf){
+        size += compressingBuf->bufferSize();
+    }
+    {
+        std::lock_guard<std::mutex> lock(outputQueueMutex);
+        for(auto& output : outputQueue){
+            size += output.data.capacity();
+        }
+        for(auto& buf : spareOutputBuffers){
+            size += buf.capacity();
+        }
+    }
+
+    if(decompressingBuf){
+        size += decompressingBuf->bufferSize();
+    }
+    size += indexedFramePositions.capacity() * sizeof(int64_t) + indexedFrameTimes.capacity() * sizeof(float);
+    for(auto& bodyInfo : bodyInfos){
+        size += (bodyInfo->linkKeyframe.capacity() + bodyInfo->jointKeyframe.capacity()) * sizeof(double);
+        for(auto& deviceInfo : bodyInfo->deviceInfos){
+            size += sizeof(DeviceInfo) + deviceInfo.lastState.capacity() * sizeof(double);
+        }
+    }
+
+    // The pages of the mapped log file are not counted because they are backed by the file
+    counter.add(size);
+}
+
+
 const std::string& WorldLogFileItem::logFile() const
 {
     return filePath();
@@ -559,6 +1198,12 @@ string WorldLogFileItemImpl::getActualFilename()
 }
 
 
+string WorldLogFileItemImpl::getFrameIndexFilename()
+{
+    return getActualFilename() + ".index";
+}
+
+
 double WorldLogFileItem::recordingFrameRate() const
 {
     return impl->recordingFrameRate;
@@ -622,23 +1267,46 @@ bool WorldLogFileItemImpl::readTopHeader()
     currentReadFrameDataSize = 0;
     prevReadFrameOffset = 0;
     currentReadFrameTime = -1.0;
-    
-    if(ifs.is_open()){
-        ifs.close();
-    }
+    indexedFramePositions.clear();
+    indexedFrameTimes.clear();
+    // The cached states refer to the positions in the previous file
+    isBodyInfoUpdateNeeded = true;
+
+    closeInput();
     string fname = getActualFilename();
     if(filesystem::exists(fname)){
         ifs.open(fname.c_str(), ios::in | ios::binary);
         if(ifs.is_open()){
-            readBuf.clear();
+            int marker;
+            if(readRawInt(ifs.rdbuf(), marker) && marker == -blockCompressedFormatVersion){
+                decompressingBuf.reset(new BlockDecompressingBuf(ifs.rdbuf(), sizeof(int)));
+                is.rdbuf(decompressingBuf.get());
+            } else {
+                ifs.seekg(0);
+                is.rdbuf(ifs.rdbuf());
+                setMappedLogFile(getMappedLogFile(fname, 0));
+            }
+            inputFilename = fname;
+            readBuf.clear(0);
             try {
                 int headerSize = readBuf.readSeekOffset();
-                if(readBuf.checkSize(headerSize)){
+                formatVersion = 1;
+                if(headerSize < 0){
+                    formatVersion = -headerSize;
+                    headerSize = readBuf.readSeekOffset();
+                }
+                if(formatVersion <= currentFormatVersion && readBuf.checkSize(headerSize)){
                     while(!readBuf.isEnd()){
                         bodyNames.push_back(readBuf.readString());
                     }
                     currentReadFramePos = readBuf.pos;
                     result = readFrameHeader(readBuf.pos);
+                    if(result){
+                        indexedFramePositions.push_back(currentReadFramePos);
+                        indexedFrameTimes.push_back(currentReadFrameTime);
+                        loadFrameIndexFile();
+                        readFrameHeader(indexedFramePositions.front());
+                    }
                 }
             } catch(NotEnoughDataException& ex){
                 bodyNames.clear();
@@ -652,25 +1320,59 @@ bool WorldLogFileItemImpl::readTopHeader()
 }
 
 
-bool WorldLogFileItemImpl::readFrameHeader(int pos)
+void WorldLogFileItemImpl::setMappedLogFile(std::shared_ptr<MappedLogFile> file)
 {
-    isCurrentFrameDataLoaded = false;
-    
-    if(!ifs.is_open()){
+    mappedLogFile = file;
+    if(file){
+        readBuf.setMappedFile(file->file.data(), file->file.size());
+        readBuf2.setMappedFile(file->file.data(), file->file.size());
+    } else {
+        readBuf.setMappedFile(nullptr, 0);
+        readBuf2.setMappedFile(nullptr, 0);
+    }
+}
+
+
+/**
+   The file being recorded is mapped again when it has been extended after it was mapped.
+   @return True if the mapping is extended.
+*/
+bool WorldLogFileItemImpl::extendMappedLogFile()
+{
+    if(!mappedLogFile){
+        return false;
+    }
+    boost::system::error_code ec;
+    const int64_t fileSize = filesystem::file_size(inputFilename, ec);
+    if(ec || fileSize <= static_cast<int64_t>(mappedLogFile->file.size())){
+        return false;
+    }
+    auto file = getMappedLogFile(inputFilename, fileSize);
+    if(!file){
         return false;
     }
+    setMappedLogFile(file);
+    return true;
+}
 
-    ifs.seekg(pos);
 
-    if(ifs.eof()){
-        ifs.seekg(currentReadFramePos);
+bool WorldLogFileItemImpl::readFrameHeader(int64_t pos)
+{
+    isCurrentFrameDataLoaded = false;
+    
+    if(!ifs.is_open()){
         return false;
     }
 
-    readBuf.clear();
+    readBuf.clear(pos);
     if(!readBuf.checkSize(frameHeaderSize)){
-        ifs.seekg(currentReadFramePos);
-        return false;
+        if(!extendMappedLogFile()){
+            return false;
+        }
+        readBuf.clear(pos);
+        if(!readBuf.checkSize(frameHeaderSize)){
+            return false;
+        }
     }
     
     currentReadFramePos = pos;
@@ -682,54 +1384,149 @@ bool WorldLogFileItemImpl::readFrameHeader(int pos)
 }
         
         
+/**
+   The index file is only used when its first and last frames correspond to those of the log file,
+   so that the index file which does not belong to the current log file is not used.
+*/
+bool WorldLogFileItemImpl::loadFrameIndexFile()
+{
+    ifstream indexIfs(getFrameIndexFilename().c_str(), ios::in | ios::binary);
+    if(!indexIfs.is_open()){
+        return false;
+    }
+    indexIfs.seekg(0, ios::end);
+    const int fileSize = indexIfs.tellg();
+    indexIfs.seekg(0);
+
+    vector<int64_t> positions;
+    vector<float> times;
+    ReadBuf buf(indexIfs);
+    try {
+        if(buf.readString() != frameIndexFileHeader){
+            return false;
+        }
+        const int n = (fileSize - buf.pos) / frameIndexEntrySize;
+        buf.ensureSize(n * frameIndexEntrySize);
+        positions.resize(n);
+        times.resize(n);
+        for(int i=0; i < n; ++i){
+            positions[i] = buf.readSeekPos();
+            times[i] = buf.readFloat();
+        }
+    } catch(NotEnoughDataException& ex){
+        return false;
+    }
+
+    if(positions.empty() ||
+       positions.front() != indexedFramePositions.front() ||
+       times.front() != indexedFrameTimes.front()){
+        return false;
+    }
+    if(!readFrameHeader(positions.back()) || currentReadFrameTime != times.back()){
+        return false;
+    }
+
+    indexedFramePositions.swap(positions);
+    indexedFrameTimes.swap(times);
+
+    return true;
+}
+
+
+void WorldLogFileItemImpl::saveFrameIndexFile()
+{
+    ofstream indexOfs2(getFrameIndexFilename().c_str(), ios::out | ios::binary | ios::trunc);
+    if(indexOfs2.is_open()){
+        WriteBuf buf(indexOfs2);
+        buf.writeString(frameIndexFileHeader);
+        for(size_t i=0; i < indexedFramePositions.size(); ++i){
+            buf.writeSeekPos(indexedFramePositions[i]);
+            buf.writeFloat(indexedFrameTimes[i]);
+        }
+        buf.flush();
+    }
+}
+
+
+/**
+   The frames following the last indexed frame are scanned until the frame after the given time
+   is found. This is necessary for the log file without the index file and for the log file being
+   recorded. The index file is saved when the whole log file has been scanned for the first time.
+*/
+void WorldLogFileItemImpl::extendFrameIndex(double time)
+{
+    if(!readFrameHeader(indexedFramePositions.back())){
+        return;
+    }
+    bool isExtended = false;
+    while(currentReadFrameTime <= time){
+        if(!readFrameHeader(currentReadFramePos + frameHeaderSize + currentReadFrameDataSize)){
+            // The end of the log has been reached
+            if(isExtended && !ofs.is_open()){
+                saveFrameIndexFile();
+            }
+            break;
+        }
+        indexedFramePositions.push_back(currentReadFramePos);
+        indexedFrameTimes.push_back(currentReadFrameTime);
+        isExtended = true;
+    }
+}
+
+
 bool WorldLogFileItemImpl::seek(double time)
 {
     isOverRange = false;
 
-    if(!readFrameHeader(currentReadFramePos)){
-        readTopHeader();
+    if(mappedLogFile && !mappedLogFile->isValid){
+        // The file has been truncated for a new recording
+        closeInput();
+    }
+
+    if(!ifs.is_open() || indexedFramePositions.empty()){
+        if(!readTopHeader()){
+            isOverRange = true;
+            return false;
+        }
     }
     
     if(currentReadFrameTime == time){
         return true;
     }
 
-    if(currentReadFrameTime < time){
-        while(true){
-            int pos = currentReadFramePos;
-            if(!readFrameHeader(currentReadFramePos + frameHeaderSize + currentReadFrameDataSize)){
-                isOverRange = true;
-                return (currentReadFrameTime >= 0.0);
-            }
-            if(currentReadFrameTime == time){
-                return true;
-            } else if(currentReadFrameTime > time){
-                return readFrameHeader(pos);
-            }
-        }
+    if(time > indexedFrameTimes.back()){
+        extendFrameIndex(time);
     }
 
-    // currentReadFrameTime > time
-    while(true){
-        if(prevReadFrameOffset <= 0){
+    // The last frame whose time is not greater than the given time
+    auto p = std::upper_bound(indexedFrameTimes.begin(), indexedFrameTimes.end(), time);
+    int index;
+    if(p == indexedFrameTimes.begin()){
+        isOverRange = true;
+        index = 0;
+    } else {
+        if(p == indexedFrameTimes.end() && time > indexedFrameTimes.back()){
             isOverRange = true;
-            return (currentReadFrameTime >= 0.0);
-        }
-        if(!readFrameHeader(currentReadFramePos - prevReadFrameOffset)){
-            return false;
-        }
-        if(currentReadFrameTime <= time){
-            return true;
         }
+        index = (p - indexedFrameTimes.begin()) - 1;
+    }
+
+    if(indexedFramePositions[index] == currentReadFramePos){
+        return true;
     }
+    return readFrameHeader(indexedFramePositions[index]);
 }
 
 
 bool WorldLogFileItemImpl::loadCurrentFrameData()
 {
-    ifs.seekg(currentReadFramePos + frameHeaderSize);
-    readBuf.clear();
+    const int64_t pos = currentReadFramePos + frameHeaderSize;
+    readBuf.clear(pos);
     isCurrentFrameDataLoaded = readBuf.checkSize(currentReadFrameDataSize);
+    if(!isCurrentFrameDataLoaded && extendMappedLogFile()){
+        readBuf.clear(pos);
+        isCurrentFrameDataLoaded = readBuf.checkSize(currentReadFrameDataSize);
+    }
     return isCurrentFrameDataLoaded;
 }
 
@@ -813,6 +1610,20 @@ void WorldLogFileItemImpl::readBodyState(BodyInfo* bodyInfo, double time)
                 updated = true;
             }
             break;
+        case QUANTIZED_LINK_POSITIONS:
+            numLinks = readQuantizedLinkPositions(bodyInfo);
+            if(numLinks > 0){
+                updated = true;
+                if(numLinks > 1){
+                    doForwardKinematics = false;
+                }
+            }
+            break;
+        case QUANTIZED_JOINT_POSITIONS:
+            if(readQuantizedJointPositions(bodyInfo)){
+                updated = true;
+            }
+            break;
         case DEVICE_STATES:
             if(updated){
                 bodyInfo->bodyItem->notifyKinematicStateChange(doForwardKinematics);
@@ -860,6 +1671,87 @@ int WorldLogFileItemImpl::readJointPositions(Body* body)
 }
 
 
+/**
+   The keyframe values are cached in io_values while the keyframe at the same position is referred.
+*/
+bool WorldLogFileItemImpl::readKeyframe
+(int64_t pos, int dataTypeID, int stride, int64_t& io_keyframePos, vector<double>& io_values)
+{
+    if(pos == io_keyframePos){
+        return true;
+    }
+    io_keyframePos = -1;
+    readBuf2.clear(pos);
+    try {
+        if(readBuf2.readID() != dataTypeID){
+            return false;
+        }
+        readBuf2.readSeekOffset(); // block size
+        const int n = readBuf2.readShort() * stride;
+        io_values.resize(n);
+        for(int i=0; i < n; ++i){
+            io_values[i] = readBuf2.readFloat();
+        }
+    } catch(NotEnoughDataException& ex){
+        return false;
+    }
+    io_keyframePos = pos;
+    return true;
+}
+
+
+int WorldLogFileItemImpl::readQuantizedLinkPositions(BodyInfo* bodyInfo)
+{
+    const int endPos = readBuf.readNextBlockPos();
+    const int size = readBuf.readShort();
+    const int64_t keyframePos = readBuf.readSeekPos();
+    const double translationPrecision = readBuf.readFloat();
+    const double rotationPrecision = readBuf.readFloat();
+    int n = 0;
+    if(readKeyframe(keyframePos, LINK_POSITIONS, 7, bodyInfo->linkKeyframePos, bodyInfo->linkKeyframe) &&
+       static_cast<int>(bodyInfo->linkKeyframe.size()) == size * 7){
+        Body* body = bodyInfo->body;
+        const double* key = bodyInfo->linkKeyframe.data();
+        n = std::min(size, body->numLinks());
+        for(int i=0; i < n; ++i){
+            Link* link = body->link(i);
+            for(int j=0; j < 3; ++j){
+                link->p()[j] = key[j] + readBuf.readVarInt() * translationPrecision;
+            }
+            Quat q;
+            q.w() = key[3] + readBuf.readVarInt() * rotationPrecision;
+            q.x() = key[4] + readBuf.readVarInt() * rotationPrecision;
+            q.y() = key[5] + readBuf.readVarInt() * rotationPrecision;
+            q.z() = key[6] + readBuf.readVarInt() * rotationPrecision;
+            link->R() = q.normalized().toRotationMatrix();
+            key += 7;
+        }
+    }
+    readBuf.seek(endPos);
+    return n;
+}
+
+
+int WorldLogFileItemImpl::readQuantizedJointPositions(BodyInfo* bodyInfo)
+{
+    const int endPos = readBuf.readNextBlockPos();
+    const int size = readBuf.readShort();
+    const int64_t keyframePos = readBuf.readSeekPos();
+    const double precision = readBuf.readFloat();
+    int n = 0;
+    if(readKeyframe(keyframePos, JOINT_POSITIONS, 1, bodyInfo->jointKeyframePos, bodyInfo->jointKeyframe) &&
+       static_cast<int>(bodyInfo->jointKeyframe.size()) == size){
+        Body* body = bodyInfo->body;
+        n = std::min(size, body->numAllJoints());
+        for(int i=0; i < n; ++i){
+            body->joint(i)->q() = bodyInfo->jointKeyframe[i] + readBuf.readVarInt() * precision;
+        }
+    }
+    readBuf.seek(endPos);
+    return n;
+}
+
+
 void WorldLogFileItemImpl::readDeviceStates(BodyInfo* bodyInfo, double time)
 {
     const int endPos = readBuf.readNextBlockPos();
@@ -903,7 +1795,12 @@ void WorldLogFileItemImpl::readDeviceState(DeviceInfo& devInfo, Device* device,
 
 void WorldLogFileItemImpl::readLastDeviceState(DeviceInfo& devInfo, Device* device)
 {
-    size_t pos = readBuf.readSeekOffset();
+    size_t pos;
+    if(formatVersion >= 2){
+        pos = readBuf.readSeekPos();
+    } else {
+        pos = readBuf.readSeekOffset();
+    }
     if(pos == devInfo.lastStateSeekPos){
         if(!devInfo.isConsistent){
             device->readState(&devInfo.lastState.front());
@@ -911,9 +1808,8 @@ void WorldLogFileItemImpl::readLastDeviceState(DeviceInfo& devInfo, Device* devi
             devInfo.isConsistent = true;
         }
     } else {
-        ifs.seekg(pos);
         devInfo.lastStateSeekPos = pos;
-        readBuf2.clear();
+        readBuf2.clear(pos);
         int size = readBuf2.readShort();
         if(size > 0){
             readDeviceState(devInfo, device, readBuf2, size);
@@ -944,20 +1840,182 @@ void WorldLogFileItemImpl::clearOutput()
 {
     bodyNames.clear();
 
+    closeInput();
+    closeOutput();
+    recordingStartTime = QDateTime::currentDateTime();
+
+    const string filename = getActualFilename();
+    invalidateMappedLogFile(filename);
+    ofs.open(filename.c_str(), ios::out | ios::binary | ios::trunc);
+    if(isBlockCompressionEnabled){
+        writeRawInt(ofs.rdbuf(), -blockCompressedFormatVersion);
+        compressingBuf.reset(new BlockCompressingBuf(ofs.rdbuf()));
+        os.rdbuf(compressingBuf.get());
+    } else {
+        os.rdbuf(ofs.rdbuf());
+    }
+    writeBuf.clear();
+    lastOutputFramePos = 0;
+    numOutputStalls = 0;
+    outputStallTime = 0.0;
+    maxQueuedOutputSize = 0;
+    linkKeyframeStates.clear();
+    jointKeyframeStates.clear();
+
+    if(indexOfs.is_open()){
+        indexOfs.close();
+    }
+    indexOfs.open(getFrameIndexFilename().c_str(), ios::out | ios::binary | ios::trunc);
+    if(indexOfs.is_open()){
+        indexWriteBuf.clear();
+        indexWriteBuf.writeString(frameIndexFileHeader);
+        indexWriteBuf.flush();
+    }
+
+    currentDeviceStateCacheArrayIndex = 0;
+    exchangeDeviceStateCacheArrays();
+}
+
+
+void WorldLogFileItemImpl::closeInput()
+{
+    setMappedLogFile(nullptr);
+    is.rdbuf(nullptr);
+    decompressingBuf.reset();
     if(ifs.is_open()){
         ifs.close();
     }
+}
+
+
+/**
+   This must be called when the recording is finished because the data queued for the output
+   thread and the last block of the compressed log are kept in the memory until they are written
+   by this function.
+*/
+void WorldLogFileItem::endOutput()
+{
+    impl->closeOutput();
+
+    if(impl->numOutputStalls > 0){
+        MessageView::instance()->putln(
+            format(_("The recording of {0} was stalled {1} times ({2:.3f} s in total) because "
+                     "the writing to the log file could not keep up with it."),
+                   name(), impl->numOutputStalls, impl->outputStallTime),
+            MessageView::WARNING);
+    }
+}
+
+
+void WorldLogFileItemImpl::closeOutput()
+{
+    stopOutputThread();
+    
+    if(compressingBuf){
+        compressingBuf->finish();
+    }
+    os.rdbuf(nullptr);
+    compressingBuf.reset();
     if(ofs.is_open()){
         ofs.close();
     }
-    recordingStartTime = QDateTime::currentDateTime();
+    if(indexOfs.is_open()){
+        indexOfs.close();
+    }
+}
+
+
+/**
+   The data of the buffer is moved to the queue of the output thread. The caller is blocked
+   while the queue is full so that the memory consumption is bounded.
+*/
+void WorldLogFileItemImpl::queueOutput(WriteBuf& buf, bool isIndex)
+{
+    const size_t size = buf.size();
     
-    ofs.open(getActualFilename().c_str(), ios::out | ios::binary | ios::trunc);
-    writeBuf.clear();
-    lastOutputFramePos = 0;
+    {
+        std::unique_lock<std::mutex> lock(outputQueueMutex);
 
-    currentDeviceStateCacheArrayIndex = 0;
-    exchangeDeviceStateCacheArrays();
+        if(!isOutputThreadActive){
+            isOutputThreadActive = true;
+            outputThread = std::thread([this](){ outputQueuedData(); });
+        }
+        if(outputQueueSize > 0 && outputQueueSize + size > maxOutputQueueSize){
+            auto stallStartTime = std::chrono::steady_clock::now();
+            while(outputQueueSize > 0 && outputQueueSize + size > maxOutputQueueSize){
+                outputQueueCondition.wait(lock);
+            }
+            ++numOutputStalls;
+            outputStallTime +=
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - stallStartTime).count();
+        }
+
+        outputQueue.emplace_back();
+        OutputData& output = outputQueue.back();
+        if(!spareOutputBuffers.empty()){
+            output.data.swap(spareOutputBuffers.back());
+            spareOutputBuffers.pop_back();
+        }
+        buf.moveDataTo(output.data);
+        output.isIndex = isIndex;
+        outputQueueSize += size;
+        if(outputQueueSize > maxQueuedOutputSize){
+            maxQueuedOutputSize = outputQueueSize;
+        }
+    }
+    
+    outputQueueCondition.notify_all();
+}
+
+
+void WorldLogFileItemImpl::outputQueuedData()
+{
+    vector<char> data;
+    
+    while(true){
+        bool isIndex;
+        {
+            std::unique_lock<std::mutex> lock(outputQueueMutex);
+            if(!data.empty()){
+                outputQueueSize -= data.size();
+                data.clear();
+                spareOutputBuffers.emplace_back();
+                spareOutputBuffers.back().swap(data);
+                outputQueueCondition.notify_all();
+            }
+            while(isOutputThreadActive && outputQueue.empty()){
+                outputQueueCondition.wait(lock);
+            }
+            if(outputQueue.empty()){
+                break;
+            }
+            data.swap(outputQueue.front().data);
+            isIndex = outputQueue.front().isIndex;
+            outputQueue.pop_front();
+        }
+
+        if(!data.empty()){
+            // The flush also compresses the filled block when the block compression is enabled
+            ostream& out = isIndex ? static_cast<ostream&>(indexOfs) : os;
+            out.write(&data.front(), data.size());
+            out.flush();
+        }
+    }
+}
+
+
+void WorldLogFileItemImpl::stopOutputThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(outputQueueMutex);
+        if(!isOutputThreadActive){
+            return;
+        }
+        isOutputThreadActive = false;
+    }
+    outputQueueCondition.notify_all();
+    outputThread.join();
+    spareOutputBuffers.clear();
 }
 
 
@@ -980,6 +2038,7 @@ void WorldLogFileItemImpl::fixSizeHeader()
 void WorldLogFileItem::beginHeaderOutput()
 {
     impl->writeBuf.clear();
+    impl->writeBuf.writeInt(-currentFormatVersion);
     impl->reserveSizeHeader();
 }
 
@@ -1002,7 +2061,7 @@ void WorldLogFileItem::endHeaderOutput()
 void WorldLogFileItemImpl::endHeaderOutput()
 {
     fixSizeHeader();
-    writeBuf.flush();
+    queueOutput(writeBuf, false);
 }
 
 
@@ -1026,7 +2085,7 @@ void WorldLogFileItem::beginFrameOutput(double time)
 
 void WorldLogFileItemImpl::beginFrameOutput(double time)
 {
-    size_t pos = writeBuf.seekPos();
+    int64_t pos = writeBuf.seekPos();
     
     if(lastOutputFramePos){
         writeBuf.writeSeekOffset(pos - lastOutputFramePos);
@@ -1034,8 +2093,14 @@ void WorldLogFileItemImpl::beginFrameOutput(double time)
         writeBuf.writeSeekOffset(0);
     }
     lastOutputFramePos = pos;
+
+    if(indexOfs.is_open()){
+        indexWriteBuf.writeSeekPos(pos);
+        indexWriteBuf.writeFloat(time);
+    }
     
     deviceIndex = 0;
+    bodyStateIndex = -1;
     writeBuf.writeFloat(time);
     reserveSizeHeader(); // area for the frame data size
 }
@@ -1043,32 +2108,175 @@ void WorldLogFileItemImpl::beginFrameOutput(double time)
 
 void WorldLogFileItem::beginBodyStateOutput()
 {
+    ++impl->bodyStateIndex;
     impl->writeBuf.writeID(BODY_STATE);
     impl->reserveSizeHeader();
 }
 
 
+WorldLogFileItemImpl::KeyframeState& WorldLogFileItemImpl::keyframeState(vector<KeyframeState>& states)
+{
+    if(bodyStateIndex >= static_cast<int>(states.size())){
+        KeyframeState initialState;
+        initialState.seekPos = -1;
+        initialState.numDeltaFrames = 0;
+        states.resize(bodyStateIndex + 1, initialState);
+    }
+    return states[bodyStateIndex];
+}
+
+
+/**
+   The positions in positionWriteBuf are quantized into quantizedDeltaBuf as the deltas from the
+   keyframe positions. False is returned when a new keyframe must be output instead.
+*/
+bool WorldLogFileItemImpl::quantizePositions(KeyframeState& keyframe, int stride, const double* precisions)
+{
+    const int n = positionWriteBuf.size();
+    if(keyframe.seekPos < 0 || static_cast<int>(keyframe.values.size()) != n ||
+       keyframe.numDeltaFrames >= keyframeInterval){
+        return false;
+    }
+    quantizedDeltaBuf.resize(n);
+    for(int i=0; i < n; ++i){
+        double delta = std::round((positionWriteBuf[i] - keyframe.values[i]) / precisions[i % stride]);
+        if(std::abs(delta) > maxQuantizedDelta){
+            return false;
+        }
+        quantizedDeltaBuf[i] = static_cast<int>(delta);
+    }
+    ++keyframe.numDeltaFrames;
+    return true;
+}
+
+
+/**
+   The keyframe is a usual position block. The positions are kept as the float values
+   which are read by the player so that the deltas do not include the rounding errors.
+*/
+void WorldLogFileItemImpl::outputKeyframe(KeyframeState& keyframe, DataTypeID dataTypeID, int stride)
+{
+    const int n = positionWriteBuf.size();
+    keyframe.seekPos = writeBuf.seekPos();
+    keyframe.numDeltaFrames = 0;
+    keyframe.values.resize(n);
+
+    writeBuf.writeID(dataTypeID);
+    reserveSizeHeader();
+    writeBuf.writeShort(n / stride);
+    for(int i=0; i < n; ++i){
+        float value = positionWriteBuf[i];
+        keyframe.values[i] = value;
+        writeBuf.writeFloat(value);
+    }
+    fixSizeHeader();
+}
+
+
 void WorldLogFileItem::outputLinkPositions(SE3* positions, int size)
 {
-    impl->writeBuf.writeID(LINK_POSITIONS);
-    impl->reserveSizeHeader();
-    impl->writeBuf.writeShort(size);
+    impl->outputLinkPositions(positions, size);
+}
+
+
+void WorldLogFileItemImpl::outputLinkPositions(SE3* positions, int size)
+{
+    if(!isQuantizedEncodingEnabled){
+        writeBuf.writeID(LINK_POSITIONS);
+        reserveSizeHeader();
+        writeBuf.writeShort(size);
+        for(int i=0; i < size; ++i){
+            writeBuf.writeSE3(positions[i]);
+        }
+        fixSizeHeader();
+        return;
+    }
+
+    KeyframeState& keyframe = keyframeState(linkKeyframeStates);
+    const bool hasKeyframe = (static_cast<int>(keyframe.values.size()) == size * 7);
+    
+    // The elements are stored in the same order as writeSE3
+    positionWriteBuf.resize(size * 7);
+    double* p = positionWriteBuf.data();
     for(int i=0; i < size; ++i){
-        impl->writeBuf.writeSE3(positions[i]);
+        const Vector3& t = positions[i].translation();
+        const Quat& q = positions[i].rotation();
+        double sign = 1.0;
+        if(hasKeyframe){
+            // q and -q are the same rotation and the one closer to the keyframe is quantized
+            const double* k = &keyframe.values[i * 7 + 3];
+            if(q.w() * k[0] + q.x() * k[1] + q.y() * k[2] + q.z() * k[3] < 0.0){
+                sign = -1.0;
+            }
+        }
+        p[0] = t.x();
+        p[1] = t.y();
+        p[2] = t.z();
+        p[3] = sign * q.w();
+        p[4] = sign * q.x();
+        p[5] = sign * q.y();
+        p[6] = sign * q.z();
+        p += 7;
+    }
+
+    // The precisions written in the file are used for quantizing
+    const double tp = static_cast<float>(linkTranslationPrecision);
+    const double rp = static_cast<float>(linkRotationPrecision);
+    const double precisions[] = { tp, tp, tp, rp, rp, rp, rp };
+    
+    if(!quantizePositions(keyframe, 7, precisions)){
+        outputKeyframe(keyframe, LINK_POSITIONS, 7);
+    } else {
+        writeBuf.writeID(QUANTIZED_LINK_POSITIONS);
+        reserveSizeHeader();
+        writeBuf.writeShort(size);
+        writeBuf.writeSeekPos(keyframe.seekPos);
+        writeBuf.writeFloat(tp);
+        writeBuf.writeFloat(rp);
+        for(auto& delta : quantizedDeltaBuf){
+            writeBuf.writeVarInt(delta);
+        }
+        fixSizeHeader();
     }
-    impl->fixSizeHeader();
 }
 
 
 void WorldLogFileItem::outputJointPositions(double* values, int size)
 {
-    impl->writeBuf.writeID(JOINT_POSITIONS);
-    impl->reserveSizeHeader();
-    impl->writeBuf.writeShort(size);
-    for(int i=0; i < size; ++i){
-        impl->writeBuf.writeFloat(values[i]);
+    impl->outputJointPositions(values, size);
+}
+
+
+void WorldLogFileItemImpl::outputJointPositions(double* values, int size)
+{
+    if(!isQuantizedEncodingEnabled){
+        writeBuf.writeID(JOINT_POSITIONS);
+        reserveSizeHeader();
+        writeBuf.writeShort(size);
+        for(int i=0; i < size; ++i){
+            writeBuf.writeFloat(values[i]);
+        }
+        fixSizeHeader();
+        return;
+    }
+
+    KeyframeState& keyframe = keyframeState(jointKeyframeStates);
+    positionWriteBuf.assign(values, values + size);
+    const double precision = static_cast<float>(jointPositionPrecision);
+    
+    if(!quantizePositions(keyframe, 1, &precision)){
+        outputKeyframe(keyframe, JOINT_POSITIONS, 1);
+    } else {
+        writeBuf.writeID(QUANTIZED_JOINT_POSITIONS);
+        reserveSizeHeader();
+        writeBuf.writeShort(size);
+        writeBuf.writeSeekPos(keyframe.seekPos);
+        writeBuf.writeFloat(precision);
+        for(auto& delta : quantizedDeltaBuf){
+            writeBuf.writeVarInt(delta);
+        }
+        fixSizeHeader();
     }
-    impl->fixSizeHeader();
 }
 
 
@@ -1095,21 +2303,39 @@ void WorldLogFileItemImpl::outputDeviceState(DeviceState* state)
         cache = (*pLastDeviceStateCacheArray)[deviceIndex];
         if(state == cache->state){
             writeBuf.writeShort(-1);
-            writeBuf.writeSeekOffset(cache->seekPos);
+            writeBuf.writeSeekPos(cache->seekPos);
             goto endOutputDeviceState;
         }
     }
-    cache->state = state;
-    cache->seekPos = writeBuf.seekPos();
     if(!state){
+        cache->state = state;
+        cache->values.clear();
+        cache->seekPos = writeBuf.seekPos();
         writeBuf.writeShort(0);
     } else {
-        int size = state->stateSize();
-        writeBuf.writeShort(size);
+        const int size = state->stateSize();
         doubleWriteBuf.resize(size);
-        state->writeState(&doubleWriteBuf.front());
-        for(int i=0; i < size; ++i){
-            writeBuf.writeFloat(doubleWriteBuf[i]);
+        state->writeState(doubleWriteBuf.data());
+        bool isChanged = !cache->state || static_cast<int>(cache->values.size()) != size;
+        for(int i=0; !isChanged && i < size; ++i){
+            if(static_cast<float>(doubleWriteBuf[i]) != cache->values[i]){
+                isChanged = true;
+            }
+        }
+        cache->state = state;
+        if(!isChanged){
+            // The new state object which has the same values is recorded as the reference
+            writeBuf.writeShort(-1);
+            writeBuf.writeSeekPos(cache->seekPos);
+        } else {
+            cache->values.resize(size);
+            cache->seekPos = writeBuf.seekPos();
+            writeBuf.writeShort(size);
+            for(int i=0; i < size; ++i){
+                const float value = doubleWriteBuf[i];
+                cache->values[i] = value;
+                writeBuf.writeFloat(value);
+            }
         }
     }
 endOutputDeviceState:
@@ -1134,7 +2360,11 @@ void WorldLogFileItem::endBodyStateOutput()
 void WorldLogFileItem::endFrameOutput()
 {
     impl->fixSizeHeader();
-    impl->writeBuf.flush();
+    impl->queueOutput(impl->writeBuf, false);
+    if(impl->indexOfs.is_open()){
+        // The index entry is written after the frame so that it always refers to a complete frame
+        impl->queueOutput(impl->indexWriteBuf, true);
+    }
     impl->exchangeDeviceStateCacheArrays();
 }
 
@@ -1160,6 +2390,23 @@ void WorldLogFileItem::doPutProperties(PutPropertyFunction& putProperty)
                 changeProperty(impl->isTimeStampSuffixEnabled));
     putProperty(_("Recording frame rate"), impl->recordingFrameRate,
                 changeProperty(impl->recordingFrameRate));
+    putProperty(_("Block compression"), impl->isBlockCompressionEnabled,
+                changeProperty(impl->isBlockCompressionEnabled));
+    putProperty(_("Quantized encoding"), impl->isQuantizedEncodingEnabled,
+                changeProperty(impl->isQuantizedEncodingEnabled));
+    putProperty.decimals(7).min(1.0e-7);
+    putProperty(_("Joint position precision"), impl->jointPositionPrecision,
+                changeProperty(impl->jointPositionPrecision));
+    putProperty(_("Link translation precision"), impl->linkTranslationPrecision,
+                changeProperty(impl->linkTranslationPrecision));
+    putProperty(_("Link rotation precision"), impl->linkRotationPrecision,
+                changeProperty(impl->linkRotationPrecision));
+    putProperty.reset().min(1)(_("Keyframe interval"), impl->keyframeInterval,
+                               changeProperty(impl->keyframeInterval));
+    putProperty.reset();
+    putProperty(_("Output stalls"), impl->numOutputStalls);
+    putProperty(_("Output stall time"), impl->outputStallTime);
+    putProperty(_("Max output queue [MiB]"), impl->maxQueuedOutputSize / (1024.0 * 1024.0));
 }
 
 
@@ -1169,6 +2416,12 @@ bool WorldLogFileItem::store(Archive& archive)
     archive.write("format", fileFormat());
     archive.write("timeStampSuffix", impl->isTimeStampSuffixEnabled);
     archive.write("recordingFrameRate", impl->recordingFrameRate);
+    archive.write("blockCompression", impl->isBlockCompressionEnabled);
+    archive.write("quantizedEncoding", impl->isQuantizedEncodingEnabled);
+    archive.write("jointPositionPrecision", impl->jointPositionPrecision);
+    archive.write("linkTranslationPrecision", impl->linkTranslationPrecision);
+    archive.write("linkRotationPrecision", impl->linkRotationPrecision);
+    archive.write("keyframeInterval", impl->keyframeInterval);
     return true;
 }
 
@@ -1177,6 +2430,12 @@ bool WorldLogFileItem::restore(const Archive& archive)
 {
     archive.read("timeStampSuffix", impl->isTimeStampSuffixEnabled);
     archive.read("recordingFrameRate", impl->recordingFrameRate);
+    archive.read("blockCompression", impl->isBlockCompressionEnabled);
+    archive.read("quantizedEncoding", impl->isQuantizedEncodingEnabled);
+    archive.read("jointPositionPrecision", impl->jointPositionPrecision);
+    archive.read("linkTranslationPrecision", impl->linkTranslationPrecision);
+    archive.read("linkRotationPrecision", impl->linkRotationPrecision);
+    archive.read("keyframeInterval", impl->keyframeInterval);
     
     std::string filename, formatId;
     if(archive.readRelocatablePath("filename", filename)){
@@ -43,6 +43,7 @@ public:
     void endDeviceStateOutput();
     void endBodyStateOutput();
     void endFrameOutput();
+    void endOutput();
 
     int numBodies() const;
     const std::string& bodyName(int bodyIndex) const;
@@ -52,6 +53,9 @@ public:
 
     virtual void notifyUpdate() override;
 
+    //! The buffers for recording and playback are counted except the mapped log file
+    virtual void countMemoryUsage(MemoryUsageCounter& counter) override;
+
 protected:
     virtual Item* doDuplicate() const override;
     virtual void onPositionChanged() override;
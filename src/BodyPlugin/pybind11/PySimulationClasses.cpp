@@ -6,16 +6,92 @@
 #include "../AISTSimulatorItem.h"
 #include "../SubSimulatorItem.h"
 #include "../GLVisionSimulatorItem.h"
+#include "../SimulationStreamServerItem.h"
+#include "../SimulationStreamClientItem.h"
 #include "../SimulationScriptItem.h"
 #include "../SimulationBar.h"
 #include "../BodyItem.h"
 #include "../SimpleControllerItem.h"
 #include <cnoid/PyBase>
 #include <cnoid/PyEigenTypes>
+#include <cnoid/Body>
+#include <pybind11/numpy.h>
+#include <memory>
 
+using namespace std;
 using namespace cnoid;
 namespace py = pybind11;
 
+namespace {
+
+/**
+   Calls a Python function with the joint states of all the simulation bodies every given
+   number of simulation steps. The states are gathered in the simulation thread without the GIL,
+   and the GIL is only acquired to call the function. The function receives the current time
+   and a dictionary which maps the body names to the arrays whose rows are the joint position,
+   velocity and torque of each joint. The arrays are views of the internal buffers, so they must
+   be copied to be used after the function returns.
+*/
+class PyJointStateCallback
+{
+public:
+    SimulatorItem* simulatorItem;
+    py::object func;
+    int interval;
+    int counter;
+    vector<vector<double>> buffers;
+
+    PyJointStateCallback(SimulatorItem* simulatorItem, py::object func, int interval)
+        : simulatorItem(simulatorItem), func(func), interval(std::max(interval, 1)), counter(0) { }
+
+    ~PyJointStateCallback() {
+        // The function set of the simulator item may be cleared in a thread without the GIL
+        py::gil_scoped_acquire lock;
+        func = py::object();
+    }
+
+    void operator()() {
+        if(++counter < interval){
+            return;
+        }
+        counter = 0;
+
+        auto& simBodies = simulatorItem->simulationBodies();
+        buffers.resize(simBodies.size());
+        for(size_t i=0; i < simBodies.size(); ++i){
+            Body* body = simBodies[i]->body();
+            const int n = body->numJoints();
+            auto& buf = buffers[i];
+            buf.resize(n * 3);
+            for(int j=0; j < n; ++j){
+                Link* joint = body->joint(j);
+                buf[j * 3] = joint->q();
+                buf[j * 3 + 1] = joint->dq();
+                buf[j * 3 + 2] = joint->u();
+            }
+        }
+
+        py::gil_scoped_acquire lock;
+        try {
+            py::capsule owner(buffers.data(), [](void*){ });
+            py::dict states;
+            for(size_t i=0; i < simBodies.size(); ++i){
+                auto& buf = buffers[i];
+                const py::ssize_t n = buf.size() / 3;
+                states[py::str(simBodies[i]->body()->name())] =
+                    py::array_t<double>(
+                        { n, (py::ssize_t)3 }, { (py::ssize_t)(3 * sizeof(double)), (py::ssize_t)sizeof(double) },
+                        buf.data(), owner);
+            }
+            func(simulatorItem->currentTime(), states);
+        } catch(const py::error_already_set& ex) {
+            py::print(ex.what());
+        }
+    }
+};
+
+}
+
 namespace cnoid {
 
 void exportSimulationClasses(py::module m)
@@ -42,6 +118,11 @@ void exportSimulationClasses(py::module m)
         .def_property_readonly("recordingMode", &SimulatorItem::recordingMode)
         .def("setTimeRangeMode", &SimulatorItem::setTimeRangeMode)
         .def("setRealtimeSyncMode", &SimulatorItem::setRealtimeSyncMode)
+        .def("setCheckpointInterval", &SimulatorItem::setCheckpointInterval)
+        .def_property_readonly("checkpointInterval", &SimulatorItem::checkpointInterval)
+        .def("startSimulationFromTime", &SimulatorItem::startSimulationFromTime)
+        .def("setFastForwardMode", &SimulatorItem::setFastForwardMode)
+        .def("isFastForwardMode", &SimulatorItem::isFastForwardMode)
         .def("setDeviceStateOutputEnabled", &SimulatorItem::setDeviceStateOutputEnabled)
         .def("isRecordingEnabled", &SimulatorItem::isRecordingEnabled)
         .def("isDeviceStateOutputEnabled", &SimulatorItem::isDeviceStateOutputEnabled)
@@ -55,6 +136,13 @@ void exportSimulationClasses(py::module m)
         .def("clearExternalForces", &SimulatorItem::clearExternalForces)
         .def("setForcedPosition", &SimulatorItem::setForcedPosition)
         .def("clearForcedPositions", &SimulatorItem::clearForcedPositions)
+        .def("addJointStateCallback", [](SimulatorItem& self, py::object func, int interval){
+                auto callback = std::make_shared<PyJointStateCallback>(&self, func, interval);
+                py::gil_scoped_release release;
+                return self.addPostDynamicsFunction([callback](){ (*callback)(); });
+            }, py::arg("func"), py::arg("interval") = 1)
+        .def("removeJointStateCallback", &SimulatorItem::removePostDynamicsFunction,
+             py::call_guard<py::gil_scoped_release>())
 
         // deprecated
         .def("getWorldTimeStep", &SimulatorItem::worldTimeStep)
@@ -108,11 +196,33 @@ void exportSimulationClasses(py::module m)
         .def("setConstraintForceOutputEnabled", &AISTSimulatorItem::setConstraintForceOutputEnabled)
         .def("clearExtraJoint", &AISTSimulatorItem::clearExtraJoint)
         .def("addExtraJoint", &AISTSimulatorItem::addExtraJoint)
+        .def_property_readonly("solverStatistics", &AISTSimulatorItem::solverStatistics)
+        .def("getSolverStatistics", &AISTSimulatorItem::solverStatistics)
 
         // deprecated
         .def("setFriction", (void (AISTSimulatorItem::*)(Link*, Link*, double, double)) &AISTSimulatorItem::setFriction)
         ;
 
+    py::class_<ConstraintForceSolver::Statistics>(aistSimulatorItemClass, "StepSolverStatistics")
+        .def_readonly("numContacts", &ConstraintForceSolver::Statistics::numContacts)
+        .def_readonly("problemSize", &ConstraintForceSolver::Statistics::problemSize)
+        .def_readonly("numIslands", &ConstraintForceSolver::Statistics::numIslands)
+        .def_readonly("numIterations", &ConstraintForceSolver::Statistics::numIterations)
+        .def_readonly("error", &ConstraintForceSolver::Statistics::error)
+        .def_readonly("isIterationLimitReached", &ConstraintForceSolver::Statistics::isIterationLimitReached)
+        ;
+
+    py::class_<AISTSimulatorItem::SolverStatistics>(aistSimulatorItemClass, "SolverStatistics")
+        .def_readonly("lastStep", &AISTSimulatorItem::SolverStatistics::lastStep)
+        .def_readonly("numSteps", &AISTSimulatorItem::SolverStatistics::numSteps)
+        .def_readonly("numIterationLimitHits", &AISTSimulatorItem::SolverStatistics::numIterationLimitHits)
+        .def_readonly("totalNumIterations", &AISTSimulatorItem::SolverStatistics::totalNumIterations)
+        .def_readonly("maxNumContacts", &AISTSimulatorItem::SolverStatistics::maxNumContacts)
+        .def_readonly("maxProblemSize", &AISTSimulatorItem::SolverStatistics::maxProblemSize)
+        .def_readonly("maxNumIterations", &AISTSimulatorItem::SolverStatistics::maxNumIterations)
+        .def_readonly("maxError", &AISTSimulatorItem::SolverStatistics::maxError)
+        ;
+
     py::enum_<AISTSimulatorItem::DynamicsMode>(aistSimulatorItemClass, "DynamicsMode")
         .value("FORWARD_DYNAMICS", AISTSimulatorItem::DynamicsMode::FORWARD_DYNAMICS)
         .value("KINEMATICS", AISTSimulatorItem::DynamicsMode::KINEMATICS)
@@ -151,6 +261,32 @@ void exportSimulationClasses(py::module m)
 
     PyItemList<GLVisionSimulatorItem>(m, "GLVisionSimulatorItemList");
 
+    py::class_<SimulationStreamServerItem, SimulationStreamServerItemPtr, SubSimulatorItem>(m, "SimulationStreamServerItem")
+        .def(py::init<>())
+        .def("setPort", &SimulationStreamServerItem::setPort)
+        .def_property_readonly("port", &SimulationStreamServerItem::port)
+        .def("setFrameRate", &SimulationStreamServerItem::setFrameRate)
+        .def("setBandwidth", &SimulationStreamServerItem::setBandwidth)
+        .def("setContactStreamingEnabled", &SimulationStreamServerItem::setContactStreamingEnabled)
+        .def("setImageFrameRate", &SimulationStreamServerItem::setImageFrameRate)
+        .def("setImageDownscaleFactor", &SimulationStreamServerItem::setImageDownscaleFactor)
+        .def_property_readonly("numClients", &SimulationStreamServerItem::numClients)
+        ;
+
+    py::class_<SimulationStreamClientItem, SimulationStreamClientItemPtr, Item>(m, "SimulationStreamClientItem")
+        .def(py::init<>())
+        .def("setHost", &SimulationStreamClientItem::setHost)
+        .def_property_readonly("host", &SimulationStreamClientItem::host)
+        .def("setPort", &SimulationStreamClientItem::setPort)
+        .def_property_readonly("port", &SimulationStreamClientItem::port)
+        .def("setBandwidth", &SimulationStreamClientItem::setBandwidth)
+        .def("setImageStreamingEnabled", &SimulationStreamClientItem::setImageStreamingEnabled)
+        .def("connectToServer", &SimulationStreamClientItem::connectToServer)
+        .def("disconnectFromServer", &SimulationStreamClientItem::disconnectFromServer)
+        .def("isConnected", &SimulationStreamClientItem::isConnected)
+        .def_property_readonly("streamTime", &SimulationStreamClientItem::streamTime)
+        ;
+
     py::class_<SimulationScriptItem, SimulationScriptItemPtr, ScriptItem> simulationScriptItemClass(m,"SimulationScriptItem");
 
     simulationScriptItemClass
@@ -15,9 +15,11 @@
 #include <cnoid/BasicSensorSimulationHelper>
 #include <cnoid/MeshExtractor>
 #include <cnoid/SceneDrawables>
+#include <cnoid/ConvexDecomposition>
 #include <btBulletDynamicsCommon.h>
 #include <HACD/hacdHACD.h>
 #include <BulletCollision/Gimpact/btGImpactShape.h>
+#include <BulletCollision/CollisionShapes/btHeightfieldTerrainShape.h>
 #include <BulletCollision/Gimpact/btGImpactCollisionAlgorithm.h>
 #include <BulletDynamics/Featherstone/btMultiBody.h>
 #include <BulletDynamics/Featherstone/btMultiBodyConstraintSolver.h>
@@ -28,6 +30,14 @@
 #include <BulletDynamics/Featherstone/btMultiBodyJointMotor.h>
 #include <BulletDynamics/Featherstone/btMultiBodyPoint2Point.h>
 #include <BulletDynamics/Featherstone/btMultiBodyJointFeedback.h>
+#if defined(BT_THREADSAFE) && defined(BT_VER_GT_287)
+#define CNOID_BULLET_MULTITHREADING
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <LinearMath/btThreads.h>
+#include <algorithm>
+#endif
 #include "gettext.h"
 
 using namespace std;
@@ -48,6 +58,33 @@ const btScalar DEFAULT_COLLISION_MARGIN = 0.0001;
 const bool meshOnly = false;             // not use primitive Shape
 const bool mixedPrimitiveMesh = true;   // mixed of Primitive and Mesh on one link
 
+enum TaskSchedulerType { DEFAULT_SCHEDULER, OPENMP_SCHEDULER, TBB_SCHEDULER, PPL_SCHEDULER, NUM_TASK_SCHEDULERS };
+
+#ifdef CNOID_BULLET_MULTITHREADING
+/**
+   The task scheduler is global in Bullet, and the schedulers are created once and
+   shared by the simulator items. The default scheduler is used when the specified one
+   is not available in the Bullet library.
+*/
+btITaskScheduler* getTaskScheduler(int type)
+{
+    static btITaskScheduler* schedulers[NUM_TASK_SCHEDULERS] = { nullptr, nullptr, nullptr, nullptr };
+    static bool created = false;
+    if(!created){
+        schedulers[DEFAULT_SCHEDULER] = btCreateDefaultTaskScheduler();
+        schedulers[OPENMP_SCHEDULER] = btGetOpenMPTaskScheduler();
+        schedulers[TBB_SCHEDULER] = btGetTBBTaskScheduler();
+        schedulers[PPL_SCHEDULER] = btGetPPLTaskScheduler();
+        created = true;
+    }
+    btITaskScheduler* scheduler = schedulers[type];
+    if(!scheduler){
+        scheduler = schedulers[DEFAULT_SCHEDULER];
+    }
+    return scheduler;
+}
+#endif
+
 void diagonalizeInertia(const Vector3& c, const Matrix3& I, btVector3& localInertia, btTransform& shift)
 {
     shift.setIdentity();
@@ -76,6 +113,8 @@ public:
     btTransform invShift;
     vector<btScalar> vertices;
     vector<int> triangles;
+    // The heights referred by the heightfield shapes, which are shared by the tiles of a field
+    vector<std::shared_ptr<const vector<float>>> heightFields;
 
     btTriangleIndexVertexArray* pMeshData;
     btTriangleMesh* trimesh;
@@ -97,6 +136,7 @@ public:
     void createLinkBody(BulletSimulatorItemImpl* simImpl, BulletLink* parent, const Vector3& origin,
                         short group, bool isSelfCollisionDetectionEnabled);
     void addMesh(MeshExtractor* extractor, bool meshOnly);
+    void addConvexPieces(SgMesh* mesh, const Affine3& T);
     void createGeometry();
     void getKinematicStateFromBullet();
     void setKinematicStateToBullet();
@@ -147,6 +187,9 @@ public:
     btBroadphaseInterface* broadphase;
     btConstraintSolver* solver;
     btDynamicsWorld* dynamicsWorld;
+#ifdef CNOID_BULLET_MULTITHREADING
+    btConstraintSolverPoolMt* solverPool;
+#endif
 
     Vector3 gravity;
     double timeStep;
@@ -159,6 +202,9 @@ public:
     bool useHACD;                           // Hierarchical Approximate Convex Decomposition
     double collisionMargin;
     bool usefeatherstoneAlgorithm;
+    bool useConvexDecomposition;
+    int numThreads;
+    Selection taskScheduler;
 
     BulletSimulatorItemImpl(BulletSimulatorItem* self);
     BulletSimulatorItemImpl(BulletSimulatorItem* self, const BulletSimulatorItemImpl& org);
@@ -379,6 +425,7 @@ void BulletLink::addMesh(MeshExtractor* extractor, bool meshOnly)
             }
             if(doAddPrimitive){
                 bool created = false;
+                Vector3 origin = Vector3::Zero();
 
                 btCollisionShape* primitiveShape;
                 switch(mesh->primitiveType()){
@@ -407,6 +454,28 @@ void BulletLink::addMesh(MeshExtractor* extractor, bool meshOnly)
                     primitiveShape = new btCapsuleShape(capsule.radius * scale.x(), capsule.height * scale.y());
                     created = true;
                     break; }
+                case SgMesh::HEIGHT_FIELD : {
+                    // The heightfield shape is only used for a static link because it is concave
+                    if(!isStatic){
+                        break;
+                    }
+                    auto& field = mesh->primitive<SgMesh::HeightField>();
+                    if(std::find(heightFields.begin(), heightFields.end(), field.heights) != heightFields.end()){
+                        meshAdded = true;
+                        break;
+                    }
+                    heightFields.push_back(field.heights);
+                    auto range = std::minmax_element(field.heights->begin(), field.heights->end());
+                    primitiveShape = new btHeightfieldTerrainShape(
+                        field.xDimension, field.zDimension, field.heights->data(), 1.0,
+                        *range.first, *range.second, 1, PHY_FLOAT, false);
+                    primitiveShape->setLocalScaling(btVector3(field.xSpacing, 1.0, field.zSpacing));
+                    // The origin of a heightfield shape is the center of its bounding box
+                    origin = Vector3(field.xSpacing * (field.xDimension - 1) / 2.0,
+                                     (*range.first + *range.second) / 2.0,
+                                     field.zSpacing * (field.zDimension - 1) / 2.0);
+                    created = true;
+                    break; }
                 default :
                     break;
                 }
@@ -422,6 +491,7 @@ void BulletLink::addMesh(MeshExtractor* extractor, bool meshOnly)
                     if(translation){
                         T_ *= Translation3(*translation);
                     }
+                    T_ *= Translation3(origin);
                     btVector3 p(T_(0,3), T_(1,3), T_(2,3));
                     btMatrix3x3 R(T_(0,0), T_(0,1), T_(0,2),
                                   T_(1,0), T_(1,1), T_(1,2),
@@ -434,7 +504,9 @@ void BulletLink::addMesh(MeshExtractor* extractor, bool meshOnly)
         }
     }
     if(!meshAdded){
-        if(!simImpl->useHACD || isStatic){
+        if(simImpl->useConvexDecomposition && !isStatic){
+            addConvexPieces(mesh, T);
+        } else if(!simImpl->useHACD || isStatic){
             const int vertexIndexTop = vertices.size() / 3;
 
             const SgVertexArray& vertices_ = *mesh->vertices();
@@ -572,6 +644,46 @@ void BulletLink::addMesh(MeshExtractor* extractor, bool meshOnly)
     }
 }
 
+/**
+   The convex pieces are given by the shared convex decomposition service,
+   which caches the results so that the decomposition is not repeated when
+   the simulation is restarted.
+*/
+void BulletLink::addConvexPieces(SgMesh* mesh, const Affine3& T)
+{
+    auto pieces = ConvexDecomposition::instance()->decompose(mesh);
+    if(pieces.empty()){
+        return;
+    }
+
+    btCompoundShape* compoundShape = dynamic_cast<btCompoundShape*>(collisionShape);
+    if(!compoundShape){
+        compoundShape = new btCompoundShape();
+        compoundShape->setLocalScaling(btVector3(1.f,1.f,1.f));
+        if(collisionShape){
+            btTransform I;
+            I.setIdentity();
+            compoundShape->addChildShape(I, collisionShape);
+        }
+        collisionShape = compoundShape;
+    }
+
+    btTransform I;
+    I.setIdentity();
+    for(auto& piece : pieces){
+        btConvexHullShape* convexHullShape = new btConvexHullShape();
+        const SgVertexArray& pieceVertices = *piece->vertices();
+        for(size_t i=0; i < pieceVertices.size(); ++i){
+            const Vector3 v = T * pieceVertices[i].cast<Position::Scalar>();
+            convexHullShape->addPoint(invShift * btVector3(v.x(), v.y(), v.z()), false);
+        }
+        convexHullShape->recalcLocalAabb();
+        convexHullShape->setMargin(simImpl->collisionMargin);
+        compoundShape->addChildShape(I, convexHullShape);
+    }
+}
+
+
 void BulletLink::createLinkBody(BulletSimulatorItemImpl* simImpl, BulletLink* parent_, const Vector3& origin, 
                                 short group, bool isSelfCollisionDetectionEnabled)
 {
@@ -1290,7 +1402,8 @@ BulletSimulatorItem::BulletSimulatorItem()
 
 
 BulletSimulatorItemImpl::BulletSimulatorItemImpl(BulletSimulatorItem* self)
-    : self(self)
+    : self(self),
+      taskScheduler(NUM_TASK_SCHEDULERS, CNOID_GETTEXT_DOMAIN_NAME)
 
 {
     initialize();
@@ -1304,7 +1417,14 @@ BulletSimulatorItemImpl::BulletSimulatorItemImpl(BulletSimulatorItem* self)
     useHACD = false;
     collisionMargin = DEFAULT_COLLISION_MARGIN;
     usefeatherstoneAlgorithm = true;
-
+    useConvexDecomposition = false;
+    numThreads = 1;
+
+    taskScheduler.setSymbol(DEFAULT_SCHEDULER, N_("Default"));
+    taskScheduler.setSymbol(OPENMP_SCHEDULER, N_("OpenMP"));
+    taskScheduler.setSymbol(TBB_SCHEDULER, N_("TBB"));
+    taskScheduler.setSymbol(PPL_SCHEDULER, N_("PPL"));
+    taskScheduler.select(DEFAULT_SCHEDULER);
 }
 
 
@@ -1329,7 +1449,9 @@ BulletSimulatorItemImpl::BulletSimulatorItemImpl(BulletSimulatorItem* self, cons
     useHACD = org.useHACD;
     collisionMargin = org.collisionMargin;
     usefeatherstoneAlgorithm = org.usefeatherstoneAlgorithm;
-
+    useConvexDecomposition = org.useConvexDecomposition;
+    numThreads = org.numThreads;
+    taskScheduler = org.taskScheduler;
 }
 
 void BulletSimulatorItemImpl::initialize()
@@ -1339,6 +1461,9 @@ void BulletSimulatorItemImpl::initialize()
     broadphase = 0;
     solver =0;
     dynamicsWorld = 0;
+#ifdef CNOID_BULLET_MULTITHREADING
+    solverPool = 0;
+#endif
 
     gContactAddedCallback = 0;
 
@@ -1392,10 +1517,35 @@ bool BulletSimulatorItemImpl::initializeSimulation(const std::vector<SimulationB
     clear();
 
     collisionConfiguration = new btDefaultCollisionConfiguration();
-    dispatcher = new btCollisionDispatcher(collisionConfiguration);
     broadphase = new btDbvtBroadphase();
 
-    if(usefeatherstoneAlgorithm){
+#ifdef CNOID_BULLET_MULTITHREADING
+    if(numThreads > 1){
+        btITaskScheduler* scheduler = getTaskScheduler(taskScheduler.which());
+        scheduler->setNumThreads(numThreads);
+        btSetTaskScheduler(scheduler);
+
+        // The narrow phase is processed in parallel in both of the dynamics worlds
+        dispatcher = new btCollisionDispatcherMt(collisionConfiguration, 40);
+
+        // The islands are solved in parallel only by the world without the Featherstone algorithm
+        if(!usefeatherstoneAlgorithm){
+            solverPool = new btConstraintSolverPoolMt(numThreads);
+            solver = new btSequentialImpulseConstraintSolverMt();
+            dynamicsWorld = new btDiscreteDynamicsWorldMt(
+                dispatcher, broadphase, solverPool, solver, collisionConfiguration);
+            self->setAllLinkPositionOutputMode(true);
+        }
+    } else {
+        dispatcher = new btCollisionDispatcher(collisionConfiguration);
+    }
+#else
+    dispatcher = new btCollisionDispatcher(collisionConfiguration);
+#endif
+
+    if(dynamicsWorld){
+        // The multithreaded world has been created
+    } else if(usefeatherstoneAlgorithm){
         btMultiBodyConstraintSolver* solver_ = new btMultiBodyConstraintSolver;
         solver = solver_;
         dynamicsWorld = new btMultiBodyDynamicsWorld(dispatcher,broadphase,solver_,collisionConfiguration);
@@ -1430,6 +1580,12 @@ void BulletSimulatorItemImpl::clear()
 {
     if(dynamicsWorld)
         delete dynamicsWorld;
+    dynamicsWorld = 0;
+#ifdef CNOID_BULLET_MULTITHREADING
+    if(solverPool)
+        delete solverPool;
+    solverPool = 0;
+#endif
     if(solver)
         delete solver;
     if(dispatcher)
@@ -1547,6 +1703,12 @@ void BulletSimulatorItemImpl::doPutProperties(PutPropertyFunction& putProperty)
     putProperty(_("use HACD"), useHACD, changeProperty(useHACD));
     putProperty(_("Collision Margin"), collisionMargin, changeProperty(collisionMargin));
     putProperty(_("use Featherstone Algorithm"), usefeatherstoneAlgorithm, changeProperty(usefeatherstoneAlgorithm));
+    putProperty(_("use Convex Decomposition"), useConvexDecomposition, changeProperty(useConvexDecomposition));
+#ifdef CNOID_BULLET_MULTITHREADING
+    putProperty.min(1);
+    putProperty(_("Num of Threads"), numThreads, changeProperty(numThreads));
+    putProperty(_("Task Scheduler"), taskScheduler, changeProperty(taskScheduler));
+#endif
 }
 
 
@@ -1569,6 +1731,9 @@ void BulletSimulatorItemImpl::store(Archive& archive)
     archive.write("useHACD", useHACD);
     archive.write("CollisionMargin", collisionMargin);
     archive.write("usefeatherstoneAlgorithm", usefeatherstoneAlgorithm);
+    archive.write("useConvexDecomposition", useConvexDecomposition);
+    archive.write("numThreads", numThreads);
+    archive.write("taskScheduler", taskScheduler.selectedSymbol());
 }
 
 
@@ -1591,6 +1756,12 @@ void BulletSimulatorItemImpl::restore(const Archive& archive)
     archive.read("useHACD", useHACD);
     archive.read("CollisionMargin", collisionMargin);
     archive.read("usefeatherstoneAlgorithm", usefeatherstoneAlgorithm);
+    archive.read("useConvexDecomposition", useConvexDecomposition);
+    archive.read("numThreads", numThreads);
+    string symbol;
+    if(archive.read("taskScheduler", symbol)){
+        taskScheduler.select(symbol);
+    }
 }
 
 void BulletSimulatorItemImpl::setSolverParameter()
@@ -0,0 +1,385 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#include "BodyStateService_impl.h"
+#include <cnoid/BodyItem>
+#include <cnoid/RootItem>
+#include <cnoid/ItemList>
+#include <cnoid/TimeBar>
+#include <cnoid/LazyCaller>
+#include <cnoid/Camera>
+#include <cnoid/EigenTypes>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+// The subscriptions are checked at this interval, which limits the maximum rate
+const int subscriptionCheckInterval = 10; // [ms]
+
+void getBodyItems(const Corba::StringSequence& names, ItemList<BodyItem>& out_bodyItems)
+{
+    ItemList<BodyItem> allBodyItems;
+    allBodyItems.extractSubTreeItems(RootItem::instance());
+    if(names.length() == 0){
+        out_bodyItems = allBodyItems;
+    } else {
+        out_bodyItems.clear();
+        for(CORBA::ULong i=0; i < names.length(); ++i){
+            for(size_t j=0; j < allBodyItems.size(); ++j){
+                if(allBodyItems[j]->name() == names[i].in()){
+                    out_bodyItems.push_back(allBodyItems[j]);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+
+BodyItem* findBodyItem(const char* name)
+{
+    ItemList<BodyItem> bodyItems;
+    bodyItems.extractSubTreeItems(RootItem::instance());
+    for(size_t i=0; i < bodyItems.size(); ++i){
+        if(bodyItems[i]->name() == name){
+            return bodyItems.get(i);
+        }
+    }
+    return nullptr;
+}
+
+
+void readBodyState(BodyItem* bodyItem, int flags, Corba::BodyState& state)
+{
+    Body* body = bodyItem->body();
+    state.name = bodyItem->name().c_str();
+
+    const int numLinks = (flags & Corba::ALL_LINK_POSITIONS) ? body->numLinks() : 1;
+    state.linkPositions.length(numLinks * 7);
+    double* p = state.linkPositions.get_buffer();
+    for(int i=0; i < numLinks; ++i){
+        Link* link = body->link(i);
+        const Vector3 t = link->translation();
+        const Quat q(link->rotation());
+        *p++ = t.x();
+        *p++ = t.y();
+        *p++ = t.z();
+        *p++ = q.w();
+        *p++ = q.x();
+        *p++ = q.y();
+        *p++ = q.z();
+    }
+
+    const int numJoints = body->numJoints();
+    state.q.length(numJoints);
+    state.dq.length((flags & Corba::JOINT_VELOCITIES) ? numJoints : 0);
+    state.u.length((flags & Corba::JOINT_TORQUES) ? numJoints : 0);
+    for(int i=0; i < numJoints; ++i){
+        Link* joint = body->joint(i);
+        state.q[i] = joint->q();
+        if(flags & Corba::JOINT_VELOCITIES){
+            state.dq[i] = joint->dq();
+        }
+        if(flags & Corba::JOINT_TORQUES){
+            state.u[i] = joint->u();
+        }
+    }
+
+    const int numDevices = body->numDevices();
+    if(!(flags & Corba::DEVICE_STATES)){
+        state.deviceStates.length(0);
+    } else {
+        int size = 0;
+        for(int i=0; i < numDevices; ++i){
+            size += body->device(i)->stateSize();
+        }
+        state.deviceStates.length(size);
+        double* buf = state.deviceStates.get_buffer();
+        for(int i=0; i < numDevices; ++i){
+            buf = body->device(i)->writeState(buf);
+        }
+    }
+
+    state.images.length(0);
+    if(flags & Corba::CAMERA_IMAGES){
+        for(int i=0; i < numDevices; ++i){
+            auto camera = dynamic_cast<Camera*>(body->device(i));
+            if(camera){
+                const Image& image = camera->constImage();
+                if(!image.empty()){
+                    const int index = state.images.length();
+                    state.images.length(index + 1);
+                    Corba::CameraImage& cameraImage = state.images[index];
+                    cameraImage.deviceIndex = i;
+                    cameraImage.width = image.width();
+                    cameraImage.height = image.height();
+                    cameraImage.numComponents = image.numComponents();
+                    const size_t size = image.width() * image.height() * image.numComponents();
+                    cameraImage.pixels.length(size);
+                    std::memcpy(cameraImage.pixels.get_buffer(), image.pixels(), size);
+                }
+            }
+        }
+    }
+}
+
+
+void readWorldState(const Corba::StringSequence& bodyNames, int flags, Corba::WorldState& state)
+{
+    ItemList<BodyItem> bodyItems;
+    getBodyItems(bodyNames, bodyItems);
+    state.time = TimeBar::instance()->time();
+    state.bodies.length(bodyItems.size());
+    for(size_t i=0; i < bodyItems.size(); ++i){
+        readBodyState(bodyItems.get(i), flags, state.bodies[i]);
+    }
+}
+
+}
+
+
+BodyStateService_impl::BodyStateService_impl(CORBA::ORB_ptr orb)
+    : orb(CORBA::ORB::_duplicate(orb))
+{
+    lastSubscriptionId = 0;
+    isSenderTerminationRequested = false;
+    subscriptionTimer.setInterval(subscriptionCheckInterval);
+    subscriptionTimer.sigTimeout().connect([&](){ onSubscriptionTimeout(); });
+}
+
+
+BodyStateService_impl::~BodyStateService_impl()
+{
+    finalize();
+
+    PortableServer::POA_var poa = _default_POA();
+    PortableServer::ObjectId_var id = poa->servant_to_id(this);
+    poa->deactivate_object(id);
+}
+
+
+void BodyStateService_impl::finalize()
+{
+    subscriptionTimer.stop();
+    subscriptions.clear();
+
+    if(senderThread.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(senderMutex);
+            isSenderTerminationRequested = true;
+        }
+        senderCondition.notify_all();
+        senderThread.join();
+    }
+}
+
+
+Corba::StringSequence* BodyStateService_impl::getBodyNames()
+{
+    Corba::StringSequence_var names = new Corba::StringSequence;
+    callSynchronously([&](){
+            ItemList<BodyItem> bodyItems;
+            bodyItems.extractSubTreeItems(RootItem::instance());
+            names->length(bodyItems.size());
+            for(size_t i=0; i < bodyItems.size(); ++i){
+                names[i] = bodyItems[i]->name().c_str();
+            }
+        });
+    return names._retn();
+}
+
+
+CORBA::Boolean BodyStateService_impl::getBodyInfo(const char* bodyName, Corba::BodyInfo_out out_info)
+{
+    Corba::BodyInfo_var info = new Corba::BodyInfo;
+    bool found = false;
+
+    callSynchronously([&](){
+            BodyItem* bodyItem = findBodyItem(bodyName);
+            if(!bodyItem){
+                return;
+            }
+            Body* body = bodyItem->body();
+            info->name = bodyItem->name().c_str();
+            info->linkNames.length(body->numLinks());
+            for(int i=0; i < body->numLinks(); ++i){
+                info->linkNames[i] = body->link(i)->name().c_str();
+            }
+            info->jointNames.length(body->numJoints());
+            for(int i=0; i < body->numJoints(); ++i){
+                info->jointNames[i] = body->joint(i)->name().c_str();
+            }
+            info->deviceNames.length(body->numDevices());
+            info->deviceStateSizes.length(body->numDevices());
+            for(int i=0; i < body->numDevices(); ++i){
+                Device* device = body->device(i);
+                info->deviceNames[i] = device->name().c_str();
+                info->deviceStateSizes[i] = device->stateSize();
+            }
+            found = true;
+        });
+
+    out_info = info._retn();
+    return found;
+}
+
+
+CORBA::Boolean BodyStateService_impl::getBodyState(const char* bodyName, CORBA::Long flags, Corba::BodyState_out out_state)
+{
+    Corba::BodyState_var state = new Corba::BodyState;
+    bool found = false;
+
+    callSynchronously([&](){
+            if(BodyItem* bodyItem = findBodyItem(bodyName)){
+                readBodyState(bodyItem, flags, state.inout());
+                found = true;
+            }
+        });
+
+    out_state = state._retn();
+    return found;
+}
+
+
+Corba::WorldState* BodyStateService_impl::getWorldState(const Corba::StringSequence& bodyNames, CORBA::Long flags)
+{
+    Corba::WorldState_var state = new Corba::WorldState;
+    callSynchronously([&](){ readWorldState(bodyNames, flags, state.inout()); });
+    return state._retn();
+}
+
+
+CORBA::Long BodyStateService_impl::subscribe
+(Corba::BodyStateListener_ptr listener, const Corba::StringSequence& bodyNames, CORBA::Long flags, CORBA::Double maxRate)
+{
+    auto subscription = std::make_shared<Subscription>();
+    subscription->listener = Corba::BodyStateListener::_duplicate(listener);
+    for(CORBA::ULong i=0; i < bodyNames.length(); ++i){
+        subscription->bodyNames.push_back(bodyNames[i].in());
+    }
+    subscription->flags = flags;
+    subscription->minInterval = (maxRate > 0.0) ? (1.0 / maxRate) : 0.0;
+    subscription->isFailed = false;
+
+    int id = 0;
+    callSynchronously([&](){
+            id = ++lastSubscriptionId;
+            subscriptions[id] = subscription;
+            if(!subscriptionTimer.isActive()){
+                subscriptionTimer.start();
+            }
+        });
+
+    if(!senderThread.joinable()){
+        std::lock_guard<std::mutex> lock(senderMutex);
+        if(!senderThread.joinable()){
+            isSenderTerminationRequested = false;
+            senderThread = std::thread([this](){ senderLoop(); });
+        }
+    }
+
+    return id;
+}
+
+
+void BodyStateService_impl::unsubscribe(CORBA::Long subscriptionId)
+{
+    callSynchronously([&](){
+            subscriptions.erase(subscriptionId);
+            if(subscriptions.empty()){
+                subscriptionTimer.stop();
+            }
+        });
+}
+
+
+void BodyStateService_impl::onSubscriptionTimeout()
+{
+    auto now = std::chrono::steady_clock::now();
+    bool hasStatesToSend = false;
+
+    auto p = subscriptions.begin();
+    while(p != subscriptions.end()){
+        auto& subscription = p->second;
+        {
+            std::lock_guard<std::mutex> lock(senderMutex);
+            if(subscription->isFailed){
+                p = subscriptions.erase(p);
+                continue;
+            }
+        }
+        double elapsed = std::chrono::duration<double>(now - subscription->lastTime).count();
+        if(elapsed >= subscription->minInterval){
+            Corba::StringSequence names;
+            names.length(subscription->bodyNames.size());
+            for(size_t i=0; i < subscription->bodyNames.size(); ++i){
+                names[i] = subscription->bodyNames[i].c_str();
+            }
+            std::unique_ptr<Corba::WorldState> state(new Corba::WorldState);
+            readWorldState(names, subscription->flags, *state);
+            {
+                std::lock_guard<std::mutex> lock(senderMutex);
+                // The state which has not been sent yet is replaced with the new one
+                if(!subscription->stateToSend){
+                    subscriptionsToSend.push_back(subscription);
+                }
+                subscription->stateToSend = std::move(state);
+            }
+            subscription->lastTime = now;
+            hasStatesToSend = true;
+        }
+        ++p;
+    }
+
+    if(hasStatesToSend){
+        senderCondition.notify_all();
+    }
+    if(subscriptions.empty()){
+        subscriptionTimer.stop();
+    }
+}
+
+
+/**
+   The states are sent in this thread so that the main thread is not blocked by the
+   network even if a listener is slow.
+*/
+void BodyStateService_impl::senderLoop()
+{
+    vector<SubscriptionPtr> targets;
+
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(senderMutex);
+            while(!isSenderTerminationRequested && subscriptionsToSend.empty()){
+                senderCondition.wait(lock);
+            }
+            if(isSenderTerminationRequested){
+                break;
+            }
+            targets.swap(subscriptionsToSend);
+        }
+        for(auto& subscription : targets){
+            std::unique_ptr<Corba::WorldState> state;
+            {
+                std::lock_guard<std::mutex> lock(senderMutex);
+                state = std::move(subscription->stateToSend);
+            }
+            if(state){
+                try {
+                    subscription->listener->onStateUpdated(*state);
+                }
+                catch(CORBA::Exception&){
+                    std::lock_guard<std::mutex> lock(senderMutex);
+                    subscription->isFailed = true;
+                }
+            }
+        }
+        targets.clear();
+    }
+}
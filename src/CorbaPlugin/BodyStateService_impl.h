@@ -0,0 +1,77 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_CORBA_PLUGIN_BODY_STATE_SERVICE_IMPL_H
+#define CNOID_CORBA_PLUGIN_BODY_STATE_SERVICE_IMPL_H
+
+#include <cnoid/corba/BodyStateService.hh>
+#include <cnoid/Timer>
+#include <map>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace cnoid {
+
+/**
+   The states of the body items are read in the main thread and returned in a single call
+   for a body or the whole world so that the external clients do not need to access the
+   links and the sensors one by one.
+*/
+class BodyStateService_impl : virtual public POA_cnoid::Corba::BodyStateService
+{
+public:
+    BodyStateService_impl(CORBA::ORB_ptr orb);
+    virtual ~BodyStateService_impl();
+
+    //! This must be called before the ORB is shut down
+    void finalize();
+
+    virtual Corba::StringSequence* getBodyNames();
+    virtual CORBA::Boolean getBodyInfo(const char* bodyName, Corba::BodyInfo_out info);
+    virtual CORBA::Boolean getBodyState(const char* bodyName, CORBA::Long flags, Corba::BodyState_out state);
+    virtual Corba::WorldState* getWorldState(const Corba::StringSequence& bodyNames, CORBA::Long flags);
+    virtual CORBA::Long subscribe(
+        Corba::BodyStateListener_ptr listener, const Corba::StringSequence& bodyNames,
+        CORBA::Long flags, CORBA::Double maxRate);
+    virtual void unsubscribe(CORBA::Long subscriptionId);
+
+private:
+    struct Subscription
+    {
+        Corba::BodyStateListener_var listener;
+        std::vector<std::string> bodyNames;
+        int flags;
+        double minInterval;
+        std::chrono::steady_clock::time_point lastTime;
+        // The latest state which has not been sent, guarded by the sender mutex
+        std::unique_ptr<Corba::WorldState> stateToSend;
+        bool isFailed;
+    };
+    typedef std::shared_ptr<Subscription> SubscriptionPtr;
+
+    CORBA::ORB_var orb;
+
+    // The subscriptions are only modified in the main thread
+    std::map<int, SubscriptionPtr> subscriptions;
+    int lastSubscriptionId;
+    Timer subscriptionTimer;
+
+    std::thread senderThread;
+    std::mutex senderMutex;
+    std::condition_variable senderCondition;
+    std::vector<SubscriptionPtr> subscriptionsToSend;
+    bool isSenderTerminationRequested;
+
+    void onSubscriptionTimeout();
+    void senderLoop();
+};
+
+}
+
+#endif
@@ -5,6 +5,7 @@
 
 #include "CorbaPlugin.h"
 #include "MessageView_impl.h"
+#include "BodyStateService_impl.h"
 #include "NameServerView.h"
 #include <cnoid/Plugin>
 #include <cnoid/MessageView>
@@ -112,10 +113,12 @@ class CorbaPlugin : public Plugin
 {
     QAction* useChoreonoidNameServerIfNecessaryCheck;
     MessageView_impl* messageView;
+    BodyStateService_impl* bodyStateService;
     std::thread orbMainLoopThread;
 
 public:
     CorbaPlugin() : Plugin("Corba") {
+        require("Body");
         commonInitializationDone = false;
     }
         
@@ -139,6 +142,11 @@ public:
             MessageView::instance()->putln(nc->errorMessage());
         }
 
+        bodyStateService = new BodyStateService_impl(getORB());
+        if(!nc->bindObject(bodyStateService->_this(), "BodyStateService")){
+            MessageView::instance()->putln(nc->errorMessage());
+        }
+
         NameServerView::initializeClass(this);
 
         if(doSetupCorbaMainLoop){
@@ -159,6 +167,8 @@ public:
         Mapping& conf = *AppConfig::archive()->openMapping("CORBA");
         conf.write("useChoreonoidNameServerIfNecessary", useChoreonoidNameServerIfNecessaryCheck->isChecked());
 
+        bodyStateService->finalize();
+
         if(orbMainLoopThread.joinable()){
             getORB()->shutdown(false);
             orbMainLoopThread.join();
@@ -10,8 +10,10 @@
 #include <cnoid/SceneDrawables>
 #include <fcl/narrowphase/collision.h>
 #include <fcl/geometry/bvh/BVH_model.h>
+#include <fcl/broadphase/broadphase_dynamic_AABB_tree.h>
 #include <boost/optional.hpp>
 #include <memory>
+#include <map>
 
 using namespace std;
 using namespace fcl;
@@ -75,7 +77,18 @@ public :
     vector<Transform3d, Eigen::aligned_allocator<Transform3d> > primitiveLocalT;
     vector<Vector3d> points;
     vector<Triangle> tri_indices;
+    int geometryId;
     bool isStatic;
+    bool isMoved;
+
+    template<class Function> void forEachObject(Function func){
+        if(meshObject){
+            func(meshObject.get());
+        }
+        for(auto& object : primitiveObjects){
+            func(object.get());
+        }
+    }
 };
 typedef std::shared_ptr<CollisionObjectEx> CollisionObjectExPtr;
 
@@ -83,7 +96,9 @@ CollisionObjectEx::CollisionObjectEx()
 {
     primitiveObjects.clear();
     primitiveLocalT.clear();
+    geometryId = -1;
     isStatic = false;
+    isMoved = false;
 }
 
 CollisionObjectEx::~CollisionObjectEx()
@@ -103,9 +118,21 @@ public:
 
     vector<CollisionObjectExPtr> models;
     typedef set< IdPair<> > IdPairSet;
-    IdPairSet modelPairs;
     IdPairSet nonInterfarencePairs;
 
+    /*
+      The collision objects are registered in the broad-phase managers of FCL.
+      The static objects are only checked against the dynamic ones, and the tree of
+      the dynamic objects is updated only for the objects which have been moved.
+    */
+    DynamicAABBTreeCollisionManagerd staticManager;
+    DynamicAABBTreeCollisionManagerd dynamicManager;
+    vector<CollisionObjectd*> movedObjects;
+    bool isStaticManagerDirty;
+
+    // The collisions of the geometry pairs found in the current detection
+    map<IdPair<>, vector<Collision>> pairCollisions;
+
     MeshExtractor* meshExtractor;
 
     int addGeometry(SgNode* geometry);
@@ -113,7 +140,8 @@ public:
     bool makeReady();
     void updatePosition(int geometryId, const Position& position);
     void detectCollisions(std::function<void(const CollisionPair&)> callback);
-    void detectObjectCollisions(CollisionObjectd* object1, CollisionObjectd* object2, CollisionPair& collisionPair);
+    static bool broadPhaseCallback(CollisionObjectd* object1, CollisionObjectd* object2, void* data);
+    void detectObjectCollisions(CollisionObjectd* object1, CollisionObjectd* object2, vector<Collision>& collisions);
 
 private :
 
@@ -131,6 +159,7 @@ FCLCollisionDetector::FCLCollisionDetector()
 FCLCollisionDetectorImpl::FCLCollisionDetectorImpl()
 {
     meshExtractor = new MeshExtractor();
+    isStaticManagerDirty = false;
 }
 
 
@@ -160,9 +189,11 @@ CollisionDetectorPtr FCLCollisionDetector::clone() const
         
 void FCLCollisionDetector::clearGeometries()
 {
+    impl->staticManager.clear();
+    impl->dynamicManager.clear();
+    impl->movedObjects.clear();
     impl->models.clear();
     impl->nonInterfarencePairs.clear();
-    impl->modelPairs.clear();
 }
 
 
@@ -196,6 +227,8 @@ int FCLCollisionDetectorImpl::addGeometry(SgNode* geometry)
                 model->meshModel->endModel();
                 model->meshObject = std::make_shared<CollisionObjectd>(model->meshModel);
             }
+            model->geometryId = index;
+            model->forEachObject([&](CollisionObjectd* object){ object->setUserData(model.get()); });
             models.push_back(model);
             isValid = true;
         }
@@ -367,24 +400,28 @@ bool FCLCollisionDetector::makeReady()
 
 bool FCLCollisionDetectorImpl::makeReady()
 {
-    modelPairs.clear();
-
-    const int n = models.size();
-    for(int i=0; i < n; ++i){
-        CollisionObjectExPtr& model1 = models[i];
-        if(model1){
-            for(int j = i+1; j < n; ++j){
-                CollisionObjectExPtr& model2 = models[j];
-                if(model2){
-                    if(!model1->isStatic || !model2->isStatic){
-                        if(nonInterfarencePairs.find(IdPair<>(i, j)) == nonInterfarencePairs.end()){
-                            modelPairs.insert(IdPair<>(i,j));
-                        }
-                    }
-                }
-            }
+    staticManager.clear();
+    dynamicManager.clear();
+    movedObjects.clear();
+    isStaticManagerDirty = false;
+
+    vector<CollisionObjectd*> staticObjects;
+    vector<CollisionObjectd*> dynamicObjects;
+    for(auto& model : models){
+        if(model){
+            auto& objects = model->isStatic ? staticObjects : dynamicObjects;
+            model->forEachObject([&](CollisionObjectd* object){
+                    object->computeAABB();
+                    objects.push_back(object);
+                });
+            model->isMoved = false;
         }
     }
+    staticManager.registerObjects(staticObjects);
+    staticManager.setup();
+    dynamicManager.registerObjects(dynamicObjects);
+    dynamicManager.setup();
+
     return true;
 }
 
@@ -401,6 +438,7 @@ void FCLCollisionDetectorImpl::updatePosition(int geometryId, const Position& po
     if(model){
         if(model->meshObject){
             model->meshObject->setTransform(position);
+            model->meshObject->computeAABB();
         }
         vector<Transform3d, Eigen::aligned_allocator<Transform3d> >::iterator itt = model->primitiveLocalT.begin();
         for(vector<CollisionObjectPtr>::iterator it = model->primitiveObjects.begin();
@@ -409,7 +447,14 @@ void FCLCollisionDetectorImpl::updatePosition(int geometryId, const Position& po
                 fcl::Transform3d trans;
                 trans = position * (*itt);
                 (*it)->setTransform(trans);
+                (*it)->computeAABB();
             }
+        if(model->isStatic){
+            isStaticManagerDirty = true;
+        } else if(!model->isMoved){
+            model->isMoved = true;
+            model->forEachObject([&](CollisionObjectd* object){ movedObjects.push_back(object); });
+        }
     }
 }
 
@@ -422,43 +467,61 @@ void FCLCollisionDetector::detectCollisions(std::function<void(const CollisionPa
 
 void FCLCollisionDetectorImpl::detectCollisions(std::function<void(const CollisionPair&)> callback)
 {
-    CollisionPair collisionPair;
-    vector<Collision>& collisions = collisionPair.collisions;
-
-    for(IdPairSet::iterator it = modelPairs.begin(); it!=modelPairs.end(); it++){
-        CollisionObjectExPtr& model1 = models[(*it)(0)];
-        CollisionObjectExPtr& model2 = models[(*it)(1)];
-        collisions.clear();
-
-        if(model1->meshObject){
-            if(model2->meshObject)
-                detectObjectCollisions(model1->meshObject.get(), model2->meshObject.get(), collisionPair);
-            for(vector<CollisionObjectPtr>::iterator itt = model2->primitiveObjects.begin();
-                itt!=model2->primitiveObjects.end(); itt++)
-                detectObjectCollisions(model1->meshObject.get(), (*itt).get(), collisionPair);
-        }
-        for(vector<CollisionObjectPtr>::iterator iter = model1->primitiveObjects.begin();
-            iter!=model1->primitiveObjects.end(); iter++){
-            if(model2->meshObject)
-                detectObjectCollisions((*iter).get(), model2->meshObject.get(), collisionPair);
-            for(vector<CollisionObjectPtr>::iterator itt = model2->primitiveObjects.begin();
-                itt!=model2->primitiveObjects.end(); itt++)
-                detectObjectCollisions((*iter).get(), (*itt).get(), collisionPair);
+    if(!movedObjects.empty()){
+        dynamicManager.update(movedObjects);
+        for(auto& object : movedObjects){
+            static_cast<CollisionObjectEx*>(object->getUserData())->isMoved = false;
         }
+        movedObjects.clear();
+    }
+    if(isStaticManagerDirty){
+        staticManager.update();
+        isStaticManagerDirty = false;
+    }
 
-        if(!collisions.empty()){
-            collisionPair.geometryId[0] = (*it)(0);
-            collisionPair.geometryId[1] = (*it)(1);
+    pairCollisions.clear();
+    dynamicManager.collide(this, broadPhaseCallback);
+    dynamicManager.collide(&staticManager, this, broadPhaseCallback);
+
+    // The pairs are given in the order of the geometry ids as before
+    CollisionPair collisionPair;
+    for(auto& kv : pairCollisions){
+        if(!kv.second.empty()){
+            collisionPair.geometryId[0] = kv.first(0);
+            collisionPair.geometryId[1] = kv.first(1);
+            collisionPair.collisions.swap(kv.second);
             callback(collisionPair);
         }
     }
+}
+
 
+bool FCLCollisionDetectorImpl::broadPhaseCallback(CollisionObjectd* object1, CollisionObjectd* object2, void* data)
+{
+    auto self = static_cast<FCLCollisionDetectorImpl*>(data);
+    auto model1 = static_cast<CollisionObjectEx*>(object1->getUserData());
+    auto model2 = static_cast<CollisionObjectEx*>(object2->getUserData());
+
+    if(model1 == model2 || (model1->isStatic && model2->isStatic)){
+        return false;
+    }
+    if(model1->geometryId > model2->geometryId){
+        std::swap(model1, model2);
+        std::swap(object1, object2);
+    }
+    IdPair<> idPair(model1->geometryId, model2->geometryId);
+    if(self->nonInterfarencePairs.find(idPair) != self->nonInterfarencePairs.end()){
+        return false;
+    }
+    self->detectObjectCollisions(object1, object2, self->pairCollisions[idPair]);
+
+    // Continue the detection for the other pairs
+    return false;
 }
 
 
-void FCLCollisionDetectorImpl::detectObjectCollisions(CollisionObjectd* object1, CollisionObjectd* object2, CollisionPair& collisionPair)
+void FCLCollisionDetectorImpl::detectObjectCollisions(CollisionObjectd* object1, CollisionObjectd* object2, vector<Collision>& collisions)
 {
-    vector<Collision>& collisions = collisionPair.collisions;
     CollisionRequestd request(std::numeric_limits<int>::max(), true);
     CollisionResultd result;
     std::vector<Contactd> contacts;
@@ -13,7 +13,7 @@
 #include <cnoid/PutPropertyFunction>
 #include <cnoid/CorbaUtil>
 #include <cnoid/OpenRTMUtil>
-#include <cnoid/Timer>
+#include <cnoid/RobotAccessWorker>
 #include <cnoid/BodyItem>
 #include <cnoid/BasicSensors>
 #include <cnoid/ExtraBodyStateAccessor>
@@ -136,6 +136,37 @@ public:
 };
     
 typedef ref_ptr<RobotState> RobotStatePtr;
+
+/**
+   The services accessed in the worker thread.
+   The references are copied from the ones of the item when the state reading is started
+   so that the item can release its references independently.
+*/
+struct WorkerServices
+{
+    OpenHRP::RobotHardwareService_var robotHardwareService;
+    OpenHRP::StateHolderService_var stateHolderService;
+};
+
+class StateSnapshot : public Referenced
+{
+public:
+    OpenHRP::RobotHardwareService::RobotState_var state;
+    OpenHRP::StateHolderService::Command_var command;
+    bool hasState;
+    bool hasCommand;
+    bool isRobotHardwareFailed;
+    bool isStateHolderFailed;
+
+    StateSnapshot() {
+        hasState = false;
+        hasCommand = false;
+        isRobotHardwareFailed = false;
+        isStateHolderFailed = false;
+    }
+};
+
+typedef ref_ptr<StateSnapshot> StateSnapshotPtr;
 }       
 
 
@@ -171,7 +202,7 @@ public:
     double readInterval; // [ms]
     bool doConnectOnLoading;
         
-    Timer timer;
+    RobotAccessWorker worker;
         
     Hrpsys31ItemImpl(Hrpsys31Item* self);
     Hrpsys31ItemImpl(Hrpsys31Item* self, const Hrpsys31ItemImpl& org);
@@ -184,7 +215,10 @@ public:
     typename ServiceType::_ptr_type findService(RTC::RTObject_ptr rtc, const string& serviceName);
     bool disconnectFromRobot();
     bool activateServos(bool on);
-    void onReadRequest();
+    void switchServos(bool on, OpenHRP::RobotHardwareService::RobotState_var state);
+    void startStateReading();
+    static ReferencedPtr readState(WorkerServices& services);
+    void applyState(Referenced* state);
     template<class SensorType, class SequenceType>
     void copySensorState(DeviceList<SensorType>& sensors, SequenceType& seq);
     void doPutProperties(PutPropertyFunction& putProperty);
@@ -258,7 +292,6 @@ Hrpsys31ItemImpl::Hrpsys31ItemImpl(Hrpsys31Item* self, const Hrpsys31ItemImpl& o
 void Hrpsys31ItemImpl::init()
 {
     mv = MessageView::instance();
-    timer.sigTimeout().connect(std::bind(&Hrpsys31ItemImpl::onReadRequest, this));
 }
 
 
@@ -354,8 +387,7 @@ bool Hrpsys31ItemImpl::connectToRobot()
     if(result){
         mv->putln("Connected.");
         if(bodyItem && isStateReadingEnabled){
-            timer.setInterval(readInterval);
-            timer.start();
+            startStateReading();
             mv->putln("Periodic state reading has been started.");
         }
     }
@@ -405,9 +437,10 @@ bool Hrpsys31Item::disconnectFromRobot()
 
 bool Hrpsys31ItemImpl::disconnectFromRobot()
 {
-    if(timer.isActive()){
-        timer.stop();
-    }
+    // The services must not be released while they are used in the worker thread
+    worker.stopPolling();
+    worker.waitForRequests();
+    
     bool disconnected = false;
     if(!CORBA::is_nil(robotHardwareService)){
         robotHardwareService = OpenHRP::RobotHardwareService::_nil();
@@ -432,160 +465,226 @@ bool Hrpsys31Item::activateServos(bool on)
 
 bool Hrpsys31ItemImpl::activateServos(bool on)
 {
-    bool confirmed = true;
-    bool result = false;
-    
     if(CORBA::is_nil(robotHardwareService)){
         mv->putln(format(_("{0} cannot turn on / off the servos because it is not connected with {1}."),
                          self->name(), robotHardwareName));
-    } else {
-        OpenHRP::RobotHardwareService::RobotState_var state;
-        try {
-            robotHardwareService->getStatus(state);
-            const OpenHRP::RobotHardwareService::LongSequenceSequence& ss = state->servoState;
-            bool isOperationValid = false;
-            for(CORBA::ULong i=0; i < ss.length(); ++i){
-                bool servo = (ss[i][0] & OpenHRP::RobotHardwareService::SERVO_STATE_MASK);
-                if((on && !servo) || (!on && servo)){
-                    isOperationValid = true;
-                    break;
-                }
+        return false;
+    }
+
+    // The current servo states are read in the worker thread and checked in the main thread
+    OpenHRP::RobotHardwareService_var service = robotHardwareService;
+    auto status = std::make_shared<OpenHRP::RobotHardwareService::RobotState_var>();
+    auto failed = std::make_shared<bool>(false);
+    worker.request(
+        [service, status, failed](){
+            try {
+                service->getStatus(*status);
+            } catch(CORBA::Exception& ex){
+                *failed = true;
             }
-            if(!isOperationValid){
-                mv->putln(format(_("All the target servos of {} have already been turned on."), self->name()));
-                result = true;
+        },
+        [this, on, status, failed](){
+            if(*failed){
+                mv->putln(format(_("{}: A CORBA Exception happened."), self->name()));
+                mv->putln(format(_("{} cannot turn on the servos."), self->name()));
             } else {
-                confirmed = showConfirmDialog((on ? _("Servo On") : _("Servo Off")), _("Click OK to continue."));
-
-                if(confirmed){
-                    result = robotHardwareService->servo(
-                        "all", (on ? OpenHRP::RobotHardwareService::SWITCH_ON : OpenHRP::RobotHardwareService::SWITCH_OFF));
-                    if(result){
-                        mv->putln(format(_("The target servos of {} have been turned on."), self->name()));
-                        onReadRequest();
-                    }
-                }
+                switchServos(on, *status);
             }
-        } catch(CORBA::Exception& ex){
-            mv->putln(format(_("{}: A CORBA Exception happened."), self->name()));
-        }
-        if(confirmed && !result){
-            mv->putln(format(_("{} cannot turn on the servos."), self->name()));
+        });
+
+    return true;
+}
+
+
+void Hrpsys31ItemImpl::switchServos(bool on, OpenHRP::RobotHardwareService::RobotState_var state)
+{
+    const OpenHRP::RobotHardwareService::LongSequenceSequence& ss = state->servoState;
+    bool isOperationValid = false;
+    for(CORBA::ULong i=0; i < ss.length(); ++i){
+        bool servo = (ss[i][0] & OpenHRP::RobotHardwareService::SERVO_STATE_MASK);
+        if((on && !servo) || (!on && servo)){
+            isOperationValid = true;
+            break;
         }
     }
-    return result;
+    if(!isOperationValid){
+        mv->putln(format(_("All the target servos of {} have already been turned on."), self->name()));
+        return;
+    }
+    
+    if(!showConfirmDialog((on ? _("Servo On") : _("Servo Off")), _("Click OK to continue."))){
+        return;
+    }
+
+    // The connection may have been terminated while the dialog is shown
+    OpenHRP::RobotHardwareService_var service = robotHardwareService;
+    if(CORBA::is_nil(service)){
+        return;
+    }
+    auto result = std::make_shared<bool>(false);
+    worker.request(
+        [service, on, result](){
+            try {
+                *result = service->servo(
+                    "all", (on ? OpenHRP::RobotHardwareService::SWITCH_ON : OpenHRP::RobotHardwareService::SWITCH_OFF));
+            } catch(CORBA::Exception& ex){
+                *result = false;
+            }
+        },
+        [this, result](){
+            if(*result){
+                mv->putln(format(_("The target servos of {} have been turned on."), self->name()));
+            } else {
+                mv->putln(format(_("{} cannot turn on the servos."), self->name()));
+            }
+        });
 }
 
 
 bool Hrpsys31Item::setStateReadingEnabled(bool on)
 {
+    impl->isStateReadingEnabled = on;
+    if(!on){
+        impl->worker.stopPolling();
+    } else if(impl->bodyItem && !impl->worker.isPolling() &&
+              (!CORBA::is_nil(impl->robotHardwareService) || !CORBA::is_nil(impl->stateHolderService))){
+        impl->startStateReading();
+    }
     return true;
 }
 
 
-void Hrpsys31ItemImpl::onReadRequest()
+void Hrpsys31ItemImpl::startStateReading()
+{
+    auto services = std::make_shared<WorkerServices>();
+    services->robotHardwareService = robotHardwareService;
+    services->stateHolderService = stateHolderService;
+
+    worker.startPolling(
+        [services](){ return readState(*services); },
+        [this](Referenced* state){ applyState(state); },
+        readInterval / 1000.0);
+}
+
+
+/**
+   This function is executed in the worker thread.
+   A service is not accessed any more once the access to it fails.
+*/
+ReferencedPtr Hrpsys31ItemImpl::readState(WorkerServices& services)
+{
+    StateSnapshotPtr snapshot = new StateSnapshot;
+
+    if(!CORBA::is_nil(services.robotHardwareService)){
+        try {
+            services.robotHardwareService->getStatus(snapshot->state);
+            snapshot->hasState = true;
+        } catch(CORBA::Exception& ex){
+            services.robotHardwareService = OpenHRP::RobotHardwareService::_nil();
+            snapshot->isRobotHardwareFailed = true;
+        }
+    }
+    if(!CORBA::is_nil(services.stateHolderService)){
+        try {
+            services.stateHolderService->getCommand(snapshot->command);
+            snapshot->hasCommand = true;
+        } catch(CORBA::Exception& ex){
+            services.stateHolderService = OpenHRP::StateHolderService::_nil();
+            snapshot->isStateHolderFailed = true;
+        }
+    }
+
+    return snapshot;
+}
+
+
+void Hrpsys31ItemImpl::applyState(Referenced* snapshotObject)
 {
     if(!bodyItem){
         return;
     }
+    auto snapshot = static_cast<StateSnapshot*>(snapshotObject);
     
     bool jointStateChanged = false;
     bool robotStateChanged = false;
     const BodyPtr& body = bodyItem->body();
         
-    if(!CORBA::is_nil(robotHardwareService)){
-        bool connectionFailed = false;
-        OpenHRP::RobotHardwareService::RobotState_var state;
-        try {
-            robotHardwareService->getStatus(state);
-            
-        } catch(CORBA::Exception& ex){
-            robotHardwareService = OpenHRP::RobotHardwareService::_nil();
-            mv->putln(format(_("{0}: Access to {1} failed. The connection is terminated."),
-                    self->name(), robotHardwareName));
-            connectionFailed = true;
-        }
-        
-        if(!connectionFailed){
-            
-            const int n = std::min(body->numJoints(), (int)state->angle.length());
-            if(n > 0){
-                for(int i=0; i < n; ++i){
-                    JointState& js = robotState->joints[i];
-                    Link* joint = body->joint(i);
-                    if(bodyJointUpdateMode.is(UPDATE_BY_ACTUAL)){
-                        joint->q() = state->angle[i];
-                    } else {
-                        joint->q() = state->command[i];
-                    }
-                    joint->u() = state->torque[i];
-                    js.q_actual = state->angle[i];
-                    js.q_target = state->command[i];
-                    CORBA::Long s = state->servoState[i][0];
-                    js.calib = s & OpenHRP::RobotHardwareService::CALIB_STATE_MASK;
-                    js.servo = s & OpenHRP::RobotHardwareService::SERVO_STATE_MASK;
-                    js.power = s & OpenHRP::RobotHardwareService::POWER_STATE_MASK;
-                    js.temperature = (s & OpenHRP::RobotHardwareService::DRIVER_TEMP_MASK)
-                        >> OpenHRP::RobotHardwareService::DRIVER_TEMP_SHIFT; 
-                    js.alarm = (s & OpenHRP::RobotHardwareService::SERVO_ALARM_MASK)
-                        >> OpenHRP::RobotHardwareService::SERVO_ALARM_SHIFT; 
-                }
-                jointStateChanged = true;
-            }
-
-            DeviceList<ForceSensor> forceSensors = body->devices<ForceSensor>();
-            copySensorState(forceSensors, state->force);
-            DeviceList<RateGyroSensor> gyros = body->devices<RateGyroSensor>();
-            copySensorState(gyros, state->rateGyro);
-            DeviceList<AccelerationSensor> accelSensors = body->devices<AccelerationSensor>();
-            copySensorState(accelSensors, state->accel);
-
-            for(int i=0; i < 2; ++i){
-                ForceSensorPtr& s = footForceSensors[i];
-                if(!s || s->f().z() < verticalForceThreshForFootContact){
-                    robotState->localZMP[i] = boost::none;
+    if(snapshot->isRobotHardwareFailed){
+        robotHardwareService = OpenHRP::RobotHardwareService::_nil();
+        mv->putln(format(_("{0}: Access to {1} failed. The connection is terminated."),
+                         self->name(), robotHardwareName));
+    }
+    if(snapshot->hasState){
+        auto& state = snapshot->state;
+        const int n = std::min(body->numJoints(), (int)state->angle.length());
+        if(n > 0){
+            for(int i=0; i < n; ++i){
+                JointState& js = robotState->joints[i];
+                Link* joint = body->joint(i);
+                if(bodyJointUpdateMode.is(UPDATE_BY_ACTUAL)){
+                    joint->q() = state->angle[i];
                 } else {
-                    robotState->localZMP[i] =
-                        Vector3(-s->tau().y() / s->f().z(), s->tau().x() / s->f().z(), 0.0);
+                    joint->q() = state->command[i];
                 }
+                joint->u() = state->torque[i];
+                js.q_actual = state->angle[i];
+                js.q_target = state->command[i];
+                CORBA::Long s = state->servoState[i][0];
+                js.calib = s & OpenHRP::RobotHardwareService::CALIB_STATE_MASK;
+                js.servo = s & OpenHRP::RobotHardwareService::SERVO_STATE_MASK;
+                js.power = s & OpenHRP::RobotHardwareService::POWER_STATE_MASK;
+                js.temperature = (s & OpenHRP::RobotHardwareService::DRIVER_TEMP_MASK)
+                    >> OpenHRP::RobotHardwareService::DRIVER_TEMP_SHIFT; 
+                js.alarm = (s & OpenHRP::RobotHardwareService::SERVO_ALARM_MASK)
+                    >> OpenHRP::RobotHardwareService::SERVO_ALARM_SHIFT; 
             }
+            jointStateChanged = true;
+        }
 
-            robotState->voltage = state->voltage;
-            robotState->electricCurrent = state->current;
-            robotStateChanged = true;
+        DeviceList<ForceSensor> forceSensors = body->devices<ForceSensor>();
+        copySensorState(forceSensors, state->force);
+        DeviceList<RateGyroSensor> gyros = body->devices<RateGyroSensor>();
+        copySensorState(gyros, state->rateGyro);
+        DeviceList<AccelerationSensor> accelSensors = body->devices<AccelerationSensor>();
+        copySensorState(accelSensors, state->accel);
+
+        for(int i=0; i < 2; ++i){
+            ForceSensorPtr& s = footForceSensors[i];
+            if(!s || s->f().z() < verticalForceThreshForFootContact){
+                robotState->localZMP[i] = boost::none;
+            } else {
+                robotState->localZMP[i] =
+                    Vector3(-s->tau().y() / s->f().z(), s->tau().x() / s->f().z(), 0.0);
+            }
         }
+
+        robotState->voltage = state->voltage;
+        robotState->electricCurrent = state->current;
+        robotStateChanged = true;
     }
     
-    if(!CORBA::is_nil(stateHolderService)){
-        bool connectionFailed = false;
-        OpenHRP::StateHolderService::Command_var command;
-        try {
-            stateHolderService->getCommand(command);
-            
-        } catch(CORBA::Exception& ex){
-            stateHolderService = OpenHRP::StateHolderService::_nil();
-            mv->putln(format(_("{0}: Access to {1} failed. The connection is terminated."),
-                             self->name(), stateHolderName));
-            connectionFailed = true;
-        }
-        
-        if(!connectionFailed){
-            const int n = std::min(body->numJoints(), (int)command->jointRefs.length());
-            if(n > 0){
-                for(int i=0; i < n; ++i){
-                    const double q = command->jointRefs[i];
-                    if(bodyJointUpdateMode.is(UPDATE_BY_REFERENCE)){
-                        body->joint(i)->q() = q;
-                        jointStateChanged = true;
-                    }
-                    robotState->joints[i].q_target = q;
+    if(snapshot->isStateHolderFailed){
+        stateHolderService = OpenHRP::StateHolderService::_nil();
+        mv->putln(format(_("{0}: Access to {1} failed. The connection is terminated."),
+                         self->name(), stateHolderName));
+    }
+    if(snapshot->hasCommand){
+        auto& command = snapshot->command;
+        const int n = std::min(body->numJoints(), (int)command->jointRefs.length());
+        if(n > 0){
+            for(int i=0; i < n; ++i){
+                const double q = command->jointRefs[i];
+                if(bodyJointUpdateMode.is(UPDATE_BY_REFERENCE)){
+                    body->joint(i)->q() = q;
+                    jointStateChanged = true;
                 }
-            }
-            if(command->zmp.length() == 3){
-                bodyItem->setZmp(Eigen::Map<const Vector3>(&command->zmp[0]));
-                robotStateChanged = true;
+                robotState->joints[i].q_target = q;
             }
         }
+        if(command->zmp.length() == 3){
+            bodyItem->setZmp(Eigen::Map<const Vector3>(&command->zmp[0]));
+            robotStateChanged = true;
+        }
     }
         
     if(jointStateChanged){
@@ -657,6 +756,9 @@ bool Hrpsys31ItemImpl::onReadIntervalEdited(int interval)
 {
     if(interval > 0.0){
         readInterval = interval;
+        if(worker.isPolling()){
+            worker.setPollingInterval(readInterval / 1000.0);
+        }
         return true;
     }
     return false;
@@ -7,7 +7,12 @@
 #include <cnoid/FileUtil>
 #include <cnoid/MessageView>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <stack>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
 
 using namespace std;
 using namespace cnoid;
@@ -29,6 +34,36 @@ public:
 
 static const char* InterpreterInstanceKey = "cnoid_lua_interpreter";
 
+namespace {
+
+struct ChunkCacheEntry
+{
+    uint64_t sourceHash;
+    string bytecode;
+};
+
+std::mutex chunkCacheMutex;
+unordered_map<string, ChunkCacheEntry> chunkCache;
+
+// FNV-1a
+uint64_t calcSourceHash(const string& source)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for(unsigned char c : source){
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+int writeBytecode(lua_State* /* state */, const void* p, size_t size, void* userData)
+{
+    static_cast<string*>(userData)->append(static_cast<const char*>(p), size);
+    return 0;
+}
+
+}
+
 LuaInterpreter* LuaInterpreter::mainInstance()
 {
     static LuaInterpreter* mainInterpreter = new LuaInterpreter;
@@ -146,6 +181,73 @@ lua_State* LuaInterpreter::state()
 }
 
 
+int LuaInterpreter::loadFile(const std::string& filename)
+{
+    lua_State* L = impl->state;
+
+    ifstream ifs(filename.c_str(), ios::in | ios::binary);
+    if(!ifs){
+        // Let luaL_loadfile push the error message
+        return luaL_loadfile(L, filename.c_str());
+    }
+    stringstream ss;
+    ss << ifs.rdbuf();
+    string source = ss.str();
+
+    // Skip the first line starting with '#' as luaL_loadfile does, keeping the line numbers
+    if(!source.empty() && source[0] == '#'){
+        auto pos = source.find('\n');
+        source.erase(0, (pos == string::npos) ? source.size() : pos);
+    }
+
+    const uint64_t hash = calcSourceHash(source);
+    const string chunkName = "@" + filename;
+
+    {
+        std::lock_guard<std::mutex> lock(chunkCacheMutex);
+        auto p = chunkCache.find(filename);
+        if(p != chunkCache.end() && p->second.sourceHash == hash){
+            const string& bytecode = p->second.bytecode;
+            return luaL_loadbuffer(L, bytecode.data(), bytecode.size(), chunkName.c_str());
+        }
+    }
+
+    int status = luaL_loadbuffer(L, source.data(), source.size(), chunkName.c_str());
+    if(status == 0){
+        ChunkCacheEntry entry;
+        entry.sourceHash = hash;
+        // The debug information is kept for the error messages
+#if LUA_VERSION_NUM >= 503
+        bool dumped = (lua_dump(L, writeBytecode, &entry.bytecode, 0) == 0);
+#else
+        bool dumped = (lua_dump(L, writeBytecode, &entry.bytecode) == 0);
+#endif
+        if(dumped){
+            std::lock_guard<std::mutex> lock(chunkCacheMutex);
+            chunkCache[filename] = std::move(entry);
+        }
+    }
+    return status;
+}
+
+
+void LuaInterpreter::clearChunkCache()
+{
+    std::lock_guard<std::mutex> lock(chunkCacheMutex);
+    chunkCache.clear();
+}
+
+
+bool LuaInterpreter::isJIT()
+{
+#ifdef LUAJIT_VERSION
+    return true;
+#else
+    return false;
+#endif
+}
+
+
 void LuaInterpreter::beginRedirect(std::ostream& os)
 {
     impl->outputStack.push(&os);
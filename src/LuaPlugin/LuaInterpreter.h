@@ -7,6 +7,7 @@
 
 #include <lua.hpp>
 #include <iosfwd>
+#include <string>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -28,6 +29,19 @@ public:
 
     lua_State* state();
 
+    /**
+       Loads a Lua file as a function pushed on the stack in the same way as luaL_loadfile.
+       The compiled chunks are cached in the process with the hash of the source, so the
+       source is not compiled again until it is modified.
+       \return The status code of luaL_loadfile
+    */
+    int loadFile(const std::string& filename);
+
+    static void clearChunkCache();
+
+    //! Returns true when the interpreter is LuaJIT
+    static bool isJIT();
+
     //! \todo Introduce an object to change the output in a particular scope
     void beginRedirect(std::ostream& os);
     void endRedirect();
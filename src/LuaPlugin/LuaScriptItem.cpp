@@ -182,7 +182,7 @@ bool LuaScriptItemImpl::execute()
 
     bool hasError = false;
 
-    if(luaL_loadfile(L, scriptFilename.c_str()) || lua_pcall(L, 0, LUA_MULTRET, 0)){
+    if(interpreter->loadFile(scriptFilename) || lua_pcall(L, 0, LUA_MULTRET, 0)){
         // error
         auto msg = lua_tostring(L, -1);
         if(msg == nullptr){
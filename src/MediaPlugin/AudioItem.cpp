@@ -7,6 +7,11 @@
 #include <cnoid/ItemManager>
 #include <cnoid/Archive>
 #include <fmt/format.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstring>
 
 #ifdef CNOID_MEDIA_PLUGIN_USE_LIBSNDFILE
 #include <sndfile.h>
@@ -20,7 +25,51 @@ using namespace cnoid;
 using fmt::format;
 
 namespace {
+
 std::shared_ptr< std::vector<float> > emptySamplingData;
+
+// The number of the frames decoded at a time
+const int numBlockFrames = 4096;
+
+// The ring buffer keeps this number of the blocks ahead of the read position
+const int numRingBufferBlocks = 32;
+
+}
+
+namespace cnoid {
+
+class AudioStreamImpl
+{
+public:
+    int numChannels;
+    vector<float> ringBuffer;
+    int ringBufferFrames;
+
+    // The following variables are guarded by the mutex
+    std::mutex mutex;
+    std::condition_variable condition;
+    int readPosition;
+    int numBufferedFrames;
+    // The file frame which is decoded next
+    int decodingFrame;
+    // Incremented by seek so that the block being decoded for the previous position is discarded
+    int seekCount;
+    bool isSeekRequested;
+    bool isEndOfFile;
+    bool isTerminationRequested;
+
+#ifdef CNOID_MEDIA_PLUGIN_USE_LIBSNDFILE
+    SNDFILE* sndfile;
+    std::thread decodingThread;
+#endif
+
+    AudioStreamImpl(AudioItem* audioItem);
+    ~AudioStreamImpl();
+    void seek(int frame);
+    int read(float* out_samples, int numFrames);
+    void decodingLoop();
+};
+
 }
 
 
@@ -44,6 +93,7 @@ AudioItem::AudioItem()
     : samplingData_(emptySamplingData)
 {
     numChannels_ = 1;
+    numFrames_ = 0;
     samplingRate_ = 44100.0;
     offsetTime_ = 0.0;
 }
@@ -52,8 +102,10 @@ AudioItem::AudioItem()
 AudioItem::AudioItem(const AudioItem& org)
     : Item(org),
       samplingData_(org.samplingData_),
+      audioFilePath_(org.audioFilePath_),
       offsetTime_(org.offsetTime_),
       numChannels_(org.numChannels_),
+      numFrames_(org.numFrames_),
       samplingRate_(org.samplingRate_),
       title(org.title),
       copyright(org.copyright),
@@ -80,7 +132,9 @@ AudioItem::~AudioItem()
 void AudioItem::clear()
 {
     numChannels_ = 1;
+    numFrames_ = 0;
     samplingData_ = emptySamplingData;
+    audioFilePath_.clear();
     title.clear();
     copyright.clear();
     artists.clear();
@@ -138,15 +192,12 @@ bool AudioItem::loadAudioFile(const std::string& filename, std::ostream& os, Ite
                          (sfinfo.format & SF_FORMAT_ENDMASK));
         }
 
+        // The samples are decoded by AudioStream or samplingData() when they are needed
+        audioFilePath_ = filename;
         numChannels_ = sfinfo.channels;
+        numFrames_ = sfinfo.frames;
         samplingRate_ = sfinfo.samplerate;
-
-        samplingData_ = std::make_shared< std::vector<float> >(sfinfo.frames * sfinfo.channels);
-        sf_count_t framesRead = sf_readf_float(sndfile, &(*samplingData_)[0], sfinfo.frames);
-
-        if(framesRead < sfinfo.frames){
-            samplingData_->resize(framesRead * sfinfo.channels);
-        }
+        samplingData_.reset();
 
         setTextInfo(sndfile, SF_STR_TITLE, title);
         setTextInfo(sndfile, SF_STR_COPYRIGHT, copyright);
@@ -164,6 +215,177 @@ bool AudioItem::loadAudioFile(const std::string& filename, std::ostream& os, Ite
     return result;
 }
 
+
+const std::vector<float>& AudioItem::samplingData()
+{
+    if(!samplingData_){
+        auto data = std::make_shared< std::vector<float> >(numFrames_ * numChannels_);
+        SF_INFO sfinfo;
+        std::memset(&sfinfo, 0, sizeof(sfinfo));
+        SNDFILE* sndfile = sf_open(audioFilePath_.c_str(), SFM_READ, &sfinfo);
+        if(!sndfile){
+            data->clear();
+        } else {
+            sf_count_t framesRead = 0;
+            if(!data->empty()){
+                framesRead = sf_readf_float(sndfile, &(*data)[0], numFrames_);
+            }
+            data->resize(framesRead * numChannels_);
+            sf_close(sndfile);
+        }
+        samplingData_ = data;
+    }
+    return *samplingData_;
+}
+
+
+AudioStreamImpl::AudioStreamImpl(AudioItem* audioItem)
+{
+    numChannels = audioItem->numChannels();
+    ringBufferFrames = numBlockFrames * numRingBufferBlocks;
+    ringBuffer.resize(ringBufferFrames * numChannels);
+    readPosition = 0;
+    numBufferedFrames = 0;
+    decodingFrame = 0;
+    seekCount = 0;
+    isSeekRequested = false;
+    isEndOfFile = true;
+    isTerminationRequested = false;
+
+    SF_INFO sfinfo;
+    std::memset(&sfinfo, 0, sizeof(sfinfo));
+    sndfile = nullptr;
+    if(audioItem->numFrames() > 0){
+        sndfile = sf_open(audioItem->audioFilePath().c_str(), SFM_READ, &sfinfo);
+    }
+    if(sndfile){
+        if(sfinfo.channels != numChannels){
+            sf_close(sndfile);
+            sndfile = nullptr;
+        } else {
+            isEndOfFile = false;
+            decodingThread = std::thread([this](){ decodingLoop(); });
+        }
+    }
+}
+
+
+AudioStreamImpl::~AudioStreamImpl()
+{
+    if(decodingThread.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isTerminationRequested = true;
+        }
+        condition.notify_all();
+        decodingThread.join();
+    }
+    if(sndfile){
+        sf_close(sndfile);
+    }
+}
+
+
+void AudioStreamImpl::seek(int frame)
+{
+    if(sndfile){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            decodingFrame = std::max(0, frame);
+            readPosition = 0;
+            numBufferedFrames = 0;
+            isEndOfFile = false;
+            isSeekRequested = true;
+            ++seekCount;
+        }
+        condition.notify_all();
+    }
+}
+
+
+int AudioStreamImpl::read(float* out_samples, int numFrames)
+{
+    int numReadFrames = 0;
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while(numReadFrames < numFrames){
+        while(numBufferedFrames == 0 && !isEndOfFile && !isTerminationRequested){
+            condition.wait(lock);
+        }
+        if(numBufferedFrames == 0){
+            break;
+        }
+        // The frames are copied up to the end of the ring buffer at a time
+        const int n = std::min({ numFrames - numReadFrames, numBufferedFrames, ringBufferFrames - readPosition });
+        std::memcpy(out_samples + numReadFrames * numChannels,
+                    &ringBuffer[readPosition * numChannels],
+                    n * numChannels * sizeof(float));
+        readPosition = (readPosition + n) % ringBufferFrames;
+        numBufferedFrames -= n;
+        numReadFrames += n;
+        condition.notify_all();
+    }
+
+    return numReadFrames;
+}
+
+
+/**
+   The blocks are decoded without locking the mutex so that the reader is not blocked while
+   decoding. A block decoded for the position before a seek is discarded.
+*/
+void AudioStreamImpl::decodingLoop()
+{
+    vector<float> block(numBlockFrames * numChannels);
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while(true){
+        while(!isTerminationRequested &&
+              (isEndOfFile || ringBufferFrames - numBufferedFrames < numBlockFrames)){
+            condition.wait(lock);
+        }
+        if(isTerminationRequested){
+            break;
+        }
+
+        const int frame = decodingFrame;
+        const bool doSeek = isSeekRequested;
+        const int currentSeekCount = seekCount;
+        isSeekRequested = false;
+        lock.unlock();
+
+        if(doSeek){
+            sf_seek(sndfile, frame, SEEK_SET);
+        }
+        const int numDecodedFrames = sf_readf_float(sndfile, &block[0], numBlockFrames);
+
+        lock.lock();
+
+        if(seekCount != currentSeekCount){
+            continue;
+        }
+        if(numDecodedFrames <= 0){
+            isEndOfFile = true;
+        } else {
+            int writePosition = (readPosition + numBufferedFrames) % ringBufferFrames;
+            const int n1 = std::min(numDecodedFrames, ringBufferFrames - writePosition);
+            std::memcpy(&ringBuffer[writePosition * numChannels], &block[0], n1 * numChannels * sizeof(float));
+            if(n1 < numDecodedFrames){
+                std::memcpy(&ringBuffer[0], &block[n1 * numChannels],
+                            (numDecodedFrames - n1) * numChannels * sizeof(float));
+            }
+            numBufferedFrames += numDecodedFrames;
+            decodingFrame = frame + numDecodedFrames;
+            if(numDecodedFrames < numBlockFrames){
+                isEndOfFile = true;
+            }
+        }
+        condition.notify_all();
+    }
+}
+
 #else
 
 bool AudioItem::loadAudioFile(const std::string& filename, std::ostream& os, Item* parentItem)
@@ -172,12 +394,68 @@ bool AudioItem::loadAudioFile(const std::string& filename, std::ostream& os, Ite
     return false;
 }
 
+
+const std::vector<float>& AudioItem::samplingData()
+{
+    return *samplingData_;
+}
+
+
+AudioStreamImpl::AudioStreamImpl(AudioItem* audioItem)
+{
+    numChannels = audioItem->numChannels();
+    ringBufferFrames = 0;
+    isEndOfFile = true;
+}
+
+
+AudioStreamImpl::~AudioStreamImpl()
+{
+
+}
+
+
+void AudioStreamImpl::seek(int frame)
+{
+
+}
+
+
+int AudioStreamImpl::read(float* out_samples, int numFrames)
+{
+    return 0;
+}
+
 #endif
 
 
+AudioStream::AudioStream(AudioItem* audioItem)
+{
+    impl = new AudioStreamImpl(audioItem);
+}
+
+
+AudioStream::~AudioStream()
+{
+    delete impl;
+}
+
+
+void AudioStream::seek(int frame)
+{
+    impl->seek(frame);
+}
+
+
+int AudioStream::read(float* out_samples, int numFrames)
+{
+    return impl->read(out_samples, numFrames);
+}
+
+
 void AudioItem::doPutProperties(PutPropertyFunction& putProperty)
 {
-    if(!samplingData_->empty()){
+    if(numFrames_ > 0){
         putProperty("title", title);
         putProperty("length", timeLength());
         putProperty("offset", offsetTime(), std::bind(&AudioItem::setOffsetTime, this, _1), true);
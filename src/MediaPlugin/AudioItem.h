@@ -8,11 +8,40 @@
 
 #include <cnoid/Item>
 #include <memory>
+#include <vector>
 #include "exportdecl.h"
 
 namespace cnoid {
 
 class ExtensionManager;
+class AudioItem;
+class AudioStreamImpl;
+
+/**
+   The samples of the audio file of an AudioItem are decoded in blocks by a background thread
+   into a ring buffer, which keeps a few seconds of the samples ahead of the read position,
+   so that a long audio file can be played without decoding the whole file.
+*/
+class CNOID_EXPORT AudioStream
+{
+public:
+    AudioStream(AudioItem* audioItem);
+    ~AudioStream();
+
+    //! The decoding restarts from the frame, which is done without decoding the preceding frames
+    void seek(int frame);
+
+    /**
+       Copies the samples of the frames following the previous ones into the buffer. This waits
+       for the decoding thread when the frames are not decoded yet.
+       
+eturn The number of the frames copied, which is less than numFrames at the end of the file
+    */
+    int read(float* out_samples, int numFrames);
+
+private:
+    AudioStreamImpl* impl;
+};
     
 class CNOID_EXPORT AudioItem : public Item
 {
@@ -27,7 +56,7 @@ public:
     }
 
     int numFrames() {
-        return samplingData_->size() / numChannels_;
+        return numFrames_;
     }
             
     double timeLength() {
@@ -48,10 +77,16 @@ public:
         return offsetTime_ * samplingRate_;
     }
 
-    const std::vector<float>& samplingData() {
-        return *samplingData_;
+    const std::string& audioFilePath() const {
+        return audioFilePath_;
     }
 
+    /**
+       The whole samples are decoded at the first call of this function. Use AudioStream
+       to read the samples without keeping them in memory.
+    */
+    const std::vector<float>& samplingData();
+
 protected:
     ~AudioItem();
 
@@ -62,8 +97,10 @@ protected:
 
 private:
     std::shared_ptr< std::vector<float> > samplingData_;
+    std::string audioFilePath_;
     double offsetTime_;
     int numChannels_;
+    int numFrames_;
     double samplingRate_;
     std::string title;
     std::string copyright;
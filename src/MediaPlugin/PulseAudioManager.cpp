@@ -45,6 +45,8 @@ public:
     double timeToFinish;
     pa_sample_spec sampleSpec;
     vector<float> silenceBuf;
+    std::unique_ptr<AudioStream> audioStream;
+    vector<float> sampleBuf;
     pa_operation* operation;
     LazyCaller stopLater;
         
@@ -485,6 +487,8 @@ bool Source::initialize()
     sampleSpec.rate = audioItem->samplingRate();
     sampleSpec.channels = audioItem->numChannels();
 
+    audioStream.reset(new AudioStream(audioItem));
+
     bool initialized;
     
     if(manager->connectionKeepCheck->isChecked()){
@@ -609,6 +613,9 @@ void Source::seek(double time)
 {
     currentFrame = floor((time - audioItem->offsetTime()) * audioItem->samplingRate());
     hasAllFramesWritten = false;
+    if(audioStream){
+        audioStream->seek(std::max(0, currentFrame));
+    }
 }
 
 
@@ -675,17 +682,19 @@ void Source::write(size_t nbytes, bool isDoingInitialization)
         silenceBuf.resize(numSilentFrames * sampleSpec.channels, 0.0f);
         pa_stream_write(stream, &silenceBuf[0], (numSilentFrames * frameSize), NULL, 0, seekMode);
         currentFrame += numSilentFrames;
-        numBufFrames = pa_stream_writable_size(stream);
+        numBufFrames = pa_stream_writable_size(stream) / frameSize;
         seekMode = PA_SEEK_RELATIVE;
     }
 
-    const std::vector<float>& data = audioItem->samplingData();
-    const int numAllFrames = data.size() / sampleSpec.channels;
+    const int numAllFrames = audioItem->numFrames();
     int numFrames = std::min(numAllFrames - currentFrame, numBufFrames);
+    if(numFrames > 0){
+        sampleBuf.resize(numFrames * sampleSpec.channels);
+        numFrames = audioStream->read(&sampleBuf[0], numFrames);
+    }
 
     if(numFrames > 0){
-        const float* p = &data[currentFrame * sampleSpec.channels];
-        pa_stream_write(stream, p, (numFrames * frameSize), NULL, 0, seekMode);
+        pa_stream_write(stream, &sampleBuf[0], (numFrames * frameSize), NULL, 0, seekMode);
         currentFrame += numFrames;
 
     } else if(numSilentFrames == 0){
@@ -3,6 +3,7 @@
 */
 
 #include "MulticopterPluginHeader.h"
+#include <cnoid/ThreadPool>
 
 namespace Multicopter {
 namespace FFCalc {
@@ -10,6 +11,8 @@ namespace FFCalc {
 
 const double FFCalculator::TINY_VELOCITY = 1.0e-12;
 
+const int FFCalculator::TRIANGLE_GRAIN_SIZE = 256;
+
 FFCalculator::FFCalculator (
     const Vector3& gravity,
     const FluidEnvironment& fluidEnv,
@@ -28,6 +31,8 @@ FFCalculator::FFCalculator (
 
     _linkVolume = mass / density;
 
+    _repLength = std::pow (_linkVolume, 1.0/3.0);
+
     return;
 }
 
@@ -94,79 +99,124 @@ void FFCalculator::calcAddMass (LinkForce* pLinkForceT, LinkForce* pLinkForceR)
     return;
 }
 
+namespace {
+
+struct SurfaceForce
+{
+    LinkForce normal;
+    LinkForce tangential;
+};
+
+}
+
 void FFCalculator::calcSurfaceGeneral(LinkForce* pLinkForceN, LinkForce* pLinkForceT,int degreeNumber)
 {
 
-    const int numIP = degreeNumber;
+    const int numIP = (degreeNumber == 1) ? 1 : std::min(degreeNumber, 4);
 
-    for (const auto& triAttr : _triAttrAry)
-    {
-        const GaussTriangle3d tri (triAttr.triangle(), _linkState.trans());
+    const Matrix3 rot = _linkState.trans().linear();
+    const Vector3 trans = _linkState.trans().translation();
 
-        for (int iIP=0; iIP<numIP; ++iIP)
-        {
+    const SurfaceForce zero { LinkForce(pLinkForceN->point()), LinkForce(pLinkForceT->point()) };
 
-            const double cutCoef = triAttr.cutoffCoefficient(iIP);
-            if (cutCoef < 1.0e-12)
-                continue;
+    // The triangles of a detailed hull are processed in parallel. The partial sums are combined
+    // in a fixed order so that the result does not depend on the number of the threads.
+    const SurfaceForce sum = cnoid::ThreadPool::instance()->parallelReduce(
+        0, static_cast<int>(_triAttrAry.size()), zero,
+        [&](int idx){
+            SurfaceForce force = zero;
+            _calcSurfaceTriangle (_triAttrAry[idx], numIP, rot, trans, &force.normal, &force.tangential);
+            return force;
+        },
+        [](SurfaceForce sum, const SurfaceForce& force){
+            sum.normal.add (force.normal);
+            sum.tangential.add (force.tangential);
+            return sum;
+        },
+        TRIANGLE_GRAIN_SIZE);
 
-            const Vector3 posIP = tri.getGaussPoint(iIP,numIP);
+    pLinkForceN->add (sum.normal);
+    pLinkForceT->add (sum.tangential);
 
-            FluidEnvironment::FluidValue fluid;
-            bool inBounds = _fluidEnv.get (posIP, fluid);
+    return;
+}
 
-            if ( inBounds==false  && _fluidEnvAll.isFluid ==false)
-                continue;
+void FFCalculator::_calcSurfaceTriangle (
+    const LinkTriangleAttribute& triAttr, int numIP, const Matrix3& rot, const Vector3& trans,
+    LinkForce* pLinkForceN, LinkForce* pLinkForceT) const
+{
+    // Only the pose dependent terms are computed here. The Gauss points are transformed at once.
+    const Vector3 normal = rot * triAttr.localNormal();
+    Eigen::Matrix<double, 3, 4> posIPs;
+    if (numIP == 1){
+        posIPs.col(0) = rot * triAttr.localGaussPoint1() + trans;
+    } else {
+        posIPs.noalias() = rot * triAttr.localGaussPoints4();
+        posIPs.colwise() += trans;
+    }
 
-            if(inBounds==true){
-                if(fluid.isFluid ==true){
-                }else continue;
-            }else if(_fluidEnvAll.isFluid == true){
-                fluid=_fluidEnvAll;
+    for (int iIP=0; iIP<numIP; ++iIP)
+    {
+
+        const double cutCoef = triAttr.cutoffCoefficient(iIP);
+        if (cutCoef < 1.0e-12)
+            continue;
+
+        const Vector3 posIP = posIPs.col(iIP);
+
+        FluidEnvironment::FluidValue fluid;
+        bool inBounds = _fluidEnv.get (posIP, fluid);
+
+        if ( inBounds==false  && _fluidEnvAll.isFluid ==false)
+            continue;
+
+        if(inBounds==true){
+            if(fluid.isFluid ==true){
             }else continue;
+        }else if(_fluidEnvAll.isFluid == true){
+            fluid=_fluidEnvAll;
+        }else continue;
 
-            const double coefIP = cutCoef * tri.getGaussWeight(iIP,numIP) * tri.area();
+        const double weight = (numIP == 1) ?
+            GaussQuadratureTriangle::param1[iIP].weight : GaussQuadratureTriangle::param4[iIP].weight;
+        const double coefIP = cutCoef * weight * triAttr.area();
 
-            double velPerp;
-            double velPara;
-            Vector3 vePara;
+        double velPerp;
+        double velPara;
+        Vector3 vePara;
 
-            Vector3 velRelative = fluid.velocity - _linkState.translationalVelocityAt(posIP);
-            _calcVectorDecomp (velRelative, -tri.normal(), &velPerp, &velPara, &vePara);
+        Vector3 velRelative = fluid.velocity - _linkState.translationalVelocityAt(posIP);
+        _calcVectorDecomp (velRelative, -normal, &velPerp, &velPara, &vePara);
 
-            if (velPerp >= TINY_VELOCITY)
+        if (velPerp >= TINY_VELOCITY)
+        {
+            double pressure = 0.5 * fluid.density * velPerp * velPerp;
+            Vector3 force = -normal * pressure;
+            pLinkForceN->addForce (coefIP * force, posIP);
+        }
+
+        if (velPara >= TINY_VELOCITY)
+        {
+
+            double coefReynolds = fluid.density * velPara * _repLength / fluid.viscosity;
+
+            if (coefReynolds < 4.0e5)
             {
-                double pressure = 0.5 * fluid.density * std::pow (std::max (0.0, velPerp), 2);
-                Vector3 force = -tri.normal() * pressure;
-                pLinkForceN->addForce (coefIP * force, posIP);
+                Vector3 forceT = 0.664 * velPara * vePara *
+                                 std::sqrt (fluid.viscosity * fluid.density * velPara / _repLength);
+                pLinkForceT->addForce (coefIP * forceT, posIP);
             }
-
-            if (velPara >= TINY_VELOCITY)
+            else
             {
+                double coefResist = 0.455 / std::pow (std::log10(coefReynolds), 2.58) - 1700.0 / coefReynolds;
+                if (coefReynolds < 6.0e5)
+                    coefResist = std::max (coefResist, 1.328 / std::sqrt(coefReynolds));
 
-                double repLength = std::pow (_linkVolume, 1.0/3.0);
-
-                double coefReynolds = fluid.density * velPara * repLength / fluid.viscosity;
-
-                if (coefReynolds < 4.0e5)
-                {
-                    Vector3 forceT = 0.664 * velPara * vePara *
-                                     std::sqrt (fluid.viscosity * fluid.density * velPara / repLength);
-                    pLinkForceT->addForce (coefIP * forceT, posIP);
-                }
-                else
-                {
-                    double coefResist = 0.455 / std::pow (std::log10(coefReynolds), 2.58) - 1700.0 / coefReynolds;
-                    if (coefReynolds < 6.0e5)
-                        coefResist = std::max (coefResist, 1.328 / std::sqrt(coefReynolds));
-
-                    Vector3 forceT = coefResist * 0.5 * fluid.density * velPara * velPara * vePara;
-                    pLinkForceT->addForce (coefIP * forceT, posIP);
-                }
+                Vector3 forceT = coefResist * 0.5 * fluid.density * velPara * velPara * vePara;
+                pLinkForceT->addForce (coefIP * forceT, posIP);
             }
         }
     }
-    return;
 }
 
 void FFCalculator::calcGravity_forDebug (LinkForce* pLinkForce)
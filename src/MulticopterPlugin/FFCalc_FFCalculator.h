@@ -25,10 +25,14 @@ private:
 
     double _linkVolume;
 
+    double _repLength;
+
     const Vector3 _gravity;
 
     static const double TINY_VELOCITY;
 
+    static const int TRIANGLE_GRAIN_SIZE;
+
 
 
 public:
@@ -61,7 +65,11 @@ private:
         const Vector3& vecZ, const Vector3& vecXZ,
         Vector3* vex, Vector3* vey, Vector3* vez);
 
-    void _calcVectorDecomp (
+    void _calcSurfaceTriangle (
+        const LinkTriangleAttribute& triAttr, int numIP, const Matrix3& rot, const Vector3& trans,
+        LinkForce* pLinkForceN, LinkForce* pLinkForceT) const;
+
+    static void _calcVectorDecomp (
         const Vector3& vec, const Vector3& vDirection, double* normDir,
         double* normPlane, Vector3* vePlane);
 };
@@ -12,20 +12,35 @@ namespace Multicopter{
 class LinkTriangleAttribute
 {
 public:
+    // Not aligned so that the attributes can be stored in std::vector with the default allocator
+    typedef Eigen::Matrix<double, 3, 4, Eigen::DontAlign> GaussPointMatrix;
+
     LinkTriangleAttribute(const Triangle3d& tri){
         _tri = tri;
 
         for (int idx=0; idx<_cutoffCoefAry.size(); ++idx)
             _cutoffCoefAry[idx] = 1.0;
+
+        updateLocalTerms();
     }
     
-    Triangle3d& triangle(){
-        return _tri;
-    }
-
     const Triangle3d& triangle() const{
         return _tri;
     }
+
+    /*
+      The terms which do not depend on the link pose are cached in the link frame.
+      The area does not change by the rigid transformation.
+    */
+    double area() const{ return _area; }
+
+    const Eigen::Vector3d& localNormal() const{ return _localNormal; }
+
+    // The columns are the Gauss points of the quadrature with four points
+    const GaussPointMatrix& localGaussPoints4() const{ return _localGaussPoints4; }
+
+    // The Gauss point of the quadrature with one point is the barycenter, which is also the first one above
+    Eigen::Vector3d localGaussPoint1() const{ return _localGaussPoints4.col(0); }
     
     int cutoffCoeffientSize() const{ return _cutoffCoefAry.size(); }
 
@@ -40,5 +55,18 @@ public:
 private:
     Triangle3d _tri;
     std::array<double,7> _cutoffCoefAry;
+    double _area;
+    Eigen::Vector3d _localNormal;
+    GaussPointMatrix _localGaussPoints4;
+
+    void updateLocalTerms(){
+        Eigen::Vector3d cross = (_tri[1]-_tri[0]).cross(_tri[2]-_tri[0]);
+        _area = 0.5 * cross.norm();
+        _localNormal = cross / (2.0*_area);
+        for (int idx=0; idx<4; ++idx){
+            _localGaussPoints4.col(idx) =
+                FFCalc::GaussQuadratureTriangle::param4[idx].getPosition(_tri[0], _tri[1], _tri[2]);
+        }
+    }
 };
 }
@@ -18,6 +18,7 @@
 #include <cnoid/BodyItem>
 #include <cnoid/BodyCollisionDetector>
 #include <QElapsedTimer>
+#include <set>
 #include "gettext.h"
 
 #ifdef GAZEBO_ODE
@@ -41,6 +42,9 @@ const bool MEASURE_PHYSICS_CALCULATION_TIME = true;
 
 const double DEFAULT_GRAVITY_ACCELERATION = 9.80665;
 
+// The thickness of a height field below its lowest point [m]
+const double HEIGHT_FIELD_THICKNESS = 1.0;
+
 typedef Eigen::Matrix<float, 3, 1> Vertex;
 
 struct Triangle {
@@ -69,6 +73,32 @@ inline void toInternal(const Vector3& v, Vector3& out_v) {
 
 class ODEBody;
 
+/**
+   The triangle mesh data of a link. The data is cached in the simulator item so that
+   the bounding volume hierarchy built by ODE can be reused when the simulation is restarted.
+*/
+class TriMeshData : public Referenced
+{
+public:
+    dTriMeshDataID id;
+    vector<Vertex> vertices;
+    vector<Triangle> triangles;
+    Vector3 c;
+
+    TriMeshData(vector<Vertex>&& vertices, vector<Triangle>&& triangles, const Vector3& c)
+        : vertices(std::move(vertices)), triangles(std::move(triangles)), c(c) {
+        id = dGeomTriMeshDataCreate();
+        // The arrays are referred by ODE without being copied
+        dGeomTriMeshDataBuildSingle(id,
+                                    &this->vertices[0], sizeof(Vertex), this->vertices.size(),
+                                    &this->triangles[0], this->triangles.size() * 3, sizeof(Triangle));
+    }
+    ~TriMeshData(){
+        dGeomTriMeshDataDestroy(id);
+    }
+};
+typedef ref_ptr<TriMeshData> TriMeshDataPtr;
+
 class ODELink : public Referenced
 {
 public:
@@ -76,9 +106,12 @@ public:
     dBodyID bodyID;
     dJointID jointID;
     vector<dGeomID> geomID;
-    dTriMeshDataID triMeshDataID;
+    TriMeshDataPtr triMeshData;
     vector<Vertex> vertices;
     vector<Triangle> triangles;
+    // The tiles of a height field share the geometry of the whole field
+    std::set<const vector<float>*> addedHeightFields;
+    vector<dHeightfieldDataID> heightfieldDataIDs;
     typedef map< dGeomID, Position, std::less<dGeomID>, 
                  Eigen::aligned_allocator< pair<const dGeomID, Position> > > OffsetMap;
     OffsetMap offsetMap;
@@ -88,7 +121,7 @@ public:
             const Vector3& parentOrigin, Link* link);
     ~ODELink();
     void createLinkBody(ODESimulatorItemImpl* simImpl, dWorldID worldID, ODELink* parent, const Vector3& origin);
-    void createGeometry(ODEBody* odeBody);
+    void createGeometry(ODESimulatorItemImpl* simImpl, ODEBody* odeBody);
     void setKinematicStateToODE();
     void setKinematicStateToODEflip();
     void setTorqueToODE();
@@ -139,6 +172,17 @@ public:
     double timeStep;
     CrawlerLinkMap crawlerLinks;
 
+    // The key is the collision shape of a link
+    typedef map<SgNodePtr, TriMeshDataPtr> TriMeshDataMap;
+    TriMeshDataMap triMeshDataCache;
+    std::set<SgNode*> usedTriMeshShapes;
+
+    int numThreads;
+#ifndef GAZEBO_ODE
+    dThreadingImplementationID threading;
+    dThreadingThreadPoolID threadPool;
+#endif
+
     Selection stepMode;
     Vector3 gravity;
     double friction;
@@ -164,6 +208,9 @@ public:
     void initialize();
     ~ODESimulatorItemImpl();
     void clear();
+    void setupThreading();
+    void clearThreading();
+    TriMeshData* findTriMeshData(Link* link);
     bool initializeSimulation(const std::vector<SimulationBody*>& simBodies);
     void addBody(ODEBody* odeBody);
     bool stepSimulation(const std::vector<SimulationBody*>& activeSimBodies);
@@ -183,7 +230,6 @@ ODELink::ODELink
     this->link = link;
     bodyID = 0;
     jointID = 0;
-    triMeshDataID = 0;
     geomID.clear();
     motorID = 0;
     
@@ -193,7 +239,7 @@ ODELink::ODELink
         createLinkBody(simImpl, odeBody->worldID, parent, o);
     }
     if(!simImpl->useWorldCollisionDetector){
-        createGeometry(odeBody);
+        createGeometry(simImpl, odeBody);
     }
 
     for(Link* child = link->child(); child; child = child->sibling()){
@@ -339,24 +385,27 @@ void ODELink::createLinkBody(ODESimulatorItemImpl* simImpl, dWorldID worldID, OD
 }
 
 
-void ODELink::createGeometry(ODEBody* odeBody)
+void ODELink::createGeometry(ODESimulatorItemImpl* simImpl, ODEBody* odeBody)
 {
     if(link->collisionShape()){
+        // The mesh vertices are not collected by addMesh if the data has been cached
+        triMeshData = simImpl->findTriMeshData(link);
         MeshExtractor* extractor = new MeshExtractor;
         if(extractor->extract(
                link->collisionShape(), [&](){ addMesh(extractor, odeBody); })){
-            if(!vertices.empty()){
-                triMeshDataID = dGeomTriMeshDataCreate();
-                dGeomTriMeshDataBuildSingle(triMeshDataID,
-                                            &vertices[0], sizeof(Vertex), vertices.size(),
-                                            &triangles[0],triangles.size() * 3, sizeof(Triangle));
-            
-                dGeomID gId = dCreateTriMesh(odeBody->spaceID, triMeshDataID, 0, 0, 0);
+            if(!triMeshData && !vertices.empty()){
+                triMeshData = new TriMeshData(std::move(vertices), std::move(triangles), link->c());
+                simImpl->triMeshDataCache[link->collisionShape()] = triMeshData;
+            }
+            if(triMeshData){
+                dGeomID gId = dCreateTriMesh(odeBody->spaceID, triMeshData->id, 0, 0, 0);
                 geomID.push_back(gId);
                 dGeomSetBody(gId, bodyID);
             }
         }
         delete extractor;
+        vertices.clear();
+        triangles.clear();
     }
 }
 
@@ -403,6 +452,7 @@ void ODELink::addMesh(MeshExtractor* extractor, ODEBody* odeBody)
         if(doAddPrimitive){
             bool created = false;
             dGeomID geomId;
+            Vector3 origin = Vector3::Zero();
             switch(mesh->primitiveType()){
             case SgMesh::BOX : {
                 const Vector3& s = mesh->primitive<SgMesh::Box>().size;
@@ -424,6 +474,24 @@ void ODELink::addMesh(MeshExtractor* extractor, ODEBody* odeBody)
                 geomId = dCreateCapsule(odeBody->spaceID, capsule.radius * scale.x(), capsule.height * scale.y());
                 created = true;
                 break; }
+            case SgMesh::HEIGHT_FIELD : {
+                auto& field = mesh->primitive<SgMesh::HeightField>();
+                if(!addedHeightFields.insert(field.heights.get()).second){
+                    meshAdded = true;
+                    break;
+                }
+                const double width = field.xSpacing * (field.xDimension - 1);
+                const double depth = field.zSpacing * (field.zDimension - 1);
+                dHeightfieldDataID dataID = dGeomHeightfieldDataCreate();
+                dGeomHeightfieldDataBuildSingle(
+                    dataID, field.heights->data(), 1, width, depth, field.xDimension, field.zDimension,
+                    1.0, 0.0, HEIGHT_FIELD_THICKNESS, 0);
+                heightfieldDataIDs.push_back(dataID);
+                geomId = dCreateHeightfield(odeBody->spaceID, dataID, 1);
+                // The origin of an ODE heightfield is the center of the field
+                origin = Vector3(width / 2.0, 0.0, depth / 2.0);
+                created = true;
+                break; }
             default :
                 break;
             }
@@ -434,6 +502,7 @@ void ODELink::addMesh(MeshExtractor* extractor, ODEBody* odeBody)
                 if(translation){
                     T_ *= Translation3(*translation);
                 }
+                T_ *= Translation3(origin);
                 if(mesh->primitiveType()==SgMesh::CYLINDER ||
                         mesh->primitiveType()==SgMesh::CAPSULE )
                     T_ *= AngleAxis(radian(90), Vector3::UnitX());
@@ -452,7 +521,7 @@ void ODELink::addMesh(MeshExtractor* extractor, ODEBody* odeBody)
         }
     }
 
-    if(!meshAdded){
+    if(!meshAdded && !triMeshData){
         const int vertexIndexTop = vertices.size();
 
         const SgVertexArray& vertices_ = *mesh->vertices();
@@ -479,8 +548,8 @@ ODELink::~ODELink()
 {
     for(vector<dGeomID>::iterator it=geomID.begin(); it!=geomID.end(); it++)
         dGeomDestroy(*it);
-    if(triMeshDataID){
-        dGeomTriMeshDataDestroy(triMeshDataID);
+    for(auto& id : heightfieldDataIDs){
+        dGeomHeightfieldDataDestroy(id);
     }
 }
 
@@ -884,6 +953,7 @@ ODESimulatorItemImpl::ODESimulatorItemImpl(ODESimulatorItem* self)
     is2Dmode = false;
     flipYZ = false;
     useWorldCollisionDetector = false;
+    numThreads = 1;
 }
 
 
@@ -913,6 +983,7 @@ ODESimulatorItemImpl::ODESimulatorItemImpl(ODESimulatorItem* self, const ODESimu
     is2Dmode = org.is2Dmode;
     flipYZ = org.flipYZ;
     useWorldCollisionDetector = org.useWorldCollisionDetector;
+    numThreads = org.numThreads;
 }
 
 
@@ -920,6 +991,10 @@ void ODESimulatorItemImpl::initialize()
 {
     worldID = 0;
     spaceID = 0;
+#ifndef GAZEBO_ODE
+    threading = 0;
+    threadPool = 0;
+#endif
     contactJointGroupID = dJointGroupCreate(0);
     self->SimulatorItem::setAllLinkPositionOutputMode(true);
 }
@@ -1007,6 +1082,12 @@ void ODESimulatorItem::setMaxCorrectingVelocity(double vel)
 }
 
 
+void ODESimulatorItem::setNumThreads(int n)
+{
+    impl->numThreads = std::max(1, n);
+}
+
+
 void ODESimulatorItem::setSurfaceLayerDepth(double value)
 {
     impl->surfaceLayerDepth = value;
@@ -1037,6 +1118,8 @@ void ODESimulatorItemImpl::clear()
 {
     dJointGroupEmpty(contactJointGroupID);
 
+    clearThreading();
+
     if(worldID){
         dWorldDestroy(worldID);
         worldID = 0;
@@ -1050,6 +1133,63 @@ void ODESimulatorItemImpl::clear()
 }    
 
 
+/**
+   The islands of the bodies are stepped in parallel by the threading implementation of ODE.
+   The collision detection is still done in the simulation thread.
+*/
+void ODESimulatorItemImpl::setupThreading()
+{
+#ifndef GAZEBO_ODE
+    if(numThreads > 1){
+        threading = dThreadingAllocateMultiThreadedImplementation();
+        if(!threading){
+            // ODE is built without the built-in threading implementation
+            return;
+        }
+        threadPool = dThreadingAllocateThreadPool(numThreads, 0, dAllocateFlagBasicData, nullptr);
+        dThreadingThreadPoolServeMultiThreadedImplementation(threadPool, threading);
+        dWorldSetStepThreadingImplementation(
+            worldID, dThreadingImplementationGetFunctions(threading), threading);
+        dWorldSetStepIslandsProcessingMaxThreadCount(worldID, numThreads);
+    }
+#endif
+}
+
+
+void ODESimulatorItemImpl::clearThreading()
+{
+#ifndef GAZEBO_ODE
+    if(threading){
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingFreeThreadPool(threadPool);
+        threadPool = 0;
+        if(worldID){
+            dWorldSetStepThreadingImplementation(worldID, nullptr, nullptr);
+        }
+        dThreadingFreeImplementation(threading);
+        threading = 0;
+    }
+#endif
+}
+
+
+TriMeshData* ODESimulatorItemImpl::findTriMeshData(Link* link)
+{
+    SgNode* shape = link->collisionShape();
+    usedTriMeshShapes.insert(shape);
+    auto p = triMeshDataCache.find(shape);
+    if(p != triMeshDataCache.end()){
+        TriMeshData* data = p->second;
+        // The vertices are relative to the center of mass
+        if(data->c == link->c()){
+            return data;
+        }
+        triMeshDataCache.erase(p);
+    }
+    return nullptr;
+}
+
+
 Item* ODESimulatorItem::doDuplicate() const
 {
     return new ODESimulatorItem(*this);
@@ -1100,9 +1240,22 @@ bool ODESimulatorItemImpl::initializeSimulation(const std::vector<SimulationBody
 
     timeStep = self->worldTimeStep();
 
+    setupThreading();
+
+    usedTriMeshShapes.clear();
     for(size_t i=0; i < simBodies.size(); ++i){
         addBody(static_cast<ODEBody*>(simBodies[i]));
     }
+    // Release the data of the shapes which are not used any more
+    auto p = triMeshDataCache.begin();
+    while(p != triMeshDataCache.end()){
+        if(usedTriMeshShapes.find(p->first.get()) == usedTriMeshShapes.end()){
+            p = triMeshDataCache.erase(p);
+        } else {
+            ++p;
+        }
+    }
+    usedTriMeshShapes.clear();
     if(useWorldCollisionDetector){
         bodyCollisionDetector.makeReady();
     }
@@ -1411,6 +1564,10 @@ void ODESimulatorItemImpl::doPutProperties(PutPropertyFunction& putProperty)
 
     putProperty(_("Use WorldItem's Collision Detector"), useWorldCollisionDetector, changeProperty(useWorldCollisionDetector));
 
+#ifndef GAZEBO_ODE
+    putProperty.min(1)(_("Threads"), numThreads, changeProperty(numThreads));
+#endif
+
 }
 
 
@@ -1436,6 +1593,7 @@ void ODESimulatorItemImpl::store(Archive& archive)
     archive.write("maxCorrectingVel", maxCorrectingVel);
     archive.write("2Dmode", is2Dmode);
     archive.write("useWorldCollisionDetector", useWorldCollisionDetector);
+    archive.write("numThreads", numThreads);
 }
 
 
@@ -1466,4 +1624,5 @@ void ODESimulatorItemImpl::restore(const Archive& archive)
     if(!archive.read("useWorldCollisionDetector", useWorldCollisionDetector)){
         archive.read("UseWorldItem'sCollisionDetector", useWorldCollisionDetector);
     }
+    archive.read("numThreads", numThreads);
 }
@@ -42,6 +42,9 @@ public:
     void setSurfaceLayerDepth(double value);
     void useWorldCollisionDetector(bool on);
 
+    //! The number of the threads used to step the islands of the bodies in parallel
+    void setNumThreads(int n);
+
     virtual void setAllLinkPositionOutputMode(bool on) override;
     virtual Vector3 getGravity() const override;
 
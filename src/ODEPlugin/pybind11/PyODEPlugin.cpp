@@ -29,6 +29,7 @@ PYBIND11_MODULE(ODEPlugin, m)
         .def("setMaxCorrectingVelocity", &ODESimulatorItem::setMaxCorrectingVelocity)
         .def("setSurfaceLayerDepth", &ODESimulatorItem::setSurfaceLayerDepth)
         .def("useWorldCollisionDetector", &ODESimulatorItem::useWorldCollisionDetector)
+        .def("setNumThreads", &ODESimulatorItem::setNumThreads)
         ;
 
     py::enum_<ODESimulatorItem::StepMode>(odeSimulatorItemScope, "StepMode")
@@ -5,6 +5,7 @@
 
 #include "BodyStateSubscriberRTCItem.h"
 #include <cnoid/BodyItem>
+#include <cnoid/BodyMotionItem>
 #include <cnoid/RangeCamera>
 #include <cnoid/RangeSensor>
 #include <cnoid/ItemManager>
@@ -13,12 +14,16 @@
 #include <cnoid/MessageView>
 #include <cnoid/OpenRTMUtil>
 #include <cnoid/LazyCaller>
+#include <cnoid/Timer>
 #include <rtm/DataFlowComponentBase.h>
 #include <rtm/DataInPort.h>
 #include <rtm/idl/InterfaceDataTypes.hh>
 #include <cnoid/corba/PointCloud.hh>
 #include <fmt/format.h>
 #include <mutex>
+#include <deque>
+#include <chrono>
+#include <cmath>
 
 #ifdef USE_BUILTIN_CAMERA_IMAGE_IDL
 # include "deprecated/corba/CameraImage.hh"
@@ -58,6 +63,8 @@ public:
 
 class SubscriberRTC;
 
+typedef std::chrono::steady_clock Clock;
+
 class InputBase : public Referenced
 {
 public:
@@ -67,20 +74,46 @@ public:
 typedef ref_ptr<InputBase> InputBasePtr;
 
 
+/**
+   The received states are buffered in the thread of the RTC, and the display is updated
+   from the buffered states by the timer of the item at the display rate. The states
+   are also recorded into a body motion in the thread of the RTC when the recording is enabled.
+*/
 class KinematicStateInput : public InputBase
 {
 public:
     
     BodyItem* bodyItem;
+    int numJoints;
     RTC::InPort<RTC::TimedDoubleSeq> qin;
     RTC::TimedDoubleSeq q;
-    vector<double> qtmp;
-    LazyCaller updateKinematicStateCaller;
     std::mutex kinematicStateMutex;
 
+    struct Sample {
+        double time;
+        vector<double> q;
+    };
+    // The recent samples for the interpolation
+    std::deque<Sample> samples;
+    static const int maxNumSamples = 16;
+    Clock::time_point latestArrivalTime;
+    double sampleInterval;
+    bool isNewSampleAvailable;
+    double lastDisplayTime;
+
+    // Used when the display is updated for each received state
+    bool isImmediateUpdateMode;
+    LazyCaller updateKinematicStateCaller;
+
+    std::shared_ptr<BodyMotion> recordingMotion;
+    double recordingStartTime;
+
     KinematicStateInput(SubscriberRTC* rtc, BodyItem* bodyItem);
     virtual void read() override;
+    void addSample(const Clock::time_point& arrivalTime);
+    void record(const Sample& sample);
     void updateKinematicState();
+    bool getDisplayState(bool doInterpolation, vector<double>& out_q);
 };
 
     
@@ -139,6 +172,7 @@ class SubscriberRTC : public RTC::DataFlowComponentBase
 {
 public:
     vector<InputBasePtr> inputs;
+    ref_ptr<KinematicStateInput> kinematicStateInput;
     
     SubscriberRTC(RTC::Manager* manager);
     void createInPorts(BodyItem* bodyItem, int pointCloudPortType, bool isVisionSensorSubscriber);
@@ -161,7 +195,8 @@ SubscriberRTC::SubscriberRTC(RTC::Manager* manager)
 void SubscriberRTC::createInPorts(BodyItem* bodyItem, int pointCloudPortType, bool isVisionSensorSubscriber)
 {
     if(!isVisionSensorSubscriber){
-        inputs.push_back(new KinematicStateInput(this, bodyItem));
+        kinematicStateInput = new KinematicStateInput(this, bodyItem);
+        inputs.push_back(kinematicStateInput);
     }
     
     DeviceList<> devices = bodyItem->body()->devices();
@@ -218,6 +253,13 @@ KinematicStateInput::KinematicStateInput(SubscriberRTC* rtc, BodyItem* bodyItem)
       qin("q", q),
       updateKinematicStateCaller([&](){ updateKinematicState(); })
 {
+    numJoints = bodyItem->body()->numJoints();
+    sampleInterval = 0.0;
+    isNewSampleAvailable = false;
+    lastDisplayTime = 0.0;
+    isImmediateUpdateMode = false;
+    recordingStartTime = 0.0;
+    
     rtc->addInPort("q", qin);
 }
 
@@ -225,17 +267,93 @@ KinematicStateInput::KinematicStateInput(SubscriberRTC* rtc, BodyItem* bodyItem)
 void KinematicStateInput::read()
 {
     if(qin.isNew()){
+        // All the buffered states are read so that the recorded motion does not lose them
         do {
             qin.read();
+            if(q.data.length() > 0){
+                addSample(Clock::now());
+            }
         } while(qin.isNew());
+    }
+}
 
-        if(q.data.length() > 0){
-            lock_guard<mutex> lock(kinematicStateMutex);
-            qtmp.resize(q.data.length());
-            for(size_t i=0; i < qtmp.size(); ++i){
-                qtmp[i] = q.data[i];
-            }
-            updateKinematicStateCaller();
+
+void KinematicStateInput::addSample(const Clock::time_point& arrivalTime)
+{
+    double time;
+    if(q.tm.sec == 0 && q.tm.nsec == 0){
+        // The time stamp is not given by the publisher
+        time = std::chrono::duration<double>(arrivalTime.time_since_epoch()).count();
+    } else {
+        time = q.tm.sec + q.tm.nsec * 1.0e-9;
+    }
+    
+    lock_guard<mutex> lock(kinematicStateMutex);
+
+    if(!samples.empty() && time <= samples.back().time){
+        // The publisher may have been restarted
+        samples.clear();
+        sampleInterval = 0.0;
+    }
+
+    Sample sample;
+    if(samples.size() >= maxNumSamples){
+        // Reuse the buffer of the oldest sample
+        sample = std::move(samples.front());
+        samples.pop_front();
+    }
+    sample.time = time;
+    const int n = q.data.length();
+    sample.q.resize(n);
+    for(int i=0; i < n; ++i){
+        sample.q[i] = q.data[i];
+    }
+
+    if(!samples.empty()){
+        double dt = time - samples.back().time;
+        if(sampleInterval <= 0.0){
+            sampleInterval = dt;
+        } else {
+            sampleInterval = 0.9 * sampleInterval + 0.1 * dt;
+        }
+    }
+    samples.push_back(std::move(sample));
+    latestArrivalTime = arrivalTime;
+    isNewSampleAvailable = true;
+
+    if(recordingMotion){
+        record(samples.back());
+    }
+    
+    if(isImmediateUpdateMode){
+        updateKinematicStateCaller();
+    }
+}
+
+
+/**
+   The frames between the previous sample and the current sample are filled with the current sample.
+   This function is called with the mutex locked.
+*/
+void KinematicStateInput::record(const Sample& sample)
+{
+    auto seq = recordingMotion->jointPosSeq();
+    const int prevNumFrames = seq->numFrames();
+    if(prevNumFrames == 0){
+        recordingStartTime = sample.time;
+    }
+    const int frame = static_cast<int>(std::round((sample.time - recordingStartTime) * seq->frameRate()));
+    if(frame < 0){
+        return;
+    }
+    if(frame >= prevNumFrames){
+        seq->setNumFrames(frame + 1);
+    }
+    const int n = std::min(seq->numParts(), (int)sample.q.size());
+    for(int i=std::min(frame, prevNumFrames); i <= frame; ++i){
+        auto f = seq->frame(i);
+        for(int j=0; j < n; ++j){
+            f[j] = sample.q[j];
         }
     }
 }
@@ -246,13 +364,72 @@ void KinematicStateInput::updateKinematicState()
     auto body = bodyItem->body();
     {
         lock_guard<mutex> lock(kinematicStateMutex);
+        if(samples.empty()){
+            return;
+        }
+        auto& qtmp = samples.back().q;
         int n = std::min(body->numJoints(), (int)qtmp.size());
         for(int i=0; i < n; ++i){
             body->joint(i)->q() = qtmp[i];
         }
+        isNewSampleAvailable = false;
     }
     bodyItem->notifyKinematicStateChangeLater(true);
 }
+
+
+/**
+   \return false if the display does not have to be updated
+*/
+bool KinematicStateInput::getDisplayState(bool doInterpolation, vector<double>& out_q)
+{
+    lock_guard<mutex> lock(kinematicStateMutex);
+
+    if(samples.empty()){
+        return false;
+    }
+
+    if(!doInterpolation || samples.size() < 2 || sampleInterval <= 0.0){
+        if(!isNewSampleAvailable){
+            return false;
+        }
+        out_q = samples.back().q;
+        isNewSampleAvailable = false;
+        return true;
+    }
+
+    /*
+      The display time lags behind the newest sample by the sample interval so that
+      the display time usually stays between the two latest samples and advances smoothly.
+    */
+    double elapsed = std::chrono::duration<double>(Clock::now() - latestArrivalTime).count();
+    double time = samples.back().time + std::min(elapsed, sampleInterval) - sampleInterval;
+    if(time == lastDisplayTime){
+        return false;
+    }
+    lastDisplayTime = time;
+    isNewSampleAvailable = false;
+
+    if(time <= samples.front().time){
+        out_q = samples.front().q;
+        return true;
+    }
+    for(size_t i=1; i < samples.size(); ++i){
+        const Sample& s1 = samples[i];
+        if(time <= s1.time){
+            const Sample& s0 = samples[i-1];
+            const double r = (time - s0.time) / (s1.time - s0.time);
+            const int n = std::min(s0.q.size(), s1.q.size());
+            out_q.resize(n);
+            for(int j=0; j < n; ++j){
+                out_q[j] = (1.0 - r) * s0.q[j] + r * s1.q[j];
+            }
+            return true;
+        }
+    }
+    out_q = samples.back().q;
+    return true;
+}
     
         
 CameraImageInput::CameraImageInput(SubscriberRTC* rtc, Camera* camera)
@@ -564,6 +741,12 @@ public:
     RTC::ExecutionContext_var execContext;
     int periodicRate;
     Selection pointCloudPortType;
+    int displayRate;
+    bool isInterpolationEnabled;
+    Timer displayTimer;
+    vector<double> qDisplay;
+    bool isRecording;
+    double recordingFrameRate;
 
     BodyStateSubscriberRTCItemImpl(BodyStateSubscriberRTCItem* self);
     BodyStateSubscriberRTCItemImpl(BodyStateSubscriberRTCItem* self, const BodyStateSubscriberRTCItemImpl& org);
@@ -574,6 +757,12 @@ public:
     void deleteRTC();
     bool start();
     void stop();
+    void setDisplayRate(int rate);
+    void updateDisplayMode();
+    void onDisplayTimeout();
+    void setRecordingEnabled(bool on);
+    void startRecording();
+    void stopRecording();
 };
 
 }
@@ -628,6 +817,10 @@ BodyStateSubscriberRTCItemImpl::BodyStateSubscriberRTCItemImpl(BodyStateSubscrib
     subscriberRTC = nullptr;
     execContext = RTC::ExecutionContext::_nil();
     periodicRate = 30;
+    displayRate = 30;
+    isInterpolationEnabled = false;
+    isRecording = false;
+    recordingFrameRate = 1000.0;
 
     pointCloudPortType.setSymbol(
         BodyStateSubscriberRTCItem::POINT_CLOUD_TYPES_POINT_CLOUD_TYPE,
@@ -638,6 +831,8 @@ BodyStateSubscriberRTCItemImpl::BodyStateSubscriberRTCItemImpl(BodyStateSubscrib
     pointCloudPortType.select(BodyStateSubscriberRTCItem::POINT_CLOUD_TYPES_POINT_CLOUD_TYPE);
     
     self->sigNameChanged().connect([&](const string&){ createRTC(); });
+
+    displayTimer.sigTimeout().connect([&](){ onDisplayTimeout(); });
 }
 
 
@@ -647,6 +842,9 @@ BodyStateSubscriberRTCItemImpl::BodyStateSubscriberRTCItemImpl
 {
     periodicRate = org.periodicRate;
     pointCloudPortType = org.pointCloudPortType;
+    displayRate = org.displayRate;
+    isInterpolationEnabled = org.isInterpolationEnabled;
+    recordingFrameRate = org.recordingFrameRate;
 }
 
 
@@ -743,12 +941,22 @@ void BodyStateSubscriberRTCItemImpl::createRTC()
             break;
         }
     }
+
+    updateDisplayMode();
+    if(isRecording){
+        startRecording();
+    }
 }
 
 
 void BodyStateSubscriberRTCItemImpl::deleteRTC()
 {
+    displayTimer.stop();
+    
     if(subscriberRTC){
+        if(isRecording){
+            stopRecording();
+        }
         subscriberRTC->exit();
         RTC::Manager::instance().cleanupComponents();
         subscriberRTC = nullptr;
@@ -756,6 +964,133 @@ void BodyStateSubscriberRTCItemImpl::deleteRTC()
 }
 
 
+void BodyStateSubscriberRTCItem::setDisplayRate(int rate)
+{
+    impl->setDisplayRate(rate);
+}
+
+
+void BodyStateSubscriberRTCItemImpl::setDisplayRate(int rate)
+{
+    displayRate = std::max(0, rate);
+    updateDisplayMode();
+}
+
+
+void BodyStateSubscriberRTCItem::setInterpolationEnabled(bool on)
+{
+    impl->isInterpolationEnabled = on;
+}
+
+
+void BodyStateSubscriberRTCItemImpl::updateDisplayMode()
+{
+    KinematicStateInput* input = subscriberRTC ? subscriberRTC->kinematicStateInput.get() : nullptr;
+    if(!input){
+        displayTimer.stop();
+        return;
+    }
+    {
+        lock_guard<mutex> lock(input->kinematicStateMutex);
+        input->isImmediateUpdateMode = (displayRate == 0);
+    }
+    if(displayRate > 0){
+        displayTimer.setInterval(1000 / displayRate);
+        displayTimer.start();
+    } else {
+        displayTimer.stop();
+    }
+}
+
+
+void BodyStateSubscriberRTCItemImpl::onDisplayTimeout()
+{
+    if(!subscriberRTC || !subscriberRTC->kinematicStateInput){
+        return;
+    }
+    if(subscriberRTC->kinematicStateInput->getDisplayState(isInterpolationEnabled, qDisplay)){
+        auto body = bodyItem->body();
+        int n = std::min(body->numJoints(), (int)qDisplay.size());
+        for(int i=0; i < n; ++i){
+            body->joint(i)->q() = qDisplay[i];
+        }
+        bodyItem->notifyKinematicStateChange(true);
+    }
+}
+
+
+void BodyStateSubscriberRTCItem::setRecordingEnabled(bool on)
+{
+    impl->setRecordingEnabled(on);
+}
+
+
+void BodyStateSubscriberRTCItemImpl::setRecordingEnabled(bool on)
+{
+    if(on != isRecording){
+        isRecording = on;
+        if(on){
+            startRecording();
+        } else {
+            stopRecording();
+        }
+    }
+}
+
+
+void BodyStateSubscriberRTCItemImpl::startRecording()
+{
+    KinematicStateInput* input = subscriberRTC ? subscriberRTC->kinematicStateInput.get() : nullptr;
+    if(!input){
+        return;
+    }
+    auto motion = std::make_shared<BodyMotion>();
+    motion->setFrameRate(recordingFrameRate);
+    motion->setDimension(0, input->numJoints, 1);
+    
+    lock_guard<mutex> lock(input->kinematicStateMutex);
+    input->recordingMotion = motion;
+}
+
+
+/**
+   The recorded motion is added to the body item as a new body motion item.
+*/
+void BodyStateSubscriberRTCItemImpl::stopRecording()
+{
+    KinematicStateInput* input = subscriberRTC ? subscriberRTC->kinematicStateInput.get() : nullptr;
+    if(!input){
+        return;
+    }
+    std::shared_ptr<BodyMotion> motion;
+    {
+        lock_guard<mutex> lock(input->kinematicStateMutex);
+        motion = input->recordingMotion;
+        input->recordingMotion.reset();
+    }
+    if(!motion || motion->numFrames() == 0){
+        return;
+    }
+
+    // The root link is fixed at the current position
+    const int numFrames = motion->jointPosSeq()->numFrames();
+    auto linkPosSeq = motion->linkPosSeq();
+    linkPosSeq->setNumFrames(numFrames);
+    auto rootLink = bodyItem->body()->rootLink();
+    for(int i=0; i < numFrames; ++i){
+        auto& position = linkPosSeq->at(i, 0);
+        position.translation() = rootLink->p();
+        position.rotation() = rootLink->R();
+    }
+
+    BodyMotionItemPtr motionItem = new BodyMotionItem(motion);
+    motionItem->setName(format("{}-recorded", self->name()));
+    bodyItem->addChildItem(motionItem);
+    mv->putln(format(_("The states received by \"{0}\" have been recorded into \"{1}\"."),
+                     self->name(), motionItem->name()));
+}
+
+
 Item* BodyStateSubscriberRTCItem::doDuplicate() const
 {
     return new BodyStateSubscriberRTCItem(*this);
@@ -769,6 +1104,15 @@ void BodyStateSubscriberRTCItem::doPutProperties(PutPropertyFunction& putPropert
 
     putProperty(_("Point cloud port type"), impl->pointCloudPortType,
                 [&](int which){ setPointCloudPortType(which); return true; });
+
+    putProperty.min(0)(_("Display rate"), impl->displayRate,
+                       [&](int rate){ setDisplayRate(rate); return true; });
+    putProperty(_("Interpolation"), impl->isInterpolationEnabled,
+                [&](bool on){ setInterpolationEnabled(on); return true; });
+    putProperty(_("Recording"), impl->isRecording,
+                [&](bool on){ setRecordingEnabled(on); return true; });
+    putProperty.min(1.0)(_("Recording frame rate"), impl->recordingFrameRate,
+                         changeProperty(impl->recordingFrameRate));
 }
 
 
@@ -776,6 +1120,9 @@ bool BodyStateSubscriberRTCItem::store(Archive& archive)
 {
     archive.write("periodicRate", impl->periodicRate);
     archive.write("pointCloudPortType", impl->pointCloudPortType.selectedSymbol(), DOUBLE_QUOTED);
+    archive.write("displayRate", impl->displayRate);
+    archive.write("interpolation", impl->isInterpolationEnabled);
+    archive.write("recordingFrameRate", impl->recordingFrameRate);
     return true;
 }
 
@@ -788,6 +1135,10 @@ bool BodyStateSubscriberRTCItem::restore(const Archive& archive)
     if(archive.read("pointCloudPortType", type)){
         impl->pointCloudPortType.select(type);
     }
+
+    archive.read("displayRate", impl->displayRate);
+    archive.read("interpolation", impl->isInterpolationEnabled);
+    archive.read("recordingFrameRate", impl->recordingFrameRate);
     
     return true;
 }
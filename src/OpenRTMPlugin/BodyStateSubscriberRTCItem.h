@@ -33,6 +33,21 @@ public:
     
     void setPointCloudPortType(int type);
 
+    /**
+       The rate [Hz] at which the display of the body is updated from the received states.
+       The display is updated for each received state when the rate is zero.
+    */
+    void setDisplayRate(int rate);
+
+    //! The displayed state is interpolated between the received states
+    void setInterpolationEnabled(bool on);
+
+    /**
+       The received states are recorded without the intervention of the GUI thread, and
+       the recorded motion is added to the body item when the recording is disabled.
+    */
+    void setRecordingEnabled(bool on);
+
     virtual void onDisconnectedFromRoot() override;
     virtual void onPositionChanged() override;
     virtual Item* doDuplicate() const override;
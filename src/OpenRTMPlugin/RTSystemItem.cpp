@@ -6,6 +6,7 @@
 #include <cnoid/EigenArchive>
 #include <cnoid/AppConfig>
 #include <rtm/CORBA_SeqUtil.h>
+#include <rtm/Manager.h>
 #include <fmt/format.h>
 #include "LoggerUtil.h"
 #include "gettext.h"
@@ -264,6 +265,47 @@ RTSConnection::RTSConnection(const string& id, const string& name,
 }
 
 
+#if defined(OPENRTM_VERSION12)
+static bool isLocalComponent(RTSComp* rtsComp)
+{
+    if (!rtsComp || CORBA::is_nil(rtsComp->rtc_)) {
+        return false;
+    }
+    for (auto comp : RTC::Manager::instance().getComponents()) {
+        RTC::RTObject_var obj = comp->getObjRef();
+        if (obj->_is_equivalent(rtsComp->rtc_)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static bool hasInterfaceType(RTSPort* port, const string& type)
+{
+    for (auto& t : port->getInterfaceTypes()) {
+        if (QString::fromStdString(t).trimmed().compare(type.c_str(), Qt::CaseInsensitive) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+   The data of the "corba_cdr" connection between the data ports of the RTCs in this process
+   is transferred by the "direct" interface type, which gives the data to the input port
+   without the CDR marshalling. The properties recorded in the connection are not changed
+   so that the project can be used with the RTCs in other processes.
+*/
+static bool canConnectDirectly(RTSPort* sourcePort, RTSPort* targetPort)
+{
+    return hasInterfaceType(sourcePort, "direct") && hasInterfaceType(targetPort, "direct") &&
+        isLocalComponent(sourcePort->rtsComp) && isLocalComponent(targetPort->rtsComp);
+}
+#endif
+
+
 bool RTSConnection::connect()
 {
     DDEBUG("RTSConnection::connect");
@@ -290,10 +332,21 @@ bool RTSConnection::connect()
     cprof.ports[0] = PortService::_duplicate(sourcePort->port);
     cprof.ports[1] = PortService::_duplicate(targetPort->port);
 
+    bool isDirect = false;
+#if defined(OPENRTM_VERSION12)
+    if (!sourcePort->isServicePort) {
+        isDirect = canConnectDirectly(sourcePort, targetPort);
+    }
+#endif
+
     for (int index = 0; index < propList.size(); index++) {
         NamedValuePtr param = propList[index];
+        const char* value = param->value_.c_str();
+        if (isDirect && param->name_ == "dataport.interface_type" && param->value_ == "corba_cdr") {
+            value = "direct";
+        }
         CORBA_SeqUtil::push_back(
-            cprof.properties, NVUtil::newNV(param->name_.c_str(), param->value_.c_str()));
+            cprof.properties, NVUtil::newNV(param->name_.c_str(), value));
     }
 
     RTC::ReturnCode_t result = sourcePort->port->connect(cprof);
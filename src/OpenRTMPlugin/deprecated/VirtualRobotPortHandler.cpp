@@ -449,6 +449,8 @@ public:
     Camera* camera;
     std::string cameraName;
     std::shared_ptr<const Image> prevImage;
+    // The image whose pixels are referred to by the output value
+    std::shared_ptr<const Image> imageForValue;
     double controlTime;
 
     CameraImageOutPortHandlerImpl(CameraImageOutPortHandler* self, PortInfo& info, bool synchController);
@@ -545,11 +547,11 @@ void CameraImageOutPortHandlerImpl::onCameraStateChanged()
             default : value.data.image.format = Img::CF_UNKNOWN;
                 break;
             }
-            size_t length = width * height * image.numComponents() * sizeof(unsigned char);
-            value.data.image.raw_data.length(length);
-            void* src = (void*)image.pixels();
-            void* dis = (void*)value.data.image.raw_data.get_buffer();
-            memcpy(dis, src, length);
+            // The sequence refers to the pixels of the image without copying them
+            CORBA::ULong length = width * height * image.numComponents() * sizeof(unsigned char);
+            value.data.image.raw_data.replace(
+                length, length, const_cast<CORBA::Octet*>(image.pixels()), false);
+            imageForValue = camera->sharedImage();
         }
         prevImage = camera->sharedImage();
         std::lock_guard<std::mutex> lock(mtx);
@@ -4,17 +4,81 @@
 */
 
 #include "PointCloudUtil.h"
+#include <cnoid/LazyCaller>
 #include <pcl/point_types.h>
 #include <pcl/io/pcd_io.h>
 #include <pcl/kdtree/kdtree_flann.h>
-#include <pcl/features/normal_3d.h>
+#include <pcl/features/normal_3d_omp.h>
 #include <pcl/surface/gp3.h>
 #include <pcl/registration/icp.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <iostream>
 
 using namespace std;
 using namespace cnoid;
 
+namespace {
+
+const double DefaultSearchRadius = 0.025;
+const int NumNormalEstimationNeighbors = 20;
+
+typedef pcl::PointCloud<pcl::PointXYZ> PointCloud;
+typedef pcl::PointCloud<pcl::PointNormal> PointNormalCloud;
+
+/**
+   The normals are estimated in the threads of OpenMP.
+   \param indices The indices of the points whose normals are estimated. All the points of the
+   cloud are used as the neighbors of them.
+*/
+void estimateNormals
+(PointCloud::Ptr cloud, pcl::IndicesPtr indices, const Vector3& viewPoint, pcl::PointCloud<pcl::Normal>& out_normals)
+{
+    pcl::NormalEstimationOMP<pcl::PointXYZ, pcl::Normal> estimation;
+    estimation.setNumberOfThreads(0);
+    pcl::search::KdTree<pcl::PointXYZ>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZ>);
+    tree->setInputCloud(cloud);
+    estimation.setInputCloud(cloud);
+    if(indices){
+        estimation.setIndices(indices);
+    }
+    estimation.setSearchMethod(tree);
+    estimation.setViewPoint(viewPoint.x(), viewPoint.y(), viewPoint.z());
+    estimation.setKSearch(NumNormalEstimationNeighbors);
+    estimation.compute(out_normals);
+}
+
+
+void triangulate(PointNormalCloud::Ptr cloud, double searchRadius, vector<pcl::Vertices>& out_triangles)
+{
+    pcl::search::KdTree<pcl::PointNormal>::Ptr tree(new pcl::search::KdTree<pcl::PointNormal>);
+    tree->setInputCloud(cloud);
+    
+    pcl::GreedyProjectionTriangulation<pcl::PointNormal> gp3;
+
+    // Set the maximum distance between connected points (maximum edge length)
+    gp3.setSearchRadius(searchRadius);
+    
+    // Set typical values for the parameters
+    gp3.setMu(2.5);
+    gp3.setMaximumNearestNeighbors(100);
+    gp3.setMaximumSurfaceAngle(M_PI / 4.0); // 45 degrees
+    gp3.setMinimumAngle(M_PI / 18.0); // 10 degrees
+    gp3.setMaximumAngle(2.0 * M_PI / 3.0); // 120 degrees
+    gp3.setNormalConsistency(false);
+    gp3.setConsistentVertexOrdering(true);
+    
+    gp3.setInputCloud(cloud);
+    gp3.setSearchMethod(tree);
+    gp3.reconstruct(out_triangles);
+}
+
+}
+
+
 SgMesh* cnoid::createSurfaceMesh(SgPointSet* pointSet)
 {
     if(!pointSet->hasVertices()){
@@ -27,73 +91,31 @@ SgMesh* cnoid::createSurfaceMesh(SgPointSet* pointSet)
     SgMesh* mesh = new SgMesh;
     mesh->setVertices(vertices);
 
-    typedef pcl::PointCloud<pcl::PointXYZ> PointCloud;
     PointCloud::Ptr cloud(new PointCloud(numPoints, 1));
     for(int i=0; i < numPoints; ++i){
         const Vector3f& p = (*vertices)[i];
         cloud->points[i] = pcl::PointXYZ(p.x(), p.y(), p.z());
     }
     
-    // Normal estimation*
-    pcl::NormalEstimation<pcl::PointXYZ, pcl::Normal> n;
     pcl::PointCloud<pcl::Normal>::Ptr normals(new pcl::PointCloud<pcl::Normal>);
-    pcl::search::KdTree<pcl::PointXYZ>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZ>);
-    tree->setInputCloud(cloud);
-    n.setInputCloud(cloud);
-    n.setSearchMethod(tree);
-    //n.setRadiusSearch(0.03);
-    n.setViewPoint(0.0, 0.0, 0.5);
-    n.setKSearch(20);
-    n.compute(*normals);
-    //* normals should not contain the point normals + surface curvatures
-
-    /*
-    SgNormalArray& meshNormals = *mesh->setNormals(new SgNormalArray(normals->size()));
-    for(size_t i=0; i < normals->size(); ++i){
-        meshNormals[i] = Eigen::Map<const Vector3f>(normals->points[i].normal);
-    }
-    */
+    estimateNormals(cloud, nullptr, Vector3(0.0, 0.0, 0.5), *normals);
     
-    // Concatenate the XYZ and normal fields*
-    pcl::PointCloud<pcl::PointNormal>::Ptr cloud_with_normals(new pcl::PointCloud<pcl::PointNormal>);
+    // Concatenate the XYZ and normal fields
+    PointNormalCloud::Ptr cloud_with_normals(new PointNormalCloud);
     pcl::concatenateFields(*cloud, *normals, *cloud_with_normals);
-    //* cloud_with_normals = cloud + normals
-    
-    // Create search tree*
-    pcl::search::KdTree<pcl::PointNormal>::Ptr tree2(new pcl::search::KdTree<pcl::PointNormal>);
-    tree2->setInputCloud(cloud_with_normals);
-    
-    // Initialize objects
-    pcl::GreedyProjectionTriangulation<pcl::PointNormal> gp3;
-    pcl::PolygonMesh polygonMesh;
-    
-    // Set the maximum distance between connected points (maximum edge length)
-    gp3.setSearchRadius(0.025);
-    
-    // Set typical values for the parameters
-    gp3.setMu(2.5);
-    gp3.setMaximumNearestNeighbors(100);
-    gp3.setMaximumSurfaceAngle(M_PI / 4.0); // 45 degrees
-    gp3.setMinimumAngle(M_PI / 18.0); // 10 degrees
-    gp3.setMaximumAngle(2.0 * M_PI / 3.0); // 120 degrees
-    gp3.setNormalConsistency(false);
-    gp3.setConsistentVertexOrdering(true);
-    
-    // Get result
-    gp3.setInputCloud(cloud_with_normals);
-    gp3.setSearchMethod(tree2);
-    gp3.reconstruct(polygonMesh); // The result type is supposed to be triangles
+
+    vector<pcl::Vertices> triangles;
+    triangulate(cloud_with_normals, DefaultSearchRadius, triangles);
 
     SgNormalArray& meshNormals = *mesh->setNormals(new SgNormalArray(cloud_with_normals->size()));
     for(size_t i=0; i < cloud_with_normals->size(); ++i){
         meshNormals[i] = Eigen::Map<const Vector3f>(cloud_with_normals->points[i].normal);
     }
 
-    const vector<pcl::Vertices>& triangles = polygonMesh.polygons;
     const int numTriangles = triangles.size();
     mesh->reserveNumTriangles(numTriangles);
     for(int i=0; i < numTriangles; ++i){
-        const vector<uint32_t>& triangleVertices = triangles[i].vertices;
+        auto& triangleVertices = triangles[i].vertices;
         if(triangleVertices.size() == 3){
             mesh->addTriangle(triangleVertices[0], triangleVertices[1], triangleVertices[2]);
         }
@@ -103,6 +125,336 @@ SgMesh* cnoid::createSurfaceMesh(SgPointSet* pointSet)
 }
 
 
+namespace cnoid {
+
+class SurfaceMeshBuilderImpl
+{
+public:
+    Signal<void(SgMesh* mesh)> sigMeshAdded;
+    QueuedCaller meshDeliverer;
+
+    std::thread thread;
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+
+    // The following variables are guarded by the mutex
+    double voxelSize;
+    double searchRadius;
+    struct Scan {
+        SgVertexArray points;
+        Vector3 viewPoint;
+    };
+    vector<Scan> pendingScans;
+    bool isClearRequested;
+    bool isProcessing;
+    bool isTerminationRequested;
+
+    // The following variables are only accessed in the background thread
+    unordered_set<uint64_t> occupiedVoxels;
+    vector<Vector3f> points;
+    vector<Vector3f> normals;
+    unordered_map<uint64_t, vector<int>> neighborCells;
+    double neighborCellSize;
+
+    SurfaceMeshBuilderImpl();
+    ~SurfaceMeshBuilderImpl();
+    void addPoints(const SgVertexArray& points, const Vector3& viewPoint);
+    void buildMeshes();
+    void clearPoints();
+    SgMesh* buildMesh(const Scan& scan, double voxelSize, double searchRadius);
+};
+
+}
+
+
+namespace {
+
+uint64_t getVoxelKey(const Vector3f& p, double size)
+{
+    const uint64_t mask = (1 << 21) - 1;
+    const uint64_t x = static_cast<int64_t>(std::floor(p.x() / size)) & mask;
+    const uint64_t y = static_cast<int64_t>(std::floor(p.y() / size)) & mask;
+    const uint64_t z = static_cast<int64_t>(std::floor(p.z() / size)) & mask;
+    return (x << 42) | (y << 21) | z;
+}
+
+}
+
+
+SurfaceMeshBuilder::SurfaceMeshBuilder()
+{
+    impl = new SurfaceMeshBuilderImpl;
+}
+
+
+SurfaceMeshBuilderImpl::SurfaceMeshBuilderImpl()
+{
+    voxelSize = DefaultSearchRadius / 2.0;
+    searchRadius = DefaultSearchRadius;
+    isClearRequested = false;
+    isProcessing = false;
+    isTerminationRequested = false;
+    neighborCellSize = 0.0;
+}
+
+
+SurfaceMeshBuilder::~SurfaceMeshBuilder()
+{
+    delete impl;
+}
+
+
+SurfaceMeshBuilderImpl::~SurfaceMeshBuilderImpl()
+{
+    if(thread.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isTerminationRequested = true;
+        }
+        condition.notify_all();
+        thread.join();
+    }
+}
+
+
+void SurfaceMeshBuilder::setVoxelSize(double size)
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->voxelSize = size;
+}
+
+
+void SurfaceMeshBuilder::setSearchRadius(double radius)
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->searchRadius = radius;
+}
+
+
+SignalProxy<void(SgMesh* mesh)> SurfaceMeshBuilder::sigMeshAdded()
+{
+    return impl->sigMeshAdded;
+}
+
+
+void SurfaceMeshBuilder::addPoints(const SgVertexArray& points, const Vector3& viewPoint)
+{
+    impl->addPoints(points, viewPoint);
+}
+
+
+void SurfaceMeshBuilderImpl::addPoints(const SgVertexArray& points, const Vector3& viewPoint)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingScans.emplace_back();
+        Scan& scan = pendingScans.back();
+        scan.points = points;
+        scan.viewPoint = viewPoint;
+    }
+    if(!thread.joinable()){
+        thread = std::thread([this](){ buildMeshes(); });
+    }
+    condition.notify_all();
+}
+
+
+void SurfaceMeshBuilder::clear()
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->pendingScans.clear();
+    impl->isClearRequested = true;
+    impl->meshDeliverer.cancel();
+}
+
+
+bool SurfaceMeshBuilder::isBusy() const
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    return impl->isProcessing || !impl->pendingScans.empty();
+}
+
+
+void SurfaceMeshBuilderImpl::buildMeshes()
+{
+    while(true){
+        Scan scan;
+        double voxelSize;
+        double searchRadius;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            isProcessing = false;
+            while(!isTerminationRequested && !isClearRequested && pendingScans.empty()){
+                condition.wait(lock);
+            }
+            if(isTerminationRequested){
+                break;
+            }
+            if(isClearRequested){
+                clearPoints();
+                isClearRequested = false;
+                continue;
+            }
+            // The scans which have been added while the previous scan was processed are merged
+            scan = std::move(pendingScans.front());
+            for(size_t i=1; i < pendingScans.size(); ++i){
+                auto& scanPoints = pendingScans[i].points;
+                scan.points.reserve(scan.points.size() + scanPoints.size());
+                for(size_t j=0; j < scanPoints.size(); ++j){
+                    scan.points.push_back(scanPoints[j]);
+                }
+            }
+            pendingScans.clear();
+            voxelSize = this->voxelSize;
+            searchRadius = this->searchRadius;
+            isProcessing = true;
+        }
+        SgMeshPtr mesh = buildMesh(scan, voxelSize, searchRadius);
+        if(mesh){
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!isClearRequested){
+                meshDeliverer.callLater([this, mesh](){ sigMeshAdded(mesh.get()); });
+            }
+        }
+    }
+}
+
+
+void SurfaceMeshBuilderImpl::clearPoints()
+{
+    occupiedVoxels.clear();
+    points.clear();
+    normals.clear();
+    neighborCells.clear();
+}
+
+
+/**
+   The mesh of the new points is built with the points added before in their neighborhood so
+   that it is connected to the meshes built before. Only the triangles which have at least one
+   new point are included in the mesh.
+*/
+SgMesh* SurfaceMeshBuilderImpl::buildMesh(const Scan& scan, double voxelSize, double searchRadius)
+{
+    if(searchRadius != neighborCellSize){
+        neighborCells.clear();
+        neighborCellSize = searchRadius;
+        for(size_t i=0; i < points.size(); ++i){
+            neighborCells[getVoxelKey(points[i], neighborCellSize)].push_back(i);
+        }
+    }
+
+    const int numOldPoints = points.size();
+    vector<Vector3f> newPoints;
+    newPoints.reserve(scan.points.size());
+    for(size_t i=0; i < scan.points.size(); ++i){
+        const Vector3f& p = scan.points[i];
+        if(p.allFinite()){
+            if(voxelSize <= 0.0 || occupiedVoxels.insert(getVoxelKey(p, voxelSize)).second){
+                newPoints.push_back(p);
+            }
+        }
+    }
+    const int numNewPoints = newPoints.size();
+    if(numNewPoints == 0){
+        return nullptr;
+    }
+
+    // Collect the old points in the neighboring cells of the new points
+    vector<int> neighborPoints;
+    unordered_set<uint64_t> visitedCells;
+    for(auto& p : newPoints){
+        for(int x=-1; x <= 1; ++x){
+            for(int y=-1; y <= 1; ++y){
+                for(int z=-1; z <= 1; ++z){
+                    const Vector3f q = p + Vector3f(x, y, z) * static_cast<float>(neighborCellSize);
+                    const uint64_t key = getVoxelKey(q, neighborCellSize);
+                    if(visitedCells.insert(key).second){
+                        auto found = neighborCells.find(key);
+                        if(found != neighborCells.end()){
+                            neighborPoints.insert(neighborPoints.end(), found->second.begin(), found->second.end());
+                        }
+                    }
+                }
+            }
+        }
+    }
+    const int numLocalPoints = numNewPoints + neighborPoints.size();
+
+    PointCloud::Ptr cloud(new PointCloud(numLocalPoints, 1));
+    for(int i=0; i < numNewPoints; ++i){
+        const Vector3f& p = newPoints[i];
+        cloud->points[i] = pcl::PointXYZ(p.x(), p.y(), p.z());
+    }
+    for(size_t i=0; i < neighborPoints.size(); ++i){
+        const Vector3f& p = points[neighborPoints[i]];
+        cloud->points[numNewPoints + i] = pcl::PointXYZ(p.x(), p.y(), p.z());
+    }
+    pcl::IndicesPtr newPointIndices(new std::vector<int>(numNewPoints));
+    for(int i=0; i < numNewPoints; ++i){
+        (*newPointIndices)[i] = i;
+    }
+    pcl::PointCloud<pcl::Normal> newNormals;
+    estimateNormals(cloud, newPointIndices, scan.viewPoint, newNormals);
+
+    PointNormalCloud::Ptr cloudWithNormals(new PointNormalCloud(numLocalPoints, 1));
+    for(int i=0; i < numLocalPoints; ++i){
+        auto& point = cloudWithNormals->points[i];
+        const Vector3f p = Eigen::Map<const Vector3f>(cloud->points[i].data);
+        const Vector3f n = (i < numNewPoints) ?
+            Vector3f(Eigen::Map<const Vector3f>(newNormals.points[i].normal)) :
+            normals[neighborPoints[i - numNewPoints]];
+        point.x = p.x();
+        point.y = p.y();
+        point.z = p.z();
+        point.normal_x = n.x();
+        point.normal_y = n.y();
+        point.normal_z = n.z();
+    }
+
+    vector<pcl::Vertices> triangles;
+    triangulate(cloudWithNormals, searchRadius, triangles);
+
+    // The new points are stored even if they are not connected to any triangle
+    points.reserve(numOldPoints + numNewPoints);
+    normals.reserve(numOldPoints + numNewPoints);
+    for(int i=0; i < numNewPoints; ++i){
+        points.push_back(newPoints[i]);
+        normals.push_back(Eigen::Map<const Vector3f>(newNormals.points[i].normal));
+        neighborCells[getVoxelKey(newPoints[i], neighborCellSize)].push_back(numOldPoints + i);
+    }
+
+    SgMeshPtr mesh = new SgMesh;
+    auto& meshVertices = *mesh->getOrCreateVertices();
+    auto& meshNormals = *mesh->getOrCreateNormals();
+    vector<int> vertexIndexMap(numLocalPoints, -1);
+    for(auto& triangle : triangles){
+        auto& vertices = triangle.vertices;
+        if(vertices.size() == 3 &&
+           (static_cast<int>(vertices[0]) < numNewPoints ||
+            static_cast<int>(vertices[1]) < numNewPoints ||
+            static_cast<int>(vertices[2]) < numNewPoints)){
+            int indices[3];
+            for(int j=0; j < 3; ++j){
+                int& index = vertexIndexMap[vertices[j]];
+                if(index < 0){
+                    index = meshVertices.size();
+                    const auto& point = cloudWithNormals->points[vertices[j]];
+                    meshVertices.push_back(Vector3f(point.x, point.y, point.z));
+                    meshNormals.push_back(Vector3f(point.normal_x, point.normal_y, point.normal_z));
+                }
+                indices[j] = index;
+            }
+            mesh->addTriangle(indices[0], indices[1], indices[2]);
+        }
+    }
+    if(mesh->numTriangles() == 0){
+        return nullptr;
+    }
+    return mesh.retn();
+}
+
+
 boost::optional<double> cnoid::alignPointCloud
 (SgPointSet* target, SgPointSet* source, Affine3& io_T, double maxCorrespondenceDistance, int maxIterations, double epsilon)
 {
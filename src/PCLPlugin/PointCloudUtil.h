@@ -7,6 +7,7 @@
 #define CNOID_PCL_PLUGIN_POINT_CLOUD_UTIL_H
 
 #include <cnoid/SceneDrawables>
+#include <cnoid/Signal>
 #include <boost/optional.hpp>
 #include "exportdecl.h"
 
@@ -14,6 +15,41 @@ namespace cnoid {
 
 CNOID_EXPORT SgMesh* createSurfaceMesh(SgPointSet* pointSet);
 
+class SurfaceMeshBuilderImpl;
+
+/**
+   This class builds the surface mesh of a point cloud which grows with the scans of a range sensor.
+   The points are downsampled with a voxel grid and meshed in a background thread. The mesh of each
+   scan only covers the points newly added by the scan and is delivered by sigMeshAdded in the main
+   thread, so the meshes delivered so far together form the surface of the whole cloud.
+*/
+class CNOID_EXPORT SurfaceMeshBuilder
+{
+public:
+    SurfaceMeshBuilder();
+    ~SurfaceMeshBuilder();
+
+    //! The points closer than this size are merged. Zero disables the downsampling.
+    void setVoxelSize(double size);
+
+    //! The maximum edge length of the triangles
+    void setSearchRadius(double radius);
+
+    /**
+       The points must be given in a fixed coordinate frame.
+       \param viewPoint The position of the sensor, which the normals of the points face.
+    */
+    void addPoints(const SgVertexArray& points, const Vector3& viewPoint);
+
+    void clear();
+    bool isBusy() const;
+
+    SignalProxy<void(SgMesh* mesh)> sigMeshAdded();
+
+private:
+    SurfaceMeshBuilderImpl* impl;
+};
+
 CNOID_EXPORT boost::optional<double> alignPointCloud
 (SgPointSet* target, SgPointSet* source, Affine3& io_T,
  double maxCorrespondenceDistance, int maxIterations, double epsilon = 1.0e-8);
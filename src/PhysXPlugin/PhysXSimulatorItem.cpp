@@ -14,7 +14,9 @@
 #include <cnoid/Link>
 #include <cnoid/BasicSensorSimulationHelper>
 #include <cnoid/BodyItem>
+#include <cnoid/TimeMeasure>
 #include <boost/optional.hpp>
+#include <fmt/format.h>
 #include "gettext.h"
 #include <iostream>
 
@@ -33,9 +35,16 @@ using std::isfinite;
 #endif
 #endif
 
+#if PX_PHYSICS_VERSION_MAJOR > 3 || (PX_PHYSICS_VERSION_MAJOR == 3 && PX_PHYSICS_VERSION_MINOR >= 4)
+#if PX_SUPPORT_GPU_PHYSX
+#define ENABLE_GPU_RIGID_BODIES
+#endif
+#endif
+
 using namespace std;
 using namespace cnoid;
 using namespace physx;
+using fmt::format;
 
 namespace {
 
@@ -113,6 +122,9 @@ public:
 
     PxPhysics* pxPhysics;
     PxDefaultCpuDispatcher* pxDispatcher;
+#ifdef ENABLE_GPU_RIGID_BODIES
+    PxCudaContextManager* pxCudaContextManager;
+#endif
     PxScene* pxScene;
     PxMaterial* pxMaterial;
 
@@ -123,6 +135,13 @@ public:
     double dynamicFriction;
     double restitution;
     bool isJointLimitMode;
+    bool isGpuDynamicsEnabled;
+    bool isGpuBroadPhaseEnabled;
+
+    bool isProfilingEnabled;
+    TimeMeasure inputTimer;
+    TimeMeasure simulationTimer;
+    TimeMeasure outputTimer;
 
     PhysXSimulatorItemImpl(PhysXSimulatorItem* self);
     PhysXSimulatorItemImpl(PhysXSimulatorItem* self, const PhysXSimulatorItemImpl& org);
@@ -131,6 +150,7 @@ public:
     ~PhysXSimulatorItemImpl();
     void clear();
     bool initializeSimulation(const std::vector<SimulationBody*>& simBodies);
+    void setupGpuRigidBodies(PxSceneDesc& sceneDesc);
     bool stepSimulation(const std::vector<SimulationBody*>& activeSimBodies);
     void addBody(PhysXBody* physXBody);
     void doPutProperties(PutPropertyFunction& putProperty);
@@ -912,6 +932,8 @@ PhysXSimulatorItemImpl::PhysXSimulatorItemImpl(PhysXSimulatorItem* self)
     staticFriction = 0.5;
     dynamicFriction = 0.5;
     restitution = 0.1;
+    isGpuDynamicsEnabled = false;
+    isGpuBroadPhaseEnabled = false;
 
 }
 
@@ -935,6 +957,8 @@ PhysXSimulatorItemImpl::PhysXSimulatorItemImpl(PhysXSimulatorItem* self, const P
     dynamicFriction = org.dynamicFriction;
     restitution = org.restitution;
     isJointLimitMode = org.isJointLimitMode;
+    isGpuDynamicsEnabled = org.isGpuDynamicsEnabled;
+    isGpuBroadPhaseEnabled = org.isGpuBroadPhaseEnabled;
 
 }
 
@@ -965,7 +989,11 @@ void PhysXSimulatorItemImpl::initialize()
 
     pxScene = 0;
     pxDispatcher = 0;
+#ifdef ENABLE_GPU_RIGID_BODIES
+    pxCudaContextManager = 0;
+#endif
     pxMaterial = 0;
+    isProfilingEnabled = false;
 }
 
 
@@ -1026,6 +1054,13 @@ void PhysXSimulatorItemImpl::clear()
         pxDispatcher->release();
         pxDispatcher = 0;
     }
+#ifdef ENABLE_GPU_RIGID_BODIES
+    // The CUDA context must be released after the scene using it
+    if(pxCudaContextManager){
+        pxCudaContextManager->release();
+        pxCudaContextManager = 0;
+    }
+#endif
 
 }    
 
@@ -1061,6 +1096,8 @@ bool PhysXSimulatorItemImpl::initializeSimulation(const std::vector<SimulationBo
     sceneDesc.contactModifyCallback = this;
     if(DEBUG_COLLISION)
         sceneDesc.simulationEventCallback = this;
+    if(isGpuDynamicsEnabled || isGpuBroadPhaseEnabled)
+        setupGpuRigidBodies(sceneDesc);
 
     pxScene = pxPhysics->createScene(sceneDesc);
     if (!pxScene)
@@ -1071,6 +1108,7 @@ bool PhysXSimulatorItemImpl::initializeSimulation(const std::vector<SimulationBo
 
 
     timeStep = self->worldTimeStep();
+    isProfilingEnabled = self->isProfilingEnabled();
 
     for(size_t i=0; i < simBodies.size(); ++i){
         addBody(static_cast<PhysXBody*>(simBodies[i]));
@@ -1080,6 +1118,37 @@ bool PhysXSimulatorItemImpl::initializeSimulation(const std::vector<SimulationBo
 }
 
 
+/**
+   The scene falls back to the CPU pipeline when the CUDA context is not available.
+*/
+void PhysXSimulatorItemImpl::setupGpuRigidBodies(PxSceneDesc& sceneDesc)
+{
+#ifdef ENABLE_GPU_RIGID_BODIES
+    PxCudaContextManagerDesc cudaContextManagerDesc;
+    pxCudaContextManager = PxCreateCudaContextManager(*pxFoundation, cudaContextManagerDesc);
+    if(pxCudaContextManager && !pxCudaContextManager->contextIsValid()){
+        pxCudaContextManager->release();
+        pxCudaContextManager = 0;
+    }
+    if(!pxCudaContextManager){
+        mv->putln(format(_("{}: CUDA is not available. The simulation is done on the CPU."), self->name()));
+        return;
+    }
+    sceneDesc.gpuDispatcher = pxCudaContextManager->getGpuDispatcher();
+    if(isGpuDynamicsEnabled){
+        // The GPU dynamics requires the persistent contact manifold
+        sceneDesc.flags |= PxSceneFlag::eENABLE_GPU_DYNAMICS;
+        sceneDesc.flags |= PxSceneFlag::eENABLE_PCM;
+    }
+    if(isGpuBroadPhaseEnabled){
+        sceneDesc.broadPhaseType = PxBroadPhaseType::eGPU;
+    }
+#else
+    mv->putln(format(_("{}: This PhysX build does not support the GPU rigid bodies. The simulation is done on the CPU."), self->name()));
+#endif
+}
+
+
 void PhysXSimulatorItemImpl::addBody(PhysXBody* physXBody)
 {
     Body& body = *physXBody->body();
@@ -1180,15 +1249,20 @@ bool PhysXSimulatorItem::stepSimulation(const std::vector<SimulationBody*>& acti
 
 bool PhysXSimulatorItemImpl::stepSimulation(const std::vector<SimulationBody*>& activeSimBodies)
 {
+    if(isProfilingEnabled) inputTimer.begin();
     for(size_t i=0; i < activeSimBodies.size(); ++i){
         PhysXBody* physXBody = static_cast<PhysXBody*>(activeSimBodies[i]);
         physXBody->body()->setVirtualJointForces();
         physXBody->setControlValToPhysX();
     }
+    if(isProfilingEnabled) inputTimer.end();
 
+    if(isProfilingEnabled) simulationTimer.begin();
     pxScene->simulate(timeStep);
     pxScene->fetchResults(true);
+    if(isProfilingEnabled) simulationTimer.end();
 
+    if(isProfilingEnabled) outputTimer.begin();
     for(size_t i=0; i < activeSimBodies.size(); ++i){
         PhysXBody* physXBody = static_cast<PhysXBody*>(activeSimBodies[i]);
 
@@ -1202,11 +1276,28 @@ bool PhysXSimulatorItemImpl::stepSimulation(const std::vector<SimulationBody*>&
             physXBody->sensorHelper.updateGyroAndAccelerationSensors();
         }
     }
+    if(isProfilingEnabled) outputTimer.end();
 
     return true;
 }
 
 
+void PhysXSimulatorItem::getProfilingNames(vector<string>& profilingNames)
+{
+    profilingNames.push_back("Control input time");
+    profilingNames.push_back("PhysX simulation time");
+    profilingNames.push_back("State output time");
+}
+
+
+void PhysXSimulatorItem::getProfilingTimes(vector<double>& profilingTimes)
+{
+    profilingTimes.push_back(impl->inputTimer.time());
+    profilingTimes.push_back(impl->simulationTimer.time());
+    profilingTimes.push_back(impl->outputTimer.time());
+}
+
+
 void PhysXSimulatorItem::doPutProperties(PutPropertyFunction& putProperty)
 {
     SimulatorItem::doPutProperties(putProperty);
@@ -1227,6 +1318,10 @@ void PhysXSimulatorItemImpl::doPutProperties(PutPropertyFunction& putProperty)
 
     putProperty(_("Limit joint range"), isJointLimitMode, changeProperty(isJointLimitMode));
 
+    putProperty(_("GPU dynamics"), isGpuDynamicsEnabled, changeProperty(isGpuDynamicsEnabled));
+
+    putProperty(_("GPU broad phase"), isGpuBroadPhaseEnabled, changeProperty(isGpuBroadPhaseEnabled));
+
 }
 
 
@@ -1244,6 +1339,8 @@ void PhysXSimulatorItemImpl::store(Archive& archive)
     archive.write("dynamicFriction", dynamicFriction);
     archive.write("Restitution", restitution);
     archive.write("jointLimitMode", isJointLimitMode);
+    archive.write("gpuDynamics", isGpuDynamicsEnabled);
+    archive.write("gpuBroadPhase", isGpuBroadPhaseEnabled);
 }
 
 
@@ -1263,4 +1360,6 @@ void PhysXSimulatorItemImpl::restore(const Archive& archive)
     archive.read("dynamicFriction", dynamicFriction);
     archive.read("Restitution", restitution);
     archive.read("jointLimitMode", isJointLimitMode);
+    archive.read("gpuDynamics", isGpuDynamicsEnabled);
+    archive.read("gpuBroadPhase", isGpuBroadPhaseEnabled);
 }
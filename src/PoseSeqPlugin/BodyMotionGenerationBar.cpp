@@ -21,6 +21,7 @@
 #include <cnoid/CheckBox>
 #include <cnoid/Dialog>
 #include <QDialogButtonBox>
+#include <QProgressDialog>
 #include <set>
 #include "gettext.h"
 
@@ -525,7 +526,22 @@ bool BodyMotionGenerationBar::shapeBodyMotionWithSimpleInterpolation
     auto motion = motionItem->motion();
     motion->setFrameRate(timeBar->frameRate());
 
+    QProgressDialog progress(
+        _("Generating the body motion..."), _("Cancel"), 0, 100, MainWindow::instance());
+    progress.setWindowTitle(_("Body Motion Generation"));
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(500);
+    poseProviderToBodyMotionConverter->setProgressCallback(
+        [&](int numConvertedFrames, int numFrames){
+            progress.setMaximum(numFrames);
+            progress.setValue(numConvertedFrames);
+            return !progress.wasCanceled();
+        });
+
     bool result = poseProviderToBodyMotionConverter->convert(body, provider, *motion);
+
+    poseProviderToBodyMotionConverter->setProgressCallback(nullptr);
+    progress.reset();
     
     if(result){
         motionItem->notifyUpdate();
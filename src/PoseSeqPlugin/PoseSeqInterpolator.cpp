@@ -156,6 +156,7 @@ struct JointSample
         c[0].y = pose->jointPosition(jointId);
         c[0].yp = 0.0;
         isEndPoint = pose->isJointStationaryPoint(jointId);
+        isTransition = false;
     }
 
     SegmentType segmentType;
@@ -164,6 +165,7 @@ struct JointSample
     Coeff c[1];
     bool isEndPoint;
     bool isDirty;
+    bool isTransition; // inserted for the max transition time of the next pose
 
     typedef std::list<JointSample> Seq;
 };
@@ -257,12 +259,19 @@ class PSIImpl
 public:
 
     PSIImpl(PoseSeqInterpolator* self);
+    ~PSIImpl();
+    void copySettings(const PSIImpl& org);
 
     PoseSeqInterpolator* self;
     BodyPtr body;
     PoseSeqPtr poseSeq;
 
     bool needUpdate;
+    bool needFullUpdate;
+
+    // The time range of the poses modified since the last update
+    double modifiedTimeMin;
+    double modifiedTimeMax;
 
     ConnectionSet poseSeqConnections;
 
@@ -373,10 +382,16 @@ public:
 
     void adjustZmpAndFootKeyPoses();
     void insertAuxKeyPosesForStealthySteps();
+    void requestFullUpdate();
+    void addModifiedTime(double time);
     bool update();
+    void insertJointSample(
+        JointInfo& info, JointSample::Seq::iterator pos, PoseSeq::iterator poseIter, Pose* pose, int jointId);
+    void updateJointSamplesLocally(int jointId);
     LinkInfo* getIkLinkInfo(int linkIndex);
     void onPoseInserted(PoseSeq::iterator it);
     void onPoseRemoving(PoseSeq::iterator it, bool isMoving);
+    void onPoseModifying(PoseSeq::iterator it);
     void onPoseModified(PoseSeq::iterator it);
 };
 }
@@ -542,15 +557,22 @@ updateCubicSplineSegment(typename SampleType::Seq::iterator s, typename SampleTy
 
 /**
    pre-determined velocity version
+   @param s The first sample to process
+   @param end The sample next to the last sample to process
 */
 template <int dim, class SampleType>
-void usePredeterminedVelocities(typename SampleType::Seq& samples)
+void usePredeterminedVelocities
+(typename SampleType::Seq& samples, typename SampleType::Seq::iterator s, typename SampleType::Seq::iterator end)
 {
-    typename SampleType::Seq::iterator s = samples.begin();
-
-    typename SampleType::Seq::iterator prev = s;
+    typename SampleType::Seq::iterator prev = samples.begin();
+    for(typename SampleType::Seq::iterator p = s; p != samples.begin(); ){
+        if((--p)->segmentType != INVALID){
+            prev = p;
+            break;
+        }
+    }
 
-    while(s != samples.end()){
+    while(s != end){
 
         if(s->segmentType != INVALID){
             typename SampleType::Seq::iterator next = s; ++next;
@@ -598,18 +620,22 @@ void usePredeterminedVelocities(typename SampleType::Seq& samples)
 }
     
 
+/**
+   @param s The first sample to interpolate
+   @param end The sample next to the last sample to interpolate.
+   The segments starting from the samples in this range are updated.
+*/
 template <int dim, class SampleType, bool useJerkMinModel>
-void initializeInterpolation(typename SampleType::Seq& samples)
+void initializeInterpolation
+(typename SampleType::Seq& samples, typename SampleType::Seq::iterator s, typename SampleType::Seq::iterator end)
 {
     if(TRACE_FUNCTIONS){
         cout << "initializeInterpolation" << endl;
     }
 
-    usePredeterminedVelocities<dim, SampleType>(samples);
+    usePredeterminedVelocities<dim, SampleType>(samples, s, end);
         
-    typename SampleType::Seq::iterator s = samples.begin();
-
-    while(s != samples.end()){
+    while(s != end){
 
         if(s->segmentType == INVALID){
             ++s;
@@ -634,6 +660,13 @@ void initializeInterpolation(typename SampleType::Seq& samples)
 }
 
 
+template <int dim, class SampleType, bool useJerkMinModel>
+void initializeInterpolation(typename SampleType::Seq& samples)
+{
+    initializeInterpolation<dim, SampleType, useJerkMinModel>(samples, samples.begin(), samples.end());
+}
+
+
 template <int dim, class SampleType>
 bool interpolate(
     typename SampleType::Seq& samples, typename SampleType::Seq::iterator& p, double x, double* out_result)
@@ -790,6 +823,12 @@ PoseSeqInterpolator::PoseSeqInterpolator()
 }
 
 
+PoseSeqInterpolator::~PoseSeqInterpolator()
+{
+    delete impl;
+}
+
+
 PSIImpl::PSIImpl(PoseSeqInterpolator* self)
     : self(self)
 {
@@ -801,11 +840,66 @@ PSIImpl::PSIImpl(PoseSeqInterpolator* self)
     zmpMaxDistanceFromCenterSqr = 0.015 * 0.015;
 
     isStealthyStepMode = false;
+    stealthyHeightRatioThresh = 0.0;
+    flatLiftingHeight = 0.0;
+    flatLandingHeight = 0.0;
+    impactReductionHeight = 0.0;
+    impactReductionTime = 0.0;
     setStealthyStepParameters(2.0, 0.005, 0.005, 0.012, 0.3);
 
     isLipSyncMixEnabled = false;
     
-    needUpdate = true;
+    requestFullUpdate();
+}
+
+
+PSIImpl::~PSIImpl()
+{
+    poseSeqConnections.disconnect();
+}
+
+
+PoseProvider* PoseSeqInterpolator::clone() const
+{
+    auto interpolator = new PoseSeqInterpolator;
+    interpolator->impl->copySettings(*impl);
+    return interpolator;
+}
+
+
+void PSIImpl::copySettings(const PSIImpl& org)
+{
+    setBody(org.body);
+    for(size_t i=0; i < jointInfos.size(); ++i){
+        jointInfos[i].useLinearInterpolation = org.jointInfos[i].useLinearInterpolation;
+    }
+    footLinkIndices = org.footLinkIndices;
+    soleCenters = org.soleCenters;
+
+    isLipSyncMixEnabled = org.isLipSyncMixEnabled;
+    lipSyncJoints = org.lipSyncJoints;
+    lipSyncLinkIndices = org.lipSyncLinkIndices;
+    lipSyncShapes = org.lipSyncShapes;
+    lipSyncMaxTransitionTime = org.lipSyncMaxTransitionTime;
+
+    isAutoZmpAdjustmentMode = org.isAutoZmpAdjustmentMode;
+    minZmpTransitionTime = org.minZmpTransitionTime;
+    zmpCenteringTimeThresh = org.zmpCenteringTimeThresh;
+    zmpTimeMarginBeforeLifting = org.zmpTimeMarginBeforeLifting;
+    zmpMaxDistanceFromCenterSqr = org.zmpMaxDistanceFromCenterSqr;
+
+    isStealthyStepMode = org.isStealthyStepMode;
+    setStealthyStepParameters(
+        org.stealthyHeightRatioThresh, org.flatLiftingHeight, org.flatLandingHeight,
+        org.impactReductionHeight, org.impactReductionTime);
+
+    timeScaleRatio = org.timeScaleRatio;
+
+    // The signals of the sequence are not connected
+    poseSeq = org.poseSeq;
+
+    invalidateCurrentInterpolation();
+    requestFullUpdate();
 }
 
 
@@ -834,7 +928,7 @@ void PSIImpl::setBody(Body* body0)
         validIkLinkFlag.resize(body->numLinks());
         invalidateCurrentInterpolation();
     }
-    needUpdate = true;
+    requestFullUpdate();
 }
 
 
@@ -854,6 +948,7 @@ void PSIImpl::setLinearInterpolationJoint(int jointId)
 {
     if(jointId < (int)jointInfos.size()){
         jointInfos[jointId].useLinearInterpolation = true;
+        requestFullUpdate();
     }
 }
 
@@ -868,7 +963,7 @@ void PSIImpl::addFootLink(int linkIndex, const Vector3& soleCenter)
 {
     footLinkIndices.push_back(linkIndex);
     soleCenters.push_back(soleCenter);
-    needUpdate = true;
+    requestFullUpdate();
 }
 
 
@@ -877,7 +972,7 @@ void PSIImpl::clearLipSyncShapes()
     lipSyncJoints.clear();
     lipSyncLinkIndices.clear();
     lipSyncSeq.clear();
-    needUpdate = true;
+    requestFullUpdate();
 }
 
 
@@ -892,7 +987,7 @@ void PoseSeqInterpolator::setLipSyncShapes(const Mapping& info)
 */
 void PSIImpl::setLipSyncShapes(const Mapping& info)
 {
-    needUpdate = true;
+    requestFullUpdate();
 
     clearLipSyncShapes();
     
@@ -984,10 +1079,11 @@ void PSIImpl::setPoseSeq(PoseSeqPtr seq)
     poseSeqConnections = seq->connectSignalSet(
         std::bind(&PSIImpl::onPoseInserted, this, _1),
         std::bind(&PSIImpl::onPoseRemoving, this, _1, _2),
+        std::bind(&PSIImpl::onPoseModifying, this, _1),
         std::bind(&PSIImpl::onPoseModified, this, _1));
     
     invalidateCurrentInterpolation();
-    needUpdate = true;
+    requestFullUpdate();
 }
 
 
@@ -1015,26 +1111,36 @@ double PoseSeqInterpolator::endingTime() const
 
 void PoseSeqInterpolator::enableAutoZmpAdjustmentMode(bool on)
 {
-    impl->isAutoZmpAdjustmentMode = on;
-    impl->needUpdate = true;
+    if(on != impl->isAutoZmpAdjustmentMode){
+        impl->isAutoZmpAdjustmentMode = on;
+        impl->requestFullUpdate();
+    }
 }
 
 
 void PoseSeqInterpolator::setZmpAdjustmentParameters
 (double minTransitionTime, double centeringTimeThresh, double timeMarginBeforeLifting, double maxDistanceFromCenter)
 {
-    impl->minZmpTransitionTime = minTransitionTime;
-    impl->zmpCenteringTimeThresh = centeringTimeThresh;
-    impl->zmpTimeMarginBeforeLifting = timeMarginBeforeLifting;
-    impl->zmpMaxDistanceFromCenterSqr = maxDistanceFromCenter * maxDistanceFromCenter;
-    impl->needUpdate = true;
+    const double maxDistanceFromCenterSqr = maxDistanceFromCenter * maxDistanceFromCenter;
+    if(minTransitionTime != impl->minZmpTransitionTime ||
+       centeringTimeThresh != impl->zmpCenteringTimeThresh ||
+       timeMarginBeforeLifting != impl->zmpTimeMarginBeforeLifting ||
+       maxDistanceFromCenterSqr != impl->zmpMaxDistanceFromCenterSqr){
+        impl->minZmpTransitionTime = minTransitionTime;
+        impl->zmpCenteringTimeThresh = centeringTimeThresh;
+        impl->zmpTimeMarginBeforeLifting = timeMarginBeforeLifting;
+        impl->zmpMaxDistanceFromCenterSqr = maxDistanceFromCenterSqr;
+        impl->requestFullUpdate();
+    }
 }
 
 
 void PoseSeqInterpolator::enableStealthyStepMode(bool on)
 {
-    impl->isStealthyStepMode = on;
-    impl->needUpdate = true;
+    if(on != impl->isStealthyStepMode){
+        impl->isStealthyStepMode = on;
+        impl->requestFullUpdate();
+    }
 }
 
 
@@ -1054,14 +1160,21 @@ void PSIImpl::setStealthyStepParameters
  double flatLiftingHeight, double flatLandingHeight,
  double impactReductionHeight, double impactReductionTime)
 {
-    this->stealthyHeightRatioThresh = heightRatioThresh;
-    this->flatLiftingHeight = flatLiftingHeight;
-    this->flatLandingHeight = flatLandingHeight;
-    this->impactReductionHeight = impactReductionHeight;
-    this->impactReductionTime = impactReductionTime;
-    this->impactReductionVelocity = -2.0 * impactReductionHeight / impactReductionTime;
+    if(heightRatioThresh != this->stealthyHeightRatioThresh ||
+       flatLiftingHeight != this->flatLiftingHeight ||
+       flatLandingHeight != this->flatLandingHeight ||
+       impactReductionHeight != this->impactReductionHeight ||
+       impactReductionTime != this->impactReductionTime){
 
-    needUpdate = true;
+        this->stealthyHeightRatioThresh = heightRatioThresh;
+        this->flatLiftingHeight = flatLiftingHeight;
+        this->flatLandingHeight = flatLandingHeight;
+        this->impactReductionHeight = impactReductionHeight;
+        this->impactReductionTime = impactReductionTime;
+        this->impactReductionVelocity = -2.0 * impactReductionHeight / impactReductionTime;
+
+        requestFullUpdate();
+    }
 }
 
 
@@ -1508,14 +1621,44 @@ boost::optional<Vector3> PoseSeqInterpolator::ZMP() const
 }
 
 
+void PSIImpl::requestFullUpdate()
+{
+    needUpdate = true;
+    needFullUpdate = true;
+}
+
+
+void PSIImpl::addModifiedTime(double time)
+{
+    if(!needUpdate){
+        modifiedTimeMin = time;
+        modifiedTimeMax = time;
+        needUpdate = true;
+    } else if(!needFullUpdate){
+        modifiedTimeMin = std::min(modifiedTimeMin, time);
+        modifiedTimeMax = std::max(modifiedTimeMax, time);
+    }
+}
+
+
 bool PSIImpl::update()
 {
     if(!body || !poseSeq){
         return false;
     }
-    
-    for(size_t i=0; i < jointInfos.size(); ++i){
-        jointInfos[i].clear();
+
+    /*
+      When only the poses notified by the signals of the pose sequence have been modified,
+      the joint samples are only updated around the modified poses. The samples of the IK links,
+      ZMP and lip sync are always regenerated because the ZMP adjustment and the stealthy step
+      insert auxiliary samples over the support phases.
+    */
+    const bool doUpdateJointsLocally = needUpdate && !needFullUpdate;
+
+    if(!doUpdateJointsLocally){
+        for(size_t i=0; i < jointInfos.size(); ++i){
+            jointInfos[i].clear();
+        }
     }
     ikLinkInfos.clear();
     zmpSamples.clear();
@@ -1545,24 +1688,13 @@ bool PSIImpl::update()
         } else {
             appendLinkSamples(poseIter, pose);
 
-            const int n = std::min(pose->numJoints(), (int)jointInfos.size());
-
-            for(int i=0; i < n; ++i){
-                JointInfo& jointInfo = jointInfos[i];
-                if(pose->isJointValid(i)){
-
-                    // make a flipping point stationary point
-                    double q = pose->jointPosition(i);
-                    double sign = q - jointInfo.prev_q;
-                    if(jointInfo.prevSegmentDirectionSign * sign <= 0.0){
-                        if(!jointInfo.samples.empty()){
-                            jointInfo.samples.back().isEndPoint = true;
-                        }
+            if(!doUpdateJointsLocally){
+                const int n = std::min(pose->numJoints(), (int)jointInfos.size());
+                for(int i=0; i < n; ++i){
+                    if(pose->isJointValid(i)){
+                        JointInfo& jointInfo = jointInfos[i];
+                        insertJointSample(jointInfo, jointInfo.samples.end(), poseIter, pose, i);
                     }
-                    jointInfo.prevSegmentDirectionSign = sign;
-                    jointInfo.prev_q = q;
-
-                    appendSample(jointInfo.samples, JointSample(poseIter, i, jointInfo.useLinearInterpolation));
                 }
             }
             if(pose->isZmpValid()){
@@ -1585,7 +1717,9 @@ bool PSIImpl::update()
         if(TRACE_FUNCTIONS){
             cout << "PSIImpl::update: joint " << i << endl;
         }
-        if(!info.useLinearInterpolation){
+        if(doUpdateJointsLocally){
+            updateJointSamplesLocally(i);
+        } else if(!info.useLinearInterpolation){
             initializeInterpolation<1, JointSample, false>(info.samples);
         }
         info.iter = info.samples.begin();
@@ -1606,6 +1740,7 @@ bool PSIImpl::update()
 
     invalidateCurrentInterpolation();
     needUpdate = false;
+    needFullUpdate = false;
 
     sigUpdated();
 
@@ -1613,6 +1748,117 @@ bool PSIImpl::update()
 }
 
 
+/**
+   Inserts the sample of a joint in a pose before pos, making a flipping point a stationary point
+   and inserting the sample for the max transition time of the pose.
+   The direction of the previous segment is given by info.prev_q and info.prevSegmentDirectionSign.
+*/
+void PSIImpl::insertJointSample
+(JointInfo& info, JointSample::Seq::iterator pos, PoseSeq::iterator poseIter, Pose* pose, int jointId)
+{
+    JointSample::Seq& samples = info.samples;
+    
+    // make a flipping point stationary point
+    double q = pose->jointPosition(jointId);
+    double sign = q - info.prev_q;
+    if(info.prevSegmentDirectionSign * sign <= 0.0){
+        if(pos != samples.begin()){
+            std::prev(pos)->isEndPoint = true;
+        }
+    }
+    info.prevSegmentDirectionSign = sign;
+    info.prev_q = q;
+
+    if(pos != samples.begin()){
+        JointSample::Seq::iterator prev = std::prev(pos);
+        const double time = poseIter->time();
+        const double ttime = poseIter->maxTransitionTime();
+        if(ttime > 0.0 && time - prev->x > ttime){
+            prev->isEndPoint = true;
+            JointSample::Seq::iterator transition = samples.insert(pos, *prev);
+            transition->x = time - ttime;
+            transition->c[0].yp = 0.0;
+            transition->isEndPoint = true;
+            transition->isTransition = true;
+        }
+    }
+
+    samples.insert(pos, JointSample(poseIter, jointId, info.useLinearInterpolation));
+}
+
+
+/**
+   The velocity and the end point flag of a sample are determined by the adjacent samples,
+   so the samples from the second last pose before the modified time range to the first pose
+   after the range are regenerated and the others are kept.
+*/
+void PSIImpl::updateJointSamplesLocally(int jointId)
+{
+    JointInfo& info = jointInfos[jointId];
+    JointSample::Seq& samples = info.samples;
+    const JointSample::Seq::iterator end = samples.end();
+
+    // The last three pose samples before the modified range
+    JointSample::Seq::iterator prev[3] = { end, end, end };
+    JointSample::Seq::iterator s = samples.begin();
+    while(s != end && s->x < modifiedTimeMin){
+        if(!s->isTransition){
+            prev[2] = prev[1];
+            prev[1] = prev[0];
+            prev[0] = s;
+        }
+        ++s;
+    }
+    // The first pose sample after the modified range
+    while(s != end && (s->isTransition || s->x <= modifiedTimeMax)){
+        ++s;
+    }
+
+    const JointSample::Seq::iterator first = prev[1]; // kept
+    const JointSample::Seq::iterator last = s; // regenerated
+    
+    PoseSeq::iterator poseIter;
+    if(first == end){
+        poseIter = poseSeq->begin();
+        info.prev_q = 0.0;
+        info.prevSegmentDirectionSign = 0.0;
+    } else {
+        poseIter = std::next(first->poseIter);
+        info.prev_q = first->c[0].y;
+        info.prevSegmentDirectionSign = first->c[0].y - ((prev[2] != end) ? prev[2]->c[0].y : 0.0);
+    }
+    const PoseSeq::iterator poseEnd = (last == end) ? poseSeq->end() : std::next(last->poseIter);
+    const JointSample::Seq::iterator pos = (last == end) ? end : std::next(last);
+    
+    samples.erase((first == end) ? samples.begin() : std::next(first), pos);
+
+    for( ; poseIter != poseEnd; ++poseIter){
+        Pose* pose = dynamic_cast<Pose*>(poseIter->poseUnit().get());
+        if(pose && jointId < pose->numJoints() && pose->isJointValid(jointId)){
+            insertJointSample(info, pos, poseIter, pose, jointId);
+        }
+    }
+
+    // Apply the process done for the next pose to the last regenerated sample
+    if(pos != end && pos != samples.begin()){
+        JointSample::Seq::iterator next = pos;
+        if(next->isTransition){
+            std::prev(pos)->isEndPoint = true;
+            ++next;
+        }
+        double sign = next->c[0].y - info.prev_q;
+        if(info.prevSegmentDirectionSign * sign <= 0.0){
+            std::prev(pos)->isEndPoint = true;
+        }
+    }
+
+    if(!info.useLinearInterpolation){
+        initializeInterpolation<1, JointSample, false>(
+            samples, (first == end) ? samples.begin() : first, pos);
+    }
+}
+
+
 void PSIImpl::appendLinkSamples(PoseSeq::iterator poseIter, PosePtr& pose)
 {
     for(Pose::LinkInfoMap::iterator it = pose->ikLinkBegin(); it != pose->ikLinkEnd(); ++it){
@@ -2195,17 +2441,33 @@ LinkInfo* PSIImpl::getIkLinkInfo(int linkIndex)
 
 void PSIImpl::onPoseInserted(PoseSeq::iterator it)
 {
-    needUpdate = true;
+    addModifiedTime(it->time());
 }
 
 
 void PSIImpl::onPoseRemoving(PoseSeq::iterator it, bool isMoving)
 {
-    needUpdate = true;
+    addModifiedTime(it->time());
+}
+
+
+void PSIImpl::onPoseModifying(PoseSeq::iterator it)
+{
+    addModifiedTime(it->time());
 }
 
 
 void PSIImpl::onPoseModified(PoseSeq::iterator it)
 {
-    needUpdate = true;
+    addModifiedTime(it->time());
+
+    // A named pose unit may be shared by other references
+    if(!it->name().empty() && !needFullUpdate){
+        PoseUnitPtr unit = it->poseUnit();
+        for(PoseSeq::iterator p = poseSeq->begin(); p != poseSeq->end(); ++p){
+            if(p != it && p->poseUnit() == unit){
+                addModifiedTime(p->time());
+            }
+        }
+    }
 }
@@ -21,6 +21,7 @@ class CNOID_EXPORT PoseSeqInterpolator : public PoseProvider
 {
 public:
     PoseSeqInterpolator();
+    ~PoseSeqInterpolator();
 
     void setBody(Body* body);
     Body* body() const;
@@ -78,6 +79,12 @@ public:
 
     virtual void getJointPositions(std::vector< boost::optional<double> >& out_q) const;
 
+    /**
+       The copy has the same body and settings and refers to the same pose sequence,
+       but it is not updated by the modifications of the sequence.
+    */
+    virtual PoseProvider* clone() const;
+
 private:
 
     PSIImpl* impl;
@@ -0,0 +1,271 @@
+/**
+   \file
+*/
+
+#include "RobotAccessWorker.h"
+#include <cnoid/LazyCaller>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+}
+
+namespace cnoid {
+
+class RobotAccessWorkerImpl : public std::enable_shared_from_this<RobotAccessWorkerImpl>
+{
+public:
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable idleCondition;
+    bool isExitRequested;
+
+    std::deque<std::function<void()>> requests;
+    bool isProcessingRequest;
+
+    std::function<ReferencedPtr()> pollFunction;
+    std::function<void(Referenced* state)> applyFunction;
+    Clock::duration pollingInterval;
+    Clock::time_point nextPollingTime;
+    bool isPolling;
+    bool isPollingInProgress;
+
+    // Incremented when the polling is stopped to discard the states of the previous polling
+    int pollingId;
+    
+    ReferencedPtr latestState;
+    int latestStateId;
+    bool isApplyPending;
+
+    RobotAccessWorkerImpl();
+    ~RobotAccessWorkerImpl();
+    void startThreadIfNecessary();
+    void run();
+    void postState(ReferencedPtr state, int id);
+    void applyLatestState();
+};
+
+}
+
+
+RobotAccessWorker::RobotAccessWorker()
+    : impl(std::make_shared<RobotAccessWorkerImpl>())
+{
+
+}
+
+
+RobotAccessWorkerImpl::RobotAccessWorkerImpl()
+{
+    isExitRequested = false;
+    isProcessingRequest = false;
+    isPolling = false;
+    isPollingInProgress = false;
+    pollingId = 0;
+    latestStateId = 0;
+    isApplyPending = false;
+}
+
+
+RobotAccessWorker::~RobotAccessWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->isExitRequested = true;
+    }
+    impl->condition.notify_all();
+    if(impl->thread.joinable()){
+        impl->thread.join();
+    }
+}
+
+
+RobotAccessWorkerImpl::~RobotAccessWorkerImpl()
+{
+
+}
+
+
+void RobotAccessWorkerImpl::startThreadIfNecessary()
+{
+    if(!thread.joinable()){
+        thread = std::thread([this](){ run(); });
+    }
+}
+
+
+void RobotAccessWorker::request(std::function<void()> function, std::function<void()> callback)
+{
+    std::weak_ptr<RobotAccessWorkerImpl> weakImpl = impl;
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->requests.push_back(
+            [function, callback, weakImpl](){
+                function();
+                if(callback){
+                    callLater([callback, weakImpl](){
+                            if(weakImpl.lock()){
+                                callback();
+                            }
+                        });
+                }
+            });
+        impl->startThreadIfNecessary();
+    }
+    impl->condition.notify_all();
+}
+
+
+void RobotAccessWorker::startPolling
+(std::function<ReferencedPtr()> poll, std::function<void(Referenced* state)> apply, double interval)
+{
+    stopPolling();
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->pollFunction = poll;
+        impl->applyFunction = apply;
+        impl->pollingInterval =
+            std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval));
+        impl->nextPollingTime = Clock::now();
+        impl->isPolling = true;
+        impl->startThreadIfNecessary();
+    }
+    impl->condition.notify_all();
+}
+
+
+void RobotAccessWorker::setPollingInterval(double interval)
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    auto newInterval =
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval));
+    impl->nextPollingTime += newInterval - impl->pollingInterval;
+    impl->pollingInterval = newInterval;
+    impl->condition.notify_all();
+}
+
+
+void RobotAccessWorker::stopPolling()
+{
+    std::unique_lock<std::mutex> lock(impl->mutex);
+    impl->isPolling = false;
+    ++impl->pollingId;
+    impl->idleCondition.wait(lock, [&](){ return !impl->isPollingInProgress; });
+    impl->latestState.reset();
+    impl->pollFunction = nullptr;
+    impl->applyFunction = nullptr;
+}
+
+
+bool RobotAccessWorker::isPolling() const
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    return impl->isPolling;
+}
+
+
+void RobotAccessWorker::waitForRequests()
+{
+    std::unique_lock<std::mutex> lock(impl->mutex);
+    impl->idleCondition.wait(
+        lock, [&](){ return impl->requests.empty() && !impl->isProcessingRequest; });
+}
+
+
+void RobotAccessWorkerImpl::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while(!isExitRequested){
+
+        if(!requests.empty()){
+            auto function = std::move(requests.front());
+            requests.pop_front();
+            isProcessingRequest = true;
+            lock.unlock();
+            function();
+            lock.lock();
+            isProcessingRequest = false;
+            idleCondition.notify_all();
+            continue;
+        }
+
+        if(!isPolling){
+            condition.wait(lock);
+            continue;
+        }
+
+        auto now = Clock::now();
+        if(now < nextPollingTime){
+            condition.wait_until(lock, nextPollingTime);
+            continue;
+        }
+        
+        auto poll = pollFunction;
+        int id = pollingId;
+        isPollingInProgress = true;
+        lock.unlock();
+        ReferencedPtr state = poll();
+        lock.lock();
+        isPollingInProgress = false;
+        idleCondition.notify_all();
+
+        // Keep the polling rate unless the polling itself takes longer than the interval
+        nextPollingTime += pollingInterval;
+        if(nextPollingTime < now){
+            nextPollingTime = now + pollingInterval;
+        }
+        
+        if(state && id == pollingId){
+            postState(state, id);
+        }
+    }
+}
+
+
+// Called with the mutex locked
+void RobotAccessWorkerImpl::postState(ReferencedPtr state, int id)
+{
+    // The previous state is overwritten if it has not been applied yet
+    latestState = state;
+    latestStateId = id;
+    
+    if(!isApplyPending){
+        isApplyPending = true;
+        std::weak_ptr<RobotAccessWorkerImpl> weakSelf = shared_from_this();
+        callLater([weakSelf](){
+                if(auto self = weakSelf.lock()){
+                    self->applyLatestState();
+                }
+            });
+    }
+}
+
+
+void RobotAccessWorkerImpl::applyLatestState()
+{
+    ReferencedPtr state;
+    std::function<void(Referenced* state)> apply;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isApplyPending = false;
+        if(latestStateId == pollingId){
+            state = std::move(latestState);
+            apply = applyFunction;
+        }
+        latestState.reset();
+    }
+    if(state && apply){
+        apply(state);
+    }
+}
@@ -0,0 +1,74 @@
+/**
+   \file
+*/
+
+#ifndef CNOID_ROBOT_ACCESS_PLUGIN_ROBOT_ACCESS_WORKER_H
+#define CNOID_ROBOT_ACCESS_PLUGIN_ROBOT_ACCESS_WORKER_H
+
+#include <cnoid/Referenced>
+#include <functional>
+#include <memory>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class RobotAccessWorkerImpl;
+
+/**
+   This class runs the communication with a real robot in a dedicated thread so that
+   the GUI thread is not blocked by the network latency.
+
+   The requests are executed in the worker thread in the order they are issued, and the
+   issuer can continue to issue the next requests without waiting for the results.
+   The state of the robot can be polled periodically in the worker thread. Only the newest
+   polled state is delivered to the main thread and the older states which have not been
+   applied yet are dropped, so that a slow GUI does not delay the state reading.
+
+   The callback functions given to the worker are called in the main thread. They are not
+   called after the worker is destroyed.
+*/
+class CNOID_EXPORT RobotAccessWorker
+{
+public:
+    RobotAccessWorker();
+    ~RobotAccessWorker();
+
+    RobotAccessWorker(const RobotAccessWorker&) = delete;
+    RobotAccessWorker& operator=(const RobotAccessWorker&) = delete;
+
+    /**
+       \param function The function executed in the worker thread
+       \param callback The function called in the main thread after the request is processed
+    */
+    void request(std::function<void()> function, std::function<void()> callback = nullptr);
+
+    /**
+       \param poll The function which reads the state in the worker thread.
+       A null pointer can be returned when no state is available.
+       \param apply The function which applies the state in the main thread
+       \param interval The polling interval [s]
+    */
+    void startPolling(
+        std::function<ReferencedPtr()> poll, std::function<void(Referenced* state)> apply, double interval);
+
+    //! Changes the interval of the current polling
+    void setPollingInterval(double interval);
+
+    /**
+       This function waits for the polling in progress to finish,
+       and the states which have not been applied are discarded.
+    */
+    void stopPolling();
+
+    bool isPolling() const;
+
+    //! Waits until all the issued requests are processed
+    void waitForRequests();
+        
+private:
+    std::shared_ptr<RobotAccessWorkerImpl> impl;
+};
+
+}
+
+#endif
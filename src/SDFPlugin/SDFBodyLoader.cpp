@@ -19,6 +19,7 @@
 #include <cnoid/RootItem>
 #include <cnoid/EigenUtil>
 #include <cnoid/PolymorphicFunctionSet>
+#include <cnoid/ThreadPool>
 #include <sdf/sdf.hh>
 #include <sdf/parser_urdf.hh>
 #include <ignition/math.hh>
@@ -29,6 +30,7 @@
 #include <boost/filesystem.hpp>
 #include <fmt/format.h>
 #include <map>
+#include <sstream>
 #include "gettext.h"
 
 using namespace std;
@@ -102,6 +104,8 @@ public:
     bool haveScale;
     Vector3 scale;
     SgNodePtr sgNode;
+    // The mesh file which is loaded after the whole file is read
+    string meshFile;
 };
 typedef ref_ptr<GeometryInfo> GeometryInfoPtr;
 
@@ -283,6 +287,10 @@ public:
     vector<JointInfoPtr> jointInfos;
     LinkInfo* root;
 
+    // The model included from the same file, whose body is copied instead of converting this model
+    ModelInfoPtr templateModel;
+    BodyPtr body;
+
     ModelInfo(){
         isStatic = false;
         selfCollide = false;
@@ -304,8 +312,18 @@ public:
     std::map<std::string, LinkInfoPtr> linkdataMap;
     typedef std::map<std::string, SgImagePtr> ImagePathToSgImageMap;
     ImagePathToSgImageMap imagePathToSgImageMap;
-    SceneLoader sceneLoader;
     MeshGenerator meshGenerator;
+    vector<GeometryInfoPtr> pendingMeshGeometries;
+    std::map<std::string, ModelInfoPtr> includedModelMap;
+    vector<string> dependentFiles;
+
+    struct LoadedMeshFile
+    {
+        SgNodePtr node;
+        float unit;
+        bool isZUp;
+        string message;
+    };
 
     ostream& os() { return *os_; }
 
@@ -313,7 +331,10 @@ public:
     ~SDFBodyLoaderImpl();
     void pose2affine(const ignition::math::Pose3d& pose, cnoid::Affine3& out );
 
+    void clearLoadingState();
     void readSDF(const std::string& filename, vector<ModelInfoPtr>& modelInfos);
+    void loadMeshFiles();
+    void loadMeshFile(const string& url, LoadedMeshFile& out_loaded);
 
     bool load(Body* body, const std::string& filename);
     bool load(BodyItem* item, const std::string& filename);
@@ -321,7 +342,7 @@ public:
 
 
     void readWorld(sdf::ElementPtr world, vector<ModelInfoPtr>& modelInfos);
-    void readInclude(sdf::ElementPtr include, vector<ModelInfoPtr>& modelInfos);
+    void readInclude(sdf::ElementPtr include, vector<ModelInfoPtr>& modelInfos, bool doShareModel);
     void readModel(sdf::ElementPtr model, vector<ModelInfoPtr>& modelInfos);
     void readLink(sdf::ElementPtr link, std::map<std::string, LinkInfoPtr>& linksInfos);
     void readJoint(sdf::ElementPtr joint, vector<JointInfoPtr>& jointInfos);
@@ -342,7 +363,7 @@ public:
                                           const std::string name);
 
 private:
-    SDFLoaderPseudoGazeboColor* gazeboColor;
+    const SDFLoaderPseudoGazeboColor* gazeboColor;
 
 };
 
@@ -659,8 +680,7 @@ SDFBodyLoaderImpl::SDFBodyLoaderImpl()
     isVerbose = false;
     os_ = &nullout();
 
-    gazeboColor = new SDFLoaderPseudoGazeboColor;
-
+    gazeboColor = SDFLoaderPseudoGazeboColor::instance();
 }
 
 
@@ -672,14 +692,13 @@ SDFBodyLoader::~SDFBodyLoader()
 
 SDFBodyLoaderImpl::~SDFBodyLoaderImpl()
 {
-    delete gazeboColor;
+
 }
 
 
 void SDFBodyLoader::setMessageSink(std::ostream& os)
 {
     impl->os_ = &os;
-    impl->sceneLoader.setMessageSink(os);
 }
 
 
@@ -701,6 +720,17 @@ bool SDFBodyLoader::load(BodyItem* item, const std::string& filename)
 }
 
 
+/**
+   The included model files, the mesh files and the texture files are reported so that
+   BodyLoader can keep the loaded models in its model cache.
+*/
+bool SDFBodyLoader::getDependentFiles(std::vector<std::string>& out_files) const
+{
+    out_files.insert(out_files.end(), impl->dependentFiles.begin(), impl->dependentFiles.end());
+    return true;
+}
+
+
 void SDFBodyLoaderImpl::pose2affine(const Pose3d& pose, Affine3& out)
 {
     Vector3 trans(pose.Pos().X(), pose.Pos().Y(), pose.Pos().Z());
@@ -715,12 +745,15 @@ bool SDFBodyLoaderImpl::load(BodyItem* item, const std::string& filename)
 {
     vector<ModelInfoPtr> models;
 
+    clearLoadingState();
     try{
         readSDF(filename, models);
     } catch(const std::exception& ex){
         os() << "Error: " << ex.what() << endl;
+        clearLoadingState();
         return false;
     }
+    loadMeshFiles();
 
     std::cout << "num of models= " << models.size() << std::endl;
 
@@ -740,8 +773,16 @@ bool SDFBodyLoaderImpl::load(BodyItem* item, const std::string& filename)
     }
 
     for(size_t i=0; i<models.size(); i++){
-        BodyPtr body = new Body();
-        createBody(body, models[i].get());
+        ModelInfo* model = models[i].get();
+        BodyPtr body;
+        if(model->templateModel && model->templateModel->body){
+            body = model->templateModel->body->clone();
+            body->setModelName(model->name);
+        } else {
+            body = new Body();
+            createBody(body, model);
+            model->body = body;
+        }
 
         BodyItemPtr bodyItem;
         if(worldItem){
@@ -759,6 +800,8 @@ bool SDFBodyLoaderImpl::load(BodyItem* item, const std::string& filename)
         bodyItem->setEditable(!body->isStaticModel());
     }
 
+    includedModelMap.clear();
+
     if(worldItem)
         return false; // The message fails.
     else
@@ -766,6 +809,16 @@ bool SDFBodyLoaderImpl::load(BodyItem* item, const std::string& filename)
 }
 
 
+void SDFBodyLoaderImpl::clearLoadingState()
+{
+    pendingMeshGeometries.clear();
+    includedModelMap.clear();
+    dependentFiles.clear();
+    // The textures are loaded again to report them as the dependent files
+    imagePathToSgImageMap.clear();
+}
+
+
 void  SDFBodyLoaderImpl::readSDF(const std::string& filename, vector<ModelInfoPtr>& models)
 {
     try {
@@ -814,13 +867,19 @@ void SDFBodyLoaderImpl::readWorld(sdf::ElementPtr world, vector<ModelInfoPtr>& m
     if(world->HasElement("include")){
         for(sdf::ElementPtr include = world->GetElement("include"); include;
                 include = include->GetNextElement("include")){
-            readInclude(include, modelInfos);
+            readInclude(include, modelInfos, true);
         }
     }
 }
 
 
-void SDFBodyLoaderImpl::readInclude(sdf::ElementPtr include, vector<ModelInfoPtr>& modelInfos)
+/**
+   The models included from the same file in a world are only read once when doShareModel
+   is true. The later ones refer to the first model as their template, and their bodies are
+   the copies of the body of the template. The nested models are always read because they
+   are merged into their parent model.
+*/
+void SDFBodyLoaderImpl::readInclude(sdf::ElementPtr include, vector<ModelInfoPtr>& modelInfos, bool doShareModel)
 {
     for(sdf::ElementPtr element = include->GetFirstElement(); element; element = element->GetNextElement() ){
         if(element->GetName()=="uri"){
@@ -828,11 +887,30 @@ void SDFBodyLoaderImpl::readInclude(sdf::ElementPtr include, vector<ModelInfoPtr
             string url = sdf::findFile(uri);
             if(url.empty())
                 continue;
+            if(doShareModel){
+                auto p = includedModelMap.find(url);
+                if(p != includedModelMap.end()){
+                    ModelInfo* templateModel = p->second;
+                    ModelInfoPtr modelInfo(new ModelInfo());
+                    modelInfo->name = templateModel->name;
+                    modelInfo->isStatic = templateModel->isStatic;
+                    modelInfo->selfCollide = templateModel->selfCollide;
+                    modelInfo->pose = templateModel->pose;
+                    modelInfo->templateModel = templateModel;
+                    modelInfos.push_back(modelInfo);
+                    continue;
+                }
+            }
+            const size_t numModels = modelInfos.size();
             try{
                 readSDF(url, modelInfos);
             }catch(const std::exception& ex){
                 throw ex;
             }
+            dependentFiles.push_back(url);
+            if(doShareModel && modelInfos.size() == numModels + 1){
+                includedModelMap[url] = modelInfos.back();
+            }
         }else if(element->GetName()=="name"){
             modelInfos.back()->name = element->Get<string>("name");
         }else if(element->GetName()=="static"){
@@ -861,7 +939,7 @@ void SDFBodyLoaderImpl::readModel(sdf::ElementPtr model, vector<ModelInfoPtr>& m
     if(model->HasElement("include")){
         for(sdf::ElementPtr include = model->GetElement("include"); include;
                 include =include->GetNextElement("include")){
-                    readInclude(include, modelInfo->nestedModels);
+                    readInclude(include, modelInfo->nestedModels, false);
                 }
     }
 
@@ -1113,56 +1191,14 @@ GeometryInfo* SDFBodyLoaderImpl::readGeometry(sdf::ElementPtr geometry)
     for(sdf::ElementPtr el = geometry->GetFirstElement(); el; el = el->GetNextElement()) {
         if(el->GetName() == "mesh") {
             std::string url = sdf::findFile(el->Get<std::string>("uri"));
-            std::string urllower = url;
-            boost::algorithm::to_lower(urllower);
 
             if (!url.empty()) {
-                if (isVerbose) {
-                    os() << "     read mesh " << url << std::endl;
-                }
-
-                float scale0 = 1;
-
-                if (boost::algorithm::iends_with(urllower, "dae")){
-                    TiXmlDocument xmlDoc;
-                    xmlDoc.LoadFile(url);
-                    string dae_axis = "Y_UP";
-                    if(!xmlDoc.Error()) {
-                        TiXmlElement * colladaXml = xmlDoc.FirstChildElement("COLLADA");
-                        if(colladaXml) {
-                            TiXmlElement *assetXml = colladaXml->FirstChildElement("asset");
-                            if(assetXml) {
-                                TiXmlElement *unitXml = assetXml->FirstChildElement("unit");
-                                if (unitXml && unitXml->Attribute("meter") &&
-                                    unitXml->QueryFloatAttribute("meter", &scale0) == TIXML_SUCCESS) {
-                                }
-                                TiXmlElement *up_axisXml = assetXml->FirstChildElement("up_axis");
-                                if (up_axisXml) {
-                                    dae_axis = up_axisXml->GetText();
-                                }
-                            }
-                        }
-                    }else{
-                        cout << xmlDoc.ErrorDesc() << endl;
-                    }
-
-                    SgNode* node = sceneLoader.load(url);
-
-                    if (dae_axis == "Z_UP") {
-                        SgPosTransformPtr transform = new SgPosTransform;
-                        transform->setRotation(AngleAxis(radian(90), Vector3::UnitX()));
-                        transform->addChild(node);
-                        geometryInfo->sgNode = transform;
-                    }else{
-                        geometryInfo->sgNode = node;
-                    }
-                } else {
-                    geometryInfo->sgNode = sceneLoader.load(url);
-                }
+                geometryInfo->meshFile = url;
+                pendingMeshGeometries.push_back(geometryInfo);
 
                 if(el->HasElement("scale")){
                     ignition::math::Vector3d scale = el->Get<ignition::math::Vector3d>("scale");
-                    geometryInfo->scale = (double)scale0 * Vector3(scale.X(), scale.Y(), scale.Z());
+                    geometryInfo->scale = Vector3(scale.X(), scale.Y(), scale.Z());
                     geometryInfo->haveScale = true;
                 } else {
                     geometryInfo->scale = Vector3(1,1,1);
@@ -1200,6 +1236,107 @@ GeometryInfo* SDFBodyLoaderImpl::readGeometry(sdf::ElementPtr geometry)
 }
 
 
+/**
+   The mesh files are loaded in parallel because loading them takes most of the time to read
+   a world including many models. Each file is only loaded once, and the geometries of the
+   same file share the meshes of the loaded scene. Their shape nodes are cloned because the
+   materials of the visuals are set to the shape nodes.
+*/
+void SDFBodyLoaderImpl::loadMeshFiles()
+{
+    vector<string> files;
+    std::map<string, int> fileIndexMap;
+    for(auto& geometry : pendingMeshGeometries){
+        if(fileIndexMap.insert(make_pair(geometry->meshFile, (int)files.size())).second){
+            files.push_back(geometry->meshFile);
+        }
+    }
+
+    vector<LoadedMeshFile> loadedFiles(files.size());
+    ThreadPool::instance()->parallelFor(
+        0, files.size(),
+        [&](int index){ loadMeshFile(files[index], loadedFiles[index]); },
+        1);
+
+    for(size_t i=0; i < files.size(); ++i){
+        if (isVerbose) {
+            os() << "     read mesh " << files[i] << std::endl;
+        }
+        os() << loadedFiles[i].message;
+        dependentFiles.push_back(files[i]);
+    }
+
+    vector<bool> isFileNodeUsed(files.size(), false);
+    for(auto& geometry : pendingMeshGeometries){
+        const int index = fileIndexMap[geometry->meshFile];
+        LoadedMeshFile& loaded = loadedFiles[index];
+        SgNodePtr node = loaded.node;
+        if(node){
+            if(isFileNodeUsed[index]){
+                SgCloneMap cloneMap;
+                cloneMap.setNonNodeCloning(false);
+                node = cloneMap.getClone<SgNode>(node);
+            }
+            isFileNodeUsed[index] = true;
+            if(loaded.isZUp){
+                SgPosTransformPtr transform = new SgPosTransform;
+                transform->setRotation(AngleAxis(radian(90), Vector3::UnitX()));
+                transform->addChild(node);
+                node = transform;
+            }
+        }
+        geometry->sgNode = node;
+        if(geometry->haveScale){
+            geometry->scale *= (double)loaded.unit;
+        }
+        geometry->meshFile.clear();
+    }
+
+    pendingMeshGeometries.clear();
+}
+
+
+/**
+   This is called in the threads of the thread pool. The messages are stored in out_loaded
+   and put in the loading order later.
+*/
+void SDFBodyLoaderImpl::loadMeshFile(const string& url, LoadedMeshFile& out_loaded)
+{
+    ostringstream message;
+    out_loaded.unit = 1;
+    out_loaded.isZUp = false;
+
+    if (boost::algorithm::iends_with(url, "dae")){
+        TiXmlDocument xmlDoc;
+        xmlDoc.LoadFile(url);
+        if(!xmlDoc.Error()) {
+            TiXmlElement * colladaXml = xmlDoc.FirstChildElement("COLLADA");
+            if(colladaXml) {
+                TiXmlElement *assetXml = colladaXml->FirstChildElement("asset");
+                if(assetXml) {
+                    TiXmlElement *unitXml = assetXml->FirstChildElement("unit");
+                    if (unitXml && unitXml->Attribute("meter") &&
+                        unitXml->QueryFloatAttribute("meter", &out_loaded.unit) == TIXML_SUCCESS) {
+                    }
+                    TiXmlElement *up_axisXml = assetXml->FirstChildElement("up_axis");
+                    if (up_axisXml && up_axisXml->GetText()) {
+                        out_loaded.isZUp = (string(up_axisXml->GetText()) == "Z_UP");
+                    }
+                }
+            }
+        }else{
+            message << xmlDoc.ErrorDesc() << endl;
+        }
+    }
+
+    // The loaders of a scene loader are not shared with the other threads
+    SceneLoader sceneLoader;
+    sceneLoader.setMessageSink(message);
+    out_loaded.node = sceneLoader.load(url);
+    out_loaded.message = message.str();
+}
+
+
 void SDFBodyLoaderImpl::readSensor(sdf::ElementPtr sensor, vector<SensorInfoPtr>& sensors)
 {
     if (!sensor->HasAttribute("name") || !sensor->HasAttribute("type")) {
@@ -1509,12 +1646,16 @@ bool SDFBodyLoaderImpl::load(Body* body, const std::string& filename)
 {
     vector<ModelInfoPtr> models;
 
+    clearLoadingState();
     try{
         readSDF(filename, models);
     } catch(const std::exception& ex){
         os() << "Error: " << ex.what() << endl;
+        clearLoadingState();
         return false;
     }
+    loadMeshFiles();
+    includedModelMap.clear();
 
     if(models.size() != 1){
         os() << "Error: multiple models defined in one model file. please consider reading each separate files." << endl;
@@ -1646,6 +1787,7 @@ SgTexture* SDFBodyLoaderImpl::convertTexture(MaterialInfo* material, const strin
             imageIO.setUpsideDown(true);
             imageIO.load(image->image(), textureFile);
             imagePathToSgImageMap[textureFile] = image;
+            dependentFiles.push_back(textureFile);
         } catch(const exception_base& ex){
             cout << boost::get_error_info<error_info_message>(ex) << endl;
             image = 0;
@@ -1669,9 +1811,7 @@ SgMaterial* SDFBodyLoaderImpl::convertMaterial(MaterialInfo* material, float tra
     if(!material)
         return 0;
 
-    SgMaterial* sgMaterial;
-    SDFLoaderPseudoGazeboColorInfo* cinfo = gazeboColor->get(material->scriptName);
-    sgMaterial = cinfo->material;
+    SgMaterial* sgMaterial = gazeboColor->createMaterial(material->scriptName);
 
     sdf::Color& ambient = material->ambient;
     if(ambient.r != -1){
@@ -21,6 +21,7 @@ public:
     virtual void setMessageSink(std::ostream& os);
     virtual void setVerbose(bool on);
     virtual bool load(Body* body, const std::string& filename);
+    virtual bool getDependentFiles(std::vector<std::string>& out_files) const;
 
     bool load(BodyItem* item, const std::string& filename);
 
@@ -35,6 +35,12 @@ SDFLoaderPseudoGazeboColorInfo::~SDFLoaderPseudoGazeboColorInfo()
 {
 }
 
+const SDFLoaderPseudoGazeboColor* SDFLoaderPseudoGazeboColor::instance()
+{
+    static SDFLoaderPseudoGazeboColor gazeboColor;
+    return &gazeboColor;
+}
+
 SDFLoaderPseudoGazeboColor::SDFLoaderPseudoGazeboColor()
 {
     #define SDFLOADER_SET_COLOR_MATERIAL(                                                         \
@@ -70,29 +76,24 @@ SDFLoaderPseudoGazeboColor::SDFLoaderPseudoGazeboColor()
 
 SDFLoaderPseudoGazeboColor::~SDFLoaderPseudoGazeboColor()
 {
+    for (auto& kv : colorInfoMap_) {
+        delete kv.second;
+    }
 }
 
-SDFLoaderPseudoGazeboColorInfo* SDFLoaderPseudoGazeboColor::get(std::string name)
+const SDFLoaderPseudoGazeboColorInfo* SDFLoaderPseudoGazeboColor::find(const std::string& name) const
 {
-    SDFLoaderPseudoGazeboColorInfo* ret;
-    SDFLoaderPseudoGazeboColorInfo* p;
-
-    ret = new SDFLoaderPseudoGazeboColorInfo;
-
-    if (colorInfoMap_.find(name) != colorInfoMap_.end()) {
-        p = colorInfoMap_[name];
-
-        ret->isSettingAmbient = p->isSettingAmbient;
-        ret->isSettingDiffuse = p->isSettingDiffuse;
-        ret->isSettingSpecular = p->isSettingSpecular;
-        ret->isSettingEmissive = p->isSettingEmissive;
-        ret->material->setAmbientIntensity(p->material->ambientIntensity());
-        ret->material->setDiffuseColor(p->material->diffuseColor());
-        ret->material->setEmissiveColor(p->material->emissiveColor());
-        ret->material->setShininess(p->material->shininess());
-        ret->material->setSpecularColor(p->material->specularColor());
-        ret->material->setTransparency(p->material->transparency());
+    auto p = colorInfoMap_.find(name);
+    if (p != colorInfoMap_.end()) {
+        return p->second;
     }
+    return nullptr;
+}
 
-    return ret;
+SgMaterial* SDFLoaderPseudoGazeboColor::createMaterial(const std::string& name) const
+{
+    if (const SDFLoaderPseudoGazeboColorInfo* info = find(name)) {
+        return new SgMaterial(*info->material);
+    }
+    return new SgMaterial(*defaultColorInfo_.material);
 }
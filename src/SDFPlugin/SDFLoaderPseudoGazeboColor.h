@@ -36,6 +36,11 @@ public:
 class SDFLoaderPseudoGazeboColor
 {
 public:
+    /**
+       The color table is only created once and shared by the loaders
+     */
+    static const SDFLoaderPseudoGazeboColor* instance();
+
     /**
      */
     SDFLoaderPseudoGazeboColor();
@@ -45,11 +50,19 @@ public:
     ~SDFLoaderPseudoGazeboColor();
 
     /**
+       \return null if the color is not defined
+     */
+    const SDFLoaderPseudoGazeboColorInfo* find(const std::string& name) const;
+
+    /**
+       Creates a new material which is a copy of the material of the color, or the default
+       material if the color is not defined
      */
-    SDFLoaderPseudoGazeboColorInfo* get(std::string name);
+    SgMaterial* createMaterial(const std::string& name) const;
 
 private:
     std::map<std::string, SDFLoaderPseudoGazeboColorInfo*> colorInfoMap_;
+    SDFLoaderPseudoGazeboColorInfo defaultColorInfo_;
 };
 
 }
@@ -471,6 +471,14 @@ void SceneGraphPropertyViewImpl::setProperty(SgMesh* mesh)
             addProperty(_("radius"), new PropertyItem(this,Double(capsule.radius,3)));
             addProperty(_("height"), new PropertyItem(this,Double(capsule.height,3)));
             break; }
+        case SgMesh::HEIGHT_FIELD :{
+            addProperty(_("primitive type"), new PropertyItem(this, string("HeightField")));
+            const SgMesh::HeightField& field = mesh->primitive<SgMesh::HeightField>();
+            addProperty(_("xDimension"), new PropertyItem(this,Int(field.xDimension)));
+            addProperty(_("zDimension"), new PropertyItem(this,Int(field.zDimension)));
+            addProperty(_("xSpacing"), new PropertyItem(this,Double(field.xSpacing,3)));
+            addProperty(_("zSpacing"), new PropertyItem(this,Double(field.zSpacing,3)));
+            break; }
         }
 }
 
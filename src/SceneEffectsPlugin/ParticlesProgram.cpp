@@ -36,6 +36,7 @@ bool ParticlesProgramBase::initializeRendering(SceneParticles* particles)
     angle2pixelsLocation = glsl.getUniformLocation("angle2pixels");
     
     timeLocation = glsl.getUniformLocation("time");
+    numParticlesLocation = glsl.getUniformLocation("numParticles");
     particleTexLocation = glsl.getUniformLocation("particleTex");
 
     if(!particles->texture().empty()){
@@ -50,6 +51,9 @@ bool ParticlesProgramBase::initializeRendering(SceneParticles* particles)
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     }
 
+    // The core profile requires a bound vertex array even if it has no attributes
+    glGenVertexArrays(1, &vertexArray);
+
     return true;
 }
 
@@ -137,6 +141,18 @@ void ParticlesProgramBase::render
 }
 
 
+void ParticlesProgramBase::drawParticles(int numParticles)
+{
+    if(numParticles <= 0){
+        return;
+    }
+    glUniform1i(numParticlesLocation, numParticles);
+    glBindVertexArray(vertexArray);
+    glDrawArrays(GL_POINTS, 0, numParticles);
+    glBindVertexArray(0);
+}
+
+
 ParticlesProgram::ParticlesProgram
 (GLSLSceneRenderer* renderer, const char* vertexShader, const char* fragmentShader)
     : BasicLightingProgram(vertexShader, fragmentShader),
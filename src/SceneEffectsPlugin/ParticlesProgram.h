@@ -22,9 +22,6 @@ public:
     void setTime(float time){
         glUniform1f(timeLocation, time);
     }
-    static float frandom(float max = 1.0f) {
-        return ((float)rand() / RAND_MAX) * max;
-    }
 
 protected:
     virtual bool initializeRendering(SceneParticles* particles) = 0;
@@ -32,6 +29,12 @@ protected:
     GLSLSceneRenderer* renderer() { return renderer_; }
     const Matrix3f& globalAttitude() const { return globalAttitude_; }
 
+    /**
+       The initial state of each particle is generated in the vertex shader from
+       gl_VertexID, so the particles are drawn without any vertex buffers.
+    */
+    void drawParticles(int numParticles);
+
 private:
     enum State { NOT_INITIALIZED, INITIALIZED, FAILED } initializationState;
     GLSLSceneRenderer* renderer_;
@@ -40,8 +43,10 @@ private:
     GLint pointSizeLocation;
     GLint angle2pixelsLocation;
     GLint timeLocation;
+    GLint numParticlesLocation;
     GLint particleTexLocation;
     GLuint textureId;
+    GLuint vertexArray;
     Matrix3f globalAttitude_;
 
     void render(SceneParticles* particles, const Affine3& position, const std::function<void()>& renderingFunction);
@@ -23,12 +23,8 @@ public:
 
     GLint velocityLocation;
     GLint lifeTimeLocation;
-
-    GLfloat lifeTime;
-    GLuint numParticles;
-    GLuint initPosBuffer;
-    GLuint offsetTimeBuffer;
-    GLuint vertexArray;
+    GLint radiusLocation;
+    GLint topLocation;
 };
 
 struct Registration {
@@ -129,58 +125,11 @@ bool RainSnowProgram::initializeRendering(SceneParticles* particles)
         return false;
     }
 
-    auto rs = static_cast<SceneRainSnowBase*>(particles);
-    auto& ps = rs->particleSystem();
-
-    // Initial position buffer
-    vector<GLfloat> data(ps.numParticles() * 3);
-    const float r = rs->radius();
-    const float r2 = r * 4;
-    for(GLuint i = 0; i < ps.numParticles(); ++i) {
-        float x, y;
-        while(true){
-            x = 2.0 * r * frandom() - r;
-            y = 2.0 * r * frandom() - r;
-            if(x * x + y * y <= r2){
-                break;
-            }
-        }
-        data[3*i]     = x;
-        data[3*i + 1] = y;
-        data[3*i + 2] = rs->top();
-    }
-    glGenBuffers(1, &initPosBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, initPosBuffer);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data.front(), GL_STATIC_DRAW);
-
-    // Offset time buffer
-    data.resize(ps.numParticles());
-    lifeTime = fabsf((rs->top() - rs->bottom()) / rs->velocity().z());
-    float rate = lifeTime / ps.numParticles();
-    float time = 0.0f;
-    for(GLuint i = 0; i < ps.numParticles(); ++i) {
-        data[i] = time;
-        time += rate;
-    }
-    glGenBuffers(1, &offsetTimeBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, offsetTimeBuffer);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data.front(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    // Vertex arrays
-    glGenVertexArrays(1, &vertexArray);
-    glBindVertexArray(vertexArray);
-    glBindBuffer(GL_ARRAY_BUFFER, initPosBuffer);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, offsetTimeBuffer);
-    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(1);
-    glBindVertexArray(0);
-
     auto& glsl = glslProgram();
     velocityLocation = glsl.getUniformLocation("velocity");
     lifeTimeLocation = glsl.getUniformLocation("lifeTime");
+    radiusLocation = glsl.getUniformLocation("radius");
+    topLocation = glsl.getUniformLocation("top");
 
     return true;
 }
@@ -192,9 +141,11 @@ void RainSnowProgram::render(SceneRainSnowBase* particles)
 
     setTime(particles->time() + ps.offsetTime());
 
+    float lifeTime = fabsf((particles->top() - particles->bottom()) / particles->velocity().z());
     glUniform1f(lifeTimeLocation, lifeTime);
     glUniform3fv(velocityLocation, 1, particles->velocity().data());
+    glUniform1f(radiusLocation, particles->radius());
+    glUniform1f(topLocation, particles->top());
 
-    glBindVertexArray(vertexArray);
-    glDrawArrays(GL_POINTS, 0, ps.numParticles());
+    drawParticles(ps.numParticles());
 }
@@ -1,13 +1,14 @@
 #version 330
 
-layout (location = 0) in vec3 vertexInitVel;
-layout (location = 1) in float offsetTime;
-
 out vec3 position;
 out float alpha;
 
 uniform float time;
 uniform float lifeTime;
+uniform int numParticles;
+uniform float emissionRange;
+uniform float initialSpeedAverage;
+uniform float initialSpeedVariation;
 uniform vec3 accel = vec3(0.0, 0.0, 0.1);
 
 uniform mat4 modelViewMatrix;
@@ -15,8 +16,26 @@ uniform mat4 projectionMatrix;
 uniform float pointSize;
 uniform float angle2pixels;
 
+// Integer hash giving a reproducible random value in [0, 1] for each particle
+float random(int particle, uint stream)
+{
+    uint x = uint(particle) * 4u + stream;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return float(x) / 4294967295.0;
+}
+
 void main()
 {
+    float theta = emissionRange / 2.0 * random(gl_VertexID, 0u);
+    float phi = 2.0 * 3.14159265 * random(gl_VertexID, 1u);
+    float speed = max(0.0, initialSpeedAverage + initialSpeedVariation * (random(gl_VertexID, 2u) - 0.5));
+    vec3 vertexInitVel = vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta)) * speed;
+    float offsetTime = lifeTime * float(gl_VertexID) / float(numParticles);
+
     vec3 pos;
     float t = time - offsetTime;
     if(t > 0){
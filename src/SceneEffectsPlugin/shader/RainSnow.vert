@@ -1,22 +1,40 @@
 #version 330
 
-layout (location = 0) in vec3 vertexInitPos;
-layout (location = 1) in float offsetTime;
-
 out vec3 position;
 out float alpha;
 
 uniform float time;
 uniform float lifeTime;
 uniform vec3 velocity;
+uniform int numParticles;
+uniform float radius;
+uniform float top;
 
 uniform mat4 modelViewMatrix;
 uniform mat4 projectionMatrix;
 uniform float pointSize;
 uniform float angle2pixels;
 
+// Integer hash giving a reproducible random value in [0, 1] for each particle
+float random(int particle, uint stream)
+{
+    uint x = uint(particle) * 4u + stream;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return float(x) / 4294967295.0;
+}
+
 void main()
 {
+    // Uniform distribution on the disk
+    float r = radius * sqrt(random(gl_VertexID, 0u));
+    float theta = 2.0 * 3.14159265 * random(gl_VertexID, 1u);
+    vec3 vertexInitPos = vec3(r * cos(theta), r * sin(theta), top);
+    float offsetTime = lifeTime * float(gl_VertexID) / float(numParticles);
+
     vec3 pos = vertexInitPos;
     alpha = 0.0;
     float t = time - offsetTime;
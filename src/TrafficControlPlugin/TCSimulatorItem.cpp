@@ -197,7 +197,7 @@ TCSimulatorItem::TCSimulatorItem(const TCSimulatorItem& org) : SubSimulatorItem(
 
 TCSimulatorItem::~TCSimulatorItem()
 {
-
+    stopDynamicTCThread();
 }
 
 Item*
@@ -239,6 +239,8 @@ TCSimulatorItem::initializeSimulation(SimulatorItem* simulatorItem)
 
     doTC();
 
+    startDynamicTCThread();
+
     return true;
 }
 
@@ -299,6 +301,8 @@ TCSimulatorItem::resetTC() {
 void
 TCSimulatorItem::finalizeSimulation()
 {
+    stopDynamicTCThread();
+
     resetTC();
 
     TrafficControlShare* _share = TrafficControlShare::instance();
@@ -311,6 +315,8 @@ TCSimulatorItem::finalizeSimulation()
 
 void
 TCSimulatorItem::onPaused() {
+    stopDynamicTCThread();
+
     resetTC();
 
     TrafficControlShare* _share = TrafficControlShare::instance();
@@ -328,6 +334,8 @@ TCSimulatorItem::onResumed() {
     }
 
     doTC();
+
+    startDynamicTCThread();
 }
 
 void
@@ -890,42 +898,47 @@ TCSimulatorItem::doTC(const int& ethIdxNo) {
 
 void
 TCSimulatorItem::doTC2com(const int& ethIdxNo,const int *p1,const int *p2,const double *p3,const int *p4,const int *p5,const double *p6) {
+    doTC2com(ethIdxNo,p1[ethIdxNo],p2[ethIdxNo],p3[ethIdxNo],p4[ethIdxNo],p5[ethIdxNo],p6[ethIdxNo]);
+}
+
+void
+TCSimulatorItem::doTC2com(const int& ethIdxNo,int outDelay,int outRate,double outLoss,int inDelay,int inRate,double inLoss) {
 
     bool rc1=true;
 
-    if(p1[ethIdxNo]<ZERO||p1[ethIdxNo]>DELAY_MAX) {
-        MessageView::mainInstance()->putln(MessageView::ERROR,"TCSimulatorItem::doTC2com OutboundDelay value="+std::to_string(p1[ethIdxNo])+" is out of range."+rangeStr(ZERO,DELAY_MAX));
+    if(outDelay<ZERO||outDelay>DELAY_MAX) {
+        MessageView::mainInstance()->putln(MessageView::ERROR,"TCSimulatorItem::doTC2com OutboundDelay value="+std::to_string(outDelay)+" is out of range."+rangeStr(ZERO,DELAY_MAX));
         rc1=false;
     }
-    if(p2[ethIdxNo]<ZERO||p2[ethIdxNo]>BAND_MAX) {
-        MessageView::mainInstance()->putln(MessageView::ERROR,"TCSimulatorItem::doTC2com OutboundBandWidth value="+std::to_string(p2[ethIdxNo])+" is out of range."+rangeStr(ZERO,BAND_MAX));
+    if(outRate<ZERO||outRate>BAND_MAX) {
+        MessageView::mainInstance()->putln(MessageView::ERROR,"TCSimulatorItem::doTC2com OutboundBandWidth value="+std::to_string(outRate)+" is out of range."+rangeStr(ZERO,BAND_MAX));
         rc1=false;
     }
-    if(p3[ethIdxNo]<ZERO||p3[ethIdxNo]>LOSS_MAX) {
-        MessageView::mainInstance()->putln(MessageView::ERROR,"TCSimulatorItem::doTC2com OutboundLoss value="+std::to_string(p3[ethIdxNo])+" is out of range."+rangeStr(ZERO,LOSS_MAX));
+    if(outLoss<ZERO||outLoss>LOSS_MAX) {
+        MessageView::mainInstance()->putln(MessageView::ERROR,"TCSimulatorItem::doTC2com OutboundLoss value="+std::to_string(outLoss)+" is out of range."+rangeStr(ZERO,LOSS_MAX));
         rc1=false;
     }
     if(rc1) {
-        string cmd="tc qdisc replace dev "+_ethName[ethIdxNo]+" parent 1:1 handle 11: netem"+" delay "+std::to_string(p1[ethIdxNo])+"ms"+" rate "+std::to_string(p2[ethIdxNo])+"kbit"+" loss "+std::to_string(p3[ethIdxNo])+"%";
+        string cmd="tc qdisc replace dev "+_ethName[ethIdxNo]+" parent 1:1 handle 11: netem"+" delay "+std::to_string(outDelay)+"ms"+" rate "+std::to_string(outRate)+"kbit"+" loss "+std::to_string(outLoss)+"%";
         sysCall(cmd);
     }
 
     bool rc2=true;
 
-    if(p4[ethIdxNo]<ZERO||p4[ethIdxNo]>DELAY_MAX) {
-        MessageView::mainInstance()->putln(MessageView::ERROR,"TCSimulatorItem::doTC2com InboundDelay value="+std::to_string(p4[ethIdxNo])+" is out of range."+rangeStr(ZERO,DELAY_MAX));
+    if(inDelay<ZERO||inDelay>DELAY_MAX) {
+        MessageView::mainInstance()->putln(MessageView::ERROR,"TCSimulatorItem::doTC2com InboundDelay value="+std::to_string(inDelay)+" is out of range."+rangeStr(ZERO,DELAY_MAX));
         rc2=false;
     }
-    if(p5[ethIdxNo]<ZERO||p5[ethIdxNo]>BAND_MAX) {
-        MessageView::mainInstance()->putln(MessageView::ERROR,"TCSimulatorItem::doTC2com InboundBandWidth value="+std::to_string(p5[ethIdxNo])+" is out of range."+rangeStr(ZERO,BAND_MAX));
+    if(inRate<ZERO||inRate>BAND_MAX) {
+        MessageView::mainInstance()->putln(MessageView::ERROR,"TCSimulatorItem::doTC2com InboundBandWidth value="+std::to_string(inRate)+" is out of range."+rangeStr(ZERO,BAND_MAX));
         rc2=false;
     }
-    if(p6[ethIdxNo]<ZERO||p6[ethIdxNo]>LOSS_MAX) {
-        MessageView::mainInstance()->putln(MessageView::ERROR,"TCSimulatorItem::doTC2com InboundLoss value="+std::to_string(p6[ethIdxNo])+" is out of range."+rangeStr(ZERO,LOSS_MAX));
+    if(inLoss<ZERO||inLoss>LOSS_MAX) {
+        MessageView::mainInstance()->putln(MessageView::ERROR,"TCSimulatorItem::doTC2com InboundLoss value="+std::to_string(inLoss)+" is out of range."+rangeStr(ZERO,LOSS_MAX));
         rc2=false;
     }
     if(rc2) {
-        string cmd="tc qdisc replace dev "+_virName[ethIdxNo]+" parent 1:1 handle 11: netem"+" delay "+std::to_string(p4[ethIdxNo])+"ms"+" rate "+std::to_string(p5[ethIdxNo])+"kbit"+" loss "+std::to_string(p6[ethIdxNo])+"%";
+        string cmd="tc qdisc replace dev "+_virName[ethIdxNo]+" parent 1:1 handle 11: netem"+" delay "+std::to_string(inDelay)+"ms"+" rate "+std::to_string(inRate)+"kbit"+" loss "+std::to_string(inLoss)+"%";
         sysCall(cmd);
     }
 }
@@ -985,7 +998,12 @@ TCSimulatorItem::bridgeInit() {
     }
 
     for(int i=0;i<portCount;i++) {
-        doTC2D(i);
+        if(_isDynamicTCThreadActive) {
+            postDynamicTC(i);
+        }
+        else {
+            doTC2D(i);
+        }
     }
 }
 
@@ -1058,7 +1076,89 @@ TCSimulatorItem::bridgeTC(const int& ethIdxNo,const double& distance,const doubl
         _InboundBandWidthD[ethIdxNo] = i5;
         _InboundLossD[ethIdxNo] = i6;
 
-        doTC2D(ethIdxNo);
+        if(_isDynamicTCThreadActive) {
+            postDynamicTC(ethIdxNo);
+        }
+        else {
+            doTC2D(ethIdxNo);
+        }
+    }
+}
+
+void
+TCSimulatorItem::startDynamicTCThread() {
+    if(_isDynamicTCThreadActive) return;
+
+    for(int i=0;i<NIC_MAX;i++) {
+        _isPending[i]=false;
+    }
+    _isDynamicTCThreadActive=true;
+    _dynamicTCThread=std::thread([this](){ dynamicTCThreadMain(); });
+}
+
+/**
+   The pending parameters are discarded because the caller resets the traffic control.
+*/
+void
+TCSimulatorItem::stopDynamicTCThread() {
+    if(!_isDynamicTCThreadActive) return;
+
+    {
+        std::lock_guard<std::mutex> lock(_dynamicTCMutex);
+        _isDynamicTCThreadActive=false;
+        for(int i=0;i<NIC_MAX;i++) {
+            _isPending[i]=false;
+        }
+    }
+    _dynamicTCCondition.notify_all();
+    _dynamicTCThread.join();
+}
+
+void
+TCSimulatorItem::postDynamicTC(const int& ethIdxNo) {
+    {
+        std::lock_guard<std::mutex> lock(_dynamicTCMutex);
+        _pendingParams[ethIdxNo] = {
+            _OutboundDelayD[ethIdxNo], _OutboundBandWidthD[ethIdxNo], _OutboundLossD[ethIdxNo],
+            _InboundDelayD[ethIdxNo], _InboundBandWidthD[ethIdxNo], _InboundLossD[ethIdxNo] };
+        _isPending[ethIdxNo]=true;
+    }
+    _dynamicTCCondition.notify_one();
+}
+
+void
+TCSimulatorItem::dynamicTCThreadMain() {
+    DynamicTCParams params[NIC_MAX];
+    bool isPending[NIC_MAX];
+
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(_dynamicTCMutex);
+            _dynamicTCCondition.wait(lock, [&](){
+                    if(!_isDynamicTCThreadActive) return true;
+                    for(int i=0;i<NIC_MAX;i++) {
+                        if(_isPending[i]) return true;
+                    }
+                    return false;
+                });
+            if(!_isDynamicTCThreadActive) break;
+
+            for(int i=0;i<NIC_MAX;i++) {
+                isPending[i]=_isPending[i];
+                if(isPending[i]) {
+                    params[i]=_pendingParams[i];
+                    _isPending[i]=false;
+                }
+            }
+        }
+
+        // The parameters posted while a command is running are applied in the next round
+        for(int i=0;i<NIC_MAX;i++) {
+            if(isPending[i]) {
+                const DynamicTCParams& p=params[i];
+                doTC2com(i,p.outDelay,p.outRate,p.outLoss,p.inDelay,p.inRate,p.inLoss);
+            }
+        }
     }
 }
 
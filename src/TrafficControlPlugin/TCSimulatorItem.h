@@ -6,6 +6,10 @@
 
 #include <cnoid/SubSimulatorItem>
 #include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include "exportdecl.h"
 
 #ifndef NIC_MAX
@@ -85,10 +89,15 @@ private:
     void doTC();
     void doTC(const int& ethIdxNo);
     void doTC2com(const int& ethIdxNo,const int *p1,const int *p2,const double *p3,const int *p4,const int *p5,const double *p6);
+    void doTC2com(const int& ethIdxNo,int outDelay,int outRate,double outLoss,int inDelay,int inRate,double inLoss);
     void doTC2S(const int& ethIdxNo);
     void doTC2D(const int& ethIdxNo);
     std::vector<std::string> split(const std::string &str,const char& delim);
     std::string rangeStr(const int &min,const int &max);
+    void startDynamicTCThread();
+    void stopDynamicTCThread();
+    void postDynamicTC(const int& ethIdxNo);
+    void dynamicTCThreadMain();
     void initTC();
     void resetTC();
     bool findNIC(const std::string &nic);
@@ -136,6 +145,25 @@ private:
     bool _initTC = false;
 
     bool _monitorDynamicTC = false;
+
+    /*
+      The dynamic parameters are applied by a worker thread because the tc command takes
+      much longer than a simulation step. Only the newest parameters of each port are kept.
+    */
+    struct DynamicTCParams {
+        int    outDelay;
+        int    outRate;
+        double outLoss;
+        int    inDelay;
+        int    inRate;
+        double inLoss;
+    };
+    DynamicTCParams _pendingParams[NIC_MAX];
+    bool _isPending[NIC_MAX];
+    std::thread _dynamicTCThread;
+    std::mutex _dynamicTCMutex;
+    std::condition_variable _dynamicTCCondition;
+    std::atomic<bool> _isDynamicTCThreadActive { false };
 };
 
 typedef cnoid::ref_ptr<TCSimulatorItem> TCSimulatorItemPtr;
@@ -29,3 +29,9 @@ void AbstractSceneLoader::setDefaultCreaseAngle(double /* theta */)
 {
 
 }
+
+
+void AbstractSceneLoader::setAppearanceLoadingEnabled(bool /* on */)
+{
+
+}
@@ -17,6 +17,15 @@ public:
     virtual void setMessageSink(std::ostream& os);
     virtual void setDefaultDivisionNumber(int n);
     virtual void setDefaultCreaseAngle(double theta);
+
+    /**
+       The materials, textures, texture coordinates and colors are not loaded when this is
+       disabled, which is used when the scene is only used for the collision detection.
+       The loaders which do not support this setting load them as usual.
+       The default value is true.
+    */
+    virtual void setAppearanceLoadingEnabled(bool on);
+
     virtual SgNode* load(const std::string& filename) = 0;
 };
 
@@ -117,6 +117,12 @@ double AbstractSeq::getTimeLength() const
 }
 
 
+void AbstractSeq::countMemoryUsage(MemoryUsageCounter& counter) const
+{
+    counter.add(sizeof(*this));
+}
+
+
 bool AbstractSeq::readSeq(const Mapping* archive, std::ostream& os)
 {
     bool result = false;
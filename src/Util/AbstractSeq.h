@@ -7,6 +7,7 @@
 #define CNOID_UTIL_ABSTRACT_SEQ_H
 
 #include "NullOut.h"
+#include "MemoryUsage.h"
 #include <string>
 #include <vector>
 #include <memory>
@@ -66,6 +67,12 @@ public:
     */
     double getTimeLength() const;
 
+    /**
+       Adds the bytes owned by the sequence to the counter.
+       The default implementation only counts the object itself.
+    */
+    virtual void countMemoryUsage(MemoryUsageCounter& counter) const;
+
     const std::string& seqContentName() {
         return contentName_;
     }
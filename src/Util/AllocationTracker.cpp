@@ -0,0 +1,110 @@
+/**
+   @file
+*/
+
+#include "AllocationTracker.h"
+#if defined(CNOID_ENABLE_ALLOCATION_TRACKING) && !defined(_WIN32)
+#define CNOID_REPLACE_OPERATOR_NEW
+#include <new>
+#include <cstdlib>
+#endif
+
+using namespace cnoid;
+
+namespace {
+
+// The counters have no constructors so that they can be used while a thread is starting or exiting
+thread_local int64_t threadAllocationCount = 0;
+thread_local int64_t threadAllocatedBytes = 0;
+
+}
+
+#ifdef CNOID_REPLACE_OPERATOR_NEW
+
+namespace {
+
+void* allocate(std::size_t size)
+{
+    ++threadAllocationCount;
+    threadAllocatedBytes += size;
+    return std::malloc(size ? size : 1);
+}
+
+}
+
+void* operator new(std::size_t size)
+{
+    if(void* p = allocate(size)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+#endif
+
+
+bool AllocationTracker::isAvailable()
+{
+#ifdef CNOID_REPLACE_OPERATOR_NEW
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+int64_t AllocationTracker::numThreadAllocations()
+{
+    return threadAllocationCount;
+}
+
+
+int64_t AllocationTracker::numThreadAllocatedBytes()
+{
+    return threadAllocatedBytes;
+}
@@ -0,0 +1,36 @@
+/**
+   @file
+*/
+
+#ifndef CNOID_UTIL_ALLOCATION_TRACKER_H
+#define CNOID_UTIL_ALLOCATION_TRACKER_H
+
+#include <cstdint>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+/**
+   Counts the heap allocations done by the global operator new in each thread.
+   The operators are replaced by this library when Choreonoid is built with the
+   ENABLE_ALLOCATION_TRACKING option, and the counters are always zero otherwise.
+   The allocations of a section of code are obtained as the increase of the counters
+   of the thread executing it. The allocations done by malloc directly are not counted.
+   On Windows, the operators of the other modules are not replaced, so the tracking is
+   not available.
+*/
+class CNOID_EXPORT AllocationTracker
+{
+public:
+    static bool isAvailable();
+
+    //! The number of the allocations done by the calling thread since it was started
+    static int64_t numThreadAllocations();
+
+    //! The total number of the bytes allocated by the calling thread since it was started
+    static int64_t numThreadAllocatedBytes();
+};
+
+}
+
+#endif
@@ -152,3 +152,22 @@ CollisionDetector::~CollisionDetector()
 {
 
 }
+
+
+void CollisionDetector::setGeometryResting(GeometryHandle /* geometry */, bool /* isResting */)
+{
+
+}
+
+
+void CollisionDetector::setGeometryCollisionFilter
+(GeometryHandle /* geometry */, uint32_t /* category */, uint32_t /* mask */)
+{
+
+}
+
+
+void CollisionDetector::setNumThreads(int /* n */)
+{
+
+}
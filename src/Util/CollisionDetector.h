@@ -10,6 +10,7 @@
 #include "Referenced.h"
 #include <boost/optional.hpp>
 #include <cstdint>
+#include <limits>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -49,6 +50,28 @@ public:
     virtual void setGeometryStatic(GeometryHandle geometry, bool isStatic = true) = 0;
     virtual void setNonInterfarenceGeometyrPair(GeometryHandle geometry1, GeometryHandle geometry2) = 0;
     virtual bool makeReady() = 0;
+
+    /**
+       A resting geometry is temporarily treated as a static geometry, so the pairs of
+       the resting and static geometries may not be tested. This can be called after
+       makeReady(). A detector which does not support it tests the pairs as usual.
+    */
+    virtual void setGeometryResting(GeometryHandle geometry, bool isResting = true);
+
+    /**
+       A pair of geometries is tested only when the category of each geometry has a common bit
+       with the mask of the other one. The category is 1 and the mask has all the bits by default.
+       This can be changed after makeReady() without rebuilding the pairs.
+       A detector which does not support it tests the pairs as usual.
+    */
+    virtual void setGeometryCollisionFilter(GeometryHandle geometry, uint32_t category, uint32_t mask);
+
+    /**
+       Sets the maximum number of the threads used to test the pairs in detectCollisions().
+       Zero means that the pairs are tested in the calling thread. This must be called before
+       makeReady(). A detector which does not support it ignores the setting.
+    */
+    virtual void setNumThreads(int n);
     
     virtual void updatePosition(GeometryHandle geometry, const Position& position) = 0;
     virtual void updatePositions(
@@ -66,6 +89,60 @@ public:
     virtual double detectDistance(
         CollisionDetector::GeometryHandle geometry1, CollisionDetector::GeometryHandle geometry2,
         Vector3& out_point1, Vector3& out_point2) = 0;
+
+    /**
+       Computes the distances of the geometry pairs, which may be done in parallel.
+       The computation of a pair stops when its distance is found to be larger than maxDistance,
+       and then a value larger than maxDistance is given.
+       \param geometryPairs The array of the 2 * numPairs handles of the pairs
+       \param out_points1, out_points2 The arrays of the closest points, which can be null
+       \note The default implementation calls detectDistance for each pair.
+    */
+    virtual void detectDistances(
+        const CollisionDetector::GeometryHandle* geometryPairs, int numPairs,
+        double* out_distances, Vector3* out_points1, Vector3* out_points2,
+        double maxDistance = std::numeric_limits<double>::max()) {
+        Vector3 p1, p2;
+        for(int i=0; i < numPairs; ++i){
+            out_distances[i] = detectDistance(geometryPairs[i * 2], geometryPairs[i * 2 + 1], p1, p2);
+            if(out_points1){ out_points1[i] = p1; }
+            if(out_points2){ out_points2[i] = p2; }
+        }
+    }
+
+    //! Computes the distances between a geometry and each of the geometries
+    virtual void detectDistances(
+        CollisionDetector::GeometryHandle geometry,
+        const CollisionDetector::GeometryHandle* geometries, int numGeometries,
+        double* out_distances, Vector3* out_points1, Vector3* out_points2,
+        double maxDistance = std::numeric_limits<double>::max()) {
+        Vector3 p1, p2;
+        for(int i=0; i < numGeometries; ++i){
+            out_distances[i] = detectDistance(geometry, geometries[i], p1, p2);
+            if(out_points1){ out_points1[i] = p1; }
+            if(out_points2){ out_points2[i] = p2; }
+        }
+    }
+};
+
+
+class CollisionDetectorRayCastAPI
+{
+public:
+    /**
+       Computes the distance from the origin to the nearest geometry along each of the rays,
+       which may be done in parallel. The positions of the geometries must not be updated
+       until this function returns.
+       \param directions The unit vectors of the directions in the world coordinate
+       \param out_distances The distances of the rays. A value larger than maxDistance is given
+       to a ray which does not hit any geometry between minDistance and maxDistance.
+       \param geometryFilter The geometries whose custom objects are rejected by this function are
+       not tested. All the geometries are tested when the function is empty.
+    */
+    virtual void castRays(
+        const Vector3& origin, const Vector3* directions, int numRays,
+        double minDistance, double maxDistance, double* out_distances,
+        std::function<bool(Referenced* object)> geometryFilter = nullptr) = 0;
 };
 
 
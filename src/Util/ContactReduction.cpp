@@ -0,0 +1,190 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#include "ContactReduction.h"
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+typedef Eigen::Vector2d Vector2;
+
+// The area gains and the distances smaller than this are regarded as zero
+const double TINY = 1.0e-12;
+
+double cross(const Vector2& o, const Vector2& a, const Vector2& b)
+{
+    return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+}
+
+/**
+   The area of the convex hull computed with the monotone chain algorithm.
+   The number of the points is at most the maximum number of the contact points,
+   so the hull is computed from scratch for each candidate.
+*/
+double calcConvexHullArea(vector<Vector2>& points)
+{
+    const int n = points.size();
+    if(n < 3){
+        return 0.0;
+    }
+    std::sort(points.begin(), points.end(),
+              [](const Vector2& a, const Vector2& b){
+                  return a.x() < b.x() || (a.x() == b.x() && a.y() < b.y()); });
+
+    vector<Vector2> hull(2 * n);
+    int k = 0;
+    for(int i=0; i < n; ++i){
+        while(k >= 2 && cross(hull[k-2], hull[k-1], points[i]) <= 0.0){
+            --k;
+        }
+        hull[k++] = points[i];
+    }
+    for(int i = n - 2, t = k + 1; i >= 0; --i){
+        while(k >= t && cross(hull[k-2], hull[k-1], points[i]) <= 0.0){
+            --k;
+        }
+        hull[k++] = points[i];
+    }
+
+    double area = 0.0;
+    for(int i=0; i < k - 1; ++i){
+        area += hull[i].x() * hull[i+1].y() - hull[i+1].x() * hull[i].y();
+    }
+    return 0.5 * std::abs(area);
+}
+
+}
+
+
+void cnoid::selectContactManifoldPoints
+(const CollisionArray& collisions, int maxNumPoints, std::vector<int>& out_indices)
+{
+    out_indices.clear();
+    const int n = collisions.size();
+
+    if(maxNumPoints <= 0 || n <= maxNumPoints){
+        for(int i=0; i < n; ++i){
+            out_indices.push_back(i);
+        }
+        return;
+    }
+
+    vector<bool> isSelected(n, false);
+
+    auto select = [&](int index){
+        out_indices.push_back(index);
+        isSelected[index] = true;
+    };
+
+    int deepest = 0;
+    for(int i=1; i < n; ++i){
+        if(collisions[i].depth > collisions[deepest].depth){
+            deepest = i;
+        }
+    }
+    select(deepest);
+    const Vector3& p0 = collisions[deepest].point;
+
+    int farthest = -1;
+    double maxDistance = TINY;
+    for(int i=0; i < n; ++i){
+        const double d = (collisions[i].point - p0).squaredNorm();
+        if(d > maxDistance){
+            maxDistance = d;
+            farthest = i;
+        }
+    }
+    if(farthest < 0){
+        return; // All the points are at the same position
+    }
+    select(farthest);
+
+    // The points are projected on the plane perpendicular to the normal of the deepest point
+    Vector3 normal = collisions[deepest].normal;
+    if(normal.squaredNorm() < TINY){
+        normal = Vector3::UnitZ();
+    } else {
+        normal.normalize();
+    }
+    Vector3 axis1 = (std::abs(normal.x()) < 0.9) ? normal.cross(Vector3::UnitX()) : normal.cross(Vector3::UnitY());
+    axis1.normalize();
+    const Vector3 axis2 = normal.cross(axis1);
+
+    vector<Vector2> projected(n);
+    for(int i=0; i < n; ++i){
+        const Vector3 d = collisions[i].point - p0;
+        projected[i] << d.dot(axis1), d.dot(axis2);
+    }
+
+    vector<Vector2> hullPoints;
+    hullPoints.reserve(maxNumPoints);
+    double currentArea = 0.0;
+
+    while((int)out_indices.size() < maxNumPoints){
+        int best = -1;
+        double maxArea = currentArea + TINY;
+        for(int i=0; i < n; ++i){
+            if(isSelected[i]){
+                continue;
+            }
+            hullPoints.clear();
+            for(auto index : out_indices){
+                hullPoints.push_back(projected[index]);
+            }
+            hullPoints.push_back(projected[i]);
+            const double area = calcConvexHullArea(hullPoints);
+            if(area > maxArea){
+                maxArea = area;
+                best = i;
+            }
+        }
+
+        if(best < 0 && currentArea < TINY){
+            // The points are on a line. The point farthest from the selected ones is added
+            // so that both ends of the line are kept.
+            double maxMinDistance = TINY;
+            for(int i=0; i < n; ++i){
+                if(isSelected[i]){
+                    continue;
+                }
+                double minDistance = std::numeric_limits<double>::max();
+                for(auto index : out_indices){
+                    minDistance = std::min(minDistance, (collisions[i].point - collisions[index].point).squaredNorm());
+                }
+                if(minDistance > maxMinDistance){
+                    maxMinDistance = minDistance;
+                    best = i;
+                }
+            }
+        } else if(best >= 0){
+            currentArea = maxArea;
+        }
+
+        if(best < 0){
+            break;
+        }
+        select(best);
+    }
+}
+
+
+void cnoid::reduceContactManifold(CollisionArray& collisions, int maxNumPoints)
+{
+    if(maxNumPoints <= 0 || (int)collisions.size() <= maxNumPoints){
+        return;
+    }
+    vector<int> indices;
+    selectContactManifoldPoints(collisions, maxNumPoints, indices);
+    CollisionArray reduced;
+    reduced.reserve(indices.size());
+    for(auto index : indices){
+        reduced.push_back(collisions[index]);
+    }
+    collisions.swap(reduced);
+}
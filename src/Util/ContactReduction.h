@@ -0,0 +1,34 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_UTIL_CONTACT_REDUCTION_H
+#define CNOID_UTIL_CONTACT_REDUCTION_H
+
+#include "Collision.h"
+#include "exportdecl.h"
+
+namespace cnoid {
+
+/**
+   Selects the representative points of the contact manifold of a pair of objects.
+   The deepest point is selected first, the point farthest from it second, and then the
+   points which enlarge the area spanned by the selected points most when the points are
+   projected on the contact plane. The selection stops when the remaining points do not
+   enlarge the area any more, so the result may have fewer points than maxNumPoints.
+   The function can be used by any simulator which receives the collisions of a pair
+   as CollisionArray.
+
+   \param maxNumPoints The maximum number of the selected points. The points are not reduced
+   if this is zero or the collisions do not have more points than this.
+   \param out_indices The indices of the selected collisions in the order of the selection
+*/
+CNOID_EXPORT void selectContactManifoldPoints(
+    const CollisionArray& collisions, int maxNumPoints, std::vector<int>& out_indices);
+
+//! The collisions which are not selected are removed.
+CNOID_EXPORT void reduceContactManifold(CollisionArray& collisions, int maxNumPoints);
+
+}
+
+#endif
@@ -0,0 +1,815 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#include "ConvexDecomposition.h"
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <array>
+#include <fstream>
+#include <mutex>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace cnoid;
+namespace filesystem = boost::filesystem;
+
+namespace {
+
+// This must be incremented when the format of the file or the decomposition is changed
+const uint32_t CACHE_VERSION = 1;
+
+const char CACHE_MAGIC[8] = { 'C', 'N', 'O', 'I', 'D', 'C', 'V', 'X' };
+
+// The points closer to a plane than this ratio to the size of the points are regarded as on the plane
+const double HULL_TOLERANCE_RATIO = 1.0e-6;
+
+// A piece is not split near its ends so that the both sides have volumes
+const double MIN_SPLIT_POSITION_RATIO = 0.05;
+
+// The hull faces nearly parallel to the normal of a surface point are not used to measure the concavity
+const double NORMAL_RAY_COS_EPSILON = 1.0e-6;
+
+std::mutex directoryMutex;
+std::string directory;
+bool isDirectoryInitialized = false;
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t hash;
+    uint32_t numHulls;
+    uint32_t reserved;
+};
+
+string getDirectory()
+{
+    std::lock_guard<std::mutex> lock(directoryMutex);
+    if(!isDirectoryInitialized){
+        if(const char* dir = getenv("CNOID_CONVEX_DECOMPOSITION_CACHE_DIR")){
+            directory = dir;
+        }
+        isDirectoryInitialized = true;
+    }
+    return directory;
+}
+
+typedef std::array<int, 3> Triangle;
+typedef std::array<Vector3, 3> TriangleVertices;
+
+/**
+   The quickhull algorithm. The visible faces of a point are found by testing all the faces,
+   which is fast enough because the number of the hull faces is much smaller than the points.
+*/
+class ConvexHullBuilder
+{
+public:
+    const vector<Vector3>& points;
+    double tolerance;
+
+    struct Face {
+        int v[3];
+        Vector3 normal;
+        double offset;
+        vector<int> outsidePoints;
+        bool isAlive;
+    };
+    vector<Face> faces;
+
+    ConvexHullBuilder(const vector<Vector3>& points) : points(points) { }
+
+    double distance(const Face& face, int point) const {
+        return face.normal.dot(points[point]) - face.offset;
+    }
+
+    bool addFace(int v0, int v1, int v2){
+        Face face;
+        face.v[0] = v0;
+        face.v[1] = v1;
+        face.v[2] = v2;
+        Vector3 n = (points[v1] - points[v0]).cross(points[v2] - points[v0]);
+        const double l = n.norm();
+        if(l <= 0.0){
+            return false;
+        }
+        face.normal = n / l;
+        face.offset = face.normal.dot(points[v0]);
+        face.isAlive = true;
+        faces.push_back(std::move(face));
+        return true;
+    }
+
+    void assignPoint(int point, int faceTop){
+        double maxDistance = tolerance;
+        int farthestFace = -1;
+        for(size_t i = faceTop; i < faces.size(); ++i){
+            if(faces[i].isAlive){
+                const double d = distance(faces[i], point);
+                if(d > maxDistance){
+                    maxDistance = d;
+                    farthestFace = i;
+                }
+            }
+        }
+        if(farthestFace >= 0){
+            faces[farthestFace].outsidePoints.push_back(point);
+        }
+    }
+
+    bool build();
+    void getHull(vector<Vector3>& out_vertices, vector<Triangle>& out_triangles) const;
+};
+
+
+bool ConvexHullBuilder::build()
+{
+    faces.clear();
+    const int n = points.size();
+    if(n < 4){
+        return false;
+    }
+
+    Vector3 minPos = points[0];
+    Vector3 maxPos = points[0];
+    int extremes[6] = { 0, 0, 0, 0, 0, 0 };
+    for(int i=1; i < n; ++i){
+        for(int j=0; j < 3; ++j){
+            if(points[i][j] < points[extremes[j * 2]][j]){
+                extremes[j * 2] = i;
+            }
+            if(points[i][j] > points[extremes[j * 2 + 1]][j]){
+                extremes[j * 2 + 1] = i;
+            }
+        }
+        minPos = minPos.cwiseMin(points[i]);
+        maxPos = maxPos.cwiseMax(points[i]);
+    }
+    tolerance = HULL_TOLERANCE_RATIO * std::max((maxPos - minPos).maxCoeff(), maxPos.cwiseAbs().cwiseMax(minPos.cwiseAbs()).maxCoeff());
+
+    // The initial tetrahedron
+    int i0 = -1, i1 = -1;
+    double maxDistance = 0.0;
+    for(int i=0; i < 6; ++i){
+        for(int j = i + 1; j < 6; ++j){
+            const double d = (points[extremes[i]] - points[extremes[j]]).squaredNorm();
+            if(d > maxDistance){
+                maxDistance = d;
+                i0 = extremes[i];
+                i1 = extremes[j];
+            }
+        }
+    }
+    if(i0 < 0 || sqrt(maxDistance) <= tolerance){
+        return false;
+    }
+    const Vector3 axis = (points[i1] - points[i0]).normalized();
+    int i2 = -1;
+    maxDistance = tolerance;
+    for(int i=0; i < n; ++i){
+        const double d = (points[i] - points[i0]).cross(axis).norm();
+        if(d > maxDistance){
+            maxDistance = d;
+            i2 = i;
+        }
+    }
+    if(i2 < 0){
+        return false;
+    }
+    const Vector3 normal = axis.cross(points[i2] - points[i0]).normalized();
+    int i3 = -1;
+    maxDistance = tolerance;
+    for(int i=0; i < n; ++i){
+        const double d = fabs(normal.dot(points[i] - points[i0]));
+        if(d > maxDistance){
+            maxDistance = d;
+            i3 = i;
+        }
+    }
+    if(i3 < 0){
+        return false;
+    }
+    if(normal.dot(points[i3] - points[i0]) > 0.0){
+        std::swap(i1, i2);
+    }
+    addFace(i0, i1, i2);
+    addFace(i0, i3, i1);
+    addFace(i1, i3, i2);
+    addFace(i2, i3, i0);
+    if(faces.size() != 4){
+        return false;
+    }
+
+    for(int i=0; i < n; ++i){
+        if(i != i0 && i != i1 && i != i2 && i != i3){
+            assignPoint(i, 0);
+        }
+    }
+
+    unordered_set<int64_t> visibleEdges;
+    vector<int> visibleFaces;
+    vector<std::pair<int, int>> horizon;
+    vector<int> orphans;
+
+    while(true){
+        int currentFace = -1;
+        for(size_t i=0; i < faces.size(); ++i){
+            if(faces[i].isAlive && !faces[i].outsidePoints.empty()){
+                currentFace = i;
+                break;
+            }
+        }
+        if(currentFace < 0){
+            break;
+        }
+        int eye = -1;
+        maxDistance = 0.0;
+        for(auto point : faces[currentFace].outsidePoints){
+            const double d = distance(faces[currentFace], point);
+            if(d > maxDistance){
+                maxDistance = d;
+                eye = point;
+            }
+        }
+
+        visibleFaces.clear();
+        visibleEdges.clear();
+        for(size_t i=0; i < faces.size(); ++i){
+            Face& face = faces[i];
+            if(face.isAlive && (static_cast<int>(i) == currentFace || distance(face, eye) > tolerance)){
+                visibleFaces.push_back(i);
+                for(int j=0; j < 3; ++j){
+                    visibleEdges.insert((static_cast<int64_t>(face.v[j]) << 32) | face.v[(j + 1) % 3]);
+                }
+            }
+        }
+        horizon.clear();
+        orphans.clear();
+        for(auto i : visibleFaces){
+            Face& face = faces[i];
+            for(int j=0; j < 3; ++j){
+                const int a = face.v[j];
+                const int b = face.v[(j + 1) % 3];
+                if(visibleEdges.find((static_cast<int64_t>(b) << 32) | a) == visibleEdges.end()){
+                    horizon.emplace_back(a, b);
+                }
+            }
+            for(auto point : face.outsidePoints){
+                if(point != eye){
+                    orphans.push_back(point);
+                }
+            }
+            face.outsidePoints.clear();
+            face.isAlive = false;
+        }
+
+        const int faceTop = faces.size();
+        for(auto& edge : horizon){
+            addFace(edge.first, edge.second, eye);
+        }
+        for(auto point : orphans){
+            assignPoint(point, faceTop);
+        }
+    }
+
+    return true;
+}
+
+
+void ConvexHullBuilder::getHull(vector<Vector3>& out_vertices, vector<Triangle>& out_triangles) const
+{
+    out_vertices.clear();
+    out_triangles.clear();
+    unordered_map<int, int> indexMap;
+    for(auto& face : faces){
+        if(face.isAlive){
+            Triangle triangle;
+            for(int i=0; i < 3; ++i){
+                auto inserted = indexMap.emplace(face.v[i], out_vertices.size());
+                if(inserted.second){
+                    out_vertices.push_back(points[face.v[i]]);
+                }
+                triangle[i] = inserted.first->second;
+            }
+            out_triangles.push_back(triangle);
+        }
+    }
+}
+
+
+struct Piece
+{
+    vector<TriangleVertices> triangles;
+    vector<Vector3> hullVertices;
+    vector<Triangle> hullTriangles;
+    double concavity;
+    Vector3 deepestPoint;
+    bool isSplittable;
+
+    /**
+       The concavity is the maximum distance from the surface of the piece to its convex hull
+       along the normals of the surface. The distance is measured at the vertices and the
+       centroids of the triangles because a concave vertex may be on a face of the hull.
+       \return false if the piece does not have a volume
+    */
+    bool update(){
+        vector<Vector3> points;
+        points.reserve(triangles.size() * 3);
+        for(auto& triangle : triangles){
+            for(auto& v : triangle){
+                points.push_back(v);
+            }
+        }
+        ConvexHullBuilder builder(points);
+        if(!builder.build()){
+            return false;
+        }
+        builder.getHull(hullVertices, hullTriangles);
+
+        vector<std::pair<Vector3, double>> planes;
+        planes.reserve(hullTriangles.size());
+        for(auto& t : hullTriangles){
+            Vector3 n = (hullVertices[t[1]] - hullVertices[t[0]]).cross(hullVertices[t[2]] - hullVertices[t[0]]);
+            n.normalize();
+            planes.emplace_back(n, n.dot(hullVertices[t[0]]));
+        }
+        concavity = 0.0;
+        deepestPoint = points.front();
+        for(auto& triangle : triangles){
+            Vector3 normal = (triangle[1] - triangle[0]).cross(triangle[2] - triangle[0]);
+            const double l = normal.norm();
+            if(l <= 0.0){
+                continue;
+            }
+            normal /= l;
+            const Vector3 samples[4] = {
+                triangle[0], triangle[1], triangle[2], (triangle[0] + triangle[1] + triangle[2]) / 3.0 };
+            for(auto& p : samples){
+                double distance = std::numeric_limits<double>::max();
+                for(auto& plane : planes){
+                    const double c = plane.first.dot(normal);
+                    if(c > NORMAL_RAY_COS_EPSILON){
+                        distance = std::min(distance, (plane.second - plane.first.dot(p)) / c);
+                    }
+                }
+                if(distance != std::numeric_limits<double>::max() && distance > concavity){
+                    concavity = distance;
+                    deepestPoint = p;
+                }
+            }
+        }
+        isSplittable = true;
+        return true;
+    }
+};
+
+
+void splitTriangle
+(const TriangleVertices& triangle, int axis, double position,
+ vector<TriangleVertices>& out_lower, vector<TriangleVertices>& out_upper)
+{
+    double s[3];
+    int numUpper = 0;
+    int numLower = 0;
+    for(int i=0; i < 3; ++i){
+        s[i] = triangle[i][axis] - position;
+        if(s[i] > 0.0){
+            ++numUpper;
+        } else if(s[i] < 0.0){
+            ++numLower;
+        }
+    }
+    if(numUpper == 0){
+        out_lower.push_back(triangle);
+        return;
+    }
+    if(numLower == 0){
+        out_upper.push_back(triangle);
+        return;
+    }
+
+    // The polygons of the both sides, which are triangulated as fans
+    vector<Vector3> lower;
+    vector<Vector3> upper;
+    for(int i=0; i < 3; ++i){
+        const Vector3& p1 = triangle[i];
+        const Vector3& p2 = triangle[(i + 1) % 3];
+        const double s1 = s[i];
+        const double s2 = s[(i + 1) % 3];
+        if(s1 <= 0.0){
+            lower.push_back(p1);
+        }
+        if(s1 >= 0.0){
+            upper.push_back(p1);
+        }
+        if((s1 < 0.0 && s2 > 0.0) || (s1 > 0.0 && s2 < 0.0)){
+            Vector3 p = p1 + (p2 - p1) * (s1 / (s1 - s2));
+            p[axis] = position;
+            lower.push_back(p);
+            upper.push_back(p);
+        }
+    }
+    for(size_t i=1; i + 1 < lower.size(); ++i){
+        out_lower.push_back(TriangleVertices{{ lower[0], lower[i], lower[i + 1] }});
+    }
+    for(size_t i=1; i + 1 < upper.size(); ++i){
+        out_upper.push_back(TriangleVertices{{ upper[0], upper[i], upper[i + 1] }});
+    }
+}
+
+
+bool splitPiece(const Piece& piece, int axis, Piece& out_lower, Piece& out_upper)
+{
+    double minPos = std::numeric_limits<double>::max();
+    double maxPos = -minPos;
+    for(auto& v : piece.hullVertices){
+        minPos = std::min(minPos, v[axis]);
+        maxPos = std::max(maxPos, v[axis]);
+    }
+    const double margin = (maxPos - minPos) * MIN_SPLIT_POSITION_RATIO;
+    const double position = std::max(minPos + margin, std::min(maxPos - margin, piece.deepestPoint[axis]));
+
+    out_lower.triangles.clear();
+    out_upper.triangles.clear();
+    for(auto& triangle : piece.triangles){
+        splitTriangle(triangle, axis, position, out_lower.triangles, out_upper.triangles);
+    }
+    return out_lower.update() && out_upper.update();
+}
+
+
+uint64_t computeHash(SgMesh* mesh, double concavityTolerance, int maxNumPieces)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](const void* data, size_t size){
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for(size_t i=0; i < size; ++i){
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    add(&CACHE_VERSION, sizeof(CACHE_VERSION));
+    add(&concavityTolerance, sizeof(concavityTolerance));
+    add(&maxNumPieces, sizeof(maxNumPieces));
+    const SgVertexArray& vertices = *mesh->vertices();
+    for(auto& v : vertices){
+        add(v.data(), sizeof(float) * 3);
+    }
+    const SgIndexArray& indices = mesh->triangleVertices();
+    for(auto index : indices){
+        const int32_t i = index;
+        add(&i, sizeof(i));
+    }
+    return hash;
+}
+
+}
+
+namespace cnoid {
+
+class ConvexDecompositionImpl
+{
+public:
+    double concavityTolerance;
+    int maxNumPieces;
+    std::mutex cacheMutex;
+    unordered_map<uint64_t, vector<SgMeshPtr>> cache;
+
+    ConvexDecompositionImpl();
+    void decompose(SgMesh* mesh, vector<SgMeshPtr>& out_hulls);
+    bool load(const string& filename, uint64_t hash, vector<SgMeshPtr>& out_hulls);
+    void save(const string& filename, uint64_t hash, const vector<SgMeshPtr>& hulls);
+};
+
+}
+
+
+ConvexDecomposition* ConvexDecomposition::instance()
+{
+    static ConvexDecomposition decomposition;
+    return &decomposition;
+}
+
+
+void ConvexDecomposition::setCacheDirectory(const std::string& dir)
+{
+    std::lock_guard<std::mutex> lock(directoryMutex);
+    directory = dir;
+    isDirectoryInitialized = true;
+}
+
+
+ConvexDecomposition::ConvexDecomposition()
+{
+    impl = new ConvexDecompositionImpl;
+}
+
+
+ConvexDecompositionImpl::ConvexDecompositionImpl()
+{
+    concavityTolerance = 0.02;
+    maxNumPieces = 32;
+}
+
+
+ConvexDecomposition::~ConvexDecomposition()
+{
+    delete impl;
+}
+
+
+void ConvexDecomposition::setConcavityTolerance(double ratio)
+{
+    std::lock_guard<std::mutex> lock(impl->cacheMutex);
+    impl->concavityTolerance = ratio;
+}
+
+
+double ConvexDecomposition::concavityTolerance() const
+{
+    return impl->concavityTolerance;
+}
+
+
+void ConvexDecomposition::setMaxNumPieces(int n)
+{
+    std::lock_guard<std::mutex> lock(impl->cacheMutex);
+    impl->maxNumPieces = std::max(1, n);
+}
+
+
+int ConvexDecomposition::maxNumPieces() const
+{
+    return impl->maxNumPieces;
+}
+
+
+void ConvexDecomposition::clearCache()
+{
+    std::lock_guard<std::mutex> lock(impl->cacheMutex);
+    impl->cache.clear();
+}
+
+
+std::vector<SgMeshPtr> ConvexDecomposition::decompose(SgMesh* mesh)
+{
+    vector<SgMeshPtr> hulls;
+    if(!mesh->hasVertices() || mesh->triangleVertices().empty()){
+        return hulls;
+    }
+
+    double concavityTolerance;
+    int maxNumPieces;
+    {
+        std::lock_guard<std::mutex> lock(impl->cacheMutex);
+        concavityTolerance = impl->concavityTolerance;
+        maxNumPieces = impl->maxNumPieces;
+    }
+    const uint64_t hash = computeHash(mesh, concavityTolerance, maxNumPieces);
+    {
+        std::lock_guard<std::mutex> lock(impl->cacheMutex);
+        auto p = impl->cache.find(hash);
+        if(p != impl->cache.end()){
+            return p->second;
+        }
+    }
+
+    string filename;
+    string dir = getDirectory();
+    if(!dir.empty()){
+        filename = (filesystem::path(dir) / fmt::format("{:016x}.cvx", hash)).string();
+    }
+    if(filename.empty() || !impl->load(filename, hash, hulls)){
+        impl->decompose(mesh, hulls);
+        if(!filename.empty()){
+            impl->save(filename, hash, hulls);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(impl->cacheMutex);
+    impl->cache[hash] = hulls;
+    return hulls;
+}
+
+
+/**
+   The most concave piece is split first until the number of the pieces reaches the maximum.
+   A piece is split by the plane through its deepest vertex which is perpendicular to one of
+   the coordinate axes, and the axis giving the less concave pieces is selected.
+*/
+void ConvexDecompositionImpl::decompose(SgMesh* mesh, vector<SgMeshPtr>& out_hulls)
+{
+    vector<Piece> pieces(1);
+    Piece& whole = pieces.front();
+    const SgVertexArray& vertices = *mesh->vertices();
+    const int numTriangles = mesh->numTriangles();
+    whole.triangles.reserve(numTriangles);
+    BoundingBox bbox;
+    for(auto& v : vertices){
+        bbox.expandBy(v.cast<double>());
+    }
+    for(int i=0; i < numTriangles; ++i){
+        auto triangle = mesh->triangle(i);
+        whole.triangles.push_back(
+            TriangleVertices{{ vertices[triangle[0]].cast<double>(),
+                               vertices[triangle[1]].cast<double>(),
+                               vertices[triangle[2]].cast<double>() }});
+    }
+    if(!whole.update()){
+        return;
+    }
+    const double tolerance = concavityTolerance * (bbox.max() - bbox.min()).norm();
+
+    while(static_cast<int>(pieces.size()) < maxNumPieces){
+        int target = -1;
+        double maxConcavity = tolerance;
+        for(size_t i=0; i < pieces.size(); ++i){
+            if(pieces[i].isSplittable && pieces[i].concavity > maxConcavity){
+                maxConcavity = pieces[i].concavity;
+                target = i;
+            }
+        }
+        if(target < 0){
+            break;
+        }
+        Piece bestLower, bestUpper;
+        double minConcavity = std::numeric_limits<double>::max();
+        for(int axis=0; axis < 3; ++axis){
+            Piece lower, upper;
+            if(splitPiece(pieces[target], axis, lower, upper)){
+                const double concavity = std::max(lower.concavity, upper.concavity);
+                if(concavity < minConcavity){
+                    minConcavity = concavity;
+                    bestLower = std::move(lower);
+                    bestUpper = std::move(upper);
+                }
+            }
+        }
+        if(minConcavity == std::numeric_limits<double>::max()){
+            pieces[target].isSplittable = false;
+        } else {
+            pieces[target] = std::move(bestLower);
+            pieces.push_back(std::move(bestUpper));
+        }
+    }
+
+    for(auto& piece : pieces){
+        SgMeshPtr hull = new SgMesh;
+        SgVertexArray& hullVertices = *hull->getOrCreateVertices(piece.hullVertices.size());
+        for(size_t i=0; i < piece.hullVertices.size(); ++i){
+            hullVertices[i] = piece.hullVertices[i].cast<float>();
+        }
+        hull->reserveNumTriangles(piece.hullTriangles.size());
+        for(auto& t : piece.hullTriangles){
+            hull->addTriangle(t[0], t[1], t[2]);
+        }
+        hull->updateBoundingBox();
+        out_hulls.push_back(hull);
+    }
+}
+
+
+SgMesh* ConvexDecomposition::createConvexHull(const SgVertexArray& points)
+{
+    vector<Vector3> positions;
+    positions.reserve(points.size());
+    for(auto& p : points){
+        positions.push_back(p.cast<double>());
+    }
+    ConvexHullBuilder builder(positions);
+    if(!builder.build()){
+        return nullptr;
+    }
+    vector<Vector3> vertices;
+    vector<Triangle> triangles;
+    builder.getHull(vertices, triangles);
+
+    auto hull = new SgMesh;
+    SgVertexArray& hullVertices = *hull->getOrCreateVertices(vertices.size());
+    for(size_t i=0; i < vertices.size(); ++i){
+        hullVertices[i] = vertices[i].cast<float>();
+    }
+    hull->reserveNumTriangles(triangles.size());
+    for(auto& t : triangles){
+        hull->addTriangle(t[0], t[1], t[2]);
+    }
+    hull->updateBoundingBox();
+    return hull;
+}
+
+
+bool ConvexDecompositionImpl::load(const string& filename, uint64_t hash, vector<SgMeshPtr>& out_hulls)
+{
+    ifstream file(filename, ios::in | ios::binary);
+    if(!file){
+        return false;
+    }
+    FileHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if(!file ||
+       memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+       header.version != CACHE_VERSION ||
+       header.headerSize != sizeof(FileHeader) ||
+       header.hash != hash){
+        return false;
+    }
+    vector<SgMeshPtr> hulls;
+    for(uint32_t i=0; i < header.numHulls; ++i){
+        uint32_t sizes[2];
+        file.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+        if(!file){
+            return false;
+        }
+        const uint32_t numVertices = sizes[0];
+        const uint32_t numTriangles = sizes[1];
+        vector<float> vertexData(numVertices * 3);
+        vector<int32_t> indices(numTriangles * 3);
+        file.read(reinterpret_cast<char*>(vertexData.data()), vertexData.size() * sizeof(float));
+        file.read(reinterpret_cast<char*>(indices.data()), indices.size() * sizeof(int32_t));
+        if(!file){
+            return false;
+        }
+        SgMeshPtr hull = new SgMesh;
+        SgVertexArray& vertices = *hull->getOrCreateVertices(numVertices);
+        for(uint32_t j=0; j < numVertices; ++j){
+            vertices[j] << vertexData[j * 3], vertexData[j * 3 + 1], vertexData[j * 3 + 2];
+        }
+        hull->reserveNumTriangles(numTriangles);
+        for(uint32_t j=0; j < numTriangles; ++j){
+            for(int k=0; k < 3; ++k){
+                if(indices[j * 3 + k] < 0 || indices[j * 3 + k] >= static_cast<int32_t>(numVertices)){
+                    return false;
+                }
+            }
+            hull->addTriangle(indices[j * 3], indices[j * 3 + 1], indices[j * 3 + 2]);
+        }
+        hull->updateBoundingBox();
+        hulls.push_back(hull);
+    }
+    out_hulls = std::move(hulls);
+    return true;
+}
+
+
+/**
+   The file is written with a temporary name and renamed so that the other processes
+   decomposing the same mesh do not read an incomplete file.
+*/
+void ConvexDecompositionImpl::save(const string& filename, uint64_t hash, const vector<SgMeshPtr>& hulls)
+{
+    boost::system::error_code ec;
+    filesystem::path path(filename);
+    filesystem::create_directories(path.parent_path(), ec);
+    if(ec){
+        return;
+    }
+    filesystem::path tmpPath = path.parent_path() / filesystem::unique_path("%%%%-%%%%-%%%%.tmp", ec);
+    if(ec){
+        return;
+    }
+
+    {
+        ofstream file(tmpPath.string(), ios::out | ios::binary);
+        if(!file){
+            return;
+        }
+        FileHeader header;
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = CACHE_VERSION;
+        header.headerSize = sizeof(FileHeader);
+        header.hash = hash;
+        header.numHulls = hulls.size();
+        header.reserved = 0;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for(auto& hull : hulls){
+            const SgVertexArray& vertices = *hull->vertices();
+            const SgIndexArray& indices = hull->triangleVertices();
+            const uint32_t sizes[2] = {
+                static_cast<uint32_t>(vertices.size()), static_cast<uint32_t>(indices.size() / 3) };
+            file.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+            for(auto& v : vertices){
+                file.write(reinterpret_cast<const char*>(v.data()), sizeof(float) * 3);
+            }
+            for(auto index : indices){
+                const int32_t i = index;
+                file.write(reinterpret_cast<const char*>(&i), sizeof(i));
+            }
+        }
+
+        if(!file){
+            file.close();
+            filesystem::remove(tmpPath, ec);
+            return;
+        }
+    }
+
+    filesystem::rename(tmpPath, path, ec);
+    if(ec){
+        filesystem::remove(tmpPath, ec);
+    }
+}
@@ -0,0 +1,69 @@
+/**
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_UTIL_CONVEX_DECOMPOSITION_H
+#define CNOID_UTIL_CONVEX_DECOMPOSITION_H
+
+#include "SceneDrawables.h"
+#include <vector>
+#include <string>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class ConvexDecompositionImpl;
+
+/**
+   This class decomposes a triangle mesh into convex pieces for the collision detection.
+   A piece is split by the plane through its most concave vertex until the concavity of
+   every piece is within the tolerance, and the convex hulls of the pieces are given.
+   The results are cached in memory by the hash of the mesh and the parameters, and are
+   also saved in the cache directory so that they can be shared by the processes.
+*/
+class CNOID_EXPORT ConvexDecomposition
+{
+public:
+    //! The process-wide instance, which is shared by the simulators
+    static ConvexDecomposition* instance();
+
+    /**
+       The cache directory can also be given by the environment variable
+       CNOID_CONVEX_DECOMPOSITION_CACHE_DIR. The cache files are not used when it is empty.
+    */
+    static void setCacheDirectory(const std::string& directory);
+
+    ConvexDecomposition();
+    ~ConvexDecomposition();
+
+    ConvexDecomposition(const ConvexDecomposition&) = delete;
+    ConvexDecomposition& operator=(const ConvexDecomposition&) = delete;
+
+    //! The ratio of the allowed concavity to the diagonal length of the bounding box of the mesh
+    void setConcavityTolerance(double ratio);
+    double concavityTolerance() const;
+
+    void setMaxNumPieces(int n);
+    int maxNumPieces() const;
+
+    /**
+       This function is thread-safe.
+       \return The convex hulls of the pieces, which are in the coordinate of the mesh.
+       The array is empty when the mesh does not have a volume.
+    */
+    std::vector<SgMeshPtr> decompose(SgMesh* mesh);
+
+    /**
+       \return The convex hull of the points, or null when the points do not have a volume
+    */
+    static SgMesh* createConvexHull(const SgVertexArray& points);
+
+    void clearCache();
+
+private:
+    ConvexDecompositionImpl* impl;
+};
+
+}
+
+#endif
@@ -6,12 +6,21 @@
 #ifndef CNOID_UTIL_DEQUE_2D_H
 #define CNOID_UTIL_DEQUE_2D_H
 
+#include <Eigen/Core>
 #include <memory>
 #include <iterator>
+#include <type_traits>
+#include <algorithm>
 
 namespace cnoid {
 
-template <typename ElementType, typename Allocator = std::allocator<ElementType>>
+/**
+   The elements are stored in a ring buffer of rows, and the elements of a row are contiguous.
+   The default allocator aligns the buffer so that the rows can be mapped to Eigen objects
+   and processed with vectorized instructions. The capacity is expanded geometrically,
+   so appending a row is amortized O(1).
+*/
+template <typename ElementType, typename Allocator = Eigen::aligned_allocator<ElementType>>
 class Deque2D
 {
     typedef Deque2D<ElementType, Allocator> Deque2DType;
@@ -165,7 +174,7 @@ public:
             size_ = owner.colSize_;
             top = owner.buf;
             if(owner.capacity_ > 0){
-                top += (owner.offset + rowIndex * owner.colSize_) % owner.capacity_;
+                top += owner.ringIndex(rowIndex * owner.colSize_);
             }
         }
 
@@ -224,11 +233,11 @@ public:
         }
 
         Element& operator[](int rowIndex){
-            return top[(offset + rowIndex * colSize) % capacity];
+            return top[index(rowIndex)];
         }
 
         const Element& operator[](int rowIndex) const {
-            return top[(offset + rowIndex * colSize) % capacity];
+            return top[index(rowIndex)];
         }
 
         Element& at(int index) {
@@ -284,6 +293,15 @@ public:
         }
 
     private:
+        int index(int rowIndex) const {
+            // This is faster than the modulo operation
+            int i = offset + rowIndex * colSize;
+            if(i >= capacity){
+                i -= capacity;
+            }
+            return i;
+        }
+        
         ElementType* top;
         int offset;
         int colSize;
@@ -372,7 +390,7 @@ public:
                     allocator.destroy(q);
                 }
             }
-            allocator.deallocate(buf, capacity_);
+            releaseBuffer();
         }
     }
 
@@ -380,7 +398,42 @@ public:
         return !rowSize_ || !colSize_;
     }
 
+    /**
+       The given buffer, which has the elements of the rows and the area of one more row for
+       the end iterator, is used as the storage without copying the elements. The holder keeps
+       the buffer alive while it is used. The elements are moved to the memory of the allocator
+       when the storage is reallocated.
+    */
+    void setExternalBuffer(ElementType* externalBuf, int rowSize, int colSize, std::shared_ptr<void> holder) {
+        static_assert(std::is_trivially_copyable<ElementType>::value,
+                      "The external buffer is only available for trivially copyable elements");
+        clear();
+        if(rowSize > 0 && colSize > 0){
+            buf = externalBuf;
+            externalBufHolder = holder;
+            offset = 0;
+            rowSize_ = rowSize;
+            colSize_ = colSize;
+            size_ = rowSize * colSize;
+            capacity_ = size_ + colSize;
+            end_ = iterator(*this, buf + size_);
+        }
+    }
+
+    bool hasExternalBuffer() const {
+        return externalBufHolder != nullptr;
+    }
+
 private:
+    void releaseBuffer() {
+        if(externalBufHolder){
+            externalBufHolder.reset();
+        } else {
+            allocator.deallocate(buf, capacity_);
+        }
+    }
+    
+
     void reallocMemory(int newColSize, int newSize, int newCapacity, bool doCopy) {
 
         ElementType* newBuf;
@@ -400,15 +453,15 @@ private:
                 ElementType* q = buf + offset;
                 if(q <= qend){
                     while(q != qend && p != pend){
-                        allocator.construct(p++, *q++);
+                        allocator.construct(p++, std::move(*q++));
                     }
                 } else {
-                    for(ElementType* r = buf; r != qend && p != pend; ++r){
-                        allocator.construct(p++, *r);
-                    }
                     ElementType* qterm = buf + capacity_;
                     for(ElementType* r = q; r != qterm && p != pend; ++r){
-                        allocator.construct(p++, *r);
+                        allocator.construct(p++, std::move(*r));
+                    }
+                    for(ElementType* r = buf; r != qend && p != pend; ++r){
+                        allocator.construct(p++, std::move(*r));
                     }
                 }
             }
@@ -435,7 +488,7 @@ private:
         }
 
         if(buf){
-            allocator.deallocate(buf, capacity_);
+            releaseBuffer();
         }
         buf = newBuf;
         capacity_ = newCapacity;
@@ -503,13 +556,10 @@ private:
                         }
                     }
                 } else {
-                    int newCapacity;
-                    const int expandedSize = size_ * 3 / 2;
-                    if(expandedSize > newSize){
-                        newCapacity = expandedSize - (expandedSize % newColSize) + newColSize;
-                    } else {
-                        newCapacity = minCapacity;
-                    }
+                    // The capacity is expanded geometrically based on the current capacity
+                    const int expandedCapacity = capacity_ + capacity_ / 2;
+                    const int newCapacity =
+                        std::max(minCapacity, expandedCapacity - (expandedCapacity % newColSize));
                     reallocMemory(newColSize, newSize, newCapacity, doCopy);
                 }
             }
@@ -545,24 +595,43 @@ public:
         return colSize_;
     }
 
+    //! The number of the elements allocated in the ring buffer
+    int capacity() const {
+        return capacity_;
+    }
+
     void clear() {
         resize(0, 0);
     }
 
+    //! The memory for the given number of rows is allocated so that appending rows does not reallocate it
+    void reserve(int numRows) {
+        const int minCapacity = (numRows + 1) * colSize_;
+        if(colSize_ > 0 && minCapacity > capacity_){
+            reallocMemory(colSize_, size_, minCapacity, true);
+            end_ = iterator(*this, buf + size_);
+        }
+    }
+
+    //! The number of the rows which can be stored without reallocating the memory
+    int rowCapacity() const {
+        return (colSize_ > 0 && capacity_ > 0) ? (capacity_ / colSize_ - 1) : 0;
+    }
+
     const Element& operator()(int rowIndex, int colIndex) const {
-        return buf[(offset + (rowIndex * colSize_)) % capacity_ + colIndex];
+        return buf[ringIndex(rowIndex * colSize_) + colIndex];
     }
 
     Element& operator()(int rowIndex, int colIndex) {
-        return buf[(offset + (rowIndex * colSize_)) % capacity_ + colIndex];
+        return buf[ringIndex(rowIndex * colSize_) + colIndex];
     }
 
     const Element& at(int rowIndex, int colIndex) const {
-        return buf[(offset + (rowIndex * colSize_)) % capacity_ + colIndex];
+        return buf[ringIndex(rowIndex * colSize_) + colIndex];
     }
 
     Element& at(int rowIndex, int colIndex) {
-        return buf[(offset + (rowIndex * colSize_)) % capacity_ + colIndex];
+        return buf[ringIndex(rowIndex * colSize_) + colIndex];
     }
 
     Row operator[](int rowIndex) {
@@ -597,6 +666,30 @@ public:
         return Column(*this, colIndex);
     }
     
+    /**
+       Copies the elements of a column to a contiguous array. The buffer is scanned in at most
+       two segments separated by the end of the ring buffer, so this is faster than accessing
+       the elements by Column::operator[].
+    */
+    template<class OutputIterator>
+    void copyColumnTo(int colIndex, OutputIterator out) const {
+        forEachColumnSegment(colIndex, [&](ElementType* p, ElementType* pend){
+                for( ; p != pend; p += colSize_){
+                    *out++ = *p;
+                }
+            });
+    }
+
+    //! Sets the elements of a column from a contiguous array in the same way as copyColumnTo
+    template<class InputIterator>
+    void setColumnFrom(int colIndex, InputIterator in) {
+        forEachColumnSegment(colIndex, [&](ElementType* p, ElementType* pend){
+                for( ; p != pend; p += colSize_){
+                    *p = *in++;
+                }
+            });
+    }
+
     Row append() {
         resize(rowSize_ + 1, colSize_);
         return Row(*this, rowSize_ - 1);
@@ -641,8 +734,33 @@ public:
 
 
 private:
+    int ringIndex(int index) const {
+        index += offset;
+        if(index >= capacity_){
+            index -= capacity_;
+        }
+        return index;
+    }
+
+    template<class Function>
+    void forEachColumnSegment(int colIndex, Function func) const {
+        if(size_ == 0){
+            return;
+        }
+        ElementType* p = buf + offset + colIndex;
+        const int numRowsToTerm = (capacity_ - offset) / colSize_;
+        if(rowSize_ <= numRowsToTerm){
+            func(p, p + rowSize_ * colSize_);
+        } else {
+            func(p, p + numRowsToTerm * colSize_);
+            p = buf + colIndex;
+            func(p, p + (rowSize_ - numRowsToTerm) * colSize_);
+        }
+    }
+    
     Allocator allocator;
     ElementType* buf;
+    std::shared_ptr<void> externalBufHolder;
     int offset;
     int rowSize_;
     int colSize_;
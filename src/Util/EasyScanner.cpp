@@ -10,6 +10,8 @@
 #include <cstdlib>
 #include <cmath>
 #include <cstring>
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <fmt/format.h>
 #include <errno.h>
@@ -19,6 +21,165 @@ using namespace std;
 using namespace cnoid;
 using fmt::format;
 
+namespace {
+
+const double exactDoublePowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+const float exactFloatPowersOf10[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+template<class T> struct ExactDecimal;
+
+template<> struct ExactDecimal<double> {
+    static const uint64_t maxMantissa = uint64_t(1) << 53;
+    static const int maxExponent = 22;
+    static double powerOf10(int e) { return exactDoublePowersOf10[e]; }
+};
+
+template<> struct ExactDecimal<float> {
+    static const uint64_t maxMantissa = uint64_t(1) << 24;
+    static const int maxExponent = 10;
+    static float powerOf10(int e) { return exactFloatPowersOf10[e]; }
+};
+
+/**
+   Converts a number in the plain decimal notation without calling strtod / strtof.
+   The conversion is only done when the mantissa and the power of ten are exactly representable
+   by the type, in which case a single multiplication or division gives the correctly rounded
+   value, which is the same as the value given by strtod / strtof. False is returned for the
+   other cases, and then the standard function must be used.
+*/
+template<class T> bool readExactDecimal(char*& text, T& out_value)
+{
+    const char* p = text;
+    bool isNegative = false;
+    if(*p == '-'){
+        isNegative = true;
+        ++p;
+    } else if(*p == '+'){
+        ++p;
+    }
+
+    uint64_t mantissa = 0;
+    int numSignificantDigits = 0;
+    int exponent = 0;
+    bool hasDigits = false;
+    
+    while(*p >= '0' && *p <= '9'){
+        if(numSignificantDigits > 0 || *p != '0'){
+            if(++numSignificantDigits > 19){
+                return false;
+            }
+        }
+        mantissa = mantissa * 10 + (*p - '0');
+        hasDigits = true;
+        ++p;
+    }
+    if(*p == '.'){
+        ++p;
+        while(*p >= '0' && *p <= '9'){
+            if(numSignificantDigits > 0 || *p != '0'){
+                if(++numSignificantDigits > 19){
+                    return false;
+                }
+            }
+            mantissa = mantissa * 10 + (*p - '0');
+            --exponent;
+            hasDigits = true;
+            ++p;
+        }
+    }
+    if(!hasDigits){
+        return false;
+    }
+    if(*p == 'e' || *p == 'E'){
+        const char* q = p + 1;
+        bool isExponentNegative = false;
+        if(*q == '-'){
+            isExponentNegative = true;
+            ++q;
+        } else if(*q == '+'){
+            ++q;
+        }
+        if(*q >= '0' && *q <= '9'){
+            int e = 0;
+            while(*q >= '0' && *q <= '9'){
+                if(e < 10000){
+                    e = e * 10 + (*q - '0');
+                }
+                ++q;
+            }
+            exponent += isExponentNegative ? -e : e;
+            p = q;
+        }
+    }
+    // Hexadecimal values, infinity, NaN and so on are left to the standard function
+    if(isalpha((unsigned char)*p) || *p == '.'){
+        return false;
+    }
+
+    T value;
+    if(mantissa == 0){
+        value = 0;
+    } else if(mantissa > ExactDecimal<T>::maxMantissa ||
+              exponent < -ExactDecimal<T>::maxExponent || exponent > ExactDecimal<T>::maxExponent){
+        return false;
+    } else if(exponent < 0){
+        value = static_cast<T>(mantissa) / ExactDecimal<T>::powerOf10(-exponent);
+    } else {
+        value = static_cast<T>(mantissa) * ExactDecimal<T>::powerOf10(exponent);
+    }
+    out_value = isNegative ? -value : value;
+    text = const_cast<char*>(p);
+    return true;
+}
+
+/**
+   Converts a decimal integer which is read by strtol with the same result.
+   The values which may exceed the range of int, the octal values and the hexadecimal
+   values are left to strtol.
+*/
+bool readSimpleInt(char*& text, int& out_value)
+{
+    const char* p = text;
+    bool isNegative = false;
+    if(*p == '-'){
+        isNegative = true;
+        ++p;
+    } else if(*p == '+'){
+        ++p;
+    }
+    if(*p < '0' || *p > '9' || (*p == '0' && (isalnum((unsigned char)p[1])))){
+        return false;
+    }
+    int value = 0;
+    int numDigits = 0;
+    while(*p >= '0' && *p <= '9'){
+        if(++numDigits > 9){
+            return false;
+        }
+        value = value * 10 + (*p - '0');
+        ++p;
+    }
+    out_value = isNegative ? -value : value;
+    text = const_cast<char*>(p);
+    return true;
+}
+
+inline void strtoValue(char* text, char** tail, float& out_value)
+{
+    out_value = cnoid::strtof(text, tail);
+}
+
+inline void strtoValue(char* text, char** tail, double& out_value)
+{
+    out_value = cnoid::strtod(text, tail);
+}
+
+}
+
 
 std::string EasyScanner::Exception::getFullMessage() const
 {
@@ -67,6 +228,9 @@ void EasyScanner::init()
 
     whiteSpaceChars.push_back(' ');
     whiteSpaceChars.push_back('\t');
+    std::fill(isWhiteSpaceChar, isWhiteSpaceChar + 256, false);
+    isWhiteSpaceChar[(unsigned char)' '] = true;
+    isWhiteSpaceChar[(unsigned char)'\t'] = true;
 
     symbols.reset(new SymbolMap());
 }
@@ -80,6 +244,7 @@ void EasyScanner::init()
 EasyScanner::EasyScanner(const EasyScanner& org, bool copyText) :
     whiteSpaceChars(org.whiteSpaceChars)
 {
+    std::copy(org.isWhiteSpaceChar, org.isWhiteSpaceChar + 256, isWhiteSpaceChar);
     commentChar = org.commentChar;
     quoteChar = org.quoteChar;
     isLineOriented = org.isLineOriented;
@@ -185,6 +350,7 @@ void EasyScanner::setLineOriented(bool on)
 void EasyScanner::setWhiteSpaceChar(char ws)
 {
     whiteSpaceChars.push_back(ws);
+    isWhiteSpaceChar[(unsigned char)ws] = true;
 }
 
 
@@ -249,16 +415,9 @@ void EasyScanner::skipToLineEnd()
 
 void EasyScanner::skipSpace()
 {
-    int n = whiteSpaceChars.size();
     while(true){
-        int i=0;
-        while(i < n){
-            if(*text == whiteSpaceChars[i]){
-                text++;
-                i = 0;
-            } else {
-                i++;
-            }
+        while(isWhiteSpaceChar[(unsigned char)*text]){
+            text++;
         }
         if(*text == commentChar){
             text++;
@@ -418,6 +577,10 @@ bool EasyScanner::readFloat()
 
     if(checkLF()) return false;
 
+    if(readExactDecimal(text, floatValue)){
+        return true;
+    }
+
     floatValue = cnoid::strtof(text, &tail);
 
     if(tail != text){
@@ -435,6 +598,10 @@ bool EasyScanner::readDouble()
 
     if(checkLF()) return false;
 
+    if(readExactDecimal(text, doubleValue)){
+        return true;
+    }
+
     doubleValue = cnoid::strtod(text, &tail);
 
     if(tail != text){
@@ -446,12 +613,65 @@ bool EasyScanner::readDouble()
 }
 
 
+/**
+   The white spaces before a value are skipped in the loop, and skipSpace() and checkLF()
+   are only called when other characters such as a comment or a line feed appear.
+*/
+template<class T> int EasyScanner::readNumbers(T* out_values, int maxNumValues)
+{
+    int numValues = 0;
+    char* p = text;
+    
+    while(numValues < maxNumValues){
+        while(isWhiteSpaceChar[(unsigned char)*p]){
+            ++p;
+        }
+        const char c = *p;
+        if(!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.')){
+            text = p;
+            if(checkLF()){
+                break;
+            }
+            p = text;
+        }
+        if(!readExactDecimal(p, out_values[numValues])){
+            char* tail;
+            strtoValue(p, &tail, out_values[numValues]);
+            if(tail == p){
+                break;
+            }
+            p = tail;
+        }
+        ++numValues;
+    }
+
+    text = p;
+    return numValues;
+}
+
+
+int EasyScanner::readFloats(float* out_values, int maxNumValues)
+{
+    return readNumbers(out_values, maxNumValues);
+}
+
+
+int EasyScanner::readDoubles(double* out_values, int maxNumValues)
+{
+    return readNumbers(out_values, maxNumValues);
+}
+
+
 bool EasyScanner::readInt()
 {
     char* tail;
 
     if(checkLF()) return false;
 
+    if(readSimpleInt(text, intValue)){
+        return true;
+    }
+
     intValue = strtol(text, &tail, 0);
     if(tail != text){
         text = tail;
@@ -90,6 +90,15 @@ public:
     bool readFloat();
     bool readDouble();
     bool readInt();
+
+    /**
+       Reads the numbers into the buffer in a single call.
+       Reading stops when maxNumValues values are read, the next token is not a number,
+       or the end of the line is reached in the line oriented mode. The line feed is not consumed.
+       \return The number of the values read
+    */
+    int readFloats(float* out_values, int maxNumValues);
+    int readDoubles(double* out_values, int maxNumValues);
     bool readChar();
     bool readChar(int chara);
     int  peekChar();
@@ -258,6 +267,7 @@ private:
     bool readLF0();
     bool readWord0();
     bool readString0(const int delimiterChar);
+    template<class T> int readNumbers(T* out_values, int maxNumValues);
     
     char* textBuf;
     size_t size;
@@ -268,6 +278,7 @@ private:
     bool isLineOriented;
 
     std::vector<int> whiteSpaceChars;
+    bool isWhiteSpaceChar[256];
 
     std::shared_ptr<SymbolMap> symbols;
 
@@ -0,0 +1,112 @@
+/**
+   @file
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_UTIL_FLAT_MAP_H
+#define CNOID_UTIL_FLAT_MAP_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+namespace cnoid {
+
+/**
+   A map container which stores the elements in a vector sorted by the keys.
+   The iteration order is same as std::map, and a lookup is a binary search over contiguous
+   memory without the node allocation of each element. Inserting an element moves the
+   following elements, but appending an element with the largest key, which is the common
+   case of the sorted input, does not. Inserting or erasing an element invalidates the iterators.
+*/
+template <class Key, class T, class Compare = std::less<Key>>
+class FlatMap
+{
+public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<Key, T> value_type;
+    typedef std::vector<value_type> Container;
+    typedef typename Container::iterator iterator;
+    typedef typename Container::const_iterator const_iterator;
+    typedef typename Container::size_type size_type;
+
+    bool empty() const { return elements.empty(); }
+    size_type size() const { return elements.size(); }
+    void clear() { elements.clear(); }
+    void reserve(size_type n) { elements.reserve(n); }
+
+    iterator begin() { return elements.begin(); }
+    iterator end() { return elements.end(); }
+    const_iterator begin() const { return elements.begin(); }
+    const_iterator end() const { return elements.end(); }
+
+    iterator lower_bound(const Key& key) {
+        return std::lower_bound(elements.begin(), elements.end(), key, KeyCompare());
+    }
+    const_iterator lower_bound(const Key& key) const {
+        return std::lower_bound(elements.begin(), elements.end(), key, KeyCompare());
+    }
+
+    iterator find(const Key& key) {
+        iterator p = lower_bound(key);
+        return (p != elements.end() && !Compare()(key, p->first)) ? p : elements.end();
+    }
+    const_iterator find(const Key& key) const {
+        const_iterator p = lower_bound(key);
+        return (p != elements.end() && !Compare()(key, p->first)) ? p : elements.end();
+    }
+
+    //! The existing element is not replaced as std::map::emplace
+    template <class K, class V>
+    std::pair<iterator, bool> emplace(K&& key, V&& value) {
+        if(elements.empty() || Compare()(elements.back().first, key)){
+            elements.emplace_back(std::forward<K>(key), std::forward<V>(value));
+            return std::make_pair(elements.end() - 1, true);
+        }
+        iterator p = lower_bound(key);
+        if(!Compare()(key, p->first)){
+            return std::make_pair(p, false);
+        }
+        p = elements.emplace(p, std::forward<K>(key), std::forward<V>(value));
+        return std::make_pair(p, true);
+    }
+
+    template <class InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+        for(InputIterator p = first; p != last; ++p){
+            emplace(p->first, p->second);
+        }
+    }
+
+    T& operator[](const Key& key) {
+        return emplace(key, T()).first->second;
+    }
+
+    iterator erase(const_iterator position) {
+        return elements.erase(position);
+    }
+
+    size_type erase(const Key& key) {
+        iterator p = find(key);
+        if(p == elements.end()){
+            return 0;
+        }
+        elements.erase(p);
+        return 1;
+    }
+
+private:
+    struct KeyCompare {
+        bool operator()(const value_type& element, const Key& key) const {
+            return Compare()(element.first, key);
+        }
+    };
+
+    Container elements;
+};
+
+}
+
+#endif
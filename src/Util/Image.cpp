@@ -7,10 +7,71 @@
 #include "ImageIO.h"
 #include "Exception.h"
 #include <fmt/format.h>
+#include <algorithm>
+#include <cstring>
 
 using namespace std;
 using namespace cnoid;
 
+namespace {
+
+/*
+  The following functions convert a row of pixels. The loops do not have any branch
+  so that the compiler can vectorize them.
+*/
+
+inline unsigned char luminance(const unsigned char* rgb)
+{
+    // ITU-R BT.601 weights in the 8-bit fixed point
+    return (77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2] + 128) >> 8;
+}
+
+void convertRow(const unsigned char* src, int srcComponents, unsigned char* dest, int destComponents, int width)
+{
+    const bool srcHasAlpha = (srcComponents % 2) == 0;
+    const bool destHasAlpha = (destComponents % 2) == 0;
+    const bool srcIsGray = srcComponents <= 2;
+    const bool destIsGray = destComponents <= 2;
+
+    if(srcIsGray == destIsGray){
+        const int n = srcIsGray ? 1 : 3;
+        if(destHasAlpha && srcHasAlpha){
+            for(int x=0; x < width; ++x){
+                std::memcpy(dest + x * destComponents, src + x * srcComponents, destComponents);
+            }
+        } else if(destHasAlpha){
+            for(int x=0; x < width; ++x){
+                std::memcpy(dest + x * destComponents, src + x * srcComponents, n);
+                dest[x * destComponents + n] = 255;
+            }
+        } else {
+            for(int x=0; x < width; ++x){
+                std::memcpy(dest + x * destComponents, src + x * srcComponents, n);
+            }
+        }
+    } else if(srcIsGray){
+        for(int x=0; x < width; ++x){
+            const unsigned char* s = src + x * srcComponents;
+            unsigned char* d = dest + x * destComponents;
+            d[0] = d[1] = d[2] = s[0];
+            if(destHasAlpha){
+                d[3] = srcHasAlpha ? s[1] : 255;
+            }
+        }
+    } else {
+        for(int x=0; x < width; ++x){
+            const unsigned char* s = src + x * srcComponents;
+            unsigned char* d = dest + x * destComponents;
+            d[0] = luminance(s);
+            if(destHasAlpha){
+                d[1] = srcHasAlpha ? s[3] : 255;
+            }
+        }
+    }
+}
+
+}
+
 
 Image::Image()
 {
@@ -75,6 +136,26 @@ void Image::setSize(int width, int height)
 }
 
 
+void Image::assign(const ImageRegion& region, int nComponents)
+{
+    if(nComponents <= 0){
+        nComponents = region.numComponents();
+    }
+    setSize(region.width(), region.height(), nComponents);
+
+    const int lineSize = rowSize();
+    unsigned char* dest = pixels_.data();
+    for(int y=0; y < height_; ++y){
+        if(nComponents == region.numComponents()){
+            std::memcpy(dest, region.row(y), lineSize);
+        } else {
+            convertRow(region.row(y), region.numComponents(), dest, nComponents, width_);
+        }
+        dest += lineSize;
+    }
+}
+
+
 void Image::clear()
 {
     std::fill(pixels_.begin(), pixels_.end(), 0);
@@ -84,19 +165,31 @@ void Image::clear()
 void Image::applyVerticalFlip()
 {
     const int heightHalf = height_ / 2;
-    const int lineSize = width_ * numComponents_;
-    unsigned char* upperLine = pixels();
-    unsigned char* lowerLine = pixels() + lineSize * (height_ - 1);
+    const int lineSize = rowSize();
+    unsigned char* upperLine = pixels_.data();
+    unsigned char* lowerLine = pixels_.data() + lineSize * (height_ - 1);
     for(int y = 0; y < heightHalf; ++y){
-        for(int x=0; x < lineSize; ++x){
-            std::swap(upperLine[x], lowerLine[x]);
-        }
+        std::swap_ranges(upperLine, upperLine + lineSize, lowerLine);
         upperLine += lineSize;
         lowerLine -= lineSize;
     }
 }
 
 
+void Image::swapRedAndBlue()
+{
+    if(numComponents_ < 3){
+        return;
+    }
+    const int n = numComponents_;
+    const int numPixels = width_ * height_;
+    unsigned char* p = pixels_.data();
+    for(int i=0; i < numPixels; ++i){
+        std::swap(p[i * n], p[i * n + 2]);
+    }
+}
+
+
     
 void Image::load(const std::string& filename)
 {
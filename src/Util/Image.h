@@ -6,12 +6,44 @@
 #ifndef CNOID_UTIL_IMAGE_H
 #define CNOID_UTIL_IMAGE_H
 
+#include <Eigen/Core>
 #include <string>
 #include <vector>
 #include "exportdecl.h"
 
 namespace cnoid {
 
+/**
+   A read-only view of the pixels of an image or an external buffer such as a mapped pixel buffer.
+   The rows are separated by rowStride bytes, which may be larger than the row size for a sub-region
+   and negative for the rows stored from the bottom.
+*/
+class ImageRegion
+{
+public:
+    ImageRegion(const unsigned char* top, int width, int height, int numComponents, int rowStride)
+        : top_(top), width_(width), height_(height), numComponents_(numComponents), rowStride_(rowStride) { }
+
+    const unsigned char* row(int y) const { return top_ + y * rowStride_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int numComponents() const { return numComponents_; }
+    int rowStride() const { return rowStride_; }
+
+    //! The view whose rows are in the reverse order
+    ImageRegion flipped() const {
+        return ImageRegion(row(height_ - 1), width_, height_, numComponents_, -rowStride_);
+    }
+        
+private:
+    const unsigned char* top_;
+    int width_;
+    int height_;
+    int numComponents_;
+    int rowStride_;
+};
+
+
 class CNOID_EXPORT Image
 {
 public:
@@ -24,6 +56,10 @@ public:
     void reset();
     bool empty() const { return pixels_.empty(); }
 
+    /**
+       The pixels are stored row by row without any padding, and the buffer is aligned
+       so that the conversion loops can be vectorized.
+    */
     unsigned char* pixels() { return &pixels_.front(); }
     const unsigned char* pixels() const { return &pixels_.front(); }
 
@@ -31,18 +67,41 @@ public:
     int height() const { return height_; }
     int numComponents() const { return numComponents_; }
     bool hasAlphaComponent() const { return (numComponents() % 2) == 0; }
+    int rowSize() const { return width_ * numComponents_; }
 
     void setSize(int width, int height, int nComponents);
     void setSize(int width, int height);
 
+    ImageRegion region() const {
+        return ImageRegion(pixels_.data(), width_, height_, numComponents_, rowSize());
+    }
+    ImageRegion region(int x, int y, int width, int height) const {
+        return ImageRegion(pixels_.data() + y * rowSize() + x * numComponents_,
+                           width, height, numComponents_, rowSize());
+    }
+
+    /**
+       Copies the pixels of the region. The pixel format is converted when the number of
+       components is different. Gray and RGB (1 or 3 components) and their alpha versions
+       (2 or 4 components) are converted to each other, and the alpha value is 255 when it
+       is not given. The region must not be a view of this image.
+    */
+    void assign(const ImageRegion& region, int nComponents = 0);
+
     void clear();
     void applyVerticalFlip();
 
+    //! Converts RGB to BGR and RGBA to BGRA, or the opposite
+    void swapRedAndBlue();
+
     void load(const std::string& filename);
     void save(const std::string& filename) const;
 
+    //! The number of bytes used by the object and the allocated pixel buffer
+    size_t memorySize() const { return sizeof(*this) + pixels_.capacity(); }
+
 private:
-    std::vector<unsigned char> pixels_;
+    std::vector<unsigned char, Eigen::aligned_allocator<unsigned char>> pixels_;
     int width_;
     int height_;
     int numComponents_;
@@ -8,7 +8,11 @@
 #include "Exception.h"
 #include <fmt/format.h>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
 #include <png.h>
+#include <map>
+#include <mutex>
+#include <ctime>
 
 extern "C" {
 #define XMD_H
@@ -21,6 +25,30 @@ using namespace cnoid;
 
 namespace {
 
+struct SharedImageInfo
+{
+    /**
+       The cache has the strong reference so that the image is always copied by SgImage
+       before it is modified. The image is released when this is the only reference.
+    */
+    std::shared_ptr<Image> image;
+    std::time_t time;
+    uintmax_t size;
+};
+
+map<pair<string, bool>, SharedImageInfo> sharedImageCache;
+std::mutex sharedImageCacheMutex;
+
+bool getFileStamp(const string& filename, std::time_t& out_time, uintmax_t& out_size)
+{
+    boost::system::error_code ec;
+    out_time = filesystem::last_write_time(filename, ec);
+    if(!ec){
+        out_size = filesystem::file_size(filename, ec);
+    }
+    return !ec;
+}
+
 void throwLoadException(const string& filename, const std::string& description)
 {
     exception_base exception;
@@ -318,30 +346,22 @@ void loadTGA(Image& image, const std::string& filename, bool isUpsideDown)
 
     image.setSize(width, height, bytesPerPixel);
 
+    // The rows are read in bulk and the BGR(A) pixels are converted to RGB(A) at once
     unsigned char* pixels = image.pixels();
+    const unsigned int rowSize = image.rowSize();
     for(unsigned int i=0; i<height; i++){
         unsigned int row;
         if(isUpsideDown){
-            row = (height-1-i) * width * bytesPerPixel;
+            row = (height-1-i) * rowSize;
         }else{
-            row = i * width * bytesPerPixel;
+            row = i * rowSize;
         }
-
-        for(unsigned int j=0, k=row; j<width; j++){
-
-            unsigned char imageBuf[4];
-            if( fread(imageBuf, 1, bytesPerPixel, fp)!=bytesPerPixel ){
-                fclose(fp);
-                throwLoadException(filename, "Internal error." );
-            }
-
-            pixels[k++] = imageBuf[2];
-            pixels[k++] = imageBuf[1];
-            pixels[k++] = imageBuf[0];
-            if(bytesPerPixel==4)
-                pixels[k++] = imageBuf[3];
+        if( fread(&pixels[row], 1, rowSize, fp)!=rowSize ){
+            fclose(fp);
+            throwLoadException(filename, "Internal error." );
         }
     }
+    image.swapRedAndBlue();
 
     fclose (fp);
 
@@ -370,6 +390,60 @@ void ImageIO::load(Image& image, const std::string& filename)
 }
 
 
+std::shared_ptr<Image> ImageIO::loadSharedImage(const std::string& filename)
+{
+    const auto key = make_pair(filename, isUpsideDown_);
+    std::time_t time;
+    uintmax_t size;
+    const bool hasStamp = getFileStamp(filename, time, size);
+
+    if(hasStamp){
+        lock_guard<std::mutex> lock(sharedImageCacheMutex);
+        auto p = sharedImageCache.find(key);
+        if(p != sharedImageCache.end()){
+            auto& info = p->second;
+            if(info.time == time && info.size == size){
+                return info.image;
+            }
+            sharedImageCache.erase(p);
+        }
+    }
+
+    // The image is decoded without locking the mutex so that the different images are decoded in parallel
+    auto image = std::make_shared<Image>();
+    load(*image, filename);
+
+    if(hasStamp){
+        lock_guard<std::mutex> lock(sharedImageCacheMutex);
+        auto p = sharedImageCache.begin();
+        while(p != sharedImageCache.end()){
+            if(p->second.image.use_count() == 1){
+                p = sharedImageCache.erase(p);
+            } else {
+                ++p;
+            }
+        }
+        auto& info = sharedImageCache[key];
+        if(info.image && info.time == time && info.size == size){
+            // The same image has been decoded by another thread
+            return info.image;
+        }
+        info.image = image;
+        info.time = time;
+        info.size = size;
+    }
+
+    return image;
+}
+
+
+void ImageIO::clearSharedImageCache()
+{
+    lock_guard<std::mutex> lock(sharedImageCacheMutex);
+    sharedImageCache.clear();
+}
+
+
 void ImageIO::save(const Image& image, const std::string& filename)
 {
     if(iends_with(filename, "png")){
@@ -7,6 +7,7 @@
 #define CNOID_UTIL_IMAGE_IO_H
 
 #include "Image.h"
+#include <memory>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -22,6 +23,17 @@ public:
     void allocateAlphaComponent(bool on);
         
     void load(Image& image, const std::string& filename);
+
+    /**
+       The decoded images are shared in the process by the file names and the upside-down
+       settings, so the file which is already decoded is not decoded again unless it has been
+       modified. The returned image must be used with the copy-on-write of SgImage, and the
+       images which are only referenced by the cache are released when another image is
+       loaded by this function or the cache is cleared. This function is thread-safe.
+    */
+    std::shared_ptr<Image> loadSharedImage(const std::string& filename);
+    static void clearSharedImageCache();
+    
     void save(const Image& image, const std::string& filename);
 
 private:
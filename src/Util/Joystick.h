@@ -69,6 +69,21 @@ public:
     bool getButtonUp(int button) const;
     bool getButtonHold(int button, int duration/*(msec)*/) const;
     bool getButtonHoldOn(int button, int duration/*(msec)*/) const;
+
+    /**
+       When the input thread is enabled, the events of the device are read by a dedicated
+       thread and readCurrentState only takes the latest state published by the thread.
+       The signals are emitted in the thread calling readCurrentState. The file descriptor
+       must not be read by another reader such as a socket notifier in this mode.
+    */
+    bool setInputThreadEnabled(bool on);
+    bool isInputThreadEnabled() const;
+
+    /**
+       The elapsed time (sec) from the reception of the last event reflected in the current
+       state to the readCurrentState call that took the state.
+    */
+    double stateLatency() const;
 #endif
     
     bool isActive() const;
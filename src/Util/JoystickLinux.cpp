@@ -9,10 +9,13 @@
 #include <boost/filesystem.hpp>
 #include <linux/joystick.h>
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <string>
 #include <vector>
 #include <map>
 #include <chrono>
+#include <thread>
+#include <atomic>
 #include <cerrno>
 #include <cstring>
 #include <cmath>
@@ -162,6 +165,8 @@ const map<string, ModelID> modelIdMap = {
     { "Logitech Gamepad F310", F310 }
 };
 
+const int inputThreadPollingTimeout = 100; // msec
+
 const vector<ModelInfo> modelInfos = {
     { PS4,         PS4_Axes,   PS4_Buttons,   true  },
     { PS4v2,       PS4v2_Axes, PS4v2_Buttons, true  },
@@ -183,14 +188,28 @@ public:
     ExtJoystick* extJoystick;
     int fd;
     ModelInfo currentModel;
-    
-    vector<double> axes;
+
+    struct InputState
+    {
+        vector<double> axes;
+        vector<bool> buttons;
+        vector<chrono::system_clock::time_point> buttonDownTime;
+        // The time when the last event was received from the device
+        chrono::steady_clock::time_point eventTime;
+    };
+
+    /*
+      The state updated by the events read from the device. It is owned by the input
+      thread while the thread is running, and otherwise it is the current state itself.
+    */
+    InputState deviceState;
+    InputState* currentState;
+
     vector<bool> axisEnabled;
+    vector<double> prevAxes;
     Signal<void(int id, double position)> sigAxis;
     
-    vector<bool> buttons;
     vector<bool> prevButtons;
-    vector<chrono::system_clock::time_point> buttonDownTime;
     vector<bool> buttonHoldValid;
     Signal<void(int id, bool isPressed)> sigButton;
 
@@ -198,6 +217,26 @@ public:
     vector<double> initial_pos;
     vector<bool> initialized;
 
+    /*
+      The states published by the input thread are exchanged with the reader by
+      a triple buffer so that neither side blocks the other. latestInputStateIndex
+      is the index of the buffer that is not used by either side, and
+      NewInputStateFlag is set to it when the buffer has a state the reader has
+      not taken yet.
+    */
+    enum { NewInputStateFlag = 4, InputStateIndexMask = 3 };
+    InputState inputStates[3];
+    std::atomic<int> latestInputStateIndex;
+    int writingInputStateIndex;
+    int readingInputStateIndex;
+    std::thread inputThread;
+    std::atomic<bool> isInputThreadStopRequested;
+    std::atomic<int> inputThreadErrorNumber;
+    bool isInputThreadActive;
+
+    chrono::steady_clock::time_point lastStateEventTime;
+    double stateLatency;
+
     string errorMessage;
 
     JoystickImpl(Joystick* self, const string& device);
@@ -206,7 +245,12 @@ public:
     bool openDevice(const string& device);
     bool setupDevice();
     void closeDevice();
+    bool startInputThread();
+    void stopInputThread();
+    void inputThreadMain();
+    void publishInputState();
     bool readCurrentState();
+    bool readPublishedInputState();
     bool readEvent();
     void setAxisState(int id, double pos);
 };
@@ -230,6 +274,12 @@ JoystickImpl::JoystickImpl(Joystick* self, const string& device)
     : self(self)
 {
     fd = -1;
+    currentState = &deviceState;
+    latestInputStateIndex = 0;
+    isInputThreadStopRequested = false;
+    inputThreadErrorNumber = 0;
+    isInputThreadActive = false;
+    stateLatency = 0.0;
 
     extJoystick = ExtJoystick::findJoystick(device);
 
@@ -334,11 +384,12 @@ bool JoystickImpl::setupDevice()
         numAxes = NUM_AXES;
         numButtons = NUM_BUTTONS;
     }
-    axes.resize(numAxes, 0.0);
+    deviceState.axes.resize(numAxes, 0.0);
     axisEnabled.resize(numAxes, true);
-    buttons.resize(numButtons, false);
+    prevAxes.resize(numAxes, 0.0);
+    deviceState.buttons.resize(numButtons, false);
     prevButtons.resize(numButtons, false);
-    buttonDownTime.resize(numButtons);
+    deviceState.buttonDownTime.resize(numButtons);
     buttonHoldValid.resize(numButtons, false);
 
     if(currentModel.doIgnoreInitialState){
@@ -366,6 +417,8 @@ JoystickImpl::~JoystickImpl()
 
 void JoystickImpl::closeDevice()
 {
+    stopInputThread();
+    
     if(fd >= 0){
         close(fd);
         fd = -1;
@@ -393,16 +446,22 @@ int Joystick::fileDescriptor() const
 
 int Joystick::numAxes() const
 {
-    return impl->extJoystick ? impl->extJoystick->numAxes() : impl->axes.size();
+    return impl->extJoystick ? impl->extJoystick->numAxes() : impl->currentState->axes.size();
 }
 
 
 void Joystick::setAxisEnabled(int axis, bool on)
 {
     if(!impl->extJoystick){
-        if(axis < static_cast<int>(impl->axes.size())){
-            impl->axes[axis] = 0.0;
+        if(axis < static_cast<int>(impl->deviceState.axes.size())){
+            // The axis state is owned by the input thread while it is running
+            bool isInputThreadActive = impl->isInputThreadActive;
+            impl->stopInputThread();
+            impl->deviceState.axes[axis] = 0.0;
             impl->axisEnabled[axis] = on;
+            if(isInputThreadActive){
+                impl->startInputThread();
+            }
         }
     }
 }
@@ -410,7 +469,7 @@ void Joystick::setAxisEnabled(int axis, bool on)
 
 int Joystick::numButtons() const
 {
-    return impl->extJoystick ? impl->extJoystick->numButtons() : impl->buttons.size();
+    return impl->extJoystick ? impl->extJoystick->numButtons() : impl->currentState->buttons.size();
 }
 
 
@@ -420,14 +479,173 @@ bool Joystick::readCurrentState()
 }
 
 
+/**
+   The input thread blocks on the device and publishes the state for every burst of
+   the events, so that the state read by the controllers in the simulation loop does
+   not depend on the timing of the thread that calls readCurrentState.
+*/
+bool Joystick::setInputThreadEnabled(bool on)
+{
+    if(on){
+        return impl->startInputThread();
+    }
+    impl->stopInputThread();
+    return true;
+}
+
+
+bool Joystick::isInputThreadEnabled() const
+{
+    return impl->isInputThreadActive;
+}
+
+
+bool JoystickImpl::startInputThread()
+{
+    if(isInputThreadActive){
+        return true;
+    }
+    if(extJoystick || fd < 0){
+        return false;
+    }
+
+    for(auto& state : inputStates){
+        state = deviceState;
+    }
+    writingInputStateIndex = 0;
+    readingInputStateIndex = 1;
+    latestInputStateIndex = 2;
+    currentState = &inputStates[readingInputStateIndex];
+    isInputThreadStopRequested = false;
+    inputThreadErrorNumber = 0;
+
+    // This flag must be set before the thread starts because it is also checked in readEvent
+    isInputThreadActive = true;
+    inputThread = std::thread([this](){ inputThreadMain(); });
+
+    return true;
+}
+
+
+void JoystickImpl::stopInputThread()
+{
+    if(isInputThreadActive){
+        isInputThreadStopRequested = true;
+        inputThread.join();
+        isInputThreadActive = false;
+        currentState = &deviceState;
+    }
+}
+
+
+void JoystickImpl::inputThreadMain()
+{
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while(!isInputThreadStopRequested){
+        int result = poll(&pfd, 1, inputThreadPollingTimeout);
+        if(result < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            inputThreadErrorNumber = errno;
+            break;
+        }
+        if(result > 0){
+            bool updated = false;
+            while(readEvent()){
+                updated = true;
+            }
+            if(updated){
+                publishInputState();
+            }
+            if(inputThreadErrorNumber){
+                break;
+            }
+        }
+    }
+}
+
+
+void JoystickImpl::publishInputState()
+{
+    InputState& state = inputStates[writingInputStateIndex];
+    state.axes = deviceState.axes;
+    state.buttons = deviceState.buttons;
+    state.buttonDownTime = deviceState.buttonDownTime;
+    state.eventTime = deviceState.eventTime;
+
+    writingInputStateIndex =
+        latestInputStateIndex.exchange(writingInputStateIndex | NewInputStateFlag, std::memory_order_acq_rel)
+        & InputStateIndexMask;
+}
+
+
 bool JoystickImpl::readCurrentState()
 {
-    prevButtons = buttons;
-    while(readEvent());
+    prevButtons = currentState->buttons;
+
+    bool updated = false;
+    if(isInputThreadActive){
+        updated = readPublishedInputState();
+    } else {
+        while(readEvent()){
+            updated = true;
+        }
+    }
+    if(updated){
+        auto eventTime = currentState->eventTime;
+        if(eventTime != lastStateEventTime){
+            stateLatency = chrono::duration<double>(chrono::steady_clock::now() - eventTime).count();
+            lastStateEventTime = eventTime;
+        }
+    }
+    
     return (fd >= 0);
 }
 
 
+bool JoystickImpl::readPublishedInputState()
+{
+    if(inputThreadErrorNumber){
+        int errorNumber = inputThreadErrorNumber;
+        stopInputThread();
+        errorMessage = strerror(errorNumber);
+        closeDevice();
+        return false;
+    }
+    
+    if(!(latestInputStateIndex.load(std::memory_order_acquire) & NewInputStateFlag)){
+        return false;
+    }
+    readingInputStateIndex =
+        latestInputStateIndex.exchange(readingInputStateIndex, std::memory_order_acq_rel) & InputStateIndexMask;
+    currentState = &inputStates[readingInputStateIndex];
+
+    // The signals are emitted in the thread reading the state instead of the input thread
+    auto& axes = currentState->axes;
+    for(size_t i=0; i < axes.size(); ++i){
+        if(axes[i] != prevAxes[i]){
+            prevAxes[i] = axes[i];
+            sigAxis(i, axes[i]);
+        }
+    }
+    auto& buttons = currentState->buttons;
+    for(size_t i=0; i < buttons.size(); ++i){
+        if(buttons[i] != prevButtons[i]){
+            if(buttons[i]){
+                buttonHoldValid[i] = false;
+            }
+            sigButton(i, buttons[i]);
+        }
+    }
+
+    return true;
+}
+
+
 bool JoystickImpl::readEvent()
 {
     if(fd < 0){
@@ -443,6 +661,10 @@ bool JoystickImpl::readEvent()
     if(len <= 0) {
         if(errno == EAGAIN){
             return false;
+        } else if(isInputThreadActive){
+            // The device is closed by the thread reading the state
+            inputThreadErrorNumber = errno;
+            return false;
         } else {
             errorMessage = strerror(errno);
             closeDevice();
@@ -455,6 +677,7 @@ bool JoystickImpl::readEvent()
 
     int id = event.number;
     double pos = (double)event.value / MAX_VALUE_16BIT;
+    deviceState.eventTime = chrono::steady_clock::now();
 
     if(event.type & JS_EVENT_BUTTON) { // button
 
@@ -465,11 +688,15 @@ bool JoystickImpl::readEvent()
             bool isPressed = (pos > 0.0);
 
             if(id < DIRECTIONAL_PAD_LEFT_BUTTON){
-                buttons[id] = isPressed;
-                sigButton(id, isPressed);
+                deviceState.buttons[id] = isPressed;
                 if(isPressed){
-                    buttonDownTime[id] = chrono::system_clock::now();
-                    buttonHoldValid[id] = false;
+                    deviceState.buttonDownTime[id] = chrono::system_clock::now();
+                }
+                if(!isInputThreadActive){
+                    sigButton(id, isPressed);
+                    if(isPressed){
+                        buttonHoldValid[id] = false;
+                    }
                 }
             } else {
                 double p = isPressed ? 1.0 : 0.0;
@@ -528,10 +755,13 @@ bool JoystickImpl::readEvent()
 
 void JoystickImpl::setAxisState(int id, double pos)
 {
-    double prevPos = axes[id];
-    if(pos != prevPos){
-        axes[id] = pos;
-        sigAxis(id, pos);
+    double& currentPos = deviceState.axes[id];
+    if(pos != currentPos){
+        currentPos = pos;
+        if(!isInputThreadActive){
+            prevAxes[id] = pos;
+            sigAxis(id, pos);
+        }
     }
 }
     
@@ -542,8 +772,8 @@ double Joystick::getPosition(int axis) const
     
     if(impl->extJoystick){
         pos = impl->extJoystick->getPosition(axis);
-    } else if(axis < (int)impl->axes.size()){
-        pos = impl->axes[axis];
+    } else if(axis < (int)impl->currentState->axes.size()){
+        pos = impl->currentState->axes[axis];
     }
 
     return pos;
@@ -556,8 +786,8 @@ bool Joystick::getButtonState(int button) const
     
     if(impl->extJoystick){
         state = impl->extJoystick->getButtonState(button);
-    } else if(button < (int)impl->buttons.size()){
-        state = impl->buttons[button];
+    } else if(button < (int)impl->currentState->buttons.size()){
+        state = impl->currentState->buttons[button];
     }
 
     return state;
@@ -566,7 +796,7 @@ bool Joystick::getButtonState(int button) const
 
 bool Joystick::getButtonDown(int button) const
 {
-    if(button >= (int)impl->buttons.size()){
+    if(button >= (int)impl->currentState->buttons.size()){
         return false;
     }
     return getButtonState(button) && !impl->prevButtons[button];
@@ -575,7 +805,7 @@ bool Joystick::getButtonDown(int button) const
 
 bool Joystick::getButtonUp(int button) const
 {
-    if(button >= (int)impl->buttons.size()){
+    if(button >= (int)impl->currentState->buttons.size()){
         return false;
     }
     return !getButtonState(button) && impl->prevButtons[button];
@@ -597,10 +827,10 @@ bool Joystick::getButtonHold(int button, int duration/*(msec)*/) const
 
 bool Joystick::getButtonHoldOn(int button, int duration/*(msec)*/) const
 {
-    if(button >= (int)impl->buttons.size() || !getButtonState(button)){
+    if(button >= (int)impl->currentState->buttons.size() || !getButtonState(button)){
         return false;
     }
-    auto dur = chrono::system_clock::now() - impl->buttonDownTime[button];
+    auto dur = chrono::system_clock::now() - impl->currentState->buttonDownTime[button];
     if(chrono::duration_cast<chrono::milliseconds>(dur).count() > duration) return true;
     return false;
 }
@@ -612,13 +842,15 @@ bool Joystick::isActive() const
         return impl->extJoystick->isActive();
     }
     
-    for(size_t i=0; i < impl->axes.size(); ++i){
-        if(impl->axes[i] != 0.0){
+    auto& axes = impl->currentState->axes;
+    for(size_t i=0; i < axes.size(); ++i){
+        if(axes[i] != 0.0){
             return true;
         }
     }
-    for(size_t i=0; i < impl->buttons.size(); ++i){
-        if(impl->buttons[i]){
+    auto& buttons = impl->currentState->buttons;
+    for(size_t i=0; i < buttons.size(); ++i){
+        if(buttons[i]){
             return true;
         }
     }
@@ -626,6 +858,12 @@ bool Joystick::isActive() const
 }
 
 
+double Joystick::stateLatency() const
+{
+    return impl->stateLatency;
+}
+
+
 SignalProxy<void(int id, bool isPressed)> Joystick::sigButton()
 {
     return impl->sigButton;
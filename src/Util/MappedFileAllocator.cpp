@@ -0,0 +1,124 @@
+/**
+   @file
+   @author Shin'ichiro Nakaoka
+*/
+
+#include "MappedFileAllocator.h"
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/filesystem.hpp>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+using namespace std;
+using namespace cnoid;
+using namespace boost;
+
+namespace {
+
+struct MappedRegion
+{
+    iostreams::mapped_file file;
+    filesystem::path path;
+};
+
+std::atomic<size_t> threshold(size_t(1) << 30);
+
+std::mutex regionMutex;
+string directory;
+unordered_map<void*, unique_ptr<MappedRegion>> regions;
+
+// This is checked without locking the mutex so that releasing the memory not allocated
+// by allocateMappedFileMemory does not take the lock when no region is mapped
+std::atomic<int> numRegions(0);
+
+}
+
+
+void cnoid::setMappedFileMemoryThreshold(size_t bytes)
+{
+    threshold = bytes;
+}
+
+
+size_t cnoid::mappedFileMemoryThreshold()
+{
+    return threshold;
+}
+
+
+void cnoid::setMappedFileMemoryDirectory(const std::string& directory_)
+{
+    std::lock_guard<std::mutex> lock(regionMutex);
+    directory = directory_;
+}
+
+
+void* cnoid::allocateMappedFileMemory(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(regionMutex);
+
+    unique_ptr<MappedRegion> region(new MappedRegion);
+
+    try {
+        system::error_code ec;
+        filesystem::path dir = directory.empty() ? filesystem::temp_directory_path(ec) : filesystem::path(directory);
+        if(ec){
+            return nullptr;
+        }
+        region->path = dir / filesystem::unique_path("cnoid-%%%%-%%%%-%%%%-%%%%.mem");
+
+        iostreams::mapped_file_params params(region->path.string());
+        params.flags = iostreams::mapped_file::readwrite;
+        params.new_file_size = bytes;
+        region->file.open(params);
+
+    } catch(const std::exception&){
+        system::error_code ec;
+        filesystem::remove(region->path, ec);
+        return nullptr;
+    }
+
+    if(!region->file.is_open()){
+        return nullptr;
+    }
+
+#ifndef _WIN32
+    // The file is removed when the mapping is closed or the process exits
+    system::error_code ec;
+    filesystem::remove(region->path, ec);
+    region->path.clear();
+#endif
+
+    void* p = region->file.data();
+    regions[p] = std::move(region);
+    ++numRegions;
+
+    return p;
+}
+
+
+bool cnoid::releaseMappedFileMemory(void* p)
+{
+    if(numRegions == 0){
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(regionMutex);
+
+    auto iter = regions.find(p);
+    if(iter == regions.end()){
+        return false;
+    }
+    auto& region = iter->second;
+    region->file.close();
+    if(!region->path.empty()){
+        system::error_code ec;
+        filesystem::remove(region->path, ec);
+    }
+    regions.erase(iter);
+    --numRegions;
+
+    return true;
+}
@@ -0,0 +1,76 @@
+/**
+   @file
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_UTIL_MAPPED_FILE_ALLOCATOR_H
+#define CNOID_UTIL_MAPPED_FILE_ALLOCATOR_H
+
+#include <Eigen/Core>
+#include <string>
+#include <cstddef>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+/**
+   The memory blocks whose sizes are not smaller than the threshold are allocated in
+   temporary files mapped to the memory, so that the OS pages the elements out to the disk.
+   Zero disables the mapped files. The default threshold is 1 GiB.
+*/
+CNOID_EXPORT void setMappedFileMemoryThreshold(size_t bytes);
+CNOID_EXPORT size_t mappedFileMemoryThreshold();
+
+//! The temporary files are created in the temporary directory of the system by default
+CNOID_EXPORT void setMappedFileMemoryDirectory(const std::string& directory);
+
+//! \return nullptr if the file cannot be created or mapped
+CNOID_EXPORT void* allocateMappedFileMemory(size_t bytes);
+
+//! \return false if the memory is not allocated by allocateMappedFileMemory
+CNOID_EXPORT bool releaseMappedFileMemory(void* p);
+
+/**
+   The allocator which uses allocateMappedFileMemory for the large blocks and
+   Eigen::aligned_allocator for the others. The memory is allocated by the latter
+   when the mapped file is not available.
+*/
+template<class T>
+class MappedFileAllocator : public Eigen::aligned_allocator<T>
+{
+    typedef Eigen::aligned_allocator<T> BaseAllocator;
+
+public:
+    typedef typename BaseAllocator::pointer pointer;
+    typedef typename BaseAllocator::size_type size_type;
+
+    template<class U>
+    struct rebind {
+        typedef MappedFileAllocator<U> other;
+    };
+
+    MappedFileAllocator() { }
+    MappedFileAllocator(const MappedFileAllocator& other) : BaseAllocator(other) { }
+    template<class U>
+    MappedFileAllocator(const MappedFileAllocator<U>& other) : BaseAllocator(other) { }
+
+    pointer allocate(size_type num, const void* hint = 0) {
+        const size_t threshold = mappedFileMemoryThreshold();
+        if(threshold > 0 && num * sizeof(T) >= threshold){
+            if(void* p = allocateMappedFileMemory(num * sizeof(T))){
+                return static_cast<pointer>(p);
+            }
+        }
+        return BaseAllocator::allocate(num, hint);
+    }
+
+    void deallocate(pointer p, size_type num) {
+        if(!releaseMappedFileMemory(p)){
+            BaseAllocator::deallocate(p, num);
+        }
+    }
+};
+
+}
+
+#endif
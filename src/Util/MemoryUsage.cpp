@@ -0,0 +1,32 @@
+/**
+   @file
+*/
+
+#include "MemoryUsage.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+size_t cnoid::getPeakMemoryUsage()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))){
+        return counters.PeakWorkingSetSize;
+    }
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0){
+#ifdef __APPLE__
+        return usage.ru_maxrss;
+#else
+        return usage.ru_maxrss * size_t(1024);
+#endif
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,62 @@
+/**
+   @file
+*/
+
+#ifndef CNOID_UTIL_MEMORY_USAGE_H
+#define CNOID_UTIL_MEMORY_USAGE_H
+
+#include <cstddef>
+#include <unordered_set>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+/**
+   \return The peak physical memory used by the current process in bytes, which is the maximum
+   resident set size on Unix and the peak working set size on Windows. Zero is returned when the
+   value cannot be obtained.
+*/
+CNOID_EXPORT size_t getPeakMemoryUsage();
+
+/**
+   This class accumulates the numbers of bytes owned by the objects.
+   The data shared by several objects is counted only once by checking if its address
+   has already been visited with the same counter. The number of bytes counted for an object
+   can be obtained as the increase of bytes() while the object is counted.
+*/
+class MemoryUsageCounter
+{
+public:
+    MemoryUsageCounter() : bytes_(0) { }
+
+    void clear() {
+        visited.clear();
+        bytes_ = 0;
+    }
+
+    /**
+       \return false if the data has already been visited
+    */
+    bool visit(const void* data) {
+        return data && visited.insert(data).second;
+    }
+
+    void add(size_t bytes) { bytes_ += bytes; }
+
+    //! The bytes are added only when the shared data is visited for the first time
+    void addShared(const void* data, size_t bytes) {
+        if(visit(data)){
+            bytes_ += bytes;
+        }
+    }
+
+    size_t bytes() const { return bytes_; }
+
+private:
+    std::unordered_set<const void*> visited;
+    size_t bytes_;
+};
+
+}
+
+#endif
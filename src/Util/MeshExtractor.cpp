@@ -5,6 +5,7 @@
 
 #include "MeshExtractor.h"
 #include "SceneDrawables.h"
+#include "ConvexDecomposition.h"
 #include "PolymorphicFunctionSet.h"
 
 using namespace cnoid;
@@ -25,6 +26,7 @@ public:
     Affine3 currentTransformWithoutScaling;
     bool isCurrentScaled;
     bool meshFound;
+    bool isConvexDecompositionEnabled;
     
     MeshExtractorImpl();
     void visitGroup(SgGroup* group);
@@ -32,6 +34,7 @@ public:
     void visitTransform(SgTransform* transform);
     void visitPosTransform(SgPosTransform* transform);
     void visitShape(SgShape* shape);
+    void callback(SgMesh* mesh);
     bool extract(SgNode* node);
 };
 
@@ -46,6 +49,8 @@ MeshExtractor::MeshExtractor()
 
 MeshExtractorImpl::MeshExtractorImpl()
 {
+    isConvexDecompositionEnabled = false;
+
     functions.setFunction<SgGroup>(
         [&](SgGroup* node){ visitGroup(node); });
     functions.setFunction<SgSwitch>(
@@ -107,12 +112,13 @@ void MeshExtractorImpl::visitShape(SgShape* shape)
     SgMesh* mesh = shape->mesh();
     if(mesh && mesh->vertices() && !mesh->vertices()->empty() && !mesh->triangleVertices().empty()){
         meshFound = true;
-        currentMesh = mesh;
         currentShape = shape;
-        if(callback1){
-            callback1();
+        if(isConvexDecompositionEnabled && mesh->primitiveType() == SgMesh::MESH){
+            for(auto& piece : ConvexDecomposition::instance()->decompose(mesh)){
+                callback(piece);
+            }
         } else {
-            callback2(mesh);
+            callback(mesh);
         }
         currentMesh = 0;
         currentShape = 0;
@@ -120,6 +126,23 @@ void MeshExtractorImpl::visitShape(SgShape* shape)
 }
 
 
+void MeshExtractorImpl::callback(SgMesh* mesh)
+{
+    currentMesh = mesh;
+    if(callback1){
+        callback1();
+    } else {
+        callback2(mesh);
+    }
+}
+
+
+void MeshExtractor::setConvexDecompositionEnabled(bool on)
+{
+    impl->isConvexDecompositionEnabled = on;
+}
+
+
 SgMesh* MeshExtractor::currentMesh() const
 {
     return impl->currentMesh;
@@ -25,6 +25,13 @@ public:
     bool extract(SgNode* node, std::function<void(SgMesh* mesh)> callback);
     SgMesh* integrate(SgNode* node);
 
+    /**
+       When this is enabled, a mesh which is not a primitive is given as its convex pieces by the
+       callback, which are obtained by ConvexDecomposition::instance(). The transform is the same
+       as the original mesh because the pieces are in the coordinate of the mesh.
+    */
+    void setConvexDecompositionEnabled(bool on);
+
     SgMesh* currentMesh() const;
     SgShape* currentShape() const;
     const Affine3& currentTransform() const;
@@ -10,6 +10,8 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <array>
+#include <queue>
+#include <cmath>
 
 using namespace std;
 using namespace cnoid;
@@ -18,6 +20,12 @@ namespace {
 
 const float PI = 3.14159265358979323846f;
 
+// The crease angle used to generate the normals of the simplified meshes of the levels of detail
+const float creaseAngleOfSimplifiedMeshes = PI / 4.0f;
+
+// The weight of the planes which keep the border edges in the mesh simplification
+const double borderEdgeWeight = 1000.0;
+
 typedef array<int, 3> FaceId;
 
 template<class Triangle>
@@ -70,6 +78,103 @@ struct EdgeId : public IdPair<int>
         }
     }
 };
+
+
+/*
+  The symmetric 4x4 matrix of the quadric error metric, which is stored as the upper triangle
+*/
+struct Quadric
+{
+    double a[10];
+
+    Quadric(){
+        std::fill(a, a + 10, 0.0);
+    }
+
+    // The quadric of the squared distance to the plane n.dot(x) + d = 0 multiplied by the weight
+    Quadric(const Vector3& n, double d, double w){
+        a[0] = w * n.x() * n.x(); a[1] = w * n.x() * n.y(); a[2] = w * n.x() * n.z(); a[3] = w * n.x() * d;
+        a[4] = w * n.y() * n.y(); a[5] = w * n.y() * n.z(); a[6] = w * n.y() * d;
+        a[7] = w * n.z() * n.z(); a[8] = w * n.z() * d;
+        a[9] = w * d * d;
+    }
+
+    Quadric& operator+=(const Quadric& q){
+        for(int i=0; i < 10; ++i){
+            a[i] += q.a[i];
+        }
+        return *this;
+    }
+
+    double error(const Vector3& v) const {
+        const double x = v.x(), y = v.y(), z = v.z();
+        return a[0]*x*x + 2.0*a[1]*x*y + 2.0*a[2]*x*z + 2.0*a[3]*x
+            + a[4]*y*y + 2.0*a[5]*y*z + 2.0*a[6]*y
+            + a[7]*z*z + 2.0*a[8]*z + a[9];
+    }
+
+    bool findMinimumErrorPosition(Vector3& out_position) const {
+        Matrix3 A;
+        A << a[0], a[1], a[2],
+             a[1], a[4], a[5],
+             a[2], a[5], a[7];
+        const double s = A.trace();
+        if(std::fabs(A.determinant()) <= 1.0e-9 * s * s * s){
+            return false;
+        }
+        out_position = A.inverse() * -Vector3(a[3], a[6], a[8]);
+        return true;
+    }
+};
+
+
+struct EdgeCollapse
+{
+    double error;
+    int vertices[2];
+    int stamps[2];
+    Vector3 position;
+
+    bool operator>(const EdgeCollapse& rhs) const { return error > rhs.error; }
+};
+
+
+struct VertexPositionHash
+{
+    std::size_t operator()(const Vector3f& v) const {
+        std::hash<float> hasher;
+        std::size_t seed = hasher(v.x());
+        seed ^= hasher(v.y()) + 0x9e3779b9 + (seed<<6) + (seed>>2);
+        seed ^= hasher(v.z()) + 0x9e3779b9 + (seed<<6) + (seed>>2);
+        return seed;
+    }
+};
+
+
+/*
+  The state of the mesh simplification. The identical vertices are merged first so that the
+  edges shared by the triangles of the different vertex indices can be collapsed.
+*/
+class MeshSimplifier
+{
+public:
+    vector<Vector3> positions;
+    vector<Quadric> quadrics;
+    vector<int> vertexStamps;
+    vector<bool> vertexValidFlags;
+    vector<array<int, 3>> faces;
+    vector<bool> faceValidFlags;
+    vector<vector<int>> facesOfVertex;
+    priority_queue<EdgeCollapse, vector<EdgeCollapse>, greater<EdgeCollapse>> collapses;
+    int numValidFaces;
+
+    void initialize(const SgMesh* mesh);
+    void simplify(int targetNumFaces);
+    void addCollapse(int v0, int v1);
+    bool isCollapseValid(const EdgeCollapse& collapse);
+    void doCollapse(const EdgeCollapse& collapse);
+    void getResult(SgVertexArray& out_vertices, SgIndexArray& out_triangles);
+};
     
 }
 
@@ -124,6 +229,15 @@ public:
     void makeFacesOfVertexMap(SgMesh* mesh, bool removeSameNormalFaces = false);
     void makeFacesOfEdgeMap(SgMesh* mesh);
     void setVertexNormals(SgMesh* mesh, float creaseAngle);
+    bool isSimplifiable(const SgMesh* mesh) const;
+    bool simplify(const SgMesh* mesh, int targetNumTriangles, SgMesh* out_mesh);
+    SgNode* generateLevelsOfDetail(SgNode* node, int numLevels, float reductionRatio, double switchingSize);
+    SgNode* createLOD(SgShape* shape, int numLevels, float reductionRatio, double switchingSize);
+    bool simplifyShapes(SgNode* node, float reductionRatio);
+
+    int minNumTrianglesToSimplify;
+    unordered_map<const SgMesh*, vector<SgMeshPtr>> levelMeshesMap;
+    unordered_map<const SgMesh*, SgMeshPtr> simplifiedMeshMap;
 };
 
 }
@@ -140,6 +254,7 @@ MeshFilterImpl::MeshFilterImpl()
     isNormalOverwritingEnabled = false;
     minCreaseAngle = 0.0f;
     maxCreaseAngle = PI;
+    minNumTrianglesToSimplify = 1000;
 }
 
 
@@ -154,6 +269,7 @@ MeshFilterImpl::MeshFilterImpl(const MeshFilterImpl& org)
     isNormalOverwritingEnabled = org.isNormalOverwritingEnabled;
     minCreaseAngle = org.minCreaseAngle;
     maxCreaseAngle = org.maxCreaseAngle;
+    minNumTrianglesToSimplify = org.minNumTrianglesToSimplify;
 }
 
 
@@ -646,3 +762,460 @@ void MeshFilterImpl::setVertexNormals(SgMesh* mesh, float givenCreaseAngle)
         }
     }
 }
+
+
+void MeshSimplifier::initialize(const SgMesh* mesh)
+{
+    const auto& vertices = *mesh->vertices();
+    vector<int> indexMap(vertices.size());
+    unordered_map<Vector3f, int, VertexPositionHash> vertexIndexMap;
+    vertexIndexMap.reserve(vertices.size());
+    positions.clear();
+    for(size_t i=0; i < vertices.size(); ++i){
+        auto inserted = vertexIndexMap.insert(make_pair(vertices[i], static_cast<int>(positions.size())));
+        if(inserted.second){
+            positions.push_back(vertices[i].cast<double>());
+        }
+        indexMap[i] = inserted.first->second;
+    }
+
+    const int numVertices = positions.size();
+    quadrics.assign(numVertices, Quadric());
+    vertexStamps.assign(numVertices, 0);
+    vertexValidFlags.assign(numVertices, true);
+    facesOfVertex.assign(numVertices, vector<int>());
+
+    const int numTriangles = mesh->numTriangles();
+    faces.clear();
+    faces.reserve(numTriangles);
+    unordered_map<IdPair<int>, int> edgeFaceCounts;
+    edgeFaceCounts.reserve(numTriangles * 2);
+    
+    for(int i=0; i < numTriangles; ++i){
+        auto triangle = mesh->triangle(i);
+        array<int, 3> face = { indexMap[triangle[0]], indexMap[triangle[1]], indexMap[triangle[2]] };
+        if(face[0] == face[1] || face[1] == face[2] || face[2] == face[0]){
+            continue;
+        }
+        const int faceIndex = faces.size();
+        faces.push_back(face);
+        for(int j=0; j < 3; ++j){
+            facesOfVertex[face[j]].push_back(faceIndex);
+            ++edgeFaceCounts[IdPair<int>(face[j], face[(j + 1) % 3])];
+        }
+    }
+    numValidFaces = faces.size();
+    faceValidFlags.assign(faces.size(), true);
+
+    for(auto& face : faces){
+        const Vector3& p0 = positions[face[0]];
+        Vector3 n = (positions[face[1]] - p0).cross(positions[face[2]] - p0);
+        const double norm = n.norm();
+        if(norm == 0.0){
+            continue;
+        }
+        n /= norm;
+        const Quadric q(n, -n.dot(p0), 1.0);
+        for(int j=0; j < 3; ++j){
+            quadrics[face[j]] += q;
+        }
+        // The border edges are kept by the planes which are perpendicular to their faces
+        for(int j=0; j < 3; ++j){
+            const int v0 = face[j];
+            const int v1 = face[(j + 1) % 3];
+            if(edgeFaceCounts[IdPair<int>(v0, v1)] == 1){
+                Vector3 m = (positions[v1] - positions[v0]).cross(n);
+                const double length = m.norm();
+                if(length > 0.0){
+                    m /= length;
+                    const Quadric borderQuadric(m, -m.dot(positions[v0]), borderEdgeWeight);
+                    quadrics[v0] += borderQuadric;
+                    quadrics[v1] += borderQuadric;
+                }
+            }
+        }
+    }
+
+    collapses = decltype(collapses)();
+    for(auto& kv : edgeFaceCounts){
+        addCollapse(kv.first(0), kv.first(1));
+    }
+}
+
+
+void MeshSimplifier::addCollapse(int v0, int v1)
+{
+    Quadric q = quadrics[v0];
+    q += quadrics[v1];
+    const Vector3& p0 = positions[v0];
+    const Vector3& p1 = positions[v1];
+
+    EdgeCollapse collapse;
+    collapse.vertices[0] = v0;
+    collapse.vertices[1] = v1;
+    collapse.stamps[0] = vertexStamps[v0];
+    collapse.stamps[1] = vertexStamps[v1];
+    collapse.position = 0.5 * (p0 + p1);
+    collapse.error = q.error(collapse.position);
+
+    // The optimal position far from the edge is not used because it is numerically unstable
+    Vector3 optimal;
+    if(q.findMinimumErrorPosition(optimal) && (optimal - collapse.position).norm() <= (p1 - p0).norm()){
+        const double error = q.error(optimal);
+        if(error < collapse.error){
+            collapse.position = optimal;
+            collapse.error = error;
+        }
+    }
+    for(auto& p : { p0, p1 }){
+        const double error = q.error(p);
+        if(error < collapse.error){
+            collapse.position = p;
+            collapse.error = error;
+        }
+    }
+    
+    collapses.push(collapse);
+}
+
+
+bool MeshSimplifier::isCollapseValid(const EdgeCollapse& collapse)
+{
+    const int v0 = collapse.vertices[0];
+    const int v1 = collapse.vertices[1];
+    if(!vertexValidFlags[v0] || !vertexValidFlags[v1] ||
+       vertexStamps[v0] != collapse.stamps[0] || vertexStamps[v1] != collapse.stamps[1]){
+        return false;
+    }
+
+    // The vertices which are adjacent to both the vertices must be the opposite vertices of
+    // the faces sharing the edge. Otherwise the collapse makes a non-manifold mesh.
+    int numSharedFaces = 0;
+    vector<int> neighbors0;
+    for(int f : facesOfVertex[v0]){
+        if(faceValidFlags[f]){
+            auto& face = faces[f];
+            bool isShared = false;
+            for(int j=0; j < 3; ++j){
+                if(face[j] == v1){
+                    isShared = true;
+                } else if(face[j] != v0){
+                    neighbors0.push_back(face[j]);
+                }
+            }
+            if(isShared){
+                ++numSharedFaces;
+            }
+        }
+    }
+    std::sort(neighbors0.begin(), neighbors0.end());
+    neighbors0.erase(std::unique(neighbors0.begin(), neighbors0.end()), neighbors0.end());
+    vector<int> neighbors1;
+    for(int f : facesOfVertex[v1]){
+        if(faceValidFlags[f]){
+            for(auto v : faces[f]){
+                if(v != v0 && v != v1 && std::binary_search(neighbors0.begin(), neighbors0.end(), v)){
+                    neighbors1.push_back(v);
+                }
+            }
+        }
+    }
+    std::sort(neighbors1.begin(), neighbors1.end());
+    if(std::unique(neighbors1.begin(), neighbors1.end()) - neighbors1.begin() > numSharedFaces){
+        return false;
+    }
+
+    // The faces must not be flipped
+    for(int v : collapse.vertices){
+        for(int f : facesOfVertex[v]){
+            if(!faceValidFlags[f]){
+                continue;
+            }
+            auto& face = faces[f];
+            Vector3 p[3];
+            int movedIndex = -1;
+            for(int j=0; j < 3; ++j){
+                p[j] = positions[face[j]];
+                if(face[j] == v){
+                    movedIndex = j;
+                } else if(face[j] == v0 || face[j] == v1){
+                    movedIndex = -2; // removed by the collapse
+                    break;
+                }
+            }
+            if(movedIndex < 0){
+                continue;
+            }
+            const Vector3 n0 = (p[1] - p[0]).cross(p[2] - p[0]);
+            p[movedIndex] = collapse.position;
+            const Vector3 n1 = (p[1] - p[0]).cross(p[2] - p[0]);
+            if(n0.squaredNorm() > 0.0 && n0.dot(n1) <= 0.0){
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+void MeshSimplifier::doCollapse(const EdgeCollapse& collapse)
+{
+    const int v0 = collapse.vertices[0];
+    const int v1 = collapse.vertices[1];
+
+    positions[v0] = collapse.position;
+    quadrics[v0] += quadrics[v1];
+    vertexValidFlags[v1] = false;
+    ++vertexStamps[v0];
+    ++vertexStamps[v1];
+
+    auto& faces0 = facesOfVertex[v0];
+    for(int f : facesOfVertex[v1]){
+        if(!faceValidFlags[f]){
+            continue;
+        }
+        auto& face = faces[f];
+        if(face[0] == v0 || face[1] == v0 || face[2] == v0){
+            faceValidFlags[f] = false;
+            --numValidFaces;
+        } else {
+            for(int j=0; j < 3; ++j){
+                if(face[j] == v1){
+                    face[j] = v0;
+                }
+            }
+            faces0.push_back(f);
+        }
+    }
+    vector<int>().swap(facesOfVertex[v1]);
+    faces0.erase(
+        std::remove_if(faces0.begin(), faces0.end(), [&](int f){ return !faceValidFlags[f]; }),
+        faces0.end());
+
+    vector<int> neighbors;
+    for(int f : faces0){
+        for(auto v : faces[f]){
+            if(v != v0 && std::find(neighbors.begin(), neighbors.end(), v) == neighbors.end()){
+                neighbors.push_back(v);
+            }
+        }
+    }
+    for(auto v : neighbors){
+        addCollapse(v0, v);
+    }
+}
+
+
+void MeshSimplifier::simplify(int targetNumFaces)
+{
+    while(numValidFaces > targetNumFaces && !collapses.empty()){
+        EdgeCollapse collapse = collapses.top();
+        collapses.pop();
+        if(isCollapseValid(collapse)){
+            doCollapse(collapse);
+        }
+    }
+}
+
+
+void MeshSimplifier::getResult(SgVertexArray& out_vertices, SgIndexArray& out_triangles)
+{
+    vector<int> indexMap(positions.size(), -1);
+    out_vertices.clear();
+    out_triangles.clear();
+    out_triangles.reserve(numValidFaces * 3);
+    for(size_t i=0; i < faces.size(); ++i){
+        if(faceValidFlags[i]){
+            for(auto v : faces[i]){
+                int& index = indexMap[v];
+                if(index < 0){
+                    index = out_vertices.size();
+                    out_vertices.push_back(positions[v].cast<float>());
+                }
+                out_triangles.push_back(index);
+            }
+        }
+    }
+}
+
+
+bool MeshFilter::simplify(SgMesh* mesh, int targetNumTriangles)
+{
+    if(mesh->primitiveType() != SgMesh::MESH || !mesh->hasVertices()){
+        return false;
+    }
+    return impl->simplify(mesh, targetNumTriangles, mesh);
+}
+
+
+bool MeshFilterImpl::simplify(const SgMesh* mesh, int targetNumTriangles, SgMesh* out_mesh)
+{
+    if(mesh->numTriangles() <= targetNumTriangles){
+        return false;
+    }
+    
+    MeshSimplifier simplifier;
+    simplifier.initialize(mesh);
+    simplifier.simplify(targetNumTriangles);
+    SgVertexArrayPtr vertices = new SgVertexArray;
+    SgIndexArray triangles;
+    simplifier.getResult(*vertices, triangles);
+
+    if(static_cast<int>(triangles.size() / 3) >= mesh->numTriangles()){
+        return false;
+    }
+
+    out_mesh->setVertices(vertices);
+    out_mesh->triangleVertices().swap(triangles);
+    out_mesh->setNormals(nullptr);
+    out_mesh->normalIndices().clear();
+    out_mesh->setColors(nullptr);
+    out_mesh->colorIndices().clear();
+    out_mesh->setTexCoords(nullptr);
+    out_mesh->texCoordIndices().clear();
+    out_mesh->setSolid(mesh->isSolid());
+    out_mesh->updateBoundingBox();
+
+    return true;
+}
+
+
+void MeshFilter::setMinNumTrianglesToSimplify(int n)
+{
+    impl->minNumTrianglesToSimplify = n;
+}
+
+
+bool MeshFilterImpl::isSimplifiable(const SgMesh* mesh) const
+{
+    return mesh && mesh->primitiveType() == SgMesh::MESH && mesh->hasVertices() &&
+        mesh->numTriangles() >= minNumTrianglesToSimplify;
+}
+
+
+SgNode* MeshFilter::generateLevelsOfDetail(SgNode* scene, int numLevels, float reductionRatio, double switchingSize)
+{
+    SgNode* root = impl->generateLevelsOfDetail(scene, numLevels, reductionRatio, switchingSize);
+    impl->levelMeshesMap.clear();
+    return root;
+}
+
+
+SgNode* MeshFilterImpl::generateLevelsOfDetail(SgNode* node, int numLevels, float reductionRatio, double switchingSize)
+{
+    if(auto shape = dynamic_cast<SgShape*>(node)){
+        return createLOD(shape, numLevels, reductionRatio, switchingSize);
+
+    } else if(node->isGroup() && !dynamic_cast<SgLOD*>(node)){
+        auto group = static_cast<SgGroup*>(node);
+        for(int i=0; i < group->numChildren(); ++i){
+            SgNodePtr child = group->child(i);
+            SgNode* newChild = generateLevelsOfDetail(child, numLevels, reductionRatio, switchingSize);
+            if(newChild != child){
+                group->removeChildAt(i);
+                group->insertChild(newChild, i);
+            }
+        }
+    }
+    return node;
+}
+
+
+SgNode* MeshFilterImpl::createLOD(SgShape* shape, int numLevels, float reductionRatio, double switchingSize)
+{
+    // The texture coordinates and the colors are not kept by the simplification
+    SgMesh* mesh = shape->mesh();
+    if(!isSimplifiable(mesh) || shape->texture() || mesh->hasColors()){
+        return shape;
+    }
+
+    auto& levelMeshes = levelMeshesMap[mesh];
+    if(levelMeshes.empty()){
+        const SgMesh* source = mesh;
+        for(int i=0; i < numLevels; ++i){
+            const int numSourceTriangles = source->numTriangles();
+            SgMeshPtr levelMesh = new SgMesh;
+            if(!simplify(source, numSourceTriangles * reductionRatio, levelMesh)){
+                break;
+            }
+            // A level which is not simplified enough is not worth adding
+            if(levelMesh->numTriangles() > numSourceTriangles * (1.0f + reductionRatio) / 2.0f){
+                break;
+            }
+            calculateFaceNormals(levelMesh, false);
+            makeFacesOfVertexMap(levelMesh, true);
+            setVertexNormals(levelMesh, creaseAngleOfSimplifiedMeshes);
+            levelMeshes.push_back(levelMesh);
+            source = levelMesh;
+        }
+        if(levelMeshes.empty()){
+            return shape;
+        }
+    }
+
+    SgLODPtr lod = new SgLOD;
+    lod->setName(shape->name());
+    lod->addChild(shape);
+    // The number of the triangles is proportional to the projected area
+    const double sizeRatio = sqrt(reductionRatio);
+    double size = switchingSize;
+    for(auto& levelMesh : levelMeshes){
+        auto levelShape = new SgShape;
+        levelShape->setMesh(levelMesh);
+        levelShape->setMaterial(shape->material());
+        lod->addLevel(levelShape, size);
+        size *= sizeRatio;
+    }
+    return lod.retn();
+}
+
+
+SgNode* MeshFilter::createSimplifiedScene(SgNode* scene, float reductionRatio)
+{
+    SgCloneMap cloneMap;
+    cloneMap.setNonNodeCloning(false);
+    SgNodePtr simplifiedScene = scene->cloneNode(cloneMap);
+    bool simplified = impl->simplifyShapes(simplifiedScene, reductionRatio);
+    impl->simplifiedMeshMap.clear();
+    return simplified ? simplifiedScene.retn() : scene;
+}
+
+
+bool MeshFilterImpl::simplifyShapes(SgNode* node, float reductionRatio)
+{
+    bool simplified = false;
+    
+    if(auto shape = dynamic_cast<SgShape*>(node)){
+        SgMesh* mesh = shape->mesh();
+        if(isSimplifiable(mesh)){
+            SgMeshPtr simplifiedMesh;
+            auto p = simplifiedMeshMap.find(mesh);
+            if(p != simplifiedMeshMap.end()){
+                simplifiedMesh = p->second;
+            } else {
+                simplifiedMesh = new SgMesh;
+                if(!simplify(mesh, mesh->numTriangles() * reductionRatio, simplifiedMesh)){
+                    simplifiedMesh = nullptr;
+                }
+                simplifiedMeshMap[mesh] = simplifiedMesh;
+                if(simplifiedMesh){
+                    // The shape shared by the other groups is not simplified twice
+                    simplifiedMeshMap[simplifiedMesh] = simplifiedMesh;
+                }
+            }
+            if(simplifiedMesh){
+                shape->setMesh(simplifiedMesh);
+                simplified = true;
+            }
+        }
+    } else if(node->isGroup()){
+        for(auto& child : *static_cast<SgGroup*>(node)){
+            if(simplifyShapes(child, reductionRatio)){
+                simplified = true;
+            }
+        }
+    }
+
+    return simplified;
+}
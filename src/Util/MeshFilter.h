@@ -49,6 +49,35 @@ public:
     // Deprecated. Use enableNormalOverwriting()
     void setOverwritingEnabled(bool on);
 
+    /**
+       The number of the triangles is reduced to the target number by collapsing the edges in the
+       ascending order of the quadric error metric. The identical vertices are merged, and the
+       normals, the colors and the texture coordinates are removed. The meshes of the primitive
+       types other than MESH are not simplified.
+       \return false if the mesh is not simplified
+    */
+    bool simplify(SgMesh* mesh, int targetNumTriangles);
+
+    //! The following functions do not simplify the meshes which have less triangles than this number
+    void setMinNumTrianglesToSimplify(int n);
+
+    /**
+       The shapes in the scene are replaced with the SgLOD nodes which have the simplified shapes
+       as the levels. The number of the triangles of each level is reduced by the reduction ratio
+       from the previous level, and the first level is used when the projected size is smaller than
+       the switching size [pixel]. The shapes with textures or vertex colors are not processed.
+       \return The root node, which is a new node when the given node itself is replaced
+    */
+    SgNode* generateLevelsOfDetail(
+        SgNode* scene, int numLevels = 3, float reductionRatio = 0.25f, double switchingSize = 256.0);
+
+    /**
+       The returned scene consists of the copies of the nodes, whose meshes are replaced with the
+       simplified meshes. The other meshes, materials and textures are shared with the given scene.
+       The given scene is returned as it is when no mesh is simplified.
+    */
+    SgNode* createSimplifiedScene(SgNode* scene, float reductionRatio);
+
 private:
     MeshFilterImpl* impl;
 };
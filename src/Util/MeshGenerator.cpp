@@ -16,12 +16,57 @@ namespace {
 const double PI = 3.14159265358979323846;
 const int defaultDivisionNumber = 20;
 
+enum SharedMeshType {
+    BoxMesh, SphereMesh, CylinderMesh, ConeMesh, CapsuleMesh, DiscMesh, ArrowMesh, TorusMesh
+};
+
+template<class... Args>
+vector<double> makeSharedMeshKey(Args... args)
+{
+    return { static_cast<double>(args)... };
+}
+
+// A level of a height field tile is used while its cells are projected smaller than this size [pixel]
+const double heightFieldCellSwitchingSize = 8.0;
+
+
+bool isValidHeightField(const SgMesh::HeightField& field)
+{
+    return field.heights && field.xDimension >= 2 && field.zDimension >= 2 &&
+        static_cast<int>(field.heights->size()) == field.xDimension * field.zDimension;
+}
+
+
+Vector3f getHeightFieldNormal(const SgMesh::HeightField& field, int x, int z)
+{
+    const int x0 = std::max(x - 1, 0);
+    const int x1 = std::min(x + 1, field.xDimension - 1);
+    const int z0 = std::max(z - 1, 0);
+    const int z1 = std::min(z + 1, field.zDimension - 1);
+    const float dx = (field.height(x1, z) - field.height(x0, z)) / ((x1 - x0) * field.xSpacing);
+    const float dz = (field.height(x, z1) - field.height(x, z0)) / ((z1 - z0) * field.zSpacing);
+    return Vector3f(-dx, 1.0f, -dz).normalized();
+}
+
+
+SgShape* createHeightFieldShape(SgShape* appearance, SgMesh* mesh)
+{
+    auto shape = new SgShape;
+    if(appearance){
+        shape->setMaterial(appearance->material());
+        shape->setTexture(appearance->texture());
+    }
+    shape->setMesh(mesh);
+    return shape;
+}
+
 }
 
 MeshGenerator::MeshGenerator()
 {
     isNormalGenerationEnabled_ = true;
     isBoundingBoxUpdateEnabled_ = true;
+    isMeshSharingEnabled_ = false;
     meshFilter = nullptr;
     divisionNumber_ = ::defaultDivisionNumber;
 }
@@ -98,8 +143,58 @@ bool MeshGenerator::isBoundingBoxUpdateEnabled() const
 }
 
 
+void MeshGenerator::setMeshSharingEnabled(bool on)
+{
+    isMeshSharingEnabled_ = on;
+}
+
+
+bool MeshGenerator::isMeshSharingEnabled() const
+{
+    return isMeshSharingEnabled_;
+}
+
+
+void MeshGenerator::clearSharedMeshes()
+{
+    sharedMeshes.clear();
+}
+
+
+/**
+   The settings which affect all the meshes are added to the key given by the parameters of a shape.
+*/
+SgMesh* MeshGenerator::findSharedMesh(std::vector<double>& io_key)
+{
+    io_key.push_back(isNormalGenerationEnabled_);
+    io_key.push_back(isBoundingBoxUpdateEnabled_);
+    auto p = sharedMeshes.find(io_key);
+    if(p != sharedMeshes.end()){
+        return p->second;
+    }
+    return nullptr;
+}
+
+
+SgMesh* MeshGenerator::addSharedMesh(const std::vector<double>& key, SgMesh* mesh)
+{
+    if(mesh && !key.empty()){
+        sharedMeshes[key] = mesh;
+    }
+    return mesh;
+}
+
+
 SgMesh* MeshGenerator::generateBox(Vector3 size, bool enableTextureCoordinate)
 {
+    vector<double> key;
+    if(isMeshSharingEnabled_){
+        key = makeSharedMeshKey(BoxMesh, size.x(), size.y(), size.z(), enableTextureCoordinate);
+        if(auto mesh = findSharedMesh(key)){
+            return mesh;
+        }
+    }
+
     if(size.x() < 0.0 || size.y() < 0.0 || size.z() < 0.0){
         return 0;
     }
@@ -148,12 +243,20 @@ SgMesh* MeshGenerator::generateBox(Vector3 size, bool enableTextureCoordinate)
         generateTextureCoordinateForBox(mesh);
     }
 
-    return mesh;
+    return addSharedMesh(key, mesh);
 }
 
 
 SgMesh* MeshGenerator::generateSphere(double radius, bool enableTextureCoordinate)
 {
+    vector<double> key;
+    if(isMeshSharingEnabled_){
+        key = makeSharedMeshKey(SphereMesh, radius, divisionNumber_, enableTextureCoordinate);
+        if(auto mesh = findSharedMesh(key)){
+            return mesh;
+        }
+    }
+
     if(radius < 0.0 || divisionNumber_ < 4){
         return 0;
     }
@@ -217,13 +320,21 @@ SgMesh* MeshGenerator::generateSphere(double radius, bool enableTextureCoordinat
         generateTextureCoordinateForSphere(mesh);
     }
 
-    return mesh;
+    return addSharedMesh(key, mesh);
 }
 
 
 SgMesh* MeshGenerator::generateCylinder(double radius, double height, bool bottom, bool top, bool side,
         bool enableTextureCoordinate)
 {
+    vector<double> key;
+    if(isMeshSharingEnabled_){
+        key = makeSharedMeshKey(CylinderMesh, radius, height, bottom, top, side, divisionNumber_, enableTextureCoordinate);
+        if(auto mesh = findSharedMesh(key)){
+            return mesh;
+        }
+    }
+
     if(height < 0.0 || radius < 0.0){
         return 0;
     }
@@ -280,13 +391,21 @@ SgMesh* MeshGenerator::generateCylinder(double radius, double height, bool botto
         generateTextureCoordinateForCylinder(mesh);
     }
 
-    return mesh;
+    return addSharedMesh(key, mesh);
 }
 
 
 SgMesh* MeshGenerator::generateCone(double radius, double height, bool bottom, bool side,
         bool enableTextureCoordinate)
 {
+    vector<double> key;
+    if(isMeshSharingEnabled_){
+        key = makeSharedMeshKey(ConeMesh, radius, height, bottom, side, divisionNumber_, enableTextureCoordinate);
+        if(auto mesh = findSharedMesh(key)){
+            return mesh;
+        }
+    }
+
     if(radius < 0.0 || height < 0.0){
         return 0;
     }
@@ -331,12 +450,20 @@ SgMesh* MeshGenerator::generateCone(double radius, double height, bool bottom, b
         generateTextureCoordinateForCone(mesh);
     }
 
-    return mesh;
+    return addSharedMesh(key, mesh);
 }
 
 
 SgMesh* MeshGenerator::generateCapsule(double radius, double height)
 {
+    vector<double> key;
+    if(isMeshSharingEnabled_){
+        key = makeSharedMeshKey(CapsuleMesh, radius, height, divisionNumber_);
+        if(auto mesh = findSharedMesh(key)){
+            return mesh;
+        }
+    }
+
     if(height < 0.0 || radius < 0.0){
         return 0;
     }
@@ -407,12 +534,20 @@ SgMesh* MeshGenerator::generateCapsule(double radius, double height)
 
     generateNormals(mesh, PI / 2.0);
 
-    return mesh;
+    return addSharedMesh(key, mesh);
 }
 
 
 SgMesh* MeshGenerator::generateDisc(double radius, double innerRadius)
 {
+    vector<double> key;
+    if(isMeshSharingEnabled_){
+        key = makeSharedMeshKey(DiscMesh, radius, innerRadius, divisionNumber_);
+        if(auto mesh = findSharedMesh(key)){
+            return mesh;
+        }
+    }
+
     if(innerRadius <= 0.0 || radius <= innerRadius){
         return 0;
     }
@@ -450,12 +585,20 @@ SgMesh* MeshGenerator::generateDisc(double radius, double innerRadius)
         mesh->updateBoundingBox();
     }
 
-    return mesh;
+    return addSharedMesh(key, mesh);
 }
 
 
 SgMesh* MeshGenerator::generateArrow(double cylinderRadius, double cylinderHeight, double coneRadius, double coneHeight)
 {
+    vector<double> key;
+    if(isMeshSharingEnabled_){
+        key = makeSharedMeshKey(ArrowMesh, cylinderRadius, cylinderHeight, coneRadius, coneHeight, divisionNumber_);
+        if(auto mesh = findSharedMesh(key)){
+            return mesh;
+        }
+    }
+
     auto cone = new SgShape;
     //setDivisionNumber(20);
     cone->setMesh(generateCone(coneRadius, coneHeight));
@@ -478,12 +621,20 @@ SgMesh* MeshGenerator::generateArrow(double cylinderRadius, double cylinderHeigh
         arrow->updateBoundingBox();
     }
     
-    return arrow;
+    return addSharedMesh(key, arrow);
 }
 
 
 SgMesh* MeshGenerator::generateTorus(double radius, double crossSectionRadius)
 {
+    vector<double> key;
+    if(isMeshSharingEnabled_){
+        key = makeSharedMeshKey(TorusMesh, radius, crossSectionRadius, divisionNumber_);
+        if(auto mesh = findSharedMesh(key)){
+            return mesh;
+        }
+    }
+
     int divisionNumber2 = divisionNumber_ / 4;
 
     SgMesh* mesh = new SgMesh();
@@ -521,7 +672,7 @@ SgMesh* MeshGenerator::generateTorus(double radius, double crossSectionRadius)
 
     generateNormals(mesh, PI);
 
-    return mesh;
+    return addSharedMesh(key, mesh);
 }
 
 SgMesh* MeshGenerator::generateExtrusion(const Extrusion& extrusion, bool enableTextureCoordinate)
@@ -803,6 +954,145 @@ SgMesh* MeshGenerator::generateElevationGrid(const ElevationGrid& grid, bool ena
 }
 
 
+SgMesh* MeshGenerator::generateHeightField(const SgMesh::HeightField& field, bool enableTextureCoordinate)
+{
+    if(!isValidHeightField(field)){
+        return new SgMesh;
+    }
+    SgMesh* mesh = generateHeightFieldTile(
+        field, 0, 0, field.xDimension - 1, field.zDimension - 1, 1, enableTextureCoordinate);
+    mesh->setPrimitive(field);
+    return mesh;
+}
+
+
+SgNode* MeshGenerator::generateTiledHeightField
+(const SgMesh::HeightField& field, SgShape* appearance, int tileSize, int numLevels, bool enableTextureCoordinate)
+{
+    SgGroup* group = new SgGroup;
+    if(!isValidHeightField(field)){
+        return group;
+    }
+    tileSize = std::max(tileSize, 1);
+    
+    for(int z = 0; z < field.zDimension - 1; z += tileSize){
+        const int zEnd = std::min(z + tileSize, field.zDimension - 1);
+        for(int x = 0; x < field.xDimension - 1; x += tileSize){
+            const int xEnd = std::min(x + tileSize, field.xDimension - 1);
+            SgMesh* mesh = generateHeightFieldTile(field, x, z, xEnd, zEnd, 1, enableTextureCoordinate);
+            mesh->setPrimitive(field);
+            SgShape* shape = createHeightFieldShape(appearance, mesh);
+            const int numCells = std::max(xEnd - x, zEnd - z);
+            if(numLevels <= 1 || numCells < 2){
+                group->addChild(shape);
+                continue;
+            }
+            SgLOD* lod = new SgLOD;
+            lod->addChild(shape);
+            int step = 2;
+            for(int i=1; i < numLevels && step <= numCells; ++i){
+                SgMesh* levelMesh = generateHeightFieldTile(field, x, z, xEnd, zEnd, step, enableTextureCoordinate);
+                lod->addLevel(createHeightFieldShape(appearance, levelMesh),
+                              heightFieldCellSwitchingSize * numCells / (2.0 * step));
+                step *= 2;
+            }
+            group->addChild(lod);
+        }
+    }
+
+    return group;
+}
+
+
+/**
+   The points of the tile are sampled at the intervals of the step, and the last points are always
+   included. The subsampled grid has the skirts hanging down from the borders, which hide the cracks
+   between the tiles of the different levels.
+*/
+SgMesh* MeshGenerator::generateHeightFieldTile
+(const SgMesh::HeightField& field, int xBegin, int zBegin, int xEnd, int zEnd, int step,
+ bool enableTextureCoordinate)
+{
+    vector<int> xs;
+    for(int x = xBegin; x < xEnd; x += step){
+        xs.push_back(x);
+    }
+    xs.push_back(xEnd);
+    vector<int> zs;
+    for(int z = zBegin; z < zEnd; z += step){
+        zs.push_back(z);
+    }
+    zs.push_back(zEnd);
+    const int nx = xs.size();
+    const int nz = zs.size();
+
+    SgMesh* mesh = new SgMesh;
+    SgVertexArray& vertices = *mesh->getOrCreateVertices();
+    SgNormalArray& normals = *mesh->getOrCreateNormals();
+    SgTexCoordArray* texCoords = enableTextureCoordinate ? mesh->getOrCreateTexCoords() : nullptr;
+    const float xmax = field.xSpacing * (field.xDimension - 1);
+    const float zmax = field.zSpacing * (field.zDimension - 1);
+
+    for(int j=0; j < nz; ++j){
+        const int z = zs[j];
+        for(int i=0; i < nx; ++i){
+            const int x = xs[i];
+            const Vector3f v(x * field.xSpacing, field.height(x, z), z * field.zSpacing);
+            vertices.push_back(v);
+            normals.push_back(getHeightFieldNormal(field, x, z));
+            if(texCoords){
+                texCoords->push_back(Vector2f(v.x() / xmax, v.z() / zmax));
+            }
+        }
+    }
+
+    mesh->reserveNumTriangles((nx - 1) * (nz - 1) * 2);
+    for(int j=0; j < nz - 1; ++j){
+        for(int i=0; i < nx - 1; ++i){
+            const int v00 = j * nx + i;
+            const int v10 = v00 + 1;
+            const int v01 = v00 + nx;
+            const int v11 = v01 + 1;
+            mesh->addTriangle(v00, v01, v11);
+            mesh->addTriangle(v00, v11, v10);
+        }
+    }
+
+    if(step > 1){
+        // The border points in the counterclockwise order viewed from above
+        vector<int> border;
+        for(int i=0; i < nx; ++i){ border.push_back(i); }
+        for(int j=1; j < nz; ++j){ border.push_back(j * nx + nx - 1); }
+        for(int i = nx - 2; i >= 0; --i){ border.push_back((nz - 1) * nx + i); }
+        for(int j = nz - 2; j >= 0; --j){ border.push_back(j * nx); }
+
+        const float depth = step * std::max(field.xSpacing, field.zSpacing);
+        const int top = vertices.size();
+        for(auto index : border){
+            vertices.push_back(vertices[index] - Vector3f(0.0f, depth, 0.0f));
+            normals.push_back(normals[index]);
+            if(texCoords){
+                texCoords->push_back((*texCoords)[index]);
+            }
+        }
+        for(size_t k=0; k < border.size() - 1; ++k){
+            const int a = border[k];
+            const int b = border[k + 1];
+            const int a2 = top + k;
+            const int b2 = top + k + 1;
+            mesh->addTriangle(a, b, b2);
+            mesh->addTriangle(a, b2, a2);
+        }
+    }
+
+    if(isBoundingBoxUpdateEnabled_){
+        mesh->updateBoundingBox();
+    }
+
+    return mesh;
+}
+
+
 void MeshGenerator::generateTextureCoordinateForBox(SgMesh* mesh)
 {
     mesh->setTexCoords(new SgTexCoordArray());
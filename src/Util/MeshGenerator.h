@@ -8,6 +8,8 @@
 
 #include "EigenTypes.h"
 #include "SceneDrawables.h"
+#include <map>
+#include <vector>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -33,6 +35,15 @@ public:
     void setBoundingBoxUpdateEnabled(bool on);
     bool isBoundingBoxUpdateEnabled() const;
 
+    /**
+       When this is enabled, the mesh of a primitive shape generated with the same parameters and
+       settings as a previous one is the same instance as the previous mesh, which the renderer can
+       also draw with instancing. The returned mesh must not be modified in that case.
+    */
+    void setMeshSharingEnabled(bool on);
+    bool isMeshSharingEnabled() const;
+    void clearSharedMeshes();
+
     SgMesh* generateBox(Vector3 size, bool enableTextureCoordinate=false);
     SgMesh* generateSphere(double radius, bool enableTextureCoordinate=false);
     SgMesh* generateCylinder(double radius, double height, bool bottom = true,
@@ -88,15 +99,39 @@ public:
 
     SgMesh* generateElevationGrid(const ElevationGrid& elevationGrid, bool enableTextureCoordinate=false);
 
+    /**
+       The mesh of the whole field, which has the height field as its primitive.
+       The normals are given to the vertices from the gradients of the heights.
+    */
+    SgMesh* generateHeightField(const SgMesh::HeightField& field, bool enableTextureCoordinate=false);
+
+    /**
+       The field is divided into the tiles of tileSize x tileSize cells so that the invisible tiles
+       are culled. Each tile is an SgLOD node whose levels are the grids subsampled by 2, 4, 8, ...
+       when numLevels is greater than one. The shapes of the tiles share the material and the texture
+       of the given shape, and the meshes of the full detail have the height field as their primitive.
+    */
+    SgNode* generateTiledHeightField(
+        const SgMesh::HeightField& field, SgShape* appearance, int tileSize, int numLevels,
+        bool enableTextureCoordinate=false);
+
     void generateTextureCoordinateForIndexedFaceSet(SgMesh* mesh);
 
 private:
     int divisionNumber_;
     bool isNormalGenerationEnabled_;
     bool isBoundingBoxUpdateEnabled_;
+    bool isMeshSharingEnabled_;
     MeshFilter* meshFilter;
+    std::map<std::vector<double>, SgMeshPtr> sharedMeshes;
+
+    SgMesh* findSharedMesh(std::vector<double>& io_key);
+    SgMesh* addSharedMesh(const std::vector<double>& key, SgMesh* mesh);
 
     void generateNormals(SgMesh* mesh, double creaseAngle);
+    SgMesh* generateHeightFieldTile(
+        const SgMesh::HeightField& field, int xBegin, int zBegin, int xEnd, int zEnd, int step,
+        bool enableTextureCoordinate);
 
     int findTexCoordPoint(const SgTexCoordArray& texCoord, const Vector2f& point);
     void generateTextureCoordinateForBox(SgMesh* mesh);
@@ -16,9 +16,9 @@ namespace cnoid {
 class Mapping;
 class YAMLWriter;
 
-class CNOID_EXPORT MultiSE3MatrixSeq : public MultiSeq<Affine3, Eigen::aligned_allocator<Affine3>>
+class CNOID_EXPORT MultiSE3MatrixSeq : public MultiSeq<Affine3>
 {
-    typedef MultiSeq<Affine3, Eigen::aligned_allocator<Affine3>> BaseSeqType;
+    typedef MultiSeq<Affine3> BaseSeqType;
 
 public:
     MultiSE3MatrixSeq();
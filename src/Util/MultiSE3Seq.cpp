@@ -17,6 +17,12 @@ using namespace std;
 using namespace cnoid;
 using fmt::format;
 
+namespace {
+
+const size_t maxPlainFormatBufferSize = 1024 * 1024;
+
+}
+
 
 MultiSE3Seq::MultiSE3Seq()
     : MultiSE3Seq::BaseSeqType("MultiSE3Seq")
@@ -127,20 +133,10 @@ bool MultiSE3Seq::doReadSeq(const Mapping* archive, std::ostream& os)
 
 static void writeSE3(YAMLWriter& writer, const SE3& value)
 {
-    writer.startFlowStyleListing();
-
     const Vector3& p = value.translation();
-    writer.putScalar(p.x());
-    writer.putScalar(p.y());
-    writer.putScalar(p.z());
-
     const Quat& q = value.rotation();
-    writer.putScalar(q.w());
-    writer.putScalar(q.x());
-    writer.putScalar(q.y());
-    writer.putScalar(q.z());
-
-    writer.endListing();
+    const double elements[] = { p.x(), p.y(), p.z(), q.w(), q.x(), q.y(), q.z() };
+    writer.putFlowStyleListing(elements, 7);
 }
     
 
@@ -198,11 +194,11 @@ bool MultiSE3Seq::loadPlainMatrixFormat(const std::string& filename, std::ostrea
     setDimension(loader.numFrames(), m);
     setTimeStep(loader.timeStep());
 
-    int f = 0;
-    for(PlainSeqFileLoader::iterator it = loader.begin(); it != loader.end(); ++it){
-        vector<double>& data = *it;
+    const int nFrames = loader.numFrames();
+    for(int f=0; f < nFrames; ++f){
+        const double* data = loader.frame(f);
         int i = 0;
-        Frame frame = MultiSE3Seq::frame(f++);
+        Frame frame = MultiSE3Seq::frame(f);
         for(int j=0; j < m; ++j){
             SE3& x = frame[j];
             x.translation() << data[i], data[i+1], data[i+2];
@@ -238,10 +234,10 @@ bool MultiSE3Seq::loadPlainRpyFormat(const std::string& filename, std::ostream&
     setDimension(loader.numFrames(), 1);
     setTimeStep(loader.timeStep());
 
-    int f = 0;
-    for(PlainSeqFileLoader::iterator it = loader.begin(); it != loader.end(); ++it){
-        vector<double>& data = *it;
-        Frame frame = MultiSE3Seq::frame(f++);
+    const int nFrames = loader.numFrames();
+    for(int f=0; f < nFrames; ++f){
+        const double* data = loader.frame(f);
+        Frame frame = MultiSE3Seq::frame(f);
         SE3& x = frame[0];
         x.translation() << 0, 0, 0;
         double r, p, y;
@@ -271,12 +267,14 @@ bool MultiSE3Seq::saveTopPartAsPlainMatrixFormat(const std::string& filename, st
 
         const double r = frameRate();
 
+        // The lines are formatted into the buffer, which is written to the file in large blocks
+        fmt::memory_buffer buf;
         Part base = part(0);
         for(int i=0; i < nFrames; ++i){
-            file << format("{0:.4f}", (i / r));
+            fmt::format_to(buf, "{0:.4f}", (i / r));
             const SE3& x = base[i];
             for(int j=0; j < 3; ++j){
-                file << " " << x.translation()[j];
+                fmt::format_to(buf, " {:g}", x.translation()[j]);
             }
             Matrix3 R(x.rotation());
             for(int j=0; j < 3; ++j){
@@ -285,12 +283,17 @@ bool MultiSE3Seq::saveTopPartAsPlainMatrixFormat(const std::string& filename, st
                     if(fabs(m) < 1.0e-14){
                         m = 0.0;
                     }
-                    file << " " << m;
+                    fmt::format_to(buf, " {:g}", m);
                 }
             }
-            file << " 0 0 0 0 0 0"; // velocity elements (dv, omega)
-            file << "\n";
+            const char velocityElements[] = " 0 0 0 0 0 0\n"; // dv, omega
+            buf.append(velocityElements, velocityElements + sizeof(velocityElements) - 1);
+            if(buf.size() >= maxPlainFormatBufferSize){
+                file.write(buf.data(), buf.size());
+                buf.clear();
+            }
         }
+        file.write(buf.data(), buf.size());
 
         return true;
     }
@@ -17,9 +17,9 @@ class Mapping;
 class Listing;
 class YAMLWriter;
         
-class CNOID_EXPORT MultiSE3Seq : public MultiSeq<SE3, Eigen::aligned_allocator<SE3>>
+class CNOID_EXPORT MultiSE3Seq : public MultiSeq<SE3>
 {
-    typedef MultiSeq<SE3, Eigen::aligned_allocator<SE3>> BaseSeqType;
+    typedef MultiSeq<SE3> BaseSeqType;
 
 public:
     MultiSE3Seq();
@@ -8,12 +8,17 @@
 
 #include "AbstractSeq.h"
 #include "Deque2D.h"
+#include "MappedFileAllocator.h"
 #include <algorithm>
 #include <memory>
 
 namespace cnoid {
 
-template <typename ElementType, typename Allocator = std::allocator<ElementType>>
+/**
+   The frames of a large sequence are stored in a temporary file mapped to the memory
+   by the default allocator. See setMappedFileMemoryThreshold.
+*/
+template <typename ElementType, typename Allocator = MappedFileAllocator<ElementType>>
 class MultiSeq : public Deque2D<ElementType, Allocator>, public AbstractMultiSeq
 {
     typedef MultiSeq<ElementType, Allocator> MultiSeqType;
@@ -144,6 +149,11 @@ public:
         return Container::colSize();
     }
 
+    //! The buffer mapped to a temporary file is also counted
+    virtual void countMemoryUsage(MemoryUsageCounter& counter) const override {
+        counter.add(sizeof(*this) + Container::capacity() * sizeof(ElementType));
+    }
+
     int numParts() const {
         return Container::colSize();
     }
@@ -200,6 +210,10 @@ public:
         Container::pop_front();
     }
 
+    void popFrontFrames(int numFrames) {
+        Container::pop_front(numFrames);
+    }
+
     Frame appendFrame() {
         return Container::append();
     }
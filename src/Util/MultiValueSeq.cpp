@@ -16,6 +16,12 @@ using namespace std;
 using namespace cnoid;
 using fmt::format;
 
+namespace {
+
+const size_t maxPlainFormatBufferSize = 1024 * 1024;
+
+}
+
 
 MultiValueSeq::MultiValueSeq()
     : BaseSeqType("MultiValueSeq")
@@ -71,12 +77,7 @@ bool MultiValueSeq::doWriteSeq(YAMLWriter& writer, std::function<void()> additio
             const int n = numFrames();
             const int m = numParts();
             for(int i=0; i < n; ++i){
-                writer.startFlowStyleListing();
-                Frame v = frame(i);
-                for(int j=0; j < m; ++j){
-                    writer.putScalar(v[j]);
-                }
-                writer.endListing();
+                writer.putFlowStyleListing(frame(i).begin(), m);
             }
             writer.endListing();
         });
@@ -94,9 +95,11 @@ bool MultiValueSeq::loadPlainFormat(const std::string& filename, std::ostream& o
     setDimension(loader.numFrames(), loader.numParts());
     setFrameRate(1.0 / loader.timeStep());
 
-    int i = 0;
-    for(PlainSeqFileLoader::iterator it = loader.begin(); it != loader.end(); ++it){
-        copy((it->begin() + 1), it->end(), frame(i++).begin());
+    const int n = loader.numFrames();
+    const int m = loader.numParts();
+    for(int i=0; i < n; ++i){
+        const double* values = loader.frame(i) + 1;
+        copy(values, values + m, frame(i).begin());
     }
 
     return true;
@@ -106,7 +109,6 @@ bool MultiValueSeq::loadPlainFormat(const std::string& filename, std::ostream& o
 bool MultiValueSeq::saveAsPlainFormat(const std::string& filename, std::ostream& os)
 {
     ofstream file(filename.c_str());
-    file.setf(ios::fixed);
 
     if(!file){
         os << format(_("\"{}\" cannot be opened."), filename) << endl;
@@ -117,14 +119,21 @@ bool MultiValueSeq::saveAsPlainFormat(const std::string& filename, std::ostream&
     const int m = numParts();
     const double r = frameRate();
 
+    // The lines are formatted into the buffer, which is written to the file in large blocks
+    fmt::memory_buffer buf;
     for(int i=0; i < n; ++i){
-        file << (i / r);
+        fmt::format_to(buf, "{:.6f}", (i / r));
         Frame v = frame(i);
         for(int j=0; j < m; ++j){
-            file << " " << v[j];
+            fmt::format_to(buf, " {:.6f}", v[j]);
+        }
+        buf.push_back('\n');
+        if(buf.size() >= maxPlainFormatBufferSize){
+            file.write(buf.data(), buf.size());
+            buf.clear();
         }
-        file << "\n";
     }
+    file.write(buf.data(), buf.size());
     
     return true;
 }
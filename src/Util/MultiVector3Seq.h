@@ -15,9 +15,9 @@ namespace cnoid {
 class Mapping;
 class YAMLWriter;
 
-class CNOID_EXPORT MultiVector3Seq : public MultiSeq<Vector3, Eigen::aligned_allocator<Vector3>>
+class CNOID_EXPORT MultiVector3Seq : public MultiSeq<Vector3>
 {
-    typedef MultiSeq<Vector3, Eigen::aligned_allocator<Vector3>> BaseSeqType;
+    typedef MultiSeq<Vector3> BaseSeqType;
 
 public:
     MultiVector3Seq();
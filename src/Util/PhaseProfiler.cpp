@@ -0,0 +1,215 @@
+/**
+   @file
+*/
+
+#include "PhaseProfiler.h"
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <fmt/format.h>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct PhaseRecord
+{
+    string phase;
+    string detail;
+    int threadIndex;
+    int depth;
+    Clock::time_point beginTime;
+    Clock::time_point endTime;
+    bool isFinished;
+};
+
+std::mutex recordMutex;
+vector<PhaseRecord> records;
+size_t numReportedRecords = 0;
+map<std::thread::id, int> threadIndices;
+const Clock::time_point originTime = Clock::now();
+
+thread_local int currentDepth = 0;
+
+string getTraceFilenameFromEnvironment()
+{
+    const char* value = getenv("CNOID_PHASE_PROFILE");
+    if(value && string(value) != "1"){
+        return value;
+    }
+    return string();
+}
+
+string traceFilename_ = getTraceFilenameFromEnvironment();
+
+double toMilliseconds(Clock::duration d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+void putJsonString(ostream& os, const string& s)
+{
+    os << '"';
+    for(auto c : s){
+        switch(c){
+        case '"':  os << "\\\""; break;
+        case '\\': os << "\\\\"; break;
+        case '\n': os << "\\n"; break;
+        case '\t': os << "\\t"; break;
+        default:
+            if(static_cast<unsigned char>(c) < 0x20){
+                os << fmt::format("\\u{:04x}", static_cast<int>(c));
+            } else {
+                os << c;
+            }
+        }
+    }
+    os << '"';
+}
+
+}
+
+bool PhaseProfiler::isEnabled_ = (getenv("CNOID_PHASE_PROFILE") != nullptr);
+
+
+void PhaseProfiler::setEnabled(bool on)
+{
+    isEnabled_ = on;
+}
+
+
+const std::string& PhaseProfiler::traceFilename()
+{
+    return traceFilename_;
+}
+
+
+int PhaseProfiler::begin(const char* phase, const std::string& detail)
+{
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(recordMutex);
+
+    auto inserted = threadIndices.insert(make_pair(std::this_thread::get_id(), (int)threadIndices.size()));
+
+    int index = records.size();
+    records.emplace_back();
+    PhaseRecord& record = records.back();
+    record.phase = phase;
+    record.detail = detail;
+    record.threadIndex = inserted.first->second;
+    record.depth = currentDepth++;
+    record.beginTime = now;
+    record.isFinished = false;
+
+    return index;
+}
+
+
+void PhaseProfiler::end(int index)
+{
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(recordMutex);
+    --currentDepth;
+    // The records may have been cleared while the phase was being recorded
+    if(index < (int)records.size()){
+        PhaseRecord& record = records[index];
+        record.endTime = now;
+        record.isFinished = true;
+    }
+}
+
+
+bool PhaseProfiler::putReport(std::ostream& os)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+
+    if(numReportedRecords >= records.size()){
+        return false;
+    }
+
+    vector<const PhaseRecord*> sorted;
+    for(size_t i = numReportedRecords; i < records.size(); ++i){
+        sorted.push_back(&records[i]);
+    }
+    // The phases of each thread are put together in the order of their beginning
+    std::stable_sort(
+        sorted.begin(), sorted.end(),
+        [](const PhaseRecord* r1, const PhaseRecord* r2){ return r1->threadIndex < r2->threadIndex; });
+
+    os << "Phase timing (ms):\n";
+    int threadIndex = -1;
+    for(auto record : sorted){
+        if(record->threadIndex != threadIndex){
+            threadIndex = record->threadIndex;
+            if(threadIndex > 0){
+                os << fmt::format(" Thread {}:\n", threadIndex);
+            }
+        }
+        string indent(record->depth * 2, ' ');
+        if(record->isFinished){
+            os << fmt::format("{:10.1f}  ", toMilliseconds(record->endTime - record->beginTime));
+        } else {
+            os << "  (active)  ";
+        }
+        os << indent << record->phase;
+        if(!record->detail.empty()){
+            os << ": " << record->detail;
+        }
+        os << "\n";
+    }
+    os.flush();
+
+    numReportedRecords = records.size();
+
+    return true;
+}
+
+
+bool PhaseProfiler::writeTraceFile(const std::string& filename)
+{
+    ofstream ofs(filename.c_str());
+    if(!ofs){
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(recordMutex);
+
+    ofs << "{\"traceEvents\":[\n";
+    bool isFirst = true;
+    for(auto& record : records){
+        if(!record.isFinished){
+            continue;
+        }
+        if(!isFirst){
+            ofs << ",\n";
+        }
+        isFirst = false;
+        ofs << "{\"name\":";
+        putJsonString(ofs, record.detail.empty() ? record.phase : (record.phase + ": " + record.detail));
+        ofs << ",\"cat\":";
+        putJsonString(ofs, record.phase);
+        ofs << fmt::format(",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.1f},\"dur\":{:.1f}}}",
+                           record.threadIndex,
+                           toMilliseconds(record.beginTime - originTime) * 1000.0,
+                           toMilliseconds(record.endTime - record.beginTime) * 1000.0);
+    }
+    ofs << "\n]}\n";
+
+    return !ofs.fail();
+}
+
+
+void PhaseProfiler::clear()
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    records.clear();
+    numReportedRecords = 0;
+}
@@ -0,0 +1,74 @@
+/**
+   @file
+*/
+
+#ifndef CNOID_UTIL_PHASE_PROFILER_H
+#define CNOID_UTIL_PHASE_PROFILER_H
+
+#include <string>
+#include <iosfwd>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+/**
+   Records the elapsed times of the nested phases such as the startup, the plugin loading and
+   the project loading. The recording is enabled when the CNOID_PHASE_PROFILE environment
+   variable is set. When its value is a file name other than "1", the records are also written
+   to the file in the trace event format, which can be viewed with chrome://tracing or Perfetto.
+   The phases can be recorded in any thread. Each thread has its own hierarchy.
+*/
+class CNOID_EXPORT PhaseProfiler
+{
+public:
+    static bool isEnabled() { return isEnabled_; }
+    static void setEnabled(bool on);
+
+    //! The file name given by the environment variable. It is empty when it is not given.
+    static const std::string& traceFilename();
+
+    /**
+       Records a phase from the construction to the destruction.
+       Nothing is done when the profiler is disabled.
+    */
+    class CNOID_EXPORT Scope
+    {
+    public:
+        Scope(const char* phase, const std::string& detail = std::string()) {
+            index = isEnabled_ ? PhaseProfiler::begin(phase, detail) : -1;
+        }
+        ~Scope() { end(); }
+        //! Ends the phase before the destruction
+        void end() {
+            if(index >= 0){
+                PhaseProfiler::end(index);
+                index = -1;
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        int index;
+    };
+
+    static int begin(const char* phase, const std::string& detail);
+    static void end(int index);
+
+    /**
+       Outputs the phases recorded after the previous report as indented lines.
+       \return false if there is no phase to report
+    */
+    static bool putReport(std::ostream& os);
+
+    //! All the recorded phases are written
+    static bool writeTraceFile(const std::string& filename);
+
+    static void clear();
+
+private:
+    static bool isEnabled_;
+};
+
+}
+
+#endif
@@ -4,67 +4,178 @@
 */
 
 #include "PlainSeqFileLoader.h"
-#include <fstream>
-#include <boost/tokenizer.hpp>
-#include <boost/lexical_cast.hpp>
+#include "EasyScanner.h"
+#include "ThreadPool.h"
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/filesystem.hpp>
 #include <fmt/format.h>
+#include <algorithm>
+#include <cstring>
 #include "gettext.h"
 
 using namespace std;
-using namespace boost;
 using namespace cnoid;
 
+namespace {
 
-bool PlainSeqFileLoader::load(const std::string& filename, std::ostream& os)
+// The size of the text parsed by a task. A chunk is extended to the end of the line.
+const size_t chunkSize = 1024 * 1024;
+
+struct Chunk
 {
-    ifstream is(filename.c_str());
+    const char* begin;
+    const char* end;
+    vector<double> values;
+    size_t numColumns;
+    int numLines;
+    // The line number in the chunk where an error is found. Zero means no error.
+    int errorLine;
+    bool isInvalidValueError;
+};
+
+void parseChunk(Chunk& chunk)
+{
+    chunk.numColumns = 0;
+    chunk.numLines = 0;
+    chunk.errorLine = 0;
+    
+    EasyScanner scanner;
+    scanner.setText(chunk.begin, chunk.end - chunk.begin);
+
+    // The values of a line are read into this buffer with a single call in most cases
+    vector<double> buf(16);
   
-    if(!is){
+    while(!scanner.isEOF()){
+        size_t n = 0;
+        while(true){
+            n += scanner.readDoubles(&buf[n], buf.size() - n);
+            if(n < buf.size()){
+                break;
+            }
+            buf.resize(buf.size() * 2);
+        }
+        if(!scanner.readLFEOF()){
+            chunk.errorLine = scanner.lineNumber;
+            chunk.isInvalidValueError = true;
+            return;
+        }
+        if(n == 0){
+            continue; // blank line
+        }
+        if(chunk.numColumns == 0){
+            chunk.numColumns = n;
+            // Reserve the values of the chunk estimated from the length of the first line
+            const size_t length = chunk.end - chunk.begin;
+            const char* lf = static_cast<const char*>(memchr(chunk.begin, '\n', length));
+            const size_t lineLength = lf ? (lf - chunk.begin + 1) : length;
+            chunk.values.reserve((length / lineLength + 1) * n);
+        } else if(n != chunk.numColumns){
+            chunk.errorLine = scanner.lineNumber - 1;
+            chunk.isInvalidValueError = false;
+            return;
+        }
+        chunk.values.insert(chunk.values.end(), buf.begin(), buf.begin() + n);
+        chunk.numLines++;
+    }
+}
+
+}
+
+
+bool PlainSeqFileLoader::load(const std::string& filename, std::ostream& os)
+{
+    values.clear();
+    
+    boost::iostreams::mapped_file_source file;
+    try {
+        // An empty file cannot be mapped
+        if(boost::filesystem::file_size(filename) > 0){
+            file.open(filename);
+        }
+    } catch(const std::exception&){
         os << fmt::format(_("\"{}\" cannot be opened."), filename) << endl;
         return false;
     }
-  
+
+    const char* text = file.is_open() ? file.data() : nullptr;
+    const char* textEnd = text ? (text + file.size()) : nullptr;
+
+    vector<Chunk> chunks;
+    const char* p = text;
+    while(p < textEnd){
+        Chunk chunk;
+        chunk.begin = p;
+        if(size_t(textEnd - p) <= chunkSize){
+            p = textEnd;
+        } else {
+            const char* lf = static_cast<const char*>(memchr(p + chunkSize, '\n', textEnd - (p + chunkSize)));
+            p = lf ? (lf + 1) : textEnd;
+        }
+        chunk.end = p;
+        chunks.push_back(std::move(chunk));
+    }
+
+    const int numChunks = chunks.size();
+    ThreadPool::instance()->parallelFor(
+        0, numChunks, [&](int i){ parseChunk(chunks[i]); }, 1);
+
     size_t nColumns = 0;
     size_t nLines = 0;
+    size_t numValues = 0;
+    int lineOffset = 0;
   
-    typedef char_separator<char> Separator;
-    typedef tokenizer<Separator> Tokenizer;
-    Separator sep(" \t\r\n");
-  
-    seq.clear();
-  
-    string line;
-    while(getline(is, line)){
-        nLines++;
-        seq.push_back(vector<double>(nColumns));
-        vector<double>& v = seq.back();
-        v.clear();
-        Tokenizer tokens(line, sep);
-        for(Tokenizer::iterator it = tokens.begin(); it != tokens.end(); ++it){
-            v.push_back(lexical_cast<double>(*it));
-        }
-    
-        if(nColumns == 0){
-            nColumns = v.size();
-        } else if(v.size() != nColumns){
-            os << fmt::format(_("\"{}\" contains different size columns."), filename) << endl;
+    for(auto& chunk : chunks){
+        if(chunk.errorLine > 0){
+            const int line = lineOffset + chunk.errorLine;
+            if(chunk.isInvalidValueError){
+                os << fmt::format(_("\"{}\" contains an invalid value at line {}."), filename, line) << endl;
+            } else {
+                os << fmt::format(_("\"{}\" contains different size columns."), filename) << endl;
+            }
             return false;
         }
+        if(chunk.numLines > 0){
+            if(nColumns == 0){
+                nColumns = chunk.numColumns;
+            } else if(chunk.numColumns != nColumns){
+                os << fmt::format(_("\"{}\" contains different size columns."), filename) << endl;
+                return false;
+            }
+        }
+        nLines += chunk.numLines;
+        numValues += chunk.values.size();
+        lineOffset += std::count(chunk.begin, chunk.end, '\n');
     }
 
     if(nColumns < 2 || nLines < 1){
         os << fmt::format(_("\"{}\": Empty sequence."), filename) << endl;
         return false;
     }
+
+    if(numChunks == 1){
+        values.swap(chunks.front().values);
+    } else {
+        values.resize(numValues);
+        vector<size_t> offsets(numChunks);
+        size_t offset = 0;
+        for(int i=0; i < numChunks; ++i){
+            offsets[i] = offset;
+            offset += chunks[i].values.size();
+        }
+        ThreadPool::instance()->parallelFor(
+            0, numChunks,
+            [&](int i){
+                std::copy(chunks[i].values.begin(), chunks[i].values.end(), values.begin() + offsets[i]);
+                vector<double>().swap(chunks[i].values);
+            },
+            1);
+    }
   
     numParts_ = nColumns - 1;
     numFrames_ = nLines;
 
     if(numFrames_ >= 2){
-        iterator it = seq.begin();
-        double time0 = (*it)[0];
-        double time1 = (*(++it))[0];
-        timeStep_ = time1 - time0;
+        timeStep_ = frame(1)[0] - frame(0)[0];
         if(timeStep_ <= 0.0){
             os << fmt::format(_("\"{}\": Time values are not arranged."), filename) << endl;
             return false;
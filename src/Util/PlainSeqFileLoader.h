@@ -7,30 +7,33 @@
 #define CNOID_UTIL_PLAIN_SEQ_FILE_LOADER_H
 
 #include "NullOut.h"
-#include <list>
 #include <vector>
 #include <string>
 #include "exportdecl.h"
 
 namespace cnoid {
 
+/**
+   The file is mapped to the memory and divided into chunks of lines, which are parsed in parallel.
+   The values are stored in a single array with the frames arranged in order.
+*/
 class CNOID_EXPORT PlainSeqFileLoader
 {
 public:
-    typedef std::list<std::vector<double>> Seq;
-    typedef Seq::iterator iterator;
-
     bool load(const std::string& filename, std::ostream& os = nullout());
         
-    inline iterator begin() { return seq.begin(); }
-    inline iterator end() { return seq.end(); }
-        
-    inline int numParts() { return numParts_; }
-    inline int numFrames() { return numFrames_; }
-    inline double timeStep() { return timeStep_; }
+    inline int numParts() const { return numParts_; }
+    inline int numFrames() const { return numFrames_; }
+    inline double timeStep() const { return timeStep_; }
+
+    /**
+       The values of a frame. The first value is the time,
+       and the values of the parts follow it.
+    */
+    inline const double* frame(int index) const { return &values[index * (numParts_ + 1)]; }
 
 private:
-    Seq seq;
+    std::vector<double> values;
     int numParts_;
     int numFrames_;
     double timeStep_;
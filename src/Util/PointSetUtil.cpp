@@ -6,8 +6,13 @@
 #include "PointSetUtil.h"
 #include <cnoid/EasyScanner>
 #include <cnoid/Exception>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <fmt/format.h>
 #include <fstream>
+#include <sstream>
 #include <iomanip>
+#include <cstring>
+#include <cstdint>
 
 using namespace std;
 using namespace boost;
@@ -27,6 +32,35 @@ typedef union {
     float float_value;
 } RGBValue;
 
+struct Field
+{
+    string name;
+    int size;
+    char type;
+    int count;
+    //! The byte offset of the field in a point record
+    int offset;
+};
+
+struct PCDHeader
+{
+    vector<Field> fields;
+    int pointSize;
+    int numPoints;
+    string dataFormat;
+    //! The byte offset of the point data in the file
+    size_t dataOffset;
+    int numHeaderLines;
+};
+
+//! The values of a field in the point data of the binary formats
+struct FieldData
+{
+    const Field* field;
+    const char* top;
+    size_t stride;
+};
+
 
 void readPoints(SgPointSet* out_pointSet, EasyScanner& scanner, const std::vector<Element>& elements, int numPoints)
 {
@@ -110,67 +144,391 @@ void readPoints(SgPointSet* out_pointSet, EasyScanner& scanner, const std::vecto
     }
 }
 
+
+void throwReadError(const string& message, int lineNumber, const string& filename)
+{
+    throw file_read_error() << error_info_message(
+        fmt::format("{0} at line {1} of {2}", message, lineNumber, filename));
 }
 
 
-void cnoid::loadPCD(SgPointSet* out_pointSet, const std::string& filename)
+void readHeader(const char* data, size_t size, const string& filename, PCDHeader& header)
 {
-    try {
-        EasyScanner scanner(filename);
-        scanner.setCommentChar('#');
+    vector<int> sizes;
+    vector<char> types;
+    vector<int> counts;
+    int width = -1;
+    int height = -1;
+    header.numPoints = -1;
 
-        int numPoints = 0;
+    const char* pos = data;
+    const char* end = data + size;
+    int lineNumber = 0;
+    
+    while(pos < end){
+        const char* lineEnd = static_cast<const char*>(memchr(pos, '\n', end - pos));
+        if(!lineEnd){
+            lineEnd = end;
+        }
+        istringstream line(string(pos, lineEnd));
+        pos = (lineEnd < end) ? (lineEnd + 1) : end;
+        ++lineNumber;
 
-        std::vector<Element> elements;
+        string key;
+        if(!(line >> key) || key[0] == '#'){
+            continue;
+        }
+        if(key == "FIELDS"){
+            string name;
+            while(line >> name){
+                Field field;
+                field.name = name;
+                header.fields.push_back(field);
+            }
+        } else if(key == "SIZE"){
+            int value;
+            while(line >> value){
+                sizes.push_back(value);
+            }
+        } else if(key == "TYPE"){
+            char value;
+            while(line >> value){
+                types.push_back(value);
+            }
+        } else if(key == "COUNT"){
+            int value;
+            while(line >> value){
+                counts.push_back(value);
+            }
+        } else if(key == "WIDTH"){
+            line >> width;
+        } else if(key == "HEIGHT"){
+            line >> height;
+        } else if(key == "POINTS"){
+            if(!(line >> header.numPoints) || header.numPoints < 0){
+                throwReadError("The 'POINTS' field is not correctly specified.", lineNumber, filename);
+            }
+        } else if(key == "DATA"){
+            if(!(line >> header.dataFormat)){
+                throwReadError("The 'DATA' field is not correctly specified.", lineNumber, filename);
+            }
+            header.dataOffset = pos - data;
+            header.numHeaderLines = lineNumber;
+            break;
+        }
+    }
+
+    if(header.dataFormat.empty()){
+        throwReadError("The 'DATA' field is not found.", lineNumber, filename);
+    }
+    if(header.numPoints < 0){
+        header.numPoints = (width >= 0 && height >= 0) ? (width * height) : 0;
+    }
+
+    // The sizes and types of the fields are only necessary for the binary formats
+    if(header.dataFormat == "binary" || header.dataFormat == "binary_compressed"){
+        const size_t numFields = header.fields.size();
+        if(sizes.size() != numFields || types.size() != numFields ||
+           (!counts.empty() && counts.size() != numFields)){
+            throwReadError("The 'SIZE', 'TYPE' or 'COUNT' field does not match the 'FIELDS' field.",
+                           header.numHeaderLines, filename);
+        }
+        header.pointSize = 0;
+        for(size_t i=0; i < numFields; ++i){
+            auto& field = header.fields[i];
+            field.size = sizes[i];
+            field.type = types[i];
+            field.count = counts.empty() ? 1 : counts[i];
+            field.offset = header.pointSize;
+            header.pointSize += field.size * field.count;
+        }
+    }
+}
+
+
+bool isSupportedScalarType(const Field& field)
+{
+    switch(field.type){
+    case 'F':
+        return field.size == 4 || field.size == 8;
+    case 'U':
+    case 'I':
+        return field.size == 1 || field.size == 2 || field.size == 4;
+    }
+    return false;
+}
 
-        while(true){
-            scanner.skipBlankLines();
-            scanner.readWordEx("Illegal header key");
-
-            if(scanner.stringValue == "FIELDS"){
-                while(scanner.readWord()){
-                    if(scanner.stringValue == "x"){
-                        elements.push_back(E_X);
-                    } else if(scanner.stringValue == "y"){
-                        elements.push_back(E_Y);
-                    } else if(scanner.stringValue == "z"){
-                        elements.push_back(E_Z);
-                    } else if(scanner.stringValue == "normal_x"){
-                        elements.push_back(E_NORMAL_X);
-                    } else if(scanner.stringValue == "normal_y"){
-                        elements.push_back(E_NORMAL_Y);
-                    } else if(scanner.stringValue == "normal_z"){
-                        elements.push_back(E_NORMAL_Z);
-                    } else if(scanner.stringValue == "rgb"){
-                        elements.push_back(E_RGB);
-                    }
+
+template<typename T>
+inline T loadValue(const char* p)
+{
+    T value;
+    // The values in the point records are not necessarily aligned
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+
+float loadFloatValue(const char* p, const Field& field)
+{
+    if(field.type == 'F'){
+        return (field.size == 4) ? loadValue<float>(p) : loadValue<double>(p);
+    } else if(field.type == 'U'){
+        switch(field.size){
+        case 1: return loadValue<uint8_t>(p);
+        case 2: return loadValue<uint16_t>(p);
+        default: return loadValue<uint32_t>(p);
+        }
+    } else {
+        switch(field.size){
+        case 1: return loadValue<int8_t>(p);
+        case 2: return loadValue<int16_t>(p);
+        default: return loadValue<int32_t>(p);
+        }
+    }
+}
+
+
+void readVectors(SgVectorArray<Vector3f>& out_vectors, const FieldData* xyz, int numPoints)
+{
+    out_vectors.resize(numPoints);
+    
+    if(xyz[0].field->type == 'F' && xyz[0].field->size == 4 &&
+       xyz[1].field->type == 'F' && xyz[1].field->size == 4 &&
+       xyz[2].field->type == 'F' && xyz[2].field->size == 4){
+        for(int i=0; i < numPoints; ++i){
+            auto& v = out_vectors[i];
+            for(int j=0; j < 3; ++j){
+                memcpy(&v[j], xyz[j].top + i * xyz[j].stride, sizeof(float));
+            }
+        }
+    } else {
+        for(int i=0; i < numPoints; ++i){
+            auto& v = out_vectors[i];
+            for(int j=0; j < 3; ++j){
+                v[j] = loadFloatValue(xyz[j].top + i * xyz[j].stride, *xyz[j].field);
+            }
+        }
+    }
+}
+
+
+/**
+   The implementation of the LZF decompression, which is used in the binary_compressed format.
+   \return false if the compressed data is corrupted
+*/
+bool decompressLZF(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize)
+{
+    const uint8_t* ip = in;
+    const uint8_t* const inEnd = in + inSize;
+    uint8_t* op = out;
+    uint8_t* const outEnd = out + outSize;
+
+    while(ip < inEnd){
+        size_t ctrl = *ip++;
+        if(ctrl < 32){
+            // Literal run
+            const size_t length = ctrl + 1;
+            if(length > size_t(inEnd - ip) || length > size_t(outEnd - op)){
+                return false;
+            }
+            memcpy(op, ip, length);
+            ip += length;
+            op += length;
+        } else {
+            // Back reference
+            size_t length = ctrl >> 5;
+            if(length == 7){
+                if(ip == inEnd){
+                    return false;
                 }
-            } else if(scanner.stringValue == "POINTS"){
-                numPoints = scanner.readIntEx("The 'POINTS' field is not correctly specified.");
-            } else if(scanner.stringValue == "DATA"){
-                scanner.readWordEx("The 'DATA' field is not correctly specified.");
-                if(scanner.stringValue == "ascii"){
-                    scanner.readLFex();
-                    if(elements.empty()){
-                        scanner.throwException("The specification of field elements is not found.");
-                    }
-                    readPoints(out_pointSet, scanner, elements, numPoints);
-                    break;
+                length += *ip++;
+            }
+            length += 2;
+            if(ip == inEnd){
+                return false;
+            }
+            const size_t distance = ((ctrl & 0x1f) << 8) + *ip++ + 1;
+            if(distance > size_t(op - out) || length > size_t(outEnd - op)){
+                return false;
+            }
+            // The source and the destination may overlap
+            const uint8_t* ref = op - distance;
+            for(size_t i=0; i < length; ++i){
+                op[i] = ref[i];
+            }
+            op += length;
+        }
+    }
+
+    return op == outEnd;
+}
+
+
+/**
+   \param data The point data, which is arranged by points in the binary format and
+   by fields in the binary_compressed format.
+*/
+void readBinaryPoints
+(SgPointSet* out_pointSet, const PCDHeader& header, const char* data, bool isFieldMajor, const string& filename)
+{
+    const int numPoints = header.numPoints;
+    
+    auto findField = [&](const char* name, FieldData& out_data){
+        for(auto& field : header.fields){
+            if(field.name == name){
+                out_data.field = &field;
+                if(isFieldMajor){
+                    out_data.top = data + static_cast<size_t>(numPoints) * field.offset;
+                    out_data.stride = field.size * field.count;
                 } else {
-                    scanner.throwException("The 'ascii' format is only supported for the point DATA.");
+                    out_data.top = data + field.offset;
+                    out_data.stride = header.pointSize;
                 }
-            } else {
-                scanner.skipToLineEnd();
+                return true;
+            }
+        }
+        return false;
+    };
+    auto findVectorFields = [&](const char* x, const char* y, const char* z, FieldData* out_xyz){
+        if(findField(x, out_xyz[0]) && findField(y, out_xyz[1]) && findField(z, out_xyz[2])){
+            for(int i=0; i < 3; ++i){
+                if(!isSupportedScalarType(*out_xyz[i].field)){
+                    throwReadError(
+                        fmt::format("The type of the '{}' field is not supported.", out_xyz[i].field->name),
+                        header.numHeaderLines, filename);
+                }
+            }
+            return true;
+        }
+        return false;
+    };
+
+    FieldData xyz[3];
+    if(!findVectorFields("x", "y", "z", xyz)){
+        throwReadError("The specification of field elements is not found.", header.numHeaderLines, filename);
+    }
+    SgVertexArrayPtr vertices = new SgVertexArray;
+    readVectors(*vertices, xyz, numPoints);
+
+    SgNormalArrayPtr normals;
+    FieldData normalXyz[3];
+    if(findVectorFields("normal_x", "normal_y", "normal_z", normalXyz)){
+        normals = new SgNormalArray;
+        readVectors(*normals, normalXyz, numPoints);
+    }
+
+    SgColorArrayPtr colors;
+    FieldData rgb;
+    if((findField("rgb", rgb) || findField("rgba", rgb)) && rgb.field->size == 4){
+        colors = new SgColorArray(numPoints);
+        for(int i=0; i < numPoints; ++i){
+            // The packed color is stored in the order of blue, green, red and alpha
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(rgb.top + i * rgb.stride);
+            (*colors)[i] << p[2] / 255.0f, p[1] / 255.0f, p[0] / 255.0f;
+        }
+    }
+
+    if(vertices->empty()){
+        throw file_read_error() << error_info_message("No valid points");
+    }
+    out_pointSet->setVertices(vertices);
+    out_pointSet->setNormals(normals);
+    out_pointSet->normalIndices().clear();
+    out_pointSet->setColors(colors);
+    out_pointSet->colorIndices().clear();
+}
+
+}
+
+
+/**
+   The file is mapped to the memory, and the point data of the binary formats are directly
+   copied or decompressed from the mapped file into the arrays of the point set.
+*/
+void cnoid::loadPCD(SgPointSet* out_pointSet, const std::string& filename)
+{
+    boost::iostreams::mapped_file_source file;
+    try {
+        file.open(filename);
+    }
+    catch(const std::exception&){
+        throw file_read_error() << error_info_message(fmt::format("Cannot open file {}", filename));
+    }
+    const char* data = file.data();
+    const size_t size = file.size();
+
+    PCDHeader header;
+    readHeader(data, size, filename, header);
+
+    const char* pointData = data + header.dataOffset;
+    const size_t pointDataSize = size - header.dataOffset;
+    const size_t numPointBytes = static_cast<size_t>(header.numPoints) * header.pointSize;
+
+    if(header.dataFormat == "ascii"){
+        std::vector<Element> elements;
+        for(auto& field : header.fields){
+            if(field.name == "x"){
+                elements.push_back(E_X);
+            } else if(field.name == "y"){
+                elements.push_back(E_Y);
+            } else if(field.name == "z"){
+                elements.push_back(E_Z);
+            } else if(field.name == "normal_x"){
+                elements.push_back(E_NORMAL_X);
+            } else if(field.name == "normal_y"){
+                elements.push_back(E_NORMAL_Y);
+            } else if(field.name == "normal_z"){
+                elements.push_back(E_NORMAL_Z);
+            } else if(field.name == "rgb"){
+                elements.push_back(E_RGB);
             }
-            scanner.readLFEOFex("The field value is not correctly specified.");
         }
-    } catch(EasyScanner::Exception& ex){
-        throw file_read_error() << error_info_message(ex.getFullMessage());
+        if(elements.empty()){
+            throwReadError("The specification of field elements is not found.", header.numHeaderLines, filename);
+        }
+        try {
+            EasyScanner scanner;
+            scanner.setCommentChar('#');
+            scanner.setLineNumberOffset(header.numHeaderLines + 1);
+            scanner.setText(pointData, pointDataSize);
+            scanner.filename = filename;
+            readPoints(out_pointSet, scanner, elements, header.numPoints);
+        } catch(EasyScanner::Exception& ex){
+            throw file_read_error() << error_info_message(ex.getFullMessage());
+        }
+        
+    } else if(header.dataFormat == "binary"){
+        if(pointDataSize < numPointBytes){
+            throwReadError("The point data is shorter than the specified size.", header.numHeaderLines, filename);
+        }
+        readBinaryPoints(out_pointSet, header, pointData, false, filename);
+
+    } else if(header.dataFormat == "binary_compressed"){
+        uint32_t compressedSize = 0;
+        uint32_t uncompressedSize = 0;
+        if(pointDataSize >= 8){
+            compressedSize = loadValue<uint32_t>(pointData);
+            uncompressedSize = loadValue<uint32_t>(pointData + 4);
+        }
+        if(pointDataSize < 8 || pointDataSize - 8 < compressedSize || uncompressedSize < numPointBytes){
+            throwReadError("The compressed point data is not correctly specified.", header.numHeaderLines, filename);
+        }
+        vector<char> buf(uncompressedSize);
+        if(!decompressLZF(reinterpret_cast<const uint8_t*>(pointData + 8), compressedSize,
+                          reinterpret_cast<uint8_t*>(buf.data()), uncompressedSize)){
+            throwReadError("The compressed point data is corrupted.", header.numHeaderLines, filename);
+        }
+        readBinaryPoints(out_pointSet, header, buf.data(), true, filename);
+
+    } else {
+        throwReadError(fmt::format("The '{}' format of the point DATA is not supported.", header.dataFormat),
+                       header.numHeaderLines, filename);
     }
 }
 
 
-void cnoid::savePCD(SgPointSet* pointSet, const std::string& filename, const Affine3& viewpoint)
+void cnoid::savePCD(SgPointSet* pointSet, const std::string& filename, const Affine3& viewpoint, bool isBinary)
 {
     if(!pointSet->hasVertices()){
         throw empty_data_error() << error_info_message("Empty pointset");
@@ -179,7 +537,11 @@ void cnoid::savePCD(SgPointSet* pointSet, const std::string& filename, const Aff
     bool hasColors = pointSet->hasColors() && pointSet->colorIndices().empty();
 
     ofstream ofs;
-    ofs.open(filename.c_str());
+    if(isBinary){
+        ofs.open(filename.c_str(), ios::out | ios::binary);
+    } else {
+        ofs.open(filename.c_str());
+    }
     ofs << scientific << setprecision(9);
 
     ofs << "# .PCD v.7 - Point Cloud Data file format\n";
@@ -209,9 +571,30 @@ void cnoid::savePCD(SgPointSet* pointSet, const std::string& filename, const Aff
 
     ofs << "POINTS " << numPoints << "\n";
     
-    ofs << "DATA ascii\n";
+    if(isBinary){
+        ofs << "DATA binary\n";
+        const int numFields = hasColors ? 4 : 3;
+        vector<float> buf(numPoints * numFields);
+        float* p = buf.data();
+        RGBValue rgb;
+        rgb.alpha = 0;
+        for(int i=0; i < numPoints; ++i){
+            const Vector3f& point = points[i];
+            *p++ = point.x();
+            *p++ = point.y();
+            *p++ = point.z();
+            if(hasColors){
+                const Vector3f& c = (*pointSet->colors())[i];
+                rgb.red = (unsigned char)(255.0 * c[0]);
+                rgb.green = (unsigned char)(255.0 * c[1]);
+                rgb.blue = (unsigned char)(255.0 * c[2]);
+                *p++ = rgb.float_value;
+            }
+        }
+        ofs.write(reinterpret_cast<const char*>(buf.data()), buf.size() * sizeof(float));
 
-    if(hasColors){
+    } else if(hasColors){
+        ofs << "DATA ascii\n";
         RGBValue rgb;
         rgb.alpha = 0.0;
         const SgColorArray& colors = *pointSet->colors();
@@ -224,6 +607,7 @@ void cnoid::savePCD(SgPointSet* pointSet, const std::string& filename, const Aff
             ofs << p.x() << " " << p.y() << " " << p.z() << " " << rgb.float_value << "\n";
         }
     } else {
+        ofs << "DATA ascii\n";
         for(int i=0; i < numPoints; ++i){
             const Vector3f& p = points[i];
             ofs << p.x() << " " << p.y() << " " << p.z() << "\n";
@@ -11,8 +11,15 @@
 
 namespace cnoid {
 
+/**
+   The ascii, binary and binary_compressed formats are supported.
+*/
 CNOID_EXPORT void loadPCD(SgPointSet* out_pointSet, const std::string& filename);
-CNOID_EXPORT void savePCD(SgPointSet* pointSet, const std::string& filename, const Affine3d& viewpoint = Affine3d::Identity());
+
+/**
+   \param isBinary The points are saved in the binary format instead of the ascii format if true.
+*/
+CNOID_EXPORT void savePCD(SgPointSet* pointSet, const std::string& filename, const Affine3d& viewpoint = Affine3d::Identity(), bool isBinary = false);
 
 }
 
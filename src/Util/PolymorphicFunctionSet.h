@@ -43,9 +43,13 @@ public:
         }
     }
 
-    template <class Object>
-    void setFunction(std::function<void(Object* obj)> func){
-        setFunction<Object>([func](ObjectBase* obj){ func(static_cast<Object*>(obj)); });
+    /**
+       The function object is directly stored in the wrapper function which casts the object
+       so that a dispatch only calls one std::function.
+    */
+    template <class Object, class ObjectFunction>
+    void setFunction(ObjectFunction func){
+        setFunction<Object>(Function([func](ObjectBase* obj){ func(static_cast<Object*>(obj)); }));
     }
 
     template <class Object>
@@ -94,6 +98,7 @@ public:
                 }
             }
         }
+        isDirty = false;
     }
 
     inline void dispatch(ObjectBase* obj){
@@ -109,7 +114,10 @@ public:
 
     template <class Object>
     inline void dispatchAs(Object* obj){
-        const auto& func = dispatchTable[ObjectBase::template findPolymorphicId<Object>()];
+        // The type has been registered because the object of the type has been created,
+        // so the id found at the first call is kept without looking up the type map each time
+        static const int id = ObjectBase::template findPolymorphicId<Object>();
+        const auto& func = dispatchTable[id];
         if(func){
             func(obj);
         }
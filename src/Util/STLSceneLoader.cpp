@@ -8,11 +8,15 @@
 #include "NullOut.h"
 #include "FileUtil.h"
 #include "strtofloat.h"
+#include "ThreadPool.h"
 #include <fmt/format.h>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <fstream>
 #include <thread>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstring>
+#include <cstdint>
 #include "gettext.h"
 
 using namespace std;
@@ -243,15 +247,6 @@ public:
     SgIndexArray* triangleVertices;
     SgNormalArrayPtr normals;
     SgIndexArray* normalIndices;
-
-    /**
-       The following two variables are only used in BinaryMeshLoader.
-       Defining them here instead of BinaryMeshLoader can improve the loading speed.
-       It seems that this is because the cache hit ratio is improved.
-    */
-    size_t triangleVerticesIndex;
-    size_t normalIndicesIndex;
-    
     BoundingBoxf bbox;
     thread loaderThread;
 
@@ -291,16 +286,106 @@ public:
     SgMeshPtr completeMesh(bool doShrin);
 };
 
-class BinaryMeshLoader : public MeshLoader
+/**
+   The open addressing hash table of the indices of the vectors stored in an array.
+   The vectors which have exactly the same coordinates are found as the same element.
+*/
+class VectorHashTable
 {
 public:
-    BinaryMeshLoader(size_t numTriangles) : MeshLoader(numTriangles) { }
-    BinaryMeshLoader(const BinaryMeshLoader& mainLoader) : MeshLoader(mainLoader) { }
-    void initializeArrays(size_t triangleOffset, size_t numTriangles);
-    void addNormal(const Vector3f& normal);
-    void addVertex(const Vector3f& vertex);
-    void load(ifstream& ifs, size_t triangleOffset, size_t numTriangles);
-    void loadConcurrently(const string& filename, size_t triangleOffset, size_t numTriangles);
+    vector<int> slots;
+    size_t mask;
+
+    VectorHashTable(size_t numExpectedElements)
+    {
+        size_t size = 16;
+        while(size < numExpectedElements * 2){
+            size *= 2;
+        }
+        slots.resize(size, -1);
+        mask = size - 1;
+    }
+
+    static size_t hash(const Vector3f& v)
+    {
+        uint32_t bits[3];
+        std::memcpy(bits, v.data(), sizeof(bits));
+        uint64_t h = bits[0];
+        h = h * 0x9e3779b97f4a7c15ull + bits[1];
+        h = h * 0x9e3779b97f4a7c15ull + bits[2];
+        h *= 0x9e3779b97f4a7c15ull;
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+
+    void rehash(const SgVectorArray<Vector3f>& elements)
+    {
+        slots.assign(slots.size() * 2, -1);
+        mask = slots.size() - 1;
+        const int n = elements.size();
+        for(int index = 0; index < n; ++index){
+            size_t i = hash(elements[index]) & mask;
+            while(slots[i] >= 0){
+                i = (i + 1) & mask;
+            }
+            slots[i] = index;
+        }
+    }
+
+    int findOrAdd(const float* values, SgVectorArray<Vector3f>& elements)
+    {
+        // Adding zero makes negative zeros positive so that they are the same as positive zeros
+        const Vector3f v(values[0] + 0.0f, values[1] + 0.0f, values[2] + 0.0f);
+        if((elements.size() + 1) * 2 > slots.size()){
+            rehash(elements);
+        }
+        size_t i = hash(v) & mask;
+        while(true){
+            const int index = slots[i];
+            if(index < 0){
+                slots[i] = elements.size();
+                elements.push_back(v);
+                return slots[i];
+            }
+            if(elements[index] == v){
+                return index;
+            }
+            i = (i + 1) & mask;
+        }
+    }
+};
+
+/**
+   The loader of the binary format which directly reads the triangle records in the mapped file.
+   The vertices and the normals are merged with the hash tables of their coordinates, so the
+   elements are shared in the whole mesh as long as their coordinates are exactly the same.
+   The triangles are divided into the chunks loaded in parallel, and the elements of the
+   chunks are merged after that.
+*/
+class BinaryMeshLoader
+{
+public:
+    struct Chunk
+    {
+        size_t triangleOffset;
+        size_t numTriangles;
+        SgVertexArrayPtr vertices;
+        SgNormalArrayPtr normals;
+        vector<int> vertexIndexMap;
+        vector<int> normalIndexMap;
+    };
+
+    const char* data;
+    size_t numTriangles;
+    SgMeshPtr mesh;
+    vector<Chunk> chunks;
+
+    BinaryMeshLoader(const char* data, size_t numTriangles);
+    SgMeshPtr load();
+    void loadChunk(Chunk& chunk);
+    void mergeChunks(ThreadPool* threadPool);
+    void mergeElements(
+        const SgVectorArray<Vector3f>& chunkElements, SgVectorArray<Vector3f>& elements,
+        VectorHashTable& table, vector<int>& out_indexMap);
 };
 
 class AsciiMeshLoader : public MeshLoader
@@ -348,9 +433,7 @@ public:
 
     STLSceneLoaderImpl();
     SgNode* load(const string& filename);
-    SgMeshPtr loadBinaryFormat(const string& filename, ifstream& ifs, size_t numTriangles);
-    SgMeshPtr loadBinaryFormatConcurrently(
-        const string& filename, ifstream& ifs, size_t numTriangles, size_t numThreads, BinaryMeshLoader& mainLoader);
+    SgMeshPtr loadBinaryFormat(const string& filename, size_t numTriangles);
     SgMeshPtr loadAsciiFormat(const string& filename, pos_type fileSize);
     SgMeshPtr loadAsciiFormatConcurrently(
         const string& filename, AsciiMeshLoader& mainLoader, pos_type fileSize, size_t numThreads);
@@ -686,9 +769,11 @@ SgNode* STLSceneLoaderImpl::load(const string& filename)
         }
     }
 
+    ifs.close();
+
     SgMeshPtr mesh;
     if(isBinary){
-        mesh = loadBinaryFormat(filename, ifs, numTriangles);
+        mesh = loadBinaryFormat(filename, numTriangles);
     } else {
         mesh = loadAsciiFormat(filename, fileSize);
     }
@@ -703,7 +788,7 @@ SgNode* STLSceneLoaderImpl::load(const string& filename)
 }
 
 
-SgMeshPtr STLSceneLoaderImpl::loadBinaryFormat(const string& filename, ifstream& ifs, size_t numTriangles)
+SgMeshPtr STLSceneLoaderImpl::loadBinaryFormat(const string& filename, size_t numTriangles)
 {
     if(numTriangles == 0){
         os() << format(_("No triangles in \"{1}\"."), filename) << endl;
@@ -713,124 +798,154 @@ SgMeshPtr STLSceneLoaderImpl::loadBinaryFormat(const string& filename, ifstream&
         os() << format(_("Unable to load \"{1}\". Its file size is too large."), filename) << endl;
         return nullptr;
     }
-    
-    BinaryMeshLoader mainLoader(numTriangles);
-
-    size_t numThreads = std::min(maxNumThreads, std::max(size_t(1), numTriangles / NumTrianglesPerThread));
 
-    /**
-       The number of threads is limited to 4 at maximum because just increasing
-       the number of threds accessing the same file will slow down overall file
-       reading speed.
-    */
-    if(numThreads > 4){
-        numThreads = 4;
+    boost::iostreams::mapped_file_source file;
+    try {
+        file.open(filename);
     }
-
-    if(numThreads == 1){
-        mainLoader.load(ifs, 0, numTriangles);
-        return mainLoader.completeMesh(true);
-    } else {
-        return loadBinaryFormatConcurrently(filename, ifs, numTriangles, numThreads, mainLoader);
+    catch(const std::exception&){
+        os() << format(_("Unable to open file \"{}\"."), filename) << endl;
+        return nullptr;
     }
+
+    BinaryMeshLoader loader(file.data(), numTriangles);
+    return loader.load();
 }
 
 
-SgMeshPtr STLSceneLoaderImpl::loadBinaryFormatConcurrently
-(const string& filename, ifstream& ifs, size_t numTriangles, size_t numThreads, BinaryMeshLoader& mainLoader)
+BinaryMeshLoader::BinaryMeshLoader(const char* data, size_t numTriangles)
+    : data(data),
+      numTriangles(numTriangles),
+      mesh(new SgMesh)
 {
-    vector<BinaryMeshLoader> loaders(numThreads, mainLoader);
-    
-    int index = 0;
-    size_t triangleOffset = 0;
-    size_t numTrianglesPerThread = numTriangles / numThreads;
-    while(index < numThreads - 1){
-        loaders[index].loadConcurrently(filename, triangleOffset, numTrianglesPerThread);
-        ++index;
-        triangleOffset += numTrianglesPerThread;
-    }
-    loaders[index].load(ifs, triangleOffset, numTriangles - triangleOffset);
-
-    for(auto& loader : loaders){
-        loader.join();
-    }
-
-    return integrateSubLoaderMeshes(mainLoader, getMeshLoaderPointers(loaders));
+    mesh->setNumTriangles(numTriangles);
+    mesh->normalIndices().resize(numTriangles * 3);
 }
 
 
-void BinaryMeshLoader::initializeArrays(size_t triangleOffset, size_t numTriangles)
+SgMeshPtr BinaryMeshLoader::load()
 {
-    this->triangleOffset = triangleOffset;
-    this->numTriangles = numTriangles;
-    
-    vertices->reserve(ENABLE_COMPACTION ? (numTriangles * 3 * 0.4) : (numTriangles * 3));
-    triangleVertices = &sharedMesh->triangleVertices();
-    triangleVerticesIndex = triangleOffset * 3;
+    auto threadPool = ThreadPool::instance();
+    const size_t numChunks =
+        std::min(size_t(threadPool->size() + 1), std::max(size_t(1), numTriangles / NumTrianglesPerThread));
+    chunks.resize(numChunks);
+    const size_t numTrianglesPerChunk = numTriangles / numChunks;
+    for(size_t i=0; i < numChunks; ++i){
+        auto& chunk = chunks[i];
+        chunk.triangleOffset = i * numTrianglesPerChunk;
+        chunk.numTriangles = (i < numChunks - 1) ? numTrianglesPerChunk : (numTriangles - chunk.triangleOffset);
+    }
 
-    normals->reserve(ENABLE_COMPACTION ? (numTriangles * 0.25) : numTriangles);
-    normalIndices = &sharedMesh->normalIndices();
-    normalIndicesIndex = triangleOffset * 3;
-}
+    threadPool->parallelFor(0, numChunks, [&](int i){ loadChunk(chunks[i]); }, 1);
 
+    if(numChunks == 1){
+        mesh->setVertices(chunks[0].vertices);
+        mesh->setNormals(chunks[0].normals);
+    } else {
+        mergeChunks(threadPool);
+    }
+    chunks.clear();
 
-void BinaryMeshLoader::addNormal(const Vector3f& normal)
-{
-    MeshLoader::addNormal(
-        normal,
-        [this](int index){
-            (*normalIndices)[normalIndicesIndex++] = index;
-            (*normalIndices)[normalIndicesIndex++] = index;
-            (*normalIndices)[normalIndicesIndex++] = index;
-        });
+    auto& vertices = *mesh->vertices();
+    BoundingBoxf bbox;
+    for(auto& vertex : vertices){
+        bbox.expandBy(vertex);
+    }
+    mesh->setBoundingBox(bbox);
+
+    return mesh;
 }
 
 
-void BinaryMeshLoader::addVertex(const Vector3f& vertex)
+void BinaryMeshLoader::loadChunk(Chunk& chunk)
 {
-    MeshLoader::addVertex(
-        vertex,
-        [this](int index){
-            (*triangleVertices)[triangleVerticesIndex++] = index;
-        });
+    const size_t n = chunk.numTriangles;
+    chunk.vertices = new SgVertexArray;
+    chunk.normals = new SgNormalArray;
+
+    // A closed mesh has about half as many vertices as triangles
+    VectorHashTable vertexTable(n / 2);
+    VectorHashTable normalTable(n / 4);
+
+    const char* record = data + STL_BINARY_HEADER_SIZE + chunk.triangleOffset * 50;
+    int* vertexIndices = &mesh->triangleVertices()[chunk.triangleOffset * 3];
+    int* normalIndices = &mesh->normalIndices()[chunk.triangleOffset * 3];
+    float values[12];
+
+    for(size_t i=0; i < n; ++i){
+        // The records are not aligned to the float values
+        std::memcpy(values, record, sizeof(values));
+        record += 50;
+        const int normalIndex = normalTable.findOrAdd(values, *chunk.normals);
+        normalIndices[0] = normalIndex;
+        normalIndices[1] = normalIndex;
+        normalIndices[2] = normalIndex;
+        normalIndices += 3;
+        vertexIndices[0] = vertexTable.findOrAdd(&values[3], *chunk.vertices);
+        vertexIndices[1] = vertexTable.findOrAdd(&values[6], *chunk.vertices);
+        vertexIndices[2] = vertexTable.findOrAdd(&values[9], *chunk.vertices);
+        vertexIndices += 3;
+    }
 }
 
 
-void BinaryMeshLoader::load(ifstream& ifs, size_t triangleOffset, size_t numTriangles)
+/**
+   The elements of the chunks are added to the hash tables of the whole mesh in the order
+   of the chunks so that the result does not depend on the number of the chunks, and then
+   the chunk-local indices are converted in parallel.
+*/
+void BinaryMeshLoader::mergeChunks(ThreadPool* threadPool)
 {
-    ifs.seekg(STL_BINARY_HEADER_SIZE + triangleOffset * 50);
-
-    /**
-       Buffer size can be specified by the following code.
-       It is currently disabled becasue it does not especially obtain a better result
-       on both Ubuntu 18.04 + GCC 8.3.0 and Visual C++ 2017.
-    */
-    /*
-    vector<char> buf(1 * 1024 * 1024);
-    ifs.rdbuf()->pubsetbuf(&buf.front(), buf.size());
-    */
-    
-    initializeArrays(triangleOffset, numTriangles);
-
-    const size_t datasize = sizeof(float) * 3 * 4 + 2;
-    char data[datasize];
-    for(size_t i = 0; i < numTriangles; ++i){
-        ifs.read(data, datasize);
-        addNormal(Vector3f(reinterpret_cast<float*>(data)));
-        addVertex(Vector3f(reinterpret_cast<float*>(&data[12])));
-        addVertex(Vector3f(reinterpret_cast<float*>(&data[24])));
-        addVertex(Vector3f(reinterpret_cast<float*>(&data[36])));
+    size_t totalNumVertices = 0;
+    size_t totalNumNormals = 0;
+    for(auto& chunk : chunks){
+        totalNumVertices += chunk.vertices->size();
+        totalNumNormals += chunk.normals->size();
+    }
+    auto vertices = mesh->setVertices(new SgVertexArray);
+    auto normals = mesh->setNormals(new SgNormalArray);
+    vertices->reserve(totalNumVertices);
+    normals->reserve(totalNumNormals);
+    VectorHashTable vertexTable(totalNumVertices);
+    VectorHashTable normalTable(totalNumNormals);
+
+    for(auto& chunk : chunks){
+        mergeElements(*chunk.vertices, *vertices, vertexTable, chunk.vertexIndexMap);
+        chunk.vertices.reset();
+        mergeElements(*chunk.normals, *normals, normalTable, chunk.normalIndexMap);
+        chunk.normals.reset();
     }
+    vertices->shrink_to_fit();
+    normals->shrink_to_fit();
+
+    auto& triangleVertices = mesh->triangleVertices();
+    auto& normalIndices = mesh->normalIndices();
+
+    // The indices of the first chunk are not changed
+    threadPool->parallelFor(
+        1, chunks.size(),
+        [&](int i){
+            auto& chunk = chunks[i];
+            const size_t begin = chunk.triangleOffset * 3;
+            const size_t end = begin + chunk.numTriangles * 3;
+            for(size_t j = begin; j < end; ++j){
+                triangleVertices[j] = chunk.vertexIndexMap[triangleVertices[j]];
+                normalIndices[j] = chunk.normalIndexMap[normalIndices[j]];
+            }
+        },
+        1);
 }
 
 
-void BinaryMeshLoader::loadConcurrently(const string& filename, size_t triangleOffset, size_t numTriangles)
+void BinaryMeshLoader::mergeElements
+(const SgVectorArray<Vector3f>& chunkElements, SgVectorArray<Vector3f>& elements,
+ VectorHashTable& table, vector<int>& out_indexMap)
 {
-    loaderThread = thread(
-        [this, filename, triangleOffset, numTriangles](){
-            ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
-            load(ifs, triangleOffset, numTriangles);
-        });
+    const size_t n = chunkElements.size();
+    out_indexMap.resize(n);
+    for(size_t i=0; i < n; ++i){
+        out_indexMap[i] = table.findOrAdd(chunkElements[i].data(), elements);
+    }
 }
 
 
@@ -88,6 +88,13 @@ SgObject* SgImage::clone(SgCloneMap&) const
 }
 
 
+void SgImage::countOwnMemoryUsage(MemoryUsageCounter& counter) const
+{
+    SgObject::countOwnMemoryUsage(counter);
+    counter.addShared(image_.get(), image_->memorySize());
+}
+
+
 Image& SgImage::image()
 {
     if(image_.use_count() > 1){
@@ -315,6 +322,17 @@ SgObject* SgMeshBase::childObject(int index)
 }
 
 
+void SgMeshBase::countOwnMemoryUsage(MemoryUsageCounter& counter) const
+{
+    SgObject::countOwnMemoryUsage(counter);
+    counter.add((normalIndices_.capacity() + colorIndices_.capacity() + texCoordIndices_.capacity()) * sizeof(int));
+    // The texture coordinates are not included in the child objects
+    if(texCoords_){
+        texCoords_->countMemoryUsage(counter);
+    }
+}
+
+
 void SgMeshBase::updateBoundingBox()
 {
     if(!vertices_){
@@ -440,6 +458,13 @@ SgObject* SgMesh::clone(SgCloneMap& cloneMap) const
 }
 
 
+void SgMesh::countOwnMemoryUsage(MemoryUsageCounter& counter) const
+{
+    SgMeshBase::countOwnMemoryUsage(counter);
+    counter.add(triangleVertices_.capacity() * sizeof(int));
+}
+
+
 void SgMesh::updateBoundingBox()
 {
     if(!USE_FACES_FOR_BOUNDING_BOX_CALCULATION){
@@ -529,6 +554,13 @@ SgObject* SgPolygonMesh::clone(SgCloneMap& cloneMap) const
 }
 
 
+void SgPolygonMesh::countOwnMemoryUsage(MemoryUsageCounter& counter) const
+{
+    SgMeshBase::countOwnMemoryUsage(counter);
+    counter.add(polygonVertices_.capacity() * sizeof(int));
+}
+
+
 void SgPolygonMesh::updateBoundingBox()
 {
     if(!USE_FACES_FOR_BOUNDING_BOX_CALCULATION){
@@ -768,6 +800,20 @@ SgObject* SgPlot::childObject(int index)
     if(colors_) objects[i++] = colors_.get();
     return objects[index];
 }
+
+
+void SgPlot::countOwnMemoryUsage(MemoryUsageCounter& counter) const
+{
+    SgNode::countOwnMemoryUsage(counter);
+    counter.add((normalIndices_.capacity() + colorIndices_.capacity()) * sizeof(int));
+    // The normals and the material are not included in the child objects
+    if(normals_){
+        normals_->countMemoryUsage(counter);
+    }
+    if(material_){
+        material_->countMemoryUsage(counter);
+    }
+}
     
 
 const BoundingBox& SgPlot::boundingBox() const
@@ -949,6 +995,13 @@ SgObject* SgLineSet::clone(SgCloneMap& cloneMap) const
 {
     return new SgLineSet(*this, cloneMap);
 }
+
+
+void SgLineSet::countOwnMemoryUsage(MemoryUsageCounter& counter) const
+{
+    SgPlot::countOwnMemoryUsage(counter);
+    counter.add(lineVertices_.capacity() * sizeof(int));
+}
     
 
 SgOverlay::SgOverlay(int polymorhicId)
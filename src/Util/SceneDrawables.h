@@ -8,6 +8,7 @@
 
 #include "SceneGraph.h"
 #include "Image.h"
+#include "MemoryUsage.h"
 #include <boost/variant.hpp>
 #include <memory>
 #include <initializer_list>
@@ -57,6 +58,8 @@ public:
     SgImage(std::shared_ptr<Image> sharedImage);
     SgImage(const SgImage& org);
     virtual SgObject* clone(SgCloneMap& cloneMap) const;
+    //! The image shared with other objects is counted only once
+    virtual void countOwnMemoryUsage(MemoryUsageCounter& counter) const;
 
     Image& image();
     const Image& image() const { return *image_; }
@@ -175,6 +178,11 @@ public:
     SgVectorArray(const SgVectorArray& org) : SgObject(org), values(org.values) { }
 
     virtual SgObject* clone(SgCloneMap&) const { return new SgVectorArray(*this); }
+
+    virtual void countOwnMemoryUsage(MemoryUsageCounter& counter) const {
+        SgObject::countOwnMemoryUsage(counter);
+        counter.add(values.capacity() * sizeof(T));
+    }
         
     SgVectorArray<T>& operator=(const SgVectorArray<T>& rhs) {
         values = rhs.values;
@@ -236,6 +244,7 @@ protected:
 public:
     virtual int numChildObjects() const;
     virtual SgObject* childObject(int index);
+    virtual void countOwnMemoryUsage(MemoryUsageCounter& counter) const;
 
     const BoundingBox& boundingBox() const { return bbox; }
     virtual void updateBoundingBox();
@@ -305,6 +314,7 @@ class CNOID_EXPORT SgMesh : public SgMeshBase
 public:
     SgMesh();
     virtual SgObject* clone(SgCloneMap& cloneMap) const;
+    virtual void countOwnMemoryUsage(MemoryUsageCounter& counter) const;
 
     virtual void updateBoundingBox();
 
@@ -350,7 +360,7 @@ public:
         triangleVertices_.push_back(v2);
     }
         
-    enum PrimitiveType { MESH = 0, BOX, SPHERE, CYLINDER, CONE, CAPSULE };
+    enum PrimitiveType { MESH = 0, BOX, SPHERE, CYLINDER, CONE, CAPSULE, HEIGHT_FIELD };
 
     class Mesh { }; // defined for no primitive information
 
@@ -396,7 +406,24 @@ public:
             double height;
         };
 
-    typedef boost::variant<Mesh, Box, Sphere, Cylinder, Cone, Capsule> Primitive;
+    /**
+       The heights of the grid on the x-z plane whose origin is the first point. A large field is
+       divided into the meshes of the tiles, which share this information of the whole field.
+       The triangles of a cell are divided by the diagonal from the point (x, z) to (x + 1, z + 1).
+    */
+    class HeightField {
+    public:
+        HeightField() : xDimension(0), zDimension(0), xSpacing(1.0), zSpacing(1.0) { }
+        float height(int x, int z) const { return (*heights)[z * xDimension + x]; }
+        int xDimension;
+        int zDimension;
+        double xSpacing;
+        double zSpacing;
+        //! The heights in the row-major order of the z index
+        std::shared_ptr<const std::vector<float>> heights;
+    };
+
+    typedef boost::variant<Mesh, Box, Sphere, Cylinder, Cone, Capsule, HeightField> Primitive;
 
     const int primitiveType() const { return primitive_.which(); }
     template<class TPrimitive> const TPrimitive& primitive() const { return boost::get<TPrimitive>(primitive_); }
@@ -421,6 +448,7 @@ class CNOID_EXPORT SgPolygonMesh : public SgMeshBase
 public:
     SgPolygonMesh();
     virtual SgObject* clone(SgCloneMap& cloneMap) const;
+    virtual void countOwnMemoryUsage(MemoryUsageCounter& counter) const;
 
     virtual void updateBoundingBox();
     
@@ -493,6 +521,7 @@ public:
 
     virtual int numChildObjects() const;
     virtual SgObject* childObject(int index);
+    virtual void countOwnMemoryUsage(MemoryUsageCounter& counter) const;
 
     virtual const BoundingBox& boundingBox() const;
     void updateBoundingBox();
@@ -568,6 +597,7 @@ class CNOID_EXPORT SgLineSet : public SgPlot
 public:
     SgLineSet();
     virtual SgObject* clone(SgCloneMap& cloneMap) const;
+    virtual void countOwnMemoryUsage(MemoryUsageCounter& counter) const;
 
     const SgIndexArray& lineVertices() const { return lineVertices_; }
     SgIndexArray& lineVertices() { return lineVertices_; }
@@ -5,9 +5,11 @@
 
 #include "SceneGraph.h"
 #include "Exception.h"
+#include "MemoryUsage.h"
 #include <unordered_map>
 #include <typeindex>
 #include <mutex>
+#include <algorithm>
 
 using namespace std;
 using namespace cnoid;
@@ -97,6 +99,26 @@ SgObject* SgObject::childObject(int /* index */)
 }
 
 
+void SgObject::countMemoryUsage(MemoryUsageCounter& counter)
+{
+    if(counter.visit(this)){
+        countOwnMemoryUsage(counter);
+        const int n = numChildObjects();
+        for(int i=0; i < n; ++i){
+            if(auto child = childObject(i)){
+                child->countMemoryUsage(counter);
+            }
+        }
+    }
+}
+
+
+void SgObject::countOwnMemoryUsage(MemoryUsageCounter& counter) const
+{
+    counter.add(sizeof(SgObject) + name_.capacity());
+}
+
+
 void SgObject::onUpdated(SgUpdate& update)
 {
     update.push(this);
@@ -110,7 +132,9 @@ void SgObject::onUpdated(SgUpdate& update)
 
 void SgObject::addParent(SgObject* parent, bool doNotify)
 {
-    parents.insert(parent);
+    if(std::find(parents.begin(), parents.end(), parent) == parents.end()){
+        parents.push_back(parent);
+    }
     if(doNotify){
         SgUpdate update(SgUpdate::ADDED);
         update.push(this);
@@ -124,7 +148,10 @@ void SgObject::addParent(SgObject* parent, bool doNotify)
 
 void SgObject::removeParent(SgObject* parent)
 {
-    parents.erase(parent);
+    auto p = std::find(parents.begin(), parents.end(), parent);
+    if(p != parents.end()){
+        parents.erase(p);
+    }
     if(parents.empty()){
         sigGraphConnection_(false);
     }
@@ -285,6 +312,7 @@ SgGroup::SgGroup()
     : SgNode(findPolymorphicId<SgGroup>())
 {
     isBboxCacheValid = false;
+    isBboxCacheRefittable = false;
 }
 
 
@@ -292,6 +320,7 @@ SgGroup::SgGroup(int polymorhicId)
     : SgNode(polymorhicId)
 {
     isBboxCacheValid = false;
+    isBboxCacheRefittable = false;
 }
 
 
@@ -306,6 +335,7 @@ SgGroup::SgGroup(const SgGroup& org)
     }
 
     isBboxCacheValid = true;
+    isBboxCacheRefittable = false;
     bboxCache = org.bboxCache;
 }
 
@@ -320,6 +350,7 @@ SgGroup::SgGroup(const SgGroup& org, SgCloneMap& cloneMap)
     }
 
     isBboxCacheValid = true;
+    isBboxCacheRefittable = false;
     bboxCache = org.bboxCache;
 }
 
@@ -350,6 +381,13 @@ SgObject* SgGroup::childObject(int index)
 }
 
 
+void SgGroup::countOwnMemoryUsage(MemoryUsageCounter& counter) const
+{
+    SgObject::countOwnMemoryUsage(counter);
+    counter.add(children.capacity() * sizeof(SgNodePtr));
+}
+
+
 void SgGroup::onUpdated(SgUpdate& update)
 {
     //if(update.action() & SgUpdate::BBOX_UPDATED){
@@ -369,6 +407,7 @@ const BoundingBox& SgGroup::boundingBox() const
         bboxCache.expandBy((*p)->boundingBox());
     }
     isBboxCacheValid = true;
+    isBboxCacheRefittable = false;
 
     return bboxCache;
 }
@@ -499,6 +538,17 @@ void SgGroup::moveChildrenTo(SgGroup* group, bool doNotify)
 }
 
 
+void SgGroup::notifyChildPositionsUpdate(SgUpdate& update)
+{
+    for(auto& node : children){
+        if(node->isGroup()){
+            static_cast<SgGroup*>(node.get())->invalidateBoundingBoxForTransformUpdate();
+        }
+    }
+    notifyUpdate(update);
+}
+
+
 void SgGroup::throwTypeMismatchError()
 {
     throw type_mismatch_error();
@@ -553,6 +603,19 @@ SgTransform::SgTransform(const SgTransform& org, SgCloneMap& cloneMap)
 }
 
 
+void SgTransform::updateUntransformedBboxCache() const
+{
+    if(!isBboxCacheRefittable){
+        untransformedBboxCache.clear();
+        for(const_iterator p = begin(); p != end(); ++p){
+            untransformedBboxCache.expandBy((*p)->boundingBox());
+        }
+    }
+    isBboxCacheValid = true;
+    isBboxCacheRefittable = false;
+}
+
+
 const BoundingBox& SgTransform::untransformedBoundingBox() const
 {
     if(!isBboxCacheValid){
@@ -612,13 +675,9 @@ const BoundingBox& SgPosTransform::boundingBox() const
     if(isBboxCacheValid){
         return bboxCache;
     }
-    bboxCache.clear();
-    for(const_iterator p = begin(); p != end(); ++p){
-        bboxCache.expandBy((*p)->boundingBox());
-    }
-    untransformedBboxCache = bboxCache;
+    updateUntransformedBboxCache();
+    bboxCache = untransformedBboxCache;
     bboxCache.transform(T_);
-    isBboxCacheValid = true;
     return bboxCache;
 }
 
@@ -717,13 +776,9 @@ const BoundingBox& SgAffineTransform::boundingBox() const
     if(isBboxCacheValid){
         return bboxCache;
     }
-    bboxCache.clear();
-    for(const_iterator p = begin(); p != end(); ++p){
-        bboxCache.expandBy((*p)->boundingBox());
-    }
-    untransformedBboxCache = bboxCache;
+    updateUntransformedBboxCache();
+    bboxCache = untransformedBboxCache;
     bboxCache.transform(T_);
-    isBboxCacheValid = true;
     return bboxCache;
 }
 
@@ -745,13 +800,9 @@ const BoundingBox& SgScaleTransform::boundingBox() const
     if(isBboxCacheValid){
         return bboxCache;
     }
-    bboxCache.clear();
-    for(const_iterator p = begin(); p != end(); ++p){
-        bboxCache.expandBy((*p)->boundingBox());
-    }
-    untransformedBboxCache = bboxCache;
+    updateUntransformedBboxCache();
+    bboxCache = untransformedBboxCache;
     bboxCache.transform(Affine3(scale_.asDiagonal()));
-    isBboxCacheValid = true;
     return bboxCache;
 }
 
@@ -798,6 +849,65 @@ void SgSwitch::setTurnedOn(bool on, bool doNotify)
 }
 
 
+SgLOD::SgLOD()
+    : SgGroup(findPolymorphicId<SgLOD>())
+{
+
+}
+
+
+SgLOD::SgLOD(const SgLOD& org)
+    : SgGroup(org),
+      levels_(org.levels_)
+{
+
+}
+
+
+SgLOD::SgLOD(const SgLOD& org, SgCloneMap& cloneMap)
+    : SgGroup(org, cloneMap)
+{
+    levels_.reserve(org.levels_.size());
+    for(auto& level : org.levels_){
+        levels_.push_back({ cloneMap.getClone<SgNode>(level.node.get()), level.switchingSize });
+    }
+}
+
+
+SgObject* SgLOD::clone(SgCloneMap& cloneMap) const
+{
+    return new SgLOD(*this, cloneMap);
+}
+
+
+int SgLOD::numChildObjects() const
+{
+    return numChildren() + levels_.size();
+}
+
+
+SgObject* SgLOD::childObject(int index)
+{
+    const int n = numChildren();
+    if(index < n){
+        return child(index);
+    }
+    return levels_[index - n].node;
+}
+
+
+void SgLOD::addLevel(SgNode* node, double switchingSize)
+{
+    levels_.push_back({ node, switchingSize });
+}
+
+
+void SgLOD::clearLevels()
+{
+    levels_.clear();
+}
+
+
 SgUnpickableGroup::SgUnpickableGroup()
     : SgGroup(findPolymorphicId<SgUnpickableGroup>())
 {
@@ -857,6 +967,7 @@ struct NodeTypeRegistration {
         SgNode::registerType<SgPosTransform, SgTransform>();
         SgNode::registerType<SgScaleTransform, SgTransform>();
         SgNode::registerType<SgSwitch, SgGroup>();
+        SgNode::registerType<SgLOD, SgGroup>();
         SgNode::registerType<SgUnpickableGroup, SgGroup>();
         SgNode::registerType<SgPreprocessed, SgNode>();
     }
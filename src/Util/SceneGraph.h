@@ -9,6 +9,7 @@
 #include <cnoid/Referenced>
 #include <cnoid/BoundingBox>
 #include <cnoid/Signal>
+#include <cnoid/SmallVector>
 #include <string>
 #include <vector>
 #include <set>
@@ -18,6 +19,7 @@ namespace cnoid {
 
 class SgObject;
 typedef ref_ptr<SgObject> SgObjectPtr;
+class MemoryUsageCounter;
 
 class CNOID_EXPORT SgUpdate
 {
@@ -78,7 +80,8 @@ private:
 class CNOID_EXPORT SgObject : public Referenced
 {
 public:
-    typedef std::set<SgObject*> ParentContainer;
+    // Most objects have one or two parents
+    typedef SmallVector<SgObject*, 2> ParentContainer;
     typedef ParentContainer::iterator parentIter;
     typedef ParentContainer::const_iterator const_parentIter;
         
@@ -90,6 +93,18 @@ public:
     virtual int numChildObjects() const;
     virtual SgObject* childObject(int index);
 
+    /**
+       Counts the bytes used by the object and its descendant objects. The objects reached
+       through several parents and the data shared with other objects are counted only once.
+    */
+    void countMemoryUsage(MemoryUsageCounter& counter);
+
+    /**
+       Adds the bytes owned by the object except its child objects to the counter.
+       The default implementation only counts the size of SgObject.
+    */
+    virtual void countOwnMemoryUsage(MemoryUsageCounter& counter) const;
+
     SignalProxy<void(const SgUpdate& update)> sigUpdated() {
         return sigUpdated_;
     }
@@ -208,11 +223,27 @@ public:
     virtual SgObject* clone(SgCloneMap& cloneMap) const override;
     virtual int numChildObjects() const override;
     virtual SgObject* childObject(int index) override;
+    virtual void countOwnMemoryUsage(MemoryUsageCounter& counter) const override;
     virtual void onUpdated(SgUpdate& update) override;
     virtual const BoundingBox& boundingBox() const override;
     virtual bool isGroup() const override;
     
-    void invalidateBoundingBox() { isBboxCacheValid = false; }
+    void invalidateBoundingBox() {
+        isBboxCacheValid = false;
+        isBboxCacheRefittable = false;
+    }
+
+    /**
+       Invalidates the bounding box when only the transform of this node is changed.
+       The bounding box of a transform node is then refitted by transforming the cached bounding box
+       of the children instead of merging the bounding boxes of the children again.
+    */
+    void invalidateBoundingBoxForTransformUpdate() {
+        if(isBboxCacheValid){
+            isBboxCacheValid = false;
+            isBboxCacheRefittable = true;
+        }
+    }
 
     iterator begin() { return children.begin(); }
     iterator end() { return children.end(); }
@@ -251,6 +282,14 @@ public:
     void copyChildrenTo(SgGroup* group, bool doNotify = false);
     void moveChildrenTo(SgGroup* group, bool doNotify = false);
 
+    /**
+       This is used when the positions of many child transforms are changed without their own
+       notifications, such as the per-frame update of the link positions. The bounding boxes of
+       the children are refitted to their new positions, and the update is propagated to the upper
+       nodes only once.
+    */
+    void notifyChildPositionsUpdate(SgUpdate& update);
+
     template<class NodeType> NodeType* findNodeOfType(int depth = -1) {
         for(int i=0; i < numChildren(); ++i){
             if(NodeType* node = dynamic_cast<NodeType*>(child(i))) return node;
@@ -272,6 +311,7 @@ protected:
     SgGroup(int polymorhicId);
     mutable BoundingBox bboxCache;
     mutable bool isBboxCacheValid;
+    mutable bool isBboxCacheRefittable;
 
 private:
     Container children;
@@ -305,6 +345,7 @@ protected:
     SgTransform(int polymorhicId);
     SgTransform(const SgTransform& org);
     SgTransform(const SgTransform& org, SgCloneMap& cloneMap);
+    void updateUntransformedBboxCache() const;
     mutable BoundingBox untransformedBboxCache;
 };
 typedef ref_ptr<SgTransform> SgTransformPtr;
@@ -476,6 +517,43 @@ public:
 typedef ref_ptr<SgSwitch> SgSwitchPtr;
 
 
+/**
+   The children of this node are the nodes of the full detail, and the simplified nodes are given
+   as the levels, which are not the children. A renderer which supports this node uses a level when
+   the projected size of the node is smaller than the switching size of the level, and the other
+   visitors such as the collision detectors just process the children of the full detail.
+   The levels must be added in the descending order of the switching sizes.
+*/
+class CNOID_EXPORT SgLOD : public SgGroup
+{
+public:
+    SgLOD();
+    SgLOD(const SgLOD& org);
+    SgLOD(const SgLOD& org, SgCloneMap& cloneMap);
+    virtual SgObject* clone(SgCloneMap& cloneMap) const override;
+    virtual int numChildObjects() const override;
+    virtual SgObject* childObject(int index) override;
+
+    int numLevels() const { return static_cast<int>(levels_.size()); }
+    SgNode* level(int index) { return levels_[index].node; }
+    const SgNode* level(int index) const { return levels_[index].node; }
+
+    //! The projected size [pixel] below which the level is used
+    double switchingSize(int index) const { return levels_[index].switchingSize; }
+
+    void addLevel(SgNode* node, double switchingSize);
+    void clearLevels();
+    
+private:
+    struct Level {
+        SgNodePtr node;
+        double switchingSize;
+    };
+    std::vector<Level> levels_;
+};
+typedef ref_ptr<SgLOD> SgLODPtr;
+
+
 class CNOID_EXPORT SgUnpickableGroup : public SgGroup
 {
 public:
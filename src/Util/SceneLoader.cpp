@@ -5,6 +5,7 @@
 #include "SceneLoader.h"
 #include "NullOut.h"
 #include "FileUtil.h"
+#include "PhaseProfiler.h"
 #include <fmt/format.h>
 #include <mutex>
 #include <map>
@@ -36,6 +37,7 @@ public:
     LoaderMap loaders;
     int defaultDivisionNumber;
     double defaultCreaseAngle;
+    bool isAppearanceLoadingEnabled;
 
     SceneLoaderImpl();
     AbstractSceneLoaderPtr findLoader(string ext);
@@ -91,6 +93,7 @@ SceneLoaderImpl::SceneLoaderImpl()
     os_ = &nullout();
     defaultDivisionNumber = -1;
     defaultCreaseAngle = -1.0;
+    isAppearanceLoadingEnabled = true;
 }
 
 
@@ -118,6 +121,12 @@ void SceneLoader::setDefaultCreaseAngle(double theta)
 }
 
 
+void SceneLoader::setAppearanceLoadingEnabled(bool on)
+{
+    impl->isAppearanceLoadingEnabled = on;
+}
+
+
 AbstractSceneLoaderPtr SceneLoaderImpl::findLoader(string ext)
 {
     AbstractSceneLoaderPtr loader;
@@ -157,6 +166,8 @@ SgNode* SceneLoader::load(const std::string& filename, bool& out_isSupportedForm
 
 SgNode* SceneLoaderImpl::load(const std::string& filename, bool* out_isSupportedFormat)
 {
+    PhaseProfiler::Scope scope("Scene loading", filename);
+
     boost::filesystem::path filepath(filename);
 
     string ext = getExtension(filepath);
@@ -184,6 +195,8 @@ SgNode* SceneLoaderImpl::load(const std::string& filename, bool* out_isSupported
         if(defaultCreaseAngle >= 0.0){
             loader->setDefaultCreaseAngle(defaultCreaseAngle);
         }
+        // The loaders are shared by the loads, so the setting is always given
+        loader->setAppearanceLoadingEnabled(isAppearanceLoadingEnabled);
         node = loader->load(filename);
     }
 
@@ -27,6 +27,7 @@ public:
     virtual void setMessageSink(std::ostream& os) override;
     virtual void setDefaultDivisionNumber(int n) override;
     virtual void setDefaultCreaseAngle(double theta) override;
+    virtual void setAppearanceLoadingEnabled(bool on) override;
     virtual SgNode* load(const std::string& filename) override;
 
     SgNode* load(const std::string& filename, bool& out_isSupportedFormat);
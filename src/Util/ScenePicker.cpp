@@ -0,0 +1,514 @@
+/*!
+  @file
+  @author Shin'ichiro Nakaoka
+*/
+
+#include "ScenePicker.h"
+#include "SceneDrawables.h"
+#include "SceneLights.h"
+#include "PolymorphicFunctionSet.h"
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+// The maximum number of the triangles in a leaf of the hierarchy
+const int MaxNumLeafTriangles = 4;
+
+bool intersectBox
+(const Vector3& origin, const Vector3& invDirection, const Vector3& min, const Vector3& max,
+ double tMax, double& out_tEntry)
+{
+    double t0 = 0.0;
+    double t1 = tMax;
+    for(int i=0; i < 3; ++i){
+        double ta = (min[i] - origin[i]) * invDirection[i];
+        double tb = (max[i] - origin[i]) * invDirection[i];
+        if(ta > tb){
+            std::swap(ta, tb);
+        }
+        // NaN given by a zero direction component on the slab boundary is ignored here
+        if(ta > t0){
+            t0 = ta;
+        }
+        if(tb < t1){
+            t1 = tb;
+        }
+        if(t0 > t1){
+            return false;
+        }
+    }
+    out_tEntry = t0;
+    return true;
+}
+
+/**
+   The bounding volume hierarchy of the triangles of a mesh.
+   The nodes are stored in the depth first order, so the left child of a node is the next node.
+*/
+class MeshBvh
+{
+public:
+    struct Node {
+        Vector3f min;
+        Vector3f max;
+        int first;
+        int count; // zero for an internal node
+        int right;
+    };
+    vector<Node> nodes;
+    vector<int> triangles;
+
+    // The followings are used to check if the mesh has been replaced
+    weak_ref_ptr<SgMesh> mesh;
+    const SgVertexArray* vertices;
+    size_t numVertices;
+    size_t numTriangleVertices;
+
+    vector<Vector3f> centroids;
+
+    bool isValidFor(SgMesh* mesh_) const {
+        return (mesh.lock() == mesh_ &&
+                mesh_->vertices() == vertices &&
+                vertices->size() == numVertices &&
+                mesh_->triangleVertices().size() == numTriangleVertices);
+    }
+
+    void build(SgMesh* mesh_);
+    int buildNode(SgMesh* mesh, int first, int count);
+    bool intersect(SgMesh* mesh, const Vector3f& origin, const Vector3f& direction, bool doCullBackFaces, double& io_t) const;
+};
+
+
+void MeshBvh::build(SgMesh* mesh_)
+{
+    mesh = mesh_;
+    vertices = mesh_->vertices();
+    numVertices = vertices->size();
+    numTriangleVertices = mesh_->triangleVertices().size();
+
+    const int numTriangles = mesh_->numTriangles();
+    const auto& v = *vertices;
+    triangles.resize(numTriangles);
+    centroids.resize(numTriangles);
+    for(int i=0; i < numTriangles; ++i){
+        triangles[i] = i;
+        auto t = mesh_->triangle(i);
+        centroids[i] = (v[t[0]] + v[t[1]] + v[t[2]]) / 3.0f;
+    }
+    nodes.clear();
+    nodes.reserve(2 * numTriangles / MaxNumLeafTriangles + 1);
+    if(numTriangles > 0){
+        buildNode(mesh_, 0, numTriangles);
+    }
+    centroids.clear();
+    centroids.shrink_to_fit();
+}
+
+
+int MeshBvh::buildNode(SgMesh* mesh, int first, int count)
+{
+    const auto& v = *vertices;
+    const int index = nodes.size();
+    nodes.emplace_back();
+
+    Vector3f min = Vector3f::Constant(std::numeric_limits<float>::max());
+    Vector3f max = Vector3f::Constant(-std::numeric_limits<float>::max());
+    Vector3f cmin = min;
+    Vector3f cmax = max;
+    for(int i = first; i < first + count; ++i){
+        auto t = mesh->triangle(triangles[i]);
+        for(int j=0; j < 3; ++j){
+            min = min.cwiseMin(v[t[j]]);
+            max = max.cwiseMax(v[t[j]]);
+        }
+        cmin = cmin.cwiseMin(centroids[triangles[i]]);
+        cmax = cmax.cwiseMax(centroids[triangles[i]]);
+    }
+
+    if(count <= MaxNumLeafTriangles){
+        Node& node = nodes[index];
+        node.min = min;
+        node.max = max;
+        node.first = first;
+        node.count = count;
+        node.right = -1;
+        return index;
+    }
+
+    int axis;
+    (cmax - cmin).maxCoeff(&axis);
+    const int half = count / 2;
+    std::nth_element(
+        triangles.begin() + first, triangles.begin() + first + half, triangles.begin() + first + count,
+        [&](int a, int b){ return centroids[a][axis] < centroids[b][axis]; });
+
+    buildNode(mesh, first, half);
+    const int right = buildNode(mesh, first + half, count - half);
+
+    Node& node = nodes[index];
+    node.min = min;
+    node.max = max;
+    node.first = first;
+    node.count = 0;
+    node.right = right;
+    return index;
+}
+
+
+bool MeshBvh::intersect
+(SgMesh* mesh, const Vector3f& origin, const Vector3f& direction, bool doCullBackFaces, double& io_t) const
+{
+    if(nodes.empty()){
+        return false;
+    }
+
+    const auto& v = *vertices;
+    const Vector3 o = origin.cast<double>();
+    const Vector3 invd = direction.cast<double>().cwiseInverse();
+    bool hit = false;
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+
+    while(top > 0){
+        const Node& node = nodes[stack[--top]];
+        double tEntry;
+        if(!intersectBox(o, invd, node.min.cast<double>(), node.max.cast<double>(), io_t, tEntry)){
+            continue;
+        }
+        if(node.count == 0){
+            if(top + 2 > 64){
+                continue; // never happens with the balanced hierarchy
+            }
+            stack[top++] = node.right;
+            stack[top++] = &node - &nodes[0] + 1;
+            continue;
+        }
+        for(int i = node.first; i < node.first + node.count; ++i){
+            auto tri = mesh->triangle(triangles[i]);
+            const Vector3f& v0 = v[tri[0]];
+            const Vector3f e1 = v[tri[1]] - v0;
+            const Vector3f e2 = v[tri[2]] - v0;
+            const Vector3f p = direction.cross(e2);
+            const float det = e1.dot(p);
+            // The determinant is positive for a front face
+            if(doCullBackFaces ? (det <= 0.0f) : (det == 0.0f)){
+                continue;
+            }
+            const float invDet = 1.0f / det;
+            const Vector3f s = origin - v0;
+            const float a = s.dot(p) * invDet;
+            if(a < 0.0f || a > 1.0f){
+                continue;
+            }
+            const Vector3f q = s.cross(e1);
+            const float b = direction.dot(q) * invDet;
+            if(b < 0.0f || a + b > 1.0f){
+                continue;
+            }
+            const double t = e2.dot(q) * invDet;
+            if(t >= 0.0 && t < io_t){
+                io_t = t;
+                hit = true;
+            }
+        }
+    }
+
+    return hit;
+}
+
+}
+
+namespace cnoid {
+
+class ScenePickerImpl
+{
+public:
+    PolymorphicFunctionSet<SgNode> functions;
+    int cullingMode;
+
+    // The ray in the coordinate of the node being visited. The parameter t is common to all the frames.
+    Vector3 origin;
+    Vector3 direction;
+    Vector3 invDirection;
+    double tPicked;
+    double tUndetermined;
+
+    SgNodePath currentNodePath;
+    SgNodePath pickedNodePath;
+    Vector3 pickedPoint;
+
+    unordered_map<SgMesh*, unique_ptr<MeshBvh>> bvhs;
+    size_t numBvhsToPrune;
+
+    ScenePickerImpl();
+    void setRay(const Vector3& origin, const Vector3& direction);
+    bool hitBoundingBox(const BoundingBox& bbox, double& out_tEntry);
+    void visitGroup(SgGroup* group);
+    void visitSwitch(SgSwitch* switchNode);
+    void visitTransform(SgTransform* transform);
+    void visitShape(SgShape* shape);
+    void visitPlot(SgPlot* plot);
+    void visitUnknownNode(SgNode* node);
+    void pruneBvhs();
+};
+
+}
+
+
+ScenePicker::ScenePicker()
+{
+    impl = new ScenePickerImpl;
+}
+
+
+ScenePickerImpl::ScenePickerImpl()
+{
+    cullingMode = ScenePicker::ENABLE_BACK_FACE_CULLING;
+    numBvhsToPrune = 64;
+
+    functions.setFunction<SgNode>(
+        [&](SgNode* node){ visitUnknownNode(node); });
+    functions.setFunction<SgGroup>(
+        [&](SgGroup* node){ visitGroup(node); });
+    functions.setFunction<SgSwitch>(
+        [&](SgSwitch* node){ visitSwitch(node); });
+    functions.setFunction<SgTransform>(
+        [&](SgTransform* node){ visitTransform(node); });
+    functions.setFunction<SgShape>(
+        [&](SgShape* node){ visitShape(node); });
+    functions.setFunction<SgPlot>(
+        [&](SgPlot* node){ visitPlot(node); });
+
+    // The following nodes are not picked by the rendering either
+    functions.setFunction<SgUnpickableGroup>([](SgUnpickableGroup*){ });
+    functions.setFunction<SgOverlay>([](SgOverlay*){ });
+    functions.setFunction<SgPreprocessed>([](SgPreprocessed*){ });
+
+    functions.updateDispatchTable();
+}
+
+
+ScenePicker::~ScenePicker()
+{
+    delete impl;
+}
+
+
+void ScenePicker::setBackFaceCullingMode(int mode)
+{
+    impl->cullingMode = mode;
+}
+
+
+ScenePicker::Result ScenePicker::pick(SgNode* root, const Vector3& nearPoint, const Vector3& farPoint)
+{
+    impl->setRay(nearPoint, farPoint - nearPoint);
+    impl->tPicked = 1.0;
+    impl->tUndetermined = std::numeric_limits<double>::max();
+    impl->currentNodePath.clear();
+    impl->pickedNodePath.clear();
+
+    impl->functions.dispatch(root);
+
+    if(impl->bvhs.size() > impl->numBvhsToPrune){
+        impl->pruneBvhs();
+    }
+
+    if(impl->tUndetermined <= impl->tPicked){
+        impl->pickedNodePath.clear();
+        return UNDETERMINED;
+    }
+    if(impl->pickedNodePath.empty()){
+        return NOT_PICKED;
+    }
+    impl->pickedPoint = nearPoint + impl->tPicked * (farPoint - nearPoint);
+    return PICKED;
+}
+
+
+void ScenePickerImpl::setRay(const Vector3& origin_, const Vector3& direction_)
+{
+    origin = origin_;
+    direction = direction_;
+    invDirection = direction.cwiseInverse();
+}
+
+
+bool ScenePickerImpl::hitBoundingBox(const BoundingBox& bbox, double& out_tEntry)
+{
+    if(bbox.empty()){
+        return false;
+    }
+    return intersectBox(origin, invDirection, bbox.min(), bbox.max(), tPicked, out_tEntry);
+}
+
+
+void ScenePickerImpl::visitGroup(SgGroup* group)
+{
+    double tEntry;
+    if(!hitBoundingBox(group->boundingBox(), tEntry)){
+        return;
+    }
+    currentNodePath.push_back(group);
+    for(auto& child : *group){
+        functions.dispatch(child);
+    }
+    currentNodePath.pop_back();
+}
+
+
+void ScenePickerImpl::visitSwitch(SgSwitch* switchNode)
+{
+    if(switchNode->isTurnedOn()){
+        visitGroup(switchNode);
+    }
+}
+
+
+void ScenePickerImpl::visitTransform(SgTransform* transform)
+{
+    double tEntry;
+    if(!hitBoundingBox(transform->boundingBox(), tEntry)){
+        return;
+    }
+    const Vector3 origin0 = origin;
+    const Vector3 direction0 = direction;
+    Affine3 T;
+    transform->getTransform(T);
+    const Affine3 Tinv = T.inverse();
+    setRay(Tinv * origin0, Tinv.linear() * direction0);
+
+    currentNodePath.push_back(transform);
+    for(auto& child : *transform){
+        functions.dispatch(child);
+    }
+    currentNodePath.pop_back();
+
+    setRay(origin0, direction0);
+}
+
+
+void ScenePickerImpl::visitShape(SgShape* shape)
+{
+    SgMesh* mesh = shape->mesh();
+    if(!mesh || !mesh->hasVertices()){
+        return;
+    }
+    double tEntry;
+    if(!hitBoundingBox(mesh->boundingBox(), tEntry)){
+        return;
+    }
+
+    auto& bvh = bvhs[mesh];
+    if(!bvh || !bvh->isValidFor(mesh)){
+        bvh.reset(new MeshBvh);
+        bvh->build(mesh);
+    }
+
+    bool doCullBackFaces;
+    switch(cullingMode){
+    case ScenePicker::ENABLE_BACK_FACE_CULLING:
+        doCullBackFaces = mesh->isSolid();
+        break;
+    case ScenePicker::FORCE_BACK_FACE_CULLING:
+        doCullBackFaces = true;
+        break;
+    default:
+        doCullBackFaces = false;
+        break;
+    }
+
+    if(bvh->intersect(mesh, origin.cast<float>(), direction.cast<float>(), doCullBackFaces, tPicked)){
+        pickedNodePath = currentNodePath;
+        pickedNodePath.push_back(shape);
+    }
+}
+
+
+/**
+   The points and lines are rendered with the sizes in pixels, which cannot be tested with the ray.
+   The result is undetermined when the bounding box is hit in front of the picked shape.
+*/
+void ScenePickerImpl::visitPlot(SgPlot* plot)
+{
+    const BoundingBox& bbox = plot->boundingBox();
+    if(bbox.empty()){
+        if(plot->hasVertices()){
+            tUndetermined = 0.0; // the bounding box has not been updated
+        }
+    } else {
+        double tEntry;
+        if(hitBoundingBox(bbox, tEntry)){
+            tUndetermined = std::min(tUndetermined, tEntry);
+        }
+    }
+}
+
+
+//! The nodes of unknown types may be rendered anywhere unless they have their bounding boxes
+void ScenePickerImpl::visitUnknownNode(SgNode* node)
+{
+    const BoundingBox& bbox = node->boundingBox();
+    if(bbox.empty()){
+        tUndetermined = 0.0;
+    } else {
+        double tEntry;
+        if(hitBoundingBox(bbox, tEntry)){
+            tUndetermined = std::min(tUndetermined, tEntry);
+        }
+    }
+}
+
+
+void ScenePickerImpl::pruneBvhs()
+{
+    auto p = bvhs.begin();
+    while(p != bvhs.end()){
+        if(p->second->mesh.expired()){
+            p = bvhs.erase(p);
+        } else {
+            ++p;
+        }
+    }
+    numBvhsToPrune = std::max(size_t(64), bvhs.size() * 2);
+}
+
+
+const Vector3& ScenePicker::pickedPoint() const
+{
+    return impl->pickedPoint;
+}
+
+
+const SgNodePath& ScenePicker::pickedNodePath() const
+{
+    return impl->pickedNodePath;
+}
+
+
+void ScenePicker::onSceneGraphUpdated(const SgUpdate& update)
+{
+    // A mesh is the first or the second object of the path when the mesh or its vertices are updated
+    auto& path = update.path();
+    const int n = std::min(path.size(), size_t(2));
+    for(int i=0; i < n; ++i){
+        if(auto mesh = dynamic_cast<SgMesh*>(path[i])){
+            impl->bvhs.erase(mesh);
+        }
+    }
+}
+
+
+void ScenePicker::clearCache()
+{
+    impl->bvhs.clear();
+    impl->numBvhsToPrune = 64;
+}
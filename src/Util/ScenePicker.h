@@ -0,0 +1,59 @@
+/*!
+  @file
+  @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_UTIL_SCENE_PICKER_H
+#define CNOID_UTIL_SCENE_PICKER_H
+
+#include "SceneGraph.h"
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class ScenePickerImpl;
+
+/**
+   This class picks the shape hit by a ray without rendering the scene.
+   The ray is tested with the cached bounding boxes of the nodes and the bounding volume hierarchy
+   of the triangles of each mesh, which is built when the mesh is hit by a ray for the first time.
+   The point sets, the line sets and the nodes of unknown types are not picked by this class.
+   When such a node may be in front of the picked shape, the result is UNDETERMINED and
+   the picking by rendering should be used instead.
+*/
+class CNOID_EXPORT ScenePicker
+{
+public:
+    ScenePicker();
+    ~ScenePicker();
+
+    enum Result { NOT_PICKED, PICKED, UNDETERMINED };
+
+    //! The values correspond to GLSceneRenderer::CullingMode
+    enum CullingMode {
+        ENABLE_BACK_FACE_CULLING,
+        DISABLE_BACK_FACE_CULLING,
+        FORCE_BACK_FACE_CULLING
+    };
+    void setBackFaceCullingMode(int mode);
+
+    /**
+       The ray is the segment from nearPoint to farPoint, which are usually the points
+       on the near and far clip planes of the view.
+    */
+    Result pick(SgNode* root, const Vector3& nearPoint, const Vector3& farPoint);
+
+    const Vector3& pickedPoint() const;
+    const SgNodePath& pickedNodePath() const;
+
+    //! The cached hierarchies of the meshes in the path of the update are discarded
+    void onSceneGraphUpdated(const SgUpdate& update);
+    void clearCache();
+
+private:
+    ScenePickerImpl* impl;
+};
+
+}
+
+#endif
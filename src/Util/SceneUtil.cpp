@@ -71,6 +71,8 @@ public:
     {
         setFunction<SgGroup>(
             [&](SgNode* node){ visitGroup(static_cast<SgGroup*>(node)); });
+        setFunction<SgLOD>(
+            [&](SgNode* node){ visitLOD(static_cast<SgLOD*>(node)); });
         setFunction<SgShape>(
             [&](SgNode* node){ visitShape(static_cast<SgShape*>(node)); });
         setFunction<SgPlot>(
@@ -96,6 +98,14 @@ public:
         }
     }
     
+    void visitLOD(SgLOD* lod)
+    {
+        visitGroup(lod);
+        for(int i=0; i < lod->numLevels(); ++i){
+            dispatch(lod->level(i));
+        }
+    }
+    
     void visitShape(SgShape* shape)
     {
         if(shape->material()){
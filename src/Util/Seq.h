@@ -99,6 +99,10 @@ public:
         return container.empty();
     }
 
+    virtual void countMemoryUsage(MemoryUsageCounter& counter) const override {
+        counter.add(sizeof(*this) + container.capacity() * sizeof(ElementType));
+    }
+
     double timeLength() const {
         return (frameRate_ > 0.0) ? (numFrames() / frameRate_) : 0.0;
     }
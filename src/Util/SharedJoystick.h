@@ -23,6 +23,10 @@ public:
         mode_ = 0;
         numModes_ = 0;
         prevButtonState = false;
+#ifdef __linux__
+        // The controllers take the latest state of the device without waiting for the events
+        defaultJoystick.setInputThreadEnabled(true);
+#endif
     }
 
     void setJoystick(JoystickInterface* joystick){
@@ -81,6 +85,13 @@ public:
         return isMode(targetMode) ? joystick->getButtonState(button) : false;
     }
 
+#ifdef __linux__
+    //! The latency of the input state of the default joystick. See Joystick::stateLatency.
+    double stateLatency() const {
+        return (joystick == &defaultJoystick) ? defaultJoystick.stateLatency() : 0.0;
+    }
+#endif
+
 private:
     JoystickInterface* joystick;
     Joystick defaultJoystick;
@@ -0,0 +1,114 @@
+/**
+   @file
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_UTIL_SHARED_OBJECT_POOL_H
+#define CNOID_UTIL_SHARED_OBJECT_POOL_H
+
+#include <memory>
+#include <vector>
+#include <mutex>
+
+namespace cnoid {
+
+/**
+   A pool of the objects which are handed out as shared pointers.
+   An object returns to the pool when the last shared pointer to it is released, and
+   it is handed out again by get() with the contents and the allocated memory of the
+   previous use. This avoids the allocations of large buffers such as images when the
+   objects are repeatedly created and passed to other modules with the shared pointers,
+   and the objects can be kept by the other modules as long as they are needed.
+
+   The objects may be released in any thread, but get() must not be called from
+   multiple threads at the same time. The pool may be destroyed before the objects
+   handed out from it, which are then deleted when they are released.
+*/
+template<class T>
+class SharedObjectPool
+{
+public:
+    //! \param maxNumFreeObjects The released objects exceeding this number are deleted
+    SharedObjectPool(int maxNumFreeObjects = 4)
+        : storage(std::make_shared<Storage>(maxNumFreeObjects)) { }
+
+    SharedObjectPool(const SharedObjectPool&) = delete;
+    SharedObjectPool& operator=(const SharedObjectPool&) = delete;
+
+    /**
+       The returned object is not shared with any other pointer, so it can be passed to
+       the functions which take over an unshared object such as Camera::setImage.
+       The object is created by the default constructor if there is no free object.
+    */
+    std::shared_ptr<T> get() {
+        T* object = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(storage->mutex);
+            if(!storage->freeObjects.empty()){
+                object = storage->freeObjects.back();
+                storage->freeObjects.pop_back();
+            }
+        }
+        if(!object){
+            object = new T;
+        }
+        return std::shared_ptr<T>(object, Recycler(storage));
+    }
+
+    int numFreeObjects() const {
+        std::lock_guard<std::mutex> lock(storage->mutex);
+        return storage->freeObjects.size();
+    }
+
+    //! The free objects are deleted
+    void clear() {
+        std::lock_guard<std::mutex> lock(storage->mutex);
+        storage->deleteFreeObjects();
+    }
+
+private:
+    struct Storage
+    {
+        std::mutex mutex;
+        std::vector<T*> freeObjects;
+        size_t maxNumFreeObjects;
+
+        Storage(int maxNumFreeObjects) : maxNumFreeObjects(maxNumFreeObjects) {
+            freeObjects.reserve(maxNumFreeObjects);
+        }
+        ~Storage() { deleteFreeObjects(); }
+
+        void deleteFreeObjects() {
+            for(auto object : freeObjects){
+                delete object;
+            }
+            freeObjects.clear();
+        }
+    };
+
+    class Recycler
+    {
+    public:
+        Recycler(const std::shared_ptr<Storage>& storage) : storage(storage) { }
+
+        void operator()(T* object) const {
+            if(auto s = storage.lock()){
+                std::lock_guard<std::mutex> lock(s->mutex);
+                if(s->freeObjects.size() < s->maxNumFreeObjects){
+                    s->freeObjects.push_back(object);
+                    return;
+                }
+            }
+            delete object;
+        }
+
+    private:
+        std::weak_ptr<Storage> storage;
+    };
+
+    std::shared_ptr<Storage> storage;
+};
+
+}
+
+#endif
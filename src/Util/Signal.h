@@ -8,6 +8,7 @@
 #include "Referenced.h"
 #include <functional>
 #include <tuple>
+#include <vector>
 
 namespace cnoid {
 
@@ -94,59 +95,193 @@ public:
 };
 
 
-template<typename SlotHolderType, typename... Args>
+/**
+   The slots of a signal are stored in this contiguous array so that they are called without
+   following the links between the slot holders. The slots removed during an emission are kept
+   in the array until the emission finishes so that the iteration is not disturbed and the slot
+   functions being called are not destroyed. The array is also shared with the emission in
+   progress so that the iteration can be continued even if the signal itself is destroyed by
+   a slot function.
+*/
+template<typename TSlotHolder>
+class SlotArray : public Referenced
+{
+public:
+    typedef TSlotHolder SlotHolderType;
+    typedef ref_ptr<SlotHolderType> SlotHolderPtr;
+
+    std::vector<SlotHolderPtr> slots;
+    int numRemovedSlots;
+    int emissionDepth;
+    std::vector<std::pair<SlotHolderPtr, int>> deferredOrderChanges;
+
+    SlotArray() : numRemovedSlots(0), emissionDepth(0) { }
+
+    bool empty() const {
+        return (static_cast<int>(slots.size()) == numRemovedSlots);
+    }
+
+    void append(SlotHolderType* slot){
+        slot->index = slots.size();
+        slots.push_back(slot);
+    }
+
+    //! The owner and the blocking flag of the slot must be reset before calling this function
+    void remove(SlotHolderType* slot){
+        ++numRemovedSlots;
+        if(emissionDepth == 0){
+            slots[slot->index] = nullptr;
+            if(numRemovedSlots * 2 > static_cast<int>(slots.size())){
+                compact();
+            }
+        }
+    }
+
+    void clear(){
+        for(auto& slot : slots){
+            if(slot){
+                slot->owner = 0;
+                slot->isBlocked = true;
+            }
+        }
+        if(emissionDepth == 0){
+            slots.clear();
+            numRemovedSlots = 0;
+        } else {
+            numRemovedSlots = slots.size();
+        }
+        deferredOrderChanges.clear();
+    }
+
+    void compact(){
+        size_t n = 0;
+        for(size_t i=0; i < slots.size(); ++i){
+            if(slots[i] && slots[i]->owner){
+                if(n != i){
+                    slots[n] = std::move(slots[i]);
+                }
+                slots[n]->index = n;
+                ++n;
+            }
+        }
+        slots.resize(n);
+        numRemovedSlots = 0;
+    }
+
+    void changeOrder(SlotHolderType* slot, int orderId){
+        if(emissionDepth > 0){
+            // Moving the slot would break the iteration in progress
+            deferredOrderChanges.emplace_back(slot, orderId);
+            return;
+        }
+        SlotHolderPtr holder = slot;
+        slots[slot->index] = nullptr;
+        ++numRemovedSlots;
+        compact();
+        if(orderId == 0){ // Connection::FIRST
+            slots.insert(slots.begin(), holder);
+            for(size_t i=0; i < slots.size(); ++i){
+                slots[i]->index = i;
+            }
+        } else {
+            append(slot);
+        }
+    }
+
+    void endEmission(){
+        if(--emissionDepth == 0){
+            if(!deferredOrderChanges.empty()){
+                std::vector<std::pair<SlotHolderPtr, int>> changes;
+                changes.swap(deferredOrderChanges);
+                for(auto& change : changes){
+                    if(change.first->owner){
+                        changeOrder(change.first, change.second);
+                    }
+                }
+            }
+            if(numRemovedSlots > 0){
+                compact();
+            }
+        }
+    }
+
+    class EmissionScope
+    {
+        ref_ptr<SlotArray> array;
+    public:
+        EmissionScope(SlotArray* array) : array(array) { ++array->emissionDepth; }
+        ~EmissionScope() { array->endEmission(); }
+    };
+};
+
+
+template<typename SlotArrayType, typename... Args>
 class SlotCallIterator
 {
+    typedef typename SlotArrayType::SlotHolderType SlotHolderType;
     typedef typename SlotHolderType::result_type result_type;
 
-    SlotHolderType* currentSlotHolder;
-    std::tuple<Args...>& args;
+    SlotArrayType* slotArray;
+    mutable size_t index;
+    std::tuple<Args&...>& args;
 
 public:
-    void seekActiveSlot(){
-        while(currentSlotHolder && currentSlotHolder->isBlocked){
-            currentSlotHolder = currentSlotHolder->next;
+    /**
+       The active slot is sought when the end is checked because the slots after the current
+       one may be removed or blocked by the slot function called last.
+    */
+    void seekActiveSlot() const {
+        if(slotArray){
+            auto& slots = slotArray->slots;
+            while(index < slots.size() && (!slots[index] || slots[index]->isBlocked)){
+                ++index;
+            }
         }
     }
     
-    SlotCallIterator(SlotHolderType* firstSlot, std::tuple<Args...>& args)
-        : currentSlotHolder(firstSlot), args(args) {
-        seekActiveSlot();
+    SlotCallIterator(SlotArrayType* slotArray, std::tuple<Args&...>& args)
+        : slotArray(slotArray), index(0), args(args) {
     }
 
     SlotCallIterator(const SlotCallIterator& org)
-        : currentSlotHolder(org.currentSlotHolder), args(org.args) {
+        : slotArray(org.slotArray), index(org.index), args(org.args) {
+    }
+
+    bool isEnd() const {
         seekActiveSlot();
+        return !slotArray || index >= slotArray->slots.size();
     }
 
     bool operator==(const SlotCallIterator& rhs) const {
-        return (currentSlotHolder == rhs.currentSlotHolder);
+        if(isEnd()){
+            return rhs.isEnd();
+        }
+        return !rhs.isEnd() && index == rhs.index;
     }
 
     bool operator!=(const SlotCallIterator& rhs) const {
-        return (currentSlotHolder != rhs.currentSlotHolder);
+        return !operator==(rhs);
     }
 
     SlotCallIterator operator++(int) {
         SlotCallIterator iter(*this);
-        currentSlotHolder = currentSlotHolder->next;
-        seekActiveSlot();
+        ++index;
         return iter;
     }
     
     result_type operator*() const {
         /**
-           The reference to currentSlotHolder should be kept when the slot
-           function is called to guarantee the existence of the slot function.
-           For example, if the corresponding cnoid::Connection object is holded
-           in a Lua script, the connection may be deleted by the garbage collection
-           in the Lua interperter when a slot function defined in the Lua script
-           is called. In this case, the function does not exist when it is actually
-           called unless the reference to currentSlotHolder is kept here.
+           The slot holder must exist while the slot function is called. For example,
+           if the corresponding cnoid::Connection object is holded in a Lua script,
+           the connection may be deleted by the garbage collection in the Lua interperter
+           when a slot function defined in the Lua script is called. The slot array keeps
+           the holder until the emission finishes in that case, so the raw pointer can be
+           used here without the reference counting. Note that the array itself may be
+           reallocated by the slot function.
         */
-        ref_ptr<SlotHolderBase> holder = currentSlotHolder;
+        SlotHolderType* holder = slotArray->slots[index].get();
         
-        return apply(currentSlotHolder->func, args);
+        return apply(holder->func, args);
     }
 };
 
@@ -170,9 +305,8 @@ public:
     typedef std::function<Signature> FuncType;
     FuncType func;
     
-    typedef ref_ptr<SlotHolder> SlotHolderPtr;
-    SlotHolderPtr next;
-    SlotHolder* prev;
+    //! The position in the slot array of the owner signal
+    size_t index;
 
     typedef Signal<Signature, Combiner> SignalType;
     SignalType* owner;
@@ -180,7 +314,7 @@ public:
     typedef typename signal_private::function_traits<Signature>::result_type result_type;
     
     SlotHolder(const FuncType& func)
-        : func(func), prev(0), owner(0) {
+        : func(func), index(0), owner(0) {
     }
 
     virtual void disconnect() {
@@ -283,15 +417,15 @@ public:
 private:
     typedef signal_private::SlotHolder<R(Args...), Combiner> SlotHolderType;
     typedef ref_ptr<SlotHolderType> SlotHolderPtr;
+    typedef signal_private::SlotArray<SlotHolderType> SlotArrayType;
 
-    SlotHolderPtr firstSlot;
-    SlotHolderType* lastSlot;
+    ref_ptr<SlotArrayType> slotArray;
 
     Signal(const Signal& org);
     Signal& operator=(const Signal& rhs);
 
 public:
-    Signal() : lastSlot(0) { }
+    Signal() { }
 
     ~Signal() {
         disconnect_all_slots();
@@ -301,14 +435,10 @@ public:
 
         SlotHolderType* slot = new SlotHolderType(func);
 
-        if(!firstSlot){
-            firstSlot = slot;
-            lastSlot = slot;
-        } else {
-            lastSlot->next = slot;
-            slot->prev = lastSlot;
-            lastSlot = slot;
+        if(!slotArray){
+            slotArray = new SlotArrayType;
         }
+        slotArray->append(slot);
         slot->owner = this;
 
         return Connection(slot);
@@ -316,73 +446,37 @@ public:
 
     void remove(SlotHolderPtr slot){
         if(slot->owner == this){
-            SlotHolderType* next = slot->next;
-            SlotHolderType* prev = slot->prev;
-            if(next){
-                next->prev = prev;
-            } else {
-                lastSlot = prev;
-            }
-            if(prev){
-                prev->next = next;
-            } else {
-                firstSlot = next;
-            }
-            slot->prev = 0;
             slot->owner = 0;
             slot->isBlocked = true;
-
-            /**
-               keep slot->next so that the slot call iteration
-               can be continued even if the slot is disconnected
-               during the iteration.
-            */
+            slotArray->remove(slot);
         }
     }
 
     void changeOrder(SlotHolderPtr slot, int orderId){
         if(slot->owner == this){
-            if(orderId == Connection::FIRST){
-                if(firstSlot != slot){
-                    remove(slot);
-                    slot->owner = this;
-                    if(firstSlot){
-                        slot->next = firstSlot;
-                        slot->next->prev = slot;
-                    }
-                    firstSlot = slot;
-                }
-            } else if(orderId == Connection::LAST){
-                if(lastSlot != slot){
-                    remove(slot);
-                    slot->owner = this;
-                    if(lastSlot){
-                        lastSlot->next = slot;
-                        slot->prev = lastSlot;
-                    } else {
-                        firstSlot = slot;
-                    }
-                    lastSlot = slot;
-                }
-            }
+            slotArray->changeOrder(slot, orderId);
         }
     }
                         
     void disconnect_all_slots() {
-        while(firstSlot){
-            remove(firstSlot);
+        if(slotArray){
+            slotArray->clear();
         }
     }
 
     bool empty() const {
-        return (firstSlot == 0);
+        return !slotArray || slotArray->empty();
     }
     
     result_type operator()(Args... args){
-        typedef signal_private::SlotCallIterator<SlotHolderType, Args...> IteratorType;
+        typedef signal_private::SlotCallIterator<SlotArrayType, Args...> IteratorType;
         Combiner combiner;
-        std::tuple<Args...> argset(args...);
-        return combiner(IteratorType(firstSlot, argset), IteratorType(0, argset));
+        std::tuple<Args&...> argset(args...);
+        if(!slotArray){
+            return combiner(IteratorType(nullptr, argset), IteratorType(nullptr, argset));
+        }
+        typename SlotArrayType::EmissionScope scope(slotArray);
+        return combiner(IteratorType(slotArray, argset), IteratorType(nullptr, argset));
     }
 };
 
@@ -0,0 +1,109 @@
+/**
+   @file
+   @author Shin'ichiro Nakaoka
+*/
+
+#ifndef CNOID_UTIL_SMALL_VECTOR_H
+#define CNOID_UTIL_SMALL_VECTOR_H
+
+#include <type_traits>
+#include <algorithm>
+#include <cstring>
+
+namespace cnoid {
+
+/**
+   A vector which stores up to N elements in the object itself without allocating the memory.
+   The element type must be trivially copyable such as a pointer.
+*/
+template <class T, int N>
+class SmallVector
+{
+    static_assert(std::is_trivially_copyable<T>::value, "The element type must be trivially copyable");
+
+public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    SmallVector() : elements(inlineElements), size_(0), capacity_(N) { }
+
+    SmallVector(const SmallVector& org) : elements(inlineElements), size_(0), capacity_(N) {
+        assign(org);
+    }
+
+    SmallVector& operator=(const SmallVector& rhs) {
+        if(this != &rhs){
+            size_ = 0;
+            assign(rhs);
+        }
+        return *this;
+    }
+
+    ~SmallVector() {
+        if(elements != inlineElements){
+            delete[] elements;
+        }
+    }
+
+    bool empty() const { return size_ == 0; }
+    int size() const { return size_; }
+    void clear() { size_ = 0; }
+
+    iterator begin() { return elements; }
+    iterator end() { return elements + size_; }
+    const_iterator begin() const { return elements; }
+    const_iterator end() const { return elements + size_; }
+
+    T& operator[](int index) { return elements[index]; }
+    const T& operator[](int index) const { return elements[index]; }
+    T& back() { return elements[size_ - 1]; }
+    const T& back() const { return elements[size_ - 1]; }
+
+    void reserve(int n) {
+        if(n > capacity_){
+            T* newElements = new T[n];
+            std::memcpy(newElements, elements, size_ * sizeof(T));
+            if(elements != inlineElements){
+                delete[] elements;
+            }
+            elements = newElements;
+            capacity_ = n;
+        }
+    }
+
+    void push_back(const T& x) {
+        if(size_ == capacity_){
+            const T copy = x; // x may be an element of this vector
+            reserve(capacity_ * 2);
+            elements[size_++] = copy;
+        } else {
+            elements[size_++] = x;
+        }
+    }
+
+    void pop_back() { --size_; }
+
+    iterator erase(const_iterator position) {
+        iterator p = elements + (position - elements);
+        std::memmove(p, p + 1, (end() - p - 1) * sizeof(T));
+        --size_;
+        return p;
+    }
+
+private:
+    void assign(const SmallVector& org) {
+        reserve(org.size_);
+        std::memcpy(elements, org.elements, org.size_ * sizeof(T));
+        size_ = org.size_;
+    }
+
+    T* elements;
+    int size_;
+    int capacity_;
+    T inlineElements[N];
+};
+
+}
+
+#endif
@@ -0,0 +1,293 @@
+/**
+   @file
+   @author Shin'ichiro Nakaoka
+*/
+
+#include "ThreadPool.h"
+#include <deque>
+#include <thread>
+#include <chrono>
+
+using namespace std;
+using namespace cnoid;
+
+namespace cnoid {
+
+class ThreadPoolImpl
+{
+public:
+    typedef ThreadPool::TaskGroup TaskGroup;
+
+    struct Task {
+        std::function<void()> function;
+        TaskGroup* group;
+    };
+
+    struct Worker {
+        deque<Task> tasks;
+        std::mutex mutex;
+        std::thread thread;
+    };
+
+    ThreadPool* self;
+    vector<unique_ptr<Worker>> workers;
+
+    // Tasks started from the threads which are not the workers of this pool
+    deque<Task> injectedTasks;
+    std::mutex injectionMutex;
+
+    std::atomic<int> numQueuedTasks;
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    bool isDestroying;
+
+    ThreadPoolImpl(ThreadPool* self, int size);
+    ~ThreadPoolImpl();
+    int currentWorkerIndex() const;
+    void push(Task&& task);
+    bool popTask(Task& out_task, int workerIndex);
+    void execute(Task& task);
+    void run(int workerIndex);
+    void wait(TaskGroup* group);
+};
+
+}
+
+namespace {
+
+thread_local ThreadPoolImpl* currentPool = nullptr;
+thread_local int currentWorkerIndex_ = -1;
+
+}
+
+
+ThreadPool::ThreadPool(int size)
+{
+    impl = new ThreadPoolImpl(this, size);
+    defaultGroup.reset(new TaskGroup(this));
+}
+
+
+ThreadPoolImpl::ThreadPoolImpl(ThreadPool* self, int size)
+    : self(self),
+      numQueuedTasks(0),
+      isDestroying(false)
+{
+    for(int i=0; i < size; ++i){
+        workers.emplace_back(new Worker);
+    }
+    for(int i=0; i < size; ++i){
+        workers[i]->thread = std::thread([this, i](){ run(i); });
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    defaultGroup.reset();
+    delete impl;
+}
+
+
+ThreadPoolImpl::~ThreadPoolImpl()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        isDestroying = true;
+    }
+    sleepCondition.notify_all();
+
+    for(auto& worker : workers){
+        if(worker->thread.joinable()){
+            worker->thread.join();
+        }
+    }
+}
+
+
+ThreadPool* ThreadPool::instance()
+{
+    // The calling thread also executes tasks while it is waiting for them
+    static ThreadPool pool(std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1));
+    return &pool;
+}
+
+
+int ThreadPool::size() const
+{
+    return impl->workers.size();
+}
+
+
+void ThreadPool::start(std::function<void()> f)
+{
+    defaultGroup->run(std::move(f));
+}
+
+
+void ThreadPool::wait()
+{
+    defaultGroup->wait();
+}
+
+
+int ThreadPoolImpl::currentWorkerIndex() const
+{
+    return (currentPool == this) ? currentWorkerIndex_ : -1;
+}
+
+
+void ThreadPoolImpl::push(Task&& task)
+{
+    const int workerIndex = currentWorkerIndex();
+    if(workerIndex >= 0){
+        Worker* worker = workers[workerIndex].get();
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->tasks.push_back(std::move(task));
+    } else {
+        std::lock_guard<std::mutex> lock(injectionMutex);
+        injectedTasks.push_back(std::move(task));
+    }
+    {
+        // The counter is updated with the lock so that a worker going to sleep does not miss the task
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        numQueuedTasks.fetch_add(1, std::memory_order_release);
+    }
+    sleepCondition.notify_one();
+}
+
+
+/**
+   A worker takes its own newest task first. Otherwise the oldest task of the
+   injected tasks or the other workers is taken.
+*/
+bool ThreadPoolImpl::popTask(Task& out_task, int workerIndex)
+{
+    if(numQueuedTasks.load(std::memory_order_acquire) == 0){
+        return false;
+    }
+
+    if(workerIndex >= 0){
+        Worker* worker = workers[workerIndex].get();
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if(!worker->tasks.empty()){
+            out_task = std::move(worker->tasks.back());
+            worker->tasks.pop_back();
+            numQueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(injectionMutex);
+        if(!injectedTasks.empty()){
+            out_task = std::move(injectedTasks.front());
+            injectedTasks.pop_front();
+            numQueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    const int n = workers.size();
+    for(int i=1; i <= n; ++i){
+        const int victimIndex = (workerIndex + i + n) % n;
+        if(victimIndex == workerIndex){
+            continue;
+        }
+        Worker* victim = workers[victimIndex].get();
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if(!victim->tasks.empty()){
+            out_task = std::move(victim->tasks.front());
+            victim->tasks.pop_front();
+            numQueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void ThreadPoolImpl::execute(Task& task)
+{
+    task.function();
+
+    // The counter is updated with the lock so that the group is not destroyed before the notification
+    TaskGroup* group = task.group;
+    std::lock_guard<std::mutex> lock(group->mutex);
+    if(group->numPendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        group->finishCondition.notify_all();
+    }
+}
+
+
+void ThreadPoolImpl::run(int workerIndex)
+{
+    currentPool = this;
+    currentWorkerIndex_ = workerIndex;
+
+    while(true){
+        Task task;
+        if(popTask(task, workerIndex)){
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        while(!isDestroying && numQueuedTasks.load(std::memory_order_acquire) == 0){
+            sleepCondition.wait(lock);
+        }
+        if(isDestroying && numQueuedTasks.load(std::memory_order_acquire) == 0){
+            break;
+        }
+    }
+}
+
+
+void ThreadPoolImpl::wait(TaskGroup* group)
+{
+    const int workerIndex = currentWorkerIndex();
+
+    while(group->numPendingTasks.load(std::memory_order_acquire) > 0){
+        Task task;
+        if(popTask(task, workerIndex)){
+            execute(task);
+        } else {
+            /*
+              The remaining tasks of the group are being executed by the other threads.
+              The waiting is timed out periodically to check the tasks queued meanwhile,
+              which may not be taken by any other thread when all the workers are waiting.
+            */
+            std::unique_lock<std::mutex> lock(group->mutex);
+            if(group->numPendingTasks.load(std::memory_order_acquire) > 0){
+                group->finishCondition.wait_for(lock, std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    // Wait for the thread which has finished the last task to release the lock
+    std::lock_guard<std::mutex> lock(group->mutex);
+}
+
+
+ThreadPool::TaskGroup::TaskGroup(ThreadPool* pool)
+    : pool(pool),
+      numPendingTasks(0)
+{
+
+}
+
+
+ThreadPool::TaskGroup::~TaskGroup()
+{
+    wait();
+}
+
+
+void ThreadPool::TaskGroup::run(std::function<void()> function)
+{
+    numPendingTasks.fetch_add(1, std::memory_order_acq_rel);
+    pool->impl->push(ThreadPoolImpl::Task{ std::move(function), this });
+}
+
+
+void ThreadPool::TaskGroup::wait()
+{
+    pool->impl->wait(this);
+}
@@ -6,113 +6,178 @@
 #ifndef CNOID_UTIL_THREAD_POOL_H
 #define CNOID_UTIL_THREAD_POOL_H
 
-#include <queue>
 #include <functional>
-#include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <algorithm>
+#include "exportdecl.h"
 
 namespace cnoid {
 
-class ThreadPool
+class ThreadPoolImpl;
+
+/**
+   A thread pool with a work-stealing scheduler.
+   Each worker thread has its own task deque. A task started from a worker is pushed to
+   the deque of the worker, and an idle worker steals tasks from the other workers.
+   A thread waiting for tasks executes the pending tasks instead of only blocking,
+   so that tasks can start and wait for other tasks without deadlock.
+*/
+class CNOID_EXPORT ThreadPool
 {
-private:
-    std::vector<std::thread> threads;
-    std::queue<std::function<void()>> queue;
-    std::mutex mutex;
-    std::condition_variable condition;
-    std::condition_variable finishCondition;
-    int numActiveThreads;
-    bool isDestroying;
-        
 public:
-    ThreadPool(int size = 1) {
-        numActiveThreads = 0;
-        isDestroying = false;
-        for(int i = 0; i < size; ++i){
-            threads.emplace_back(std::bind(&ThreadPool::run, this));
+    ThreadPool(int size = 1);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+       The process-wide pool whose size is based on the number of the hardware threads.
+       The pool is created when this function is called first.
+    */
+    static ThreadPool* instance();
+
+    int size() const;
+
+    /**
+       A set of tasks which can be waited for independently of the other tasks of the pool.
+    */
+    class CNOID_EXPORT TaskGroup
+    {
+    public:
+        TaskGroup(ThreadPool* pool = ThreadPool::instance());
+        ~TaskGroup();
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        void run(std::function<void()> function);
+
+        //! Blocks until all the tasks of the group finish. The pending tasks are executed meanwhile.
+        void wait();
+
+        bool isRunning() const { return numPendingTasks.load(std::memory_order_acquire) > 0; }
+
+    private:
+        ThreadPool* pool;
+        std::atomic<int> numPendingTasks;
+        std::mutex mutex;
+        std::condition_variable finishCondition;
+
+        friend class ThreadPoolImpl;
+    };
+
+    //! Starts a task which belongs to the default task group of the pool
+    void start(std::function<void()> f);
+
+    //! Waits for the tasks started by the start function
+    void wait();
+
+    /**
+       This function is the same as wait() now.
+       It used to be a busy loop and it is kept for the compatibility.
+    */
+    void waitLoop() { wait(); }
+
+    bool isRunning() const { return defaultGroup->isRunning(); }
+
+    /**
+       Calls function(i) for i in [begin, end) in parallel. The calling thread also executes
+       the function. The range is divided into chunks of grainSize elements, or into chunks
+       corresponding to the number of the threads when grainSize is zero.
+    */
+    template<class Function>
+    void parallelFor(int begin, int end, const Function& function, int grainSize = 0) {
+        const int numElements = end - begin;
+        const int chunkSize = getChunkSize(numElements, grainSize);
+        if(chunkSize <= 0){
+            return;
         }
-    }
-    
-    ~ThreadPool() {
-        {
-            std::lock_guard<std::mutex> guard(mutex);
-            isDestroying = true;
-            condition.notify_all();
+        const int numChunks = (numElements + chunkSize - 1) / chunkSize;
+        if(numChunks == 1){
+            for(int i=begin; i < end; ++i){
+                function(i);
+            }
+            return;
         }
-        // join_all
-        for(auto& thread : threads){
-            if(thread.joinable()){
-                thread.join();
+        std::atomic<int> chunkCounter(0);
+        auto processChunks = [&](){
+            int chunk;
+            while((chunk = chunkCounter.fetch_add(1, std::memory_order_relaxed)) < numChunks){
+                const int chunkBegin = begin + chunk * chunkSize;
+                const int chunkEnd = std::min(chunkBegin + chunkSize, end);
+                for(int i=chunkBegin; i < chunkEnd; ++i){
+                    function(i);
+                }
             }
+        };
+        TaskGroup group(this);
+        const int numTasks = std::min(numChunks - 1, size());
+        for(int i=0; i < numTasks; ++i){
+            group.run(processChunks);
         }
+        processChunks();
+        group.wait();
     }
-    
-    int size() const { return threads.size(); }
-    
-    void start(std::function<void()> f) {
-        std::lock_guard<std::mutex> guard(mutex);
-        queue.push(f);
-        condition.notify_one();
-    }
-    
-    void wait(){
-        std::unique_lock<std::mutex> lock(mutex);
-        while(!queue.empty() || numActiveThreads > 0){
-            finishCondition.wait(lock);
+
+    /**
+       Computes the reduction of function(i) for i in [begin, end) in parallel.
+       The partial results of the chunks are combined by reduction in the order of the chunks,
+       so the result does not depend on the scheduling.
+       \param function A function which takes an index and returns a value of type T.
+       \param reduction A function which takes two values of type T and returns the combined value.
+    */
+    template<class T, class Function, class Reduction>
+    T parallelReduce(int begin, int end, const T& identity,
+                     const Function& function, const Reduction& reduction, int grainSize = 0) {
+        const int numElements = end - begin;
+        const int chunkSize = getChunkSize(numElements, grainSize);
+        if(chunkSize <= 0){
+            return identity;
         }
-    }
-    
-    void waitLoop(){
-        while(true){
-            {
-                std::unique_lock<std::mutex> lock(mutex, std::try_to_lock_t());
-                if(lock.owns_lock()){
-                    if(queue.empty() && numActiveThreads == 0){
-                        break;
-                    }
+        const int numChunks = (numElements + chunkSize - 1) / chunkSize;
+        std::vector<T> partialResults(numChunks, identity);
+        parallelFor(
+            0, numChunks,
+            [&](int chunk){
+                const int chunkBegin = begin + chunk * chunkSize;
+                const int chunkEnd = std::min(chunkBegin + chunkSize, end);
+                T& result = partialResults[chunk];
+                for(int i=chunkBegin; i < chunkEnd; ++i){
+                    result = reduction(result, function(i));
                 }
-            }
+            },
+            1);
+        T result = identity;
+        for(auto& partialResult : partialResults){
+            result = reduction(result, partialResult);
         }
+        return result;
     }
 
-    bool isRunning() {
-        std::lock_guard<std::mutex> guard(mutex);
-        return numActiveThreads > 0;
-    }
-    
 private:
-    void run() {
-        while(true){
-            std::function<void()> f;
-            {
-                std::unique_lock<std::mutex> lock(mutex);
-                
-                while (queue.empty() && !isDestroying){
-                    condition.wait(lock);
-                }
-                if(!queue.empty()){
-                    f = queue.front();
-                    queue.pop();
-                    ++numActiveThreads;
-                }
-            }
-            if(f){
-                f();
-                {
-                    std::lock_guard<std::mutex> lock(mutex);
-                    --numActiveThreads;
-                    if(numActiveThreads == 0){
-                        finishCondition.notify_all();
-                    }
-                }
-            } else {
-                break;
-            }
+    ThreadPoolImpl* impl;
+    std::unique_ptr<TaskGroup> defaultGroup;
+
+    int getChunkSize(int numElements, int grainSize) const {
+        if(numElements <= 0){
+            return 0;
+        }
+        if(grainSize > 0){
+            return grainSize;
         }
+        // A few chunks per thread for the load balancing
+        const int numChunks = std::min(numElements, (size() + 1) * 4);
+        return (numElements + numChunks - 1) / numChunks;
     }
+
+    friend class ThreadPoolImpl;
 };
 
 }
-    
+
 #endif
@@ -0,0 +1,70 @@
+/**
+   @file
+*/
+
+#include "TimeStatistics.h"
+#include <limits>
+#include <algorithm>
+
+using namespace std;
+using namespace cnoid;
+
+
+TimeStatistics::TimeStatistics()
+{
+    clear();
+}
+
+
+void TimeStatistics::clear()
+{
+    count_ = 0;
+    totalTime_ = 0.0;
+    minTime_ = std::numeric_limits<double>::max();
+    maxTime_ = 0.0;
+    buckets.fill(0);
+}
+
+
+void TimeStatistics::merge(const TimeStatistics& other)
+{
+    count_ += other.count_;
+    totalTime_ += other.totalTime_;
+    minTime_ = std::min(minTime_, other.minTime_);
+    maxTime_ = std::max(maxTime_, other.maxTime_);
+    for(int i=0; i < NumBuckets; ++i){
+        buckets[i] += other.buckets[i];
+    }
+}
+
+
+/**
+   The geometric center of the bucket containing the percentile is returned,
+   which is clamped into the range of the recorded times.
+*/
+double TimeStatistics::percentile(double ratio) const
+{
+    if(count_ == 0){
+        return 0.0;
+    }
+    const int64_t rank = std::min(count_ - 1, static_cast<int64_t>(ratio * (count_ - 1) + 0.5));
+    int64_t accumulated = 0;
+    int index = 0;
+    while(index < NumBuckets - 1){
+        accumulated += buckets[index];
+        if(accumulated > rank){
+            break;
+        }
+        ++index;
+    }
+    if(index == 0){
+        return minTime_;
+    }
+    const int octave = index / NumBucketsPerOctave;
+    const int subIndex = index % NumBucketsPerOctave;
+    // The lower bound of the bucket is 2^octave * (1 + subIndex / NumBucketsPerOctave) nanoseconds
+    const double lower = std::ldexp(1.0 + static_cast<double>(subIndex) / NumBucketsPerOctave, octave);
+    const double upper = std::ldexp(1.0 + static_cast<double>(subIndex + 1) / NumBucketsPerOctave, octave);
+    const double time = std::sqrt(lower * upper) * 1.0e-9;
+    return std::max(minTime_, std::min(maxTime_, time));
+}
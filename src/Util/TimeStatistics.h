@@ -0,0 +1,77 @@
+/**
+   @file
+*/
+
+#ifndef CNOID_UTIL_TIME_STATISTICS_H
+#define CNOID_UTIL_TIME_STATISTICS_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+/**
+   This class accumulates the statistics of the measured computation times.
+   The times are counted in a histogram whose buckets are spaced logarithmically with
+   eight buckets per doubling of the time, so that the percentiles can be obtained without
+   keeping the samples. The error of a percentile is within about six percent.
+   The times are given in seconds.
+*/
+class CNOID_EXPORT TimeStatistics
+{
+public:
+    TimeStatistics();
+
+    void clear();
+
+    void record(double time) {
+        ++count_;
+        totalTime_ += time;
+        if(time < minTime_){
+            minTime_ = time;
+        }
+        if(time > maxTime_){
+            maxTime_ = time;
+        }
+        ++buckets[bucketIndex(time)];
+    }
+
+    void merge(const TimeStatistics& other);
+
+    int64_t count() const { return count_; }
+    double totalTime() const { return totalTime_; }
+    double meanTime() const { return count_ > 0 ? totalTime_ / count_ : 0.0; }
+    double minTime() const { return count_ > 0 ? minTime_ : 0.0; }
+    double maxTime() const { return count_ > 0 ? maxTime_ : 0.0; }
+
+    //! \param ratio The ratio of the percentile such as 0.99 for the 99th percentile
+    double percentile(double ratio) const;
+
+private:
+    // The buckets cover the times from a nanosecond to about 18 minutes
+    static constexpr int NumBucketsPerOctave = 8;
+    static constexpr int NumOctaves = 40;
+    static constexpr int NumBuckets = NumBucketsPerOctave * NumOctaves;
+
+    static int bucketIndex(double time) {
+        int exponent;
+        double mantissa = std::frexp(time * 1.0e9, &exponent);
+        if(exponent < 1){
+            return 0;
+        }
+        int index = (exponent - 1) * NumBucketsPerOctave + static_cast<int>((mantissa - 0.5) * (2 * NumBucketsPerOctave));
+        return (index < NumBuckets) ? index : (NumBuckets - 1);
+    }
+
+    int64_t count_;
+    double totalTime_;
+    double minTime_;
+    double maxTime_;
+    std::array<uint32_t, NumBuckets> buckets;
+};
+
+}
+
+#endif
@@ -0,0 +1,203 @@
+/**
+   @file
+*/
+
+#include "TraceRecorder.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <fmt/format.h>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const Clock::time_point originTime = Clock::now();
+
+struct TraceEvent
+{
+    const char* name;
+    const char* category;
+    int64_t beginTime;
+    // Negative for an instant event
+    int64_t duration;
+};
+
+struct ThreadBuffer
+{
+    int threadIndex;
+    string threadName;
+    std::mutex mutex;
+    vector<TraceEvent> events;
+    int64_t numDiscardedEvents;
+
+    ThreadBuffer(int index) : threadIndex(index), numDiscardedEvents(0) { }
+
+    void add(const TraceEvent& event){
+        std::lock_guard<std::mutex> lock(mutex);
+        if(events.size() < TraceRecorder::maxNumEventsPerThread){
+            events.push_back(event);
+        } else {
+            ++numDiscardedEvents;
+        }
+    }
+};
+
+// The buffers are kept after the threads finish so that their events can be written
+std::mutex buffersMutex;
+vector<unique_ptr<ThreadBuffer>> buffers;
+
+thread_local ThreadBuffer* currentThreadBuffer = nullptr;
+
+ThreadBuffer* getCurrentThreadBuffer()
+{
+    if(!currentThreadBuffer){
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.emplace_back(new ThreadBuffer(buffers.size()));
+        currentThreadBuffer = buffers.back().get();
+    }
+    return currentThreadBuffer;
+}
+
+void putJsonString(ostream& os, const char* s)
+{
+    os << '"';
+    for(const char* p = s; *p; ++p){
+        const char c = *p;
+        switch(c){
+        case '"':  os << "\\\""; break;
+        case '\\': os << "\\\\"; break;
+        case '\n': os << "\\n"; break;
+        case '\t': os << "\\t"; break;
+        default:
+            if(static_cast<unsigned char>(c) < 0x20){
+                os << fmt::format("\\u{:04x}", static_cast<int>(c));
+            } else {
+                os << c;
+            }
+        }
+    }
+    os << '"';
+}
+
+}
+
+std::atomic<bool> TraceRecorder::isRecording_(false);
+
+
+void TraceRecorder::startRecording()
+{
+    isRecording_ = true;
+}
+
+
+void TraceRecorder::stopRecording()
+{
+    isRecording_ = false;
+}
+
+
+void TraceRecorder::setThreadName(const std::string& name)
+{
+    auto buffer = getCurrentThreadBuffer();
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    buffer->threadName = name;
+}
+
+
+int64_t TraceRecorder::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - originTime).count();
+}
+
+
+void TraceRecorder::addEvent(const char* name, const char* category, int64_t beginTime, int64_t endTime)
+{
+    getCurrentThreadBuffer()->add({ name, category, beginTime, endTime - beginTime });
+}
+
+
+void TraceRecorder::addInstantEvent(const char* name, const char* category)
+{
+    if(isRecording()){
+        getCurrentThreadBuffer()->add({ name, category, now(), -1 });
+    }
+}
+
+
+int64_t TraceRecorder::numDiscardedEvents()
+{
+    int64_t n = 0;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for(auto& buffer : buffers){
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        n += buffer->numDiscardedEvents;
+    }
+    return n;
+}
+
+
+bool TraceRecorder::writeTraceFile(const std::string& filename)
+{
+    ofstream ofs(filename.c_str());
+    if(!ofs){
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(buffersMutex);
+
+    ofs << "{\"traceEvents\":[\n";
+    bool isFirst = true;
+    for(auto& buffer : buffers){
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        if(buffer->events.empty()){
+            continue;
+        }
+        if(!buffer->threadName.empty()){
+            if(!isFirst){
+                ofs << ",\n";
+            }
+            isFirst = false;
+            ofs << fmt::format("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":",
+                               buffer->threadIndex);
+            putJsonString(ofs, buffer->threadName.c_str());
+            ofs << "}}";
+        }
+        for(auto& event : buffer->events){
+            if(!isFirst){
+                ofs << ",\n";
+            }
+            isFirst = false;
+            ofs << "{\"name\":";
+            putJsonString(ofs, event.name);
+            ofs << ",\"cat\":";
+            putJsonString(ofs, event.category);
+            if(event.duration >= 0){
+                ofs << fmt::format(",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                                   buffer->threadIndex, event.beginTime / 1000.0, event.duration / 1000.0);
+            } else {
+                ofs << fmt::format(",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":{},\"ts\":{:.3f}}}",
+                                   buffer->threadIndex, event.beginTime / 1000.0);
+            }
+        }
+    }
+    ofs << "\n]}\n";
+
+    return !ofs.fail();
+}
+
+
+void TraceRecorder::clear()
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for(auto& buffer : buffers){
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        buffer->events.clear();
+        buffer->numDiscardedEvents = 0;
+    }
+}
@@ -0,0 +1,82 @@
+/**
+   @file
+*/
+
+#ifndef CNOID_UTIL_TRACE_RECORDER_H
+#define CNOID_UTIL_TRACE_RECORDER_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+/**
+   Records the short operations repeated in several threads such as the simulation steps,
+   the sensor rendering and the redraws, and writes them in the trace event format so that
+   the interactions of the threads can be viewed on a timeline with chrome://tracing or Perfetto.
+   Each thread records the events in its own buffer, which keeps up to maxNumEventsPerThread events,
+   so that the threads do not wait for each other. Unlike PhaseProfiler, the names and the categories
+   of the events are not copied, so they must be string literals or other strings which live until
+   the events are written.
+*/
+class CNOID_EXPORT TraceRecorder
+{
+public:
+    static bool isRecording() { return isRecording_.load(std::memory_order_relaxed); }
+    static void startRecording();
+    static void stopRecording();
+
+    //! The name shown for the thread calling this function
+    static void setThreadName(const std::string& name);
+
+    /**
+       Records an event from the construction to the destruction.
+       Nothing is done when the recording is not active at the construction.
+    */
+    class Scope
+    {
+    public:
+        Scope(const char* name, const char* category)
+            : name(name), category(category) {
+            beginTime = isRecording() ? now() : -1;
+        }
+        ~Scope() { end(); }
+        //! Ends the event before the destruction
+        void end() {
+            if(beginTime >= 0){
+                TraceRecorder::addEvent(name, category, beginTime, now());
+                beginTime = -1;
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        const char* name;
+        const char* category;
+        int64_t beginTime;
+    };
+
+    //! The time in nanoseconds from the start of the process
+    static int64_t now();
+
+    static void addEvent(const char* name, const char* category, int64_t beginTime, int64_t endTime);
+    static void addInstantEvent(const char* name, const char* category);
+
+    static const int maxNumEventsPerThread = 1000000;
+
+    //! The number of the events discarded because the buffers were full
+    static int64_t numDiscardedEvents();
+
+    static bool writeTraceFile(const std::string& filename);
+
+    static void clear();
+
+private:
+    static std::atomic<bool> isRecording_;
+};
+
+}
+
+#endif
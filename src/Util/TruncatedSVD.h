@@ -16,6 +16,7 @@ class TruncatedSVD
     typedef typename MatrixType::Scalar Scalar;
     Eigen::JacobiSVD<MatrixType> svd;
     Eigen::DiagonalMatrix<Scalar, Eigen::Dynamic> sinv;
+    mutable Eigen::Matrix<Scalar, Eigen::Dynamic, 1> y;
     Scalar truncateRatio;
     int numTruncated;
 
@@ -43,30 +44,29 @@ public:
         svd.compute(matrix, Eigen::ComputeThinU | Eigen::ComputeThinV);
         sinv.diagonal() = svd.singularValues();
 
-        int lastNonZeroSingularValues = svd.nonzeroSingularValues() - 1;
+        const int lastNonZeroSingularValues = svd.nonzeroSingularValues() - 1;
+        for(int i = sinv.diagonal().size() - 1; i > lastNonZeroSingularValues; --i){
+            sinv.diagonal()(i) = Scalar(0.0);
+        }
+        int j = lastNonZeroSingularValues;
         if(lastNonZeroSingularValues > 0){
-            Scalar& s0 = sinv.diagonal()(0);
-            Scalar& s_last = sinv.diagonal()(lastNonZeroSingularValues);
-            if((s0 / s_last) > truncateRatio){
-                s_last = Scalar(0.0);
-                ++numTruncated;
-                int j;
-                for(j = lastNonZeroSingularValues - 1; j > 0; --j){
-                    Scalar& s = sinv.diagonal()(j);
-                    if((s0 / s) > truncateRatio){
-                        s = Scalar(0.0);
-                        ++numTruncated;
-                    } else {
-                        break;
-                    }
-                }
-                while(j >= 0){
-                    Scalar& s = sinv.diagonal()(j);
-                    s = Scalar(1.0) / s;
+            const Scalar s0 = sinv.diagonal()(0);
+            while(j > 0){
+                Scalar& s = sinv.diagonal()(j);
+                if((s0 / s) > truncateRatio){
+                    s = Scalar(0.0);
+                    ++numTruncated;
                     --j;
+                } else {
+                    break;
                 }
             }
         }
+        while(j >= 0){
+            Scalar& s = sinv.diagonal()(j);
+            s = Scalar(1.0) / s;
+            --j;
+        }
         return *this;
     }
 
@@ -78,13 +78,15 @@ public:
         return svd.singularValues();
     }
         
+    /**
+       The intermediate vector is kept as a member so that the solution does not allocate
+       the memory when the sizes of the problem are not changed.
+    */
     template <class VectorType1, class VectorType2>
     void solve(const Eigen::MatrixBase<VectorType1>& b, Eigen::MatrixBase<VectorType2>& out_x) const {
-        if(numTruncated > 0){
-            out_x = svd.matrixV() * sinv * svd.matrixU().transpose() * b;
-        } else {
-            out_x = svd.solve(b);
-        }
+        y.noalias() = svd.matrixU().transpose() * b;
+        y.array() *= sinv.diagonal().array();
+        out_x.noalias() = svd.matrixV() * y;
     }
 };
 }
@@ -14,9 +14,11 @@
 #include "SceneLoader.h"
 #include "Exception.h"
 #include "NullOut.h"
+#include "ThreadPool.h"
 #include <fmt/format.h>
 #include <boost/algorithm/string.hpp>
 #include <tuple>
+#include <set>
 
 using namespace std;
 using namespace cnoid;
@@ -65,6 +67,15 @@ public:
 
     typedef map<VRMLGeometryPtr, SgPlotPtr> VRMLGeometryToSgPlotMap;
     VRMLGeometryToSgPlotMap vrmlGeometryToSgPlotMap;
+
+    // The face sets triangulated before the conversion of the nodes which have them
+    struct TriangulatedFaceSet
+    {
+        SgPolygonMeshPtr polygonMesh;
+        SgMeshPtr mesh;
+        string errorMessage;
+    };
+    map<VRMLIndexedFaceSet*, TriangulatedFaceSet> triangulatedFaceSetMap;
         
     typedef map<VRMLMaterialPtr, SgMaterialPtr> VRMLMaterialToSgMaterialMap;
     VRMLMaterialToSgMaterialMap vrmlMaterialToSgMaterialMap;
@@ -84,6 +95,8 @@ public:
         
     VRMLToSGConverterImpl(VRMLToSGConverter* self);
     void putMessage(const std::string& message);
+    void triangulateFaceSetsInParallel(VRMLNode* vnode);
+    void collectFaceSetsToTriangulate(VRMLNode* vnode, vector<VRMLIndexedFaceSet*>& faceSets, set<VRMLNode*>& visited);
     SgNode* convertNode(VRMLNode* vnode);
     SgNode* convertGroupNode(AbstractVRMLGroup* vgroup);
     pair<SgNode*, SgGroup*> createTransformNodeSet(VRMLTransform* vt);
@@ -194,18 +207,90 @@ void VRMLToSGConverter::clearConvertedNodeMap()
     impl->vrmlTextureToSgTextureMap.clear();
     impl->vrmlTextureTransformToSgTextureTransformMap.clear();
     impl->imagePathToSgImageMap.clear();
+    impl->meshGenerator.clearSharedMeshes();
 }
 
 
 SgNodePtr VRMLToSGConverter::convert(VRMLNodePtr vrmlNode)
 {
     if(vrmlNode){
-        return impl->convertNode(vrmlNode.get());
+        if(impl->isTriangulationEnabled){
+            impl->triangulateFaceSetsInParallel(vrmlNode.get());
+        }
+        SgNodePtr node = impl->convertNode(vrmlNode.get());
+        impl->triangulatedFaceSetMap.clear();
+        return node;
     }
     return 0;
 }
 
 
+/**
+   The face sets in the node tree are triangulated and given the normals in parallel before the
+   nodes are converted. The polygon meshes are created in this thread so that their messages are
+   put in the order of the nodes.
+*/
+void VRMLToSGConverterImpl::triangulateFaceSetsInParallel(VRMLNode* vnode)
+{
+    vector<VRMLIndexedFaceSet*> faceSets;
+    set<VRMLNode*> visited;
+    collectFaceSetsToTriangulate(vnode, faceSets, visited);
+    if(faceSets.size() < 2){
+        return;
+    }
+
+    vector<TriangulatedFaceSet*> targets;
+    targets.reserve(faceSets.size());
+    for(auto& faceSet : faceSets){
+        auto& triangulated = triangulatedFaceSetMap[faceSet];
+        triangulated.polygonMesh = createPolygonMeshFromIndexedFaceSet(faceSet);
+        targets.push_back(&triangulated);
+    }
+
+    ThreadPool::instance()->parallelFor(
+        0, targets.size(),
+        [&](int index){
+            auto& triangulated = *targets[index];
+            if(triangulated.polygonMesh){
+                PolygonMeshTriangulator triangulator(polygonMeshTriangulator);
+                triangulated.mesh = triangulator.triangulate(triangulated.polygonMesh);
+                triangulated.errorMessage = triangulator.errorMessage();
+                if(triangulated.mesh && isNormalGenerationEnabled){
+                    MeshFilter filter(meshFilter);
+                    filter.generateNormals(triangulated.mesh, faceSets[index]->creaseAngle);
+                }
+                triangulated.polygonMesh.reset();
+            }
+        },
+        1);
+}
+
+
+void VRMLToSGConverterImpl::collectFaceSetsToTriangulate
+(VRMLNode* vnode, vector<VRMLIndexedFaceSet*>& faceSets, set<VRMLNode*>& visited)
+{
+    if(!vnode || !visited.insert(vnode).second ||
+       vrmlNodeToSgNodeMap.find(vnode) != vrmlNodeToSgNodeMap.end()){
+        return;
+    }
+    if(auto protoInstance = dynamic_cast<VRMLProtoInstance*>(vnode)){
+        collectFaceSetsToTriangulate(protoInstance->actualNode.get(), faceSets, visited);
+
+    } else if(auto group = dynamic_cast<AbstractVRMLGroup*>(vnode)){
+        const int n = group->countChildren();
+        for(int i=0; i < n; ++i){
+            collectFaceSetsToTriangulate(group->getChild(i), faceSets, visited);
+        }
+    } else if(auto shape = dynamic_cast<VRMLShape*>(vnode)){
+        auto faceSet = dynamic_cast<VRMLIndexedFaceSet*>(shape->geometry.get());
+        if(faceSet && visited.insert(faceSet).second &&
+           vrmlGeometryToSgMeshMap.find(faceSet) == vrmlGeometryToSgMeshMap.end()){
+            faceSets.push_back(faceSet);
+        }
+    }
+}
+
+
 void VRMLToSGConverterImpl::putMessage(const std::string& message)
 {
     os() << message << endl;
@@ -331,26 +416,38 @@ SgNode* VRMLToSGConverterImpl::convertShapeNode(VRMLShape* vshape)
             if(vshape->appearance && vshape->appearance->texture){
                 generateTexCoord = true;
             }
+            // The mesh of a primitive is shared unless the mesh is given the name of the node
+            meshGenerator.setMeshSharingEnabled(vrmlGeometry->defName.empty());
+            
             if(VRMLIndexedFaceSet* faceSet = dynamic_cast<VRMLIndexedFaceSet*>(vrmlGeometry)){
+                bool areNormalsGenerated = false;
                 if(!isTriangulationEnabled){
                     mesh = createMeshFromIndexedFaceSet(faceSet);
                 } else {
-                    SgPolygonMeshPtr polygonMesh = createPolygonMeshFromIndexedFaceSet(faceSet);
-                    if(polygonMesh){
-                        mesh = polygonMeshTriangulator.triangulate(polygonMesh);
-                        const string& errorMessage = polygonMeshTriangulator.errorMessage();
-                        if(!errorMessage.empty()){
-                            string message;
-                            if(faceSet->defName.empty()){
-                                message = "Error of an IndexedFaceSet node: \n";
-                            } else {
-                                message = format("Error of IndexedFaceSet node \"{}\": \n", faceSet->defName);
-                            }
-                            putMessage(message + errorMessage);
+                    string errorMessage;
+                    auto q = triangulatedFaceSetMap.find(faceSet);
+                    if(q != triangulatedFaceSetMap.end()){
+                        mesh = q->second.mesh;
+                        errorMessage = q->second.errorMessage;
+                        areNormalsGenerated = true;
+                    } else {
+                        SgPolygonMeshPtr polygonMesh = createPolygonMeshFromIndexedFaceSet(faceSet);
+                        if(polygonMesh){
+                            mesh = polygonMeshTriangulator.triangulate(polygonMesh);
+                            errorMessage = polygonMeshTriangulator.errorMessage();
                         }
                     }
+                    if(!errorMessage.empty()){
+                        string message;
+                        if(faceSet->defName.empty()){
+                            message = "Error of an IndexedFaceSet node: \n";
+                        } else {
+                            message = format("Error of IndexedFaceSet node \"{}\": \n", faceSet->defName);
+                        }
+                        putMessage(message + errorMessage);
+                    }
                 }
-                if(mesh && isNormalGenerationEnabled){
+                if(mesh && isNormalGenerationEnabled && !areNormalsGenerated){
                     meshFilter.generateNormals(mesh, faceSet->creaseAngle);
                 }
                     
@@ -1204,7 +1301,6 @@ SgTexture* VRMLToSGConverterImpl::createTexture(VRMLTexture* vt)
     VRMLImageTexturePtr imageTextureNode = dynamic_node_cast<VRMLImageTexture>(vt);
     if(imageTextureNode){
         SgImagePtr image;
-        SgImagePtr imageForLoading;
         const MFString& urls = imageTextureNode->url;
         for(size_t i=0; i < urls.size(); ++i){
             const string& url = urls[i];
@@ -1215,11 +1311,7 @@ SgTexture* VRMLToSGConverterImpl::createTexture(VRMLTexture* vt)
                     break;
                 } else {
                     try {
-                        if(!imageForLoading){
-                            imageForLoading = new SgImage;
-                        }
-                        imageIO.load(imageForLoading->image(), url);
-                        image = imageForLoading;
+                        image = new SgImage(imageIO.loadSharedImage(url));
                         imagePathToSgImageMap[url] = image;
                         break;
                     } catch(const exception_base& ex){
@@ -639,6 +639,21 @@ inline void Mapping::insertSub(const std::string& key, ValueNode* node)
 }
 
 
+//! The key is moved into the container to avoid copying the string
+void Mapping::insertSub(std::string&& key, ValueNode* node)
+{
+    if(key.empty()){
+        EmptyKeyException ex;
+        throw ex;
+    }
+    auto inserted = values.emplace(std::move(key), node);
+    if(!inserted.second){
+        inserted.first->second = node;
+    }
+    node->indexInMapping_ = indexCounter++;
+}
+
+
 void Mapping::insert(const std::string& key, ValueNode* node)
 {
     if(!isValid()){
@@ -647,8 +662,7 @@ void Mapping::insert(const std::string& key, ValueNode* node)
     if(!node){
         throwException(_("A node to insert into a Mapping is a null node"));
     }
-    const string uKey(key);
-    insertSub(uKey, node);
+    insertSub(key, node);
 }
 
 
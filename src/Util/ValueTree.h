@@ -6,6 +6,7 @@
 #define CNOID_UTIL_VALUE_TREE_H
 
 #include "Referenced.h"
+#include "FlatMap.h"
 #include <map>
 #include <vector>
 #include <string>
@@ -226,7 +227,7 @@ private:
 
 class CNOID_EXPORT Mapping : public ValueNode
 {
-    typedef std::map<std::string, ValueNodePtr> Container;
+    typedef FlatMap<std::string, ValueNodePtr> Container;
         
 public:
 
@@ -399,6 +400,7 @@ private:
     Listing* openFlowStyleListing_(const std::string& key, bool doOverwrite);
 
     inline void insertSub(const std::string& key, ValueNode* node);
+    void insertSub(std::string&& key, ValueNode* node);
 
     void writeSub(const std::string &key, const char* text, size_t length, StringStyle stringStyle);
 
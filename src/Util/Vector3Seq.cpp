@@ -16,6 +16,12 @@ using namespace std;
 using namespace cnoid;
 using fmt::format;
 
+namespace {
+
+const size_t maxPlainFormatBufferSize = 1024 * 1024;
+
+}
+
 
 Vector3Seq::Vector3Seq(int nFrames)
     : BaseSeqType("Vector3Seq", nFrames)
@@ -75,12 +81,7 @@ bool Vector3Seq::doWriteSeq(YAMLWriter& writer, std::function<void()> additional
             writer.startListing();
             const int n = numFrames();
             for(int i=0; i < n; ++i){
-                writer.startFlowStyleListing();
-                const Vector3& v = (*this)[i];
-                for(int j=0; j < 3; ++j){
-                    writer.putScalar(v[j]);
-                }
-                writer.endListing();
+                writer.putFlowStyleListing((*this)[i].data(), 3);
             }
             writer.endListing();
         });
@@ -103,10 +104,10 @@ bool Vector3Seq::loadPlainFormat(const std::string& filename, std::ostream& os)
     setNumFrames(loader.numFrames());
     setFrameRate(1.0 / loader.timeStep());
 
-    int frame = 0;
-    for(PlainSeqFileLoader::iterator it = loader.begin(); it != loader.end(); ++it){
-        vector<double>& data = *it;
-        (*this)[frame++] << data[1], data[2], data[3];
+    const int n = loader.numFrames();
+    for(int i=0; i < n; ++i){
+        const double* data = loader.frame(i);
+        (*this)[i] << data[1], data[2], data[3];
     }
 
     return true;
@@ -117,22 +118,26 @@ bool Vector3Seq::saveAsPlainFormat(const std::string& filename, std::ostream& os
 {
     clearSeqMessage();
     ofstream file(filename.c_str());
-    file.setf(ios::fixed);
 
     if(!file){
         os << format(_("\"{}\" cannot be opened."), filename) << endl;
         return false;
     }
 
-    const string f("{0:.4f} {1:.6f} {2:.6f} {3:.6f}\n");
-
     const int n = numFrames();
     const double r = frameRate();
 
+    // The lines are formatted into the buffer, which is written to the file in large blocks
+    fmt::memory_buffer buf;
     for(int i=0; i < n; ++i){
         const Vector3& v = (*this)[i];
-        file << format(f, (i / r), v.x(), v.y(), v.z());
+        fmt::format_to(buf, "{0:.4f} {1:.6f} {2:.6f} {3:.6f}\n", (i / r), v.x(), v.y(), v.z());
+        if(buf.size() >= maxPlainFormatBufferSize){
+            file.write(buf.data(), buf.size());
+            buf.clear();
+        }
     }
+    file.write(buf.data(), buf.size());
     
     return true;
 }
@@ -9,6 +9,7 @@
 #include <yaml.h>
 #include <fmt/format.h>
 #include <unordered_map>
+#include <cstddef>
 #include "gettext.h"
 
 using namespace std;
@@ -17,6 +18,13 @@ using fmt::format;
 
 namespace {
 const bool debugTrace = false;
+
+const size_t arenaBlockSize = 64 * 1024;
+
+// Each node in the arena is preceded by the holder of its reference
+const size_t arenaHolderSize =
+    (sizeof(ValueNodePtr) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
 }
 
 namespace cnoid {
@@ -44,7 +52,11 @@ public:
     void onScalar(yaml_event_t& event);
     void onAlias(yaml_event_t& event);
 
-    static ScalarNode* createScalar(const yaml_event_t& event);
+    ScalarNode* createScalar(const yaml_event_t& event);
+
+    template<class NodeType, class... Args> NodeType* createNode(Args... args);
+    char* allocateArenaSlot(size_t size);
+    void clearArena();
 
     YAMLReader* self;
     
@@ -52,6 +64,13 @@ public:
     FILE* file;
 
     YAMLReader::MappingFactoryBase* mappingFactory;
+    bool isDefaultMappingFactory;
+
+    bool isArenaAllocationEnabled;
+    vector<char*> arenaBlocks;
+    char* arenaTop;
+    size_t arenaSpace;
+    vector<ValueNode*> arenaNodes;
 
     vector<ValueNodePtr> documents;
     int currentDocumentIndex;
@@ -88,6 +107,10 @@ YAMLReaderImpl::YAMLReaderImpl(YAMLReader* self)
 {
     file = 0;
     mappingFactory = new YAMLReader::MappingFactory<Mapping>();
+    isDefaultMappingFactory = true;
+    isArenaAllocationEnabled = false;
+    arenaTop = nullptr;
+    arenaSpace = 0;
     currentDocumentIndex = 0;
     isRegularMultiListingExpected = false;
 }
@@ -109,6 +132,75 @@ YAMLReaderImpl::~YAMLReaderImpl()
     }
 
     delete mappingFactory;
+
+    clearDocuments();
+    importedAnchorMap.clear();
+    clearArena();
+}
+
+
+/**
+   The nodes in the arena are kept alive by the holders until this function is called.
+   The references among the nodes are released before any node is destructed so that
+   the nodes allocated in the heap and referenced by the arena nodes are correctly released.
+*/
+void YAMLReaderImpl::clearArena()
+{
+    for(auto& node : arenaNodes){
+        if(node->isMapping()){
+            static_cast<Mapping*>(node)->clear();
+        } else if(node->isListing()){
+            static_cast<Listing*>(node)->clear();
+        }
+    }
+    for(auto& node : arenaNodes){
+        node->~ValueNode();
+    }
+    arenaNodes.clear();
+    
+    for(auto& block : arenaBlocks){
+        delete[] block;
+    }
+    arenaBlocks.clear();
+    arenaTop = nullptr;
+    arenaSpace = 0;
+}
+
+
+char* YAMLReaderImpl::allocateArenaSlot(size_t size)
+{
+    const size_t alignment = alignof(std::max_align_t);
+    size = arenaHolderSize + (size + alignment - 1) / alignment * alignment;
+
+    if(size > arenaSpace){
+        if(size > arenaBlockSize / 4){
+            // A large node has its own block so that the space of the current block is not wasted
+            char* block = new char[size];
+            arenaBlocks.push_back(block);
+            return block;
+        }
+        arenaTop = new char[arenaBlockSize];
+        arenaBlocks.push_back(arenaTop);
+        arenaSpace = arenaBlockSize;
+    }
+    char* slot = arenaTop;
+    arenaTop += size;
+    arenaSpace -= size;
+    return slot;
+}
+
+
+template<class NodeType, class... Args>
+NodeType* YAMLReaderImpl::createNode(Args... args)
+{
+    if(!isArenaAllocationEnabled){
+        return new NodeType(args...);
+    }
+    char* slot = allocateArenaSlot(sizeof(NodeType));
+    NodeType* node = new(slot + arenaHolderSize) NodeType(args...);
+    new(slot) ValueNodePtr(node);
+    arenaNodes.push_back(node);
+    return node;
 }
 
 
@@ -122,6 +214,7 @@ void YAMLReaderImpl::setMappingFactory(YAMLReader::MappingFactoryBase* factory)
 {
     delete mappingFactory;
     mappingFactory = factory;
+    isDefaultMappingFactory = false;
 }
 
 
@@ -131,6 +224,12 @@ void YAMLReader::expectRegularMultiListing()
 }
 
 
+void YAMLReader::setArenaAllocationEnabled(bool on)
+{
+    impl->isArenaAllocationEnabled = on;
+}
+
+
 void YAMLReader::clearDocuments()
 {
     impl->clearDocuments();
@@ -343,7 +442,7 @@ void YAMLReaderImpl::addNode(ValueNode* node, yaml_event_t& event)
             }
         }
         
-        mapping->insert(info.key, node);
+        mapping->insertSub(std::move(info.key), node);
         info.key.clear();
     }
 }
@@ -386,7 +485,12 @@ void YAMLReaderImpl::onMappingStart(yaml_event_t& event)
 
     NodeInfo info;
     const yaml_mark_t& mark = event.start_mark;
-    Mapping* mapping = mappingFactory->create(mark.line, mark.column);
+    Mapping* mapping;
+    if(isArenaAllocationEnabled && isDefaultMappingFactory){
+        mapping = createNode<Mapping>(mark.line, mark.column);
+    } else {
+        mapping = mappingFactory->create(mark.line, mark.column);
+    }
     mapping->setFlowStyle(event.data.mapping_start.style == YAML_FLOW_MAPPING_STYLE);
     info.node = mapping;
 
@@ -420,14 +524,14 @@ void YAMLReaderImpl::onListingStart(yaml_event_t& event)
     const yaml_mark_t& mark = event.start_mark;
 
     if(!isRegularMultiListingExpected){
-        listing = new Listing(mark.line, mark.column);
+        listing = createNode<Listing>(mark.line, mark.column);
     } else {
         size_t level = nodeStack.size();
         if(expectedListingSizes.size() <= level){
             expectedListingSizes.resize(level + 1, 0);
         }
         const int prevSize = expectedListingSizes[level];
-        listing = new Listing(mark.line, mark.column, prevSize);
+        listing = createNode<Listing>(mark.line, mark.column, prevSize);
     }
 
     listing->setFlowStyle(event.data.sequence_start.style == YAML_FLOW_SEQUENCE_STYLE);
@@ -505,7 +609,7 @@ void YAMLReaderImpl::onScalar(yaml_event_t& event)
 
 ScalarNode* YAMLReaderImpl::createScalar(const yaml_event_t& event)
 {
-    ScalarNode* scalar = new ScalarNode((char*)event.data.scalar.value, event.data.scalar.length);
+    ScalarNode* scalar = createNode<ScalarNode>((const char*)event.data.scalar.value, event.data.scalar.length);
 
     const yaml_mark_t& start_mark = event.start_mark;
     scalar->line_ = start_mark.line;
@@ -35,6 +35,16 @@ public:
     }
         
     void expectRegularMultiListing();
+
+    /**
+       The nodes of the documents are constructed in the memory blocks owned by the reader
+       instead of being allocated one by one, which makes the loading of large documents faster.
+       The nodes are only released when the reader is destructed, so the nodes loaded in this mode
+       must not be used after the reader is destructed, and the memory used by the documents is
+       not released by clearDocuments(). This mode is not applied to the mappings created by
+       the mapping class specified with setMappingClass(). The default value is false.
+    */
+    void setArenaAllocationEnabled(bool on);
 #ifdef CNOID_BACKWARD_COMPATIBILITY
     void expectRegularMultiSequence() { expectRegularMultiListing(); }
     bool load_string(const std::string& yamlstring) { return parse(yamlstring); }
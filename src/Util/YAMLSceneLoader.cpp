@@ -75,6 +75,12 @@ void YAMLSceneLoader::setDefaultDivisionNumber(int n)
 }
 
 
+void YAMLSceneLoader::setAppearanceLoadingEnabled(bool on)
+{
+    impl->sceneReader.setAppearanceLoadingEnabled(on);
+}
+
+
 int YAMLSceneLoader::defaultDivisionNumber() const
 {
     return impl->sceneReader.defaultDivisionNumber();
@@ -19,6 +19,7 @@ public:
     virtual ~YAMLSceneLoader();
     virtual void setMessageSink(std::ostream& os) override;
     virtual void setDefaultDivisionNumber(int n) override;
+    virtual void setAppearanceLoadingEnabled(bool on) override;
     virtual SgNode* load(const std::string& filename) override;
 
     int defaultDivisionNumber() const;
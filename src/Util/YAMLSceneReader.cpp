@@ -17,9 +17,13 @@
 #include <cnoid/Exception>
 #include <cnoid/ImageIO>
 #include <cnoid/Config>
+#include <cnoid/ThreadPool>
 #include <unordered_map>
 #include <fmt/format.h>
 #include <mutex>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
 
 #ifdef CNOID_USE_BOOST_REGEX
 #include <boost/regex.hpp>
@@ -62,6 +66,21 @@ struct ResourceInfo : public Referenced
 };
 typedef ref_ptr<ResourceInfo> ResourceInfoPtr;
 
+struct ResourceLoadingTask
+{
+    SgNodePtr scene;
+    ostringstream messages;
+    // This must be the last member so that the task finishes before the other members are destructed
+    ThreadPool::TaskGroup group;
+};
+
+struct ImageLoadingTask
+{
+    std::shared_ptr<Image> image;
+    string errorMessage;
+    ThreadPool::TaskGroup group;
+};
+
 
 unordered_map<string, YAMLSceneReader::UriSchemeHandler> uriSchemeHandlerMap;
 std::mutex uriSchemeHandlerMutex;
@@ -96,12 +115,18 @@ public:
     ImageIO imageIO;
 
     map<string, ResourceInfoPtr> resourceInfoMap;
+    map<string, ResourceInfoPtr> fileResourceInfoMap;
+    map<string, unique_ptr<ResourceLoadingTask>> resourceLoadingTasks;
+    map<string, unique_ptr<ImageLoadingTask>> imageLoadingTasks;
     SceneLoader sceneLoader;
+    int sceneLoaderDivisionNumber;
+    bool isAppearanceLoadingEnabled;
     filesystem::path baseDirectory;
     regex uriSchemeRegex;
     bool isUriSchemeRegexReady;
     typedef map<string, SgImagePtr> ImagePathToSgImageMap;
     ImagePathToSgImageMap imagePathToSgImageMap;
+    vector<string> imageFiles;
     bool generateTexCoord;
 
     YAMLSceneReaderImpl(YAMLSceneReader* self);
@@ -129,6 +154,8 @@ public:
     SgMesh* readCapsule(Mapping& info);
     SgMesh* readExtrusion(Mapping& info);
     SgMesh* readElevationGrid(Mapping& info);
+    void readHeightField(Mapping& info, SgMesh::HeightField& out_field);
+    SgNode* readTiledHeightField(Mapping& info, SgShape* appearance);
     SgMesh* readIndexedFaceSet(Mapping& info);
     SgMesh* readResourceAsGeometry(Mapping& info);
     void readAppearance(SgShape* shape, Mapping& info);
@@ -148,6 +175,13 @@ public:
         Mapping& resourceNode, ResourceInfo* info, vector<string>& names, const string& uri, YAMLSceneReader::Resource& resource);
     void decoupleResourceNode(Mapping& resourceNode, const string& uri, const string& nodeName);
     ResourceInfo* getOrCreateResourceInfo(Mapping& resourceNode, const string& uri);
+    filesystem::path getResourceFilePath(Mapping& resourceNode, const string& uri);
+    void prefetchResources(ValueNode& node);
+    void startResourceLoading(Mapping& resourceNode, const string& uri);
+    SgNodePtr loadScene(const string& filename);
+    string getImageFilename(const string& url);
+    void startImageLoading(const string& url);
+    std::shared_ptr<Image> loadImage(const string& filename);
     filesystem::path findFileInPackage(const string& file);
     void adjustNodeCoordinate(SceneNodeInfo& info);
     void makeSceneNodeMap(ResourceInfo* info);
@@ -200,8 +234,12 @@ YAMLSceneReaderImpl::YAMLSceneReaderImpl(YAMLSceneReader* self)
     }
     os_ = &nullout();
     defaultDivisionNumber = meshGenerator.defaultDivisionNumber();
+    sceneLoaderDivisionNumber = -1;
+    isAppearanceLoadingEnabled = true;
     isUriSchemeRegexReady = false;
     imageIO.setUpsideDown(true);
+    // The meshes of the primitive geometries are not modified by this reader
+    meshGenerator.setMeshSharingEnabled(true);
 }
 
 
@@ -228,6 +266,14 @@ void YAMLSceneReader::setDefaultDivisionNumber(int n)
 {
     impl->defaultDivisionNumber = n;
     impl->sceneLoader.setDefaultDivisionNumber(n);
+    impl->sceneLoaderDivisionNumber = n;
+}
+
+
+void YAMLSceneReader::setAppearanceLoadingEnabled(bool on)
+{
+    impl->isAppearanceLoadingEnabled = on;
+    impl->sceneLoader.setAppearanceLoadingEnabled(on);
 }
 
 
@@ -260,7 +306,12 @@ void YAMLSceneReader::clear()
     isDegreeMode_ = true;
     impl->defaultMaterial = 0;
     impl->resourceInfoMap.clear();
+    impl->fileResourceInfoMap.clear();
+    impl->resourceLoadingTasks.clear();
+    impl->imageLoadingTasks.clear();
     impl->imagePathToSgImageMap.clear();
+    impl->imageFiles.clear();
+    impl->meshGenerator.clearSharedMeshes();
 }
 
 
@@ -601,11 +652,13 @@ SgNode* YAMLSceneReaderImpl::readShape(Mapping& info)
     if(geometry.isValid()){
         SgShapePtr shape = new SgShape;
 
-        Mapping& appearance = *info.findMapping("appearance");
-        if(appearance.isValid()){
-            readAppearance(shape, appearance);
-        } else {
-            setDefaultMaterial(shape);
+        if(isAppearanceLoadingEnabled){
+            Mapping& appearance = *info.findMapping("appearance");
+            if(appearance.isValid()){
+                readAppearance(shape, appearance);
+            } else {
+                setDefaultMaterial(shape);
+            }
         }
 
         if(shape->texture()){
@@ -613,12 +666,20 @@ SgNode* YAMLSceneReaderImpl::readShape(Mapping& info)
         }else{
             generateTexCoord = false;
         }
-        shape->setMesh(readGeometry(geometry));
 
-        scene = readTransformParameters(info, shape);
+        SgNodePtr node;
+        string type;
+        if(geometry.read("type", type) && type == "HeightField"){
+            node = readTiledHeightField(geometry, shape);
+        } else {
+            shape->setMesh(readGeometry(geometry));
+            node = shape;
+        }
+
+        scene = readTransformParameters(info, node);
 
-        if(scene == shape){
-            return shape.retn();
+        if(scene == node){
+            return node.retn();
         }
     }
 
@@ -645,6 +706,10 @@ SgMesh* YAMLSceneReaderImpl::readGeometry(Mapping& info)
         mesh = readExtrusion(info);
     } else if(type == "ElevationGrid"){
         mesh = readElevationGrid(info);
+    } else if(type == "HeightField"){
+        SgMesh::HeightField field;
+        readHeightField(info, field);
+        mesh = meshGenerator.generateHeightField(field, generateTexCoord);
     } else if(type == "IndexedFaceSet"){
         mesh = readIndexedFaceSet(info);
     } else if(type == "Resource"){
@@ -805,7 +870,7 @@ SgMesh* YAMLSceneReaderImpl::readElevationGrid(Mapping& info)
 
     SgTexCoordArray* texCoord = 0;
     Listing& texCoordNode = *info.findListing("texCoord");
-    if(texCoordNode.isValid()){
+    if(texCoordNode.isValid() && isAppearanceLoadingEnabled){
         const int size = texCoordNode.size() / 2;
         texCoord = new SgTexCoordArray();
         texCoord->resize(size);
@@ -830,6 +895,99 @@ SgMesh* YAMLSceneReaderImpl::readElevationGrid(Mapping& info)
 }
 
 
+/**
+   The heights are given by the "height" listing with the dimensions, or the file of a gray scale
+   image or a text file whose lines are the rows of the heights. The pixel values of an image are
+   mapped to the range from zero to one. The heights are multiplied by heightScale and heightOffset
+   is added to them.
+*/
+void YAMLSceneReaderImpl::readHeightField(Mapping& info, SgMesh::HeightField& out_field)
+{
+    info.read("xSpacing", out_field.xSpacing);
+    info.read("zSpacing", out_field.zSpacing);
+    const double scale = info.get("heightScale", 1.0);
+    const double offset = info.get("heightOffset", 0.0);
+
+    auto heights = std::make_shared<vector<float>>();
+    int xDimension = 0;
+    int zDimension = 0;
+
+    string file;
+    if(!info.read("file", file)){
+        info.read("xDimension", xDimension);
+        info.read("zDimension", zDimension);
+        Listing& heightNode = *info.findListing("height");
+        if(heightNode.isValid()){
+            heights->reserve(heightNode.size());
+            for(int i=0; i < heightNode.size(); ++i){
+                heights->push_back(heightNode[i].toDouble() * scale + offset);
+            }
+        }
+    } else {
+        string filename = getImageFilename(file);
+        string ext = filesystem::path(filename).extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if(ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp"){
+            std::shared_ptr<Image> image;
+            try {
+                image = loadImage(filename);
+            } catch(const exception_base& ex){
+                info.throwException(*boost::get_error_info<error_info_message>(ex));
+            }
+            xDimension = image->width();
+            zDimension = image->height();
+            const int n = image->numComponents();
+            const unsigned char* pixels = image->pixels();
+            heights->resize(xDimension * zDimension);
+            for(size_t i=0; i < heights->size(); ++i){
+                (*heights)[i] = (pixels[i * n] / 255.0) * scale + offset;
+            }
+        } else {
+            ifstream ifs(filename.c_str());
+            if(!ifs){
+                info.throwException(format(_("Height field file \"{}\" cannot be opened"), file));
+            }
+            string line;
+            while(std::getline(ifs, line)){
+                std::replace(line.begin(), line.end(), ',', ' ');
+                istringstream is(line);
+                int numValues = 0;
+                double h;
+                while(is >> h){
+                    heights->push_back(h * scale + offset);
+                    ++numValues;
+                }
+                if(numValues > 0){
+                    if(zDimension == 0){
+                        xDimension = numValues;
+                    } else if(numValues != xDimension){
+                        info.throwException(
+                            format(_("The row {0} of \"{1}\" does not have {2} heights"), zDimension + 1, file, xDimension));
+                    }
+                    ++zDimension;
+                }
+            }
+        }
+    }
+
+    if(xDimension < 2 || zDimension < 2 || static_cast<int>(heights->size()) != xDimension * zDimension){
+        info.throwException(_("The heights of the height field do not match its dimensions"));
+    }
+    out_field.xDimension = xDimension;
+    out_field.zDimension = zDimension;
+    out_field.heights = heights;
+}
+
+
+SgNode* YAMLSceneReaderImpl::readTiledHeightField(Mapping& info, SgShape* appearance)
+{
+    SgMesh::HeightField field;
+    readHeightField(info, field);
+    return meshGenerator.generateTiledHeightField(
+        field, appearance, info.get("tileSize", 64), info.get("levelsOfDetail", 4), generateTexCoord);
+}
+
+
 SgMesh* YAMLSceneReaderImpl::readIndexedFaceSet(Mapping& info)
 {
     SgPolygonMeshPtr polygonMesh = new SgPolygonMesh;
@@ -858,7 +1016,7 @@ SgMesh* YAMLSceneReaderImpl::readIndexedFaceSet(Mapping& info)
     }
 
     Listing& texCoordNode = *info.findListing("texCoord");
-    if(texCoordNode.isValid()){
+    if(texCoordNode.isValid() && isAppearanceLoadingEnabled){
         const int size = texCoordNode.size() / 2;
         SgTexCoordArray& texCoord = *polygonMesh->setTexCoords(new SgTexCoordArray());
         texCoord.resize(size);
@@ -871,7 +1029,7 @@ SgMesh* YAMLSceneReaderImpl::readIndexedFaceSet(Mapping& info)
     }
 
     Listing& texCoordIndexNode = *info.findListing("texCoordIndex");
-    if(texCoordIndexNode.isValid()){
+    if(texCoordIndexNode.isValid() && isAppearanceLoadingEnabled){
         SgIndexArray& texCoordIndices = polygonMesh->texCoordIndices();
         const int size = texCoordIndexNode.size();
         texCoordIndices.reserve(size);
@@ -995,14 +1153,10 @@ void YAMLSceneReaderImpl::readTexture(SgShape* shape, Mapping& info)
                 image = p->second;
             }else{
                 try{
-                    image = new SgImage;
-                    filesystem::path filepath(url);
-                    if(!checkAbsolute(filepath)){
-                        filepath = baseDirectory / filepath;
-                        filepath.normalize();
-                    }
-                    imageIO.load(image->image(), getAbsolutePathString(filepath));
+                    string filename = getImageFilename(url);
+                    image = new SgImage(loadImage(filename));
                     imagePathToSgImageMap[url] = image;
+                    imageFiles.push_back(filename);
                 }catch(const exception_base& ex){
                     info.throwException(*boost::get_error_info<error_info_message>(ex));
                 }
@@ -1236,6 +1390,173 @@ void YAMLSceneReaderImpl::decoupleResourceNode(Mapping& resourceNode, const stri
 }
 
 
+void YAMLSceneReader::prefetchResources(ValueNode& node)
+{
+    impl->prefetchResources(node);
+}
+
+
+void YAMLSceneReader::getResourceFiles(std::vector<std::string>& out_files) const
+{
+    for(auto& kv : impl->fileResourceInfoMap){
+        out_files.push_back(kv.first);
+    }
+    out_files.insert(out_files.end(), impl->imageFiles.begin(), impl->imageFiles.end());
+}
+
+
+void YAMLSceneReaderImpl::prefetchResources(ValueNode& node)
+{
+    if(node.isMapping()){
+        Mapping& mapping = *node.toMapping();
+        ValueNode& typeNode = *mapping.find("type");
+        if(typeNode.isString() && typeNode.toString() == "Resource"){
+            ValueNode& uriNode = *mapping.find("uri");
+            if(uriNode.isString()){
+                startResourceLoading(mapping, uriNode.toString());
+            }
+        }
+        if(isAppearanceLoadingEnabled){
+            ValueNode& textureNode = *mapping.find("texture");
+            if(textureNode.isMapping()){
+                ValueNode& urlNode = *textureNode.toMapping()->find("url");
+                if(urlNode.isString() && !urlNode.toString().empty()){
+                    startImageLoading(urlNode.toString());
+                }
+            }
+        }
+        for(auto& kv : mapping){
+            prefetchResources(*kv.second);
+        }
+    } else if(node.isListing()){
+        for(auto& element : *node.toListing()){
+            if(!element->isScalar()){
+                prefetchResources(*element);
+            }
+        }
+    }
+}
+
+
+void YAMLSceneReaderImpl::startResourceLoading(Mapping& resourceNode, const string& uri)
+{
+    if(resourceInfoMap.find(uri) != resourceInfoMap.end()){
+        return;
+    }
+
+    filesystem::path filepath;
+    try {
+        filepath = getResourceFilePath(resourceNode, uri);
+    }
+    catch(const ValueNode::Exception&){
+        // The error is reported when the resource node is actually read
+        return;
+    }
+
+    string ext = filesystem::extension(filepath);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if(ext == ".yaml" || ext == ".yml"){
+        return;
+    }
+
+    string filename = filesystem::absolute(filepath).string();
+    if(fileResourceInfoMap.find(filename) != fileResourceInfoMap.end() ||
+       resourceLoadingTasks.find(filename) != resourceLoadingTasks.end()){
+        return;
+    }
+
+    auto task = new ResourceLoadingTask;
+    resourceLoadingTasks[filename].reset(task);
+
+    const int divisionNumber = sceneLoaderDivisionNumber;
+    const bool isAppearanceLoadingEnabled = this->isAppearanceLoadingEnabled;
+    task->group.run(
+        [task, filename, divisionNumber, isAppearanceLoadingEnabled](){
+            // The loader of each task is independent so that the loaders do not share any state
+            SceneLoader loader;
+            loader.setMessageSink(task->messages);
+            if(divisionNumber > 0){
+                loader.setDefaultDivisionNumber(divisionNumber);
+            }
+            loader.setAppearanceLoadingEnabled(isAppearanceLoadingEnabled);
+            task->scene = loader.load(filename);
+        });
+}
+
+
+SgNodePtr YAMLSceneReaderImpl::loadScene(const string& filename)
+{
+    SgNodePtr scene;
+    auto iter = resourceLoadingTasks.find(filename);
+    if(iter == resourceLoadingTasks.end()){
+        scene = sceneLoader.load(filename);
+    } else {
+        auto& task = iter->second;
+        task->group.wait();
+        os() << task->messages.str();
+        scene = task->scene;
+        resourceLoadingTasks.erase(iter);
+    }
+    return scene;
+}
+
+
+string YAMLSceneReaderImpl::getImageFilename(const string& url)
+{
+    filesystem::path filepath(url);
+    if(!checkAbsolute(filepath)){
+        filepath = baseDirectory / filepath;
+        filepath.normalize();
+    }
+    return getAbsolutePathString(filepath);
+}
+
+
+void YAMLSceneReaderImpl::startImageLoading(const string& url)
+{
+    if(imagePathToSgImageMap.find(url) != imagePathToSgImageMap.end()){
+        return;
+    }
+    string filename = getImageFilename(url);
+    if(imageLoadingTasks.find(filename) != imageLoadingTasks.end()){
+        return;
+    }
+
+    auto task = new ImageLoadingTask;
+    imageLoadingTasks[filename].reset(task);
+
+    ImageIO taskImageIO = imageIO;
+    task->group.run(
+        [task, filename, taskImageIO]() mutable {
+            try {
+                task->image = taskImageIO.loadSharedImage(filename);
+            } catch(const exception_base& ex){
+                task->errorMessage = *boost::get_error_info<error_info_message>(ex);
+            }
+        });
+}
+
+
+std::shared_ptr<Image> YAMLSceneReaderImpl::loadImage(const string& filename)
+{
+    auto iter = imageLoadingTasks.find(filename);
+    if(iter == imageLoadingTasks.end()){
+        return imageIO.loadSharedImage(filename);
+    }
+    auto& task = iter->second;
+    task->group.wait();
+    auto image = task->image;
+    string errorMessage = task->errorMessage;
+    imageLoadingTasks.erase(iter);
+    if(!image){
+        exception_base exception;
+        exception << error_info_message(errorMessage);
+        throw exception;
+    }
+    return image;
+}
+
+
 ResourceInfo* YAMLSceneReaderImpl::getOrCreateResourceInfo(Mapping& resourceNode, const string& uri)
 {
     auto iter = resourceInfoMap.find(uri);
@@ -1244,6 +1565,52 @@ ResourceInfo* YAMLSceneReaderImpl::getOrCreateResourceInfo(Mapping& resourceNode
         return iter->second;
     }
 
+    filesystem::path filepath = getResourceFilePath(resourceNode, uri);
+
+    string filename = filesystem::absolute(filepath).string();
+
+    auto fileIter = fileResourceInfoMap.find(filename);
+    if(fileIter != fileResourceInfoMap.end()){
+        ResourceInfo* info = fileIter->second;
+        resourceInfoMap[uri] = info;
+        return info;
+    }
+
+    ResourceInfoPtr info = new ResourceInfo;
+
+    string ext = filesystem::extension(filepath);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    if(ext == ".yaml" || ext == ".yml"){
+        auto reader = new YAMLReader;
+        reader->importAnchors(*mainYamlReader);
+        if(!reader->load(filename)){
+            resourceNode.throwException(
+                format(_("YAML resource \"{0}\" cannot be loaded ({1})"),
+                 uri, reader->errorMessage()));
+        }
+        info->yamlReader.reset(reader);
+
+    } else {
+        SgNodePtr scene = loadScene(filename);
+        if(!scene){
+            resourceNode.throwException(
+                format(_("The resource is not found at URI \"{}\""), uri));
+        }
+        info->scene = scene;
+    }
+
+    info->directory = filepath.parent_path().string();
+    
+    resourceInfoMap[uri] = info;
+    fileResourceInfoMap[filename] = info;
+
+    return info;
+}
+
+
+filesystem::path YAMLSceneReaderImpl::getResourceFilePath(Mapping& resourceNode, const string& uri)
+{
     filesystem::path filepath;
         
     if(!isUriSchemeRegexReady){
@@ -1286,36 +1653,7 @@ ResourceInfo* YAMLSceneReaderImpl::getOrCreateResourceInfo(Mapping& resourceNode
             format(_("The resource URI \"{}\" is not valid"), uri));
     }
 
-    ResourceInfoPtr info = new ResourceInfo;
-
-    string filename = filesystem::absolute(filepath).string();
-    string ext = filesystem::extension(filepath);
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-
-    if(ext == ".yaml" || ext == ".yml"){
-        auto reader = new YAMLReader;
-        reader->importAnchors(*mainYamlReader);
-        if(!reader->load(filename)){
-            resourceNode.throwException(
-                format(_("YAML resource \"{0}\" cannot be loaded ({1})"),
-                 uri, reader->errorMessage()));
-        }
-        info->yamlReader.reset(reader);
-
-    } else {
-        SgNodePtr scene = sceneLoader.load(filename);
-        if(!scene){
-            resourceNode.throwException(
-                format(_("The resource is not found at URI \"{}\""), uri));
-        }
-        info->scene = scene;
-    }
-
-    info->directory = filepath.parent_path().string();
-    
-    resourceInfoMap[uri] = info;
-
-    return info;
+    return filepath;
 }
 
 
@@ -25,6 +25,13 @@ public:
     void setMessageSink(std::ostream& os);
     void setDefaultDivisionNumber(int n);
     int defaultDivisionNumber() const;
+
+    /**
+       The appearances of the shapes and the texture coordinates of the geometries are not
+       read when this is disabled. The setting is also applied to the loaders of the resource
+       files. The default value is true.
+    */
+    void setAppearanceLoadingEnabled(bool on);
     void setBaseDirectory(const std::string& directory);
     std::string baseDirectory();
     void setYAMLReader(YAMLReader* reader);
@@ -62,6 +69,19 @@ public:
         std::string directory;
     };
     Resource readResourceNode(Mapping& info);
+
+    /**
+       The mesh files referenced by the resource nodes in the given node tree are loaded
+       in parallel by the thread pool in advance. The loaded scenes are used when the
+       resource nodes are read, and each file is only loaded once even if it is referenced
+       by different URIs. The YAML resources are not loaded in advance. The texture images
+       are also decoded in parallel unless the appearance loading is disabled.
+       The base directory must be set before calling this function.
+    */
+    void prefetchResources(ValueNode& node);
+
+    //! Gets the resource and texture files read since the reader was cleared
+    void getResourceFiles(std::vector<std::string>& out_files) const;
     
     SgObject* readObject(Mapping& info);
 
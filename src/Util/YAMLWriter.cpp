@@ -9,10 +9,174 @@
 #include <algorithm>
 #include <stack>
 #include <fstream>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
 
 using namespace std;
 using namespace cnoid;
 
+namespace {
+
+const double pow10Table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+const int64_t int64Pow10Table[] = {
+    1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL, 100000000LL,
+    1000000000LL, 10000000000LL, 100000000000LL, 1000000000000LL, 10000000000000LL,
+    100000000000000LL, 1000000000000000LL };
+
+const int maxFastFormatPrecision = 15;
+
+/**
+   @return The precision of the "%.<precision>g" format, or -1 if the format is not the form.
+*/
+int getPrecisionOfGeneralFormat(const char* format)
+{
+    if(format[0] != '%'){
+        return -1;
+    }
+    const char* p = format + 1;
+    if(*p == 'g' && *(p + 1) == '\0'){
+        return 6;
+    }
+    if(*p++ != '.'){
+        return -1;
+    }
+    int precision = 0;
+    int numDigits = 0;
+    while(*p >= '0' && *p <= '9'){
+        precision = precision * 10 + (*p++ - '0');
+        ++numDigits;
+    }
+    if(numDigits == 0 || numDigits > 2 || *p != 'g' || *(p + 1) != '\0'){
+        return -1;
+    }
+    if(precision == 0){
+        precision = 1;
+    }
+    return (precision <= maxFastFormatPrecision) ? precision : -1;
+}
+
+
+/**
+   Writes the value in the same way as the "%.<precision>g" format of printf, where the
+   digits are given by a single multiplication or division with an exact power of ten and
+   the integer rounding instead of the arbitrary precision arithmetic of printf.
+   @return The number of the written characters, or zero if the value cannot be processed.
+*/
+int formatDoubleInGeneralFormat(double value, int precision, char* buf)
+{
+    if(!std::isfinite(value)){
+        return 0;
+    }
+    char* p = buf;
+    if(std::signbit(value)){
+        *p++ = '-';
+        value = -value;
+    }
+    if(value == 0.0){
+        *p++ = '0';
+        return p - buf;
+    }
+
+    // The estimated decimal exponent may be less than the actual one by one
+    int binaryExponent;
+    std::frexp(value, &binaryExponent);
+    int exponent = static_cast<int>(std::floor((binaryExponent - 1) * 0.30102999566398120));
+    int64_t mantissa = 0;
+    for(int i=0; i < 2; ++i){
+        const int k = precision - 1 - exponent;
+        double scaled;
+        if(k >= 0 && k <= 22){
+            scaled = value * pow10Table[k];
+        } else if(k < 0 && k >= -22){
+            scaled = value / pow10Table[-k];
+        } else {
+            return 0;
+        }
+        /*
+          The scaled value may have the rounding error of a unit in the last place, which
+          may change the rounded digits when the value is close to the middle of them.
+          Such a value is formatted by printf.
+        */
+        if(std::fabs(scaled - std::floor(scaled) - 0.5) <= scaled * 4.5e-16){
+            return 0;
+        }
+        mantissa = static_cast<int64_t>(std::nearbyint(scaled));
+        if(mantissa >= int64Pow10Table[precision]){
+            ++exponent;
+        } else if(mantissa < int64Pow10Table[precision - 1]){
+            --exponent;
+        } else {
+            break;
+        }
+        if(i == 1){
+            return 0;
+        }
+    }
+
+    char digits[maxFastFormatPrecision];
+    for(int i = precision - 1; i >= 0; --i){
+        digits[i] = '0' + static_cast<char>(mantissa % 10);
+        mantissa /= 10;
+    }
+    int numDigits = precision;
+    while(numDigits > 1 && digits[numDigits - 1] == '0'){
+        --numDigits;
+    }
+
+    if(exponent < -4 || exponent >= precision){
+        *p++ = digits[0];
+        if(numDigits > 1){
+            *p++ = '.';
+            for(int i=1; i < numDigits; ++i){
+                *p++ = digits[i];
+            }
+        }
+        *p++ = 'e';
+        if(exponent < 0){
+            *p++ = '-';
+            exponent = -exponent;
+        } else {
+            *p++ = '+';
+        }
+        if(exponent >= 100){
+            *p++ = '0' + exponent / 100;
+            exponent %= 100;
+        }
+        *p++ = '0' + exponent / 10;
+        *p++ = '0' + exponent % 10;
+
+    } else if(exponent >= 0){
+        for(int i=0; i <= exponent; ++i){
+            *p++ = (i < numDigits) ? digits[i] : '0';
+        }
+        if(numDigits > exponent + 1){
+            *p++ = '.';
+            for(int i = exponent + 1; i < numDigits; ++i){
+                *p++ = digits[i];
+            }
+        }
+    } else {
+        *p++ = '0';
+        *p++ = '.';
+        for(int i = -1; i > exponent; --i){
+            *p++ = '0';
+        }
+        for(int i=0; i < numDigits; ++i){
+            *p++ = digits[i];
+        }
+    }
+
+    return p - buf;
+}
+
+}
+
 namespace cnoid {
 
 enum { TOP, MAPPING, LISTING };
@@ -29,6 +193,7 @@ class YAMLWriterImpl
 {
 public:
     std::ofstream ofs;
+    std::vector<char> ofsBuffer;
     std::ostream& os;
     std::ostream* messageSink_;
 
@@ -39,6 +204,9 @@ public:
     bool doInsertLineFeed;
 
     const char* doubleFormat;
+    // The precision of doubleFormat when the values can be written by the fast formatter, or -1
+    int doublePrecision;
+    std::string valueBuffer;
 
     std::stack<State> states;
 
@@ -60,6 +228,8 @@ public:
     void endValuePut();
     void putString(const std::string& value);
     void putString(const char* value);
+    int formatDouble(double value, char* buf);
+    void putFlowStyleListing(const double* values, int size);
     template<class StringType> void putSingleQuotedString(const StringType& value);
     template<class StringType> void putDoubleQuotedString(const StringType& value);
     void putBlockStyleString(const std::string& value, bool isLiteral);
@@ -86,6 +256,9 @@ YAMLWriter::YAMLWriter(const std::string filename)
 YAMLWriterImpl::YAMLWriterImpl(const std::string filename)
     : YAMLWriterImpl(ofs)
 {
+    // A large buffer reduces the system calls in writing a long sequence
+    ofsBuffer.resize(256 * 1024);
+    ofs.rdbuf()->pubsetbuf(&ofsBuffer[0], ofsBuffer.size());
     ofs.open(filename.c_str());
 }
 
@@ -107,6 +280,7 @@ YAMLWriterImpl::YAMLWriterImpl(std::ostream& os)
     messageSink_ = &nullout();
 
     doubleFormat = "%.7g";
+    doublePrecision = 7;
 
     pushState(TOP, false);
 
@@ -442,18 +616,74 @@ void YAMLWriter::putScalar(int value)
 void YAMLWriter::putScalar(double value)
 {
     char buf[32];
+    impl->formatDouble(value, buf);
+    impl->putString(buf);
+}
+
+
+/**
+   @return The number of the written characters except for the terminating null character
+*/
+int YAMLWriterImpl::formatDouble(double value, char* buf)
+{
+    int length = 0;
+    if(doublePrecision > 0){
+        length = formatDoubleInGeneralFormat(value, doublePrecision, buf);
+    }
+    if(length > 0){
+        buf[length] = '\0';
+    } else {
 #ifdef _WIN32
-    _snprintf(buf, 32, impl->doubleFormat, value);
+        length = _snprintf(buf, 32, doubleFormat, value);
 #else
-    snprintf(buf, 32, impl->doubleFormat, value);
+        length = snprintf(buf, 32, doubleFormat, value);
 #endif
-    impl->putString(buf);
+        if(length < 0 || length > 31){
+            buf[31] = '\0';
+            length = strlen(buf);
+        }
+    }
+    return length;
 }
 
 
 void YAMLWriter::setDoubleFormat(const char* format)
 {
     impl->doubleFormat = format;
+    impl->doublePrecision = getPrecisionOfGeneralFormat(format);
+}
+
+
+void YAMLWriter::putFlowStyleListing(const double* values, int size)
+{
+    impl->putFlowStyleListing(values, size);
+}
+
+
+/**
+   The values are formatted into a buffer and it is written to the stream at once.
+*/
+void YAMLWriterImpl::putFlowStyleListing(const double* values, int size)
+{
+    const size_t depth = states.size();
+    startListingSub(true);
+    if(states.size() == depth){
+        return;
+    }
+    if(size > 0){
+        valueBuffer.resize(size * 34);
+        char* p = &valueBuffer[0];
+        for(int i=0; i < size; ++i){
+            if(i > 0){
+                *p++ = ',';
+                *p++ = ' ';
+            }
+            p += formatDouble(values[i], p);
+        }
+        os.write(valueBuffer.data(), p - valueBuffer.data());
+        current->hasValuesBeenPut = true;
+    }
+    endListing();
 }
 
 
@@ -54,6 +54,12 @@ public:
     void putScalar(const std::string& value){ putString(value); }
     void setDoubleFormat(const char* format);
 
+    /**
+       Puts the values as a flow-style listing. This is much faster than putting each value
+       with putScalar and should be used to write the frames of a large sequence.
+    */
+    void putFlowStyleListing(const double* values, int size);
+
     void startMapping();
     void startFlowStyleMapping();
     void putKey(const char* key, StringStyle style = PLAIN_STRING);
@@ -72,7 +72,7 @@ void exportPySeqTypes(py::module& m)
         .def("getPartLabel", &AbstractMultiSeq::partLabel)
         ;
 
-    typedef Deque2D<double, std::allocator<double>> Deque2DDouble;
+    typedef MultiValueSeq::Container Deque2DDouble;
     
     py::class_<Deque2DDouble::Row>(m, "Deque2DDouble_Row")
         .def_property_readonly("size", &Deque2DDouble::Row::size)